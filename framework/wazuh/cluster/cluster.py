@@ -129,6 +129,33 @@ def get_status_json():
 # Files
 #
 
+# Checksums of the files already hashed, by full path, with the stat values they were computed for
+_md5_cache = {}
+
+
+def cached_md5(full_path, file_stat):
+    """
+    Gets the MD5 of a file, hashing it only if it has changed since the last time
+
+    :param full_path: Absolute path of the file
+    :param file_stat: Result of stat() on the file
+    :return: MD5 of the file
+    """
+    key = (file_stat.st_mtime_ns, file_stat.st_size, file_stat.st_ino)
+    cached = _md5_cache.get(full_path)
+
+    if cached is not None and cached[0] == key:
+        return cached[1]
+
+    checksum = md5(full_path)
+
+    # A file modified in the last second may change again without a new mtime
+    if file_stat.st_mtime < time() - 1:
+        _md5_cache[full_path] = (key, checksum)
+
+    return checksum
+
+
 def walk_dir(dirname, recursive, files, excluded_files, excluded_extensions, get_cluster_item_key, get_md5=True, whoami='master'):
     walk_files = {}
 
@@ -146,7 +173,8 @@ def walk_dir(dirname, recursive, files, excluded_files, excluded_extensions, get
             if entry in files or files == ["all"]:
 
                 if not path.isdir(common.ossec_path + full_path):
-                    file_mod_time = datetime.utcfromtimestamp(stat(common.ossec_path + full_path).st_mtime)
+                    file_stat = stat(common.ossec_path + full_path)
+                    file_mod_time = datetime.utcfromtimestamp(file_stat.st_mtime)
 
                     if whoami == 'worker' and file_mod_time < (datetime.utcnow() - timedelta(minutes=30)):
                         continue
@@ -160,7 +188,7 @@ def walk_dir(dirname, recursive, files, excluded_files, excluded_extensions, get
                         entry_metadata['merged'] = False
 
                     if get_md5:
-                        entry_metadata['md5'] = md5(common.ossec_path + full_path)
+                        entry_metadata['md5'] = cached_md5(common.ossec_path + full_path, file_stat)
 
                     walk_files[full_path] = entry_metadata
 
@@ -200,6 +228,11 @@ def get_files_status(node_type, node_name, get_md5=True):
             except Exception as e:
                 logger.warning("Error getting file status: {}.".format(e))
 
+    # Forget the checksums of files that are gone
+    if get_md5:
+        for full_path in _md5_cache.keys() - {common.ossec_path + file_path for file_path in final_items}:
+            del _md5_cache[full_path]
+
     return final_items
 
 
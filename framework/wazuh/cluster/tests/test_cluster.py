@@ -2,6 +2,7 @@
 # Created by Wazuh, Inc. <info@wazuh.com>.
 # This program is free software; you can redistribute it and/or modify it under the terms of GPLv2
 
+import os
 import time
 from datetime import datetime
 from unittest.mock import patch, mock_open
@@ -141,3 +142,29 @@ def test_unmerge_agent_info(stat_mock, agent_info, exception):
     with patch('builtins.open', mock_open(read_data=agent_info)) as m:
         agent_infos = list(cluster.unmerge_agent_info('agent-info', '/random/path', 'agent-info.merged'))
         assert len(agent_infos) == (1 if exception is None else 0)
+
+
+def test_cached_md5(tmpdir):
+    """
+    Tests that a file is only hashed again when it changes
+    """
+    file_path = str(tmpdir.join('file'))
+    with open(file_path, 'w') as f:
+        f.write('content')
+    os.utime(file_path, (time.time() - 60, time.time() - 60))
+
+    with patch('wazuh.cluster.cluster.md5', return_value='checksum') as md5_mock:
+        assert cluster.cached_md5(file_path, os.stat(file_path)) == 'checksum'
+        assert cluster.cached_md5(file_path, os.stat(file_path)) == 'checksum'
+        assert md5_mock.call_count == 1
+
+        with open(file_path, 'a') as f:
+            f.write('more content')
+        cluster.cached_md5(file_path, os.stat(file_path))
+        assert md5_mock.call_count == 2
+
+        # Recently modified files are not kept
+        cluster.cached_md5(file_path, os.stat(file_path))
+        assert md5_mock.call_count == 3
+
+    cluster._md5_cache.clear()
@@ -4,6 +4,7 @@
 
 from unittest.mock import patch
 import pytest
+import struct
 
 from wazuh import exception
 from wazuh.wdb import WazuhDBConnection
@@ -149,4 +150,124 @@ def test_failed_execute(send_mock, connect_mock, error_query, error_type, expect
         with patch("wazuh.wdb.WazuhDBConnection._send", return_value=[{'total': 5}]):
             with patch("wazuh.wdb.range", side_effect=error_type):
                 with pytest.raises(exception.WazuhException, match=f'.* {expected_exception} .*'):
-                    mywdb.execute(error_query, delete=delete, update=update)
\ No newline at end of file
+                    mywdb.execute(error_query, delete=delete, update=update)
+
+
+@patch("socket.socket.connect")
+@patch("socket.socket.send")
+def test_send_stream(send_mock, connect_mock):
+    """
+    Tests the rows of every chunk of a streamed response are collected
+    """
+    chunks = [b'due [{"a": 1}, {"a": "(null)"}]', b'ok [{"a": 3}]']
+    stream = bytearray(b''.join(struct.pack('<I', len(chunk)) + chunk for chunk in chunks))
+
+    def recv_mock(size_to_receive):
+        data = bytes(stream[:size_to_receive])
+        del stream[:size_to_receive]
+        return data
+
+    with patch('socket.socket.recv', side_effect=recv_mock):
+        mywdb = WazuhDBConnection(stream=True)
+        assert mywdb._send_stream('agent 000 stream select a from test') == [{'a': 1}, {}, {'a': 3}]
+
+
+@patch("socket.socket.connect")
+@patch("socket.socket.send")
+def test_failed_send_stream(send_mock, connect_mock):
+    """
+    Tests an exception is properly raised when a streamed response fails
+    """
+    chunks = [b'due [{"a": 1}]', b'err Cannot execute SQL query']
+    stream = bytearray(b''.join(struct.pack('<I', len(chunk)) + chunk for chunk in chunks))
+
+    def recv_mock(size_to_receive):
+        data = bytes(stream[:size_to_receive])
+        del stream[:size_to_receive]
+        return data
+
+    with patch('socket.socket.recv', side_effect=recv_mock):
+        mywdb = WazuhDBConnection(stream=True)
+        with pytest.raises(exception.WazuhException, match=".* 2003 .*"):
+            mywdb._send_stream('agent 000 stream select a from test')
+
+
+@patch("socket.socket.connect")
+def test_execute_stream(connect_mock):
+    """
+    Tests select queries are streamed instead of paginated, keeping their limit and offset
+    """
+    mywdb = WazuhDBConnection(stream=True)
+    with patch("wazuh.wdb.WazuhDBConnection._send", return_value=[{'total': 5}]):
+        with patch("wazuh.wdb.WazuhDBConnection._send_stream", return_value=[{'test': 1}]) as stream_mock:
+            assert mywdb.execute("agent 000 sql select test from test offset 1 limit 2", count=True) == \
+                ([{'test': 1}], 5)
+            stream_mock.assert_called_with("agent 000 stream select test from test limit 2 offset 1")
+
+            assert mywdb.execute("agent 000 sql select test from test") == [{'test': 1}]
+            stream_mock.assert_called_with("agent 000 stream select test from test")
+
+
+def binary_payload(columns, rows):
+    """
+    Encodes rows in the binary result format, with the given column names
+    """
+    payload = struct.pack('<II', len(columns), len(rows))
+    for column in columns:
+        payload += struct.pack('<H', len(column)) + column.encode()
+        for row in rows:
+            value = row.get(column)
+            if value is None:
+                payload += bytes([WazuhDBConnection.BINARY_NULL])
+            elif isinstance(value, int):
+                payload += bytes([WazuhDBConnection.BINARY_INTEGER]) + struct.pack('<q', value)
+            elif isinstance(value, float):
+                payload += bytes([WazuhDBConnection.BINARY_FLOAT]) + struct.pack('<d', value)
+            elif isinstance(value, bytes):
+                payload += bytes([WazuhDBConnection.BINARY_BLOB]) + struct.pack('<I', len(value)) + value
+            else:
+                payload += bytes([WazuhDBConnection.BINARY_TEXT]) + struct.pack('<I', len(value.encode())) + \
+                           value.encode()
+    return payload
+
+
+def test_decode_binary():
+    """
+    Tests a binary result is decoded into the same rows as the JSON result
+    """
+    rows = [{'id': 1, 'name': 'ñ', 'score': 0.5}, {'id': -2, 'name': '(null)', 'data': b'\x00\x01'}]
+    payload = binary_payload(['id', 'name', 'score', 'data'], rows)
+
+    assert WazuhDBConnection._decode_binary(payload) == \
+        [{'id': 1, 'name': 'ñ', 'score': 0.5}, {'id': -2, 'data': b'\x00\x01'}]
+    assert WazuhDBConnection._decode_binary(binary_payload([], [])) == []
+
+    with pytest.raises(exception.WazuhException, match=".* 2007 .*"):
+        WazuhDBConnection._decode_binary(payload[:-1])
+
+
+@patch("socket.socket.connect")
+@patch("socket.socket.send")
+def test_send_binary(send_mock, connect_mock):
+    """
+    Tests the binary format is requested on connection, and used only for sql queries
+    """
+    payload = b'ok ' + binary_payload(['a'], [{'a': 1}])
+    responses = [b'ok', payload, b'ok [{"a": 2}]', b'err Cannot execute SQL query']
+    stream = bytearray(b''.join(struct.pack('<I', len(response)) + response for response in responses))
+
+    def recv_mock(size_to_receive):
+        data = bytes(stream[:size_to_receive])
+        del stream[:size_to_receive]
+        return data
+
+    with patch('socket.socket.recv', side_effect=recv_mock):
+        mywdb = WazuhDBConnection(binary=True)
+        assert mywdb.binary
+        send_mock.assert_called_with(struct.pack('<I', 21) + b'wazuhdb format binary')
+
+        assert mywdb._send('agent 000 sql select a from test') == [{'a': 1}]
+        assert mywdb._send('wazuhdb remove 001') == [{'a': 2}]
+
+        with pytest.raises(exception.WazuhException, match=".* 2003 .*"):
+            mywdb._send('mitre sql select a from test')
@@ -780,7 +780,7 @@ class WazuhDBBackend(AbstractDatabaseBackend):
         super().__init__()
 
     def connect_to_db(self):
-        return WazuhDBConnection()
+        return WazuhDBConnection(stream=True)
 
     def _substitute_params(self, query, request):
         """
@@ -18,19 +18,94 @@ class WazuhDBConnection:
     Represents a connection to the wdb socket
     """
 
-    def __init__(self, request_slice=20, max_size=6144):
+    # Value types of the binary result format
+    BINARY_NULL, BINARY_INTEGER, BINARY_FLOAT, BINARY_TEXT, BINARY_BLOB = range(5)
+
+    def __init__(self, request_slice=20, max_size=6144, stream=False, binary=False):
         """
         Constructor
+
+        :param stream: Read the rows of agent queries in a single streamed response, instead of paginating them
+        :param binary: Receive the results of sql queries in the binary format, instead of JSON
         """
         self.socket_path = common.wdb_socket_path
         self.request_slice = request_slice
         self.max_size = max_size
+        self.stream = stream
+        self.binary = False
         self.__conn = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
         try:
             self.__conn.connect(self.socket_path)
         except OSError as e:
             raise WazuhException(2005, e)
 
+        if binary:
+            self._set_binary()
+
+    def _set_binary(self):
+        """
+        Switches the results of sql queries on this connection to the binary format
+        """
+        msg = "wazuhdb format binary"
+        self.__conn.send(struct.pack('<I', len(msg)) + msg.encode())
+        data_size = struct.unpack('<I', self._recv_exact(4))[0]
+        data = self._recv_exact(data_size).decode(encoding='utf-8', errors='ignore').split(" ", 1)
+
+        if data[0] != "ok":
+            raise WazuhException(2003, data[1] if len(data) > 1 else data[0])
+
+        self.binary = True
+
+    @staticmethod
+    def _decode_binary(payload):
+        """
+        Decodes a binary result into a list of rows, like the JSON result
+
+        The payload has the number of columns and rows, and then, for each column, its name and the value of every
+        row. Null values and "(null)" strings are left out of the rows.
+        """
+        try:
+            columns, rows = struct.unpack_from('<II', payload, 0)
+            offset = 8
+            result = [{} for _ in range(rows)]
+
+            for _ in range(columns):
+                name_length = struct.unpack_from('<H', payload, offset)[0]
+                name = payload[offset + 2:offset + 2 + name_length].decode(encoding='utf-8', errors='ignore')
+                offset += 2 + name_length
+
+                for row in result:
+                    value_type = payload[offset]
+                    offset += 1
+
+                    if value_type == WazuhDBConnection.BINARY_NULL:
+                        continue
+                    elif value_type == WazuhDBConnection.BINARY_INTEGER:
+                        value = struct.unpack_from('<q', payload, offset)[0]
+                        offset += 8
+                    elif value_type == WazuhDBConnection.BINARY_FLOAT:
+                        value = struct.unpack_from('<d', payload, offset)[0]
+                        offset += 8
+                    elif value_type in (WazuhDBConnection.BINARY_TEXT, WazuhDBConnection.BINARY_BLOB):
+                        length = struct.unpack_from('<I', payload, offset)[0]
+                        value = payload[offset + 4:offset + 4 + length]
+                        if len(value) < length:
+                            raise ValueError("Truncated value")
+                        if value_type == WazuhDBConnection.BINARY_TEXT:
+                            value = value.decode(encoding='utf-8', errors='ignore')
+                            if value == "(null)":
+                                value = None
+                        offset += 4 + length
+                    else:
+                        raise ValueError("Unknown value type {}".format(value_type))
+
+                    if value is not None:
+                        row[name] = value
+        except (struct.error, IndexError, ValueError) as e:
+            raise WazuhException(2007, "Malformed binary response: {}".format(e))
+
+        return result
+
     def __query_input_validation(self, query):
         """
         Checks input queries have the correct format
@@ -67,9 +142,20 @@ class WazuhDBConnection:
         """
         Sends a message to the wdb socket
         """
+        binary = self.binary and re.match(r"(agent \d+|mitre) sql ", msg) is not None
         msg = struct.pack('<I', len(msg)) + msg.encode()
         self.__conn.send(msg)
 
+        if binary:
+            data_size = struct.unpack('<I', self._recv_exact(4))[0]
+            data = self._recv_exact(data_size)
+
+            if data.startswith(b"ok "):
+                return self._decode_binary(data[3:])
+
+            data = data.decode(encoding='utf-8', errors='ignore').split(" ", 1)
+            raise WazuhException(2003, data[1] if len(data) > 1 else data[0])
+
         # Get the data size (4 bytes)
         data = self.__conn.recv(4)
         data_size = struct.unpack('<I', data[0:4])[0]
@@ -81,6 +167,42 @@ class WazuhDBConnection:
         else:
             return json.loads(data[1], object_hook=lambda dct: {k: v for k, v in dct.items() if v != "(null)"})
 
+    def _recv_exact(self, size):
+        """
+        Receives exactly size bytes from the wdb socket
+        """
+        data = bytearray()
+
+        while len(data) < size:
+            chunk = self.__conn.recv(size - len(data))
+            if not chunk:
+                raise WazuhException(2007, "Connection with wazuh-db closed")
+            data.extend(chunk)
+
+        return bytes(data)
+
+    def _send_stream(self, msg):
+        """
+        Sends a stream query to the wdb socket and collects the rows of every chunk of the response
+
+        Each chunk comes with status "due", except the last one, that comes with "ok".
+        """
+        msg = struct.pack('<I', len(msg)) + msg.encode()
+        self.__conn.send(msg)
+        rows = []
+
+        while True:
+            data_size = struct.unpack('<I', self._recv_exact(4))[0]
+            status, payload = self._recv_exact(data_size).decode(encoding='utf-8', errors='ignore').split(" ", 1)
+
+            if status == "err":
+                raise WazuhException(2003, payload)
+
+            rows.extend(json.loads(payload, object_hook=lambda dct: {k: v for k, v in dct.items() if v != "(null)"}))
+
+            if status != "due":
+                return rows
+
     def __query_lower(self, query):
         """
         Convert a query to lower except the words between ""
@@ -167,6 +289,22 @@ class WazuhDBConnection:
             regex = re.compile(r"\w+(?: \d*|)? sql select ([A-Z a-z0-9,*_` \.\-%\(\):\']+) from")
             select = regex.match(query_lower).group(1)
             countq = query_lower.replace(select, "count(*)", 1)
+
+            if self.stream and query_lower.startswith('agent '):
+                # wazuh-db keeps the statement open and sends every row, so there is no need to paginate
+                total = 0
+                if count:
+                    try:
+                        total = list(self._send(countq)[0].values())[0]
+                    except IndexError:
+                        pass
+
+                request = query_lower.replace(" sql ", " stream ", 1)
+                if lim or offset:
+                    request += " limit {} offset {}".format(lim if lim else -1, offset)
+
+                response = self._send_stream(request)
+                return (response, total) if count else response
             try:
                 total = list(self._send(countq)[0].values())[0]
             except IndexError:
@@ -171,20 +171,15 @@ int OS_RemoveAgent(const char *u_id) {
     }
 
     // Remove DB from wazuh-db
-    int sock = -1;
     int error;
     snprintf(wdbquery, OS_SIZE_128, "agent %s remove", u_id);
     os_calloc(OS_SIZE_6144, sizeof(char), wdboutput);
-    if (error = wdbc_query_ex(&sock, wdbquery, wdboutput, OS_SIZE_6144), !error) {
+    if (error = wdbc_pool_query(wdbc_pool_default(), wdbquery, wdboutput, OS_SIZE_6144), !error) {
         mdebug1("DB from agent %s was deleted '%s'", u_id, wdboutput);
     } else {
         merror("Could not remove the DB of the agent %s. Error: %d.", u_id, error);
     }
 
-    if (sock >= 0) {
-        close(sock);
-    }
-
     os_free(wdboutput);
 
     /* Remove counter for ID */
@@ -780,20 +775,19 @@ char* OS_CreateBackupDir(const char *id, const char *name, const char *ip, time_
 
 void OS_AddAgentTimestamp(const char *id, const char *name, const char *ip, time_t now)
 {
-    File file;
+    FILE *fp;
     char timestamp[40];
     struct tm tm_result = { .tm_sec = 0 };
 
-    if (TempFile(&file, TIMESTAMP_FILE, 1) < 0) {
+    /* Append the line instead of copying the whole file */
+    if (fp = fopen(TIMESTAMP_FILE, "a"), !fp) {
         merror("Couldn't open timestamp file.");
         return;
     }
 
     strftime(timestamp, 40, "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm_result));
-    fprintf(file.fp, "%s %s %s %s\n", id, name, ip, timestamp);
-    fclose(file.fp);
-    OS_MoveFile(file.name, TIMESTAMP_FILE);
-    free(file.name);
+    fprintf(fp, "%s %s %s %s\n", id, name, ip, timestamp);
+    fclose(fp);
 }
 
 void OS_RemoveAgentTimestamp(const char *id)
@@ -20,12 +20,22 @@ static int  send_log_msg(const char *script, const char *host, const char *msg);
 static int  gen_diff_alert(const char *host, const char *script, time_t alert_diff_time);
 static int  check_diff_file(const char *host, const char *script);
 static FILE *open_diff_file(const char *host, const char *script);
-static int  run_periodic_cmd(agentlessd_entries *entry, int test_it);
+static int  test_periodic_cmd(agentlessd_entries *entry);
+static void run_periodic_host(agentlessd_entries *entry, int server);
+static void *lessd_worker(void *arg);
+
+/* Host of an entry to be checked by a worker */
+typedef struct lessd_job_t {
+    agentlessd_entries *entry;
+    int server;
+} lessd_job_t;
 
 /* Global variables */
 agentlessd_config lessdc;
 
 static const char *STR_MORE_CHANGES = "More changes...";
+static w_queue_t *lessd_jobs;
+static pthread_mutex_t lessd_mutex = PTHREAD_MUTEX_INITIALIZER;    /* Queue socket and entry counters */
 
 
 /* Save agentless entry for the control tools to gather */
@@ -56,6 +66,7 @@ static int send_intcheck_msg(const char *script, const char *host, const char *m
 
     sys_location[1024] = '\0';
     snprintf(sys_location, 1024, "(%s) %s->%s", script, host, SYSCHECK);
+    w_mutex_lock(&lessd_mutex);
 
     if (SendMSG(lessdc.queue, msg, sys_location, SYSCHECK_MQ) < 0) {
         merror(QUEUE_SEND);
@@ -68,6 +79,7 @@ static int send_intcheck_msg(const char *script, const char *host, const char *m
         SendMSG(lessdc.queue, msg, sys_location, SYSCHECK_MQ);
     }
 
+    w_mutex_unlock(&lessd_mutex);
     return (0);
 }
 
@@ -78,6 +90,7 @@ static int send_log_msg(const char *script, const char *host, const char *msg)
 
     sys_location[1024] = '\0';
     snprintf(sys_location, 1024, "(%s) %s->%s", script, host, SYSCHECK);
+    w_mutex_lock(&lessd_mutex);
 
     if (SendMSG(lessdc.queue, msg, sys_location, LOCALFILE_MQ) < 0) {
         merror(QUEUE_SEND);
@@ -88,6 +101,8 @@ static int send_log_msg(const char *script, const char *host, const char *msg)
         /* If we reach here, we can try to send it again */
         SendMSG(lessdc.queue, msg, sys_location, LOCALFILE_MQ);
     }
+
+    w_mutex_unlock(&lessd_mutex);
     return (0);
 }
 
@@ -133,6 +148,7 @@ static int gen_diff_alert(const char *host, const char *script, time_t alert_dif
     /* Create alert */
     snprintf(diff_alert, sizeof(diff_alert), "ossec: agentless: Change detected:\n%s", buf);
     snprintf(buf, 1024, "(%s) %s->agentless", script, host);
+    w_mutex_lock(&lessd_mutex);
 
     if (SendMSG(lessdc.queue, diff_alert, buf, LOCALFILE_MQ) < 0) {
         merror(QUEUE_SEND);
@@ -145,6 +161,8 @@ static int gen_diff_alert(const char *host, const char *script, time_t alert_dif
         SendMSG(lessdc.queue, diff_alert, buf, LOCALFILE_MQ);
     }
 
+    w_mutex_unlock(&lessd_mutex);
+
     save_agentless_entry(host, script, "diff");
 
     fclose(fp);
@@ -317,120 +335,133 @@ static char ** command_args(const char * type, const char * server, const char *
     return argv;
 }
 
-/* Run periodic commands */
-static int run_periodic_cmd(agentlessd_entries *entry, int test_it)
+/* Test the script of an entry, on its first host */
+static int test_periodic_cmd(agentlessd_entries *entry)
 {
-    int i = 0;
-    char *tmp_str;
-    char buf[OS_SIZE_2048 + 1];
+    int i;
+    int ret_code = 0;
     char command[OS_SIZE_1024 + 1];
-    char ** argv;
-    FILE *fp_store = NULL;
     wfd_t * wfd;
 
-    buf[0] = '\0';
-    command[0] = '\0';
-    command[OS_SIZE_1024] = '\0';
-
-    while (entry->server[i]) {
-        /* Ignored entry */
-        if (entry->server[i][0] == '\0') {
-            i++;
-            continue;
-        }
+    /* Ignored entries */
+    for (i = 0; entry->server[i] && entry->server[i][0] == '\0'; i++);
 
-        /* We only test for the first server entry */
-        else if (test_it) {
-            int ret_code = 0;
-            snprintf(command, OS_SIZE_1024, "%s/%s", AGENTLESSDIRPATH, entry->type);
+    if (!entry->server[i]) {
+        return (0);
+    }
 
-            if (wfd = wpopenl(command, W_CHECK_WRITE, command, "test", "test", NULL), wfd) {
-                ret_code = wpclose(wfd);
-            }
+    snprintf(command, OS_SIZE_1024, "%s/%s", AGENTLESSDIRPATH, entry->type);
 
-            /* Check if the test worked */
-            if (ret_code != 0) {
-                if (ret_code == 32512) {
-                    merror("Expect command not found (or bad "
-                           "arguments) for '%s'.",
-                           entry->type);
-                }
-                merror("Test failed for '%s' (%d). Ignoring.",
-                       entry->type, ret_code / 256);
-                entry->error_flag = 99;
-                return (-1);
-            }
+    if (wfd = wpopenl(command, W_CHECK_WRITE, command, "test", "test", NULL), wfd) {
+        ret_code = wpclose(wfd);
+    }
 
-            minfo("Test passed for '%s'.", entry->type);
-            return (0);
+    /* Check if the test worked */
+    if (ret_code != 0) {
+        if (ret_code == 32512) {
+            merror("Expect command not found (or bad "
+                   "arguments) for '%s'.",
+                   entry->type);
         }
+        merror("Test failed for '%s' (%d). Ignoring.",
+               entry->type, ret_code / 256);
+        entry->error_flag = 99;
+        return (-1);
+    }
 
-        argv = command_args(entry->type, entry->server[i], entry->options);
-        wfd = wpopenv(argv[0], argv, W_BIND_STDOUT | W_BIND_STDERR | W_CHECK_WRITE);
-        free_strarray(argv);
+    minfo("Test passed for '%s'.", entry->type);
+    return (0);
+}
 
-        if (wfd) {
-            while (fgets(buf, OS_SIZE_2048, wfd->file) != NULL) {
-                /* Remove newlines and carriage returns */
-                tmp_str = strchr(buf, '\r');
-                if (tmp_str) {
-                    *tmp_str = '\0';
-                }
-                tmp_str = strchr(buf, '\n');
-                if (tmp_str) {
-                    *tmp_str = '\0';
-                }
+/* Run the periodic command of an entry on one of its hosts */
+static void run_periodic_host(agentlessd_entries *entry, int server)
+{
+    const char *host = entry->server[server] + 1;
+    char *tmp_str;
+    char buf[OS_SIZE_2048 + 1];
+    char ** argv;
+    FILE *fp_store = NULL;
+    wfd_t * wfd;
 
-                if (strncmp(buf, "ERROR: ", 7) == 0) {
-                    merror("%s: %s: %s",
-                           entry->type, entry->server[i] + 1, buf + 7);
-                    entry->error_flag++;
-                    break;
-                } else if (strncmp(buf, "INFO: ", 6) == 0) {
-                    minfo("%s: %s: %s",
-                            entry->type, entry->server[i] + 1, buf + 6);
-                } else if (strncmp(buf, "FWD: ", 4) == 0) {
-                    tmp_str = buf + 5;
-                    send_intcheck_msg(entry->type, entry->server[i] + 1,
-                                      tmp_str);
-                } else if (strncmp(buf, "LOG: ", 4) == 0) {
-                    tmp_str = buf + 5;
-                    send_log_msg(entry->type, entry->server[i] + 1,
-                                 tmp_str);
-                } else if ((entry->state & LESSD_STATE_DIFF) &&
-                           (strncmp(buf, "STORE: ", 7) == 0)) {
-                    if (fp_store) {
-                        fclose(fp_store);
-                    }
-                    fp_store = open_diff_file(entry->server[i] + 1,
-                                              entry->type);
-                } else if (fp_store) {
-                    fprintf(fp_store, "%s\n", buf);
-                } else {
-                    mdebug1("Buffer: %s", buf);
-                }
-            }
+    buf[0] = '\0';
+
+    argv = command_args(entry->type, entry->server[server], entry->options);
+    wfd = wpopenv(argv[0], argv, W_BIND_STDOUT | W_BIND_STDERR | W_CHECK_WRITE);
+    free_strarray(argv);
+
+    if (!wfd) {
+        merror("Subprocess failed on '%s' for '%s'.", entry->type, host);
+        w_mutex_lock(&lessd_mutex);
+        entry->error_flag++;
+        w_mutex_unlock(&lessd_mutex);
+        return;
+    }
 
+    while (fgets(buf, OS_SIZE_2048, wfd->file) != NULL) {
+        /* Remove newlines and carriage returns */
+        tmp_str = strchr(buf, '\r');
+        if (tmp_str) {
+            *tmp_str = '\0';
+        }
+        tmp_str = strchr(buf, '\n');
+        if (tmp_str) {
+            *tmp_str = '\0';
+        }
+
+        if (strncmp(buf, "ERROR: ", 7) == 0) {
+            merror("%s: %s: %s", entry->type, host, buf + 7);
+            w_mutex_lock(&lessd_mutex);
+            entry->error_flag++;
+            w_mutex_unlock(&lessd_mutex);
+            break;
+        } else if (strncmp(buf, "INFO: ", 6) == 0) {
+            minfo("%s: %s: %s", entry->type, host, buf + 6);
+        } else if (strncmp(buf, "FWD: ", 4) == 0) {
+            tmp_str = buf + 5;
+            send_intcheck_msg(entry->type, host, tmp_str);
+        } else if (strncmp(buf, "LOG: ", 4) == 0) {
+            tmp_str = buf + 5;
+            send_log_msg(entry->type, host, tmp_str);
+        } else if ((entry->state & LESSD_STATE_DIFF) &&
+                   (strncmp(buf, "STORE: ", 7) == 0)) {
             if (fp_store) {
                 fclose(fp_store);
-                fp_store = NULL;
-
-                check_diff_file(entry->server[i] + 1, entry->type);
-            } else {
-                save_agentless_entry(entry->server[i] + 1,
-                                     entry->type, "syscheck");
             }
-            wpclose(wfd);
+            fp_store = open_diff_file(host, entry->type);
+        } else if (fp_store) {
+            fprintf(fp_store, "%s\n", buf);
         } else {
-            merror("Subprocess failed on '%s' for '%s'.",
-                   entry->type, entry->server[i] + 1);
-            entry->error_flag++;
+            mdebug1("Buffer: %s", buf);
         }
+    }
 
-        i++;
+    if (fp_store) {
+        fclose(fp_store);
+        check_diff_file(host, entry->type);
+    } else {
+        save_agentless_entry(host, entry->type, "syscheck");
     }
 
-    return (0);
+    wpclose(wfd);
+}
+
+/* Check the hosts queued by the main loop, so that a slow host doesn't delay the rest */
+static void *lessd_worker(__attribute__((unused)) void *arg)
+{
+    lessd_job_t *job;
+
+    while (1) {
+        job = queue_pop_ex(lessd_jobs);
+        run_periodic_host(job->entry, job->server);
+
+        w_mutex_lock(&lessd_mutex);
+        job->entry->running--;
+        w_mutex_unlock(&lessd_mutex);
+
+        os_free(job);
+    }
+
+    return NULL;
 }
 
 /* Main agentlessd */
@@ -441,6 +472,10 @@ void Agentlessd()
 
     int today = 0;
     int test_it = 1;
+    int sessions;
+    size_t hosts = 0;
+    unsigned int i;
+    unsigned int j;
 
     char str[OS_SIZE_1024 + 1];
 
@@ -462,9 +497,24 @@ void Agentlessd()
     // Start com request thread
     w_create_thread(lessdcom_main, NULL);
 
+    /* An entry is not queued again while any of its hosts is pending, so the queue never fills */
+    for (i = 0; lessdc.entries[i]; i++) {
+        for (j = 0; lessdc.entries[i]->server[j]; j++) {
+            hosts++;
+        }
+    }
+
+    lessd_jobs = queue_init(hosts + 1);
+    sessions = getDefine_Int("agentlessd", "sessions", 1, 64);
+
+    for (j = 0; j < (unsigned int)sessions; j++) {
+        w_create_thread(lessd_worker, NULL);
+    }
+
+    mdebug1("Checking up to %d hosts at the same time.", sessions);
+
     /* Main monitor loop */
     while (1) {
-        unsigned int i = 0;
         tm = time(NULL);
         localtime_r(&tm, &tm_result);
 
@@ -473,32 +523,60 @@ void Agentlessd()
             today = tm_result.tm_mday;
         }
 
-        while (lessdc.entries[i]) {
-            if (lessdc.entries[i]->error_flag >= 10) {
-                if (lessdc.entries[i]->error_flag != 99) {
+        for (i = 0; lessdc.entries[i]; i++) {
+            agentlessd_entries *entry = lessdc.entries[i];
+            int error_flag;
+            int running;
+
+            w_mutex_lock(&lessd_mutex);
+            error_flag = entry->error_flag;
+            running = entry->running;
+            w_mutex_unlock(&lessd_mutex);
+
+            if (error_flag >= 10) {
+                if (error_flag != 99) {
                     merror("Too many failures for '%s'. Ignoring it.",
-                           lessdc.entries[i]->type);
-                    lessdc.entries[i]->error_flag = 99;
+                           entry->type);
+                    w_mutex_lock(&lessd_mutex);
+                    entry->error_flag = 99;
+                    w_mutex_unlock(&lessd_mutex);
                 }
 
-                i++;
-                sleep(i);
                 continue;
             }
 
-            /* Run the check again if the frequency has elapsed */
-            if ((lessdc.entries[i]->state & LESSD_STATE_PERIODIC) &&
-                    ((lessdc.entries[i]->current_state +
-                      lessdc.entries[i]->frequency) < tm)) {
-                run_periodic_cmd(lessdc.entries[i], test_it);
-                if (!test_it) {
-                    lessdc.entries[i]->current_state = tm;
-                }
+            /* Run the check again if the frequency has elapsed and the last run finished */
+            if (!(entry->state & LESSD_STATE_PERIODIC) ||
+                    (entry->current_state + entry->frequency) >= tm ||
+                    running) {
+                continue;
             }
 
-            i++;
+            if (test_it) {
+                test_periodic_cmd(entry);
+                continue;
+            }
+
+            for (j = 0; entry->server[j]; j++) {
+                lessd_job_t *job;
+
+                /* Ignored entry */
+                if (entry->server[j][0] == '\0') {
+                    continue;
+                }
+
+                os_malloc(sizeof(lessd_job_t), job);
+                job->entry = entry;
+                job->server = j;
+
+                w_mutex_lock(&lessd_mutex);
+                entry->running++;
+                w_mutex_unlock(&lessd_mutex);
+
+                queue_push_ex_block(lessd_jobs, job);
+            }
 
-            sleep(i);
+            entry->current_state = tm;
         }
 
         /* We only check every minute */
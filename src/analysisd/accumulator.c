@@ -15,19 +15,18 @@
 #include "shared.h"
 #include "accumulator.h"
 #include "eventinfo.h"
-
-/* Local variables */
-static OSHash *acm_store = NULL;
-
-/* Counters for Purging */
-static int    acm_lookups = 0;
-static time_t acm_purge_ts = 0;
+#include "memory_budget.h"
 
 /* Accumulator Constants */
 #define OS_ACM_EXPIRE_ELM      120
+#define OS_ACM_EXPIRE_SHRINK   30
 #define OS_ACM_PURGE_INTERVAL  300
 #define OS_ACM_PURGE_COUNT     200
 
+/* Number of independent stores (power of two) and rows of each one */
+#define OS_ACM_SHARDS          16
+#define OS_ACM_SHARD_SIZE      (2048 / OS_ACM_SHARDS)
+
 /* Accumulator Max Values */
 #define OS_ACM_MAXKEY 256
 #define OS_ACM_MAXELM 81
@@ -43,30 +42,58 @@ typedef struct _OS_ACM_Store {
     char *data;
 } OS_ACM_Store;
 
+/* Upper bound of the memory of an entry: its key and seven values */
+#define OS_ACM_ENTRY_SIZE (sizeof(OS_ACM_Store) + OS_ACM_MAXKEY + 7 * OS_ACM_MAXELM)
+
+/* Each shard owns a part of the keys, so that events with different IDs
+ * can be accumulated in parallel. The shard mutex serializes every access
+ * to its store, hence the unlocked OSHash calls below.
+ */
+typedef struct _OS_ACM_Shard {
+    pthread_mutex_t mutex;
+    OSHash *store;
+
+    /* Counters for Purging */
+    int    lookups;
+    time_t purge_ts;
+} OS_ACM_Shard;
+
+/* Local variables */
+static OS_ACM_Shard acm_shards[OS_ACM_SHARDS];
+
 /* Internal Functions */
 static int acm_str_replace(char **dst, const char *src);
 static OS_ACM_Store *InitACMStore(void);
 static void FreeACMStore(OS_ACM_Store *obj);
+static OS_ACM_Shard *acm_get_shard(const char *key);
+static void acm_shard_cleanup(OS_ACM_Shard *shard, time_t current_ts, int force);
+static time_t acm_expire_time(void);
 
 /* Start the Accumulator module */
 int Accumulate_Init()
 {
     struct timeval tp;
-
-    /* Create store data */
-    acm_store = OSHash_Create();
-    if (!acm_store) {
-        merror(LIST_ERROR);
-        return (0);
-    }
-    if (!OSHash_setSize(acm_store, 2048)) {
-        merror(LIST_ERROR);
-        return (0);
-    }
+    int i;
 
     /* Default Expiry */
     gettimeofday(&tp, NULL);
-    acm_purge_ts = tp.tv_sec;
+
+    /* Create store data */
+    for (i = 0; i < OS_ACM_SHARDS; i++) {
+        acm_shards[i].store = OSHash_Create();
+        if (!acm_shards[i].store) {
+            merror(LIST_ERROR);
+            return (0);
+        }
+        if (!OSHash_setSize(acm_shards[i].store, OS_ACM_SHARD_SIZE)) {
+            merror(LIST_ERROR);
+            return (0);
+        }
+
+        w_mutex_init(&acm_shards[i].mutex, NULL);
+        acm_shards[i].lookups = 0;
+        acm_shards[i].purge_ts = tp.tv_sec;
+    }
 
     mdebug1("Accumulator Init completed.");
     return (1);
@@ -80,6 +107,7 @@ Eventinfo *Accumulate(Eventinfo *lf)
 
     char _key[OS_ACM_MAXKEY];
     OS_ACM_Store *stored_data = 0;
+    OS_ACM_Shard *shard;
 
     time_t  current_ts;
     struct timeval tp;
@@ -101,9 +129,6 @@ Eventinfo *Accumulate(Eventinfo *lf)
         return lf;
     }
 
-    /* Purge the cache as needed */
-    Accumulate_CleanUp();
-
     gettimeofday(&tp, NULL);
     current_ts = tp.tv_sec;
 
@@ -118,12 +143,18 @@ Eventinfo *Accumulate(Eventinfo *lf)
         return lf;
     }
 
+    shard = acm_get_shard(_key);
+    w_mutex_lock(&shard->mutex);
+
+    /* Purge the shard as needed */
+    acm_shard_cleanup(shard, current_ts, 0);
+
     /* Check if acm is already present */
-    if ((stored_data = (OS_ACM_Store *)OSHash_Get_ex(acm_store, _key)) != NULL) {
+    if ((stored_data = (OS_ACM_Store *)OSHash_Get(shard->store, _key)) != NULL) {
         mdebug2("accumulator: DEBUG: Lookup for '%s' found a stored value!", _key);
 
-        if ( stored_data->timestamp > 0 && stored_data->timestamp < current_ts - OS_ACM_EXPIRE_ELM ) {
-            if ( OSHash_Delete_ex(acm_store, _key) != NULL ) {
+        if ( stored_data->timestamp > 0 && stored_data->timestamp < current_ts - acm_expire_time() ) {
+            if ( OSHash_Delete(shard->store, _key) != NULL ) {
                 mdebug1("accumulator: DEBUG: Deleted expired hash entry for '%s'", _key);
                 /* Clear this memory */
                 FreeACMStore(stored_data);
@@ -198,13 +229,13 @@ Eventinfo *Accumulate(Eventinfo *lf)
     /* Update or Add to the hash */
     if ( do_update == 1 ) {
         /* Update the hash entry */
-        if ( (result = OSHash_Update_ex(acm_store, _key, stored_data)) != 1) {
+        if ( (result = OSHash_Update(shard->store, _key, stored_data)) != 1) {
             merror("accumulator: ERROR: Update of stored data for %s failed (%d).", _key, result);
         } else {
             mdebug1("accumulator: DEBUG: Updated stored data for %s", _key);
         }
     } else {
-        if ((result = OSHash_Add_ex(acm_store, _key, stored_data)) != 2 ) {
+        if ((result = OSHash_Add(shard->store, _key, stored_data)) != 2 ) {
             FreeACMStore(stored_data);
             merror("accumulator: ERROR: Addition of stored data for %s failed (%d).", _key, result);
         } else {
@@ -212,14 +243,43 @@ Eventinfo *Accumulate(Eventinfo *lf)
         }
     }
 
+    w_mutex_unlock(&shard->mutex);
+
     return lf;
 }
 
+/* Expire the old entries of every shard */
 void Accumulate_CleanUp()
 {
     struct timeval tp;
-    time_t current_ts = 0;
+    int i;
+
+    gettimeofday(&tp, NULL);
+
+    for (i = 0; i < OS_ACM_SHARDS; i++) {
+        w_mutex_lock(&acm_shards[i].mutex);
+        acm_shard_cleanup(&acm_shards[i], tp.tv_sec, 1);
+        w_mutex_unlock(&acm_shards[i].mutex);
+    }
+}
+
+/* Get the shard that owns a key (FNV-1a) */
+OS_ACM_Shard *acm_get_shard(const char *key)
+{
+    unsigned int hash = 2166136261u;
+
+    for (; *key; key++) {
+        hash = (hash ^ (unsigned char)*key) * 16777619u;
+    }
+
+    return &acm_shards[hash & (OS_ACM_SHARDS - 1)];
+}
+
+/* Expire the old entries of a shard. The caller must hold its mutex. */
+void acm_shard_cleanup(OS_ACM_Shard *shard, time_t current_ts, int force)
+{
     int expired = 0;
+    time_t expire_ts;
 
     OSHashNode *curr;
     OS_ACM_Store *stored_data;
@@ -227,24 +287,22 @@ void Accumulate_CleanUp()
     unsigned int ti;
 
     /* Keep track of how many times we're called */
-    acm_lookups++;
-
-    gettimeofday(&tp, NULL);
-    current_ts = tp.tv_sec;
+    shard->lookups++;
 
     /* Do we really need to purge? */
-    if ( acm_lookups < OS_ACM_PURGE_COUNT && acm_purge_ts < current_ts + OS_ACM_PURGE_INTERVAL ) {
+    if ( !force && shard->lookups < OS_ACM_PURGE_COUNT && current_ts < shard->purge_ts + OS_ACM_PURGE_INTERVAL ) {
         return;
     }
     mdebug1("accumulator: DEBUG: Accumulator_CleanUp() running .. ");
 
     /* Yes, we do */
-    acm_lookups = 0;
-    acm_purge_ts = current_ts;
+    shard->lookups = 0;
+    shard->purge_ts = current_ts;
+    expire_ts = current_ts - acm_expire_time();
 
     /* Loop through the hash */
-    for ( ti = 0; ti < acm_store->rows; ti++ ) {
-        curr = acm_store->table[ti];
+    for ( ti = 0; ti < shard->store->rows; ti++ ) {
+        curr = shard->store->table[ti];
         while ( curr != NULL ) {
             /* Get the Key and Data */
             key  = (char *) curr->key;
@@ -257,9 +315,9 @@ void Accumulate_CleanUp()
             if ( stored_data != NULL ) {
                 /* Check for expiration */
                 mdebug2("accumulator: DEBUG: CleanUp() elm:%ld, curr:%ld", (long int)stored_data->timestamp, (long int)current_ts);
-                if ( stored_data->timestamp < current_ts - OS_ACM_EXPIRE_ELM ) {
+                if ( stored_data->timestamp < expire_ts ) {
                     mdebug2("accumulator: DEBUG: CleanUp() Expiring '%s'", key);
-                    if ( OSHash_Delete_ex(acm_store, key) != NULL ) {
+                    if ( OSHash_Delete(shard->store, key) != NULL ) {
                         FreeACMStore(stored_data);
                         expired++;
                     } else {
@@ -272,11 +330,18 @@ void Accumulate_CleanUp()
     mdebug1("accumulator: DEBUG: Expired %d elements", expired);
 }
 
+/* Entries expire sooner while the memory budget is tight */
+time_t acm_expire_time()
+{
+    return w_mem_level() >= W_MEM_SHRINK ? OS_ACM_EXPIRE_SHRINK : OS_ACM_EXPIRE_ELM;
+}
+
 /* Initialize a storage object */
 OS_ACM_Store *InitACMStore()
 {
     OS_ACM_Store *obj;
     os_calloc(1, sizeof(OS_ACM_Store), obj);
+    w_mem_add(W_MEM_ACCUMULATOR, OS_ACM_ENTRY_SIZE);
 
     obj->timestamp = 0;
     obj->srcuser = NULL;
@@ -303,6 +368,7 @@ void FreeACMStore(OS_ACM_Store *obj)
         free(obj->srcport);
         free(obj->data);
         free(obj);
+        w_mem_sub(W_MEM_ACCUMULATOR, OS_ACM_ENTRY_SIZE);
     }
 }
 
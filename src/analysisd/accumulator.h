@@ -15,7 +15,11 @@
 
 /* Accumulator Functions */
 int Accumulate_Init(void);
+
+/* Thread-safe: keys are spread across independently locked shards */
 Eventinfo *Accumulate(Eventinfo *lf);
+
+/* Expire the old entries of the whole store */
 void Accumulate_CleanUp(void);
 
 #endif /* ACCUMULATOR_H */
@@ -17,15 +17,89 @@
 #include "os_regex/os_regex.h"
 #include "os_execd/execd.h"
 #include "eventinfo.h"
+#include "mpmc_queue_op.h"
+#include "hash_oa_op.h"
 
 
-void OS_Exec(int execq, int arq, const Eventinfo *lf, const active_response *ar)
+/* Maximum number of responses sent at once by the dispatcher */
+#define AR_BATCH_SIZE 64
+
+/* Active response waiting to be sent */
+typedef struct ar_message {
+    int queue;              // Socket: execq or arq
+    int remote;             // Whether the socket is arq
+    size_t dest_length;     // Length of the destination prefix, used to group messages
+    size_t id_offset;       // Alert ID, left out of the suppression key
+    size_t id_length;
+    size_t length;          // Length of text, terminator included
+    char text[];
+} ar_message;
+
+static w_mpmc_queue_t * ar_queue;
+static OSHashOA * ar_recent;
+static unsigned int ar_window;
+static unsigned int ar_dropped;
+
+static void ar_send(int queue, int remote, const char * msg);
+
+void OS_ExecInit(size_t queue_size, unsigned int dedup_window)
+{
+    ar_queue = mpmc_queue_init(queue_size);
+    ar_window = dedup_window;
+
+    if (ar_window) {
+        ar_recent = OSHashOA_Create(0);
+    }
+}
+
+/* Queue a response, or send it at once if there is no dispatcher */
+static void ar_dispatch(int queue, int remote, const char * header, size_t dest_length, const char * alert_id, const char * trailer)
 {
     char exec_msg[OS_SIZE_1024 + 1];
+    size_t id_offset;
+    size_t id_length;
+    size_t length;
+    ar_message * message;
+
+    id_offset = snprintf(exec_msg, OS_SIZE_1024, "%s ", header);
+    id_offset = id_offset < OS_SIZE_1024 ? id_offset : OS_SIZE_1024 - 1;
+    length = id_offset + snprintf(exec_msg + id_offset, OS_SIZE_1024 - id_offset, "%s %s", alert_id, trailer);
+    length = length < OS_SIZE_1024 ? length : OS_SIZE_1024 - 1;
+
+    if (!ar_queue) {
+        ar_send(queue, remote, exec_msg);
+        return;
+    }
+
+    id_length = strlen(alert_id);
+    id_length = id_offset + id_length < length ? id_length : length - id_offset;
+
+    os_malloc(sizeof(ar_message) + length + 1, message);
+    message->queue = queue;
+    message->remote = remote;
+    message->dest_length = dest_length < id_offset ? dest_length : id_offset;
+    message->id_offset = id_offset;
+    message->id_length = id_length;
+    message->length = length + 1;
+    memcpy(message->text, exec_msg, length + 1);
+
+    /* Rule threads don't wait for the sockets */
+    if (mpmc_queue_push_ex(ar_queue, message) < 0) {
+        __atomic_add_fetch(&ar_dropped, 1, __ATOMIC_RELAXED);
+        free(message);
+    }
+}
+
+void OS_Exec(int execq, int arq, const Eventinfo *lf, const active_response *ar)
+{
+    char header[OS_SIZE_1024 + 1];
+    char alert_id[64];
+    char trailer[OS_SIZE_1024 + 1];
     const char *ip;
     const char *user;
     char *filename = NULL;
     char *extra_args = NULL;
+    int dest_length;
 
     ip = user = "-";
 
@@ -76,6 +150,17 @@ void OS_Exec(int execq, int arq, const Eventinfo *lf, const active_response *ar)
         extra_args = os_shell_escape(ar->ar_cmd->extra_args);
     }
 
+    /* The alert ID goes apart, as it's the only field that changes between
+     * repeated executions of the same response */
+    snprintf(alert_id, sizeof(alert_id), "%ld.%ld", (long int)lf->time.tv_sec, __crt_ftell);
+
+    snprintf(trailer, OS_SIZE_1024,
+             "%d %s %s %s",
+             lf->generated_rule->sigid,
+             lf->location,
+             filename ? filename : "-",
+             extra_args ? extra_args : "-");
+
     /* Active Response on the server
      * The response must be here if the ar->location is set to AS
      * or the ar->location is set to local (REMOTE_AGENT) and the
@@ -87,73 +172,37 @@ void OS_Exec(int execq, int arq, const Eventinfo *lf, const active_response *ar)
             goto cleanup;
         }
 
-        snprintf(exec_msg, OS_SIZE_1024,
-                 "%s %s %s %ld.%ld %d %s %s %s",
+        snprintf(header, OS_SIZE_1024,
+                 "%s %s %s",
                  ar->name,
                  user,
-                 ip,
-                 (long int)lf->time.tv_sec,
-                 __crt_ftell,
-                 lf->generated_rule->sigid,
-                 lf->location,
-                 filename ? filename : "-",
-                 extra_args ? extra_args : "-");
-
-        if (OS_SendUnix(execq, exec_msg, 0) < 0) {
-            merror("Error communicating with execd.");
-        }
+                 ip);
+
+        ar_dispatch(execq, 0, header, 0, alert_id, trailer);
     }
 
     /* Active Response to the forwarder */
     else if ((Config.ar & REMOTE_AR)) {
-        int rc;
         /* If lf->location start with a ( was generated by remote agent and its
          * ID is included in lf->location if missing then it must have been
          * generated by the local analysisd, so prepend a false id tag */
-        if (lf->location[0] == '(') {
-            snprintf(exec_msg, OS_SIZE_1024,
-                     "%s %c%c%c %s %s %s %s %ld.%ld %d %s %s %s",
-                     lf->location,
-                     (ar->location & ALL_AGENTS) ? ALL_AGENTS_C : NONE_C,
-                     (ar->location & REMOTE_AGENT) ? REMOTE_AGENT_C : NONE_C,
-                     (ar->location & SPECIFIC_AGENT) ? SPECIFIC_AGENT_C : NONE_C,
-                     ar->agent_id != NULL ? ar->agent_id : "(null)",
-                     ar->name,
-                     user,
-                     ip,
-                     (long int)lf->time.tv_sec,
-                     __crt_ftell,
-                     lf->generated_rule->sigid,
-                     lf->location,
-                     filename ? filename : "-",
-                     extra_args ? extra_args : "-");
-        } else {
-            snprintf(exec_msg, OS_SIZE_1024,
-                     "(local_source) %s %c%c%c %s %s %s %s %ld.%ld %d %s %s %s",
-                     lf->location,
-                     (ar->location & ALL_AGENTS) ? ALL_AGENTS_C : NONE_C,
-                     (ar->location & REMOTE_AGENT) ? REMOTE_AGENT_C : NONE_C,
-                     (ar->location & SPECIFIC_AGENT) ? SPECIFIC_AGENT_C : NONE_C,
-                     ar->agent_id != NULL ? ar->agent_id : "(null)",
-                     ar->name,
-                     user,
-                     ip,
-                     (long int)lf->time.tv_sec,
-                     __crt_ftell,
-                     lf->generated_rule->sigid,
-                     lf->location,
-                     filename ? filename : "-",
-                     extra_args ? extra_args : "-");
-        }
+        dest_length = snprintf(header, OS_SIZE_1024,
+                               "%s%s %c%c%c %s",
+                               lf->location[0] == '(' ? "" : "(local_source) ",
+                               lf->location,
+                               (ar->location & ALL_AGENTS) ? ALL_AGENTS_C : NONE_C,
+                               (ar->location & REMOTE_AGENT) ? REMOTE_AGENT_C : NONE_C,
+                               (ar->location & SPECIFIC_AGENT) ? SPECIFIC_AGENT_C : NONE_C,
+                               ar->agent_id != NULL ? ar->agent_id : "(null)");
+        dest_length = dest_length < OS_SIZE_1024 ? dest_length : OS_SIZE_1024 - 1;
 
-        if ((rc = OS_SendUnix(arq, exec_msg, 0)) < 0) {
-            if (rc == OS_SOCKBUSY) {
-                merror("AR socket busy.");
-            } else {
-                merror("AR socket error (shutdown?).");
-            }
-            merror("Error communicating with ar queue (%d).", rc);
-        }
+        snprintf(header + dest_length, OS_SIZE_1024 - dest_length,
+                 " %s %s %s",
+                 ar->name,
+                 user,
+                 ip);
+
+        ar_dispatch(arq, 1, header, dest_length, alert_id, trailer);
     }
 
     cleanup:
@@ -164,3 +213,163 @@ void OS_Exec(int execq, int arq, const Eventinfo *lf, const active_response *ar)
 
     return;
 }
+
+/* Report a failed delivery */
+static void ar_send_error(int remote, int busy)
+{
+    if (!remote) {
+        merror("Error communicating with execd.");
+    } else {
+        merror(busy ? "AR socket busy." : "AR socket error (shutdown?).");
+        merror("Error communicating with ar queue (%d).", busy ? OS_SOCKBUSY : OS_SOCKTERR);
+    }
+}
+
+static void ar_send(int queue, int remote, const char * msg)
+{
+    int rc;
+
+    if (rc = OS_SendUnix(queue, msg, 0), rc < 0) {
+        ar_send_error(remote, rc == OS_SOCKBUSY);
+    }
+}
+
+/* Build the suppression key: the message without the alert ID */
+static void ar_key(const ar_message * message, char * key)
+{
+    size_t tail = message->id_offset + message->id_length;
+
+    memcpy(key, message->text, message->id_offset);
+    memcpy(key + message->id_offset, message->text + tail, message->length - tail);
+}
+
+/* Tell whether the same response was sent within the window, and remember it otherwise */
+static int ar_suppressed(const ar_message * message, time_t now)
+{
+    char key[OS_SIZE_1024 + 1];
+    intptr_t until;
+
+    ar_key(message, key);
+
+    if (until = (intptr_t)OSHashOA_Get(ar_recent, key), until > now) {
+        return 1;
+    }
+
+    OSHashOA_Set(ar_recent, key, (void *)(intptr_t)(now + ar_window));
+    return 0;
+}
+
+/* Copy an entry that hasn't expired into the new table */
+static void ar_keep_recent(const char * key, void * data, void * arg)
+{
+    void ** args = arg;
+
+    if ((intptr_t)data > *(time_t *)args[1]) {
+        OSHashOA_Add(args[0], key, data);
+    }
+}
+
+/* Forget the responses out of the window */
+static void ar_purge(time_t now)
+{
+    OSHashOA * recent = OSHashOA_Create(0);
+    void * args[] = { recent, &now };
+
+    OSHashOA_It(ar_recent, args, ar_keep_recent);
+    OSHashOA_Free(ar_recent);
+    ar_recent = recent;
+}
+
+/* Send a batch to one socket, grouping the messages for the same destination */
+static void ar_flush(ar_message ** batch, size_t n)
+{
+    char * msgs[AR_BATCH_SIZE];
+    int sizes[AR_BATCH_SIZE];
+    char placed[AR_BATCH_SIZE] = { 0 };
+    int count = 0;
+    int sent;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < n; i++) {
+        if (placed[i]) {
+            continue;
+        }
+
+        for (j = i; j < n; j++) {
+            if (!placed[j] && batch[j]->dest_length == batch[i]->dest_length && !strncmp(batch[j]->text, batch[i]->text, batch[i]->dest_length)) {
+                placed[j] = 1;
+                msgs[count] = batch[j]->text;
+                sizes[count++] = (int)batch[j]->length;
+            }
+        }
+    }
+
+    if (sent = OS_SendUnixBatch(batch[0]->queue, msgs, sizes, count), sent < count) {
+        mdebug2("Unable to send %d active responses.", count - sent);
+        ar_send_error(batch[0]->remote, errno == ENOBUFS);
+    }
+}
+
+void * w_ar_dispatch_thread(__attribute__((unused)) void * args)
+{
+    ar_message * batch[AR_BATCH_SIZE];
+    ar_message * others[AR_BATCH_SIZE];
+    struct timespec deadline;
+    time_t next_purge = 0;
+    time_t now;
+    unsigned int dropped;
+    size_t count;
+    size_t n;
+    size_t n_others;
+    size_t i;
+
+    while (1) {
+        /* Wake up at least once a second, to purge the suppression table */
+        gettime(&deadline);
+        deadline.tv_sec++;
+
+        count = mpmc_queue_pop_ex_batch(ar_queue, (void **)batch, AR_BATCH_SIZE, &deadline);
+        now = time(NULL);
+
+        for (i = n = 0; i < count; i++) {
+            if (ar_recent && ar_suppressed(batch[i], now)) {
+                mdebug2("Active response suppressed: '%s'", batch[i]->text);
+                free(batch[i]);
+            } else {
+                batch[n++] = batch[i];
+            }
+        }
+
+        /* There are two sockets at most: split the batch by socket */
+        while (n > 0) {
+            for (i = n_others = count = 0; i < n; i++) {
+                if (batch[i]->queue == batch[0]->queue) {
+                    batch[count++] = batch[i];
+                } else {
+                    others[n_others++] = batch[i];
+                }
+            }
+
+            ar_flush(batch, count);
+
+            for (i = 0; i < count; i++) {
+                free(batch[i]);
+            }
+
+            memcpy(batch, others, n_others * sizeof(ar_message *));
+            n = n_others;
+        }
+
+        if (dropped = __atomic_exchange_n(&ar_dropped, 0, __ATOMIC_RELAXED), dropped) {
+            mwarn("Active response queue is full. %u responses were dropped.", dropped);
+        }
+
+        if (ar_recent && now >= next_purge) {
+            ar_purge(now);
+            next_purge = now + ar_window;
+        }
+    }
+
+    return NULL;
+}
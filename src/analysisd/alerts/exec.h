@@ -14,6 +14,21 @@
 #include "eventinfo.h"
 #include "active-response.h"
 
+/**
+ * @brief Create the queue of active responses, so that OS_Exec() doesn't send them by itself.
+ *
+ * @param queue_size Maximum number of responses waiting to be sent.
+ * @param dedup_window Seconds during which an identical response is not sent again (0 to disable).
+ */
+void OS_ExecInit(size_t queue_size, unsigned int dedup_window);
+
 void OS_Exec(int execq, int arq, const Eventinfo *lf, const active_response *ar);
 
+/**
+ * @brief Thread that sends the queued active responses, in batches.
+ *
+ * @param args Unused.
+ */
+void * w_ar_dispatch_thread(void * args);
+
 #endif /* EXEC_H */
@@ -10,8 +10,33 @@
 
 /* Get the log directory/file based on the day/month/year */
 
+#include <stdio_ext.h>
 #include "getloglocation.h"
 #include "config.h"
+#include "external/zlib/zlib.h"
+
+/* Buffer of zlib for each compressed log */
+#define GZLOG_BUFFER 65536
+
+/* Compressed log behind a FILE stream */
+typedef struct gzlog {
+    gzFile gz;
+    off64_t offset;         // Where the stream starts, plus the uncompressed bytes written
+    off64_t synced;         // Offset at the last flush point
+    FILE * fp;
+    struct gzlog * next;
+} gzlog;
+
+static gzlog * gzlogs;
+
+/* Output buffer of a log */
+typedef struct logbuf {
+    FILE * fp;
+    char * data;
+    struct logbuf * next;
+} logbuf;
+
+static logbuf * logbufs;
 
 /* Global definitions */
 FILE *_eflog;
@@ -19,6 +44,7 @@ FILE *_aflog;
 FILE *_fflog;
 FILE *_jflog;
 FILE *_ejflog;
+ino_t _jflog_inode;
 
 /* Global variables */
 static int __crt_day;
@@ -35,7 +61,11 @@ static char __jlogfile[OS_FLSIZE + 1];
 static char __ejlogfile[OS_FLSIZE + 1];
 
 // Open a valid log or die. No return on error.
-static FILE * openlog(FILE * fp, char path[OS_FLSIZE + 1], const char * logdir, int year, const char * month, const char * tag, int day, const char * ext, const char * lname, int * counter, int rotate);
+static FILE * openlog(FILE * fp, char path[OS_FLSIZE + 1], const char * logdir, int year, const char * month, const char * tag, int day, const char * ext, const char * lname, int * counter, int rotate, int compress);
+static FILE * gzlog_open(const char * path);
+static void logbuf_set(FILE * fp);
+static void logbuf_close(FILE * fp);
+static ino_t log_inode(FILE * fp);
 
 void OS_InitLog()
 {
@@ -73,22 +103,23 @@ int OS_GetLogLocation(int day,int year,char *mon)
      */
 
     /* For the events */
-    _eflog = openlog(_eflog, __elogfile, EVENTS, year, mon, "archive", day, "log", EVENTS_DAILY, &__ecounter, FALSE);
+    _eflog = openlog(_eflog, __elogfile, EVENTS, year, mon, "archive", day, "log", EVENTS_DAILY, &__ecounter, FALSE, Config.archives_compress);
 
     /* For the events in JSON */
     if (Config.logall_json) {
-        _ejflog = openlog(_ejflog, __ejlogfile, EVENTS, year, mon, "archive", day, "json", EVENTSJSON_DAILY, &__ejcounter, FALSE);
+        _ejflog = openlog(_ejflog, __ejlogfile, EVENTS, year, mon, "archive", day, "json", EVENTSJSON_DAILY, &__ejcounter, FALSE, Config.archives_compress);
     }
 
     /* For the alerts logs */
-    _aflog = openlog(_aflog, __alogfile, ALERTS, year, mon, "alerts", day, "log", ALERTS_DAILY, &__acounter, FALSE);
+    _aflog = openlog(_aflog, __alogfile, ALERTS, year, mon, "alerts", day, "log", ALERTS_DAILY, &__acounter, FALSE, Config.alerts_compress);
 
     if (Config.jsonout_output) {
-        _jflog = openlog(_jflog, __jlogfile, ALERTS, year, mon, "alerts", day, "json", ALERTSJSON_DAILY, &__jcounter, FALSE);
+        _jflog = openlog(_jflog, __jlogfile, ALERTS, year, mon, "alerts", day, "json", ALERTSJSON_DAILY, &__jcounter, FALSE, Config.alerts_compress);
+        _jflog_inode = log_inode(_jflog);
     }
 
     /* For the firewall events */
-    _fflog = openlog(_fflog, __flogfile, FWLOGS, year, mon, "firewall", day, "log", FWLOGS_DAILY, &__fcounter, FALSE);
+    _fflog = openlog(_fflog, __flogfile, FWLOGS, year, mon, "firewall", day, "log", FWLOGS_DAILY, &__fcounter, FALSE, FALSE);
 
     /* Setting the new day */
     __crt_day = day;
@@ -99,15 +130,17 @@ int OS_GetLogLocation(int day,int year,char *mon)
 
 // Open a valid log or die. No return on error.
 
-FILE * openlog(FILE * fp, char * path, const char * logdir, int year, const char * month, const char * tag, int day, const char * ext, const char * lname, int * counter, int rotate) {
+FILE * openlog(FILE * fp, char * path, const char * logdir, int year, const char * month, const char * tag, int day, const char * ext, const char * lname, int * counter, int rotate, int compress) {
     char next[OS_FLSIZE + 1];
+    char link_name[OS_FLSIZE + 1];
+    const char * suffix = compress ? ".gz" : "";
 
     if (fp) {
         if (ftell(fp) == 0) {
             unlink(path);
         }
 
-        fclose(fp);
+        logbuf_close(fp);
     }
 
     snprintf(path, OS_FLSIZE + 1, "%s/%d/", logdir, year);
@@ -125,26 +158,30 @@ FILE * openlog(FILE * fp, char * path, const char * logdir, int year, const char
     // Create the logfile name
 
     if (rotate) {
-        snprintf(path, OS_FLSIZE + 1, "%s/%d/%s/ossec-%s-%02d-%.3d.%s", logdir, year, month, tag, day, ++(*counter), ext);
+        snprintf(path, OS_FLSIZE + 1, "%s/%d/%s/ossec-%s-%02d-%.3d.%s%s", logdir, year, month, tag, day, ++(*counter), ext, suffix);
     } else {
-        snprintf(path, OS_FLSIZE + 1, "%s/%d/%s/ossec-%s-%02d.%s", logdir, year, month, tag, day, ext);
+        snprintf(path, OS_FLSIZE + 1, "%s/%d/%s/ossec-%s-%02d.%s%s", logdir, year, month, tag, day, ext, suffix);
 
         // While this file is bigger than maximum or there is a next file
-        for (*counter = 0; snprintf(next, OS_FLSIZE + 1, "%s/%d/%s/ossec-%s-%02d-%.3d.%s", logdir, year, month, tag, day, *counter + 1, ext), !IsFile(next) || (Config.max_output_size && FileSize(path) > Config.max_output_size); (*counter)++) {
+        for (*counter = 0; snprintf(next, OS_FLSIZE + 1, "%s/%d/%s/ossec-%s-%02d-%.3d.%s%s", logdir, year, month, tag, day, *counter + 1, ext, suffix), !IsFile(next) || (Config.max_output_size && FileSize(path) > Config.max_output_size); (*counter)++) {
             strncpy(path, next, OS_FLSIZE);
             path[OS_FLSIZE] = '\0';
         }
     }
 
-    if (fp = fopen(path, "a"), !fp) {
+    if (fp = compress ? gzlog_open(path) : fopen(path, "a"), !fp) {
         merror_exit("Error opening logfile: '%s': (%d) %s", path, errno, strerror(errno));
     }
 
-    // Create a symlink
+    logbuf_set(fp);
+
+    // Create a symlink, named after the format of the log
+    snprintf(link_name, OS_FLSIZE + 1, "%s%s", lname, suffix);
     unlink(lname);
+    unlink(link_name);
 
-    if (link(path, lname) == -1) {
-        merror_exit(LINK_ERROR, path, lname, errno, strerror(errno));
+    if (link(path, link_name) == -1) {
+        merror_exit(LINK_ERROR, path, link_name, errno, strerror(errno));
     }
 
     return fp;
@@ -155,23 +192,24 @@ void OS_RotateLogs(int day,int year,char *mon) {
     if (Config.rotate_interval && c_time - __crt_rsec > Config.rotate_interval) {
         // If timespan exceeded the rotation time and the file isn't empty
         if (_eflog && ftell(_eflog) > 0) {
-            _eflog = openlog(_eflog, __elogfile, EVENTS, year, mon, "archive", day, "log", EVENTS_DAILY, &__ecounter, TRUE);
+            _eflog = openlog(_eflog, __elogfile, EVENTS, year, mon, "archive", day, "log", EVENTS_DAILY, &__ecounter, TRUE, Config.archives_compress);
         }
 
         if (_ejflog && ftell(_ejflog) > 0) {
-            _ejflog = openlog(_ejflog, __ejlogfile, EVENTS, year, mon, "archive", day, "json", EVENTSJSON_DAILY, &__ejcounter, TRUE);
+            _ejflog = openlog(_ejflog, __ejlogfile, EVENTS, year, mon, "archive", day, "json", EVENTSJSON_DAILY, &__ejcounter, TRUE, Config.archives_compress);
         }
 
         if (_aflog && ftell(_aflog) > 0) {
-            _aflog = openlog(_aflog, __alogfile, ALERTS, year, mon, "alerts", day, "log", ALERTS_DAILY, &__acounter, TRUE);
+            _aflog = openlog(_aflog, __alogfile, ALERTS, year, mon, "alerts", day, "log", ALERTS_DAILY, &__acounter, TRUE, Config.alerts_compress);
         }
 
         if (_jflog && ftell(_jflog) > 0) {
-            _jflog = openlog(_jflog, __jlogfile, ALERTS, year, mon, "alerts", day, "json", ALERTSJSON_DAILY, &__jcounter, TRUE);
+            _jflog = openlog(_jflog, __jlogfile, ALERTS, year, mon, "alerts", day, "json", ALERTSJSON_DAILY, &__jcounter, TRUE, Config.alerts_compress);
+            _jflog_inode = log_inode(_jflog);
         }
 
         if (_fflog && ftell(_fflog) > 0) {
-            _fflog = openlog(_fflog, __flogfile, FWLOGS, year, mon, "firewall", day, "log", FWLOGS_DAILY, &__fcounter, TRUE);
+            _fflog = openlog(_fflog, __flogfile, FWLOGS, year, mon, "firewall", day, "log", FWLOGS_DAILY, &__fcounter, TRUE, FALSE);
         }
 
         __crt_rsec = c_time;
@@ -179,28 +217,178 @@ void OS_RotateLogs(int day,int year,char *mon) {
         // Or if timespan from last rotation is enough and the file is too big
 
         if (_eflog && ftell(_eflog) > Config.max_output_size) {
-            _eflog = openlog(_eflog, __elogfile, EVENTS, year, mon, "archive", day, "log", EVENTS_DAILY, &__ecounter, TRUE);
+            _eflog = openlog(_eflog, __elogfile, EVENTS, year, mon, "archive", day, "log", EVENTS_DAILY, &__ecounter, TRUE, Config.archives_compress);
             __crt_rsec = c_time;
         }
 
         if (_ejflog && ftell(_ejflog) > Config.max_output_size) {
-            _ejflog = openlog(_ejflog, __ejlogfile, EVENTS, year, mon, "archive", day, "json", EVENTSJSON_DAILY, &__ejcounter, TRUE);
+            _ejflog = openlog(_ejflog, __ejlogfile, EVENTS, year, mon, "archive", day, "json", EVENTSJSON_DAILY, &__ejcounter, TRUE, Config.archives_compress);
             __crt_rsec = c_time;
         }
 
         if (_aflog && ftell(_aflog) > Config.max_output_size) {
-            _aflog = openlog(_aflog, __alogfile, ALERTS, year, mon, "alerts", day, "log", ALERTS_DAILY, &__acounter, TRUE);
+            _aflog = openlog(_aflog, __alogfile, ALERTS, year, mon, "alerts", day, "log", ALERTS_DAILY, &__acounter, TRUE, Config.alerts_compress);
             __crt_rsec = c_time;
         }
 
         if (_jflog && ftell(_jflog) > Config.max_output_size) {
-            _jflog = openlog(_jflog, __jlogfile, ALERTS, year, mon, "alerts", day, "json", ALERTSJSON_DAILY, &__jcounter, TRUE);
+            _jflog = openlog(_jflog, __jlogfile, ALERTS, year, mon, "alerts", day, "json", ALERTSJSON_DAILY, &__jcounter, TRUE, Config.alerts_compress);
+            _jflog_inode = log_inode(_jflog);
             __crt_rsec = c_time;
         }
 
         if (_fflog && ftell(_fflog) > Config.max_output_size) {
-            _fflog = openlog(_fflog, __flogfile, FWLOGS, year, mon, "firewall", day, "log", FWLOGS_DAILY, &__fcounter, TRUE);
+            _fflog = openlog(_fflog, __flogfile, FWLOGS, year, mon, "firewall", day, "log", FWLOGS_DAILY, &__fcounter, TRUE, FALSE);
             __crt_rsec = c_time;
         }
     }
 }
+
+static ssize_t gzlog_write(void * cookie, const char * buf, size_t size) {
+    gzlog * log = cookie;
+    int written;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    if (written = gzwrite(log->gz, buf, (unsigned)size), written <= 0) {
+        return -1;
+    }
+
+    log->offset += written;
+    return written;
+}
+
+/* Only ftell() is supported: positions count the uncompressed bytes, so that
+ * alert IDs stay unique and the size rotation keeps working */
+static int gzlog_seek(void * cookie, off64_t * position, int whence) {
+    gzlog * log = cookie;
+
+    if (whence != SEEK_CUR || *position != 0) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    *position = log->offset;
+    return 0;
+}
+
+static int gzlog_close(void * cookie) {
+    gzlog * log = cookie;
+    gzlog ** node;
+    int result;
+
+    for (node = &gzlogs; *node; node = &(*node)->next) {
+        if (*node == log) {
+            *node = log->next;
+            break;
+        }
+    }
+
+    result = gzclose(log->gz) == Z_OK ? 0 : EOF;
+    free(log);
+    return result;
+}
+
+/* Open a gzip log for appending. Another gzip member is added to an existing file. */
+FILE * gzlog_open(const char * path) {
+    cookie_io_functions_t functions = { .write = gzlog_write, .seek = gzlog_seek, .close = gzlog_close };
+    gzlog * log;
+    off_t size;
+
+    os_calloc(1, sizeof(gzlog), log);
+
+    /* An existing file must not look empty, or it would be removed as such */
+    size = FileSize(path);
+    log->offset = size > 0 ? size : 0;
+    log->synced = log->offset;
+
+    if (log->gz = gzopen(path, "ab"), !log->gz) {
+        free(log);
+        return NULL;
+    }
+
+    gzbuffer(log->gz, GZLOG_BUFFER);
+
+    if (log->fp = fopencookie(log, "w", functions), !log->fp) {
+        gzclose(log->gz);
+        free(log);
+        return NULL;
+    }
+
+    log->next = gzlogs;
+    gzlogs = log;
+    return log->fp;
+}
+
+void OS_SyncLogs(void) {
+    gzlog * log;
+
+    for (log = gzlogs; log; log = log->next) {
+        fflush(log->fp);
+
+        /* Every flush point costs some compression: skip idle logs */
+        if (log->offset == log->synced) {
+            continue;
+        }
+
+        if (gzflush(log->gz, Z_SYNC_FLUSH) != Z_OK) {
+            merror("Could not flush a compressed log: %s", gzerror(log->gz, NULL));
+        }
+
+        log->synced = log->offset;
+    }
+}
+
+/* Only the writer threads use the logs, under their own mutex: give them a
+ * large buffer, written in a single call when full or flushed, and no stdio lock */
+void logbuf_set(FILE * fp) {
+    logbuf * buffer;
+
+    __fsetlocking(fp, FSETLOCKING_BYCALLER);
+
+    if (Config.log_buffer_size <= 0) {
+        return;
+    }
+
+    os_calloc(1, sizeof(logbuf), buffer);
+    os_malloc((size_t)Config.log_buffer_size * 1024, buffer->data);
+    buffer->fp = fp;
+
+    if (setvbuf(fp, buffer->data, _IOFBF, (size_t)Config.log_buffer_size * 1024) != 0) {
+        mwarn("Could not set the output buffer of a log.");
+        free(buffer->data);
+        free(buffer);
+        return;
+    }
+
+    buffer->next = logbufs;
+    logbufs = buffer;
+}
+
+/* Close a log, and then release its buffer */
+void logbuf_close(FILE * fp) {
+    logbuf ** node;
+    logbuf * buffer;
+
+    fclose(fp);
+
+    for (node = &logbufs; *node; node = &(*node)->next) {
+        if ((*node)->fp == fp) {
+            buffer = *node;
+            *node = buffer->next;
+            free(buffer->data);
+            free(buffer);
+            break;
+        }
+    }
+}
+
+/* Readers can only resume from a plain log */
+ino_t log_inode(FILE * fp) {
+    struct stat buf;
+    int fd = fileno(fp);
+
+    return fd >= 0 && fstat(fd, &buf) == 0 ? buf.st_ino : 0;
+}
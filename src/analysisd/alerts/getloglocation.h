@@ -29,8 +29,14 @@ extern FILE *_ejflog;
 extern FILE *_aflog;
 extern FILE *_fflog;
 extern FILE *_jflog;
+
+/* Inode of the JSON alerts log, 0 if it's compressed */
+extern ino_t _jflog_inode;
 extern FILE *_ejflog;
 
 void OS_RotateLogs(int day,int year,char *mon);
 
+/* Add a flush point to the compressed logs, so that readers get everything written so far */
+void OS_SyncLogs(void);
+
 #endif /* GETLL_H */
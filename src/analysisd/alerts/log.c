@@ -16,6 +16,7 @@
 #include "rules.h"
 #include "eventinfo.h"
 #include "config.h"
+#include "labels.h"
 
 /* Drop/allow patterns */
 static OSMatch FWDROPpm;
@@ -105,7 +106,8 @@ void OS_Store_Flush(){
 void OS_LogOutput(Eventinfo *lf)
 {
     int i;
-    char labels[OS_MAXSTR] = {0};
+    char labels_buffer[OS_MAXSTR];
+    const char *labels = labels_buffer;
     char * saveptr;
     char buf_ptr[26];
 
@@ -120,10 +122,12 @@ void OS_LogOutput(Eventinfo *lf)
     }
 #endif
 
-    if (lf->labels && lf->labels[0].key) {
-        format_labels(labels, OS_MAXSTR, lf);
+    if (lf->label_set) {
+        labels = lf->label_set->text;
+    } else if (lf->labels && lf->labels[0].key) {
+        format_labels(labels_buffer, OS_MAXSTR, lf);
     } else {
-        labels[0] = '\0';
+        labels_buffer[0] = '\0';
     }
 
     printf(
@@ -318,7 +322,8 @@ void OS_LogOutput(Eventinfo *lf)
 void OS_Log(Eventinfo *lf)
 {
     int i;
-    char labels[OS_MAXSTR] = {0};
+    char labels_buffer[OS_MAXSTR];
+    const char *labels = labels_buffer;
     char * saveptr;
     char buf_ptr[26];
 
@@ -332,10 +337,12 @@ void OS_Log(Eventinfo *lf)
         }
     }
 #endif
-    if (lf->labels && lf->labels[0].key) {
-        format_labels(labels, OS_MAXSTR, lf);
+    if (lf->label_set) {
+        labels = lf->label_set->text;
+    } else if (lf->labels && lf->labels[0].key) {
+        format_labels(labels_buffer, OS_MAXSTR, lf);
     } else {
-        labels[0] = '\0';
+        labels_buffer[0] = '\0';
     }
 
     /* Writing to the alert log file */
@@ -682,7 +689,9 @@ int FW_Log(Eventinfo *lf)
             lf->dstip,
             lf->dstport);
 
-    fflush(_fflog);
-
     return (1);
 }
+
+void FW_Log_Flush(){
+    fflush(_fflog);
+}
@@ -26,5 +26,6 @@ void OS_Log_Flush();
 void OS_CustomLog_Flush();
 void OS_Store_Flush();
 int FW_Log(Eventinfo *lf);
+void FW_Log_Flush();
 
 #endif /* LOG_H */
@@ -42,6 +42,11 @@
 #include "state.h"
 #include "syscheck_op.h"
 #include "lists_make.h"
+#include "ruleset_load.h"
+#include "rule_prefilter.h"
+#include "rule_profile.h"
+#include "archive_filter.h"
+#include "memory_budget.h"
 
 #ifdef PRELUDE_OUTPUT_ENABLED
 #include "output/prelude.h"
@@ -61,9 +66,11 @@ void DecodeEvent(Eventinfo *lf, regex_matching *decoder_match);
 int DecodeSyscheck(Eventinfo *lf, _sdb *sdb);
 // Decode events in json format
 int decode_fim_event(_sdb *sdb, Eventinfo *lf);
+void fim_flush_db(_sdb *sdb);
 int DecodeRootcheck(Eventinfo *lf);
 int DecodeHostinfo(Eventinfo *lf);
 int DecodeSyscollector(Eventinfo *lf,int *socket);
+void SyscollectorFlush(int *socket);
 int DecodeCiscat(Eventinfo *lf, int *socket);
 int DecodeWinevt(Eventinfo *lf);
 int DecodeSCA(Eventinfo *lf,int *socket);
@@ -78,6 +85,10 @@ static void DumpLogstats(void);
 // Message handler thread
 void * ad_input_main(void * args);
 
+/* Memory budget */
+static void ad_memory_update(void);
+static int ad_input_rejected(char type);
+
 /** Global definitions **/
 int today;
 int thishour;
@@ -100,12 +111,25 @@ static int execdq = 0;
 /* Active response queue */
 static int arq = 0;
 
+/* Shared-memory rings of the input queue */
+static w_shm_queue_t * input_shm;
+
+/* Datagrams received from the input socket and not handled yet */
+static struct {
+    char * buffer[AD_INPUT_BATCH];
+    int length[AD_INPUT_BATCH];
+    int count;
+    int next;
+} input_batch;
+
+/* Hourly counters, updated with relaxed atomics */
 static unsigned int hourly_alerts;
 static unsigned int hourly_events;
 static unsigned int hourly_syscheck;
 static unsigned int hourly_firewall;
 
 void w_free_event_info(Eventinfo *lf);
+int w_event_copy_shareable(void);
 
 /* Output threads */
 void * w_main_output_thread(__attribute__((unused)) void * args);
@@ -128,23 +152,45 @@ void * w_writer_log_fts_thread(__attribute__((unused)) void * args );
 /* Flush logs thread */
 void w_log_flush();
 
-/* Decode syscollector threads */
-void * w_decode_syscollector_thread(__attribute__((unused)) void * args);
+/* State of a syscheck decode lane */
+typedef struct w_syscheck_lane_t {
+    _sdb sdb;
+    OSDecoderInfo * fim_decoder;
+} w_syscheck_lane_t;
+
+/* State of an event decode lane */
+typedef struct w_event_lane_t {
+    regex_matching decoder_match;
+    int sock;
+} w_event_lane_t;
+
+/* Priority of the decode lanes in the shared pool: real-time events first */
+#define W_LANE_WEIGHT_EVENT     4
+#define W_LANE_WEIGHT_SYSCHECK  2
+#define W_LANE_WEIGHT_INVENTORY 1
+
+/* Decode syscollector batches */
+void w_decode_syscollector_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n);
 
-/* Decode syscheck threads */
-void * w_decode_syscheck_thread(__attribute__((unused)) void * args);
+/* Decode syscheck batches */
+void * w_decode_syscheck_context(void);
+void w_decode_syscheck_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n);
 
-/* Decode hostinfo threads */
-void * w_decode_hostinfo_thread(__attribute__((unused)) void * args);
+/* Decode hostinfo batches */
+void w_decode_hostinfo_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n);
 
-/* Decode rootcheck threads */
-void * w_decode_rootcheck_thread(__attribute__((unused)) void * args);
+/* Decode rootcheck batches */
+void w_decode_rootcheck_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n);
 
-/* Decode Security Configuration Assessment threads */
-void * w_decode_sca_thread(__attribute__((unused)) void * args);
+/* Decode Security Configuration Assessment batches */
+void w_decode_sca_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n);
 
-/* Decode event threads */
-void * w_decode_event_thread(__attribute__((unused)) void * args);
+/* Socket to Wazuh DB of the syscollector and SCA lanes */
+void * w_decode_socket_context(void);
+
+/* Decode event batches */
+void * w_decode_event_context(void);
+void w_decode_event_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n);
 
 /* Process decoded event - rule matching threads */
 void * w_process_event_thread(__attribute__((unused)) void * id);
@@ -152,8 +198,12 @@ void * w_process_event_thread(__attribute__((unused)) void * id);
 /* Do log rotation thread */
 void * w_log_rotate_thread(__attribute__((unused)) void * args);
 
-/* Decode winevt threads */
-void * w_decode_winevt_thread(__attribute__((unused)) void * args);
+/* Decode winevt batches */
+void w_decode_winevt_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n);
+
+/* Serve a decode lane: with its own thread, or through the shared pool */
+static void w_decode_lane_add(const char * name, int id, w_mpmc_queue_t * queue, w_lane_work_t work, void * context, unsigned int weight);
+static double w_metric_decode_pool_busy(void * pool);
 
 /* Database synchronization thread */
 static void * w_dispatch_dbsync_thread(void * args);
@@ -173,60 +223,98 @@ typedef struct _osmatch_exec {
     RuleInfo *rule;
 } _osmatch_execute;
 
+/* Input queues of a stateful decoder: one for each decode lane. The
+ * messages of an agent always go to the same queue, so they're decoded in
+ * order and with the same decoder state */
+typedef struct w_decode_shards_t {
+    w_mpmc_queue_t ** queues;
+    unsigned int count;
+    size_t size;                ///< Capacity of all the queues
+} w_decode_shards_t;
+
+/* Create a queue for each of the n threads (or one per core if n is 0) that share the capacity */
+static void w_decode_shards_init(w_decode_shards_t * shards, int n, int size);
+
+/* Get the queue of the agent that sent a message */
+static w_mpmc_queue_t * w_decode_shard(const w_decode_shards_t * shards, const char * msg);
+
+/* Items and peak of all the queues */
+static size_t w_decode_shards_elements(const w_decode_shards_t * shards);
+static size_t w_decode_shards_take_high_water(w_decode_shards_t * shards);
+
+/* Add a lane for each queue, with the state made by context() (if not NULL) */
+static void w_decode_shards_lanes(const char * name, const w_decode_shards_t * shards, w_lane_work_t work, void * (*context)(void), unsigned int weight);
+
+/* Export the depth of the queues as metrics */
+static void w_init_queues_metrics();
+static double w_metric_shards_elements(void * shards);
+static double w_metric_queue_elements(void * queue);
+
 /* Archives writer queue */
-static w_queue_t * writer_queue;
+static w_mpmc_queue_t * writer_queue;
 
 /* Alerts log writer queue */
-static w_queue_t * writer_queue_log;
+static w_mpmc_queue_t * writer_queue_log;
 
 /* Statistical log writer queue */
-static w_queue_t * writer_queue_log_statistical;
+static w_mpmc_queue_t * writer_queue_log_statistical;
 
 /* Firewall log writer queue */
-static w_queue_t * writer_queue_log_firewall;
+static w_mpmc_queue_t * writer_queue_log_firewall;
 
 /* FTS log writer queue */
-static w_queue_t * writer_queue_log_fts;
+static w_mpmc_queue_t * writer_queue_log_fts;
 
 /* Decode syscheck input queue */
-static w_queue_t * decode_queue_syscheck_input;
+static w_decode_shards_t decode_queue_syscheck_input;
 
 /* Decode syscollector input queue */
-static w_queue_t * decode_queue_syscollector_input;
+static w_decode_shards_t decode_queue_syscollector_input;
 
 /* Decode rootcheck input queue */
-static w_queue_t * decode_queue_rootcheck_input;
+static w_decode_shards_t decode_queue_rootcheck_input;
 
 /* Decode policy monitoring input queue */
-static w_queue_t * decode_queue_sca_input;
+static w_decode_shards_t decode_queue_sca_input;
 
 /* Decode hostinfo input queue */
-static w_queue_t * decode_queue_hostinfo_input;
+static w_decode_shards_t decode_queue_hostinfo_input;
 
 /* Decode event input queue */
-static w_queue_t * decode_queue_event_input;
+static w_mpmc_queue_t * decode_queue_event_input;
 
 /* Decode pending event output */
-static w_queue_t * decode_queue_event_output;
+static w_mpmc_queue_t * decode_queue_event_output;
 
 /* Decode windows event input queue */
-static w_queue_t * decode_queue_winevt_input;
+static w_mpmc_queue_t * decode_queue_winevt_input;
 
 /* Database synchronization input queue */
-static w_queue_t * dispatch_dbsync_input;
+static w_mpmc_queue_t * dispatch_dbsync_input;
 
-/* Hourly alerts mutex */
-static pthread_mutex_t hourly_alert_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Stages of the events traced, from the reception to the alert */
+enum {
+    W_TRACE_INPUT_QUEUE,
+    W_TRACE_DECODING,
+    W_TRACE_DECODED_QUEUE,
+    W_TRACE_RULE_MATCHING,
+    W_TRACE_WRITER_QUEUE,
+    W_TRACE_ALERT_WRITING,
+    W_TRACE_STAGES
+};
 
-/* Hourly firewall mutex */
-static pthread_mutex_t hourly_firewall_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char * const event_trace_stages[W_TRACE_STAGES] = {
+    "input_queue", "decoding", "decoded_queue", "rule_matching", "writer_queue", "alert_writing"
+};
+
+static w_tracer_t event_tracer;
+
+/* Carries a sampled event through the input queue, as a bare string */
+static w_trace_probe_t event_input_probe;
 
 /* Do diff mutex */
 static pthread_mutex_t do_diff_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* Accumulate mutex */
-static pthread_mutex_t accumulate_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 /* Reported variables */
 static int reported_syscheck = 0;
 static int reported_syscollector = 0;
@@ -242,7 +330,6 @@ static int reported_dbsync;
 pthread_mutex_t decode_syscheck_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t process_event_check_hour_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t process_event_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t lf_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* Reported mutexes */
 static pthread_mutex_t writer_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -256,6 +343,16 @@ static const char *(month[]) = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
 /* CPU Info*/
 static int cpu_cores;
 
+/* Threads reading the ruleset at startup */
+static int ruleset_threads;
+
+/* Average size of the messages received, to estimate the memory of the queues */
+static size_t input_message_size;
+
+/* Threads shared by all the decoders (0: each decoder has its own) */
+static int num_decode_pool_threads;
+static w_lane_pool_t decode_pool;
+
 /* Print help statement */
 __attribute__((noreturn))
 static void help_analysisd(void)
@@ -416,8 +513,7 @@ int main_analysisd(int argc, char **argv)
 
     /* Opening GeoIP DB */
     if(Config.geoipdb_file) {
-        geoipdb = GeoIP_open(Config.geoipdb_file, GEOIP_INDEX_CACHE);
-        if (geoipdb == NULL)
+        if (OpenGeoIP(Config.geoipdb_file) < 0)
         {
             merror("Unable to open GeoIP database from: %s (disabling GeoIP).", Config.geoipdb_file);
         }
@@ -466,6 +562,15 @@ int main_analysisd(int argc, char **argv)
         num_rule_matching_threads = cpu_cores;
     }
 
+    ruleset_threads = getDefine_Int("analysisd", "ruleset_threads", 0, 32);
+
+    if (ruleset_threads == 0) {
+        ruleset_threads = cpu_cores;
+    }
+
+    /* The budget is set in MiB */
+    w_mem_budget_init((size_t)getDefine_Int("analysisd", "memory_budget", 0, 1048576) << 20);
+
     /* Continuing in Daemon mode */
     if (!test_config && !run_foreground) {
         nowDaemon();
@@ -502,6 +607,7 @@ int main_analysisd(int argc, char **argv)
     nowChroot();
 
     Config.decoder_order_size = (size_t)getDefine_Int("analysisd", "decoder_order_size", MIN_ORDER_SIZE, MAX_DECODER_ORDER_SIZE);
+    OSRegex_SetDFA(getDefine_Int("analysisd", "regex_dfa", 0, 1));
 
     if (!last_events_list) {
         os_calloc(1, sizeof(EventList), last_events_list);
@@ -517,6 +623,8 @@ int main_analysisd(int argc, char **argv)
      */
     {
         {
+            Ruleset_CacheInit();
+
             /* Initialize the decoders list */
             OS_CreateOSDecoderList();
 
@@ -527,6 +635,9 @@ int main_analysisd(int argc, char **argv)
                 Read_Rules(NULL, &Config, NULL);
             }
 
+            /* Parse every decoder and rule file at once, they are linked below in order */
+            Ruleset_Preload(Config.decoders, Config.includes, ruleset_threads);
+
             /* New loaded based on file loaded (in ossec.conf or default) */
             {
                 char **decodersfiles;
@@ -568,7 +679,7 @@ int main_analysisd(int argc, char **argv)
                 free(Config.lists);
                 Config.lists = NULL;
             }
-            Lists_OP_MakeAll(0, 0);
+            Lists_OP_MakeAll(0, 0, ruleset_threads);
         }
 
         {
@@ -607,6 +718,7 @@ int main_analysisd(int argc, char **argv)
              * rule evaluation.
              */
             OS_ListLoadRules();
+            Ruleset_PreloadFree();
         }
     }
 
@@ -619,8 +731,19 @@ int main_analysisd(int argc, char **argv)
         if (!test_config) {
             minfo("Total rules enabled: '%d'", total_rules);
         }
+
+        /* Index sibling rules so that matching only tries viable candidates */
+        mdebug1("Rule lists indexed: '%d'", OS_CompileRulePrefilters(tmp_node));
+
+        /* Number the rules for the per-rule cost accounting */
+        if (rule_profile_enabled = getDefine_Int("analysisd", "rule_profile", 0, 1), rule_profile_enabled) {
+            minfo("Rule profiling enabled for %u rules.", rule_profile_init(tmp_node));
+        }
     }
 
+    /* Filters of the events archived */
+    w_archive_filter_init();
+
     /* Create a rules hash (for reading alerts from other servers) */
     {
         RuleNode *tmp_node = OS_GetFirstRule();
@@ -666,6 +789,17 @@ int main_analysisd(int argc, char **argv)
         merror_exit(QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
     }
 
+    /* Offer shared-memory rings to the local producers. A segment left by a
+     * previous run is dropped anyway, so nobody keeps writing into it */
+    if (getDefine_Int("analysisd", "shm_queue", 0, 1)) {
+        input_shm = shm_queue_create(DEFAULTQUEUE SHM_QUEUE_SUFFIX, (size_t)getDefine_Int("analysisd", "shm_queue_size", 128, 65536) * 1024);
+    } else {
+        shm_queue_unlink(DEFAULTQUEUE SHM_QUEUE_SUFFIX);
+    }
+
+    /* Publish the JSON alerts to the daemons that read them */
+    jsonout_output_event_ring(Config.jsonout_output ? (size_t)getDefine_Int("analysisd", "alerts_ring_size", 0, 262144) * 1024 : 0);
+
     /* Whitelist */
     if (Config.white_list == NULL) {
         if (Config.ar) {
@@ -711,8 +845,11 @@ int main_analysisd(int argc, char **argv)
     /* Startup message */
     minfo(STARTUP_MSG, (int)getpid());
 
+    /* The rule matching threads read the lists that asyscom may reload */
+    Lists_OP_InitReaders(num_rule_matching_threads);
+
     // Start com request thread
-    w_create_thread(asyscom_main, NULL);
+    w_create_named_thread(asyscom_main, NULL, "ad-com");
 
     /* Load Mitre JSON File and Mitre hash table */
     mitre_load(NULL);
@@ -825,10 +962,17 @@ void OS_ReadMSG_analysisd(int m_queue)
         Config.stats = 0;
     }
 
+    /* Events freed by one thread are reused by the others */
+    Init_EventinfoPool(EVENTINFO_POOL_SIZE);
+
+    Config.archives_compress = getDefine_Int("analysisd", "archives_compress", 0, 1);
+    Config.alerts_compress = getDefine_Int("analysisd", "alerts_compress", 0, 1);
+    Config.log_buffer_size = getDefine_Int("analysisd", "log_buffer_size", 0, 65536);
+    Config.log_flush_interval = getDefine_Int("analysisd", "log_flush_interval", 50, 10000);
+
     /* Initialize the logs */
     {
-        os_calloc(1, sizeof(Eventinfo), lf);
-        os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+        lf = Alloc_Eventinfo();
         lf->year = prev_year;
         strncpy(lf->mon, prev_month, 3);
         lf->day = today;
@@ -845,49 +989,34 @@ void OS_ReadMSG_analysisd(int m_queue)
 
     Config.label_cache_maxage = getDefine_Int("analysisd", "label_cache_maxage", 0, 60);
     Config.show_hidden_labels = getDefine_Int("analysisd", "show_hidden_labels", 0, 1);
+    Config.wdb_batch = getDefine_Int("analysisd", "wdb_batch", 0, 1);
 
     if (Config.custom_alert_output) {
         mdebug1("Custom output found.!");
     }
 
+    w_analysisd_metrics_init();
+
+    /* The decoders write the event queues first: their cells go to the decoders' node */
+    w_affinity_enter("analysisd", "decode");
     w_init_queues();
+    w_affinity_leave();
 
     /* Queue stats */
     w_get_initial_queues_size();
+    w_init_queues_metrics();
+    w_tracer_init(&event_tracer, "analysisd", "wazuh_analysisd", event_trace_stages, W_TRACE_STAGES);
 
     int num_decode_event_threads = getDefine_Int("analysisd", "event_threads", 0, 32);
-    int num_decode_syscheck_threads = getDefine_Int("analysisd", "syscheck_threads", 0, 32);
-    int num_decode_syscollector_threads = getDefine_Int("analysisd", "syscollector_threads", 0, 32);
-    int num_decode_rootcheck_threads = getDefine_Int("analysisd", "rootcheck_threads", 0, 32);
-    int num_decode_sca_threads = getDefine_Int("analysisd", "sca_threads", 0, 32);
-    int num_decode_hostinfo_threads = getDefine_Int("analysisd", "hostinfo_threads", 0, 32);
     int num_decode_winevt_threads = getDefine_Int("analysisd", "winevt_threads", 0, 32);
     int num_dispatch_dbsync_threads = getDefine_Int("analysisd", "dbsync_threads", 0, 32);
+    num_decode_pool_threads = getDefine_Int("analysisd", "decode_pool_threads", 0, 256);
+    w_lane_pool_init(&decode_pool);
 
     if(num_decode_event_threads == 0){
         num_decode_event_threads = cpu_cores;
     }
 
-    if(num_decode_syscheck_threads == 0){
-        num_decode_syscheck_threads = cpu_cores;
-    }
-
-    if(num_decode_syscollector_threads == 0){
-        num_decode_syscollector_threads = cpu_cores;
-    }
-
-    if(num_decode_rootcheck_threads == 0){
-        num_decode_rootcheck_threads = cpu_cores;
-    }
-
-    if(num_decode_sca_threads == 0){
-        num_decode_sca_threads = cpu_cores;
-    }
-
-    if(num_decode_hostinfo_threads == 0){
-        num_decode_hostinfo_threads = cpu_cores;
-    }
-
     if(num_decode_winevt_threads == 0){
         num_decode_winevt_threads = cpu_cores;
     }
@@ -895,88 +1024,253 @@ void OS_ReadMSG_analysisd(int m_queue)
     num_dispatch_dbsync_threads = (num_dispatch_dbsync_threads > 0) ? num_dispatch_dbsync_threads : cpu_cores;
 
     /* Initiate the FTS list */
+    w_affinity_enter("analysisd", "rules");
+
     if (!FTS_Init(num_rule_matching_threads)) {
         merror_exit(FTS_LIST_ERROR);
     }
 
+    w_affinity_leave();
+
     /* Create message handler thread */
-    w_create_thread(ad_input_main, &m_queue);
+    w_affinity_enter("analysisd", "input");
+    w_create_named_thread(ad_input_main, &m_queue, "ad-input");
+    w_affinity_leave();
+
+    w_affinity_enter("analysisd", "writer");
 
     /* Create archives writer thread */
-    w_create_thread(w_writer_thread,NULL);
+    w_create_named_thread(w_writer_thread, NULL, "ad-wr-archives");
 
     /* Create alerts log writer thread */
-    w_create_thread(w_writer_log_thread,NULL);
+    w_create_named_thread(w_writer_log_thread, NULL, "ad-wr-alerts");
 
     /* Create statistical log writer thread */
-    w_create_thread(w_writer_log_statistical_thread,NULL);
+    w_create_named_thread(w_writer_log_statistical_thread, NULL, "ad-wr-stats");
 
     /* Create firewall log writer thread */
-    w_create_thread(w_writer_log_firewall_thread,NULL);
+    w_create_named_thread(w_writer_log_firewall_thread, NULL, "ad-wr-firewall");
 
     /* Create FTS log writer thread */
-    w_create_thread(w_writer_log_fts_thread,NULL);
+    w_create_named_thread(w_writer_log_fts_thread, NULL, "ad-wr-fts");
+
+    w_affinity_leave();
 
     /* Create log rotation thread */
-    w_create_thread(w_log_rotate_thread,NULL);
+    w_create_named_thread(w_log_rotate_thread, NULL, "ad-rotate");
 
-    /* Create decode syscheck threads */
-    for(i = 0; i < num_decode_syscheck_threads;i++){
-        w_create_thread(w_decode_syscheck_thread,NULL);
-    }
+    w_affinity_enter("analysisd", "decode");
 
-    /* Create decode syscollector threads */
-    for(i = 0; i < num_decode_syscollector_threads;i++){
-        w_create_thread(w_decode_syscollector_thread,NULL);
-    }
+    /* Stateful decoders get a lane per shard, the others as many lanes as threads */
+    w_decode_shards_lanes("fim", &decode_queue_syscheck_input, w_decode_syscheck_batch, w_decode_syscheck_context, W_LANE_WEIGHT_SYSCHECK);
+    w_decode_shards_lanes("syscol", &decode_queue_syscollector_input, w_decode_syscollector_batch, w_decode_socket_context, W_LANE_WEIGHT_INVENTORY);
+    w_decode_shards_lanes("host", &decode_queue_hostinfo_input, w_decode_hostinfo_batch, NULL, W_LANE_WEIGHT_INVENTORY);
+    w_decode_shards_lanes("rootck", &decode_queue_rootcheck_input, w_decode_rootcheck_batch, NULL, W_LANE_WEIGHT_INVENTORY);
+    w_decode_shards_lanes("sca", &decode_queue_sca_input, w_decode_sca_batch, w_decode_socket_context, W_LANE_WEIGHT_INVENTORY);
 
-    /* Create decode hostinfo threads */
-    for(i = 0; i < num_decode_hostinfo_threads;i++){
-        w_create_thread(w_decode_hostinfo_thread,NULL);
+    for(i = 0; i < num_decode_event_threads;i++){
+        w_decode_lane_add("event", i, decode_queue_event_input, w_decode_event_batch, w_decode_event_context(), W_LANE_WEIGHT_EVENT);
     }
 
-    /* Create decode rootcheck threads */
-    for(i = 0; i < num_decode_rootcheck_threads;i++){
-        w_create_thread(w_decode_rootcheck_thread,NULL);
+    for(i = 0; i < num_decode_winevt_threads;i++){
+        w_decode_lane_add("winevt", i, decode_queue_winevt_input, w_decode_winevt_batch, NULL, W_LANE_WEIGHT_EVENT);
     }
 
-    /* Create decode Security Configuration Assessment threads */
-    for(i = 0; i < num_decode_sca_threads;i++){
-        w_create_thread(w_decode_sca_thread,NULL);
-    }
+    /* Create the decode threads: one per lane, or a pool shared by all of them */
+    if (num_decode_pool_threads > 0) {
+        mdebug2("Creating %d decode pool threads for %u lanes.", num_decode_pool_threads, decode_pool.count);
+        w_metrics_gauge("wazuh_analysisd_decode_pool_busy", "Decode pool threads working.", NULL, w_metric_decode_pool_busy, &decode_pool);
 
-    /* Create decode event threads */
-    for(i = 0; i < num_decode_event_threads;i++){
-        w_create_thread(w_decode_event_thread,NULL);
+        for(i = 0; i < num_decode_pool_threads;i++){
+            w_create_named_thread(w_lane_pool_main, &decode_pool, "ad-decode-%d", i);
+        }
     }
 
+    w_affinity_leave();
+
     /* Create the process event threads */
+    w_affinity_enter("analysisd", "rules");
+
     for(i = 0; i < num_rule_matching_threads;i++){
-        w_create_thread(w_process_event_thread,(void *) (intptr_t)i);
+        w_create_named_thread(w_process_event_thread, (void *)(intptr_t)i, "ad-rules-%d", i);
     }
 
-    /* Create decode winevt threads */
-    for(i = 0; i < num_decode_winevt_threads;i++){
-        w_create_thread(w_decode_winevt_thread,NULL);
-    }
+    w_affinity_leave();
 
     /* Create database synchronization dispatcher threads */
     for (i = 0; i < num_dispatch_dbsync_threads; i++){
-        w_create_thread(w_dispatch_dbsync_thread, NULL);
+        w_create_named_thread(w_dispatch_dbsync_thread, NULL, "ad-dbsync-%d", i);
+    }
+
+    /* Create active response dispatcher thread */
+    if (Config.ar) {
+        w_create_named_thread(w_ar_dispatch_thread, NULL, "ad-ar");
     }
 
     /* Create State thread */
-    w_create_thread(w_analysisd_state_main,NULL);
+    w_create_named_thread(w_analysisd_state_main, NULL, "ad-state");
+    w_metrics_http_start("analysisd");
 
     mdebug1("Startup completed. Waiting for new messages..");
 
     while (1) {
         sleep(1);
+        ad_memory_update();
     }
 }
 
-/* Checks if the current_rule matches the event information */
-RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching *rule_match)
+/* Check the CDB list lookups of a rule */
+static int OS_CheckRuleLists(Eventinfo *lf, ListRule *list_holder)
+{
+    const char *field;
+
+    while (list_holder) {
+        switch (list_holder->field) {
+            case RULE_SRCIP:
+                if (!lf->srcip) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->srcip)) {
+                    return 0;
+                }
+                break;
+            case RULE_SRCPORT:
+                if (!lf->srcport) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->srcport)) {
+                    return 0;
+                }
+                break;
+            case RULE_DSTIP:
+                if (!lf->dstip) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->dstip)) {
+                    return 0;
+                }
+                break;
+            case RULE_DSTPORT:
+                if (!lf->dstport) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->dstport)) {
+                    return 0;
+                }
+                break;
+            case RULE_USER:
+                if (lf->srcuser) {
+                    if (!OS_DBSearch(list_holder, lf->srcuser)) {
+                        return 0;
+                    }
+                } else if (lf->dstuser) {
+                    if (!OS_DBSearch(list_holder, lf->dstuser)) {
+                        return 0;
+                    }
+                } else {
+                    return 0;
+                }
+                break;
+            case RULE_URL:
+                if (!lf->url) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->url)) {
+                    return 0;
+                }
+                break;
+            case RULE_ID:
+                if (!lf->id) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->id)) {
+                    return 0;
+                }
+                break;
+            case RULE_HOSTNAME:
+                if (!lf->hostname) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->hostname)) {
+                    return 0;
+                }
+                break;
+            case RULE_PROGRAM_NAME:
+                if (!lf->program_name) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->program_name)) {
+                    return 0;
+                }
+                break;
+            case RULE_STATUS:
+                if (!lf->status) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->status)) {
+                    return 0;
+                }
+                break;
+            case RULE_ACTION:
+                if (!lf->action) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->action)) {
+                    return 0;
+                }
+                break;
+            case RULE_SYSTEMNAME:
+                if (!lf->systemname) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->systemname)){
+                    return 0;
+                }
+                break;
+            case RULE_PROTOCOL:
+                if (!lf->protocol) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->protocol)){
+                    return 0;
+                }
+                break;
+            case RULE_DATA:
+                if (!lf->data) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->data)){
+                    return 0;
+                }
+                break;
+            case RULE_EXTRA_DATA:
+                if (!lf->extra_data) {
+                    return 0;
+                }
+                if (!OS_DBSearch(list_holder, lf->extra_data)) {
+                    return 0;
+                }
+                break;
+            case RULE_DYNAMIC:
+                field = FindField(lf, list_holder->dfield);
+
+                if (!(field &&OS_DBSearch(list_holder, (char*)field)))
+                    return 0;
+
+                break;
+            default:
+                return 0;
+        }
+
+        list_holder = list_holder->next;
+    }
+
+    return 1;
+}
+
+/* Checks if the current_rule matches the event information
+ * Profiled rules account their checks to the counters of profile */
+static RuleInfo *OS_CheckRule(Eventinfo *lf, RuleNode *curr_node, regex_matching *rule_match, rule_profile_counters *profile)
 {
     /* We check for:
      * decoded_as,
@@ -1071,14 +1365,29 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
 
     /* Check if any word to match exists */
     if (rule->match) {
-        if (!OSMatch_Execute(lf->log, lf->size, rule->match)) {
+        uint64_t start = rule_profile_start(profile);
+        int matched = OSMatch_Execute(lf->log, lf->size, rule->match);
+
+        rule_profile_stop(profile, RULE_PROFILE_MATCH, start);
+
+        if (!matched) {
             return (NULL);
         }
     }
 
     /* Check if exist any regex for this rule */
     if (rule->regex) {
-        if (!OSRegex_Execute_ex(lf->log, rule->regex, rule_match)) {
+        uint64_t start = rule_profile_start(profile);
+        unsigned long backtracks = profile ? OSRegex_Backtracks() : 0;
+        int matched = OSRegex_Execute_ex(lf->log, rule->regex, rule_match) != NULL;
+
+        rule_profile_stop(profile, RULE_PROFILE_REGEX, start);
+
+        if (profile) {
+            rule_profile_add(&profile->regex_backtracks, OSRegex_Backtracks() - backtracks);
+        }
+
+        if (!matched) {
             return (NULL);
         }
     }
@@ -1117,11 +1426,18 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
     }
 
     /* Check for dynamic fields */
+    if (rule->fields[0]) {
+        uint64_t start = rule_profile_start(profile);
+        int matched = 1;
+
+        for (i = 0; matched && i < Config.decoder_order_size && rule->fields[i]; i++) {
+            field = FindFieldId(lf, rule->fields[i]->id, rule->fields[i]->name);
+            matched = field && OSRegex_Execute_ex(field, rule->fields[i]->regex, rule_match);
+        }
 
-    for (i = 0; i < Config.decoder_order_size && rule->fields[i]; i++) {
-        field = FindField(lf, rule->fields[i]->name);
+        rule_profile_stop(profile, RULE_PROFILE_FIELDS, start);
 
-        if (!(field && OSRegex_Execute_ex(field, rule->fields[i]->regex, rule_match))) {
+        if (!matched) {
             return NULL;
         }
     }
@@ -1325,7 +1641,7 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
             if(_line){
                 os_strdup(_line,_line_cpy);
                 free(_line);
-                if (queue_push_ex_block(writer_queue_log_fts,_line_cpy) < 0) {
+                if (mpmc_queue_push_ex_block(writer_queue_log_fts,_line_cpy) < 0) {
                     free(_line_cpy);
                 }
             }
@@ -1336,146 +1652,13 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
 
     /* List lookups */
     if (rule->lists != NULL) {
-        ListRule *list_holder = rule->lists;
-        while (list_holder) {
-            switch (list_holder->field) {
-                case RULE_SRCIP:
-                    if (!lf->srcip) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->srcip)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_SRCPORT:
-                    if (!lf->srcport) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->srcport)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_DSTIP:
-                    if (!lf->dstip) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->dstip)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_DSTPORT:
-                    if (!lf->dstport) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->dstport)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_USER:
-                    if (lf->srcuser) {
-                        if (!OS_DBSearch(list_holder, lf->srcuser)) {
-                            return (NULL);
-                        }
-                    } else if (lf->dstuser) {
-                        if (!OS_DBSearch(list_holder, lf->dstuser)) {
-                            return (NULL);
-                        }
-                    } else {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_URL:
-                    if (!lf->url) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->url)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_ID:
-                    if (!lf->id) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->id)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_HOSTNAME:
-                    if (!lf->hostname) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->hostname)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_PROGRAM_NAME:
-                    if (!lf->program_name) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->program_name)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_STATUS:
-                    if (!lf->status) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->status)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_ACTION:
-                    if (!lf->action) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->action)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_SYSTEMNAME:
-                    if (!lf->systemname) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->systemname)){
-                        return (NULL);
-                    }
-                    break;
-                case RULE_PROTOCOL:
-                    if (!lf->protocol) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->protocol)){
-                        return (NULL);
-                    }
-                    break;
-                case RULE_DATA:
-                    if (!lf->data) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->data)){
-                        return (NULL);
-                    }
-                    break;
-                case RULE_EXTRA_DATA:
-                    if (!lf->extra_data) {
-                        return (NULL);
-                    }
-                    if (!OS_DBSearch(list_holder, lf->extra_data)) {
-                        return (NULL);
-                    }
-                    break;
-                case RULE_DYNAMIC:
-                    field = FindField(lf, list_holder->dfield);
+        uint64_t start = rule_profile_start(profile);
+        int matched = OS_CheckRuleLists(lf, rule->lists);
 
-                    if (!(field &&OS_DBSearch(list_holder, (char*)field)))
-                        return NULL;
+        rule_profile_stop(profile, RULE_PROFILE_LISTS, start);
 
-                    break;
-                default:
-                    return (NULL);
-            }
-
-            list_holder = list_holder->next;
+        if (!matched) {
+            return (NULL);
         }
     }
 
@@ -1491,6 +1674,10 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
         }
     }
 
+    if (profile) {
+        rule_profile_add(&profile->matches, 1);
+    }
+
 #ifdef TESTRULE
     if (full_output && !alert_only) {
         print_out("       *Rule %d matched.", rule->sigid);
@@ -1508,6 +1695,36 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
         }
 #endif
 
+#ifdef TESTRULE
+        /* Keep the full trace of tried rules in verbose mode */
+        if (curr_node->prefilter && !full_output) {
+#else
+        if (curr_node->prefilter) {
+#endif
+            rule_prefilter *prefilter = curr_node->prefilter;
+            uint64_t candidates[RULE_PREFILTER_MAX_WORDS];
+            uint64_t bits;
+            unsigned int w;
+
+            rule_prefilter_candidates(prefilter, lf, candidates);
+
+            for (w = 0; w < prefilter->words; w++) {
+                for (bits = candidates[w]; bits; bits &= bits - 1) {
+                    child_node = prefilter->nodes[w * 64 + __builtin_ctzll(bits)];
+                    child_rule = OS_CheckIfRuleMatch(lf, child_node, rule_match);
+
+                    if (child_rule != NULL) {
+                        if (!child_rule->prev_rule) {
+                            child_rule->prev_rule = rule;
+                        }
+                        return (child_rule);
+                    }
+                }
+            }
+
+            child_node = NULL;
+        }
+
         while (child_node) {
             child_rule = OS_CheckIfRuleMatch(lf, child_node, rule_match);
             if (child_rule != NULL) {
@@ -1526,9 +1743,7 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
         return (NULL);
     }
 
-    w_mutex_lock(&hourly_alert_mutex);
-    hourly_alerts++;
-    w_mutex_unlock(&hourly_alert_mutex);
+    __atomic_add_fetch(&hourly_alerts, 1, __ATOMIC_RELAXED);
     w_mutex_lock(&rule->mutex);
     rule->firedtimes++;
     lf->r_firedtimes = rule->firedtimes;
@@ -1537,6 +1752,35 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching
     return (rule); /* Matched */
 }
 
+/* Checks if the current_rule matches the event information
+ * In profiling mode, the time of each rule excludes that of its children */
+RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching *rule_match)
+{
+    static __thread uint64_t children_ns;
+    rule_profile_counters *profile;
+    uint64_t parent_children_ns;
+    uint64_t start;
+    uint64_t elapsed;
+    RuleInfo *rule;
+
+    if (!rule_profile_enabled || !(profile = rule_profile_local(curr_node->ruleinfo))) {
+        return OS_CheckRule(lf, curr_node, rule_match, NULL);
+    }
+
+    parent_children_ns = children_ns;
+    children_ns = 0;
+
+    start = rule_profile_now();
+    rule = OS_CheckRule(lf, curr_node, rule_match, profile);
+    elapsed = rule_profile_now() - start;
+
+    rule_profile_add(&profile->evaluations, 1);
+    rule_profile_add(&profile->self_ns, elapsed - children_ns);
+    children_ns = parent_children_ns + elapsed;
+
+    return (rule);
+}
+
 /*  Update each rule and print it to the logs */
 static void LoopRule(RuleNode *curr_node, FILE *flog)
 {
@@ -1613,28 +1857,85 @@ static void DumpLogstats()
     /* Print total for the hour */
     fprintf(flog, "%d--%d--%d--%d--%d\n\n",
             thishour,
-            hourly_alerts, hourly_events, hourly_syscheck, hourly_firewall);
-    hourly_alerts = 0;
-    hourly_events = 0;
-    hourly_syscheck = 0;
-    hourly_firewall = 0;
+            __atomic_exchange_n(&hourly_alerts, 0, __ATOMIC_RELAXED),
+            __atomic_exchange_n(&hourly_events, 0, __ATOMIC_RELAXED),
+            __atomic_exchange_n(&hourly_syscheck, 0, __ATOMIC_RELAXED),
+            __atomic_exchange_n(&hourly_firewall, 0, __ATOMIC_RELAXED));
 
     fclose(flog);
 }
 
 // Message handler thread
+/* Get the next datagram from the input socket, receiving a batch when none is left */
+static int ad_input_socket(int m_queue, char ** message, int flags) {
+    int i;
+
+    if (input_batch.next == input_batch.count) {
+        if (!input_batch.buffer[0]) {
+            for (i = 0; i < AD_INPUT_BATCH; i++) {
+                os_malloc(OS_MAXSTR + 1, input_batch.buffer[i]);
+            }
+        }
+
+        input_batch.next = 0;
+
+        if (input_batch.count = OS_RecvUnixBatch(m_queue, OS_MAXSTR, input_batch.buffer, input_batch.length, AD_INPUT_BATCH, flags), input_batch.count == 0) {
+            return 0;
+        }
+    }
+
+    *message = input_batch.buffer[input_batch.next];
+    return input_batch.length[input_batch.next++];
+}
+
+/* Get the next input message, from the shared rings or the socket */
+static int ad_input_recv(int m_queue, char ** message) {
+    static char * shm_buffer;
+    static unsigned int ring_streak;
+    ssize_t recvd;
+
+    if (!input_shm || input_batch.next < input_batch.count) {
+        return ad_input_socket(m_queue, message, 0);
+    }
+
+    /* Look at the socket now and then, so datagram producers don't starve */
+    if (ring_streak++ == AD_INPUT_RING_STREAK) {
+        ring_streak = 0;
+
+        if (recvd = ad_input_socket(m_queue, message, MSG_DONTWAIT), recvd > 0) {
+            return (int)recvd;
+        }
+    }
+
+    if (!shm_buffer) {
+        os_malloc(OS_MAXSTR + 1, shm_buffer);
+    }
+
+    if (recvd = shm_queue_recv(input_shm, shm_buffer, OS_MAXSTR), recvd > 0) {
+        *message = shm_buffer;
+        return (int)recvd;
+    }
+
+    /* The rings are empty: wait for a datagram, which may be a wake-up call */
+    ring_streak = 0;
+    return ad_input_socket(m_queue, message, 0);
+}
+
 void * ad_input_main(void * args) {
     int m_queue = *(int *)args;
-    char buffer[OS_MAXSTR + 1] = "";
+    w_mpmc_queue_t * queue;
+    char * buffer = NULL;
     char * copy;
+    w_trace_t trace;
     char *msg;
+    size_t message_size;
     int result;
     int recv = 0;
 
     mdebug1("Input message handler thread started.");
 
     while (1) {
-        if (recv = OS_RecvUnix(m_queue, OS_MAXSTR, buffer),recv) {
+        if (recv = ad_input_recv(m_queue, &buffer),recv) {
             buffer[recv] = '\0';
             msg = buffer;
 
@@ -1647,105 +1948,121 @@ void * ad_input_main(void * args) {
                 continue;
             }
 
-            s_events_received++;
+            w_inc_received_events();
+
+            /* A moving average, with weight 1/64 for the last message */
+            message_size = __atomic_load_n(&input_message_size, __ATOMIC_RELAXED);
+            __atomic_store_n(&input_message_size, message_size + ((size_t)recv >> 6) - (message_size >> 6), __ATOMIC_RELAXED);
+
+            if (w_mem_level() == W_MEM_REJECT && ad_input_rejected(msg[0])) {
+                continue;
+            }
 
             if (msg[0] == SYSCHECK_MQ) {
 
                 os_strdup(buffer, copy);
-                if(queue_full(decode_queue_syscheck_input)){
+                queue = w_decode_shard(&decode_queue_syscheck_input, msg);
+
+                if(mpmc_queue_full(queue)){
                     if(!reported_syscheck){
                         reported_syscheck = 1;
                         mwarn("Syscheck decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_SYSCHECK);
                     free(copy);
                     continue;
                 }
 
-                result = queue_push_ex(decode_queue_syscheck_input,copy);
+                result = mpmc_queue_push_ex(queue,copy);
 
                 if(result < 0){
                     if(!reported_syscheck){
                         reported_syscheck = 1;
                         mwarn("Syscheck decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_SYSCHECK);
                     free(copy);
                     continue;
                 }
-                hourly_syscheck++;
+                __atomic_add_fetch(&hourly_syscheck, 1, __ATOMIC_RELAXED);
                 /* Increment number of events received */
-                hourly_events++;
+                __atomic_add_fetch(&hourly_events, 1, __ATOMIC_RELAXED);
             }
             else if(msg[0] == ROOTCHECK_MQ){
                 os_strdup(buffer, copy);
 
-                if(queue_full(decode_queue_rootcheck_input)){
+                queue = w_decode_shard(&decode_queue_rootcheck_input, msg);
+
+                if(mpmc_queue_full(queue)){
                     if(!reported_rootcheck){
                         reported_rootcheck = 1;
                         mwarn("Rootcheck decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_ROOTCHECK);
                     free(copy);
                     continue;
                 }
 
-                result = queue_push_ex(decode_queue_rootcheck_input,copy);
+                result = mpmc_queue_push_ex(queue,copy);
 
                 if(result < 0){
                     if(!reported_rootcheck){
                         reported_rootcheck = 1;
                         mwarn("Rootcheck decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_ROOTCHECK);
                     free(copy);
                     continue;
                 }
 
                 /* Increment number of events received */
-                hourly_events++;
+                __atomic_add_fetch(&hourly_events, 1, __ATOMIC_RELAXED);
             } else if(msg[0] == SCA_MQ){
                 os_strdup(buffer, copy);
 
-                if(queue_full(decode_queue_sca_input)){
+                queue = w_decode_shard(&decode_queue_sca_input, msg);
+
+                if(mpmc_queue_full(queue)){
                     if(!reported_sca){
                         reported_sca = 1;
                         mwarn("Security Configuration Assessment decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_SCA);
                     free(copy);
                     continue;
                 }
 
-                result = queue_push_ex(decode_queue_sca_input,copy);
+                result = mpmc_queue_push_ex(queue,copy);
 
                 if(result < 0){
                     if(!reported_sca){
                         reported_sca = 1;
                         mwarn("Security Configuration Assessment json decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_SCA);
                     free(copy);
                     continue;
                 }
 
                 /* Increment number of events received */
-                hourly_events++;
+                __atomic_add_fetch(&hourly_events, 1, __ATOMIC_RELAXED);
             } else if(msg[0] == SYSCOLLECTOR_MQ){
 
                 os_strdup(buffer, copy);
 
-                if(queue_full(decode_queue_syscollector_input)){
+                queue = w_decode_shard(&decode_queue_syscollector_input, msg);
+
+                if(mpmc_queue_full(queue)){
                     if(!reported_syscollector){
                         reported_syscollector = 1;
                         mwarn("Syscollector decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_SYSCOLLECTOR);
                     free(copy);
                     continue;
                 }
 
-                result = queue_push_ex(decode_queue_syscollector_input,copy);
+                result = mpmc_queue_push_ex(queue,copy);
 
                 if(result < 0){
 
@@ -1753,75 +2070,77 @@ void * ad_input_main(void * args) {
                         reported_syscollector = 1;
                         mwarn("Syscollector decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_SYSCOLLECTOR);
                     free(copy);
                     continue;
                 }
                 /* Increment number of events received */
-                hourly_events++;
+                __atomic_add_fetch(&hourly_events, 1, __ATOMIC_RELAXED);
             }
             else if(msg[0] == HOSTINFO_MQ){
 
                 os_strdup(buffer, copy);
 
-                if(queue_full(decode_queue_hostinfo_input)){
+                queue = w_decode_shard(&decode_queue_hostinfo_input, msg);
+
+                if(mpmc_queue_full(queue)){
                     if(!reported_hostinfo){
                         reported_hostinfo = 1;
                         mwarn("Hostinfo decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_HOSTINFO);
                     free(copy);
                     continue;
                 }
 
-                result = queue_push_ex(decode_queue_hostinfo_input,copy);
+                result = mpmc_queue_push_ex(queue,copy);
 
                 if(result < 0){
                     if(!reported_hostinfo){
                         reported_hostinfo = 1;
                         mwarn("Hostinfo decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_HOSTINFO);
                     free(copy);
                     continue;
                 }
                 /* Increment number of events received */
-                hourly_events++;
+                __atomic_add_fetch(&hourly_events, 1, __ATOMIC_RELAXED);
             }
             else if(msg[0] == WIN_EVT_MQ){
 
                 os_strdup(buffer, copy);
 
-                if(queue_full(decode_queue_winevt_input)){
+                if(mpmc_queue_full(decode_queue_winevt_input)){
                     if(!reported_winevt){
                         reported_winevt = 1;
                         mwarn("Windows eventchannel decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_WINEVT);
                     free(copy);
                     continue;
                 }
 
-                result = queue_push_ex(decode_queue_winevt_input,copy);
+                result = mpmc_queue_push_ex(decode_queue_winevt_input,copy);
 
                 if(result < 0){
                     if(!reported_winevt){
                         reported_winevt = 1;
                         mwarn("Windows eventchannel decoder queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_WINEVT);
                     free(copy);
                     continue;
                 }
                 /* Increment number of events received */
-                hourly_events++;
+                __atomic_add_fetch(&hourly_events, 1, __ATOMIC_RELAXED);
             } else if (msg[0] == DBSYNC_MQ) {
                 result = -1;
 
-                if (!queue_full(dispatch_dbsync_input)) {
+                if (!mpmc_queue_full(dispatch_dbsync_input)) {
                     os_strdup(buffer, copy);
 
-                    result = queue_push_ex(dispatch_dbsync_input, copy);
+                    result = mpmc_queue_push_ex(dispatch_dbsync_input, copy);
 
                     if (result == -1) {
                         free(copy);
@@ -1829,7 +2148,7 @@ void * ad_input_main(void * args) {
                 }
 
                 if (result == -1) {
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_DBSYNC);
 
                     if (!reported_dbsync) {
                         mwarn("Database synchronization messge queue is full.");
@@ -1840,17 +2159,21 @@ void * ad_input_main(void * args) {
 
                 os_strdup(buffer, copy);
 
-                if(queue_full(decode_queue_event_input)){
+                if(mpmc_queue_full(decode_queue_event_input)){
                     if(!reported_event){
                         reported_event = 1;
                         mwarn("Input queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_EVENT);
                     free(copy);
                     continue;
                 }
 
-                result = queue_push_ex(decode_queue_event_input,copy);
+                if (w_trace_begin(&event_tracer, &trace)) {
+                    w_trace_probe_set(&event_input_probe, copy, &trace);
+                }
+
+                result = mpmc_queue_push_ex(decode_queue_event_input,copy);
 
                 if(result < 0){
 
@@ -1858,12 +2181,13 @@ void * ad_input_main(void * args) {
                         reported_event = 1;
                         mwarn("Input queue is full.");
                     }
-                    w_inc_dropped_events();
+                    w_inc_dropped_events(W_INPUT_EVENT);
+                    w_trace_probe_take(&event_input_probe, copy, &trace);
                     free(copy);
                     continue;
                 }
                 /* Increment number of events received */
-                hourly_events++;
+                __atomic_add_fetch(&hourly_events, 1, __ATOMIC_RELAXED);
             }
         }
     }
@@ -1871,8 +2195,79 @@ void * ad_input_main(void * args) {
     return NULL;
 }
 
-void w_free_event_info(Eventinfo *lf) {
-    /** Cleaning the memory **/
+/* Reject the messages of low priority while the memory budget is exceeded.
+ * They come from inventories and assessments that the agents send again.
+ */
+static int ad_input_rejected(char type) {
+    w_input_t input;
+
+    switch (type) {
+    case SYSCOLLECTOR_MQ:
+        input = W_INPUT_SYSCOLLECTOR;
+        break;
+    case HOSTINFO_MQ:
+        input = W_INPUT_HOSTINFO;
+        break;
+    case SCA_MQ:
+        input = W_INPUT_SCA;
+        break;
+    case ROOTCHECK_MQ:
+        input = W_INPUT_ROOTCHECK;
+        break;
+    case DBSYNC_MQ:
+        input = W_INPUT_DBSYNC;
+        break;
+    default:
+        return 0;
+    }
+
+    w_inc_rejected_events(input);
+    return 1;
+}
+
+/* Estimate the memory of the queues and apply the degradation level */
+static void ad_memory_update(void) {
+    size_t message_size;
+    size_t messages;
+    size_t events;
+
+    messages = w_decode_shards_elements(&decode_queue_syscheck_input) +
+               w_decode_shards_elements(&decode_queue_syscollector_input) +
+               w_decode_shards_elements(&decode_queue_rootcheck_input) +
+               w_decode_shards_elements(&decode_queue_sca_input) +
+               w_decode_shards_elements(&decode_queue_hostinfo_input) +
+               mpmc_queue_elements(decode_queue_winevt_input) +
+               mpmc_queue_elements(decode_queue_event_input) +
+               mpmc_queue_elements(dispatch_dbsync_input);
+
+    events = mpmc_queue_elements(decode_queue_event_output) +
+             mpmc_queue_elements(writer_queue) +
+             mpmc_queue_elements(writer_queue_log) +
+             mpmc_queue_elements(writer_queue_log_statistical) +
+             mpmc_queue_elements(writer_queue_log_firewall);
+
+    message_size = __atomic_load_n(&input_message_size, __ATOMIC_RELAXED);
+    w_mem_set(W_MEM_QUEUES, messages * message_size + events * (sizeof(Eventinfo) + message_size));
+
+    /* Entries expire sooner: drop the expired ones now */
+    if (w_mem_update() >= W_MEM_SHRINK) {
+        Accumulate_CleanUp();
+    }
+}
+
+/* Writers can share a copy as long as none of them modifies it */
+int w_event_copy_shareable(void) {
+#ifdef LIBGEOIP_ENABLED
+    /* OS_Log fills in the GeoIP fields of the alert */
+    if (Config.geoipdb_file) {
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+void w_free_event_info(Eventinfo *lf) {
+    /** Cleaning the memory **/
     int force_remove = 1;
     /* Only clear the memory if the eventinfo was not
         * added to the stateful memory
@@ -1902,37 +2297,52 @@ void w_free_event_info(Eventinfo *lf) {
 }
 
 void * w_writer_thread(__attribute__((unused)) void * args ){
-    Eventinfo *lf = NULL;
+    Eventinfo *lf_batch[QUEUE_BATCH_SIZE];
+    size_t batch_n;
+    size_t i;
 
     while(1){
-        /* Receive message from queue */
-        if (lf = queue_pop_ex(writer_queue), lf) {
+        /* Receive messages from queue */
+        batch_n = mpmc_queue_pop_ex_batch(writer_queue, (void **)lf_batch, QUEUE_BATCH_SIZE, NULL);
 
-            w_mutex_lock(&writer_threads_mutex);
+        w_mutex_lock(&writer_threads_mutex);
 
+        for (i = 0; i < batch_n; i++) {
             /* If configured to log all, do it */
             if (Config.logall){
-                OS_Store(lf);
+                OS_Store(lf_batch[i]);
             }
             if (Config.logall_json){
-                jsonout_output_archive(lf);
+                jsonout_output_archive(lf_batch[i]);
             }
+        }
 
-            Free_Eventinfo(lf);
-            w_mutex_unlock(&writer_threads_mutex);
+        w_mutex_unlock(&writer_threads_mutex);
+
+        for (i = 0; i < batch_n; i++) {
+            Free_Eventinfo(lf_batch[i]);
         }
     }
 }
 
 void * w_writer_log_thread(__attribute__((unused)) void * args ){
     Eventinfo *lf;
+    Eventinfo *lf_batch[QUEUE_BATCH_SIZE];
+    size_t batch_n;
+    size_t i;
+    struct timespec start;
 
     while(1){
-            /* Receive message from queue */
-            if (lf = queue_pop_ex(writer_queue_log), lf) {
+            /* Receive messages from queue */
+            batch_n = mpmc_queue_pop_ex_batch(writer_queue_log, (void **)lf_batch, QUEUE_BATCH_SIZE, NULL);
+
+            w_mutex_lock(&writer_threads_mutex);
 
-                w_mutex_lock(&writer_threads_mutex);
+            for (i = 0; i < batch_n; i++) {
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                lf = lf_batch[i];
                 w_inc_alerts_written();
+                w_trace_stage(&event_tracer, &lf->trace, W_TRACE_WRITER_QUEUE);
 
                 if (Config.custom_alert_output) {
                     __crt_ftell = ftell(_aflog);
@@ -1963,323 +2373,342 @@ void * w_writer_log_thread(__attribute__((unused)) void * args ){
                     zeromq_output_event(lf);
                 }
     #endif
-                w_mutex_unlock(&writer_threads_mutex);
-                Free_Eventinfo(lf);
+
+                w_add_stage_latency(W_STAGE_ALERT_WRITING, &start);
+                w_trace_stage(&event_tracer, &lf->trace, W_TRACE_ALERT_WRITING);
+                w_trace_end(&event_tracer, &lf->trace);
+            }
+
+            w_mutex_unlock(&writer_threads_mutex);
+
+            for (i = 0; i < batch_n; i++) {
+                Free_Eventinfo(lf_batch[i]);
             }
     }
 }
 
 
-void * w_decode_syscheck_thread(__attribute__((unused)) void * args){
-    Eventinfo *lf = NULL;
-    char *msg = NULL;
-    _sdb sdb;
-    OSDecoderInfo *fim_decoder = NULL;
+void * w_decode_syscheck_context(void) {
+    w_syscheck_lane_t * context;
 
-    os_calloc(1, sizeof(OSDecoderInfo), fim_decoder);
+    os_calloc(1, sizeof(w_syscheck_lane_t), context);
+    os_calloc(1, sizeof(OSDecoderInfo), context->fim_decoder);
 
     /* Initialize the integrity database */
-    sdb_init(&sdb, fim_decoder);
-
-    while(1){
+    sdb_init(&context->sdb, context->fim_decoder);
+    return context;
+}
 
-        /* Receive message from queue */
-        if (msg = queue_pop_ex(decode_queue_syscheck_input), msg) {
-            int res = 0;
-            os_calloc(1, sizeof(Eventinfo), lf);
-            os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+void w_decode_syscheck_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n){
+    w_syscheck_lane_t * context = lane->context;
+    Eventinfo *lf = NULL;
+    char *msg = NULL;
+    size_t batch_i;
 
-            /* Default values for the log info */
-            Zero_Eventinfo(lf);
+    for (batch_i = 0; batch_i < batch_n; batch_i++) {
+        msg = msg_batch[batch_i];
+        int res = 0;
+        lf = Alloc_Eventinfo();
 
-            if (OS_CleanMSG(msg, lf) < 0) {
-                merror(IMSG_ERROR, msg);
-                Free_Eventinfo(lf);
-                free(msg);
-                continue;
-            }
+        /* Default values for the log info */
+        Zero_Eventinfo(lf);
 
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
             free(msg);
+            continue;
+        }
 
-            /* Msg cleaned */
-            DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
+        free(msg);
 
-            w_inc_syscheck_decoded_events();
-            lf->decoder_info = fim_decoder;
+        /* Msg cleaned */
+        DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
 
-            // If the event comes in JSON format agent version is >= 3.11. Therefore we decode, alert and update DB entry.
-            if (*lf->log == '{') {
-                res = decode_fim_event(&sdb, lf);
-            } else {
-                res = DecodeSyscheck(lf, &sdb);
-            }
+        w_inc_syscheck_decoded_events();
+        lf->decoder_info = context->fim_decoder;
 
-            if (res == 1 && queue_push_ex_block(decode_queue_event_output,lf) == 0) {
-                continue;
-            } else {
-                /* We don't process syscheck events further */
-                w_free_event_info(lf);
-            }
+        // If the event comes in JSON format agent version is >= 3.11. Therefore we decode, alert and update DB entry.
+        if (*lf->log == '{') {
+            res = decode_fim_event(&context->sdb, lf);
+        } else {
+            res = DecodeSyscheck(lf, &context->sdb);
+        }
+
+        if (res == 1 && mpmc_queue_push_ex_block(decode_queue_event_output,lf) == 0) {
+            continue;
+        } else {
+            /* We don't process syscheck events further */
+            w_free_event_info(lf);
         }
     }
+
+    /* Don't keep the database updates of this batch waiting for the next one */
+    fim_flush_db(&context->sdb);
 }
 
-void * w_decode_syscollector_thread(__attribute__((unused)) void * args){
-    Eventinfo *lf = NULL;
-    char *msg = NULL;
-    int socket = -1;
+void * w_decode_socket_context(void) {
+    int * socket;
 
-    while(1){
+    os_malloc(sizeof(int), socket);
+    *socket = -1;
+    return socket;
+}
 
-        /* Receive message from queue */
-        if (msg = queue_pop_ex(decode_queue_syscollector_input), msg) {
-            os_calloc(1, sizeof(Eventinfo), lf);
-            os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+void w_decode_syscollector_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n){
+    int * socket = lane->context;
+    Eventinfo *lf = NULL;
+    char *msg = NULL;
+    size_t batch_i;
 
-            /* Default values for the log info */
-            Zero_Eventinfo(lf);
+    for (batch_i = 0; batch_i < batch_n; batch_i++) {
+        msg = msg_batch[batch_i];
+        lf = Alloc_Eventinfo();
 
-            if (OS_CleanMSG(msg, lf) < 0) {
-                merror(IMSG_ERROR, msg);
-                Free_Eventinfo(lf);
-                free(msg);
-                continue;
-            }
+        /* Default values for the log info */
+        Zero_Eventinfo(lf);
 
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
             free(msg);
+            continue;
+        }
+
+        free(msg);
 
-            /* Msg cleaned */
-            DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
+        /* Msg cleaned */
+        DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
 
-            /** Check the date/hour changes **/
+        /** Check the date/hour changes **/
 
-            if (!DecodeSyscollector(lf,&socket)) {
-                /* We don't process syscollector events further */
+        if (!DecodeSyscollector(lf,socket)) {
+            /* We don't process syscollector events further */
+            w_free_event_info(lf);
+        }
+        else{
+            if (mpmc_queue_push_ex_block(decode_queue_event_output,lf) < 0) {
                 w_free_event_info(lf);
             }
-            else{
-                if (queue_push_ex_block(decode_queue_event_output,lf) < 0) {
-                    w_free_event_info(lf);
-                }
-            }
-
-            w_inc_syscollector_decoded_events();
         }
+
+        w_inc_syscollector_decoded_events();
     }
+
+    /* Don't keep the database updates of this batch waiting for the next one */
+    SyscollectorFlush(socket);
 }
 
-void * w_decode_rootcheck_thread(__attribute__((unused)) void * args){
+void w_decode_rootcheck_batch(__attribute__((unused)) w_lane_t * lane, void ** msg_batch, size_t batch_n){
     Eventinfo *lf = NULL;
     char *msg = NULL;
+    size_t batch_i;
 
-    while(1){
-
-        /* Receive message from queue */
-        if (msg = queue_pop_ex(decode_queue_rootcheck_input), msg) {
-
-            os_calloc(1, sizeof(Eventinfo), lf);
-            os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+    for (batch_i = 0; batch_i < batch_n; batch_i++) {
+        msg = msg_batch[batch_i];
 
-            /* Default values for the log info */
-            Zero_Eventinfo(lf);
+        lf = Alloc_Eventinfo();
 
-            if (OS_CleanMSG(msg, lf) < 0) {
-                merror(IMSG_ERROR, msg);
-                Free_Eventinfo(lf);
-                free(msg);
-                continue;
-            }
+        /* Default values for the log info */
+        Zero_Eventinfo(lf);
 
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
             free(msg);
+            continue;
+        }
+
+        free(msg);
 
-            /* Msg cleaned */
-            DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
+        /* Msg cleaned */
+        DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
 
-            if (!DecodeRootcheck(lf)) {
-                /* We don't process rootcheck events further */
+        if (!DecodeRootcheck(lf)) {
+            /* We don't process rootcheck events further */
+            w_free_event_info(lf);
+        }
+        else{
+            if (mpmc_queue_push_ex_block(decode_queue_event_output,lf) < 0) {
                 w_free_event_info(lf);
             }
-            else{
-                if (queue_push_ex_block(decode_queue_event_output,lf) < 0) {
-                    w_free_event_info(lf);
-                }
-            }
-
-            w_inc_rootcheck_decoded_events();
         }
+
+        w_inc_rootcheck_decoded_events();
     }
 }
 
-void * w_decode_sca_thread(__attribute__((unused)) void * args){
+void w_decode_sca_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n){
+    int * socket = lane->context;
     Eventinfo *lf = NULL;
     char *msg = NULL;
-    int socket = -1;
-
-    while(1){
+    size_t batch_i;
 
-        /* Receive message from queue */
-        if (msg = queue_pop_ex(decode_queue_sca_input), msg) {
+    for (batch_i = 0; batch_i < batch_n; batch_i++) {
+        msg = msg_batch[batch_i];
 
-            os_calloc(1, sizeof(Eventinfo), lf);
-            os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+        lf = Alloc_Eventinfo();
 
-            /* Default values for the log info */
-            Zero_Eventinfo(lf);
-
-            if (OS_CleanMSG(msg, lf) < 0) {
-                merror(IMSG_ERROR, msg);
-                Free_Eventinfo(lf);
-                free(msg);
-                continue;
-            }
+        /* Default values for the log info */
+        Zero_Eventinfo(lf);
 
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
             free(msg);
+            continue;
+        }
+
+        free(msg);
 
-            /* Msg cleaned */
-            DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
+        /* Msg cleaned */
+        DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
 
-            if (!DecodeSCA(lf,&socket)) {
-                /* We don't process rootcheck events further */
+        if (!DecodeSCA(lf,socket)) {
+            /* We don't process rootcheck events further */
+            w_free_event_info(lf);
+        }
+        else{
+            if (mpmc_queue_push_ex_block(decode_queue_event_output,lf) < 0) {
                 w_free_event_info(lf);
             }
-            else{
-                if (queue_push_ex_block(decode_queue_event_output,lf) < 0) {
-                    w_free_event_info(lf);
-                }
-            }
-
-            w_inc_sca_decoded_events();
         }
+
+        w_inc_sca_decoded_events();
     }
 }
 
-void * w_decode_hostinfo_thread(__attribute__((unused)) void * args){
+void w_decode_hostinfo_batch(__attribute__((unused)) w_lane_t * lane, void ** msg_batch, size_t batch_n){
     Eventinfo *lf = NULL;
     char * msg = NULL;
+    size_t batch_i;
 
-    while(1){
-
-        /* Receive message from queue */
-        if (msg = queue_pop_ex(decode_queue_hostinfo_input), msg) {
-            os_calloc(1, sizeof(Eventinfo), lf);
-            os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
-
-            /* Default values for the log info */
-            Zero_Eventinfo(lf);
+    for (batch_i = 0; batch_i < batch_n; batch_i++) {
+        msg = msg_batch[batch_i];
+        lf = Alloc_Eventinfo();
 
-            if (OS_CleanMSG(msg, lf) < 0) {
-                merror(IMSG_ERROR, msg);
-                Free_Eventinfo(lf);
-                free(msg);
-                continue;
-            }
+        /* Default values for the log info */
+        Zero_Eventinfo(lf);
 
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
             free(msg);
-            /* Msg cleaned */
-            DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
+            continue;
+        }
 
-            if (!DecodeHostinfo(lf)) {
-                /* We don't process syscheck events further */
+        free(msg);
+        /* Msg cleaned */
+        DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
+
+        if (!DecodeHostinfo(lf)) {
+            /* We don't process syscheck events further */
+            w_free_event_info(lf);
+        }
+        else{
+            if (mpmc_queue_push_ex_block(decode_queue_event_output,lf) < 0) {
                 w_free_event_info(lf);
             }
-            else{
-                if (queue_push_ex_block(decode_queue_event_output,lf) < 0) {
-                    w_free_event_info(lf);
-                }
-            }
-
-            w_inc_hostinfo_decoded_events();
         }
+
+        w_inc_hostinfo_decoded_events();
     }
 }
 
+void * w_decode_event_context(void) {
+    w_event_lane_t * context;
 
-void * w_decode_event_thread(__attribute__((unused)) void * args){
+    os_calloc(1, sizeof(w_event_lane_t), context);
+    context->sock = -1;
+    return context;
+}
+
+void w_decode_event_batch(w_lane_t * lane, void ** msg_batch, size_t batch_n){
+    w_event_lane_t * context = lane->context;
     Eventinfo *lf = NULL;
     char * msg = NULL;
-    regex_matching decoder_match;
-    memset(&decoder_match, 0, sizeof(regex_matching));
-    int sock = -1;
+    size_t batch_i;
+    Eventinfo * lf_batch[W_LANE_BATCH];
+    size_t lf_n = 0;
+    struct timespec start;
 
-    while(1){
+    for (batch_i = 0; batch_i < batch_n; batch_i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        msg = msg_batch[batch_i];
+        lf = Alloc_Eventinfo();
 
-        /* Receive message from queue */
-        if (msg = queue_pop_ex(decode_queue_event_input), msg) {
-            os_calloc(1, sizeof(Eventinfo), lf);
-            os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+        /* Default values for the log info */
+        Zero_Eventinfo(lf);
 
-            /* Default values for the log info */
-            Zero_Eventinfo(lf);
+        if (w_trace_probe_take(&event_input_probe, msg, &lf->trace)) {
+            w_trace_stage(&event_tracer, &lf->trace, W_TRACE_INPUT_QUEUE);
+        }
 
-            if (OS_CleanMSG(msg, lf) < 0) {
-                merror(IMSG_ERROR, msg);
-                Free_Eventinfo(lf);
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
+            free(msg);
+            continue;
+        }
+
+        if (msg[0] == CISCAT_MQ) {
+            if (!DecodeCiscat(lf, &context->sock)) {
+                w_free_event_info(lf);
                 free(msg);
                 continue;
             }
+        } else {
+            DecodeEvent(lf, &context->decoder_match);
+        }
 
-            if (msg[0] == CISCAT_MQ) {
-                if (!DecodeCiscat(lf, &sock)) {
-                    w_free_event_info(lf);
-                    free(msg);
-                    continue;
-                }
-            } else {
-                DecodeEvent(lf, &decoder_match);
-            }
-
-            free(msg);
-
-            /* Msg cleaned */
-            DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
-
-
+        free(msg);
 
-            if (queue_push_ex_block(decode_queue_event_output,lf) < 0) {
-                Free_Eventinfo(lf);
-            }
+        /* Msg cleaned */
+        DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
 
-            w_inc_decoded_events();
-        }
+        lf_batch[lf_n++] = lf;
+        w_inc_decoded_events();
+        w_add_stage_latency(W_STAGE_DECODING, &start);
+        w_trace_stage(&event_tracer, &lf->trace, W_TRACE_DECODING);
     }
+
+    /* Hand the whole batch to the rule matching threads at once */
+    mpmc_queue_push_ex_batch(decode_queue_event_output, (void **)lf_batch, lf_n);
 }
 
-void * w_decode_winevt_thread(__attribute__((unused)) void * args){
+void w_decode_winevt_batch(__attribute__((unused)) w_lane_t * lane, void ** msg_batch, size_t batch_n){
     Eventinfo *lf = NULL;
     char * msg = NULL;
+    size_t batch_i;
 
-    while(1){
-
-        /* Receive message from queue */
-        if (msg = queue_pop_ex(decode_queue_winevt_input), msg) {
-            os_calloc(1, sizeof(Eventinfo), lf);
-            os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
-
-            /* Default values for the log info */
-            Zero_Eventinfo(lf);
+    for (batch_i = 0; batch_i < batch_n; batch_i++) {
+        msg = msg_batch[batch_i];
+        lf = Alloc_Eventinfo();
 
-            if (OS_CleanMSG(msg, lf) < 0) {
-                merror(IMSG_ERROR, msg);
-                Free_Eventinfo(lf);
-                free(msg);
-                continue;
-            }
+        /* Default values for the log info */
+        Zero_Eventinfo(lf);
 
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
             free(msg);
-            /* Msg cleaned */
-            DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
-            if (DecodeWinevt(lf)) {
-                /* We don't process windows events further */
+            continue;
+        }
+
+        free(msg);
+        /* Msg cleaned */
+        DEBUG_MSG("%s: DEBUG: Msg cleanup: %s ", ARGV0, lf->log);
+        if (DecodeWinevt(lf)) {
+            /* We don't process windows events further */
+            w_free_event_info(lf);
+        }
+        else{
+            if (mpmc_queue_push_ex_block(decode_queue_event_output,lf) < 0) {
                 w_free_event_info(lf);
             }
-            else{
-                if (queue_push_ex_block(decode_queue_event_output,lf) < 0) {
-                    w_free_event_info(lf);
-                }
-            }
-
-            w_inc_winevt_decoded_events();
         }
+
+        w_inc_winevt_decoded_events();
     }
 }
 
@@ -2289,11 +2718,10 @@ void * w_dispatch_dbsync_thread(__attribute__((unused)) void * args) {
     dbsync_context_t ctx = { .db_sock = -1, .ar_sock = -1 };
 
     for (;;) {
-        msg = queue_pop_ex(dispatch_dbsync_input);
+        msg = mpmc_queue_pop_ex(dispatch_dbsync_input);
         assert(msg != NULL);
 
-        os_calloc(1, sizeof(Eventinfo), lf);
-        os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+        lf = Alloc_Eventinfo();
         Zero_Eventinfo(lf);
 
         if (OS_CleanMSG(msg, lf) < 0) {
@@ -2312,6 +2740,15 @@ void * w_dispatch_dbsync_thread(__attribute__((unused)) void * args) {
     return NULL;
 }
 
+/* Check the archive filters once per event: wanted is -1 until they are checked */
+static int w_archive_wanted(const Eventinfo *lf, int *wanted) {
+    if (*wanted < 0) {
+        *wanted = w_archive_filter(lf);
+    }
+
+    return *wanted;
+}
+
 void * w_process_event_thread(__attribute__((unused)) void * id){
 
     Eventinfo *lf = NULL;
@@ -2322,6 +2759,11 @@ void * w_process_event_thread(__attribute__((unused)) void * id){
     memset(&rule_match, 0, sizeof(regex_matching));
     Eventinfo *lf_cpy = NULL;
     Eventinfo *lf_logall = NULL;
+    int archive_wanted;
+    Eventinfo *lf_batch[QUEUE_BATCH_SIZE];
+    size_t batch_n;
+    size_t batch_i;
+    struct timespec start;
 
     /* Stats */
     RuleInfo *stats_rule = NULL;
@@ -2344,270 +2786,284 @@ void * w_process_event_thread(__attribute__((unused)) void * id){
     }
 
     while(1) {
-        RuleNode *rulenode_pt;
-        lf_logall = NULL;
+        /* Extract decoded events from the queue */
+        batch_n = mpmc_queue_pop_ex_batch(decode_queue_event_output, (void **)lf_batch, QUEUE_BATCH_SIZE, NULL);
 
-        /* Extract decoded event from the queue */
-        if (lf = queue_pop_ex(decode_queue_event_output), !lf) {
-            continue;
-        }
-
-        lf->tid = t_id;
-        t_currently_rule = NULL;
+        /* Reloaded lists are picked up between batches */
+        Lists_OP_ReadBegin(t_id);
 
-        lf->size = strlen(lf->log);
-
-        /* Run accumulator */
-        if ( lf->decoder_info->accumulate == 1 ) {
-            w_mutex_lock(&accumulate_mutex);
-            lf = Accumulate(lf);
-            w_mutex_unlock(&accumulate_mutex);
-        }
+        for (batch_i = 0; batch_i < batch_n; batch_i++) {
+            RuleNode *rulenode_pt;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            lf = lf_batch[batch_i];
+            lf_logall = NULL;
+            archive_wanted = -1;
+            w_trace_stage(&event_tracer, &lf->trace, W_TRACE_DECODED_QUEUE);
 
-        /* Firewall event */
-        if (lf->decoder_info->type == FIREWALL) {
-            /* If we could not get any information from
-                * the log, just ignore it
-                */
-            w_mutex_lock(&hourly_firewall_mutex);
-            hourly_firewall++;
-            w_mutex_unlock(&hourly_firewall_mutex);
-            if (Config.logfw) {
-
-                if (!lf->action || !lf->srcip || !lf->dstip || !lf->srcport ||
-                        !lf->dstport || !lf->protocol) {
-                    w_free_event_info(lf);
-                    continue;
-                }
+            lf->tid = t_id;
+            t_currently_rule = NULL;
 
-                os_calloc(1, sizeof(Eventinfo), lf_cpy);
-                w_copy_event_for_log(lf,lf_cpy);
+            lf->size = strlen(lf->log);
 
-                if (queue_push_ex_block(writer_queue_log_firewall, lf_cpy) < 0) {
-                    Free_Eventinfo(lf_cpy);
-                }
+            /* Run accumulator */
+            if ( lf->decoder_info->accumulate == 1 ) {
+                lf = Accumulate(lf);
             }
-        }
-
-        /* Stats checking */
-        if (Config.stats) {
-            w_mutex_lock(&process_event_check_hour_mutex);
-            if (Check_Hour() == 1) {
-                RuleInfo *saved_rule = lf->generated_rule;
-                char *saved_log;
 
-                /* Save previous log */
-                saved_log = lf->full_log;
+            /* Firewall event */
+            if (lf->decoder_info->type == FIREWALL) {
+                /* If we could not get any information from
+                    * the log, just ignore it
+                    */
+                __atomic_add_fetch(&hourly_firewall, 1, __ATOMIC_RELAXED);
+                if (Config.logfw) {
 
-                lf->generated_rule = stats_rule;
-                lf->full_log = __stats_comment;
+                    if (!lf->action || !lf->srcip || !lf->dstip || !lf->srcport ||
+                            !lf->dstport || !lf->protocol) {
+                        w_free_event_info(lf);
+                        continue;
+                    }
 
-                /* Alert for statistical analysis */
-                if (stats_rule && (stats_rule->alert_opts & DO_LOGALERT)) {
-                    os_calloc(1, sizeof(Eventinfo), lf_cpy);
+                    lf_cpy = Alloc_Eventinfo();
                     w_copy_event_for_log(lf,lf_cpy);
 
-                    if (queue_push_ex_block(writer_queue_log_statistical, lf_cpy) < 0) {
+                    if (mpmc_queue_push_ex_block(writer_queue_log_firewall, lf_cpy) < 0) {
                         Free_Eventinfo(lf_cpy);
                     }
                 }
-
-                /* Set lf to the old values */
-                lf->generated_rule = saved_rule;
-                lf->full_log = saved_log;
             }
-            w_mutex_unlock(&process_event_check_hour_mutex);
-        }
 
-        // Insert labels
-        w_mutex_lock(&lf_mutex);
-        lf->labels = labels_find(lf);
-        w_mutex_unlock(&lf_mutex);
+            /* Stats checking */
+            if (Config.stats) {
+                w_mutex_lock(&process_event_check_hour_mutex);
+                if (Check_Hour() == 1) {
+                    RuleInfo *saved_rule = lf->generated_rule;
+                    char *saved_log;
 
-        /* Check the rules */
-        DEBUG_MSG("%s: DEBUG: Checking the rules - %d ",
-                    ARGV0, lf->decoder_info->type);
+                    /* Save previous log */
+                    saved_log = lf->full_log;
 
-        /* Loop over all the rules */
-        rulenode_pt = OS_GetFirstRule();
-        if (!rulenode_pt) {
-            merror_exit("Rules in an inconsistent state. Exiting.");
-        }
-        do {
-            if (lf->decoder_info->type == OSSEC_ALERT) {
-                if (!lf->generated_rule) {
-                    goto next_it;
-                }
+                    lf->generated_rule = stats_rule;
+                    lf->full_log = __stats_comment;
 
-                /* Process the alert */
-                t_currently_rule = lf->generated_rule;
-            }
-            /* Categories must match */
-            else if (rulenode_pt->ruleinfo->category !=
-                        lf->decoder_info->type) {
-                continue;
+                    /* Alert for statistical analysis */
+                    if (stats_rule && (stats_rule->alert_opts & DO_LOGALERT)) {
+                        lf_cpy = Alloc_Eventinfo();
+                        w_copy_event_for_log(lf,lf_cpy);
+
+                        if (mpmc_queue_push_ex_block(writer_queue_log_statistical, lf_cpy) < 0) {
+                            Free_Eventinfo(lf_cpy);
+                        }
+                    }
+
+                    /* Set lf to the old values */
+                    lf->generated_rule = saved_rule;
+                    lf->full_log = saved_log;
+                }
+                w_mutex_unlock(&process_event_check_hour_mutex);
             }
 
-            /* Check each rule */
-            else if ((t_currently_rule = OS_CheckIfRuleMatch(lf, rulenode_pt, &rule_match))
-                        == NULL) {
-                continue;
+            // Insert labels. The set is shared by the events of the agent
+            if (lf->label_set = labels_find(lf), lf->label_set) {
+                lf->labels = lf->label_set->labels;
             }
 
-            /* Ignore level 0 */
-            if (t_currently_rule->level == 0) {
-                break;
+            /* Check the rules */
+            DEBUG_MSG("%s: DEBUG: Checking the rules - %d ",
+                        ARGV0, lf->decoder_info->type);
+
+            /* Loop over all the rules */
+            rulenode_pt = OS_GetFirstRule();
+            if (!rulenode_pt) {
+                merror_exit("Rules in an inconsistent state. Exiting.");
             }
+            do {
+                if (lf->decoder_info->type == OSSEC_ALERT) {
+                    if (!lf->generated_rule) {
+                        goto next_it;
+                    }
 
-            /* Check ignore time */
-            if (t_currently_rule->ignore_time) {
-                if (t_currently_rule->time_ignored == 0) {
-                    t_currently_rule->time_ignored = lf->generate_time;
+                    /* Process the alert */
+                    t_currently_rule = lf->generated_rule;
                 }
-                /* If the current time - the time the rule was ignored
-                    * is less than the time it should be ignored,
-                    * alert about the parent one instead
-                    */
-                else if ((lf->generate_time - t_currently_rule->time_ignored)
-                            < t_currently_rule->ignore_time) {
-                    if (t_currently_rule->prev_rule) {
-                        t_currently_rule = (RuleInfo*)t_currently_rule->prev_rule;
-                        w_FreeArray(lf->last_events);
+                /* Categories must match */
+                else if (rulenode_pt->ruleinfo->category !=
+                            lf->decoder_info->type) {
+                    continue;
+                }
+
+                /* Check each rule */
+                else if ((t_currently_rule = OS_CheckIfRuleMatch(lf, rulenode_pt, &rule_match))
+                            == NULL) {
+                    continue;
+                }
+
+                /* Ignore level 0 */
+                if (t_currently_rule->level == 0) {
+                    break;
+                }
+
+                /* Check ignore time */
+                if (t_currently_rule->ignore_time) {
+                    if (t_currently_rule->time_ignored == 0) {
+                        t_currently_rule->time_ignored = lf->generate_time;
+                    }
+                    /* If the current time - the time the rule was ignored
+                        * is less than the time it should be ignored,
+                        * alert about the parent one instead
+                        */
+                    else if ((lf->generate_time - t_currently_rule->time_ignored)
+                                < t_currently_rule->ignore_time) {
+                        if (t_currently_rule->prev_rule) {
+                            t_currently_rule = (RuleInfo*)t_currently_rule->prev_rule;
+                            w_FreeArray(lf->last_events);
+                        } else {
+                            break;
+                        }
                     } else {
-                        break;
+                        t_currently_rule->time_ignored = lf->generate_time;
                     }
-                } else {
-                    t_currently_rule->time_ignored = lf->generate_time;
                 }
-            }
 
-            /* Pointer to the rule that generated it */
-            lf->generated_rule = t_currently_rule;
+                /* Pointer to the rule that generated it */
+                lf->generated_rule = t_currently_rule;
 
-            /* Check if we should ignore it */
-            if (t_currently_rule->ckignore && IGnore(lf, t_id)) {
-                /* Ignore rule */
-                lf->generated_rule = NULL;
-                break;
-            }
+                /* Check if we should ignore it */
+                if (t_currently_rule->ckignore && IGnore(lf, t_id)) {
+                    /* Ignore rule */
+                    lf->generated_rule = NULL;
+                    break;
+                }
 
-            /* Check if we need to add to ignore list */
-            if (t_currently_rule->ignore) {
-                AddtoIGnore(lf, t_id);
-            }
+                /* Check if we need to add to ignore list */
+                if (t_currently_rule->ignore) {
+                    AddtoIGnore(lf, t_id);
+                }
 
-            /* Log the alert if configured to */
-            if (t_currently_rule->alert_opts & DO_LOGALERT) {
-                lf->comment = ParseRuleComment(lf);
+                /* Log the alert if configured to */
+                if (t_currently_rule->alert_opts & DO_LOGALERT) {
+                    lf->comment = ParseRuleComment(lf);
 
-                os_calloc(1, sizeof(Eventinfo), lf_cpy);
-                w_copy_event_for_log(lf,lf_cpy);
-                if (queue_push_ex_block(writer_queue_log, lf_cpy) < 0) {
-                    Free_Eventinfo(lf_cpy);
-                }
-            }
+                    lf_cpy = Alloc_Eventinfo();
+                    w_copy_event_for_log(lf,lf_cpy);
 
-            /* Execute an active response */
-            if (t_currently_rule->ar) {
-                int do_ar;
-                active_response **rule_ar;
+                    /* The alert carries on the trace of the event */
+                    if (lf->trace.id) {
+                        w_trace_stage(&event_tracer, &lf->trace, W_TRACE_RULE_MATCHING);
+                        lf_cpy->trace = lf->trace;
+                        lf->trace.id = 0;
+                    }
 
-                rule_ar = t_currently_rule->ar;
+                    /* The archives writer gets the same copy */
+                    if ((Config.logall || Config.logall_json) && w_event_copy_shareable() && w_archive_wanted(lf, &archive_wanted)) {
+                        lf_cpy->refs = 2;
+                        lf_logall = lf_cpy;
+                    }
 
-                while (*rule_ar) {
-                    do_ar = 1;
-                    if ((*rule_ar)->ar_cmd->expect & USERNAME) {
-                        if (!lf->dstuser ||
-                                !OS_PRegex(lf->dstuser, "^[a-zA-Z._0-9@?-]*$")) {
-                            if (lf->dstuser) {
-                                mwarn(CRAFTED_USER, lf->dstuser);
+                    if (mpmc_queue_push_ex_block(writer_queue_log, lf_cpy) < 0) {
+                        Free_Eventinfo(lf_cpy);
+                    }
+                }
+
+                /* Execute an active response */
+                if (t_currently_rule->ar) {
+                    int do_ar;
+                    active_response **rule_ar;
+
+                    rule_ar = t_currently_rule->ar;
+
+                    while (*rule_ar) {
+                        do_ar = 1;
+                        if ((*rule_ar)->ar_cmd->expect & USERNAME) {
+                            if (!lf->dstuser ||
+                                    !OS_PRegex(lf->dstuser, "^[a-zA-Z._0-9@?-]*$")) {
+                                if (lf->dstuser) {
+                                    mwarn(CRAFTED_USER, lf->dstuser);
+                                }
+                                do_ar = 0;
                             }
-                            do_ar = 0;
                         }
-                    }
-                    if ((*rule_ar)->ar_cmd->expect & SRCIP) {
-                        if (!lf->srcip ||
-                                !OS_PRegex(lf->srcip, "^[a-zA-Z.:_0-9-]*$")) {
-                            if (lf->srcip) {
-                                mwarn(CRAFTED_IP, lf->srcip);
+                        if ((*rule_ar)->ar_cmd->expect & SRCIP) {
+                            if (!lf->srcip ||
+                                    !OS_PRegex(lf->srcip, "^[a-zA-Z.:_0-9-]*$")) {
+                                if (lf->srcip) {
+                                    mwarn(CRAFTED_IP, lf->srcip);
+                                }
+                                do_ar = 0;
                             }
-                            do_ar = 0;
                         }
-                    }
-                    if ((*rule_ar)->ar_cmd->expect & FILENAME) {
-                        if (!lf->filename) {
-                            do_ar = 0;
+                        if ((*rule_ar)->ar_cmd->expect & FILENAME) {
+                            if (!lf->filename) {
+                                do_ar = 0;
+                            }
                         }
-                    }
 
-                    if (do_ar && execdq >= 0) {
-                        OS_Exec(execdq, arq, lf, *rule_ar);
+                        if (do_ar && execdq >= 0) {
+                            OS_Exec(execdq, arq, lf, *rule_ar);
+                        }
+                        rule_ar++;
                     }
-                    rule_ar++;
                 }
-            }
 
 
-            /* Copy the structure to the state memory of if_matched_sid */
-            if (t_currently_rule->sid_prev_matched) {
-                OSListNode *node;
-                w_mutex_lock(&t_currently_rule->mutex);
-                if (node = OSList_AddData(t_currently_rule->sid_prev_matched, lf), !node) {
-                    merror("Unable to add data to sig list.");
-                } else {
-                    lf->sid_node_to_delete = node;
+                /* Copy the structure to the state memory of if_matched_sid.
+                 * Each list keeps its own reference to the event.
+                 */
+                if (t_currently_rule->sid_prev_matched) {
+                    OS_AddEvent(Hold_Eventinfo(lf), t_currently_rule->sid_prev_matched);
                 }
-                w_mutex_unlock(&t_currently_rule->mutex);
-            }
-            /* Group list */
-            else if (t_currently_rule->group_prev_matched) {
-                unsigned int j = 0;
-                OSListNode *node;
+                /* Group list */
+                else if (t_currently_rule->group_prev_matched) {
+                    unsigned int j = 0;
 
-                w_mutex_lock(&t_currently_rule->mutex);
-                os_calloc(t_currently_rule->group_prev_matched_sz, sizeof(OSListNode *), lf->group_node_to_delete);
-                while (j < t_currently_rule->group_prev_matched_sz) {
-                    if (node = OSList_AddData(t_currently_rule->group_prev_matched[j], lf), !node) {
-                        merror("Unable to add data to grp list.");
-                    } else {
-                        lf->group_node_to_delete[j] = node;
+                    while (j < t_currently_rule->group_prev_matched_sz) {
+                        OS_AddEvent(Hold_Eventinfo(lf), t_currently_rule->group_prev_matched[j]);
+                        j++;
                     }
-                    j++;
                 }
-                w_mutex_unlock(&t_currently_rule->mutex);
-            }
 
-            lf->queue_added = 1;
-            os_calloc(1, sizeof(Eventinfo), lf_logall);
-            w_copy_event_for_log(lf, lf_logall);
-            w_free_event_info(lf);
-            OS_AddEvent(lf, last_events_list);
-            break;
+                lf->queue_added = 1;
+
+                if (!lf_logall && (Config.logall || Config.logall_json) && w_archive_wanted(lf, &archive_wanted)) {
+                    lf_logall = Alloc_Eventinfo();
+                    w_copy_event_for_log(lf, lf_logall);
+                }
+
+                w_free_event_info(lf);
+                OS_AddEvent(lf, last_events_list);
+                break;
 
-        } while ((rulenode_pt = rulenode_pt->next) != NULL);
+            } while ((rulenode_pt = rulenode_pt->next) != NULL);
 
-        w_inc_processed_events();
+            w_inc_processed_events();
+            w_add_stage_latency(W_STAGE_RULE_MATCHING, &start);
+            w_trace_stage(&event_tracer, &lf->trace, W_TRACE_RULE_MATCHING);
+            w_trace_end(&event_tracer, &lf->trace);
 
-        if (Config.logall || Config.logall_json){
-            if (!lf_logall) {
-                os_calloc(1, sizeof(Eventinfo), lf_logall);
-                w_copy_event_for_log(lf, lf_logall);
-            }
-            result = queue_push_ex(writer_queue, lf_logall);
-            if (result < 0) {
-                if(!reported_writer){
-                    reported_writer = 1;
-                    mwarn("Archive writer queue is full. %d", t_id);
+            /* Filtered out events are never copied */
+            if ((Config.logall || Config.logall_json) && (lf_logall || w_archive_wanted(lf, &archive_wanted))) {
+                if (!lf_logall) {
+                    lf_logall = Alloc_Eventinfo();
+                    w_copy_event_for_log(lf, lf_logall);
                 }
+                result = mpmc_queue_push_ex(writer_queue, lf_logall);
+                if (result < 0) {
+                    if(!reported_writer){
+                        reported_writer = 1;
+                        mwarn("Archive writer queue is full. %d", t_id);
+                    }
+                    Free_Eventinfo(lf_logall);
+                }
+            } else if (lf_logall) {
                 Free_Eventinfo(lf_logall);
             }
-        } else if (lf_logall) {
-            Free_Eventinfo(lf_logall);
-        }
 next_it:
-        if (!lf->queue_added) {
-            w_free_event_info(lf);
+            if (!lf->queue_added) {
+                w_free_event_info(lf);
+            }
         }
+
+        Lists_OP_ReadEnd(t_id);
     }
 }
 
@@ -2658,19 +3114,25 @@ void * w_log_rotate_thread(__attribute__((unused)) void * args){
 
         OS_RotateLogs(day,year,mon);
         w_mutex_unlock(&writer_threads_mutex);
-        sleep(1);
+        w_time_delay(Config.log_flush_interval);
     }
 }
 
 void * w_writer_log_statistical_thread(__attribute__((unused)) void * args ){
 
     Eventinfo *lf;
+    Eventinfo *lf_batch[QUEUE_BATCH_SIZE];
+    size_t batch_n;
+    size_t i;
 
     while(1){
-            /* Receive message from queue */
-        if (lf = queue_pop_ex(writer_queue_log_statistical), lf) {
+            /* Receive messages from queue */
+        batch_n = mpmc_queue_pop_ex_batch(writer_queue_log_statistical, (void **)lf_batch, QUEUE_BATCH_SIZE, NULL);
 
-            w_mutex_lock(&writer_threads_mutex);
+        w_mutex_lock(&writer_threads_mutex);
+
+        for (i = 0; i < batch_n; i++) {
+            lf = lf_batch[i];
 
             if (Config.custom_alert_output) {
                 __crt_ftell = ftell(_aflog);
@@ -2686,28 +3148,37 @@ void * w_writer_log_statistical_thread(__attribute__((unused)) void * args ){
             if (Config.jsonout_output) {
                 jsonout_output_event(lf);
             }
+        }
 
-            w_mutex_unlock(&writer_threads_mutex);
+        w_mutex_unlock(&writer_threads_mutex);
 
-            Free_Eventinfo(lf);
+        for (i = 0; i < batch_n; i++) {
+            Free_Eventinfo(lf_batch[i]);
         }
     }
 }
 
 void * w_writer_log_firewall_thread(__attribute__((unused)) void * args ){
 
-    Eventinfo *lf;
+    Eventinfo *lf_batch[QUEUE_BATCH_SIZE];
+    size_t batch_n;
+    size_t i;
 
     while(1){
-            /* Receive message from queue */
-        if (lf = queue_pop_ex(writer_queue_log_firewall), lf) {
+            /* Receive messages from queue */
+        batch_n = mpmc_queue_pop_ex_batch(writer_queue_log_firewall, (void **)lf_batch, QUEUE_BATCH_SIZE, NULL);
 
-            w_mutex_lock(&writer_threads_mutex);
+        w_mutex_lock(&writer_threads_mutex);
+
+        for (i = 0; i < batch_n; i++) {
             w_inc_firewall_written();
-            FW_Log(lf);
-            w_mutex_unlock(&writer_threads_mutex);
+            FW_Log(lf_batch[i]);
+        }
 
-            Free_Eventinfo(lf);
+        w_mutex_unlock(&writer_threads_mutex);
+
+        for (i = 0; i < batch_n; i++) {
+            Free_Eventinfo(lf_batch[i]);
         }
     }
 }
@@ -2736,52 +3207,80 @@ void w_log_flush(){
         OS_Log_Flush();
     }
 
-    FTS_Flush();
+    if (Config.logfw) {
+        FW_Log_Flush();
+    }
 
+    /* Let tail readers decompress everything written so far */
+    OS_SyncLogs();
 }
 
 void * w_writer_log_fts_thread(__attribute__((unused)) void * args ){
 
-    char * line;
+    char * line_batch[QUEUE_BATCH_SIZE];
+    size_t batch_n;
+    size_t i;
 
     while(1){
-        /* Receive message from queue */
-        if (line = queue_pop_ex(writer_queue_log_fts), line) {
+        /* Receive messages from queue */
+        batch_n = mpmc_queue_pop_ex_batch(writer_queue_log_fts, (void **)line_batch, QUEUE_BATCH_SIZE, NULL);
 
-            w_mutex_lock(&writer_threads_mutex);
+        w_mutex_lock(&writer_threads_mutex);
+
+        for (i = 0; i < batch_n; i++) {
             w_inc_fts_written();
-            FTS_Fprintf(line);
-            w_mutex_unlock(&writer_threads_mutex);
+        }
 
-            free(line);
+        /* One seek and one flush for the whole batch */
+        FTS_Fprintf_Batch(line_batch, batch_n);
+
+        w_mutex_unlock(&writer_threads_mutex);
+
+        for (i = 0; i < batch_n; i++) {
+            free(line_batch[i]);
         }
     }
 }
 
 void w_get_queues_size(){
 
-    s_syscheck_queue = ((decode_queue_syscheck_input->elements / (float)decode_queue_syscheck_input->size));
-    s_syscollector_queue = ((decode_queue_syscollector_input->elements / (float)decode_queue_syscollector_input->size));
-    s_rootcheck_queue = ((decode_queue_rootcheck_input->elements / (float)decode_queue_rootcheck_input->size));
-    s_sca_queue = ((decode_queue_sca_input->elements / (float)decode_queue_sca_input->size));
-    s_hostinfo_queue = ((decode_queue_hostinfo_input->elements / (float)decode_queue_hostinfo_input->size));
-    s_winevt_queue = ((decode_queue_winevt_input->elements / (float)decode_queue_winevt_input->size));
-    s_event_queue = ((decode_queue_event_input->elements / (float)decode_queue_event_input->size));
-    s_process_event_queue = ((decode_queue_event_output->elements / (float)decode_queue_event_output->size));
-    s_dbsync_message_queue = ((dispatch_dbsync_input->elements / (float)dispatch_dbsync_input->size));
-
-    s_writer_archives_queue = ((writer_queue->elements / (float)writer_queue->size));
-    s_writer_alerts_queue = ((writer_queue_log->elements / (float)writer_queue_log->size));
-    s_writer_statistical_queue = ((writer_queue_log_statistical->elements / (float)writer_queue_log_statistical->size));
-    s_writer_firewall_queue = ((writer_queue_log_firewall->elements / (float)writer_queue_log_firewall->size));
+    s_syscheck_queue = (w_decode_shards_elements(&decode_queue_syscheck_input) / (float)decode_queue_syscheck_input.size);
+    s_syscollector_queue = (w_decode_shards_elements(&decode_queue_syscollector_input) / (float)decode_queue_syscollector_input.size);
+    s_rootcheck_queue = (w_decode_shards_elements(&decode_queue_rootcheck_input) / (float)decode_queue_rootcheck_input.size);
+    s_sca_queue = (w_decode_shards_elements(&decode_queue_sca_input) / (float)decode_queue_sca_input.size);
+    s_hostinfo_queue = (w_decode_shards_elements(&decode_queue_hostinfo_input) / (float)decode_queue_hostinfo_input.size);
+    s_winevt_queue = (mpmc_queue_elements(decode_queue_winevt_input) / (float)decode_queue_winevt_input->size);
+    s_event_queue = (mpmc_queue_elements(decode_queue_event_input) / (float)decode_queue_event_input->size);
+    s_process_event_queue = (mpmc_queue_elements(decode_queue_event_output) / (float)decode_queue_event_output->size);
+    s_dbsync_message_queue = (mpmc_queue_elements(dispatch_dbsync_input) / (float)dispatch_dbsync_input->size);
+
+    s_writer_archives_queue = (mpmc_queue_elements(writer_queue) / (float)writer_queue->size);
+    s_writer_alerts_queue = (mpmc_queue_elements(writer_queue_log) / (float)writer_queue_log->size);
+    s_writer_statistical_queue = (mpmc_queue_elements(writer_queue_log_statistical) / (float)writer_queue_log_statistical->size);
+    s_writer_firewall_queue = (mpmc_queue_elements(writer_queue_log_firewall) / (float)writer_queue_log_firewall->size);
+
+    s_syscheck_queue_peak = w_decode_shards_take_high_water(&decode_queue_syscheck_input);
+    s_syscollector_queue_peak = w_decode_shards_take_high_water(&decode_queue_syscollector_input);
+    s_rootcheck_queue_peak = w_decode_shards_take_high_water(&decode_queue_rootcheck_input);
+    s_sca_queue_peak = w_decode_shards_take_high_water(&decode_queue_sca_input);
+    s_hostinfo_queue_peak = w_decode_shards_take_high_water(&decode_queue_hostinfo_input);
+    s_winevt_queue_peak = mpmc_queue_take_high_water(decode_queue_winevt_input);
+    s_event_queue_peak = mpmc_queue_take_high_water(decode_queue_event_input);
+    s_process_event_queue_peak = mpmc_queue_take_high_water(decode_queue_event_output);
+    s_dbsync_message_queue_peak = mpmc_queue_take_high_water(dispatch_dbsync_input);
+
+    s_writer_archives_queue_peak = mpmc_queue_take_high_water(writer_queue);
+    s_writer_alerts_queue_peak = mpmc_queue_take_high_water(writer_queue_log);
+    s_writer_statistical_queue_peak = mpmc_queue_take_high_water(writer_queue_log_statistical);
+    s_writer_firewall_queue_peak = mpmc_queue_take_high_water(writer_queue_log_firewall);
 }
 
 void w_get_initial_queues_size(){
-    s_syscheck_queue_size = decode_queue_syscheck_input->size;
-    s_syscollector_queue_size = decode_queue_syscollector_input->size;
-    s_rootcheck_queue_size = decode_queue_rootcheck_input->size;
-    s_sca_queue_size = decode_queue_sca_input->size;
-    s_hostinfo_queue_size = decode_queue_hostinfo_input->size;
+    s_syscheck_queue_size = decode_queue_syscheck_input.size;
+    s_syscollector_queue_size = decode_queue_syscollector_input.size;
+    s_rootcheck_queue_size = decode_queue_rootcheck_input.size;
+    s_sca_queue_size = decode_queue_sca_input.size;
+    s_hostinfo_queue_size = decode_queue_hostinfo_input.size;
     s_winevt_queue_size = decode_queue_winevt_input->size;
     s_event_queue_size = decode_queue_event_input->size;
     s_process_event_queue_size = decode_queue_event_output->size;
@@ -2795,44 +3294,146 @@ void w_get_initial_queues_size(){
 
 void w_init_queues(){
      /* Init the archives writer queue */
-    writer_queue = queue_init(getDefine_Int("analysisd", "archives_queue_size", 0, 2000000));
+    writer_queue = mpmc_queue_init(getDefine_Int("analysisd", "archives_queue_size", 0, 2000000));
 
     /* Init the alerts log writer queue */
-    writer_queue_log = queue_init(getDefine_Int("analysisd", "alerts_queue_size", 0, 2000000));
+    writer_queue_log = mpmc_queue_init(getDefine_Int("analysisd", "alerts_queue_size", 0, 2000000));
 
     /* Init statistical the log writer queue */
-    writer_queue_log_statistical = queue_init(getDefine_Int("analysisd", "statistical_queue_size", 0, 2000000));
+    writer_queue_log_statistical = mpmc_queue_init(getDefine_Int("analysisd", "statistical_queue_size", 0, 2000000));
 
     /* Init the firewall log writer queue */
-    writer_queue_log_firewall = queue_init(getDefine_Int("analysisd", "firewall_queue_size", 0, 2000000));
+    writer_queue_log_firewall = mpmc_queue_init(getDefine_Int("analysisd", "firewall_queue_size", 0, 2000000));
 
     /* Init the FTS log writer queue */
-    writer_queue_log_fts = queue_init(getDefine_Int("analysisd", "fts_queue_size", 0, 2000000));
+    writer_queue_log_fts = mpmc_queue_init(getDefine_Int("analysisd", "fts_queue_size", 0, 2000000));
 
     /* Init the decode syscheck queue input */
-    decode_queue_syscheck_input = queue_init(getDefine_Int("analysisd", "decode_syscheck_queue_size", 0, 2000000));
+    w_decode_shards_init(&decode_queue_syscheck_input, getDefine_Int("analysisd", "syscheck_threads", 0, 32), getDefine_Int("analysisd", "decode_syscheck_queue_size", 0, 2000000));
 
     /* Init the decode syscollector queue input */
-    decode_queue_syscollector_input = queue_init(getDefine_Int("analysisd", "decode_syscollector_queue_size", 0, 2000000));
+    w_decode_shards_init(&decode_queue_syscollector_input, getDefine_Int("analysisd", "syscollector_threads", 0, 32), getDefine_Int("analysisd", "decode_syscollector_queue_size", 0, 2000000));
 
     /* Init the decode rootcheck queue input */
-    decode_queue_rootcheck_input = queue_init(getDefine_Int("analysisd", "decode_rootcheck_queue_size", 0, 2000000));
+    w_decode_shards_init(&decode_queue_rootcheck_input, getDefine_Int("analysisd", "rootcheck_threads", 0, 32), getDefine_Int("analysisd", "decode_rootcheck_queue_size", 0, 2000000));
 
     /* Init the decode rootcheck json queue input */
-    decode_queue_sca_input = queue_init(getDefine_Int("analysisd", "decode_sca_queue_size", 0, 2000000));
+    w_decode_shards_init(&decode_queue_sca_input, getDefine_Int("analysisd", "sca_threads", 0, 32), getDefine_Int("analysisd", "decode_sca_queue_size", 0, 2000000));
 
     /* Init the decode hostinfo queue input */
-    decode_queue_hostinfo_input = queue_init(getDefine_Int("analysisd", "decode_hostinfo_queue_size", 0, 2000000));
+    w_decode_shards_init(&decode_queue_hostinfo_input, getDefine_Int("analysisd", "hostinfo_threads", 0, 32), getDefine_Int("analysisd", "decode_hostinfo_queue_size", 0, 2000000));
 
     /* Init the decode winevt queue input */
-    decode_queue_winevt_input = queue_init(getDefine_Int("analysisd", "decode_winevt_queue_size", 0, 2000000));
+    decode_queue_winevt_input = mpmc_queue_init(getDefine_Int("analysisd", "decode_winevt_queue_size", 0, 2000000));
 
     /* Init the decode event queue input */
-    decode_queue_event_input = queue_init(getDefine_Int("analysisd", "decode_event_queue_size", 0, 2000000));
+    decode_queue_event_input = mpmc_queue_init(getDefine_Int("analysisd", "decode_event_queue_size", 0, 2000000));
 
     /* Init the decode event queue output */
-    decode_queue_event_output = queue_init(getDefine_Int("analysisd", "decode_output_queue_size", 0, 2000000));
+    decode_queue_event_output = mpmc_queue_init(getDefine_Int("analysisd", "decode_output_queue_size", 0, 2000000));
 
     /* Initialize database synchronization message queue */
-    dispatch_dbsync_input = queue_init(getDefine_Int("analysisd", "dbsync_queue_size", 0, 2000000));
+    dispatch_dbsync_input = mpmc_queue_init(getDefine_Int("analysisd", "dbsync_queue_size", 0, 2000000));
+
+    /* Init the active response queue */
+    if (Config.ar) {
+        OS_ExecInit(getDefine_Int("analysisd", "ar_queue_size", 128, 2000000), getDefine_Int("analysisd", "ar_dedup_window", 0, 3600));
+    }
+}
+
+void w_init_queues_metrics(){
+    const char * help = "Events waiting in each queue.";
+    const char * name = "wazuh_analysisd_queue_elements";
+
+    w_metrics_gauge(name, help, "queue=\"syscheck\"", w_metric_shards_elements, &decode_queue_syscheck_input);
+    w_metrics_gauge(name, help, "queue=\"syscollector\"", w_metric_shards_elements, &decode_queue_syscollector_input);
+    w_metrics_gauge(name, help, "queue=\"rootcheck\"", w_metric_shards_elements, &decode_queue_rootcheck_input);
+    w_metrics_gauge(name, help, "queue=\"sca\"", w_metric_shards_elements, &decode_queue_sca_input);
+    w_metrics_gauge(name, help, "queue=\"hostinfo\"", w_metric_shards_elements, &decode_queue_hostinfo_input);
+    w_metrics_gauge(name, help, "queue=\"winevt\"", w_metric_queue_elements, decode_queue_winevt_input);
+    w_metrics_gauge(name, help, "queue=\"event\"", w_metric_queue_elements, decode_queue_event_input);
+    w_metrics_gauge(name, help, "queue=\"rule_matching\"", w_metric_queue_elements, decode_queue_event_output);
+    w_metrics_gauge(name, help, "queue=\"dbsync\"", w_metric_queue_elements, dispatch_dbsync_input);
+    w_metrics_gauge(name, help, "queue=\"archives\"", w_metric_queue_elements, writer_queue);
+    w_metrics_gauge(name, help, "queue=\"alerts\"", w_metric_queue_elements, writer_queue_log);
+    w_metrics_gauge(name, help, "queue=\"statistical\"", w_metric_queue_elements, writer_queue_log_statistical);
+    w_metrics_gauge(name, help, "queue=\"firewall\"", w_metric_queue_elements, writer_queue_log_firewall);
+    w_metrics_gauge(name, help, "queue=\"fts\"", w_metric_queue_elements, writer_queue_log_fts);
+}
+
+double w_metric_shards_elements(void * shards) {
+    return w_decode_shards_elements(shards);
+}
+
+double w_metric_queue_elements(void * queue) {
+    return mpmc_queue_elements(queue);
+}
+
+void w_decode_shards_init(w_decode_shards_t * shards, int n, int size) {
+    unsigned int i;
+
+    shards->count = n > 0 ? n : (cpu_cores > 0 ? cpu_cores : 1);
+    shards->size = 0;
+    os_calloc(shards->count, sizeof(w_mpmc_queue_t *), shards->queues);
+
+    for (i = 0; i < shards->count; i++) {
+        shards->queues[i] = mpmc_queue_init(size / shards->count > 0 ? size / shards->count : 1);
+        shards->size += shards->queues[i]->size;
+    }
+}
+
+w_mpmc_queue_t * w_decode_shard(const w_decode_shards_t * shards, const char * msg) {
+    unsigned long id = 0;
+
+    /* Messages from agents look like "<queue>:[<id>] (<name>) <ip>->..."
+     * Local ones go to the first queue */
+    if (msg[1] == ':' && msg[2] == '[') {
+        id = strtoul(msg + 3, NULL, 10);
+    }
+
+    return shards->queues[id % shards->count];
+}
+
+size_t w_decode_shards_elements(const w_decode_shards_t * shards) {
+    size_t elements = 0;
+    unsigned int i;
+
+    for (i = 0; i < shards->count; i++) {
+        elements += mpmc_queue_elements(shards->queues[i]);
+    }
+
+    return elements;
+}
+
+size_t w_decode_shards_take_high_water(w_decode_shards_t * shards) {
+    size_t high_water = 0;
+    unsigned int i;
+
+    for (i = 0; i < shards->count; i++) {
+        high_water += mpmc_queue_take_high_water(shards->queues[i]);
+    }
+
+    return high_water;
+}
+
+void w_decode_lane_add(const char * name, int id, w_mpmc_queue_t * queue, w_lane_work_t work, void * context, unsigned int weight) {
+    w_lane_t * lane = w_lane_init(queue, work, context, weight);
+
+    if (num_decode_pool_threads > 0) {
+        w_lane_pool_add(&decode_pool, lane);
+    } else {
+        w_create_named_thread(w_lane_main, lane, "ad-dec-%s-%d", name, id);
+    }
+}
+
+void w_decode_shards_lanes(const char * name, const w_decode_shards_t * shards, w_lane_work_t work, void * (*context)(void), unsigned int weight) {
+    unsigned int i;
+
+    for (i = 0; i < shards->count; i++) {
+        w_decode_lane_add(name, i, shards->queues[i], work, context ? context() : NULL, weight);
+    }
+}
+
+double w_metric_decode_pool_busy(void * pool) {
+    return __atomic_load_n(&((w_lane_pool_t *)pool)->busy, __ATOMIC_RELAXED);
 }
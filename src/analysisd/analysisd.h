@@ -46,6 +46,9 @@ extern time_t current_time;
 void * asyscom_main(__attribute__((unused)) void * arg) ;
 size_t asyscom_dispatch(char * command, char ** output);
 size_t asyscom_getconfig(const char * section, char ** output);
+size_t asyscom_reloadlists(char ** output);
+size_t asyscom_getruleprofile(const char * top, char ** output);
+size_t asyscom_getmetrics(char ** output);
 
 #define WM_ANALYSISD_LOGTAG ARGV0 "" // Tag for log messages
 
@@ -67,6 +70,15 @@ void w_init_queues();
 #define OSSEC_SERVER    "ossec-server"
 #define MAX_DECODER_ORDER_SIZE  1024
 
+// Maximum number of items a pipeline thread takes from its queue per wakeup
+#define QUEUE_BATCH_SIZE 64
+
+// Messages the input thread reads from the shared rings before it looks at the socket
+#define AD_INPUT_RING_STREAK 256
+
+// Datagrams the input thread takes from the socket per call
+#define AD_INPUT_BATCH 32
+
 OSHash *fim_agentinfo;
 extern int num_rule_matching_threads;
 
@@ -0,0 +1,100 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "config.h"
+#include "rules.h"
+#include "decoders/decoder.h"
+#include "archive_filter.h"
+
+/* Events seen by location, for the sampling */
+static OSHashOA *sample_counters;
+
+/* Whether any filter is set */
+static int archive_filtered;
+
+void w_archive_filter_init(void) {
+    archive_filtered = Config.logall_level > 0 || Config.logall_ignore_decoders || Config.logall_ignore_locations ||
+                       Config.logall_ignore_labels || Config.logall_samples;
+
+    if (Config.logall_samples && !sample_counters) {
+        sample_counters = OSHashOA_Create(ARCHIVE_SAMPLE_STRIPES);
+        OSHashOA_SetFreeDataPointer(sample_counters, free);
+    }
+}
+
+/* Count an event of a location, and tell whether it's the first of a group of rate */
+static int archive_sample(const char *location, unsigned int rate) {
+    unsigned long *counter;
+
+    if (counter = OSHashOA_Get(sample_counters, location), !counter) {
+        os_calloc(1, sizeof(unsigned long), counter);
+
+        /* Another thread may have added it meanwhile */
+        if (OSHashOA_Add(sample_counters, location, counter) != 2) {
+            os_free(counter);
+
+            if (counter = OSHashOA_Get(sample_counters, location), !counter) {
+                return 1;
+            }
+        }
+    }
+
+    return __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED) % rate == 0;
+}
+
+int w_archive_filter(const Eventinfo *lf) {
+    const char *location = lf->location ? lf->location : "";
+    int i;
+
+    if (!archive_filtered) {
+        return 1;
+    }
+
+    if (Config.logall_level > 0 && (!lf->generated_rule || lf->generated_rule->level < Config.logall_level)) {
+        return 0;
+    }
+
+    if (Config.logall_ignore_decoders && lf->decoder_info && lf->decoder_info->name) {
+        for (i = 0; Config.logall_ignore_decoders[i]; i++) {
+            if (strcmp(lf->decoder_info->name, Config.logall_ignore_decoders[i]) == 0 ||
+                    (lf->decoder_info->parent && strcmp(lf->decoder_info->parent, Config.logall_ignore_decoders[i]) == 0)) {
+                return 0;
+            }
+        }
+    }
+
+    if (Config.logall_ignore_locations) {
+        for (i = 0; Config.logall_ignore_locations[i]; i++) {
+            if (OSMatch_Execute(location, strlen(location), Config.logall_ignore_locations[i])) {
+                return 0;
+            }
+        }
+    }
+
+    if (Config.logall_ignore_labels && lf->labels) {
+        for (i = 0; Config.logall_ignore_labels[i].key; i++) {
+            const char *value = labels_get(lf->labels, Config.logall_ignore_labels[i].key);
+
+            if (value && strcmp(value, Config.logall_ignore_labels[i].value) == 0) {
+                return 0;
+            }
+        }
+    }
+
+    if (Config.logall_samples) {
+        for (i = 0; Config.logall_samples[i].rate; i++) {
+            if (!Config.logall_samples[i].location || OSMatch_Execute(location, strlen(location), Config.logall_samples[i].location)) {
+                return Config.logall_samples[i].rate == 1 || archive_sample(location, Config.logall_samples[i].rate);
+            }
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,35 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef ARCHIVE_FILTER_H
+#define ARCHIVE_FILTER_H
+
+#include "eventinfo.h"
+
+/* Stripes of the table of sampling counters */
+#define ARCHIVE_SAMPLE_STRIPES 16
+
+/**
+ * @brief Set up the archive filters of the configuration.
+ */
+void w_archive_filter_init(void);
+
+/**
+ * @brief Check whether an event must be archived.
+ *
+ * It is checked before the event is copied for the archives writer, after the
+ * rule matching, so that the level of the rule matched is known. Sampling
+ * keeps the first event of each group of rate events of a location.
+ *
+ * @param lf Event.
+ * @return 1 if the event must be archived, 0 otherwise.
+ */
+int w_archive_filter(const Eventinfo *lf);
+
+#endif /* ARCHIVE_FILTER_H */
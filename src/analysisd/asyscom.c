@@ -13,6 +13,7 @@
 #include "wazuh_modules/wmodules.h"
 #include "analysisd.h"
 #include "config.h"
+#include "rule_profile.h"
 
 size_t asyscom_dispatch(char * command, char ** output) {
 
@@ -33,6 +34,15 @@ size_t asyscom_dispatch(char * command, char ** output) {
         }
         return asyscom_getconfig(rcv_args, output);
 
+    } else if (strcmp(rcv_comm, "reloadlists") == 0){
+        return asyscom_reloadlists(output);
+
+    } else if (strcmp(rcv_comm, "getruleprofile") == 0){
+        return asyscom_getruleprofile(rcv_args, output);
+
+    } else if (strcmp(rcv_comm, "getmetrics") == 0){
+        return asyscom_getmetrics(output);
+
     } else {
         mdebug1("ASYSCOM Unrecognized command '%s'.", rcv_comm);
         os_strdup("err Unrecognized command", *output);
@@ -149,6 +159,58 @@ error:
     return strlen(*output);
 }
 
+size_t asyscom_reloadlists(char ** output) {
+    int reloaded;
+
+    if (reloaded = Lists_OP_ReloadLists(), reloaded < 0) {
+        mdebug1("At ASYSCOM reloadlists: Lists cannot be reloaded yet.");
+        os_strdup("err Lists cannot be reloaded", *output);
+        return strlen(*output);
+    }
+
+    os_malloc(OS_SIZE_128, *output);
+    snprintf(*output, OS_SIZE_128, "ok {\"reloaded\":%d}", reloaded);
+    return strlen(*output);
+}
+
+size_t asyscom_getruleprofile(const char * top, char ** output) {
+    cJSON *report;
+    char *json_str;
+    int n = top ? atoi(top) : RULE_PROFILE_DEFAULT_TOP;
+
+    if (!rule_profile_enabled) {
+        mdebug1("At ASYSCOM getruleprofile: Rule profiling is disabled.");
+        os_strdup("err Rule profiling is disabled", *output);
+        return strlen(*output);
+    }
+
+    if (n <= 0) {
+        mdebug1("At ASYSCOM getruleprofile: Invalid number of rules '%s'.", top);
+        os_strdup("err Invalid number of rules", *output);
+        return strlen(*output);
+    }
+
+    if (report = rule_profile_report(n), !report) {
+        os_strdup("err No rules profiled", *output);
+        return strlen(*output);
+    }
+
+    os_strdup("ok", *output);
+    json_str = cJSON_PrintUnformatted(report);
+    wm_strcat(output, json_str, ' ');
+    free(json_str);
+    cJSON_Delete(report);
+    return strlen(*output);
+}
+
+size_t asyscom_getmetrics(char ** output) {
+    char *metrics = w_metrics_render();
+
+    os_strdup("ok", *output);
+    wm_strcat(output, metrics, ' ');
+    free(metrics);
+    return strlen(*output);
+}
 
 void * asyscom_main(__attribute__((unused)) void * arg) {
     int sock;
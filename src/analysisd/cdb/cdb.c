@@ -52,7 +52,7 @@ void cdb_init(struct cdb *c, int fd)
         }
 }
 
-int cdb_read(struct cdb *c, char *buf, unsigned int len, uint32 pos)
+int cdb_read(const struct cdb *c, char *buf, unsigned int len, uint32 pos)
 {
     if (c->map) {
         if ((pos > c->size) || (c->size - pos < len)) {
@@ -60,14 +60,11 @@ int cdb_read(struct cdb *c, char *buf, unsigned int len, uint32 pos)
         }
         memcpy(buf, c->map + pos, len);
     } else {
-        if (lseek(c->fd, pos, SEEK_SET) == -1) {
-            return -1;
-        }
-        /* if (seek_set(c->fd,pos) == -1) return -1; */
+        /* pread() keeps the file offset untouched: safe for concurrent readers */
         while (len > 0) {
-            int r;
+            ssize_t r;
             do {
-                r = read(c->fd, buf, len);
+                r = pread(c->fd, buf, len, pos);
             } while ((r == -1) && (errno == EINTR));
             if (r == -1) {
                 return -1;
@@ -76,6 +73,7 @@ int cdb_read(struct cdb *c, char *buf, unsigned int len, uint32 pos)
                 goto FORMAT;
             }
             buf += r;
+            pos += r;
             len -= r;
         }
     }
@@ -86,11 +84,25 @@ FORMAT:
     return -1;
 }
 
-static int match(struct cdb *c, char *key, unsigned int len, uint32 pos)
+const char *cdb_mapped(const struct cdb *c, uint32 pos, unsigned int len)
+{
+    if (!c->map || (pos > c->size) || (c->size - pos < len)) {
+        return NULL;
+    }
+    return c->map + pos;
+}
+
+static int match(const struct cdb *c, const char *key, unsigned int len, uint32 pos)
 {
     char buf[32];
+    const char *mapped;
     unsigned int n;
 
+    /* Compare in place when the file is mapped */
+    if ((mapped = cdb_mapped(c, pos, len))) {
+        return memcmp(mapped, key, len) == 0;
+    }
+
     while (len > 0) {
         n = sizeof buf;
         if (n > len) {
@@ -179,3 +191,90 @@ int cdb_find(struct cdb *c, char *key, unsigned int len)
     cdb_findstart(c);
     return cdb_findnext(c, key, len);
 }
+
+int cdb_lookup(const struct cdb *c, const char *key, unsigned int len, uint32 *dpos, uint32 *dlen)
+{
+    char buf[8];
+    uint32 pos;
+    uint32 hpos;
+    uint32 hslots;
+    uint32 kpos;
+    uint32 khash;
+    uint32 loop;
+    uint32 u;
+
+    khash = cdb_hash((char *)key, len);
+    if (cdb_read(c, buf, 8, (khash << 3) & 2047) == -1) {
+        return -1;
+    }
+    uint32_unpack(buf + 4, &hslots);
+    if (!hslots) {
+        return 0;
+    }
+    uint32_unpack(buf, &hpos);
+    kpos = hpos + (((khash >> 8) % hslots) << 3);
+
+    for (loop = 0; loop < hslots; loop++) {
+        if (cdb_read(c, buf, 8, kpos) == -1) {
+            return -1;
+        }
+        uint32_unpack(buf + 4, &pos);
+        if (!pos) {
+            return 0;
+        }
+        kpos += 8;
+        if (kpos == hpos + (hslots << 3)) {
+            kpos = hpos;
+        }
+        uint32_unpack(buf, &u);
+        if (u == khash) {
+            if (cdb_read(c, buf, 8, pos) == -1) {
+                return -1;
+            }
+            uint32_unpack(buf, &u);
+            if (u == len)
+                switch (match(c, key, len, pos + 8)) {
+                    case -1:
+                        return -1;
+                    case 1:
+                        uint32_unpack(buf + 4, dlen);
+                        *dpos = pos + 8 + len;
+                        return 1;
+                }
+        }
+    }
+    return 0;
+}
+
+int cdb_nextrecord(const struct cdb *c, uint32 *pos, uint32 *kpos, uint32 *klen, uint32 *dpos, uint32 *dlen)
+{
+    char buf[8];
+    uint32 eod;
+
+    /* The first hash table starts right after the last record */
+    if (cdb_read(c, buf, 4, 0) == -1) {
+        return -1;
+    }
+    uint32_unpack(buf, &eod);
+
+    if (*pos == 0) {
+        *pos = 2048;
+    }
+    if (*pos >= eod) {
+        return 0;
+    }
+    if (cdb_read(c, buf, 8, *pos) == -1) {
+        return -1;
+    }
+    uint32_unpack(buf, klen);
+    uint32_unpack(buf + 4, dlen);
+    *kpos = *pos + 8;
+    *dpos = *kpos + *klen;
+
+    if (*dpos < *kpos || *dpos + *dlen < *dpos || *dpos + *dlen > eod) {
+        errno = EPROTO;
+        return -1;
+    }
+    *pos = *dpos + *dlen;
+    return 1;
+}
@@ -30,12 +30,26 @@ struct cdb {
 extern void cdb_free(struct cdb *);
 extern void cdb_init(struct cdb *, int fd);
 
-extern int cdb_read(struct cdb *, char *, unsigned int, uint32);
+extern int cdb_read(const struct cdb *, char *, unsigned int, uint32);
 
 extern void cdb_findstart(struct cdb *);
 extern int cdb_findnext(struct cdb *, char *, unsigned int);
 extern int cdb_find(struct cdb *, char *, unsigned int);
 
+/* Stateless lookup: the cursor is not touched, so it can run concurrently
+ * on the same cdb. Returns 1 and sets *dpos, *dlen if found, 0 if not and
+ * -1 on error.
+ */
+extern int cdb_lookup(const struct cdb *, const char *, unsigned int, uint32 *, uint32 *);
+
+/* Pointer to len bytes at pos of a mapped cdb, or NULL if not mapped */
+extern const char *cdb_mapped(const struct cdb *, uint32, unsigned int);
+
+/* Walk the records in order. Start with *pos = 0. Returns 1 and sets the
+ * key and data positions, 0 after the last record and -1 on error.
+ */
+extern int cdb_nextrecord(const struct cdb *, uint32 *, uint32 *, uint32 *, uint32 *, uint32 *);
+
 #define cdb_datapos(c) ((c)->dpos)
 #define cdb_datalen(c) ((c)->dlen)
 
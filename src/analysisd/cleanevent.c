@@ -21,14 +21,165 @@ static const char *(month[]) = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
                   };
 
+/* How the rest of the log is handled after a header */
+typedef enum header_kind_t {
+    HEADER_SYSLOG,      /* Hostname and program name follow */
+    HEADER_PLAIN,       /* Only the timestamp is cut */
+    HEADER_ASL,         /* OS X ASL entries */
+    HEADER_SQUID        /* Spaces after the timestamp are skipped */
+} header_kind_t;
+
+/* Header format recognized at the start of a log */
+typedef struct header_format_t {
+    const char *pattern;    /* '*' matches any byte, '#' a digit */
+    size_t min_len;         /* The log (with terminator) must be longer */
+    header_kind_t kind;
+    int offset;             /* Start of the log past the header */
+    int ts_skip;            /* Start of the timestamp past the start of the log */
+    int ts_end;             /* End of the timestamp before the log */
+} header_format_t;
+
+/* Tried in this order, the first one that matches wins */
+static const header_format_t header_formats[] = {
+    /* Dec 29 10:00:01 */
+    { "*** ** **:**:** ", 17, HEADER_SYSLOG, 16, 0, 1 },
+    /* 2015-04-16 21:51:02,805 (proftpd 1.3.5) */
+    { "****-**-** **:**:**,", 24, HEADER_SYSLOG, 23, 0, 1 },
+    /* 2007-06-14T15:48:55-04:00 (syslog-ng isodate) */
+    { "****-**-**T**:**:*****:** ", 33, HEADER_SYSLOG, 26, 0, 1 },
+    /* 2009-05-22T09:36:46.214994-07:00 (rsyslog) */
+    { "****-**-**T**:**:**.*********:", 33, HEADER_SYSLOG, 33, 0, 1 },
+    { "****-**-**T**:**:**.", 33, HEADER_SYSLOG, 32, 0, 1 },
+    /* 2015 Dec 29 10:00:01 */
+    { "#*** *** ** **:**:** ", 21, HEADER_SYSLOG, 21, 0, 1 },
+    /* xferlog: Mon Apr 17 18:27:14 2006 1 64.160.42.130 */
+    { "*** *** ** **:**:** **** * ", 28, HEADER_PLAIN, 25, 0, 1 },
+    /* snort: 01/28-09:13:16.240702  [**] */
+    { "**/**-**:**:**.****** ", 24, HEADER_PLAIN, 23, 0, 2 },
+    /* suricata: 01/28/1979-09:13:16.240702  [**] */
+    { "**/**/****-**:**:**.****** ", 26, HEADER_PLAIN, 28, 0, 2 },
+    /* apache: [Fri Feb 11 18:06:35 2004] [warn] */
+    { "[*** *** ** **:**:** ****]", 27, HEADER_PLAIN, 27, 1, 2 },
+    /* OS X ASL: [Time 2006.12.28 15:53:55 UTC] [Facility auth] [Sender sshd] ... */
+    { "[T*** ****.**.** **:", 26, HEADER_ASL, 25, 0, 0 },
+    /* squid: 1140804070.368  11623 (seconds from 00:00:00 1970-01-01 UTC) */
+    { "1###******.**# ****** ", 32, HEADER_SQUID, 14, 0, 1 },
+    { "1###******.**# ******* ", 32, HEADER_SQUID, 14, 0, 1 },
+};
+
+#define HEADER_FORMATS (int)(sizeof(header_formats) / sizeof(header_formats[0]))
+#define HEADER_CHECKS 16
+#define HEADER_DISPATCH 5           /* Leading bytes looked up to pick the candidate formats */
+#define HEADER_MIN_LEN 17           /* Shortest min_len */
+
+/* Positions of a pattern that are not '*' */
+typedef struct header_check_t {
+    unsigned char pos;
+    char chr;
+} header_check_t;
+
+static struct {
+    header_check_t checks[HEADER_FORMATS][HEADER_CHECKS];
+    int count[HEADER_FORMATS];
+    uint16_t allowed[HEADER_DISPATCH][256]; /* Formats that each leading byte allows */
+} header;
+
+static pthread_once_t header_once = PTHREAD_ONCE_INIT;
+
+static int header_check_match(const header_check_t *check, unsigned char c) {
+    return check->chr == '#' ? (unsigned char)(c - '0') < 10 : (unsigned char)check->chr == c;
+}
+
+static void header_compile(void) {
+    int i;
+    int k;
+    int c;
+
+    for (i = 0; i < HEADER_FORMATS; i++) {
+        const char *pattern = header_formats[i].pattern;
+
+        assert(header_formats[i].min_len >= HEADER_MIN_LEN);
+
+        for (k = 0; pattern[k]; k++) {
+            if (pattern[k] != '*') {
+                assert(header.count[i] < HEADER_CHECKS);
+                header.checks[i][header.count[i]].pos = (unsigned char)k;
+                header.checks[i][header.count[i]].chr = pattern[k];
+                header.count[i]++;
+            }
+        }
+
+        for (k = 0; k < HEADER_DISPATCH; k++) {
+            header_check_t check = { (unsigned char)k, pattern[k] };
+
+            for (c = 0; c < 256; c++) {
+                if (pattern[k] == '*' || header_check_match(&check, (unsigned char)c)) {
+                    header.allowed[k][c] |= (uint16_t)(1 << i);
+                }
+            }
+        }
+    }
+}
+
+static int header_format_match(int i, const char *log, size_t loglen) {
+    const header_check_t *check = header.checks[i];
+    int k;
+
+    if (loglen <= header_formats[i].min_len) {
+        return 0;
+    }
+
+    for (k = 0; k < header.count[i]; k++) {
+        if (!header_check_match(&check[k], (unsigned char)log[check[k].pos])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Find the header format of a log: the first one of header_formats that
+ * matches. Only the formats that the leading bytes allow are tried.
+ */
+static int header_match(const char *log, size_t loglen) {
+    uint16_t candidates;
+    int i;
+
+    if (loglen <= HEADER_MIN_LEN) {
+        return -1;
+    }
+
+    pthread_once(&header_once, header_compile);
+
+    candidates = header.allowed[0][(unsigned char)log[0]];
+
+    for (i = 1; i < HEADER_DISPATCH && candidates; i++) {
+        candidates &= header.allowed[i][(unsigned char)log[i]];
+    }
+
+    for (i = 0; candidates; i++, candidates >>= 1) {
+        if ((candidates & 1) && header_format_match(i, log, loglen)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
 
 /* Format a received message in the Eventinfo structure */
 int OS_CleanMSG(char *msg, Eventinfo *lf)
 {
     size_t loglen;
+    size_t locationlen;
+    size_t hostlen;
+    size_t size;
     char *pieces;
-    struct tm p = { .tm_sec = 0 };
+    char *buffer;
+    const w_time_cache_t * now;
     struct timespec local_c_timespec;
+    int format;
 
     /* The message is formated in the following way:
      * id:location:message.
@@ -47,13 +198,31 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
     *pieces = '\0';
     pieces++;
 
-    os_strdup(msg, lf->location);
-
-    /* Get the log length */
+    /* Get the location and log lengths */
+    locationlen = (size_t)(pieces - msg);
     loglen = strlen(pieces) + 1;
 
+    /* The location, agent id and hostname are views of the message buffer,
+     * followed by full_log and log. The hostname comes from the location,
+     * the log or __shost.
+     */
+    hostlen = strlen(__shost) + 1;
+    hostlen = locationlen > hostlen ? locationlen : hostlen;
+    hostlen = loglen > hostlen ? loglen : hostlen;
+    size = locationlen + sizeof("000") + hostlen + (2 * loglen) + 1;
+
+    if (lf->msg_buffer_size < size) {
+        os_free(lf->msg_buffer);
+        os_malloc(size, lf->msg_buffer);
+        lf->msg_buffer_size = size;
+    }
+
+    buffer = lf->msg_buffer;
+    memcpy(buffer, msg, locationlen);
+    lf->location = buffer;
+
     /* Assign the values in the structure (lf->full_log) */
-    os_malloc((2 * loglen) + 1, lf->full_log);
+    lf->full_log = buffer + locationlen + sizeof("000") + hostlen;
 
     /* Set the whole message at full_log */
     strncpy(lf->full_log, pieces, loglen);
@@ -76,66 +245,14 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
         }
     }
 
-    /* Check for the syslog date format
-     * ( ex: Dec 29 10:00:01
-     *   or  2015 Dec 29 10:00:01
-     *   or  2007-06-14T15:48:55-04:00 for syslog-ng isodate
-     *   or  2009-05-22T09:36:46.214994-07:00 for rsyslog )
-     *   or  2015-04-16 21:51:02,805 (proftpd 1.3.5)
-     */
-    if (
-        (
-            (loglen > 17) &&
-            (pieces[3] == ' ') &&
-            (pieces[6] == ' ') &&
-            (pieces[9] == ':') &&
-            (pieces[12] == ':') &&
-            (pieces[15] == ' ') && (lf->log += 16)
-        )
-        ||
-	(
-	    (loglen > 24) &&
-	    (pieces[4] == '-') &&
-	    (pieces[7] == '-') &&
-	    (pieces[10] == ' ') &&
-	    (pieces[13] == ':') &&
-	    (pieces[16] == ':') &&
-	    (pieces[19] == ',') &&
-	    (lf->log += 23)
-	)
-	||
-        (
-            (loglen > 33) &&
-            (pieces[4] == '-') &&
-            (pieces[7] == '-') &&
-            (pieces[10] == 'T') &&
-            (pieces[13] == ':') &&
-            (pieces[16] == ':') &&
-
-            (
-                ((pieces[22] == ':') &&
-                 (pieces[25] == ' ') && (lf->log += 26)) ||
-
-                ((pieces[19] == '.') &&
-                 (pieces[29] == ':') && (lf->log += 33))  ||
-
-                ((pieces[19] == '.') && (lf->log += 32))
-            )
-        )
-     ||
-        (
-            (loglen > 21) &&
-            (isdigit(pieces[0])) &&
-            (pieces[4] == ' ') &&
-            (pieces[8] == ' ') &&
-            (pieces[11] == ' ') &&
-            (pieces[14] == ':') &&
-            (pieces[17] == ':') &&
-            (pieces[20] == ' ') && (lf->log += 21)
-        )
-
-    ) {
+    format = header_match(pieces, loglen);
 
+    if (format >= 0) {
+        lf->log += header_formats[format].offset;
+    }
+
+    /* Syslog date formats, followed by hostname and program name */
+    if (format >= 0 && header_formats[format].kind == HEADER_SYSLOG) {
         lf->dec_timestamp = lf->full_log + loglen;
         lf->log[-1] = '\0';
 
@@ -328,70 +445,10 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
         }
     }
 
-    /* xferlog date format
-     * Mon Apr 17 18:27:14 2006 1 64.160.42.130
-     */
-    else if ((loglen > 28) &&
-             (pieces[3] == ' ') &&
-             (pieces[7] == ' ') &&
-             (pieces[10] == ' ') &&
-             (pieces[13] == ':') &&
-             (pieces[16] == ':') &&
-             (pieces[19] == ' ') &&
-             (pieces[24] == ' ') &&
-             (pieces[26] == ' ')) {
-        /* Move log to the beginning of the message */
-        lf->log += 25;
-        lf->dec_timestamp = lf->full_log + loglen;
-        lf->log[-1] = '\0';
-    }
-
-    /* Check for snort date format
-     * ex: 01/28-09:13:16.240702  [**]
-     */
-    else if ( (loglen > 24) &&
-              (pieces[2] == '/') &&
-              (pieces[5] == '-') &&
-              (pieces[8] == ':') &&
-              (pieces[11] == ':') &&
-              (pieces[14] == '.') &&
-              (pieces[21] == ' ') ) {
-        lf->log += 23;
-        lf->dec_timestamp = lf->full_log + loglen;
-        lf->log[-2] = '\0';
-    }
-
-    /* Check for suricata (new) date format
-     * ex: 01/28/1979-09:13:16.240702  [**]
-     */
-    else if ( (loglen > 26) &&
-              (pieces[2] == '/') &&
-              (pieces[5] == '/') &&
-              (pieces[10] == '-') &&
-              (pieces[13] == ':') &&
-              (pieces[16] == ':') &&
-              (pieces[19] == '.') &&
-              (pieces[26] == ' ') ) {
-        lf->log += 28;
-        lf->dec_timestamp = lf->full_log + loglen;
-        lf->log[-2] = '\0';
-    }
-
-
-    /* Check for apache log format */
-    /* [Fri Feb 11 18:06:35 2004] [warn] */
-    else if ( (loglen > 27) &&
-              (pieces[0] == '[') &&
-              (pieces[4] == ' ') &&
-              (pieces[8] == ' ') &&
-              (pieces[11] == ' ') &&
-              (pieces[14] == ':') &&
-              (pieces[17] == ':') &&
-              (pieces[20] == ' ') &&
-              (pieces[25] == ']') ) {
-        lf->log += 27;
-        lf->dec_timestamp = lf->full_log + loglen + 1;
-        lf->log[-2] = '\0';
+    /* Formats with only a timestamp */
+    else if (format >= 0 && header_formats[format].kind == HEADER_PLAIN) {
+        lf->dec_timestamp = lf->full_log + loglen + header_formats[format].ts_skip;
+        lf->log[-header_formats[format].ts_end] = '\0';
     }
 
     /* Check for the osx asl log format.
@@ -401,20 +458,10 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
      [Message refused connect from 59.124.44.34] [Level 4] [UID -2] [GID -2]
      [Host robert-wyatts-emac]
      */
-    else if ((loglen > 26) &&
-             (pieces[0] == '[')  &&
-             (pieces[1] == 'T')  &&
-             (pieces[5] == ' ')  &&
-             (pieces[10] == '.') &&
-             (pieces[13] == '.') &&
-             (pieces[16] == ' ') &&
-             (pieces[19] == ':')) {
+    else if (format >= 0 && header_formats[format].kind == HEADER_ASL) {
         /* Do not read more than 1 message entry -> log tampering */
         short unsigned int done_message = 0;
 
-        /* Remove the date */
-        lf->log += 25;
-
         /* Get the desired values */
         pieces = strchr(lf->log, '[');
         while (pieces) {
@@ -491,17 +538,7 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
      * 1140804070.368  11623
      * seconds from 00:00:00 1970-01-01 UTC
      */
-    else if ((loglen > 32) &&
-             (pieces[0] == '1') &&
-             (isdigit((int)pieces[1])) &&
-             (isdigit((int)pieces[2])) &&
-             (isdigit((int)pieces[3])) &&
-             (pieces[10] == '.') &&
-             (isdigit((int)pieces[13])) &&
-             (pieces[14] == ' ') &&
-             ((pieces[21] == ' ') || (pieces[22] == ' '))) {
-        lf->log += 14;
-
+    else if (format >= 0 && header_formats[format].kind == HEADER_SQUID) {
         /* We need to start at the size of the event */
         while (*lf->log == ' ') {
             lf->log++;
@@ -519,54 +556,51 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
     /* Set hostname for local messages */
     if (lf->location[0] == '[') {
         /* Messages from an agent */
-        char *orig = lf->location;
+        char *end;
 
         lf->agent_id = lf->location + 1;
-        lf->location = strchr(lf->agent_id, ']');
 
-        if (!lf->location) {
+        if (end = strchr(lf->agent_id, ']'), !end) {
             merror(FORMAT_ERROR);
             return (-1);
         }
 
-        *lf->location = '\0';
-        os_strdup(lf->agent_id, lf->agent_id);
-        os_strdup(lf->location + 2, lf->location);
+        *end = '\0';
+        lf->location = end[1] ? end + 2 : end + 1;
 
-        if (lf->location[0] == '(') {
-            char * end;
+        /* Copied aside: it would cut the location */
+        pieces = buffer + locationlen + sizeof("000");
 
-            os_strdup(lf->location + 1, lf->hostname);
-
-            if (end = strchr(lf->hostname, ')'), end) {
-                *end = '\0';
-            } else {
-                lf->hostname[0] = '\0';
-            }
+        if (lf->location[0] == '(' && (end = strchr(lf->location + 1, ')'), end)) {
+            memcpy(pieces, lf->location + 1, (size_t)(end - lf->location - 1));
+            pieces[end - lf->location - 1] = '\0';
         } else {
-            os_strdup("", lf->hostname);
+            *pieces = '\0';
         }
 
-        free(orig);
+        lf->hostname = pieces;
     } else {
-        os_strdup(lf->hostname ? lf->hostname : __shost, lf->hostname);
-        os_strdup("000", lf->agent_id);
+        const char *hostname = lf->hostname ? lf->hostname : __shost;
+
+        lf->agent_id = buffer + locationlen;
+        memcpy(lf->agent_id, "000", sizeof("000"));
+
+        /* The log may be rewritten by the decoders */
+        lf->hostname = lf->agent_id + sizeof("000");
+        memcpy(lf->hostname, hostname, strlen(hostname) + 1);
     }
 
     /* Set up the event data */
     gettime(&local_c_timespec);
     time(&lf->generate_time);
     lf->time = local_c_timespec;
-    localtime_r(&lf->time.tv_sec, &p);
+    now = w_time_cache_get(lf->time.tv_sec);
 
     /* Assign hour, day, year and month values */
-    lf->day = p.tm_mday;
-    lf->year = p.tm_year + 1900;
-    strncpy(lf->mon, month[p.tm_mon], 3);
-    snprintf(lf->hour, 9, "%02d:%02d:%02d",
-             p.tm_hour,
-             p.tm_min,
-             p.tm_sec);
+    lf->day = now->tm.tm_mday;
+    lf->year = now->tm.tm_year + 1900;
+    strncpy(lf->mon, month[now->tm.tm_mon], 3);
+    memcpy(lf->hour, now->hour, sizeof(lf->hour));
 
 #ifdef TESTRULE
     if (!alert_only) {
@@ -270,6 +270,10 @@ cJSON *getAnalysisInternalOptions(void) {
     cJSON_AddNumberToObject(analysisd,"decoder_order_size",Config.decoder_order_size);
     cJSON_AddNumberToObject(analysisd,"label_cache_maxage",Config.label_cache_maxage);
     cJSON_AddNumberToObject(analysisd,"show_hidden_labels",Config.show_hidden_labels);
+    cJSON_AddNumberToObject(analysisd,"archives_compress",Config.archives_compress);
+    cJSON_AddNumberToObject(analysisd,"alerts_compress",Config.alerts_compress);
+    cJSON_AddNumberToObject(analysisd,"log_buffer_size",Config.log_buffer_size);
+    cJSON_AddNumberToObject(analysisd,"log_flush_interval",Config.log_flush_interval);
     cJSON_AddNumberToObject(analysisd,"rlimit_nofile",nofile);
     cJSON_AddNumberToObject(analysisd,"min_rotate_interval",Config.min_rotate_interval);
 #ifdef LIBGEOIP_ENABLED
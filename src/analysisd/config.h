@@ -18,16 +18,24 @@
 #include "analysisd/decoders/plugin_decoders.h"
 
 #ifdef LIBGEOIP_ENABLED
+#ifdef LIBMAXMINDDB_ENABLED
+#include <maxminddb.h>
+#else
 #include "GeoIP.h"
 #endif
+#endif
 
 
 extern long int __crt_ftell; /* Global ftell pointer */
 extern _Config Config;       /* Global Config structure */
 
 #ifdef LIBGEOIP_ENABLED
+#ifdef LIBMAXMINDDB_ENABLED
+MMDB_s *geoipdb;
+#else
 GeoIP *geoipdb;
 #endif
+#endif
 
 int GlobalConf(const char *cfgfile);
 
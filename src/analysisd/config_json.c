@@ -26,6 +26,7 @@ void _getDecodersListJSON(OSDecoderNode *list, cJSON *array) {
         if (node->osdecoder->name) cJSON_AddStringToObject(decoder,"name",node->osdecoder->name);
         if (node->osdecoder->parent) cJSON_AddStringToObject(decoder,"parent",node->osdecoder->parent);
         if (node->osdecoder->ftscomment) cJSON_AddStringToObject(decoder,"ftscomment",node->osdecoder->ftscomment);
+        cJSON_AddNumberToObject(decoder,"hits",__atomic_load_n(&node->osdecoder->hits, __ATOMIC_RELAXED));
         if (Config.decoder_order_size && node->osdecoder->order) {
             cJSON *_list = cJSON_CreateArray();
             for (i=0;i<Config.decoder_order_size;i++) {
@@ -16,6 +16,7 @@
 #include "decoder.h"
 #include "plugin_decoders.h"
 #include "config.h"
+#include "ruleset_load.h"
 
 /* Internal functions */
 static char *_loadmemory(char *at, char *str);
@@ -175,16 +176,23 @@ int ReadDecodeXML(const char *file)
     const char *xml_arraystructure = "json_array_structure";
 
     int i = 0;
+    int vars = 0;
     OSDecoderInfo *NULL_Decoder_tmp = NULL;
 
     char *regex = NULL;
     char *prematch = NULL;
     char *p_name = NULL;
     XML_NODE elements = NULL;
+    xml_cursor node_cursor;
+    xml_cursor elements_cursor;
     OSDecoderInfo *pi = NULL;
 
+    /* The nodes of each level are kept by its own cursor */
+    OS_CursorInit(&node_cursor, &xml);
+    OS_CursorInit(&elements_cursor, &xml);
+
     /* Read the XML */
-    if ((i = OS_ReadXML(file, &xml)) < 0) {
+    if ((i = Ruleset_ReadXML(file, &xml, &vars)) < 0) {
         if ((i == -2) && (strcmp(file, XML_LDECODER) == 0)) {
             return (-2);
         }
@@ -194,7 +202,7 @@ int ReadDecodeXML(const char *file)
     }
 
     /* Apply any variables found */
-    if (OS_ApplyVariables(&xml) != 0) {
+    if (vars != 0) {
         merror(XML_ERROR_VAR, file, xml.err);
         goto cleanup;
     }
@@ -208,7 +216,7 @@ int ReadDecodeXML(const char *file)
     }
 
     /* Get the root elements */
-    node = OS_GetElementsbyNode(&xml, NULL);
+    node = OS_CursorGetElements(&node_cursor, NULL);
     if (!node) {
         if (strcmp(file, XML_LDECODER) != 0) {
             merror(XML_ELEMNULL);
@@ -265,7 +273,7 @@ int ReadDecodeXML(const char *file)
         }
 
         /* Get decoder options */
-        elements = OS_GetElementsbyNode(&xml, node[i]);
+        elements = OS_CursorGetElements(&elements_cursor, node[i]);
         if (elements == NULL) {
             merror(XML_ELEMNULL);
             goto cleanup;
@@ -535,6 +543,7 @@ int ReadDecodeXML(const char *file)
                     } else {
                         pi->order[order_int] = DynamicField_FP;
                         os_strdup(word, pi->fields[order_int]);
+                        FieldId_Add(word);
                     }
 
                     free(*norder);
@@ -632,7 +641,6 @@ int ReadDecodeXML(const char *file)
 
         } /* while(elements[j]) */
 
-        OS_ClearNode(elements);
         elements = NULL;
 
         /* Prematch must be set */
@@ -773,9 +781,9 @@ cleanup:
     free(prematch);
     free(regex);
 
-    /* Clean node and XML structures */
-    OS_ClearNode(elements);
-    OS_ClearNode(node);
+    /* Clean the cursors and XML structures */
+    OS_CursorClear(&elements_cursor);
+    OS_CursorClear(&node_cursor);
     OS_ClearXML(&xml);
 
     FreeDecoderInfo(pi);
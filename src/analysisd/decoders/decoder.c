@@ -21,7 +21,9 @@ void DecodeEvent(Eventinfo *lf, regex_matching *decoder_match)
 {
     OSDecoderNode *node;
     OSDecoderNode *child_node;
+    OSDecoderNode **candidates = NULL;
     OSDecoderInfo *nnode;
+    unsigned int i = 0;
 
     const char *llog = NULL;
     const char *pmatch = NULL;
@@ -41,13 +43,20 @@ void DecodeEvent(Eventinfo *lf, regex_matching *decoder_match)
     }
 #endif
 
+    /* Only walk the decoders whose program name matches */
+    if (lf->program_name && (candidates = OS_GetOSDecoderCandidates(lf->program_name, lf->p_name_size))) {
+        if (!(node = candidates[0])) {
+            goto no_match;
+        }
+    }
+
     do {
         nnode = node->osdecoder;
 
         /* First check program name */
         if (lf->program_name) {
-            if (!OSMatch_Execute(lf->program_name, lf->p_name_size,
-                                 nnode->program_name)) {
+            if (!candidates && !OSMatch_Execute(lf->program_name, lf->p_name_size,
+                                                nnode->program_name)) {
                 continue;
             }
             pmatch = lf->log;
@@ -65,6 +74,8 @@ void DecodeEvent(Eventinfo *lf, regex_matching *decoder_match)
             }
         }
 
+        __atomic_add_fetch(&nnode->hits, 1, __ATOMIC_RELAXED);
+
 #ifdef TESTRULE
         if (!alert_only) {
             print_out("       decoder: '%s'", nnode->name);
@@ -220,8 +231,9 @@ void DecodeEvent(Eventinfo *lf, regex_matching *decoder_match)
 
         /* ok to return  */
         return;
-    } while ((node = node->next) != NULL);
+    } while ((node = candidates ? candidates[++i] : node->next) != NULL);
 
+no_match:
 #ifdef TESTRULE
     if (!alert_only) {
         print_out("       No decoder matched.");
@@ -229,13 +241,98 @@ void DecodeEvent(Eventinfo *lf, regex_matching *decoder_match)
 #endif
 }
 
-/* Find index of a dynamic field. Returns NULL if not found. */
+/* Table of interned field names. It's filled while loading rules and
+ * decoders, and only read once events are processed. */
+
+typedef struct field_name_t {
+    char *name;
+    int id;
+} field_name_t;
+
+static field_name_t *field_names;
+static unsigned int field_names_size;
+static int field_names_count;
+
+/* Case insensitive FNV-1a */
+static unsigned int FieldName_Hash(const char *name) {
+    unsigned int hash = 2166136261U;
+
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char)tolower((unsigned char)*name)) * 16777619U;
+    }
+
+    return hash;
+}
+
+static field_name_t *FieldName_Slot(field_name_t *table, unsigned int size, const char *name) {
+    unsigned int i = FieldName_Hash(name) & (size - 1);
+
+    while (table[i].name && strcasecmp(table[i].name, name)) {
+        i = (i + 1) & (size - 1);
+    }
+
+    return &table[i];
+}
+
+int FieldId_Add(const char *name) {
+    field_name_t *slot;
+    field_name_t *table;
+    unsigned int size;
+    unsigned int i;
+
+    if (field_names && (slot = FieldName_Slot(field_names, field_names_size, name), slot->name)) {
+        return slot->id;
+    }
+
+    /* Keep the table at most half full */
+    if ((unsigned int)(field_names_count + 1) * 2 > field_names_size) {
+        size = field_names_size ? field_names_size * 2 : 256;
+        os_calloc(size, sizeof(field_name_t), table);
+
+        for (i = 0; i < field_names_size; i++) {
+            if (field_names[i].name) {
+                *FieldName_Slot(table, size, field_names[i].name) = field_names[i];
+            }
+        }
+
+        os_free(field_names);
+        field_names = table;
+        field_names_size = size;
+    }
+
+    slot = FieldName_Slot(field_names, field_names_size, name);
+    os_strdup(name, slot->name);
+    slot->id = ++field_names_count;
+    return slot->id;
+}
+
+int FieldId_Get(const char *name) {
+    field_name_t *slot;
+
+    if (!name || !field_names) {
+        return 0;
+    }
+
+    slot = FieldName_Slot(field_names, field_names_size, name);
+    return slot->name ? slot->id : 0;
+}
+
+/* Find the value of a dynamic field. Returns NULL if not found. */
 
 const char* FindField(const Eventinfo *lf, const char *key) {
+    return FindFieldId(lf, 0, key);
+}
+
+const char* FindFieldId(const Eventinfo *lf, int id, const char *key) {
     int i;
 
+    if (id == 0) {
+        id = FieldId_Get(key);
+    }
+
+    /* Fields set without an ID are compared by name */
     for (i = 0; i < lf->nfields; i++)
-        if (!strcasecmp(lf->fields[i].key, key))
+        if (lf->fields[i].id ? lf->fields[i].id == id : lf->fields[i].key && !strcasecmp(lf->fields[i].key, key))
             return lf->fields[i].value;
 
     return NULL;
@@ -444,6 +541,7 @@ void *DynamicField_FP(Eventinfo *lf, char *field, const char *order)
 #endif
 
     os_strdup(order, lf->fields[lf->nfields].key);
+    lf->fields[lf->nfields].id = FieldId_Get(order);
     lf->fields[lf->nfields++].value = field;
     return (NULL);
 }
@@ -19,6 +19,9 @@
 #define AFTER_PREVREGEX 0x004   /* 4   */
 #define AFTER_ERROR     0x010
 
+/* Maximum number of program names with memoized parent decoders */
+#define DECODER_PNAME_INDEX_MAX 4096
+
 // JSON decoder flags
 // null treatment
 #define DISCARD     0
@@ -44,6 +47,7 @@ typedef struct {
 
     int fts;
     int accumulate;
+    unsigned int hits;
     char *parent;
     char *name;
     char *ftscomment;
@@ -81,8 +85,20 @@ typedef struct dbsync_context_t {
 void OS_CreateOSDecoderList(void);
 int OS_AddOSDecoder(OSDecoderInfo *pi);
 OSDecoderNode *OS_GetFirstOSDecoder(const char *pname);
+
+/**
+ * @brief Get the parent decoders whose program_name matches a program name.
+ *
+ * The result is computed once per name and keeps the order of the decoder list.
+ *
+ * @param pname Program name of the event.
+ * @param pname_size Length of pname.
+ * @return NULL-terminated array of parent decoders, or NULL if the index is full.
+ */
+OSDecoderNode **OS_GetOSDecoderCandidates(const char *pname, size_t pname_size);
 int getDecoderfromlist(const char *name);
 char *GetGeoInfobyIP(char *ip_addr);
+int OpenGeoIP(const char *file);
 int SetDecodeXML(void);
 void HostinfoInit(void);
 int fim_init(void);
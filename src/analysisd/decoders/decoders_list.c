@@ -24,6 +24,12 @@
 OSDecoderNode *osdecodernode_forpname;
 OSDecoderNode *osdecodernode_nopname;
 
+/* Parent decoders of the forpname list that match each program name
+ * seen so far. Decoding threads read it without locking.
+ */
+static OSHash *osdecoder_pname_index;
+static unsigned int osdecoder_pname_count;
+
 static OSDecoderNode *_OS_AddOSDecoder(OSDecoderNode *s_node, OSDecoderInfo *pi);
 
 /* Create the Event List */
@@ -32,6 +38,18 @@ void OS_CreateOSDecoderList()
     osdecodernode_forpname = NULL;
     osdecodernode_nopname = NULL;
 
+    if (osdecoder_pname_index) {
+        OSHash_Free(osdecoder_pname_index);
+    }
+
+    osdecoder_pname_count = 0;
+
+    if (osdecoder_pname_index = OSHash_Create(), osdecoder_pname_index) {
+        OSHash_setSize(osdecoder_pname_index, DECODER_PNAME_INDEX_MAX);
+        OSHash_SetFreeDataPointer(osdecoder_pname_index, free);
+        OSHash_SetRCU(osdecoder_pname_index);
+    }
+
     return;
 }
 
@@ -46,6 +64,57 @@ OSDecoderNode *OS_GetFirstOSDecoder(const char *p_name)
     return (osdecodernode_nopname);
 }
 
+/* Get the parent decoders that match a program name */
+OSDecoderNode **OS_GetOSDecoderCandidates(const char *p_name, size_t p_name_size)
+{
+    OSDecoderNode **candidates;
+    OSDecoderNode *node;
+    unsigned int count = 0;
+
+    if (!osdecoder_pname_index) {
+        return (NULL);
+    }
+
+    if (candidates = OSHash_Get_ex(osdecoder_pname_index, p_name), candidates) {
+        return (candidates);
+    }
+
+    /* Unbounded program names (e.g. including a PID) must not fill the memory */
+    if (__atomic_load_n(&osdecoder_pname_count, __ATOMIC_RELAXED) >= DECODER_PNAME_INDEX_MAX) {
+        return (NULL);
+    }
+
+    for (node = osdecodernode_forpname; node; node = node->next) {
+        if (OSMatch_Execute(p_name, p_name_size, node->osdecoder->program_name)) {
+            count++;
+        }
+    }
+
+    os_calloc(count + 1, sizeof(OSDecoderNode *), candidates);
+    count = 0;
+
+    for (node = osdecodernode_forpname; node; node = node->next) {
+        if (OSMatch_Execute(p_name, p_name_size, node->osdecoder->program_name)) {
+            candidates[count++] = node;
+        }
+    }
+
+    switch (OSHash_Add_ex(osdecoder_pname_index, p_name, candidates)) {
+    case 2:
+        __atomic_add_fetch(&osdecoder_pname_count, 1, __ATOMIC_RELAXED);
+        return (candidates);
+
+    case 1:
+        /* Another thread got here first */
+        free(candidates);
+        return (OSHash_Get_ex(osdecoder_pname_index, p_name));
+
+    default:
+        free(candidates);
+        return (NULL);
+    }
+}
+
 /* Add an osdecoder to the list */
 static OSDecoderNode *_OS_AddOSDecoder(OSDecoderNode *s_node, OSDecoderInfo *pi)
 {
@@ -22,27 +22,225 @@
 #include "eventinfo.h"
 #include "alerts/alerts.h"
 #include "decoder.h"
+
+#ifdef LIBMAXMINDDB_ENABLED
+#include <maxminddb.h>
+#else
 #include "GeoIP.h"
 #include "GeoIPCity.h"
+#endif
 
+/* Recent lookups of each thread. Addresses repeat a lot (firewall traffic),
+ * so the result of each one, even if it was not found, is kept in a small
+ * LRU cache. The database doesn't change while running */
 
-char *GetGeoInfobyIP(char *ip_addr)
+#define GEOIP_CACHE_SIZE    1024
+#define GEOIP_CACHE_BUCKETS 2048
+
+typedef struct geoip_entry {
+    char ip[IPSIZE + 1];
+    char *geodata;          // NULL if the address was not found
+    int hash_next;          // Bucket chain
+    int prev;               // LRU list, the most recent first
+    int next;
+} geoip_entry;
+
+typedef struct geoip_cache {
+    geoip_entry *entries;
+    int buckets[GEOIP_CACHE_BUCKETS];
+    int count;
+    int head;
+    int tail;
+} geoip_cache;
+
+static __thread geoip_cache *geoip_lru;
+
+static unsigned int geoip_hash(const char *ip) {
+    unsigned int hash = 2166136261u;
+
+    for (; *ip; ip++) {
+        hash = (hash ^ (unsigned char)*ip) * 16777619u;
+    }
+
+    return hash % GEOIP_CACHE_BUCKETS;
+}
+
+static void geoip_unlink(geoip_cache *cache, int i) {
+    geoip_entry *entry = cache->entries + i;
+
+    if (entry->prev >= 0) {
+        cache->entries[entry->prev].next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+
+    if (entry->next >= 0) {
+        cache->entries[entry->next].prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+static void geoip_push_front(geoip_cache *cache, int i) {
+    geoip_entry *entry = cache->entries + i;
+
+    entry->prev = -1;
+    entry->next = cache->head;
+
+    if (cache->head >= 0) {
+        cache->entries[cache->head].prev = i;
+    } else {
+        cache->tail = i;
+    }
+
+    cache->head = i;
+}
+
+static geoip_cache *geoip_cache_get(void) {
+    int i;
+
+    if (!geoip_lru) {
+        os_calloc(1, sizeof(geoip_cache), geoip_lru);
+        os_calloc(GEOIP_CACHE_SIZE, sizeof(geoip_entry), geoip_lru->entries);
+        geoip_lru->head = geoip_lru->tail = -1;
+
+        for (i = 0; i < GEOIP_CACHE_BUCKETS; i++) {
+            geoip_lru->buckets[i] = -1;
+        }
+    }
+
+    return geoip_lru;
+}
+
+/* Return the cached entry of an address, as the most recent one, or NULL */
+static geoip_entry *geoip_cache_find(geoip_cache *cache, const char *ip, unsigned int hash) {
+    int i;
+
+    for (i = cache->buckets[hash]; i >= 0; i = cache->entries[i].hash_next) {
+        if (strcmp(cache->entries[i].ip, ip) == 0) {
+            if (cache->head != i) {
+                geoip_unlink(cache, i);
+                geoip_push_front(cache, i);
+            }
+
+            return cache->entries + i;
+        }
+    }
+
+    return NULL;
+}
+
+/* Add an address and take its data, replacing the least recent one if full */
+static void geoip_cache_add(geoip_cache *cache, const char *ip, unsigned int hash, char *geodata) {
+    geoip_entry *entry;
+    int *link;
+    int i;
+
+    if (cache->count < GEOIP_CACHE_SIZE) {
+        i = cache->count++;
+    } else {
+        i = cache->tail;
+        entry = cache->entries + i;
+
+        for (link = cache->buckets + geoip_hash(entry->ip); *link != i; link = &cache->entries[*link].hash_next);
+        *link = entry->hash_next;
+
+        geoip_unlink(cache, i);
+        os_free(entry->geodata);
+    }
+
+    entry = cache->entries + i;
+    strcpy(entry->ip, ip);
+    entry->geodata = geodata;
+    entry->hash_next = cache->buckets[hash];
+    cache->buckets[hash] = i;
+    geoip_push_front(cache, i);
+}
+
+#ifdef LIBMAXMINDDB_ENABLED
+
+static MMDB_s mmdb;
+
+int OpenGeoIP(const char *file)
 {
-    GeoIPRecord *geoiprecord;
-    char *geodata = NULL;
+    int status;
+
+    /* The database is mapped in memory, no lookup reads the file */
+    if (status = MMDB_open(file, MMDB_MODE_MMAP, &mmdb), status != MMDB_SUCCESS) {
+        mdebug1("MMDB_open(%s): %s", file, MMDB_strerror(status));
+        return -1;
+    }
+
+    geoipdb = &mmdb;
+    return 0;
+}
+
+// Get a string of a record, or NULL
+static const char *geoip_string(MMDB_entry_s *entry, char *buffer, size_t size, ...)
+{
+    MMDB_entry_data_s data;
+    va_list path;
+    int status;
+
+    va_start(path, size);
+    status = MMDB_vget_value(entry, &data, path);
+    va_end(path);
+
+    if (status != MMDB_SUCCESS || !data.has_data || data.type != MMDB_DATA_TYPE_UTF8_STRING || data.data_size >= size) {
+        return NULL;
+    }
+
+    memcpy(buffer, data.utf8_string, data.data_size);
+    buffer[data.data_size] = '\0';
+    return buffer;
+}
+
+static char *geoip_lookup(const char *ip_addr)
+{
+    MMDB_lookup_result_s result;
+    char country_code[8];
+    char regionname[128];
     char geobuffer[256 +1];
+    char *geodata = NULL;
+    int gai_error;
+    int mmdb_error;
 
-    if(!geoipdb)
-    {
-        return(NULL);
+    result = MMDB_lookup_string(geoipdb, ip_addr, &gai_error, &mmdb_error);
+
+    if (gai_error != 0 || mmdb_error != MMDB_SUCCESS || !result.found_entry) {
+        return NULL;
     }
 
-    if(!ip_addr)
-    {
-        return(NULL);
+    if (!geoip_string(&result.entry, country_code, sizeof(country_code), "country", "iso_code", NULL) || strlen(country_code) < 2) {
+        return NULL;
+    }
+
+    if (geoip_string(&result.entry, regionname, sizeof(regionname), "subdivisions", "0", "names", "en", NULL) && *regionname) {
+        snprintf(geobuffer, 255, "%s / %s", country_code, regionname);
+        geobuffer[255] = '\0';
+        os_strdup(geobuffer, geodata);
+    } else {
+        os_strdup(country_code, geodata);
     }
 
-    geoiprecord = GeoIP_record_by_name(geoipdb, (const char *)ip_addr);
+    return geodata;
+}
+
+#else
+
+int OpenGeoIP(const char *file)
+{
+    geoipdb = GeoIP_open(file, GEOIP_INDEX_CACHE);
+    return geoipdb ? 0 : -1;
+}
+
+static char *geoip_lookup(const char *ip_addr)
+{
+    GeoIPRecord *geoiprecord;
+    char *geodata = NULL;
+    char geobuffer[256 +1];
+
+    geoiprecord = GeoIP_record_by_name(geoipdb, ip_addr);
     if(geoiprecord == NULL)
     {
         return(NULL);
@@ -83,7 +281,45 @@ char *GetGeoInfobyIP(char *ip_addr)
 
     GeoIPRecord_delete(geoiprecord);
     return(geodata);
+}
+
+#endif
+
+char *GetGeoInfobyIP(char *ip_addr)
+{
+    geoip_cache *cache;
+    geoip_entry *entry;
+    char *geodata = NULL;
+    unsigned int hash;
+
+    if(!geoipdb)
+    {
+        return(NULL);
+    }
 
+    if(!ip_addr)
+    {
+        return(NULL);
+    }
+
+    if (strlen(ip_addr) > IPSIZE) {
+        return geoip_lookup(ip_addr);
+    }
+
+    cache = geoip_cache_get();
+    hash = geoip_hash(ip_addr);
+
+    if (entry = geoip_cache_find(cache, ip_addr, hash), !entry) {
+        geoip_cache_add(cache, ip_addr, hash, geoip_lookup(ip_addr));
+        entry = cache->entries + cache->head;
+    }
+
+    /* The caller owns the string */
+    if (entry->geodata) {
+        os_strdup(entry->geodata, geodata);
+    }
+
+    return(geodata);
 }
 
 #endif
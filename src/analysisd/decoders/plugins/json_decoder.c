@@ -203,169 +203,529 @@ void fillData(Eventinfo *lf, const char *key, const char *value)
 #endif
     os_strdup(key, lf->fields[lf->nfields].key);
     os_strdup(value, lf->fields[lf->nfields].value);
+    lf->fields[lf->nfields].id = FieldId_Get(key);
     lf->nfields++;
 
 }
 
-static void readJSON (cJSON *logJSON, char *parent, Eventinfo *lf)
-{
-    static const char * VALUE_NULL = "null";
-    static const char * VALUE_TRUE = "true";
-    static const char * VALUE_FALSE = "false";
-    static const char * VALUE_COMMA = ",";
-    static const char * VALUE_EMPTY = "";
-
-    cJSON *next, *array;
-    char *key = NULL;
-    char *value = NULL;
-    size_t  n;
-
-    while (logJSON) {
-        next = logJSON->next;
-        if (logJSON->string) {
-            if (parent) {
-                n = strlen(parent);
-                key = malloc(n + strlen(logJSON->string) + 2);
-                strcpy(key, parent);
-                key[n++] = '.';
-                strcpy(key + n, logJSON->string);
+/* Single-pass JSON tokenizer. It reads the same grammar that
+ * cJSON_ParseWithOpts() accepts, builds the dotted keys in a per-thread path
+ * buffer and stages the (key, value) pairs, which are passed to fillData()
+ * only once the whole text has been read, so a malformed event adds nothing.
+ */
+
+#define JSON_NESTING_LIMIT 1000
+
+typedef struct jd_buffer {
+    char *data;
+    size_t size;
+    size_t length;
+} jd_buffer;
+
+typedef enum jd_mode {
+    JD_MEMBER,      // Value of an object member: stage it with the current path
+    JD_ELEMENT,     // Element of an array joined as CSV
+    JD_SKIP         // Check the value and drop it
+} jd_mode;
+
+typedef struct jd_tokenizer {
+    u_int8_t flags;
+    jd_buffer *path;
+    jd_buffer *value;
+    jd_buffer *pairs;
+    unsigned int count;
+    int overflow;
+} jd_tokenizer;
+
+static __thread jd_buffer jd_path;
+static __thread jd_buffer jd_value;
+static __thread jd_buffer jd_pairs;
+
+static const char * jd_parse_value(jd_tokenizer *jd, const char *p, unsigned int depth, jd_mode mode);
+
+/* Get room for n more bytes and the terminator */
+static char * jd_reserve(jd_buffer *buffer, size_t n) {
+    if (buffer->length + n >= buffer->size) {
+        size_t size = buffer->size ? buffer->size : OS_SIZE_1024;
+
+        while (buffer->length + n >= size) {
+            size *= 2;
+        }
+
+        os_realloc(buffer->data, size, buffer->data);
+        buffer->size = size;
+    }
+
+    return buffer->data + buffer->length;
+}
+
+static void jd_append(jd_buffer *buffer, const char *str, size_t n) {
+    memcpy(jd_reserve(buffer, n), str, n);
+    buffer->length += n;
+    buffer->data[buffer->length] = '\0';
+}
+
+static void jd_stage(jd_tokenizer *jd, const char *value) {
+    jd_append(jd->pairs, jd->path->data, strlen(jd->path->data) + 1);
+    jd_append(jd->pairs, value, strlen(value) + 1);
+    jd->count++;
+}
+
+static const char * jd_skip(const char *p) {
+    while (*p && (unsigned char)*p <= 32) {
+        p++;
+    }
+
+    return p;
+}
+
+static int jd_hex4(const char *p, unsigned int *code) {
+    int i;
+
+    for (*code = 0, i = 0; i < 4; i++) {
+        char c = p[i];
+
+        if (c >= '0' && c <= '9') {
+            *code = (*code << 4) | (c - '0');
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            *code = (*code << 4) | ((c | 0x20) - 'a' + 10);
+        } else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* p points to the opening quote. Unescape the string into out, if any, and
+ * return the position after the closing quote.
+ */
+static const char * jd_parse_string(const char *p, jd_buffer *out) {
+    const char *run;
+    unsigned int code;
+    unsigned int low;
+    char utf8[4];
+    size_t n;
+
+    for (run = ++p; *p != '"'; p++) {
+        if (*p == '\0') {
+            return NULL;
+        }
+
+        if (*p != '\\') {
+            continue;
+        }
+
+        if (out) {
+            jd_append(out, run, p - run);
+        }
+
+        switch (*++p) {
+        case 'b':
+            *utf8 = '\b';
+            n = 1;
+            break;
+        case 'f':
+            *utf8 = '\f';
+            n = 1;
+            break;
+        case 'n':
+            *utf8 = '\n';
+            n = 1;
+            break;
+        case 'r':
+            *utf8 = '\r';
+            n = 1;
+            break;
+        case 't':
+            *utf8 = '\t';
+            n = 1;
+            break;
+        case '"':
+        case '\\':
+        case '/':
+            *utf8 = *p;
+            n = 1;
+            break;
+
+        case 'u':
+            if (jd_hex4(p + 1, &code) < 0 || (code >= 0xDC00 && code <= 0xDFFF)) {
+                return NULL;
+            }
+
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                // A high surrogate needs a low one
+                if (p[5] != '\\' || p[6] != 'u' || jd_hex4(p + 7, &low) < 0 || low < 0xDC00 || low > 0xDFFF) {
+                    return NULL;
+                }
+
+                code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+                p += 6;
             }
-            else {
-                os_strdup(logJSON->string, key);
+
+            p += 4;
+
+            if (code < 0x80) {
+                utf8[0] = code;
+                n = 1;
+            } else if (code < 0x800) {
+                utf8[0] = 0xC0 | (code >> 6);
+                utf8[1] = 0x80 | (code & 0x3F);
+                n = 2;
+            } else if (code < 0x10000) {
+                utf8[0] = 0xE0 | (code >> 12);
+                utf8[1] = 0x80 | ((code >> 6) & 0x3F);
+                utf8[2] = 0x80 | (code & 0x3F);
+                n = 3;
+            } else {
+                utf8[0] = 0xF0 | (code >> 18);
+                utf8[1] = 0x80 | ((code >> 12) & 0x3F);
+                utf8[2] = 0x80 | ((code >> 6) & 0x3F);
+                utf8[3] = 0x80 | (code & 0x3F);
+                n = 4;
             }
+
+            break;
+
+        default:
+            return NULL;
         }
 
-        switch ((logJSON->type)&255) {
+        if (out) {
+            jd_append(out, utf8, n);
+        }
 
-            case cJSON_String:
-                fillData(lf, key, logJSON->valuestring);
-                break;
+        run = p + 1;
+    }
 
-            case cJSON_Number:
-                if ((double)logJSON->valueint == logJSON->valuedouble){
-                    char value_char[64];
-                    snprintf(value_char, 64, "%i", logJSON->valueint);
-                    fillData(lf, key, value_char);
-                }
-                else{
-                    char value_char[64];
-                    snprintf(value_char, 64, "%f", logJSON->valuedouble);
-                    fillData(lf, key, value_char);
-                }
-                break;
-
-            case cJSON_Array:
-                if (lf->decoder_info->flags & CSV_STRING) {
-                    os_malloc(OS_MAXSTR, value);
-                    *value = '\0';
-                    size_t n = 0;
-                    size_t z;
-                    for (array = logJSON->child; array; array = array->next){
-                        if (array->type == cJSON_String) {
-                            z = strlen(array->valuestring);
-                            if (n + z < OS_MAXSTR) {
-                                strcpy(value + n, array->valuestring);
-                                n += z;
-                            } else {
-                                *value = '\0';
-                                break;
-                            }
-                        }
-                        else if (array->type == cJSON_Number) {
-                            char value_char[64];
-                            z = (double)array->valueint == array->valuedouble ? snprintf(value_char, 64, "%i", array->valueint) : snprintf(value_char, 64, "%f", array->valuedouble);
-
-                            if (n + z < OS_MAXSTR) {
-                                strcpy(value + n, value_char);
-                                n += z;
-                            } else {
-                                *value = '\0';
-                                break;
-                            }
-                        }
-                        else if (array->type == cJSON_NULL) {
-                            z = strlen(VALUE_NULL);
-
-                            if (n + z < OS_MAXSTR) {
-                                strcpy(value + n, VALUE_NULL);
-                                n += z;
-                            } else {
-                                *value = '\0';
-                                break;
-                            }
-                        }
-                        else if (array->type == cJSON_True) {
-                            z = strlen(VALUE_TRUE);
-
-                            if (n + z < OS_MAXSTR) {
-                                strcpy(value + n, VALUE_TRUE);
-                                n += z;
-                            } else {
-                                *value = '\0';
-                                break;
-                            }
-                        }
-                        else if (array->type == cJSON_False) {
-                            z = strlen(VALUE_FALSE);
-
-                            if (n + z < OS_MAXSTR) {
-                                strcpy(value + n, VALUE_FALSE);
-                                n += z;
-                            } else {
-                                *value = '\0';
-                                break;
-                            }
-                        } else {
-                            continue;
-                        }
-
-                        z = strlen(VALUE_COMMA);
-
-                        if (n + z < OS_MAXSTR) {
-                            strcpy(value + n, VALUE_COMMA);
-                            n += z;
-                        } else {
-                            *value = '\0';
-                            break;
-                        }
-                    }
-                } else if (lf->decoder_info->flags & JSON_ARRAY) {
-                    value = cJSON_Print(logJSON);
-                }
+    if (out) {
+        jd_append(out, run, p - run);
+    }
 
-                if (value && *value != '\0') {
-                    fillData(lf, key, value);
-                }
+    return p + 1;
+}
 
-                os_free(value);
-                break;
+/* Print a number the way the tree walk did: as an integer whenever cJSON's
+ * valueint holds it, or with "%f" otherwise.
+ */
+static const char * jd_parse_number(const char *p, char *value, size_t size) {
+    char number[64];
+    char *end;
+    double valuedouble;
+    int valueint;
+    size_t n = strspn(p, "0123456789+-eE.");
+
+    if (n >= sizeof(number)) {
+        n = sizeof(number) - 1;
+    }
 
-            case cJSON_NULL:
-                if (lf->decoder_info->flags & EMPTY) {
-                    fillData(lf, key, VALUE_EMPTY);
-                } else if (lf->decoder_info->flags & SHOW_STRING) {
-                    fillData(lf, key, VALUE_NULL);
-                }
-                break;
+    memcpy(number, p, n);
+    number[n] = '\0';
+    valuedouble = strtod(number, &end);
+
+    if (end == number) {
+        return NULL;
+    }
+
+    if (valuedouble >= INT_MAX) {
+        valueint = INT_MAX;
+    } else if (valuedouble <= (double)INT_MIN) {
+        valueint = INT_MIN;
+    } else {
+        valueint = (int)valuedouble;
+    }
+
+    if ((double)valueint == valuedouble) {
+        snprintf(value, size, "%i", valueint);
+    } else {
+        snprintf(value, size, "%f", valuedouble);
+    }
+
+    return p + (end - number);
+}
+
+/* Join a scalar element into the CSV value, as long as it fits in OS_MAXSTR */
+static void jd_join(jd_tokenizer *jd, size_t start) {
+    jd_buffer *value = jd->value;
+
+    // Elements end at the first null character, like C strings do
+    value->length = start + strlen(value->data + start);
+
+    if (jd->overflow || value->length + 1 >= OS_MAXSTR) {
+        jd->overflow = 1;
+        value->length = start;
+    } else {
+        jd_append(value, ",", 1);
+    }
+
+    value->data[value->length] = '\0';
+}
+
+static const char * jd_parse_object(jd_tokenizer *jd, const char *p, unsigned int depth, jd_mode mode, int nested) {
+    size_t base = jd->path->length;
+    size_t start;
+
+    if (p = jd_skip(p + 1), *p == '}') {
+        return p + 1;
+    }
+
+    while (1) {
+        if (p = jd_skip(p), *p != '"') {
+            return NULL;
+        }
+
+        if (mode == JD_MEMBER) {
+            jd->path->length = base;
+
+            if (nested) {
+                jd_append(jd->path, ".", 1);
+            }
+
+            start = jd->path->length;
+
+            if (p = jd_parse_string(p, jd->path), !p) {
+                return NULL;
+            }
+
+            jd->path->length = start + strlen(jd->path->data + start);
+        } else if (p = jd_parse_string(p, NULL), !p) {
+            return NULL;
+        }
+
+        if (p = jd_skip(p), *p != ':') {
+            return NULL;
+        }
+
+        if (p = jd_parse_value(jd, jd_skip(p + 1), depth, mode), !p) {
+            return NULL;
+        }
+
+        switch (*(p = jd_skip(p))) {
+        case ',':
+            p++;
+            break;
+
+        case '}':
+            if (mode == JD_MEMBER) {
+                jd->path->length = base;
+                jd->path->data[base] = '\0';
+            }
 
-            case cJSON_True:
-                fillData(lf, key, VALUE_TRUE);
-                break;
+            return p + 1;
 
-            case cJSON_False:
-                fillData(lf, key, VALUE_FALSE);
-                break;
+        default:
+            return NULL;
+        }
+    }
+}
+
+static const char * jd_parse_array(jd_tokenizer *jd, const char *p, unsigned int depth, jd_mode mode) {
+    if (p = jd_skip(p + 1), *p == ']') {
+        return p + 1;
+    }
+
+    while (1) {
+        if (p = jd_parse_value(jd, jd_skip(p), depth, mode), !p) {
+            return NULL;
+        }
+
+        switch (*(p = jd_skip(p))) {
+        case ',':
+            p++;
+            break;
+        case ']':
+            return p + 1;
+        default:
+            return NULL;
+        }
+    }
+}
+
+/* Arrays become a CSV string, their cJSON_Print() output, or nothing at all,
+ * depending on the decoder flags.
+ */
+static const char * jd_parse_member_array(jd_tokenizer *jd, const char *p, unsigned int depth) {
+    if (jd->flags & CSV_STRING) {
+        jd->value->length = 0;
+        jd_reserve(jd->value, 0);
+        jd->value->data[0] = '\0';
+        jd->overflow = 0;
+
+        if (p = jd_parse_array(jd, p, depth, JD_ELEMENT), !p) {
+            return NULL;
+        }
+
+        if (!jd->overflow && jd->value->length > 0) {
+            jd_stage(jd, jd->value->data);
+        }
+
+        return p;
+    }
+
+    if (jd->flags & JSON_ARRAY) {
+        const char *end;
+        cJSON *array;
+        char *value;
+
+        if (array = cJSON_ParseWithOpts(p, &end, 0), !array) {
+            return NULL;
+        }
 
-            case cJSON_Object:
-                readJSON (logJSON->child, key, lf);
-                break;
+        if (value = cJSON_Print(array), value) {
+            if (*value != '\0') {
+                jd_stage(jd, value);
+            }
 
-        } // switch
-        logJSON = next;
-        free (key);
-        key = NULL;
-    } // while
+            free(value);
+        }
 
+        cJSON_Delete(array);
+        return end;
+    }
+
+    return jd_parse_array(jd, p, depth, JD_SKIP);
+}
+
+static const char * jd_parse_value(jd_tokenizer *jd, const char *p, unsigned int depth, jd_mode mode) {
+    const char *literal = NULL;
+    char number[64];
+    size_t start;
+
+    switch (*p) {
+    case '{':
+        if (depth >= JSON_NESTING_LIMIT) {
+            return NULL;
+        }
+
+        return jd_parse_object(jd, p, depth + 1, mode == JD_MEMBER ? JD_MEMBER : JD_SKIP, 1);
+
+    case '[':
+        if (depth >= JSON_NESTING_LIMIT) {
+            return NULL;
+        }
+
+        return mode == JD_MEMBER ? jd_parse_member_array(jd, p, depth + 1) : jd_parse_array(jd, p, depth + 1, JD_SKIP);
+
+    case '"':
+        switch (mode) {
+        case JD_MEMBER:
+            jd->value->length = 0;
+            jd_reserve(jd->value, 0);
+            jd->value->data[0] = '\0';
+
+            if (p = jd_parse_string(p, jd->value), p) {
+                jd_stage(jd, jd->value->data);
+            }
+
+            return p;
+
+        case JD_ELEMENT:
+            start = jd->value->length;
+
+            if (p = jd_parse_string(p, jd->value), p) {
+                jd_join(jd, start);
+            }
+
+            return p;
+
+        default:
+            return jd_parse_string(p, NULL);
+        }
+
+    case 'n':
+        if (strncmp(p, "null", 4)) {
+            return NULL;
+        }
+
+        if (mode == JD_ELEMENT) {
+            literal = "null";
+        } else if (mode == JD_MEMBER) {
+            if (jd->flags & EMPTY) {
+                jd_stage(jd, "");
+            } else if (jd->flags & SHOW_STRING) {
+                jd_stage(jd, "null");
+            }
+        }
+
+        p += 4;
+        break;
+
+    case 't':
+        if (strncmp(p, "true", 4)) {
+            return NULL;
+        }
+
+        literal = "true";
+        p += 4;
+        break;
+
+    case 'f':
+        if (strncmp(p, "false", 5)) {
+            return NULL;
+        }
+
+        literal = "false";
+        p += 5;
+        break;
+
+    default:
+        if (!(*p == '-' || (*p >= '0' && *p <= '9')) || (p = jd_parse_number(p, number, sizeof(number)), !p)) {
+            return NULL;
+        }
+
+        literal = number;
+    }
+
+    if (literal) {
+        if (mode == JD_MEMBER) {
+            jd_stage(jd, literal);
+        } else if (mode == JD_ELEMENT) {
+            start = jd->value->length;
+            jd_append(jd->value, literal, strlen(literal));
+            jd_join(jd, start);
+        }
+    }
+
+    return p;
+}
+
+/* Tokenize the event and fill its fields. Only the members of a root object
+ * produce fields. Return 0 on success or -1 if the text is not valid JSON.
+ */
+static int readJSON(const char *input, Eventinfo *lf)
+{
+    jd_tokenizer jd = { lf->decoder_info->flags, &jd_path, &jd_value, &jd_pairs, 0, 0 };
+    const char *p;
+    const char *key;
+    const char *value;
+    unsigned int i;
+
+    // Skip the UTF-8 BOM
+    if (strncmp(input, "\xEF\xBB\xBF", 3) == 0) {
+        input += 3;
+    }
+
+    jd_path.length = 0;
+    jd_reserve(&jd_path, 0);
+    *jd_path.data = '\0';
+    jd_pairs.length = 0;
+
+    if (p = jd_skip(input), *p == '{') {
+        p = jd_parse_object(&jd, p, 1, JD_MEMBER, 0);
+    } else {
+        p = jd_parse_value(&jd, p, 0, JD_SKIP);
+    }
+
+    if (!p) {
+        return -1;
+    }
+
+    for (i = 0, key = jd_pairs.data; i < jd.count; i++, key = value + strlen(value) + 1) {
+        value = key + strlen(key) + 1;
+        fillData(lf, key, value);
+    }
+
+    return 0;
 }
 
 void *JSON_Decoder_Init()
@@ -376,7 +736,6 @@ void *JSON_Decoder_Init()
 
 void *JSON_Decoder_Exec(Eventinfo *lf, __attribute__((unused)) regex_matching *decoder_match)
 {
-    cJSON *logJSON;
     const char * input;
 
     switch (lf->decoder_info->plugin_offset) {
@@ -400,15 +759,8 @@ void *JSON_Decoder_Exec(Eventinfo *lf, __attribute__((unused)) regex_matching *d
     else {
         mdebug2("Decoding JSON: '%.32s'", input);
 
-        const char *jsonErrPtr;
-        logJSON = cJSON_ParseWithOpts(input, &jsonErrPtr, 0);
-        if (!logJSON)
+        if (readJSON(input, lf) < 0)
             mdebug2("Malformed JSON string '%s'", input);
-        else
-        {
-            readJSON (logJSON, NULL, lf);
-            cJSON_Delete (logJSON);
-        }
     }
     return (NULL);
 }
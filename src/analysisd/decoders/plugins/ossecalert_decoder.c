@@ -99,11 +99,9 @@ void *OSSECAlert_Decoder_Exec(Eventinfo *lf, __attribute__((unused)) regex_match
              AGENTINFO_DIR, lf->hostname, lf->location);
 
     snprintf(oa_newlocation, 255, "%s|%s", lf->location, oa_location);
-    free(lf->location);
+    Free_EventinfoField(lf, &lf->location);
     os_strdup(oa_newlocation, lf->location);
-    if (lf->hostname) {
-        free(lf->hostname);
-    }
+    Free_EventinfoField(lf, &lf->hostname);
     os_strdup(lf->location, lf->hostname);
 
     /* Writting to the agent file */
@@ -147,8 +145,7 @@ void *OSSECAlert_Decoder_Exec(Eventinfo *lf, __attribute__((unused)) regex_match
     tmpstr_buffer[4095] = '\0';
     strncpy(tmpstr_buffer, tmp_str, 4094);
 
-    free(lf->full_log);
-    lf->full_log = NULL;
+    Free_EventinfoField(lf, &lf->full_log);
     os_strdup(tmpstr_buffer, lf->full_log);
     lf->log = lf->full_log;
 
@@ -209,8 +209,10 @@ int DecodeRootcheck(Eventinfo *lf)
                 lf->decoder_info = rootcheck_dec;
                 lf->nfields = RK_NFIELDS;
                 os_strdup(rootcheck_dec->fields[RK_TITLE], lf->fields[RK_TITLE].key);
+                lf->fields[RK_TITLE].id = FieldId_Get(lf->fields[RK_TITLE].key);
                 lf->fields[RK_TITLE].value = rk_get_title(lf->log);
                 os_strdup(rootcheck_dec->fields[RK_FILE], lf->fields[RK_FILE].key);
+                lf->fields[RK_FILE].id = FieldId_Get(lf->fields[RK_FILE].key);
                 lf->fields[RK_FILE].value = rk_get_file(lf->log);
                 w_mutex_unlock(&rootcheck_mutex[agent_id]);
                 return (1);
@@ -234,8 +236,10 @@ int DecodeRootcheck(Eventinfo *lf)
                 lf->decoder_info = rootcheck_dec;
                 lf->nfields = RK_NFIELDS;
                 os_strdup(rootcheck_dec->fields[RK_TITLE], lf->fields[RK_TITLE].key);
+                lf->fields[RK_TITLE].id = FieldId_Get(lf->fields[RK_TITLE].key);
                 lf->fields[RK_TITLE].value = rk_get_title(lf->log);
                 os_strdup(rootcheck_dec->fields[RK_FILE], lf->fields[RK_FILE].key);
+                lf->fields[RK_FILE].id = FieldId_Get(lf->fields[RK_FILE].key);
                 lf->fields[RK_FILE].value = rk_get_file(lf->log);
                 w_mutex_unlock(&rootcheck_mutex[agent_id]);
                 return (1);
@@ -260,8 +264,10 @@ int DecodeRootcheck(Eventinfo *lf)
     lf->rootcheck_fts = fts_r;
     lf->nfields = RK_NFIELDS;
     os_strdup(rootcheck_dec->fields[RK_TITLE], lf->fields[RK_TITLE].key);
+    lf->fields[RK_TITLE].id = FieldId_Get(lf->fields[RK_TITLE].key);
     lf->fields[RK_TITLE].value = rk_get_title(lf->log);
     os_strdup(rootcheck_dec->fields[RK_FILE], lf->fields[RK_FILE].key);
+    lf->fields[RK_FILE].id = FieldId_Get(lf->fields[RK_FILE].key);
     lf->fields[RK_FILE].value = rk_get_file(lf->log);
 
     w_mutex_unlock(&rootcheck_mutex[agent_id]);
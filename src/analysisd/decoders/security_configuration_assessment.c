@@ -37,10 +37,12 @@ static int SaveEventcheck(Eventinfo *lf, int exists, int *socket, int id , int s
         char *reason, cJSON *event);
 static int SaveScanInfo(Eventinfo *lf,int *socket, char * policy_id,int scan_id, int pm_start_scan, int pm_end_scan,
         int pass,int failed, int invalid, int total_checks, int score,char * hash,int update);
-static int SaveCompliance(Eventinfo *lf,int *socket, int id_check, char *key, char *value);
-static int SaveRules(Eventinfo *lf,int *socket, int id_check, char *type, char *rule);
+static int SaveCompliance(Eventinfo *lf, int id_check, char *key, char *value);
+static int SaveRules(Eventinfo *lf, int id_check, char *type, char *rule);
 static int SavePolicyInfo(Eventinfo *lf, int *socket, char *name, char *file, char * id, char *description, char *references,
         char *hash_file);
+static int SaveAsync(const char *msg);
+static void WaitSaves();
 static void HandleCheckEvent(Eventinfo *lf, int *socket, cJSON *event);
 static void HandleScanInfo(Eventinfo *lf, int *socket, cJSON *event);
 static void HandlePoliciesInfo(Eventinfo *lf, int *socket, cJSON *event);
@@ -68,6 +70,10 @@ static int cfgar_socket;
 
 static w_queue_t * request_queue;
 
+/* The compliance and rules of the checks are only saved, so they're pipelined
+ * through this connection instead of waiting for each one */
+static __thread wdbc_async_t sca_async;
+
 void SecurityConfigurationAssessmentInit()
 {
 
@@ -78,6 +84,7 @@ void SecurityConfigurationAssessmentInit()
     sca_json_dec->fts = 0;
 
     request_queue = queue_init(1024);
+    queue_metrics_register(request_queue, "sca_request");
 
     w_create_thread(RequestDBThread,NULL);
 
@@ -488,6 +495,8 @@ static int DeletePolicy(Eventinfo *lf, char *policy, int *socket) {
     char *response = NULL;
     int retval = -1;
 
+    WaitSaves();
+
     os_calloc(OS_MAXSTR, sizeof(char), msg);
     os_calloc(OS_MAXSTR, sizeof(char), response);
 
@@ -524,6 +533,8 @@ static int DeletePolicyCheck(Eventinfo *lf, char *policy, int *socket) {
     char *response = NULL;
     int retval = -1;
 
+    WaitSaves();
+
     os_calloc(OS_MAXSTR, sizeof(char), msg);
     os_calloc(OS_MAXSTR, sizeof(char), response);
 
@@ -560,6 +571,8 @@ static int DeletePolicyCheckDistinct(Eventinfo *lf, char *policy_id,int scan_id,
     char *response = NULL;
     int retval = -1;
 
+    WaitSaves();
+
     os_calloc(OS_MAXSTR, sizeof(char), msg);
     os_calloc(OS_MAXSTR, sizeof(char), response);
 
@@ -681,62 +694,78 @@ static int SavePolicyInfo(Eventinfo *lf,int *socket, char *name,char *file, char
     }
 }
 
-static int SaveCompliance(Eventinfo *lf,int *socket, int id_check, char *key, char *value) {
+static int SaveCompliance(Eventinfo *lf, int id_check, char *key, char *value) {
     assert(lf);
     assert(key);
     assert(value);
 
     char *msg = NULL;
-    char *response = NULL;
 
     os_calloc(OS_MAXSTR, sizeof(char), msg);
-    os_calloc(OS_MAXSTR, sizeof(char), response);
 
     mdebug1("Saving compliance key:'%s', value:'%s' for check: %d", key, value, id_check);
 
     snprintf(msg, OS_MAXSTR - 1, "agent %s sca insert_compliance %d|%s|%s",lf->agent_id, id_check,key,value );
 
-    if (!wdbc_query_ex(socket, msg, response, OS_MAXSTR))
+    if (!SaveAsync(msg))
     {
         free(msg);
-        os_free(response);
         return 0;
     }
     else
     {
         free(msg);
-        os_free(response);
         return -1;
     }
 }
 
-static int SaveRules(Eventinfo *lf,int *socket, int id_check, char *type, char *rule) {
+static int SaveRules(Eventinfo *lf, int id_check, char *type, char *rule) {
     assert(lf);
 
     char *msg = NULL;
-    char *response = NULL;
 
     os_calloc(OS_MAXSTR, sizeof(char), msg);
-    os_calloc(OS_MAXSTR, sizeof(char), response);
 
     mdebug1("Saving rules for check id '%d'. Rule: %s", id_check, rule);
 
     snprintf(msg, OS_MAXSTR - 1, "agent %s sca insert_rules %d|%s|%s",lf->agent_id, id_check, type, rule);
 
-    if (!wdbc_query_ex(socket, msg, response, OS_MAXSTR))
+    if (!SaveAsync(msg))
     {
         free(msg);
-        os_free(response);
         return 0;
     }
     else
     {
         free(msg);
-        os_free(response);
         return -1;
     }
 }
 
+static void SaveAsyncDone(char *response, __attribute__((unused)) void *arg) {
+    // A lost connection was already logged
+    if (response && wdbc_parse_result(response, NULL) != WDBC_OK) {
+        mdebug1("Bad response from wazuh-db to a configuration assessment save query.");
+    }
+}
+
+static int SaveAsync(const char *msg) {
+    assert(msg);
+
+    if (!sca_async.window) {
+        wdbc_async_init(&sca_async, WDBC_ASYNC_WINDOW);
+    }
+
+    return wdbc_async_query(&sca_async, msg, SaveAsyncDone, NULL) < 0 ? -1 : 0;
+}
+
+/* Anything deleted afterwards on another connection must include the rows saved */
+static void WaitSaves() {
+    if (sca_async.window) {
+        wdbc_async_wait(&sca_async);
+    }
+}
+
 static void HandleCheckEvent(Eventinfo *lf,int *socket,cJSON *event) {
 
     assert(lf);
@@ -867,7 +896,7 @@ static void HandleCheckEvent(Eventinfo *lf,int *socket,cJSON *event) {
                             value = comp->valuestring;
                         }
 
-                        SaveCompliance(lf,socket,id->valueint,key,value);
+                        SaveCompliance(lf,id->valueint,key,value);
 
                         if(free_value) {
                             os_free(value);
@@ -911,7 +940,7 @@ static void HandleCheckEvent(Eventinfo *lf,int *socket,cJSON *event) {
                                     continue;
                             }
 
-                            SaveRules(lf, socket, id->valueint, type, rule->valuestring);
+                            SaveRules(lf, id->valueint, type, rule->valuestring);
 
                             os_free(type);
                         }
@@ -63,7 +63,7 @@ void sdb_clean(_sdb *localsdb);
 int fim_get_scantime (long *ts, Eventinfo *lf, _sdb *sdb, const char *param);
 
 // Process fim alert
-static int fim_process_alert(_sdb *sdb, Eventinfo *lf, cJSON *event);
+static int fim_process_alert(_sdb *sdb, Eventinfo *lf, cJSON *event, const char *payload, size_t payload_length);
 
 // Generate fim alert
 
@@ -83,15 +83,33 @@ static int fim_generate_alert(Eventinfo *lf, char *event_type, cJSON *attributes
 // Send save query to Wazuh DB
 static void fim_send_db_save(_sdb * sdb, const char * agent_id, cJSON * data);
 
+// Send the original payload of an event to be saved, as long as it fits in a query
+static int fim_send_db_save_payload(_sdb * sdb, const char * agent_id, const char * payload, size_t length);
+
 // Send delete query to Wazuh DB
 void fim_send_db_delete(_sdb * sdb, const char * agent_id, const char * path);
 
 // Send a query to Wazuh DB
 void fim_send_db_query(int * sock, const char * query);
 
+// Send the queries queued by this thread
+void fim_flush_db(_sdb * sdb);
+
+// Save and delete queries queued by this decoder thread, while Config.wdb_batch is set
+static __thread wdbc_batch_t fim_batch;
+
+// Connection the batches of this thread are pipelined through
+static __thread wdbc_async_t fim_async;
+
+// Queue a query into the batch of this thread
+static int fim_batch_add(int * sock, const char * query);
+
 // Build change comment
 static size_t fim_generate_comment(char * str, long size, const char * format, const char * a1, const char * a2);
 
+// Join the hard links of a printed JSON array with commas
+static void fim_join_hard_links(const char * array, char * list, size_t size);
+
 // Process scan info event
 static void fim_process_scan_info(_sdb * sdb, const char * agent_id, fim_scan_event event, cJSON * data);
 
@@ -457,6 +475,7 @@ int fim_db_search(char *f_name, char *c_sum, char *w_sum, Eventinfo *lf, _sdb *s
         lf->nfields = FIM_NFIELDS;
         for (i = 0; i < FIM_NFIELDS; i++) {
             os_strdup(lf->decoder_info->fields[i], lf->fields[i].key);
+            lf->fields[i].id = FieldId_Get(lf->fields[i].key);
         }
 
         if(fim_alert(f_name, &oldsum, &newsum, lf, sdb) == -1) {
@@ -733,7 +752,7 @@ int fim_alert (char *f_name, sk_sum_t *oldsum, sk_sum_t *newsum, Eventinfo *lf,
     }
 
     // Create a new log message
-    free(lf->full_log);
+    Free_EventinfoField(lf, &lf->full_log);
     os_strdup(localsdb->comment, lf->full_log);
     lf->log = lf->full_log;
 
@@ -1161,6 +1180,8 @@ int decode_fim_event(_sdb *sdb, Eventinfo *lf) {
      */
 
     cJSON *root_json = NULL;
+    const char *payload;
+    size_t payload_length = 0;
     int retval = 0;
 
     assert(sdb != NULL);
@@ -1176,7 +1197,10 @@ int decode_fim_event(_sdb *sdb, Eventinfo *lf) {
 
     if (type != NULL && data != NULL) {
         if (strcmp(type, "event") == 0) {
-            if (fim_process_alert(sdb, lf, data) == -1) {
+            // wazuh-db reads the original data member, so it doesn't need to be printed again
+            payload = json_scan_member(lf->log, "data", &payload_length);
+
+            if (fim_process_alert(sdb, lf, data, payload, payload_length) == -1) {
                 merror("Can't generate fim alert for event: '%s'", lf->log);
                 cJSON_Delete(root_json);
                 return retval;
@@ -1199,7 +1223,7 @@ int decode_fim_event(_sdb *sdb, Eventinfo *lf) {
 }
 
 
-static int fim_process_alert(_sdb * sdb, Eventinfo *lf, cJSON * event) {
+static int fim_process_alert(_sdb * sdb, Eventinfo *lf, cJSON * event, const char *payload, size_t payload_length) {
     cJSON *attributes = NULL;
     cJSON *old_attributes = NULL;
     cJSON *audit = NULL;
@@ -1286,7 +1310,10 @@ static int fim_process_alert(_sdb * sdb, Eventinfo *lf, cJSON * event) {
     switch (lf->event_type) {
     case FIM_ADDED:
     case FIM_MODIFIED:
-        fim_send_db_save(sdb, lf->agent_id, event);
+        if (payload == NULL || fim_send_db_save_payload(sdb, lf->agent_id, payload, payload_length) < 0) {
+            fim_send_db_save(sdb, lf->agent_id, event);
+        }
+
         break;
 
     case FIM_DELETED:
@@ -1319,13 +1346,38 @@ void fim_send_db_save(_sdb * sdb, const char * agent_id, cJSON * data) {
         goto end;
     }
 
-    fim_send_db_query(&sdb->socket, query);
+    if (Config.wdb_batch) {
+        fim_batch_add(&sdb->socket, query);
+    } else {
+        fim_send_db_query(&sdb->socket, query);
+    }
 
 end:
     free(data_plain);
     free(query);
 }
 
+int fim_send_db_save_payload(_sdb * sdb, const char * agent_id, const char * payload, size_t length) {
+    char * query;
+    int retval = -1;
+
+    os_malloc(OS_MAXSTR, query);
+
+    // Members that wazuh-db doesn't read are sent along and ignored there
+    if (length < OS_MAXSTR && snprintf(query, OS_MAXSTR, "agent %s syscheck save2 %.*s", agent_id, (int)length, payload) < OS_MAXSTR) {
+        if (Config.wdb_batch) {
+            fim_batch_add(&sdb->socket, query);
+        } else {
+            fim_send_db_query(&sdb->socket, query);
+        }
+
+        retval = 0;
+    }
+
+    free(query);
+    return retval;
+}
+
 void fim_send_db_delete(_sdb * sdb, const char * agent_id, const char * path) {
     char query[OS_SIZE_6144];
 
@@ -1334,13 +1386,29 @@ void fim_send_db_delete(_sdb * sdb, const char * agent_id, const char * path) {
         return;
     }
 
-    fim_send_db_query(&sdb->socket, query);
+    if (Config.wdb_batch) {
+        fim_batch_add(&sdb->socket, query);
+    } else {
+        fim_send_db_query(&sdb->socket, query);
+    }
+}
+
+int fim_batch_add(int * sock, const char * query) {
+    if (!fim_batch.async) {
+        wdbc_async_init(&fim_async, WDBC_ASYNC_WINDOW);
+        fim_batch.async = &fim_async;
+    }
+
+    return wdbc_batch_add(sock, &fim_batch, query);
 }
 
 void fim_send_db_query(int * sock, const char * query) {
     char * response;
     char * arg;
 
+    // Keep the order of the queries of this thread
+    wdbc_batch_wait(sock, &fim_batch);
+
     os_malloc(OS_MAXSTR, response);
 
     switch (wdbc_query_ex(sock, query, response, OS_MAXSTR)) {
@@ -1366,6 +1434,10 @@ end:
     free(response);
 }
 
+void fim_flush_db(_sdb * sdb) {
+    wdbc_batch_flush(&sdb->socket, &fim_batch);
+}
+
 
 static int fim_generate_alert(Eventinfo *lf, char *event_type, cJSON *attributes, cJSON *old_attributes, cJSON *audit) {
 
@@ -1388,6 +1460,7 @@ static int fim_generate_alert(Eventinfo *lf, char *event_type, cJSON *attributes
     lf->nfields = FIM_NFIELDS;
     for (it = 0; it < FIM_NFIELDS; it++) {
         os_strdup(lf->decoder_info->fields[it], lf->fields[it].key);
+        lf->fields[it].id = FieldId_Get(lf->fields[it].key);
     }
 
     if (fim_fetch_attributes(attributes, old_attributes, lf)) {
@@ -1471,16 +1544,11 @@ static int fim_generate_alert(Eventinfo *lf, char *event_type, cJSON *attributes
     snprintf(changed_attributes, OS_SIZE_256, "Changed attributes: %s\n", lf->fields[FIM_CHFIELDS].value);
 
     char hard_links[OS_SIZE_256];
-    cJSON *tmp = cJSON_Parse(lf->fields[FIM_HARD_LINKS].value);
     if (lf->fields[FIM_HARD_LINKS].value) {
-        cJSON *item;
-        char * hard_links_tmp = NULL;
-        cJSON_ArrayForEach(item, tmp) {
-            wm_strcat(&hard_links_tmp, item->valuestring, ',');
-        }
+        char hard_links_list[OS_SIZE_256];
 
-        snprintf(hard_links, OS_SIZE_256, "Hard links: %s\n", hard_links_tmp);
-        os_free(hard_links_tmp);
+        fim_join_hard_links(lf->fields[FIM_HARD_LINKS].value, hard_links_list, sizeof(hard_links_list));
+        snprintf(hard_links, OS_SIZE_256, "Hard links: %s\n", hard_links_list);
     }
 
     // When full_log field is too long (max 756), it is fixed to show the last part of the path (more relevant)
@@ -1520,7 +1588,6 @@ static int fim_generate_alert(Eventinfo *lf, char *event_type, cJSON *attributes
             //lf->fields[FIM_SYM_PATH].value
     );
 
-    cJSON_Delete(tmp);
 
     return 0;
 }
@@ -1539,6 +1606,75 @@ size_t fim_generate_comment(char * str, long size, const char * format, const ch
     return str_size;
 }
 
+void fim_join_hard_links(const char * array, char * list, size_t size) {
+    unsigned int code;
+    size_t n = 0;
+    int items = 0;
+    int in_string = 0;
+    char c;
+
+    /* The array was printed by cJSON, so every item is a string and only
+     * quotes, backslashes and control characters are escaped */
+    for (; *array && n + 1 < size; array++) {
+        c = *array;
+
+        if (!in_string) {
+            if (c == '"') {
+                if (items++ > 0) {
+                    list[n++] = ',';
+                }
+
+                in_string = 1;
+            }
+
+            continue;
+        }
+
+        if (c == '"') {
+            in_string = 0;
+            continue;
+        }
+
+        if (c == '\\') {
+            switch (*++array) {
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+                if (sscanf(array + 1, "%4x", &code) != 1) {
+                    list[n] = '\0';
+                    return;
+                }
+
+                c = (char)code;
+                array += 4;
+                break;
+            case '\0':
+                list[n] = '\0';
+                return;
+            default:
+                c = *array;
+            }
+        }
+
+        list[n++] = c;
+    }
+
+    list[n] = '\0';
+}
+
 // Process scan info event
 
 void fim_process_scan_info(_sdb * sdb, const char * agent_id, fim_scan_event event, cJSON * data) {
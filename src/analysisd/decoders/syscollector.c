@@ -29,6 +29,10 @@ static int prev_port_id = 0;
 static int error_process = 0;
 static int prev_process_id = 0;
 
+/* Inventory items saved by this decoder thread, while Config.wdb_batch is set */
+static __thread wdbc_batch_t sc_batch;
+static __thread wdbc_async_t sc_async;
+
 static int decode_netinfo( Eventinfo *lf, cJSON * logJSON,int *socket);
 static int decode_osinfo( Eventinfo *lf, cJSON * logJSON,int *socket);
 static int decode_hardware( Eventinfo *lf, cJSON * logJSON,int *socket);
@@ -39,6 +43,30 @@ static int decode_process( Eventinfo *lf, cJSON * logJSON,int *socket);
 
 static OSDecoderInfo *sysc_decoder = NULL;
 
+/* Send a save query, or queue it if the queries are batched */
+static int sc_send_save(int *socket, const char *msg, char *response, int len) {
+    if (Config.wdb_batch) {
+        // The batches are pipelined, so this thread doesn't wait for each one
+        if (!sc_batch.async) {
+            wdbc_async_init(&sc_async, WDBC_ASYNC_WINDOW);
+            sc_batch.async = &sc_async;
+        }
+
+        return wdbc_batch_add(socket, &sc_batch, msg);
+    }
+
+    if (wdbc_query_ex(socket, msg, response, len) != 0 || wdbc_parse_result(response, NULL) != WDBC_OK) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Send the inventory items queued by this thread */
+void SyscollectorFlush(int *socket) {
+    wdbc_batch_flush(socket, &sc_batch);
+}
+
 void SyscollectorInit(){
 
     os_calloc(1, sizeof(OSDecoderInfo), sysc_decoder);
@@ -970,14 +998,7 @@ int decode_port( Eventinfo *lf, cJSON * logJSON,int *socket) {
             wm_strcat(&msg, "NULL", '|');
         }
 
-        char *message;
-        if (wdbc_query_ex(socket, msg, response, OS_SIZE_6144) == 0) {
-            if (wdbc_parse_result(response, &message) != WDBC_OK) {
-                error_port = 1;
-                prev_port_id = scan_id->valueint;
-                goto end;
-            }
-        } else {
+        if (sc_send_save(socket, msg, response, OS_SIZE_6144) < 0) {
             error_port = 1;
             prev_port_id = scan_id->valueint;
             goto end;
@@ -1001,6 +1022,13 @@ int decode_port( Eventinfo *lf, cJSON * logJSON,int *socket) {
                 }
             }
 
+            // The items of the scan must be stored before the older ones are deleted
+            if (wdbc_batch_wait(socket, &sc_batch) < 0) {
+                error_port = 1;
+                prev_port_id = scan_id->valueint;
+                goto end;
+            }
+
             snprintf(msg, OS_SIZE_6144 - 1, "agent %s port del %d", lf->agent_id, scan_id->valueint);
 
             char *message;
@@ -1138,161 +1166,219 @@ end:
     return retval;
 }
 
-int decode_package( Eventinfo *lf,cJSON * logJSON,int *socket) {
+/* Save a package of a scan. The fields of the event are only filled with
+ * the package of single messages, not with the ones of a batch. */
+static int decode_package_item(Eventinfo *lf, cJSON * package, int scan_id, cJSON * scan_time, int fill, int *socket) {
     char * msg = NULL;
     char * response = NULL;
-    cJSON * package;
-    cJSON * scan_id;
-    int retval = -1;
-
-    if (scan_id = cJSON_GetObjectItem(logJSON, "ID"), !scan_id) {
-        return -1;
-    }
+    int retval;
 
     os_calloc(OS_SIZE_6144, sizeof(char), msg);
     os_calloc(OS_SIZE_6144, sizeof(char), response);
 
-    if (package = cJSON_GetObjectItem(logJSON, "program"), package) {
-        if (error_package) {
-            if (scan_id->valueint == prev_package_id) {
-                retval = 0;
-                goto end;
-            } else {
-                error_package = 0;
-            }
-        }
-        cJSON * scan_time = cJSON_GetObjectItem(logJSON, "timestamp");
-        cJSON * format = cJSON_GetObjectItem(package, "format");
-        cJSON * name = cJSON_GetObjectItem(package, "name");
-        cJSON * priority = cJSON_GetObjectItem(package, "priority");
-        cJSON * section = cJSON_GetObjectItem(package, "group");
-        cJSON * size = cJSON_GetObjectItem(package, "size");
-        cJSON * vendor = cJSON_GetObjectItem(package, "vendor");
-        cJSON * version = cJSON_GetObjectItem(package, "version");
-        cJSON * architecture = cJSON_GetObjectItem(package, "architecture");
-        cJSON * multiarch = cJSON_GetObjectItem(package, "multi-arch");
-        cJSON * source = cJSON_GetObjectItem(package, "source");
-        cJSON * description = cJSON_GetObjectItem(package, "description");
-        cJSON * installtime = cJSON_GetObjectItem(package, "install_time");
-        cJSON * location = cJSON_GetObjectItem(package, "location");
-
-        snprintf(msg, OS_SIZE_6144 - 1, "agent %s package save", lf->agent_id);
+    cJSON * format = cJSON_GetObjectItem(package, "format");
+    cJSON * name = cJSON_GetObjectItem(package, "name");
+    cJSON * priority = cJSON_GetObjectItem(package, "priority");
+    cJSON * section = cJSON_GetObjectItem(package, "group");
+    cJSON * size = cJSON_GetObjectItem(package, "size");
+    cJSON * vendor = cJSON_GetObjectItem(package, "vendor");
+    cJSON * version = cJSON_GetObjectItem(package, "version");
+    cJSON * architecture = cJSON_GetObjectItem(package, "architecture");
+    cJSON * multiarch = cJSON_GetObjectItem(package, "multi-arch");
+    cJSON * source = cJSON_GetObjectItem(package, "source");
+    cJSON * description = cJSON_GetObjectItem(package, "description");
+    cJSON * installtime = cJSON_GetObjectItem(package, "install_time");
+    cJSON * location = cJSON_GetObjectItem(package, "location");
+
+    snprintf(msg, OS_SIZE_6144 - 1, "agent %s package save", lf->agent_id);
 
-        char id[OS_SIZE_1024];
-        snprintf(id, OS_SIZE_1024 - 1, "%d", scan_id->valueint);
-        wm_strcat(&msg, id, ' ');
+    char id[OS_SIZE_1024];
+    snprintf(id, OS_SIZE_1024 - 1, "%d", scan_id);
+    wm_strcat(&msg, id, ' ');
 
-        if (scan_time) {
-            wm_strcat(&msg, scan_time->valuestring, '|');
-        } else {
-            wm_strcat(&msg, "NULL", '|');
-        }
+    if (scan_time) {
+        wm_strcat(&msg, scan_time->valuestring, '|');
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (format) {
-            wm_strcat(&msg, format->valuestring, '|');
+    if (format) {
+        wm_strcat(&msg, format->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.format",format->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (name) {
-            wm_strcat(&msg, name->valuestring, '|');
+    if (name) {
+        wm_strcat(&msg, name->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.name",name->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (priority) {
-            wm_strcat(&msg, priority->valuestring, '|');
+    if (priority) {
+        wm_strcat(&msg, priority->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.priority",priority->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (section) {
-            wm_strcat(&msg, section->valuestring, '|');
+    if (section) {
+        wm_strcat(&msg, section->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.section",section->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (size) {
-            char _size[OS_SIZE_512];
-            snprintf(_size, OS_SIZE_512 - 1, "%d", size->valueint);
+    if (size) {
+        char _size[OS_SIZE_512];
+        snprintf(_size, OS_SIZE_512 - 1, "%d", size->valueint);
+        if (fill) {
             fillData(lf,"program.size",_size);
-            wm_strcat(&msg, _size, '|');
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+        wm_strcat(&msg, _size, '|');
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (vendor) {
-            wm_strcat(&msg, vendor->valuestring, '|');
+    if (vendor) {
+        wm_strcat(&msg, vendor->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.vendor",vendor->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (installtime) {
-            wm_strcat(&msg, installtime->valuestring, '|');
+    if (installtime) {
+        wm_strcat(&msg, installtime->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.install_time",installtime->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (version) {
-            wm_strcat(&msg, version->valuestring, '|');
+    if (version) {
+        wm_strcat(&msg, version->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.version",version->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (architecture) {
-            wm_strcat(&msg, architecture->valuestring, '|');
+    if (architecture) {
+        wm_strcat(&msg, architecture->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.architecture",architecture->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (multiarch) {
-            wm_strcat(&msg, multiarch->valuestring, '|');
+    if (multiarch) {
+        wm_strcat(&msg, multiarch->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.multiarch",multiarch->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (source) {
-            wm_strcat(&msg, source->valuestring, '|');
+    if (source) {
+        wm_strcat(&msg, source->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.source",source->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (description) {
-            wm_strcat(&msg, description->valuestring, '|');
+    if (description) {
+        wm_strcat(&msg, description->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.description",description->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        if (location) {
-            wm_strcat(&msg, location->valuestring, '|');
+    if (location) {
+        wm_strcat(&msg, location->valuestring, '|');
+        if (fill) {
             fillData(lf,"program.location",location->valuestring);
-        } else {
-            wm_strcat(&msg, "NULL", '|');
         }
+    } else {
+        wm_strcat(&msg, "NULL", '|');
+    }
 
-        char *message;
-        if (wdbc_query_ex(socket, msg, response, OS_SIZE_6144) == 0) {
-            if (wdbc_parse_result(response, &message) != WDBC_OK) {
-                error_package = 1;
-                prev_package_id = scan_id->valueint;
+    retval = sc_send_save(socket, msg, response, OS_SIZE_6144);
+
+    free(response);
+    free(msg);
+    return retval;
+}
+
+int decode_package( Eventinfo *lf,cJSON * logJSON,int *socket) {
+    char * msg = NULL;
+    char * response = NULL;
+    cJSON * package;
+    cJSON * scan_id;
+    int retval = -1;
+
+    if (scan_id = cJSON_GetObjectItem(logJSON, "ID"), !scan_id) {
+        return -1;
+    }
+
+    os_calloc(OS_SIZE_6144, sizeof(char), msg);
+    os_calloc(OS_SIZE_6144, sizeof(char), response);
+
+    if (package = cJSON_GetObjectItem(logJSON, "program"), package) {
+        if (error_package) {
+            if (scan_id->valueint == prev_package_id) {
+                retval = 0;
                 goto end;
+            } else {
+                error_package = 0;
             }
-        } else {
+        }
+        cJSON * scan_time = cJSON_GetObjectItem(logJSON, "timestamp");
+
+        if (decode_package_item(lf, package, scan_id->valueint, scan_time, 1, socket) < 0) {
             error_package = 1;
             prev_package_id = scan_id->valueint;
             goto end;
         }
+    } else if (package = cJSON_GetObjectItem(logJSON, "programs"), cJSON_IsArray(package)) {
+        // Batch of packages of the same scan
+        if (error_package) {
+            if (scan_id->valueint == prev_package_id) {
+                retval = 0;
+                goto end;
+            } else {
+                error_package = 0;
+            }
+        }
+
+        cJSON * scan_time = cJSON_GetObjectItem(logJSON, "timestamp");
+        cJSON * item;
+
+        cJSON_ArrayForEach(item, package) {
+            if (decode_package_item(lf, item, scan_id->valueint, scan_time, 0, socket) < 0) {
+                error_package = 1;
+                prev_package_id = scan_id->valueint;
+                goto end;
+            }
+        }
     } else {
         // Looking for 'end' message.
         char * msg_type = NULL;
@@ -1312,6 +1398,13 @@ int decode_package( Eventinfo *lf,cJSON * logJSON,int *socket) {
                 }
             }
 
+            // The items of the scan must be stored before the older ones are deleted
+            if (wdbc_batch_wait(socket, &sc_batch) < 0) {
+                error_package = 1;
+                prev_package_id = scan_id->valueint;
+                goto end;
+            }
+
             snprintf(msg, OS_SIZE_6144 - 1, "agent %s package del %d", lf->agent_id, scan_id->valueint);
 
             char *message;
@@ -1359,7 +1452,7 @@ int decode_hotfix(Eventinfo *lf, cJSON * logJSON, int *socket) {
                 hotfix->valuestring);
 
         fillData(lf, "hotfix", hotfix->valuestring);
-        if (wdbc_query_ex(socket, msg, response, sizeof(response)) != 0 || wdbc_parse_result(response, NULL) != WDBC_OK) {
+        if (sc_send_save(socket, msg, response, sizeof(response)) < 0) {
             free(msg);
             return -1;
         }
@@ -1376,7 +1469,7 @@ int decode_hotfix(Eventinfo *lf, cJSON * logJSON, int *socket) {
         } else if (strcmp(msg_type, "hotfix_end") == 0) {
             snprintf(msg, OS_SIZE_1024 - 1, "agent %s hotfix del %d", lf->agent_id, scan_id->valueint);
 
-            if (wdbc_query_ex(socket, msg, response, sizeof(response)) != 0 || wdbc_parse_result(response, NULL) != WDBC_OK) {
+            if (wdbc_batch_wait(socket, &sc_batch) < 0 || wdbc_query_ex(socket, msg, response, sizeof(response)) != 0 || wdbc_parse_result(response, NULL) != WDBC_OK) {
                 free(msg);
                 return -1;
             }
@@ -1693,14 +1786,7 @@ int decode_process(Eventinfo *lf, cJSON * logJSON,int *socket) {
             wm_strcat(&msg, "NULL", '|');
         }
 
-        char *message;
-        if (wdbc_query_ex(socket, msg, response, OS_SIZE_6144) == 0) {
-            if (wdbc_parse_result(response, &message) != WDBC_OK) {
-                error_process = 1;
-                prev_process_id = scan_id->valueint;
-                goto end;
-            }
-        } else {
+        if (sc_send_save(socket, msg, response, OS_SIZE_6144) < 0) {
             error_process = 1;
             prev_process_id = scan_id->valueint;
             goto end;
@@ -1725,6 +1811,13 @@ int decode_process(Eventinfo *lf, cJSON * logJSON,int *socket) {
                 }
             }
 
+            // The items of the scan must be stored before the older ones are deleted
+            if (wdbc_batch_wait(socket, &sc_batch) < 0) {
+                error_process = 1;
+                prev_process_id = scan_id->valueint;
+                goto end;
+            }
+
             snprintf(msg, OS_SIZE_6144 - 1, "agent %s process del %d", lf->agent_id, scan_id->valueint);
 
             char *message;
@@ -21,20 +21,11 @@
 #include "string_op.h"
 #include <time.h>
 
-/* Logging levels */
-#define AUDIT		0
-#define CRITICAL	1
-#define ERROR		2
-#define WARNING	    3
-#define INFORMATION	4
-#define VERBOSE	    5
-
-/* Audit types */
-#define AUDIT_FAILURE 0x10000000000000LL
-#define AUDIT_SUCCESS 0x20000000000000LL
-
 static OSDecoderInfo *winevt_decoder = NULL;
 static int first_time = 0;
+static __thread w_json_writer_t winevt_writer;
+
+static int winevt_decode_xml(Eventinfo *lf);
 
 void WinevtInit(){
 
@@ -72,8 +63,107 @@ char *replace_win_format(char *str, int message){
     return result;
 }
 
+/* Copy the decoded event over full_log, that can take up to the end of the message buffer */
+static void winevt_set_log(Eventinfo *lf, const char *json, size_t length) {
+    size_t size = (size_t)(lf->msg_buffer + lf->msg_buffer_size - lf->full_log);
+
+    if (length >= size) {
+        mdebug1("Decoded EventChannel event truncated to %zu bytes.", size - 1);
+        length = size - 1;
+    }
+
+    memmove(lf->full_log, json, length);
+    lf->full_log[length] = '\0';
+    lf->log = lf->full_log;
+}
+
+/* Check that a JSON string would be printed again with the same bytes, so
+ * that its text is what the cJSON tree would give */
+static int winevt_canonical(const char *str, size_t length) {
+    size_t i;
+
+    if (length < 2 || *str != '"') {
+        return 0;
+    }
+
+    for (i = 1; i < length - 1; i++) {
+        if ((unsigned char)str[i] < 0x20) {
+            return 0;
+        } else if (str[i] == '\\') {
+            if (str[++i] == 'u' || str[i] == '/') {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* Decode an event without building the cJSON and OS_XML trees.
+ * Return -1 if it has to take the slow path. */
+static int winevt_decode_stream(Eventinfo *lf) {
+    const char *begin;
+    const char *event;
+    const char *message;
+    size_t event_length;
+    size_t message_length;
+    char *raw_message;
+    char *filtered = NULL;
+    int retval;
+
+    // The slow path reports malformed events
+    if (!json_scan_object(lf->log, &begin, NULL, NULL)) {
+        return -1;
+    }
+
+    if (event = json_scan_member(lf->log, "Event", &event_length), !event) {
+        // Events that the agent already rendered, see logcollector.winevt_render
+        if (event = json_scan_member(lf->log, "win", &event_length), !event || *event != '{') {
+            return -1;
+        }
+
+        winevt_set_log(lf, lf->log, strlen(lf->log));
+        return 0;
+    }
+
+    if (!winevt_canonical(event, event_length)) {
+        return -1;
+    }
+
+    if (message = json_scan_member(lf->log, "Message", &message_length), message) {
+        if (!winevt_canonical(message, message_length)) {
+            return -1;
+        }
+
+        os_malloc(message_length + 1, raw_message);
+        memcpy(raw_message, message, message_length);
+        raw_message[message_length] = '\0';
+        filtered = replace_win_format(raw_message, 1);
+        os_free(raw_message);
+    }
+
+    if (retval = w_winevt_render(event, event_length, filtered, &winevt_writer), retval == 0) {
+        winevt_set_log(lf, winevt_writer.buffer, winevt_writer.length);
+    }
+
+    os_free(filtered);
+    return retval;
+}
+
 /* Special decoder for Windows eventchannel */
 int DecodeWinevt(Eventinfo *lf){
+    lf->decoder_info = winevt_decoder;
+
+    if (winevt_decode_stream(lf) == 0) {
+        JSON_Decoder_Exec(lf, NULL);
+        return 0;
+    }
+
+    return winevt_decode_xml(lf);
+}
+
+/* Decode an event through the cJSON and OS_XML trees */
+static int winevt_decode_xml(Eventinfo *lf){
     OS_XML xml;
     int xml_init = 0;
     int ret_val = 0;
@@ -88,8 +178,6 @@ int DecodeWinevt(Eventinfo *lf){
     cJSON *json_received_event = NULL;
     cJSON *json_find_msg = NULL;
     cJSON *received_event = NULL;
-    int level_n;
-    unsigned long long int keywords_n;
     XML_NODE node, child;
     char *extra = NULL;
     char *filtered_string = NULL;
@@ -99,7 +187,6 @@ int DecodeWinevt(Eventinfo *lf){
     char *returned_event = NULL;
     char *event = NULL;
     char *find_msg = NULL;
-    char *severityValue = NULL;
     char *join_data = NULL;
     char *join_data2 = NULL;
     lf->decoder_info = winevt_decoder;
@@ -317,298 +404,16 @@ int DecodeWinevt(Eventinfo *lf){
             OS_ClearXML(&xml);
 
             if(level && keywords){
-                level_n = strtol(level, NULL, 10);
-                keywords_n = strtoull(keywords, NULL, 16);
-
-                switch (level_n) {
-                    case CRITICAL:
-                        severityValue = "CRITICAL";
-                        break;
-                    case ERROR:
-                        severityValue = "ERROR";
-                        break;
-                    case WARNING:
-                        severityValue = "WARNING";
-                        break;
-                    case INFORMATION:
-                        severityValue = "INFORMATION";
-                        break;
-                    case VERBOSE:
-                        severityValue = "VERBOSE";
-                        break;
-                    case AUDIT:
-                        if (keywords_n & AUDIT_FAILURE) {
-                            severityValue = "AUDIT_FAILURE";
-                            break;
-                        } else if (keywords_n & AUDIT_SUCCESS) {
-                            severityValue = "AUDIT_SUCCESS";
-                            break;
-                        }
-                        // fall through
-                    default:
-                        severityValue = "UNKNOWN";
-                }
-
-                cJSON_AddStringToObject(json_system_in, "severityValue", severityValue);
+                cJSON_AddStringToObject(json_system_in, "severityValue", w_winevt_severity(level, keywords));
 
                 // Event category, subcategory and Audit Policy Changes
 
                 if (categoryId && subcategoryId){
+                    const char *category;
+                    const char *subcategory;
+
+                    w_winevt_category(categoryId, subcategoryId, &category, &subcategory);
 
-                    char *category = NULL;
-                    char *subcategory = NULL;
-                    int categoryId_n;
-                    int subcategoryId_n;
-                    char * filtered_categoryId = wstr_replace(categoryId, "%%", "");
-                    char * filtered_subcategoryId = wstr_replace(subcategoryId, "%%", "");
-
-                    categoryId_n = strtol(filtered_categoryId, NULL, 10);
-                    subcategoryId_n = strtol(filtered_subcategoryId, NULL, 10);
-
-                    switch (categoryId_n) {
-                        case 8272:
-                            category = "System";
-                            switch (subcategoryId_n) {
-                                case 12288:
-                                    subcategory = "Security State Change";
-                                    break;
-                                case 12289:
-                                    subcategory = "Security System Extension";
-                                    break;
-                                case 12290:
-                                    subcategory = "System Integrity";
-                                    break;
-                                case 12291:
-                                    subcategory = "IPsec Driver";
-                                    break;
-                                case 12292:
-                                    subcategory = "Other System Events";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8273:
-                            category = "Logon/Logoff";
-                            switch (subcategoryId_n) {
-                                case 12544:
-                                    subcategory = "Logon";
-                                    break;
-                                case 12545:
-                                    subcategory = "Logoff";
-                                    break;
-                                case 12546:
-                                    subcategory = "Account Lockout";
-                                    break;
-                                case 12547:
-                                    subcategory = "IPsec Main Mode";
-                                    break;
-                                case 12548:
-                                    subcategory = "Special Logon";
-                                    break;
-                                case 12549:
-                                    subcategory = "IPSec Extended Mode";
-                                    break;
-                                case 12550:
-                                    subcategory = "IPSec Quick Mode";
-                                    break;
-                                case 12551:
-                                    subcategory = "Other Logon/Logoff Events";
-                                    break;
-                                case 12552:
-                                    subcategory = "Network Policy Server";
-                                    break;
-                                case 12553:
-                                    subcategory = "User/Device Claims";
-                                    break;
-                                case 12554:
-                                    subcategory = "Group Membership";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8274:
-                            category = "Object Access";
-                            switch (subcategoryId_n) {
-                                case 12800:
-                                    subcategory = "File System";
-                                    break;
-                                case 12801:
-                                    subcategory = "Registry";
-                                    break;
-                                case 12802:
-                                    subcategory = "Kernel Object";
-                                    break;
-                                case 12803:
-                                    subcategory = "SAM";
-                                    break;
-                                case 12804:
-                                    subcategory = "Other Object Access Events";
-                                    break;
-                                case 12805:
-                                    subcategory = "Certification Services";
-                                    break;
-                                case 12806:
-                                    subcategory = "Application Generated";
-                                    break;
-                                case 12807:
-                                    subcategory = "Handle Manipulation";
-                                    break;
-                                case 12808:
-                                    subcategory = "File Share";
-                                    break;
-                                case 12809:
-                                    subcategory = "Filtering Platform Packet Drop";
-                                    break;
-                                case 12810:
-                                    subcategory = "Filtering Platform Connection";
-                                    break;
-                                case 12811:
-                                    subcategory = "Detailed File Share";
-                                    break;
-                                case 12812:
-                                    subcategory = "Removable Storage";
-                                    break;
-                                case 12813:
-                                    subcategory = "Central Policy Staging";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8275:
-                            category = "Privilege Use";
-                            switch (subcategoryId_n) {
-                                case 13056:
-                                    subcategory = "Sensitive Privilege Use";
-                                    break;
-                                case 13057:
-                                    subcategory = "Non Sensitive Privilege Use";
-                                    break;
-                                case 13058:
-                                    subcategory = "Other Privilege Use Events";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8276:
-                            category = "Detailed Tracking";
-                            switch (subcategoryId_n) {
-                                case 13312:
-                                    subcategory = "Process Creation";
-                                    break;
-                                case 13313:
-                                    subcategory = "Process Termination";
-                                    break;
-                                case 13314:
-                                    subcategory = "DPAPI Activity";
-                                    break;
-                                case 13315:
-                                    subcategory = "RPC Events";
-                                    break;
-                                case 13316:
-                                    subcategory = "Plug and Play Events";
-                                    break;
-                                case 13317:
-                                    subcategory = "Token Right Adjusted Events";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8277:
-                            category = "Policy Change";
-                            switch (subcategoryId_n) {
-                                case 13568:
-                                    subcategory = "Audit Policy Change";
-                                    break;
-                                case 13569:
-                                    subcategory = "Authentication Policy Change";
-                                    break;
-                                case 13570:
-                                    subcategory = "Authorization Policy Change";
-                                    break;
-                                case 13571:
-                                    subcategory = "MPSSVC Rule-Level Policy Change";
-                                    break;
-                                case 13572:
-                                    subcategory = "Filtering Platform Policy Change";
-                                    break;
-                                case 13573:
-                                    subcategory = "Other Policy Change Events";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8278:
-                            category = "Account Management";
-                            switch (subcategoryId_n) {
-                                case 13824:
-                                    subcategory = "User Account Management";
-                                    break;
-                                case 13825:
-                                    subcategory = "Computer Account Management";
-                                    break;
-                                case 13826:
-                                    subcategory = "Security Group Management";
-                                    break;
-                                case 13827:
-                                    subcategory = "Distribution Group Management";
-                                    break;
-                                case 13828:
-                                    subcategory = "Application Group Management";
-                                    break;
-                                case 13829:
-                                    subcategory = "Other Account Management Events";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8279:
-                            category = "DS Access";
-                            switch (subcategoryId_n) {
-                                case 14080:
-                                    subcategory = "Directory Service Access";
-                                    break;
-                                case 14081:
-                                    subcategory = "Directory Service Changes";
-                                    break;
-                                case 14082:
-                                    subcategory = "Directory Service Replication";
-                                    break;
-                                case 14083:
-                                    subcategory = "Detailed Directory Service Replication";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        case 8280:
-                            category = "Account Logon";
-                            switch (subcategoryId_n) {
-                                case 14336:
-                                    subcategory = "Credential Validation";
-                                    break;
-                                case 14337:
-                                    subcategory = "Kerberos Service Ticket Operations";
-                                    break;
-                                case 14338:
-                                    subcategory = "Other Account Logon Events";
-                                    break;
-                                case 14339:
-                                    subcategory = "Kerberos Authentication Service";
-                                    break;
-                                default:
-                                    break;
-                            }
-                            break;
-                        default:
-                            break;
-                    }
                     if (category) {
                         cJSON_AddStringToObject(json_eventdata_in, "category", category);
                     }
@@ -618,51 +423,18 @@ int DecodeWinevt(Eventinfo *lf){
 
                     os_free(categoryId);
                     os_free(subcategoryId);
-                    os_free(filtered_categoryId);
-                    os_free(filtered_subcategoryId);
                 }
             }
 
             if (auditPolicyChangesId) {
-                int audit_split_n = 0;
-                char **audit_split;
-                char *audit_pol_changes = NULL;
-                char *audit_final_field = NULL;
-                int i = 0;
-
-                char * filtered_changes = wstr_replace(auditPolicyChangesId, "%%", "");
-                os_free(auditPolicyChangesId);
+                char *audit_final_field = w_winevt_audit_changes(auditPolicyChangesId);
 
-                audit_split = OS_StrBreak(',', filtered_changes, 4);
-
-                while (audit_split[i]) {
-                    audit_split_n = strtol(audit_split[i], NULL, 10);
-
-                    switch (audit_split_n) {
-                        case 8448:
-                            wm_strcat(&audit_pol_changes, "Success removed", ',');
-                            break;
-                        case 8449:
-                            wm_strcat(&audit_pol_changes, "Success added", ',');
-                            break;
-                        case 8450:
-                            wm_strcat(&audit_pol_changes, "Failure removed", ',');
-                            break;
-                        case 8451:
-                            wm_strcat(&audit_pol_changes, "Failure added", ',');
-                            break;
-                        default:
-                            break;
-                    }
-
-                    i++;
+                if (audit_final_field) {
+                    cJSON_AddStringToObject(json_eventdata_in, "auditPolicyChanges", audit_final_field);
+                    os_free(audit_final_field);
                 }
-                audit_final_field = wstr_replace(audit_pol_changes, ",", ", ");
-                cJSON_AddStringToObject(json_eventdata_in, "auditPolicyChanges", audit_final_field);
-                os_free(filtered_changes);
-                os_free(audit_pol_changes);
-                os_free(audit_final_field);
-                free_strarray(audit_split);
+
+                os_free(auditPolicyChangesId);
             }
 
             xml_init = 1;
@@ -714,8 +486,7 @@ int DecodeWinevt(Eventinfo *lf){
     returned_event = cJSON_PrintUnformatted(final_event);
 
     if (returned_event){
-        lf->full_log[strlen(returned_event)] = '\0';
-        memcpy(lf->full_log, returned_event, strlen(returned_event));
+        winevt_set_log(lf, returned_event, strlen(returned_event));
     } else {
         lf->full_log = NULL;
     }
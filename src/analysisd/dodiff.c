@@ -12,6 +12,72 @@
 
 #include "shared.h"
 
+/* Maximum number of last outputs whose digest is kept in memory */
+#define DIFF_CACHE_MAX 131072
+
+/* Digest of the last output of a rule for an agent */
+typedef struct diff_last_t {
+    uint64_t hash;
+    size_t size;
+} diff_last_t;
+
+/* Digests indexed by the path of the last file. They let unchanged outputs
+ * be told without touching the disk. */
+static OSHashOA *diff_cache;
+static pthread_mutex_t diff_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Tell whether the digest of the last output is known and matches */
+static int _diff_cached(const char *file, const diff_last_t *digest)
+{
+    diff_last_t *last;
+    int result;
+
+    w_mutex_lock(&diff_mutex);
+    last = diff_cache ? OSHashOA_Get(diff_cache, file) : NULL;
+    result = last && last->hash == digest->hash && last->size == digest->size;
+    w_mutex_unlock(&diff_mutex);
+
+    return result;
+}
+
+/* Save the digest of the last output, while there is room for it */
+static void _diff_remember(const char *file, const diff_last_t *digest)
+{
+    diff_last_t *last;
+
+    w_mutex_lock(&diff_mutex);
+
+    if (!diff_cache) {
+        diff_cache = OSHashOA_Create(0);
+        OSHashOA_SetFreeDataPointer(diff_cache, free);
+    }
+
+    if (last = OSHashOA_Get(diff_cache, file), last) {
+        *last = *digest;
+    } else if (OSHashOA_Get_Elem(diff_cache) < DIFF_CACHE_MAX) {
+        os_malloc(sizeof(diff_last_t), last);
+        *last = *digest;
+
+        if (OSHashOA_Add(diff_cache, file, last) != 2) {
+            free(last);
+        }
+    }
+
+    w_mutex_unlock(&diff_mutex);
+}
+
+/* Forget the digest of an output that could not be saved */
+static void _diff_forget(const char *file)
+{
+    w_mutex_lock(&diff_mutex);
+
+    if (diff_cache) {
+        free(OSHashOA_Delete(diff_cache, file));
+    }
+
+    w_mutex_unlock(&diff_mutex);
+}
+
 static int _add2last(const char *str, size_t strsize, const char *file)
 {
     FILE *fp;
@@ -68,6 +134,7 @@ static int _add2last(const char *str, size_t strsize, const char *file)
 int doDiff(RuleInfo *rule, Eventinfo *lf)
 {
     time_t date_of_change;
+    diff_last_t digest;
     char *htpt = NULL;
     char flastfile[OS_SIZE_2048 + 1];
     char flastcontent[OS_SIZE_65536 + 1];
@@ -105,13 +172,23 @@ int doDiff(RuleInfo *rule, Eventinfo *lf)
         return (0);
     }
 
+    digest.hash = w_hash64(lf->log, lf->size, 0);
+    digest.size = lf->size;
+
+    /* Nothing changed since the last output, which is already on disk */
+    if (_diff_cached(flastfile, &digest)) {
+        return (0);
+    }
+
     /* Check if last diff exists */
     date_of_change = File_DateofChange(flastfile);
     if (date_of_change <= 0) {
         if (!_add2last(lf->log, lf->size, flastfile)) {
             merror("Unable to create last file: %s", flastfile);
+            _diff_forget(flastfile);
             return (0);
         }
+        _diff_remember(flastfile, &digest);
         return (0);
     } else {
         FILE *fp;
@@ -136,11 +213,15 @@ int doDiff(RuleInfo *rule, Eventinfo *lf)
 
     /* Nothing changed */
     if (strcmp(flastcontent, lf->log) == 0) {
+        _diff_remember(flastfile, &digest);
         return (0);
     }
 
-    if (!_add2last(lf->log, lf->size, flastfile)) {
+    if (_add2last(lf->log, lf->size, flastfile)) {
+        _diff_remember(flastfile, &digest);
+    } else {
         merror("Unable to create last file: %s", flastfile);
+        _diff_forget(flastfile);
     }
 
     add_lastevt(lf->last_events, 0, "Previous output:");
@@ -12,6 +12,8 @@
 #include "analysisd.h"
 #include "eventinfo.h"
 #include "os_regex/os_regex.h"
+#include "labels.h"
+#include "memory_budget.h"
 
 /* Global definitions */
 #ifdef TESTRULE
@@ -25,6 +27,13 @@ EventList *last_events_list;
 int num_rule_matching_threads;
 time_t current_time = 0;
 
+/* Recycled events */
+static w_mpmc_queue_t *eventinfo_pool;
+static __thread Eventinfo *eventinfo_cache[EVENTINFO_CACHE_SIZE];
+static __thread unsigned int eventinfo_cache_n;
+
+static void Release_Eventinfo(Eventinfo *lf);
+
 size_t field_offset[] = {
     offsetof(Eventinfo, srcip),
     offsetof(Eventinfo, id),
@@ -92,7 +101,7 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *rule, __attribute__((unus
 {
     Eventinfo *lf = NULL;
     Eventinfo *first_matched = NULL;
-    OSListNode *lf_node;
+    EventListSearch search;
     int frequency_count = 0;
     int i;
     int found;
@@ -105,26 +114,12 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *rule, __attribute__((unus
         return NULL;
     }
 
-    while (1) {
-        w_mutex_lock(&rule->sid_search->mutex);
-            if (!rule->sid_search->pending_remove) {
-                rule->sid_search->count++;
-                w_mutex_unlock(&rule->sid_search->mutex);
-                break;
-            }
-        w_mutex_unlock(&rule->sid_search->mutex);
-    }
-
-    /* Get last node */
-    lf_node = OSList_GetLastNode(rule->sid_search);
-    if (!lf_node) {
-        lf = NULL;
-        goto end;
-    }
-
-    do {
-        lf = (Eventinfo *)lf_node->data;
+#ifdef TESTRULE
+    time(&current_time);
+#endif
 
+    /* Only the buckets inside the timeframe are visited */
+    for (lf = OS_SearchFirstEvent(rule->sid_search, current_time - rule->timeframe, &search); lf; lf = OS_SearchNextEvent(&search)) {
 #ifdef TESTRULE
         time(&current_time);
  #endif
@@ -236,7 +231,7 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *rule, __attribute__((unus
         if (frequency_count < rule->frequency) {
             frequency_count++;
             if (!first_matched) {
-               first_matched = lf;
+               first_matched = Hold_Eventinfo(lf);
             }
             continue;
         }
@@ -248,13 +243,15 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *rule, __attribute__((unus
             first_matched->matched = rule->level;
         }
         goto end;
-    } while ((lf_node = lf_node->prev) != NULL);
+    }
 
-    lf = NULL;
 end:
-    w_mutex_lock(&rule->sid_search->mutex);
-    rule->sid_search->count--;
-    w_mutex_unlock(&rule->sid_search->mutex);
+    OS_SearchEnd(&search);
+
+    /* It may have been evicted while it was not locked */
+    if (first_matched) {
+        Free_Eventinfo(first_matched);
+    }
     return lf;
 }
 
@@ -264,44 +261,27 @@ end:
 Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *rule, __attribute__((unused)) regex_matching *rule_match)
 {
     Eventinfo *lf = NULL;
-    OSListNode *lf_node;
     Eventinfo *first_matched = NULL;
+    EventListSearch search;
     int frequency_count = 0;
     int i;
     int found;
-    OSList *list = rule->group_search;
+    EventList *list = rule->group_search;
     const char * my_field;
     const char * field;
 
-    //w_mutex_lock(&rule->mutex);
-
     /* Check if sid search is valid */
     if (!list) {
         merror("No group search.");
         return NULL;
     }
 
-    while (1) {
-        w_mutex_lock(&list->mutex);
-            if (!list->pending_remove) {
-                list->count++;
-                w_mutex_unlock(&list->mutex);
-                break;
-            }
-        w_mutex_unlock(&list->mutex);
-    }
-
-    /* Get last node */
-    lf_node = OSList_GetLastNode_group(list);
-
-    if (!lf_node) {
-        lf = NULL;
-        goto end;
-    }
-
-    do {
-        lf = (Eventinfo *)lf_node->data;
+#ifdef TESTRULE
+    time(&current_time);
+#endif
 
+    /* Only the buckets inside the timeframe are visited */
+    for (lf = OS_SearchFirstEvent(list, current_time - rule->timeframe, &search); lf; lf = OS_SearchNextEvent(&search)) {
 #ifdef TESTRULE
         time(&current_time);
 #endif
@@ -418,7 +398,7 @@ Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *rule, __attribute__((un
         if (frequency_count < rule->frequency) {
             frequency_count++;
             if (!first_matched) {
-               first_matched = lf;
+               first_matched = Hold_Eventinfo(lf);
             }
             continue;
         }
@@ -430,14 +410,15 @@ Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *rule, __attribute__((un
             first_matched->matched = rule->level;
         }
         goto end;
-    } while ((lf_node = lf_node->prev) != NULL);
+    }
 
-    lf = NULL;
 end:
-    w_mutex_lock(&list->mutex);
-    list->count--;
-    w_mutex_unlock(&list->mutex);
-    //w_mutex_unlock(&rule->mutex);
+    OS_SearchEnd(&search);
+
+    /* It may have been evicted while it was not locked */
+    if (first_matched) {
+        Free_Eventinfo(first_matched);
+    }
     return lf;
 }
 
@@ -447,8 +428,7 @@ end:
  */
 Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *rule, regex_matching *rule_match)
 {
-    EventNode *eventnode_pt = NULL;
-    EventNode *first_pt;
+    EventListSearch search;
     Eventinfo *first_matched = NULL;
     Eventinfo *lf = NULL;
     int frequency_count = 0;
@@ -457,24 +437,12 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *rule, regex_matching *r
     const char * my_field;
     const char * field;
 
-    w_mutex_lock(&rule->mutex);
-
-    /* Get the first event */
-    if (first_pt = OS_GetFirstEvent(last_events_list), !first_pt) {
-        /* Nothing found */
-        goto end;
-    }
-
-    w_mutex_lock(&first_pt->mutex);
-    if (eventnode_pt = first_pt->next, eventnode_pt) {
-        eventnode_pt->count++;
-    }
-    w_mutex_unlock(&first_pt->mutex);
-
-    /* Search all previous events */
-    while (eventnode_pt) {
-        lf = eventnode_pt->event;
+#ifdef TESTRULE
+    time(&current_time);
+#endif
 
+    /* Search all previous events inside the timeframe */
+    for (lf = OS_SearchFirstEvent(last_events_list, current_time - rule->timeframe, &search); lf; lf = OS_SearchNextEvent(&search)) {
 #ifdef TESTRULE
         time(&current_time);
 #endif
@@ -496,53 +464,53 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *rule, regex_matching *r
 
         /* The category must be the same */
         if (lf->decoder_info->type != my_lf->decoder_info->type) {
-            goto next_it;
+            continue;
         }
 
         /* If regex does not match, go to next */
         if (rule->if_matched_regex) {
             if (!OSRegex_Execute_ex(lf->log, rule->if_matched_regex, rule_match)) {
                 /* Didn't match */
-                goto next_it;
+                continue;
             }
         }
 
         /* Check for same ID */
         if (rule->same_field & FIELD_ID) {
             if ((!lf->id) || (!my_lf->id)) {
-                goto next_it;
+                continue;
             }
 
             if (strcmp(lf->id, my_lf->id) != 0) {
-                goto next_it;
+                continue;
             }
         }
 
         /* Check for repetitions from same src_ip */
         if (rule->same_field & FIELD_SRCIP) {
             if ((!lf->srcip) || (!my_lf->srcip)) {
-                goto next_it;
+                continue;
             }
 
             if (strcmp(lf->srcip, my_lf->srcip) != 0) {
-                goto next_it;
+                continue;
             }
         }
 
         /* Searching same fields */
         if (!same_loop(rule, lf, my_lf)) {
-            goto next_it;
+            continue;
         }
 
         /* Searching different fields */
         if (!different_loop(rule, lf, my_lf)) {
-            goto next_it;
+            continue;
         }
 
         /* Check for repetitions from same dynamic fields */
         if (rule->same_field & FIELD_DYNAMICS) {
             if (my_lf->nfields == 0 || lf->nfields == 0)
-                goto next_it;
+                continue;
 
             found = 1;
             for (i = 0; rule->same_fields[i] && found; ++i) {
@@ -557,14 +525,14 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *rule, regex_matching *r
             }
 
             if (!found) {
-                goto next_it;
+                continue;
             }
         }
 
         /* Check for differences from dynamic fields values (not_same_field) */
         if (rule->different_field & FIELD_DYNAMICS) {
             if (my_lf->nfields == 0 && lf->nfields == 0)
-                goto next_it;
+                continue;
 
             found = 0;
             for (i = 0; rule->not_same_fields[i] && !found; ++i) {
@@ -578,7 +546,7 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *rule, regex_matching *r
             }
 
             if (found) {
-                goto next_it;
+                continue;
             }
         }
 
@@ -598,9 +566,9 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *rule, regex_matching *r
 
             frequency_count++;
             if (!first_matched) {
-               first_matched = lf;
+               first_matched = Hold_Eventinfo(lf);
             }
-            goto next_it;
+            continue;
         }
 
         /* If reached here, we matched */
@@ -609,26 +577,106 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *rule, regex_matching *r
             first_matched->matched = rule->level;
         }
         goto end;
-next_it:
-        w_mutex_lock(&eventnode_pt->mutex);
-        eventnode_pt->count--;
-        if (first_pt = eventnode_pt->next, first_pt) {
-            first_pt->count++;
-        }
-        w_mutex_unlock(&eventnode_pt->mutex);
-        eventnode_pt = first_pt;
-    } // while close
-    lf = NULL;
+    }
+
 end:
-    if (eventnode_pt) {
-        w_mutex_lock(&eventnode_pt->mutex);
-        eventnode_pt->count--;
-        w_mutex_unlock(&eventnode_pt->mutex);
+    OS_SearchEnd(&search);
+
+    /* It may have been evicted while it was not locked */
+    if (first_matched) {
+        Free_Eventinfo(first_matched);
+    }
+    return lf;
+}
+
+Eventinfo *Hold_Eventinfo(Eventinfo *lf) {
+    int refs = __atomic_load_n(&lf->refs, __ATOMIC_RELAXED);
+
+    /* An event with no count has a single holder */
+    while (!__atomic_compare_exchange_n(&lf->refs, &refs, (refs > 0 ? refs : 1) + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    return lf;
+}
+
+void Init_EventinfoPool(size_t size) {
+    eventinfo_pool = mpmc_queue_init(size);
+}
+
+Eventinfo *Alloc_Eventinfo(void) {
+    Eventinfo *lf = NULL;
+    DynamicField *fields;
+    size_t fields_size;
+    char *msg_buffer;
+    size_t msg_buffer_size;
+
+    if (eventinfo_cache_n > 0) {
+        lf = eventinfo_cache[--eventinfo_cache_n];
+    } else if (eventinfo_pool) {
+        lf = mpmc_queue_pop(eventinfo_pool);
+    }
+
+    if (lf) {
+        /* The fields were cleared when the event was freed */
+        fields = lf->fields;
+        fields_size = lf->fields_size;
+        msg_buffer = lf->msg_buffer;
+        msg_buffer_size = lf->msg_buffer_size;
+        memset(lf, 0, sizeof(Eventinfo));
+        lf->fields = fields;
+        lf->fields_size = fields_size;
+        lf->msg_buffer = msg_buffer;
+        lf->msg_buffer_size = msg_buffer_size;
+    } else {
+        os_calloc(1, sizeof(Eventinfo), lf);
+        os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+        lf->fields_size = Config.decoder_order_size;
     }
-    w_mutex_unlock(&rule->mutex);
+
     return lf;
 }
 
+/* Keep the event for reuse, or free it if there is no room */
+static void Release_Eventinfo(Eventinfo *lf) {
+    /* Don't let idle events hold the room of the longest messages */
+    if (lf->msg_buffer_size > EVENTINFO_BUFFER_MAX) {
+        os_free(lf->msg_buffer);
+        lf->msg_buffer_size = 0;
+    }
+
+    if (lf->fields_size == (size_t)Config.decoder_order_size) {
+        if (eventinfo_cache_n < EVENTINFO_CACHE_SIZE) {
+            eventinfo_cache[eventinfo_cache_n++] = lf;
+            return;
+        }
+
+        if (eventinfo_pool && mpmc_queue_push_ex(eventinfo_pool, lf) == 0) {
+            return;
+        }
+    }
+
+    os_free(lf->fields);
+    os_free(lf->msg_buffer);
+    os_free(lf);
+}
+
+/* Fields that may hold data. Decoders such as syscheck fill indexed fields
+ * before setting nfields, and may give up before they do, so a recyclable
+ * array is cleared whole.
+ */
+static size_t Eventinfo_FieldsUsed(const Eventinfo *lf) {
+    return lf->fields_size ? lf->fields_size : (size_t)lf->nfields;
+}
+
+void Free_EventinfoField(Eventinfo *lf, char **field) {
+    char *str = *field;
+
+    if (str && !(lf->msg_buffer && str >= lf->msg_buffer && str < lf->msg_buffer + lf->msg_buffer_size)) {
+        free(str);
+    }
+
+    *field = NULL;
+}
+
 /* Zero the loginfo structure */
 void Zero_Eventinfo(Eventinfo *lf)
 {
@@ -662,11 +710,13 @@ void Zero_Eventinfo(Eventinfo *lf)
     lf->systemname = NULL;
 
     if (lf->fields) {
-        int i;
-        for (i = 0; i < lf->nfields; i++)
+        size_t n = Eventinfo_FieldsUsed(lf);
+        size_t i;
+
+        for (i = 0; i < n; i++)
             free(lf->fields[i].value);
 
-        memset(lf->fields, 0, sizeof(DynamicField) * Config.decoder_order_size);
+        memset(lf->fields, 0, sizeof(DynamicField) * n);
     }
 
     lf->nfields = 0;
@@ -681,8 +731,6 @@ void Zero_Eventinfo(Eventinfo *lf)
     lf->day = 0;
 
     lf->generated_rule = NULL;
-    lf->sid_node_to_delete = NULL;
-    lf->group_node_to_delete = NULL;
     lf->decoder_info = NULL_Decoder;
 
     lf->filename = NULL;
@@ -704,6 +752,7 @@ void Zero_Eventinfo(Eventinfo *lf)
     lf->diff = NULL;
     lf->previous = NULL;
     lf->labels = NULL;
+    lf->label_set = NULL;
     lf->sk_tag = NULL;
     lf->sym_path = NULL;
 
@@ -737,78 +786,35 @@ void Free_Eventinfo(Eventinfo *lf)
         return;
     }
 
-    if (lf->node && lf->node->prev) {
-        EventNode *prev = lf->node->prev;
-        w_mutex_lock(&prev->mutex);
-        prev->next = NULL;
-        while (lf->node->count > 0) {}
-        w_mutex_unlock(&prev->mutex);
-    }
-
-    // Free node to delete
-    if(!lf->is_a_copy){
-        if (lf->sid_node_to_delete) {
-            w_mutex_lock(&lf->generated_rule->sid_prev_matched->mutex);
-            lf->generated_rule->sid_prev_matched->pending_remove = 1;
-            w_mutex_unlock(&lf->generated_rule->sid_prev_matched->mutex);
-            while (lf->generated_rule->sid_prev_matched->count);
-
-            OSList_DeleteThisNode(lf->generated_rule->sid_prev_matched,
-                                    lf->sid_node_to_delete);
-
-            w_mutex_lock(&lf->generated_rule->sid_prev_matched->mutex);
-            lf->generated_rule->sid_prev_matched->pending_remove = 0;
-            w_mutex_unlock(&lf->generated_rule->sid_prev_matched->mutex);
-        } else if (lf->generated_rule && lf->generated_rule->group_prev_matched) {
-            unsigned int i = 0;
-
-            // Block all lists
-            while (i < lf->generated_rule->group_prev_matched_sz) {
-                w_mutex_lock(&lf->generated_rule->group_prev_matched[i]->mutex);
-                lf->generated_rule->group_prev_matched[i]->pending_remove = 1;
-                w_mutex_unlock(&lf->generated_rule->group_prev_matched[i]->mutex);
-                i++;
-            }
-
-            i = 0;
-            // Remove the node from all lists
-            while (i < lf->generated_rule->group_prev_matched_sz) {
-                while (lf->generated_rule->group_prev_matched[i]->count > 0);
-                OSList_DeleteThisNode(lf->generated_rule->group_prev_matched[i],
-                                        lf->group_node_to_delete[i]);
-                // Unblock the list
-                w_mutex_lock(&lf->generated_rule->group_prev_matched[i]->mutex);
-                lf->generated_rule->group_prev_matched[i]->pending_remove = 0;
-                w_mutex_unlock(&lf->generated_rule->group_prev_matched[i]->mutex);
-                i++;
-            }
-
-            free(lf->group_node_to_delete);
-        }
+    /* Shared events are read-only: only the last holder frees them */
+    if (__atomic_load_n(&lf->refs, __ATOMIC_ACQUIRE) > 1 && __atomic_sub_fetch(&lf->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
     }
 
-    if (lf->is_a_copy && lf->program_name) {
-        free(lf->program_name);
+    if (lf->mem_size) {
+        w_mem_sub(W_MEM_EVENT_LISTS, lf->mem_size);
     }
 
     if (lf->comment) {
         free(lf->comment);
     }
 
-    if (lf->full_log) {
-        free(lf->full_log);
-    }
-
-    if (lf->agent_id) {
-        free(lf->agent_id);
-    }
-
-    if (lf->location) {
-        free(lf->location);
-    }
+    Free_EventinfoField(lf, &lf->full_log);
 
-    if (lf->hostname) {
-        free(lf->hostname);
+    /* Copies share the values repeated across events */
+    if (lf->is_a_copy) {
+        w_intern_release(lf->agent_id);
+        w_intern_release(lf->location);
+        w_intern_release(lf->hostname);
+        w_intern_release(lf->program_name);
+        lf->agent_id = NULL;
+        lf->location = NULL;
+        lf->hostname = NULL;
+        lf->program_name = NULL;
+    } else {
+        Free_EventinfoField(lf, &lf->agent_id);
+        Free_EventinfoField(lf, &lf->location);
+        Free_EventinfoField(lf, &lf->hostname);
     }
 
     if (lf->srcip) {
@@ -850,7 +856,9 @@ void Free_Eventinfo(Eventinfo *lf)
     if (lf->dstuser) {
         free(lf->dstuser);
     }
-    if (lf->labels && lf->labels != Config.labels) {
+    if (lf->label_set) {
+        labels_release(lf->label_set);
+    } else if (lf->labels && lf->labels != Config.labels) {
         labels_free(lf->labels);
     }
     if (lf->id) {
@@ -876,13 +884,20 @@ void Free_Eventinfo(Eventinfo *lf)
     }
 
     if (lf->fields) {
-        int i;
-        for (i = 0; i < lf->nfields; i++) {
+        size_t n = Eventinfo_FieldsUsed(lf);
+        size_t i;
+
+        for (i = 0; i < n; i++) {
             free(lf->fields[i].key);
             free(lf->fields[i].value);
         }
 
-        free(lf->fields);
+        /* Recyclable arrays are reused as they are */
+        if (lf->fields_size) {
+            memset(lf->fields, 0, sizeof(DynamicField) * n);
+        } else {
+            os_free(lf->fields);
+        }
     }
 
     if (lf->filename) {
@@ -997,7 +1012,12 @@ void Free_Eventinfo(Eventinfo *lf)
      * fts
      * comment
      */
-    os_free(lf);
+    if (lf->fields) {
+        Release_Eventinfo(lf);
+    } else {
+        os_free(lf->msg_buffer);
+        os_free(lf);
+    }
 
     return;
 }
@@ -1106,19 +1126,19 @@ void w_copy_event_for_log(Eventinfo *lf,Eventinfo *lf_cpy){
     lf_cpy->generate_time = lf->generate_time;
 
     if(lf->agent_id){
-        os_strdup(lf->agent_id,lf_cpy->agent_id);
+        lf_cpy->agent_id = (char *)w_intern(lf->agent_id);
     }
 
     if(lf->location){
-        os_strdup(lf->location,lf_cpy->location);
+        lf_cpy->location = (char *)w_intern(lf->location);
     }
 
     if(lf->hostname){
-        os_strdup(lf->hostname,lf_cpy->hostname);
+        lf_cpy->hostname = (char *)w_intern(lf->hostname);
     }
 
     if(lf->program_name){
-        os_strdup(lf->program_name,lf_cpy->program_name);
+        lf_cpy->program_name = (char *)w_intern(lf->program_name);
     }
 
     if(lf->comment){
@@ -1201,11 +1221,18 @@ void w_copy_event_for_log(Eventinfo *lf,Eventinfo *lf_cpy){
     lf_cpy->nfields = lf->nfields;
 
     int i;
-    os_calloc(lf->nfields, sizeof(DynamicField), lf_cpy->fields);
+
+    /* Reuse the array of an event from Alloc_Eventinfo() */
+    if ((size_t)lf->nfields > lf_cpy->fields_size) {
+        os_free(lf_cpy->fields);
+        lf_cpy->fields_size = 0;
+        os_calloc(lf->nfields, sizeof(DynamicField), lf_cpy->fields);
+    }
 
     for (i = 0; i < lf->nfields; i++) {
         w_strdup(lf->fields[i].value, lf_cpy->fields[i].value);
         w_strdup(lf->fields[i].key, lf_cpy->fields[i].key);
+        lf_cpy->fields[i].id = lf->fields[i].id;
     }
 
     /* Pointer to the rule that generated it */
@@ -1213,9 +1240,6 @@ void w_copy_event_for_log(Eventinfo *lf,Eventinfo *lf_cpy){
 
     lf_cpy->decoder_info = lf->decoder_info;
 
-    /* Sid node to delete */
-    lf_cpy->sid_node_to_delete = lf->sid_node_to_delete;
-
     /* Extract when the event fires a rule */
     lf_cpy->size = lf->size;
     lf_cpy->p_name_size = lf->p_name_size;
@@ -1363,7 +1387,12 @@ void w_copy_event_for_log(Eventinfo *lf,Eventinfo *lf_cpy){
 
     w_strdup(lf->sym_path, lf_cpy->sym_path);
 
-    lf_cpy->labels = labels_dup(lf->labels);
+    if (lf->label_set) {
+        lf_cpy->label_set = labels_retain(lf->label_set);
+        lf_cpy->labels = lf->labels;
+    } else {
+        lf_cpy->labels = labels_dup(lf->labels);
+    }
     lf_cpy->decoder_syscheck_id = lf->decoder_syscheck_id;
     lf_cpy->rootcheck_fts = lf->rootcheck_fts;
     lf_cpy->is_a_copy = 1;
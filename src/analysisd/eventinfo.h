@@ -15,11 +15,11 @@
 #include "decoders/decoder.h"
 
 typedef enum syscheck_event_t { FIM_ADDED, FIM_MODIFIED, FIM_READDED, FIM_DELETED } syscheck_event_t;
-typedef struct _EventNode EventNode;
 
 typedef struct _DynamicField {
     char *key;
     char *value;
+    int id;         ///< Interned name (FieldId_Get()), or 0 to compare by key
 } DynamicField;
 
 /* Event Information structure */
@@ -56,6 +56,9 @@ typedef struct _Eventinfo {
     char *systemname;
     DynamicField *fields;
     int nfields;
+    size_t fields_size;     ///< Capacity of fields when it comes from Alloc_Eventinfo(), 0 otherwise
+    char *msg_buffer;       ///< Message copied by OS_CleanMSG(). Its fields may point into it
+    size_t msg_buffer_size;
 
     /* Pointer to the rule that generated it */
     RuleInfo *generated_rule;
@@ -63,12 +66,6 @@ typedef struct _Eventinfo {
     /* Pointer to the decoder that matched */
     OSDecoderInfo *decoder_info;
 
-    /* Sid node to delete */
-    OSListNode *sid_node_to_delete;
-
-    /* Group node to delete */
-    OSListNode **group_node_to_delete;
-
     /* Extract when the event fires a rule */
     size_t size;
     size_t p_name_size;
@@ -107,6 +104,7 @@ typedef struct _Eventinfo {
     char *diff;
     char *previous;
     wlabel_t *labels;
+    struct wlabel_set_t *label_set;     ///< Shared set that labels belongs to, if any
     // Whodata fields. They are duplicated by 'fields'
     char *user_id;
     char *user_name;
@@ -128,32 +126,51 @@ typedef struct _Eventinfo {
     char **last_events;
     int r_firedtimes;
     int queue_added;
-    // Node reference
-    EventNode *node;
+    int refs;               ///< Holders of the event: writers and event lists (0 or 1 if not shared)
+    size_t mem_size;        ///< Bytes accounted for it since it entered an event list
+    w_trace_t trace;        ///< Trace of the event through the stages, if it's sampled
     // Process thread id
     int tid;
 } Eventinfo;
 
 /* Events List structure */
-struct _EventNode {
-    Eventinfo *event;
-    pthread_mutex_t mutex;
-    volatile int count;
-    EventNode *next;
-    EventNode *prev;
-};
-
+/* Number of locks shared by the buckets of an event list */
+#define EVENTLIST_STRIPES   8
+
+/* Events generated in the same second, oldest first */
+typedef struct EventBucket {
+    time_t time;
+    unsigned int start;     ///< First event still in the list
+    unsigned int count;
+    unsigned int size;
+    Eventinfo **events;
+} EventBucket;
+
+/* Time-bucketed history of events: a ring with one bucket per second.
+ * Bucket i stores the events of the seconds t where t % n_buckets == i,
+ * and it's guarded by the stripe i % EVENTLIST_STRIPES.
+ */
 typedef struct EventList {
-    EventNode *first_node;
-    EventNode *last_node;
-    EventNode *last_added_node;
+    EventBucket *buckets;
+    unsigned int n_buckets;
+    time_t newest;          ///< Time of the last bucket filled
+    time_t oldest;          ///< Hint for the eviction: no live event is older
 
     int _memoryused;
     int _memorymaxsize;
-    int _max_freq;
-    pthread_mutex_t event_mutex;
+    pthread_mutex_t evict_mutex;
+    pthread_rwlock_t stripes[EVENTLIST_STRIPES];
 } EventList;
 
+/* Iteration over an event list, from the newest to the oldest event */
+typedef struct EventListSearch {
+    EventList *list;
+    time_t time;            ///< Second of the current bucket
+    time_t oldest;          ///< Oldest second to visit
+    unsigned int index;     ///< Position after the next event of the bucket
+    pthread_rwlock_t *lock; ///< Lock held on the current bucket, if any
+} EventListSearch;
+
 #ifdef TESTRULE
 extern int full_output;
 extern int alert_only;
@@ -191,24 +208,100 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *currently_rule, regex_m
 Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *currently_rule, regex_matching *rule_match);
 Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *currently_rule, regex_matching *rule_match);
 
+/* Idle events kept by every thread, and by default in the shared pool */
+#define EVENTINFO_CACHE_SIZE    32
+#define EVENTINFO_POOL_SIZE     1024
+
+/* Largest message buffer that a recycled event keeps */
+#define EVENTINFO_BUFFER_MAX    OS_SIZE_8192
+
+/**
+ * @brief Create the pool where threads leave the events they free for others to reuse.
+ *
+ * @param size Maximum number of idle events in the pool.
+ */
+void Init_EventinfoPool(size_t size);
+
+/**
+ * @brief Get an empty event with room for Config.decoder_order_size dynamic fields.
+ *
+ * An event freed by this thread is reused first, then one from the shared
+ * pool. A new one is allocated if both are empty.
+ *
+ * @return Zeroed event (as with calloc). It must be released with Free_Eventinfo().
+ */
+Eventinfo *Alloc_Eventinfo(void);
+
 /* Zero the eventinfo structure */
 void Zero_Eventinfo(Eventinfo *lf);
 
-/* Free the eventinfo structure */
+/* Free the eventinfo structure. A shared event is freed by its last holder */
 void Free_Eventinfo(Eventinfo *lf);
 
-/* Add and event to the list of previous events */
-void OS_AddEvent(Eventinfo *lf, EventList *list);
+/**
+ * @brief Free a field of an event, unless it points into the message buffer.
+ *
+ * Fields set by OS_CleanMSG() are views of lf->msg_buffer, so a decoder
+ * replacing one of them must release the old value with this function.
+ *
+ * @param lf Event.
+ * @param field Field to free. It is set to NULL.
+ */
+void Free_EventinfoField(Eventinfo *lf, char **field);
 
-/* Return the last event from the Event list */
-EventNode *OS_GetFirstEvent(EventList *list);
+/* Add a holder to an event. The caller must already hold it */
+Eventinfo *Hold_Eventinfo(Eventinfo *lf);
+
+/* Add and event to the list of previous events. The list takes over the caller's reference */
+void OS_AddEvent(Eventinfo *lf, EventList *list);
 
 /* Create the event list. Maxsize must be specified */
 void OS_CreateEventList(int maxsize, EventList *list);
 
-/* Find index of a dynamic field. Returns -1 if not found. */
+/**
+ * @brief Make an event list keep at least the events of the last timeframe seconds.
+ *
+ * The ring is only resized while the list is still empty, i.e. during the rules loading.
+ *
+ * @param list Event list.
+ * @param timeframe Timeframe of a rule that searches the list.
+ */
+void OS_SetEventListTimeframe(EventList *list, int timeframe);
+
+/**
+ * @brief Start a search in an event list, from the newest event.
+ *
+ * Buckets older than the oldest second are not visited. The bucket of the
+ * returned event stays locked until the next call, so the search must be
+ * finished with OS_SearchEnd().
+ *
+ * @param list Event list.
+ * @param oldest Oldest generation time to look at.
+ * @param search Search state.
+ * @return Newest event, or NULL if there is none.
+ */
+Eventinfo *OS_SearchFirstEvent(EventList *list, time_t oldest, EventListSearch *search);
+
+/* Get the next (older) event of a search, or NULL at the end */
+Eventinfo *OS_SearchNextEvent(EventListSearch *search);
+
+/* Release the bucket locked by a search */
+void OS_SearchEnd(EventListSearch *search);
+
+/* Find the value of a dynamic field. Returns NULL if not found. */
 const char* FindField(const Eventinfo *lf, const char *name);
 
+/* Find the value of a dynamic field by the ID of its name (0 to look it up),
+ * which is also passed for the fields that have no ID. Returns NULL if not found. */
+const char* FindFieldId(const Eventinfo *lf, int id, const char *name);
+
+/* Intern a field name (case insensitive) that rules or decoders look up.
+ * Only while loading them. Returns its ID, greater than 0. */
+int FieldId_Add(const char *name);
+
+/* Get the ID of a field name, or 0 if it was never interned */
+int FieldId_Get(const char *name);
+
 /* Parse rule comment with dynamic fields */
 char* ParseRuleComment(Eventinfo *lf);
 
@@ -11,101 +11,283 @@
 #include "shared.h"
 #include "eventinfo.h"
 #include "rules.h"
+#include "memory_budget.h"
+
+/* Minimum number of events removed when the list is full */
+#define EVENTLIST_EVICT_MIN 10
+
+/* Lists keep this fraction of their size while the memory budget is tight */
+#define EVENTLIST_SHRINK_FACTOR 4
+
+static void OS_EvictEvents(EventList *list);
+static int OS_ClearBucket(EventBucket *bucket);
+static int OS_EventListLimit(const EventList *list);
+
+#define EVENTLIST_BUCKET(list, t) (&(list)->buckets[(size_t)(t) % (list)->n_buckets])
+#define EVENTLIST_STRIPE(list, t) (&(list)->stripes[((size_t)(t) % (list)->n_buckets) % EVENTLIST_STRIPES])
 
 /* Create the Event List */
 void OS_CreateEventList(int maxsize, EventList *list)
 {
-    list->first_node = NULL;
-    list->last_added_node = NULL;
+    pthread_rwlockattr_t attr;
+    int i;
+
+    list->buckets = NULL;
+    list->n_buckets = 0;
+    list->newest = 0;
+    list->oldest = 0;
     list->_memorymaxsize = maxsize;
     list->_memoryused = 0;
-    list->_max_freq = 0;
-    list->event_mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    list->evict_mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_rwlockattr_init(&attr);
+
+#ifdef __linux__
+    /* Searches must not starve the insertions.
+     * A search holds one stripe at a time, so there is no recursive locking.
+     */
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+
+    for (i = 0; i < EVENTLIST_STRIPES; i++) {
+        w_rwlock_init(&list->stripes[i], &attr);
+    }
+
+    pthread_rwlockattr_destroy(&attr);
+
+    OS_SetEventListTimeframe(list, 0);
 }
 
-/* Get the first node */
-EventNode *OS_GetFirstEvent(EventList *list) {
-    EventNode *node;
-    w_mutex_lock(&list->event_mutex);
-    node = list->first_node;
-    w_mutex_unlock(&list->event_mutex);
-    return node;
+/* Make the ring cover the timeframe of a rule */
+void OS_SetEventListTimeframe(EventList *list, int timeframe)
+{
+    /* One more bucket holds the current second */
+    unsigned int n_buckets = (timeframe > 0 ? (unsigned int)timeframe : 0) + 2;
+
+    if (n_buckets <= list->n_buckets || list->newest) {
+        return;
+    }
+
+    os_free(list->buckets);
+    os_calloc(n_buckets, sizeof(EventBucket), list->buckets);
+    list->n_buckets = n_buckets;
 }
 
-/* Add an event to the list -- always to the beginning */
+/* Add an event to the list -- always to the bucket of its second */
 void OS_AddEvent(Eventinfo *lf, EventList *list)
 {
-    w_mutex_lock(&list->event_mutex);
+    time_t t = lf->generate_time;
+    time_t newest;
+    time_t oldest;
+    pthread_rwlock_t *stripe = EVENTLIST_STRIPE(list, t);
+    EventBucket *bucket = EVENTLIST_BUCKET(list, t);
+    int dropped = 0;
+
+    w_rwlock_wrlock(stripe);
+
+    if (bucket->time != t) {
+        if (bucket->time > t) {
+            /* Older than any timeframe: no search would reach it */
+            w_rwlock_unlock(stripe);
+            Free_Eventinfo(lf);
+            return;
+        }
+
+        /* The bucket belongs to a second that already expired */
+        dropped = OS_ClearBucket(bucket);
+        bucket->time = t;
+    }
+
+    if (bucket->count == bucket->size) {
+        if (bucket->start > 0) {
+            memmove(bucket->events, bucket->events + bucket->start, (bucket->count - bucket->start) * sizeof(Eventinfo *));
+            bucket->count -= bucket->start;
+            bucket->start = 0;
+        } else {
+            bucket->size = bucket->size ? bucket->size * 2 : 8;
+            os_realloc(bucket->events, bucket->size * sizeof(Eventinfo *), bucket->events);
+        }
+    }
+
+    bucket->events[bucket->count++] = lf;
+
+    /* Shared events are accounted once, until the last list releases them */
+    if (!lf->mem_size) {
+        lf->mem_size = sizeof(Eventinfo) + lf->msg_buffer_size + lf->fields_size * sizeof(DynamicField) + (lf->full_log ? strlen(lf->full_log) + 1 : 0);
+        w_mem_add(W_MEM_EVENT_LISTS, lf->mem_size);
+    }
+
+    w_rwlock_unlock(stripe);
+
+    newest = __atomic_load_n(&list->newest, __ATOMIC_RELAXED);
+
+    while (newest < t && !__atomic_compare_exchange_n(&list->newest, &newest, t, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    /* A late event moves back the start of the eviction */
+    oldest = __atomic_load_n(&list->oldest, __ATOMIC_RELAXED);
+
+    while (oldest > t && !__atomic_compare_exchange_n(&list->oldest, &oldest, t, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    /* Need to remove the oldest events */
+    if (__atomic_add_fetch(&list->_memoryused, 1 - dropped, __ATOMIC_RELAXED) > OS_EventListLimit(list)) {
+        OS_EvictEvents(list);
+    }
+}
+
+Eventinfo *OS_SearchFirstEvent(EventList *list, time_t oldest, EventListSearch *search)
+{
+    time_t newest = __atomic_load_n(&list->newest, __ATOMIC_ACQUIRE);
+
+    search->list = list;
+    search->time = newest + 1;
+    search->oldest = newest - (time_t)list->n_buckets + 1;
+    search->index = 0;
+    search->lock = NULL;
+
+    if (oldest > search->oldest) {
+        search->oldest = oldest;
+    }
+
+    if (search->oldest < 0) {
+        search->oldest = 0;
+    }
+
+    return newest ? OS_SearchNextEvent(search) : NULL;
+}
+
+Eventinfo *OS_SearchNextEvent(EventListSearch *search)
+{
+    EventList *list = search->list;
+    EventBucket *bucket;
+
+    while (1) {
+        if (search->lock) {
+            bucket = EVENTLIST_BUCKET(list, search->time);
+
+            if (search->index > bucket->start) {
+                return bucket->events[--search->index];
+            }
+
+            w_rwlock_unlock(search->lock);
+            search->lock = NULL;
+        }
+
+        if (--search->time < search->oldest) {
+            return NULL;
+        }
+
+        search->lock = EVENTLIST_STRIPE(list, search->time);
+        w_rwlock_rdlock(search->lock);
+        bucket = EVENTLIST_BUCKET(list, search->time);
+
+        /* Skip the buckets of expired seconds */
+        search->index = bucket->time == search->time ? bucket->count : 0;
+    }
+}
+
+void OS_SearchEnd(EventListSearch *search)
+{
+    if (search->lock) {
+        w_rwlock_unlock(search->lock);
+        search->lock = NULL;
+    }
+}
+
+/* Remove the oldest events until the list is back to its size.
+ * Stale buckets found on the way are dropped completely.
+ */
+static void OS_EvictEvents(EventList *list)
+{
+    time_t newest;
+    time_t oldest;
+    time_t t;
+    EventBucket *bucket;
+    pthread_rwlock_t *stripe;
+    int excess;
+    int evicted;
 
-    if (list->last_added_node) {
-        EventNode *new_node;
-        new_node = (EventNode *)calloc(1, sizeof(EventNode));
+    /* Another thread is already on it */
+    if (pthread_mutex_trylock(&list->evict_mutex) != 0) {
+        return;
+    }
+
+    /* Insertions that found the mutex taken are also covered */
+    while (excess = __atomic_load_n(&list->_memoryused, __ATOMIC_RELAXED) - OS_EventListLimit(list), excess > 0) {
+        if (excess < EVENTLIST_EVICT_MIN) {
+            excess = EVENTLIST_EVICT_MIN;
+        }
+
+        newest = __atomic_load_n(&list->newest, __ATOMIC_ACQUIRE);
+        oldest = __atomic_load_n(&list->oldest, __ATOMIC_RELAXED);
+        t = newest - (time_t)list->n_buckets + 1;
+        evicted = 0;
+
+        if (oldest > t) {
+            t = oldest;
+        }
 
-        if (new_node == NULL) {
-            merror_exit(MEM_ERROR, errno, strerror(errno));
+        if (t < 0) {
+            t = 0;
         }
 
-        // Always add after the first node, which must be empty
-        new_node->next = list->last_added_node;
-        new_node->prev = list->first_node;
-        list->last_added_node->prev = new_node;
-        list->first_node->next = new_node;
-
-        list->last_added_node = new_node;
-
-        list->_memoryused++;
-
-        /* Need to remove the last nodes */
-        if (list->_memoryused > list->_memorymaxsize) {
-            int i = 0;
-            EventNode *oldlast;
-
-            /* Remove at least the last 10 events
-             * or the events that will not match anymore
-             * (higher than max frequency)
-             */
-            while (list->last_node != list->last_added_node && ((i < 10) ||
-                   ((lf->time.tv_sec - list->last_node->event->time.tv_sec) > list->_max_freq))) {
-                oldlast = list->last_node;
-                list->last_node = list->last_node->prev;
-                list->last_node->next = NULL;
-
-                /* Free event info */
-                Free_Eventinfo(oldlast->event);
-                free(oldlast);
-
-                list->_memoryused--;
-                i++;
+        for (; t <= newest; t++) {
+            stripe = EVENTLIST_STRIPE(list, t);
+            bucket = EVENTLIST_BUCKET(list, t);
+
+            w_rwlock_wrlock(stripe);
+
+            if (bucket->time == t) {
+                while (bucket->start < bucket->count && evicted < excess) {
+                    Free_Eventinfo(bucket->events[bucket->start++]);
+                    evicted++;
+                }
+
+                if (bucket->start == bucket->count) {
+                    bucket->start = bucket->count = 0;
+                }
+            } else if (bucket->time < t) {
+                evicted += OS_ClearBucket(bucket);
+            }
+
+            w_rwlock_unlock(stripe);
+
+            /* Keep the current bucket as the start of the next eviction */
+            if (evicted >= excess) {
+                break;
             }
         }
-    } else {
-        // Add the first and second node
-        // The first node is always empty
-        EventNode *second_node;
-
-        os_calloc(1, sizeof(EventNode), second_node);
-        if (!list->first_node) {
-            os_calloc(1, sizeof(EventNode), list->first_node);
-            list->first_node->prev = NULL;
-            list->first_node->event = NULL;
-            list->first_node->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+
+        /* Unless a late event came in the meantime */
+        __atomic_compare_exchange_n(&list->oldest, &oldest, t, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&list->_memoryused, evicted, __ATOMIC_RELAXED);
+
+        if (evicted == 0) {
+            break;
         }
-        list->_memoryused++;
-        list->first_node->next = second_node;
+    }
+
+    w_mutex_unlock(&list->evict_mutex);
+}
 
-        second_node->prev = list->first_node;
-        second_node->next = NULL;
+/* Release all the events of a bucket. The caller must hold its stripe */
+static int OS_ClearBucket(EventBucket *bucket)
+{
+    int dropped = bucket->count - bucket->start;
 
-        list->last_node = second_node;
-        list->last_added_node = second_node;
+    while (bucket->start < bucket->count) {
+        Free_Eventinfo(bucket->events[bucket->start++]);
     }
 
-    list->last_added_node->event = lf;
-    lf->node = list->last_added_node;
-    list->last_added_node->count = 0;
-    list->last_added_node->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    bucket->start = bucket->count = 0;
+    return dropped;
+}
 
-    w_mutex_unlock(&list->event_mutex);
+/* Size of the list, smaller while the memory budget is tight */
+static int OS_EventListLimit(const EventList *list)
+{
+    if (w_mem_level() >= W_MEM_SHRINK && list->_memorymaxsize >= EVENTLIST_SHRINK_FACTOR) {
+        return list->_memorymaxsize / EVENTLIST_SHRINK_FACTOR;
+    }
 
-    return;
+    return list->_memorymaxsize;
 }
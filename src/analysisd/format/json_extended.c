@@ -72,10 +72,10 @@ int W_isRootcheck(cJSON* root)
         group = cJSON_GetArrayItem(groups, i);
         group_json = cJSON_Print(group);
         if(strcmp(group_json, "\"rootcheck\"") == 0) {
-            free(group_json);
+            cJSON_free(group_json);
             return 1;
         }
-        free(group_json);
+        cJSON_free(group_json);
     }
     return 0;
 }
@@ -16,6 +16,7 @@
 #include "mitre.h"
 #include "cJSON.h"
 #include "config.h"
+#include "labels.h"
 #include "wazuh_modules/wmodules.h"
 
 #define is_win_permission(x) (strchr(x, '|'))
@@ -34,6 +35,7 @@ char* Eventinfo_to_jsonstr(const Eventinfo* lf, bool force_full_log)
     cJSON* data;
     cJSON* cluster;
     char manager_name[512];
+    char* printed;
     char* out;
     int i;
     char * saveptr;
@@ -41,6 +43,9 @@ char* Eventinfo_to_jsonstr(const Eventinfo* lf, bool force_full_log)
 
     extern long int __crt_ftell;
 
+    // The whole tree is built in an arena, released after printing it
+    json_arena_open();
+
     root = cJSON_CreateObject();
 
     // Parse timestamp
@@ -509,8 +514,9 @@ char* Eventinfo_to_jsonstr(const Eventinfo* lf, bool force_full_log)
     }
 
     W_ParseJSON(root, lf);
-    out = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
+    printed = cJSON_PrintUnformatted(root);
+    out = printed ? strdup(printed) : NULL;
+    json_arena_close();
     return out;
 }
 
@@ -529,3 +535,695 @@ void add_json_attrs(const char *attrs_str, cJSON *file_diff, char after) {
                 after ? "new" : "before");
     }
 }
+
+/* Streaming serialization
+ *
+ * Eventinfo_to_jsonbuf() prints the same document as Eventinfo_to_jsonstr()
+ * and W_ParseJSON() together, member by member, without building a tree.
+ * Both must be kept in sync. The events whose output depends on a parsed
+ * tree (syscheck, rootcheck and SCA compliance, and values with JSON arrays)
+ * are still printed by Eventinfo_to_jsonstr().
+ */
+
+typedef struct json_field_t {
+    const char *key;
+    const char *value;
+} json_field_t;
+
+static const struct {
+    const char *prefix;
+    size_t length;
+    const char *name;
+} json_compliance[] = {
+    { "pci_dss_", 8, "pci_dss" },
+    { "cis_", 4, "cis" },
+    { "gdpr_", 5, "gdpr" },
+    { "gpg13_", 6, "gpg13" },
+    { "hipaa_", 6, "hipaa" },
+    { "nist_800_53_", 12, "nist_800_53" },
+    { "tsc_", 4, "tsc" }
+};
+
+#define JSON_COMPLIANCE_N (sizeof(json_compliance) / sizeof(json_compliance[0]))
+#define is_json_array(x) (*(x) == '[')
+
+static __thread w_json_writer_t json_writer;
+static __thread json_field_t *json_fields;
+static __thread unsigned char *json_fields_done;
+static __thread size_t json_fields_size;
+
+/* Get room for n dynamic fields, none of them added */
+static void json_reserve_fields(size_t n) {
+    if (n > json_fields_size) {
+        os_realloc(json_fields, n * sizeof(json_field_t), json_fields);
+        os_realloc(json_fields_done, n, json_fields_done);
+        json_fields_size = n;
+    }
+
+    if (n) {
+        memset(json_fields_done, 0, n);
+    }
+}
+
+/* Whether the output depends on what W_ParseJSON() reads back from the tree */
+static int json_needs_tree(const Eventinfo *lf) {
+    int i;
+
+    if (lf->filename) {
+        return 1;
+    }
+
+    if (lf->generated_rule && lf->generated_rule->group) {
+        const char *group = lf->generated_rule->group;
+        size_t length;
+
+        /* Rootcheck compliance */
+        for (; *group; group += length + (group[length] == ',')) {
+            length = strcspn(group, ",");
+
+            if (lf->full_log && length == 9 && !strncmp(group, "rootcheck", 9)) {
+                return 1;
+            }
+        }
+
+        /* SCA compliance */
+        if (lf->decoder_info && lf->fields) {
+            for (i = 0; i < lf->nfields; i++) {
+                if (lf->fields[i].value && *lf->fields[i].value && !strncasecmp(lf->fields[i].key, "sca.", 4)) {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    if (lf->decoder_info && lf->fields) {
+        for (i = 0; i < lf->nfields; i++) {
+            if (lf->fields[i].value && is_json_array(lf->fields[i].value)) {
+                return 1;
+            }
+        }
+    }
+
+    if (lf->labels) {
+        for (i = 0; lf->labels[i].key != NULL; i++) {
+            if (!lf->labels[i].flags.system && lf->labels[i].value && is_json_array(lf->labels[i].value)) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Get the segment of a field key at a nesting path, as W_JSON_AddField() walks it */
+static const char *json_field_at(const char *key, const char *path, size_t path_length) {
+    if (!path) {
+        return key;
+    }
+
+    if (strncasecmp(key, path, path_length) || key[path_length] != '.') {
+        return NULL;
+    }
+
+    return key + path_length + 1;
+}
+
+/* Mark the fields at a path whose segment is name: they are added already, or
+ * cJSON_GetObjectItem() would find name and W_JSON_AddField() skip them.
+ */
+static void json_skip_fields(int n, const char *path, size_t path_length, const char *name, size_t length) {
+    const char *rel;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (!json_fields_done[i] && (rel = json_field_at(json_fields[i].key, path, path_length), rel)
+            && !strncasecmp(rel, name, length) && (rel[length] == '\0' || rel[length] == '.')) {
+            json_fields_done[i] = 1;
+        }
+    }
+}
+
+/* Add the fields of an object in the order W_JSON_AddField() would */
+static void json_add_fields(w_json_writer_t *writer, int n, const char *path, size_t path_length, const char * const *reserved) {
+    const char *rel;
+    size_t length;
+    int i;
+    int j;
+
+    for (i = 0; i < n; i++) {
+        if (json_fields_done[i] || !(rel = json_field_at(json_fields[i].key, path, path_length), rel)) {
+            continue;
+        }
+
+        length = strcspn(rel, ".");
+
+        for (j = 0; reserved && reserved[j]; j++) {
+            if (strlen(reserved[j]) == length && !strncasecmp(reserved[j], rel, length)) {
+                break;
+            }
+        }
+
+        if (!(reserved && reserved[j])) {
+            w_json_add_key_n(writer, rel, length);
+
+            if (rel[length] == '\0') {
+                w_json_add_string(writer, NULL, json_fields[i].value);
+            } else {
+                w_json_open_object(writer, NULL);
+                json_add_fields(writer, n, json_fields[i].key, (size_t)(rel - json_fields[i].key) + length, NULL);
+                w_json_close_object(writer);
+            }
+        }
+
+        json_skip_fields(n, path, path_length, rel, length);
+    }
+}
+
+/* Match the predecoder hostname pattern of W_JSON_ParseHostname() */
+static const char *json_syslog_hostname(const char *log, size_t *length) {
+    static const char format[] = "Aaa 00 00:00:00 ";
+    const unsigned char *p = (const unsigned char *)log;
+    int i;
+
+    for (i = 0; format[i]; i++) {
+        switch (format[i]) {
+        case 'A':
+            if (!(p[i] >= 'A' && p[i] <= 'Z')) {
+                return NULL;
+            }
+            break;
+        case 'a':
+            if (!(p[i] >= 'a' && p[i] <= 'z')) {
+                return NULL;
+            }
+            break;
+        case '0':
+            if (i == 4 ? !strchr(" 0123", p[i]) || !p[i] : !isdigit(p[i])) {
+                return NULL;
+            }
+            break;
+        default:
+            if (p[i] != (unsigned char)format[i]) {
+                return NULL;
+            }
+        }
+    }
+
+    if (*length = strcspn(log + i, " "), *length == 0) {
+        return NULL;
+    }
+
+    return log + i;
+}
+
+static void json_add_groups(w_json_writer_t *writer, const char *group) {
+    char buffer[OS_SIZE_1024] = "";
+    const char *tokens[OS_SIZE_1024 / 2];
+    unsigned int kinds[OS_SIZE_1024 / 2];
+    unsigned int order[JSON_COMPLIANCE_N];
+    unsigned int n_order = 0;
+    unsigned int n = 0;
+    unsigned int i;
+    unsigned int k;
+    char *saveptr;
+    char *token;
+
+    strncpy(buffer, group, OS_SIZE_1024 - 1);
+
+    for (token = strtok_r(buffer, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        for (k = 0; k < JSON_COMPLIANCE_N && strncmp(token, json_compliance[k].prefix, json_compliance[k].length); k++);
+
+        /* The arrays are created in the order of their first group */
+        if (k < JSON_COMPLIANCE_N) {
+            for (i = 0; i < n_order && order[i] != k; i++);
+
+            if (i == n_order) {
+                order[n_order++] = k;
+            }
+        }
+
+        tokens[n] = token;
+        kinds[n++] = k;
+    }
+
+    w_json_open_array(writer, "groups");
+
+    for (i = 0; i < n; i++) {
+        if (kinds[i] == JSON_COMPLIANCE_N) {
+            w_json_add_string(writer, NULL, tokens[i]);
+        }
+    }
+
+    w_json_close_array(writer);
+
+    for (k = 0; k < n_order; k++) {
+        w_json_open_array(writer, json_compliance[order[k]].name);
+
+        for (i = 0; i < n; i++) {
+            if (kinds[i] == order[k]) {
+                w_json_add_string(writer, NULL, tokens[i] + json_compliance[order[k]].length);
+            }
+        }
+
+        w_json_close_array(writer);
+    }
+}
+
+static void json_add_mitre(w_json_writer_t *writer, char **mitre_id) {
+    const mitre_data_t *data;
+    const char **added = NULL;
+    size_t mark;
+    int n_added = 0;
+    int i;
+    int j;
+    int k;
+
+    w_json_open_object(writer, "mitre");
+    w_json_open_array(writer, "id");
+
+    for (i = 0; mitre_id[i] != NULL; i++) {
+        w_json_add_string(writer, NULL, mitre_id[i]);
+    }
+
+    w_json_close_array(writer);
+
+    /* A single technique has no duplicated tactics: copy its array */
+    if (mitre_id[1] == NULL) {
+        if (data = mitre_get_data(mitre_id[0]), data == NULL) {
+            mwarn("Mitre Technique ID '%s' not found in database.", mitre_id[0]);
+        } else {
+            w_json_add_raw(writer, "tactics", data->json);
+        }
+
+        w_json_close_object(writer);
+        return;
+    }
+
+    mark = writer->length;
+    w_json_open_array(writer, "tactics");
+
+    for (i = 0; mitre_id[i] != NULL; i++) {
+        if (data = mitre_get_data(mitre_id[i]), data == NULL) {
+            mwarn("Mitre Technique ID '%s' not found in database.", mitre_id[i]);
+            continue;
+        }
+
+        for (k = 0; data->tactics_json[k] != NULL; k++) {
+            /* Check if the tactic is already in the array */
+            for (j = 0; j < n_added && strcmp(added[j], data->tactics_json[k]); j++);
+
+            if (j == n_added) {
+                os_realloc(added, (n_added + 1) * sizeof(char *), added);
+                added[n_added++] = data->tactics_json[k];
+                w_json_add_raw(writer, NULL, data->tactics_json[k]);
+            }
+        }
+    }
+
+    os_free(added);
+
+    if (!w_json_drop_empty(writer, mark)) {
+        w_json_close_array(writer);
+    }
+
+    w_json_close_object(writer);
+}
+
+/* Add the members of W_JSON_ParseAgentless(). Returns 0 if it's not agentless */
+static int json_add_agentless(w_json_writer_t *writer, const Eventinfo *lf, int dry_run) {
+    const char *script;
+    const char *user;
+    const char *host;
+    const char *end;
+
+    if (!(lf->location && lf->location[0] == '(' && lf->agent_id && !strcmp(lf->agent_id, "000"))) {
+        return 0;
+    }
+
+    script = lf->location + 1;
+
+    if (!(user = strstr(script, ") "), user) || !(host = strchr(user + 2, '@'), host)
+        || !(end = strstr(host + 1, "->"), end)) {
+        return 0;
+    }
+
+    if (!dry_run) {
+        w_json_open_object(writer, "agentless");
+        w_json_add_string_n(writer, "script", script, (size_t)(user - script));
+        w_json_add_string_n(writer, "user", user + 2, (size_t)(host - user - 2));
+        w_json_add_string_n(writer, "host", host + 1, (size_t)(end - host - 1));
+        w_json_close_object(writer);
+    }
+
+    return 1;
+}
+
+/* Write the visible labels as an object. Nothing is written unless some label
+ * besides the leading system ones exists. */
+static void json_add_labels(w_json_writer_t *writer, const char *key, const wlabel_t *labels) {
+    int i;
+    int n;
+
+    for (i = 0; labels[i].key != NULL && labels[i].flags.system; i++);
+
+    if (labels[i].key == NULL) {
+        return;
+    }
+
+    for (; labels[i].key != NULL; i++);
+    json_reserve_fields(i);
+
+    for (i = n = 0; labels[i].key != NULL; i++) {
+        if (!labels[i].flags.system && (!labels[i].flags.hidden || Config.show_hidden_labels)) {
+            json_fields[n].key = labels[i].key;
+            json_fields[n++].value = labels[i].value;
+        }
+    }
+
+    w_json_open_object(writer, key);
+    json_add_fields(writer, n, NULL, 0, NULL);
+    w_json_close_object(writer);
+}
+
+/* Get the labels object of a shared set, serializing it the first time.
+ * An empty string means that the set has no visible labels. */
+static const char * json_labels_fragment(wlabel_set_t *set) {
+    w_json_writer_t fragment = { NULL, 0, 0 };
+    char *json = __atomic_load_n(&set->json, __ATOMIC_ACQUIRE);
+    char *expected = NULL;
+
+    if (json) {
+        return json;
+    }
+
+    if (set->labels) {
+        json_add_labels(&fragment, NULL, set->labels);
+    }
+
+    os_strdup(w_json_writer_str(&fragment), json);
+    w_json_writer_free(&fragment);
+
+    // Another thread may have published its copy meanwhile
+    if (!__atomic_compare_exchange_n(&set->json, &expected, json, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        os_free(json);
+        json = expected;
+    }
+
+    return json;
+}
+
+static void json_add_agent(w_json_writer_t *writer, const Eventinfo *lf, const char *manager_name) {
+    w_json_open_object(writer, "agent");
+
+    if (lf->agent_id) {
+        w_json_add_string(writer, "id", lf->agent_id);
+    }
+
+    if (lf->full_log && lf->hostname) {
+        const char *ip;
+
+        if (lf->location[0] == '(') {
+            w_json_add_string(writer, "name", lf->hostname);
+        } else if (lf->agent_id && !strcmp(lf->agent_id, "000")) {
+            w_json_add_string(writer, "name", manager_name);
+        }
+
+        if (ip = labels_get(lf->labels, "_agent_ip"), ip) {
+            if (strcmp(ip, "any")) {
+                w_json_add_string(writer, "ip", ip);
+            }
+        } else if (lf->location[0] == '(' && (ip = strchr(lf->location, ')'), ip) && ip[1]) {
+            size_t length;
+
+            ip += 2;
+            length = strcspn(ip, "-");
+
+            if (!(length == 3 && !strncmp(ip, "any", 3))) {
+                w_json_add_string_n(writer, "ip", ip, length);
+            }
+        }
+    }
+
+    if (lf->label_set) {
+        const char *labels = json_labels_fragment(lf->label_set);
+
+        if (*labels) {
+            w_json_add_raw(writer, "labels", labels);
+        }
+    } else if (lf->labels && lf->labels[0].key) {
+        json_add_labels(writer, "labels", lf->labels);
+    }
+
+    w_json_close_object(writer);
+}
+
+static void json_add_data(w_json_writer_t *writer, const Eventinfo *lf) {
+    const char *reserved[16];
+    size_t mark = writer->length;
+    int n_reserved = 0;
+    int i;
+    int n;
+
+#define json_add_data_field(name, value) if (value) { w_json_add_string(writer, name, value); reserved[n_reserved++] = name; }
+
+    w_json_open_object(writer, "data");
+
+    json_add_data_field("protocol", lf->protocol);
+    json_add_data_field("action", lf->action);
+    json_add_data_field("srcip", lf->srcip);
+    json_add_data_field("srcport", lf->srcport);
+    json_add_data_field("srcuser", lf->srcuser);
+    json_add_data_field("dstip", lf->dstip);
+    json_add_data_field("dstport", lf->dstport);
+    json_add_data_field("dstuser", lf->dstuser);
+    json_add_data_field("id", lf->id);
+    json_add_data_field("status", lf->status);
+    json_add_data_field("url", lf->url);
+    json_add_data_field("data", lf->data);
+    json_add_data_field("extra_data", lf->extra_data);
+    json_add_data_field("system_name", lf->systemname);
+    reserved[n_reserved] = NULL;
+
+#undef json_add_data_field
+
+    // Dynamic fields
+    if (lf->decoder_info && lf->fields) {
+        json_reserve_fields(lf->nfields);
+
+        for (i = n = 0; i < lf->nfields; i++) {
+            if (lf->fields[i].value && *lf->fields[i].value) {
+                json_fields[n].key = lf->fields[i].key;
+                json_fields[n++].value = lf->fields[i].value;
+            }
+        }
+
+        json_add_fields(writer, n, NULL, 0, reserved);
+    }
+
+    if (!w_json_drop_empty(writer, mark)) {
+        w_json_close_object(writer);
+    }
+}
+
+static void json_add_location(w_json_writer_t *writer, const char *location) {
+    if (location[0] == '(') {
+        size_t length = strnlen(location, OS_SIZE_1024 - 1);
+        const char *search = memchr(location, '>', length);
+
+        if (search) {
+            w_json_add_string_n(writer, "location", search + 1, length - (size_t)(search + 1 - location));
+        }
+    } else {
+        w_json_add_string(writer, "location", location);
+    }
+}
+
+/* Convert Eventinfo to json in a buffer of the thread */
+const char *Eventinfo_to_jsonbuf(const Eventinfo *lf, bool force_full_log)
+{
+    w_json_writer_t *writer = &json_writer;
+    const char *syslog_hostname = NULL;
+    size_t syslog_hostname_size = 0;
+    char manager_name[512];
+    int agentless;
+
+    extern long int __crt_ftell;
+
+    w_json_writer_reset(writer);
+
+    if (json_needs_tree(lf)) {
+        char *out = Eventinfo_to_jsonstr(lf, force_full_log);
+
+        if (out) {
+            w_json_add_raw(writer, NULL, out);
+            free(out);
+        }
+
+        return w_json_writer_str(writer);
+    }
+
+    if (lf->full_log && lf->hostname) {
+        syslog_hostname = json_syslog_hostname(lf->full_log, &syslog_hostname_size);
+    }
+
+    agentless = json_add_agentless(writer, lf, 1);
+
+    w_json_open_object(writer, NULL);
+
+    // Parse timestamp
+    if (lf->time.tv_sec) {
+        const w_time_cache_t * now = w_time_cache_get(lf->time.tv_sec);
+        char timestamp[160];
+
+        snprintf(timestamp, sizeof(timestamp), "%s.%03ld%s", now->datetime, lf->time.tv_nsec / 1000000, now->timezone);
+        w_json_add_string(writer, "timestamp", timestamp);
+    }
+
+    /* Get manager hostname */
+    memset(manager_name, '\0', 512);
+    if (gethostname(manager_name, 512 - 1) != 0) {
+        strncpy(manager_name, "localhost", 32);
+    }
+
+    if (lf->generated_rule) {
+        RuleInfo *rule = lf->generated_rule;
+
+        w_json_open_object(writer, "rule");
+
+        if (rule->level) {
+            w_json_add_number(writer, "level", rule->level);
+        }
+        if (lf->comment) {
+            w_json_add_string(writer, "description", lf->comment);
+        }
+        if (rule->sigid) {
+            char id[12];
+            snprintf(id, 12, "%d", rule->sigid);
+            w_json_add_string(writer, "id", id);
+        }
+        if (rule->mitre_id) {
+            json_add_mitre(writer, rule->mitre_id);
+        }
+        if (rule->cve) {
+            w_json_add_string(writer, "cve", rule->cve);
+        }
+        if (rule->info) {
+            w_json_add_string(writer, "info", rule->info);
+        }
+        if (rule->event_search) {
+            w_json_add_number(writer, "frequency", rule->frequency + 2);
+        }
+        if (lf->r_firedtimes != -1 && !(rule->alert_opts & NO_COUNTER)) {
+            w_json_add_number(writer, "firedtimes", lf->r_firedtimes);
+        }
+        w_json_add_bool(writer, "mail", rule->alert_opts & DO_MAILALERT);
+
+        if (rule->group) {
+            json_add_groups(writer, rule->group);
+        }
+
+        w_json_close_object(writer);
+    }
+
+    if (!agentless) {
+        json_add_agent(writer, lf, manager_name);
+    }
+
+    w_json_open_object(writer, "manager");
+    w_json_add_string(writer, "name", manager_name);
+    w_json_close_object(writer);
+
+    if (lf->time.tv_sec) {
+        char alert_id[23];
+        alert_id[22] = '\0';
+        if ((snprintf(alert_id, 22, "%ld.%ld", (long int)lf->time.tv_sec, __crt_ftell)) < 0) {
+            merror("snprintf failed");
+        }
+
+        w_json_add_string(writer, "id", alert_id);
+    }
+
+    // Cluster information
+    if (!Config.hide_cluster_info) {
+        w_json_open_object(writer, "cluster");
+        w_json_add_string(writer, "name", Config.cluster_name ? Config.cluster_name : "wazuh");
+        w_json_add_string(writer, "node", Config.node_name);
+        w_json_close_object(writer);
+    }
+
+    if (lf->generated_rule && lf->last_events && lf->last_events[0] && lf->last_events[1] && *lf->last_events[1] != '\0') {
+        char *previous_events = NULL;
+        char **lasts;
+
+        for (lasts = lf->last_events; *lasts; lasts++) {
+            wm_strcat(&previous_events, *lasts, '\n');
+        }
+
+        w_json_add_string(writer, "previous_output", previous_events);
+        os_free(previous_events);
+    }
+
+    #ifdef LIBGEOIP_ENABLED
+    if (lf->srcgeoip && Config.geoip_jsonout) {
+        w_json_add_string(writer, "srcgeoip", lf->srcgeoip);
+    }
+    if (lf->dstgeoip && Config.geoip_jsonout) {
+        w_json_add_string(writer, "dstgeoip", lf->dstgeoip);
+    }
+    #endif
+
+    if (lf->full_log && (force_full_log || !(lf->generated_rule && lf->generated_rule->alert_opts & NO_FULL_LOG))) {
+        w_json_add_string(writer, "full_log", lf->full_log);
+    }
+
+    if (lf->program_name || lf->dec_timestamp) {
+        w_json_open_object(writer, "predecoder");
+        w_json_add_string(writer, "program_name", lf->program_name);
+        w_json_add_string(writer, "timestamp", lf->dec_timestamp);
+
+        if (syslog_hostname) {
+            w_json_add_string_n(writer, "hostname", syslog_hostname, syslog_hostname_size);
+            syslog_hostname = NULL;
+        }
+
+        w_json_close_object(writer);
+    }
+
+    if (lf->command) {
+        w_json_add_string(writer, "command", lf->command);
+    }
+
+    // DecoderInfo
+    if (lf->decoder_info) {
+        w_json_open_object(writer, "decoder");
+
+        if (lf->decoder_info->accumulate) {
+            w_json_add_number(writer, "accumulate", lf->decoder_info->accumulate);
+        }
+
+        w_json_add_string(writer, "parent", lf->decoder_info->parent);
+        w_json_add_string(writer, "name", lf->decoder_info->name);
+        w_json_add_string(writer, "ftscomment", lf->decoder_info->ftscomment);
+        w_json_close_object(writer);
+    }
+
+    if (lf->previous) {
+        w_json_add_string(writer, "previous_log", lf->previous);
+    }
+
+    json_add_data(writer, lf);
+
+    if (syslog_hostname) {
+        w_json_open_object(writer, "predecoder");
+        w_json_add_string_n(writer, "hostname", syslog_hostname, syslog_hostname_size);
+        w_json_close_object(writer);
+    }
+
+    if (lf->location) {
+        json_add_location(writer, lf->location);
+        json_add_agentless(writer, lf, 0);
+    }
+
+    w_json_close_object(writer);
+    return w_json_writer_str(writer);
+}
@@ -14,4 +14,9 @@
 #include "eventinfo.h"
 #define add_json_field(obj, name, string, filter) if (string && strcmp(string, filter)) { if (!obj) obj = cJSON_CreateObject(); cJSON_AddStringToObject(obj, name, string); }
 char *Eventinfo_to_jsonstr(const Eventinfo *lf, bool force_full_log);
+
+/* Convert an event to JSON, as Eventinfo_to_jsonstr() does, in a buffer of
+ * the calling thread. It's valid until the next call from the same thread.
+ */
+const char *Eventinfo_to_jsonbuf(const Eventinfo *lf, bool force_full_log);
 #endif /* TO_JSON_H */
@@ -13,14 +13,36 @@
 #include "fts.h"
 #include "eventinfo.h"
 #include "config.h"
+#include "memory_budget.h"
+
+/* Memory of an entry of the store: the line, its copy as the key and the node */
+#define FTS_ENTRY_SIZE(len) (2 * ((len) + 1) + sizeof(OSHashNode))
 
 /* Local variables */
 unsigned int fts_minsize_for_str = 0;
 int fts_list_size;
 
-static OSList *fts_list = NULL;
 static OSHash *fts_store = NULL;
 
+/* Similarity index of the last IDS lines.
+ * Two lines are similar when they share more than fts_minsize_for_str
+ * characters, so the prefix of that length plus one is a bucket of lines
+ * matching each other. The ring keeps the bucket of each line, in order.
+ */
+typedef struct fts_prefix {
+    int count;
+    char key[];
+} fts_prefix;
+
+static OSHash *fts_prefixes = NULL;
+static fts_prefix **fts_ring = NULL;
+static int fts_ring_next;
+static int fts_ring_count;
+static pthread_mutex_t fts_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int FTS_CountSimilar(const char *line);
+static void FTS_IndexLine(const char *line);
+
 static FILE *fp_list = NULL;
 static FILE **fp_ignore = NULL;
 
@@ -36,12 +58,6 @@ int FTS_Init(int threads)
 
     _line[OS_FLSIZE] = '\0';
 
-    fts_list = OSList_Create();
-    if (!fts_list) {
-        merror(LIST_ERROR);
-        return (0);
-    }
-
     w_rwlock_init(&file_update_rwlock, NULL);
     fts_write_lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
 
@@ -62,6 +78,9 @@ int FTS_Init(int threads)
         return (0);
     }
 
+    /* Every alert looks up the store, entries are never removed */
+    OSHash_SetRCU(fts_store);
+
     /* Get default list size */
     fts_list_size = getDefine_Int("analysisd",
                                   "fts_list_size",
@@ -72,11 +91,14 @@ int FTS_Init(int threads)
                           "fts_min_size_for_str",
                           6, 128);
 
-    if (!OSList_SetMaxSize(fts_list, fts_list_size)) {
-        merror(LIST_SIZE_ERROR);
+    fts_prefixes = OSHash_Create();
+    if (!fts_prefixes || !OSHash_setSize(fts_prefixes, fts_list_size * 2)) {
+        merror(LIST_ERROR);
         return (0);
     }
 
+    os_calloc(fts_list_size, sizeof(fts_prefix *), fts_ring);
+
     /* Create fts list */
     fp_list = fopen(FTS_QUEUE, "r+");
     if (!fp_list) {
@@ -122,6 +144,8 @@ int FTS_Init(int threads)
         if (OSHash_Add(fts_store, tmp_s, tmp_s) != 2) {
             free(tmp_s);
             merror(LIST_ADD_ERROR);
+        } else {
+            w_mem_add(W_MEM_FTS, FTS_ENTRY_SIZE(strlen(tmp_s)));
         }
 
         /* Reset pointer addresses before using strdup() again */
@@ -279,10 +303,8 @@ int IGnore(Eventinfo *lf, int pos)
 char * FTS(Eventinfo *lf)
 {
     int i;
-    int number_of_matches = 0;
     char *_line = NULL;
     char *line_for_list = NULL;
-    OSListNode *fts_node = NULL;
     const char *field;
 
     os_calloc(OS_FLSIZE + 1,sizeof(char),_line);
@@ -318,59 +340,97 @@ char * FTS(Eventinfo *lf)
      * If yes, we just ignore it.
      */
     if (lf->decoder_info->type == IDS) {
-        fts_node = OSList_GetLastNode(fts_list);
-        while (fts_node) {
-            if (OS_StrHowClosedMatch((char *)fts_node->data, _line) >
-                    fts_minsize_for_str) {
-                number_of_matches++;
-
-                /* We go and add this new entry to the list */
-                if (number_of_matches > 2) {
-                    _line[fts_minsize_for_str] = '\0';
-                    break;
-                }
-            }
+        w_mutex_lock(&fts_index_mutex);
 
-            fts_node = OSList_GetPrevNode(fts_list);
-        }
-
-        fts_node = NULL;
-
-        os_strdup(_line, line_for_list);
-        if (!line_for_list) {
-            merror(MEM_ERROR, errno, strerror(errno));
-            free(_line);
-            return NULL;
-        }
-
-        fts_node = OSList_AddData(fts_list, line_for_list);
-        if (!fts_node) {
-            free(line_for_list);
-            free(_line);
-            return NULL;
+        if (FTS_CountSimilar(_line) > 2) {
+            _line[fts_minsize_for_str] = '\0';
         }
     }
 
     /* Store new entry */
-    if (line_for_list == NULL) {
-        os_strdup(_line, line_for_list);
-        if (!line_for_list) {
-            merror(MEM_ERROR, errno, strerror(errno));
-            free(_line);
-            return NULL;
-        }
-    }
+    os_strdup(_line, line_for_list);
 
     if (OSHash_Add_ex(fts_store, line_for_list, line_for_list) != 2) {
-        if (fts_node) OSList_DeleteThisNode(fts_list, fts_node);
+        if (lf->decoder_info->type == IDS) {
+            w_mutex_unlock(&fts_index_mutex);
+        }
+
         free(line_for_list);
         free(_line);
         return NULL;
     }
 
+    w_mem_add(W_MEM_FTS, FTS_ENTRY_SIZE(strlen(line_for_list)));
+
+    if (lf->decoder_info->type == IDS) {
+        FTS_IndexLine(line_for_list);
+        w_mutex_unlock(&fts_index_mutex);
+    }
+
     return _line;
 }
 
+/* Number of lines in the ring similar to a new one. Needs fts_index_mutex */
+static int FTS_CountSimilar(const char *line)
+{
+    fts_prefix *prefix;
+    char key[OS_FLSIZE + 1];
+
+    if (strlen(line) <= fts_minsize_for_str) {
+        return 0;
+    }
+
+    memcpy(key, line, fts_minsize_for_str + 1);
+    key[fts_minsize_for_str + 1] = '\0';
+
+    prefix = OSHash_Get(fts_prefixes, key);
+    return prefix ? prefix->count : 0;
+}
+
+/* Push a line into the ring, dropping the oldest one if full. Needs fts_index_mutex */
+static void FTS_IndexLine(const char *line)
+{
+    fts_prefix *prefix = NULL;
+    fts_prefix *oldest;
+    size_t len = fts_minsize_for_str + 1;
+
+    if (fts_ring_count == fts_list_size) {
+        if (oldest = fts_ring[fts_ring_next], oldest && --oldest->count == 0) {
+            OSHash_Delete(fts_prefixes, oldest->key);
+            free(oldest);
+        }
+    } else {
+        fts_ring_count++;
+    }
+
+    /* Lines too short to be similar to others take a slot with no bucket */
+    if (strlen(line) >= len) {
+        char key[OS_FLSIZE + 1];
+
+        memcpy(key, line, len);
+        key[len] = '\0';
+
+        if (prefix = OSHash_Get(fts_prefixes, key), !prefix) {
+            os_malloc(sizeof(fts_prefix) + len + 1, prefix);
+            prefix->count = 0;
+            memcpy(prefix->key, key, len + 1);
+
+            if (OSHash_Add(fts_prefixes, prefix->key, prefix) != 2) {
+                merror(LIST_ADD_ERROR);
+                free(prefix);
+                prefix = NULL;
+            }
+        }
+
+        if (prefix) {
+            prefix->count++;
+        }
+    }
+
+    fts_ring[fts_ring_next] = prefix;
+    fts_ring_next = (fts_ring_next + 1) % fts_list_size;
+}
+
 FILE **w_get_fp_ignore(){
     return fp_ignore;
 }
@@ -383,6 +443,21 @@ void FTS_Fprintf(char * _line){
     w_mutex_unlock(&fts_write_lock);
 }
 
+void FTS_Fprintf_Batch(char ** lines, size_t n){
+    size_t i;
+
+    /* Save to fts fp, once per batch */
+    w_mutex_lock(&fts_write_lock);
+    fseek(fp_list, 0, SEEK_END);
+
+    for (i = 0; i < n; i++) {
+        fprintf(fp_list, "%s\n", lines[i]);
+    }
+
+    fflush(fp_list);
+    w_mutex_unlock(&fts_write_lock);
+}
+
 void FTS_Flush(){
     w_mutex_lock(&fts_write_lock);
     fflush(fp_list);
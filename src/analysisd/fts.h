@@ -28,6 +28,7 @@ int IGnore(Eventinfo *lf, int pos);
 char * FTS(Eventinfo *lf);
 FILE **w_get_fp_ignore();
 void FTS_Fprintf(char * _line);
+void FTS_Fprintf_Batch(char ** lines, size_t n);
 void FTS_Flush();
 
 /* Global variables */
@@ -16,10 +16,58 @@
 
 static OSHash *label_cache;
 static pthread_mutex_t label_mutex;
+static wlabel_set_t *manager_labels;
+
+/* Create a set that owns labels, with one reference */
+static wlabel_set_t *labels_set_create(wlabel_t *labels) {
+    wlabel_set_t *set;
+    char text[OS_MAXSTR];
+    size_t z = 0;
+    int i;
+
+    os_calloc(1, sizeof(wlabel_set_t), set);
+    set->labels = labels;
+    set->refs = 1;
+    *text = '\0';
+
+    for (i = 0; labels[i].key != NULL; i++) {
+        if (!labels[i].flags.system && (!labels[i].flags.hidden || Config.show_hidden_labels)) {
+            z += (size_t)snprintf(text + z, sizeof(text) - z, "%s: %s\n", labels[i].key, labels[i].value);
+
+            if (z >= sizeof(text)) {
+                *text = '\0';
+                break;
+            }
+        }
+    }
+
+    os_strdup(text, set->text);
+    return set;
+}
+
+wlabel_set_t* labels_retain(wlabel_set_t *set) {
+    if (set) {
+        __atomic_add_fetch(&set->refs, 1, __ATOMIC_RELAXED);
+    }
+
+    return set;
+}
+
+void labels_release(wlabel_set_t *set) {
+    if (set && __atomic_sub_fetch(&set->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (set->labels != Config.labels) {
+            labels_free(set->labels);
+        }
+
+        free(set->text);
+        free(set->json);
+        free(set);
+    }
+}
 
 /* Free label cache */
 void free_label_cache(wlabel_data_t *data) {
-    if (data->labels) labels_free(data->labels);
+    labels_release(data->set);
     free(data);
 }
 
@@ -37,17 +85,32 @@ int labels_init() {
     return (1);
 }
 
-/* Find the label array for an agent. Returns NULL if no such agent file found. */
-wlabel_t* labels_find(const Eventinfo *lf) {
+/* Find the label set for an agent. Returns NULL if no such agent file found. */
+wlabel_set_t* labels_find(const Eventinfo *lf) {
     char path[PATH_MAX];
     char hostname[OS_MAXSTR];
     char *ip;
     char *end;
     wlabel_data_t *data;
-    wlabel_t *ret_labels;
+    wlabel_set_t *ret_labels;
+    wlabel_t *labels;
+    time_t now;
 
     if (strcmp(lf->agent_id, "000") == 0) {
-        return Config.labels;
+        if (!Config.labels) {
+            return NULL;
+        }
+
+        w_mutex_lock(&label_mutex);
+
+        // The set of the manager is never released by the cache
+        if (!manager_labels) {
+            manager_labels = labels_set_create(Config.labels);
+        }
+
+        ret_labels = labels_retain(manager_labels);
+        w_mutex_unlock(&label_mutex);
+        return ret_labels;
     }
 
     if (lf->location[0] != '(') {
@@ -72,42 +135,41 @@ wlabel_t* labels_find(const Eventinfo *lf) {
         return NULL;
     }
 
+    now = time(NULL);
+
     w_mutex_lock(&label_mutex);
     if (data = (wlabel_data_t*)OSHash_Get(label_cache, path), !data) {
         // Data not cached
 
-        os_calloc(1, sizeof(wlabel_data_t), data);
-        data->labels = labels_parse(path);
-
-        if (!data->labels) {
+        if (labels = labels_parse(path), !labels) {
             mdebug1("Couldn't parse labels for agent %s (%s). Info file may not exist.", hostname, ip);
-            free(data);
             w_mutex_unlock(&label_mutex);
             return NULL;
         }
 
+        os_calloc(1, sizeof(wlabel_data_t), data);
+        data->set = labels_set_create(labels);
         data->mtime = File_DateofChange(path);
+        data->checked = now;
 
         if (data->mtime == -1) {
             merror("Getting stats for agent %s (%s). Cannot parse labels.", hostname, ip);
-            labels_free(data->labels);
-            free(data);
+            free_label_cache(data);
             w_mutex_unlock(&label_mutex);
             return NULL;
         }
 
         if (OSHash_Add(label_cache, path, data) != 2) {
             merror("Couldn't store labels for agent %s (%s) on cache.", hostname, ip);
-            labels_free(data->labels);
-            free(data);
+            free_label_cache(data);
             w_mutex_unlock(&label_mutex);
             return NULL;
         }
-    } else {
-        // Data cached, check modification time
+    } else if (data->checked != now) {
+        // Data cached, check modification time once per second at most, as remoted updates the file
 
-        wlabel_data_t *new_data;
-        time_t mtime = File_DateofChange(path);;
+        time_t mtime = File_DateofChange(path);
+        data->checked = now;
 
         if (mtime == -1) {
             if (!data->error_flag) {
@@ -120,25 +182,18 @@ wlabel_t* labels_find(const Eventinfo *lf) {
                 data->error_flag = 1;
             }
         } else if (mtime > data->mtime + Config.label_cache_maxage) {
-            // Update file, keep old to return in case of error
-
-            os_calloc(1, sizeof(wlabel_data_t), new_data);
-            new_data->labels = labels_parse(path);
-            new_data->mtime = mtime;
-
-            if (!OSHash_Update(label_cache, path, new_data)) {
-                merror("Couldn't update labels for agent %s (%s) on cache.", hostname, ip);
-                labels_free(new_data->labels);
-                free(new_data);
-                w_mutex_unlock(&label_mutex);
-                return NULL;
+            // Update the set. The events that hold the old one keep it
+
+            if (labels = labels_parse(path), labels) {
+                labels_release(data->set);
+                data->set = labels_set_create(labels);
             }
 
-            data = new_data;
+            data->mtime = mtime;
             data->error_flag = 0;
         }
     }
-    ret_labels = labels_dup(data->labels);
+    ret_labels = labels_retain(data->set);
     w_mutex_unlock(&label_mutex);
 
     return ret_labels;
@@ -12,16 +12,32 @@
 #ifndef LABELS_H
 #define LABELS_H
 
-typedef struct wlabel_data_t {
+/* Labels of an agent, shared by its events until the agent-info file changes */
+typedef struct wlabel_set_t {
     wlabel_t *labels;
+    char *text;                 ///< Visible labels, as the alerts log prints them
+    char *json;                 ///< "labels" object of JSON alerts, set by the first alert that needs it
+    unsigned int refs;
+} wlabel_set_t;
+
+typedef struct wlabel_data_t {
+    wlabel_set_t *set;
     time_t mtime;
+    time_t checked;             ///< Last time the agent-info file was looked at
     unsigned int error_flag;
 } wlabel_data_t;
 
 /* Initialize label cache */
 int labels_init();
 
-/* Find the label array for an agent. Returns NULL if no such agent file found. */
-wlabel_t* labels_find(const Eventinfo *lf);
+/* Find the label set for an agent. Returns NULL if no such agent file found.
+ * The caller gets a reference, to be dropped with labels_release(). */
+wlabel_set_t* labels_find(const Eventinfo *lf);
+
+/* Get another reference to a label set */
+wlabel_set_t* labels_retain(wlabel_set_t *set);
+
+/* Drop a reference to a label set */
+void labels_release(wlabel_set_t *set);
 
 #endif
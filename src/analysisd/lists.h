@@ -15,6 +15,7 @@
 
 #include "cdb/cdb.h"
 #include "cdb/uint32.h"
+#include "lists_trie.h"
 
 #define LR_STRING_MATCH 0
 #define LR_STRING_NOT_MATCH 1
@@ -24,13 +25,26 @@
 #define LR_ADDRESS_NOT_MATCH 11
 #define LR_ADDRESS_MATCH_VALUE 12
 
+/* One version of an open list database. Reloads publish a new one and
+ * free the old one after the rule matching threads are done with it.
+ */
+typedef struct ListCDB {
+    struct cdb cdb;
+    list_trie *trie;            /* Address prefixes, if any address rule uses the list */
+    ino_t inode;                /* File the database was opened from */
+    time_t mtime;
+} ListCDB;
+
+/* Lists are opened and compiled while loading the rules, and only read
+ * afterwards: lookups don't take any lock.
+ */
 typedef struct ListNode {
-    int loaded;
+    int loaded;                 /* The database has been opened (or tried to) */
+    int address;                /* Some rule looks up addresses in the list */
     char *cdb_filename;
     char *txt_filename;
-    struct cdb cdb;
+    ListCDB *current;           /* NULL if the database could not be opened */
     struct ListNode *next;
-    pthread_mutex_t mutex;
 } ListNode;
 
 typedef struct ListRule {
@@ -42,7 +56,6 @@ typedef struct ListRule {
     char *filename;
     ListNode *db;
     struct ListRule *next;
-    pthread_mutex_t mutex;
 } ListRule;
 
 /* Create the rule list */
@@ -67,4 +80,14 @@ ListNode *OS_FindList(const char *listname);
 
 void Lists_OP_CreateLists(void);
 
+/* Threads that look up lists while they may be reloaded. Each one gets an ID in 0 .. n_readers - 1 */
+void Lists_OP_InitReaders(unsigned int n_readers);
+
+/* Enclose the lookups of a reader between an event boundary and the next one */
+void Lists_OP_ReadBegin(unsigned int reader);
+void Lists_OP_ReadEnd(unsigned int reader);
+
+/* Rebuild the changed lists and swap them in. Returns the number of lists reloaded, or -1 on error */
+int Lists_OP_ReloadLists(void);
+
 #endif /* LISTS_H */
@@ -10,7 +10,9 @@
 
 #include "shared.h"
 #include "rules.h"
+#include "eventinfo.h"
 #include "cdb/cdb.h"
+#include "lists_make.h"
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,6 +22,13 @@
 static ListNode *global_listnode;
 static ListRule *global_listrule;
 
+/* Readers of the lists, only set when they may be reloaded */
+static w_rcu_t *lists_rcu;
+static pthread_mutex_t lists_reload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ListCDB *OS_ListOpenCDB(const ListNode *lnode);
+static void OS_ListFreeCDB(ListCDB *db);
+
 
 /* Create the ListRule */
 void OS_CreateListsList()
@@ -38,6 +47,8 @@ ListNode *OS_GetFirstList()
     return (listnode_pt);
 }
 
+static void _OS_CDBOpen(ListNode *lnode, int address);
+
 void OS_ListLoadRules()
 {
     ListRule *lrule = global_listrule;
@@ -104,12 +115,18 @@ ListRule *OS_AddListRule(ListRule *first_rule_list,
     new_rulelist_pt->lookup_type = lookup_type;
     new_rulelist_pt->filename = strdup(listname);
     new_rulelist_pt->dfield = field == RULE_DYNAMIC ? strdup(dfield) : NULL;
-    new_rulelist_pt->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
-    if ((new_rulelist_pt->db = OS_FindList(listname)) == NULL) {
-        new_rulelist_pt->loaded = 0;
-    } else {
-        new_rulelist_pt->loaded = 1;
+
+    if (new_rulelist_pt->dfield) {
+        FieldId_Add(new_rulelist_pt->dfield);
+    }
+
+    /* The lists are loaded before the rules: open the database now, so that
+     * lookups only have to read it and don't need any lock.
+     */
+    if ((new_rulelist_pt->db = OS_FindList(listname)) != NULL) {
+        _OS_CDBOpen(new_rulelist_pt->db, lookup_type >= LR_ADDRESS_MATCH);
     }
+    new_rulelist_pt->loaded = 1;
     if (first_rule_list == NULL) {
         mdebug1("Adding First rulelist item: filename: %s field: %d lookup_type: %d",
                new_rulelist_pt->filename,
@@ -129,170 +146,252 @@ ListRule *OS_AddListRule(ListRule *first_rule_list,
     return first_rule_list;
 }
 
-static int _OS_CDBOpen(ListNode *lnode)
+static void _OS_CDBOpen(ListNode *lnode, int address)
 {
-    int fd;
-    if (lnode->loaded != 1) {
-        if ((fd = open(lnode->cdb_filename, O_RDONLY)) == -1) {
-            merror(OPEN_ERROR, lnode->cdb_filename, errno, strerror (errno));
-            return -1;
-        }
-        cdb_init(&lnode->cdb, fd);
+    if (address) {
+        lnode->address = 1;
+    }
+
+    if (!lnode->loaded) {
+        lnode->current = OS_ListOpenCDB(lnode);
         lnode->loaded = 1;
+    } else if (address && lnode->current && !lnode->current->trie) {
+        /* An address rule came after the list was opened for a string rule */
+        lnode->current->trie = list_trie_build(&lnode->current->cdb);
     }
-    return 0;
 }
 
-static int OS_DBSearchKeyValue(ListRule *lrule, char *key)
+/* Open the database of a list, compiling its address prefixes if needed */
+static ListCDB *OS_ListOpenCDB(const ListNode *lnode)
 {
-    int result = -1;
-    char *val;
-    unsigned vlen, vpos;
-    w_mutex_lock(&lrule->mutex);
-    if (lrule->db != NULL) {
-        if (_OS_CDBOpen(lrule->db) == -1) {
-            w_mutex_unlock(&lrule->mutex);
-            return 0;
-        }
-        if (cdb_find(&lrule->db->cdb, key, strlen(key)) > 0 ) {
-            vpos = cdb_datapos(&lrule->db->cdb);
-            vlen = cdb_datalen(&lrule->db->cdb);
-            val = (char *) calloc(vlen + 1, sizeof(char));
+    ListCDB *db;
+    struct stat st;
+    int fd;
 
-            w_mutex_unlock(&lrule->mutex);
-            if (!val){
-                return 0;
-            }
+    if ((fd = open(lnode->cdb_filename, O_RDONLY)) == -1) {
+        merror(OPEN_ERROR, lnode->cdb_filename, errno, strerror (errno));
+        return NULL;
+    }
 
-            w_mutex_lock(&lrule->db->cdb.mutex)
-            cdb_read(&lrule->db->cdb, val, vlen, vpos);
-            w_mutex_unlock(&lrule->db->cdb.mutex);
-            result = OSMatch_Execute(val, vlen, lrule->matcher);
-            free(val);
-            return result;
+    os_calloc(1, sizeof(ListCDB), db);
+    cdb_init(&db->cdb, fd);
+
+    if (fstat(fd, &st) == 0) {
+        db->inode = st.st_ino;
+        db->mtime = st.st_mtime;
+    }
+
+    /* Compile the address prefixes once, instead of retrying truncated keys on every lookup */
+    if (lnode->address) {
+        if (db->trie = list_trie_build(&db->cdb), db->trie) {
+            mdebug1("List '%s': %u address prefixes compiled.", lnode->cdb_filename, db->trie->n_prefixes);
         } else {
-            w_mutex_unlock(&lrule->mutex);
-            return 0;
+            mwarn("Could not compile the address prefixes of list '%s'.", lnode->cdb_filename);
         }
     }
-    w_mutex_unlock(&lrule->mutex);
-    return 0;
+    return db;
 }
 
-static int OS_DBSeachKey(ListRule *lrule, char *key)
+static void OS_ListFreeCDB(ListCDB *db)
 {
-    w_mutex_lock(&lrule->mutex);
-    if (lrule->db != NULL) {
-        if (_OS_CDBOpen(lrule->db) == -1) {
-            w_mutex_unlock(&lrule->mutex);
-            return -1;
+    if (db) {
+        cdb_free(&db->cdb);
+        close(db->cdb.fd);
+        list_trie_free(db->trie);
+        free(db);
+    }
+}
+
+void Lists_OP_InitReaders(unsigned int n_readers)
+{
+    lists_rcu = w_rcu_init(n_readers);
+}
+
+void Lists_OP_ReadBegin(unsigned int reader)
+{
+    if (lists_rcu) {
+        w_rcu_read_lock(lists_rcu, reader);
+    }
+}
+
+void Lists_OP_ReadEnd(unsigned int reader)
+{
+    if (lists_rcu) {
+        w_rcu_read_unlock(lists_rcu, reader);
+    }
+}
+
+int Lists_OP_ReloadLists()
+{
+    ListNode *lnode;
+    ListCDB **retired;
+    ListCDB *db;
+    struct stat st;
+    int n_lists = 0;
+    int n_retired = 0;
+    int i;
+
+    if (!lists_rcu) {
+        return -1;
+    }
+
+    w_mutex_lock(&lists_reload_mutex);
+
+    for (lnode = OS_GetFirstList(); lnode; lnode = lnode->next) {
+        n_lists++;
+    }
+
+    os_calloc(n_lists + 1, sizeof(ListCDB *), retired);
+
+    for (lnode = OS_GetFirstList(); lnode; lnode = lnode->next) {
+        /* Lists that no rule looks up are never opened */
+        if (!lnode->loaded) {
+            continue;
         }
-        w_mutex_unlock(&lrule->mutex);
-        if ( cdb_find(&lrule->db->cdb, key, strlen(key)) > 0 ) {
-            return 1;
+
+        /* The new database replaces the file, so the old mapping stays valid */
+        Lists_OP_MakeCDB(lnode->txt_filename, lnode->cdb_filename, 0, 0);
+
+        if (stat(lnode->cdb_filename, &st) == -1) {
+            merror(FSTAT_ERROR, lnode->cdb_filename, errno, strerror(errno));
+            continue;
+        }
+
+        if (lnode->current && lnode->current->inode == st.st_ino && lnode->current->mtime == st.st_mtime) {
+            continue;
         }
-    }else {
-        w_mutex_unlock(&lrule->mutex);
+
+        if (db = OS_ListOpenCDB(lnode), !db) {
+            continue;
+        }
+
+        minfo("Reloading list '%s'.", lnode->cdb_filename);
+        retired[n_retired++] = lnode->current;
+        __atomic_store_n(&lnode->current, db, __ATOMIC_RELEASE);
     }
-    return 0;
+
+    /* Free the old versions once no lookup can be using them */
+    if (n_retired) {
+        w_rcu_synchronize(lists_rcu);
+
+        for (i = 0; i < n_retired; i++) {
+            OS_ListFreeCDB(retired[i]);
+        }
+    }
+
+    free(retired);
+    w_mutex_unlock(&lists_reload_mutex);
+    return n_retired;
 }
 
-static int OS_DBSeachKeyAddress(ListRule *lrule, char *key)
+/* Match the value of a record with the rule's pattern */
+static int OS_DBMatchValue(ListRule *lrule, const ListCDB *db, uint32 vpos, uint32 vlen)
+{
+    char buffer[OS_SIZE_1024];
+    char *val = buffer;
+    int result = 0;
+
+    if (vlen >= sizeof(buffer)) {
+        os_malloc(vlen + 1, val);
+    }
+
+    if (cdb_read(&db->cdb, val, vlen, vpos) == 0) {
+        val[vlen] = '\0';
+        result = OSMatch_Execute(val, vlen, lrule->matcher);
+    }
+
+    if (val != buffer) {
+        free(val);
+    }
+    return result;
+}
+
+/* Find an address, or else the longest prefix that contains it */
+static int OS_DBFindAddress(const ListCDB *db, const char *key, uint32 *vpos, uint32 *vlen)
 {
-    w_mutex_lock(&lrule->mutex);
-    if (lrule->db != NULL) {
-        if (_OS_CDBOpen(lrule->db) == -1) {
-            w_mutex_unlock(&lrule->mutex);
-            return -1;
+    size_t len = strlen(key);
+    int result;
+
+    if (cdb_lookup(&db->cdb, key, len, vpos, vlen) == 1) {
+        return 1;
+    }
+
+    if (db->trie) {
+        result = list_trie_search(db->trie, key, vpos, vlen);
+
+        /* An IPv4 address can only match octet prefixes, all of them are in the trie */
+        if (result == 1 || (result == 0 && !strchr(key, ':'))) {
+            return result;
         }
-        w_mutex_unlock(&lrule->mutex);
-        if ( cdb_find(&lrule->db->cdb, key, strlen(key)) > 0 ) {
+    }
+
+    /* Not an IPv4 address: look for the keys ending at any of its dots */
+    while (len > 1) {
+        if (key[--len - 1] == '.' && cdb_lookup(&db->cdb, key, len, vpos, vlen) == 1) {
             return 1;
-        } else {
-            char *tmpkey;
-            os_strdup(key, tmpkey);
-            while (strlen(tmpkey) > 0) {
-                if (tmpkey[strlen(tmpkey) - 1] == '.') {
-                    if ( cdb_find(&lrule->db->cdb, tmpkey, strlen(tmpkey)) > 0 ) {
-                        free(tmpkey);
-                        return 1;
-                    }
-                }
-                tmpkey[strlen(tmpkey) - 1] = '\0';
-            }
-            free(tmpkey);
         }
-    }else{
-        w_mutex_unlock(&lrule->mutex);
     }
     return 0;
 }
 
-static int OS_DBSearchKeyAddressValue(ListRule *lrule, char *key)
+static int OS_DBSearchKeyValue(ListRule *lrule, char *key)
 {
-    int result = -1;
-    char *val;
-    unsigned vlen, vpos;
-    w_mutex_lock(&lrule->mutex);
-    if (lrule->db != NULL) {
-        if (_OS_CDBOpen(lrule->db) == -1) {
-            w_mutex_unlock(&lrule->mutex);
-            return 0;
-        }
+    ListCDB *db;
+    uint32 vlen, vpos;
 
-        w_mutex_unlock(&lrule->mutex);
-
-        /* First lookup for a single IP address */
-        if (cdb_find(&lrule->db->cdb, key, strlen(key)) > 0 ) {
-            vpos = cdb_datapos(&lrule->db->cdb);
-            vlen = cdb_datalen(&lrule->db->cdb);
-            val = (char *) malloc(vlen);
-            w_mutex_lock(&lrule->db->cdb.mutex)
-            cdb_read(&lrule->db->cdb, val, vlen, vpos);
-            w_mutex_unlock(&lrule->db->cdb.mutex)
-            result = OSMatch_Execute(val, vlen, lrule->matcher);
-            free(val);
-            return result;
-        } else {
-            /* IP address not found, look for matching subnets */
-            char *tmpkey;
-            os_strdup(key, tmpkey);
-            while (strlen(tmpkey) > 0) {
-                if (tmpkey[strlen(tmpkey) - 1] == '.') {
-                    if ( cdb_find(&lrule->db->cdb, tmpkey, strlen(tmpkey)) > 0 ) {
-                        vpos = cdb_datapos(&lrule->db->cdb);
-                        vlen = cdb_datalen(&lrule->db->cdb);
-                        val = (char *) malloc(vlen);
-                        w_mutex_lock(&lrule->db->cdb.mutex)
-                        cdb_read(&lrule->db->cdb, val, vlen, vpos);
-                        w_mutex_unlock(&lrule->db->cdb.mutex)
-                        result = OSMatch_Execute(val, vlen, lrule->matcher);
-                        free(val);
-                        free(tmpkey);
-                        return result;
-                    }
-                }
-                tmpkey[strlen(tmpkey) - 1] = '\0';
-            }
-            free(tmpkey);
-            return 0;
-        }
-    }else{
-        w_mutex_unlock(&lrule->mutex);
+    if (lrule->db == NULL || (db = __atomic_load_n(&lrule->db->current, __ATOMIC_ACQUIRE)) == NULL) {
+        return 0;
+    }
+    if (cdb_lookup(&db->cdb, key, strlen(key), &vpos, &vlen) == 1) {
+        return OS_DBMatchValue(lrule, db, vpos, vlen);
     }
     return 0;
 }
 
-int OS_DBSearch(ListRule *lrule, char *key)
+static int OS_DBSeachKey(ListRule *lrule, char *key)
+{
+    ListCDB *db;
+    uint32 vlen, vpos;
+
+    if (lrule->db == NULL) {
+        return 0;
+    }
+    if ((db = __atomic_load_n(&lrule->db->current, __ATOMIC_ACQUIRE)) == NULL) {
+        return -1;
+    }
+    return cdb_lookup(&db->cdb, key, strlen(key), &vpos, &vlen) == 1;
+}
+
+static int OS_DBSeachKeyAddress(ListRule *lrule, char *key)
+{
+    ListCDB *db;
+    uint32 vlen, vpos;
+
+    if (lrule->db == NULL) {
+        return 0;
+    }
+    if ((db = __atomic_load_n(&lrule->db->current, __ATOMIC_ACQUIRE)) == NULL) {
+        return -1;
+    }
+    return OS_DBFindAddress(db, key, &vpos, &vlen);
+}
+
+static int OS_DBSearchKeyAddressValue(ListRule *lrule, char *key)
 {
-    //XXX - god damn hack!!! Jeremy Rossi
-    w_mutex_lock(&lrule->mutex);
-    if (lrule->loaded == 0) {
-        lrule->db = OS_FindList(lrule->filename);
-        lrule->loaded = 1;
+    ListCDB *db;
+    uint32 vlen, vpos;
+
+    if (lrule->db == NULL || (db = __atomic_load_n(&lrule->db->current, __ATOMIC_ACQUIRE)) == NULL) {
+        return 0;
     }
-    w_mutex_unlock(&lrule->mutex);
+    if (OS_DBFindAddress(db, key, &vpos, &vlen) == 1) {
+        return OS_DBMatchValue(lrule, db, vpos, vlen);
+    }
+    return 0;
+}
 
+int OS_DBSearch(ListRule *lrule, char *key)
+{
     switch (lrule->lookup_type) {
         case LR_STRING_MATCH:
             if (OS_DBSeachKey(lrule, key) == 1) {
@@ -16,50 +16,169 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <utime.h>
 #include "lists_make.h"
+#include "ruleset_load.h"
 
 
-void Lists_OP_MakeAll(int force, int show_message)
+/* Source of a database, stored after its hash tables, where readers never look */
+#define CDB_SOURCE_MAGIC "WZCDBSRC"
+
+typedef struct cdb_source_t {
+    char magic[8];
+    uint64_t hash;
+    uint64_t size;
+} cdb_source_t;
+
+/* Buffer of the text and database files */
+#define CDB_BUFFER_SIZE (1024 * 1024)
+
+/* FNV-1a, 64 bits, so that it can be computed by parts */
+static uint64_t lists_hash(const char *data, size_t len, uint64_t hash)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/* Check whether a text has changed since its database was built */
+static int lists_source_changed(const char *txt_filename, const char *cdb_filename)
 {
-    ListNode *lnode = OS_GetFirstList();
-    while (lnode) {
-        Lists_OP_MakeCDB(lnode->txt_filename,
-                         lnode->cdb_filename,
-                         force, show_message);
-        lnode = lnode->next;
+    cdb_source_t stored;
+    cdb_source_t current = { CDB_SOURCE_MAGIC, 0xcbf29ce484222325ULL, 0 };
+    struct stat st;
+    char *buffer;
+    size_t n;
+    FILE *fp;
+    int fd;
+
+    if (fd = open(cdb_filename, O_RDONLY | O_CLOEXEC), fd < 0) {
+        return 1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(stored) ||
+            pread(fd, &stored, sizeof(stored), st.st_size - sizeof(stored)) != (ssize_t)sizeof(stored) ||
+            memcmp(stored.magic, CDB_SOURCE_MAGIC, sizeof(stored.magic)) != 0) {
+        close(fd);
+        return 1;
+    }
+
+    close(fd);
+
+    if (fp = fopen(txt_filename, "r"), !fp) {
+        return 1;
+    }
+
+    os_malloc(CDB_BUFFER_SIZE, buffer);
+
+    while (n = fread(buffer, 1, CDB_BUFFER_SIZE, fp), n > 0) {
+        current.hash = lists_hash(buffer, n, current.hash);
+        current.size += n;
     }
+
+    os_free(buffer);
+    fclose(fp);
+
+    return current.size != stored.size || current.hash != stored.hash;
+}
+
+static void lists_make_cdb(void *item)
+{
+    ListNode *lnode = item;
+
+    Lists_OP_MakeCDB(lnode->txt_filename, lnode->cdb_filename, 0, 0);
+}
+
+static void lists_make_cdb_verbose(void *item)
+{
+    ListNode *lnode = item;
+
+    Lists_OP_MakeCDB(lnode->txt_filename, lnode->cdb_filename, 0, 1);
+}
+
+void Lists_OP_MakeAll(int force, int show_message, int threads)
+{
+    OSHashOA *seen = OSHashOA_Create(0);
+    ListNode **lists = NULL;
+    size_t count = 0;
+    ListNode *lnode;
+
+    /* Two workers must not write the same database */
+    for (lnode = OS_GetFirstList(); lnode; lnode = lnode->next) {
+        if (OSHashOA_Add(seen, lnode->cdb_filename, lnode) != 2) {
+            continue;
+        }
+
+        /* Forced builds print every key, so they are kept in order */
+        if (force) {
+            Lists_OP_MakeCDB(lnode->txt_filename, lnode->cdb_filename, force, show_message);
+            continue;
+        }
+
+        os_realloc(lists, (count + 1) * sizeof(ListNode *), lists);
+        lists[count++] = lnode;
+    }
+
+    if (count > 0) {
+        Ruleset_Run((void **)lists, count, show_message ? lists_make_cdb_verbose : lists_make_cdb, threads);
+    }
+
+    OSHashOA_Free(seen);
+    os_free(lists);
 }
 
 void Lists_OP_MakeCDB(const char *txt_filename, const char *cdb_filename, const int force, const int show_message)
 {
     struct cdb_make cdbm;
+    cdb_source_t source = { CDB_SOURCE_MAGIC, 0xcbf29ce484222325ULL, 0 };
     FILE *tmp_fd;
     FILE *txt_fd;
     char *tmp_str;
     char *key, *val;
     char str[OS_MAXSTR + 1];
     char *value_begin;
+    size_t length;
 
     str[OS_MAXSTR] = '\0';
     char tmp_filename[OS_MAXSTR];
     tmp_filename[OS_MAXSTR - 2] = '\0';
-    snprintf(tmp_filename, OS_MAXSTR - 2, "%s.tmp", txt_filename);
+    snprintf(tmp_filename, OS_MAXSTR - 2, "%s.tmp", cdb_filename);
 
-    if (File_DateofChange(txt_filename) > File_DateofChange(cdb_filename) ||
+    if (!force && File_DateofChange(txt_filename) > File_DateofChange(cdb_filename) &&
+            !lists_source_changed(txt_filename, cdb_filename)) {
+        /* Same content: a newer date on the database keeps it from being checked again */
+        if (utime(cdb_filename, NULL) == -1) {
+            mdebug1("Could not update the date of '%s': %s (%d)", cdb_filename, strerror(errno), errno);
+        }
+        if (show_message) {
+            printf(" * CDB list %s is up-to-date\n", cdb_filename);
+        }
+    } else if (File_DateofChange(txt_filename) > File_DateofChange(cdb_filename) ||
             force) {
     	if (show_message){
             printf(" * CDB list %s has been updated successfully\n", cdb_filename);
         }
+        if (!(txt_fd = fopen(txt_filename, "r"))) {
+            merror(FOPEN_ERROR, txt_filename, errno, strerror(errno));
+            return;
+        }
         if (tmp_fd = fopen(tmp_filename, "w+"), !tmp_fd) {
             merror(FOPEN_ERROR, tmp_filename, errno, strerror(errno));
+            fclose(txt_fd);
             return;
         }
+        setvbuf(txt_fd, NULL, _IOFBF, CDB_BUFFER_SIZE);
+        setvbuf(tmp_fd, NULL, _IOFBF, CDB_BUFFER_SIZE);
         cdb_make_start(&cdbm, tmp_fd);
-        if (!(txt_fd = fopen(txt_filename, "r"))) {
-            merror(FOPEN_ERROR, txt_filename, errno, strerror(errno));
-            return;
-        }
         while ((fgets(str, OS_MAXSTR - 1, txt_fd)) != NULL) {
+            length = strlen(str);
+            source.hash = lists_hash(str, length, source.hash);
+            source.size += length;
+
             /* Remove newlines and carriage returns */
             tmp_str = strchr(str, '\r');
             if (tmp_str) {
@@ -146,7 +265,19 @@ void Lists_OP_MakeCDB(const char *txt_filename, const char *cdb_filename, const
 
         fclose(txt_fd);
 
-        cdb_make_finish(&cdbm);
+        /* The source goes after the tables, the database is replaced in a single step */
+        if (cdb_make_finish(&cdbm) != 0 || fseek(tmp_fd, 0, SEEK_END) != 0 ||
+                fwrite(&source, sizeof(source), 1, tmp_fd) != 1) {
+            merror("Could not write cdb list '%s' due to: [%d - %s]", tmp_filename, errno, strerror(errno));
+            fclose(tmp_fd);
+            unlink(tmp_filename);
+            return;
+        }
+        if (fclose(tmp_fd) != 0) {
+            merror("Could not write cdb list '%s' due to: [%d - %s]", tmp_filename, errno, strerror(errno));
+            unlink(tmp_filename);
+            return;
+        }
         if (rename(tmp_filename, cdb_filename) == -1) {
             merror(RENAME_ERROR, tmp_filename, cdb_filename, errno, strerror(errno));
             return;
@@ -12,6 +12,14 @@
 #define LISTSMAKE_H
 
 void Lists_OP_MakeCDB(const char *txt_filename, const char *cdb_filename, const int force, const int show_message);
-void Lists_OP_MakeAll(int force, int show_message);
+
+/**
+ * @brief Build the databases of the lists whose text changed.
+ *
+ * @param force Build every database, printing its keys.
+ * @param show_message Print whether each database was built.
+ * @param threads Number of threads building the databases.
+ */
+void Lists_OP_MakeAll(int force, int show_message, int threads);
 
 #endif /* LISTSMAKE_H */
@@ -0,0 +1,223 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "lists_trie.h"
+#include <arpa/inet.h>
+
+/* Longest key that may hold an address prefix */
+#define LIST_TRIE_KEY_MAX 64
+
+static int list_trie_parse_prefix(const char * key, unsigned int len, unsigned char * addr, int * family, unsigned int * bits);
+static unsigned int list_trie_new_node(list_trie * trie);
+
+list_trie * list_trie_build(const struct cdb * cdb) {
+    list_trie * trie;
+    uint32 pos = 0;
+    uint32 kpos;
+    uint32 klen;
+    uint32 dpos;
+    uint32 dlen;
+    char key[LIST_TRIE_KEY_MAX];
+    int r;
+
+    os_calloc(1, sizeof(list_trie), trie);
+    list_trie_new_node(trie);
+    list_trie_new_node(trie);
+
+    while (r = cdb_nextrecord(cdb, &pos, &kpos, &klen, &dpos, &dlen), r == 1) {
+        if (klen >= sizeof(key)) {
+            continue;
+        }
+
+        if (cdb_read(cdb, key, klen, kpos) == -1) {
+            r = -1;
+            break;
+        }
+
+        list_trie_insert(trie, key, klen, dpos, dlen);
+    }
+
+    if (r == -1) {
+        list_trie_free(trie);
+        return NULL;
+    }
+
+    return trie;
+}
+
+int list_trie_insert(list_trie * trie, const char * key, unsigned int len, uint32 dpos, uint32 dlen) {
+    unsigned char addr[16];
+    unsigned int bits;
+    unsigned int node;
+    unsigned int next;
+    unsigned int i;
+    int family;
+    int bit;
+
+    if (!list_trie_parse_prefix(key, len, addr, &family, &bits)) {
+        return 0;
+    }
+
+    node = family == AF_INET ? 0 : 1;
+
+    for (i = 0; i < bits; i++) {
+        bit = (addr[i >> 3] >> (7 - (i & 7))) & 1;
+
+        if (next = trie->nodes[node].child[bit], !next) {
+            /* The pool may move: don't keep pointers to nodes across this */
+            next = list_trie_new_node(trie);
+            trie->nodes[node].child[bit] = next;
+        }
+
+        node = next;
+    }
+
+    if (!trie->nodes[node].value) {
+        trie->nodes[node].value = 1;
+        trie->nodes[node].dpos = dpos;
+        trie->nodes[node].dlen = dlen;
+        trie->n_prefixes++;
+    }
+
+    return 1;
+}
+
+int list_trie_search(const list_trie * trie, const char * address, uint32 * dpos, uint32 * dlen) {
+    unsigned char addr[16];
+    unsigned int bits;
+    unsigned int node;
+    unsigned int i;
+    int found = 0;
+
+    if (inet_pton(AF_INET, address, addr) == 1) {
+        node = 0;
+        bits = 32;
+    } else if (inet_pton(AF_INET6, address, addr) == 1) {
+        node = 1;
+        bits = 128;
+    } else {
+        return -1;
+    }
+
+    for (i = 0; ; i++) {
+        const list_trie_node * current = &trie->nodes[node];
+
+        if (current->value) {
+            *dpos = current->dpos;
+            *dlen = current->dlen;
+            found = 1;
+        }
+
+        if (i == bits || !(node = current->child[(addr[i >> 3] >> (7 - (i & 7))) & 1])) {
+            break;
+        }
+    }
+
+    return found;
+}
+
+void list_trie_free(list_trie * trie) {
+    if (trie) {
+        os_free(trie->nodes);
+        os_free(trie);
+    }
+}
+
+/* Parse "a.", "a.b.", "a.b.c." (octet prefixes) and "address/bits" */
+static int list_trie_parse_prefix(const char * key, unsigned int len, unsigned char * addr, int * family, unsigned int * bits) {
+    char buffer[LIST_TRIE_KEY_MAX];
+    char * slash;
+    char * end;
+    unsigned int octets = 0;
+    unsigned int i;
+    long value;
+
+    if (len == 0 || len >= sizeof(buffer)) {
+        return 0;
+    }
+
+    memcpy(buffer, key, len);
+    buffer[len] = '\0';
+    memset(addr, 0, 16);
+
+    if (slash = strchr(buffer, '/'), slash) {
+        *slash++ = '\0';
+
+        if (!isdigit((unsigned char)*slash)) {
+            return 0;
+        }
+
+        value = strtol(slash, &end, 10);
+
+        if (*end != '\0') {
+            return 0;
+        }
+
+        if (inet_pton(AF_INET, buffer, addr) == 1) {
+            *family = AF_INET;
+            if (value > 32) {
+                return 0;
+            }
+        } else if (inet_pton(AF_INET6, buffer, addr) == 1) {
+            *family = AF_INET6;
+            if (value > 128) {
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+
+        *bits = (unsigned int)value;
+        return 1;
+    }
+
+    /* Octet prefixes must be canonical, like the addresses they are compared with */
+    if (buffer[len - 1] != '.') {
+        return 0;
+    }
+
+    for (i = 0; i < len && octets < 3; octets++) {
+        if (!isdigit((unsigned char)buffer[i]) || (buffer[i] == '0' && buffer[i + 1] != '.')) {
+            return 0;
+        }
+
+        for (value = 0; isdigit((unsigned char)buffer[i]); i++) {
+            value = value * 10 + buffer[i] - '0';
+
+            if (value > 255) {
+                return 0;
+            }
+        }
+
+        if (buffer[i++] != '.') {
+            return 0;
+        }
+
+        addr[octets] = (unsigned char)value;
+    }
+
+    if (i != len) {
+        return 0;
+    }
+
+    *family = AF_INET;
+    *bits = octets * 8;
+    return 1;
+}
+
+static unsigned int list_trie_new_node(list_trie * trie) {
+    if (trie->n_nodes == trie->size) {
+        trie->size = trie->size ? trie->size * 2 : 64;
+        os_realloc(trie->nodes, trie->size * sizeof(list_trie_node), trie->nodes);
+    }
+
+    memset(&trie->nodes[trie->n_nodes], 0, sizeof(list_trie_node));
+    return trie->n_nodes++;
+}
@@ -0,0 +1,87 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef LISTS_TRIE_H
+#define LISTS_TRIE_H
+
+#include "cdb/cdb.h"
+#include "cdb/uint32.h"
+
+/**
+ * @brief Trie node. A prefix may end at any node, not only at the leaves.
+ */
+typedef struct list_trie_node {
+    unsigned int child[2];          ///< Index of the child for each bit, 0 if none
+    uint32 dpos;                    ///< Position of the value in the CDB
+    uint32 dlen;                    ///< Length of the value
+    unsigned char value;            ///< A prefix of the list ends here
+} list_trie_node;
+
+/**
+ * @brief Binary trie with the address prefixes of a CDB list.
+ *
+ * Nodes 0 and 1 are the roots of the IPv4 and IPv6 trees, so index 0 never
+ * shows up as a child. The trie is not modified after being built, so any
+ * number of threads may search it without locking.
+ *
+ * Prefixes are the keys ending at an octet boundary ("10.", "192.168.",
+ * "172.16.0.") and the CIDR blocks ("10.0.0.0/8", "2001:db8::/32"). Single
+ * addresses are left to the CDB hash, which resolves them in one probe.
+ */
+typedef struct list_trie {
+    list_trie_node * nodes;
+    unsigned int n_nodes;
+    unsigned int size;
+    unsigned int n_prefixes;        ///< Number of prefixes inserted
+} list_trie;
+
+/**
+ * @brief Compile the address prefixes of a CDB file.
+ *
+ * @param cdb Open CDB.
+ * @return New trie, or NULL if the file could not be read.
+ */
+list_trie * list_trie_build(const struct cdb * cdb);
+
+/**
+ * @brief Insert a list key if it denotes an address prefix.
+ *
+ * Earlier insertions win over later ones, like the first record of a CDB.
+ *
+ * @param trie Trie.
+ * @param key List key (not null-terminated).
+ * @param len Length of the key.
+ * @param dpos Position of the value in the CDB.
+ * @param dlen Length of the value.
+ * @retval 1 if the key was inserted.
+ * @retval 0 if the key is not a prefix.
+ */
+int list_trie_insert(list_trie * trie, const char * key, unsigned int len, uint32 dpos, uint32 dlen);
+
+/**
+ * @brief Find the longest prefix containing an address.
+ *
+ * @param trie Trie.
+ * @param address IPv4 or IPv6 address.
+ * @param dpos Output: position of the value of the prefix.
+ * @param dlen Output: length of the value.
+ * @retval 1 if a prefix contains the address.
+ * @retval 0 if none does.
+ * @retval -1 if the string is not an address.
+ */
+int list_trie_search(const list_trie * trie, const char * address, uint32 * dpos, uint32 * dlen);
+
+/**
+ * @brief Free a trie.
+ *
+ * @param trie Trie (may be NULL).
+ */
+void list_trie_free(list_trie * trie);
+
+#endif /* LISTS_TRIE_H */
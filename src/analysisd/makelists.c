@@ -178,6 +178,6 @@ int main(int argc, char **argv)
 
     printf(" Since Wazuh v3.11.0, this binary is deprecated\n");
     printf(" CDB lists are now compiled at manager start-up time as well as each time ossec-logtest is run.\n");
-    Lists_OP_MakeAll(force, 1);
+    Lists_OP_MakeAll(force, 1, get_nproc());
     exit(0);
 }
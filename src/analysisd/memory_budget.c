@@ -0,0 +1,102 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "memory_budget.h"
+
+/* Share of a threshold (percent) the usage must go below to leave its level */
+#define W_MEM_HYSTERESIS_PERCENT 95
+
+static const char * mem_subsystem_names[W_MEM_COUNT] = {
+    [W_MEM_QUEUES] = "queues",
+    [W_MEM_EVENT_LISTS] = "event_lists",
+    [W_MEM_ACCUMULATOR] = "accumulator",
+    [W_MEM_FTS] = "fts"
+};
+
+static const char * mem_level_names[W_MEM_LEVEL_COUNT] = {
+    [W_MEM_NORMAL] = "normal",
+    [W_MEM_SHRINK] = "shrink",
+    [W_MEM_REJECT] = "reject"
+};
+
+/* Only touched with relaxed atomics. The total is the last slot */
+static size_t mem_used[W_MEM_COUNT + 1];
+static size_t mem_budget;
+
+/* Level set by w_mem_update(), so that it doesn't flap from one event to the next */
+static w_mem_level_t mem_level;
+
+void w_mem_budget_init(size_t budget) {
+    mem_budget = budget;
+}
+
+void w_mem_add(w_mem_subsystem_t subsystem, size_t bytes) {
+    __atomic_add_fetch(&mem_used[subsystem], bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mem_used[W_MEM_COUNT], bytes, __ATOMIC_RELAXED);
+}
+
+void w_mem_sub(w_mem_subsystem_t subsystem, size_t bytes) {
+    __atomic_sub_fetch(&mem_used[subsystem], bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mem_used[W_MEM_COUNT], bytes, __ATOMIC_RELAXED);
+}
+
+void w_mem_set(w_mem_subsystem_t subsystem, size_t bytes) {
+    size_t old = __atomic_exchange_n(&mem_used[subsystem], bytes, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&mem_used[W_MEM_COUNT], bytes - old, __ATOMIC_RELAXED);
+}
+
+size_t w_mem_used(w_mem_subsystem_t subsystem) {
+    return __atomic_load_n(&mem_used[subsystem], __ATOMIC_RELAXED);
+}
+
+size_t w_mem_budget(void) {
+    return mem_budget;
+}
+
+w_mem_level_t w_mem_level(void) {
+    return __atomic_load_n(&mem_level, __ATOMIC_RELAXED);
+}
+
+w_mem_level_t w_mem_update(void) {
+    size_t used = w_mem_used(W_MEM_COUNT);
+    size_t thresholds[W_MEM_LEVEL_COUNT] = { 0, mem_budget / 100 * W_MEM_SHRINK_PERCENT, mem_budget };
+    w_mem_level_t level = mem_level;
+
+    if (!mem_budget) {
+        level = W_MEM_NORMAL;
+    }
+
+    /* Go up as soon as a threshold is reached, and down once well below it */
+    while (mem_budget && level + 1 < W_MEM_LEVEL_COUNT && used >= thresholds[level + 1]) {
+        level++;
+    }
+
+    while (level > W_MEM_NORMAL && used < thresholds[level] / 100 * W_MEM_HYSTERESIS_PERCENT) {
+        level--;
+    }
+
+    if (level > mem_level) {
+        mwarn("Memory usage (%zu KiB) is close to the budget (%zu KiB): entering level '%s'.", used >> 10, mem_budget >> 10, mem_level_names[level]);
+    } else if (level < mem_level) {
+        minfo("Memory usage (%zu KiB) went down: entering level '%s'.", used >> 10, mem_level_names[level]);
+    }
+
+    __atomic_store_n(&mem_level, level, __ATOMIC_RELAXED);
+    return level;
+}
+
+const char * w_mem_subsystem_name(w_mem_subsystem_t subsystem) {
+    return subsystem < W_MEM_COUNT ? mem_subsystem_names[subsystem] : "total";
+}
+
+const char * w_mem_level_name(w_mem_level_t level) {
+    return mem_level_names[level];
+}
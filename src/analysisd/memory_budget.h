@@ -0,0 +1,82 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <stddef.h>
+
+/* Share of the budget (percent) from which the correlation windows shrink */
+#define W_MEM_SHRINK_PERCENT 80
+
+/* Subsystems whose memory is accounted */
+typedef enum w_mem_subsystem_t {
+    W_MEM_QUEUES,           ///< Messages waiting in the decoder queues
+    W_MEM_EVENT_LISTS,      ///< Events kept for the correlation rules
+    W_MEM_ACCUMULATOR,      ///< Entries of the accumulator
+    W_MEM_FTS,              ///< First time seen store
+    W_MEM_COUNT
+} w_mem_subsystem_t;
+
+/* Degradation levels, from the mildest to the hardest */
+typedef enum w_mem_level_t {
+    W_MEM_NORMAL,
+    W_MEM_SHRINK,           ///< Event lists and accumulator keep less history
+    W_MEM_REJECT,           ///< Low-priority inputs are rejected too
+    W_MEM_LEVEL_COUNT
+} w_mem_level_t;
+
+/**
+ * @brief Set the global budget.
+ *
+ * @param budget Budget in bytes. 0 accounts the memory, but never degrades.
+ */
+void w_mem_budget_init(size_t budget);
+
+/**
+ * @brief Account memory taken by a subsystem.
+ */
+void w_mem_add(w_mem_subsystem_t subsystem, size_t bytes);
+
+/**
+ * @brief Account memory released by a subsystem.
+ */
+void w_mem_sub(w_mem_subsystem_t subsystem, size_t bytes);
+
+/**
+ * @brief Set the memory of a subsystem that is estimated as a whole.
+ */
+void w_mem_set(w_mem_subsystem_t subsystem, size_t bytes);
+
+/**
+ * @brief Get the memory accounted for a subsystem, or the total with W_MEM_COUNT.
+ */
+size_t w_mem_used(w_mem_subsystem_t subsystem);
+
+/**
+ * @brief Get the configured budget in bytes (0 if unlimited).
+ */
+size_t w_mem_budget(void);
+
+/**
+ * @brief Get the current degradation level.
+ */
+w_mem_level_t w_mem_level(void);
+
+/**
+ * @brief Re-evaluate the degradation level and log its changes.
+ *
+ * @return Current level.
+ */
+w_mem_level_t w_mem_update(void);
+
+const char * w_mem_subsystem_name(w_mem_subsystem_t subsystem);
+const char * w_mem_level_name(w_mem_level_t level);
+
+#endif /* MEMORY_BUDGET_H */
@@ -11,6 +11,46 @@
 
 static OSHash *mitre_table;
 
+/* Render the tactics of a technique once, so alerts only copy bytes */
+static mitre_data_t * mitre_data_create(cJSON *tactics) {
+    w_json_writer_t writer = { NULL, 0, 0 };
+    mitre_data_t *data;
+    cJSON *tactic;
+    int i = 0;
+
+    os_calloc(1, sizeof(mitre_data_t), data);
+    os_calloc(cJSON_GetArraySize(tactics) + 1, sizeof(char *), data->tactics_json);
+    data->tactics = tactics;
+
+    cJSON_ArrayForEach(tactic, tactics) {
+        w_json_writer_reset(&writer);
+        w_json_add_string(&writer, NULL, tactic->valuestring);
+        os_strdup(w_json_writer_str(&writer), data->tactics_json[i++]);
+    }
+
+    w_json_writer_reset(&writer);
+    w_json_open_array(&writer, NULL);
+
+    for (i = 0; data->tactics_json[i] != NULL; i++) {
+        w_json_add_raw(&writer, NULL, data->tactics_json[i]);
+    }
+
+    w_json_close_array(&writer);
+    os_strdup(w_json_writer_str(&writer), data->json);
+    w_json_writer_free(&writer);
+
+    return data;
+}
+
+static void mitre_data_free(mitre_data_t *data) {
+    if (data) {
+        cJSON_Delete(data->tactics);
+        free_strarray(data->tactics_json);
+        os_free(data->json);
+        os_free(data);
+    }
+}
+
 int mitre_load(char * mode){
     int result = 0;
     int hashcheck;
@@ -29,9 +69,11 @@ int mitre_load(char * mode){
     cJSON *tactics_json = NULL;
     cJSON *tactics = NULL;
     cJSON *tactic = NULL;
+    mitre_data_t *data = NULL;
 
     /* Create hash table */
     mitre_table = OSHash_Create();
+    OSHash_SetFreeDataPointer(mitre_table, (void (*)(void *))mitre_data_free);
 
     /* Get Mitre IDs from Mitre's database */
     os_calloc(OS_SIZE_6144 + 1, sizeof(char), wazuhdb_query);
@@ -111,15 +153,15 @@ int mitre_load(char * mode){
         tactics_json = NULL;
 
         /* Filling Hash table with Mitre's information */
-        if (hashcheck = OSHash_Add(mitre_table, ext_id, tactics_array), hashcheck == 0) {
+        data = mitre_data_create(tactics_array);
+        tactics_array = NULL;
+
+        if (hashcheck = OSHash_Add(mitre_table, ext_id, data), hashcheck == 0) {
             merror("Mitre Hash table adding failed. Mitre Technique ID '%s' cannot be stored.", ext_id);
+            mitre_data_free(data);
             result = -1;
             goto end;
         }
-
-        if (mode != NULL && !strcmp(mode,"test")) {
-            cJSON_Delete(tactics_array);
-        }
     }
 
 end:
@@ -144,5 +186,10 @@ end:
 }
 
 cJSON * mitre_get_attack(const char * mitre_id) {
+    mitre_data_t *data = OSHash_Get(mitre_table, mitre_id);
+    return data ? data->tactics : NULL;
+}
+
+const mitre_data_t * mitre_get_data(const char * mitre_id) {
     return OSHash_Get(mitre_table, mitre_id);
 }
@@ -15,6 +15,13 @@
 #include "os_net/os_net.h"
 #include "headers/wazuhdb_op.h"
 
+/* Tactics of a Mitre technique, also rendered as JSON at load time */
+typedef struct mitre_data_t {
+    cJSON *tactics;             ///< Array of tactic names
+    char **tactics_json;        ///< Each tactic as a JSON string, NULL-terminated
+    char *json;                 ///< Whole tactics array as JSON
+} mitre_data_t;
+
 /**
  * @brief This function fills Hash Table using Mitre technique ID as Key and technique's tactics as info.
  * 
@@ -32,4 +39,12 @@ int mitre_load(char *mode);
  */
 cJSON * mitre_get_attack(const char * mitre_id);
 
+/**
+ * @brief This function gets a Mitre technique ID's tactics, with their JSON rendering, from Hash Table 'mitre table'.
+ *
+ * @param mitre_id Input parameter, Mitre technique ID (e.g. T1168).
+ * @return const mitre_data_t*, the technique's tactics or NULL if the technique is not found.
+ */
+const mitre_data_t * mitre_get_data(const char * mitre_id);
+
 #endif /* MITRE_H */
@@ -12,9 +12,34 @@
 #include "alerts/getloglocation.h"
 #include "format/to_json.h"
 
+static w_shm_bcast_t *alerts_ring;
+
+void jsonout_output_event_ring(size_t ring_size)
+{
+    const char *path = isChroot() ? ALERTSQUEUE : DEFAULTDIR ALERTSQUEUE;
+
+    if (ring_size) {
+        if (alerts_ring = shm_bcast_create(path, ring_size), !alerts_ring) {
+            mwarn("The alerts will only be read from the file.");
+        }
+    } else {
+        shm_bcast_unlink(path);
+    }
+}
+
 void jsonout_output_event(const Eventinfo *lf)
 {
-    char *json_alert = Eventinfo_to_jsonstr(lf, false);
+    const char *json_alert = Eventinfo_to_jsonbuf(lf, false);
+    shm_bcast_origin_t origin;
+    size_t length;
+
+    if (alerts_ring) {
+        length = strlen(json_alert);
+        origin.file_id = _jflog_inode;
+        origin.start = ftell(_jflog);
+        origin.end = origin.start + length + 1;
+        shm_bcast_publish(alerts_ring, json_alert, length, &origin);
+    }
 
     fprintf(_jflog,
             "%s\n",
@@ -22,17 +47,15 @@ void jsonout_output_event(const Eventinfo *lf)
     if (strstr(json_alert,"gcp")) {
         mdebug2("Sending gcp event: %s", json_alert);
     }
-    free(json_alert);
     return;
 }
 void jsonout_output_archive(const Eventinfo *lf)
 {
-    char *json_alert;
+    const char *json_alert;
 
     if (strcmp(lf->location, "ossec-keepalive") && !strstr(lf->location, "->ossec-keepalive")) {
-        json_alert = Eventinfo_to_jsonstr(lf, true);
+        json_alert = Eventinfo_to_jsonbuf(lf, true);
         fprintf(_ejflog, "%s\n", json_alert);
-        free(json_alert);
     }
 }
 
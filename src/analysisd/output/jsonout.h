@@ -18,4 +18,12 @@ void jsonout_output_archive(const Eventinfo *lf);
 void jsonout_output_archive_flush();
 void jsonout_output_event_flush();
 
+/**
+ * @brief Publish the JSON alerts on a shared ring too, so that the daemons that
+ *        read them don't have to tail the file.
+ *
+ * @param ring_size Bytes of the ring, or 0 to drop any ring left by a previous run.
+ */
+void jsonout_output_event_ring(size_t ring_size);
+
 #endif /* JSONOUT_H */
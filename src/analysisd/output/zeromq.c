@@ -112,24 +112,22 @@ void zeromq_output_end()
 #if CZMQ_VERSION_MAJOR == 2
 void zeromq_output_event(const Eventinfo *lf)
 {
-    char *json_alert = Eventinfo_to_jsonstr(lf);
+    const char *json_alert = Eventinfo_to_jsonbuf(lf, false);
 
     zmsg_t *msg = zmsg_new();
     zmsg_addstr(msg, "ossec.alerts");
     zmsg_addstr(msg, json_alert);
     zmsg_send(&msg, zeromq_pubsocket);
-    free(json_alert);
 }
 #elif ZMQ_VERSION_MAJOR >= 3
 void zeromq_output_event(const Eventinfo *lf)
 {
-    char *json_alert = Eventinfo_to_jsonstr(lf);
+    const char *json_alert = Eventinfo_to_jsonbuf(lf, false);
 
     zmsg_t *msg = zmsg_new();
     zmsg_addstr(msg, "ossec.alerts");
     zmsg_addstr(msg, json_alert);
     zmsg_send(&msg, zeromq_pubsocket);
-    free(json_alert);
 }
 #endif
 
@@ -0,0 +1,338 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "rule_prefilter.h"
+#include "config.h"
+
+/* Minimum number of siblings that must share an exact field to index it */
+#define RULE_PREFILTER_MIN_FIELD_RULES 4
+
+/* Minimum number of siblings with literal <match> to build their automaton */
+#define RULE_PREFILTER_MIN_MATCH_RULES 4
+
+#define BIT_SET(set, i) ((set)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+
+static rule_prefilter * rule_prefilter_build(RuleNode * first);
+static void rule_prefilter_build_match(rule_prefilter * prefilter);
+static char ** rule_prefilter_exact_values(const OSRegex * regex);
+static const char * rule_prefilter_pick_field(RuleNode ** nodes, unsigned int count);
+static uint64_t * rule_prefilter_add_decoder(rule_prefilter * prefilter, u_int16_t id);
+static uint64_t * rule_prefilter_add_value(rule_prefilter * prefilter, const char * value);
+static int rule_prefilter_cmp_value(const void * key, const void * item);
+static int rule_prefilter_cmp_decoder(const void * key, const void * item);
+
+int OS_CompileRulePrefilters(RuleNode * node) {
+    int indexed = 0;
+
+    while (node) {
+        if (node->child) {
+            if (!node->prefilter && (node->prefilter = rule_prefilter_build(node->child))) {
+                indexed++;
+            }
+
+            indexed += OS_CompileRulePrefilters(node->child);
+        }
+
+        node = node->next;
+    }
+
+    return indexed;
+}
+
+void rule_prefilter_candidates(const rule_prefilter * prefilter, Eventinfo * lf, uint64_t * candidates) {
+    const uint64_t * decoder_set = NULL;
+    const uint64_t * value_set = NULL;
+    const rule_prefilter_value * value;
+    const u_int16_t * id_pt;
+    u_int16_t id;
+    const char * field;
+    uint64_t pending = 0;
+    unsigned int i;
+
+    id = lf->decoder_syscheck_id != 0 ? lf->decoder_syscheck_id : lf->decoder_info->id;
+
+    if (id_pt = bsearch(&id, prefilter->decoder_ids, prefilter->n_decoders, sizeof(u_int16_t), rule_prefilter_cmp_decoder), id_pt) {
+        decoder_set = prefilter->decoder_rules[id_pt - prefilter->decoder_ids];
+    }
+
+    if (prefilter->field && (field = FindField(lf, prefilter->field), field)) {
+        if (value = bsearch(field, prefilter->values, prefilter->n_values, sizeof(rule_prefilter_value), rule_prefilter_cmp_value), value) {
+            value_set = value->rules;
+        }
+    }
+
+    for (i = 0; i < prefilter->words; i++) {
+        candidates[i] = prefilter->decoded_any[i];
+
+        if (decoder_set) {
+            candidates[i] |= decoder_set[i];
+        }
+
+        if (!lf->program_name) {
+            candidates[i] &= ~prefilter->pname_required[i];
+        }
+
+        if (prefilter->field) {
+            candidates[i] &= prefilter->field_any[i] | (value_set ? value_set[i] : 0);
+        }
+
+        if (prefilter->match) {
+            pending |= candidates[i] & ~prefilter->match_any[i];
+        }
+    }
+
+    /* Scan the log once for the <match> of all the remaining candidates */
+    if (pending && lf->log) {
+        uint64_t found[RULE_PREFILTER_MAX_WORDS];
+
+        memset(found, 0, prefilter->words * sizeof(uint64_t));
+        OSMultiMatch_Execute(lf->log, lf->size, prefilter->match, found);
+
+        for (i = 0; i < prefilter->words; i++) {
+            candidates[i] &= prefilter->match_any[i] | found[i];
+        }
+    }
+}
+
+/* Index a sibling list */
+static rule_prefilter * rule_prefilter_build(RuleNode * first) {
+    rule_prefilter * prefilter;
+    RuleNode * node;
+    RuleInfo * rule;
+    unsigned int count = 0;
+    unsigned int i;
+    int j;
+    int k;
+    char ** values;
+
+    for (node = first; node; node = node->next) {
+        count++;
+    }
+
+    if (count < RULE_PREFILTER_MIN_SIBLINGS || count > RULE_PREFILTER_MAX_WORDS * 64) {
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(rule_prefilter), prefilter);
+    prefilter->count = count;
+    prefilter->words = (count + 63) / 64;
+    os_calloc(count, sizeof(RuleNode *), prefilter->nodes);
+    os_calloc(prefilter->words, sizeof(uint64_t), prefilter->decoded_any);
+    os_calloc(prefilter->words, sizeof(uint64_t), prefilter->pname_required);
+
+    for (i = 0, node = first; node; node = node->next, i++) {
+        prefilter->nodes[i] = node;
+    }
+
+    if (prefilter->field = (char *)rule_prefilter_pick_field(prefilter->nodes, count), prefilter->field) {
+        os_strdup(prefilter->field, prefilter->field);
+        os_calloc(prefilter->words, sizeof(uint64_t), prefilter->field_any);
+    }
+
+    for (i = 0; i < count; i++) {
+        rule = prefilter->nodes[i]->ruleinfo;
+
+        if (rule->decoded_as) {
+            BIT_SET(rule_prefilter_add_decoder(prefilter, rule->decoded_as), i);
+        } else {
+            BIT_SET(prefilter->decoded_any, i);
+        }
+
+        if (rule->program_name) {
+            BIT_SET(prefilter->pname_required, i);
+        }
+
+        if (!prefilter->field) {
+            continue;
+        }
+
+        values = NULL;
+
+        for (j = 0; j < Config.decoder_order_size && rule->fields[j]; j++) {
+            if (strcasecmp(rule->fields[j]->name, prefilter->field) == 0 && (values = rule_prefilter_exact_values(rule->fields[j]->regex), values)) {
+                break;
+            }
+        }
+
+        if (values) {
+            for (k = 0; values[k]; k++) {
+                BIT_SET(rule_prefilter_add_value(prefilter, values[k]), i);
+            }
+
+            free_strarray(values);
+        } else {
+            BIT_SET(prefilter->field_any, i);
+        }
+    }
+
+    rule_prefilter_build_match(prefilter);
+
+    return prefilter;
+}
+
+/* Build the automaton of the <match> literals of the siblings */
+static void rule_prefilter_build_match(rule_prefilter * prefilter) {
+    RuleInfo * rule;
+    unsigned int indexed = 0;
+    unsigned int i;
+
+    os_calloc(1, sizeof(OSMultiMatch), prefilter->match);
+    os_calloc(prefilter->words, sizeof(uint64_t), prefilter->match_any);
+    OSMultiMatch_Init(prefilter->match);
+
+    for (i = 0; i < prefilter->count; i++) {
+        rule = prefilter->nodes[i]->ruleinfo;
+
+        if (rule->match && OSMultiMatch_AddMatch(prefilter->match, rule->match, i)) {
+            indexed++;
+        } else {
+            BIT_SET(prefilter->match_any, i);
+        }
+    }
+
+    if (indexed < RULE_PREFILTER_MIN_MATCH_RULES || !OSMultiMatch_Compile(prefilter->match)) {
+        OSMultiMatch_FreePattern(prefilter->match);
+        os_free(prefilter->match);
+        os_free(prefilter->match_any);
+    }
+}
+
+/* Get the alternatives of a regex made only of "^literal$" terms */
+static char ** rule_prefilter_exact_values(const OSRegex * regex) {
+    char ** values = NULL;
+    const char * term;
+    const char * end;
+    size_t n = 0;
+
+    if (!regex || !regex->raw) {
+        return NULL;
+    }
+
+    for (term = regex->raw; ; term = end + 1) {
+        end = strchr(term, '|');
+
+        if (!end) {
+            end = term + strlen(term);
+        }
+
+        if (end - term < 3 || term[0] != '^' || end[-1] != '$' || strcspn(term + 1, "\\+*()^$|") != (size_t)(end - term - 2)) {
+            free_strarray(values);
+            return NULL;
+        }
+
+        os_realloc(values, (n + 2) * sizeof(char *), values);
+        os_calloc(end - term - 1, sizeof(char), values[n]);
+        memcpy(values[n], term + 1, end - term - 2);
+        values[++n] = NULL;
+
+        if (*end == '\0') {
+            break;
+        }
+    }
+
+    return values;
+}
+
+/* Choose the dynamic field that most siblings constrain to exact values */
+static const char * rule_prefilter_pick_field(RuleNode ** nodes, unsigned int count) {
+    const char * best = NULL;
+    unsigned int best_count = 0;
+    unsigned int i;
+    unsigned int l;
+    unsigned int hits;
+    int j;
+    int k;
+    char ** values;
+
+    for (i = 0; i < count; i++) {
+        RuleInfo * rule = nodes[i]->ruleinfo;
+
+        for (j = 0; j < Config.decoder_order_size && rule->fields[j]; j++) {
+            if (best && strcasecmp(best, rule->fields[j]->name) == 0) {
+                continue;
+            }
+
+            if (values = rule_prefilter_exact_values(rule->fields[j]->regex), !values) {
+                continue;
+            }
+
+            free_strarray(values);
+            hits = 0;
+
+            for (l = i; l < count; l++) {
+                RuleInfo * other = nodes[l]->ruleinfo;
+
+                for (k = 0; k < Config.decoder_order_size && other->fields[k]; k++) {
+                    if (strcasecmp(other->fields[k]->name, rule->fields[j]->name) == 0 && (values = rule_prefilter_exact_values(other->fields[k]->regex), values)) {
+                        free_strarray(values);
+                        hits++;
+                        break;
+                    }
+                }
+            }
+
+            if (hits > best_count) {
+                best = rule->fields[j]->name;
+                best_count = hits;
+            }
+        }
+    }
+
+    return best_count >= RULE_PREFILTER_MIN_FIELD_RULES ? best : NULL;
+}
+
+/* Get (or create) the set of rules that require a decoder, keeping IDs sorted */
+static uint64_t * rule_prefilter_add_decoder(rule_prefilter * prefilter, u_int16_t id) {
+    unsigned int i;
+
+    for (i = 0; i < prefilter->n_decoders && prefilter->decoder_ids[i] < id; i++);
+
+    if (i < prefilter->n_decoders && prefilter->decoder_ids[i] == id) {
+        return prefilter->decoder_rules[i];
+    }
+
+    os_realloc(prefilter->decoder_ids, (prefilter->n_decoders + 1) * sizeof(u_int16_t), prefilter->decoder_ids);
+    os_realloc(prefilter->decoder_rules, (prefilter->n_decoders + 1) * sizeof(uint64_t *), prefilter->decoder_rules);
+    memmove(prefilter->decoder_ids + i + 1, prefilter->decoder_ids + i, (prefilter->n_decoders - i) * sizeof(u_int16_t));
+    memmove(prefilter->decoder_rules + i + 1, prefilter->decoder_rules + i, (prefilter->n_decoders - i) * sizeof(uint64_t *));
+    prefilter->decoder_ids[i] = id;
+    os_calloc(prefilter->words, sizeof(uint64_t), prefilter->decoder_rules[i]);
+    prefilter->n_decoders++;
+
+    return prefilter->decoder_rules[i];
+}
+
+/* Get (or create) the set of rules that require a field value, keeping values sorted */
+static uint64_t * rule_prefilter_add_value(rule_prefilter * prefilter, const char * value) {
+    unsigned int i;
+    int cmp = 1;
+
+    for (i = 0; i < prefilter->n_values && (cmp = strcasecmp(prefilter->values[i].value, value)) < 0; i++);
+
+    if (i < prefilter->n_values && cmp == 0) {
+        return prefilter->values[i].rules;
+    }
+
+    os_realloc(prefilter->values, (prefilter->n_values + 1) * sizeof(rule_prefilter_value), prefilter->values);
+    memmove(prefilter->values + i + 1, prefilter->values + i, (prefilter->n_values - i) * sizeof(rule_prefilter_value));
+    os_strdup(value, prefilter->values[i].value);
+    os_calloc(prefilter->words, sizeof(uint64_t), prefilter->values[i].rules);
+    prefilter->n_values++;
+
+    return prefilter->values[i].rules;
+}
+
+static int rule_prefilter_cmp_value(const void * key, const void * item) {
+    return strcasecmp((const char *)key, ((const rule_prefilter_value *)item)->value);
+}
+
+static int rule_prefilter_cmp_decoder(const void * key, const void * item) {
+    return (int)*(const u_int16_t *)key - (int)*(const u_int16_t *)item;
+}
@@ -0,0 +1,77 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef RULE_PREFILTER_H
+#define RULE_PREFILTER_H
+
+#include "rules.h"
+#include "eventinfo.h"
+
+/* Sibling lists shorter than this are walked linearly */
+#define RULE_PREFILTER_MIN_SIBLINGS 8
+
+/* Maximum number of 64-bit words of a candidate set (4096 siblings) */
+#define RULE_PREFILTER_MAX_WORDS    64
+
+/**
+ * @brief Rules of a sibling list that require an exact value in the indexed field.
+ */
+typedef struct rule_prefilter_value {
+    char * value;
+    uint64_t * rules;
+} rule_prefilter_value;
+
+/**
+ * @brief Index over the children of a rule node.
+ *
+ * Every set is a bitmap over the position of the child in the list, so
+ * intersecting them keeps the original evaluation order. A rule is only
+ * discarded if one of its side-effect free checks would fail anyway.
+ */
+typedef struct rule_prefilter {
+    unsigned int count;             ///< Number of siblings
+    unsigned int words;             ///< Words per bitmap
+    RuleNode ** nodes;              ///< Siblings, in list order
+
+    uint64_t * decoded_any;         ///< Rules without <decoded_as>
+    unsigned int n_decoders;
+    u_int16_t * decoder_ids;        ///< Sorted decoder IDs
+    uint64_t ** decoder_rules;      ///< Rules requiring each decoder ID
+
+    uint64_t * pname_required;      ///< Rules with <program_name>
+
+    char * field;                   ///< Dynamic field indexed by exact value, or NULL
+    uint64_t * field_any;           ///< Rules without an exact constraint on the field
+    unsigned int n_values;
+    rule_prefilter_value * values;  ///< Sorted (case insensitive) exact values
+
+    OSMultiMatch * match;           ///< Literals of every sibling's <match>, tagged with its position, or NULL
+    uint64_t * match_any;           ///< Rules whose <match> has no mandatory literal, or without <match>
+} rule_prefilter;
+
+/**
+ * @brief Build the prefilter of every sibling list under a rule tree.
+ *
+ * Must be called once all the rules are loaded.
+ *
+ * @param node First node of the tree.
+ * @return Number of sibling lists indexed.
+ */
+int OS_CompileRulePrefilters(RuleNode * node);
+
+/**
+ * @brief Compute the children of a node that may match an event.
+ *
+ * @param prefilter Index of the children.
+ * @param lf Event.
+ * @param candidates Output bitmap with room for prefilter->words words.
+ */
+void rule_prefilter_candidates(const rule_prefilter * prefilter, Eventinfo * lf, uint64_t * candidates);
+
+#endif /* RULE_PREFILTER_H */
@@ -0,0 +1,458 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "rule_profile.h"
+
+/* Counters of a thread, one per rule */
+typedef struct rule_profile_thread {
+    rule_profile_counters * counters;
+    struct rule_profile_thread * next;
+} rule_profile_thread;
+
+/* Totals of a rule, for the report */
+typedef struct rule_profile_total {
+    const RuleInfo * rule;
+    rule_profile_counters counters;
+} rule_profile_total;
+
+/* Rule among its siblings */
+typedef struct rule_profile_sibling {
+    const rule_profile_total * total;
+    unsigned int position;
+} rule_profile_sibling;
+
+/* Sibling list that would check fewer rules sorted by matches */
+typedef struct rule_profile_reorder {
+    int parent;
+    uint64_t saved;
+    cJSON * current;
+    cJSON * suggested;
+} rule_profile_reorder;
+
+/* State of the cost analysis */
+typedef struct rule_profile_cost {
+    const rule_profile_total * totals;  /* By profile ID */
+    unsigned char * seen;
+    unsigned int * unmatched;
+    unsigned int n_unmatched;
+    unsigned int * unreached;
+    unsigned int n_unreached;
+    rule_profile_reorder * reorder;
+    unsigned int n_reorder;
+} rule_profile_cost;
+
+/* Flags of the rules already analyzed, as a rule has a node under each parent */
+#define RULE_PROFILE_SEEN_BRANCH    1
+#define RULE_PROFILE_SEEN_CHILDREN  2
+
+int rule_profile_enabled;
+
+static RuleInfo ** profile_rules;
+static unsigned int profile_count;
+static rule_profile_thread * profile_threads;
+static unsigned int profile_n_threads;
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread rule_profile_counters * profile_local;
+
+static void rule_profile_number(RuleNode * node);
+static rule_profile_total * rule_profile_collect(unsigned int * n_threads);
+static int rule_profile_cmp(const void * a, const void * b);
+static void rule_profile_walk(rule_profile_cost * cost, RuleNode * node, int parent);
+static void rule_profile_siblings(rule_profile_cost * cost, RuleNode * node, int parent);
+
+unsigned int rule_profile_init(RuleNode * node) {
+    rule_profile_number(node);
+    return profile_count;
+}
+
+/* Rules are numbered from 1, so that 0 means "not profiled" */
+static void rule_profile_number(RuleNode * node) {
+    for (; node; node = node->next) {
+        if (node->ruleinfo && !node->ruleinfo->profile_id) {
+            os_realloc(profile_rules, (profile_count + 1) * sizeof(RuleInfo *), profile_rules);
+            profile_rules[profile_count++] = node->ruleinfo;
+            node->ruleinfo->profile_id = profile_count;
+        }
+
+        rule_profile_number(node->child);
+    }
+}
+
+rule_profile_counters * rule_profile_local(const RuleInfo * rule) {
+    rule_profile_thread * thread;
+
+    if (!rule || !rule->profile_id || rule->profile_id > profile_count) {
+        return NULL;
+    }
+
+    if (!profile_local) {
+        os_calloc(profile_count, sizeof(rule_profile_counters), profile_local);
+        os_malloc(sizeof(rule_profile_thread), thread);
+        thread->counters = profile_local;
+
+        w_mutex_lock(&profile_mutex);
+        thread->next = profile_threads;
+        profile_threads = thread;
+        profile_n_threads++;
+        w_mutex_unlock(&profile_mutex);
+    }
+
+    return profile_local + rule->profile_id - 1;
+}
+
+/* Most expensive first */
+static int rule_profile_cmp(const void * a, const void * b) {
+    const rule_profile_total * x = a;
+    const rule_profile_total * y = b;
+
+    if (x->counters.self_ns != y->counters.self_ns) {
+        return x->counters.self_ns < y->counters.self_ns ? 1 : -1;
+    }
+
+    return x->rule->sigid - y->rule->sigid;
+}
+
+/* Add up the counters of every thread, by profile ID */
+static rule_profile_total * rule_profile_collect(unsigned int * n_threads) {
+    rule_profile_total * totals;
+    rule_profile_thread * thread;
+    unsigned int i;
+    unsigned int j;
+
+    os_calloc(profile_count, sizeof(rule_profile_total), totals);
+
+    for (i = 0; i < profile_count; i++) {
+        totals[i].rule = profile_rules[i];
+    }
+
+    /* Threads are only added, at the head, so the list can be walked out of the lock */
+    w_mutex_lock(&profile_mutex);
+    thread = profile_threads;
+    *n_threads = profile_n_threads;
+    w_mutex_unlock(&profile_mutex);
+
+    for (; thread; thread = thread->next) {
+        for (i = 0; i < profile_count; i++) {
+            rule_profile_counters * counters = thread->counters + i;
+
+            totals[i].counters.evaluations += __atomic_load_n(&counters->evaluations, __ATOMIC_RELAXED);
+            totals[i].counters.matches += __atomic_load_n(&counters->matches, __ATOMIC_RELAXED);
+            totals[i].counters.self_ns += __atomic_load_n(&counters->self_ns, __ATOMIC_RELAXED);
+            totals[i].counters.regex_backtracks += __atomic_load_n(&counters->regex_backtracks, __ATOMIC_RELAXED);
+
+            for (j = 0; j < RULE_PROFILE_PHASES; j++) {
+                totals[i].counters.phase_ns[j] += __atomic_load_n(&counters->phase_ns[j], __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    return totals;
+}
+
+cJSON * rule_profile_report(unsigned int top) {
+    static const char * PHASES[RULE_PROFILE_PHASES] = { "match_ns", "regex_ns", "fields_ns", "lists_ns" };
+    rule_profile_total * totals;
+    cJSON * report;
+    cJSON * rules;
+    cJSON * item;
+    unsigned int n_threads;
+    unsigned int i;
+    unsigned int j;
+
+    if (!profile_count) {
+        return NULL;
+    }
+
+    totals = rule_profile_collect(&n_threads);
+    qsort(totals, profile_count, sizeof(rule_profile_total), rule_profile_cmp);
+
+    report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "threads", n_threads);
+    cJSON_AddNumberToObject(report, "total_rules", profile_count);
+    rules = cJSON_CreateArray();
+    cJSON_AddItemToObject(report, "rules", rules);
+
+    for (i = 0; i < profile_count && i < top && totals[i].counters.evaluations; i++) {
+        item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "id", totals[i].rule->sigid);
+        cJSON_AddNumberToObject(item, "level", totals[i].rule->level);
+        cJSON_AddNumberToObject(item, "evaluations", totals[i].counters.evaluations);
+        cJSON_AddNumberToObject(item, "matches", totals[i].counters.matches);
+        cJSON_AddNumberToObject(item, "time_ns", totals[i].counters.self_ns);
+
+        for (j = 0; j < RULE_PROFILE_PHASES; j++) {
+            cJSON_AddNumberToObject(item, PHASES[j], totals[i].counters.phase_ns[j]);
+        }
+
+        cJSON_AddNumberToObject(item, "regex_backtracks", totals[i].counters.regex_backtracks);
+
+        cJSON_AddItemToArray(rules, item);
+    }
+
+    free(totals);
+    return report;
+}
+
+/* Most evaluated first */
+static int rule_profile_cmp_evaluations(const void * a, const void * b) {
+    const rule_profile_total * x = *(const rule_profile_total * const *)a;
+    const rule_profile_total * y = *(const rule_profile_total * const *)b;
+
+    if (x->counters.evaluations != y->counters.evaluations) {
+        return x->counters.evaluations < y->counters.evaluations ? 1 : -1;
+    }
+
+    return x->rule->sigid - y->rule->sigid;
+}
+
+/* Most backtracking first */
+static int rule_profile_cmp_backtracks(const void * a, const void * b) {
+    const rule_profile_total * x = *(const rule_profile_total * const *)a;
+    const rule_profile_total * y = *(const rule_profile_total * const *)b;
+
+    if (x->counters.regex_backtracks != y->counters.regex_backtracks) {
+        return x->counters.regex_backtracks < y->counters.regex_backtracks ? 1 : -1;
+    }
+
+    return x->rule->sigid - y->rule->sigid;
+}
+
+/* Most matched first, keeping the current order of ties */
+static int rule_profile_cmp_matches(const void * a, const void * b) {
+    const rule_profile_sibling * x = a;
+    const rule_profile_sibling * y = b;
+
+    if (x->total->counters.matches != y->total->counters.matches) {
+        return x->total->counters.matches < y->total->counters.matches ? 1 : -1;
+    }
+
+    return (int)x->position - (int)y->position;
+}
+
+/* Current order */
+static int rule_profile_cmp_position(const void * a, const void * b) {
+    return (int)((const rule_profile_sibling *)a)->position - (int)((const rule_profile_sibling *)b)->position;
+}
+
+/* Largest saving first */
+static int rule_profile_cmp_saved(const void * a, const void * b) {
+    const rule_profile_reorder * x = a;
+    const rule_profile_reorder * y = b;
+
+    if (x->saved != y->saved) {
+        return x->saved < y->saved ? 1 : -1;
+    }
+
+    return x->parent - y->parent;
+}
+
+/* Sort a list of rules and dump the top of it */
+static cJSON * rule_profile_list(const rule_profile_total ** list, unsigned int count, unsigned int top, int (*cmp)(const void *, const void *)) {
+    cJSON * array = cJSON_CreateArray();
+    cJSON * item;
+    unsigned int i;
+
+    qsort(list, count, sizeof(rule_profile_total *), cmp);
+
+    for (i = 0; i < count && i < top; i++) {
+        const rule_profile_counters * counters = &list[i]->counters;
+
+        item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "id", list[i]->rule->sigid);
+        cJSON_AddNumberToObject(item, "evaluations", counters->evaluations);
+        cJSON_AddNumberToObject(item, "matches", counters->matches);
+        cJSON_AddNumberToObject(item, "time_ns", counters->self_ns);
+        cJSON_AddNumberToObject(item, "regex_ns", counters->phase_ns[RULE_PROFILE_REGEX]);
+        cJSON_AddNumberToObject(item, "regex_backtracks", counters->regex_backtracks);
+        cJSON_AddItemToArray(array, item);
+    }
+
+    return array;
+}
+
+cJSON * rule_profile_cost_report(RuleNode * node, unsigned int top) {
+    rule_profile_cost cost = { NULL };
+    rule_profile_total * totals;
+    const rule_profile_total ** list;
+    cJSON * report;
+    cJSON * reorder;
+    cJSON * item;
+    unsigned int n_threads;
+    unsigned int count;
+    unsigned int i;
+
+    if (!profile_count) {
+        return NULL;
+    }
+
+    totals = rule_profile_collect(&n_threads);
+    cost.totals = totals;
+    os_calloc(profile_count, sizeof(unsigned char), cost.seen);
+    os_calloc(profile_count, sizeof(rule_profile_total *), list);
+
+    rule_profile_walk(&cost, node, 0);
+
+    report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "threads", n_threads);
+    cJSON_AddNumberToObject(report, "total_rules", profile_count);
+
+    for (i = count = 0; i < profile_count; i++) {
+        if (totals[i].counters.evaluations) {
+            list[count++] = totals + i;
+        }
+    }
+
+    cJSON_AddItemToObject(report, "evaluated", rule_profile_list(list, count, top, rule_profile_cmp_evaluations));
+
+    for (i = count = 0; i < profile_count; i++) {
+        if (totals[i].counters.regex_backtracks) {
+            list[count++] = totals + i;
+        }
+    }
+
+    cJSON_AddItemToObject(report, "backtracking", rule_profile_list(list, count, top, rule_profile_cmp_backtracks));
+
+    /* Children checked but never matched: the costliest dead branches first */
+    for (i = 0; i < cost.n_unmatched; i++) {
+        list[i] = totals + cost.unmatched[i];
+    }
+
+    cJSON_AddNumberToObject(report, "total_never_matched", cost.n_unmatched);
+    cJSON_AddItemToObject(report, "never_matched", rule_profile_list(list, cost.n_unmatched, top, rule_profile_cmp_evaluations));
+
+    /* Children never checked, as their parents never matched */
+    item = cJSON_CreateArray();
+
+    for (i = 0; i < cost.n_unreached && i < top; i++) {
+        cJSON_AddItemToArray(item, cJSON_CreateNumber(totals[cost.unreached[i]].rule->sigid));
+    }
+
+    cJSON_AddNumberToObject(report, "total_never_reached", cost.n_unreached);
+    cJSON_AddItemToObject(report, "never_reached", item);
+
+    qsort(cost.reorder, cost.n_reorder, sizeof(rule_profile_reorder), rule_profile_cmp_saved);
+    reorder = cJSON_CreateArray();
+    cJSON_AddItemToObject(report, "reorder", reorder);
+
+    for (i = 0; i < cost.n_reorder; i++) {
+        if (i >= top) {
+            cJSON_Delete(cost.reorder[i].current);
+            cJSON_Delete(cost.reorder[i].suggested);
+            continue;
+        }
+
+        item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "parent", cost.reorder[i].parent);
+        cJSON_AddNumberToObject(item, "checks_saved", cost.reorder[i].saved);
+        cJSON_AddItemToObject(item, "current", cost.reorder[i].current);
+        cJSON_AddItemToObject(item, "suggested", cost.reorder[i].suggested);
+        cJSON_AddItemToArray(reorder, item);
+    }
+
+    os_free(cost.reorder);
+    os_free(cost.unmatched);
+    os_free(cost.unreached);
+    os_free(cost.seen);
+    os_free(list);
+    free(totals);
+    return report;
+}
+
+/* Classify the children of parent (0 at the top level) and their descendants */
+static void rule_profile_walk(rule_profile_cost * cost, RuleNode * node, int parent) {
+    const rule_profile_counters * counters;
+    RuleNode * sibling;
+    unsigned int index;
+
+    for (sibling = node; sibling; sibling = sibling->next) {
+        if (!sibling->ruleinfo || !sibling->ruleinfo->profile_id || sibling->ruleinfo->profile_id > profile_count) {
+            continue;
+        }
+
+        index = sibling->ruleinfo->profile_id - 1;
+        counters = &cost->totals[index].counters;
+
+        if (parent && !(cost->seen[index] & RULE_PROFILE_SEEN_BRANCH)) {
+            cost->seen[index] |= RULE_PROFILE_SEEN_BRANCH;
+
+            if (!counters->evaluations) {
+                os_realloc(cost->unreached, (cost->n_unreached + 1) * sizeof(unsigned int), cost->unreached);
+                cost->unreached[cost->n_unreached++] = index;
+            } else if (!counters->matches) {
+                os_realloc(cost->unmatched, (cost->n_unmatched + 1) * sizeof(unsigned int), cost->unmatched);
+                cost->unmatched[cost->n_unmatched++] = index;
+            }
+        }
+
+        if (sibling->child && !(cost->seen[index] & RULE_PROFILE_SEEN_CHILDREN)) {
+            cost->seen[index] |= RULE_PROFILE_SEEN_CHILDREN;
+            rule_profile_walk(cost, sibling->child, sibling->ruleinfo->sigid);
+        }
+    }
+
+    rule_profile_siblings(cost, node, parent);
+}
+
+/* Suggest sorting a sibling list by matches, if that saves checks.
+ * Every match of a rule saves a check per sibling that no longer comes before it.
+ */
+static void rule_profile_siblings(rule_profile_cost * cost, RuleNode * node, int parent) {
+    rule_profile_sibling * siblings = NULL;
+    rule_profile_reorder * reorder;
+    unsigned int count = 0;
+    uint64_t saved = 0;
+    unsigned int i;
+
+    for (; node; node = node->next) {
+        if (node->ruleinfo && node->ruleinfo->profile_id && node->ruleinfo->profile_id <= profile_count) {
+            os_realloc(siblings, (count + 1) * sizeof(rule_profile_sibling), siblings);
+            siblings[count].total = cost->totals + node->ruleinfo->profile_id - 1;
+            siblings[count].position = count;
+            count++;
+        }
+    }
+
+    if (count < 2) {
+        os_free(siblings);
+        return;
+    }
+
+    qsort(siblings, count, sizeof(rule_profile_sibling), rule_profile_cmp_matches);
+
+    for (i = 0; i < count; i++) {
+        if (siblings[i].position > i) {
+            saved += siblings[i].total->counters.matches * (siblings[i].position - i);
+        }
+    }
+
+    if (saved == 0) {
+        os_free(siblings);
+        return;
+    }
+
+    os_realloc(cost->reorder, (cost->n_reorder + 1) * sizeof(rule_profile_reorder), cost->reorder);
+    reorder = cost->reorder + cost->n_reorder++;
+    reorder->parent = parent;
+    reorder->saved = saved;
+    reorder->current = cJSON_CreateArray();
+    reorder->suggested = cJSON_CreateArray();
+
+    for (i = 0; i < count; i++) {
+        cJSON_AddItemToArray(reorder->suggested, cJSON_CreateNumber(siblings[i].total->rule->sigid));
+    }
+
+    qsort(siblings, count, sizeof(rule_profile_sibling), rule_profile_cmp_position);
+
+    for (i = 0; i < count; i++) {
+        cJSON_AddItemToArray(reorder->current, cJSON_CreateNumber(siblings[i].total->rule->sigid));
+    }
+
+    os_free(siblings);
+}
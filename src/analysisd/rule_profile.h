@@ -0,0 +1,114 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef RULE_PROFILE_H
+#define RULE_PROFILE_H
+
+#include <stdint.h>
+#include <time.h>
+#include "rules.h"
+
+/* Top rules dumped if no number is requested */
+#define RULE_PROFILE_DEFAULT_TOP 10
+
+/**
+ * @brief Checks of a rule timed separately.
+ */
+typedef enum rule_profile_phase {
+    RULE_PROFILE_MATCH,     ///< <match>
+    RULE_PROFILE_REGEX,     ///< <regex>
+    RULE_PROFILE_FIELDS,    ///< Dynamic fields
+    RULE_PROFILE_LISTS,     ///< CDB list lookups
+    RULE_PROFILE_PHASES
+} rule_profile_phase;
+
+/**
+ * @brief Counters of a rule in a thread.
+ *
+ * Only the owner thread writes them, so they need no lock. Readers load every
+ * field atomically, and may see a thread's counters a few events behind.
+ */
+typedef struct rule_profile_counters {
+    uint64_t evaluations;                   ///< Times the rule was checked
+    uint64_t matches;                       ///< Times the checks of the rule passed
+    uint64_t self_ns;                       ///< Time in the rule, excluding its children
+    uint64_t phase_ns[RULE_PROFILE_PHASES]; ///< Time in each kind of check
+    uint64_t regex_backtracks;              ///< Partial matches the <regex> abandoned
+} rule_profile_counters;
+
+extern int rule_profile_enabled;
+
+/**
+ * @brief Number every rule of a tree, so that it can be profiled.
+ *
+ * Must be called once all the rules are loaded, and before the first event.
+ *
+ * @param node First node of the tree.
+ * @return Number of rules profiled.
+ */
+unsigned int rule_profile_init(RuleNode * node);
+
+/**
+ * @brief Get the counters of a rule for the calling thread.
+ *
+ * The first call of each thread allocates its counters.
+ *
+ * @param rule Rule.
+ * @return Counters, or NULL if the rule is not profiled.
+ */
+rule_profile_counters * rule_profile_local(const RuleInfo * rule);
+
+/**
+ * @brief Aggregate the counters of every thread.
+ *
+ * @param top Maximum number of rules, the most expensive first.
+ * @return JSON object like {"threads":4,"rules":[{"id":5716,...}]}.
+ */
+cJSON * rule_profile_report(unsigned int top);
+
+/**
+ * @brief Analyze the cost of a ruleset from the counters of every thread.
+ *
+ * Siblings are checked in order until one matches, so sorting them by matches
+ * saves the checks of those that come first. It's only a suggestion: siblings
+ * whose conditions overlap classify events differently once reordered.
+ *
+ * @param node First node of the tree, as given to rule_profile_init().
+ * @param top Maximum number of items of each list.
+ * @return JSON object like {"evaluated":[...],"backtracking":[...],
+ *         "never_matched":[...],"never_reached":[...],"reorder":[...]}.
+ */
+cJSON * rule_profile_cost_report(RuleNode * node, unsigned int top);
+
+/* Monotonic time in nanoseconds */
+static inline uint64_t rule_profile_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Counters have a single writer: a relaxed store keeps readers from seeing torn values */
+static inline void rule_profile_add(uint64_t * counter, uint64_t value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+/* Start timing a check, if the rule is profiled */
+static inline uint64_t rule_profile_start(const rule_profile_counters * profile) {
+    return profile ? rule_profile_now() : 0;
+}
+
+/* Account the time since start to a kind of check */
+static inline void rule_profile_stop(rule_profile_counters * profile, rule_profile_phase phase, uint64_t start) {
+    if (profile) {
+        rule_profile_add(&profile->phase_ns[phase], rule_profile_now() - start);
+    }
+}
+
+#endif /* RULE_PROFILE_H */
@@ -13,6 +13,7 @@
 #include "eventinfo.h"
 #include "compiled_rules/compiled_rules.h"
 #include "analysisd.h"
+#include "ruleset_load.h"
 
 /* Global definition */
 RuleInfo *currently_rule;
@@ -196,6 +197,7 @@ int Rules_OP_ReadRules(const char *rulefile)
     RuleInfo *config_ruleinfo = NULL;
 
     size_t i;
+    int vars = 0;
     default_timeframe = 360;
 
     /* If no directory in the rulefile, add the default */
@@ -216,14 +218,14 @@ int Rules_OP_ReadRules(const char *rulefile)
     i = 0;
 
     /* Read the XML */
-    if (OS_ReadXML(rulepath, &xml) < 0) {
+    if (Ruleset_ReadXML(rulepath, &xml, &vars) < 0) {
         merror(XML_ERROR, rulepath, xml.err, xml.err_line);
         goto cleanup;
     }
     mdebug2("Read xml for rule.");
 
     /* Apply any variable found */
-    if (OS_ApplyVariables(&xml) != 0) {
+    if (vars != 0) {
         merror(XML_ERROR_VAR, rulepath, xml.err);
         goto cleanup;
     }
@@ -714,6 +716,7 @@ int Rules_OP_ReadRules(const char *rulefile)
                             goto cleanup;
                         }
 
+                        config_ruleinfo->fields[ifield]->id = FieldId_Add(config_ruleinfo->fields[ifield]->name);
                         ifield++;
                     } else if (strcasecmp(rule_opt[k]->element, xml_list) == 0) {
                         mdebug1("-> %s == %s", rule_opt[k]->element, xml_list);
@@ -1199,6 +1202,7 @@ int Rules_OP_ReadRules(const char *rulefile)
 
                             os_realloc(config_ruleinfo->same_fields, (size + 2) * sizeof(char *), config_ruleinfo->same_fields);
                             os_strdup(rule_opt[k]->content, config_ruleinfo->same_fields[size]);
+                            FieldId_Add(rule_opt[k]->content);
                             config_ruleinfo->same_fields[size + 1] = NULL;
 
                         } else {
@@ -1206,6 +1210,7 @@ int Rules_OP_ReadRules(const char *rulefile)
                             config_ruleinfo->same_field |= FIELD_DYNAMICS;
                             os_calloc(2, sizeof(char *), config_ruleinfo->same_fields);
                             os_strdup(rule_opt[k]->content, config_ruleinfo->same_fields[0]);
+                            FieldId_Add(rule_opt[k]->content);
                             config_ruleinfo->same_fields[1] = NULL;
 
                         }
@@ -1221,6 +1226,7 @@ int Rules_OP_ReadRules(const char *rulefile)
 
                             os_realloc(config_ruleinfo->not_same_fields, (size + 2) * sizeof(char *), config_ruleinfo->not_same_fields);
                             os_strdup(rule_opt[k]->content, config_ruleinfo->not_same_fields[size]);
+                            FieldId_Add(rule_opt[k]->content);
                             config_ruleinfo->not_same_fields[size + 1] = NULL;
 
                         } else {
@@ -1228,6 +1234,7 @@ int Rules_OP_ReadRules(const char *rulefile)
                             config_ruleinfo->different_field |= FIELD_DYNAMICS;
                             os_calloc(2, sizeof(char *), config_ruleinfo->not_same_fields);
                             os_strdup(rule_opt[k]->content, config_ruleinfo->not_same_fields[0]);
+                            FieldId_Add(rule_opt[k]->content);
                             config_ruleinfo->not_same_fields[1] = NULL;
 
                         }
@@ -1310,6 +1317,7 @@ int Rules_OP_ReadRules(const char *rulefile)
 
                                 config_ruleinfo->ignore |= FTS_DYNAMIC;
                                 config_ruleinfo->ignore_fields[i] = strdup(word);
+                                FieldId_Add(word);
                             }
 
                             free(*norder);
@@ -1358,6 +1366,7 @@ int Rules_OP_ReadRules(const char *rulefile)
 
                                 config_ruleinfo->ckignore |= FTS_DYNAMIC;
                                 config_ruleinfo->ckignore_fields[i] = strdup(word);
+                                FieldId_Add(word);
                             }
 
                             free(*norder);
@@ -1735,10 +1744,9 @@ int Rules_OP_ReadRules(const char *rulefile)
             /* Mark the rules that match if_matched_group */
             else if (config_ruleinfo->if_matched_group) {
                 /* Create list */
-                config_ruleinfo->group_search = OSList_Create();
-                if (!config_ruleinfo->group_search) {
-                    merror_exit(MEM_ERROR, errno, strerror(errno));
-                }
+                os_calloc(1, sizeof(EventList), config_ruleinfo->group_search);
+                OS_CreateEventList(Config.memorysize, config_ruleinfo->group_search);
+                OS_SetEventListTimeframe(config_ruleinfo->group_search, config_ruleinfo->timeframe);
 
                 /* Mark rules that match this group */
                 OS_MarkGroup(NULL, config_ruleinfo);
@@ -1909,9 +1917,7 @@ RuleInfo *zerorulemember(int id, int level,
     ruleinfo_pt->firedtimes = 0;
     ruleinfo_pt->maxsize = maxsize;
     ruleinfo_pt->frequency = frequency;
-    if (ruleinfo_pt->frequency > last_events_list->_max_freq) {
-        last_events_list->_max_freq = ruleinfo_pt->frequency;
-    }
+    OS_SetEventListTimeframe(last_events_list, timeframe);
     ruleinfo_pt->ignore_time = ignore_time;
     ruleinfo_pt->timeframe = timeframe;
     ruleinfo_pt->time_ignored = 0;
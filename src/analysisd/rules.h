@@ -91,6 +91,7 @@ typedef struct _RuleInfoDetail {
 typedef struct _FieldInfo {
     char *name;
     OSRegex *regex;
+    int id;         /* Interned name, see FieldId_Add() */
 } FieldInfo;
 
 typedef struct _RuleInfo {
@@ -126,20 +127,20 @@ typedef struct _RuleInfo {
     u_int16_t decoded_as;
 
     /* List of previously matched events */
-    OSList *sid_prev_matched;
+    struct EventList *sid_prev_matched;
 
     /* Pointer to a list (points to sid_prev_matched of if_matched_sid */
-    OSList *sid_search;
+    struct EventList *sid_search;
 
     /* List of previously matched events in this group.
      * Every rule that has if_matched_group will have this
      * list. Every rule that matches this group, it going to
      * have a pointer to it (group_search).
      */
-    OSList **group_prev_matched;
+    struct EventList **group_prev_matched;
 
     /* Pointer to group_prev_matched */
-    OSList *group_search;
+    struct EventList *group_search;
 
     /* Function pointer to the event_search */
     void *(*event_search)(void *lf, void *rule, void *rule_match);
@@ -201,6 +202,9 @@ typedef struct _RuleInfo {
     char ** not_same_fields;
 
     char ** mitre_id;
+
+    /* Position in the profiling counters, from 1 (0 if not profiled) */
+    unsigned int profile_id;
 } RuleInfo;
 
 
@@ -208,6 +212,7 @@ typedef struct _RuleNode {
     RuleInfo *ruleinfo;
     struct _RuleNode *next;
     struct _RuleNode *child;
+    struct rule_prefilter *prefilter;   /* Index of the children (may be NULL) */
 } RuleNode;
 
 
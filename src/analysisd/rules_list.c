@@ -10,6 +10,7 @@
 
 #include "shared.h"
 #include "rules.h"
+#include "config.h"
 #include "eventinfo.h"
 
 /* Rulenode local  */
@@ -344,13 +345,13 @@ int OS_MarkID(RuleNode *r_node, RuleInfo *orig_rule)
         if (r_node->ruleinfo->sigid == orig_rule->if_matched_sid) {
             /* If child does not have a list, create one */
             if (!r_node->ruleinfo->sid_prev_matched) {
-                r_node->ruleinfo->sid_prev_matched = OSList_Create();
-                if (!r_node->ruleinfo->sid_prev_matched) {
-                    merror_exit(MEM_ERROR, errno, strerror(errno));
-                }
-                //OSList_SetFreeDataPointer(r_node->ruleinfo->sid_prev_matched, (void (*)(void *)) Free_Eventinfo);
+                os_calloc(1, sizeof(EventList), r_node->ruleinfo->sid_prev_matched);
+                OS_CreateEventList(Config.memorysize, r_node->ruleinfo->sid_prev_matched);
             }
 
+            /* The list must cover the timeframe of every rule that searches it */
+            OS_SetEventListTimeframe(r_node->ruleinfo->sid_prev_matched, orig_rule->timeframe);
+
             /* Assign the parent pointer to it */
             orig_rule->sid_search = r_node->ruleinfo->sid_prev_matched;
         }
@@ -386,7 +387,7 @@ int OS_MarkGroup(RuleNode *r_node, RuleInfo *orig_rule)
             }
 
             os_realloc(r_node->ruleinfo->group_prev_matched,
-                       (rule_g + 2)*sizeof(OSList *),
+                       (rule_g + 2)*sizeof(EventList *),
                        r_node->ruleinfo->group_prev_matched);
 
             r_node->ruleinfo->group_prev_matched[rule_g] = NULL;
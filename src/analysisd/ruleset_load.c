@@ -0,0 +1,186 @@
+/*
+ * Parallel reading of the ruleset
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "rules.h"
+#include "ruleset_load.h"
+
+/* File parsed by a worker */
+typedef struct ruleset_xml_t {
+    char *path;
+    OS_XML xml;
+    int read;
+    int vars;
+} ruleset_xml_t;
+
+/* Work split among the threads: each one takes the next item until none is left */
+typedef struct ruleset_work_t {
+    void **items;
+    size_t count;
+    size_t next;
+    void (*run)(void *item);
+} ruleset_work_t;
+
+/* Files parsed and not taken yet, only used by the main thread */
+static OSHashOA *preloaded;
+
+static void *ruleset_worker(void *arg)
+{
+    ruleset_work_t *work = arg;
+    size_t i;
+
+    while (i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED), i < work->count) {
+        work->run(work->items[i]);
+    }
+
+    return NULL;
+}
+
+void Ruleset_Run(void **items, size_t count, void (*run)(void *item), int threads)
+{
+    ruleset_work_t work = { items, count, 0, run };
+    pthread_t *workers;
+    int started = 0;
+    int i;
+
+    if ((size_t)threads > count) {
+        threads = (int)count;
+    }
+
+    os_calloc(threads > 1 ? threads - 1 : 1, sizeof(pthread_t), workers);
+
+    for (i = 0; i < threads - 1; i++) {
+        if (CreateThreadJoinable(&workers[i], ruleset_worker, &work) < 0) {
+            break;
+        }
+
+        started++;
+    }
+
+    ruleset_worker(&work);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    os_free(workers);
+}
+
+void Ruleset_CacheInit(void)
+{
+    /* Parse snapshots are written here, skipping the XML parser on the next start */
+    if (mkdir(RULESET_CACHE, 0750) < 0 && errno != EEXIST) {
+        mdebug1(MKDIR_ERROR, RULESET_CACHE, errno, strerror(errno));
+    }
+}
+
+static void ruleset_parse(void *item)
+{
+    ruleset_xml_t *file = item;
+
+    if (file->read = OS_ReadXMLCached(file->path, &file->xml, RULESET_CACHE), file->read == 0) {
+        file->vars = OS_ApplyVariables(&file->xml);
+    }
+}
+
+static void ruleset_free_xml(void *data)
+{
+    ruleset_xml_t *file = data;
+
+    OS_ClearXML(&file->xml);
+    os_free(file->path);
+    os_free(file);
+}
+
+static void ruleset_add(ruleset_xml_t ***files, size_t *count, char *path)
+{
+    ruleset_xml_t *file;
+
+    os_calloc(1, sizeof(ruleset_xml_t), file);
+    file->path = path;
+
+    /* A file listed twice is read again by its second user */
+    if (OSHashOA_Add(preloaded, path, file) != 2) {
+        os_free(file->path);
+        os_free(file);
+        return;
+    }
+
+    os_realloc(*files, (*count + 1) * sizeof(ruleset_xml_t *), *files);
+    (*files)[(*count)++] = file;
+}
+
+void Ruleset_Preload(char **decoders, char **rules, int threads)
+{
+    ruleset_xml_t **files = NULL;
+    size_t count = 0;
+    char *path;
+    size_t size;
+
+    if (!preloaded) {
+        preloaded = OSHashOA_Create(0);
+        OSHashOA_SetFreeDataPointer(preloaded, ruleset_free_xml);
+    }
+
+    for (; decoders && *decoders; decoders++) {
+        os_strdup(*decoders, path);
+        ruleset_add(&files, &count, path);
+    }
+
+    /* Same path as Rules_OP_ReadRules() */
+    for (; rules && *rules; rules++) {
+        if (strchr(*rules, '/') == NULL) {
+            size = strlen(RULEPATH) + strlen(*rules) + 2;
+            os_malloc(size, path);
+            snprintf(path, size, "%s/%s", RULEPATH, *rules);
+        } else {
+            os_strdup(*rules, path);
+        }
+
+        ruleset_add(&files, &count, path);
+    }
+
+    if (count > 0) {
+        Ruleset_Run((void **)files, count, ruleset_parse, threads);
+        mdebug1("Ruleset files read: '%zu'", count);
+    }
+
+    os_free(files);
+}
+
+int Ruleset_ReadXML(const char *file, OS_XML *xml, int *vars)
+{
+    ruleset_xml_t *preload = preloaded ? OSHashOA_Delete(preloaded, file) : NULL;
+    int read;
+
+    if (preload) {
+        *xml = preload->xml;
+        *vars = preload->vars;
+        read = preload->read;
+        os_free(preload->path);
+        os_free(preload);
+        return read;
+    }
+
+    if (read = OS_ReadXMLCached(file, xml, RULESET_CACHE), read == 0) {
+        *vars = OS_ApplyVariables(xml);
+    }
+
+    return read;
+}
+
+void Ruleset_PreloadFree(void)
+{
+    if (preloaded) {
+        OSHashOA_Free(preloaded);
+        preloaded = NULL;
+    }
+}
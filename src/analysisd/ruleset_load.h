@@ -0,0 +1,65 @@
+/*
+ * Parallel reading of the ruleset
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef RULESET_LOAD_H
+#define RULESET_LOAD_H
+
+#include "os_xml/os_xml.h"
+
+/**
+ * @brief Create the directory of the parse snapshots of the ruleset files.
+ *
+ * Failing is not fatal: the files are parsed every time.
+ */
+void Ruleset_CacheInit(void);
+
+/**
+ * @brief Read and parse the decoder and rule files in parallel.
+ *
+ * The parsed files are kept until ReadDecodeXML() and Rules_OP_ReadRules()
+ * take them, so building the trees stays serial and in the configured order.
+ *
+ * @param decoders Decoder files, NULL-terminated. May be NULL.
+ * @param rules Rule files, NULL-terminated. Names with no directory are under RULEPATH. May be NULL.
+ * @param threads Number of worker threads.
+ */
+void Ruleset_Preload(char **decoders, char **rules, int threads);
+
+/**
+ * @brief Get a ruleset file parsed, with its variables applied.
+ *
+ * Takes the result of Ruleset_Preload() if the file was preloaded, or reads it.
+ *
+ * @param file Path of the file.
+ * @param xml Output: parsed file. Must be freed with OS_ClearXML().
+ * @param vars Output: result of OS_ApplyVariables(), only set on success.
+ * @return Result of OS_ReadXML().
+ */
+int Ruleset_ReadXML(const char *file, OS_XML *xml, int *vars);
+
+/**
+ * @brief Free the preloaded files that were not taken.
+ */
+void Ruleset_PreloadFree(void);
+
+/**
+ * @brief Run a function over a set of items, in parallel.
+ *
+ * The calling thread works too, and the function returns when every item is done.
+ *
+ * @param items Items.
+ * @param count Number of items.
+ * @param run Function, called once for each item.
+ * @param threads Number of threads, the calling one included.
+ */
+void Ruleset_Run(void **items, size_t count, void (*run)(void *item), int threads);
+
+#endif /* RULESET_LOAD_H */
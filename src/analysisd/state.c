@@ -11,6 +11,7 @@
 #include "shared.h"
 #include "analysisd.h"
 #include "state.h"
+#include "memory_budget.h"
 
 unsigned int s_events_syscheck_decoded = 0;
 unsigned int s_events_syscollector_decoded  = 0;
@@ -18,11 +19,11 @@ unsigned int s_events_rootcheck_decoded = 0;
 unsigned int s_events_sca_decoded = 0;
 unsigned int s_events_hostinfo_decoded  = 0;
 unsigned int s_events_winevt_decoded = 0;
-unsigned int s_messages_dbsync_dispatched;
+unsigned int s_messages_dbsync_dispatched = 0;
 unsigned int s_events_decoded = 0;
 unsigned int s_events_processed = 0;
 unsigned int s_events_dropped = 0 ;
-volatile unsigned int s_events_received = 0;
+unsigned int s_events_received = 0;
 unsigned int s_alerts_written  = 0;
 unsigned int s_firewall_written = 0;
 unsigned int s_fts_written = 0;
@@ -57,22 +58,62 @@ unsigned int s_writer_archives_queue_size = 0;
 unsigned int s_writer_firewall_queue_size = 0;
 unsigned int s_writer_statistical_queue_size = 0;
 
-pthread_mutex_t s_syscheck_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_syscollector_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_rootcheck_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_sca_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_hostinfo_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_winevt_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_event_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_process_event_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_event_dropped_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_alerts_written_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_firewall_written_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_fts_written_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t s_dbsync_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Peak number of queued items during the last interval */
+unsigned int s_syscheck_queue_peak = 0;
+unsigned int s_syscollector_queue_peak = 0;
+unsigned int s_rootcheck_queue_peak = 0;
+unsigned int s_sca_queue_peak = 0;
+unsigned int s_hostinfo_queue_peak = 0;
+unsigned int s_winevt_queue_peak = 0;
+unsigned int s_event_queue_peak = 0;
+unsigned int s_process_event_queue_peak = 0;
+unsigned int s_dbsync_message_queue_peak = 0;
+unsigned int s_writer_alerts_queue_peak = 0;
+unsigned int s_writer_archives_queue_peak = 0;
+unsigned int s_writer_firewall_queue_peak = 0;
+unsigned int s_writer_statistical_queue_peak = 0;
+
+/* Latency histograms: bucket i counts the samples below 2^i microseconds */
+static unsigned int s_stage_latency[W_STAGE_COUNT][W_LATENCY_BUCKETS];
+
+static const char * s_stage_names[W_STAGE_COUNT] = {
+    [W_STAGE_DECODING] = "decoding",
+    [W_STAGE_RULE_MATCHING] = "rule_matching",
+    [W_STAGE_ALERT_WRITING] = "alert_writing"
+};
+
+
+static const char * s_input_names[W_INPUT_COUNT] = {
+    [W_INPUT_SYSCHECK] = "syscheck",
+    [W_INPUT_SYSCOLLECTOR] = "syscollector",
+    [W_INPUT_ROOTCHECK] = "rootcheck",
+    [W_INPUT_SCA] = "sca",
+    [W_INPUT_HOSTINFO] = "hostinfo",
+    [W_INPUT_WINEVT] = "winevt",
+    [W_INPUT_DBSYNC] = "dbsync",
+    [W_INPUT_EVENT] = "event"
+};
+
+/* Metrics keep growing, while the counters above restart with every state update */
+static w_metric_t * m_events_received;
+static w_metric_t * m_events_decoded[W_INPUT_COUNT];
+static w_metric_t * m_events_processed;
+static w_metric_t * m_events_dropped[W_INPUT_COUNT];
+static w_metric_t * m_events_rejected[W_INPUT_COUNT];
+static w_metric_t * m_alerts_written;
+static w_metric_t * m_firewall_written;
+static w_metric_t * m_fts_written;
+static w_metric_t * m_stage_latency[W_STAGE_COUNT];
 
 static int interval;
 
+/* Counters are only touched with relaxed atomics: taking them doesn't need a lock */
+#define w_inc_counter(x) __atomic_add_fetch(&(x), 1, __ATOMIC_RELAXED)
+#define w_take_counter(x) __atomic_exchange_n(&(x), 0, __ATOMIC_RELAXED)
+
+static void w_write_latencies(FILE * fp);
+static void w_write_memory(FILE * fp);
+
 void * w_analysisd_state_main(){
     interval = getDefine_Int("analysisd", "state_interval", 0, 86400);
 
@@ -95,6 +136,20 @@ int w_analysisd_write_state(){
     FILE * fp;
     char path[PATH_MAX - 8];
     char path_temp[PATH_MAX + 1];
+    unsigned int syscheck_decoded;
+    unsigned int syscollector_decoded;
+    unsigned int rootcheck_decoded;
+    unsigned int sca_decoded;
+    unsigned int hostinfo_decoded;
+    unsigned int winevt_decoded;
+    unsigned int dbsync_dispatched;
+    unsigned int decoded;
+    unsigned int processed;
+    unsigned int received;
+    unsigned int dropped;
+    unsigned int alerts_written;
+    unsigned int firewall_written;
+    unsigned int fts_written;
 
     if (!strcmp(__local_name, "unset")) {
         merror("At write_state(): __local_name is unset.");
@@ -113,6 +168,22 @@ int w_analysisd_write_state(){
 
     w_get_queues_size();
 
+    /* Take the counters and restart them in one step, so that no increment is lost */
+    syscheck_decoded = w_take_counter(s_events_syscheck_decoded);
+    syscollector_decoded = w_take_counter(s_events_syscollector_decoded);
+    rootcheck_decoded = w_take_counter(s_events_rootcheck_decoded);
+    sca_decoded = w_take_counter(s_events_sca_decoded);
+    hostinfo_decoded = w_take_counter(s_events_hostinfo_decoded);
+    winevt_decoded = w_take_counter(s_events_winevt_decoded);
+    dbsync_dispatched = w_take_counter(s_messages_dbsync_dispatched);
+    decoded = w_take_counter(s_events_decoded);
+    processed = w_take_counter(s_events_processed);
+    received = w_take_counter(s_events_received);
+    dropped = w_take_counter(s_events_dropped);
+    alerts_written = w_take_counter(s_alerts_written);
+    firewall_written = w_take_counter(s_firewall_written);
+    fts_written = w_take_counter(s_fts_written);
+
     fprintf(fp,
         "# State file for %s\n"
         "\n"
@@ -176,129 +247,184 @@ int w_analysisd_write_state(){
         "# Syscheck queue size\n"
         "syscheck_queue_size='%u'\n"
         "\n"
+        "# Syscheck queue peak usage\n"
+        "syscheck_queue_peak='%u'\n"
+        "\n"
         "# Syscollector queue\n"
         "syscollector_queue_usage='%.2f'\n"
         "\n"
         "# Syscollector queue size\n"
         "syscollector_queue_size='%u'\n"
         "\n"
+        "# Syscollector queue peak usage\n"
+        "syscollector_queue_peak='%u'\n"
+        "\n"
         "# Rootcheck queue\n"
         "rootcheck_queue_usage='%.2f'\n"
         "\n"
         "# Rootcheck queue size\n"
         "rootcheck_queue_size='%u'\n"
         "\n"
+        "# Rootcheck queue peak usage\n"
+        "rootcheck_queue_peak='%u'\n"
+        "\n"
         "# Security configuration assessment queue\n"
         "sca_queue_usage='%.2f'\n"
         "\n"
         "# Security configuration assessment queue size\n"
         "sca_queue_size='%u'\n"
         "\n"
+        "# Security configuration assessment queue peak usage\n"
+        "sca_queue_peak='%u'\n"
+        "\n"
         "# Hostinfo queue\n"
         "hostinfo_queue_usage='%.2f'\n"
         "\n"
         "# Hostinfo queue size\n"
         "hostinfo_queue_size='%u'\n"
         "\n"
+        "# Hostinfo queue peak usage\n"
+        "hostinfo_queue_peak='%u'\n"
+        "\n"
         "# Winevt queue\n"
         "winevt_queue_usage='%.2f'\n"
         "\n"
         "# Winevt queue size\n"
         "winevt_queue_size='%u'\n"
         "\n"
+        "# Winevt queue peak usage\n"
+        "winevt_queue_peak='%u'\n"
+        "\n"
         "# Database synchronization message queue\n"
         "dbsync_queue_usage='%.2f'\n"
         "\n"
         "# Database synchronization message queue size\n"
         "dbsync_queue_size='%u'\n"
         "\n"
+        "# Database synchronization message queue peak usage\n"
+        "dbsync_queue_peak='%u'\n"
+        "\n"
         "# Event queue\n"
         "event_queue_usage='%.2f'\n"
         "\n"
         "# Event queue size\n"
         "event_queue_size='%u'\n"
         "\n"
+        "# Event queue peak usage\n"
+        "event_queue_peak='%u'\n"
+        "\n"
         "# Rule matching queue\n"
         "rule_matching_queue_usage='%.2f'\n"
         "\n"
         "# Rule matching queue size\n"
         "rule_matching_queue_size='%u'\n"
         "\n"
+        "# Rule matching queue peak usage\n"
+        "rule_matching_queue_peak='%u'\n"
+        "\n"
         "# Alerts log queue\n"
         "alerts_queue_usage='%.2f'\n"
         "\n"
         "# Alerts log queue size\n"
         "alerts_queue_size='%u'\n"
         "\n"
+        "# Alerts log queue peak usage\n"
+        "alerts_queue_peak='%u'\n"
+        "\n"
         "# Firewall log queue\n"
         "firewall_queue_usage='%.2f'\n"
         "\n"
         "# Firewall log queue size\n"
         "firewall_queue_size='%u'\n"
         "\n"
+        "# Firewall log queue peak usage\n"
+        "firewall_queue_peak='%u'\n"
+        "\n"
         "# Statistical log queue\n"
         "statistical_queue_usage='%.2f'\n"
         "\n"
         "# Statistical log queue size\n"
         "statistical_queue_size='%u'\n"
         "\n"
+        "# Statistical log queue peak usage\n"
+        "statistical_queue_peak='%u'\n"
+        "\n"
         "# Archives log queue\n"
         "archives_queue_usage='%.2f'\n"
         "\n"
         "# Archives log queue size\n"
         "archives_queue_size='%u'\n"
+        "\n"
+        "# Archives log queue peak usage\n"
+        "archives_queue_peak='%u'\n"
         "\n",
         __local_name,
-        s_events_decoded + s_events_syscheck_decoded + s_events_syscollector_decoded + s_events_rootcheck_decoded + s_events_hostinfo_decoded + s_events_winevt_decoded + s_events_sca_decoded,
-        s_events_syscheck_decoded,
-        s_events_syscheck_decoded / interval,
-        s_events_syscollector_decoded,
-        s_events_syscollector_decoded / interval,
-        s_events_rootcheck_decoded,
-        s_events_rootcheck_decoded / interval,
-        s_events_sca_decoded,
-        s_events_sca_decoded / interval,
-        s_events_hostinfo_decoded,
-        s_events_hostinfo_decoded / interval,
-        s_events_winevt_decoded,
-        s_events_winevt_decoded / interval,
-        s_messages_dbsync_dispatched, s_messages_dbsync_dispatched / interval,
-        s_events_decoded,
-        s_events_decoded / interval,
-        s_events_processed,
-        s_events_processed / interval,
-        s_events_received,
-        s_events_dropped,
-        s_alerts_written,
-        s_firewall_written,
-        s_fts_written,
+        decoded + syscheck_decoded + syscollector_decoded + rootcheck_decoded + hostinfo_decoded + winevt_decoded + sca_decoded,
+        syscheck_decoded,
+        syscheck_decoded / interval,
+        syscollector_decoded,
+        syscollector_decoded / interval,
+        rootcheck_decoded,
+        rootcheck_decoded / interval,
+        sca_decoded,
+        sca_decoded / interval,
+        hostinfo_decoded,
+        hostinfo_decoded / interval,
+        winevt_decoded,
+        winevt_decoded / interval,
+        dbsync_dispatched, dbsync_dispatched / interval,
+        decoded,
+        decoded / interval,
+        processed,
+        processed / interval,
+        received,
+        dropped,
+        alerts_written,
+        firewall_written,
+        fts_written,
         s_syscheck_queue,
         s_syscheck_queue_size,
+        s_syscheck_queue_peak,
         s_syscollector_queue,
         s_syscollector_queue_size,
+        s_syscollector_queue_peak,
         s_rootcheck_queue,
         s_rootcheck_queue_size,
+        s_rootcheck_queue_peak,
         s_sca_queue,
         s_sca_queue_size,
+        s_sca_queue_peak,
         s_hostinfo_queue,
         s_hostinfo_queue_size,
+        s_hostinfo_queue_peak,
         s_winevt_queue,
         s_winevt_queue_size,
-        s_dbsync_message_queue, s_dbsync_message_queue_size,
-        s_event_queue,s_event_queue_size,
+        s_winevt_queue_peak,
+        s_dbsync_message_queue,
+        s_dbsync_message_queue_size,
+        s_dbsync_message_queue_peak,
+        s_event_queue,
+        s_event_queue_size,
+        s_event_queue_peak,
         s_process_event_queue,
         s_process_event_queue_size,
+        s_process_event_queue_peak,
         s_writer_alerts_queue,
         s_writer_alerts_queue_size,
+        s_writer_alerts_queue_peak,
         s_writer_firewall_queue,
         s_writer_firewall_queue_size,
+        s_writer_firewall_queue_peak,
         s_writer_statistical_queue,
         s_writer_statistical_queue_size,
+        s_writer_statistical_queue_peak,
         s_writer_archives_queue,
-        s_writer_archives_queue_size);
-    fclose(fp);
+        s_writer_archives_queue_size,
+        s_writer_archives_queue_peak);
 
-    w_reset_stats();
+    w_write_memory(fp);
+    w_write_latencies(fp);
+    fclose(fp);
 
     if (rename(path_temp, path) < 0) {
         merror("Renaming %s to %s: %s", path_temp, path, strerror(errno));
@@ -312,135 +438,181 @@ int w_analysisd_write_state(){
 }
 
 void w_inc_syscheck_decoded_events(){
-    w_mutex_lock(&s_syscheck_mutex);
-    s_events_syscheck_decoded++;
-    w_mutex_unlock(&s_syscheck_mutex);
+    w_inc_counter(s_events_syscheck_decoded);
+    w_metrics_inc(m_events_decoded[W_INPUT_SYSCHECK]);
 }
 
 void w_inc_syscollector_decoded_events(){
-    w_mutex_lock(&s_syscollector_mutex);
-    s_events_syscollector_decoded++;
-    w_mutex_unlock(&s_syscollector_mutex);
+    w_inc_counter(s_events_syscollector_decoded);
+    w_metrics_inc(m_events_decoded[W_INPUT_SYSCOLLECTOR]);
 }
 
 void w_inc_rootcheck_decoded_events(){
-    w_mutex_lock(&s_rootcheck_mutex);
-    s_events_rootcheck_decoded++;
-    w_mutex_unlock(&s_rootcheck_mutex);
+    w_inc_counter(s_events_rootcheck_decoded);
+    w_metrics_inc(m_events_decoded[W_INPUT_ROOTCHECK]);
 }
 
 void w_inc_sca_decoded_events(){
-    w_mutex_lock(&s_sca_mutex);
-    s_events_sca_decoded++;
-    w_mutex_unlock(&s_sca_mutex);
+    w_inc_counter(s_events_sca_decoded);
+    w_metrics_inc(m_events_decoded[W_INPUT_SCA]);
 }
 
 void w_inc_hostinfo_decoded_events(){
-    w_mutex_lock(&s_hostinfo_mutex);
-    s_events_hostinfo_decoded++;
-    w_mutex_unlock(&s_hostinfo_mutex);
+    w_inc_counter(s_events_hostinfo_decoded);
+    w_metrics_inc(m_events_decoded[W_INPUT_HOSTINFO]);
 }
 
 void w_inc_winevt_decoded_events(){
-    w_mutex_lock(&s_winevt_mutex);
-    s_events_winevt_decoded++;
-    w_mutex_unlock(&s_winevt_mutex);
+    w_inc_counter(s_events_winevt_decoded);
+    w_metrics_inc(m_events_decoded[W_INPUT_WINEVT]);
 }
 
 void w_inc_dbsync_dispatched_messages() {
-    w_mutex_lock(&s_dbsync_mutex);
-    s_messages_dbsync_dispatched++;
-    w_mutex_unlock(&s_dbsync_mutex);
+    w_inc_counter(s_messages_dbsync_dispatched);
+    w_metrics_inc(m_events_decoded[W_INPUT_DBSYNC]);
 }
 
 void w_inc_decoded_events(){
-    w_mutex_lock(&s_event_mutex);
-    s_events_decoded++;
-    w_mutex_unlock(&s_event_mutex);
+    w_inc_counter(s_events_decoded);
+    w_metrics_inc(m_events_decoded[W_INPUT_EVENT]);
 }
 
 void w_inc_processed_events(){
-    w_mutex_lock(&s_process_event_mutex);
-    s_events_processed++;
-    w_mutex_unlock(&s_process_event_mutex);
+    w_inc_counter(s_events_processed);
+    w_metrics_inc(m_events_processed);
+}
+
+void w_inc_dropped_events(w_input_t input){
+    w_inc_counter(s_events_dropped);
+    w_metrics_inc(m_events_dropped[input]);
 }
 
-void w_inc_dropped_events(){
-    w_mutex_lock(&s_event_dropped_mutex);
-    s_events_dropped++;
-    w_mutex_unlock(&s_event_dropped_mutex);
+void w_inc_rejected_events(w_input_t input){
+    w_inc_counter(s_events_dropped);
+    w_metrics_inc(m_events_rejected[input]);
 }
 
 void w_inc_alerts_written(){
-    w_mutex_lock(&s_alerts_written_mutex);
-    s_alerts_written++;
-    w_mutex_unlock(&s_alerts_written_mutex);
+    w_inc_counter(s_alerts_written);
+    w_metrics_inc(m_alerts_written);
 }
 
 void w_inc_firewall_written(){
-    w_mutex_lock(&s_firewall_written_mutex);
-    s_firewall_written++;
-    w_mutex_unlock(&s_firewall_written_mutex);
+    w_inc_counter(s_firewall_written);
+    w_metrics_inc(m_firewall_written);
 }
 
 void w_inc_fts_written(){
-    w_mutex_lock(&s_fts_written_mutex);
-    s_fts_written++;
-    w_mutex_unlock(&s_fts_written_mutex);
+    w_inc_counter(s_fts_written);
+    w_metrics_inc(m_fts_written);
 }
 
 void w_reset_stats(){
-    w_mutex_lock(&s_syscheck_mutex);
-    s_events_syscheck_decoded = 0;
-    w_mutex_unlock(&s_syscheck_mutex);
+    w_take_counter(s_events_syscheck_decoded);
+    w_take_counter(s_events_syscollector_decoded);
+    w_take_counter(s_events_rootcheck_decoded);
+    w_take_counter(s_events_sca_decoded);
+    w_take_counter(s_events_hostinfo_decoded);
+    w_take_counter(s_events_winevt_decoded);
+    w_take_counter(s_messages_dbsync_dispatched);
+    w_take_counter(s_events_decoded);
+    w_take_counter(s_events_processed);
+    w_take_counter(s_events_dropped);
+    w_take_counter(s_alerts_written);
+    w_take_counter(s_firewall_written);
+    w_take_counter(s_fts_written);
+    w_take_counter(s_events_received);
+}
+
+void w_inc_received_events(){
+    w_inc_counter(s_events_received);
+    w_metrics_inc(m_events_received);
+}
+
+void w_add_stage_latency(w_stage_t stage, const struct timespec * start){
+    struct timespec now;
+    long long usec;
+    int bucket;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_nsec - start->tv_nsec) / 1000;
+
+    for (bucket = 0; bucket < W_LATENCY_BUCKETS - 1 && usec >= (1LL << bucket); bucket++);
+
+    w_inc_counter(s_stage_latency[stage][bucket]);
+    w_metrics_observe(m_stage_latency[stage], usec > 0 ? usec : 0);
+}
+
+void w_analysisd_metrics_init(){
+    char labels[OS_SIZE_128];
+    int i;
+
+    m_events_received = w_metrics_counter("wazuh_analysisd_events_received", "Events received.", NULL);
+    m_events_processed = w_metrics_counter("wazuh_analysisd_events_processed", "Events matched against the rules.", NULL);
+
+    for (i = 0; i < W_INPUT_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "input=\"%s\"", s_input_names[i]);
+        m_events_decoded[i] = w_metrics_counter("wazuh_analysisd_events_decoded", "Events decoded, by input.", labels);
+    }
+
+    for (i = 0; i < W_INPUT_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "input=\"%s\",reason=\"queue_full\"", s_input_names[i]);
+        m_events_dropped[i] = w_metrics_counter("wazuh_analysisd_events_dropped", "Events dropped, by input and reason.", labels);
+    }
 
-    w_mutex_lock(&s_syscollector_mutex);
-    s_events_syscollector_decoded = 0;
-    w_mutex_unlock(&s_syscollector_mutex);
+    for (i = 0; i < W_INPUT_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "input=\"%s\",reason=\"memory_budget\"", s_input_names[i]);
+        m_events_rejected[i] = w_metrics_counter("wazuh_analysisd_events_dropped", "Events dropped, by input and reason.", labels);
+    }
 
-    w_mutex_lock(&s_rootcheck_mutex);
-    s_events_rootcheck_decoded = 0;
-    w_mutex_unlock(&s_rootcheck_mutex);
+    m_alerts_written = w_metrics_counter("wazuh_analysisd_alerts_written", "Alerts written, by log.", "log=\"alerts\"");
+    m_firewall_written = w_metrics_counter("wazuh_analysisd_alerts_written", "Alerts written, by log.", "log=\"firewall\"");
+    m_fts_written = w_metrics_counter("wazuh_analysisd_alerts_written", "Alerts written, by log.", "log=\"fts\"");
 
-    w_mutex_lock(&s_sca_mutex);
-    s_events_sca_decoded = 0;
-    w_mutex_unlock(&s_sca_mutex);
+    for (i = 0; i < W_STAGE_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", s_stage_names[i]);
+        m_stage_latency[i] = w_metrics_histogram("wazuh_analysisd_stage_latency_seconds", "Time events spend in each stage.", labels);
+    }
+}
 
-    w_mutex_lock(&s_hostinfo_mutex);
-    s_events_hostinfo_decoded = 0;
-    w_mutex_unlock(&s_hostinfo_mutex);
+/* Print a line per stage with the bucket counts since the last state update */
+static void w_write_latencies(FILE * fp){
+    int stage;
+    int bucket;
 
-    w_mutex_lock(&s_winevt_mutex)
-    s_events_winevt_decoded = 0;
-    w_mutex_unlock(&s_winevt_mutex);
+    fprintf(fp, "# Latency histograms: number of events that took under 1, 2, 4 ... %d us, and above\n", 1 << (W_LATENCY_BUCKETS - 2));
 
-    w_mutex_lock(&s_dbsync_mutex)
-    s_messages_dbsync_dispatched = 0;
-    w_mutex_unlock(&s_dbsync_mutex);
+    for (stage = 0; stage < W_STAGE_COUNT; stage++) {
+        fprintf(fp, "%s_latency='", s_stage_names[stage]);
 
-    w_mutex_lock(&s_event_mutex);
-    s_events_decoded = 0;
-    w_mutex_unlock(&s_event_mutex);
+        for (bucket = 0; bucket < W_LATENCY_BUCKETS; bucket++) {
+            fprintf(fp, bucket ? ",%u" : "%u", w_take_counter(s_stage_latency[stage][bucket]));
+        }
 
-    w_mutex_lock(&s_process_event_mutex);
-    s_events_processed = 0;
-    w_mutex_unlock(&s_process_event_mutex);
+        fprintf(fp, "'\n");
+    }
 
-    w_mutex_lock(&s_event_dropped_mutex);
-    s_events_dropped = 0;
-    w_mutex_unlock(&s_event_dropped_mutex);
+    fprintf(fp, "\n");
+}
 
-    w_mutex_lock(&s_alerts_written_mutex);
-    s_alerts_written = 0;
-    w_mutex_unlock(&s_alerts_written_mutex);
+/* Print the memory accounted for each subsystem, and the degradation level */
+static void w_write_memory(FILE * fp){
+    int i;
 
-    w_mutex_lock(&s_firewall_written_mutex);
-    s_firewall_written = 0;
-    w_mutex_unlock(&s_firewall_written_mutex);
+    fprintf(fp, "# Memory accounted, in bytes, and budget (0: unlimited)\n");
 
-    w_mutex_lock(&s_fts_written_mutex);
-    s_fts_written = 0;
-    w_mutex_unlock(&s_fts_written_mutex);
+    for (i = 0; i < W_MEM_COUNT; i++) {
+        fprintf(fp, "memory_%s='%zu'\n", w_mem_subsystem_name(i), w_mem_used(i));
+    }
 
-    s_events_received = 0;
+    fprintf(fp,
+        "memory_total='%zu'\n"
+        "memory_budget='%zu'\n"
+        "\n"
+        "# Memory degradation level (normal, shrink, reject)\n"
+        "memory_level='%s'\n"
+        "\n",
+        w_mem_used(W_MEM_COUNT),
+        w_mem_budget(),
+        w_mem_level_name(w_mem_level()));
 }
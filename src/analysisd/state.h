@@ -12,6 +12,32 @@
 #ifndef STATE_A_H
 #define STATE_A_H
 
+#include <time.h>
+
+/* Number of buckets of the latency histograms */
+#define W_LATENCY_BUCKETS 20
+
+/* Pipeline stages whose latency is measured */
+typedef enum w_stage_t {
+    W_STAGE_DECODING,
+    W_STAGE_RULE_MATCHING,
+    W_STAGE_ALERT_WRITING,
+    W_STAGE_COUNT
+} w_stage_t;
+
+/* Kinds of input of analysisd, each with its queue */
+typedef enum w_input_t {
+    W_INPUT_SYSCHECK,
+    W_INPUT_SYSCOLLECTOR,
+    W_INPUT_ROOTCHECK,
+    W_INPUT_SCA,
+    W_INPUT_HOSTINFO,
+    W_INPUT_WINEVT,
+    W_INPUT_DBSYNC,
+    W_INPUT_EVENT,
+    W_INPUT_COUNT
+} w_input_t;
+
 extern unsigned int s_events_syscheck_decoded;
 extern unsigned int s_events_syscollector_decoded;
 extern unsigned int s_events_rootcheck_decoded;
@@ -19,7 +45,7 @@ extern unsigned int s_events_hostinfo_decoded;
 extern unsigned int s_events_decoded;
 extern unsigned int s_events_processed;
 extern unsigned int s_events_dropped;
-extern volatile unsigned int s_events_received;
+extern unsigned int s_events_received;
 extern unsigned int s_alerts_written;
 extern unsigned int s_firewall_written;
 extern unsigned int s_fts_written;
@@ -54,6 +80,20 @@ extern unsigned int s_writer_archives_queue_size;
 extern unsigned int s_writer_firewall_queue_size;
 extern unsigned int s_writer_statistical_queue_size;
 
+extern unsigned int s_syscheck_queue_peak;
+extern unsigned int s_syscollector_queue_peak;
+extern unsigned int s_rootcheck_queue_peak;
+extern unsigned int s_sca_queue_peak;
+extern unsigned int s_hostinfo_queue_peak;
+extern unsigned int s_winevt_queue_peak;
+extern unsigned int s_event_queue_peak;
+extern unsigned int s_process_event_queue_peak;
+extern unsigned int s_dbsync_message_queue_peak;
+extern unsigned int s_writer_alerts_queue_peak;
+extern unsigned int s_writer_archives_queue_peak;
+extern unsigned int s_writer_firewall_queue_peak;
+extern unsigned int s_writer_statistical_queue_peak;
+
 void * w_analysisd_state_main();
 int w_analysisd_write_state();
 
@@ -64,12 +104,27 @@ void w_inc_sca_decoded_events();
 void w_inc_hostinfo_decoded_events();
 void w_inc_decoded_events();
 void w_inc_processed_events();
-void w_inc_dropped_events();
+void w_inc_dropped_events(w_input_t input);
+void w_inc_rejected_events(w_input_t input);
 void w_inc_alerts_written();
 void w_inc_firewall_written();
 void w_inc_fts_written();
 void w_inc_winevt_decoded_events();
 void w_inc_dbsync_dispatched_messages();
+void w_inc_received_events();
 void w_reset_stats();
 
+/**
+ * @brief Register the metrics of analysisd. Call it before the counters are used.
+ */
+void w_analysisd_metrics_init();
+
+/**
+ * @brief Account the time an event spent in a stage of the pipeline.
+ *
+ * @param stage Stage.
+ * @param start Time (CLOCK_MONOTONIC) the event entered the stage.
+ */
+void w_add_stage_latency(w_stage_t stage, const struct timespec * start);
+
 #endif /* STATE_A_H */
@@ -29,10 +29,72 @@
 #include "fts.h"
 #include "cleanevent.h"
 #include "lists_make.h"
+#include "ruleset_load.h"
+#include "rule_prefilter.h"
+#include "rule_profile.h"
+#include "format/to_json.h"
+
+/* Phases of an event measured by the benchmark */
+typedef enum bench_phase_t {
+    BENCH_PREDECODING,
+    BENCH_DECODING,
+    BENCH_RULE_MATCHING,
+    BENCH_FORMATTING,
+    BENCH_PHASES
+} bench_phase_t;
+
+/* Results of a benchmark run, or read from a saved one */
+typedef struct bench_report_t {
+    size_t events;
+    size_t alerts;
+    double seconds;
+    double eps;
+    double phase_us[BENCH_PHASES];  /* Average time per event */
+    double p50_us;
+    double p99_us;
+    int *sids;                      /* Rule that classified each event, 0 if none */
+} bench_report_t;
+
+/* State of a benchmark thread */
+typedef struct bench_thread_t {
+    pthread_t thread;
+    int id;
+    size_t alerts;
+    uint64_t phase_ns[BENCH_PHASES];
+} bench_thread_t;
+
+static const char *bench_phase_names[BENCH_PHASES] = {
+    "predecoding", "decoding", "rule_matching", "formatting"
+};
+
+/* Corpus of the benchmark, shared by its threads */
+static struct {
+    char **lines;
+    size_t size;
+    size_t next;
+    uint64_t *latency;
+    int *sids;
+    unsigned int cost_top;          /* Rules of each list of the cost report, 0: no report */
+} bench;
 
 /** Internal Functions **/
 void OS_ReadMSG(char *ut_str);
 
+/* Read the logs to replay, one per line */
+static void bench_load(const char *path);
+
+/* Read the results saved by a previous run */
+static int bench_read_report(const char *path, bench_report_t *report);
+
+/* Replay the corpus on a number of threads and report the results */
+__attribute__((noreturn))
+static void bench_run(int threads, FILE *save, const bench_report_t *baseline);
+
+/* Print where the rule matching time of the benchmark went */
+static void bench_cost_print(void);
+
+void w_free_event_info(Eventinfo *lf);
+
 /* Analysisd function */
 RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node, regex_matching *rule_match);
 
@@ -50,6 +112,7 @@ static void help_logtest(void)
 {
     print_header();
     print_out("  %s: -[Vhdtva] [-c config] [-D dir] [-U rule:alert:decoder]", ARGV0);
+    print_out("               [-b corpus [-n threads] [-s results] [-S results] [-R top]]");
     print_out("    -V          Version and license message");
     print_out("    -h          This help message");
     print_out("    -d          Execute in debug mode. This parameter");
@@ -61,6 +124,14 @@ static void help_logtest(void)
     print_out("    -c <config> Configuration file to use (default: %s)", DEFAULTCPATH);
     print_out("    -D <dir>    Directory to chroot into (default: %s)", DEFAULTDIR);
     print_out("    -U <rule:alert:decoder>  Unit test. Refer to contrib/ossec-testing/runtests.py");
+    print_out("    -b <corpus> Benchmark: replay the logs in corpus, one per line");
+    print_out("    -n <threads> Threads of the benchmark (default: 1)");
+    print_out("    -s <file>   Save the benchmark results to file");
+    print_out("    -S <file>   Compare the benchmark results with the ones saved in file,");
+    print_out("                for instance with another ruleset");
+    print_out("    -R <top>    Report the cost of the ruleset over the benchmark: the top");
+    print_out("                rules evaluated and backtracking, branches never taken");
+    print_out("                and sibling rules worth reordering");
     print_out(" ");
     exit(1);
 }
@@ -78,6 +149,12 @@ int main(int argc, char **argv)
     gid_t gid;
     struct sigaction action = { .sa_handler = onsignal };
     int quiet = 0;
+    const char *bench_corpus = NULL;
+    const char *bench_save = NULL;
+    const char *bench_compare = NULL;
+    int bench_threads = 1;
+    FILE *bench_fp = NULL;
+    bench_report_t baseline = { .events = 0 };
     num_rule_matching_threads = 1;
     last_events_list = NULL;
 
@@ -97,7 +174,7 @@ int main(int argc, char **argv)
     geoipdb = NULL;
 #endif
 
-    while ((c = getopt(argc, argv, "VatvdhU:D:c:q")) != -1) {
+    while ((c = getopt(argc, argv, "VatvdhU:D:c:qb:n:s:S:R:")) != -1) {
         switch (c) {
             case 'V':
                 print_version();
@@ -138,6 +215,41 @@ int main(int argc, char **argv)
             case 'v':
                 full_output = 1;
                 break;
+            case 'b':
+                if (!optarg) {
+                    merror_exit("-b needs an argument");
+                }
+                bench_corpus = optarg;
+                break;
+            case 'n':
+                if (!optarg) {
+                    merror_exit("-n needs an argument");
+                }
+                if (bench_threads = atoi(optarg), bench_threads < 1 || bench_threads > 256) {
+                    merror_exit("Invalid number of threads: '%s'", optarg);
+                }
+                break;
+            case 's':
+                if (!optarg) {
+                    merror_exit("-s needs an argument");
+                }
+                bench_save = optarg;
+                break;
+            case 'S':
+                if (!optarg) {
+                    merror_exit("-S needs an argument");
+                }
+                bench_compare = optarg;
+                break;
+            case 'R':
+                if (!optarg) {
+                    merror_exit("-R needs an argument");
+                }
+                if (atoi(optarg) < 1) {
+                    merror_exit("Invalid number of rules: '%s'", optarg);
+                }
+                bench.cost_top = (unsigned int)atoi(optarg);
+                break;
             default:
                 help_logtest();
                 break;
@@ -151,13 +263,28 @@ int main(int argc, char **argv)
 
     mdebug1(READ_CONFIG);
 
+    /* The benchmark files are opened before chrooting */
+    if (bench_corpus) {
+        bench_load(bench_corpus);
+
+        if (bench_compare && bench_read_report(bench_compare, &baseline) < 0) {
+            merror_exit("Cannot read the benchmark results at '%s'", bench_compare);
+        }
+
+        if (bench_save && (bench_fp = fopen(bench_save, "w"), !bench_fp)) {
+            merror_exit(FOPEN_ERROR, bench_save, errno, strerror(errno));
+        }
+
+        alert_only = 1;
+        full_output = 0;
+    }
+
 #ifdef LIBGEOIP_ENABLED
     Config.geoip_jsonout = getDefine_Int("analysisd", "geoip_jsonout", 0, 1);
 
     /* Opening GeoIP DB */
     if(Config.geoipdb_file) {
-        geoipdb = GeoIP_open(Config.geoipdb_file, GEOIP_INDEX_CACHE);
-        if (geoipdb == NULL)
+        if (OpenGeoIP(Config.geoipdb_file) < 0)
         {
             merror("Unable to open GeoIP database from: %s (disabling GeoIP).", Config.geoipdb_file);
         }
@@ -199,6 +326,7 @@ int main(int argc, char **argv)
     nowChroot();
 
     Config.decoder_order_size = (size_t)getDefine_Int("analysisd", "decoder_order_size", MIN_ORDER_SIZE, MAX_DECODER_ORDER_SIZE);
+    OSRegex_SetDFA(getDefine_Int("analysisd", "regex_dfa", 0, 1));
 
     if (!last_events_list) {
         os_calloc(1, sizeof(EventList), last_events_list);
@@ -214,6 +342,8 @@ int main(int argc, char **argv)
      */
     {
         {
+            Ruleset_CacheInit();
+
             /* Load decoders */
             /* Initialize the decoders list */
             OS_CreateOSDecoderList();
@@ -289,7 +419,7 @@ int main(int argc, char **argv)
                 free(Config.lists);
                 Config.lists = NULL;
             }
-            Lists_OP_MakeAll(0, 0);
+            Lists_OP_MakeAll(0, 0, get_nproc());
         }
         {
             /* Load Rules */
@@ -332,6 +462,15 @@ int main(int argc, char **argv)
 
         total_rules = _setlevels(tmp_node, 0);
         mdebug1("Total rules enabled: '%d'", total_rules);
+
+        /* Index sibling rules so that matching only tries viable candidates */
+        mdebug1("Rule lists indexed: '%d'", OS_CompileRulePrefilters(tmp_node));
+
+        /* The cost report comes from the per-rule counters */
+        if (bench_corpus && bench.cost_top) {
+            rule_profile_enabled = 1;
+            mdebug1("Rule profiling enabled for %u rules.", rule_profile_init(tmp_node));
+        }
     }
 
     /* Creating a rules hash (for reading alerts from other servers) */
@@ -363,6 +502,10 @@ int main(int argc, char **argv)
     /* Start up message */
     minfo(STARTUP_MSG, (int)getpid());
 
+    if (bench_corpus) {
+        bench_run(bench_threads, bench_fp, bench_compare ? &baseline : NULL);
+    }
+
     /* Going to main loop */
     OS_ReadMSG(ut_str);
 
@@ -435,8 +578,7 @@ void OS_ReadMSG(char *ut_str)
 
     /* Daemon loop */
     while (1) {
-        os_calloc(1, sizeof(Eventinfo), lf);
-        os_calloc(Config.decoder_order_size, sizeof(DynamicField), lf->fields);
+        lf = Alloc_Eventinfo();
 
         /* Fix the msg */
         snprintf(msg, 15, "1:stdin:");
@@ -587,12 +729,7 @@ void OS_ReadMSG(char *ut_str)
 
                 /* Copy the structure to the state memory of if_matched_sid */
                 if (currently_rule->sid_prev_matched) {
-                    if (!OSList_AddData(currently_rule->sid_prev_matched, lf)) {
-                        merror("Unable to add data to sig list.");
-                    } else {
-                        lf->sid_node_to_delete =
-                            currently_rule->sid_prev_matched->last_node;
-                    }
+                    OS_AddEvent(Hold_Eventinfo(lf), currently_rule->sid_prev_matched);
                 }
 
                 /* Group list */
@@ -600,11 +737,7 @@ void OS_ReadMSG(char *ut_str)
                     unsigned int i = 0;
 
                     while (i < currently_rule->group_prev_matched_sz) {
-                        if (!OSList_AddData(
-                                    currently_rule->group_prev_matched[i],
-                                    lf)) {
-                            merror("Unable to add data to grp list.");
-                        }
+                        OS_AddEvent(Hold_Eventinfo(lf), currently_rule->group_prev_matched[i]);
                         i++;
                     }
                 }
@@ -660,6 +793,465 @@ void OS_ReadMSG(char *ut_str)
     exit(exit_code);
 }
 
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void bench_load(const char *path)
+{
+    char buffer[OS_MAXSTR + 1];
+    size_t allocated = 0;
+    size_t length;
+    FILE *fp;
+
+    if (fp = fopen(path, "r"), !fp) {
+        merror_exit(FOPEN_ERROR, path, errno, strerror(errno));
+    }
+
+    while (fgets(buffer, OS_MAXSTR - 8, fp)) {
+        length = strlen(buffer);
+
+        if (length > 0 && buffer[length - 1] == '\n') {
+            buffer[--length] = '\0';
+        }
+
+        /* Blank lines are ignored, as in the interactive mode */
+        if (length < 2) {
+            continue;
+        }
+
+        if (bench.size == allocated) {
+            allocated = allocated ? allocated * 2 : 1024;
+            os_realloc(bench.lines, allocated * sizeof(char *), bench.lines);
+        }
+
+        os_strdup(buffer, bench.lines[bench.size++]);
+    }
+
+    fclose(fp);
+
+    if (bench.size == 0) {
+        merror_exit("No logs found at '%s'", path);
+    }
+
+    os_calloc(bench.size, sizeof(uint64_t), bench.latency);
+    os_calloc(bench.size, sizeof(int), bench.sids);
+}
+
+int bench_read_report(const char *path, bench_report_t *report)
+{
+    char buffer[OS_SIZE_1024];
+    char key[OS_SIZE_128];
+    double value;
+    size_t i = 0;
+    int i_phase;
+    FILE *fp;
+
+    if (fp = fopen(path, "r"), !fp) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        if (report->sids) {
+            if (i < report->events) {
+                report->sids[i++] = atoi(buffer);
+            }
+            continue;
+        }
+
+        if (sscanf(buffer, "%127s %lf", key, &value) != 2) {
+            if (!strncmp(buffer, "sids", 4) && report->events > 0) {
+                os_calloc(report->events, sizeof(int), report->sids);
+            }
+            continue;
+        }
+
+        if (!strcmp(key, "events")) {
+            report->events = (size_t)value;
+        } else if (!strcmp(key, "alerts")) {
+            report->alerts = (size_t)value;
+        } else if (!strcmp(key, "seconds")) {
+            report->seconds = value;
+        } else if (!strcmp(key, "eps")) {
+            report->eps = value;
+        } else if (!strcmp(key, "p50_us")) {
+            report->p50_us = value;
+        } else if (!strcmp(key, "p99_us")) {
+            report->p99_us = value;
+        } else {
+            for (i_phase = 0; i_phase < BENCH_PHASES; i_phase++) {
+                char name[OS_SIZE_128];
+
+                snprintf(name, sizeof(name), "%s_us", bench_phase_names[i_phase]);
+
+                if (!strcmp(key, name)) {
+                    report->phase_us[i_phase] = value;
+                }
+            }
+        }
+    }
+
+    fclose(fp);
+    return report->events > 0 ? 0 : -1;
+}
+
+/* Run the rules over a decoded event, as the rule matching threads of
+ * analysisd do, and format the alert it generates. Stats, active responses
+ * and the firewall and archives logs are left out. Returns the rule that
+ * classified the event, if any.
+ */
+static RuleInfo *bench_match(Eventinfo *lf, bench_thread_t *thread, regex_matching *rule_match)
+{
+    RuleNode *rulenode_pt;
+    RuleInfo *rule = NULL;
+    uint64_t start;
+
+    for (rulenode_pt = OS_GetFirstRule(); rulenode_pt; rulenode_pt = rulenode_pt->next) {
+        if (lf->decoder_info->type == OSSEC_ALERT) {
+            if (!lf->generated_rule) {
+                break;
+            }
+
+            rule = lf->generated_rule;
+        } else if (rulenode_pt->ruleinfo->category != lf->decoder_info->type) {
+            continue;
+        } else if (rule = OS_CheckIfRuleMatch(lf, rulenode_pt, rule_match), !rule) {
+            continue;
+        }
+
+        /* Ignore level 0 */
+        if (rule->level == 0) {
+            break;
+        }
+
+        /* Check ignore time */
+        if (rule->ignore_time) {
+            if (rule->time_ignored == 0) {
+                rule->time_ignored = lf->generate_time;
+            } else if ((lf->generate_time - rule->time_ignored) < rule->ignore_time) {
+                if (rule->prev_rule) {
+                    rule = (RuleInfo *)rule->prev_rule;
+                    w_FreeArray(lf->last_events);
+                } else {
+                    break;
+                }
+            } else {
+                rule->time_ignored = lf->generate_time;
+            }
+        }
+
+        lf->generated_rule = rule;
+
+        if (rule->ckignore && IGnore(lf, thread->id)) {
+            lf->generated_rule = NULL;
+            break;
+        }
+
+        if (rule->ignore) {
+            AddtoIGnore(lf, thread->id);
+        }
+
+        /* Format the alert, as the alerts writer would */
+        if (rule->alert_opts & DO_LOGALERT) {
+            start = bench_now();
+            lf->comment = ParseRuleComment(lf);
+            Eventinfo_to_jsonbuf(lf, false);
+            thread->phase_ns[BENCH_FORMATTING] += bench_now() - start;
+            thread->alerts++;
+        }
+
+        if (rule->sid_prev_matched) {
+            OS_AddEvent(Hold_Eventinfo(lf), rule->sid_prev_matched);
+        } else if (rule->group_prev_matched) {
+            unsigned int j;
+
+            for (j = 0; j < rule->group_prev_matched_sz; j++) {
+                OS_AddEvent(Hold_Eventinfo(lf), rule->group_prev_matched[j]);
+            }
+        }
+
+        lf->queue_added = 1;
+        w_free_event_info(lf);
+        OS_AddEvent(lf, last_events_list);
+        return rule;
+    }
+
+    w_free_event_info(lf);
+    return rule;
+}
+
+static void *bench_thread_main(void *arg)
+{
+    bench_thread_t *thread = (bench_thread_t *)arg;
+    regex_matching decoder_match;
+    regex_matching rule_match;
+    Eventinfo *lf;
+    RuleInfo *rule;
+    uint64_t start;
+    uint64_t predecoded;
+    uint64_t decoded;
+    uint64_t formatting;
+    char *msg;
+    size_t i;
+
+    memset(&decoder_match, 0, sizeof(regex_matching));
+    memset(&rule_match, 0, sizeof(regex_matching));
+    os_malloc(OS_MAXSTR + 1, msg);
+
+    while (i = __atomic_fetch_add(&bench.next, 1, __ATOMIC_RELAXED), i < bench.size) {
+        snprintf(msg, OS_MAXSTR + 1, "1:stdin:%s", bench.lines[i]);
+
+        start = bench_now();
+        lf = Alloc_Eventinfo();
+        Zero_Eventinfo(lf);
+        lf->tid = thread->id;
+
+        if (OS_CleanMSG(msg, lf) < 0) {
+            merror(IMSG_ERROR, msg);
+            Free_Eventinfo(lf);
+            continue;
+        }
+
+        lf->size = strlen(lf->log);
+        predecoded = bench_now();
+        thread->phase_ns[BENCH_PREDECODING] += predecoded - start;
+
+        DecodeEvent(lf, &decoder_match);
+
+        if (lf->decoder_info->accumulate == 1) {
+            lf = Accumulate(lf);
+        }
+
+        decoded = bench_now();
+        thread->phase_ns[BENCH_DECODING] += decoded - predecoded;
+
+        formatting = thread->phase_ns[BENCH_FORMATTING];
+        rule = bench_match(lf, thread, &rule_match);
+        formatting = thread->phase_ns[BENCH_FORMATTING] - formatting;
+
+        bench.latency[i] = bench_now() - start;
+        bench.sids[i] = rule ? rule->sigid : 0;
+        thread->phase_ns[BENCH_RULE_MATCHING] += bench.latency[i] - (decoded - start) - formatting;
+    }
+
+    os_free(msg);
+    return NULL;
+}
+
+static int bench_compare_latency(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Print a figure of the results, and how it changed from the baseline */
+static void bench_print(const char *name, double value, const char *unit, const bench_report_t *baseline, double old)
+{
+    if (baseline && old > 0) {
+        print_out("  %-18s %12.2f %-8s (was %.2f, %+.1f%%)", name, value, unit, old, (value - old) * 100 / old);
+    } else {
+        print_out("  %-18s %12.2f %s", name, value, unit);
+    }
+}
+
+void bench_run(int threads, FILE *save, const bench_report_t *baseline)
+{
+    bench_thread_t *workers;
+    bench_report_t report = { .events = bench.size };
+    uint64_t *sorted;
+    uint64_t start;
+    size_t changed = 0;
+    size_t i;
+    int t;
+
+    /* Initiate the FTS list and the accumulator */
+    if (!FTS_Init(threads)) {
+        merror_exit(FTS_LIST_ERROR);
+    }
+
+    if (!Accumulate_Init()) {
+        merror_exit("accumulator: ERROR: Initialization failed");
+    }
+
+    __crt_ftell = 1;
+    c_time = time(NULL);
+
+    os_calloc(threads, sizeof(bench_thread_t), workers);
+    start = bench_now();
+
+    for (t = 0; t < threads; t++) {
+        workers[t].id = t;
+
+        if (CreateThreadJoinable(&workers[t].thread, bench_thread_main, &workers[t]) < 0) {
+            merror_exit(THREAD_ERROR);
+        }
+    }
+
+    for (t = 0; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    report.seconds = (double)(bench_now() - start) / 1e9;
+    report.eps = report.seconds > 0 ? report.events / report.seconds : 0;
+    report.sids = bench.sids;
+
+    for (t = 0; t < threads; t++) {
+        int phase;
+
+        report.alerts += workers[t].alerts;
+
+        for (phase = 0; phase < BENCH_PHASES; phase++) {
+            report.phase_us[phase] += (double)workers[t].phase_ns[phase] / 1e3 / report.events;
+        }
+    }
+
+    os_malloc(bench.size * sizeof(uint64_t), sorted);
+    memcpy(sorted, bench.latency, bench.size * sizeof(uint64_t));
+    qsort(sorted, bench.size, sizeof(uint64_t), bench_compare_latency);
+    report.p50_us = (double)sorted[(bench.size - 1) / 2] / 1e3;
+    report.p99_us = (double)sorted[(bench.size - 1) * 99 / 100] / 1e3;
+    os_free(sorted);
+
+    print_out("%s: Replayed %zu events on %d threads in %.3f seconds.", ARGV0, report.events, threads, report.seconds);
+    bench_print("Events per second", report.eps, "EPS", baseline, baseline ? baseline->eps : 0);
+    bench_print("Alerts", (double)report.alerts, "", baseline, baseline ? (double)baseline->alerts : 0);
+    bench_print("Pre-decoding", report.phase_us[BENCH_PREDECODING], "us/event", baseline, baseline ? baseline->phase_us[BENCH_PREDECODING] : 0);
+    bench_print("Decoding", report.phase_us[BENCH_DECODING], "us/event", baseline, baseline ? baseline->phase_us[BENCH_DECODING] : 0);
+    bench_print("Rule matching", report.phase_us[BENCH_RULE_MATCHING], "us/event", baseline, baseline ? baseline->phase_us[BENCH_RULE_MATCHING] : 0);
+    bench_print("Alert formatting", report.phase_us[BENCH_FORMATTING], "us/event", baseline, baseline ? baseline->phase_us[BENCH_FORMATTING] : 0);
+    bench_print("Latency p50", report.p50_us, "us", baseline, baseline ? baseline->p50_us : 0);
+    bench_print("Latency p99", report.p99_us, "us", baseline, baseline ? baseline->p99_us : 0);
+
+    /* Events classified by a different rule than in the baseline */
+    if (baseline && baseline->sids) {
+        if (baseline->events != report.events) {
+            print_out("\nThe baseline has %zu events: the rules can't be compared.", baseline->events);
+        } else {
+            for (i = 0; i < report.events; i++) {
+                if (baseline->sids[i] != report.sids[i]) {
+                    if (changed++ < 20) {
+                        print_out("  Event %zu: rule %d, was %d", i + 1, report.sids[i], baseline->sids[i]);
+                    }
+                }
+            }
+
+            print_out("\n%zu events changed of rule.", changed);
+        }
+    }
+
+    if (save) {
+        fprintf(save, "events %zu\n", report.events);
+        fprintf(save, "alerts %zu\n", report.alerts);
+        fprintf(save, "seconds %f\n", report.seconds);
+        fprintf(save, "eps %f\n", report.eps);
+
+        for (t = 0; t < BENCH_PHASES; t++) {
+            fprintf(save, "%s_us %f\n", bench_phase_names[t], report.phase_us[t]);
+        }
+
+        fprintf(save, "p50_us %f\n", report.p50_us);
+        fprintf(save, "p99_us %f\n", report.p99_us);
+        fprintf(save, "sids\n");
+
+        for (i = 0; i < report.events; i++) {
+            fprintf(save, "%d\n", report.sids[i]);
+        }
+
+        fclose(save);
+    }
+
+    if (bench.cost_top) {
+        bench_cost_print();
+    }
+
+    exit(0);
+}
+
+/* Print a list of rules of the cost report */
+static void bench_cost_rules(const cJSON *rules)
+{
+    const cJSON *rule;
+
+    print_out("  %10s %12s %10s %12s %12s %14s", "Rule", "Evaluations", "Matches", "ns/eval", "Regex ns", "Backtracks");
+
+    cJSON_ArrayForEach(rule, rules) {
+        double evaluations = cJSON_GetObjectItem(rule, "evaluations")->valuedouble;
+
+        print_out("  %10d %12.0f %10.0f %12.0f %12.0f %14.0f",
+                  cJSON_GetObjectItem(rule, "id")->valueint,
+                  evaluations,
+                  cJSON_GetObjectItem(rule, "matches")->valuedouble,
+                  evaluations > 0 ? cJSON_GetObjectItem(rule, "time_ns")->valuedouble / evaluations : 0,
+                  cJSON_GetObjectItem(rule, "regex_ns")->valuedouble,
+                  cJSON_GetObjectItem(rule, "regex_backtracks")->valuedouble);
+    }
+}
+
+/* Print a list of rule IDs in lines of ten */
+static void bench_cost_ids(const char *prefix, const cJSON *ids)
+{
+    char line[OS_SIZE_1024];
+    const cJSON *id;
+    size_t length = 0;
+    int n = 0;
+
+    cJSON_ArrayForEach(id, ids) {
+        length += snprintf(line + length, sizeof(line) - length, " %d", id->valueint);
+
+        if (++n % 10 == 0 || !id->next) {
+            print_out("  %s%s", prefix, line);
+            length = 0;
+        }
+    }
+}
+
+void bench_cost_print(void)
+{
+    const cJSON *item;
+    cJSON *report;
+
+    if (report = rule_profile_cost_report(OS_GetFirstRule(), bench.cost_top), !report) {
+        return;
+    }
+
+    print_out("\nMost evaluated rules:");
+    bench_cost_rules(cJSON_GetObjectItem(report, "evaluated"));
+
+    print_out("\nRules whose regex backtracks the most:");
+    bench_cost_rules(cJSON_GetObjectItem(report, "backtracking"));
+
+    print_out("\nChild rules evaluated but never matched (%d):", cJSON_GetObjectItem(report, "total_never_matched")->valueint);
+    bench_cost_rules(cJSON_GetObjectItem(report, "never_matched"));
+
+    print_out("\nChild rules never evaluated, as their parents never matched (%d):", cJSON_GetObjectItem(report, "total_never_reached")->valueint);
+    bench_cost_ids("", cJSON_GetObjectItem(report, "never_reached"));
+
+    print_out("\nSibling rules that would check less sorted by matches.");
+    print_out("The first sibling that matches wins: make sure they don't overlap before reordering.");
+
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(report, "reorder")) {
+        int parent = cJSON_GetObjectItem(item, "parent")->valueint;
+
+        if (parent) {
+            print_out("\n  Children of rule %d (%.0f checks saved):", parent, cJSON_GetObjectItem(item, "checks_saved")->valuedouble);
+        } else {
+            print_out("\n  Top-level rules (%.0f checks saved):", cJSON_GetObjectItem(item, "checks_saved")->valuedouble);
+        }
+
+        bench_cost_ids("current:  ", cJSON_GetObjectItem(item, "current"));
+        bench_cost_ids("suggested:", cJSON_GetObjectItem(item, "suggested"));
+    }
+
+    cJSON_Delete(report);
+}
+
 // Cleanup at exit
 void onexit() {
     char testdir[PATH_MAX + 1];
@@ -0,0 +1,204 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+/* Microbenchmark harness.
+ *
+ * Every result is printed as a line of JSON, so that runs of different
+ * releases can be stored and compared by scripts. The workloads are fixed
+ * and the pseudo-random data comes from a fixed seed, so two runs on the
+ * same host do the same work. BENCH_SCALE multiplies the iterations.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SEED          0x5eed1234U
+#define BENCH_MAX_THREADS   64
+
+/* Thread counts of the contention benchmarks */
+static const unsigned int bench_threads[] __attribute__((unused)) = { 1, 2, 4, 8 };
+#define BENCH_THREAD_STEPS (sizeof(bench_threads) / sizeof(bench_threads[0]))
+
+typedef void (*bench_func)(void *arg, unsigned int thread, unsigned int threads);
+
+typedef struct bench_job {
+    bench_func func;
+    void *arg;
+    unsigned int thread;
+    unsigned int threads;
+    pthread_barrier_t *barrier;
+} bench_job;
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Iterations of a benchmark, scaled by BENCH_SCALE */
+static inline uint64_t bench_iterations(uint64_t n)
+{
+    const char *scale = getenv("BENCH_SCALE");
+    double factor = scale ? atof(scale) : 1;
+    uint64_t scaled = factor > 0 ? (uint64_t)(n * factor) : n;
+
+    return scaled > 0 ? scaled : 1;
+}
+
+/* Reproducible pseudo-random numbers (xorshift32) */
+static inline uint32_t bench_random(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Print a result: operations done in ns nanoseconds */
+static inline void bench_report(const char *suite, const char *name, unsigned int threads, uint64_t operations, uint64_t ns)
+{
+    printf("{\"suite\":\"%s\",\"benchmark\":\"%s\",\"threads\":%u,\"operations\":%llu,\"ns\":%llu,\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f}\n",
+           suite, name, threads, (unsigned long long)operations, (unsigned long long)ns,
+           operations ? (double)ns / operations : 0, ns ? operations * 1e9 / ns : 0);
+    fflush(stdout);
+}
+
+static inline void *bench_thread_main(void *arg)
+{
+    bench_job *job = (bench_job *)arg;
+
+    pthread_barrier_wait(job->barrier);
+    job->func(job->arg, job->thread, job->threads);
+    return NULL;
+}
+
+/* Run func on a number of threads, released at once. Returns the elapsed
+ * nanoseconds, from the release to the end of the last thread.
+ */
+static inline uint64_t bench_run_threads(unsigned int threads, bench_func func, void *arg)
+{
+    pthread_t tids[BENCH_MAX_THREADS];
+    bench_job jobs[BENCH_MAX_THREADS];
+    pthread_barrier_t barrier;
+    uint64_t start;
+    unsigned int i;
+
+    if (threads > BENCH_MAX_THREADS) {
+        threads = BENCH_MAX_THREADS;
+    }
+
+    pthread_barrier_init(&barrier, NULL, threads + 1);
+
+    for (i = 0; i < threads; i++) {
+        jobs[i] = (bench_job){ func, arg, i, threads, &barrier };
+
+        if (pthread_create(&tids[i], NULL, bench_thread_main, &jobs[i]) != 0) {
+            fprintf(stderr, "Cannot create benchmark thread.\n");
+            exit(1);
+        }
+    }
+
+    start = bench_now();
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    pthread_barrier_destroy(&barrier);
+    return bench_now() - start;
+}
+
+/* Sample of real log lines, used when BENCH_CORPUS is not set */
+static const char *bench_sample_logs[] __attribute__((unused)) = {
+    "Oct 15 10:12:01 web01 sshd[2245]: Failed password for invalid user admin from 192.168.1.15 port 51234 ssh2",
+    "Oct 15 10:12:03 web01 sshd[2245]: Accepted publickey for deploy from 10.0.0.12 port 40022 ssh2: RSA SHA256:9Zx1",
+    "Oct 15 10:12:05 web01 sudo:   deploy : TTY=pts/0 ; PWD=/home/deploy ; USER=root ; COMMAND=/usr/bin/systemctl restart nginx",
+    "Oct 15 10:12:07 web01 sshd[2301]: pam_unix(sshd:auth): authentication failure; logname= uid=0 euid=0 tty=ssh ruser= rhost=203.0.113.7  user=root",
+    "192.168.1.20 - - [15/Oct/2020:10:12:09 +0000] \"GET /index.php?id=1%27%20OR%201=1 HTTP/1.1\" 200 5120 \"-\" \"Mozilla/5.0 (X11; Linux x86_64)\"",
+    "10.0.0.5 - - [15/Oct/2020:10:12:10 +0000] \"POST /wp-login.php HTTP/1.1\" 401 234 \"-\" \"curl/7.68.0\"",
+    "Oct 15 10:12:11 fw01 kernel: [UFW BLOCK] IN=eth0 OUT= MAC=00:00:00:00:00:00 SRC=198.51.100.23 DST=10.0.0.1 LEN=60 PROTO=TCP SPT=44321 DPT=22 WINDOW=29200 SYN",
+    "Oct 15 10:12:13 db01 postgres[901]: [3-1] FATAL:  password authentication failed for user \"app\"",
+    "Oct 15 10:12:15 web01 systemd[1]: Started Session 42 of user deploy.",
+    "Oct 15 10:12:17 mail01 postfix/smtpd[3312]: NOQUEUE: reject: RCPT from unknown[203.0.113.99]: 554 5.7.1 Relay access denied",
+    "{\"win\":{\"system\":{\"providerName\":\"Microsoft-Windows-Security-Auditing\",\"eventID\":\"4625\",\"computer\":\"DC01\"},\"eventdata\":{\"targetUserName\":\"Administrator\",\"ipAddress\":\"192.168.1.44\"}}}",
+    "Oct 15 10:12:19 web01 nginx: 2020/10/15 10:12:19 [error] 1234#0: *56 open() \"/var/www/html/.env\" failed (2: No such file or directory)",
+    "Oct 15 10:12:21 ids01 suricata[812]: [1:2013028:4] ET POLICY curl User-Agent Outbound [Classification: Attempted Information Leak] [Priority: 2] {TCP} 10.0.0.8:51514 -> 93.184.216.34:80",
+    "Oct 15 10:12:23 web01 auditd[511]: type=SYSCALL msg=audit(1602756743.123:9012): arch=c000003e syscall=59 success=yes exit=0 a0=55d0 a1=55d1 items=2 ppid=2210 pid=2299 auid=1000 uid=0 comm=\"bash\" exe=\"/usr/bin/bash\"",
+    "Oct 15 10:12:25 web01 CRON[3390]: (root) CMD (/usr/lib/php/sessionclean)",
+    "Oct 15 10:12:27 vpn01 openvpn[1201]: 203.0.113.50:1194 TLS Error: TLS handshake failed",
+    NULL
+};
+
+/* Load the log corpus: the file at BENCH_CORPUS, or the sample. The lines
+ * are returned NULL-terminated and their number is stored in count.
+ */
+static inline char **bench_corpus(size_t *count)
+{
+    const char *path = getenv("BENCH_CORPUS");
+    char buffer[65536];
+    char **lines = NULL;
+    size_t size = 0;
+    size_t n = 0;
+    FILE *fp;
+
+    if (!path || !(fp = fopen(path, "r"))) {
+        if (path) {
+            fprintf(stderr, "Cannot open '%s', using the sample logs.\n", path);
+        }
+
+        for (n = 0; bench_sample_logs[n]; n++);
+        *count = n;
+        return (char **)bench_sample_logs;
+    }
+
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        size_t length = strcspn(buffer, "\r\n");
+
+        if (length == 0) {
+            continue;
+        }
+
+        buffer[length] = '\0';
+
+        if (n + 1 >= size) {
+            size = size ? size * 2 : 1024;
+
+            if (lines = (char **)realloc(lines, size * sizeof(char *)), !lines) {
+                fprintf(stderr, "Cannot allocate the corpus.\n");
+                exit(1);
+            }
+        }
+
+        lines[n++] = strdup(buffer);
+    }
+
+    fclose(fp);
+
+    if (n == 0) {
+        fprintf(stderr, "No logs at '%s'.\n", path);
+        exit(1);
+    }
+
+    lines[n] = NULL;
+    *count = n;
+    return lines;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,117 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+/* CDB lists lookups */
+
+#include "shared.h"
+#include "../analysisd/cdb/cdb.h"
+#include "../analysisd/cdb/cdb_make.h"
+#include "bench.h"
+
+#define SUITE "cdb"
+
+typedef struct cdb_bench {
+    struct cdb db;
+    char **keys;
+    uint64_t nkeys;
+    uint64_t iterations;
+} cdb_bench;
+
+/* Every other lookup is for a key that isn't in the list */
+static void bench_cdb_lookup(void *arg, unsigned int thread, unsigned int threads)
+{
+    cdb_bench *b = (cdb_bench *)arg;
+    uint32_t state = BENCH_SEED + thread;
+    char missing[32];
+    uint32 dpos;
+    uint32 dlen;
+    uint64_t i;
+
+    for (i = thread; i < b->iterations; i += threads) {
+        const char *key = b->keys[bench_random(&state) % b->nkeys];
+
+        if (i & 1) {
+            snprintf(missing, sizeof(missing), "x%s", key);
+            key = missing;
+        }
+
+        cdb_lookup(&b->db, key, strlen(key), &dpos, &dlen);
+    }
+}
+
+int main(void)
+{
+    cdb_bench b;
+    struct cdb_make cdbm;
+    char path[] = "/tmp/bench_cdb.XXXXXX";
+    char value[32];
+    uint32_t state = BENCH_SEED;
+    uint64_t start;
+    uint64_t ns;
+    uint64_t i;
+    size_t t;
+    FILE *fp;
+    int fd;
+
+    memset(&b, 0, sizeof(b));
+    b.nkeys = bench_iterations(100000);
+    b.iterations = bench_iterations(1000000);
+    os_calloc(b.nkeys, sizeof(char *), b.keys);
+
+    for (i = 0; i < b.nkeys; i++) {
+        os_calloc(32, sizeof(char), b.keys[i]);
+        snprintf(b.keys[i], 32, "%u.%u.%u.%u", bench_random(&state) % 256, bench_random(&state) % 256,
+                 bench_random(&state) % 256, (unsigned int)(i % 256));
+    }
+
+    if (fd = mkstemp(path), fd < 0 || !(fp = fdopen(fd, "w+"))) {
+        fprintf(stderr, "Cannot create '%s'.\n", path);
+        return 1;
+    }
+
+    start = bench_now();
+    cdb_make_start(&cdbm, fp);
+
+    for (i = 0; i < b.nkeys; i++) {
+        snprintf(value, sizeof(value), "value-%llu", (unsigned long long)i);
+        cdb_make_add(&cdbm, b.keys[i], strlen(b.keys[i]), value, strlen(value));
+    }
+
+    if (cdb_make_finish(&cdbm) != 0) {
+        fprintf(stderr, "Cannot write '%s'.\n", path);
+        return 1;
+    }
+
+    bench_report(SUITE, "cdb_make_add", 1, b.nkeys, bench_now() - start);
+
+    cdb_init(&b.db, fd);
+
+    /* cdb_find keeps a cursor in the cdb, so it's single-threaded */
+    start = bench_now();
+    for (i = 0; i < b.iterations; i++) {
+        char *key = b.keys[bench_random(&state) % b.nkeys];
+        cdb_find(&b.db, key, strlen(key));
+    }
+    bench_report(SUITE, "cdb_find", 1, b.iterations, bench_now() - start);
+
+    for (t = 0; t < BENCH_THREAD_STEPS; t++) {
+        ns = bench_run_threads(bench_threads[t], bench_cdb_lookup, &b);
+        bench_report(SUITE, "cdb_lookup", bench_threads[t], b.iterations, ns);
+    }
+
+    cdb_free(&b.db);
+    fclose(fp);
+    unlink(path);
+
+    for (i = 0; i < b.nkeys; i++) {
+        free(b.keys[i]);
+    }
+
+    free(b.keys);
+    return 0;
+}
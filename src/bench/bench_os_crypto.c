@@ -0,0 +1,119 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+/* Secure messages between agents and manager */
+
+#include "shared.h"
+#include "sec.h"
+#include "bench.h"
+
+#define SUITE "os_crypto"
+
+/* Keystore with one agent and the sender entry. The counters are kept in
+ * memory instead of the counter table.
+ */
+static void bench_keystore(keystore *keys)
+{
+    keystore empty = KEYSTORE_INITIALIZER;
+
+    *keys = empty;
+    keys->keyhash_id = OSHash_Create();
+    keys->keyhash_ip = OSHash_Create();
+    keys->keyhash_name = OSHash_Create();
+
+    if (!keys->keyhash_id || !keys->keyhash_ip || !keys->keyhash_name) {
+        fprintf(stderr, "Cannot create the keystore.\n");
+        exit(1);
+    }
+
+    OS_AddKey(keys, "001", "bench", "any", "8e3a5c9f0b1d2e4f6a7b8c9d0e1f2a3b4c5d6e7f8091a2b3c4d5e6f708192a3b");
+
+    os_calloc(1, sizeof(keyentry), keys->keyentries[keys->keysize]);
+    w_mutex_init(&keys->keyentries[keys->keysize]->mutex, NULL);
+
+    keys->keyentries[0]->counter = &keys->keyentries[0]->counter_mem;
+    keys->keyentries[keys->keysize]->counter = &keys->keyentries[keys->keysize]->counter_mem;
+}
+
+/* Messages created before reading them, since the counters must grow */
+#define SECMSG_WINDOW 64
+
+/* Encrypt lines of the corpus and decrypt them back */
+static int bench_secmsg(keystore *keys, const char *name, crypt_method method, char **lines, size_t count, uint64_t iterations)
+{
+    char benchmark[OS_SIZE_128];
+    char cleartext[OS_MAXSTR + 1];
+    char *messages[SECMSG_WINDOW];
+    size_t lengths[SECMSG_WINDOW];
+    char *output;
+    size_t final_size;
+    uint64_t start;
+    uint64_t create_ns = 0;
+    uint64_t read_ns = 0;
+    uint64_t i;
+    size_t n;
+
+    os_set_agent_crypto_method(keys, method);
+
+    for (n = 0; n < SECMSG_WINDOW; n++) {
+        os_malloc(OS_MAXSTR + 1, messages[n]);
+    }
+
+    iterations = ((iterations + SECMSG_WINDOW - 1) / SECMSG_WINDOW) * SECMSG_WINDOW;
+
+    for (i = 0; i < iterations; i += SECMSG_WINDOW) {
+        start = bench_now();
+        for (n = 0; n < SECMSG_WINDOW; n++) {
+            const char *line = lines[(i + n) % count];
+            lengths[n] = CreateSecMSG(keys, line, strlen(line), messages[n], 0);
+        }
+        create_ns += bench_now() - start;
+
+        /* The receive buffer is reused to uncompress the message */
+        start = bench_now();
+        for (n = 0; n < SECMSG_WINDOW; n++) {
+            if (ReadSecMSG(keys, messages[n], cleartext, 0, lengths[n] - 1, &final_size, "127.0.0.1", &output) != KS_VALID) {
+                fprintf(stderr, "Cannot read the message of '%s'.\n", name);
+                return -1;
+            }
+        }
+        read_ns += bench_now() - start;
+    }
+
+    snprintf(benchmark, sizeof(benchmark), "createsecmsg_%s", name);
+    bench_report(SUITE, benchmark, 1, iterations, create_ns);
+    snprintf(benchmark, sizeof(benchmark), "readsecmsg_%s", name);
+    bench_report(SUITE, benchmark, 1, iterations, read_ns);
+
+    for (n = 0; n < SECMSG_WINDOW; n++) {
+        os_free(messages[n]);
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    keystore keys;
+    char **lines;
+    size_t count;
+    uint64_t iterations = bench_iterations(50000);
+
+    OS_SetName("bench_os_crypto");
+    lines = bench_corpus(&count);
+    bench_keystore(&keys);
+
+    if (bench_secmsg(&keys, "aes", W_METH_AES, lines, count, iterations) < 0 ||
+        bench_secmsg(&keys, "aes_gcm", W_METH_AES_GCM, lines, count, iterations) < 0 ||
+        bench_secmsg(&keys, "blowfish", W_METH_BLOWFISH, lines, count, iterations) < 0) {
+        return 1;
+    }
+
+    OS_FreeKeys(&keys);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+/* OSRegex, OSMatch and OSMultiMatch over a log corpus */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../os_regex/os_regex.h"
+#include "bench.h"
+
+#define SUITE "os_regex"
+
+/* Patterns like the ones of the default ruleset */
+static const char *regex_patterns[] = {
+    "^Failed \\S+ for invalid user (\\S+) from (\\S+) port (\\d+)",
+    "^Accepted \\S+ for (\\S+) from (\\S+) port (\\d+)",
+    "rhost=(\\S+)\\s+user=(\\S+)",
+    "SRC=(\\S+) DST=(\\S+) LEN=\\d+ \\S+ \\S+ PROTO=(\\w+) SPT=(\\d+) DPT=(\\d+)",
+    "^(\\S+) \\S+ \\S+ [\\S+ \\S+] \"(\\w+) (\\S+) HTTP\\S+\" (\\d+) ",
+    "USER=(\\S+) ; COMMAND=(\\S+)",
+    NULL
+};
+
+static const char *match_patterns[] = {
+    "Failed password|authentication failure|Invalid user",
+    "^Accepted |session opened",
+    "Relay access denied|NOQUEUE: reject",
+    "TLS Error|TLS handshake failed",
+    "FATAL:  password authentication failed",
+    "[UFW BLOCK]|[UFW AUDIT]",
+    NULL
+};
+
+typedef struct regex_bench {
+    char **lines;
+    size_t count;
+    uint64_t iterations;
+    OSRegex *regex;
+    OSMatch *match;
+    OSMultiMatch *multi;
+    size_t patterns;
+} regex_bench;
+
+static void bench_regex(void *arg, unsigned int thread, unsigned int threads)
+{
+    regex_bench *b = (regex_bench *)arg;
+    regex_matching matching;
+    uint64_t i;
+    size_t p;
+
+    memset(&matching, 0, sizeof(regex_matching));
+
+    for (i = thread; i < b->iterations; i += threads) {
+        const char *line = b->lines[i % b->count];
+
+        for (p = 0; p < b->patterns; p++) {
+            OSRegex_Execute_ex(line, &b->regex[p], &matching);
+        }
+    }
+
+    OSRegex_free_regex_matching(&matching);
+}
+
+static void bench_match(void *arg, unsigned int thread, unsigned int threads)
+{
+    regex_bench *b = (regex_bench *)arg;
+    uint64_t i;
+    size_t p;
+
+    for (i = thread; i < b->iterations; i += threads) {
+        const char *line = b->lines[i % b->count];
+        size_t length = strlen(line);
+
+        for (p = 0; p < b->patterns; p++) {
+            OSMatch_Execute(line, length, &b->match[p]);
+        }
+    }
+}
+
+static void bench_multi_match(void *arg, unsigned int thread, unsigned int threads)
+{
+    regex_bench *b = (regex_bench *)arg;
+    uint64_t found;
+    uint64_t i;
+
+    for (i = thread; i < b->iterations; i += threads) {
+        const char *line = b->lines[i % b->count];
+
+        found = 0;
+        OSMultiMatch_Execute(line, strlen(line), b->multi, &found);
+    }
+}
+
+int main(void)
+{
+    regex_bench b;
+    OSRegex regex[sizeof(regex_patterns) / sizeof(char *)];
+    OSMatch match[sizeof(match_patterns) / sizeof(char *)];
+    OSMultiMatch multi;
+    uint64_t ns;
+    size_t p;
+    size_t t;
+
+    memset(&b, 0, sizeof(b));
+    b.lines = bench_corpus(&b.count);
+    b.iterations = bench_iterations(200000);
+    b.regex = regex;
+    b.match = match;
+    b.multi = &multi;
+
+    OSMultiMatch_Init(&multi);
+
+    for (p = 0; regex_patterns[p]; p++) {
+        if (!OSRegex_Compile(regex_patterns[p], &regex[p], OS_RETURN_SUBSTRING)) {
+            fprintf(stderr, "Cannot compile regex '%s'.\n", regex_patterns[p]);
+            return 1;
+        }
+
+        if (!OSMatch_Compile(match_patterns[p], &match[p], 0) || !OSMultiMatch_AddMatch(&multi, &match[p], p)) {
+            fprintf(stderr, "Cannot compile match '%s'.\n", match_patterns[p]);
+            return 1;
+        }
+    }
+
+    b.patterns = p;
+
+    if (!OSMultiMatch_Compile(&multi)) {
+        fprintf(stderr, "Cannot compile the multi-pattern automaton.\n");
+        return 1;
+    }
+
+    /* Operations are log lines: every line is tested against all the patterns */
+    for (t = 0; t < BENCH_THREAD_STEPS; t++) {
+        ns = bench_run_threads(bench_threads[t], bench_regex, &b);
+        bench_report(SUITE, "osregex_execute", bench_threads[t], b.iterations, ns);
+    }
+
+    for (t = 0; t < BENCH_THREAD_STEPS; t++) {
+        ns = bench_run_threads(bench_threads[t], bench_match, &b);
+        bench_report(SUITE, "osmatch_execute", bench_threads[t], b.iterations, ns);
+    }
+
+    ns = bench_run_threads(1, bench_multi_match, &b);
+    bench_report(SUITE, "osmultimatch_execute", 1, b.iterations, ns);
+
+    for (p = 0; p < b.patterns; p++) {
+        OSRegex_FreePattern(&regex[p]);
+        OSMatch_FreePattern(&match[p]);
+    }
+
+    OSMultiMatch_FreePattern(&multi);
+    return 0;
+}
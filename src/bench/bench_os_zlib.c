@@ -0,0 +1,109 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+/* Compression of log lines and of large blocks */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../os_zlib/os_zlib.h"
+#include "bench.h"
+
+#define SUITE "os_zlib"
+#define BLOCK_SIZE 65536
+
+int main(void)
+{
+    char **lines;
+    size_t count;
+    char **packed;
+    unsigned long *lengths;
+    char *block;
+    char *compressed;
+    char *uncompressed;
+    unsigned long length = 0;
+    uint64_t iterations = bench_iterations(100000);
+    uint64_t blocks = bench_iterations(500);
+    uint64_t start;
+    uint64_t i;
+    size_t n;
+
+    lines = bench_corpus(&count);
+    block = malloc(BLOCK_SIZE);
+    compressed = malloc(BLOCK_SIZE * 2);
+    uncompressed = malloc(BLOCK_SIZE + 1);
+    packed = calloc(count, sizeof(char *));
+    lengths = calloc(count, sizeof(unsigned long));
+
+    if (!block || !compressed || !uncompressed || !packed || !lengths) {
+        fprintf(stderr, "Cannot allocate the buffers.\n");
+        return 1;
+    }
+
+    /* Single lines, as the agents send them */
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        n = i % count;
+        os_zlib_compress(lines[n], compressed, strlen(lines[n]), BLOCK_SIZE * 2);
+    }
+    bench_report(SUITE, "compress_line", 1, iterations, bench_now() - start);
+
+    for (n = 0; n < count; n++) {
+        lengths[n] = os_zlib_compress(lines[n], compressed, strlen(lines[n]), BLOCK_SIZE * 2);
+
+        if (!(packed[n] = malloc(lengths[n] + 1))) {
+            fprintf(stderr, "Cannot allocate the buffers.\n");
+            return 1;
+        }
+
+        memcpy(packed[n], compressed, lengths[n]);
+    }
+
+    start = bench_now();
+    for (i = 0; i < iterations; i++) {
+        n = i % count;
+        os_zlib_uncompress(packed[n], uncompressed, lengths[n], BLOCK_SIZE + 1);
+    }
+    bench_report(SUITE, "uncompress_line", 1, iterations, bench_now() - start);
+
+    /* A block filled with the corpus */
+    for (n = 0; length < BLOCK_SIZE; n = (n + 1) % count) {
+        size_t size = strlen(lines[n]);
+
+        if (size > BLOCK_SIZE - length) {
+            size = BLOCK_SIZE - length;
+        }
+
+        memcpy(block + length, lines[n], size);
+        length += size;
+    }
+
+    start = bench_now();
+    for (i = 0; i < blocks; i++) {
+        length = os_zlib_compress(block, compressed, BLOCK_SIZE, BLOCK_SIZE * 2);
+    }
+    bench_report(SUITE, "compress_64k", 1, blocks, bench_now() - start);
+
+    start = bench_now();
+    for (i = 0; i < blocks; i++) {
+        os_zlib_uncompress(compressed, uncompressed, length, BLOCK_SIZE + 1);
+    }
+    bench_report(SUITE, "uncompress_64k", 1, blocks, bench_now() - start);
+
+    for (n = 0; n < count; n++) {
+        free(packed[n]);
+    }
+
+    free(packed);
+    free(lengths);
+    free(block);
+    free(compressed);
+    free(uncompressed);
+    return 0;
+}
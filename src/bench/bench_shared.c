@@ -0,0 +1,271 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+/* OSHash, OSHashOA, w_queue_t and rb_tree */
+
+#include "shared.h"
+#include "bench.h"
+
+#define SUITE "shared"
+#define QUEUE_SIZE 1024
+
+/* Hash tables run on the same keys */
+typedef struct hash_backend {
+    const char *name;
+    void *(*create)(uint64_t size);
+    int (*add)(void *hash, const char *key, void *data);
+    void *(*get)(void *hash, const char *key);
+    void *(*delete)(void *hash, const char *key);
+    void (*destroy)(void *hash);
+} hash_backend;
+
+typedef struct shared_bench {
+    char **keys;
+    char **missing;
+    uint64_t nkeys;
+    uint64_t iterations;
+    const hash_backend *backend;
+    void *hash;
+    w_queue_t *queue;
+} shared_bench;
+
+static void *oshash_create(uint64_t size)
+{
+    OSHash *hash = OSHash_Create();
+
+    /* Sized for the keys, as the daemons do for their large tables */
+    if (hash) {
+        OSHash_setSize(hash, size);
+    }
+
+    return hash;
+}
+
+static int oshash_add(void *hash, const char *key, void *data)
+{
+    return OSHash_Add_ex((OSHash *)hash, key, data);
+}
+
+static void *oshash_get(void *hash, const char *key)
+{
+    return OSHash_Get_ex((OSHash *)hash, key);
+}
+
+static void *oshash_delete(void *hash, const char *key)
+{
+    return OSHash_Delete_ex((OSHash *)hash, key);
+}
+
+static void oshash_destroy(void *hash)
+{
+    OSHash_Free((OSHash *)hash);
+}
+
+static void *oahash_create(__attribute__((unused)) uint64_t size)
+{
+    return OSHashOA_Create(1);
+}
+
+static void *oahash_create_striped(__attribute__((unused)) uint64_t size)
+{
+    return OSHashOA_Create(16);
+}
+
+static int oahash_add(void *hash, const char *key, void *data)
+{
+    return OSHashOA_Add((OSHashOA *)hash, key, data);
+}
+
+static void *oahash_get(void *hash, const char *key)
+{
+    return OSHashOA_Get((OSHashOA *)hash, key);
+}
+
+static void *oahash_delete(void *hash, const char *key)
+{
+    return OSHashOA_Delete((OSHashOA *)hash, key);
+}
+
+static void oahash_destroy(void *hash)
+{
+    OSHashOA_Free((OSHashOA *)hash);
+}
+
+static const hash_backend hash_backends[] = {
+    { "oshash", oshash_create, oshash_add, oshash_get, oshash_delete, oshash_destroy },
+    { "oahash", oahash_create, oahash_add, oahash_get, oahash_delete, oahash_destroy },
+    { "oahash16", oahash_create_striped, oahash_add, oahash_get, oahash_delete, oahash_destroy },
+};
+
+static void bench_hash_insert(void *arg, unsigned int thread, unsigned int threads)
+{
+    shared_bench *b = (shared_bench *)arg;
+    uint64_t i;
+
+    for (i = thread; i < b->nkeys; i += threads) {
+        b->backend->add(b->hash, b->keys[i], b->keys[i]);
+    }
+}
+
+static void bench_hash_lookup(void *arg, unsigned int thread, unsigned int threads)
+{
+    shared_bench *b = (shared_bench *)arg;
+    uint32_t state = BENCH_SEED + thread;
+    uint64_t i;
+
+    for (i = thread; i < b->iterations; i += threads) {
+        b->backend->get(b->hash, b->keys[bench_random(&state) % b->nkeys]);
+    }
+}
+
+static void bench_hash_miss(void *arg, unsigned int thread, unsigned int threads)
+{
+    shared_bench *b = (shared_bench *)arg;
+    uint32_t state = BENCH_SEED + thread;
+    uint64_t i;
+
+    for (i = thread; i < b->iterations; i += threads) {
+        b->backend->get(b->hash, b->missing[bench_random(&state) % b->nkeys]);
+    }
+}
+
+static void bench_hash_delete(void *arg, unsigned int thread, unsigned int threads)
+{
+    shared_bench *b = (shared_bench *)arg;
+    uint64_t i;
+
+    for (i = thread; i < b->nkeys; i += threads) {
+        b->backend->delete(b->hash, b->keys[i]);
+    }
+}
+
+/* Every operation of a hash table, on each thread count */
+static int bench_hash(shared_bench *b, const hash_backend *backend)
+{
+    char name[64];
+    uint64_t ns;
+    size_t t;
+
+    b->backend = backend;
+
+    for (t = 0; t < BENCH_THREAD_STEPS; t++) {
+        if (b->hash = backend->create(b->nkeys), !b->hash) {
+            fprintf(stderr, "Cannot create the hash table.\n");
+            return -1;
+        }
+
+        ns = bench_run_threads(bench_threads[t], bench_hash_insert, b);
+        snprintf(name, sizeof(name), "%s_add", backend->name);
+        bench_report(SUITE, name, bench_threads[t], b->nkeys, ns);
+
+        ns = bench_run_threads(bench_threads[t], bench_hash_lookup, b);
+        snprintf(name, sizeof(name), "%s_get", backend->name);
+        bench_report(SUITE, name, bench_threads[t], b->iterations, ns);
+
+        ns = bench_run_threads(bench_threads[t], bench_hash_miss, b);
+        snprintf(name, sizeof(name), "%s_get_miss", backend->name);
+        bench_report(SUITE, name, bench_threads[t], b->iterations, ns);
+
+        ns = bench_run_threads(bench_threads[t], bench_hash_delete, b);
+        snprintf(name, sizeof(name), "%s_delete", backend->name);
+        bench_report(SUITE, name, bench_threads[t], b->nkeys, ns);
+
+        backend->destroy(b->hash);
+    }
+
+    return 0;
+}
+
+/* Half of the threads push and the other half pop */
+static void bench_queue(void *arg, unsigned int thread, unsigned int threads)
+{
+    shared_bench *b = (shared_bench *)arg;
+    unsigned int pairs = threads / 2;
+    uint64_t i;
+
+    if (thread < pairs) {
+        for (i = thread; i < b->iterations; i += pairs) {
+            queue_push_ex_block(b->queue, b->keys[i % b->nkeys]);
+        }
+    } else {
+        for (i = thread - pairs; i < b->iterations; i += pairs) {
+            queue_pop_ex(b->queue);
+        }
+    }
+}
+
+int main(void)
+{
+    shared_bench b;
+    uint32_t state = BENCH_SEED;
+    rb_tree *tree;
+    uint64_t start;
+    uint64_t ns;
+    uint64_t i;
+    size_t t;
+
+    memset(&b, 0, sizeof(b));
+    b.nkeys = bench_iterations(100000);
+    b.iterations = bench_iterations(1000000);
+    os_calloc(b.nkeys, sizeof(char *), b.keys);
+    os_calloc(b.nkeys, sizeof(char *), b.missing);
+
+    for (i = 0; i < b.nkeys; i++) {
+        os_calloc(32, sizeof(char), b.keys[i]);
+        snprintf(b.keys[i], 32, "%08x-%llu", bench_random(&state), (unsigned long long)i);
+        os_calloc(32, sizeof(char), b.missing[i]);
+        snprintf(b.missing[i], 32, "missing-%llu", (unsigned long long)i);
+    }
+
+    /* OSHash and OSHashOA, plain and with 16 lock stripes */
+    for (t = 0; t < sizeof(hash_backends) / sizeof(hash_backends[0]); t++) {
+        if (bench_hash(&b, &hash_backends[t]) < 0) {
+            return 1;
+        }
+    }
+
+    /* w_queue_t, with as many producers as consumers */
+    for (t = 0; t < BENCH_THREAD_STEPS; t++) {
+        b.queue = queue_init(QUEUE_SIZE);
+        ns = bench_run_threads(bench_threads[t] * 2, bench_queue, &b);
+        bench_report(SUITE, "queue_push_pop", bench_threads[t] * 2, b.iterations, ns);
+        queue_free(b.queue);
+    }
+
+    /* rb_tree */
+    tree = rbtree_init();
+
+    start = bench_now();
+    for (i = 0; i < b.nkeys; i++) {
+        rbtree_insert(tree, b.keys[i], b.keys[i]);
+    }
+    bench_report(SUITE, "rbtree_insert", 1, b.nkeys, bench_now() - start);
+
+    start = bench_now();
+    for (i = 0; i < b.iterations; i++) {
+        rbtree_get(tree, b.keys[bench_random(&state) % b.nkeys]);
+    }
+    bench_report(SUITE, "rbtree_get", 1, b.iterations, bench_now() - start);
+
+    start = bench_now();
+    for (i = 0; i < b.nkeys; i++) {
+        rbtree_delete(tree, b.keys[i]);
+    }
+    bench_report(SUITE, "rbtree_delete", 1, b.nkeys, bench_now() - start);
+
+    rbtree_destroy(tree);
+
+    for (i = 0; i < b.nkeys; i++) {
+        free(b.keys[i]);
+        free(b.missing[i]);
+    }
+
+    free(b.keys);
+    free(b.missing);
+    return 0;
+}
@@ -33,6 +33,9 @@ size_t agcom_dispatch(char * command, char ** output){
         }
         return agcom_getconfig(rcv_args, output);
 
+    } else if (strcmp(rcv_comm, "getmetrics") == 0){
+        return agcom_getmetrics(output);
+
     } else {
         mdebug1("AGCOM Unrecognized command '%s'.", rcv_comm);
         os_strdup("err Unrecognized command", *output);
@@ -40,6 +43,15 @@ size_t agcom_dispatch(char * command, char ** output){
     }
 }
 
+size_t agcom_getmetrics(char ** output) {
+    char *metrics = w_metrics_render();
+
+    *output = strdup("ok");
+    wm_strcat(output, metrics, ' ');
+    free(metrics);
+    return strlen(*output);
+}
+
 size_t agcom_getconfig(const char * section, char ** output) {
 
     cJSON *cfg;
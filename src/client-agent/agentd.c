@@ -21,6 +21,7 @@ void AgentdStart(int uid, int gid, const char *user, const char *group)
     int maxfd = 0;
     fd_set fdset;
     struct timeval fdtimeout;
+    int forward_pending = 0;
 
     available_server = 0;
 
@@ -72,6 +73,8 @@ void AgentdStart(int uid, int gid, const char *user, const char *group)
         merror_exit(QUEUE_ERROR, DEFAULTQPATH, strerror(errno));
     }
 
+    EventForwardInit();
+
 #ifdef HPUX
     {
         int flags;
@@ -103,6 +106,9 @@ void AgentdStart(int uid, int gid, const char *user, const char *group)
         case W_METH_AES:
             minfo("Using AES as encryption method.");
             break;
+        case W_METH_AES_GCM:
+            minfo("Using AES-GCM as encryption method.");
+            break;
         case W_METH_BLOWFISH:
             minfo("Using Blowfish as encryption method.");
             break;
@@ -142,7 +148,9 @@ void AgentdStart(int uid, int gid, const char *user, const char *group)
         rc++;
     }
 
+    agent_metrics_init();
     w_create_thread(state_main, NULL);
+    w_metrics_http_start("agent");
 
     /* Try to connect to the server */
     if (!connect_server(0)) {
@@ -199,14 +207,15 @@ void AgentdStart(int uid, int gid, const char *user, const char *group)
         FD_SET(agt->sock, &fdset);
         FD_SET(agt->m_queue, &fdset);
 
-        fdtimeout.tv_sec = 1;
+        /* Don't wait while the shared rings hold events */
+        fdtimeout.tv_sec = forward_pending ? 0 : 1;
         fdtimeout.tv_usec = 0;
 
         /* Wait with a timeout for any descriptor */
         rc = select(maxfd, &fdset, NULL, NULL, &fdtimeout);
         if (rc == -1) {
             merror_exit(SELECT_ERROR, errno, strerror(errno));
-        } else if (rc == 0) {
+        } else if (rc == 0 && !forward_pending) {
             continue;
         }
 
@@ -224,8 +233,8 @@ void AgentdStart(int uid, int gid, const char *user, const char *group)
         }
 
         /* For the forwarder */
-        if (FD_ISSET(agt->m_queue, &fdset)) {
-            EventForward();
+        if (FD_ISSET(agt->m_queue, &fdset) || forward_pending) {
+            forward_pending = EventForward();
         }
     }
 }
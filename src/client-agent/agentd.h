@@ -18,13 +18,17 @@
 
 /* Buffer functions */
 #define full(i, j, n) ((i + 1) % (n) == j)
-#define warn(i, j) ((float)((i - j + agt->buflength + 1) % (agt->buflength + 1)) / (float)agt->buflength >= ((float)warn_level/100.0))
-#define nowarn(i, j) ((float)((i - j + agt->buflength + 1) % (agt->buflength + 1)) / (float)agt->buflength <= ((float)warn_level/100.0))
-#define normal(i, j) ((float)((i - j + agt->buflength + 1) % (agt->buflength + 1)) / (float)agt->buflength <= ((float)normal_level/100.0))
-#define capacity(i, j) (float)((i - j + agt->buflength + 1) % (agt->buflength + 1)) / (float)agt->buflength
+#define buffer_full(used) ((used) >= (unsigned int)agt->buflength)
+#define buffer_level(used) ((float)(used) / (float)agt->buflength)
+#define buffer_warn(used) (buffer_level(used) >= ((float)warn_level/100.0))
+#define buffer_nowarn(used) (buffer_level(used) <= ((float)warn_level/100.0))
+#define buffer_normal(used) (buffer_level(used) <= ((float)normal_level/100.0))
 #define empty(i, j) (i == j)
 #define forward(x, n) x = (x + 1) % (n)
 
+/* Room for the checksums of the shared files in the keep-alive */
+#define SHARED_LIST_MAX OS_SIZE_2048
+
 /* Buffer statuses */
 #define NORMAL 0
 #define WARNING 1
@@ -56,8 +60,11 @@ cJSON *getAgentInternalOptions(void);
 /* Agentd init function */
 void AgentdStart(int uid, int gid, const char *user, const char *group) __attribute__((noreturn));
 
-/* Event Forwarder */
-void *EventForward(void);
+/* Offer shared-memory rings to the local queue, if enabled */
+void EventForwardInit(void);
+
+/* Event Forwarder. Returns 1 if the shared rings hold more events */
+int EventForward(void);
 
 /* Receiver messages */
 int receive_msg(void);
@@ -68,12 +75,36 @@ void *receiver_thread(void *none);
 /* Initialize agent buffer */
 void buffer_init();
 
-/* Send message to a buffer with the aim to avoid flooding issues */
-int buffer_append(const char *msg);
+/* Send message to a buffer with the aim to avoid flooding issues. A negative length means the message is a string */
+int buffer_append(const char *msg, ssize_t msg_length);
 
 /* Thread to dispatch messages from the buffer */
 void *dispatch_buffer(void * arg);
 
+/* Allow or forbid sending several events per message, as told by the manager */
+void buffer_batch_enable(int enabled);
+
+/* Scale the event rate to a percentage of events_per_second, as told by the manager */
+void buffer_credit(int percent);
+
+/* Segment files of the buffer spill */
+#define SPILL_SEGMENTS 8
+
+/* Set up the buffer spill, with a size in bytes. Not thread-safe: the buffer serializes the calls */
+int spill_init(size_t size);
+
+/* Whether there are spilled events, so new ones must be spilled too to keep the order */
+int spill_active();
+
+/* Append an event to the spill */
+int spill_push(const char * msg, size_t length);
+
+/* Get the first spilled event, valid until spill_release(), or NULL if there is none */
+const char * spill_peek(size_t * length);
+
+/* Consume the event got by spill_peek() */
+void spill_release();
+
 /* Initialize sender structure */
 void sender_init();
 
@@ -83,6 +114,9 @@ int send_msg(const char *msg, ssize_t msg_length);
 /* Extract the shared files */
 char *getsharedfiles(void);
 
+/* Rebuild merged.mg from the shared files, as listed by the manager. Returns 1 on success */
+int shared_rebuild(char *manifest);
+
 /* Get agent IP */
 char *get_agent_ip();
 
@@ -118,6 +152,9 @@ int verifyRemoteConf();
 
 // Agent status functions
 void * state_main(void * args);
+
+// Register the metrics of the agent before the counters are used
+void agent_metrics_init();
 void update_status(agent_status_t status);
 void update_keepalive(time_t curr_time);
 void update_ack(time_t curr_time);
@@ -128,6 +165,7 @@ void * agcom_main(void * arg);
 #endif
 size_t agcom_dispatch(char * command, char ** output);
 size_t agcom_getconfig(const char * section, char ** output);
+size_t agcom_getmetrics(char ** output);
 
 /*** Global variables ***/
 extern int agent_debug_level;
@@ -158,6 +196,8 @@ extern int run_foreground;
 extern keystore keys;
 extern agent *agt;
 extern agent_state_t agent_state;
+extern w_metric_t * agent_metric_msg_count;
+extern w_metric_t * agent_metric_msg_sent;
 
 static const char AG_IN_UNMERGE[] = "wazuh: Could not unmerge shared file.";
 
@@ -12,52 +12,188 @@
 #include <pthread.h>
 #include "shared.h"
 #include "agentd.h"
+#include "os_net/os_net.h"
 
 #ifdef WIN32
 #include <winsock2.h>
 #include <windows.h>
 #endif
 
-static volatile int i = 0;
-static volatile int j = 0;
-static volatile int state = NORMAL;
+static int state = NORMAL;
 
 int warn_level;
 int normal_level;
 int tolerance;
 
+/* Notices for the dispatcher, raised by any thread */
 struct{
-  unsigned int full:1;
-  unsigned int warn:1;
-  unsigned int flood:1;
-  unsigned int normal:1;
+  int full;
+  int warn;
+  int flood;
+  int normal;
 } buff;
 
-static char ** buffer;
+/* Events are kept in a ring of bytes, as a 32-bit header followed by the
+ * NUL-terminated event, aligned to BUFFER_ALIGN. Producers reserve room by
+ * moving the head with a CAS, copy the event and then publish its header,
+ * so they never block each other. The dispatcher reads the header at the
+ * tail: 0 means there is nothing (yet) to read. It zeroes every byte it
+ * consumes, so any position may hold a header later on. A record never
+ * wraps: if it doesn't fit at the end, a padding record fills the gap.
+ */
+
+#define BUFFER_ALIGN        8
+#define BUFFER_EVENT_SIZE   1024        // Bytes per event of queue_size
+#define BUFFER_PADDING      0xFFFFFFFF  // Header skipping to the end of the ring
+
+static struct {
+    char * data;
+    size_t size;                        // Power of two, at least 2 * OS_MAXSTR
+    size_t head;                        // Reserved by producers
+    char _pad0[64];
+    size_t tail;                        // Consumed by the dispatcher
+    size_t pending;                     // Bytes of the record handed by buffer_pop()
+    char _pad1[64];
+    unsigned int events;                // Events reserved and not consumed
+    int waiting;                        // The dispatcher is parked on cond_no_empty
+} ring;
+
 static pthread_mutex_t mutex_lock;
 static pthread_cond_t cond_no_empty;
 
-static time_t start, end;
+static time_t start;
+
+/* Maximum events per message, and whether the manager takes batches */
+static int batch_max;
+static int batch_enabled;
+
+/* Events that don't fit in the buffer go to the disk spill, serialized by mutex_lock */
+static int spill_enabled;
+static int spilling;
+
+/* Sampled events are traced from buffer_append() until they are sent */
+enum { BUFFER_TRACE_BUFFER, BUFFER_TRACE_SEND, BUFFER_TRACE_STAGES };
+static const char * const buffer_trace_stages[BUFFER_TRACE_STAGES] = { "buffer", "send" };
+static w_tracer_t buffer_tracer;
+
+/* Carries the trace of an event in the ring, keyed by its address. Read by the dispatcher only. */
+static w_trace_probe_t buffer_probe;
+static w_trace_t dispatch_trace;
+
+/* Rate credit granted by the manager, as a percentage of events_per_second */
+static int credit = 100;
+
+/* Token bucket: the dispatcher may send up to burst_time seconds of its rate at once */
+static int burst_time;
+static double tokens;
+static struct timespec last_refill;
+
+/**
+ * @brief Take tokens for the events sent, sleeping until the bucket covers them
+ *
+ * The bucket is refilled at events_per_second, scaled by the credit of the
+ * manager, and holds up to burst_time seconds of that rate. So an idle
+ * agent may send a burst at once, and a busy one keeps the average rate.
+ *
+ * @param count Number of events sent.
+ */
+static void throttle(int count);
+
+/**
+ * @brief Move the buffer state to a higher level, if the usage reaches it
+ *
+ * @param used Events in the buffer.
+ */
+static void buffer_raise(unsigned int used);
+
+/**
+ * @brief Move the buffer state to a lower level, if the usage comes back to it
+ *
+ * @param used Events in the buffer.
+ */
+static void buffer_lower(unsigned int used);
+
+/**
+ * @brief Copy an event into the ring
+ *
+ * @param msg Event.
+ * @param length Length of the event.
+ * @param trace Trace of the event, if it's sampled.
+ * @retval 0 The event was stored.
+ * @retval -1 The ring is full.
+ */
+static int ring_push(const char * msg, size_t length, const w_trace_t * trace);
+
+/**
+ * @brief Get the event at the tail of the ring
+ *
+ * @param length Output: length of the event.
+ * @return Pointer to the event, valid until ring_release(), or NULL if there is none.
+ */
+static char * ring_peek(size_t * length);
+
+/* Consume the event got by ring_peek() */
+static void ring_release();
+
+/**
+ * @brief Pop a message from the buffer, or from the spill when the buffer is empty
+ *
+ * @param wait Wait for a message if there is none.
+ * @param length Output: length of the message. A spilled message isn't NUL-terminated.
+ * @param spilled Output: whether the message comes from the spill.
+ * @return Message, to be handed to buffer_release(), or NULL if there is none and wait is 0.
+ */
+static char * buffer_pop(int wait, size_t * length, int * spilled);
 
 /**
- * @brief Sleep according to max_eps parameter
+ * @brief Release a message got from buffer_pop()
  *
- * Sleep (1 / max_eps) - ts_loop
+ * Release a message before popping the next one: the buffer and the spill
+ * hand the same message until it's released.
  *
- * @param ts_loop Loop time.
+ * @param msg Message.
+ * @param spilled Whether the message comes from the spill.
  */
-static void delay(struct timespec * ts_loop);
+static void buffer_release(char * msg, int spilled);
+
+/**
+ * @brief Send a message along with the ones waiting after it, in batches
+ *
+ * @param msg First message. It's released.
+ * @param length Length of the message.
+ * @param spilled Whether the message comes from the spill.
+ * @return Number of events sent.
+ */
+static int send_batch(char * msg, size_t length, int spilled);
 
 /* Create agent buffer */
 void buffer_init(){
+    int spill_size;
+
+    if (!ring.data) {
+        size_t size = 2 * OS_MAXSTR;
 
-    if (!buffer)
-        os_calloc(agt->buflength+1, sizeof(char *), buffer);
+        while (size < (size_t)agt->buflength * BUFFER_EVENT_SIZE) {
+            size <<= 1;
+        }
+
+        os_calloc(size, 1, ring.data);
+        ring.size = size;
+    }
 
     /* Read internal configuration */
     warn_level = getDefine_Int("agent", "warn_level", 1, 100);
     normal_level = getDefine_Int("agent", "normal_level", 0, warn_level-1);
     tolerance = getDefine_Int("agent", "tolerance", 0, 600);
+    batch_max = getDefine_Int("agent", "batch_events", 0, 256);
+    spill_size = getDefine_Int("agent", "spill_size", 0, 4096);
+    burst_time = getDefine_Int("agent", "burst_time", 1, 60);
+
+    if (spill_size > 0) {
+        spill_enabled = spill_init((size_t)spill_size << 20) == 0;
+    }
+
+    w_tracer_init(&buffer_tracer, "agent", "wazuh_agent", buffer_trace_stages, BUFFER_TRACE_STAGES);
 
     w_mutex_init(&mutex_lock, NULL);
     w_cond_init(&cond_no_empty, NULL);
@@ -68,174 +204,388 @@ void buffer_init(){
     mdebug1("Agent buffer created.");
 }
 
-/* Send messages to buffer. */
-int buffer_append(const char *msg){
+void buffer_raise(unsigned int used) {
+    int current = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
 
-    w_mutex_lock(&mutex_lock);
+    /* Only the thread that wins the CAS raises the notice */
 
-    /* Check if buffer usage reaches any higher level */
-    switch (state) {
+    switch (current) {
 
         case NORMAL:
-            if (full(i, j, agt->buflength + 1)){
-                buff.full = 1;
-                state = FULL;
-                start = time(0);
-            }else if (warn(i, j)){
-                state = WARNING;
-                buff.warn = 1;
-            }
-            break;
-
         case WARNING:
-            if (full(i, j, agt->buflength + 1)){
-                buff.full = 1;
-                state = FULL;
-                start = time(0);
+            if (buffer_full(used)){
+                __atomic_store_n(&start, time(0), __ATOMIC_RELAXED);
+
+                if (__atomic_compare_exchange_n(&state, &current, FULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                    __atomic_store_n(&buff.full, 1, __ATOMIC_RELAXED);
+                }
+            }else if (current == NORMAL && buffer_warn(used)){
+                if (__atomic_compare_exchange_n(&state, &current, WARNING, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                    __atomic_store_n(&buff.warn, 1, __ATOMIC_RELAXED);
+                }
             }
             break;
 
         case FULL:
-            end = time(0);
-            if (end - start >= tolerance){
-                state = FLOOD;
-                buff.flood = 1;
+            if (time(0) - __atomic_load_n(&start, __ATOMIC_RELAXED) >= tolerance){
+                if (__atomic_compare_exchange_n(&state, &current, FLOOD, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                    __atomic_store_n(&buff.flood, 1, __ATOMIC_RELAXED);
+                }
             }
             break;
 
         case FLOOD:
             break;
     }
+}
+
+void buffer_lower(unsigned int used) {
+    int current = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+    int target = current;
+
+    switch (current) {
+
+        case NORMAL:
+            break;
+
+        case WARNING:
+        case FULL:
+        case FLOOD:
+            if (current != WARNING && buffer_nowarn(used))
+                target = WARNING;
+
+            if (buffer_normal(used))
+                target = NORMAL;
+            break;
+    }
+
+    if (target != current && __atomic_compare_exchange_n(&state, &current, target, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED) && target == NORMAL) {
+        __atomic_store_n(&buff.normal, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int ring_push(const char * msg, size_t length, const w_trace_t * trace) {
+    const size_t need = (sizeof(uint32_t) + length + 1 + BUFFER_ALIGN - 1) & ~(size_t)(BUFFER_ALIGN - 1);
+    size_t head = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+    size_t offset;
+    size_t gap;
+
+    if (__atomic_fetch_add(&ring.events, 1, __ATOMIC_RELAXED) >= (unsigned int)agt->buflength) {
+        __atomic_fetch_sub(&ring.events, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    do {
+        offset = head & (ring.size - 1);
+        gap = offset + need > ring.size ? ring.size - offset : 0;
 
-    agent_state.msg_count++;
+        if (head + gap + need - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) > ring.size) {
+            __atomic_fetch_sub(&ring.events, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&ring.head, &head, head + gap + need, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if (gap) {
+        __atomic_store_n((uint32_t *)(ring.data + offset), BUFFER_PADDING, __ATOMIC_RELEASE);
+        offset = 0;
+    }
 
-    /* When buffer is full, event is dropped */
+    memcpy(ring.data + offset + sizeof(uint32_t), msg, length);
+    ring.data[offset + sizeof(uint32_t) + length] = '\0';
 
-    if (full(i, j, agt->buflength + 1)){
+    if (trace->id) {
+        w_trace_probe_set(&buffer_probe, ring.data + offset + sizeof(uint32_t), trace);
+    }
+    __atomic_store_n((uint32_t *)(ring.data + offset), (uint32_t)length + 1, __ATOMIC_SEQ_CST);
 
+    /* Pairs with the dispatcher setting ring.waiting before checking the ring */
+    if (__atomic_load_n(&ring.waiting, __ATOMIC_SEQ_CST)) {
+        w_mutex_lock(&mutex_lock);
+        w_cond_signal(&cond_no_empty);
         w_mutex_unlock(&mutex_lock);
+    }
+
+    return 0;
+}
+
+char * ring_peek(size_t * length) {
+    size_t offset = ring.tail & (ring.size - 1);
+    uint32_t header = __atomic_load_n((uint32_t *)(ring.data + offset), __ATOMIC_SEQ_CST);
+
+    if (header == BUFFER_PADDING) {
+        memset(ring.data + offset, 0, ring.size - offset);
+        __atomic_store_n(&ring.tail, ring.tail + ring.size - offset, __ATOMIC_RELEASE);
+        header = __atomic_load_n((uint32_t *)ring.data, __ATOMIC_SEQ_CST);
+        offset = 0;
+    }
+
+    if (header == 0) {
+        return NULL;
+    }
+
+    *length = header - 1;
+    ring.pending = (sizeof(uint32_t) + header + BUFFER_ALIGN - 1) & ~(size_t)(BUFFER_ALIGN - 1);
+
+    if (w_trace_probe_take(&buffer_probe, ring.data + offset + sizeof(uint32_t), &dispatch_trace)) {
+        w_trace_stage(&buffer_tracer, &dispatch_trace, BUFFER_TRACE_BUFFER);
+    }
+
+    return ring.data + offset + sizeof(uint32_t);
+}
+
+void ring_release() {
+    memset(ring.data + (ring.tail & (ring.size - 1)), 0, ring.pending);
+    __atomic_store_n(&ring.tail, ring.tail + ring.pending, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&ring.events, 1, __ATOMIC_RELAXED);
+    ring.pending = 0;
+}
+
+/* Send messages to buffer. */
+int buffer_append(const char *msg, ssize_t msg_length){
+    size_t length = msg_length < 0 ? strlen(msg) : (size_t)msg_length;
+    w_trace_t trace;
+    int result;
+
+    buffer_raise(__atomic_load_n(&ring.events, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&agent_state.msg_count, 1, __ATOMIC_RELAXED);
+    w_metrics_inc(agent_metric_msg_count);
+
+    /* Once an event is spilled, the next ones follow it until the spill is read up */
+
+    w_trace_begin(&buffer_tracer, &trace);
+
+    if (!(spill_enabled && __atomic_load_n(&spilling, __ATOMIC_ACQUIRE)) && ring_push(msg, length, &trace) == 0) {
+        return 0;
+    }
+
+    if (!spill_enabled) {
         mdebug2("Unable to store new packet: Buffer is full.");
-        return(-1);
+        return -1;
+    }
 
-    }else{
+    w_mutex_lock(&mutex_lock);
 
-        buffer[i] = strdup(msg);
-        forward(i, agt->buflength + 1);
+    if (result = spill_push(msg, length), result == 0) {
+        __atomic_store_n(&spilling, 1, __ATOMIC_RELEASE);
         w_cond_signal(&cond_no_empty);
-        w_mutex_unlock(&mutex_lock);
+    }
+
+    w_mutex_unlock(&mutex_lock);
 
-        return(0);
+    if (result < 0) {
+        mdebug2("Unable to store new packet: Buffer is full.");
     }
+
+    return result;
 }
 
-/* Send messages from buffer to the server */
-void *dispatch_buffer(__attribute__((unused)) void * arg){
+/* Allow or forbid batches, as negotiated with the manager */
+void buffer_batch_enable(int enabled) {
+    __atomic_store_n(&batch_enabled, enabled, __ATOMIC_RELAXED);
+}
 
-    char flood_msg[OS_MAXSTR];
-    char full_msg[OS_MAXSTR];
-    char warn_msg[OS_MAXSTR];
-    char normal_msg[OS_MAXSTR];
+/* Scale the event rate, as told by the manager */
+void buffer_credit(int percent) {
+    if (percent < 1 || percent > 1000) {
+        mdebug1("Invalid rate credit from the manager: %d", percent);
+        return;
+    }
 
-    char warn_str[OS_SIZE_2048];
-    struct timespec ts0;
-    struct timespec ts1;
+    if (__atomic_exchange_n(&credit, percent, __ATOMIC_RELAXED) != percent) {
+        mdebug2("Rate credit set to %d%% of %d eps.", percent, agt->events_persec);
+    }
+}
 
-    while(1){
-        gettime(&ts0);
+/* Pop a message from the buffer */
+char * buffer_pop(int wait, size_t * length, int * spilled) {
+    char * msg_output;
 
-        w_mutex_lock(&mutex_lock);
+    if (msg_output = ring_peek(length), msg_output) {
+        buffer_lower(__atomic_load_n(&ring.events, __ATOMIC_RELAXED));
+        *spilled = 0;
+        return msg_output;
+    }
 
-        while(empty(i, j)){
-            w_cond_wait(&cond_no_empty, &mutex_lock);
-        }
-        /* Check if buffer usage reaches any lower level */
-        switch (state) {
+    if (!wait && !(spill_enabled && __atomic_load_n(&spilling, __ATOMIC_ACQUIRE))) {
+        return NULL;
+    }
 
-            case NORMAL:
-                break;
+    w_mutex_lock(&mutex_lock);
 
-            case WARNING:
-                if (normal(i, j)){
-                    state = NORMAL;
-                    buff.normal = 1;
-                }
+    while (1) {
+        /* The ring holds the oldest events: read the spill only when it's empty */
+
+        if (spill_enabled && spilling) {
+            if (msg_output = (char *)spill_peek(length), msg_output) {
+                *spilled = 1;
                 break;
+            }
 
-            case FULL:
-                if (nowarn(i, j))
-                    state = WARNING;
+            __atomic_store_n(&spilling, spill_active(), __ATOMIC_RELEASE);
+        }
 
-                if (normal(i, j)){
-                    state = NORMAL;
-                    buff.normal = 1;
-                }
-                break;
+        __atomic_store_n(&ring.waiting, 1, __ATOMIC_SEQ_CST);
 
-            case FLOOD:
-                if (nowarn(i, j))
-                    state = WARNING;
+        if (msg_output = ring_peek(length), msg_output) {
+            buffer_lower(__atomic_load_n(&ring.events, __ATOMIC_RELAXED));
+            *spilled = 0;
+            break;
+        }
 
-                if (normal(i, j)){
-                    state = NORMAL;
-                    buff.normal = 1;
-                }
-                break;
+        if (!wait) {
+            break;
         }
 
-        char * msg_output = buffer[j];
-        forward(j, agt->buflength + 1);
+        w_cond_wait(&cond_no_empty, &mutex_lock);
+    }
+
+    __atomic_store_n(&ring.waiting, 0, __ATOMIC_RELAXED);
+    w_mutex_unlock(&mutex_lock);
+
+    return msg_output;
+}
+
+/* Release a message from the buffer or the spill */
+void buffer_release(__attribute__((unused)) char * msg, int spilled) {
+    if (spilled) {
+        w_mutex_lock(&mutex_lock);
+        spill_release();
         w_mutex_unlock(&mutex_lock);
+    } else {
+        ring_release();
+    }
+}
+
+/* Pack the message and the following ones into frames of BATCH_MAX_SIZE */
+int send_batch(char * msg, size_t size, int spilled) {
+    static char frame[BATCH_MAX_SIZE];
+    const size_t header = strlen(BATCH_HEADER);
+    size_t length = header;
+    int count = 0;
+
+    memcpy(frame, BATCH_HEADER, header);
 
-        if (buff.warn){
+    do {
+        uint32_t record;
+
+        if (length + sizeof(uint32_t) + size > BATCH_MAX_SIZE) {
+            if (length > header) {
+                send_msg(frame, length);
+                length = header;
+            }
+
+            /* Too big to be batched */
+            if (header + sizeof(uint32_t) + size > BATCH_MAX_SIZE) {
+                send_msg(msg, size);
+                buffer_release(msg, spilled);
+                count++;
+                continue;
+            }
+        }
+
+        record = wnet_order((uint32_t)size);
+        memcpy(frame + length, &record, sizeof(uint32_t));
+        memcpy(frame + length + sizeof(uint32_t), msg, size);
+        length += sizeof(uint32_t) + size;
+        buffer_release(msg, spilled);
+        count++;
+    } while (count < batch_max && (msg = buffer_pop(0, &size, &spilled), msg));
+
+    if (length > header) {
+        send_msg(frame, length);
+    }
+
+    return count;
+}
+
+/* Send messages from buffer to the server */
+void *dispatch_buffer(__attribute__((unused)) void * arg){
+
+    char flood_msg[OS_MAXSTR];
+    char full_msg[OS_MAXSTR];
+    char warn_msg[OS_MAXSTR];
+    char normal_msg[OS_MAXSTR];
+
+    char warn_str[OS_SIZE_2048];
+
+    tokens = (double)agt->events_persec * burst_time;
+    gettime(&last_refill);
+
+    while(1){
+        int count = 1;
+        size_t length;
+        int spilled;
+
+        char * msg_output = buffer_pop(1, &length, &spilled);
+
+        if (__atomic_exchange_n(&buff.warn, 0, __ATOMIC_RELAXED)){
 
-            buff.warn = 0;
             mwarn(WARN_BUFFER, warn_level);
             snprintf(warn_str, OS_SIZE_2048, OS_WARN_BUFFER, warn_level);
             snprintf(warn_msg, OS_MAXSTR, "%c:%s:%s", LOCALFILE_MQ, "ossec-agent", warn_str);
             send_msg(warn_msg, -1);
         }
 
-        if (buff.full){
+        if (__atomic_exchange_n(&buff.full, 0, __ATOMIC_RELAXED)){
 
-            buff.full = 0;
             mwarn(FULL_BUFFER);
             snprintf(full_msg, OS_MAXSTR, "%c:%s:%s", LOCALFILE_MQ, "ossec-agent", OS_FULL_BUFFER);
             send_msg(full_msg, -1);
         }
 
-        if (buff.flood){
+        if (__atomic_exchange_n(&buff.flood, 0, __ATOMIC_RELAXED)){
 
-            buff.flood = 0;
             mwarn(FLOODED_BUFFER);
             snprintf(flood_msg, OS_MAXSTR, "%c:%s:%s", LOCALFILE_MQ, "ossec-agent", OS_FLOOD_BUFFER);
             send_msg(flood_msg, -1);
         }
 
-        if (buff.normal){
+        if (__atomic_exchange_n(&buff.normal, 0, __ATOMIC_RELAXED)){
 
-            buff.normal = 0;
             minfo(NORMAL_BUFFER, normal_level);
             snprintf(normal_msg, OS_MAXSTR, "%c:%s:%s", LOCALFILE_MQ, "ossec-agent", OS_NORMAL_BUFFER);
             send_msg(normal_msg, -1);
         }
 
         os_wait();
-        send_msg(msg_output, -1);
-        free(msg_output);
 
-        gettime(&ts1);
-        time_sub(&ts1, &ts0);
-        delay(&ts1);
+        if (batch_max > 1 && __atomic_load_n(&batch_enabled, __ATOMIC_RELAXED)) {
+            count = send_batch(msg_output, length, spilled);
+        } else {
+            send_msg(msg_output, length);
+            buffer_release(msg_output, spilled);
+        }
+
+        w_trace_stage(&buffer_tracer, &dispatch_trace, BUFFER_TRACE_SEND);
+        w_trace_end(&buffer_tracer, &dispatch_trace);
+
+        throttle(count);
     }
 }
 
-void delay(struct timespec * ts_loop) {
-    long interval_ns = 1000000000 / agt->events_persec;
-    struct timespec ts_timeout = { interval_ns / 1000000000, interval_ns % 1000000000 };
-    time_sub(&ts_timeout, ts_loop);
+void throttle(int count) {
+    double rate = (double)agt->events_persec * __atomic_load_n(&credit, __ATOMIC_RELAXED) / 100.0;
+    double capacity = rate * burst_time;
+    struct timespec now;
+    struct timespec elapsed;
+
+    gettime(&now);
+    elapsed = now;
+    time_sub(&elapsed, &last_refill);
+    last_refill = now;
+
+    tokens += (elapsed.tv_sec + elapsed.tv_nsec / 1e9) * rate;
+
+    if (tokens > capacity) {
+        tokens = capacity;
+    }
+
+    tokens -= count;
 
-    if (ts_timeout.tv_sec >= 0 && ts_timeout.tv_nsec >= 0) {
-        struct timeval timeout = { ts_timeout.tv_sec, ts_timeout.tv_nsec / 1000 };
+    /* Wait for the debt to be paid: the time slept refills the bucket on the next call */
+    if (tokens < 0) {
+        long long wait_us = (long long)(-tokens / rate * 1e6);
+        struct timeval timeout = { wait_us / 1000000, wait_us % 1000000 };
         select(0 , NULL, NULL, NULL, &timeout);
     }
 }
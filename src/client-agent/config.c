@@ -12,6 +12,7 @@
 #include "os_xml/os_xml.h"
 #include "os_regex/os_regex.h"
 #include "os_net/os_net.h"
+#include "os_zlib/os_zlib.h"
 #include "agentd.h"
 
 /* Global variables */
@@ -61,6 +62,8 @@ int ClientConf(const char *cfgfile)
         agt->events_persec = min_eps;
     }
 
+    os_zlib_set_level(getDefine_Int("agent", "compress_level", 1, 9));
+
     return (1);
 }
 
@@ -85,6 +88,8 @@ cJSON *getClientConfig(void) {
         cJSON_AddStringToObject(client,"crypto_method","blowfish");
     else if (agt->crypto_method == W_METH_AES)
         cJSON_AddStringToObject(client,"crypto_method","aes");
+    else if (agt->crypto_method == W_METH_AES_GCM)
+        cJSON_AddStringToObject(client,"crypto_method","aes-gcm");
     if (agt->server) {
         cJSON *servers = cJSON_CreateArray();
         for (i=0;agt->server[i].rip;i++) {
@@ -14,32 +14,86 @@
 #include "sec.h"
 
 
+/* Events taken from the shared rings per call, so the receiver isn't starved */
+#define FORWARD_SHM_EVENTS 1024
+
+/* Shared-memory rings of the local queue, written by the agent modules */
+static w_shm_queue_t * forward_shm;
+
+/* Store an event in the buffer, or send it right away if there is none */
+static int forward_event(const char * msg, ssize_t length)
+{
+    if (agt->buffer) {
+        return buffer_append(msg, length);
+    }
+
+    agent_state.msg_count++;
+    w_metrics_inc(agent_metric_msg_count);
+
+    return send_msg(msg, length);
+}
+
+/* Offer shared-memory rings to the agent modules. A segment left by a
+ * previous run is dropped anyway, so nobody keeps writing into it */
+void EventForwardInit()
+{
+    if (getDefine_Int("agent", "shm_queue", 0, 1)) {
+        forward_shm = shm_queue_create(DEFAULTQPATH SHM_QUEUE_SUFFIX, (size_t)getDefine_Int("agent", "shm_queue_size", 128, 65536) * 1024);
+    } else {
+        shm_queue_unlink(DEFAULTQPATH SHM_QUEUE_SUFFIX);
+    }
+}
+
 /* Receive a message locally on the agent and forward it to the manager */
-void *EventForward()
+int EventForward()
 {
 
     ssize_t recv_b;
     char msg[OS_MAXSTR + 1];
+    const char * event;
+    size_t length;
+    int i;
 
     /* Initialize variables */
     msg[0] = '\0';
     msg[OS_MAXSTR] = '\0';
 
-    while ((recv_b = recv(agt->m_queue, msg, OS_MAXSTR, MSG_DONTWAIT)) > 0) {
+    /* An empty datagram is a producer waking us up to read the rings */
+    while ((recv_b = recv(agt->m_queue, msg, OS_MAXSTR, MSG_DONTWAIT)) >= 0) {
+        if (recv_b == 0) {
+            continue;
+        }
+
         msg[recv_b] = '\0';
-        if (agt->buffer){
-            if (buffer_append(msg) < 0) {
-                break;
+
+        if (forward_event(msg, recv_b) < 0) {
+            break;
+        }
+    }
+
+    if (!forward_shm) {
+        return 0;
+    }
+
+    /* Once the rings are empty we are parked: the next event comes with a wake-up datagram */
+    for (i = 0; i < FORWARD_SHM_EVENTS; i++) {
+        if (agt->buffer) {
+            /* The buffer copies the event straight from the ring */
+            if (event = shm_queue_peek(forward_shm, msg, sizeof(msg), &length), !event) {
+                return 0;
             }
-        }else{
-            agent_state.msg_count++;
 
-            if (send_msg(msg, -1) < 0) {
-                break;
+            buffer_append(event, length);
+            shm_queue_release(forward_shm);
+        } else {
+            /* The sender may log the event, so it gets a string */
+            if (length = shm_queue_recv(forward_shm, msg, sizeof(msg)), !length) {
+                return 0;
             }
-        }
 
+            forward_event(msg, length);
+        }
     }
 
-    return (NULL);
+    return 1;
 }
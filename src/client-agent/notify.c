@@ -15,9 +15,43 @@
 
 static time_t g_saved_time = 0;
 
+/* Checksums of the files in merged.mg, as "<md5> <name>\n" lines, or "" if they don't fit */
+static char *list_merged(const char *path)
+{
+    merged_sum_t *sums;
+    char *tag;
+    char *list;
+    size_t length = 0;
+    int i;
+
+    if (sums = OS_MD5_Merged(path, &tag, OS_TEXT), !sums) {
+        return strdup("");
+    }
+
+    os_calloc(SHARED_LIST_MAX + 1, sizeof(char), list);
+
+    for (i = 0; sums[i].name; i++) {
+        size_t size = strlen(sums[i].sum) + strlen(sums[i].name) + 2;
+
+        if (length + size > SHARED_LIST_MAX) {
+            mdebug1("Too many shared files to list them in the keep-alive.");
+            list[0] = '\0';
+            break;
+        }
+
+        length += snprintf(list + length, SHARED_LIST_MAX + 1 - length, "%s %s\n", sums[i].sum, sums[i].name);
+    }
+
+    OS_MD5_Merged_Free(sums);
+    free(tag);
+    return list;
+}
+
 /* Return the names of the files in a directory */
 char *getsharedfiles()
 {
+    static os_md5 listed_sum;
+    static char *listed;
     unsigned int m_size = 512;
     char *ret;
     os_md5 md5sum;
@@ -27,6 +61,23 @@ char *getsharedfiles()
         md5sum[1] = '\0';
     }
 
+    /* List the files in merged.mg, so the manager may send only the changed ones.
+     * This is done again only when it changes.
+     */
+    if (strcmp(md5sum, listed_sum) != 0) {
+        os_free(listed);
+        listed = md5sum[0] == 'x' ? strdup("") : list_merged(SHAREDCFG_FILEPATH);
+
+        if (!listed) {
+            merror(MEM_ERROR, errno, strerror(errno));
+            return (NULL);
+        }
+
+        strncpy(listed_sum, md5sum, sizeof(os_md5));
+    }
+
+    m_size += strlen(listed);
+
     /* We control these files, max size is m_size */
     ret = (char *)calloc(m_size + 1, sizeof(char));
     if (!ret) {
@@ -34,11 +85,138 @@ char *getsharedfiles()
         return (NULL);
     }
 
-    snprintf(ret, m_size, "%s merged.mg\n", md5sum);
+    snprintf(ret, m_size, "%s merged.mg\n%s", md5sum, listed);
 
     return (ret);
 }
 
+/* Rebuild merged.mg from the shared files, as listed by the manager.
+ * The files that aren't listed are removed. If the result doesn't match,
+ * merged.mg is removed so that the manager sends it whole.
+ */
+int shared_rebuild(char *manifest)
+{
+    char tmp_path[PATH_MAX];
+    char path[PATH_MAX];
+    char buf[OS_SIZE_2048 + 1];
+    char *names;
+    char *tag;
+    char *name;
+    char *end;
+    os_md5 md5sum;
+    FILE *fp;
+    FILE *part;
+    DIR *dir;
+    struct dirent *entry;
+    size_t length;
+    size_t n;
+
+    if (tag = strchr(manifest, '\n'), !tag) {
+        merror("Invalid shared file list from the manager.");
+        return 0;
+    }
+
+    *tag++ = '\0';
+
+    if (names = strchr(tag, '\n'), !names) {
+        merror("Invalid shared file list from the manager.");
+        return 0;
+    }
+
+    /* names keeps its leading newline, to look up "\n<name>\n" */
+    *names = '\0';
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", SHAREDCFG_FILEPATH);
+
+    if (fp = fopen(tmp_path, "w"), !fp) {
+        merror(FOPEN_ERROR, tmp_path, errno, strerror(errno));
+        return 0;
+    }
+
+    if (*tag) {
+        fprintf(fp, "#%s\n", tag);
+    }
+
+    /* Same layout as MergeAppendFile() */
+    for (name = names + 1; *name; name = end + 1) {
+        if (end = strchr(name, '\n'), !end) {
+            break;
+        }
+
+        *end = '\0';
+
+        if (strchr(name, '/') || strchr(name, '\\') || name[0] == '.') {
+            merror("Invalid shared file name from the manager: '%s'", name);
+            *end = '\n';
+            goto end;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", SHAREDCFG_DIRPATH, name);
+
+        if (part = fopen(path, "r"), !part) {
+            mdebug1(FOPEN_ERROR, path, errno, strerror(errno));
+            *end = '\n';
+            goto end;
+        }
+
+        for (length = 0; n = fread(buf, 1, sizeof(buf) - 1, part), n > 0; length += n);
+
+        rewind(part);
+        fprintf(fp, "!%ld %s\n", (long)length, name);
+
+        while (n = fread(buf, 1, sizeof(buf) - 1, part), n > 0) {
+            fwrite(buf, n, 1, fp);
+        }
+
+        fclose(part);
+        *end = '\n';
+    }
+
+    fclose(fp);
+    fp = NULL;
+
+    if (OS_MD5_File(tmp_path, md5sum, OS_TEXT) != 0 || strcmp(md5sum, manifest) != 0) {
+        mdebug1("Shared files don't match '%s' after the update: it will be sent again.", SHAREDCFG_FILENAME);
+        goto end;
+    }
+
+    if (rename_ex(tmp_path, SHAREDCFG_FILEPATH) < 0) {
+        goto end;
+    }
+
+    /* Remove the files that are gone from the group */
+    *names = '\n';
+
+    if (dir = opendir(SHAREDCFG_DIRPATH), dir) {
+        while (entry = readdir(dir), entry) {
+            snprintf(buf, sizeof(buf), "\n%s\n", entry->d_name);
+
+            if (entry->d_name[0] == '.' || strcmp(entry->d_name, SHAREDCFG_FILENAME) == 0 || strstr(names, buf)) {
+                continue;
+            }
+
+            snprintf(path, sizeof(path), "%s/%s", SHAREDCFG_DIRPATH, entry->d_name);
+
+            if (!IsFile(path)) {
+                mdebug2("Removing shared file '%s'.", path);
+                unlink(path);
+            }
+        }
+
+        closedir(dir);
+    }
+
+    return 1;
+
+end:
+    if (fp) {
+        fclose(fp);
+    }
+
+    unlink(tmp_path);
+    unlink(SHAREDCFG_FILEPATH);
+    return 0;
+}
+
 #ifndef WIN32
 char *get_agent_ip()
 {
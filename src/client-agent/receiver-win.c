@@ -159,6 +159,18 @@ void *receiver_thread(__attribute__((unused)) void *none)
                     continue;
                 }
 
+                /* The server takes batches of events */
+                else if (strcmp(tmp_msg, HC_BATCH) == 0) {
+                    buffer_batch_enable(1);
+                    continue;
+                }
+
+                /* Rate credit from the server */
+                else if (strncmp(tmp_msg, HC_CREDIT, strlen(HC_CREDIT)) == 0) {
+                    buffer_credit(atoi(tmp_msg + strlen(HC_CREDIT)));
+                    continue;
+                }
+
                 // Request from manager (or request ack)
                 else if (IS_REQ(tmp_msg)) {
                     req_push(tmp_msg + strlen(HC_REQUEST), msg_length - strlen(HC_REQUEST) - 3);
@@ -277,6 +289,19 @@ void *receiver_thread(__attribute__((unused)) void *none)
                     }
                 }
 
+                /* Changed shared files were sent: rebuild merged.mg */
+                else if (strncmp(tmp_msg, FILE_MANIFEST_HEADER,
+                                 strlen(FILE_MANIFEST_HEADER)) == 0) {
+                    if (shared_rebuild(tmp_msg + strlen(FILE_MANIFEST_HEADER)) && agt->flags.remote_conf && !verifyRemoteConf()) {
+                        if (agt->flags.auto_restart) {
+                            minfo("Agent is restarting due to shared configuration changes.");
+                            restartAgent();
+                        } else {
+                            minfo("Shared agent configuration has been updated.");
+                        }
+                    }
+                }
+
                 else {
                     mwarn("Unknown message received from server.");
                 }
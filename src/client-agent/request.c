@@ -38,6 +38,16 @@ int max_attempts;
 
 static OSHash * allowed_sockets;
 
+#ifndef WIN32
+// Connection to a local component, kept between requests
+typedef struct req_conn_t {
+    int sock;
+} req_conn_t;
+
+// Connections by target. Only the receiver thread uses it.
+static OSHash * req_conns;
+#endif
+
 // Initialize request module
 void req_init() {
     int success = 0;
@@ -66,6 +76,12 @@ void req_init() {
 
     os_calloc(request_pool, sizeof(req_node_t *), req_pool);
 
+#ifndef WIN32
+    if (req_conns = OSHash_Create(), !req_conns) {
+        merror_exit("At req_main(): OSHash_Create()");
+    }
+#endif
+
     // Create hash table allowed sockets
 
     if (allowed_sockets = OSHash_Create(), !allowed_sockets) {
@@ -110,7 +126,6 @@ int req_push(char * buffer, size_t length) {
     char * target;
     char * payload;
     char response[REQ_RESPONSE_LENGTH];
-    int sock = -1;
     int error;
     req_node_t * node;
 
@@ -144,32 +159,6 @@ int req_push(char * buffer, size_t length) {
         *(payload++) = '\0';
         length -= (payload - buffer);
 
-#ifndef WIN32
-
-        if (strcmp(target, "agent")) {
-            char sockname[PATH_MAX];
-            snprintf(sockname, PATH_MAX, DEFAULTDIR "/queue/ossec/%s", target);
-
-            if (sock = OS_ConnectUnixDomain(sockname, SOCK_STREAM, OS_MAXSTR), sock < 0) {
-                switch (errno) {
-                case ECONNREFUSED:
-                    merror("At req_push(): Target '%s' refused connection. The component might be disabled", target);
-                    break;
-
-                default:
-                    merror("At req_push(): Could not connect to socket '%s': %s (%d).", target, strerror(errno), errno);
-                }
-
-                // Example: #!-req 16 err Permission denied
-                snprintf(response, REQ_RESPONSE_LENGTH, CONTROL_HEADER HC_REQUEST "%s err %s", counter, strerror(errno));
-                send_msg(response, -1);
-
-                return -1;
-            }
-        }
-
-#endif
-
         // Send ACK, only in UDP mode
 
         if (agt->server[agt->rip_id].protocol == IPPROTO_UDP) {
@@ -180,7 +169,7 @@ int req_push(char * buffer, size_t length) {
         }
 
         // Create and insert node
-        node = req_create(sock, counter, target, payload, length);
+        node = req_create(-1, counter, target, payload, length);
         w_mutex_lock(&mutex_table);
         error = OSHash_Add(req_table, counter, node);
         w_mutex_unlock(&mutex_table);
@@ -225,157 +214,294 @@ int req_push(char * buffer, size_t length) {
     return 0;
 }
 
-// Request receiver thread start
-void * req_receiver(__attribute__((unused)) void * arg) {
+#ifndef WIN32
+
+// Connect to the socket of a local component
+static int req_connect(const char * target) {
+    char sockname[PATH_MAX];
+    int sock;
+
+    snprintf(sockname, PATH_MAX, DEFAULTDIR "/queue/ossec/%s", target);
+
+    if (sock = OS_ConnectUnixDomain(sockname, SOCK_STREAM, OS_MAXSTR), sock < 0) {
+        int error = errno;
+
+        switch (error) {
+        case ECONNREFUSED:
+            merror("At req_connect(): Target '%s' refused connection. The component might be disabled", target);
+            break;
+
+        default:
+            merror("At req_connect(): Could not connect to socket '%s': %s (%d).", target, strerror(errno), errno);
+        }
+
+        errno = error;
+    }
+
+    return sock;
+}
+
+// Drop the connection to a target, so that the next request opens a new one
+static void req_conn_drop(const char * target) {
+    req_conn_t * conn;
+
+    if (conn = OSHash_Delete(req_conns, target), conn) {
+        close(conn->sock);
+        free(conn);
+    }
+}
+
+/* Send a request through the connection to its target, opening it if there is none.
+ * A connection kept from a previous request may have been closed by a component
+ * that restarted since then: in that case, the request is sent once more through
+ * a new connection. Return the connection, or NULL on error (buffer gets the answer).
+ */
+static req_conn_t * req_send(req_node_t * node, char * buffer) {
+    req_conn_t * conn;
+    int sock;
+
+    if (conn = OSHash_Get(req_conns, node->target), conn) {
+        if (OS_SendSecureTCP(conn->sock, node->length, node->buffer) == 0) {
+            return conn;
+        }
+
+        mdebug1("Connection to '%s' is no longer valid. Reconnecting.", node->target);
+        req_conn_drop(node->target);
+    }
+
+    if (sock = req_connect(node->target), sock < 0) {
+        snprintf(buffer, OS_MAXSTR, "err %s", strerror(errno));
+        return NULL;
+    }
+
+    if (OS_SendSecureTCP(sock, node->length, node->buffer) != 0) {
+        merror("OS_SendSecureTCP(): %s", strerror(errno));
+        strcpy(buffer, "err Send data");
+        close(sock);
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(req_conn_t), conn);
+    conn->sock = sock;
+
+    if (OSHash_Add(req_conns, node->target, conn) != 2) {
+        // Serve this request, but don't keep the connection
+        merror("At req_send(): OSHash_Add()");
+        conn->sock = -1;
+        node->sock = sock;
+    }
+
+    return conn;
+}
+
+// Get the answer to a request sent by req_send(). Return its length.
+static ssize_t req_recv(req_node_t * node, req_conn_t * conn, char * buffer) {
+    int kept = conn->sock >= 0;
+    ssize_t length;
+
+    switch (length = OS_RecvSecureTCP(kept ? conn->sock : node->sock, buffer, OS_MAXSTR), length) {
+    case -1:
+        merror("recv(): %s", strerror(errno));
+        strcpy(buffer,"err Receive data");
+        break;
+
+    case 0:
+        // The component answered nothing, or closed the connection: the next send will tell
+        mdebug1("Empty message from local client.");
+        strcpy(buffer,"err Empty response");
+        break;
+
+    case OS_SOCKTERR:
+        mdebug1("Maximum buffer length reached.");
+        strcpy(buffer,"err Maximum buffer length reached");
+        break;
+
+    default:
+        buffer[length] = '\0';
+    }
+
+    if (!kept) {
+        free(conn);
+    } else if (length < 0) {
+        // The stream is out of sync: don't read another answer from it
+        req_conn_drop(node->target);
+    }
+
+    return length > 0 ? length : (ssize_t)strlen(buffer);
+}
+
+#endif
+
+// Send the answer to a request back to the manager, and release the request
+static void req_reply(req_node_t * node, char * buffer, ssize_t length) {
     int attempts;
     long nsec;
-    ssize_t length = 0;
-    req_node_t * node;
-    char *buffer = NULL;
     char response[REQ_RESPONSE_LENGTH];
     int rlen;
 
+    if (length <= 0) {
+        // Build error string
+        strcpy(buffer,"err Disconnected");
+        length = strlen(buffer);
+    }
 
+    // Build response string
+    // Example: #!-req 16 Hello World
+    rlen = snprintf(response, REQ_RESPONSE_LENGTH, CONTROL_HEADER HC_REQUEST "%s ", node->counter);
+    length += rlen;
+    os_realloc(buffer, length + 1, buffer);
+    memmove(buffer + rlen, buffer, length - rlen);
+    memcpy(buffer, response, rlen);
+    buffer[length] = '\0';
 
-    while (1) {
+    mdebug2("req_receiver(): sending '%s' to server", buffer);
 
-        // Get next node from queue
+    w_mutex_lock(&node->mutex);
 
-        w_mutex_lock(&mutex_pool);
+    for (attempts = 0; attempts < max_attempts; attempts++) {
+        struct timespec timeout;
+        struct timeval now = { 0, 0 };
 
-        while (empty(pool_i, pool_j)) {
-            w_cond_wait(&pool_available, &mutex_pool);
+        // Try to send message
+
+        if (send_msg(buffer, length)) {
+            merror("Sending response to manager.");
+            break;
         }
 
-        node = req_pool[pool_j];
-        forward(pool_j, request_pool);
-        w_mutex_unlock(&mutex_pool);
+        // Wait for ACK, only in UDP mode
 
-        w_mutex_lock(&node->mutex);
-#ifdef WIN32
-        // In Windows, forward request to target socket
-        if (strncmp(node->target, "agent", 5) == 0) {
-            length = agcom_dispatch(node->buffer, &buffer);
-        } else if (strncmp(node->target, "logcollector", 12) == 0) {
-            length = lccom_dispatch(node->buffer, &buffer);
-        } else if (strncmp(node->target, "com", 3) == 0) {
-            length = wcom_dispatch(node->buffer, node->length, &buffer);
-        } else if (strncmp(node->target, "syscheck", 8) == 0) {
-            length = syscom_dispatch(node->buffer, &buffer);
-        } else if (strncmp(node->target, "wmodules", 8) == 0) {
-            length = wmcom_dispatch(node->buffer, &buffer);
+        if (agt->server[agt->rip_id].protocol == IPPROTO_UDP) {
+            gettimeofday(&now, NULL);
+            nsec = now.tv_usec * 1000 + rto_msec * 1000000;
+            timeout.tv_sec = now.tv_sec + rto_sec + nsec / 1000000000;
+            timeout.tv_nsec = nsec % 1000000000;
+
+            if (pthread_cond_timedwait(&node->available, &node->mutex, &timeout) == 0 && IS_ACK(node->buffer)) {
+                break;
+            }
         } else {
-            os_strdup("err Could not get requested section", buffer);
-            length = strlen(buffer);
-        }
-#else
-        // In Unix, forward request to target socket
-        if (strncmp(node->target, "agent", 5) == 0) {
-            length = agcom_dispatch(node->buffer, &buffer);
+            // TCP handles ACK by itself
+            break;
         }
-        else {
-            os_calloc(OS_MAXSTR, sizeof(char), buffer);
-            mdebug2("req_receiver(): sending '%s' to socket", node->buffer);
-
-            // Send data
-            if (OS_SendSecureTCP(node->sock, node->length, node->buffer) != 0) {
-                merror("OS_SendSecureTCP(): %s", strerror(errno));
-                strcpy(buffer,"err Send data");
-                length = strlen(buffer);
-            } else {
 
-                // Get response
-
-                switch (length = OS_RecvSecureTCP(node->sock, buffer,OS_MAXSTR), length) {
-                case -1:
-                    merror("recv(): %s", strerror(errno));
-                    strcpy(buffer,"err Receive data");
-                    length = strlen(buffer);
-                    break;
-
-                case 0:
-                    mdebug1("Empty message from local client.");
-                    strcpy(buffer,"err Empty response");
-                    length = strlen(buffer);
-                    break;
+        mdebug2("Timeout for waiting ACK from manager, resending.");
+    }
 
-                case OS_SOCKTERR:
-                    mdebug1("Maximum buffer length reached.");
-                    strcpy(buffer,"err Maximum buffer length reached");
-                    length = strlen(buffer);
-                    break;
+    if (attempts == max_attempts) {
+        merror("Couldn't send response to manager: number of attempts exceeded.");
+    }
 
-                default:
-                    buffer[length] = '\0';
-                }
-            }
-        }
+    w_mutex_unlock(&node->mutex);
 
-#endif
-        if (length <= 0) {
-            // Build error string
-            strcpy(buffer,"err Disconnected");
-            length = strlen(buffer);
-        }
+    // Delete node from hash table
+    w_mutex_lock(&mutex_table);
+    OSHash_Delete(req_table, node->counter);
+    w_mutex_unlock(&mutex_table);
 
-        // Build response string
-        // Example: #!-req 16 Hello World
-        rlen = snprintf(response, REQ_RESPONSE_LENGTH, CONTROL_HEADER HC_REQUEST "%s ", node->counter);
-        length += rlen;
-        os_realloc(buffer, length + 1, buffer);
-        memmove(buffer + rlen, buffer, length - rlen);
-        memcpy(buffer, response, rlen);
-        buffer[length] = '\0';
+    // Delete node
+    os_free(buffer);
+    req_free(node);
+}
 
+/* Request receiver thread start
+ *
+ * Requests are taken from the queue in batches where no two requests have the
+ * same target. On Unix, every request of a batch is sent before any answer is
+ * read, so that the components work on them at the same time. A component
+ * serves its connection in order, and gets one request at a time from us, so
+ * each answer matches the request it was read for.
+ */
+void * req_receiver(__attribute__((unused)) void * arg) {
+    ssize_t length = 0;
+    req_node_t ** batch;
+    char ** answer;
+    int count;
+    int i;
+    int j;
+#ifndef WIN32
+    req_conn_t ** conn;
 
-        mdebug2("req_receiver(): sending '%s' to server", buffer);
+    os_calloc(request_pool, sizeof(req_conn_t *), conn);
+#endif
 
-        for (attempts = 0; attempts < max_attempts; attempts++) {
-            struct timespec timeout;
-            struct timeval now = { 0, 0 };
+    os_calloc(request_pool, sizeof(req_node_t *), batch);
+    os_calloc(request_pool, sizeof(char *), answer);
 
-            // Try to send message
+    while (1) {
 
-            if (send_msg(buffer, length)) {
-                merror("Sending response to manager.");
-                break;
-            }
+        // Get next nodes from queue
 
-            // Wait for ACK, only in UDP mode
+        w_mutex_lock(&mutex_pool);
 
-            if (agt->server[agt->rip_id].protocol == IPPROTO_UDP) {
-                gettimeofday(&now, NULL);
-                nsec = now.tv_usec * 1000 + rto_msec * 1000000;
-                timeout.tv_sec = now.tv_sec + rto_sec + nsec / 1000000000;
-                timeout.tv_nsec = nsec % 1000000000;
+        while (empty(pool_i, pool_j)) {
+            w_cond_wait(&pool_available, &mutex_pool);
+        }
 
-                if (pthread_cond_timedwait(&node->available, &node->mutex, &timeout) == 0 && IS_ACK(node->buffer)) {
+        for (count = 0; !empty(pool_i, pool_j); count++) {
+            // Stop before a second request to the same target
+            for (j = 0; j < count; j++) {
+                if (strcmp(batch[j]->target, req_pool[pool_j]->target) == 0) {
                     break;
                 }
-            } else {
-                // TCP handles ACK by itself
+            }
+
+            if (j < count) {
                 break;
             }
 
-            mdebug2("Timeout for waiting ACK from manager, resending.");
+            batch[count] = req_pool[pool_j];
+            forward(pool_j, request_pool);
         }
 
-        if (attempts == max_attempts) {
-            merror("Couldn't send response to manager: number of attempts exceeded.");
-        }
+        w_mutex_unlock(&mutex_pool);
 
-        w_mutex_unlock(&node->mutex);
+#ifndef WIN32
+        // In Unix, forward every request to its target socket first
 
-        // Delete node from hash table
-        w_mutex_lock(&mutex_table);
-        OSHash_Delete(req_table, node->counter);
-        w_mutex_unlock(&mutex_table);
+        for (i = 0; i < count; i++) {
+            os_calloc(OS_MAXSTR, sizeof(char), answer[i]);
+            conn[i] = NULL;
 
-        // Delete node
-        os_free(buffer);
-        req_free(node);
-    }
+            if (strncmp(batch[i]->target, "agent", 5)) {
+                mdebug2("req_receiver(): sending '%s' to socket", batch[i]->buffer);
+                conn[i] = req_send(batch[i], answer[i]);
+            }
+        }
+#endif
 
+        for (i = 0; i < count; i++) {
+            req_node_t * node = batch[i];
+#ifdef WIN32
+            // In Windows, forward request to target socket
+            if (strncmp(node->target, "agent", 5) == 0) {
+                length = agcom_dispatch(node->buffer, &answer[i]);
+            } else if (strncmp(node->target, "logcollector", 12) == 0) {
+                length = lccom_dispatch(node->buffer, &answer[i]);
+            } else if (strncmp(node->target, "com", 3) == 0) {
+                length = wcom_dispatch(node->buffer, node->length, &answer[i]);
+            } else if (strncmp(node->target, "syscheck", 8) == 0) {
+                length = syscom_dispatch(node->buffer, &answer[i]);
+            } else if (strncmp(node->target, "wmodules", 8) == 0) {
+                length = wmcom_dispatch(node->buffer, &answer[i]);
+            } else {
+                os_strdup("err Could not get requested section", answer[i]);
+                length = strlen(answer[i]);
+            }
+#else
+            if (strncmp(node->target, "agent", 5) == 0) {
+                os_free(answer[i]);
+                length = agcom_dispatch(node->buffer, &answer[i]);
+            } else if (conn[i]) {
+                length = req_recv(node, conn[i], answer[i]);
+            } else {
+                length = strlen(answer[i]);
+            }
+#endif
+            req_reply(node, answer[i], length);
+            answer[i] = NULL;
+        }
+    }
 
     return NULL;
 }
@@ -50,6 +50,7 @@ int send_msg(const char *msg, ssize_t msg_length)
 
     if (!retval) {
         agent_state.msg_sent++;
+        w_metrics_inc(agent_metric_msg_sent);
     } else {
 #ifdef WIN32
         error = WSAGetLastError();
@@ -0,0 +1,248 @@
+/* Disk spillover for the agent buffer
+ * June 22, 2020
+ *
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * All right reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+#include "shared.h"
+#include "agentd.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+
+/* Events that don't fit in the buffer are appended to a sequence of segment
+ * files, as a 4-byte length followed by the event. The writer appends to the
+ * last segment and the reader maps the first one, so each event is read in
+ * place. A segment is removed once it has been read. At most SPILL_SEGMENTS
+ * exist at any time, which bounds the disk usage.
+ */
+
+static struct {
+    size_t segment_size;                    // Bytes per segment file, 0 if disabled
+    unsigned long long first;               // Segment being read
+    unsigned long long last;                // Segment being written
+    int open;                               // Segments exist (first..last)
+    int fd;                                 // Descriptor of the last segment
+    size_t written;                         // Bytes written into the last segment
+    size_t sealed[SPILL_SEGMENTS];          // Bytes written into each segment, by slot
+    char * map;                             // Mapping of the first segment, or NULL
+    size_t offset;                          // Read position in the first segment
+    size_t pending;                         // Record handed by spill_peek(), not released yet
+} spill = { .fd = -1 };
+
+static void spill_path(char path[PATH_MAX], unsigned long long segment) {
+    snprintf(path, PATH_MAX, "%s/%llu", BUFFER_SPILL_DIR, segment);
+}
+
+/* Remove segments left by a previous run */
+static void spill_clean() {
+    DIR * dir = opendir(BUFFER_SPILL_DIR);
+    struct dirent * entry;
+    char path[PATH_MAX];
+
+    if (!dir) {
+        return;
+    }
+
+    while (entry = readdir(dir), entry) {
+        if (entry->d_name[0] != '.') {
+            snprintf(path, PATH_MAX, "%s/%s", BUFFER_SPILL_DIR, entry->d_name);
+            unlink(path);
+        }
+    }
+
+    closedir(dir);
+}
+
+/* Create a segment with its final size, so it can be read through a single mapping */
+static int spill_create(unsigned long long segment) {
+    char path[PATH_MAX];
+    int fd;
+
+    spill_path(path, segment);
+
+    if (fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0640), fd < 0) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(fd, spill.segment_size) < 0) {
+        merror("Cannot set the size of buffer spill file '%s': %s (%d)", path, strerror(errno), errno);
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    spill.fd = fd;
+    spill.written = 0;
+    spill.sealed[segment % SPILL_SEGMENTS] = 0;
+    return 0;
+}
+
+/* Unmap and remove the first segment */
+static void spill_drop_first() {
+    char path[PATH_MAX];
+
+    if (spill.map) {
+        munmap(spill.map, spill.segment_size);
+        spill.map = NULL;
+    }
+
+    spill_path(path, spill.first);
+    unlink(path);
+    spill.offset = 0;
+}
+
+int spill_init(size_t size) {
+    if (size < SPILL_SEGMENTS * (size_t)OS_MAXSTR) {
+        return -1;
+    }
+
+    if (mkdir(BUFFER_SPILL_DIR, 0750) < 0 && errno != EEXIST) {
+        merror("Cannot create buffer spill directory '%s': %s (%d)", BUFFER_SPILL_DIR, strerror(errno), errno);
+        return -1;
+    }
+
+    spill_clean();
+    spill.segment_size = size / SPILL_SEGMENTS;
+    minfo("Agent buffer spills up to %zu MiB over '%s'.", size >> 20, BUFFER_SPILL_DIR);
+    return 0;
+}
+
+int spill_active() {
+    return spill.open;
+}
+
+int spill_push(const char * msg, size_t length) {
+    static int reported = 0;
+    uint32_t header = (uint32_t)length;
+
+    if (!spill.segment_size) {
+        return -1;
+    }
+
+    if (spill.open && spill.written + sizeof(header) + length > spill.segment_size) {
+        /* Seal the last segment and start the next one, if there is room for it */
+        if (spill.last - spill.first + 1 >= SPILL_SEGMENTS) {
+            if (!reported) {
+                mwarn("Agent buffer spill is full. Events will be dropped.");
+                reported = 1;
+            }
+
+            return -1;
+        }
+
+        spill.sealed[spill.last % SPILL_SEGMENTS] = spill.written;
+        close(spill.fd);
+        spill.fd = -1;
+
+        if (spill_create(spill.last + 1) < 0) {
+            /* The sealed segment is still readable: keep it as the last one */
+            return -1;
+        }
+
+        spill.last++;
+    } else if (!spill.open) {
+        if (spill_create(spill.last) < 0) {
+            return -1;
+        }
+
+        spill.first = spill.last;
+        spill.open = 1;
+    }
+
+    if (pwrite(spill.fd, &header, sizeof(header), spill.written) != (ssize_t)sizeof(header) ||
+        pwrite(spill.fd, msg, length, spill.written + sizeof(header)) != (ssize_t)length) {
+        merror("Cannot write into buffer spill file: %s (%d)", strerror(errno), errno);
+        return -1;
+    }
+
+    spill.written += sizeof(header) + length;
+    spill.sealed[spill.last % SPILL_SEGMENTS] = spill.written;
+    reported = 0;
+    return 0;
+}
+
+const char * spill_peek(size_t * length) {
+    uint32_t header;
+
+    while (spill.open) {
+        if (!spill.map) {
+            char path[PATH_MAX];
+            int fd;
+
+            spill_path(path, spill.first);
+
+            if (fd = open(path, O_RDONLY), fd < 0) {
+                merror(FOPEN_ERROR, path, errno, strerror(errno));
+                return NULL;
+            }
+
+            spill.map = mmap(NULL, spill.segment_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+
+            if (spill.map == MAP_FAILED) {
+                merror("Cannot map buffer spill file '%s': %s (%d)", path, strerror(errno), errno);
+                spill.map = NULL;
+                return NULL;
+            }
+        }
+
+        if (spill.offset < spill.sealed[spill.first % SPILL_SEGMENTS]) {
+            memcpy(&header, spill.map + spill.offset, sizeof(header));
+            spill.pending = sizeof(header) + header;
+            *length = header;
+            return spill.map + spill.offset + sizeof(header);
+        }
+
+        /* The first segment was read up */
+
+        if (spill.first == spill.last) {
+            close(spill.fd);
+            spill.fd = -1;
+            spill_drop_first();
+            spill.last++;
+            spill.open = 0;
+        } else {
+            spill_drop_first();
+            spill.first++;
+        }
+    }
+
+    return NULL;
+}
+
+void spill_release() {
+    spill.offset += spill.pending;
+    spill.pending = 0;
+}
+
+#else
+
+int spill_init(__attribute__((unused)) size_t size) {
+    mwarn("Agent buffer spill is not available on this system.");
+    return -1;
+}
+
+int spill_active() {
+    return 0;
+}
+
+int spill_push(__attribute__((unused)) const char * msg, __attribute__((unused)) size_t length) {
+    return -1;
+}
+
+const char * spill_peek(__attribute__((unused)) size_t * length) {
+    return NULL;
+}
+
+void spill_release() {
+}
+
+#endif /* WIN32 */
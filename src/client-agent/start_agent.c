@@ -170,6 +170,10 @@ void start_agent(int is_startup)
     return;
 #endif
 
+    /* A new server must offer batches and grant credit again */
+    buffer_batch_enable(0);
+    buffer_credit(100);
+
     while (1) {
         /* Send start up message */
         send_msg(msg, -1);
@@ -20,6 +20,14 @@ static int write_state();
 
 int interval;
 
+w_metric_t * agent_metric_msg_count;
+w_metric_t * agent_metric_msg_sent;
+
+void agent_metrics_init() {
+    agent_metric_msg_count = w_metrics_counter("wazuh_agent_events", "Events generated by the agent.", NULL);
+    agent_metric_msg_sent = w_metrics_counter("wazuh_agent_messages_sent", "Messages sent to the manager.", NULL);
+}
+
 void * state_main(__attribute__((unused)) void * args) {
     w_mutex_init(&state_mutex, NULL);
     interval = getDefine_Int("agent", "state_interval", 0, 86400);
@@ -26,6 +26,7 @@ typedef struct _agentlessd_entries {
     time_t current_state;
     int port;
     int error_flag;
+    int running;                /* Hosts of the entry being checked */
 
     char *type;
     char **server;
@@ -167,6 +167,9 @@ int Read_Client(const OS_XML *xml, XML_NODE node, void *d1, __attribute__((unuse
             }
             else if(strcmp(node[i]->content, "aes") == 0){
                 logr->crypto_method = W_METH_AES;
+            }
+            else if(strcmp(node[i]->content, "aes-gcm") == 0){
+                logr->crypto_method = W_METH_AES_GCM;
             }else{
                 merror(XML_VALUEERR, node[i]->element, node[i]->content);
                 return (OS_INVALID);
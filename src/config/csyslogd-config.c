@@ -25,6 +25,9 @@ int Read_CSyslog(XML_NODE node, void *config, __attribute__((unused)) void *conf
     const char *xml_syslog_group = "group";
     const char *xml_syslog_location = "location";
     const char *xml_syslog_use_fqdn = "use_fqdn";
+    const char *xml_syslog_protocol = "protocol";
+    const char *xml_syslog_ca_file = "ca_file";
+    int port_set = 0;
 
     struct SyslogConfig_holder *config_holder = (struct SyslogConfig_holder *)config;
     SyslogConfig **syslog_config = config_holder->data;
@@ -73,6 +76,7 @@ int Read_CSyslog(XML_NODE node, void *config, __attribute__((unused)) void *conf
             }
 
             syslog_config[s]->port = (unsigned int) atoi(node[i]->content);
+            port_set = 1;
         } else if (strcmp(node[i]->element, xml_syslog_server) == 0) {
             os_strdup(node[i]->content, syslog_config[s]->server);
         } else if (strcmp(node[i]->element, xml_syslog_id) == 0) {
@@ -144,6 +148,20 @@ int Read_CSyslog(XML_NODE node, void *config, __attribute__((unused)) void *conf
                 merror(XML_VALUEERR, node[i]->element, node[i]->content);
                 goto fail;
             }
+        } else if (strcmp(node[i]->element, xml_syslog_protocol) == 0) {
+            if (strcmp(node[i]->content, "udp") == 0) {
+                syslog_config[s]->protocol = CSYSLOG_UDP;
+            } else if (strcmp(node[i]->content, "tcp") == 0) {
+                syslog_config[s]->protocol = CSYSLOG_TCP;
+            } else if (strcmp(node[i]->content, "tls") == 0) {
+                syslog_config[s]->protocol = CSYSLOG_TLS;
+            } else {
+                merror(XML_VALUEERR, node[i]->element, node[i]->content);
+                goto fail;
+            }
+        } else if (strcmp(node[i]->element, xml_syslog_ca_file) == 0) {
+            os_free(syslog_config[s]->ca_file);
+            os_strdup(node[i]->content, syslog_config[s]->ca_file);
         } else if (strcmp(node[i]->element, xml_syslog_location) == 0) {
             os_calloc(1, sizeof(OSMatch), syslog_config[s]->location);
             if (!OSMatch_Compile(node[i]->content,
@@ -182,6 +200,11 @@ int Read_CSyslog(XML_NODE node, void *config, __attribute__((unused)) void *conf
         goto fail;
     }
 
+    /* Syslog over TLS has a port of its own */
+    if (syslog_config[s]->protocol == CSYSLOG_TLS && !port_set) {
+        syslog_config[s]->port = 6514;
+    }
+
     config_holder->data = syslog_config;
     return (0);
 
@@ -189,6 +212,7 @@ fail:
     i = 0;
     while (syslog_config[i]) {
         free(syslog_config[i]->server);
+        free(syslog_config[i]->ca_file);
 
         if (syslog_config[i]->group) {
             OSMatch_FreePattern(syslog_config[i]->group);
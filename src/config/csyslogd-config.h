@@ -13,6 +13,8 @@
 #ifndef CSYSLOGCONFIG_H
 #define CSYSLOGCONFIG_H
 
+typedef struct csyslog_output csyslog_output;
+
 /* Database config structure */
 typedef struct _SyslogConfig {
     unsigned int port;
@@ -21,11 +23,14 @@ typedef struct _SyslogConfig {
     unsigned int *rule_id;
     unsigned int priority;
     unsigned int use_fqdn;
+    unsigned int protocol;
     int socket;
 
     char *server;
+    char *ca_file;
     OSMatch *group;
     OSMatch *location;
+    csyslog_output *output;     /* Buffer of the TCP and TLS transports */
 } SyslogConfig;
 
 struct SyslogConfig_holder {
@@ -38,6 +43,11 @@ struct SyslogConfig_holder {
 #define JSON_CSYSLOG     2
 #define SPLUNK_CSYSLOG   3
 
+/* Syslog transports */
+#define CSYSLOG_UDP 0
+#define CSYSLOG_TCP 1   /* RFC 6587, octet counting */
+#define CSYSLOG_TLS 2   /* RFC 5425 */
+
 /* Syslog severities */
 #define SLOG_EMERG   0   /* system is unusable */
 #define SLOG_ALERT   1   /* action must be taken immediately */
@@ -18,6 +18,8 @@ typedef struct _DBConfig {
     unsigned int server_id;
     unsigned int error_count;
     unsigned int maxreconnect;
+    unsigned int batch_rows;
+    long flush_interval;
     unsigned int port;
 
     char *host;
@@ -130,6 +130,12 @@ int Read_Global(XML_NODE node, void *configp, void *mailp)
     const char *xml_mailnotify = "email_notification";
     const char *xml_logall = "logall";
     const char *xml_logall_json = "logall_json";
+    const char *xml_logall_level = "logall_level";
+    const char *xml_logall_ignore_decoder = "logall_ignore_decoder";
+    const char *xml_logall_ignore_location = "logall_ignore_location";
+    const char *xml_logall_ignore_label = "logall_ignore_label";
+    const char *xml_logall_sample = "logall_sample";
+    const char *xml_location = "location";
     const char *xml_integrity = "integrity_checking";
     const char *xml_rootcheckd = "rootkit_detection";
     const char *xml_hostinfo = "host_information";
@@ -359,6 +365,96 @@ int Read_Global(XML_NODE node, void *configp, void *mailp)
                 return (OS_INVALID);
             }
         }
+        /* Archive filters */
+        else if (strcmp(node[i]->element, xml_logall_level) == 0) {
+            if (!OS_StrIsNum(node[i]->content) || atoi(node[i]->content) > 16) {
+                merror(XML_VALUEERR, node[i]->element, node[i]->content);
+                return (OS_INVALID);
+            }
+
+            if (Config) {
+                Config->logall_level = (u_int8_t) atoi(node[i]->content);
+            }
+        } else if (strcmp(node[i]->element, xml_logall_ignore_decoder) == 0) {
+            if (Config) {
+                int n;
+
+                for (n = 0; Config->logall_ignore_decoders && Config->logall_ignore_decoders[n]; n++);
+
+                os_realloc(Config->logall_ignore_decoders, (n + 2) * sizeof(char *), Config->logall_ignore_decoders);
+                os_strdup(node[i]->content, Config->logall_ignore_decoders[n]);
+                Config->logall_ignore_decoders[n + 1] = NULL;
+            }
+        } else if (strcmp(node[i]->element, xml_logall_ignore_location) == 0) {
+            if (Config) {
+                int n;
+
+                for (n = 0; Config->logall_ignore_locations && Config->logall_ignore_locations[n]; n++);
+
+                os_realloc(Config->logall_ignore_locations, (n + 2) * sizeof(OSMatch *), Config->logall_ignore_locations);
+                os_calloc(1, sizeof(OSMatch), Config->logall_ignore_locations[n]);
+                Config->logall_ignore_locations[n + 1] = NULL;
+
+                if (!OSMatch_Compile(node[i]->content, Config->logall_ignore_locations[n], 0)) {
+                    merror(REGEX_COMPILE, node[i]->content, Config->logall_ignore_locations[n]->error);
+                    return (OS_INVALID);
+                }
+            }
+        } else if (strcmp(node[i]->element, xml_logall_ignore_label) == 0) {
+            char *value = strchr(node[i]->content, ':');
+
+            if (!value || value == node[i]->content) {
+                merror(XML_VALUEERR, node[i]->element, node[i]->content);
+                return (OS_INVALID);
+            }
+
+            if (Config) {
+                label_flags_t flags = { .hidden = 0, .system = 0 };
+                size_t n;
+
+                for (n = 0; Config->logall_ignore_labels && Config->logall_ignore_labels[n].key; n++);
+
+                *value = '\0';
+                Config->logall_ignore_labels = labels_add(Config->logall_ignore_labels, &n, node[i]->content, value + 1, flags, 0);
+                *value = ':';
+            }
+        } else if (strcmp(node[i]->element, xml_logall_sample) == 0) {
+            const char *location = NULL;
+            int j;
+
+            if (!OS_StrIsNum(node[i]->content) || atoi(node[i]->content) < 1) {
+                merror(XML_VALUEERR, node[i]->element, node[i]->content);
+                return (OS_INVALID);
+            }
+
+            for (j = 0; node[i]->attributes && node[i]->attributes[j]; j++) {
+                if (strcmp(node[i]->attributes[j], xml_location) == 0) {
+                    location = node[i]->values[j];
+                } else {
+                    merror(XML_INVATTR, node[i]->attributes[j], node[i]->element);
+                    return (OS_INVALID);
+                }
+            }
+
+            if (Config) {
+                int n;
+
+                for (n = 0; Config->logall_samples && Config->logall_samples[n].rate; n++);
+
+                os_realloc(Config->logall_samples, (n + 2) * sizeof(logall_sample_t), Config->logall_samples);
+                memset(Config->logall_samples + n, 0, 2 * sizeof(logall_sample_t));
+                Config->logall_samples[n].rate = (unsigned int) atoi(node[i]->content);
+
+                if (location) {
+                    os_calloc(1, sizeof(OSMatch), Config->logall_samples[n].location);
+
+                    if (!OSMatch_Compile(location, Config->logall_samples[n].location, 0)) {
+                        merror(REGEX_COMPILE, location, Config->logall_samples[n].location->error);
+                        return (OS_INVALID);
+                    }
+                }
+            }
+        }
         /* Compress alerts */
         else if (strcmp(node[i]->element, xml_compress_alerts) == 0) {
             /* removed from here -- compatibility issues only */
@@ -13,10 +13,24 @@
 
 #include "shared.h"
 
+/* Archive sampling of the events from some locations */
+typedef struct logall_sample_t {
+    OSMatch *location;          // NULL for any location
+    unsigned int rate;          // One event out of rate is archived
+} logall_sample_t;
+
 /* Configuration structure */
 typedef struct __Config {
     u_int8_t logall;
     u_int8_t logall_json;
+
+    /* Archive filters */
+    u_int8_t logall_level;                  // Minimum level of the rule matched, 0 for events that match none
+    char **logall_ignore_decoders;          // Decoders whose events are not archived
+    OSMatch **logall_ignore_locations;      // Locations whose events are not archived
+    wlabel_t *logall_ignore_labels;         // Agent labels (usually set per group) whose events are not archived
+    logall_sample_t *logall_samples;        // Sampling by location, the first match applies. Ended by a zero rate
+
     u_int8_t stats;
     u_int8_t integrity;
     u_int8_t syscheck_auto_ignore;
@@ -101,6 +115,18 @@ typedef struct __Config {
     int label_cache_maxage;
     int show_hidden_labels;
 
+    /* Send the inventory and FIM database updates in batches */
+    int wdb_batch;
+
+    /* Write the archives and the alerts as gzip streams */
+    int archives_compress;
+    int alerts_compress;
+
+    /* Output buffer of every log, in KiB, and maximum time in milliseconds
+     * that an alert may wait in it before being written */
+    int log_buffer_size;
+    int log_flush_interval;
+
     // Cluster configuration
     char *cluster_name;
     char *node_name;
@@ -17,6 +17,8 @@
 #define ARGV0 "ossec-integrator"
 #endif
 
+typedef struct integrator_http integrator_http;
+
 /* Integrator Config Structure */
 typedef struct _IntegratorConfig
 {
@@ -32,6 +34,7 @@ typedef struct _IntegratorConfig
     char *alert_format;
     char *group;
     OSMatch *location;
+    integrator_http *http;      /* Built-in delivery, or NULL to run the script */
 }IntegratorConfig;
 
 #endif /* CINTEGRATORCONFIG_H */
@@ -37,6 +37,8 @@ int Read_Localfile(XML_NODE node, void *d1, __attribute__((unused)) void *d2)
     const char *xml_localfile_age = "age";
     const char *xml_localfile_exclude = "exclude";
     const char *xml_localfile_binaries = "ignore_binaries";
+    const char *xml_localfile_ignore = "ignore";
+    const char *xml_localfile_duplicates = "suppress_duplicates";
 
     logreader *logf;
     logreader_config *log_config;
@@ -309,6 +311,28 @@ int Read_Localfile(XML_NODE node, void *d1, __attribute__((unused)) void *d2)
                 os_free(logf[pl].exclude);
             }
             os_strdup(node[i]->content, logf[pl].exclude);
+        } else if (strcmp(node[i]->element, xml_localfile_ignore) == 0) {
+            int n;
+
+            for (n = 0; logf[pl].ignore && logf[pl].ignore[n]; n++);
+
+            os_realloc(logf[pl].ignore, (n + 2) * sizeof(OSMatch *), logf[pl].ignore);
+            os_calloc(1, sizeof(OSMatch), logf[pl].ignore[n]);
+            logf[pl].ignore[n + 1] = NULL;
+
+            if (!OSMatch_Compile(node[i]->content, logf[pl].ignore[n], 0)) {
+                merror(REGEX_COMPILE, node[i]->content, logf[pl].ignore[n]->error);
+                return (OS_INVALID);
+            }
+        } else if (strcmp(node[i]->element, xml_localfile_duplicates) == 0) {
+            if (strcmp(node[i]->content, "yes") == 0) {
+                logf[pl].suppress_duplicates = 1;
+            } else if (strcmp(node[i]->content, "no") == 0) {
+                logf[pl].suppress_duplicates = 0;
+            } else {
+                merror(XML_VALUEERR, node[i]->element, node[i]->content);
+                return (OS_INVALID);
+            }
         } else if (strcasecmp(node[i]->element, xml_localfile_alias) == 0) {
             os_strdup(node[i]->content, logf[pl].alias);
         } else if (!strcmp(node[i]->element, xml_localfile_age)) {
@@ -569,6 +593,7 @@ void Free_Localfile(logreader_config * config){
                     Free_Logreader(config->globs[i].gfiles);
                     for (j = 1; config->globs[i].gfiles[j].file; j++) {
                         free(config->globs[i].gfiles[j].file);
+                        free(config->globs[i].gfiles[j].repeat.line);
                     }
                 }
                 free(config->globs[i].gfiles);
@@ -590,6 +615,16 @@ void Free_Logreader(logreader * logf) {
         free(logf->alias);
         free(logf->query);
         free(logf->exclude);
+        free(logf->repeat.line);
+
+        if (logf->ignore) {
+            for (i = 0; logf->ignore[i]; i++) {
+                OSMatch_FreePattern(logf->ignore[i]);
+                free(logf->ignore[i]);
+            }
+
+            free(logf->ignore);
+        }
 
         if (logf->target) {
             for (i = 0; logf->target[i]; i++) {
@@ -599,7 +634,13 @@ void Free_Logreader(logreader * logf) {
             free(logf->target);
         }
 
-        free(logf->log_target);
+        if (logf->log_target) {
+            for (i = 0; logf->log_target[i].log_socket; i++) {
+                log_template_free(logf->log_target[i].compiled);
+            }
+
+            free(logf->log_target);
+        }
 
         labels_free(logf->labels);
 
@@ -21,6 +21,7 @@
 /* For ino_t */
 #include <sys/types.h>
 #include "labels_op.h"
+#include "os_regex/os_regex.h"
 
 extern int maximum_files;
 extern int total_files;
@@ -42,10 +43,19 @@ typedef struct _outformat {
 
 typedef struct _logtarget {
     char * format;
+    struct log_template_t * compiled;   // Format parsed on first use
     logsocket * log_socket;
 } logtarget;
 
 /* Logreader config */
+/* Duplicate suppression state of a file */
+typedef struct w_repeat_t {
+    char *line;                 // Last line queued
+    size_t size;                // Length of the last line
+    size_t allocated;
+    unsigned long count;        // Copies of the last line held back
+} w_repeat_t;
+
 typedef struct _logreader {
     off_t size;
     int ign;
@@ -79,6 +89,9 @@ typedef struct _logreader {
     logtarget * log_target;
     int duplicated;
     char *exclude;
+    OSMatch **ignore;           // Lines dropped before being queued
+    int suppress_duplicates;    // Identical consecutive lines are sent once, with a count
+    w_repeat_t repeat;
     wlabel_t *labels;
     pthread_mutex_t mutex;
     int exists;
@@ -89,6 +102,7 @@ typedef struct _logreader {
 
     FILE *fp;
     fpos_t position; // Pointer offset when closed
+    int watch;       // Watch descriptor of the open file, or -1 if it's polled
 } logreader;
 
 typedef struct _logreader_glob {
@@ -23,6 +23,8 @@ typedef struct _MailConfig {
     int strict_checking;
     int grouping;
     int subject_full;
+    int smtp_keepalive;
+    int queue_size;
     int priority;
     char **to;
     char *reply_to;
@@ -29,6 +29,8 @@ typedef struct _remoted {
 
     int m_queue;
     int sock;
+    int *tcp_socks;
+    int *udp_socks;
     int position;
     int nocmerged;
     socklen_t peer_size;
@@ -34,6 +34,9 @@ typedef struct _monitor_config {
     int keep_log_days;
     unsigned long size_rotate;
     int daily_rotations;
+    int compress_threads;
+    int compress_nice;
+    int compress_idle_io;
 
     char *smtpserver;
     char *emailfrom;
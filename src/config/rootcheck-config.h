@@ -38,6 +38,8 @@ typedef struct _rkconfig {
     int disabled;
     short skip_nfs;
     int tsleep;
+    int pid_threads;        /* Threads probing the PIDs missing from /proc (0: probe every PID) */
+    int scan_threads;       /* Threads reading the binaries of rootkit_trojans */
 
     int time;
     int queue;
@@ -41,6 +41,8 @@ typedef enum fdb_stmt {
     FIMDB_STMT_GET_COUNT_PATH,
     FIMDB_STMT_GET_COUNT_DATA,
     FIMDB_STMT_GET_INODE,
+    FIMDB_STMT_GET_ALL_CHECKSUMS,
+    FIMDB_STMT_GET_CHECKSUM_RANGE,
     FIMDB_STMT_SIZE
 } fdb_stmt;
 
@@ -118,6 +120,9 @@ typedef struct whodata_dir_status whodata_dir_status;
 typedef struct _rtfim {
     int fd;
     OSHash *dirtb;
+    radix_tree *dirpaths;   // Watch descriptor of each directory, by path
+    int fanotify;       // Filesystems are marked through fanotify_fd
+    int fanotify_fd;
 #ifdef WIN32
     HANDLE evt;
 #endif
@@ -238,6 +243,7 @@ typedef struct fim_entry_data {
     unsigned int scanned;
     int options;
     os_sha1 checksum;
+    unsigned int ctime;             // Not part of the checksum: only used to trust unchanged files
 } fim_entry_data;
 
 
@@ -271,6 +277,8 @@ typedef struct _config {
     int scan_on_start;
     int max_depth;                  /* max level of recursivity allowed */
     size_t file_max_size;           /* max file size for calculating hashes */
+    size_t diff_max_size;           /* max file size for in-process diffs (0: run diff) */
+    size_t diff_store_size;         /* quota of the snapshot store (0: a copy per file) */
 
     fs_set skip_fs;
     int rt_delay;                   /* Delay before real-time dispatching (ms) */
@@ -318,9 +326,18 @@ typedef struct _config {
     whodata_event_list w_clist; // List of events cached from Whodata mode in the last seconds
 #endif
     int max_audit_entries;          /* Maximum entries for Audit (whodata) */
+    int audit_queue_size;           /* Audit events read and waiting to be parsed, 0 to parse them on read */
     char **audit_key;               // Listen audit keys
     int audit_healthcheck;          // Startup health-check for whodata
     int sym_checker_interval;
+    int rehash_scans;               // Scheduled scans between full rehashes, 0 to never rehash unchanged files
+    int scan_threads;               // Workers of the scheduled scans, 1 to scan sequentially
+    int scan_hash_limit;            // Files hashed at the same time by the scan workers, 0 for no limit
+    int hash_drop_cache;            // Drop the pages of the hashed files from the page cache
+    int rt_fanotify;                // Monitor real-time directories through fanotify filesystem marks
+    int rt_max_watches;             // Real-time inotify watches budget, 0 for the system limit
+    int rt_debounce;                // Quiet time before checking a file after real-time events (ms), 0 to check right away
+    int rt_debounce_max;            // Maximum time to keep the events of a file (ms)
 
     pthread_mutex_t fim_entry_mutex;
     pthread_mutex_t fim_scan_mutex;
@@ -329,6 +346,7 @@ typedef struct _config {
     rtfim *realtime;
     fdb_t *database;
     int database_store;
+    int database_cache;             /* page cache of the memory database in MiB (0: unlimited) */
 
     char *prefilter_cmd;
     int process_priority; // Adjusts the priority of the process (or threads in Windows)
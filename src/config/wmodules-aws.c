@@ -19,6 +19,7 @@ static const char *XML_SECRET_KEY = "secret_key";
 static const char *XML_RUN_ON_START = "run_on_start";
 static const char *XML_REMOVE_FORM_BUCKET = "remove_from_bucket";
 static const char *XML_SKIP_ON_ERROR = "skip_on_error";
+static const char *XML_MAX_PARALLEL = "max_parallel";
 static const char *XML_AWS_PROFILE = "aws_profile";
 static const char *XML_IAM_ROLE_ARN = "iam_role_arn";
 static const char *XML_AWS_ORGANIZATION_ID = "aws_organization_id";
@@ -64,6 +65,7 @@ int wm_aws_read(const OS_XML *xml, xml_node **nodes, wmodule *module)
     aws_config->enabled = 1;
     aws_config->run_on_start = 1;
     aws_config->remove_from_bucket = 0;
+    aws_config->max_parallel = 1;
     sched_scan_init(&(aws_config->scan_config));
     aws_config->scan_config.interval = WM_AWS_DEFAULT_INTERVAL;
     module->context = &WM_AWS_CONTEXT;
@@ -103,6 +105,16 @@ int wm_aws_read(const OS_XML *xml, xml_node **nodes, wmodule *module)
                 merror("Invalid content for tag '%s' at module '%s'.", XML_SKIP_ON_ERROR, WM_AWS_CONTEXT.name);
                 return OS_INVALID;
             }
+        } else if (!strcmp(nodes[i]->element, XML_MAX_PARALLEL)) {
+            char * end;
+            long value = strtol(nodes[i]->content, &end, 10);
+
+            if (*end != '\0' || value < 1 || value > WM_AWS_MAX_PARALLEL) {
+                merror("Invalid content for tag '%s' at module '%s'.", XML_MAX_PARALLEL, WM_AWS_CONTEXT.name);
+                return OS_INVALID;
+            }
+
+            aws_config->max_parallel = value;
         } else if (!strcmp(nodes[i]->element, XML_REMOVE_FORM_BUCKET)) {
             if (!strcmp(nodes[i]->content, "yes"))
                 aws_config->remove_from_bucket = 1;
@@ -28,6 +28,10 @@ static const char *XML_KEEPALIVE = "keepalive";
 static const char *XML_COUNT = "count";
 static const char *XML_IDLE = "idle";
 static const char *XML_INTERVAL = "interval";
+static const char *XML_BATCH_SIZE = "batch_size";
+static const char *XML_COMPRESSION = "compression";
+static const char *XML_REQUIRE_ACK = "require_ack";
+static const char *XML_RETRY_BUFFER = "retry_buffer";
 
 static short eval_bool(const char *str)
 {
@@ -108,6 +112,8 @@ int wm_fluent_read(const OS_XML *xml, xml_node **nodes, wmodule *module)
         fluent->user_name = NULL;
         fluent->user_pass = NULL;
         fluent->poll_interval = 60;
+        fluent->batch_size = 256;
+        fluent->retry_buffer = 16;
         module->context = &WM_FLUENT_CONTEXT;
         module->tag = strdup(module->context->name);
         module->data = fluent;
@@ -274,6 +280,42 @@ int wm_fluent_read(const OS_XML *xml, xml_node **nodes, wmodule *module)
             } else {
                 mwarn("Invalid value '%s' for option '%s' at module '%s", nodes[i]->content, nodes[i]->element, WM_FLUENT_CONTEXT.name);
             }
+        } else if (!strcmp(nodes[i]->element, XML_BATCH_SIZE)) {
+            char * end;
+            int value = strtol(nodes[i]->content, &end, 10);
+
+            if (*end == '\0' && value > 0 && value <= 4096) {
+                fluent->batch_size = value;
+            } else {
+                mwarn("Invalid value '%s' for option '%s' at module '%s", nodes[i]->content, nodes[i]->element, WM_FLUENT_CONTEXT.name);
+            }
+        } else if (!strcmp(nodes[i]->element, XML_COMPRESSION)) {
+            int value = eval_bool(nodes[i]->content);
+
+            if (value == OS_INVALID) {
+                merror("Invalid content for tag '%s' at module '%s'.", XML_COMPRESSION, WM_FLUENT_CONTEXT.name);
+                return OS_INVALID;
+            }
+
+            fluent->compress = value;
+        } else if (!strcmp(nodes[i]->element, XML_REQUIRE_ACK)) {
+            int value = eval_bool(nodes[i]->content);
+
+            if (value == OS_INVALID) {
+                merror("Invalid content for tag '%s' at module '%s'.", XML_REQUIRE_ACK, WM_FLUENT_CONTEXT.name);
+                return OS_INVALID;
+            }
+
+            fluent->require_ack = value;
+        } else if (!strcmp(nodes[i]->element, XML_RETRY_BUFFER)) {
+            char * end;
+            int value = strtol(nodes[i]->content, &end, 10);
+
+            if (*end == '\0' && value > 0 && value <= 1024) {
+                fluent->retry_buffer = value;
+            } else {
+                mwarn("Invalid value '%s' for option '%s' at module '%s", nodes[i]->content, nodes[i]->element, WM_FLUENT_CONTEXT.name);
+            }
         } else if (strcmp(nodes[i]->element, XML_KEEPALIVE) == 0) {
             XML_NODE children = OS_GetElementsbyNode(xml, nodes[i]);
             wm_fluent_parse_keepalive(nodes[i], children, fluent);
@@ -87,6 +87,8 @@
 #define VU_END_SCAN           "(5472): Vulnerability scan finished."
 #define VU_NO_SRC_VERSION     "(5480): Unable to get the source '%s' version for agent '%.3d'"
 #define VU_NO_SRC_NAME        "(5481): Unable to get the source '%s' name for agent '%.3d'"
+#define VU_AG_FEEDS_UNCHANGED "(5482): The feeds of agent '%.3d' haven't changed since its last full scan"
+#define VU_FEED_NOT_MODIFIED  "(5483): The feed '%s' hasn't been modified since its last update"
 
 /* File integrity monitoring debug messages */
 #define FIM_DIFF_SKIPPED                    "(6200): Diff execution skipped for containing insecure characters."
@@ -0,0 +1,51 @@
+/*
+ * Placement of thread groups on CPU sets
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef AFFINITY_OP_H
+#define AFFINITY_OP_H
+
+#ifdef __linux__
+#include <sched.h>
+
+/**
+ * @brief Parse a CPU set.
+ *
+ * The set is either a CPU list, like "0-15,32-47", or a NUMA node, like "node:1".
+ *
+ * @param spec CPU set.
+ * @param set Output: parsed set.
+ * @return Number of CPUs in the set, or -1 if the set is invalid or empty.
+ */
+int w_cpuset_parse(const char * spec, cpu_set_t * set);
+#endif
+
+/**
+ * @brief Pin the calling thread to the CPU set of a thread group.
+ *
+ * The set is read from the internal option "<section>.cpu_set_<group>".
+ * An empty option leaves the thread where it is.
+ *
+ * Threads inherit the CPUs of their creator, so the threads of the group are
+ * created between this call and w_affinity_leave(). Memory first written in
+ * between, like the cells of a queue or the malloc arena of a new thread, is
+ * placed by the kernel on the NUMA node of those CPUs.
+ *
+ * @param section Section of the internal options.
+ * @param group Thread group, like "decode".
+ */
+void w_affinity_enter(const char * section, const char * group);
+
+/**
+ * @brief Restore the CPUs the calling thread had before the first w_affinity_enter().
+ */
+void w_affinity_leave(void);
+
+#endif /* AFFINITY_OP_H */
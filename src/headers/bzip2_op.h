@@ -15,6 +15,17 @@
 
 #define BZIP2_BUFFER_SIZE 4096
 
+typedef struct bzip2_file {
+    FILE *fp;
+    BZFILE *bz;                         // NULL if the file is read as is
+    char buffer[BZIP2_BUFFER_SIZE];
+    int length;
+    int offset;
+    unsigned int started:1;
+    unsigned int eof:1;
+    unsigned int error:1;
+} bzip2_file;
+
 /**
  * @brief bzpi2 library, function to compress
  *
@@ -37,4 +48,37 @@ int bzip2_compress(const char *file, const char *filebz2);
  */
 int bzip2_uncompress(const char *filebz2, const char *file);
 
+/**
+ * @brief Open a file to read it uncompressed, without writing it to disk.
+ *        Files that aren't compressed are read as is.
+ *
+ * @param file File path to read
+ *
+ * @return Reader of the file
+ * @retval NULL on error
+ */
+bzip2_file * bzip2_open(const char *file);
+
+/**
+ * @brief Read the next line of the uncompressed content, like fgets()
+ *
+ * @param str Buffer to store the line
+ * @param size Size of the buffer
+ * @param bzfile Reader of the file
+ *
+ * @return str
+ * @retval NULL at the end of the file or on error
+ */
+char * bzip2_gets(char *str, int size, bzip2_file *bzfile);
+
+/**
+ * @brief Close a reader
+ *
+ * @param bzfile Reader of the file
+ *
+ * @retval 0 if the file was read without errors
+ * @retval -1 if a read failed
+ */
+int bzip2_close(bzip2_file *bzfile);
+
 #endif /* BZIP2_OP_H */
@@ -13,6 +13,7 @@
 #define CLUSTER_UTILS_H_
 
 // Returns 1 if the node is a worker, 0 if it is not and -1 if error.
+// The configuration is read the first time only.
 int w_is_worker(void);
 
 // Returns the master node or "undefined" if any node is specified.
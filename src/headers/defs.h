@@ -196,9 +196,15 @@ https://www.gnu.org/licenses/gpl.html\n"
 /* Active Response queue */
 #define ARQUEUE         "/queue/alerts/ar"
 
+/* Shared ring of the JSON alerts */
+#define ALERTSQUEUE     "/queue/alerts/alerts.json.shm"
+
 /* Decoder file */
 #define XML_LDECODER    "etc/decoders/local_decoder.xml"
 
+/* Parse snapshots of the rule and decoder files */
+#define RULESET_CACHE   "queue/ruleset"
+
 /* Agent information location */
 #define AGENTINFO_DIR    "/queue/agent-info"
 #define AGENTINFO_DIR_PATH DEFAULTDIR "/queue/agent-info"
@@ -235,6 +241,13 @@ https://www.gnu.org/licenses/gpl.html\n"
 #define DIFF_NEW_FILE  "new-entry"
 #define DIFF_LAST_FILE "last-entry"
 #define DIFF_GZ_FILE "last-entry.gz"
+
+/* Agent buffer spill */
+#ifndef WIN32
+#define BUFFER_SPILL_DIR DEFAULTDIR "/queue/buffer"
+#else
+#define BUFFER_SPILL_DIR "queue/buffer"
+#endif
 #define DIFF_TEST_HOST "__test"
 
 /* Syscheck data */
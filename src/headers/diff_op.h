@@ -0,0 +1,91 @@
+/*
+ * In-process line diff
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef DIFF_OP_H
+#define DIFF_OP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Edits past which the rest of a difference is reported as a single change */
+#define W_DIFF_MAX_EDITS 1000
+
+/**
+ * @brief Text split in lines.
+ *
+ * Each line keeps its newline, so a last line without it differs from the
+ * same line with it, as in diff(1).
+ */
+typedef struct w_diff_text_t {
+    char * data;
+    size_t size;
+    size_t * lines;         ///< Offset of each line in data, and size at lines[count]
+    uint32_t * hashes;      ///< Hash of each line
+    size_t count;
+} w_diff_text_t;
+
+/**
+ * @brief Read a file, either plain or compressed with gzip.
+ *
+ * @param text Output: text of the file. Must be freed with w_diff_text_free().
+ * @param path Path of the file.
+ * @param max_size Maximum size of the uncompressed content.
+ * @return 0 on success, 1 if the content is bigger than max_size, -1 on error.
+ */
+int w_diff_text_load(w_diff_text_t * text, const char * path, size_t max_size);
+
+/**
+ * @brief Make a text of a buffer.
+ *
+ * @param text Output: text. Must be freed with w_diff_text_free().
+ * @param data Content, allocated with malloc. The text takes it.
+ * @param size Size of the content.
+ */
+void w_diff_text_set(w_diff_text_t * text, char * data, size_t size);
+
+/**
+ * @brief Write a text compressed with gzip.
+ *
+ * @param text Text.
+ * @param path Path of the file.
+ * @return 0 on success, -1 on error.
+ */
+int w_diff_text_save(const w_diff_text_t * text, const char * path);
+
+/**
+ * @brief Release a text.
+ *
+ * @param text Text.
+ */
+void w_diff_text_free(w_diff_text_t * text);
+
+/**
+ * @brief Check whether two texts have the same content.
+ *
+ * @return 1 if they are equal, 0 otherwise.
+ */
+int w_diff_text_equal(const w_diff_text_t * a, const w_diff_text_t * b);
+
+/**
+ * @brief Compare two texts line by line, with the normal output format of diff(1).
+ *
+ * The edit script is the shortest one (Myers) up to W_DIFF_MAX_EDITS edits.
+ * If either text has a NUL byte near its start, they are compared as binary.
+ *
+ * @param old Former text.
+ * @param new Current text.
+ * @param buffer Output: difference, empty if the texts are equal.
+ * @param size Size of the buffer.
+ * @return 0 if the whole difference fit in the buffer, 1 if it was cut after the last whole line that fit.
+ */
+int w_diff_lines(const w_diff_text_t * old, const w_diff_text_t * new, char * buffer, size_t size);
+
+#endif /* DIFF_OP_H */
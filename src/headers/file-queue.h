@@ -26,6 +26,12 @@ typedef struct _file_queue {
 
     FILE *fp;
     struct stat f_status;
+
+    /* JSON alerts: shared ring, and where its last alert ends in the file */
+    struct w_shm_bcast_t *ring;
+    int resync;
+    uint64_t mark_id;
+    uint64_t mark_offset;
 } file_queue;
 
 #include "read-alert.h"
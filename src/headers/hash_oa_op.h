@@ -0,0 +1,164 @@
+/*
+ * Open-addressing hash table
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 14, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef HASH_OA_OP_H
+#define HASH_OA_OP_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define OSHASHOA_GROUP 8
+
+/**
+ * @brief Slot of the table. The hash is kept to grow without hashing the keys again.
+ */
+typedef struct OSHashOASlot {
+    uint64_t hash;
+    char * key;
+    void * data;
+} OSHashOASlot;
+
+/**
+ * @brief Table of a stripe.
+ *
+ * Each slot has a control byte: 0x80 if empty, 0xFE if deleted, or the lower
+ * 7 bits of the hash if full. Probing looks at groups of 8 control bytes at
+ * once and only compares the keys whose hash bits match, so most lookups
+ * touch one group and one key.
+ */
+typedef struct OSHashOATable {
+    uint8_t * ctrl;
+    OSHashOASlot * slots;
+    unsigned int capacity;              ///< Number of slots, a power of two
+    unsigned int elements;
+    unsigned int growth_left;           ///< Empty slots that can be used before a rehash
+    pthread_rwlock_t mutex;
+} OSHashOATable;
+
+/**
+ * @brief Hash table with the interface of OSHash.
+ *
+ * Return codes match the functions of OSHash with the same name. The keys are
+ * split into stripes, each one with its own lock, so threads working on
+ * different keys rarely wait for each other. A table with no stripes has no
+ * locks at all and must be protected by the caller.
+ */
+typedef struct OSHashOA {
+    OSHashOATable * tables;
+    unsigned int n_stripes;             ///< 0 if the table is not locked
+    uint64_t seed;
+    void (*free_data_function)(void *data);
+} OSHashOA;
+
+/**
+ * @brief Hash a buffer into 64 bits.
+ *
+ * @param key Buffer.
+ * @param len Length of the buffer.
+ * @param seed Seed.
+ * @return Hash value.
+ */
+uint64_t w_hash64(const void * key, size_t len, uint64_t seed);
+
+/**
+ * @brief Create a table.
+ *
+ * @param n_stripes Number of locked stripes, or 0 for an unlocked table.
+ * @return New table.
+ */
+OSHashOA * OSHashOA_Create(unsigned int n_stripes);
+
+/**
+ * @brief Free a table, its keys and its data (if a free function was set).
+ *
+ * @param self Table.
+ */
+void OSHashOA_Free(OSHashOA * self);
+
+/**
+ * @brief Set the function to free the data on OSHashOA_Update() and OSHashOA_Free().
+ *
+ * @param self Table.
+ * @param free_data_function Function.
+ */
+void OSHashOA_SetFreeDataPointer(OSHashOA * self, void (*free_data_function)(void *));
+
+/**
+ * @brief Add a key.
+ *
+ * @param self Table.
+ * @param key Key, it is copied.
+ * @param data Data.
+ * @retval 2 if the key was added.
+ * @retval 1 if the key already existed (not added).
+ * @retval 0 on error.
+ */
+int OSHashOA_Add(OSHashOA * self, const char * key, void * data);
+
+/**
+ * @brief Add a key or replace its data.
+ *
+ * @param self Table.
+ * @param key Key, it is copied.
+ * @param data Data.
+ * @retval 2 if the key was added.
+ * @retval 1 if the key already existed (updated).
+ * @retval 0 on error.
+ */
+int OSHashOA_Set(OSHashOA * self, const char * key, void * data);
+
+/**
+ * @brief Replace the data of a key, freeing the old data.
+ *
+ * @param self Table.
+ * @param key Key.
+ * @param data Data.
+ * @retval 1 if the key was updated.
+ * @retval 0 if not found.
+ */
+int OSHashOA_Update(OSHashOA * self, const char * key, void * data);
+
+/**
+ * @brief Get the data of a key.
+ *
+ * @param self Table.
+ * @param key Key.
+ * @return Data, or NULL if not found.
+ */
+void * OSHashOA_Get(OSHashOA * self, const char * key);
+
+/**
+ * @brief Remove a key.
+ *
+ * @param self Table.
+ * @param key Key.
+ * @return Data of the key, which is not freed, or NULL if not found.
+ */
+void * OSHashOA_Delete(OSHashOA * self, const char * key);
+
+/**
+ * @brief Number of keys in the table.
+ *
+ * @param self Table.
+ * @return Number of keys.
+ */
+unsigned int OSHashOA_Get_Elem(OSHashOA * self);
+
+/**
+ * @brief Call a function for each key. The table must not be modified from it.
+ *
+ * @param self Table.
+ * @param arg Argument for the function.
+ * @param iterating_function Function, called with the key, its data and arg.
+ */
+void OSHashOA_It(OSHashOA * self, void * arg, void (*iterating_function)(const char * key, void * data, void * arg));
+
+#endif /* HASH_OA_OP_H */
@@ -32,6 +32,10 @@ typedef struct _OSHash {
 
     void (*free_data_function)(void *data);
     OSHashNode **table;
+
+    unsigned char rcu;              ///< Readers of the _ex functions take no lock
+    OSHashNode *retired;            ///< Deleted nodes that readers may still be visiting
+    unsigned int n_retired;
 } OSHash;
 
 /* Prototypes */
@@ -72,6 +76,15 @@ void *OSHash_Get_ins(const OSHash *self, const char *key) __attribute__((nonnull
 
 unsigned int OSHash_Get_Elem_ex(OSHash *self) __attribute__((nonnull));
 
+/*
+ * Read-optimized mode: OSHash_Get_ex() and its variants take no lock, so
+ * readers never write to shared memory. Writers still lock the table.
+ * Deleted nodes are freed after a grace period of the RCU thread domain.
+ * The size can't be changed afterwards, and OSHash_It() callbacks must not
+ * free nodes. Set it before the table is shared.
+ */
+void OSHash_SetRCU(OSHash *self) __attribute__((nonnull));
+
 int OSHash_setSize(OSHash *self, unsigned int new_size) __attribute__((nonnull));
 int OSHash_setSize_ex(OSHash *self, unsigned int new_size) __attribute__((nonnull));
 
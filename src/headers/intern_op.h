@@ -0,0 +1,46 @@
+/*
+ * String interning
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef INTERN_OP_H
+#define INTERN_OP_H
+
+/* Stripes of the table, each one with its own lock */
+#define W_INTERN_STRIPES 16
+
+/**
+ * @brief Get the shared copy of a string.
+ *
+ * Equal strings get the same pointer, so they can be compared by address.
+ * Each call takes a reference that must be given back with w_intern_release().
+ * It is thread-safe.
+ *
+ * @param str String.
+ * @return Shared copy, which must not be modified, or NULL if str is NULL.
+ */
+const char * w_intern(const char * str);
+
+/**
+ * @brief Release a reference taken by w_intern().
+ *
+ * The copy is freed when its last reference is released.
+ *
+ * @param str Shared copy, or NULL.
+ */
+void w_intern_release(const char * str);
+
+/**
+ * @brief Number of distinct strings held.
+ *
+ * @return Number of strings.
+ */
+unsigned int w_intern_count();
+
+#endif /* INTERN_OP_H */
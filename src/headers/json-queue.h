@@ -31,4 +31,29 @@ cJSON * jqueue_next(file_queue * queue);
 // Close queue
 void jqueue_close(file_queue * queue);
 
+// Fields of an alert that can be checked before parsing it
+typedef struct jqueue_fields_t {
+    int has_rule;
+    int has_level;
+    unsigned int level;
+    int has_rule_id;
+    unsigned int rule_id;
+    const char * groups;            // Raw "groups" array of the rule, NULL if missing
+    size_t groups_length;
+    int has_location;
+    char location[OS_SIZE_2048];    // Unescaped, and truncated if needed
+} jqueue_fields_t;
+
+// Returns nonzero if an alert must be parsed
+typedef int (*jqueue_filter_t)(const jqueue_fields_t * fields, void * arg);
+
+/*
+ * Like jqueue_next(), but the alerts that the filter rejects are not parsed.
+ * The fields are taken with a scan of the line that allocates nothing.
+ */
+cJSON * jqueue_next_filtered(file_queue * queue, jqueue_filter_t filter, void * arg);
+
+// Check if the rule of an alert has a group. Returns 1 if it has, or 0 if it hasn't.
+int jqueue_fields_group(const jqueue_fields_t * fields, const char * group, size_t length);
+
 #endif
@@ -22,6 +22,25 @@ int json_fwrite(const char * path, const cJSON * item);
 // Clear C/C++ style comments from a JSON string
 void json_strip(char * json);
 
+// Callback for each member of the object that json_scan_object() checks. The key is not unescaped
+typedef void (*json_member_cb)(const char * key, size_t length, void * arg);
+
+// Check that a string starts with a JSON object, as cJSON_ParseWithOpts() would parse it, without building it
+// Set *begin to the opening brace and return the position after the closing one, or NULL if it's not an object
+const char * json_scan_object(const char * json, const char ** begin, json_member_cb member, void * arg);
+
+// Find the first member of the JSON object that starts a string whose key is exactly key (not unescaped)
+// Return the text of its value and set *length to its size, or return NULL if it's not found. The text after it is not checked
+const char * json_scan_member(const char * json, const char * key, size_t * length);
+
+// Open an arena scope for cJSON in this thread. Until the scope is closed, the nodes and strings
+// that cJSON allocates in this thread (including printed strings) come from an arena. Scopes can be nested
+void json_arena_open(void);
+
+// Close the arena scope of this thread. If it's the outermost one, everything allocated in it is released
+// at once: the objects must not outlive the scope, and the strings to keep must be copied before
+void json_arena_close(void);
+
 // Check if a JSON object is tagged
 #define json_tagged_obj(x) (x && x->string)
 
@@ -0,0 +1,161 @@
+/*
+ * Streaming JSON writer
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * June 2, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef JSON_WRITER_OP_H
+#define JSON_WRITER_OP_H
+
+#include <stddef.h>
+
+/**
+ * @brief Growing buffer where a JSON document is printed as it is built.
+ *
+ * The output is the same as cJSON_PrintUnformatted() would give for a tree
+ * with the same members in the same order. A member is separated from the
+ * previous one only when the last byte isn't the opening of its container,
+ * so no nesting state is kept.
+ *
+ * The buffer is kept by w_json_writer_reset(), so a writer reused for many
+ * documents stops allocating once it has grown to the largest of them.
+ */
+typedef struct w_json_writer_t {
+    char * buffer;
+    size_t length;
+    size_t size;
+} w_json_writer_t;
+
+/**
+ * @brief Empty a writer, keeping its buffer.
+ *
+ * @param writer Writer. It may be zeroed (no buffer yet).
+ */
+void w_json_writer_reset(w_json_writer_t * writer);
+
+/**
+ * @brief Release the buffer of a writer.
+ *
+ * @param writer Writer.
+ */
+void w_json_writer_free(w_json_writer_t * writer);
+
+/**
+ * @brief Get the document written so far, NUL-terminated.
+ *
+ * @param writer Writer.
+ * @return Pointer to the buffer of the writer. It's valid until the next write.
+ */
+const char * w_json_writer_str(w_json_writer_t * writer);
+
+/**
+ * @brief Open an object.
+ *
+ * @param writer Writer.
+ * @param key Member name, or NULL for the root or an array element.
+ */
+void w_json_open_object(w_json_writer_t * writer, const char * key);
+
+/**
+ * @brief Open an array.
+ *
+ * @param writer Writer.
+ * @param key Member name, or NULL for the root or an array element.
+ */
+void w_json_open_array(w_json_writer_t * writer, const char * key);
+
+/**
+ * @brief Close the innermost object.
+ *
+ * @param writer Writer.
+ */
+void w_json_close_object(w_json_writer_t * writer);
+
+/**
+ * @brief Close the innermost array.
+ *
+ * @param writer Writer.
+ */
+void w_json_close_array(w_json_writer_t * writer);
+
+/**
+ * @brief Remove the container opened at a mark if nothing was written in it.
+ *
+ * @param writer Writer.
+ * @param mark Length of the document (writer->length) before the container was opened.
+ * @return 1 if the container was removed, 0 if it has members.
+ */
+int w_json_drop_empty(w_json_writer_t * writer, size_t mark);
+
+/**
+ * @brief Add a string.
+ *
+ * @param writer Writer.
+ * @param key Member name, or NULL for an array element.
+ * @param value String. Nothing is added if it's NULL, as with cJSON_AddStringToObject().
+ */
+void w_json_add_string(w_json_writer_t * writer, const char * key, const char * value);
+
+/**
+ * @brief Add a string of a given length.
+ *
+ * @param writer Writer.
+ * @param key Member name, or NULL for an array element.
+ * @param value Characters of the string. It may not be NUL-terminated.
+ * @param length Length of the string.
+ */
+void w_json_add_string_n(w_json_writer_t * writer, const char * key, const char * value, size_t length);
+
+/**
+ * @brief Add a member name of a given length, to be followed by its value.
+ *
+ * @param writer Writer.
+ * @param key Characters of the name. It may not be NUL-terminated.
+ * @param length Length of the name.
+ */
+void w_json_add_key_n(w_json_writer_t * writer, const char * key, size_t length);
+
+/**
+ * @brief Add an integer.
+ *
+ * @param writer Writer.
+ * @param key Member name, or NULL for an array element.
+ * @param value Integer.
+ */
+void w_json_add_number(w_json_writer_t * writer, const char * key, long long value);
+
+/**
+ * @brief Add a boolean.
+ *
+ * @param writer Writer.
+ * @param key Member name, or NULL for an array element.
+ * @param value Boolean (true if not 0).
+ */
+void w_json_add_bool(w_json_writer_t * writer, const char * key, int value);
+
+/**
+ * @brief Add a value that is already printed.
+ *
+ * @param writer Writer.
+ * @param key Member name, or NULL for the root or an array element.
+ * @param json JSON value, as printed by cJSON_PrintUnformatted().
+ */
+void w_json_add_raw(w_json_writer_t * writer, const char * key, const char * json);
+
+/**
+ * @brief Append JSON text as is, without separating it from the previous member.
+ *
+ * This resumes a document printed elsewhere, e.g. an object without its closing brace.
+ *
+ * @param writer Writer.
+ * @param json JSON text.
+ * @param length Length of the text.
+ */
+void w_json_put_n(w_json_writer_t * writer, const char * json, size_t length);
+
+#endif /* JSON_WRITER_OP_H */
@@ -0,0 +1,117 @@
+/*
+ * Elastic pool of workers over several queues
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef LANE_POOL_OP_H
+#define LANE_POOL_OP_H
+
+#include <pthread.h>
+#include "mpmc_queue_op.h"
+
+#define W_LANE_BATCH 64
+
+struct w_lane_t;
+
+/**
+ * @brief Process a batch of items popped from the queue of a lane.
+ *
+ * @param lane Lane. Its context belongs to the caller until it returns.
+ * @param items Items.
+ * @param n Number of items, at least 1.
+ */
+typedef void (*w_lane_work_t)(struct w_lane_t * lane, void ** items, size_t n);
+
+/**
+ * @brief Unit of work: a queue, and the state needed to consume it.
+ *
+ * A lane is served by one thread at a time, so its context needs no locking
+ * and the items of the queue keep their order. Several lanes may share a
+ * queue, to let several threads consume it.
+ */
+typedef struct w_lane_t {
+    w_mpmc_queue_t * queue;
+    w_lane_work_t work;
+    void * context;
+    unsigned int weight;                    ///< Priority: a fuller queue and a higher weight get served first
+    int busy;                               ///< A worker holds the lane
+} w_lane_t;
+
+/**
+ * @brief Workers shared by a set of lanes.
+ */
+typedef struct w_lane_pool_t {
+    w_lane_t ** lanes;
+    unsigned int count;
+    unsigned int idle;                      ///< Workers sleeping until some queue gets an item
+    unsigned int busy;                      ///< Workers holding a lane
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+} w_lane_pool_t;
+
+/**
+ * @brief Set up a lane.
+ *
+ * @param queue Queue.
+ * @param work Function that processes the items.
+ * @param context State of the lane.
+ * @param weight Priority, at least 1.
+ * @return New lane.
+ */
+w_lane_t * w_lane_init(w_mpmc_queue_t * queue, w_lane_work_t work, void * context, unsigned int weight);
+
+/**
+ * @brief Serve a single lane forever, from a dedicated thread.
+ *
+ * @param lane Lane.
+ */
+void * w_lane_main(void * lane);
+
+/**
+ * @brief Set up an empty pool.
+ *
+ * @param pool Pool.
+ */
+void w_lane_pool_init(w_lane_pool_t * pool);
+
+/**
+ * @brief Add a lane to a pool. Lanes are added before the workers start.
+ *
+ * @param pool Pool.
+ * @param lane Lane.
+ */
+void w_lane_pool_add(w_lane_pool_t * pool, w_lane_t * lane);
+
+/**
+ * @brief Pick the lane to serve next, and hold it.
+ *
+ * The lane with the highest occupancy of its queue, times its weight, wins.
+ *
+ * @param pool Pool.
+ * @param start First lane to look at, so that workers don't contend on ties.
+ * @return Lane held, or NULL if no free lane has items.
+ */
+w_lane_t * w_lane_pool_take(w_lane_pool_t * pool, unsigned int start);
+
+/**
+ * @brief Release a lane taken with w_lane_pool_take().
+ *
+ * @param pool Pool.
+ * @param lane Lane.
+ */
+void w_lane_pool_release(w_lane_pool_t * pool, w_lane_t * lane);
+
+/**
+ * @brief Worker of a pool: serve its lanes forever.
+ *
+ * @param pool Pool.
+ */
+void * w_lane_pool_main(void * pool);
+
+#endif /* LANE_POOL_OP_H */
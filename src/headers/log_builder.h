@@ -32,6 +32,41 @@ typedef struct {
     pthread_rwlock_t rwlock;                    ///< Mutex
 } log_builder_t;
 
+/**
+ * @brief Kind of a log template token
+ */
+typedef enum {
+    LOG_TOKEN_TEXT,         ///< Literal text
+    LOG_TOKEN_LOG,          ///< $(log) or $(output)
+    LOG_TOKEN_JSON_LOG,     ///< $(json_escaped_log)
+    LOG_TOKEN_LOCATION,     ///< $(location) or $(command)
+    LOG_TOKEN_TIMESTAMP,    ///< $(timestamp) or $(timestamp <format>)
+    LOG_TOKEN_HOSTNAME,     ///< $(hostname)
+    LOG_TOKEN_HOST_IP       ///< $(host_ip)
+} log_token_type_t;
+
+/**
+ * @brief Log template token
+ */
+typedef struct {
+    log_token_type_t type;  ///< Token kind
+    char * text;            ///< Literal text, or timestamp format (NULL for RFC3164)
+    size_t length;          ///< Length of the literal text
+} log_token_t;
+
+/**
+ * @brief Log template type
+ *
+ * This structure holds a log format, parsed once so that it can be
+ * rendered for every message without scanning it again.
+ *
+ */
+typedef struct log_template_t {
+    log_token_t * tokens;   ///< Token array
+    size_t count;           ///< Number of tokens
+    bool host;              ///< Whether it has $(hostname) or $(host_ip)
+} log_template_t;
+
 /**
  * @brief Initialize a log builder structure
  *
@@ -76,4 +111,36 @@ int log_builder_update(log_builder_t * builder);
  */
 char * log_builder_build(log_builder_t * builder, const char * pattern, const char * logmsg, const char * location);
 
+/**
+ * @brief Parse a log format into a template
+ *
+ * The supported patterns are the same as in log_builder_build(). Invalid
+ * parameters are reported here and dropped from the template.
+ *
+ * @param pattern String holding the log format.
+ * @return Pointer to a new template. It will never be NULL.
+ */
+log_template_t * log_builder_compile(const char * pattern);
+
+/**
+ * @brief Free a log template
+ *
+ * @param tmpl Pointer to a log template, or NULL.
+ */
+void log_template_free(log_template_t * tmpl);
+
+/**
+ * @brief Render a log template into a buffer
+ *
+ * @param builder Pointer to a log builder structure.
+ * @param tmpl Pointer to a log template.
+ * @param logmsg String containing the input log.
+ * @param location String representing the log location.
+ * @param buffer Output buffer. The log is always NUL-terminated.
+ * @param size Size of the buffer.
+ * @post If the output log doesn't fit, the input log is written instead, truncated if needed.
+ * @return Length of the output log.
+ */
+size_t log_builder_render(log_builder_t * builder, const log_template_t * tmpl, const char * logmsg, const char * location, char * buffer, size_t size);
+
 #endif // LOG_BUILDER_H
@@ -0,0 +1,183 @@
+/*
+ * Process metrics: counters, gauges and latency histograms
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef METRICS_OP_H
+#define METRICS_OP_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define METRICS_CACHE_LINE  64
+#define METRICS_SHARDS      16      ///< Threads are spread over these copies of each value
+
+/* Histogram buckets: values under 8 have a bucket each, and every power of
+ * two above is split in 8 buckets, up to 2^32 microseconds.
+ */
+#define METRICS_SUB_BITS    3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS     ((32 - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+
+typedef enum w_metric_type_t {
+    W_METRIC_COUNTER,
+    W_METRIC_GAUGE,
+    W_METRIC_HISTOGRAM
+} w_metric_type_t;
+
+/**
+ * @brief Copy of a counter, in its own cache line.
+ */
+typedef struct w_metric_slot_t {
+    uint64_t value;
+    char _pad[METRICS_CACHE_LINE - sizeof(uint64_t)];
+} w_metric_slot_t;
+
+/**
+ * @brief Copy of a histogram. The sum is in microseconds.
+ */
+typedef struct w_metric_histogram_t {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t sum;
+    char _pad[METRICS_CACHE_LINE - (METRICS_BUCKETS + 1) * sizeof(uint64_t) % METRICS_CACHE_LINE];
+} w_metric_histogram_t;
+
+/**
+ * @brief A metric of the process.
+ *
+ * Counters and histograms are split in shards: each thread updates the shard
+ * it was given with a relaxed atomic, so threads don't fight over the same
+ * cache line. The shards are summed when the metric is read.
+ *
+ * Gauges hold a value, or are read from a callback when the metrics are
+ * rendered, which suits queue depths.
+ */
+typedef struct w_metric_t {
+    char * name;
+    char * help;
+    char * labels;                      ///< Labels in OpenMetrics syntax, like queue="event", or NULL
+    w_metric_type_t type;
+    int64_t value;                      ///< Value of a gauge without callback
+    double (*read)(void * arg);         ///< Callback of a gauge or counter
+    void * arg;
+    w_metric_slot_t * slots;            ///< Shards of a counter
+    w_metric_histogram_t * histograms;  ///< Shards of a histogram
+    struct w_metric_t * next;
+} w_metric_t;
+
+/**
+ * @brief Register a counter. Registering the same name and labels again returns the same metric.
+ *
+ * @param name Name of the family, without the _total suffix.
+ * @param help Description of the family.
+ * @param labels Labels of this counter, or NULL.
+ * @return Counter.
+ */
+w_metric_t * w_metrics_counter(const char * name, const char * help, const char * labels);
+
+/**
+ * @brief Register a counter kept by someone else, read from a callback when it's rendered.
+ *
+ * @param name Name of the family, without the _total suffix.
+ * @param help Description of the family.
+ * @param labels Labels of this counter, or NULL.
+ * @param read Callback that returns the value.
+ * @param arg Argument of the callback.
+ * @return Counter. Don't add to it.
+ */
+w_metric_t * w_metrics_counter_fn(const char * name, const char * help, const char * labels, double (*read)(void *), void * arg);
+
+/**
+ * @brief Register a gauge.
+ *
+ * @param name Name of the family.
+ * @param help Description of the family.
+ * @param labels Labels of this gauge, or NULL.
+ * @param read Callback that returns the value when it's rendered, or NULL to use w_metrics_set().
+ * @param arg Argument of the callback.
+ * @return Gauge.
+ */
+w_metric_t * w_metrics_gauge(const char * name, const char * help, const char * labels, double (*read)(void *), void * arg);
+
+/**
+ * @brief Register a latency histogram. Latencies are rendered in seconds.
+ *
+ * @param name Name of the family.
+ * @param help Description of the family.
+ * @param labels Labels of this histogram, or NULL.
+ * @return Histogram.
+ */
+w_metric_t * w_metrics_histogram(const char * name, const char * help, const char * labels);
+
+/**
+ * @brief Add to a counter.
+ *
+ * @param metric Counter.
+ * @param n Amount.
+ */
+void w_metrics_add(w_metric_t * metric, uint64_t n);
+
+#define w_metrics_inc(metric) w_metrics_add(metric, 1)
+
+/**
+ * @brief Set the value of a gauge.
+ *
+ * @param metric Gauge.
+ * @param value Value.
+ */
+void w_metrics_set(w_metric_t * metric, int64_t value);
+
+/**
+ * @brief Account a latency.
+ *
+ * @param metric Histogram.
+ * @param usec Latency in microseconds.
+ */
+void w_metrics_observe(w_metric_t * metric, uint64_t usec);
+
+/**
+ * @brief Account the time elapsed since a moment.
+ *
+ * @param metric Histogram.
+ * @param start Moment (CLOCK_MONOTONIC).
+ */
+void w_metrics_observe_since(w_metric_t * metric, const struct timespec * start);
+
+/**
+ * @brief Get the value of a counter or gauge, or the number of samples of a histogram.
+ *
+ * @param metric Metric.
+ * @return Value.
+ */
+uint64_t w_metrics_value(const w_metric_t * metric);
+
+/**
+ * @brief Get a percentile of a histogram.
+ *
+ * @param metric Histogram.
+ * @param percentile Percentile, from 0 to 1.
+ * @return Upper bound of the bucket of the percentile, in microseconds, or 0 if there are no samples.
+ */
+uint64_t w_metrics_percentile(const w_metric_t * metric, double percentile);
+
+/**
+ * @brief Render all the metrics in the OpenMetrics text format.
+ *
+ * @return New string.
+ */
+char * w_metrics_render(void);
+
+/**
+ * @brief Serve the metrics over HTTP on localhost, if the internal option "<section>.metrics_port" is set.
+ *
+ * @param section Section of the internal options.
+ */
+void w_metrics_http_start(const char * section);
+
+#endif /* METRICS_OP_H */
@@ -0,0 +1,176 @@
+/*
+ * Bounded lock-free MPMC queue
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * May 26, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef MPMC_QUEUE_OP_H
+#define MPMC_QUEUE_OP_H
+
+#include <pthread.h>
+
+#define MPMC_CACHE_LINE 64
+
+/**
+ * @brief Ring cell: the sequence number tells producers and consumers whose turn it is.
+ */
+typedef struct mpmc_cell_t {
+    size_t sequence;
+    void * data;
+} mpmc_cell_t;
+
+/**
+ * @brief Bounded multi-producer/multi-consumer queue.
+ *
+ * Push and pop never take a lock while the queue has room and data. The
+ * mutex and condition variables are only used to park idle consumers (or
+ * blocked producers) and are skipped entirely when nobody is waiting.
+ *
+ * The enqueue and dequeue positions live on separate cache lines so that
+ * producers and consumers do not invalidate each other.
+ */
+typedef struct mpmc_queue_t {
+    mpmc_cell_t * cells;
+    size_t mask;
+    size_t size;                            ///< Real capacity (power of two)
+    char _pad0[MPMC_CACHE_LINE];
+    size_t enqueue_pos;
+    char _pad1[MPMC_CACHE_LINE];
+    size_t dequeue_pos;
+    char _pad2[MPMC_CACHE_LINE];
+    unsigned int consumers_waiting;
+    unsigned int producers_waiting;
+    size_t high_water;                      ///< Peak number of items since the last reset
+    void (*notify)(void * arg);             ///< Called after each push, for consumers that don't wait on the queue
+    void * notify_arg;
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+    pthread_cond_t available_not_full;
+} w_mpmc_queue_t;
+
+/**
+ * @brief Create a queue.
+ *
+ * @param n Minimum capacity. It's rounded up to the next power of two.
+ * @return Pointer to a new queue.
+ */
+w_mpmc_queue_t * mpmc_queue_init(size_t n);
+
+/**
+ * @brief Free a queue. Pending items are not freed.
+ *
+ * @param queue Queue to free.
+ */
+void mpmc_queue_free(w_mpmc_queue_t * queue);
+
+/**
+ * @brief Get the number of queued items. The value is approximate while other threads are working.
+ *
+ * @param queue Queue.
+ * @return Number of items.
+ */
+size_t mpmc_queue_elements(const w_mpmc_queue_t * queue);
+
+/**
+ * @brief Get the peak number of queued items and start a new measurement period.
+ *
+ * @param queue Queue.
+ * @return Highest number of items observed after a push since the previous call.
+ */
+size_t mpmc_queue_take_high_water(w_mpmc_queue_t * queue);
+
+int mpmc_queue_full(const w_mpmc_queue_t * queue);
+int mpmc_queue_empty(const w_mpmc_queue_t * queue);
+
+/**
+ * @brief Insert an item without blocking, waking up an idle consumer.
+ *
+ * @param queue Queue.
+ * @param data Item (not NULL).
+ * @retval 0 on success.
+ * @retval -1 if the queue is full.
+ */
+int mpmc_queue_push_ex(w_mpmc_queue_t * queue, void * data);
+
+/**
+ * @brief Insert an item, waiting while the queue is full.
+ *
+ * @param queue Queue.
+ * @param data Item (not NULL).
+ * @retval 0 on success.
+ */
+int mpmc_queue_push_ex_block(w_mpmc_queue_t * queue, void * data);
+
+/**
+ * @brief Extract an item without blocking.
+ *
+ * @param queue Queue.
+ * @return Item, or NULL if the queue is empty.
+ */
+void * mpmc_queue_pop(w_mpmc_queue_t * queue);
+
+/**
+ * @brief Extract an item, waiting while the queue is empty.
+ *
+ * @param queue Queue.
+ * @return Item.
+ */
+void * mpmc_queue_pop_ex(w_mpmc_queue_t * queue);
+
+/**
+ * @brief Extract an item, waiting until a deadline while the queue is empty.
+ *
+ * @param queue Queue.
+ * @param abstime Absolute deadline (CLOCK_REALTIME).
+ * @return Item, or NULL on timeout.
+ */
+void * mpmc_queue_pop_ex_timedwait(w_mpmc_queue_t * queue, const struct timespec * abstime);
+
+/**
+ * @brief Extract up to max items without blocking.
+ *
+ * @param queue Queue.
+ * @param items Output array with room for max items.
+ * @param max Maximum number of items to extract.
+ * @return Number of items extracted.
+ */
+size_t mpmc_queue_pop_batch(w_mpmc_queue_t * queue, void ** items, size_t max);
+
+/**
+ * @brief Extract up to max items, waiting until at least one is available.
+ *
+ * @param queue Queue.
+ * @param items Output array with room for max items.
+ * @param max Maximum number of items to extract.
+ * @param abstime Absolute deadline (CLOCK_REALTIME), or NULL to wait indefinitely.
+ * @return Number of items extracted (0 on timeout).
+ */
+size_t mpmc_queue_pop_ex_batch(w_mpmc_queue_t * queue, void ** items, size_t max, const struct timespec * abstime);
+
+/**
+ * @brief Insert n items, waiting while the queue is full, and wake consumers once.
+ *
+ * @param queue Queue.
+ * @param items Items to insert (not NULL).
+ * @param n Number of items.
+ * @retval 0 on success.
+ */
+int mpmc_queue_push_ex_batch(w_mpmc_queue_t * queue, void ** items, size_t n);
+
+/**
+ * @brief Set a function to call after every push.
+ *
+ * It lets a thread that serves several queues sleep until any of them gets an item.
+ *
+ * @param queue Queue.
+ * @param notify Function, or NULL to clear it.
+ * @param arg Argument of the function.
+ */
+void mpmc_queue_set_notify(w_mpmc_queue_t * queue, void (*notify)(void * arg), void * arg);
+
+#endif // MPMC_QUEUE_OP_H
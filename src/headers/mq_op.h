@@ -33,6 +33,10 @@
 
 #define MAX_OPENQ_ATTEMPS 15
 
+/* Batched mode of SendMSG() */
+#define MQ_BATCH_MAX 64
+#define MQ_BATCH_BUFFER (OS_MAXSTR * 8)
+
 extern int sock_fail_time;
 /**
  *  Starts a Message Queue. 
@@ -56,9 +60,26 @@ int StartMQ(const char *key, short int type) __attribute__((nonnull));
  * UNIX -> -1 if there is an error in the socket. The socket will be closed before returning (StartMQ should be called to restore queue)
  * WIN32 -> 0
  * Notes: (UNIX) If the socket is busy when trying to send a message a DEBUG2 message will be loggeed but the return code will be 0
+ * Notes: (UNIX) If the reader of the queue offers shared-memory rings, the message is written there and the call waits while the ring is full
  */
 int SendMSG(int queue, const char *message, const char *locmsg, char loc) __attribute__((nonnull));
 
+/**
+ * Sends the messages that SendMSG() batched in the calling thread, in a single call where possible
+ * @param queue file descriptor of the queue, closed if there is an error in the socket
+ * @return
+ * UNIX -> 0 if the messages were sent, or discarded because the socket is busy
+ * UNIX -> -1 if there is an error in the socket (StartMQ should be called to restore queue)
+ */
+int SendMSGFlush(int queue);
+
+/**
+ * Sets the batched mode of SendMSG() for the calling thread
+ * @param n number of messages to keep before sending them at once (up to MQ_BATCH_MAX), 0 to send each one right away
+ * Notes: (UNIX) The thread must call SendMSGFlush() before it waits for more messages to send. Errors are reported by the call that sends the batch
+ */
+void SendMSGBatch(unsigned int n);
+
 /**
  * Sends a message to a socket. If the socket has not been created yet it will be created based on 
  * the target information. If a message fails to be sent the method will not try to send it again until *sock_fail_time* has passed
@@ -13,6 +13,7 @@
 
 #ifndef WIN32
 #define w_create_thread(x, y) if (!CreateThread((void * (*) (void *))x, y)) merror_exit(THREAD_ERROR);
+#define w_create_named_thread(x, y, ...) if (!CreateThreadNamed((void * (*) (void *))x, y, __VA_ARGS__)) merror_exit(THREAD_ERROR);
 #else
 #define w_create_thread(x, y, z, a, b, c) ({HANDLE hd; if (!(hd = CreateThread(x,y,z,a,b,c))) merror_exit(THREAD_ERROR); hd;})
 #endif
@@ -23,6 +24,7 @@
 #define w_cond_init(x, y) { int error = pthread_cond_init(x, y); if (error) merror_exit("At pthread_cond_init(): %s", strerror(error)); }
 #define w_cond_wait(x, y) { int error = pthread_cond_wait(x, y); if (error) merror_exit("At pthread_cond_wait(): %s", strerror(error)); }
 #define w_cond_signal(x) { int error = pthread_cond_signal(x); if (error) merror_exit("At pthread_cond_signal(): %s", strerror(error)); }
+#define w_cond_broadcast(x) { int error = pthread_cond_broadcast(x); if (error) merror_exit("At pthread_cond_broadcast(): %s", strerror(error)); }
 #define w_cond_destroy(x) { int error = pthread_cond_destroy(x); if (error) merror_exit("At pthread_cond_destroy(): %s", strerror(error)); }
 #define w_rwlock_init(x, y) { int error = pthread_rwlock_init(x, y); if (error) merror_exit("At pthread_rwlock_init(): %s", strerror(error)); }
 #define w_rwlock_rdlock(x) { int error = pthread_rwlock_rdlock(x); if (error) merror_exit("At pthread_rwlock_rdlock(): %s", strerror(error)); }
@@ -35,6 +37,12 @@
 #ifndef WIN32
 int CreateThread(void * (*function_pointer)(void *), void * data) __attribute__((nonnull(1)));
 int CreateThreadJoinable(pthread_t *lthread, void * (*function_pointer)(void *), void *data);
+
+/* Create a detached thread, named like printf(). Returns 1 on success or 0 on error */
+int CreateThreadNamed(void * (*function_pointer)(void *), void * data, const char * format, ...) __attribute__((nonnull(1, 3))) __attribute__((format(printf, 3, 4)));
+
+/* Name a thread (up to 15 characters, as seen by top and perf) and export its CPU time as a metric */
+void w_thread_register(pthread_t thread, const char * format, ...) __attribute__((nonnull(2))) __attribute__((format(printf, 2, 3)));
 #endif
 
 #endif
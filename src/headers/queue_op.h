@@ -13,6 +13,23 @@
 #define QUEUE_OP_H
 
 #include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief Statistics of a queue.
+ *
+ * They are written under the lock of the queue, and can be read at any
+ * moment without it through queue_get_stats(). Waits are only timed when a
+ * thread actually blocks, so a queue that keeps up costs no clock reads.
+ */
+typedef struct w_queue_stats_t {
+    size_t high_water;          ///< Peak number of items since the last reset
+    uint64_t rejected;          ///< Pushes refused because the queue was full
+    uint64_t full_usec;         ///< Time the queue has been full
+    uint64_t push_wait_usec;    ///< Time producers have been blocked by a full queue
+    uint64_t pop_wait_usec;     ///< Time consumers have waited on an empty queue
+} w_queue_stats_t;
 
 typedef struct queue_t {
     void ** data;
@@ -23,6 +40,8 @@ typedef struct queue_t {
     pthread_cond_t available;
     pthread_cond_t available_not_empty;
     unsigned int elements;
+    w_queue_stats_t stats;
+    uint64_t full_since;        ///< Moment the queue got full (microseconds), or 0
 } w_queue_t;
 
 w_queue_t * queue_init(size_t n);
@@ -37,4 +56,59 @@ void * queue_pop_ex(w_queue_t * queue);
 void * queue_pop_ex_block(w_queue_t * queue);
 void * queue_pop_ex_timedwait(w_queue_t * queue, const struct timespec * abstime);
 
+/**
+ * @brief Extract up to max items, waiting until at least one is available.
+ *
+ * @param queue Queue.
+ * @param items Output array with room for max items.
+ * @param max Maximum number of items to extract.
+ * @param abstime Absolute deadline (CLOCK_REALTIME), or NULL to wait indefinitely.
+ * @return Number of items extracted (0 on timeout).
+ */
+size_t queue_pop_ex_batch(w_queue_t * queue, void ** items, size_t max, const struct timespec * abstime);
+
+/**
+ * @brief Insert n items under a single lock, waiting while the queue is full.
+ *
+ * @param queue Queue.
+ * @param items Items to insert (not NULL).
+ * @param n Number of items.
+ * @retval 0 on success.
+ */
+int queue_push_ex_batch(w_queue_t * queue, void ** items, size_t n);
+
+/**
+ * @brief Read the statistics of a queue without taking its lock.
+ *
+ * @param queue Queue.
+ * @param stats Output: statistics. The time full includes the current period.
+ */
+void queue_get_stats(const w_queue_t * queue, w_queue_stats_t * stats);
+
+/**
+ * @brief Get the peak number of items and start a new measurement period.
+ *
+ * @param queue Queue.
+ * @return Highest number of items since the previous call.
+ */
+size_t queue_take_high_water(w_queue_t * queue);
+
+/**
+ * @brief Account the time a consumer waited on an empty queue.
+ *
+ * For callers that wait on their own condition around queue_pop().
+ *
+ * @param queue Queue.
+ * @param start Moment the wait began, as given by gettime().
+ */
+void queue_add_pop_wait(w_queue_t * queue, const struct timespec * start);
+
+/**
+ * @brief Publish the depth and statistics of a queue in the metrics of the process.
+ *
+ * @param queue Queue. It must outlive the process metrics.
+ * @param name Name of the queue, for the queue label.
+ */
+void queue_metrics_register(w_queue_t * queue, const char * name);
+
 #endif // QUEUE_OP_H
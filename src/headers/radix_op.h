@@ -0,0 +1,126 @@
+/*
+ * Adaptive radix tree
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef RADIX_OP_H
+#define RADIX_OP_H
+
+#include <stddef.h>
+
+typedef struct radix_node radix_node;
+
+/**
+ * @brief Adaptive radix tree of string keys.
+ *
+ * Each inner node branches on one byte of the key and takes 4, 16, 48 or
+ * 256 children, growing and shrinking with them. The bytes that all the keys
+ * under a node share are kept in the node, so a lookup compares each byte of
+ * the key once, whatever the number of keys. The keys that share a prefix
+ * form a subtree: they are walked or removed at once.
+ *
+ * Keys are ordered bytewise, as strcmp() does. The tree is not thread-safe.
+ */
+typedef struct radix_tree {
+    radix_node * root;
+    unsigned int size;                  ///< Number of keys
+    void (*dispose)(void *);            ///< Function to dispose a value
+} radix_tree;
+
+/**
+ * @brief Create a radix tree.
+ *
+ * @return Pointer to an empty tree.
+ */
+radix_tree * radix_init();
+
+/**
+ * @brief Free a radix tree, including its keys, and its values if a dispose function was set.
+ *
+ * If tree is NULL, no operation is performed.
+ *
+ * @param tree Pointer to a radix tree.
+ */
+void radix_destroy(radix_tree * tree);
+
+/**
+ * @brief Set the function that radix_destroy(), radix_delete() and radix_delete_prefix() call on the values they drop.
+ *
+ * @param tree Pointer to a radix tree.
+ * @param dispose Pointer to function to dispose a value.
+ */
+void radix_set_dispose(radix_tree * tree, void (*dispose)(void *));
+
+/**
+ * @brief Insert a key-value in the tree.
+ *
+ * @param tree Pointer to a radix tree.
+ * @param key Data key. It's copied.
+ * @param value Data value.
+ * @return Pointer to value, on success.
+ * @retval NULL Key already exists in the tree.
+ */
+void * radix_insert(radix_tree * tree, const char * key, void * value);
+
+/**
+ * @brief Retrieve a value from the tree.
+ *
+ * @param tree Pointer to a radix tree.
+ * @param key Data key.
+ * @return Pointer to data value, if found.
+ * @retval NULL Key not found.
+ */
+void * radix_get(const radix_tree * tree, const char * key);
+
+/**
+ * @brief Remove a key from the tree.
+ *
+ * @param tree Pointer to a radix tree.
+ * @param key Data key.
+ * @retval 1 The key was found and deleted.
+ * @retval 0 Key not in the tree.
+ */
+int radix_delete(radix_tree * tree, const char * key);
+
+/**
+ * @brief Visit the keys that start with a prefix, in order.
+ *
+ * The callback must not modify the tree.
+ *
+ * @param tree Pointer to a radix tree.
+ * @param prefix Key prefix. An empty prefix visits every key.
+ * @param callback Function called for each key and value. A non-zero return stops the walk.
+ * @param arg Argument for the callback.
+ * @return Number of keys visited.
+ */
+unsigned int radix_walk_prefix(const radix_tree * tree, const char * prefix, int (*callback)(const char * key, void * value, void * arg), void * arg);
+
+/**
+ * @brief Remove the keys that start with a prefix.
+ *
+ * The subtree of the prefix is detached at once, then each of its keys is
+ * handed to the callback (if any) and disposed.
+ *
+ * @param tree Pointer to a radix tree.
+ * @param prefix Key prefix.
+ * @param callback Function called for each key and value before they are freed, or NULL.
+ * @param arg Argument for the callback.
+ * @return Number of keys removed.
+ */
+unsigned int radix_delete_prefix(radix_tree * tree, const char * prefix, void (*callback)(const char * key, void * value, void * arg), void * arg);
+
+/**
+ * @brief Get the number of keys in the tree.
+ *
+ * @param tree Pointer to a radix tree.
+ * @return Number of keys.
+ */
+unsigned int radix_size(const radix_tree * tree);
+
+#endif /* RADIX_OP_H */
@@ -110,6 +110,17 @@ void * rbtree_replace(rb_tree * tree, const char * key, void * value);
 
 void * rbtree_get(const rb_tree * tree, const char * key);
 
+/**
+ * @brief Retrieve the value of the least key greater than or equal to a key
+ *
+ * @param tree Pointer to a red-black tree.
+ * @param key Data key (search criteria).
+ * @return Pointer to data value, if found.
+ * @retval NULL Every key in the tree is less than key.
+ */
+
+void * rbtree_ceiling(const rb_tree * tree, const char * key);
+
 /**
  * @brief Remove a value from the tree
  *
@@ -16,6 +16,11 @@
 /* Global headers */
 #define CONTROL_HEADER      "#!-"
 
+/* Batch of events: the header is followed by records that are each a
+ * 4-byte length in network order and the event, with no terminator */
+#define BATCH_HEADER        "#!+"
+#define BATCH_MAX_SIZE      (OS_MAXSTR - OS_HEADER_SIZE - OS_SIZE_1024)
+
 #define IsValidHeader(str)  ((str[0] == '#') && \
                              (str[1] == '!') && \
                              (str[2] == '-') && \
@@ -27,8 +32,11 @@
 #define EXECD_HEADER        "execd "
 #define FILE_UPDATE_HEADER  "up file "
 #define FILE_CLOSE_HEADER   "close file "
+#define FILE_MANIFEST_HEADER "up merged "
 #define HC_STARTUP          "agent startup "
 #define HC_ACK              "agent ack "
+#define HC_BATCH            "agent batch "
+#define HC_CREDIT           "agent credit "
 #define HC_SK_DB_COMPLETED  "syscheck-db-completed"
 #define HC_SK_RESTART       "syscheck restart"
 #define HC_REQUEST          "req "
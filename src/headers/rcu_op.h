@@ -0,0 +1,116 @@
+/*
+ * Read-copy-update with registered readers
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 14, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef RCU_OP_H
+#define RCU_OP_H
+
+#include <pthread.h>
+
+#define RCU_CACHE_LINE 64
+
+/**
+ * @brief Reader slot: the generation the reader entered at, or 0 while outside.
+ */
+typedef struct w_rcu_slot_t {
+    unsigned long generation;
+    char _pad[RCU_CACHE_LINE - sizeof(unsigned long)];
+} w_rcu_slot_t;
+
+/**
+ * @brief Slot of a thread in the thread domain.
+ */
+typedef struct w_rcu_thread_slot_t {
+    unsigned long generation;
+    unsigned int depth;                 ///< Nesting level, only touched by its thread
+    int in_use;
+    struct w_rcu_thread_slot_t * next;
+    char _pad[RCU_CACHE_LINE - sizeof(unsigned long) - 2 * sizeof(int) - sizeof(void *)];
+} w_rcu_thread_slot_t;
+
+/**
+ * @brief Reclamation domain for a fixed set of reader threads.
+ *
+ * Each reader owns a slot, so entering and leaving a read-side section costs a
+ * store (plus a fence on entry) and never blocks. Writers publish the new
+ * version of a structure with an atomic store, then call w_rcu_synchronize()
+ * before freeing the old one: it returns once every reader that might still
+ * see the old version has left its section.
+ */
+typedef struct w_rcu_t {
+    w_rcu_slot_t * slots;
+    unsigned int n_readers;
+    unsigned long generation;
+    pthread_mutex_t mutex;              ///< Serializes writers
+} w_rcu_t;
+
+/**
+ * @brief Create a domain.
+ *
+ * @param n_readers Number of reader threads. Readers are identified by 0 .. n_readers - 1.
+ * @return Pointer to a new domain.
+ */
+w_rcu_t * w_rcu_init(unsigned int n_readers);
+
+/**
+ * @brief Free a domain. No reader may be inside a section.
+ *
+ * @param rcu Domain.
+ */
+void w_rcu_free(w_rcu_t * rcu);
+
+/**
+ * @brief Enter a read-side section. Sections must not be nested.
+ *
+ * @param rcu Domain.
+ * @param reader Reader ID.
+ */
+void w_rcu_read_lock(w_rcu_t * rcu, unsigned int reader);
+
+/**
+ * @brief Leave a read-side section.
+ *
+ * @param rcu Domain.
+ * @param reader Reader ID.
+ */
+void w_rcu_read_unlock(w_rcu_t * rcu, unsigned int reader);
+
+/**
+ * @brief Wait for a grace period.
+ *
+ * Every section that was running when this function was called has finished
+ * when it returns. Must not be called inside a section.
+ *
+ * @param rcu Domain.
+ */
+void w_rcu_synchronize(w_rcu_t * rcu);
+
+/**
+ * @brief Enter a read-side section of the thread domain.
+ *
+ * The thread domain is shared by every thread of the process, so readers need
+ * no ID: each thread gets a slot the first time it enters and releases it when
+ * it exits. Sections of the thread domain may be nested.
+ */
+void w_rcu_thread_read_lock(void);
+
+/**
+ * @brief Leave a read-side section of the thread domain.
+ */
+void w_rcu_thread_read_unlock(void);
+
+/**
+ * @brief Wait for a grace period of the thread domain.
+ *
+ * Must not be called inside a section of the thread domain.
+ */
+void w_rcu_thread_synchronize(void);
+
+#endif // RCU_OP_H
@@ -23,6 +23,8 @@ typedef struct _sched_scan_config {
     bool month_interval;    /* Flag to determine if interval is in months */
     time_t next_scheduled_scan_time;/* Absolute time next scheduled event will occur */
     time_t time_start;      /* Do not write, used by the modules          */
+    unsigned int spread;    /* Window in seconds to spread scans over     */
+    bool spread_applied;    /* Interval scans are shifted only once       */
 } sched_scan_config;
 
 /**
@@ -43,6 +45,7 @@ void sched_scan_free(sched_scan_config *scan_config);
  * <wday></wday>
  * <time></time>
  * <interval></interval>
+ * <spread></spread>
  * ´´´
  * */
 int sched_scan_read(sched_scan_config *scan_config, xml_node **nodes, const char *MODULE_NAME);
@@ -58,6 +61,11 @@ int sched_scan_read(sched_scan_config *scan_config, xml_node **nodes, const char
  * 4. Set up a scan between intervals
  * @param MODULE_TAG String to identify module
  * @param run_on_start forces first time run
+ *
+ * If a spread window is set, scans are delayed by an offset within it that
+ * depends on the host, so that a fleet doesn't scan at the same time. Scans at
+ * a given time are delayed every time, scans by interval only the first time.
+ *
  * @return time until next scan in seconds
  *   stores in config->next_scheduled_scan_time the absolute time where next event 
  *   should occur
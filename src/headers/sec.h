@@ -13,9 +13,10 @@
 
 #include <time.h>
 #include <pthread.h>
+#include <stdint.h>
 
 typedef enum _crypt_method{
-    W_METH_BLOWFISH,W_METH_AES
+    W_METH_BLOWFISH,W_METH_AES,W_METH_AES_GCM
 } crypt_method;
 
 typedef struct keystore_flags_t {
@@ -23,6 +24,12 @@ typedef struct keystore_flags_t {
     unsigned int save_removed:1;    // Save removed keys into list
 } keystore_flags_t;
 
+/* Message counters of an agent, as a record of the counter table */
+typedef struct counter_record {
+    uint32_t global;
+    uint32_t local;
+} counter_record;
+
 /* Unique key for each agent */
 typedef struct _keyentry {
     time_t rcvd;
@@ -34,14 +41,14 @@ typedef struct _keyentry {
     char *key;
     char *name;
 
-    ino_t inode;
-
     os_ip *ip;
     int sock;
     pthread_mutex_t mutex;
     struct sockaddr_in peer_info;
-    FILE *fp;
+    counter_record *counter;            // Record in the counter table, or counter_mem
+    counter_record counter_mem;         // Record used when the counter can't be stored
     crypt_method crypto_method;
+    struct os_aes_cache *aes;           // Cipher contexts of the key, created on first use
 } keyentry;
 
 /* Key storage */
@@ -49,10 +56,14 @@ typedef struct _keystore {
     /* Array with all the keys */
     keyentry **keyentries;
 
-    /* Hashes, based on the ID/IP to look up the keys */
+    /* Hashes, based on the ID/IP/name to look up the keys.
+     * The ID, IP and name hashes are read-optimized: they can be looked up
+     * while keys are added or deleted, but not while the keystore is reloaded.
+     */
     OSHash *keyhash_id;
     OSHash *keyhash_ip;
     OSHash *keyhash_sock;
+    OSHash *keyhash_name;
 
     /* Total key size */
     unsigned int keysize;
@@ -78,7 +89,10 @@ typedef enum key_states {
     KS_ENCKEY
 } key_states;
 
-#define KEYSTORE_INITIALIZER { NULL, NULL, NULL, NULL, 0, 0, 0, 0, { 0, 0 }, NULL, 0 }
+#define KEYSTORE_INITIALIZER { NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, { 0, 0 }, NULL, 0 }
+
+/* Initial size of the lookup hashes, fixed once they are read-optimized */
+#define KEYHASH_SIZE 4099
 
 /** Function prototypes -- key management **/
 
@@ -99,9 +113,18 @@ int OS_CheckUpdateKeys(const keystore *keys) __attribute((nonnull));
 /* Update the keys if they changed on the system */
 void OS_UpdateKeys(keystore *keys) __attribute((nonnull));
 
+/* Update the keys if they changed on the system, adding and removing only the agents that changed.
+ * The keystore must not be changed by other threads meanwhile. Each change is made between
+ * lock() and unlock(), so readers are blocked for a single agent at most.
+ */
+void OS_UpdateKeysDelta(keystore *keys, void (*lock)(void), void (*unlock)(void)) __attribute((nonnull));
+
 /* Start counter for all agents */
 void OS_StartCounter(keystore *keys) __attribute((nonnull));
 
+/* Start counter for an agent that is not in a keystore yet */
+void OS_StartKeyCounter(keyentry *key) __attribute((nonnull));
+
 /* Remove counter for id */
 void OS_RemoveCounter(const char *id) __attribute((nonnull));
 
@@ -117,13 +140,19 @@ int OS_DeleteKey(keystore *keys, const char *id, int purge);
 /* Write keystore on client keys file */
 int OS_WriteKeys(const keystore *keys);
 
+/* Append the entries of a keystore to the client keys file, without rewriting it */
+int OS_AppendKeys(const keystore *keys);
+
 /* Duplicate keystore except key hashes and file pointer */
 keystore* OS_DupKeys(const keystore *keys);
 
 /* Duplicate key entry except key hashes and file pointer */
 keyentry * OS_DupKeyEntry(const keyentry * key);
 
-/** Function prototypes -- agent authorization **/
+/** Function prototypes -- agent authorization
+ * These lookups are O(1) and take no lock. The position they return is
+ * only stable while the caller holds the lock that guards the keystore.
+ */
 
 /* Check if the IP is allowed */
 int OS_IsAllowedIP(keystore *keys, const char *srcip) __attribute((nonnull(1)));
@@ -165,6 +194,7 @@ void os_set_agent_crypto_method(keystore * keys,const int method);
 #endif
 
 #define SENDER_COUNTER  "sender_counter"
+#define COUNTER_TABLE   "counter_table"
 #define KEYSIZE         128
 
 extern unsigned int _s_comp_print;
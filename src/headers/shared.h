@@ -223,7 +223,21 @@ extern const char *__local_name;
 #include "dirtree_op.h"
 #include "hash_op.h"
 #include "rbtree_op.h"
+#include "radix_op.h"
 #include "queue_op.h"
+#include "mpmc_queue_op.h"
+#include "json_writer_op.h"
+#include "winevt_op.h"
+#include "shm_queue_op.h"
+#include "shm_bcast_op.h"
+#include "rcu_op.h"
+#include "metrics_op.h"
+#include "trace_op.h"
+#include "affinity_op.h"
+#include "lane_pool_op.h"
+#include "diff_op.h"
+#include "hash_oa_op.h"
+#include "intern_op.h"
 #include "store_op.h"
 #include "rc.h"
 #include "ar.h"
@@ -0,0 +1,150 @@
+/*
+ * Shared-memory broadcast ring
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * June 18, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef SHM_BCAST_OP_H
+#define SHM_BCAST_OP_H
+
+#ifndef WIN32
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_BCAST_CACHE_LINE 64
+
+/* Results of shm_bcast_recv() besides a length */
+#define SHM_BCAST_EMPTY 0
+#define SHM_BCAST_LOST -1
+#define SHM_BCAST_CLOSED -2
+
+/**
+ * @brief Header of the shared segment. The ring data follows it.
+ *
+ * There is a single producer, and any number of readers that don't hold it
+ * back: a reader that falls behind a whole ring loses its position.
+ * The positions count bytes since the ring was created.
+ */
+typedef struct shm_bcast_header_t {
+    uint32_t magic;
+    uint32_t closed;                        ///< Set when the producer drops the segment
+    pid_t producer;
+    size_t ring_size;
+    char _pad0[SHM_BCAST_CACHE_LINE];
+    uint64_t reserve;                       ///< End of the record being written
+    char _pad1[SHM_BCAST_CACHE_LINE];
+    uint64_t head;                          ///< End of the last complete record
+    uint32_t seq;                           ///< Bumped to wake up the parked readers
+    uint32_t waiting;                       ///< Readers parked on seq
+    char _pad2[SHM_BCAST_CACHE_LINE];
+} shm_bcast_header_t;
+
+/**
+ * @brief Where a message was also written to a file.
+ *
+ * A reader that falls behind, or whose producer goes away, resumes from
+ * there. An ID of 0 means that the file can't be read back.
+ */
+typedef struct shm_bcast_origin_t {
+    uint64_t file_id;                       ///< Inode of the file
+    uint64_t start;                         ///< Offset of the message in the file
+    uint64_t end;                           ///< Offset right after it
+} shm_bcast_origin_t;
+
+/**
+ * @brief Handle of a segment, local to a process. It's not thread-safe.
+ */
+typedef struct w_shm_bcast_t {
+    shm_bcast_header_t * header;
+    char * data;
+    size_t map_size;
+    size_t ring_size;
+    uint64_t pos;                           ///< Reader: next record
+} w_shm_bcast_t;
+
+/**
+ * @brief Create a segment and become its producer.
+ *
+ * Any previous segment at the same path is dropped first.
+ *
+ * @param path Path of the segment file.
+ * @param ring_size Bytes of the ring. It's rounded up to the next power of two.
+ * @return Pointer to a new handle, or NULL on error.
+ */
+w_shm_bcast_t * shm_bcast_create(const char * path, size_t ring_size);
+
+/**
+ * @brief Drop the segment at a path, if any: its readers see it closed and it's unlinked.
+ *
+ * @param path Path of the segment file.
+ */
+void shm_bcast_unlink(const char * path);
+
+/**
+ * @brief Attach to a segment as a reader, from its next message.
+ *
+ * @param path Path of the segment file.
+ * @return Pointer to a new handle, or NULL if there is no segment or it's closed.
+ */
+w_shm_bcast_t * shm_bcast_attach(const char * path);
+
+/**
+ * @brief Release a handle. The segment is left in place.
+ *
+ * @param bcast Handle.
+ */
+void shm_bcast_close(w_shm_bcast_t * bcast);
+
+/**
+ * @brief Publish a message, and wake up the parked readers.
+ *
+ * It never waits: the oldest messages are overwritten.
+ *
+ * @param bcast Producer handle.
+ * @param message Message.
+ * @param length Length of the message. It's truncated to a quarter of the ring.
+ * @param origin Where the message was written.
+ */
+void shm_bcast_publish(w_shm_bcast_t * bcast, const char * message, size_t length, const shm_bcast_origin_t * origin);
+
+/**
+ * @brief Read the next message, waiting for it up to a timeout.
+ *
+ * @param bcast Reader handle.
+ * @param buffer Output buffer. The message is NUL-terminated, and truncated if needed.
+ * @param size Size of the buffer.
+ * @param origin Output: where the message was written.
+ * @param timeout Milliseconds to wait for a message.
+ * @return Length of the message, SHM_BCAST_EMPTY after the timeout, SHM_BCAST_LOST
+ *         if the reader fell behind (its position is kept) or SHM_BCAST_CLOSED.
+ */
+int shm_bcast_recv(w_shm_bcast_t * bcast, char * buffer, size_t size, shm_bcast_origin_t * origin, int timeout);
+
+/**
+ * @brief Get the origin of the next message, without reading it.
+ *
+ * @param bcast Reader handle.
+ * @param origin Output: where the next message was written.
+ * @retval 1 There is a next message.
+ * @retval 0 There is no message yet.
+ * @retval SHM_BCAST_LOST The next message was overwritten.
+ * @retval SHM_BCAST_CLOSED The producer dropped the segment.
+ */
+int shm_bcast_peek(w_shm_bcast_t * bcast, shm_bcast_origin_t * origin);
+
+/**
+ * @brief Move a reader to the next message that will be published.
+ *
+ * @param bcast Reader handle.
+ */
+void shm_bcast_skip(w_shm_bcast_t * bcast);
+
+#endif /* WIN32 */
+
+#endif /* SHM_BCAST_OP_H */
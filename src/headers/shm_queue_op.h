@@ -0,0 +1,164 @@
+/*
+ * Shared-memory message rings
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * June 4, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef SHM_QUEUE_OP_H
+#define SHM_QUEUE_OP_H
+
+#ifndef WIN32
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define SHM_QUEUE_CACHE_LINE 64
+#define SHM_QUEUE_RINGS 32
+#define SHM_QUEUE_SUFFIX ".shm"
+#define SHM_QUEUE_WAKEUP 1
+
+/**
+ * @brief Ring of one producer process, in the shared segment.
+ *
+ * The positions count bytes since the ring was created. Each record is a
+ * 32-bit length followed by the message, and may wrap around the end.
+ */
+typedef struct shm_ring_t {
+    pid_t owner;                            ///< Producer process, 0 if the ring is free
+    char _pad0[SHM_QUEUE_CACHE_LINE];
+    size_t head;                            ///< Written by the producer
+    char _pad1[SHM_QUEUE_CACHE_LINE];
+    size_t tail;                            ///< Written by the consumer
+    char _pad2[SHM_QUEUE_CACHE_LINE];
+} shm_ring_t;
+
+/**
+ * @brief Header of the shared segment. The ring data follows it.
+ */
+typedef struct shm_header_t {
+    uint32_t magic;
+    uint32_t closed;                        ///< Set when the consumer drops the segment
+    pid_t consumer;
+    unsigned int rings_used;                ///< Rings ever claimed, so the consumer scans no more
+    size_t ring_size;
+    char _pad0[SHM_QUEUE_CACHE_LINE];
+    unsigned int waiting;                   ///< The consumer is parked on its socket
+    char _pad1[SHM_QUEUE_CACHE_LINE];
+    shm_ring_t ring[SHM_QUEUE_RINGS];
+} shm_header_t;
+
+/**
+ * @brief Handle of a shared segment, local to a process.
+ *
+ * A process is either the consumer (the creator, which reads every ring) or
+ * a producer (which writes its own ring). The handle is not thread-safe:
+ * the producer threads of a process must serialize their pushes.
+ */
+typedef struct w_shm_queue_t {
+    shm_header_t * header;
+    char * data;
+    size_t map_size;
+    size_t ring_size;
+    int ring;                               ///< Ring of a producer, -1 for the consumer
+    unsigned int next;                      ///< Consumer: ring to read first
+    int pending;                            ///< Consumer: ring of the message got by shm_queue_peek(), -1 if none
+    size_t pending_tail;                    ///< Consumer: tail of that ring once the message is released
+    unsigned int pushes;                    ///< Producer: pushes since the consumer was last seen
+} w_shm_queue_t;
+
+/**
+ * @brief Create a segment and become its consumer.
+ *
+ * Any previous segment at the same path is dropped first.
+ *
+ * @param path Path of the segment file.
+ * @param ring_size Bytes per producer ring. It's rounded up to the next power of two.
+ * @return Pointer to a new handle, or NULL on error.
+ */
+w_shm_queue_t * shm_queue_create(const char * path, size_t ring_size);
+
+/**
+ * @brief Drop the segment at a path, if any: its producers detach and it's unlinked.
+ *
+ * @param path Path of the segment file.
+ */
+void shm_queue_unlink(const char * path);
+
+/**
+ * @brief Attach to a segment as a producer and claim a ring.
+ *
+ * @param path Path of the segment file.
+ * @return Pointer to a new handle, or NULL if there is no segment, it's closed or all rings are taken.
+ */
+w_shm_queue_t * shm_queue_attach(const char * path);
+
+/**
+ * @brief Release a handle. A producer frees its ring; the consumer leaves the segment in place.
+ *
+ * @param queue Handle.
+ */
+void shm_queue_close(w_shm_queue_t * queue);
+
+/**
+ * @brief Push a message, gathered from several parts, into the ring of a producer.
+ *
+ * If the ring is full, the call waits for the consumer to make room: this
+ * is the backpressure that a busy socket didn't give.
+ *
+ * @param queue Producer handle.
+ * @param iov Parts of the message.
+ * @param iovcnt Number of parts.
+ * @retval SHM_QUEUE_WAKEUP The message was pushed and the consumer is parked: wake it up.
+ * @retval 0 The message was pushed.
+ * @retval -1 The segment was closed or its consumer is gone, or the message will never fit.
+ */
+int shm_queue_push(w_shm_queue_t * queue, const struct iovec * iov, int iovcnt);
+
+/**
+ * @brief Pop the next message from any ring, or park the consumer if all are empty.
+ *
+ * After a return of 0, the consumer must wait on its socket: a producer
+ * that pushes into a parked segment gets SHM_QUEUE_WAKEUP and sends a
+ * wake-up datagram.
+ *
+ * @param queue Consumer handle.
+ * @param buffer Output buffer. The message is NUL-terminated, and truncated if needed.
+ * @param size Size of the buffer.
+ * @return Length of the message, or 0 if the consumer was parked.
+ */
+size_t shm_queue_recv(w_shm_queue_t * queue, char * buffer, size_t size);
+
+/**
+ * @brief Get the next message from any ring without copying it, or park the consumer if all are empty.
+ *
+ * The message stays in its ring until shm_queue_release(), so producers
+ * can't overwrite it. It's only copied into the buffer (truncated and
+ * NUL-terminated) if it wraps around the end of the ring. Otherwise it
+ * points into the ring and it's not NUL-terminated.
+ * Release a message before peeking the next one. Parking works as in
+ * shm_queue_recv().
+ *
+ * @param queue Consumer handle.
+ * @param buffer Buffer for a message that wraps.
+ * @param size Size of the buffer.
+ * @param length Output: length of the message.
+ * @return Pointer to the message, or NULL if the consumer was parked.
+ */
+const char * shm_queue_peek(w_shm_queue_t * queue, char * buffer, size_t size, size_t * length);
+
+/**
+ * @brief Consume the message got by shm_queue_peek(), giving its room back to the producer.
+ *
+ * @param queue Consumer handle.
+ */
+void shm_queue_release(w_shm_queue_t * queue);
+
+#endif /* WIN32 */
+
+#endif /* SHM_QUEUE_OP_H */
@@ -31,6 +31,8 @@ typedef struct _OSStore {
     int currently_size;
     int max_size;
 
+    rb_tree *index;     /* Nodes by key */
+
     void (*free_data_function)(void *data);
 } OSStore;
 
@@ -50,6 +50,29 @@ double time_diff(const struct timespec * a, const struct timespec * b);
 
 char *w_get_timestamp(const time_t time);
 
+/**
+ * @brief Local time of a second, already formatted
+ */
+typedef struct w_time_cache_t {
+    time_t second;
+    struct tm tm;
+    char hour[10];          ///< HH:MM:SS
+    char syslog[32];        ///< Mmm dd HH:MM:SS, as "%b %e %T"
+    char datetime[32];      ///< YYYY-MM-DDTHH:MM:SS, as "%FT%T"
+    char timezone[16];      ///< +hhmm, as "%z"
+} w_time_cache_t;
+
+/**
+ * @brief Get the local time of a second, formatted in the ways events use
+ *
+ * Each thread keeps the last second it asked for, so the time is only
+ * converted and formatted again when the second changes.
+ *
+ * @param second Time to convert.
+ * @return Cache of the calling thread. It is valid until the next call in the same thread.
+ */
+const w_time_cache_t * w_time_cache_get(time_t second);
+
 /**
  * @brief Takes sleeps of 1 second until the input time is reached
  * 
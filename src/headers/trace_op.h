@@ -0,0 +1,112 @@
+/*
+ * Sampled tracing of events through the stages of a daemon
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef TRACE_OP_H
+#define TRACE_OP_H
+
+#include <stdint.h>
+#include <time.h>
+#include "metrics_op.h"
+
+#define W_TRACE_MAX_STAGES 8
+
+/**
+ * @brief Trace of an event. Events that aren't sampled have id 0, and cost nothing else.
+ */
+typedef struct w_trace_t {
+    uint64_t id;
+    struct timespec start;                  ///< Moment the trace began (CLOCK_MONOTONIC)
+    struct timespec last;                   ///< Moment of the last stage
+    uint32_t usec[W_TRACE_MAX_STAGES];      ///< Time spent in each stage
+    uint32_t done;                          ///< Bitmap of the stages recorded
+} w_trace_t;
+
+/**
+ * @brief Stages of a daemon, with a latency histogram each.
+ */
+typedef struct w_tracer_t {
+    unsigned int rate;                      ///< One event out of rate is traced. 0: disabled
+    unsigned int count;
+    const char * const * names;
+    w_metric_t * stages[W_TRACE_MAX_STAGES];
+    w_metric_t * total;
+} w_tracer_t;
+
+/**
+ * @brief Slot that carries the trace of one item through a queue.
+ *
+ * Queues hold bare pointers or bytes, so a sampled item leaves its trace
+ * here, keyed by the item, and the consumer takes it back when it pops that
+ * item. Only one item is traced through the queue at a time.
+ */
+typedef struct w_trace_probe_t {
+    const void * item;
+    w_trace_t trace;
+} w_trace_probe_t;
+
+/**
+ * @brief Set up a tracer. The rate is read from the internal option "<section>.trace_sample_rate".
+ *
+ * @param tracer Tracer.
+ * @param section Section of the internal options.
+ * @param prefix Prefix of the metrics, like "wazuh_analysisd".
+ * @param names Names of the stages.
+ * @param count Number of stages, up to W_TRACE_MAX_STAGES.
+ */
+void w_tracer_init(w_tracer_t * tracer, const char * section, const char * prefix, const char * const * names, unsigned int count);
+
+/**
+ * @brief Begin the trace of an event, if it's sampled.
+ *
+ * @param tracer Tracer.
+ * @param trace Trace of the event. Its id is 0 if the event isn't sampled.
+ * @return 1 if the event is traced, 0 otherwise.
+ */
+int w_trace_begin(const w_tracer_t * tracer, w_trace_t * trace);
+
+/**
+ * @brief Record the end of a stage: the time since the previous stage is accounted to it.
+ *
+ * @param tracer Tracer.
+ * @param trace Trace of the event.
+ * @param stage Stage.
+ */
+void w_trace_stage(const w_tracer_t * tracer, w_trace_t * trace, unsigned int stage);
+
+/**
+ * @brief End a trace: account the total time and log the record at debug level 2.
+ *
+ * @param tracer Tracer.
+ * @param trace Trace of the event. It's reset.
+ */
+void w_trace_end(const w_tracer_t * tracer, w_trace_t * trace);
+
+/**
+ * @brief Leave the trace of an item in a probe, if the probe is free.
+ *
+ * @param probe Probe.
+ * @param item Item about to be queued. Must not be NULL.
+ * @param trace Trace of the item.
+ * @return 1 if the probe took the trace, 0 otherwise.
+ */
+int w_trace_probe_set(w_trace_probe_t * probe, const void * item, const w_trace_t * trace);
+
+/**
+ * @brief Take the trace of an item back from a probe.
+ *
+ * @param probe Probe.
+ * @param item Item popped from the queue.
+ * @param trace Output: trace of the item. Untouched if the item isn't traced.
+ * @return 1 if the item was traced, 0 otherwise.
+ */
+int w_trace_probe_take(w_trace_probe_t * probe, const void * item, w_trace_t * trace);
+
+#endif /* TRACE_OP_H */
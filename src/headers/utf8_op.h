@@ -36,3 +36,15 @@ const char * w_utf8_drop(const char * string);
  * @return Return a new string with valid UTF-8 characters only.
  */
 char * w_utf8_filter(const char * string, bool replacement);
+
+
+/**
+ * @brief Filter string to remove or replace invalid characters, only if it has any.
+ *
+ * The common case of a valid string is checked without allocating memory.
+ *
+ * @param string String to be filtered.
+ * @param replacement Set to 0 for remove invalid characters or set to 1 to replace them.
+ * @return Return a new string with valid UTF-8 characters only, or NULL if string is valid already.
+ */
+char * w_utf8_filter_invalid(const char * string, bool replacement);
@@ -32,6 +32,7 @@ int getNetmask(unsigned int mask, char *strmask, size_t size) __attribute__((non
 
 /* Run-time definitions */
 int getDefine_Int(const char *high_name, const char *low_name, int min, int max) __attribute__((nonnull));
+char *getDefine_String(const char *high_name, const char *low_name) __attribute__((nonnull));
 
 
 /**
@@ -14,7 +14,115 @@
 
 typedef enum wdbc_result { WDBC_OK, WDBC_ERROR, WDBC_IGNORE, WDBC_UNKNOWN } wdbc_result;
 
+/* Default number of queries in flight on an asynchronous connection */
+#define WDBC_ASYNC_WINDOW 64
+
+/* Completion of an asynchronous query. The response is NULL if the connection was lost */
+typedef void (*wdbc_callback_t)(char *response, void *arg);
+
+/* Query sent and waiting for its response */
+typedef struct wdbc_pending_t {
+    unsigned long id;
+    wdbc_callback_t callback;
+    void *arg;
+} wdbc_pending_t;
+
+/* Connection that keeps many queries in flight. wazuh-db serves the queries
+ * of a connection in order, so each response belongs to the oldest query */
+typedef struct wdbc_async_t {
+    int sock;
+    unsigned long next_id;      // ID of the next query
+    wdbc_pending_t *pending;    // Ring of the queries in flight
+    unsigned int head;          // Oldest query in flight
+    unsigned int count;         // Queries in flight
+    unsigned int window;        // Queries in flight at most
+    os_secure_reader_t reader;  // Responses received and not completed yet
+} wdbc_async_t;
+
+/* Connections in the pool of a process, and limits of the wait between connection attempts */
+#define WDBC_POOL_SIZE 4
+#define WDBC_POOL_RETRY_MIN 1
+#define WDBC_POOL_RETRY_MAX 60
+/* Seconds a connection can be idle before it's checked again */
+#define WDBC_POOL_CHECK 5
+
+/* Connection of a pool */
+typedef struct wdbc_conn_t {
+    int sock;
+    time_t last;                // Last time it was used
+    os_secure_reader_t reader;  // Responses to pipelined queries
+} wdbc_conn_t;
+
+/* Connections to wazuh-db shared by the threads of a process */
+typedef struct wdbc_pool_t {
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+    char *path;                 // Socket of wazuh-db
+    wdbc_conn_t *conns;
+    wdbc_conn_t **idle;         // Stack of the connections not in use
+    unsigned int size;
+    unsigned int idle_count;
+    unsigned int backoff;       // Seconds since the last failed attempt, 0 if connected
+    time_t retry;               // No attempts to connect before this time
+} wdbc_pool_t;
+
+/* Queries to the same agent database, waiting to be sent in a single batch */
+typedef struct wdbc_batch_t {
+    char agent_id[16];          // Agent of the queries in the buffer
+    char *buffer;               // "agent <id> batch <length> <query> ..."
+    size_t length;              // Bytes used in the buffer
+    unsigned int items;         // Queries in the buffer
+    wdbc_async_t *async;        // Connection to send the batches through without waiting, or NULL
+    unsigned int failed;        // Batches sent through async that failed since the last wait
+} wdbc_batch_t;
+
+/* Value types of the binary result format */
+typedef enum wdbc_type { WDBC_NULL, WDBC_INTEGER, WDBC_FLOAT, WDBC_TEXT, WDBC_BLOB } wdbc_type;
+
+/* Value of a binary result. Text and blobs point into the response, and aren't terminated */
+typedef struct wdbc_value_t {
+    wdbc_type type;
+    long long integer;
+    double real;
+    const char *data;
+    size_t length;
+} wdbc_value_t;
+
+/* Column of a binary result */
+typedef struct wdbc_column_t {
+    const char *name;           // Not terminated
+    size_t name_length;
+    const unsigned char *data;  // Values of the column, one per row
+} wdbc_column_t;
+
+/* Index of a binary result, pointing into the response */
+typedef struct wdbc_table_t {
+    unsigned int columns;
+    unsigned int rows;
+    wdbc_column_t *column;
+} wdbc_table_t;
+
 int wdbc_connect();
 int wdbc_query(const int sock, const char *query, char *response, const int len);
 int wdbc_query_ex(int *sock, const char *query, char *response, const int len);
 int wdbc_parse_result(char *result, char **payload);
+int wdbc_batch_add(int *sock, wdbc_batch_t *batch, const char *query);
+int wdbc_batch_flush(int *sock, wdbc_batch_t *batch);
+int wdbc_batch_wait(int *sock, wdbc_batch_t *batch);
+void wdbc_batch_free(wdbc_batch_t *batch);
+void wdbc_async_init(wdbc_async_t *async, unsigned int window);
+long wdbc_async_query(wdbc_async_t *async, const char *query, wdbc_callback_t callback, void *arg);
+int wdbc_async_poll(wdbc_async_t *async);
+int wdbc_async_wait(wdbc_async_t *async);
+void wdbc_async_free(wdbc_async_t *async);
+void wdbc_pool_init(wdbc_pool_t *pool, unsigned int size, const char *path);
+void wdbc_pool_free(wdbc_pool_t *pool);
+wdbc_pool_t * wdbc_pool_default(void);
+int wdbc_pool_query(wdbc_pool_t *pool, const char *query, char *response, const int len);
+int wdbc_pool_pipeline(wdbc_pool_t *pool, char * const *queries, int n, wdbc_callback_t callback, void *arg);
+int wdbc_set_binary(int sock);
+int wdbc_query_binary(int *sock, const char *query, char *response, const int len);
+int wdbc_table_parse(wdbc_table_t *table, const char *response, size_t length);
+int wdbc_table_find(const wdbc_table_t *table, const char *name);
+void wdbc_table_values(const wdbc_table_t *table, unsigned int column, wdbc_value_t *values);
+void wdbc_table_free(wdbc_table_t *table);
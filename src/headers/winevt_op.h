@@ -0,0 +1,64 @@
+/*
+ * Windows EventChannel event rendering
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 14, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef WINEVT_OP_H
+#define WINEVT_OP_H
+
+#include <stddef.h>
+#include "json_writer_op.h"
+
+/**
+ * @brief Get the severity of an EventChannel event.
+ *
+ * @param level Content of System/Level.
+ * @param keywords Content of System/Keywords, in hexadecimal.
+ * @return Severity name, such as "AUDIT_SUCCESS". It's never NULL.
+ */
+const char * w_winevt_severity(const char * level, const char * keywords);
+
+/**
+ * @brief Get the names of the audit category and subcategory of an event.
+ *
+ * @param category_id Content of EventData/CategoryId, such as "%%8272".
+ * @param subcategory_id Content of EventData/SubcategoryId, such as "%%12288".
+ * @param category Set to the category name, or NULL if it's unknown.
+ * @param subcategory Set to the subcategory name, or NULL if it's unknown.
+ */
+void w_winevt_category(const char * category_id, const char * subcategory_id, const char ** category, const char ** subcategory);
+
+/**
+ * @brief Describe the changes of an audit policy change event.
+ *
+ * @param changes Content of EventData/AuditPolicyChanges, such as "%%8449, %%8451".
+ * @return Allocated string like "Success added, Failure added", or NULL if no change is known.
+ */
+char * w_winevt_audit_changes(const char * changes);
+
+/**
+ * @brief Render an EventChannel event as the "win" document of analysisd.
+ *
+ * The event XML is scanned once, without building a tree, and the members are
+ * written in the order, and with the values, that the OS_XML based decoder
+ * gives. Anything that decoder would handle differently, like comments,
+ * nested data or an element too long for OS_XML, makes this function fail so
+ * that the caller takes the slow path.
+ *
+ * @param event The "Event" member of the JSON event that logcollector sends, as
+ *              it's printed: a JSON string, quotes and escapes included.
+ * @param length Length of event.
+ * @param message Value of system.message, or NULL to leave it out.
+ * @param writer Writer where the document {"win":{...}} is printed. It's reset first.
+ * @retval 0 on success.
+ * @retval -1 if the event has to be decoded by OS_XML.
+ */
+int w_winevt_render(const char * event, size_t length, const char * message, w_json_writer_t * writer);
+
+#endif
@@ -42,11 +42,15 @@ int LogCollectorConfig(const char *cfgfile)
     maximum_lines = getDefine_Int("logcollector", "max_lines", 0, 1000000);
     maximum_files = getDefine_Int("logcollector", "max_files", 1, 100000);
     sock_fail_time = getDefine_Int("logcollector", "sock_fail_time", 1, 3600);
+    send_batch = getDefine_Int("logcollector", "send_batch", 0, MQ_BATCH_MAX);
     sample_log_length = getDefine_Int("logcollector", "sample_log_length", 1, 4096);
     force_reload = getDefine_Int("logcollector", "force_reload", 0, 1);
     reload_interval = getDefine_Int("logcollector", "reload_interval", 1, 86400);
     reload_delay = getDefine_Int("logcollector", "reload_delay", 0, 30000);
     free_excluded_files_interval = getDefine_Int("logcollector", "exclude_files_interval", 1, 172800);
+    watch_files = getDefine_Int("logcollector", "watch_files", 0, 1);
+    parse_threads = getDefine_Int("logcollector", "parse_threads", 0, 32);
+    winevt_render = getDefine_Int("logcollector", "winevt_render", 0, 1);
 
     /* Current and total files counter */
     total_files = 0;
@@ -234,6 +238,9 @@ cJSON *getLogcollectorInternalOptions(void) {
     cJSON_AddNumberToObject(logcollector,"force_reload",force_reload);
     cJSON_AddNumberToObject(logcollector,"reload_interval",reload_interval);
     cJSON_AddNumberToObject(logcollector,"reload_delay",reload_delay);
+    cJSON_AddNumberToObject(logcollector,"watch_files",watch_files);
+    cJSON_AddNumberToObject(logcollector,"parse_threads",parse_threads);
+    cJSON_AddNumberToObject(logcollector,"winevt_render",winevt_render);
 #ifndef WIN32
     cJSON_AddNumberToObject(logcollector,"rlimit_nofile",nofile);
 #endif
@@ -0,0 +1,324 @@
+/* Event-driven file reading for logcollector
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * June 29, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+#include "shared.h"
+#include "logcollector.h"
+
+/* Each open file is watched through the kernel: inotify on Linux, kqueue on
+ * BSD and macOS. A thread collects the events into a table indexed by watch
+ * descriptor, and wakes up the input threads. These only read the files
+ * that have new data, and the main loop only checks the files that were
+ * written, renamed, removed or changed its attributes since the last check.
+ *
+ * Files that couldn't be watched, and every file on a system without any
+ * of these interfaces, are polled as before.
+ */
+
+#if defined(INOTIFY_ENABLED) || defined(__MACH__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+
+#ifdef INOTIFY_ENABLED
+#include <sys/inotify.h>
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#else
+#include <sys/event.h>
+#define WATCH_MASK (NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_RENAME | NOTE_DELETE | NOTE_LINK)
+#endif
+
+#define WATCH_EVENTS 64
+
+typedef struct w_watch_t {
+    int pending;                            // The file may have new data
+    int changed;                            // The file may have been rotated or truncated
+} w_watch_t;
+
+static int watch_fd = -1;                   // inotify or kqueue descriptor, -1 if disabled
+static OSHash * watch_table;                // Watch entries, by watch descriptor
+static pthread_mutex_t watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watch_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int watch_seq;              // Event bursts collected, to wake up the input threads
+static __thread unsigned int watch_seen;    // Last burst seen by an input thread
+
+/* Mark an entry with events. The mutex must be locked */
+static void w_watch_mark(int wd) {
+    w_watch_t * watch;
+
+    if (watch = OSHash_Numeric_Get_ex(watch_table, wd), watch) {
+        watch->pending = 1;
+        watch->changed = 1;
+    }
+}
+
+/* Mark every entry, after the kernel dropped some events. The mutex must be locked */
+static void w_watch_mark_all() {
+    OSHashNode * node;
+    unsigned int i;
+
+    for (i = 0; i <= watch_table->rows; i++) {
+        for (node = watch_table->table[i]; node; node = node->next) {
+            w_watch_t * watch = node->data;
+            watch->pending = 1;
+            watch->changed = 1;
+        }
+    }
+}
+
+/* Collect the events and wake up the input threads */
+static void * w_watch_thread(__attribute__((unused)) void * args) {
+#ifdef INOTIFY_ENABLED
+    char buffer[WATCH_EVENTS * (sizeof(struct inotify_event) + NAME_MAX + 1)] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    char * p;
+
+    while (1) {
+        if (length = read(watch_fd, buffer, sizeof(buffer)), length <= 0) {
+            if (length < 0 && errno != EINTR) {
+                merror("Cannot read inotify events: %s (%d)", strerror(errno), errno);
+                sleep(1);
+            }
+
+            continue;
+        }
+
+        w_mutex_lock(&watch_mutex);
+
+        for (p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            struct inotify_event * event = (struct inotify_event *)p;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                mdebug1("Inotify event queue overflowed. Checking every file.");
+                w_watch_mark_all();
+            } else if (event->mask & IN_IGNORED) {
+                // The file was removed, or the watch was replaced
+                free(OSHash_Numeric_Delete_ex(watch_table, event->wd));
+            } else {
+                w_watch_mark(event->wd);
+            }
+        }
+#else
+    struct kevent events[WATCH_EVENTS];
+    int count;
+    int i;
+
+    while (1) {
+        if (count = kevent(watch_fd, NULL, 0, events, WATCH_EVENTS, NULL), count <= 0) {
+            if (count < 0 && errno != EINTR) {
+                merror("Cannot read kqueue events: %s (%d)", strerror(errno), errno);
+                sleep(1);
+            }
+
+            continue;
+        }
+
+        w_mutex_lock(&watch_mutex);
+
+        for (i = 0; i < count; i++) {
+            w_watch_mark((int)events[i].ident);
+        }
+#endif
+
+        watch_seq++;
+        w_cond_broadcast(&watch_cond);
+        w_mutex_unlock(&watch_mutex);
+    }
+
+    return NULL;
+}
+
+int w_watch_init() {
+    if (!watch_files) {
+        return -1;
+    }
+
+    if (watch_table = OSHash_Create(), !watch_table) {
+        merror("At w_watch_init(): OSHash_Create()");
+        return -1;
+    }
+
+#ifdef INOTIFY_ENABLED
+    watch_fd = inotify_init();
+#else
+    watch_fd = kqueue();
+#endif
+
+    if (watch_fd < 0) {
+        mwarn("Cannot watch the monitored files: %s (%d). They will be polled.", strerror(errno), errno);
+        OSHash_Free(watch_table);
+        watch_table = NULL;
+        return -1;
+    }
+
+    w_create_named_thread(w_watch_thread, NULL, "lc-watch");
+    mdebug1("Monitored files are watched for events.");
+    return 0;
+}
+
+void w_watch_add(logreader * lf) {
+    w_watch_t * watch;
+    int wd;
+
+    lf->watch = -1;
+
+    if (watch_fd < 0) {
+        return;
+    }
+
+#ifdef INOTIFY_ENABLED
+    char path[PATH_MAX];
+
+    /* Watch the file that is open, even if it has just been renamed */
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fileno(lf->fp));
+
+    if (wd = inotify_add_watch(watch_fd, path, WATCH_MASK), wd < 0) {
+        if (wd = inotify_add_watch(watch_fd, lf->file, WATCH_MASK), wd < 0) {
+            mdebug1("Cannot watch file '%s': %s (%d). It will be polled.", lf->file, strerror(errno), errno);
+            return;
+        }
+    }
+#else
+    struct kevent event;
+
+    wd = fileno(lf->fp);
+    EV_SET(&event, wd, EVFILT_VNODE, EV_ADD | EV_CLEAR, WATCH_MASK, 0, NULL);
+
+    if (kevent(watch_fd, &event, 1, NULL, 0, NULL) < 0) {
+        mdebug1("Cannot watch file '%s': %s (%d). It will be polled.", lf->file, strerror(errno), errno);
+        return;
+    }
+#endif
+
+    w_mutex_lock(&watch_mutex);
+
+    /* The watch of an inode is shared: keep the entry if it already exists */
+    if (watch = OSHash_Numeric_Get_ex(watch_table, wd), !watch) {
+        os_calloc(1, sizeof(w_watch_t), watch);
+
+        if (OSHash_Numeric_Add_ex(watch_table, wd, watch) != 2) {
+            w_mutex_unlock(&watch_mutex);
+            merror("At w_watch_add(): OSHash_Add()");
+            free(watch);
+            return;
+        }
+    }
+
+    /* The file may have data already */
+    watch->pending = 1;
+    watch->changed = 1;
+    w_mutex_unlock(&watch_mutex);
+
+    lf->watch = wd;
+}
+
+/* Take a flag of the entry of an open file. Files that aren't watched always have it */
+static int w_watch_take(const logreader * lf, int changed) {
+    w_watch_t * watch;
+    int flag = 1;
+
+    if (lf->watch < 0) {
+        return 1;
+    }
+
+    w_mutex_lock(&watch_mutex);
+
+    if (watch = OSHash_Numeric_Get_ex(watch_table, lf->watch), watch) {
+        if (changed) {
+            flag = watch->changed;
+            watch->changed = 0;
+        } else {
+            flag = watch->pending;
+            watch->pending = 0;
+        }
+    }
+
+    w_mutex_unlock(&watch_mutex);
+    return flag;
+}
+
+int w_watch_pending(const logreader * lf) {
+    return w_watch_take(lf, 0);
+}
+
+int w_watch_changed(const logreader * lf) {
+    return w_watch_take(lf, 1);
+}
+
+void w_watch_rearm(const logreader * lf) {
+    w_watch_t * watch;
+
+    if (lf->watch < 0) {
+        return;
+    }
+
+    w_mutex_lock(&watch_mutex);
+
+    if (watch = OSHash_Numeric_Get_ex(watch_table, lf->watch), watch) {
+        watch->pending = 1;
+
+        /* Don't wait for the timeout to read the rest */
+        watch_seq++;
+        w_cond_broadcast(&watch_cond);
+    }
+
+    w_mutex_unlock(&watch_mutex);
+}
+
+int w_watch_wait(int seconds) {
+    struct timespec timeout;
+
+    if (watch_fd < 0) {
+        return -1;
+    }
+
+    gettime(&timeout);
+    timeout.tv_sec += seconds;
+
+    w_mutex_lock(&watch_mutex);
+
+    /* Events that came while this thread was reading don't wait */
+    while (watch_seen == watch_seq) {
+        if (pthread_cond_timedwait(&watch_cond, &watch_mutex, &timeout) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    watch_seen = watch_seq;
+    w_mutex_unlock(&watch_mutex);
+    return 0;
+}
+
+#else
+
+int w_watch_init() {
+    if (watch_files) {
+        mdebug1("File events are not available on this system. Monitored files will be polled.");
+    }
+
+    return -1;
+}
+
+void w_watch_add(logreader * lf) {
+    lf->watch = -1;
+}
+
+int w_watch_pending(__attribute__((unused)) const logreader * lf) {
+    return 1;
+}
+
+int w_watch_changed(__attribute__((unused)) const logreader * lf) {
+    return 1;
+}
+
+void w_watch_rearm(__attribute__((unused)) const logreader * lf) {
+}
+
+int w_watch_wait(__attribute__((unused)) int seconds) {
+    return -1;
+}
+
+#endif
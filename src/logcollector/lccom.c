@@ -33,6 +33,9 @@ size_t lccom_dispatch(char * command, char ** output){
         }
         return lccom_getconfig(rcv_args, output);
 
+    } else if (strcmp(rcv_comm, "getmetrics") == 0){
+        return lccom_getmetrics(output);
+
     } else {
         mdebug1("LCCOM Unrecognized command '%s'.", rcv_comm);
         os_strdup("err Unrecognized command", *output);
@@ -40,6 +43,15 @@ size_t lccom_dispatch(char * command, char ** output){
     }
 }
 
+size_t lccom_getmetrics(char ** output) {
+    char *metrics = w_metrics_render();
+
+    os_strdup("ok", *output);
+    wm_strcat(output, metrics, ' ');
+    free(metrics);
+    return strlen(*output);
+}
+
 size_t lccom_getconfig(const char * section, char ** output) {
 
     cJSON *cfg;
@@ -96,6 +108,8 @@ void * lccom_main(__attribute__((unused)) void * arg) {
     char *response = NULL;
     ssize_t length;
     fd_set fdset;
+    fd_set peers;
+    int maxfd;
 
     mdebug1("Local requests thread ready");
 
@@ -104,13 +118,16 @@ void * lccom_main(__attribute__((unused)) void * arg) {
         return NULL;
     }
 
+    FD_ZERO(&peers);
+    maxfd = sock;
+
     while (1) {
 
-        // Wait for socket
-        FD_ZERO(&fdset);
+        // Wait for a new client, or for a request from a client that kept its connection
+        fdset = peers;
         FD_SET(sock, &fdset);
 
-        switch (select(sock + 1, &fdset, NULL, NULL, NULL)) {
+        switch (select(maxfd + 1, &fdset, NULL, NULL, NULL)) {
         case -1:
             if (errno != EINTR) {
                 merror_exit("At lccom_main(): select(): %s", strerror(errno));
@@ -122,41 +139,59 @@ void * lccom_main(__attribute__((unused)) void * arg) {
             continue;
         }
 
-        if (peer = accept(sock, NULL, NULL), peer < 0) {
-            if (errno != EINTR) {
-                merror("At lccom_main(): accept(): %s", strerror(errno));
+        if (FD_ISSET(sock, &fdset)) {
+            if (peer = accept(sock, NULL, NULL), peer < 0) {
+                if (errno != EINTR) {
+                    merror("At lccom_main(): accept(): %s", strerror(errno));
+                }
+            } else if (peer >= FD_SETSIZE) {
+                merror("At lccom_main(): Too many connections.");
+                close(peer);
+            } else {
+                FD_SET(peer, &peers);
+                maxfd = peer > maxfd ? peer : maxfd;
             }
-
-            continue;
         }
 
-        os_calloc(OS_MAXSTR, sizeof(char), buffer);
-        switch (length = OS_RecvSecureTCP(peer, buffer,OS_MAXSTR), length) {
-        case OS_SOCKTERR:
-            merror("At lccom_main(): OS_RecvSecureTCP(): response size is bigger than expected");
-            break;
-
-        case -1:
-            merror("At lccom_main(): OS_RecvSecureTCP(): %s", strerror(errno));
-            break;
+        for (peer = 0; peer <= maxfd; peer++) {
+            if (peer == sock || !FD_ISSET(peer, &fdset)) {
+                continue;
+            }
 
-        case 0:
-            mdebug1("Empty message from local client.");
-            close(peer);
-            break;
-
-        case OS_MAXLEN:
-            merror("Received message > %i", MAX_DYN_STR);
-            close(peer);
-            break;
-
-        default:
-            length = lccom_dispatch(buffer, &response);
-            OS_SendSecureTCP(peer, length, response);
-            free(response);
-            close(peer);
+            os_calloc(OS_MAXSTR, sizeof(char), buffer);
+            switch (length = OS_RecvSecureTCP(peer, buffer,OS_MAXSTR), length) {
+            case OS_SOCKTERR:
+                merror("At lccom_main(): OS_RecvSecureTCP(): response size is bigger than expected");
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            case -1:
+                merror("At lccom_main(): OS_RecvSecureTCP(): %s", strerror(errno));
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            case 0:
+                // The client closed the connection
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            case OS_MAXLEN:
+                merror("Received message > %i", MAX_DYN_STR);
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            default:
+                // Keep the connection open for the next request
+                length = lccom_dispatch(buffer, &response);
+                OS_SendSecureTCP(peer, length, response);
+                free(response);
+            }
+            free(buffer);
         }
-        free(buffer);
     }
 
     mdebug1("Local server thread finished.");
@@ -43,6 +43,10 @@ int force_reload;
 int reload_interval;
 int reload_delay;
 int free_excluded_files_interval;
+int send_batch;
+int watch_files;
+int parse_threads;
+int winevt_render;
 
 static int _cday = 0;
 int N_INPUT_THREADS = N_MIN_INPUT_THREADS;
@@ -92,6 +96,7 @@ void LogCollectorStart()
 
     set_sockets();
     files_lock_init();
+    w_watch_init();
 
     // Check for expanded files
     check_pattern_expand(1);
@@ -288,6 +293,9 @@ void LogCollectorStart()
     // Initialize message queue's log builder
     mq_log_builder_init();
 
+    /* Create the JSON parse threads */
+    w_json_parsers_init();
+
     /* Create the output threads */
     w_create_output_threads();
 
@@ -300,7 +308,8 @@ void LogCollectorStart()
 
 #ifndef WIN32
     // Start com request thread
-    w_create_thread(lccom_main, NULL);
+    w_create_named_thread(lccom_main, NULL, "lc-com");
+    w_metrics_http_start("logcollector");
 #endif
     set_can_read(1);
     /* Daemon loop */
@@ -454,6 +463,11 @@ void LogCollectorStart()
                 if (current->fp) {
 #ifndef WIN32
 
+                    /* A watched file that had no events since the last check is the same */
+                    if (!w_watch_changed(current)) {
+                        continue;
+                    }
+
                     /* To help detect a file rollover, temporarily open the file a second time.
                      * Previously the fstat would work on "cached" file data, but this should
                      * ensure it's fresh when hardlinks are used (like alerts.log).
@@ -890,6 +904,8 @@ int handle_file(int i, int j, int do_fseek, int do_log)
 #endif
     }
 
+    w_watch_add(lf);
+
     /* Set ignore to zero */
     lf->ign = 0;
     lf->exists = 1;
@@ -942,6 +958,7 @@ int reload_file(logreader * lf) {
 #endif
 
     fsetpos(lf->fp, &lf->position);
+    w_watch_add(lf);
     return 0;
 }
 
@@ -1698,6 +1715,8 @@ int w_msg_hash_queues_add_entry(const char *key){
         w_mutex_destroy(&msg->mutex);
         w_cond_destroy(&msg->available);
         free(msg);
+    } else {
+        queue_metrics_register(msg->msg_queue, key);
     }
 
     return result;
@@ -1725,6 +1744,97 @@ int w_msg_hash_queues_push(const char *str, char *file, unsigned long size, logt
     return 0;
 }
 
+int w_msg_hash_queues_push_block(w_msg_block_t *block, const w_msg_slice_t *slices, int count, const char *file, logtarget * targets, char queue_mq) {
+    static int reported = 0;
+    w_msg_queue_t *msg;
+    w_message_t *message;
+    int dropped;
+    int i;
+    int j;
+
+    for (i = 0; targets[i].log_socket; i++)
+    {
+        w_mutex_lock(&mutex);
+
+        msg = (w_msg_queue_t *)OSHash_Get(msg_queues_table, targets[i].log_socket->name);
+
+        w_mutex_unlock(&mutex);
+
+        if (!msg) {
+            continue;
+        }
+
+        dropped = 0;
+        w_mutex_lock(&msg->mutex);
+
+        for (j = 0; j < count; j++) {
+            os_calloc(1, sizeof(w_message_t), message);
+            os_strdup(file, message->file);
+            message->buffer = slices[j].str;
+            message->size = slices[j].size;
+            message->log_target = &targets[i];
+            message->queue_mq = queue_mq;
+            message->block = block;
+
+            if (queue_push(msg->msg_queue, message) < 0) {
+                free(message->file);
+                free(message);
+                dropped++;
+            } else {
+                __atomic_add_fetch(&block->refs, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        if (dropped < count) {
+            w_cond_signal(&msg->available);
+        }
+
+        if (dropped && !reported) {
+            #ifndef WIN32
+                mwarn("Target '%s' message queue is full (%zu). Log lines may be lost.", targets[i].log_socket->name, msg->msg_queue->size);
+            #else
+                mwarn("Target '%s' message queue is full (%u). Log lines may be lost.", targets[i].log_socket->name, msg->msg_queue->size);
+            #endif
+                reported = 1;
+        }
+
+        w_mutex_unlock(&msg->mutex);
+
+        if (dropped) {
+            mdebug2("Discarding %d log lines for target '%s'", dropped, targets[i].log_socket->name);
+        }
+    }
+
+    return 0;
+}
+
+w_msg_block_t * w_msg_block_init(size_t size) {
+    w_msg_block_t *block;
+
+    os_malloc(sizeof(w_msg_block_t), block);
+    os_malloc(size, block->data);
+    block->refs = 1;
+    return block;
+}
+
+void w_msg_block_release(w_msg_block_t *block) {
+    if (__atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(block->data);
+        free(block);
+    }
+}
+
+void w_msg_free(w_message_t *message) {
+    if (message->block) {
+        w_msg_block_release(message->block);
+    } else {
+        free(message->buffer);
+    }
+
+    free(message->file);
+    free(message);
+}
+
 w_message_t * w_msg_hash_queues_pop(const char *key){
     w_msg_queue_t *msg;
 
@@ -1785,82 +1895,135 @@ int w_msg_queue_push(w_msg_queue_t * msg, const char * buffer, char *file, unsig
 
 w_message_t * w_msg_queue_pop(w_msg_queue_t * msg){
     w_message_t *message;
+    struct timespec start;
     w_mutex_lock(&msg->mutex);
 
-    while (message = (w_message_t *)queue_pop(msg->msg_queue), !message) {
-        w_cond_wait(&msg->available, &msg->mutex);
+    if (message = (w_message_t *)queue_pop(msg->msg_queue), !message) {
+        gettime(&start);
+
+        while (message = (w_message_t *)queue_pop(msg->msg_queue), !message) {
+            w_cond_wait(&msg->available, &msg->mutex);
+        }
+
+        queue_add_pop_wait(msg->msg_queue, &start);
     }
 
     w_mutex_unlock(&msg->mutex);
     return message;
 }
 
+int w_msg_queue_pop_batch(w_msg_queue_t * msg, w_message_t ** messages, int max, int * empty){
+    int count;
+    struct timespec start;
+    w_mutex_lock(&msg->mutex);
+
+    if (messages[0] = (w_message_t *)queue_pop(msg->msg_queue), !messages[0]) {
+        gettime(&start);
+
+        while (messages[0] = (w_message_t *)queue_pop(msg->msg_queue), !messages[0]) {
+            w_cond_wait(&msg->available, &msg->mutex);
+        }
+
+        queue_add_pop_wait(msg->msg_queue, &start);
+    }
+
+    for (count = 1; count < max && (messages[count] = (w_message_t *)queue_pop(msg->msg_queue), messages[count]); count++);
+
+    *empty = queue_empty(msg->msg_queue);
+    w_mutex_unlock(&msg->mutex);
+    return count;
+}
+
+/* Send a message to its target */
+static void w_output_send(w_message_t * message) {
+    int sleep_time = 5;
+
+    if (strcmp(message->log_target->log_socket->name, "agent") == 0) {
+        // When dealing with this type of messages we don't want any of them to be lost
+        // Continuously attempt to reconnect to the queue and send the message.
+
+        if(SendMSGtoSCK(logr_queue, message->buffer, message->file, message->queue_mq, message->log_target) != 0) {
+            #ifdef CLIENT
+            merror("Unable to send message to '%s' (ossec-agentd might be down). Attempting to reconnect.", DEFAULTQPATH);
+            #else
+            merror("Unable to send message to '%s' (ossec-analysisd might be down). Attempting to reconnect.", DEFAULTQPATH);
+            #endif
+
+            while(1) {
+                if(logr_queue = StartMQ(DEFAULTQPATH, WRITE), logr_queue >= 0) {
+                    if (SendMSG(logr_queue, message->buffer, message->file, message->queue_mq) == 0) {
+                        minfo("Successfully reconnected to '%s'", DEFAULTQPATH);
+                        break;  //  We sent the message successfully, we can go on.
+                    }
+                }
+
+                sleep(sleep_time);
+
+                // If we failed, we will wait longer before reattempting to connect
+                if(sleep_time < 300)
+                    sleep_time += 5;
+            }
+        }
+
+    } else {
+        const int MAX_RETRIES = 3;
+        int retries = 0;
+        while (retries < MAX_RETRIES) {
+            if (SendMSGtoSCK(logr_queue, message->buffer, message->file, message->queue_mq, message->log_target) < 0) {
+                merror(QUEUE_SEND);
+
+                sleep(sleep_time);
+
+                // If we failed, we will wait longer before reattempting to connect
+                sleep_time += 5;
+                retries++;
+            } else {
+                break;
+            }
+        }
+        if (retries == MAX_RETRIES) {
+            merror(SEND_ERROR, message->log_target->log_socket->location, message->buffer);
+        }
+    }
+}
+
 void * w_output_thread(void * args){
     char *queue_name = args;
-    w_message_t *message;
+    w_message_t *messages[OUTPUT_BATCH_SIZE];
     w_msg_queue_t *msg_queue;
+    int count;
+    int empty;
+    int i;
 
     if (msg_queue = OSHash_Get(msg_queues_table, queue_name), !msg_queue) {
         mwarn("Could not found the '%s'.", queue_name);
         return NULL;
     }
 
+#ifndef WIN32
+    SendMSGBatch(send_batch);
+#endif
+
     while(1)
     {
-        int sleep_time = 5;
-        /* Pop message from the queue */
-        message = w_msg_queue_pop(msg_queue);
-
-        if (strcmp(message->log_target->log_socket->name, "agent") == 0) {
-            // When dealing with this type of messages we don't want any of them to be lost
-            // Continuously attempt to reconnect to the queue and send the message.
-
-            if(SendMSGtoSCK(logr_queue, message->buffer, message->file, message->queue_mq, message->log_target) != 0) {
-                #ifdef CLIENT
-                merror("Unable to send message to '%s' (ossec-agentd might be down). Attempting to reconnect.", DEFAULTQPATH);
-                #else
-                merror("Unable to send message to '%s' (ossec-analysisd might be down). Attempting to reconnect.", DEFAULTQPATH);
-                #endif
-
-                while(1) {
-                    if(logr_queue = StartMQ(DEFAULTQPATH, WRITE), logr_queue >= 0) {
-                        if (SendMSG(logr_queue, message->buffer, message->file, message->queue_mq) == 0) {
-                            minfo("Successfully reconnected to '%s'", DEFAULTQPATH);
-                            break;  //  We sent the message successfully, we can go on.
-                        }
-                    }
-
-                    sleep(sleep_time);
-
-                    // If we failed, we will wait longer before reattempting to connect
-                    if(sleep_time < 300)
-                        sleep_time += 5;
-                }
-            }
+        /* Take every message available, up to a batch */
+        count = w_msg_queue_pop_batch(msg_queue, messages, OUTPUT_BATCH_SIZE, &empty);
 
-        } else {
-            const int MAX_RETRIES = 3;
-            int retries = 0;
-            while (retries < MAX_RETRIES) {
-                if (SendMSGtoSCK(logr_queue, message->buffer, message->file, message->queue_mq, message->log_target) < 0) {
-                    merror(QUEUE_SEND);
+        for (i = 0; i < count; i++) {
+            w_output_send(messages[i]);
+            w_msg_free(messages[i]);
+        }
 
-                    sleep(sleep_time);
+#ifndef WIN32
+        /* Send the batched messages before waiting for more */
+        if (send_batch && empty && SendMSGFlush(logr_queue) < 0) {
+            merror(QUEUE_SEND);
 
-                    // If we failed, we will wait longer before reattempting to connect
-                    sleep_time += 5;
-                    retries++;
-                } else {
-                    break;
-                }
-            }
-            if (retries == MAX_RETRIES) {
-                merror(SEND_ERROR, message->log_target->log_socket->location, message->buffer);
+            if (logr_queue = StartMQ(DEFAULTQPATH, WRITE), logr_queue < 0) {
+                merror(QUEUE_ERROR, DEFAULTQPATH, strerror(errno));
             }
         }
-        free(message->file);
-        free(message->buffer);
-        free(message);
+#endif
     }
 
     return NULL;
@@ -1877,7 +2040,7 @@ void w_create_output_threads(){
             /* Create one thread per valid hash entry */
             if(curr_node->key){
 #ifndef WIN32
-                w_create_thread(w_output_thread, curr_node->key);
+                w_create_named_thread(w_output_thread, curr_node->key, "lc-out-%s", curr_node->key);
 #else
                 w_create_thread(NULL,
                     0,
@@ -1891,10 +2054,91 @@ void w_create_output_threads(){
     }
 }
 
+/* Input threads share the files of each pass: a thread that wakes up starts
+ * a new pass, or joins the current one, and takes the next file that no
+ * thread took yet. So the files with data are spread over every thread that
+ * is free, instead of each thread going through all of them. A file is read
+ * by one thread at a time, under its mutex, which keeps the order of its lines.
+ */
+static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int sched_pass;             // Current pass
+static int sched_next = -1;                 // Next file of the current pass, -1 if it's over
+
+/* Join the current pass, or start a new one. Return the pass */
+static unsigned int w_sched_start() {
+    unsigned int pass;
+
+    w_mutex_lock(&sched_mutex);
+
+    if (sched_next < 0) {
+        sched_next = 0;
+        sched_pass++;
+    }
+
+    pass = sched_pass;
+    w_mutex_unlock(&sched_mutex);
+    return pass;
+}
+
+/* Take the next file of a pass. Return its position, or -1 if the pass is over */
+static int w_sched_claim(unsigned int pass) {
+    int k = -1;
+
+    w_mutex_lock(&sched_mutex);
+
+    if (sched_pass == pass && sched_next >= 0) {
+        k = sched_next++;
+    }
+
+    w_mutex_unlock(&sched_mutex);
+    return k;
+}
+
+/* Close a pass after its last file */
+static void w_sched_finish(unsigned int pass) {
+    w_mutex_lock(&sched_mutex);
+
+    if (sched_pass == pass) {
+        sched_next = -1;
+    }
+
+    w_mutex_unlock(&sched_mutex);
+}
+
+/* Move a cursor forward to the file at a position of the pass.
+ * The cursor starts at i = 0, j = -1, pos = 0. Return 0, or -1 past the last file.
+ */
+static int w_sched_seek(logreader **current, int *i, int *j, int *pos, int k) {
+    IT_control f_control;
+
+    if (*pos > 0) {
+        (*i)++;
+    }
+
+    while (1) {
+        if (f_control = update_current(current, i, j), f_control) {
+            if (f_control == LEAVE_IT) {
+                return -1;
+            }
+
+            (*i)++;
+            continue;
+        }
+
+        if ((*pos)++ == k) {
+            return 0;
+        }
+
+        (*i)++;
+    }
+}
+
 void * w_input_thread(__attribute__((unused)) void * t_id){
     logreader *current;
     int i = 0, r = 0, j = -1;
-    IT_control f_control = 0;
+    int k;
+    int pos;
+    unsigned int pass;
     time_t curr_time = 0;
 #ifndef WIN32
     int int_error = 0;
@@ -1911,8 +2155,8 @@ void * w_input_thread(__attribute__((unused)) void * t_id){
         fp_timeout.tv_sec = loop_timeout;
         fp_timeout.tv_usec = 0;
 
-        /* Wait for the select timeout */
-        if ((r = select(0, NULL, NULL, NULL, &fp_timeout)) < 0) {
+        /* Wait for file events, or for the select timeout if files are polled */
+        if (w_watch_wait(loop_timeout) < 0 && (r = select(0, NULL, NULL, NULL, &fp_timeout)) < 0) {
             merror(SELECT_ERROR, errno, strerror(errno));
             int_error++;
 
@@ -1935,17 +2179,15 @@ void * w_input_thread(__attribute__((unused)) void * t_id){
 #endif
 
         /* Check which file is available */
-        for (i = 0, j = -1;; i++) {
+        pass = w_sched_start();
+
+        for (i = 0, j = -1, pos = 0; k = w_sched_claim(pass), k >= 0;) {
 
             w_rwlock_rdlock(&files_update_rwlock);
-            if (f_control = update_current(&current, &i, &j), f_control) {
+            if (w_sched_seek(&current, &i, &j, &pos, k) < 0) {
                 w_rwlock_unlock(&files_update_rwlock);
-
-                if (f_control == NEXT_IT) {
-                    continue;
-                } else {
-                    break;
-                }
+                w_sched_finish(pass);
+                break;
             }
 
             if (pthread_mutex_trylock(&current->mutex) == 0){
@@ -1991,6 +2233,13 @@ void * w_input_thread(__attribute__((unused)) void * t_id){
                     }
                 }
 
+                /* Skip watched files that had no events */
+                if (!w_watch_pending(current)) {
+                    w_mutex_unlock(&current->mutex);
+                    w_rwlock_unlock(&files_update_rwlock);
+                    continue;
+                }
+
                 /* We check for the end of file. If is returns EOF,
                 * we don't attempt to read it.
                 */
@@ -2079,6 +2328,9 @@ void * w_input_thread(__attribute__((unused)) void * t_id){
 #endif
                 /* Finally, send to the function pointer to read it */
                 current->read(current, &r, 0);
+
+                /* The reader may have stopped before the end: look again in the next loop */
+                w_watch_rearm(current);
                 /* Check for error */
                 if (!ferror(current->fp)) {
                     /* Clear EOF */
@@ -2161,7 +2413,7 @@ void w_create_input_threads(){
 
     for(i = 0; i < N_INPUT_THREADS; i++) {
 #ifndef WIN32
-        w_create_thread(w_input_thread,NULL);
+        w_create_named_thread(w_input_thread, NULL, "lc-input-%d", i);
 #else
         w_create_thread(NULL,
                      0,
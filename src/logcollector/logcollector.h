@@ -18,6 +18,10 @@
 #define N_MIN_INPUT_THREADS 1
 #define N_OUPUT_THREADS 1
 #define OUTPUT_MIN_QUEUE_SIZE 128
+#define READ_BLOCK_SIZE (OS_MAXSTR * 4)
+
+/* Messages that an output thread takes from its queue at once */
+#define OUTPUT_BATCH_SIZE MQ_BATCH_MAX
 #define WIN32_MAX_FILES 200
 
 #include "shared.h"
@@ -93,6 +97,9 @@ void *read_audit(logreader *lf, int *rc, int drop_it);
 /* Read json events */
 void *read_json(logreader *lf, int *rc, int drop_it);
 
+/* Start the threads that check and label the JSON lines */
+void w_json_parsers_init();
+
 #ifdef WIN32
 void win_startel();
 void win_readel();
@@ -107,6 +114,7 @@ void * lccom_main(void * arg);
 #endif
 size_t lccom_dispatch(char * command, char ** output);
 size_t lccom_getconfig(const char * section, char ** output);
+size_t lccom_getmetrics(char ** output);
 
 /*** Global variables ***/
 extern int loop_timeout;
@@ -140,6 +148,18 @@ typedef struct w_msg_queue_t{
 /* Hash table of queues */
 OSHash * msg_queues_table;
 
+/* Chunk of a file, shared by the messages that point into it */
+typedef struct w_msg_block_t {
+    char *data;
+    int refs;
+} w_msg_block_t;
+
+/* Message inside a block */
+typedef struct w_msg_slice_t {
+    char *str;
+    unsigned long size;
+} w_msg_slice_t;
+
 /* Message structure */
 typedef struct w_message_t {
     char *file;
@@ -147,6 +167,7 @@ typedef struct w_message_t {
     char queue_mq;
     unsigned int size;
     logtarget *log_target;
+    w_msg_block_t *block;   // Block that holds the buffer, or NULL if the message owns it
 } w_message_t;
 
 
@@ -169,6 +190,30 @@ int w_msg_hash_queues_add_entry(const char *key);
 /* Push message into the hash queue */
 int w_msg_hash_queues_push(const char *str, char *file, unsigned long size, logtarget * targets, char queue_mq);
 
+/* Push the messages of a block into the hash queue. Each message takes a reference to the block */
+int w_msg_hash_queues_push_block(w_msg_block_t *block, const w_msg_slice_t *slices, int count, const char *file, logtarget * targets, char queue_mq);
+
+/* Check whether a line must be queued: it matches no ignore pattern and, if
+ * duplicates are suppressed, it differs from the previous one. *summary gets
+ * the message for the copies of the previous line held back, if any, which
+ * must be queued before the line */
+int w_filter_line(logreader * lf, const char * line, size_t size, char ** summary);
+
+/* Get the message for the copies of the last line held back, or NULL */
+char * w_filter_flush(logreader * lf);
+
+/* Queue a summary of held back lines and free it */
+void w_filter_push(logreader * lf, char * summary);
+
+/* Create a block with one reference */
+w_msg_block_t * w_msg_block_init(size_t size);
+
+/* Drop a reference to a block */
+void w_msg_block_release(w_msg_block_t *block);
+
+/* Free a message */
+void w_msg_free(w_message_t *message);
+
 /* Pop message from the hash queue */
 w_message_t * w_msg_hash_queues_pop(const char *key);
 
@@ -178,6 +223,27 @@ int w_msg_queue_push(w_msg_queue_t * msg, const char * buffer, char *file, unsig
 /* Pop message from the queue */
 w_message_t * w_msg_queue_pop(w_msg_queue_t * queue);
 
+/* Pop up to max messages from the queue, waiting for the first one. Set *empty if no messages are left */
+int w_msg_queue_pop_batch(w_msg_queue_t * queue, w_message_t ** messages, int max, int * empty);
+
+/* Start watching the monitored files. Return 0, or -1 if they must be polled */
+int w_watch_init();
+
+/* Watch a file that has just been opened */
+void w_watch_add(logreader * lf);
+
+/* Check whether a file may have new data, and clear the mark */
+int w_watch_pending(const logreader * lf);
+
+/* Check whether a file may have been rotated or truncated, and clear the mark */
+int w_watch_changed(const logreader * lf);
+
+/* Mark a file again, when its reader stopped before the end */
+void w_watch_rearm(const logreader * lf);
+
+/* Wait for file events, up to some seconds. Return -1 if files aren't watched */
+int w_watch_wait(int seconds);
+
 /* Output processing thread*/
 void * w_output_thread(void * args);
 
@@ -199,6 +265,10 @@ int can_read();
 extern int sample_log_length;
 extern int lc_debug_level;
 extern int accept_remote;
+extern int send_batch;
+extern int watch_files;
+extern int parse_threads;
+extern int winevt_render;
 extern int N_INPUT_THREADS;
 extern int OUTPUT_QUEUE_SIZE;
 #ifndef WIN32
@@ -0,0 +1,78 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+/* Filter the lines of a file before they are queued */
+
+#include "shared.h"
+#include "logcollector.h"
+
+/* Message that stands for the copies of a line held back */
+static char * w_filter_summary(w_repeat_t * repeat) {
+    char * summary;
+    size_t size;
+
+    if (repeat->count == 1) {
+        os_malloc(repeat->size + 1, summary);
+        memcpy(summary, repeat->line, repeat->size + 1);
+    } else {
+        size = repeat->size + 64;
+        os_malloc(size, summary);
+        snprintf(summary, size, "message repeated %lu times: [ %s ]", repeat->count, repeat->line);
+    }
+
+    repeat->count = 0;
+    return summary;
+}
+
+int w_filter_line(logreader * lf, const char * line, size_t size, char ** summary) {
+    w_repeat_t * repeat = &lf->repeat;
+    int i;
+
+    *summary = NULL;
+
+    if (lf->ignore) {
+        for (i = 0; lf->ignore[i]; i++) {
+            if (OSMatch_Execute(line, size, lf->ignore[i])) {
+                mdebug2("Ignoring line from '%s': '%.*s'%s", lf->file, sample_log_length, line, size > (size_t)sample_log_length ? "..." : "");
+                return 0;
+            }
+        }
+    }
+
+    if (!lf->suppress_duplicates) {
+        return 1;
+    }
+
+    if (repeat->line && size == repeat->size && memcmp(line, repeat->line, size) == 0) {
+        repeat->count++;
+        return 0;
+    }
+
+    if (repeat->count > 0) {
+        *summary = w_filter_summary(repeat);
+    }
+
+    if (size + 1 > repeat->allocated) {
+        repeat->allocated = size + 1;
+        os_realloc(repeat->line, repeat->allocated, repeat->line);
+    }
+
+    memcpy(repeat->line, line, size);
+    repeat->line[size] = '\0';
+    repeat->size = size;
+    return 1;
+}
+
+char * w_filter_flush(logreader * lf) {
+    return lf->repeat.count > 0 ? w_filter_summary(&lf->repeat) : NULL;
+}
+
+void w_filter_push(logreader * lf, char * summary) {
+    w_msg_hash_queues_push(summary, lf->file, strlen(summary) + 1, lf->log_target, LOCALFILE_MQ);
+    free(summary);
+}
@@ -12,19 +12,262 @@
 #include "shared.h"
 #include "logcollector.h"
 
+/* JSON lines are checked and labelled by a pool of parse threads, so the
+ * input threads only read them. The lines of a file always go to the same
+ * thread, which keeps their order. A line is checked by a scanner that
+ * doesn't build a tree, and the labels are spliced before its closing
+ * brace. Lines where a label would merge into an existing member are
+ * rebuilt through cJSON as before.
+ */
+
+#define JSON_PARSE_BATCH 64
+#define JSON_LABELS_MAX 64
+
+/* Line waiting for a parse thread */
+typedef struct w_json_line_t {
+    const wlabel_t * labels;
+    logtarget * targets;
+    char * file;            // Points into data, after the line
+    char data[];            // Line and file name
+} w_json_line_t;
+
+/* Labels that match the members of a line */
+typedef struct w_json_check_t {
+    const wlabel_t * labels;
+    uint64_t found;         // Labels whose first key is a member
+    int escaped;            // Some member name has escapes: labels can't be matched
+} w_json_check_t;
+
+static w_queue_t ** json_queues;
+
+/* Check whether the first key of a label is a name. cJSON looks up members regardless of case */
+static int w_json_label_is(const char * label, const char * name, size_t length) {
+    return strcspn(label, ".") == length && strncasecmp(label, name, length) == 0;
+}
+
+static void w_json_check_member(const char * key, size_t length, void * arg) {
+    w_json_check_t * check = arg;
+    int i;
+
+    if (memchr(key, '\\', length)) {
+        check->escaped = 1;
+        return;
+    }
+
+    for (i = 0; check->labels[i].key && i < JSON_LABELS_MAX; i++) {
+        if (w_json_label_is(check->labels[i].key, key, length)) {
+            check->found |= 1ULL << i;
+        }
+    }
+}
+
+static void w_json_send(const char * json, size_t length, const char * file, logtarget * targets) {
+    mdebug2("Reading json message: '%.*s'%s", sample_log_length, json, length > (size_t)sample_log_length ? "..." : "");
+    w_msg_hash_queues_push(json, (char *)file, length + 1, targets, LOCALFILE_MQ);
+}
+
+/* Add the labels into new members at the end of the object. Return -1 if the line must be rebuilt */
+static int w_json_splice_labels(w_json_writer_t * writer, const char * begin, const char * end, const wlabel_t * labels, const w_json_check_t * check) {
+    const char * tail;
+    const char * key;
+    size_t length;
+    int depth;
+    int taken;
+    int i;
+    int j;
+
+    if (check->escaped) {
+        return -1;
+    }
+
+    w_json_writer_reset(writer);
+
+    /* The object without its closing brace */
+    for (tail = end - 1; tail > begin && (unsigned char)tail[-1] <= 32; tail--);
+    w_json_put_n(writer, begin, tail - begin);
+
+    for (i = 0; labels[i].key; i++) {
+        if (i == JSON_LABELS_MAX) {
+            return -1;
+        }
+
+        key = labels[i].key;
+        length = strcspn(key, ".");
+        taken = (check->found >> i) & 1;
+
+        for (j = 0; j < i && !taken; j++) {
+            taken = w_json_label_is(labels[j].key, key, length);
+        }
+
+        if (taken) {
+            // cJSON skips a label that is a member, but nests it into an object member
+            if (key[length] == '.') {
+                return -1;
+            }
+
+            continue;
+        }
+
+        length = strlen(labels[i].value);
+
+        if (length > 0 && labels[i].value[0] == '[' && labels[i].value[length - 1] == ']') {
+            // Labels holding an array are parsed
+            return -1;
+        }
+
+        for (depth = 0; length = strcspn(key, "."), key[length] == '.'; depth++) {
+            w_json_add_key_n(writer, key, length);
+            w_json_open_object(writer, NULL);
+            key += length + 1;
+        }
+
+        w_json_add_key_n(writer, key, length);
+        w_json_add_string(writer, NULL, labels[i].value);
+
+        while (depth--) {
+            w_json_close_object(writer);
+        }
+    }
+
+    w_json_close_object(writer);
+    return 0;
+}
+
+/* Check a line, add the labels and send it. The line is modified */
+static void w_json_process(char * line, const char * file, const wlabel_t * labels, logtarget * targets, w_json_writer_t * writer) {
+    w_json_check_t check = { labels, 0, 0 };
+    const char * begin;
+    char * end;
+    char * jsonParsed;
+    cJSON * obj;
+    int i;
+
+    if (labels && !labels[0].key) {
+        labels = NULL;
+    }
+
+    if (end = (char *)json_scan_object(line, &begin, labels ? w_json_check_member : NULL, &check), !end) {
+        mdebug1("Line '%.*s'%s read from '%s' is not a JSON object.", sample_log_length, line, strlen(line) > (size_t)sample_log_length ? "..." : "", file);
+        return;
+    }
+
+    if (!labels) {
+        *end = '\0';
+        w_json_send(begin, end - begin, file, targets);
+        return;
+    }
+
+    if (w_json_splice_labels(writer, begin, end, labels, &check) == 0) {
+        w_json_send(w_json_writer_str(writer), writer->length, file, targets);
+        return;
+    }
+
+    const char *jsonErrPtr;
+    if (obj = cJSON_ParseWithOpts(begin, &jsonErrPtr, 0), !obj) {
+        return;
+    }
+
+    for (i = 0; labels[i].key; i++) {
+        W_JSON_AddField(obj, labels[i].key, labels[i].value);
+    }
+
+    jsonParsed = cJSON_PrintUnformatted(obj);
+    cJSON_Delete(obj);
+    w_json_send(jsonParsed, strlen(jsonParsed), file, targets);
+    free(jsonParsed);
+}
+
+static void * w_json_parser(void * args) {
+    w_queue_t * queue = args;
+    w_json_line_t * lines[JSON_PARSE_BATCH];
+    w_json_writer_t writer = { NULL, 0, 0 };
+    size_t count;
+    size_t i;
+
+    while (1) {
+        count = queue_pop_ex_batch(queue, (void **)lines, JSON_PARSE_BATCH, NULL);
+
+        for (i = 0; i < count; i++) {
+            w_json_process(lines[i]->data, lines[i]->file, lines[i]->labels, lines[i]->targets, &writer);
+            free(lines[i]);
+        }
+    }
+
+    return NULL;
+}
+
+void w_json_parsers_init() {
+    int i;
+
+    if (parse_threads == 0) {
+        return;
+    }
+
+    os_calloc(parse_threads, sizeof(w_queue_t *), json_queues);
+
+    for (i = 0; i < parse_threads; i++) {
+        json_queues[i] = queue_init(OUTPUT_QUEUE_SIZE);
+#ifndef WIN32
+        w_create_named_thread(w_json_parser, json_queues[i], "lc-json-%d", i);
+#else
+        w_create_thread(NULL,
+                     0,
+                     (LPTHREAD_START_ROUTINE)w_json_parser,
+                     json_queues[i],
+                     0,
+                     NULL);
+#endif
+    }
+}
+
+/* Hand a line to a parse thread, or process it right away if there are none */
+static void w_json_dispatch(logreader * lf, w_queue_t * queue, char * line, w_json_writer_t * writer) {
+    w_json_line_t * record;
+    size_t length;
+    size_t file_length;
+
+    if (!queue) {
+        w_json_process(line, lf->file, lf->labels, lf->log_target, writer);
+        return;
+    }
+
+    length = strlen(line) + 1;
+    file_length = strlen(lf->file) + 1;
+
+    os_malloc(sizeof(w_json_line_t) + length + file_length, record);
+    record->labels = lf->labels;
+    record->targets = lf->log_target;
+    memcpy(record->data, line, length);
+    record->file = record->data + length;
+    memcpy(record->file, lf->file, file_length);
+
+    // Wait while the thread is busy, rather than dropping lines
+    queue_push_ex_block(queue, record);
+}
 
 /* Read json files */
 void *read_json(logreader *lf, int *rc, int drop_it) {
     int __ms = 0;
     int __ms_reported = 0;
-    int i;
-    char *jsonParsed;
     char str[OS_MAXSTR + 1];
     fpos_t fp_pos;
     int lines = 0;
-    cJSON * obj;
     int64_t offset = 0;
     int64_t rbytes = 0;
+    w_json_writer_t writer = { NULL, 0, 0 };
+    w_queue_t * queue = NULL;
+
+    if (json_queues) {
+        unsigned int hash = 0;
+        const char * c;
+
+        /* The lines of a file go to the same thread */
+        for (c = lf->file; *c; c++) {
+            hash = hash * 31 + (unsigned char)*c;
+        }
+
+        queue = json_queues[hash % parse_threads];
+    }
 
     str[OS_MAXSTR] = '\0';
     *rc = 0;
@@ -84,27 +327,12 @@ void *read_json(logreader *lf, int *rc, int drop_it) {
             continue;
         }
 #endif
-        const char *jsonErrPtr;
-        if (obj = cJSON_ParseWithOpts(str, &jsonErrPtr, 0), obj && cJSON_IsObject(obj)) {
-          for (i = 0; lf->labels && lf->labels[i].key; i++) {
-              W_JSON_AddField(obj, lf->labels[i].key, lf->labels[i].value);
-          }
-
-          jsonParsed = cJSON_PrintUnformatted(obj);
-          cJSON_Delete(obj);
-        } else {
-          cJSON_Delete(obj);
-          mdebug1("Line '%.*s'%s read from '%s' is not a JSON object.", sample_log_length, str, rbytes > sample_log_length ? "..." : "", lf->file);
-          continue;
-        }
-
-        mdebug2("Reading json message: '%.*s'%s", sample_log_length, jsonParsed, strlen(jsonParsed) > (size_t)sample_log_length ? "..." : "");
 
         /* Send message to queue */
         if (drop_it == 0) {
-            w_msg_hash_queues_push(jsonParsed, lf->file, strlen(jsonParsed) + 1, lf->log_target, LOCALFILE_MQ);
+            w_json_dispatch(lf, queue, str, &writer);
         }
-        free(jsonParsed);
+
         /* Incorrect message size */
         if (__ms) {
             // strlen(str) >= (OS_MAXSTR - OS_LOG_HEADER - 2)
@@ -136,6 +364,7 @@ void *read_json(logreader *lf, int *rc, int drop_it) {
         continue;
     }
 
+    w_json_writer_free(&writer);
     mdebug2("Read %d lines from %s", lines, lf->file);
     return (NULL);
 }
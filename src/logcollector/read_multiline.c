@@ -24,6 +24,8 @@ void *read_multiline(logreader *lf, int *rc, int drop_it) {
     int lines = 0;
     int64_t offset = 0;
     int64_t rbytes = 0;
+    char * summary;
+    int keep;
 
     buffer[0] = '\0';
     buffer[OS_MAXSTR] = '\0';
@@ -93,7 +95,15 @@ void *read_multiline(logreader *lf, int *rc, int drop_it) {
         /* Send message to queue */
         if (drop_it == 0) {
             mdebug2("Reading message: '%.*s'%s", sample_log_length, buffer, strlen(buffer) > (size_t)sample_log_length ? "..." : "");
-            w_msg_hash_queues_push(buffer, lf->file, strlen(buffer) + 1, lf->log_target, LOCALFILE_MQ);
+            keep = w_filter_line(lf, buffer, strlen(buffer), &summary);
+
+            if (summary) {
+                w_filter_push(lf, summary);
+            }
+
+            if (keep) {
+                w_msg_hash_queues_push(buffer, lf->file, strlen(buffer) + 1, lf->log_target, LOCALFILE_MQ);
+            }
         }
 
         buffer[0] = '\0';
@@ -128,6 +138,10 @@ void *read_multiline(logreader *lf, int *rc, int drop_it) {
         continue;
     }
 
+    if (summary = w_filter_flush(lf), summary) {
+        w_filter_push(lf, summary);
+    }
+
     mdebug2("Read %d lines from %s", lines, lf->file);
     return (NULL);
 }
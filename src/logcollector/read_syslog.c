@@ -14,6 +14,184 @@
 #include "logcollector.h"
 
 
+#ifndef WIN32
+
+/* Add a line of a block to the slices to queue, unless it's filtered out */
+static void syslog_queue(logreader *lf, w_msg_block_t *block, w_msg_slice_t **slices, int *size, int *count, char *str, long length) {
+    char * summary;
+    int keep = w_filter_line(lf, str, length, &summary);
+
+    if (summary) {
+        /* The lines held back go before this one */
+        if (*count > 0) {
+            w_msg_hash_queues_push_block(block, *slices, *count, lf->file, lf->log_target, LOCALFILE_MQ);
+            *count = 0;
+        }
+
+        w_filter_push(lf, summary);
+    }
+
+    if (keep) {
+        if (*count == *size) {
+            *size = *size ? *size * 2 : 256;
+            os_realloc(*slices, *size * sizeof(w_msg_slice_t), *slices);
+        }
+
+        (*slices)[*count].str = str;
+        (*slices)[(*count)++].size = length + 1;
+    }
+}
+
+/* Read syslog files
+ *
+ * The file is read in blocks of READ_BLOCK_SIZE bytes with pread(). The
+ * lines of a block are ended in place and queued as slices of it, so they
+ * aren't copied: the block is freed when the last of them has been sent.
+ */
+void *read_syslog(logreader *lf, int *rc, int drop_it) {
+    const long maxlen = OS_MAXSTR - OS_LOG_HEADER - 2;
+    int __ms_reported = 0;
+    int skipping = 0;
+    int incomplete = 0;
+    int lines = 0;
+    int fd = fileno(lf->fp);
+    long offset;
+    w_msg_slice_t * slices = NULL;
+    char * summary;
+    int size = 0;
+    int count;
+
+    *rc = 0;
+
+    if (offset = w_ftell(lf->fp), offset < 0) {
+        return (NULL);
+    }
+
+    while (!incomplete && can_read() && (!maximum_lines || lines < maximum_lines)) {
+        w_msg_block_t * block = w_msg_block_init(READ_BLOCK_SIZE);
+        ssize_t rbytes = pread(fd, block->data, READ_BLOCK_SIZE, offset);
+        int more = rbytes == READ_BLOCK_SIZE;
+        char * p;
+        char * end;
+
+        if (rbytes <= 0) {
+            if (rbytes < 0) {
+                merror("Cannot read from '%s': %s (%d)", lf->file, strerror(errno), errno);
+            }
+
+            w_msg_block_release(block);
+            break;
+        }
+
+        if (!more) {
+            // Don't keep the unused part while the messages are queued
+            os_realloc(block->data, rbytes, block->data);
+        }
+
+        p = block->data;
+        end = block->data + rbytes;
+        count = 0;
+
+        while (p < end && can_read() && (!maximum_lines || lines < maximum_lines)) {
+            char * nl = memchr(p, '\n', end - p);
+            long length = (nl ? nl : end) - p;
+
+            if (skipping) {
+                /* Discard the rest of a large message */
+                if (nl) {
+                    skipping = 0;
+                    p = nl + 1;
+                } else {
+                    p = end;
+                }
+
+                continue;
+            }
+
+            if (length > maxlen) {
+                /* Message size > maximum allowed: send what fits */
+                lines++;
+                p[maxlen] = '\0';
+
+                if (!__ms_reported) {
+                    merror("Large message size from file '%s' (length = " FTELL_TT "): '%.*s'...", lf->file, FTELL_INT64 (maxlen + 1), sample_log_length, p);
+                    __ms_reported = 1;
+                } else {
+                    mdebug2("Large message size from file '%s' (length = " FTELL_TT "): '%.*s'...", lf->file, FTELL_INT64 (maxlen + 1), sample_log_length, p);
+                }
+
+                if (drop_it == 0) {
+                    syslog_queue(lf, block, &slices, &size, &count, p, maxlen);
+                }
+
+                if (nl) {
+                    p = nl + 1;
+                } else {
+                    skipping = 1;
+                    p = end;
+                }
+
+                continue;
+            }
+
+            if (!nl) {
+                /* The line goes on in the next block, or it's not complete yet */
+                if (!more) {
+                    mdebug2("Message not complete from '%s'. Trying again: '%.*s'%s", lf->file, (int)(length < sample_log_length ? length : sample_log_length), p, length > sample_log_length ? "..." : "");
+                    incomplete = 1;
+                }
+
+                break;
+            }
+
+            lines++;
+            *nl = '\0';
+
+            if (memchr(p, '\0', length)) {
+                mdebug2("Line in '%s' contains some zero-bytes (valid=" FTELL_TT "/ total=" FTELL_TT "). Dropping line.", lf->file, FTELL_INT64 strlen(p), FTELL_INT64 length);
+                p = nl + 1;
+                continue;
+            }
+
+            mdebug2("Reading syslog message: '%.*s'%s", sample_log_length, p, length + 1 > sample_log_length ? "..." : "");
+
+            /* Send message to queue */
+            if (drop_it == 0) {
+                syslog_queue(lf, block, &slices, &size, &count, p, length);
+            }
+
+            p = nl + 1;
+        }
+
+        offset += p - block->data;
+
+        if (count > 0) {
+            w_msg_hash_queues_push_block(block, slices, count, lf->file, lf->log_target, LOCALFILE_MQ);
+        }
+
+        w_msg_block_release(block);
+
+        if (!more) {
+            break;
+        }
+    }
+
+    if (summary = w_filter_flush(lf), summary) {
+        w_filter_push(lf, summary);
+    }
+
+    /* Leave the stream where the next read must start */
+    if (fseek(lf->fp, offset, SEEK_SET) < 0) {
+        merror(FSEEK_ERROR, lf->file, errno, strerror(errno));
+    }
+
+    os_free(slices);
+    mdebug2("Read %d lines from %s", lines, lf->file);
+    return (NULL);
+}
+
+#else
+
 /* Read syslog files */
 void *read_syslog(logreader *lf, int *rc, int drop_it) {
     int __ms = 0;
@@ -21,6 +199,8 @@ void *read_syslog(logreader *lf, int *rc, int drop_it) {
     char str[OS_MAXSTR + 1];
     fpos_t fp_pos;
     int lines = 0;
+    char * summary;
+    int keep;
 #ifdef WIN32
     int64_t offset;
     int64_t rbytes;
@@ -98,7 +278,15 @@ void *read_syslog(logreader *lf, int *rc, int drop_it) {
 
         /* Send message to queue */
         if (drop_it == 0) {
-            w_msg_hash_queues_push(str, lf->file, rbytes, lf->log_target, LOCALFILE_MQ);
+            keep = w_filter_line(lf, str, strlen(str), &summary);
+
+            if (summary) {
+                w_filter_push(lf, summary);
+            }
+
+            if (keep) {
+                w_msg_hash_queues_push(str, lf->file, rbytes, lf->log_target, LOCALFILE_MQ);
+            }
         }
         /* Incorrect message size */
         if (__ms) {
@@ -131,6 +319,12 @@ void *read_syslog(logreader *lf, int *rc, int drop_it) {
         continue;
     }
 
+    if (summary = w_filter_flush(lf), summary) {
+        w_filter_push(lf, summary);
+    }
+
     mdebug2("Read %d lines from %s", lines, lf->file);
     return (NULL);
 }
+
+#endif
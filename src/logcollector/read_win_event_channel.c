@@ -20,6 +20,13 @@
 /* Bookmarks directory */
 #define BOOKMARKS_DIR "bookmarks"
 
+/* Events taken from a subscription at once */
+#define WIN_EVT_BATCH 64
+
+/* A bookmark is saved after this many events, or this many seconds */
+#define BOOKMARK_EVENTS 1000
+#define BOOKMARK_INTERVAL 5
+
 /* Logging levels */
 #define WINEVENT_AUDIT		0
 #define WINEVENT_CRITICAL	1
@@ -57,6 +64,7 @@ typedef struct _os_event {
     char *category;
 } os_event;
 
+/* Each channel is pulled by its own thread, so its state needs no locking */
 typedef struct _os_channel {
     char *evt_log;
     char *bookmark_name;
@@ -64,10 +72,27 @@ typedef struct _os_channel {
     char bookmark_filename[OS_MAXSTR];
     char *query;
     int reconnect_time;
+    wchar_t *wchannel;
+    wchar_t *wquery;
+    EVT_HANDLE subscription;
+    HANDLE signal;                  // Set when the subscription has events
+    EVT_HANDLE bookmark;            // Position of the last event sent
+    char bookmark_set;              // The bookmark has a position
+    unsigned int bookmark_pending;  // Events sent since the bookmark was saved
+    time_t bookmark_saved;
+    OSHash *publishers;             // Publisher metadata, by provider name
+    void *render_buffer;
+    DWORD render_size;
+    wchar_t *message_buffer;
+    DWORD message_size;
+    w_json_writer_t writer;
+    w_json_writer_t scratch;        // Event and message escaped as the manager would print them
 } os_channel;
 
-static char *get_message(EVT_HANDLE evt, LPCWSTR provider_name, DWORD flags);
+static char *get_message(EVT_HANDLE evt, EVT_HANDLE publisher, DWORD flags, os_channel *channel);
+static int render_event(os_channel *channel, const char *xml_event, const char *message);
 static EVT_HANDLE read_bookmark(os_channel *channel);
+static int event_channel_subscribe(os_channel *channel);
 
 wchar_t *convert_unix_string(char *string)
 {
@@ -120,20 +145,28 @@ wchar_t *convert_unix_string(char *string)
     return (dest);
 }
 
-char *get_message(EVT_HANDLE evt, LPCWSTR provider_name, DWORD flags)
+/* Get the publisher metadata of a provider, opened once per channel */
+static EVT_HANDLE get_publisher(os_channel *channel, const char *provider_name)
 {
-    char *message = NULL;
-    EVT_HANDLE publisher = NULL;
-    DWORD size = 0;
-    wchar_t *buffer = NULL;
-    int result = 0;
+    EVT_HANDLE *publisher;
+    wchar_t *wprovider_name;
 
-    publisher = EvtOpenPublisherMetadata(NULL,
-                                         provider_name,
-                                         NULL,
-                                         0,
-                                         0);
-    if (publisher == NULL) {
+    if (publisher = OSHash_Get(channel->publishers, provider_name), publisher) {
+        return (*publisher);
+    }
+
+    os_calloc(1, sizeof(EVT_HANDLE), publisher);
+
+    if (wprovider_name = convert_unix_string((char *)provider_name), wprovider_name) {
+        *publisher = EvtOpenPublisherMetadata(NULL,
+                                              wprovider_name,
+                                              NULL,
+                                              0,
+                                              0);
+        free(wprovider_name);
+    }
+
+    if (*publisher == NULL) {
         LSTATUS err = GetLastError();
         char error_msg[OS_SIZE_1024];
         error_msg[OS_SIZE_1024 - 1] = '\0';
@@ -143,66 +176,52 @@ char *get_message(EVT_HANDLE evt, LPCWSTR provider_name, DWORD flags)
                 (LPTSTR) &error_msg, OS_SIZE_1024, NULL);
 
         mdebug1(
-            "Could not EvtOpenPublisherMetadata() with flags (%lu) which returned (%lu): %s",
-            flags,
+            "Could not EvtOpenPublisherMetadata() for provider (%s) which returned (%lu): %s",
+            provider_name,
             err,
             error_msg);
-        goto cleanup;
     }
 
-    /* Make initial call to determine buffer size */
-    result = EvtFormatMessage(publisher,
-                              evt,
-                              0,
-                              0,
-                              NULL,
-                              flags,
-                              0,
-                              NULL,
-                              &size);
-    if (result != FALSE || GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-        merror(
-            "Could not EvtFormatMessage() to determine buffer size with flags (%lu) which returned (%lu)",
-            flags,
-            GetLastError());
-        goto cleanup;
-    }
+    /* Providers that can't be opened are remembered too */
+    if (OSHash_Add(channel->publishers, provider_name, publisher) != 2) {
+        if (*publisher != NULL) {
+            EvtClose(*publisher);
+        }
 
-    if ((buffer = calloc(size, sizeof(wchar_t))) == NULL) {
-        merror(
-            "Could not calloc() memory which returned [(%d)-(%s)]",
-            errno,
-            strerror(errno));
-        goto cleanup;
+        free(publisher);
+        return (NULL);
     }
 
-    result = EvtFormatMessage(publisher,
-                              evt,
-                              0,
-                              0,
-                              NULL,
-                              flags,
-                              size,
-                              buffer,
-                              &size);
-    if (result == FALSE) {
-        merror(
-            "Could not EvtFormatMessage() with flags (%lu) which returned (%lu)",
-            flags,
-            GetLastError());
-        goto cleanup;
-    }
+    return (*publisher);
+}
 
-    message = convert_windows_string(buffer);
+char *get_message(EVT_HANDLE evt, EVT_HANDLE publisher, DWORD flags, os_channel *channel)
+{
+    DWORD size = 0;
 
-cleanup:
-    free(buffer);
+    /* Format into the buffer of the channel, and grow it if needed */
+    while (!EvtFormatMessage(publisher,
+                             evt,
+                             0,
+                             0,
+                             NULL,
+                             flags,
+                             channel->message_size,
+                             channel->message_buffer,
+                             &size)) {
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || size <= channel->message_size) {
+            merror(
+                "Could not EvtFormatMessage() with flags (%lu) which returned (%lu)",
+                flags,
+                GetLastError());
+            return (NULL);
+        }
 
-    if (publisher != NULL) {
-        EvtClose(publisher);
+        os_realloc(channel->message_buffer, size * sizeof(wchar_t), channel->message_buffer);
+        channel->message_size = size;
     }
 
-    return (message);
+    return (convert_windows_string(channel->message_buffer));
 }
 
 /* Read an existing bookmark (if one exists) */
@@ -264,38 +283,22 @@ EVT_HANDLE read_bookmark(os_channel *channel)
     return (bookmark);
 }
 
-/* Update the log position of a bookmark */
-int update_bookmark(EVT_HANDLE evt, os_channel *channel)
+/* Write the bookmark of a channel into its file */
+static int save_bookmark(os_channel *channel)
 {
     DWORD size = 0;
     DWORD count = 0;
     void *buffer = NULL;
     int result = 0;
     int status = 0;
-    EVT_HANDLE bookmark = NULL;
     FILE *fp = NULL;
 
-    if ((bookmark = EvtCreateBookmark(NULL)) == NULL) {
-        merror(
-            "Could not EvtCreateBookmark() bookmark (%s) for (%s) which returned (%lu)",
-            channel->bookmark_filename,
-            channel->evt_log,
-            GetLastError());
-        goto cleanup;
-    }
-
-    if (!EvtUpdateBookmark(bookmark, evt)) {
-        merror(
-            "Could not EvtUpdateBookmark() bookmark (%s) for (%s) which returned (%lu)",
-            channel->bookmark_filename,
-            channel->evt_log,
-            GetLastError());
-        goto cleanup;
-    }
+    channel->bookmark_pending = 0;
+    channel->bookmark_saved = time(NULL);
 
     /* Make initial call to determine buffer size */
     result = EvtRender(NULL,
-                       bookmark,
+                       channel->bookmark,
                        EvtRenderBookmark,
                        0,
                        NULL,
@@ -321,7 +324,7 @@ int update_bookmark(EVT_HANDLE evt, os_channel *channel)
     }
 
     if (!EvtRender(NULL,
-                   bookmark,
+                   channel->bookmark,
                    EvtRenderBookmark,
                    size,
                    buffer,
@@ -355,6 +358,7 @@ int update_bookmark(EVT_HANDLE evt, os_channel *channel)
     }
 
     fclose(fp);
+    fp = NULL;
 
     /* Success */
     status = 1;
@@ -362,10 +366,6 @@ int update_bookmark(EVT_HANDLE evt, os_channel *channel)
 cleanup:
     free(buffer);
 
-    if (bookmark != NULL) {
-        EvtClose(bookmark);
-    }
-
     if (fp) {
         fclose(fp);
     }
@@ -373,16 +373,67 @@ cleanup:
     return (status);
 }
 
+/* Move the bookmark to an event. It's saved every BOOKMARK_EVENTS events or BOOKMARK_INTERVAL seconds */
+static int update_bookmark(EVT_HANDLE evt, os_channel *channel)
+{
+    if (!EvtUpdateBookmark(channel->bookmark, evt)) {
+        merror(
+            "Could not EvtUpdateBookmark() bookmark (%s) for (%s) which returned (%lu)",
+            channel->bookmark_filename,
+            channel->evt_log,
+            GetLastError());
+        return (0);
+    }
+
+    channel->bookmark_set = 1;
+
+    if (++channel->bookmark_pending >= BOOKMARK_EVENTS || time(NULL) - channel->bookmark_saved >= BOOKMARK_INTERVAL) {
+        return (save_bookmark(channel));
+    }
+
+    return (1);
+}
+
+/* Save the bookmark if some events were sent since it was saved */
+static void flush_bookmark(os_channel *channel)
+{
+    if (channel->bookmark_enabled && channel->bookmark_pending) {
+        save_bookmark(channel);
+    }
+}
+
+/* Render the event into channel->writer as the manager would decode it. Return -1 to send the XML instead */
+static int render_event(os_channel *channel, const char *xml_event, const char *message)
+{
+    char *shown_message = NULL;
+    int retval;
+
+    // The manager takes both values as they are printed in the JSON event
+    if (message) {
+        w_json_writer_reset(&channel->scratch);
+        w_json_add_string(&channel->scratch, NULL, message);
+        shown_message = wstr_unescape_json(w_json_writer_str(&channel->scratch));
+    }
+
+    w_json_writer_reset(&channel->scratch);
+    w_json_add_string(&channel->scratch, NULL, xml_event);
+
+    retval = w_winevt_render(channel->scratch.buffer, channel->scratch.length, shown_message, &channel->writer);
+    os_free(shown_message);
 
-void send_channel_event(EVT_HANDLE evt, os_channel *channel)
+    if (retval == 0 && channel->writer.length > OS_MAXSTR - OS_LOG_HEADER) {
+        retval = -1;
+    }
+
+    return retval;
+}
+
+static void send_channel_event(EVT_HANDLE evt, os_channel *channel)
 {
     DWORD buffer_length = 0;
-    PEVT_VARIANT properties_values = NULL;
     DWORD count = 0;
-    int result = 0;
-    wchar_t *wprovider_name = NULL;
-    char *msg_sent = NULL;
-    char *provider_name = NULL;
+    EVT_HANDLE publisher = NULL;
+    char provider_name[OS_MAXSTR];
     char *msg_from_prov = NULL;
     char *xml_event = NULL;
     char *beg_prov = NULL;
@@ -390,51 +441,32 @@ void send_channel_event(EVT_HANDLE evt, os_channel *channel)
     char *find_prov = NULL;
     size_t num;
 
-    cJSON *event_json = cJSON_CreateObject();
-
-    os_malloc(OS_MAXSTR, provider_name);
-
-    result = EvtRender(NULL,
-                       evt,
-                       EvtRenderEventXml,
-                       0,
-                       NULL,
-                       &buffer_length,
-                       &count);
-    if (result != FALSE || GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-        merror(
-            "Could not EvtRender() to determine buffer size for (%s) which returned (%lu)",
-            channel->evt_log,
-            GetLastError());
-        goto cleanup;
-    }
+    provider_name[0] = '\0';
+
+    /* Render into the buffer of the channel, and grow it if needed */
+    while (!EvtRender(NULL,
+                      evt,
+                      EvtRenderEventXml,
+                      channel->render_size,
+                      channel->render_buffer,
+                      &buffer_length,
+                      &count)) {
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || buffer_length <= channel->render_size) {
+            merror(
+                "Could not EvtRender() for (%s) which returned (%lu)",
+                channel->evt_log,
+                GetLastError());
+            return;
+        }
 
-    if ((properties_values = malloc(buffer_length)) == NULL) {
-        merror(
-            "Could not malloc() memory to process event (%s) which returned [(%d)-(%s)]",
-            channel->evt_log,
-            errno,
-            strerror(errno));
-        goto cleanup;
+        os_realloc(channel->render_buffer, buffer_length, channel->render_buffer);
+        channel->render_size = buffer_length;
     }
 
-    if (!EvtRender(NULL,
-                   evt,
-                   EvtRenderEventXml,
-                   buffer_length,
-                   properties_values,
-                   &buffer_length,
-                   &count)) {
-        merror(
-            "Could not EvtRender() for (%s) which returned (%lu)",
-            channel->evt_log,
-            GetLastError());
-        goto cleanup;
-    }
-    xml_event = convert_windows_string((LPCWSTR) properties_values);
+    xml_event = convert_windows_string((LPCWSTR) channel->render_buffer);
 
     if (!xml_event) {
-        goto cleanup;
+        return;
     }
 
     find_prov = strstr(xml_event, "Provider Name=");
@@ -454,81 +486,144 @@ void send_channel_event(EVT_HANDLE evt, os_channel *channel)
 
                 memcpy(provider_name, beg_prov+1, num);
                 provider_name[num] = '\0';
-                find_prov = '\0';
-                beg_prov = '\0';
-                end_prov = '\0';
             }
         }
     }
 
-     if (provider_name) {
-        wprovider_name = convert_unix_string(provider_name);
-
-        if (wprovider_name && (msg_from_prov = get_message(evt, wprovider_name, EvtFormatMessageEvent)) == NULL) {
+    if (*provider_name) {
+        if ((publisher = get_publisher(channel, provider_name)) == NULL ||
+            (msg_from_prov = get_message(evt, publisher, EvtFormatMessageEvent, channel)) == NULL) {
             merror(
                 "Could not get message for (%s)",
                 channel->evt_log);
         }
-        else {
-            cJSON_AddStringToObject(event_json, "Message", msg_from_prov);
-        }
     }
 
     win_format_event_string(xml_event);
 
-    cJSON_AddStringToObject(event_json, "Event", xml_event);
-    msg_sent = cJSON_PrintUnformatted(event_json);
+    if (winevt_render && render_event(channel, xml_event, msg_from_prov) == 0) {
+        if (SendMSG(logr_queue, w_json_writer_str(&channel->writer), "EventChannel", WIN_EVT_MQ) < 0) {
+            merror(QUEUE_SEND);
+        }
 
-    if (SendMSG(logr_queue, msg_sent, "EventChannel", WIN_EVT_MQ) < 0) {
-        merror(QUEUE_SEND);
+        goto cleanup;
     }
 
-    if (channel->bookmark_enabled) {
-        update_bookmark(evt, channel);
+    w_json_writer_reset(&channel->writer);
+    w_json_open_object(&channel->writer, NULL);
+    w_json_add_string(&channel->writer, "Message", msg_from_prov);
+    w_json_add_string(&channel->writer, "Event", xml_event);
+    w_json_close_object(&channel->writer);
+
+    if (SendMSG(logr_queue, w_json_writer_str(&channel->writer), "EventChannel", WIN_EVT_MQ) < 0) {
+        merror(QUEUE_SEND);
     }
 
 cleanup:
     os_free(msg_from_prov);
     os_free(xml_event);
-    os_free(msg_sent);
-    os_free(properties_values);
-    os_free(provider_name);
-    os_free(wprovider_name);
-    cJSON_Delete(event_json);
 
     return;
 }
 
-DWORD WINAPI event_channel_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, os_channel *channel, EVT_HANDLE evt)
+/* Pull the events of a channel in batches, and subscribe again if the service goes down */
+static DWORD WINAPI event_channel_thread(os_channel *channel)
 {
-    if (action == EvtSubscribeActionDeliver) {
-        send_channel_event(evt, channel);
-    } else {
-        mwarn("The eventlog service is down. Unable to collect logs from '%s' channel.", channel->evt_log);
-        while(1) {
-            /* Try to restart EventChannel */
-            if (win_start_event_channel(channel->evt_log, !channel->bookmark_enabled, channel->query, channel->reconnect_time) == -1) {
-                mdebug1("Trying to reconnect %s channel in %i seconds.", channel->evt_log, channel->reconnect_time );
-                sleep(channel->reconnect_time);
-            } else {
-                minfo("'%s' channel has been reconnected succesfully.", channel->evt_log);
-                break;
+    EVT_HANDLE events[WIN_EVT_BATCH];
+    DWORD returned;
+    DWORD i;
+
+    while (1) {
+        if (WaitForSingleObject(channel->signal, BOOKMARK_INTERVAL * 1000) != WAIT_OBJECT_0) {
+            flush_bookmark(channel);
+            continue;
+        }
+
+        /* Events that come from now on set the signal again */
+        ResetEvent(channel->signal);
+
+        while (EvtNext(channel->subscription, WIN_EVT_BATCH, events, INFINITE, 0, &returned)) {
+            for (i = 0; i < returned; i++) {
+                send_channel_event(events[i], channel);
             }
+
+            if (channel->bookmark_enabled && returned > 0) {
+                update_bookmark(events[returned - 1], channel);
+            }
+
+            for (i = 0; i < returned; i++) {
+                EvtClose(events[i]);
+            }
+        }
+
+        if (GetLastError() == ERROR_NO_MORE_ITEMS) {
+            continue;
         }
+
+        mwarn("The eventlog service is down. Unable to collect logs from '%s' channel.", channel->evt_log);
+        flush_bookmark(channel);
+        EvtClose(channel->subscription);
+        channel->subscription = NULL;
+
+        /* Try to restart EventChannel, after the last event sent */
+        while (event_channel_subscribe(channel) == -1) {
+            mdebug1("Trying to reconnect %s channel in %i seconds.", channel->evt_log, channel->reconnect_time );
+            sleep(channel->reconnect_time);
+        }
+
+        minfo("'%s' channel has been reconnected succesfully.", channel->evt_log);
     }
 
     return (0);
 }
 
+/* Open the subscription of a channel, after its bookmark if it has one */
+static int event_channel_subscribe(os_channel *channel)
+{
+    DWORD flags = channel->bookmark_set ? EvtSubscribeStartAfterBookmark : EvtSubscribeToFutureEvents;
+
+    channel->subscription = EvtSubscribe(NULL,
+                                         channel->signal,
+                                         channel->wchannel,
+                                         channel->wquery,
+                                         channel->bookmark_set ? channel->bookmark : NULL,
+                                         NULL,
+                                         NULL,
+                                         flags);
+
+    if (channel->subscription == NULL && flags == EvtSubscribeStartAfterBookmark) {
+        channel->subscription = EvtSubscribe(NULL,
+                                             channel->signal,
+                                             channel->wchannel,
+                                             channel->wquery,
+                                             NULL,
+                                             NULL,
+                                             NULL,
+                                             EvtSubscribeToFutureEvents);
+    }
+
+    if (channel->subscription == NULL) {
+        unsigned long id = GetLastError();
+        if (id != RPC_S_SERVER_UNAVAILABLE && id != RPC_S_UNKNOWN_IF) {
+            merror(
+                "Could not EvtSubscribe() for (%s) which returned (%lu)",
+                channel->evt_log,
+                id);
+        }
+        return (-1);
+    }
+
+    /* There may be events already */
+    SetEvent(channel->signal);
+    return (0);
+}
+
 int win_start_event_channel(char *evt_log, char future, char *query, int reconnect_time)
 {
     wchar_t *wchannel = NULL;
     wchar_t *wquery = NULL;
     char *filtered_query = NULL;
     os_channel *channel = NULL;
-    DWORD flags = EvtSubscribeToFutureEvents;
-    EVT_HANDLE bookmark = NULL;
-    EVT_HANDLE result = NULL;
     int status = 0;
 
     if ((channel = calloc(1, sizeof(os_channel))) == NULL) {
@@ -593,64 +688,79 @@ int win_start_event_channel(char *evt_log, char future, char *query, int reconne
                  sizeof(channel->bookmark_filename), "%s/%s", BOOKMARKS_DIR,
                  channel->bookmark_name);
 
-        /* Try to read existing bookmark */
-        if ((bookmark = read_bookmark(channel)) != NULL) {
-            flags = EvtSubscribeStartAfterBookmark;
+        /* Try to read existing bookmark, or start a new one */
+        if ((channel->bookmark = read_bookmark(channel)) != NULL) {
+            channel->bookmark_set = 1;
+        } else if ((channel->bookmark = EvtCreateBookmark(NULL)) == NULL) {
+            merror(
+                "Could not EvtCreateBookmark() bookmark (%s) for (%s) which returned (%lu)",
+                channel->bookmark_filename,
+                channel->evt_log,
+                GetLastError());
+            goto cleanup;
         }
+
+        channel->bookmark_saved = time(NULL);
     }
 
-    result = EvtSubscribe(NULL,
-                          NULL,
-                          wchannel,
-                          wquery,
-                          bookmark,
-                          channel,
-                          (EVT_SUBSCRIBE_CALLBACK)event_channel_callback,
-                          flags);
+    if ((channel->signal = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL) {
+        merror(
+            "Could not CreateEvent() for (%s) which returned (%lu)",
+            channel->evt_log,
+            GetLastError());
+        goto cleanup;
+    }
 
-    if (result == NULL && flags == EvtSubscribeStartAfterBookmark) {
-        result = EvtSubscribe(NULL,
-                              NULL,
-                              wchannel,
-                              wquery,
-                              NULL,
-                              channel,
-                              (EVT_SUBSCRIBE_CALLBACK)event_channel_callback,
-                              EvtSubscribeToFutureEvents);
+    if ((channel->publishers = OSHash_Create()) == NULL) {
+        merror("Could not create the publisher table for (%s).", channel->evt_log);
+        goto cleanup;
     }
 
-    if (result == NULL) {
-        unsigned long id = GetLastError();
-        if (id != RPC_S_SERVER_UNAVAILABLE && id != RPC_S_UNKNOWN_IF) {
-            merror(
-                "Could not EvtSubscribe() for (%s) which returned (%lu)",
-                channel->evt_log,
-                id);
-        }
+    channel->wchannel = wchannel;
+    channel->wquery = wquery;
+
+    if (event_channel_subscribe(channel) == -1) {
         goto cleanup;
     }
 
+    w_create_thread(NULL,
+                    0,
+                    (LPTHREAD_START_ROUTINE)event_channel_thread,
+                    channel,
+                    0,
+                    NULL);
+
     /* Success */
     status = 1;
 
 cleanup:
-    free(wchannel);
-    free(wquery);
     free(filtered_query);
 
     if (status == 0) {
+        free(wchannel);
+        free(wquery);
+
         if (channel) {
             os_free(channel->bookmark_name);
-        }
-        free(channel);
 
-        if (result != NULL) {
-            EvtClose(result);
+            if (channel->subscription != NULL) {
+                EvtClose(channel->subscription);
+            }
+
+            if (channel->bookmark != NULL) {
+                EvtClose(channel->bookmark);
+            }
+
+            if (channel->signal != NULL) {
+                CloseHandle(channel->signal);
+            }
+
+            if (channel->publishers != NULL) {
+                OSHash_Free(channel->publishers);
+            }
         }
-    }
 
-    if (bookmark != NULL) {
-        EvtClose(bookmark);
+        free(channel);
     }
 
     return status ? 0 : -1;
@@ -12,9 +12,283 @@
 #include "monitord.h"
 #include "../external/zlib/zlib.h"
 
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_CLASS_SHIFT  13
+#endif
+
+/* Uncompressed size of each gzip member written by the workers */
+#define GZ_BLOCK_SIZE (1024 * 1024)
+
+/* Blocks read ahead per worker */
+#define GZ_BLOCKS_PER_THREAD 2
+
+typedef enum gz_block_state {
+    GZ_BLOCK_FREE,
+    GZ_BLOCK_READY,
+    GZ_BLOCK_BUSY,
+    GZ_BLOCK_DONE,
+    GZ_BLOCK_ERROR
+} gz_block_state;
+
+/* Block compressed as an independent gzip member */
+typedef struct gz_block {
+    unsigned char * in;
+    size_t in_len;
+    unsigned char * out;
+    size_t out_len;
+    size_t out_size;
+    gz_block_state state;
+} gz_block;
+
+/* Pool of workers compressing the blocks of a file */
+typedef struct gz_pool {
+    gz_block * blocks;
+    unsigned int n_blocks;
+    unsigned long submitted;        // Blocks read
+    unsigned long taken;            // Blocks taken by a worker
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t available;       // A block is ready to compress, or stop is set
+    pthread_cond_t done;            // A block was compressed
+} gz_pool;
+
+static int compress_threads = 1;
+static int compress_nice;
+static int compress_idle_io;
+
+void OS_CompressLogSetup(int threads, int nice_value, int idle_io)
+{
+    compress_threads = threads > 0 ? threads : get_nproc();
+    compress_nice = nice_value;
+    compress_idle_io = idle_io;
+}
+
+#ifdef __linux__
+/* Move the calling thread to the idle I/O class, returning the former priority */
+static int gz_idle_io(void)
+{
+    pid_t tid = syscall(SYS_gettid);
+    int former = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid);
+
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0) {
+        mdebug1("Cannot set the I/O priority of the compression: %s (%d)", strerror(errno), errno);
+        return -1;
+    }
+
+    return former;
+}
+
+static void gz_restore_io(int former)
+{
+    if (former >= 0) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, (pid_t)syscall(SYS_gettid), former);
+    }
+}
+#endif
+
+/* Compress a block into a whole gzip member */
+static int gz_compress_block(gz_block * block)
+{
+    z_stream strm = { .zalloc = Z_NULL };
+    size_t bound;
+    int result;
+
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+
+    bound = deflateBound(&strm, block->in_len);
+
+    if (bound > block->out_size) {
+        os_realloc(block->out, bound, block->out);
+        block->out_size = bound;
+    }
+
+    strm.next_in = block->in;
+    strm.avail_in = block->in_len;
+    strm.next_out = block->out;
+    strm.avail_out = block->out_size;
+
+    result = deflate(&strm, Z_FINISH);
+    block->out_len = block->out_size - strm.avail_out;
+    deflateEnd(&strm);
+
+    return result == Z_STREAM_END ? 0 : -1;
+}
+
+static void * gz_worker(void * arg)
+{
+    gz_pool * pool = arg;
+    gz_block * block;
+    int result;
+
+#ifdef __linux__
+    if (compress_nice && setpriority(PRIO_PROCESS, syscall(SYS_gettid), compress_nice) < 0) {
+        mdebug1("Cannot set the priority of the compression: %s (%d)", strerror(errno), errno);
+    }
+
+    if (compress_idle_io) {
+        gz_idle_io();
+    }
+#endif
+
+    w_mutex_lock(&pool->mutex);
+
+    while (1) {
+        while (!pool->stop && pool->taken == pool->submitted) {
+            w_cond_wait(&pool->available, &pool->mutex);
+        }
+
+        if (pool->taken == pool->submitted) {
+            break;
+        }
+
+        block = &pool->blocks[pool->taken++ % pool->n_blocks];
+        block->state = GZ_BLOCK_BUSY;
+        w_mutex_unlock(&pool->mutex);
+
+        result = gz_compress_block(block);
+
+        w_mutex_lock(&pool->mutex);
+        block->state = result == 0 ? GZ_BLOCK_DONE : GZ_BLOCK_ERROR;
+        w_cond_broadcast(&pool->done);
+    }
+
+    w_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/* Compress a file with a pool of threads, like pigz: every block is an
+ * independent gzip member, and gzip readers decompress their concatenation. */
+static int gz_compress_parallel(FILE * log, FILE * zlog, int threads, log_read_hook hook, void * arg)
+{
+    gz_pool pool = { .n_blocks = threads * GZ_BLOCKS_PER_THREAD };
+    pthread_t * workers;
+    unsigned long written = 0;
+    int started;
+    int eof = 0;
+    int retval = 0;
+    unsigned int i;
+
+    os_calloc(pool.n_blocks, sizeof(gz_block), pool.blocks);
+    os_calloc(threads, sizeof(pthread_t), workers);
+
+    for (i = 0; i < pool.n_blocks; i++) {
+        os_malloc(GZ_BLOCK_SIZE, pool.blocks[i].in);
+    }
+
+    w_mutex_init(&pool.mutex, NULL);
+    w_cond_init(&pool.available, NULL);
+    w_cond_init(&pool.done, NULL);
+
+    for (started = 0; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, gz_worker, &pool)) {
+            merror(THREAD_ERROR);
+            break;
+        }
+    }
+
+    if (started == 0) {
+        retval = -1;
+        goto end;
+    }
+
+    while (retval == 0) {
+        /* Read ahead into the free blocks */
+        while (!eof && pool.submitted - written < pool.n_blocks) {
+            gz_block * block = &pool.blocks[pool.submitted % pool.n_blocks];
+
+            if (block->in_len = fread(block->in, 1, GZ_BLOCK_SIZE, log), block->in_len == 0) {
+                eof = 1;
+
+                /* An empty file still gets an empty member */
+                if (pool.submitted > 0) {
+                    break;
+                }
+            }
+
+            if (hook) {
+                hook(block->in, block->in_len, arg);
+            }
+
+            w_mutex_lock(&pool.mutex);
+            block->state = GZ_BLOCK_READY;
+            pool.submitted++;
+            w_cond_signal(&pool.available);
+            w_mutex_unlock(&pool.mutex);
+        }
+
+        if (written == pool.submitted) {
+            break;
+        }
+
+        /* Write the oldest block, keeping the order of the file */
+        gz_block * block = &pool.blocks[written % pool.n_blocks];
+
+        w_mutex_lock(&pool.mutex);
+
+        while (block->state != GZ_BLOCK_DONE && block->state != GZ_BLOCK_ERROR) {
+            w_cond_wait(&pool.done, &pool.mutex);
+        }
+
+        w_mutex_unlock(&pool.mutex);
+
+        if (block->state == GZ_BLOCK_ERROR) {
+            merror("Compression error: deflate failed.");
+            retval = -1;
+        } else if (fwrite(block->out, 1, block->out_len, zlog) != block->out_len) {
+            merror("Compression error: %s (%d)", strerror(errno), errno);
+            retval = -1;
+        }
+
+        block->state = GZ_BLOCK_FREE;
+        written++;
+    }
+
+    if (ferror(log)) {
+        merror("Compression error: %s (%d)", strerror(errno), errno);
+        retval = -1;
+    }
+
+    /* Blocks still queued on error are discarded by the workers as they finish */
+    w_mutex_lock(&pool.mutex);
+    pool.stop = 1;
+    pool.submitted = pool.taken;
+    w_cond_broadcast(&pool.available);
+    w_mutex_unlock(&pool.mutex);
+
+end:
+    for (i = 0; i < (unsigned int)started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    for (i = 0; i < pool.n_blocks; i++) {
+        free(pool.blocks[i].in);
+        free(pool.blocks[i].out);
+    }
+
+    pthread_mutex_destroy(&pool.mutex);
+    pthread_cond_destroy(&pool.available);
+    pthread_cond_destroy(&pool.done);
+    free(pool.blocks);
+    free(workers);
+
+    return retval;
+}
 
 /* gzip a log file */
 void OS_CompressLog(const char *logfile)
+{
+    OS_CompressLogEx(logfile, NULL, NULL);
+}
+
+/* gzip a log file, passing its content to a hook as it's read */
+int OS_CompressLogEx(const char *logfile, log_read_hook hook, void *arg)
 {
     FILE *log;
     gzFile zlog;
@@ -38,7 +312,42 @@ void OS_CompressLog(const char *logfile)
     log = fopen(logfile, "r");
     if (!log) {
         /* Do not warn in here, since the alert file may not exist */
-        return;
+        return -1;
+    }
+
+    if (compress_threads > 1) {
+        FILE *plog;
+        int retval;
+#ifdef __linux__
+        int former_io = compress_idle_io ? gz_idle_io() : -1;
+#endif
+
+        if (plog = fopen(logfileGZ, "w"), !plog) {
+            fclose(log);
+            merror(FOPEN_ERROR, logfileGZ, errno, strerror(errno));
+            return -2;
+        }
+
+        retval = gz_compress_parallel(log, plog, compress_threads, hook, arg);
+
+        fclose(log);
+
+        if (fclose(plog) != 0) {
+            merror("Compression error: %s (%d)", strerror(errno), errno);
+            retval = -1;
+        }
+
+#ifdef __linux__
+        gz_restore_io(former_io);
+#endif
+
+        /* Keep the original log if it couldn't be compressed */
+        if (retval < 0) {
+            unlink(logfileGZ);
+            return -2;
+        }
+
+        goto remove;
     }
 
     /* Open compressed file */
@@ -46,7 +355,7 @@ void OS_CompressLog(const char *logfile)
     if (!zlog) {
         fclose(log);
         merror(FOPEN_ERROR, logfileGZ, errno, strerror(errno));
-        return;
+        return -2;
     }
 
     for (;;) {
@@ -54,6 +363,9 @@ void OS_CompressLog(const char *logfile)
         if (len <= 0) {
             break;
         }
+        if (hook) {
+            hook(buf, (size_t)len, arg);
+        }
         if (gzwrite(zlog, buf, (unsigned)len) != len) {
             merror("Compression error: %s", gzerror(zlog, &err));
         }
@@ -62,9 +374,10 @@ void OS_CompressLog(const char *logfile)
     fclose(log);
     gzclose(zlog);
 
+remove:
     /* Remove uncompressed file */
     if ( unlink(logfile) == -1)
         merror("Unable to delete '%s' due to '%s'", logfile, strerror(errno));
 
-    return;
+    return 0;
 }
@@ -150,6 +150,10 @@ int main(int argc, char **argv)
     mond.size_rotate = (unsigned long) getDefine_Int("monitord", "size_rotate", 0, 4096) * 1024 * 1024;
     mond.daily_rotations = getDefine_Int("monitord", "daily_rotations", 1, 256);
     mond.delete_old_agents = (unsigned int)getDefine_Int("monitord", "delete_old_agents", 0, 9600);
+    mond.compress_threads = getDefine_Int("monitord", "compress_threads", 0, 64);
+    mond.compress_nice = getDefine_Int("monitord", "compress_nice", 0, 19);
+    mond.compress_idle_io = getDefine_Int("monitord", "compress_idle_io", 0, 1);
+    OS_CompressLogSetup(mond.compress_threads, mond.compress_nice, mond.compress_idle_io);
 
     mond.agents = NULL;
     mond.smtpserver = NULL;
@@ -139,6 +139,9 @@ cJSON *getMonitorInternalOptions(void) {
     cJSON_AddNumberToObject(monconf,"size_rotate",mond.size_rotate);
     cJSON_AddNumberToObject(monconf,"daily_rotations",mond.daily_rotations);
     cJSON_AddNumberToObject(monconf,"delete_old_agents",mond.delete_old_agents);
+    cJSON_AddNumberToObject(monconf,"compress_threads",mond.compress_threads);
+    cJSON_AddNumberToObject(monconf,"compress_nice",mond.compress_nice);
+    cJSON_AddNumberToObject(monconf,"compress_idle_io",mond.compress_idle_io);
 
     cJSON_AddItemToObject(root,"monitord",monconf);
 
@@ -26,8 +26,16 @@ void Monitord(void) __attribute__((noreturn));
 void manage_files(int cday, int cmon, int cyear);
 void generate_reports(int cday, int cmon, int cyear, const struct tm *p);
 void monitor_agents(void);
+/* Called with every chunk of a log as it's compressed */
+typedef void (*log_read_hook)(const void *buffer, size_t length, void *arg);
+
 void OS_SignLog(const char *logfile, const char *logfile_old, const char * ext);
+void OS_SignCompressLog(const char *logfile, const char *logfile_old, const char * ext);
 void OS_CompressLog(const char *logfile);
+
+/* Returns 0 on success, -1 if the log couldn't be opened, or -2 if it was kept uncompressed after an error */
+int OS_CompressLogEx(const char *logfile, log_read_hook hook, void *arg);
+void OS_CompressLogSetup(int threads, int nice_value, int idle_io);
 void w_rotate_log(int compress, int keep_log_days, int new_day, int rotate_json, int daily_rotations);
 int delete_old_agent(const char *agent_id);
 
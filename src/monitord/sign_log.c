@@ -16,8 +16,73 @@
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 
+/* Running digests of a set of logs */
+typedef struct sign_ctx {
+    MD5_CTX md5;
+    SHA_CTX sha1;
+    SHA256_CTX sha256;
+} sign_ctx;
+
+static void sign_log(const char *logfile, const char *logfile_old, const char * ext, int compress);
+static int sign_file(const char *path, sign_ctx *ctx, int compress);
+static void sign_update(const void *buffer, size_t length, void *arg);
+
 /* Sign a log file */
 void OS_SignLog(const char *logfile, const char *logfile_old, const char * ext)
+{
+    sign_log(logfile, logfile_old, ext, 0);
+}
+
+/* Sign a log file and compress it, reading it only once */
+void OS_SignCompressLog(const char *logfile, const char *logfile_old, const char * ext)
+{
+    sign_log(logfile, logfile_old, ext, 1);
+}
+
+static void sign_update(const void *buffer, size_t length, void *arg)
+{
+    sign_ctx *ctx = arg;
+
+    SHA1_Update(&ctx->sha1, buffer, length);
+    MD5_Update(&ctx->md5, buffer, (unsigned long)length);
+    SHA256_Update(&ctx->sha256, buffer, length);
+}
+
+/* Add a file to the digests. Returns 0 on success or -1 if it couldn't be read. */
+static int sign_file(const char *path, sign_ctx *ctx, int compress)
+{
+    char buffer[4096];
+    sign_ctx saved;
+    size_t n;
+    FILE *fp;
+
+    if (compress) {
+        saved = *ctx;
+
+        switch (OS_CompressLogEx(path, sign_update, ctx)) {
+        case 0:
+            return 0;
+        case -1:
+            return -1;
+        default:
+            /* The log was kept uncompressed: hash it again from the start */
+            *ctx = saved;
+        }
+    }
+
+    if (fp = fopen(path, "r"), !fp) {
+        return -1;
+    }
+
+    while (n = fread(buffer, 1, sizeof(buffer), fp), n > 0) {
+        sign_update(buffer, n, ctx);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static void sign_log(const char *logfile, const char *logfile_old, const char * ext, int compress)
 {
     int i;
     size_t n;
@@ -31,14 +96,12 @@ void OS_SignLog(const char *logfile, const char *logfile_old, const char * ext)
     os_sha256 sf256_sum;
     os_sha256 sf256_sum_old;
 
-    SHA_CTX sha1_ctx;
-    MD5_CTX md5_ctx;
-    SHA256_CTX sha256_ctx;
+    sign_ctx ctx;
 
     char logfilesum[OS_FLSIZE + 1];
     char logfilesum_old[OS_FLSIZE + 1];
     char logfile_r[OS_FLSIZE + 1];
-    char buffer[4096];
+    const char *suffix = "";
 
     FILE *fp;
 
@@ -56,11 +119,18 @@ void OS_SignLog(const char *logfile, const char *logfile_old, const char * ext)
     /* Create the checksum file names */
     snprintf(logfile_r, OS_FLSIZE + 1, "%s.%s", logfile, ext);
     snprintf(logfilesum, OS_FLSIZE, "%s.sum", logfile_r);
+
+    /* Logs compressed by analysisd are signed as they are stored */
+    if (IsFile(logfile_r)) {
+        suffix = ".gz";
+        compress = 0;
+        snprintf(logfile_r, OS_FLSIZE + 1, "%s.%s%s", logfile, ext, suffix);
+    }
     snprintf(logfilesum_old, OS_FLSIZE, "%s.%s.sum", logfile_old, ext);
 
-    MD5_Init(&md5_ctx);
-    SHA1_Init(&sha1_ctx);
-    SHA256_Init(&sha256_ctx);
+    MD5_Init(&ctx.md5);
+    SHA1_Init(&ctx.sha1);
+    SHA256_Init(&ctx.sha256);
 
     /* Generate MD5 of the old file */
     if (OS_MD5_File(logfilesum_old, mf_sum_old, OS_TEXT) < 0) {
@@ -85,47 +155,31 @@ void OS_SignLog(const char *logfile, const char *logfile_old, const char * ext)
 
     /* Generate MD5, SHA-1, and SHA-256 of the current file */
 
-    if (fp = fopen(logfile_r, "r"), fp) {
-        while (n = fread(buffer, 1, 2048, fp), n > 0) {
-            SHA1_Update(&sha1_ctx, buffer, n);
-            MD5_Update(&md5_ctx, buffer, (unsigned long)n);
-            SHA256_Update(&sha256_ctx, buffer, n);
-        }
-
-        fclose(fp);
-
+    if (sign_file(logfile_r, &ctx, compress) == 0) {
         // Include rotated files
 
-        for (i = 1; snprintf(logfile_r, OS_FLSIZE + 1, "%s-%.3d.%s", logfile, i, ext), !IsFile(logfile_r) && FileSize(logfile_r) > 0; i++) {
-            if (fp = fopen(logfile_r, "r"), fp) {
-                while (n = fread(buffer, 1, 2048, fp), n > 0) {
-                    SHA1_Update(&sha1_ctx, buffer, n);
-                    MD5_Update(&md5_ctx, buffer, (unsigned long)n);
-                    SHA256_Update(&sha256_ctx, buffer, n);
-                }
-
-                fclose(fp);
-            } else {
+        for (i = 1; snprintf(logfile_r, OS_FLSIZE + 1, "%s-%.3d.%s%s", logfile, i, ext, suffix), !IsFile(logfile_r) && FileSize(logfile_r) > 0; i++) {
+            if (sign_file(logfile_r, &ctx, compress) < 0) {
                 merror(FOPEN_ERROR, logfile_r, errno, strerror(errno));
                 break;
             }
         }
 
-        MD5_Final(md5_digest, &md5_ctx);
+        MD5_Final(md5_digest, &ctx.md5);
         char *mpos = mf_sum;
         for (n = 0; n < 16; n++) {
             snprintf(mpos, 3, "%02x", md5_digest[n]);
             mpos += 2;
         }
 
-        SHA1_Final(&(md[0]), &sha1_ctx);
+        SHA1_Final(&(md[0]), &ctx.sha1);
         char *spos = sf_sum;
         for (n = 0; n < SHA_DIGEST_LENGTH; n++) {
             snprintf(spos, 3, "%02x", md[n]);
             spos += 2;
         }
 
-        SHA256_Final(&(md256[0]), &sha256_ctx);
+        SHA256_Final(&(md256[0]), &ctx.sha256);
         char *sspos = sf256_sum;
         for (n = 0; n < SHA256_DIGEST_LENGTH; n++) {
             snprintf(sspos, 3, "%02x", md256[n]);
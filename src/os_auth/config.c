@@ -43,6 +43,7 @@ int authd_read_config(const char *path) {
 
     config.timeout_sec = getDefine_Int("auth", "timeout_seconds", 0, INT_MAX);
     config.timeout_usec = getDefine_Int("auth", "timeout_microseconds", 0, 999999);
+    config.workers = getDefine_Int("auth", "workers", 1, 64);
 
     return 0;
 }
@@ -34,7 +34,7 @@
 static void help_authd(void) __attribute((noreturn));
 static int ssl_error(const SSL *ssl, int ret);
 
-/* Thread for dispatching connection pool */
+/* Threads for dispatching connection pool */
 static void* run_dispatcher(void *arg);
 
 /* Thread for writing keystore onto disk */
@@ -162,10 +162,11 @@ int main(int argc, char **argv)
     struct sockaddr_in _nc;
     struct timeval timeout;
     socklen_t _ncl;
-    pthread_t thread_dispatcher;
+    pthread_t *thread_dispatcher;
     pthread_t thread_writer;
     pthread_t thread_local_server;
     fd_set fdset;
+    int i;
 
     /* Initialize some variables */
     bio_err = 0;
@@ -496,13 +497,22 @@ int main(int argc, char **argv)
     backup_tail = &queue_backup;
     remove_tail = &queue_remove;
 
-    /* Start working threads */
+    /* Read the keys before the threads look them up */
 
-    status = pthread_create(&thread_dispatcher, NULL, run_dispatcher, NULL);
+    OS_PassEmptyKeyfile();
+    OS_ReadKeys(&keys, 0, !config.flags.clear_removed, 1);
 
-    if (status != 0) {
-        merror("Couldn't create thread: %s", strerror(status));
-        return EXIT_FAILURE;
+    /* Start working threads: the TLS handshakes run in parallel */
+
+    os_calloc(config.workers, sizeof(pthread_t), thread_dispatcher);
+
+    for (i = 0; i < config.workers; i++) {
+        status = pthread_create(&thread_dispatcher[i], NULL, run_dispatcher, NULL);
+
+        if (status != 0) {
+            merror("Couldn't create thread: %s", strerror(status));
+            return EXIT_FAILURE;
+        }
     }
 
     status = pthread_create(&thread_writer, NULL, run_writer, NULL);
@@ -583,16 +593,22 @@ int main(int argc, char **argv)
     /* Join threads */
 
     w_mutex_lock(&mutex_pool);
-    w_cond_signal(&cond_new_client);
+    w_cond_broadcast(&cond_new_client);
     w_mutex_unlock(&mutex_pool);
     w_mutex_lock(&mutex_keys);
     w_cond_signal(&cond_pending);
     w_mutex_unlock(&mutex_keys);
 
-    pthread_join(thread_dispatcher, NULL);
+    for (i = 0; i < config.workers; i++) {
+        pthread_join(thread_dispatcher[i], NULL);
+    }
+
     pthread_join(thread_writer, NULL);
     pthread_join(thread_local_server, NULL);
 
+    free(thread_dispatcher);
+    SSL_CTX_free(ctx);
+
     minfo("Exiting...");
     return (0);
 }
@@ -610,6 +626,7 @@ void* run_dispatcher(__attribute__((unused)) void *arg) {
     SSL *ssl;
     char *id_exist = NULL;
     char * buf = NULL;
+    char *new_id;
     int index;
 
     authd_sigblock();
@@ -617,8 +634,6 @@ void* run_dispatcher(__attribute__((unused)) void *arg) {
     /* Initialize some variables */
     memset(srcip, '\0', IPSIZE + 1);
 
-    OS_PassEmptyKeyfile();
-    OS_ReadKeys(&keys, 0, !config.flags.clear_removed, 1);
     mdebug1("Dispatch thread ready");
 
     while (running) {
@@ -634,7 +649,7 @@ void* run_dispatcher(__attribute__((unused)) void *arg) {
         if (!running)
             break;
 
-        strncpy(srcip, inet_ntoa(client.addr), IPSIZE - 1);
+        inet_ntop(AF_INET, &client.addr, srcip, IPSIZE);
         ssl = SSL_new(ctx);
         SSL_set_fd(ssl, client.socket);
         ret = SSL_accept(ssl);
@@ -1084,22 +1099,31 @@ void* run_dispatcher(__attribute__((unused)) void *arg) {
             }
 
             snprintf(response, 2048, "OSSEC K:'%s %s %s %s'\n\n", keys.keyentries[index]->id, agentname, (config.flags.use_source_ip || use_client_ip) ? srcip : "any", keys.keyentries[index]->key);
+            os_strdup(keys.keyentries[index]->id, new_id);
             minfo("Agent key generated for '%s' (requested by %s)", agentname, srcip);
+
+            /* Don't hold the keys while writing to the network */
+            w_mutex_unlock(&mutex_keys);
             ret = SSL_write(ssl, response, strlen(response));
+            w_mutex_lock(&mutex_keys);
 
-            if (ret < 0) {
+            if (index = OS_IsAllowedID(&keys, new_id), index < 0) {
+                /* Another request replaced it meanwhile */
+                merror("Agent key not saved for %s", agentname);
+            } else if (ret < 0) {
                 merror("SSL write error (%d)", ret);
                 merror("Agent key not saved for %s", agentname);
                 ERR_print_errors_fp(stderr);
-                OS_DeleteKey(&keys, keys.keyentries[keys.keysize - 1]->id, 1);
+                OS_DeleteKey(&keys, new_id, 1);
             } else {
                 /* Add pending key to write */
-                add_insert(keys.keyentries[keys.keysize - 1], *centralized_group ? centralized_group : NULL);
+                add_insert(keys.keyentries[index], *centralized_group ? centralized_group : NULL);
                 write_pending = 1;
                 w_cond_signal(&cond_pending);
             }
 
             w_mutex_unlock(&mutex_keys);
+            free(new_id);
         }
 
         SSL_free(ssl);
@@ -1107,7 +1131,6 @@ void* run_dispatcher(__attribute__((unused)) void *arg) {
         free(buf);
     }
 
-    SSL_CTX_free(ctx);
     mdebug1("Dispatch thread finished");
     return NULL;
 }
@@ -1124,6 +1147,8 @@ void* run_writer(__attribute__((unused)) void *arg) {
     char wdbquery[OS_SIZE_128];
     char wdboutput[128];
     int wdb_sock = -1;
+    int compact;
+    int index;
 
     authd_sigblock();
 
@@ -1133,7 +1158,30 @@ void* run_writer(__attribute__((unused)) void *arg) {
         while (!write_pending && running)
             w_cond_wait(&cond_pending, &mutex_keys);
 
-        copy_keys = OS_DupKeys(&keys);
+        /* New agents alone are appended. The file is written again
+         * (and so compacted) when some key was removed or replaced.
+         */
+        compact = queue_backup || queue_remove;
+
+        if (compact) {
+            copy_keys = OS_DupKeys(&keys);
+        } else {
+            os_calloc(1, sizeof(keystore), copy_keys);
+
+            for (cur = queue_insert; cur; cur = cur->next) {
+                copy_keys->keysize++;
+            }
+
+            os_calloc(copy_keys->keysize + 1, sizeof(keyentry *), copy_keys->keyentries);
+            copy_keys->keysize = 0;
+
+            for (cur = queue_insert; cur; cur = cur->next) {
+                if (index = OS_IsAllowedID(&keys, cur->id), index >= 0) {
+                    copy_keys->keyentries[copy_keys->keysize++] = OS_DupKeyEntry(keys.keyentries[index]);
+                }
+            }
+        }
+
         copy_insert = queue_insert;
         copy_backup = queue_backup;
         copy_remove = queue_remove;
@@ -1146,7 +1194,17 @@ void* run_writer(__attribute__((unused)) void *arg) {
         write_pending = 0;
         w_mutex_unlock(&mutex_keys);
 
-        if (OS_WriteKeys(copy_keys) < 0)
+        if (!compact && OS_AppendKeys(copy_keys) < 0) {
+            /* Write the whole file instead */
+            OS_FreeKeys(copy_keys);
+            free(copy_keys);
+            w_mutex_lock(&mutex_keys);
+            copy_keys = OS_DupKeys(&keys);
+            w_mutex_unlock(&mutex_keys);
+            compact = 1;
+        }
+
+        if (compact && OS_WriteKeys(copy_keys) < 0)
             merror("Couldn't write file client.keys");
 
         OS_FreeKeys(copy_keys);
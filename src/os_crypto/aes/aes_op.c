@@ -15,23 +15,58 @@
 #include <openssl/conf.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include "shared.h"
 #include "aes_op.h"
 
 typedef unsigned char uchar;
 
+#define AES_KEY_SIZE    32
+#define AES_GCM_LABEL   "wazuh-aes-gcm:"
+
+/* Kinds of cached contexts */
+enum { AES_CBC_ENCRYPT, AES_CBC_DECRYPT, AES_GCM_ENCRYPT, AES_GCM_DECRYPT, AES_CONTEXTS };
+
+typedef struct aes_context {
+    EVP_CIPHER_CTX *ctx;
+    struct aes_context *next;
+} aes_context;
+
+/* The contexts hold the expanded key. A thread takes an idle one and
+ * gives it back after the message, so each grows to the number of
+ * threads that use the key at once.
+ */
+struct os_aes_cache {
+    pthread_mutex_t mutex;
+    uchar key[AES_KEY_SIZE];
+    uchar gcm_key[SHA256_DIGEST_LENGTH];
+    aes_context *idle[AES_CONTEXTS];
+};
+
+static uchar *aes_iv = (uchar *)"FEDCBA0987654321";
+
+/* Nonces: a random prefix for the process and a counter */
+static uchar gcm_prefix[4];
+static uint64_t gcm_counter;
+static pthread_once_t gcm_once = PTHREAD_ONCE_INIT;
+
+static aes_context *aes_get(os_aes_cache *cache, int kind);
+static void aes_put(os_aes_cache *cache, int kind, aes_context *context);
+static void aes_free(aes_context *context);
+static void gcm_init(void);
+
 
 int OS_AES_Str(const char *input, char *output, const char *charkey,
               long size, short int action)
 {
-    static unsigned char *iv = (unsigned char *)"FEDCBA0987654321";
-
     if(action == OS_ENCRYPT)
     {
-        return encrypt_AES((const uchar *)input, (int)size,(uchar *)charkey, iv,(uchar *)output);
+        return encrypt_AES((const uchar *)input, (int)size,(uchar *)charkey, aes_iv,(uchar *)output);
     }
     else
     {
-        return decrypt_AES((const uchar *)input, (int)size,(uchar *)charkey, iv,(uchar *)output);
+        return decrypt_AES((const uchar *)input, (int)size,(uchar *)charkey, aes_iv,(uchar *)output);
     }
 }
 
@@ -100,3 +135,243 @@ end:
 	EVP_CIPHER_CTX_free(ctx);
 	return plaintext_len;
 }
+
+/* Create the context cache of a key. Returns NULL on error. */
+os_aes_cache *OS_AES_CacheNew(const char *charkey)
+{
+    os_aes_cache *cache;
+    uchar label[sizeof(AES_GCM_LABEL) - 1 + AES_KEY_SIZE];
+
+    if (strlen(charkey) < AES_KEY_SIZE) {
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(os_aes_cache), cache);
+    w_mutex_init(&cache->mutex, NULL);
+    memcpy(cache->key, charkey, AES_KEY_SIZE);
+
+    /* GCM doesn't share the key of CBC */
+    memcpy(label, AES_GCM_LABEL, sizeof(AES_GCM_LABEL) - 1);
+    memcpy(label + sizeof(AES_GCM_LABEL) - 1, charkey, AES_KEY_SIZE);
+    SHA256(label, sizeof(label), cache->gcm_key);
+    memset_secure(label, '\0', sizeof(label));
+
+    return cache;
+}
+
+/* Free the context cache of a key */
+void OS_AES_CacheFree(os_aes_cache *cache)
+{
+    aes_context *context;
+    int kind;
+
+    if (!cache) {
+        return;
+    }
+
+    for (kind = 0; kind < AES_CONTEXTS; kind++) {
+        while (context = cache->idle[kind], context) {
+            cache->idle[kind] = context->next;
+            aes_free(context);
+        }
+    }
+
+    memset_secure(cache->key, '\0', sizeof(cache->key));
+    memset_secure(cache->gcm_key, '\0', sizeof(cache->gcm_key));
+    w_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+/* Same as OS_AES_Str, with the cached contexts of a key */
+int OS_AES_CacheStr(os_aes_cache *cache, const char *input, char *output,
+              long size, short int action)
+{
+    int kind = action == OS_ENCRYPT ? AES_CBC_ENCRYPT : AES_CBC_DECRYPT;
+    aes_context *context;
+    int length = 0;
+    int len;
+
+    if (context = aes_get(cache, kind), !context) {
+        return 0;
+    }
+
+    /* Only reset the IV: the key is already expanded */
+    if (action == OS_ENCRYPT) {
+        if (1 == EVP_EncryptInit_ex(context->ctx, NULL, NULL, NULL, aes_iv) &&
+            1 == EVP_EncryptUpdate(context->ctx, (uchar *)output, &len, (const uchar *)input, (int)size)) {
+            length = len;
+
+            if (1 == EVP_EncryptFinal_ex(context->ctx, (uchar *)output + len, &len)) {
+                length += len;
+            } else {
+                length = 0;
+            }
+        }
+    } else {
+        if (1 == EVP_DecryptInit_ex(context->ctx, NULL, NULL, NULL, aes_iv) &&
+            1 == EVP_DecryptUpdate(context->ctx, (uchar *)output, &len, (const uchar *)input, (int)size)) {
+            length = len;
+
+            if (1 == EVP_DecryptFinal_ex(context->ctx, (uchar *)output + len, &len)) {
+                length += len;
+            } else {
+                length = 0;
+            }
+        }
+    }
+
+    aes_put(cache, kind, context);
+    return length;
+}
+
+/* Encrypt and authenticate with AES-256-GCM
+ * Returns the length of the output, or 0 on error.
+ */
+int OS_AES_GCM_Encrypt(os_aes_cache *cache, const char *input, long size, char *output)
+{
+    uchar *nonce = (uchar *)output;
+    uchar *ciphertext = nonce + OS_AES_GCM_NONCE;
+    aes_context *context;
+    uint64_t counter;
+    int length = 0;
+    int len;
+    int i;
+
+    if (context = aes_get(cache, AES_GCM_ENCRYPT), !context) {
+        return 0;
+    }
+
+    pthread_once(&gcm_once, gcm_init);
+    counter = __atomic_fetch_add(&gcm_counter, 1, __ATOMIC_RELAXED);
+
+    memcpy(nonce, gcm_prefix, sizeof(gcm_prefix));
+
+    for (i = OS_AES_GCM_NONCE - 1; i >= (int)sizeof(gcm_prefix); i--) {
+        nonce[i] = (uchar)counter;
+        counter >>= 8;
+    }
+
+    if (1 == EVP_EncryptInit_ex(context->ctx, NULL, NULL, NULL, nonce) &&
+        1 == EVP_EncryptUpdate(context->ctx, ciphertext, &len, (const uchar *)input, (int)size)) {
+        length = len;
+
+        if (1 == EVP_EncryptFinal_ex(context->ctx, ciphertext + length, &len) &&
+            1 == EVP_CIPHER_CTX_ctrl(context->ctx, EVP_CTRL_GCM_GET_TAG, OS_AES_GCM_TAG, ciphertext + length + len)) {
+            length += len + OS_AES_GCM_OVERHEAD;
+        } else {
+            length = 0;
+        }
+    }
+
+    aes_put(cache, AES_GCM_ENCRYPT, context);
+    return length;
+}
+
+/* Check and decrypt a message of OS_AES_GCM_Encrypt
+ * Returns the length of the plaintext, or 0 if the message was forged or corrupted.
+ */
+int OS_AES_GCM_Decrypt(os_aes_cache *cache, const char *input, long size, char *output)
+{
+    const uchar *nonce = (const uchar *)input;
+    const uchar *ciphertext = nonce + OS_AES_GCM_NONCE;
+    long ciphertext_len = size - OS_AES_GCM_OVERHEAD;
+    aes_context *context;
+    int length = 0;
+    int len;
+
+    if (ciphertext_len <= 0) {
+        return 0;
+    }
+
+    if (context = aes_get(cache, AES_GCM_DECRYPT), !context) {
+        return 0;
+    }
+
+    if (1 == EVP_DecryptInit_ex(context->ctx, NULL, NULL, NULL, nonce) &&
+        1 == EVP_DecryptUpdate(context->ctx, (uchar *)output, &len, ciphertext, (int)ciphertext_len) &&
+        1 == EVP_CIPHER_CTX_ctrl(context->ctx, EVP_CTRL_GCM_SET_TAG, OS_AES_GCM_TAG, (void *)(ciphertext + ciphertext_len))) {
+        length = len;
+
+        /* The tag is checked here */
+        if (1 == EVP_DecryptFinal_ex(context->ctx, (uchar *)output + len, &len)) {
+            length += len;
+        } else {
+            length = 0;
+        }
+    }
+
+    aes_put(cache, AES_GCM_DECRYPT, context);
+    return length;
+}
+
+/* Take an idle context of a kind, or create it. The key is expanded once per context. */
+static aes_context *aes_get(os_aes_cache *cache, int kind)
+{
+    aes_context *context;
+    int result;
+
+    w_mutex_lock(&cache->mutex);
+
+    if (context = cache->idle[kind], context) {
+        cache->idle[kind] = context->next;
+    }
+
+    w_mutex_unlock(&cache->mutex);
+
+    if (context) {
+        return context;
+    }
+
+    os_calloc(1, sizeof(aes_context), context);
+
+    if (context->ctx = EVP_CIPHER_CTX_new(), !context->ctx) {
+        free(context);
+        return NULL;
+    }
+
+    switch (kind) {
+    case AES_CBC_ENCRYPT:
+        result = EVP_EncryptInit_ex(context->ctx, EVP_aes_256_cbc(), NULL, cache->key, NULL);
+        break;
+    case AES_CBC_DECRYPT:
+        result = EVP_DecryptInit_ex(context->ctx, EVP_aes_256_cbc(), NULL, cache->key, NULL);
+        break;
+    case AES_GCM_ENCRYPT:
+        result = EVP_EncryptInit_ex(context->ctx, EVP_aes_256_gcm(), NULL, cache->gcm_key, NULL);
+        break;
+    default:
+        result = EVP_DecryptInit_ex(context->ctx, EVP_aes_256_gcm(), NULL, cache->gcm_key, NULL);
+    }
+
+    if (result != 1) {
+        aes_free(context);
+        return NULL;
+    }
+
+    return context;
+}
+
+/* Give a context back to the cache */
+static void aes_put(os_aes_cache *cache, int kind, aes_context *context)
+{
+    w_mutex_lock(&cache->mutex);
+    context->next = cache->idle[kind];
+    cache->idle[kind] = context;
+    w_mutex_unlock(&cache->mutex);
+}
+
+static void aes_free(aes_context *context)
+{
+    EVP_CIPHER_CTX_free(context->ctx);
+    free(context);
+}
+
+static void gcm_init()
+{
+    if (RAND_bytes(gcm_prefix, sizeof(gcm_prefix)) != 1 ||
+        RAND_bytes((uchar *)&gcm_counter, sizeof(gcm_counter)) != 1) {
+        /* Fall back to the system generator */
+        randombytes(gcm_prefix, sizeof(gcm_prefix));
+        randombytes(&gcm_counter, sizeof(gcm_counter));
+    }
+}
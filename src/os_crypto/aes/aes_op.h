@@ -14,6 +14,13 @@
 #define OS_ENCRYPT      1
 #define OS_DECRYPT      0
 
+#define OS_AES_GCM_NONCE    12
+#define OS_AES_GCM_TAG      16
+#define OS_AES_GCM_OVERHEAD (OS_AES_GCM_NONCE + OS_AES_GCM_TAG)
+
+/* Cipher contexts of a key, initialized once and shared by the threads */
+typedef struct os_aes_cache os_aes_cache;
+
 int encrypt_AES(const unsigned char *plaintext, int plaintext_len, unsigned char *key,
     unsigned char *iv, unsigned char *ciphertext);
 int decrypt_AES(const unsigned char *ciphertext, int ciphertext_len, unsigned char *key,
@@ -21,4 +28,25 @@ int decrypt_AES(const unsigned char *ciphertext, int ciphertext_len, unsigned ch
 int OS_AES_Str(const char *input, char *output, const char *charkey,
               long size, short int action) __attribute((nonnull));
 
+/* Create the context cache of a key. Returns NULL on error. */
+os_aes_cache *OS_AES_CacheNew(const char *charkey) __attribute((nonnull));
+
+/* Free the context cache of a key */
+void OS_AES_CacheFree(os_aes_cache *cache);
+
+/* Same as OS_AES_Str, with the cached contexts of a key */
+int OS_AES_CacheStr(os_aes_cache *cache, const char *input, char *output,
+              long size, short int action) __attribute((nonnull));
+
+/* Encrypt and authenticate with AES-256-GCM. The output is the nonce,
+ * the ciphertext and the tag: size + OS_AES_GCM_OVERHEAD bytes.
+ * Returns the length of the output, or 0 on error.
+ */
+int OS_AES_GCM_Encrypt(os_aes_cache *cache, const char *input, long size, char *output) __attribute((nonnull));
+
+/* Check and decrypt a message of OS_AES_GCM_Encrypt
+ * Returns the length of the plaintext, or 0 if the message was forged or corrupted.
+ */
+int OS_AES_GCM_Decrypt(os_aes_cache *cache, const char *input, long size, char *output) __attribute((nonnull));
+
 #endif /* AES_OP_H */
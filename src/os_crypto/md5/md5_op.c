@@ -13,6 +13,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "md5_op.h"
@@ -72,3 +73,99 @@ int OS_MD5_Str(const char *str, ssize_t length, os_md5 output)
 
     return (0);
 }
+
+merged_sum_t *OS_MD5_Merged(const char *fname, char **tag, int mode)
+{
+    FILE *fp;
+    MD5_CTX ctx;
+    unsigned char buf[2048 + 1];
+    unsigned char digest[16];
+    merged_sum_t *sums;
+    merged_sum_t *new_sums;
+    size_t n_sums = 0;
+    size_t left;
+    size_t n;
+    char *name;
+    char *end;
+    int i;
+
+    *tag = NULL;
+
+    fp = fopen(fname, mode == OS_BINARY ? "rb" : "r");
+    if (!fp) {
+        return (NULL);
+    }
+
+    if (sums = calloc(1, sizeof(merged_sum_t)), !sums) {
+        fclose(fp);
+        return (NULL);
+    }
+
+    /* Same layout that UnmergeFiles() reads: "!<size> <name>" and then the contents */
+    while (fgets((char *)buf, sizeof(buf) - 1, fp)) {
+        if ((end = strchr((char *)buf, '\n'))) {
+            *end = '\0';
+        }
+
+        if (buf[0] == '#' && !n_sums && !*tag) {
+            *tag = strdup((char *)buf + 1);
+            continue;
+        }
+
+        if (buf[0] != '!' || !(name = strchr((char *)buf, ' '))) {
+            continue;
+        }
+
+        if (new_sums = realloc(sums, (n_sums + 2) * sizeof(merged_sum_t)), !new_sums) {
+            goto error;
+        }
+
+        sums = new_sums;
+        memset(sums + n_sums + 1, 0, sizeof(merged_sum_t));
+        left = (size_t)atol((char *)buf + 1);
+        sums[n_sums].size = left;
+        sums[n_sums].offset = ftell(fp);
+
+        if (sums[n_sums].name = strdup(name + 1), !sums[n_sums].name) {
+            goto error;
+        }
+
+        MD5_Init(&ctx);
+
+        while (left > 0 && (n = fread(buf, 1, left < sizeof(buf) - 1 ? left : sizeof(buf) - 1, fp)) > 0) {
+            MD5_Update(&ctx, buf, (unsigned)n);
+            left -= n;
+        }
+
+        MD5_Final(digest, &ctx);
+
+        for (i = 0; i < 16; i++) {
+            snprintf(sums[n_sums].sum + 2 * i, 3, "%02x", digest[i]);
+        }
+
+        n_sums++;
+    }
+
+    fclose(fp);
+    return (sums);
+
+error:
+    fclose(fp);
+    OS_MD5_Merged_Free(sums);
+    free(*tag);
+    *tag = NULL;
+    return (NULL);
+}
+
+void OS_MD5_Merged_Free(merged_sum_t *sums)
+{
+    int i;
+
+    if (sums) {
+        for (i = 0; sums[i].name; i++) {
+            free(sums[i].name);
+        }
+
+        free(sums);
+    }
+}
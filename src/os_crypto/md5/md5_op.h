@@ -22,4 +22,19 @@ typedef char os_md5[33];
 int OS_MD5_File(const char *fname, os_md5 output, int mode) __attribute((nonnull));
 int OS_MD5_Str(const char *str, ssize_t length, os_md5 output) __attribute((nonnull));
 
+/* File of a merged file (merged.mg), with the checksum of its contents */
+typedef struct merged_sum_t {
+    char *name;             /* NULL at the end of the array */
+    long offset;            /* Position of the contents in the merged file */
+    size_t size;
+    os_md5 sum;
+} merged_sum_t;
+
+/* Get the checksum of each file in a merged file, in order.
+ * tag gets the first line of the file without the '#', or NULL if there is none.
+ * Returns an array to be freed with OS_MD5_Merged_Free(), or NULL on error.
+ */
+merged_sum_t *OS_MD5_Merged(const char *fname, char **tag, int mode) __attribute((nonnull));
+void OS_MD5_Merged_Free(merged_sum_t *sums);
+
 #endif /* MD5_OP_H */
@@ -18,11 +18,63 @@
 #include "headers/defs.h"
 
 
+#define HASH_BUFFER_SIZE    65536               /* Bytes per read */
+#define HASH_DROP_WINDOW    (8 * 1024 * 1024)   /* Bytes read between page cache drops */
+
+#ifndef WIN32
+/* Open a file to be read once, from start to end */
+static int hash_open(const char *fname)
+{
+    int fd;
+
+#ifdef O_NOATIME
+    /* Hashing is not an access. Only the owner (or root) can avoid the atime update */
+    if (fd = open(fname, O_RDONLY | O_CLOEXEC | O_NOATIME), fd >= 0 || errno != EPERM) {
+        goto opened;
+    }
+#endif
+
+    fd = open(fname, O_RDONLY | O_CLOEXEC);
+
+#ifdef O_NOATIME
+opened:
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    return fd;
+}
+
+static ssize_t hash_read(int fd, unsigned char *buf, size_t size)
+{
+    ssize_t n;
+
+    while (n = read(fd, buf, size), n < 0 && errno == EINTR);
+    return n;
+}
+
+/* Drop the pages of a file that were read, so a scan doesn't evict the page cache */
+static void hash_drop_cache(__attribute__((unused)) int fd, __attribute__((unused)) size_t offset, __attribute__((unused)) size_t length)
+{
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, (off_t)offset, (off_t)length, POSIX_FADV_DONTNEED);
+#endif
+}
+#endif /* WIN32 */
+
 int OS_MD5_SHA1_SHA256_File(const char *fname, const char *prefilter_cmd, os_md5 md5output, os_sha1 sha1output, os_sha256 sha256output, int mode, size_t max_size)
 {
-    size_t n, read = 0;
-    FILE *fp;
-    unsigned char buf[OS_BUFFER_SIZE + 2];
+    size_t i;
+    ssize_t n;
+    size_t total = 0;
+    size_t dropped = 0;
+    int retval = -1;
+    FILE *fp = NULL;
+    int fd = -1;
+    unsigned char buf[HASH_BUFFER_SIZE];
     unsigned char sha1_digest[SHA_DIGEST_LENGTH];
     unsigned char md5_digest[16];
     unsigned char sha256_digest[SHA256_DIGEST_LENGTH];
@@ -35,14 +87,19 @@ int OS_MD5_SHA1_SHA256_File(const char *fname, const char *prefilter_cmd, os_md5
     md5output[0] = '\0';
     sha1output[0] = '\0';
     sha256output[0] = '\0';
-    buf[OS_BUFFER_SIZE + 1] = '\0';
 
     /* Use prefilter_cmd if set */
     if (prefilter_cmd == NULL) {
-        fp = fopen(fname, mode == OS_BINARY ? "rb" : "r");
+#ifndef WIN32
+        if (fd = hash_open(fname), fd < 0) {
+            return (-1);
+        }
+#else
+        fp = fopen(fname, (mode & OS_TEXT) ? "r" : "rb");
         if (!fp) {
             return (-1);
         }
+#endif
     } else {
         char cmd[OS_MAXSTR];
         size_t target_length = strlen(prefilter_cmd) + 1 + strlen(fname);
@@ -61,27 +118,40 @@ int OS_MD5_SHA1_SHA256_File(const char *fname, const char *prefilter_cmd, os_md5
     SHA1_Init(&sha1_ctx);
     SHA256_Init(&sha256_ctx);
 
-    /* Update for each one */
-    while ((n = fread(buf, 1, OS_BUFFER_SIZE, fp)) > 0) {
-
-        if (max_size > 0) {
-            read = read + n;
-            if (read >= max_size) {     // Maximum filesize error
-                mwarn("'%s' filesize is larger than the maximum allowed (%d MB). File skipped.", fname, (int)max_size/1048576); // max_size is in bytes
-                if (prefilter_cmd == NULL) {
-                    fclose(fp);
-                } else {
-                    pclose(fp);
-                }
-                return (-1);
-            }
+    /* Update for each one. The hash functions of OpenSSL use the SHA and AVX2 extensions if the CPU has them */
+    while (1) {
+#ifndef WIN32
+        n = fp ? (ssize_t)fread(buf, 1, sizeof(buf), fp) : hash_read(fd, buf, sizeof(buf));
+#else
+        n = (ssize_t)fread(buf, 1, sizeof(buf), fp);
+#endif
+
+        if (n <= 0) {
+            break;
         }
 
-        buf[n] = '\0';
+        total += (size_t)n;
+
+        if (max_size > 0 && total >= max_size) {    // Maximum filesize error
+            mwarn("'%s' filesize is larger than the maximum allowed (%d MB). File skipped.", fname, (int)max_size/1048576); // max_size is in bytes
+            goto end;
+        }
 
-        SHA1_Update(&sha1_ctx, buf, n);
-        SHA256_Update(&sha256_ctx, buf, n);
+        SHA1_Update(&sha1_ctx, buf, (size_t)n);
+        SHA256_Update(&sha256_ctx, buf, (size_t)n);
         MD5_Update(&md5_ctx, buf, (unsigned)n);
+
+#ifndef WIN32
+        if ((mode & OS_HASH_NOCACHE) && fd >= 0 && total - dropped >= HASH_DROP_WINDOW) {
+            hash_drop_cache(fd, dropped, total - dropped);
+            dropped = total;
+        }
+#endif
+    }
+
+    /* A read error would give the checksum of part of the file */
+    if (n < 0 || (fp && ferror(fp))) {
+        goto end;
     }
 
     SHA1_Final(&(sha1_digest[0]), &sha1_ctx);
@@ -89,29 +159,41 @@ int OS_MD5_SHA1_SHA256_File(const char *fname, const char *prefilter_cmd, os_md5
     MD5_Final(md5_digest, &md5_ctx);
 
     /* Set output for MD5 */
-    for (n = 0; n < 16; n++) {
-        snprintf(md5output, 3, "%02x", md5_digest[n]);
+    for (i = 0; i < 16; i++) {
+        snprintf(md5output, 3, "%02x", md5_digest[i]);
         md5output += 2;
     }
 
     /* Set output for SHA-1 */
-    for (n = 0; n < SHA_DIGEST_LENGTH; n++) {
-        snprintf(sha1output, 3, "%02x", sha1_digest[n]);
+    for (i = 0; i < SHA_DIGEST_LENGTH; i++) {
+        snprintf(sha1output, 3, "%02x", sha1_digest[i]);
         sha1output += 2;
     }
 
     /* Set output for SHA-256 */
-    for (n = 0; n < SHA256_DIGEST_LENGTH; n++) {
-        snprintf(sha256output, 3, "%02x", sha256_digest[n]);
+    for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        snprintf(sha256output, 3, "%02x", sha256_digest[i]);
         sha256output += 2;
     }
 
+    retval = 0;
+
+end:
     /* Close it */
-    if (prefilter_cmd == NULL) {
-        fclose(fp);
-    } else {
+    if (prefilter_cmd != NULL) {
         pclose(fp);
+    } else if (fp) {
+        fclose(fp);
+    }
+#ifndef WIN32
+    else {
+        if ((mode & OS_HASH_NOCACHE) && total > dropped) {
+            hash_drop_cache(fd, dropped, 0);
+        }
+
+        close(fd);
     }
+#endif
 
-    return (0);
+    return retval;
 }
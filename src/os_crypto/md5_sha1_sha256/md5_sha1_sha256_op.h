@@ -15,6 +15,8 @@
 #include "../sha1/sha1_op.h"
 #include "../sha256/sha256_op.h"
 
+/* Flag to be set in the mode: drop the pages read from the page cache (Unix only) */
+#define OS_HASH_NOCACHE 0x10
 
 int OS_MD5_SHA1_SHA256_File(const char *fname, const char *prefilter_cmd, os_md5 md5output, os_sha1 sha1output, os_sha256 sha256output, int mode, size_t max_size) __attribute((nonnull(1, 3, 4)));
 
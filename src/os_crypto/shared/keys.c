@@ -12,6 +12,7 @@
 #include "headers/sec.h"
 #include "os_crypto/md5/md5_op.h"
 #include "os_crypto/blowfish/bf_op.h"
+#include "os_crypto/aes/aes_op.h"
 
 /* Prototypes */
 static void __memclear(char *id, char *name, char *ip, char *key, size_t size) __attribute((nonnull));
@@ -47,20 +48,30 @@ static void move_netdata(keystore *keys, const keystore *old_keys)
     }
 }
 
+/* Look up the position of an entry in a read-optimized hash */
+static int key_lookup(const OSHash *hash, const char *key)
+{
+    keyentry *entry;
+    int keyid = -1;
+
+    w_rcu_thread_read_lock();
+
+    if (entry = (keyentry *) OSHash_Get_ex(hash, key), entry) {
+        keyid = (int)__atomic_load_n(&entry->keyid, __ATOMIC_RELAXED);
+    }
+
+    w_rcu_thread_read_unlock();
+    return keyid;
+}
+
 static void save_removed_key(keystore *keys, const char *key) {
     os_realloc(keys->removed_keys, (keys->removed_keys_size + 1) * sizeof(char*), keys->removed_keys);
     keys->removed_keys[keys->removed_keys_size++] = strdup(key);
 }
 
-/* Create the final key */
-int OS_AddKey(keystore *keys, const char *id, const char *name, const char *ip, const char *key)
+/* Put an entry in the keystore and its hashes */
+static int key_insert(keystore *keys, keyentry *entry)
 {
-    os_md5 filesum1;
-    os_md5 filesum2;
-
-    char *tmp_str;
-    char _finalstr[KEYSIZE];
-
     /* Allocate for the whole structure */
     keys->keyentries = (keyentry **)realloc(keys->keyentries,
                                             (keys->keysize + 2) * sizeof(keyentry *));
@@ -69,40 +80,53 @@ int OS_AddKey(keystore *keys, const char *id, const char *name, const char *ip,
     }
 
     keys->keyentries[keys->keysize + 1] = keys->keyentries[keys->keysize];
-    os_calloc(1, sizeof(keyentry), keys->keyentries[keys->keysize]);
+    keys->keyentries[keys->keysize] = entry;
+    entry->keyid = keys->keysize;
+
+    OSHash_Add(keys->keyhash_id, entry->id, entry);
+    OSHash_Add(keys->keyhash_ip, entry->ip->ip, entry);
+    OSHash_Add(keys->keyhash_name, entry->name, entry);
+
+    /* Ready for next */
+    return keys->keysize++;
+}
+
+/* Create the final key */
+int OS_AddKey(keystore *keys, const char *id, const char *name, const char *ip, const char *key)
+{
+    os_md5 filesum1;
+    os_md5 filesum2;
+
+    char *tmp_str;
+    char _finalstr[KEYSIZE];
+    keyentry *entry;
+
+    os_calloc(1, sizeof(keyentry), entry);
 
     /* Set configured values for id */
-    os_strdup(id, keys->keyentries[keys->keysize]->id);
-    OSHash_Add(keys->keyhash_id,
-               keys->keyentries[keys->keysize]->id,
-               keys->keyentries[keys->keysize]);
+    os_strdup(id, entry->id);
 
     /* Agent IP */
-    os_calloc(1, sizeof(os_ip), keys->keyentries[keys->keysize]->ip);
-    if (OS_IsValidIP(ip, keys->keyentries[keys->keysize]->ip) == 0) {
+    os_calloc(1, sizeof(os_ip), entry->ip);
+    if (OS_IsValidIP(ip, entry->ip) == 0) {
         merror_exit(INVALID_IP, ip);
     }
 
     /* We need to remove the "/" from the CIDR */
-    if ((tmp_str = strchr(keys->keyentries[keys->keysize]->ip->ip, '/')) != NULL) {
+    if ((tmp_str = strchr(entry->ip->ip, '/')) != NULL) {
         *tmp_str = '\0';
     }
-    OSHash_Add(keys->keyhash_ip,
-               keys->keyentries[keys->keysize]->ip->ip,
-               keys->keyentries[keys->keysize]);
 
     /* Agent name */
-    os_strdup(name, keys->keyentries[keys->keysize]->name);
+    os_strdup(name, entry->name);
 
     /* Initialize the variables */
-    keys->keyentries[keys->keysize]->rcvd = 0;
-    keys->keyentries[keys->keysize]->local = 0;
-    keys->keyentries[keys->keysize]->keyid = keys->keysize;
-    keys->keyentries[keys->keysize]->global = 0;
-    keys->keyentries[keys->keysize]->fp = NULL;
-    keys->keyentries[keys->keysize]->inode = 0;
-    keys->keyentries[keys->keysize]->sock = -1;
-    w_mutex_init(&keys->keyentries[keys->keysize]->mutex, NULL);
+    entry->rcvd = 0;
+    entry->local = 0;
+    entry->global = 0;
+    entry->counter = NULL;
+    entry->sock = -1;
+    w_mutex_init(&entry->mutex, NULL);
 
     if (keys->flags.rehash_keys) {
         /** Generate final symmetric key **/
@@ -126,15 +150,14 @@ int OS_AddKey(keystore *keys, const char *id, const char *name, const char *ip,
         snprintf(_finalstr, sizeof(_finalstr), "%s%s", filesum2, filesum1);
 
         /* Final key is 48 * 4 = 192bits */
-        os_strdup(_finalstr, keys->keyentries[keys->keysize]->key);
+        os_strdup(_finalstr, entry->key);
 
         /* Clean final string from memory */
         memset_secure(_finalstr, '\0', sizeof(_finalstr));
     } else
-        os_strdup(key, keys->keyentries[keys->keysize]->key);
+        os_strdup(key, entry->key);
 
-    /* Ready for next */
-    return keys->keysize++;
+    return key_insert(keys, entry);
 }
 
 /* Check if the authentication key file is present */
@@ -195,11 +218,21 @@ void OS_ReadKeys(keystore *keys, int rehash_keys, int save_removed, int no_limit
     keys->keyhash_id = OSHash_Create();
     keys->keyhash_ip = OSHash_Create();
     keys->keyhash_sock = OSHash_Create();
+    keys->keyhash_name = OSHash_Create();
+
+    if (!(keys->keyhash_id && keys->keyhash_ip && keys->keyhash_sock && keys->keyhash_name)) {
+        merror_exit(MEM_ERROR, errno, strerror(errno));
+    }
 
-    if (!(keys->keyhash_id && keys->keyhash_ip && keys->keyhash_sock)) {
+    /* Size the lookup hashes for a large fleet, before they go read-optimized */
+    if (!(OSHash_setSize(keys->keyhash_id, KEYHASH_SIZE) && OSHash_setSize(keys->keyhash_ip, KEYHASH_SIZE) && OSHash_setSize(keys->keyhash_name, KEYHASH_SIZE))) {
         merror_exit(MEM_ERROR, errno, strerror(errno));
     }
 
+    OSHash_SetRCU(keys->keyhash_id);
+    OSHash_SetRCU(keys->keyhash_ip);
+    OSHash_SetRCU(keys->keyhash_name);
+
     /* Initialize structure */
     os_calloc(1, sizeof(keyentry*), keys->keyentries);
     keys->keysize = 0;
@@ -344,11 +377,7 @@ void OS_FreeKey(keyentry *key) {
         free(key->name);
     }
 
-    /* Close counter */
-    if (key->fp) {
-        fclose(key->fp);
-    }
-
+    OS_AES_CacheFree(key->aes);
     w_mutex_destroy(&key->mutex);
     free(key);
 }
@@ -369,6 +398,9 @@ void OS_FreeKeys(keystore *keys)
     if (keys->keyhash_sock)
         OSHash_Free(keys->keyhash_sock);
 
+    if (keys->keyhash_name)
+        OSHash_Free(keys->keyhash_name);
+
     for (i = 0; i <= keys->keysize; i++) {
         if (keys->keyentries[i]) {
             OS_FreeKey(keys->keyentries[i]);
@@ -381,6 +413,7 @@ void OS_FreeKeys(keystore *keys)
     keys->keyhash_id = NULL;
     keys->keyhash_ip = NULL;
     keys->keyhash_sock = NULL;
+    keys->keyhash_name = NULL;
 
     if (keys->removed_keys) {
         for (i = 0; i < keys->removed_keys_size; i++)
@@ -433,21 +466,94 @@ void OS_UpdateKeys(keystore *keys)
     mdebug1("Key reloading completed");
 }
 
-/* Check if an IP address is allowed to connect */
-int OS_IsAllowedIP(keystore *keys, const char *srcip)
+/* Whether an entry read from the keys file differs from the one in use */
+static int key_changed(const keyentry *old_key, const keyentry *new_key)
 {
+    return strcmp(old_key->name, new_key->name) || strcmp(old_key->ip->ip, new_key->ip->ip) || strcmp(old_key->key, new_key->key);
+}
+
+/* Update the keys if changed, one agent at a time */
+void OS_UpdateKeysDelta(keystore *keys, void (*lock)(void), void (*unlock)(void))
+{
+    keystore *new_keys;
     keyentry *entry;
+    unsigned int i;
+    unsigned int added = 0;
+    unsigned int removed = 0;
+    int keyid;
+    char strsock[16];
 
-    if (srcip == NULL) {
-        return (-1);
+    mdebug1("Reloading keys");
+    minfo(ENC_READ);
+
+    /* Read the file aside: the keystore in use is only changed by this thread */
+    os_calloc(1, sizeof(keystore), new_keys);
+    OS_ReadKeys(new_keys, keys->flags.rehash_keys, 0, 0);
+
+    /* Remove the agents that are gone or changed. Deleting moves the last entry, which was checked already */
+    for (i = keys->keysize; i-- > 0;) {
+        entry = keys->keyentries[i];
+        keyid = OS_IsAllowedID(new_keys, entry->id);
+
+        if (keyid >= 0 && !key_changed(entry, new_keys->keyentries[keyid])) {
+            continue;
+        }
+
+        lock();
+
+        /* An agent keeping its address keeps its connection, as move_netdata() does */
+        if (keyid >= 0 && !strcmp(entry->ip->ip, new_keys->keyentries[keyid]->ip->ip)) {
+            new_keys->keyentries[keyid]->rcvd = entry->rcvd;
+            new_keys->keyentries[keyid]->sock = entry->sock;
+            memcpy(&new_keys->keyentries[keyid]->peer_info, &entry->peer_info, sizeof(struct sockaddr_in));
+        }
+
+        OS_DeleteKey(keys, entry->id, 1);
+        unlock();
+        removed++;
     }
 
-    entry = (keyentry *) OSHash_Get(keys->keyhash_ip, srcip);
-    if (entry) {
-        return ((int)entry->keyid);
+    /* Add the new and changed agents, with their counters */
+    for (i = 0; i < new_keys->keysize; i++) {
+        entry = new_keys->keyentries[i];
+
+        if (OS_IsAllowedID(keys, entry->id) >= 0) {
+            continue;
+        }
+
+        new_keys->keyentries[i] = NULL;
+        OS_StartKeyCounter(entry);
+
+        lock();
+        keyid = key_insert(keys, entry);
+
+        if (entry->sock >= 0) {
+            snprintf(strsock, sizeof(strsock), "%d", entry->sock);
+            OSHash_Set_ex(keys->keyhash_sock, strsock, keys->keyentries[keyid]);
+        }
+
+        unlock();
+        added++;
     }
 
-    return (-1);
+    keys->file_change = new_keys->file_change;
+    keys->inode = new_keys->inode;
+    keys->id_counter = new_keys->id_counter;
+
+    OS_FreeKeys(new_keys);
+    free(new_keys);
+
+    mdebug1("Key reloading completed: %u added, %u removed.", added, removed);
+}
+
+/* Check if an IP address is allowed to connect */
+int OS_IsAllowedIP(keystore *keys, const char *srcip)
+{
+    if (srcip == NULL) {
+        return (-1);
+    }
+
+    return key_lookup(keys->keyhash_ip, srcip);
 }
 
 /* Check if the agent name is valid */
@@ -455,6 +561,11 @@ int OS_IsAllowedName(const keystore *keys, const char *name)
 {
     unsigned int i = 0;
 
+    if (keys->keyhash_name) {
+        return key_lookup(keys->keyhash_name, name);
+    }
+
+    /* Duplicated keystores have no hashes */
     for (i = 0; i < keys->keysize; i++) {
         if (strcmp(keys->keyentries[i]->name, name) == 0) {
             return ((int)i);
@@ -466,17 +577,11 @@ int OS_IsAllowedName(const keystore *keys, const char *name)
 
 int OS_IsAllowedID(keystore *keys, const char *id)
 {
-    keyentry *entry;
-
     if (id == NULL) {
         return (-1);
     }
 
-    entry = (keyentry *) OSHash_Get(keys->keyhash_id, id);
-    if (entry) {
-        return ((int)entry->keyid);
-    }
-    return (-1);
+    return key_lookup(keys->keyhash_id, id);
 }
 
 
@@ -484,19 +589,23 @@ int OS_IsAllowedID(keystore *keys, const char *id)
 int OS_IsAllowedDynamicID(keystore *keys, const char *id, const char *srcip)
 {
     keyentry *entry;
+    int keyid = -1;
 
     if (id == NULL) {
         return (-1);
     }
 
-    entry = (keyentry *) OSHash_Get(keys->keyhash_id, id);
+    w_rcu_thread_read_lock();
+
+    entry = (keyentry *) OSHash_Get_ex(keys->keyhash_id, id);
     if (entry) {
         if (OS_IPFound(srcip, entry->ip)) {
-            return ((int)entry->keyid);
+            keyid = (int)__atomic_load_n(&entry->keyid, __ATOMIC_RELAXED);
         }
     }
 
-    return (-1);
+    w_rcu_thread_read_unlock();
+    return keyid;
 }
 
 /* Configure to pass if keys file is empty */
@@ -507,6 +616,7 @@ void OS_PassEmptyKeyfile() {
 /* Delete a key */
 int OS_DeleteKey(keystore *keys, const char *id, int purge) {
     int i = OS_IsAllowedID(keys, id);
+    keyentry *entry;
 
 
     if (i < 0)
@@ -521,24 +631,47 @@ int OS_DeleteKey(keystore *keys, const char *id, int purge) {
         save_removed_key(keys, buffer);
     }
 
-    OSHash_Delete(keys->keyhash_id, id);
-    OSHash_Delete(keys->keyhash_ip, keys->keyentries[i]->ip->ip);
+    entry = keys->keyentries[i];
+
+    OSHash_Delete_ex(keys->keyhash_id, id);
+
+    if (OSHash_Get(keys->keyhash_ip, entry->ip->ip) == entry) {
+        OSHash_Delete_ex(keys->keyhash_ip, entry->ip->ip);
+    }
 
-    if (keys->keyentries[i]->sock >= 0) {
+    /* Another agent with the same name takes its place in the index */
+    if (OSHash_Get(keys->keyhash_name, entry->name) == entry) {
+        unsigned int j;
+
+        OSHash_Delete_ex(keys->keyhash_name, entry->name);
+
+        for (j = 0; j < keys->keysize; j++) {
+            if ((int)j != i && strcmp(keys->keyentries[j]->name, entry->name) == 0) {
+                OSHash_Add(keys->keyhash_name, keys->keyentries[j]->name, keys->keyentries[j]);
+                break;
+            }
+        }
+    }
+
+    if (entry->sock >= 0) {
         char strsock[16] = "";
-        snprintf(strsock, sizeof(strsock), "%d", keys->keyentries[i]->sock);
+        snprintf(strsock, sizeof(strsock), "%d", entry->sock);
         OSHash_Delete_ex(keys->keyhash_sock, strsock);
     }
 
-    OS_FreeKey(keys->keyentries[i]);
     keys->keysize--;
 
     if (i < (int)keys->keysize) {
         keys->keyentries[i] = keys->keyentries[keys->keysize];
-        keys->keyentries[i]->keyid = i;
+        __atomic_store_n(&keys->keyentries[i]->keyid, i, __ATOMIC_RELAXED);
     }
 
     keys->keyentries[keys->keysize] = keys->keyentries[keys->keysize + 1];
+
+    /* Lookups without the keystore lock may still be reading the entry */
+    w_rcu_thread_synchronize();
+    OS_FreeKey(entry);
+
     return i;
 }
 
@@ -573,6 +706,53 @@ int OS_WriteKeys(const keystore *keys) {
     return 0;
 }
 
+/* Append new entries to the keys file. The lines are the same that
+ * OS_WriteKeys() would write, so the file needs no compaction.
+ * Returns 0 on success or -1 on error.
+ */
+int OS_AppendKeys(const keystore *keys) {
+    const char *path = isChroot() ? AUTH_FILE : KEYSFILE_PATH;
+    unsigned int i;
+    FILE *fp;
+    char cidr[20];
+    int result;
+    int c;
+
+    if (fp = fopen(path, "a+"), !fp) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        return -1;
+    }
+
+    /* Don't glue the first line to a line cut by a crash */
+    c = fseek(fp, -1, SEEK_END) == 0 ? fgetc(fp) : EOF;
+    fseek(fp, 0, SEEK_END);
+
+    if (c != EOF && c != '\n') {
+        fputc('\n', fp);
+    }
+
+    for (i = 0; i < keys->keysize; i++) {
+        keyentry *entry = keys->keyentries[i];
+        fprintf(fp, "%s %s %s %s\n", entry->id, entry->name, OS_CIDRtoStr(entry->ip, cidr, 20) ? entry->ip->ip : cidr, entry->key);
+    }
+
+    result = fflush(fp);
+#ifndef WIN32
+    if (result == 0) {
+        result = fsync(fileno(fp));
+    }
+#endif
+
+    if (result != 0) {
+        merror("Couldn't write file '%s': %s (%d)", path, strerror(errno), errno);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
 /* Duplicate keystore except key hashes and file pointer */
 keystore* OS_DupKeys(const keystore *keys) {
     keystore *copy;
@@ -16,11 +16,50 @@
 #include "os_crypto/aes/aes_op.h"
 #include "client-agent/agentd.h"
 
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
 /* Prototypes */
 static void StoreSenderCounter(const keystore *keys, unsigned int global, unsigned int local) __attribute((nonnull));
 static void StoreCounter(const keystore *keys, int id, unsigned int global, unsigned int local) __attribute((nonnull));
-static void ReloadCounter(const keystore *keys, unsigned int id, const char * cid) __attribute((nonnull));
+static void ReloadCounter(const keystore *keys, unsigned int id) __attribute((nonnull));
+static long counter_slot(const char *id);
+static int counter_open(void);
+static counter_record *counter_chunk(size_t n);
+static void counter_attach(keyentry *key, const char *id) __attribute((nonnull(1)));
+static void counter_load(keyentry *key, unsigned int *global, unsigned int *local) __attribute((nonnull));
+static void counter_store(keyentry *key, unsigned int global, unsigned int local) __attribute((nonnull));
+#ifndef WIN32
+static void counter_sync(void);
+#endif
 static char *CheckSum(char *msg, size_t length) __attribute((nonnull));
+static int CheckCounter(keystore *keys, int id, char *buffer, char *f_msg, size_t *final_size, const char *srcip, char **output) __attribute((nonnull));
+static os_aes_cache *GetKeyCache(keyentry *key) __attribute((nonnull));
+static size_t CreateSecMSG_GCM(const keystore *keys, os_aes_cache *cache, const char *msg, size_t msg_length, char *compressed, char *msg_encrypted, unsigned int id, const char *crypto_token) __attribute((nonnull));
+
+/* Counter table: a header, the sender record, and a record per agent ID.
+ * It's mapped in chunks, so the records don't move as it grows.
+ */
+#define COUNTER_MAGIC       0x44495257U         /* "WRID" */
+#define COUNTER_VERSION     1
+#define COUNTER_CHUNK       8192                /* Records per chunk */
+#define COUNTER_CHUNK_SIZE  (COUNTER_CHUNK * sizeof(counter_record))
+#define COUNTER_SLOTS       100000002           /* Up to 8-digit agent IDs */
+#define COUNTER_CHUNKS      ((COUNTER_SLOTS + COUNTER_CHUNK - 1) / COUNTER_CHUNK)
+
+static struct {
+    int open;
+#ifndef WIN32
+    int fd;
+#else
+    FILE *fp;
+#endif
+    int sync_interval;                          /* Seconds between writes to disk */
+    unsigned int synced;                        /* Time of the last write */
+    counter_record *chunk[COUNTER_CHUNKS];
+    pthread_mutex_t mutex;
+} counters = { .mutex = PTHREAD_MUTEX_INITIALIZER };
 
 /* Sending counts */
 static unsigned int global_count = 0;
@@ -62,6 +101,30 @@ int doEncryptByMethod(const char *input, char *output, const char *charkey,
     }
 }
 
+/* Get the cached AES contexts of a key, and create them on first use.
+ * Many threads may race to create them: only one wins.
+ */
+static os_aes_cache *GetKeyCache(keyentry *key)
+{
+    os_aes_cache *cache = __atomic_load_n(&key->aes, __ATOMIC_ACQUIRE);
+    os_aes_cache *expected = NULL;
+
+    if (cache) {
+        return cache;
+    }
+
+    if (cache = OS_AES_CacheNew(key->key), !cache) {
+        return NULL;
+    }
+
+    if (!__atomic_compare_exchange_n(&key->aes, &expected, cache, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        OS_AES_CacheFree(cache);
+        cache = expected;
+    }
+
+    return cache;
+}
+
 /* Set the agent crypto method read from the ossec.conf file */
 void os_set_agent_crypto_method(keystore * keys,const int method){
     keys->keyentries[0]->crypto_method = method;
@@ -73,76 +136,23 @@ static time_t saved_time = 0;
 void OS_StartCounter(keystore *keys)
 {
     unsigned int i;
-    char rids_file[OS_FLSIZE + 1];
-
-    rids_file[OS_FLSIZE] = '\0';
 
     mdebug1("OS_StartCounter: keysize: %u", keys->keysize);
 
-    /* Start receiving counter */
-    for (i = 0; i <= keys->keysize; i++) {
-        /* On i == keysize, we deal with the sender counter */
-        if (i == keys->keysize) {
-            snprintf(rids_file, OS_FLSIZE, "%s/%s",
-                     isChroot() ? RIDS_DIR : RIDS_DIR_PATH,
-                     SENDER_COUNTER);
-        } else {
-            snprintf(rids_file, OS_FLSIZE, "%s/%s",
-                     isChroot() ? RIDS_DIR : RIDS_DIR_PATH,
-                     keys->keyentries[i]->id);
-        }
-
-        keys->keyentries[i]->fp = fopen(rids_file, "r+");
-
-        /* If nothing is there, try to open as write only */
-        if (!keys->keyentries[i]->fp) {
-            keys->keyentries[i]->fp = fopen(rids_file, "w");
-            if (!keys->keyentries[i]->fp) {
-                int my_error = errno;
-
-                /* Just in case we run out of file descriptors */
-                if ((i > 10) && (keys->keyentries[i - 1]->fp)) {
-                    fclose(keys->keyentries[i - 1]->fp);
-
-                    if (keys->keyentries[i - 2]->fp) {
-                        fclose(keys->keyentries[i - 2]->fp);
-                    }
-                }
-
-                merror("Unable to open agent file. errno: %d", my_error);
-                merror_exit(FOPEN_ERROR, rids_file, errno, strerror(errno));
-            }
-        } else {
-            unsigned int g_c = 0, l_c = 0;
-            if (fscanf(keys->keyentries[i]->fp, "%u:%u", &g_c, &l_c) != 2) {
-                if (i == keys->keysize) {
-                    mdebug1("No previous sender counter.");
-                } else {
-                    mdebug1("No previous counter available for '%s'.",
-                            keys->keyentries[i]->name);
-                }
-
-                g_c = 0;
-                l_c = 0;
-            }
-
-            if (i == keys->keysize) {
-                mdebug1("Assigning sender counter: %u:%u",
-                        g_c, l_c);
-                global_count = g_c;
-                local_count = l_c;
-            } else {
-                mdebug1("Assigning counter for agent %s: '%u:%u'.",
-                        keys->keyentries[i]->name, g_c, l_c);
-
-                keys->keyentries[i]->global = g_c;
-                keys->keyentries[i]->local = l_c;
-            }
-        }
+    if (counter_open() < 0) {
+        merror_exit("Unable to open the counter table.");
+    }
 
-        keys->keyentries[i]->inode = File_Inode(rids_file);
+    /* Start receiving counter */
+    for (i = 0; i < keys->keysize; i++) {
+        OS_StartKeyCounter(keys->keyentries[i]);
     }
 
+    /* The sender counter comes after the agents */
+    counter_attach(keys->keyentries[keys->keysize], NULL);
+    counter_load(keys->keyentries[keys->keysize], &global_count, &local_count);
+    mdebug1("Assigning sender counter: %u:%u", global_count, local_count);
+
     mdebug2("Stored counter.");
 
     /* Get counter values */
@@ -163,89 +173,323 @@ void OS_StartCounter(keystore *keys)
     _s_verify_counter = getDefine_Int("remoted", "verify_msg_id" , 0, 1);
 }
 
+/* Start the counter of a single agent */
+void OS_StartKeyCounter(keyentry *key)
+{
+    counter_attach(key, key->id);
+    counter_load(key, &key->global, &key->local);
+    mdebug1("Assigning counter for agent %s: '%u:%u'.", key->name, key->global, key->local);
+}
+
 /* Remove the ID counter */
 void OS_RemoveCounter(const char *id)
 {
     char rids_file[OS_FLSIZE + 1];
+    counter_record record = { 0, 0 };
+    long slot;
+    FILE *fp;
+
+    /* The file of older versions */
     snprintf(rids_file, OS_FLSIZE, "%s/%s", RIDS_DIR, id);
     unlink(rids_file);
+
+    if (slot = counter_slot(strcmp(id, "sender") ? id : NULL), slot < 0) {
+        return;
+    }
+
+    snprintf(rids_file, OS_FLSIZE, "%s/%s", RIDS_DIR, COUNTER_TABLE);
+
+    if (fp = fopen(rids_file, "r+b"), !fp) {
+        return;
+    }
+
+    /* Don't extend the table for an agent that isn't in it */
+    if (fseek(fp, 0, SEEK_END) == 0 && ftell(fp) >= (long)((slot + 1) * sizeof(counter_record)) &&
+        fseek(fp, slot * sizeof(counter_record), SEEK_SET) == 0) {
+        fwrite(&record, sizeof(record), 1, fp);
+    }
+
+    fclose(fp);
 }
 
 /* Store sender counter */
 static void StoreSenderCounter(const keystore *keys, unsigned int global, unsigned int local)
 {
-    /* Write to the beginning of the file */
-    fseek(keys->keyentries[keys->keysize]->fp, 0, SEEK_SET);
-    fprintf(keys->keyentries[keys->keysize]->fp, "%u:%u:", global, local);
-    fflush(keys->keyentries[keys->keysize]->fp);
+    counter_store(keys->keyentries[keys->keysize], global, local);
 }
 
 /* Store the global and local count of events */
 static void StoreCounter(const keystore *keys, int id, unsigned int global, unsigned int local)
 {
-    /* Write to the beginning of the file */
-    fseek(keys->keyentries[id]->fp, 0, SEEK_SET);
-    fprintf(keys->keyentries[id]->fp, "%u:%u:", global, local);
-    fflush(keys->keyentries[id]->fp);
+    counter_store(keys->keyentries[id], global, local);
 }
 
-/* Reload the global and local count of events */
-static void ReloadCounter(const keystore *keys, unsigned int id, const char * cid)
+/* Reload the global and local count of events, in case another process reset them */
+static void ReloadCounter(const keystore *keys, unsigned int id)
+{
+    keyentry *key = keys->keyentries[id];
+
+    w_mutex_lock(&key->mutex);
+
+    if (id == keys->keysize) {
+        counter_load(key, &global_count, &local_count);
+    } else {
+        counter_load(key, &key->global, &key->local);
+    }
+
+    w_mutex_unlock(&key->mutex);
+}
+
+/* Slot of an agent ID in the counter table, or of the sender if the ID is NULL.
+ * Returns -1 if the ID isn't numeric.
+ */
+static long counter_slot(const char *id)
+{
+    size_t length;
+
+    if (!id) {
+        return 1;
+    }
+
+    length = strlen(id);
+
+    if (length == 0 || length > 8 || strspn(id, "0123456789") != length) {
+        return -1;
+    }
+
+    return 2 + strtol(id, NULL, 10);
+}
+
+/* Open the counter table, and check its header
+ * Returns 0 on success or -1 on error
+ */
+static int counter_open()
+{
+    char path[OS_FLSIZE + 1];
+    counter_record header = { 0, 0 };
+    counter_record *chunk;
+    int result = -1;
+
+    w_mutex_lock(&counters.mutex);
+
+    if (counters.open) {
+        w_mutex_unlock(&counters.mutex);
+        return 0;
+    }
+
+    snprintf(path, OS_FLSIZE, "%s/%s", isChroot() ? RIDS_DIR : RIDS_DIR_PATH, COUNTER_TABLE);
+
+#ifndef WIN32
+    if (counters.fd = open(path, O_RDWR | O_CREAT, 0640), counters.fd < 0) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        goto end;
+    }
+
+    w_descriptor_cloexec(counters.fd);
+
+    if (pread(counters.fd, &header, sizeof(header), 0) == sizeof(header) && header.global != COUNTER_MAGIC) {
+        mwarn("Invalid counter table '%s'. Starting it again.", path);
+
+        if (ftruncate(counters.fd, 0) < 0) {
+            merror("Unable to truncate '%s': %s (%d)", path, strerror(errno), errno);
+            goto end;
+        }
+    }
+#else
+    if (counters.fp = fopen(path, "r+b"), !counters.fp && (counters.fp = fopen(path, "w+b"), !counters.fp)) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        goto end;
+    }
+
+    if (fread(&header, sizeof(header), 1, counters.fp) == 1 && header.global != COUNTER_MAGIC) {
+        mwarn("Invalid counter table '%s'. Starting it again.", path);
+        fclose(counters.fp);
+
+        if (counters.fp = fopen(path, "w+b"), !counters.fp) {
+            merror(FOPEN_ERROR, path, errno, strerror(errno));
+            goto end;
+        }
+    }
+#endif
+
+    counters.sync_interval = getDefine_Int("remoted", "counter_sync_interval", 1, 3600);
+    counters.synced = (unsigned int)time(NULL);
+    counters.open = 1;
+
+    if (chunk = counter_chunk(0), !chunk) {
+        counters.open = 0;
+        goto end;
+    }
+
+    if (chunk->global != COUNTER_MAGIC) {
+        chunk->global = COUNTER_MAGIC;
+        chunk->local = COUNTER_VERSION;
+#ifdef WIN32
+        fseek(counters.fp, 0, SEEK_SET);
+        fwrite(chunk, sizeof(counter_record), 1, counters.fp);
+        fflush(counters.fp);
+#endif
+    }
+
+    result = 0;
+
+end:
+    w_mutex_unlock(&counters.mutex);
+    return result;
+}
+
+/* Get a chunk of the counter table, and map it first if needed.
+ * The chunks never move, so a key can point to its record.
+ * It must be called with the table locked.
+ */
+static counter_record *counter_chunk(size_t n)
+{
+    off_t offset = (off_t)n * COUNTER_CHUNK_SIZE;
+    counter_record *chunk;
+
+    if (chunk = counters.chunk[n], chunk) {
+        return chunk;
+    }
+
+#ifndef WIN32
+    struct stat st;
+
+    if (fstat(counters.fd, &st) < 0 || (st.st_size < offset + (off_t)COUNTER_CHUNK_SIZE && ftruncate(counters.fd, offset + COUNTER_CHUNK_SIZE) < 0)) {
+        merror("Unable to extend the counter table: %s (%d)", strerror(errno), errno);
+        return NULL;
+    }
+
+    if (chunk = mmap(NULL, COUNTER_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, counters.fd, offset), chunk == MAP_FAILED) {
+        merror("Unable to map the counter table: %s (%d)", strerror(errno), errno);
+        return NULL;
+    }
+#else
+    os_calloc(COUNTER_CHUNK, sizeof(counter_record), chunk);
+
+    /* A short read leaves zeros: no counters yet */
+    if (fseek(counters.fp, offset, SEEK_SET) == 0) {
+        if (!fread(chunk, sizeof(counter_record), COUNTER_CHUNK, counters.fp)) {
+            clearerr(counters.fp);
+        }
+    }
+#endif
+
+    __atomic_store_n(&counters.chunk[n], chunk, __ATOMIC_RELEASE);
+    return chunk;
+}
+
+/* Point a key to its record, and import the counter file of older versions, if any */
+static void counter_attach(keyentry *key, const char *id)
 {
-    ino_t new_inode;
     char rids_file[OS_FLSIZE + 1];
+    counter_record *chunk = NULL;
+    unsigned int g_c = 0, l_c = 0;
+    long slot = counter_slot(id);
+    FILE *fp;
 
-    snprintf(rids_file, OS_FLSIZE, "%s/%s", isChroot() ? RIDS_DIR : RIDS_DIR_PATH, cid);
-    new_inode = File_Inode(rids_file);
+    key->counter = &key->counter_mem;
 
-    w_mutex_lock(&keys->keyentries[id]->mutex);
+    if (slot >= 0 && counter_open() == 0) {
+        w_mutex_lock(&counters.mutex);
+        chunk = counter_chunk(slot / COUNTER_CHUNK);
+        w_mutex_unlock(&counters.mutex);
+    }
 
-    if (keys->keyentries[id]->inode != new_inode) {
-        keys->keyentries[id]->fp = fopen(rids_file, "r+");
+    if (chunk) {
+        key->counter = chunk + slot % COUNTER_CHUNK;
+    } else {
+        mwarn("The counter of agent '%s' will not be stored.", id ? id : "sender");
+    }
 
-        if (!keys->keyentries[id]->fp) {
-            keys->keyentries[id]->fp = fopen(rids_file, "w");
-            if (!keys->keyentries[id]->fp) {
-                goto fail_open;
-            }
+    if (key->counter->global || key->counter->local) {
+        return;
+    }
+
+    snprintf(rids_file, OS_FLSIZE, "%s/%s", isChroot() ? RIDS_DIR : RIDS_DIR_PATH, id ? id : SENDER_COUNTER);
+
+    if (fp = fopen(rids_file, "r"), !fp) {
+        return;
+    }
+
+    if (fscanf(fp, "%u:%u", &g_c, &l_c) == 2) {
+        mdebug1("Importing counter '%s': '%u:%u'.", rids_file, g_c, l_c);
+        fclose(fp);
+        counter_store(key, g_c, l_c);
+        unlink(rids_file);
+    } else {
+        fclose(fp);
+    }
+}
+
+/* Read the record of a key */
+static void counter_load(keyentry *key, unsigned int *global, unsigned int *local)
+{
+#ifdef WIN32
+    long slot;
+
+    /* The table may have been changed by other processes */
+    if (key->counter != &key->counter_mem && (slot = counter_slot(key->id), slot >= 0)) {
+        w_mutex_lock(&counters.mutex);
+
+        if (fseek(counters.fp, slot * sizeof(counter_record), SEEK_SET) == 0 && fread(key->counter, sizeof(counter_record), 1, counters.fp) != 1) {
+            clearerr(counters.fp);
         }
-        else {
-            unsigned int g_c = 0;
-            unsigned int l_c = 0;
-
-            if (fscanf(keys->keyentries[id]->fp, "%u:%u", &g_c, &l_c) != 2) {
-                if (id == keys->keysize) {
-                    mdebug1("No previous sender counter.");
-                } else {
-                    mdebug1("No previous counter available for '%s'.", keys->keyentries[id]->id);
-                }
-
-                g_c = 0;
-                l_c = 0;
-            }
 
-            if (id == keys->keysize) {
-                mdebug1("Reloading sender counter: %u:%u", g_c, l_c);
-                global_count = g_c;
-                local_count = l_c;
-            } else {
-                mdebug1("Reloading counter for agent %s: '%u:%u'.", keys->keyentries[id]->id, g_c, l_c);
+        w_mutex_unlock(&counters.mutex);
+    }
+#endif
 
-                keys->keyentries[id]->global = g_c;
-                keys->keyentries[id]->local = l_c;
-            }
+    *global = key->counter->global;
+    *local = key->counter->local;
+}
+
+/* Write the record of a key. The table is written back to disk at intervals. */
+static void counter_store(keyentry *key, unsigned int global, unsigned int local)
+{
+    key->counter->global = global;
+    key->counter->local = local;
+
+#ifdef WIN32
+    long slot;
+
+    /* Without a mapping, write it through */
+    if (key->counter != &key->counter_mem && (slot = counter_slot(key->id), slot >= 0)) {
+        w_mutex_lock(&counters.mutex);
+
+        if (fseek(counters.fp, slot * sizeof(counter_record), SEEK_SET) == 0) {
+            fwrite(key->counter, sizeof(counter_record), 1, counters.fp);
+            fflush(counters.fp);
         }
 
-        keys->keyentries[id]->inode = new_inode;
+        w_mutex_unlock(&counters.mutex);
     }
+#else
+    counter_sync();
+#endif
+}
 
-    w_mutex_unlock(&keys->keyentries[id]->mutex);
-    return;
+#ifndef WIN32
+/* Write the mapped chunks back to disk, once per interval and by a single thread */
+static void counter_sync()
+{
+    unsigned int now = (unsigned int)time(NULL);
+    unsigned int synced = __atomic_load_n(&counters.synced, __ATOMIC_RELAXED);
+    counter_record *chunk;
+    size_t n;
+
+    if (now - synced < (unsigned int)counters.sync_interval ||
+        !__atomic_compare_exchange_n(&counters.synced, &synced, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
 
-fail_open:
-    w_mutex_unlock(&keys->keyentries[id]->mutex);
-    merror("Unable to reload counter '%s': %s (%d)", cid, strerror(errno), errno);
+    for (n = 0; n < COUNTER_CHUNKS; n++) {
+        if (chunk = __atomic_load_n(&counters.chunk[n], __ATOMIC_ACQUIRE), chunk && msync(chunk, COUNTER_CHUNK_SIZE, MS_SYNC) < 0) {
+            mwarn("Unable to write the counter table: %s (%d)", strerror(errno), errno);
+            break;
+        }
+    }
 }
+#endif
 
 /* Verify the checksum of the message
  * Returns NULL on error or the message on success
@@ -270,11 +514,85 @@ static char *CheckSum(char *msg, size_t length)
     return (msg);
 }
 
-int ReadSecMSG(keystore *keys, char *buffer, char *cleartext, int id, unsigned int buffer_size, size_t *final_size, const char *srcip, char **output)
+/* Check the counters of an uncompressed message -- protect against replay attacks.
+ * f_msg points to the random number, past the checksum if any.
+ */
+static int CheckCounter(keystore *keys, int id, char *buffer, char *f_msg, size_t *final_size, const char *srcip, char **output)
 {
     unsigned int msg_global = 0;
     unsigned int msg_local = 0;
+
+    /* Remove random */
+    f_msg += 5;
+
+    /* Check count -- protect against replay attacks */
+    msg_global = (unsigned int) atoi(f_msg);
+    f_msg += 10;
+
+    /* Check for the right message format */
+    if (*f_msg != ':') {
+        merror(ENCFORMAT_ERROR, keys->keyentries[id]->id, srcip);
+        return KS_CORRUPT;
+    }
+    f_msg++;
+
+    msg_local = (unsigned int) atoi(f_msg);
+    f_msg += 5;
+    *final_size -= (f_msg - buffer);
+
+    /* Return the message if we don't need to verify the counter */
+    if (!_s_verify_counter) {
+        /* Update current counts */
+        keys->keyentries[id]->global = msg_global;
+        keys->keyentries[id]->local = msg_local;
+        StoreCounter(keys, id, msg_global, msg_local);
+        *output = f_msg;
+        return KS_VALID;
+    }
+
+    /* Now and then, pick up the counters that other processes reset */
+    if (rcv_count++ >= _s_recv_flush) {
+        ReloadCounter(keys, id);
+        rcv_count = 0;
+    }
+
+    if ((msg_global > keys->keyentries[id]->global) ||
+            ((msg_global == keys->keyentries[id]->global) &&
+             (msg_local > keys->keyentries[id]->local))) {
+        /* Update current counts */
+        keys->keyentries[id]->global = msg_global;
+        keys->keyentries[id]->local = msg_local;
+
+        /* Storing is a write to the mapped table */
+        StoreCounter(keys, id, msg_global, msg_local);
+        *output = f_msg;
+        return KS_VALID;
+    }
+
+    /* Check if it is a duplicated message */
+    if (msg_global == keys->keyentries[id]->global) {
+        /* Warn about duplicated messages */
+        mwarn("Duplicate error:  global: %u, local: %u, "
+            "saved global: %u, saved local:%u",
+            msg_global,
+            msg_local,
+            keys->keyentries[id]->global,
+            keys->keyentries[id]->local);
+
+        merror(ENCTIME_ERROR, keys->keyentries[id]->name);
+        return KS_RIDS;
+    }
+
+    mwarn(ENCKEY_ERROR, keys->keyentries[id]->id, srcip);
+    return KS_ENCKEY;
+}
+
+int ReadSecMSG(keystore *keys, char *buffer, char *cleartext, int id, unsigned int buffer_size, size_t *final_size, const char *srcip, char **output)
+{
+    unsigned int msg_local = 0;
+    os_aes_cache *cache;
     char *f_msg;
+    int length;
 
     if(strncmp(buffer, "#AES", 4)==0){
         buffer+=4;
@@ -282,6 +600,12 @@ int ReadSecMSG(keystore *keys, char *buffer, char *cleartext, int id, unsigned i
             keys->keyentries[id]->crypto_method = W_METH_AES;
         #endif
     }
+    else if(strncmp(buffer, "#GCM", 4)==0){
+        buffer+=4;
+        #ifndef CLIENT
+            keys->keyentries[id]->crypto_method = W_METH_AES_GCM;
+        #endif
+    }
     else{
         #ifndef CLIENT
             keys->keyentries[id]->crypto_method = W_METH_BLOWFISH;
@@ -306,12 +630,30 @@ int ReadSecMSG(keystore *keys, char *buffer, char *cleartext, int id, unsigned i
             }
             break;
         case W_METH_AES:
-            if (!OS_AES_Str(buffer, cleartext, keys->keyentries[id]->key,
-                buffer_size-4, OS_DECRYPT)) {
+            if (cache = GetKeyCache(keys->keyentries[id]), !cache ||
+                !OS_AES_CacheStr(cache, buffer, cleartext, buffer_size-4, OS_DECRYPT)) {
                 mwarn(ENCKEY_ERROR, keys->keyentries[id]->id, keys->keyentries[id]->ip->ip);
                 return KS_ENCKEY;
             }
             break;
+        case W_METH_AES_GCM:
+            if (cache = GetKeyCache(keys->keyentries[id]), !cache ||
+                (length = OS_AES_GCM_Decrypt(cache, buffer, buffer_size-4, cleartext), !length)) {
+                mwarn(ENCKEY_ERROR, keys->keyentries[id]->id, keys->keyentries[id]->ip->ip);
+                return KS_ENCKEY;
+            }
+
+            /* The tag authenticates the message: there is no padding or checksum */
+            if (*final_size = os_zlib_uncompress(cleartext, buffer, length, OS_MAXSTR), !*final_size) {
+#ifdef CLIENT
+                merror(UNCOMPRESS_ERR);
+#else
+                merror(UNCOMPRESS_ERR " Message received from agent '%s' at '%s'", keys->keyentries[id]->id, keys->keyentries[id]->ip->ip);
+#endif
+                return KS_CORRUPT;
+            }
+
+            return CheckCounter(keys, id, buffer, buffer, final_size, srcip, output);
     }
 
     /* Compressed */
@@ -343,71 +685,7 @@ int ReadSecMSG(keystore *keys, char *buffer, char *cleartext, int id, unsigned i
             return KS_CORRUPT;
         }
 
-        /* Remove random */
-        f_msg += 5;
-
-        /* Check count -- protect against replay attacks */
-        msg_global = (unsigned int) atoi(f_msg);
-        f_msg += 10;
-
-        /* Check for the right message format */
-        if (*f_msg != ':') {
-            merror(ENCFORMAT_ERROR, keys->keyentries[id]->id, srcip);
-            return KS_CORRUPT;
-        }
-        f_msg++;
-
-        msg_local = (unsigned int) atoi(f_msg);
-        f_msg += 5;
-        *final_size -= (f_msg - buffer);
-
-        /* Return the message if we don't need to verify the counter */
-        if (!_s_verify_counter) {
-            /* Update current counts */
-            keys->keyentries[id]->global = msg_global;
-            keys->keyentries[id]->local = msg_local;
-            if (rcv_count >= _s_recv_flush) {
-                StoreCounter(keys, id, msg_global, msg_local);
-                rcv_count = 0;
-            }
-            rcv_count++;
-            *output = f_msg;
-            return KS_VALID;
-        }
-
-        if (rcv_count >= _s_recv_flush) {
-            ReloadCounter(keys, id, keys->keyentries[id]->id);
-        }
-
-        if ((msg_global > keys->keyentries[id]->global) ||
-                ((msg_global == keys->keyentries[id]->global) &&
-                 (msg_local > keys->keyentries[id]->local))) {
-            /* Update current counts */
-            keys->keyentries[id]->global = msg_global;
-            keys->keyentries[id]->local = msg_local;
-
-            if (rcv_count >= _s_recv_flush) {
-                StoreCounter(keys, id, msg_global, msg_local);
-                rcv_count = 0;
-            }
-            rcv_count++;
-            *output = f_msg;
-            return KS_VALID;
-        }
-
-        /* Check if it is a duplicated message */
-        if (msg_global == keys->keyentries[id]->global) {
-            /* Warn about duplicated messages */
-            mwarn("Duplicate error:  global: %u, local: %u, "
-                "saved global: %u, saved local:%u",
-                msg_global,
-                msg_local,
-                keys->keyentries[id]->global,
-                keys->keyentries[id]->local);
-
-            merror(ENCTIME_ERROR, keys->keyentries[id]->name);
-            return KS_RIDS;
-        }
+        return CheckCounter(keys, id, buffer, f_msg, final_size, srcip, output);
     }
 
     /* Old format */
@@ -494,6 +772,55 @@ int ReadSecMSG(keystore *keys, char *buffer, char *cleartext, int id, unsigned i
     return KS_ENCKEY;
 }
 
+/* Compress and encrypt a message with AES-GCM. The tag replaces the checksum,
+ * and the message needs no padding.
+ * Returns the size
+ */
+static size_t CreateSecMSG_GCM(const keystore *keys, os_aes_cache *cache, const char *msg, size_t msg_length, char *compressed, char *msg_encrypted, unsigned int id, const char *crypto_token)
+{
+    unsigned long int cmp_size;
+    size_t length;
+    int crypto_length;
+
+    cmp_size = os_zlib_compress(msg, compressed, msg_length, OS_MAXSTR - 32 - OS_AES_GCM_OVERHEAD);
+    if (!cmp_size) {
+        merror(COMPRESS_ERR, msg);
+        return (0);
+    }
+
+    /* Get average sizes */
+    c_orig_size += msg_length;
+    c_comp_size += cmp_size;
+    if (evt_count > _s_comp_print) {
+        mdebug1("Event count after '%u': %lu->%lu (%lu%%)",
+                evt_count,
+                (unsigned long)c_orig_size,
+                (unsigned long)c_comp_size,
+                (unsigned long)((c_comp_size * 100) / c_orig_size));
+        evt_count = 0;
+        c_orig_size = 0;
+        c_comp_size = 0;
+    }
+    evt_count++;
+
+    /* If the IP is dynamic (not single host), append agent ID to the message */
+    if (!isSingleHost(keys->keyentries[id]->ip) && isAgent) {
+        length = snprintf(msg_encrypted, 16, "!%s!%s", keys->keyentries[id]->id, crypto_token);
+    } else {
+        length = snprintf(msg_encrypted, 6, "%s", crypto_token);
+    }
+
+    if (crypto_length = OS_AES_GCM_Encrypt(cache, compressed, (long)cmp_size, msg_encrypted + length), !crypto_length) {
+        merror("Unable to encrypt the message for agent '%s'.", keys->keyentries[id]->id);
+        return (0);
+    }
+
+    /* Store before leaving */
+    StoreSenderCounter(keys, global_count, local_count);
+
+    return (crypto_length + length);
+}
+
 /* Create an encrypted message
  * Returns the size
  */
@@ -508,6 +835,7 @@ size_t CreateSecMSG(const keystore *keys, const char *msg, size_t msg_length, ch
     char crypto_token[6] = {0};
     unsigned long crypto_length = 0;
     int crypto_method = 0;
+    os_aes_cache *cache = NULL;
     os_md5 md5sum;
     time_t curr_time;
 
@@ -532,10 +860,18 @@ size_t CreateSecMSG(const keystore *keys, const char *msg, size_t msg_length, ch
         case W_METH_AES:
             memcpy(crypto_token,"#AES:",5);
             break;
+        case W_METH_AES_GCM:
+            memcpy(crypto_token,"#GCM:",5);
+            break;
         default:
             return OS_INVALID;
     }
 
+    if (crypto_method != W_METH_BLOWFISH && (cache = GetKeyCache(keys->keyentries[id]), !cache)) {
+        merror("Unable to load the key of agent '%s'.", keys->keyentries[id]->id);
+        return (0);
+    }
+
     /* Random number, take only 5 chars ~= 2^16=65536*/
     rand1 = (u_int16_t) os_random();
 
@@ -543,7 +879,7 @@ size_t CreateSecMSG(const keystore *keys, const char *msg, size_t msg_length, ch
     _finmsg[OS_MAXSTR + 1] = '\0';
     msg_encrypted[OS_MAXSTR] = '\0';
 
-    ReloadCounter(keys, keys->keysize, SENDER_COUNTER);
+    ReloadCounter(keys, keys->keysize);
 
     /* Increase local and global counters */
     if (local_count >= 9997) {
@@ -556,6 +892,10 @@ size_t CreateSecMSG(const keystore *keys, const char *msg, size_t msg_length, ch
     memcpy(_tmpmsg + length, msg, msg_length);
     length += msg_length;
 
+    if (crypto_method == W_METH_AES_GCM) {
+        return CreateSecMSG_GCM(keys, cache, _tmpmsg, length, _finmsg, msg_encrypted, id, crypto_token);
+    }
+
     /* Generate MD5 of the unencrypted string */
     OS_MD5_Str(_tmpmsg, length, md5sum);
 
@@ -618,10 +958,15 @@ size_t CreateSecMSG(const keystore *keys, const char *msg, size_t msg_length, ch
      * On dynamic IPs, it will include the agent ID
      */
     /* Encrypt everything */
-    crypto_length = doEncryptByMethod(_tmpmsg + (7 - bfsize), msg_encrypted + length,
-        keys->keyentries[id]->key,
-        (long) cmp_size,
-        OS_ENCRYPT,crypto_method);
+    if (cache) {
+        crypto_length = OS_AES_CacheStr(cache, _tmpmsg + (7 - bfsize), msg_encrypted + length,
+            (long) cmp_size, OS_ENCRYPT);
+    } else {
+        crypto_length = doEncryptByMethod(_tmpmsg + (7 - bfsize), msg_encrypted + length,
+            keys->keyentries[id]->key,
+            (long) cmp_size,
+            OS_ENCRYPT,crypto_method);
+    }
 
     /* Store before leaving */
     StoreSenderCounter(keys, global_count, local_count);
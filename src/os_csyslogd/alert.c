@@ -24,8 +24,8 @@ int OS_Alert_SendSyslog(alert_data *al_data, const SyslogConfig *syslog_config)
     char *hostname;
     char syslog_msg[OS_MAXSTR];
 
-    /* Invalid socket */
-    if (syslog_config->socket < 0) {
+    /* Invalid socket. TCP and TLS buffer the alerts while they reconnect. */
+    if (syslog_config->socket < 0 && !syslog_config->output) {
         return (0);
     }
 
@@ -303,7 +303,7 @@ int OS_Alert_SendSyslog(alert_data *al_data, const SyslogConfig *syslog_config)
         field_add_truncated(syslog_msg, OS_SIZE_61440, " message=\"%s\"", al_data->log[0], 2 );
     }
 
-    OS_SendUDPbySize(syslog_config->socket, strlen(syslog_msg), syslog_msg);
+    csyslog_send(syslog_config, syslog_msg, strlen(syslog_msg));
     return (1);
 }
 
@@ -420,7 +420,7 @@ int OS_Alert_SendSyslog_JSON(cJSON *json_data, const SyslogConfig *syslog_config
             );
 
     mdebug2("OS_Alert_SendSyslog_JSON(): sending '%s'", msg);
-    OS_SendUDPbySize(syslog_config->socket, strlen(msg), msg);
+    csyslog_send(syslog_config, msg, strlen(msg));
     free(string);
 
     return 1;
@@ -48,6 +48,18 @@ cJSON *getCsyslogConfig(void) {
         cJSON *cfg = cJSON_CreateObject();
         if (syslog_config[i]->server) cJSON_AddStringToObject(cfg,"server",syslog_config[i]->server);
         cJSON_AddNumberToObject(cfg,"port",syslog_config[i]->port);
+        switch(syslog_config[i]->protocol) {
+            case CSYSLOG_UDP:
+                cJSON_AddStringToObject(cfg,"protocol","udp");
+                break;
+            case CSYSLOG_TCP:
+                cJSON_AddStringToObject(cfg,"protocol","tcp");
+                break;
+            case CSYSLOG_TLS:
+                cJSON_AddStringToObject(cfg,"protocol","tls");
+                break;
+        }
+        if (syslog_config[i]->ca_file) cJSON_AddStringToObject(cfg,"ca_file",syslog_config[i]->ca_file);
         cJSON_AddNumberToObject(cfg,"level",syslog_config[i]->level);
         if (syslog_config[i]->group) {
             cJSON *group_list = cJSON_CreateArray();
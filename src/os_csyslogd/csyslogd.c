@@ -82,6 +82,11 @@ void OS_CSyslogD(SyslogConfig **syslog_config)
     /* Connect to syslog */
 
     for (s = 0; syslog_config[s]; s++) {
+        if (syslog_config[s]->output) {
+            csyslog_output_connect(syslog_config[s]);
+            continue;
+        }
+
         syslog_config[s]->socket = OS_ConnectUDP(syslog_config[s]->port, syslog_config[s]->server, 0);
 
         if (syslog_config[s]->socket < 0) {
@@ -120,6 +125,9 @@ void OS_CSyslogD(SyslogConfig **syslog_config)
             }
         }
 
+        /* Batch the TCP and TLS writes, unless no alert is coming */
+        csyslog_output_flush(syslog_config, !al_data && !json_data);
+
         /* Clear the memory */
 
         if (al_data) {
@@ -37,6 +37,22 @@ int OS_Alert_SendSyslog(alert_data *al_data, const SyslogConfig *syslog_config);
  */
 int OS_Alert_SendSyslog_JSON(cJSON *json_data, const SyslogConfig *syslog_config);
 
+/* Allocate the buffers of the TCP and TLS transports, before the chroot
+ * Returns 0 on success or -1 on error
+ */
+int csyslog_output_setup(SyslogConfig **syslog_config);
+
+/* Connect a TCP or TLS transport, unless it's waiting to retry
+ * Returns 0 on success or -1 on error
+ */
+int csyslog_output_connect(SyslogConfig *syslog_config);
+
+/* Send a message via UDP, or buffer it for TCP and TLS */
+void csyslog_send(const SyslogConfig *syslog_config, const char *msg, size_t length);
+
+/* Write the buffered messages of the TCP and TLS transports */
+void csyslog_output_flush(SyslogConfig **syslog_config, int idle);
+
 /* Database inserting main function */
 void OS_CSyslogD(SyslogConfig **syslog_config) __attribute__((noreturn));
 
@@ -146,6 +146,11 @@ int main(int argc, char **argv)
         exit(0);
     }
 
+    /* The certificates are read before the chroot */
+    if (csyslog_output_setup(syslog_config) < 0) {
+        merror_exit(CONFIG_ERROR, cfg);
+    }
+
     /* Privilege separation */
     if (Privsep_SetGroup(gid) < 0) {
         merror_exit(SETGID_ERROR, group, errno, strerror(errno));
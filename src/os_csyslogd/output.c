@@ -0,0 +1,327 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "csyslogd.h"
+#include "os_net/os_net.h"
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#define CSYSLOG_RETRY_MIN 1         /* Seconds before the first reconnection */
+#define CSYSLOG_RETRY_MAX 60        /* Maximum seconds between reconnections */
+#define CSYSLOG_TLS_TIMEOUT 10      /* Seconds to complete the TLS handshake */
+
+/* Messages framed as "<length> <message>", waiting to be written */
+struct csyslog_output {
+    char *data;
+    size_t size;
+    size_t length;                  /* Bytes in the buffer */
+    size_t head;                    /* Start of the first frame not fully written */
+    size_t sent;                    /* Bytes written */
+    struct timespec since;          /* When the unsent frames started to wait */
+    time_t retry;                   /* Time of the next connection attempt */
+    int backoff;
+    unsigned long dropped;
+    SSL_CTX *ctx;
+    SSL *ssl;
+};
+
+static size_t output_batch;
+static long output_flush_interval;
+
+static void csyslog_output_close(SyslogConfig *config);
+static void csyslog_output_advance(csyslog_output *output);
+static size_t csyslog_output_frame(const csyslog_output *output, size_t pos);
+
+
+/* Allocate the buffers of the stream transports, and load their certificates.
+ * It must run before the chroot.
+ * Returns 0 on success or -1 on error
+ */
+int csyslog_output_setup(SyslogConfig **syslog_config)
+{
+    size_t size;
+    int s;
+
+    size = (size_t)getDefine_Int("csyslogd", "buffer_size", 16, 65536) * 1024;
+    output_batch = (size_t)getDefine_Int("csyslogd", "batch_size", 1, 1024) * 1024;
+    output_flush_interval = getDefine_Int("csyslogd", "flush_interval", 0, 10000);
+
+    for (s = 0; syslog_config[s]; s++) {
+        if (syslog_config[s]->protocol == CSYSLOG_UDP) {
+            continue;
+        }
+
+        csyslog_output *output;
+        os_calloc(1, sizeof(csyslog_output), output);
+        os_malloc(size, output->data);
+        output->size = size;
+        syslog_config[s]->output = output;
+        syslog_config[s]->socket = -1;
+
+        if (syslog_config[s]->protocol != CSYSLOG_TLS) {
+            continue;
+        }
+
+        SSL_library_init();
+        SSL_load_error_strings();
+
+        if (output->ctx = SSL_CTX_new(TLS_client_method()), !output->ctx) {
+            merror("Could not create the TLS context for '%s'.", syslog_config[s]->server);
+            return -1;
+        }
+
+        /* RFC 5425 asks for TLS 1.2 or later */
+        SSL_CTX_set_options(output->ctx, SSL_OP_NO_SSLv3 | SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1);
+        SSL_CTX_set_mode(output->ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+        /* If a CA certificate has been specified then load it and verify the peer */
+        if (syslog_config[s]->ca_file) {
+            if (SSL_CTX_load_verify_locations(output->ctx, syslog_config[s]->ca_file, NULL) != 1) {
+                merror("Unable to read CA certificate file \"%s\"", syslog_config[s]->ca_file);
+                return -1;
+            }
+
+            SSL_CTX_set_verify(output->ctx, SSL_VERIFY_PEER, NULL);
+        } else {
+            mwarn("The certificate of syslog server '%s' will not be verified. Set <ca_file> to verify it.", syslog_config[s]->server);
+        }
+    }
+
+    return 0;
+}
+
+/* Connect a stream transport, unless it is waiting to retry
+ * Returns 0 on success or -1 on error
+ */
+int csyslog_output_connect(SyslogConfig *syslog_config)
+{
+    csyslog_output *output = syslog_config->output;
+    const char *protocol = syslog_config->protocol == CSYSLOG_TLS ? "TLS" : "TCP";
+    time_t now = time(NULL);
+
+    if (now < output->retry) {
+        return -1;
+    }
+
+    if (syslog_config->socket = OS_ConnectTCP(syslog_config->port, syslog_config->server, 0), syslog_config->socket < 0) {
+        if (!output->backoff) {
+            merror(CONNS_ERROR, syslog_config->server, strerror(errno));
+        }
+
+        goto fail;
+    }
+
+    if (syslog_config->protocol == CSYSLOG_TLS) {
+        output->ssl = SSL_new(output->ctx);
+        SSL_set_fd(output->ssl, syslog_config->socket);
+        /* Check the certificate against the IP address or the name of the server */
+        if (!X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(output->ssl), syslog_config->server)) {
+            SSL_set_tlsext_host_name(output->ssl, syslog_config->server);
+            X509_VERIFY_PARAM_set1_host(SSL_get0_param(output->ssl), syslog_config->server, 0);
+        }
+
+        /* The handshake is blocking, but bounded */
+        OS_SetSendTimeout(syslog_config->socket, CSYSLOG_TLS_TIMEOUT);
+        OS_SetRecvTimeout(syslog_config->socket, CSYSLOG_TLS_TIMEOUT, 0);
+
+        if (SSL_connect(output->ssl) != 1) {
+            if (!output->backoff) {
+                merror("TLS handshake with '%s:%u' failed: %s", syslog_config->server, syslog_config->port, ERR_reason_error_string(ERR_get_error()));
+            }
+
+            ERR_clear_error();
+            goto fail;
+        }
+    }
+
+    fcntl(syslog_config->socket, F_SETFL, fcntl(syslog_config->socket, F_GETFL, 0) | O_NONBLOCK);
+
+    minfo("Forwarding alerts via syslog to: '%s:%d' (%s).", syslog_config->server, syslog_config->port, protocol);
+    output->backoff = 0;
+    return 0;
+
+fail:
+    if (output->ssl) {
+        SSL_free(output->ssl);
+        output->ssl = NULL;
+    }
+
+    if (syslog_config->socket >= 0) {
+        close(syslog_config->socket);
+        syslog_config->socket = -1;
+    }
+
+    output->backoff = output->backoff ? output->backoff * 2 : CSYSLOG_RETRY_MIN;
+
+    if (output->backoff > CSYSLOG_RETRY_MAX) {
+        output->backoff = CSYSLOG_RETRY_MAX;
+    }
+
+    mdebug1("Connecting again to '%s:%u' in %d seconds.", syslog_config->server, syslog_config->port, output->backoff);
+    output->retry = now + output->backoff;
+    return -1;
+}
+
+/* Send a message to a syslog server: UDP sends a datagram, TCP and TLS buffer a frame */
+void csyslog_send(const SyslogConfig *syslog_config, const char *msg, size_t length)
+{
+    csyslog_output *output = syslog_config->output;
+    char header[32];
+    size_t header_length;
+
+    if (!output) {
+        OS_SendUDPbySize(syslog_config->socket, length, msg);
+        return;
+    }
+
+    header_length = snprintf(header, sizeof(header), "%zu ", length);
+
+    if (output->length + header_length + length > output->size && output->head) {
+        memmove(output->data, output->data + output->head, output->length - output->head);
+        output->length -= output->head;
+        output->sent -= output->head;
+        output->head = 0;
+    }
+
+    if (output->length + header_length + length > output->size) {
+        if (!output->dropped++) {
+            mwarn("Syslog buffer of '%s:%u' is full. Dropping alerts.", syslog_config->server, syslog_config->port);
+        }
+
+        return;
+    }
+
+    if (output->dropped) {
+        minfo("Syslog buffer of '%s:%u' has room again. %lu alerts were dropped.", syslog_config->server, syslog_config->port, output->dropped);
+        output->dropped = 0;
+    }
+
+    if (output->head == output->length) {
+        gettime(&output->since);
+    }
+
+    memcpy(output->data + output->length, header, header_length);
+    memcpy(output->data + output->length + header_length, msg, length);
+    output->length += header_length + length;
+}
+
+/* Write the buffered frames in large writes: once a batch is full, once
+ * they have waited for the flush interval, or when there are no more alerts.
+ */
+void csyslog_output_flush(SyslogConfig **syslog_config, int idle)
+{
+    struct timespec now;
+    csyslog_output *output;
+    ssize_t n;
+    int s;
+
+    gettime(&now);
+
+    for (s = 0; syslog_config[s]; s++) {
+        if (output = syslog_config[s]->output, !output || output->head == output->length) {
+            continue;
+        }
+
+        if (!idle && output->length - output->head < output_batch && time_diff(&output->since, &now) * 1000 < output_flush_interval) {
+            continue;
+        }
+
+        if (syslog_config[s]->socket < 0 && csyslog_output_connect(syslog_config[s]) < 0) {
+            continue;
+        }
+
+        while (output->sent < output->length) {
+            if (output->ssl) {
+                n = SSL_write(output->ssl, output->data + output->sent, output->length - output->sent);
+
+                if (n <= 0) {
+                    int error = SSL_get_error(output->ssl, n);
+
+                    if (error != SSL_ERROR_WANT_WRITE && error != SSL_ERROR_WANT_READ) {
+                        merror("Unable to send alerts to '%s:%u': %s", syslog_config[s]->server, syslog_config[s]->port, ERR_reason_error_string(ERR_get_error()));
+                        ERR_clear_error();
+                        csyslog_output_close(syslog_config[s]);
+                    }
+
+                    break;
+                }
+            } else {
+                n = send(syslog_config[s]->socket, output->data + output->sent, output->length - output->sent, MSG_NOSIGNAL);
+
+                if (n < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                        merror("Unable to send alerts to '%s:%u': %s", syslog_config[s]->server, syslog_config[s]->port, strerror(errno));
+                        csyslog_output_close(syslog_config[s]);
+                    }
+
+                    break;
+                }
+            }
+
+            output->sent += n;
+        }
+
+        csyslog_output_advance(output);
+
+        if (output->head == output->length) {
+            output->length = output->head = output->sent = 0;
+        } else {
+            /* The server is slow: wait for another interval */
+            output->since = now;
+        }
+    }
+}
+
+/* Drop a connection. A frame written in part can't be completed on the next one. */
+static void csyslog_output_close(SyslogConfig *syslog_config)
+{
+    csyslog_output *output = syslog_config->output;
+
+    if (output->ssl) {
+        SSL_free(output->ssl);
+        output->ssl = NULL;
+    }
+
+    close(syslog_config->socket);
+    syslog_config->socket = -1;
+
+    csyslog_output_advance(output);
+
+    if (output->sent > output->head) {
+        output->head = csyslog_output_frame(output, output->head);
+    }
+
+    output->sent = output->head;
+    output->backoff = CSYSLOG_RETRY_MIN;
+    output->retry = time(NULL) + output->backoff;
+}
+
+/* Move the head past the frames fully written */
+static void csyslog_output_advance(csyslog_output *output)
+{
+    size_t end;
+
+    while (output->head < output->length && (end = csyslog_output_frame(output, output->head), end <= output->sent)) {
+        output->head = end;
+    }
+}
+
+/* End of the frame that starts at a position */
+static size_t csyslog_output_frame(const csyslog_output *output, size_t pos)
+{
+    size_t length = 0;
+
+    for (; output->data[pos] != ' '; pos++) {
+        length = length * 10 + output->data[pos] - '0';
+    }
+
+    return pos + 1 + length;
+}
@@ -13,9 +13,30 @@
 #include "config/dbd-config.h"
 #include "rules_op.h"
 
+#define MYSQL_ALERT_INSERT "INSERT INTO " \
+    "alert(server_id,rule_id,level,timestamp,location_id,src_ip,src_port,dst_ip,dst_port,alertid,user,full_log,tld) " \
+    "VALUES "
+
+#define PGSQL_ALERT_INSERT "INSERT INTO " \
+    "alert(server_id,rule_id,level,timestamp,location_id,src_ip,src_port,dst_ip,dst_port,alertid,\"user\",full_log) " \
+    "VALUES "
+
+/* Alerts waiting to be inserted: a multi-row INSERT, built as they come */
+static struct {
+    char *query;
+    size_t length;
+    size_t size;
+    size_t prefix;              /* Length of "INSERT INTO ... VALUES " */
+    size_t *rows;               /* Start of each row */
+    unsigned int count;
+    struct timespec since;      /* When the first row was added */
+} batch;
+
 /* Prototypes */
 static int __DBSelectLocation(const char *location, const DBConfig *db_config) __attribute__((nonnull));
 static int __DBInsertLocation(const char *location, const DBConfig *db_config) __attribute__((nonnull));
+static void __DBAddRow(const DBConfig *db_config, const char *row) __attribute__((nonnull));
+static void __DBInsertRows(DBConfig *db_config) __attribute__((nonnull));
 
 
 /* Select the maximum ID from the alert table
@@ -83,7 +104,7 @@ static int __DBInsertLocation(const char *location, const DBConfig *db_config)
     return (0);
 }
 
-/* Insert alert into to the db
+/* Add an alert to the batch
  * Returns 1 on success or 0 on error
  */
 int OS_Alert_InsertDB(const alert_data *al_data, DBConfig *db_config)
@@ -92,14 +113,13 @@ int OS_Alert_InsertDB(const alert_data *al_data, DBConfig *db_config)
     unsigned int s_ip = 0, d_ip = 0, location_id = 0;
     unsigned short s_port = 0, d_port = 0;
     int *loc_id;
-    char sql_query[OS_SIZE_8192 + 1];
+    char sql_row[OS_SIZE_8192 + 1];
     char *fulllog = NULL;
     char user[OS_SIZE_128];
 
     /* Clear the memory before insert */
-    sql_query[0] = '\0';
-    sql_query[OS_SIZE_8192] = '\0';
-
+    sql_row[0] = '\0';
+    sql_row[OS_SIZE_8192] = '\0';
     /* Converting srcip to int */
     if(al_data->srcip) {
         struct in_addr net;
@@ -186,13 +206,11 @@ int OS_Alert_InsertDB(const alert_data *al_data, DBConfig *db_config)
         fulllog[7456] = '\0';
     }
 
-    /* Generate final SQL */
+    /* Generate the row of the alert */
     switch (db_config->db_type) {
       case MYSQLDB:
-        snprintf(sql_query, OS_SIZE_8192,
-                 "INSERT INTO "
-                 "alert(server_id,rule_id,level,timestamp,location_id,src_ip,src_port,dst_ip,dst_port,alertid,user,full_log,tld) "
-                 "VALUES ('%u', '%u','%u','%u', '%u', '%lu', '%u', '%lu', '%u', '%s', %s, '%s','%.2s')",
+        snprintf(sql_row, OS_SIZE_8192,
+                 "('%u', '%u','%u','%u', '%u', '%lu', '%u', '%lu', '%u', '%s', %s, '%s','%.2s')",
                  db_config->server_id, al_data->rule,
                  al_data->level,
                  (unsigned int)time(0), *loc_id,
@@ -203,10 +221,8 @@ int OS_Alert_InsertDB(const alert_data *al_data, DBConfig *db_config)
 	break;
 
       case POSTGDB:
-        snprintf(sql_query, OS_SIZE_8192,
-                 "INSERT INTO "
-                 "alert(server_id,rule_id,level,timestamp,location_id,src_ip,src_port,dst_ip,dst_port,alertid,\"user\",full_log) "
-                 "VALUES ('%u', '%u','%u','%u', '%u', '%s', '%u', '%s', '%u', '%s', %s, '%s')",
+        snprintf(sql_row, OS_SIZE_8192,
+                 "('%u', '%u','%u','%u', '%u', '%s', '%u', '%s', '%u', '%s', %s, '%s')",
                  db_config->server_id, al_data->rule,
                  al_data->level,
                  (unsigned int)time(0), *loc_id,
@@ -220,11 +236,105 @@ int OS_Alert_InsertDB(const alert_data *al_data, DBConfig *db_config)
     free(fulllog);
     fulllog = NULL;
 
-    /* Insert into the db */
-    if (!osdb_query_insert(db_config->conn, sql_query)) {
-        merror(DB_GENERROR);
-    }
+    __DBAddRow(db_config, sql_row);
 
     db_config->alert_id++;
     return (1);
 }
+
+/* Insert the batch once it's full, once it has waited for the flush interval,
+ * or when there are no more alerts.
+ * Returns the number of alerts still waiting
+ */
+unsigned int OS_Alert_FlushDB(DBConfig *db_config, int idle)
+{
+    struct timespec now;
+
+    if (!batch.count) {
+        return 0;
+    }
+
+    gettime(&now);
+
+    if (idle || batch.count >= db_config->batch_rows || batch.length >= DBD_BATCH_BYTES ||
+        time_diff(&batch.since, &now) * 1000 >= db_config->flush_interval) {
+        __DBInsertRows(db_config);
+    }
+
+    return batch.count;
+}
+
+/* Append a row to the batch */
+static void __DBAddRow(const DBConfig *db_config, const char *row)
+{
+    size_t length = strlen(row);
+
+    if (!batch.count) {
+        const char *prefix = db_config->db_type == MYSQLDB ? MYSQL_ALERT_INSERT : PGSQL_ALERT_INSERT;
+
+        batch.prefix = strlen(prefix);
+
+        if (!batch.query) {
+            batch.size = batch.prefix + OS_SIZE_65536;
+            os_malloc(batch.size, batch.query);
+            os_calloc(db_config->batch_rows, sizeof(size_t), batch.rows);
+        }
+
+        memcpy(batch.query, prefix, batch.prefix + 1);
+        batch.length = batch.prefix;
+        gettime(&batch.since);
+    }
+
+    /* The separator and the final NUL */
+    if (batch.length + length + 2 > batch.size) {
+        batch.size = batch.length + length + 2 + OS_SIZE_65536;
+        os_realloc(batch.query, batch.size, batch.query);
+    }
+
+    if (batch.count) {
+        batch.query[batch.length++] = ',';
+    }
+
+    batch.rows[batch.count++] = batch.length;
+    memcpy(batch.query + batch.length, row, length + 1);
+    batch.length += length;
+}
+
+/* Insert the batch in a single statement. If it's rejected, insert the rows one by one
+ * so that a bad row doesn't take the others with it.
+ */
+static void __DBInsertRows(DBConfig *db_config)
+{
+    unsigned int i;
+
+    if (!osdb_query_insert(db_config->conn, batch.query)) {
+        if (batch.count == 1) {
+            merror(DB_GENERROR);
+        } else {
+            mdebug1("Unable to insert %u alerts at once. Inserting them one by one.", batch.count);
+
+            for (i = 0; i < batch.count; i++) {
+                size_t end = i + 1 < batch.count ? batch.rows[i + 1] - 1 : batch.length;
+                size_t length = end - batch.rows[i];
+                char sql_query[batch.prefix + length + 1];
+
+                memcpy(sql_query, batch.query, batch.prefix);
+                memcpy(sql_query + batch.prefix, batch.query + batch.rows[i], length);
+                sql_query[batch.prefix + length] = '\0';
+
+                if (!osdb_query_insert(db_config->conn, sql_query)) {
+                    merror(DB_GENERROR);
+                }
+            }
+        }
+    }
+
+    batch.count = 0;
+    batch.length = 0;
+
+    /* Don't keep a large buffer for an unusual batch */
+    if (batch.size > DBD_BATCH_BYTES * 2) {
+        batch.size = batch.prefix + OS_SIZE_65536;
+        os_realloc(batch.query, batch.size, batch.query);
+    }
+}
@@ -25,6 +25,7 @@ void OS_DBD(DBConfig *db_config)
     file_queue *fileq;
     alert_data *al_data;
     struct tm tm_result = { .tm_sec = 0 };
+    unsigned int pending = 0;
 
     /* Get current time before starting */
     tm = time(NULL);
@@ -43,14 +44,17 @@ void OS_DBD(DBConfig *db_config)
         tm = time(NULL);
         localtime_r(&tm, &tm_result);
 
-        /* Get message if available (timeout of 5 seconds) */
-        al_data = Read_FileMon(fileq, &tm_result, 5);
+        /* Get message if available (timeout of 5 seconds, or 1 while alerts wait) */
+        al_data = Read_FileMon(fileq, &tm_result, pending ? 1 : 5);
         if (!al_data) {
+            /* No more alerts: insert the waiting ones now */
+            pending = OS_Alert_FlushDB(db_config, 1);
             continue;
         }
 
-        /* Insert into the db */
+        /* Add to the batch, and insert it once it's full or late */
         OS_Alert_InsertDB(al_data, db_config);
+        pending = OS_Alert_FlushDB(db_config, 0);
 
         /* Clear the memory */
         FreeAlertData(al_data);
@@ -15,6 +15,8 @@
 #include "db_op.h"
 #include "config/dbd-config.h"
 
+#define DBD_BATCH_BYTES 262144  /* Insert the batch once its statement takes this size */
+
 /** Prototypes **/
 
 /* Read database config */
@@ -29,9 +31,14 @@ int OS_InsertRulesDB(DBConfig *db_config) __attribute__((nonnull));
 /* Get maximum ID */
 int OS_SelectMaxID(const DBConfig *db_config) __attribute__((nonnull));
 
-/* Insert alerts in to the database */
+/* Add an alert to the batch of inserts */
 int OS_Alert_InsertDB(const alert_data *al_data, DBConfig *db_config) __attribute__((nonnull));
 
+/* Insert the batch if it's full, late, or idle is set
+ * Returns the number of alerts still waiting
+ */
+unsigned int OS_Alert_FlushDB(DBConfig *db_config, int idle) __attribute__((nonnull));
+
 /* Database inserting main function */
 void OS_DBD(DBConfig *db_config) __attribute__((nonnull)) __attribute__((noreturn));
 
@@ -193,6 +193,12 @@ int main(int argc, char **argv)
     db_config.maxreconnect = (unsigned int) getDefine_Int("dbd",
                              "reconnect_attempts", 1, 9999);
 
+    /* Get the size and the delay of the batches of alerts */
+    db_config.batch_rows = (unsigned int) getDefine_Int("dbd",
+                           "batch_size", 1, 1000);
+    db_config.flush_interval = getDefine_Int("dbd",
+                               "flush_interval", 0, 60000);
+
     /* Connect to the database */
     d = 0;
     while (d <= (db_config.maxreconnect * 10)) {
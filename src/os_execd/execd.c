@@ -26,12 +26,17 @@ static void help_execd(void) __attribute__((noreturn));
 static void execd_shutdown(int sig) __attribute__((noreturn));
 static void ExecdStart(int q) __attribute__((noreturn));
 static int CheckManagerConfiguration(char ** output);
+static void timeout_key(char *key, size_t size, char *const *command);
 
 /* Global variables */
 static OSList *timeout_list;
 static OSListNode *timeout_node;
+static OSHash *timeout_hash;        /* Timeout entries by source IP and command */
 static OSHash *repeated_hash;
 
+/* Time at which a timeout entry is due */
+#define TIMEOUT_DEADLINE(entry) ((entry)->time_of_addition + (entry)->time_to_block + 1)
+
 
 /* Print help statement */
 static void help_execd()
@@ -239,6 +244,8 @@ static void ExecdStart(int q)
 {
     int i, childcount = 0;
     time_t curr_time;
+    time_t next_timeout = 0;    /* Earliest deadline in the timeout list, or 0 if it's empty */
+    char tkey[OS_SIZE_1024];
 
     char buffer[OS_MAXSTR + 1];
     char *tmp_msg = NULL;
@@ -270,6 +277,10 @@ static void ExecdStart(int q)
         merror_exit(LIST_ERROR);
     }
 
+    if (timeout_hash = OSHash_Create(), !timeout_hash) {
+        merror_exit("At ExecdStart(): OSHash_Create() failed");
+    }
+
     if (repeated_offenders_timeout[0] != 0) {
         repeated_hash = OSHash_Create();
     } else {
@@ -306,7 +317,12 @@ static void ExecdStart(int q)
         curr_time = time(0);
 
         /* Check if there is any timed out command to execute */
-        timeout_node = OSList_GetFirstNode(timeout_list);
+        timeout_node = next_timeout && curr_time >= next_timeout ? OSList_GetFirstNode(timeout_list) : NULL;
+
+        if (timeout_node) {
+            next_timeout = 0;
+        }
+
         while (timeout_node) {
             timeout_data *list_entry;
 
@@ -323,6 +339,14 @@ static void ExecdStart(int q)
 
                 ExecCmd(list_entry->command);
 
+                if (list_entry->command[2] && list_entry->command[3]) {
+                    timeout_key(tkey, sizeof(tkey), list_entry->command);
+
+                    if (OSHash_Get(timeout_hash, tkey) == list_entry) {
+                        OSHash_Delete(timeout_hash, tkey);
+                    }
+                }
+
                 /* Delete current node - already sets the pointer to next */
                 OSList_DeleteCurrentlyNode(timeout_list);
                 timeout_node = OSList_GetCurrentlyNode(timeout_list);
@@ -332,6 +356,10 @@ static void ExecdStart(int q)
 
                 childcount++;
             } else {
+                if (!next_timeout || TIMEOUT_DEADLINE(list_entry) < next_timeout) {
+                    next_timeout = TIMEOUT_DEADLINE(list_entry);
+                }
+
                 timeout_node = OSList_GetNextNode(timeout_list);
             }
         }
@@ -519,62 +547,60 @@ static void ExecdStart(int q)
             }
 
             added_before = 0;
+            timeout_key(tkey, sizeof(tkey), timeout_args);
+
             /* Check if this command was already executed */
-            timeout_node = OSList_GetFirstNode(timeout_list);
-            while (timeout_node) {
-                timeout_data *list_entry;
-
-                list_entry = (timeout_data *)timeout_node->data;
-                if ((strcmp(list_entry->command[3], timeout_args[3]) == 0) &&
-                        (strcmp(list_entry->command[0], timeout_args[0]) == 0)) {
-                    /* Means we executed this command before
-                    * and we don't need to add it again
-                    */
-                    added_before = 1;
-
-                    /* Update the timeout */
-                    mdebug1("Command already received, updating time of addition to now.");
-                    list_entry->time_of_addition = curr_time;
-
-                    if (repeated_offenders_timeout[0] != 0 &&
-                            repeated_hash != NULL &&
-                            strncmp(timeout_args[3], "-", 1) != 0) {
-                        char *ntimes = NULL;
-                        char rkey[256];
-                        rkey[255] = '\0';
-                        snprintf(rkey, 255, "%s%s", list_entry->command[0],
-                                timeout_args[3]);
-
-                        if ((ntimes = (char *) OSHash_Get(repeated_hash, rkey))) {
-                            int ntimes_int = 0;
-                            int i2 = 0;
-                            int new_timeout = 0;
-                            ntimes_int = atoi(ntimes);
-                            while (repeated_offenders_timeout[i2] != 0) {
-                                i2++;
-                            }
-                            if (ntimes_int >= i2) {
-                                new_timeout = repeated_offenders_timeout[i2 - 1] * 60;
-                            } else {
-                                free(ntimes);       /* In hash_op.c, data belongs to caller */
-                                os_calloc(16, sizeof(char), ntimes);
-                                new_timeout = repeated_offenders_timeout[ntimes_int] * 60;
-                                ntimes_int++;
-                                snprintf(ntimes, 16, "%d", ntimes_int);
-                                if (OSHash_Update(repeated_hash, rkey, ntimes) != 1) {
-                                    free(ntimes);
-                                    merror("At ExecdStart: OSHash_Update() failed");
-                                }
+            timeout_data *list_entry = OSHash_Get(timeout_hash, tkey);
+
+            if (list_entry) {
+                /* Means we executed this command before
+                * and we don't need to add it again
+                */
+                added_before = 1;
+
+                /* Update the timeout */
+                mdebug1("Command already received, updating time of addition to now.");
+                list_entry->time_of_addition = curr_time;
+
+                if (repeated_offenders_timeout[0] != 0 &&
+                        repeated_hash != NULL &&
+                        strncmp(timeout_args[3], "-", 1) != 0) {
+                    char *ntimes = NULL;
+                    char rkey[256];
+                    rkey[255] = '\0';
+                    snprintf(rkey, 255, "%s%s", list_entry->command[0],
+                            timeout_args[3]);
+
+                    if ((ntimes = (char *) OSHash_Get(repeated_hash, rkey))) {
+                        int ntimes_int = 0;
+                        int i2 = 0;
+                        int new_timeout = 0;
+                        ntimes_int = atoi(ntimes);
+                        while (repeated_offenders_timeout[i2] != 0) {
+                            i2++;
+                        }
+                        if (ntimes_int >= i2) {
+                            new_timeout = repeated_offenders_timeout[i2 - 1] * 60;
+                        } else {
+                            free(ntimes);       /* In hash_op.c, data belongs to caller */
+                            os_calloc(16, sizeof(char), ntimes);
+                            new_timeout = repeated_offenders_timeout[ntimes_int] * 60;
+                            ntimes_int++;
+                            snprintf(ntimes, 16, "%d", ntimes_int);
+                            if (OSHash_Update(repeated_hash, rkey, ntimes) != 1) {
+                                free(ntimes);
+                                merror("At ExecdStart: OSHash_Update() failed");
                             }
-                            mdebug1("Repeated offender. Setting timeout to '%ds'", new_timeout);
-                            list_entry->time_to_block = new_timeout;
                         }
+                        mdebug1("Repeated offender. Setting timeout to '%ds'", new_timeout);
+                        list_entry->time_to_block = new_timeout;
                     }
-                    break;
                 }
 
-                /* Continue with the next entry in timeout list*/
-                timeout_node = OSList_GetNextNode(timeout_list);
+                /* The new timeout may be shorter */
+                if (!next_timeout || TIMEOUT_DEADLINE(list_entry) < next_timeout) {
+                    next_timeout = TIMEOUT_DEADLINE(list_entry);
+                }
             }
         }
 
@@ -643,6 +669,16 @@ static void ExecdStart(int q)
                 if (!OSList_AddData(timeout_list, timeout_entry)) {
                     merror(LIST_ADD_ERROR);
                     FreeTimeoutEntry(timeout_entry);
+                } else {
+                    /* Keep the first entry of a key, as the list scan did */
+                    if (timeout_args[2] && timeout_args[3]) {
+                        timeout_key(tkey, sizeof(tkey), timeout_args);
+                        OSHash_Add(timeout_hash, tkey, timeout_entry);
+                    }
+
+                    if (!next_timeout || TIMEOUT_DEADLINE(timeout_entry) < next_timeout) {
+                        next_timeout = TIMEOUT_DEADLINE(timeout_entry);
+                    }
                 }
             } else {
                 /* If no timeout, we still need to free it in here */
@@ -678,6 +714,11 @@ static void ExecdStart(int q)
     }
 }
 
+/* Key of a timeout entry: the source IP, that has no spaces, and the command */
+static void timeout_key(char *key, size_t size, char *const *command) {
+    snprintf(key, size, "%s %s", command[3], command[0]);
+}
+
 static int CheckManagerConfiguration(char ** output) {
     int ret_val;
     int result_code;
@@ -651,6 +651,8 @@ void * wcom_main(__attribute__((unused)) void * arg) {
     char *response = NULL;
     ssize_t length;
     fd_set fdset;
+    fd_set peers;
+    int maxfd;
 
     mdebug1("Local requests thread ready");
 
@@ -659,13 +661,16 @@ void * wcom_main(__attribute__((unused)) void * arg) {
         return NULL;
     }
 
+    FD_ZERO(&peers);
+    maxfd = sock;
+
     while (1) {
 
-        // Wait for socket
-        FD_ZERO(&fdset);
+        // Wait for a new client, or for a request from a client that kept its connection
+        fdset = peers;
         FD_SET(sock, &fdset);
 
-        switch (select(sock + 1, &fdset, NULL, NULL, NULL)) {
+        switch (select(maxfd + 1, &fdset, NULL, NULL, NULL)) {
         case -1:
             if (errno != EINTR) {
                 merror_exit("At wcom_main(): select(): %s", strerror(errno));
@@ -677,41 +682,59 @@ void * wcom_main(__attribute__((unused)) void * arg) {
             continue;
         }
 
-        if (peer = accept(sock, NULL, NULL), peer < 0) {
-            if (errno != EINTR) {
-                merror("At wcom_main(): accept(): %s", strerror(errno));
+        if (FD_ISSET(sock, &fdset)) {
+            if (peer = accept(sock, NULL, NULL), peer < 0) {
+                if (errno != EINTR) {
+                    merror("At wcom_main(): accept(): %s", strerror(errno));
+                }
+            } else if (peer >= FD_SETSIZE) {
+                merror("At wcom_main(): Too many connections.");
+                close(peer);
+            } else {
+                FD_SET(peer, &peers);
+                maxfd = peer > maxfd ? peer : maxfd;
             }
-
-            continue;
         }
 
-        os_calloc(OS_MAXSTR, sizeof(char), buffer);
-        switch (length = OS_RecvSecureTCP(peer, buffer,OS_MAXSTR), length) {
-        case OS_SOCKTERR:
-            merror("At wcom_main(): OS_RecvSecureTCP(): response size is bigger than expected");
-            break;
+        for (peer = 0; peer <= maxfd; peer++) {
+            if (peer == sock || !FD_ISSET(peer, &fdset)) {
+                continue;
+            }
 
-        case -1:
-            merror("At wcom_main(): OS_RecvSecureTCP(): %s", strerror(errno));
-            break;
+            os_calloc(OS_MAXSTR, sizeof(char), buffer);
+            switch (length = OS_RecvSecureTCP(peer, buffer,OS_MAXSTR), length) {
+            case OS_SOCKTERR:
+                merror("At wcom_main(): OS_RecvSecureTCP(): response size is bigger than expected");
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
 
-        case 0:
-            mdebug1("Empty message from local client.");
-            close(peer);
-            break;
+            case -1:
+                merror("At wcom_main(): OS_RecvSecureTCP(): %s", strerror(errno));
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
 
-        case OS_MAXLEN:
-            merror("Received message > %i", MAX_DYN_STR);
-            close(peer);
-            break;
+            case 0:
+                // The client closed the connection
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            case OS_MAXLEN:
+                merror("Received message > %i", MAX_DYN_STR);
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
 
-        default:
-            length = wcom_dispatch(buffer, length, &response);
-            OS_SendSecureTCP(peer, length, response);
-            os_free(response);
-            close(peer);
+            default:
+                // Keep the connection open for the next request
+                length = wcom_dispatch(buffer, length, &response);
+                OS_SendSecureTCP(peer, length, response);
+                os_free(response);
+            }
+            os_free(buffer);
         }
-        os_free(buffer);
     }
 
     mdebug1("Local server thread finished.");
@@ -58,6 +58,7 @@ int WinExecd_Start()
     int c;
     char *cfg = DEFAULTCPATH;
     winexec_queue = queue_init(OS_SIZE_128);
+    queue_metrics_register(winexec_queue, "winexec");
 
     /* Read config */
     if ((c = ExecdConfig(cfg)) < 0) {
@@ -13,14 +13,121 @@
 #include <external/cJSON/cJSON.h>
 #include "os_net/os_net.h"
 
+/* Integrations to send an alert to, one flag per integration */
+typedef struct integrator_filter_arg {
+    IntegratorConfig **config;
+    char *matched;
+} integrator_filter_arg;
+
+static int integrator_match(const IntegratorConfig *config, const jqueue_fields_t *fields);
+static int integrator_filter(const jqueue_fields_t *fields, void *arg);
+
+
+/* Check an alert against the options of an integration, before parsing it */
+static int integrator_match(const IntegratorConfig *config, const jqueue_fields_t *fields)
+{
+    if(config->enabled == 0)
+    {
+        mdebug2("skipping: integration disabled");
+        return 0;
+    }
+
+    /* Looking if location is set */
+    if(config->location)
+    {
+        if (!fields->has_location) {
+            return 0;
+        }
+        if(!OSMatch_Execute(fields->location, strlen(fields->location), config->location))
+        {
+            mdebug2("skipping: location doesn't match");
+            return 0;
+        }
+    }
+
+    /* Looking for the level */
+    if(config->level)
+    {
+        if (!fields->has_level) {
+            return 0;
+        }
+        if(fields->level < config->level)
+        {
+            mdebug2("skipping: alert level is too low");
+            return 0;
+        }
+    }
+
+    /* Looking for the group */
+    if(config->group)
+    {
+        int found = 0;
+        const char * group;
+        const char * end;
+
+        for (group = config->group; group && *group && !found; group = end ? end + 1 : NULL) {
+            end = strchr(group, ',');
+            found = jqueue_fields_group(fields, group, end ? (size_t)(end - group) : strlen(group));
+        }
+
+        if (!found) {
+            mdebug2("skipping: group doesn't match");
+            return 0;
+        }
+    }
+
+    /* Looking for the rule */
+    if(config->rule_id)
+    {
+        /* match any rule in array */
+        int id_i;
+
+        if (!fields->has_rule_id) {
+            mdebug2("skipping: alert does not containg rule id.");
+            return 0;
+        }
+
+        for (id_i = 0; config->rule_id[id_i]; id_i++) {
+            if (fields->rule_id == config->rule_id[id_i]) {
+                return 1;
+            }
+        }
+
+        /* skip integration if none are matched */
+        mdebug2("skipping: rule doesn't match");
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Mark the integrations that an alert goes to. The alert is only parsed if there is any. */
+static int integrator_filter(const jqueue_fields_t *fields, void *arg)
+{
+    integrator_filter_arg *filter = arg;
+    int found = 0;
+    int s;
+
+    /* If JSON does not contain rule block, continue*/
+    if (!fields->has_rule) {
+        mdebug2("skipping: Alert does not contain a rule block");
+        return 0;
+    }
+
+    for (s = 0; filter->config[s]; s++) {
+        filter->matched[s] = integrator_match(filter->config[s], fields);
+        found |= filter->matched[s];
+    }
+
+    return found;
+}
+
 
 void OS_IntegratorD(IntegratorConfig **integrator_config)
 {
     int s = 0;
     int tries = 0;
     int temp_file_created = 0;
-    unsigned int alert_level = 0;
-    unsigned int rule_id = 0;
     char integration_path[2048 + 1];
     char exec_tmp_file[2048 + 1];
     char exec_full_cmd[4096 + 1];
@@ -28,10 +135,9 @@ void OS_IntegratorD(IntegratorConfig **integrator_config)
 
     file_queue jfileq;
     cJSON *al_json = NULL;
-    cJSON *json_object;
     cJSON *json_field;
-    cJSON *location;
     cJSON *rule;
+    integrator_filter_arg filter = { integrator_config, NULL };
     cJSON *data;
 
     integration_path[2048] = 0;
@@ -114,135 +220,48 @@ void OS_IntegratorD(IntegratorConfig **integrator_config)
         {
             minfo("Enabling integration for: '%s'.",
                    integrator_config[s]->name);
+
+            if (integrator_config[s]->http = integrator_http_new(integrator_config[s]), integrator_config[s]->http) {
+                mdebug1("Integration '%s' is sent with the built-in HTTP client.", integrator_config[s]->name);
+            }
         }
         s++;
     }
 
+    os_calloc(s + 1, sizeof(char), filter.matched);
+
     /* Infinite loop reading the alerts and inserting them. */
     while(1)
     {
 
         /* Get JSON message if available (timeout of 5 seconds) */
         mdebug2("jqueue_next()");
-        al_json = jqueue_next(&jfileq);
+        al_json = jqueue_next_filtered(&jfileq, integrator_filter, &filter);
         if(!al_json)
             continue;
 
         mdebug1("sending new alert.");
         temp_file_created = 0;
 
-        /* If JSON does not contain rule block, continue*/
-        if (rule = cJSON_GetObjectItem(al_json, "rule"), !rule){
-                s++;
-                mdebug2("skipping: Alert does not contain a rule block");
-                continue;
+        rule = cJSON_GetObjectItem(al_json, "rule");
+
+        /* Built-in deliveries first, as the scripts' text format edits the alert */
+        for (s = 0; integrator_config[s]; s++) {
+            if (filter.matched[s] && integrator_config[s]->http) {
+                integrator_http_send(integrator_config[s], al_json);
+            }
         }
 
         /* Sending to the configured integrations */
         s = 0;
         while(integrator_config[s])
         {
-            if(integrator_config[s]->enabled == 0)
+            if(!filter.matched[s] || integrator_config[s]->http)
             {
                 s++;
-                mdebug2("skipping: integration disabled");
                 continue;
             }
 
-            /* Looking if location is set */
-            if(integrator_config[s]->location)
-            {
-
-                if (location = cJSON_GetObjectItem(al_json, "location"), !location) {
-                    s++; continue;
-                }
-                if(!OSMatch_Execute(location->valuestring,
-                                   strlen(location->valuestring),
-                                   integrator_config[s]->location))
-                {
-                    mdebug2("skipping: location doesn't match");
-                    s++; continue;
-                }
-            }
-
-            /* Looking for the level */
-            if(integrator_config[s]->level)
-            {
-                if (json_field = cJSON_GetObjectItem(rule,"level"), !json_field) {
-                    s++; continue;
-                }
-                alert_level = json_field->valueint;
-                if(alert_level < integrator_config[s]->level)
-                {
-                    mdebug2("skipping: alert level is too low");
-                    s++; continue;
-                }
-            }
-
-            /* Looking for the group */
-            if(integrator_config[s]->group)
-            {
-                int found = 0;
-                char * group;
-                char * end;
-
-                if (json_object = cJSON_GetObjectItem(rule,"groups"), json_object) {
-                    for (group = integrator_config[s]->group; group && *group && !found; group = end ? end + 1 : NULL) {
-                        if (end = strchr(group, ','), end) {
-                            *end = '\0';
-                        }
-
-                        cJSON_ArrayForEach(json_field, json_object) {
-                            if (strcmp(json_field->valuestring, group) == 0) {
-                                found++;
-                                break;
-                            }
-                        }
-
-                        if (end) {
-                            *end = ',';
-                        }
-                    }
-                }
-
-                if (!found) {
-                    mdebug2("skipping: group doesn't match");
-                    s++; continue;
-                }
-            }
-
-            /* Looking for the rule */
-            if(integrator_config[s]->rule_id)
-            {
-                /* match any rule in array */
-                int id_i = 0;
-                int rule_match = -1;
-
-                if (json_field = cJSON_GetObjectItem(rule,"id"), !json_field) {
-                    mdebug2("skipping: alert does not containg rule id.");
-                    s++; continue;
-                }
-                rule_id = atoi(json_field->valuestring);
-
-                while(integrator_config[s]->rule_id[id_i])
-                {
-                    if(rule_id == integrator_config[s]->rule_id[id_i])
-                    {
-                        rule_match = id_i;
-                        break;
-                    }
-
-                    id_i++;
-                }
-
-                /* skip integration if none are matched */
-                if(rule_match == -1)
-                {
-                    mdebug2("skipping: rule doesn't match");
-                    s++; continue;
-                }
-            }
-
             /* Create temp file once per alert. */
             if(temp_file_created == 0)
             {
@@ -27,9 +27,31 @@ extern IntegratorConfig **integrator_config;
 // Read config
 cJSON *getIntegratorConfig(void);
 
+/**
+ * @brief Set up the built-in HTTP delivery of an integration.
+ *
+ * The requests are sent by a thread of their own, that keeps the connections
+ * open between them. Slack alerts are sent in batches.
+ *
+ * @param config Integration.
+ * @return Delivery handle, or NULL if the integration must run its script.
+ */
+integrator_http * integrator_http_new(const IntegratorConfig * config);
+
+/**
+ * @brief Queue an alert for the built-in HTTP delivery of an integration.
+ *
+ * It waits if the queue is full.
+ *
+ * @param config Integration, with a delivery handle.
+ * @param alert Alert. It's not modified.
+ */
+void integrator_http_send(const IntegratorConfig * config, const cJSON * alert);
+
 // Com request thread dispatcher
 size_t intgcom_dispatch(char * command, char ** output);
 size_t intgcom_getconfig(const char * section, char ** output);
+size_t intgcom_getmetrics(char ** output);
 void * intgcom_main(__attribute__((unused)) void * arg);
 
 #endif /* INTEGRATORD_H */
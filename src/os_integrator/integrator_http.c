@@ -0,0 +1,423 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "integrator.h"
+#include <external/cJSON/cJSON.h>
+
+#define INTEGRATOR_HTTP_POP 64          /* Messages taken from the queue at once */
+#define INTEGRATOR_HTTP_WAIT 100        /* Milliseconds to wait for the sockets */
+#define PAGERDUTY_URL "https://events.pagerduty.com/generic/2010-04-15/create_event.json"
+
+typedef enum integrator_http_type {
+    INTEGRATOR_HTTP_SLACK,
+    INTEGRATOR_HTTP_PAGERDUTY
+} integrator_http_type;
+
+/* Destination of an integration. The batch is only used by the HTTP thread. */
+struct integrator_http {
+    const char * name;
+    const char * url;
+    integrator_http_type type;
+    cJSON * batch;                      ///< Slack attachments not sent yet
+    unsigned int batch_count;
+    struct timespec batch_time;         ///< When the first attachment was added
+    struct integrator_http * next;
+};
+
+/* Message formatted by the main thread */
+typedef struct integrator_http_msg {
+    integrator_http * target;
+    cJSON * payload;
+} integrator_http_msg;
+
+/* Request in progress */
+typedef struct integrator_http_transfer {
+    integrator_http * target;
+    char * body;
+    unsigned int alerts;
+    struct curl_slist * headers;
+    char error[CURL_ERROR_SIZE];
+} integrator_http_transfer;
+
+static int http_enabled = -1;
+static unsigned int http_batch;
+static long http_flush_interval;
+static long http_timeout;
+static unsigned int http_max_transfers;
+static unsigned int http_transfers;
+static integrator_http * http_targets;
+static w_queue_t * http_queue;
+static CURLM * http_multi;
+
+static int integrator_http_start(void);
+static void * integrator_http_main(void * arg);
+static void integrator_http_add(integrator_http_msg * msg);
+static void integrator_http_flush(void);
+static void integrator_http_post_batch(integrator_http * target);
+static void integrator_http_post(integrator_http * target, cJSON * payload, unsigned int alerts);
+static void integrator_http_reap(void);
+static size_t integrator_http_discard(char * data, size_t size, size_t nmemb, void * arg);
+static cJSON * integrator_http_slack(const cJSON * alert);
+static cJSON * integrator_http_pagerduty(const IntegratorConfig * config, const cJSON * alert);
+
+integrator_http * integrator_http_new(const IntegratorConfig * config) {
+    integrator_http * http;
+    integrator_http_type type;
+
+    if (strcmp(config->name, "slack") == 0) {
+        type = INTEGRATOR_HTTP_SLACK;
+    } else if (strcmp(config->name, "pagerduty") == 0) {
+        type = INTEGRATOR_HTTP_PAGERDUTY;
+    } else {
+        return NULL;
+    }
+
+    if (http_enabled < 0) {
+        http_enabled = getDefine_Int("integrator", "native_http", 0, 1) && integrator_http_start() == 0;
+    }
+
+    if (!http_enabled) {
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(integrator_http), http);
+    http->name = config->name;
+    http->url = config->hookurl ? config->hookurl : type == INTEGRATOR_HTTP_PAGERDUTY ? PAGERDUTY_URL : NULL;
+    http->type = type;
+
+    if (!http->url) {
+        free(http);
+        return NULL;
+    }
+
+    /* Targets are only added before the first alert is read */
+    http->next = http_targets;
+    http_targets = http;
+
+    return http;
+}
+
+void integrator_http_send(const IntegratorConfig * config, const cJSON * alert) {
+    integrator_http_msg * msg;
+    cJSON * payload;
+
+    switch (config->http->type) {
+    case INTEGRATOR_HTTP_SLACK:
+        payload = integrator_http_slack(alert);
+        break;
+    case INTEGRATOR_HTTP_PAGERDUTY:
+        payload = integrator_http_pagerduty(config, alert);
+        break;
+    default:
+        return;
+    }
+
+    os_malloc(sizeof(integrator_http_msg), msg);
+    msg->target = config->http;
+    msg->payload = payload;
+
+    /* Hold the reader back while the endpoints are slower than the alerts */
+    queue_push_ex_block(http_queue, msg);
+}
+
+static int integrator_http_start(void) {
+    int connections;
+
+    http_batch = getDefine_Int("integrator", "http_batch", 1, 100);
+    http_flush_interval = getDefine_Int("integrator", "http_flush_interval", 0, 60000);
+    http_timeout = getDefine_Int("integrator", "http_timeout", 1, 300);
+    connections = getDefine_Int("integrator", "http_connections", 1, 64);
+
+    /* Let each connection have a few requests waiting behind it */
+    http_max_transfers = connections * 16;
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK || (http_multi = curl_multi_init(), !http_multi)) {
+        merror("Could not start the HTTP client. Using the integration scripts.");
+        return -1;
+    }
+
+    /* Keep the connections open between requests, a few per host */
+    curl_multi_setopt(http_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)connections);
+    curl_multi_setopt(http_multi, CURLMOPT_MAXCONNECTS, (long)connections * 4);
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(http_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+    http_queue = queue_init(http_max_transfers * http_batch);
+    queue_metrics_register(http_queue, "http");
+    w_create_thread(integrator_http_main, NULL);
+
+    return 0;
+}
+
+static void * integrator_http_main(__attribute__((unused)) void * arg) {
+    integrator_http_msg * msgs[INTEGRATOR_HTTP_POP];
+    struct timespec deadline;
+    struct timespec due;
+    integrator_http * target;
+    int running = 0;
+    size_t n;
+    size_t i;
+
+    while (1) {
+        gettime(&deadline);
+
+        /* With nothing on the wire, sleep on the queue until a batch is due */
+        if (!running) {
+            deadline.tv_sec++;
+
+            for (target = http_targets; target; target = target->next) {
+                if (target->batch_count) {
+                    due = target->batch_time;
+                    due.tv_sec += http_flush_interval / 1000;
+                    due.tv_nsec += (http_flush_interval % 1000) * 1000000;
+
+                    if (due.tv_nsec >= 1000000000) {
+                        due.tv_sec++;
+                        due.tv_nsec -= 1000000000;
+                    }
+
+                    if (due.tv_sec < deadline.tv_sec || (due.tv_sec == deadline.tv_sec && due.tv_nsec < deadline.tv_nsec)) {
+                        deadline = due;
+                    }
+                }
+            }
+        }
+
+        if (http_transfers < http_max_transfers) {
+            n = queue_pop_ex_batch(http_queue, (void **)msgs, INTEGRATOR_HTTP_POP, &deadline);
+
+            for (i = 0; i < n; i++) {
+                integrator_http_add(msgs[i]);
+            }
+        }
+
+        integrator_http_flush();
+        curl_multi_perform(http_multi, &running);
+        integrator_http_reap();
+
+        if (running) {
+            curl_multi_wait(http_multi, NULL, 0, INTEGRATOR_HTTP_WAIT, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static void integrator_http_add(integrator_http_msg * msg) {
+    integrator_http * target = msg->target;
+
+    switch (target->type) {
+    case INTEGRATOR_HTTP_SLACK:
+        /* Several attachments can go in one message */
+        if (!target->batch) {
+            target->batch = cJSON_CreateArray();
+            gettime(&target->batch_time);
+        }
+
+        cJSON_AddItemToArray(target->batch, msg->payload);
+
+        if (++target->batch_count >= http_batch) {
+            integrator_http_post_batch(target);
+        }
+
+        break;
+
+    default:
+        integrator_http_post(target, msg->payload, 1);
+    }
+
+    free(msg);
+}
+
+/* Send the batches that have waited enough */
+static void integrator_http_flush(void) {
+    struct timespec now;
+    integrator_http * target;
+
+    gettime(&now);
+
+    for (target = http_targets; target; target = target->next) {
+        if (target->batch_count && time_diff(&target->batch_time, &now) * 1000 >= http_flush_interval) {
+            integrator_http_post_batch(target);
+        }
+    }
+}
+
+/* Send the Slack attachments of a target in one message */
+static void integrator_http_post_batch(integrator_http * target) {
+    cJSON * payload = cJSON_CreateObject();
+
+    cJSON_AddItemToObject(payload, "attachments", target->batch);
+    integrator_http_post(target, payload, target->batch_count);
+    target->batch = NULL;
+    target->batch_count = 0;
+}
+
+/* Queue a request. The payload is freed. */
+static void integrator_http_post(integrator_http * target, cJSON * payload, unsigned int alerts) {
+    integrator_http_transfer * transfer;
+    CURL * curl;
+
+    if (curl = curl_easy_init(), !curl) {
+        merror("Could not send %u alerts to %s: unable to create the request.", alerts, target->name);
+        cJSON_Delete(payload);
+        return;
+    }
+
+    os_calloc(1, sizeof(integrator_http_transfer), transfer);
+    transfer->target = target;
+    transfer->alerts = alerts;
+    transfer->body = cJSON_PrintUnformatted(payload);
+    transfer->headers = curl_slist_append(NULL, "Content-Type: application/json");
+    transfer->headers = curl_slist_append(transfer->headers, "Accept-Charset: UTF-8");
+    cJSON_Delete(payload);
+
+    curl_easy_setopt(curl, CURLOPT_URL, target->url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, transfer->body);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, transfer->error);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, integrator_http_discard);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, http_timeout);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    curl_multi_add_handle(http_multi, curl);
+    http_transfers++;
+}
+
+/* Release the finished requests */
+static void integrator_http_reap(void) {
+    integrator_http_transfer * transfer;
+    CURLMsg * msg;
+    long status = 0;
+    char * priv;
+    int left;
+
+    while (msg = curl_multi_info_read(http_multi, &left), msg) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+        transfer = (integrator_http_transfer *)priv;
+
+        if (msg->data.result != CURLE_OK) {
+            merror("Unable to send %u alerts to %s: %s", transfer->alerts, transfer->target->name, *transfer->error ? transfer->error : curl_easy_strerror(msg->data.result));
+        } else if (curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status), status >= 400) {
+            merror("Unable to send %u alerts to %s: HTTP status %ld.", transfer->alerts, transfer->target->name, status);
+        } else {
+            mdebug2("Sent %u alerts to %s.", transfer->alerts, transfer->target->name);
+        }
+
+        curl_multi_remove_handle(http_multi, msg->easy_handle);
+        curl_easy_cleanup(msg->easy_handle);
+        curl_slist_free_all(transfer->headers);
+        free(transfer->body);
+        free(transfer);
+        http_transfers--;
+    }
+}
+
+static size_t integrator_http_discard(__attribute__((unused)) char * data, size_t size, size_t nmemb, __attribute__((unused)) void * arg) {
+    return size * nmemb;
+}
+
+static const char * integrator_http_string(const cJSON * object, const char * name, const char * value) {
+    cJSON * item = cJSON_GetObjectItem(object, name);
+    return cJSON_IsString(item) ? item->valuestring : value;
+}
+
+/* Same message as the Slack script */
+static cJSON * integrator_http_slack(const cJSON * alert) {
+    const cJSON * rule = cJSON_GetObjectItem(alert, "rule");
+    const cJSON * agent = cJSON_GetObjectItem(alert, "agent");
+    const cJSON * agentless = cJSON_GetObjectItem(alert, "agentless");
+    const cJSON * json_field = cJSON_GetObjectItem(rule, "level");
+    int level = json_field ? json_field->valueint : 0;
+    char value[OS_SIZE_1024];
+    cJSON * msg;
+    cJSON * fields;
+    cJSON * field;
+
+    msg = cJSON_CreateObject();
+    cJSON_AddStringToObject(msg, "color", level <= 4 ? "good" : level <= 7 ? "warning" : "danger");
+    cJSON_AddStringToObject(msg, "pretext", "WAZUH Alert");
+    cJSON_AddStringToObject(msg, "title", integrator_http_string(rule, "description", "N/A"));
+
+    if (json_field = cJSON_GetObjectItem(alert, "full_log"), cJSON_IsString(json_field)) {
+        cJSON_AddStringToObject(msg, "text", json_field->valuestring);
+    } else {
+        cJSON_AddNullToObject(msg, "text");
+    }
+
+    fields = cJSON_CreateArray();
+    cJSON_AddItemToObject(msg, "fields", fields);
+
+    if (agent) {
+        snprintf(value, sizeof(value), "(%s) - %s", integrator_http_string(agent, "id", ""), integrator_http_string(agent, "name", ""));
+        field = cJSON_CreateObject();
+        cJSON_AddStringToObject(field, "title", "Agent");
+        cJSON_AddStringToObject(field, "value", value);
+        cJSON_AddItemToArray(fields, field);
+    }
+
+    if (agentless) {
+        field = cJSON_CreateObject();
+        cJSON_AddStringToObject(field, "title", "Agentless Host");
+        cJSON_AddStringToObject(field, "value", integrator_http_string(agentless, "host", ""));
+        cJSON_AddItemToArray(fields, field);
+    }
+
+    field = cJSON_CreateObject();
+    cJSON_AddStringToObject(field, "title", "Location");
+    cJSON_AddStringToObject(field, "value", integrator_http_string(alert, "location", ""));
+    cJSON_AddItemToArray(fields, field);
+
+    snprintf(value, sizeof(value), "%s _(Level %d)_", integrator_http_string(rule, "id", ""), level);
+    field = cJSON_CreateObject();
+    cJSON_AddStringToObject(field, "title", "Rule ID");
+    cJSON_AddStringToObject(field, "value", value);
+    cJSON_AddItemToArray(fields, field);
+
+    cJSON_AddStringToObject(msg, "ts", integrator_http_string(alert, "id", ""));
+
+    return msg;
+}
+
+/* Same event as the PagerDuty script */
+static cJSON * integrator_http_pagerduty(const IntegratorConfig * config, const cJSON * alert) {
+    const cJSON * rule = cJSON_GetObjectItem(alert, "rule");
+    const char * rule_id = integrator_http_string(rule, "id", "");
+    const char * description = integrator_http_string(rule, "description", "");
+    char value[OS_SIZE_2048];
+    cJSON * event;
+    cJSON * details;
+
+    event = cJSON_CreateObject();
+    cJSON_AddStringToObject(event, "service_key", config->apikey);
+    snprintf(value, sizeof(value), "Alert: '%s' / Rule: '%s'", integrator_http_string(alert, "timestamp", ""), rule_id);
+    cJSON_AddStringToObject(event, "incident_key", value);
+    cJSON_AddStringToObject(event, "event_type", "trigger");
+    snprintf(value, sizeof(value), "Wazuh Alert: '%s'", description);
+    cJSON_AddStringToObject(event, "description", value);
+    cJSON_AddStringToObject(event, "client", "Wazuh");
+    cJSON_AddStringToObject(event, "client_url", "http://127.0.0.1:5601/app/wazuh");
+
+    details = cJSON_CreateObject();
+    cJSON_AddStringToObject(details, "location", integrator_http_string(alert, "location", ""));
+    cJSON_AddStringToObject(details, "Rule", rule_id);
+    cJSON_AddStringToObject(details, "Description", description);
+    cJSON_AddStringToObject(details, "Log", integrator_http_string(alert, "full_log", ""));
+    cJSON_AddItemToObject(event, "details", details);
+
+    return event;
+}
@@ -32,6 +32,9 @@ size_t intgcom_dispatch(char * command, char ** output) {
         }
         return intgcom_getconfig(rcv_args, output);
 
+    } else if (strcmp(rcv_comm, "getmetrics") == 0){
+        return intgcom_getmetrics(output);
+
     } else {
         mdebug1("INTGCOM Unrecognized command '%s'.", rcv_comm);
         os_strdup("err Unrecognized command", *output);
@@ -39,6 +42,15 @@ size_t intgcom_dispatch(char * command, char ** output) {
     }
 }
 
+size_t intgcom_getmetrics(char ** output) {
+    char *metrics = w_metrics_render();
+
+    os_strdup("ok", *output);
+    wm_strcat(output, metrics, ' ');
+    free(metrics);
+    return strlen(*output);
+}
+
 size_t intgcom_getconfig(const char * section, char ** output) {
 
     cJSON *cfg;
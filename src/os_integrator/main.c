@@ -157,6 +157,7 @@ int main(int argc, char **argv)
 
     // Start com request thread
     w_create_thread(intgcom_main, NULL);
+    w_metrics_http_start("integrator");
 
     /* Basic start up completed. */
     mdebug1(PRIVSEP_MSG ,dir,user);
@@ -198,6 +198,8 @@ cJSON *getMailInternalOptions(void) {
 
     cJSON_AddNumberToObject(maild,"strict_checking",mail.strict_checking);
     cJSON_AddNumberToObject(maild,"grouping",mail.grouping);
+    cJSON_AddNumberToObject(maild,"smtp_keepalive",mail.smtp_keepalive);
+    cJSON_AddNumberToObject(maild,"queue_size",mail.queue_size);
 #ifdef LIBGEOIP_ENABLED
     cJSON_AddNumberToObject(maild,"geoip",mail.geoip);
 #endif
@@ -23,15 +23,22 @@ static MailNode *lastnode;
 
 static int _memoryused = 0;
 static int _memorymaxsize = 0;
+static size_t _bytesused = 0;
+static size_t _bytesmaxsize = 0;
+static unsigned int _dropped = 0;
+
+static void OS_DropLastMail(void);
 
 
 /* Create the Mail List */
-void OS_CreateMailList(int maxsize)
+void OS_CreateMailList(int maxsize, size_t maxbytes)
 {
     n_node = NULL;
 
     _memorymaxsize = maxsize;
     _memoryused = 0;
+    _bytesmaxsize = maxbytes;
+    _bytesused = 0;
 
     return;
 }
@@ -50,10 +57,17 @@ MailNode *OS_PopLastMail()
     oldlast = lastnode;
     if (lastnode == NULL) {
         n_node = NULL;
+
+        if (_dropped) {
+            mwarn("The mail queue was full. %u alerts were not sent.", _dropped);
+            _dropped = 0;
+        }
+
         return (NULL);
     }
 
     _memoryused--;
+    _bytesused -= oldlast->size;
     lastnode = lastnode->prev;
 
     /* Remove the last */
@@ -74,6 +88,7 @@ void FreeMailMsg(MailMsg *ml)
         free(ml->body);
     }
 
+    free(ml->gran);
     free(ml);
 }
 
@@ -91,15 +106,39 @@ void FreeMail(MailNode *ml)
         free(ml->mail->body);
     }
 
+    free(ml->mail->gran);
     free(ml->mail);
     free(ml);
 }
 
+/* Free the oldest email, to make room for a new one */
+static void OS_DropLastMail()
+{
+    MailNode *oldlast;
+
+    if (!_dropped++) {
+        mwarn("The mail queue is full. Dropping the oldest alerts.");
+    }
+
+    oldlast = lastnode;
+    lastnode = lastnode->prev;
+    _bytesused -= oldlast->size;
+    _memoryused--;
+
+    FreeMail(oldlast);
+}
+
 
 /* Add an email to the list -- always to the beginning */
 void OS_AddMailtoList(MailMsg *ml)
 {
     MailNode *tmp_node = n_node;
+    size_t size;
+
+    /* The body was allocated for the largest alert: keep only what it takes */
+    size = strlen(ml->body) + 1;
+    os_realloc(ml->body, size, ml->body);
+    size += SUBJECT_SIZE + sizeof(MailMsg) + sizeof(MailNode);
 
     if (tmp_node) {
         MailNode *new_node;
@@ -121,20 +160,14 @@ void OS_AddMailtoList(MailMsg *ml)
 
         /* Add the event to the node */
         new_node->mail = ml;
+        new_node->size = size;
 
         _memoryused++;
+        _bytesused += size;
 
-        /* Need to remove the last node */
-        if (_memoryused > _memorymaxsize) {
-            MailNode *oldlast;
-
-            oldlast = lastnode;
-            lastnode = lastnode->prev;
-
-            /* Free last node */
-            FreeMail(oldlast);
-
-            _memoryused--;
+        /* Need to remove the last nodes */
+        while (lastnode != new_node && (_memoryused > _memorymaxsize || _bytesused > _bytesmaxsize)) {
+            OS_DropLastMail();
         }
     }
 
@@ -148,6 +181,10 @@ void OS_AddMailtoList(MailMsg *ml)
         n_node->prev = NULL;
         n_node->next = NULL;
         n_node->mail = ml;
+        n_node->size = size;
+
+        _memoryused++;
+        _bytesused += size;
 
         lastnode = n_node;
     }
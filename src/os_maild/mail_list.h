@@ -14,6 +14,7 @@
 /* Events List structure */
 typedef struct _MailNode {
     MailMsg *mail;
+    size_t size;
     struct _MailNode *next;
     struct _MailNode *prev;
 } MailNode;
@@ -29,8 +30,8 @@ MailNode *OS_PopLastMail(void);
 /* Return a pointer to the last email, not removing it */
 MailNode *OS_CheckLastMail(void);
 
-/* Create the mail list. Maxsize must be specified */
-void OS_CreateMailList(int maxsize);
+/* Create the mail list. Maxsize (emails) and maxbytes must be specified */
+void OS_CreateMailList(int maxsize, size_t maxbytes);
 
 /* Free an email node */
 void FreeMail(MailNode *ml);
@@ -19,8 +19,6 @@
 
 /* Global variables */
 unsigned int mail_timeout;
-unsigned int   _g_subject_level;
-char _g_subject[SUBJECT_SIZE + 2];
 
 /* Prototypes */
 static void OS_Run(MailConfig *mail) __attribute__((nonnull)) __attribute__((noreturn));
@@ -139,6 +137,16 @@ int main(int argc, char **argv)
                                       "full_subject",
                                       0, 1);
 
+    /* Seconds to keep the SMTP session open after an e-mail */
+    mail.smtp_keepalive = getDefine_Int("maild",
+                                        "smtp_keepalive",
+                                        0, 3600);
+
+    /* Get the size of the queue of alerts to be sent, in KiB */
+    mail.queue_size = getDefine_Int("maild",
+                                    "queue_size",
+                                    64, 262144);
+
 #ifdef LIBGEOIP_ENABLED
     /* Get GeoIP */
     mail.geoip = getDefine_Int("maild",
@@ -265,21 +273,25 @@ static void OS_Run(MailConfig *mail)
     }
 
     /* Create the list */
-    OS_CreateMailList(MAIL_LIST_SIZE);
+    OS_CreateMailList(MAIL_LIST_SIZE, (size_t)mail->queue_size * 1024);
 
     /* Set default timeout */
     mail_timeout = DEFAULT_TIMEOUT;
 
-    /* Clear global variables */
-    _g_subject_level = 0;
-    memset(_g_subject, '\0', SUBJECT_SIZE + 2);
-
     while (1) {
         tm = time(NULL);
         localtime_r(&tm, &tm_result);
 
         /* SMS messages are sent without delay */
-        if (msg_sms) {
+        if (msg_sms && mail->smtpserver[0] != '/') {
+            /* The SMTP session is kept in this process */
+            if (OS_Sendsms(mail, &tm_result, msg_sms) < 0) {
+                merror(SNDMAIL_ERROR, mail->smtpserver);
+            }
+
+            FreeMailMsg(msg_sms);
+            msg_sms = NULL;
+        } else if (msg_sms) {
             pid_t pid;
 
             pid = fork();
@@ -324,33 +336,35 @@ static void OS_Run(MailConfig *mail)
                 goto snd_check_hour;
             }
 
-            pid = fork();
-            if (pid < 0) {
-                merror(FORK_ERROR, errno, strerror(errno));
-                sleep(30);
-                continue;
-            } else if (pid == 0) {
+            if (mail->smtpserver[0] != '/') {
+                /* The SMTP session is kept in this process. It takes the emails from the list. */
                 if (OS_Sendmail(mail, &tm_result) < 0) {
                     merror(SNDMAIL_ERROR, mail->smtpserver);
                 }
+            } else {
+                pid = fork();
+                if (pid < 0) {
+                    merror(FORK_ERROR, errno, strerror(errno));
+                    sleep(30);
+                    continue;
+                } else if (pid == 0) {
+                    if (OS_Sendmail(mail, &tm_result) < 0) {
+                        merror(SNDMAIL_ERROR, mail->smtpserver);
+                    }
 
-                exit(0);
-            }
+                    exit(0);
+                }
 
-            /* Clean the memory */
-            mailmsg = OS_PopLastMail();
-            do {
-                FreeMail(mailmsg);
+                /* Clean the memory */
                 mailmsg = OS_PopLastMail();
-            } while (mailmsg);
+                do {
+                    FreeMail(mailmsg);
+                    mailmsg = OS_PopLastMail();
+                } while (mailmsg);
 
-            /* Increase child count */
-            childcount++;
-
-            /* Clear global variables */
-            _g_subject[0] = '\0';
-            _g_subject[SUBJECT_SIZE - 1] = '\0';
-            _g_subject_level = 0;
+                /* Increase child count */
+                childcount++;
+            }
 
             /* Clean up set values */
             if (mail->gran_to) {
@@ -433,6 +447,11 @@ snd_check_hour:
             }
         }
 
+        /* Don't hold an idle session */
+        if (mail->smtpserver[0] != '/') {
+            OS_SmtpIdle(mail);
+        }
+
         /* Wait for the children */
         while (childcount) {
             int wp;
@@ -55,6 +55,8 @@
 typedef struct _MailMsg {
     char *subject;
     char *body;
+    char *gran;             /* Granular recipients that the alert matched */
+    unsigned int level;
 } MailMsg;
 
 #include "shared.h"
@@ -92,12 +94,17 @@ int OS_Sendmail(MailConfig *mail, struct tm *p) __attribute__((nonnull));
 int OS_Sendsms(MailConfig *mail, struct tm *p, MailMsg *sms_msg) __attribute__((nonnull));
 int OS_SendCustomEmail(char **to, char *subject, char *smtpserver, char *from, char *replyto, char *idsname, FILE *fp, const struct tm *p);
 
+/* Send a message through the SMTP session, and open it if needed.
+ * The data holds the headers and the body.
+ * Returns 0 on success or -1 on error
+ */
+int OS_SmtpSend(const MailConfig *mail, char **rcpt, const char *data, size_t length) __attribute__((nonnull));
+
+/* Close the SMTP session once it has been idle for the keepalive time */
+void OS_SmtpIdle(const MailConfig *mail) __attribute__((nonnull));
+
 /* Mail timeout used by the file-queue */
 extern unsigned int mail_timeout;
-
-/* Global var for highest level on mail subjects */
-extern unsigned int   _g_subject_level;
-extern char _g_subject[SUBJECT_SIZE + 2];
 extern MailConfig mail;
 
 #endif /* MAILD_H */
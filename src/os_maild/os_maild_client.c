@@ -15,10 +15,23 @@
 #include "config/config.h"
 #endif
 
+/* Mark a granular recipient of a message */
+static void mail_gran_set(const MailConfig *Mail, MailMsg *mail, int i)
+{
+    int count;
+
+    if (!mail->gran) {
+        for (count = 0; Mail->gran_to[count]; count++);
+        os_calloc(count, sizeof(char), mail->gran);
+    }
+
+    mail->gran[i] = 1;
+}
+
 /* Receive a Message on the Mail queue */
 MailMsg *OS_RecvMailQ(file_queue *fileq, struct tm *p, MailConfig *Mail, MailMsg **msg_sms)
 {
-    int i = 0, sms_set = 0, donotgroup = 0;
+    int i = 0, sms_set = 0;
     size_t body_size = OS_MAXSTR - 3, log_size;
     char logs[OS_MAXSTR + 1];
     char extra_data[OS_MAXSTR + 1];
@@ -293,10 +306,12 @@ MailMsg *OS_RecvMailQ(file_queue *fileq, struct tm *p, MailConfig *Mail, MailMsg
                     } else if (Mail->gran_format[i] == DONOTGROUP) {
                         Mail->priority = DONOTGROUP;
                         Mail->gran_set[i] = DONOTGROUP;
-                        donotgroup = 1;
                     } else {
                         Mail->gran_set[i] = FULL_FORMAT;
                     }
+
+                    /* The recipient gets a digest of the alerts it matched */
+                    mail_gran_set(Mail, mail, i);
                 }
             }
             i++;
@@ -304,19 +319,8 @@ MailMsg *OS_RecvMailQ(file_queue *fileq, struct tm *p, MailConfig *Mail, MailMsg
     }
 
 
-    /* If DONOTGROUP is set, we can't assign the new subject */
-    if (!donotgroup) {
-        /* Get highest level for alert */
-        if (_g_subject[0] != '\0') {
-            if (_g_subject_level < al_data->level) {
-                strncpy(_g_subject, mail->subject, SUBJECT_SIZE);
-                _g_subject_level = al_data->level;
-            }
-        } else {
-            strncpy(_g_subject, mail->subject, SUBJECT_SIZE);
-            _g_subject_level = al_data->level;
-        }
-    }
+    /* The digests take the subject of their highest level alert */
+    mail->level = al_data->level;
 
     /* If SMS is set, create the SMS output */
     if (sms_set) {
@@ -346,7 +350,7 @@ MailMsg *OS_RecvMailQ(file_queue *fileq, struct tm *p, MailConfig *Mail, MailMsg
 
 MailMsg *OS_RecvMailQ_JSON(file_queue *fileq, MailConfig *Mail, MailMsg **msg_sms)
 {
-    int i = 0, sms_set = 0, donotgroup = 0;
+    int i = 0, sms_set = 0;
     size_t body_size = OS_MAXSTR - 3, log_size;
     char logs[OS_MAXSTR + 1] = "";
     char *subject_host = NULL;
@@ -656,10 +660,12 @@ MailMsg *OS_RecvMailQ_JSON(file_queue *fileq, MailConfig *Mail, MailMsg **msg_sm
                     } else if (Mail->gran_format[i] == DONOTGROUP) {
                         Mail->priority = DONOTGROUP;
                         Mail->gran_set[i] = DONOTGROUP;
-                        donotgroup = 1;
                     } else {
                         Mail->gran_set[i] = FULL_FORMAT;
                     }
+
+                    /* The recipient gets a digest of the alerts it matched */
+                    mail_gran_set(Mail, mail, i);
                 }
             }
             i++;
@@ -667,19 +673,8 @@ MailMsg *OS_RecvMailQ_JSON(file_queue *fileq, MailConfig *Mail, MailMsg **msg_sm
     }
 
 
-    /* If DONOTGROUP is set, we can't assign the new subject */
-    if (!donotgroup) {
-        /* Get highest level for alert */
-        if (_g_subject[0] != '\0') {
-            if (_g_subject_level < alert_level) {
-                strncpy(_g_subject, mail->subject, SUBJECT_SIZE);
-                _g_subject_level = alert_level;
-            }
-        } else {
-            strncpy(_g_subject, mail->subject, SUBJECT_SIZE);
-            _g_subject_level = alert_level;
-        }
-    }
+    /* The digests take the subject of their highest level alert */
+    mail->level = alert_level;
 
     /* If SMS is set, create the SMS output */
     if (sms_set) {
@@ -716,6 +711,7 @@ end:
     } else if (mail) {
         free(mail->body);
         free(mail->subject);
+        free(mail->gran);
         free(mail);
     }
 
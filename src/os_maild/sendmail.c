@@ -15,634 +15,290 @@
 #include "maild.h"
 #include "mail_list.h"
 
-/* Return codes (from SMTP server) */
-#define VALIDBANNER     "220"
-#define VALIDMAIL       "250"
-#define VALIDDATA       "354"
-
-/* Default values used to connect */
-#define SMTP_DEFAULT_PORT   25
-#define MAILFROM            "Mail From: <%s>\r\n"
-#define RCPTTO              "Rcpt To: <%s>\r\n"
-#define DATAMSG             "DATA\r\n"
+/* Message headers */
 #define FROM                "From: " __ossec_name " <%s>\r\n"
 #define TO                  "To: <%s>\r\n"
 #define REPLYTO             "Reply-To: " __ossec_name " <%s>\r\n"
 /*#define CC                "Cc: <%s>\r\n"*/
 #define SUBJECT             "Subject: %s\r\n"
 #define ENDHEADER           "\r\n"
-#define ENDDATA             "\r\n.\r\n"
-#define QUITMSG             "QUIT\r\n"
 #define XHEADER             "X-IDS-OSSEC: %s\r\n"
 
 /* Error messages - Can be translated */
 #define INTERNAL_ERROR  "(1760): Memory/configuration error"
-#define BANNER_ERROR    "(1762): Banner not received from server"
-#define HELO_ERROR      "(1763): Hello not accepted by server"
-#define FROM_ERROR      "(1764): Mail from not accepted by server"
-#define TO_ERROR        "(1765): RCPT TO not accepted by server - '%s'."
-#define DATA_ERROR      "(1766): DATA not accepted by server"
-#define END_DATA_ERROR  "(1767): End of DATA not accepted by server"
 
-#define MAIL_DEBUG_FLAG     0
-#define MAIL_DEBUG(x,y,z) if(MAIL_DEBUG_FLAG) merror(x,y,z)
+/* E-mail being composed */
+typedef struct mail_buffer {
+    char *data;
+    size_t length;
+    size_t size;
+} mail_buffer;
+
+static void mail_append(mail_buffer *buffer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void mail_headers(const MailConfig *mail, mail_buffer *buffer, char **rcpt, const struct tm *p, const char *subject, int xheader);
+static int mail_deliver(const MailConfig *mail, char **rcpt, const mail_buffer *buffer);
+static int mail_digest(const MailConfig *mail, const struct tm *p, MailMsg **msgs, int count, const int *digest, int gran_count, int d);
+static int mail_gran(const MailMsg *msg, int i);
 
 
 int OS_Sendsms(MailConfig *mail, struct tm *p, MailMsg *sms_msg)
 {
-    FILE *sendmail = NULL;
-    int socket = -1;
-    size_t final_to_sz;
-    char *msg;
-    char snd_msg[128];
-    char final_to[512];
-
-    if (mail->smtpserver[0] == '/') {
-        sendmail = popen(mail->smtpserver, "w");
-        if (!sendmail) {
-            return (OS_INVALID);
-        }
-    } else {
-        /* Connect to the SMTP server */
-        socket = OS_ConnectTCP(SMTP_DEFAULT_PORT, mail->smtpserver, 0);
-        if (socket < 0) {
-            return (socket);
-        }
-
-        if (OS_SetRecvTimeout(socket, SOCK_RECV_TIME0, 0) < 0) {
-            merror("Couldn't set receiving timeout for socket.");
-        }
+    mail_buffer buffer = { NULL, 0, 0 };
+    char **rcpt = NULL;
+    int count = 0;
+    int result;
+    int i;
 
+    /* Recipients of the SMS format */
+    os_calloc(1, sizeof(char *), rcpt);
 
-        /* Receive the banner */
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDBANNER, msg))) {
-            merror(BANNER_ERROR);
-            if (msg) {
-                free(msg);
-            }
-            close(socket);
-            return (OS_INVALID);
-        }
-        MAIL_DEBUG("DEBUG: Received banner: '%s' %s", msg, "");
-        free(msg);
-
-        /* Send HELO message */
-        memset(snd_msg, '\0', 128);
-        if (mail->heloserver) {
-            snprintf(snd_msg, 127, "Helo %s\r\n", mail->heloserver);
-        } else {
-            snprintf(snd_msg, 127, "Helo %s\r\n", "notify.ossec.net");
+    for (i = 0; mail->gran_to && mail->gran_to[i]; i++) {
+        if (mail->gran_set[i] == SMS_FORMAT) {
+            os_realloc(rcpt, sizeof(char *) * (count + 2), rcpt);
+            rcpt[count++] = mail->gran_to[i];
+            rcpt[count] = NULL;
         }
-        OS_SendTCP(socket, snd_msg);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-            if (msg) {
-                /* In some cases (with virus scans in the middle)
-                 * we may get two banners. Check for that in here.
-                 */
-                if (OS_Match(VALIDBANNER, msg)) {
-                    free(msg);
-
-                    /* Try again */
-                    msg = OS_RecvTCP(socket, OS_SIZE_1024);
-                    if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-                        merror("%s:%s", HELO_ERROR, msg != NULL ? msg : "null");
-                        if (msg) {
-                            free(msg);
-                        }
-                        close(socket);
-                        return (OS_INVALID);
-                    }
-                } else {
-                    merror("%s:%s", HELO_ERROR, msg);
-                    free(msg);
-                    close(socket);
-                    return (OS_INVALID);
-                }
-            } else {
-                merror("%s:%s", HELO_ERROR, "null");
-                close(socket);
-                return (OS_INVALID);
-            }
-        }
-
-        MAIL_DEBUG("DEBUG: Sent '%s', received: '%s'", snd_msg, msg);
-        free(msg);
-
-        /* Build "Mail from" msg */
-        memset(snd_msg, '\0', 128);
-        snprintf(snd_msg, 127, MAILFROM, mail->from);
-        OS_SendTCP(socket, snd_msg);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-            merror(FROM_ERROR);
-            if (msg) {
-                free(msg);
-            }
-            close(socket);
-            return (OS_INVALID);
-        }
-        MAIL_DEBUG("DEBUG: Sent '%s', received: '%s'", snd_msg, msg);
-        free(msg);
-
-        /* Additional RCPT to */
-        final_to[0] = '\0';
-        final_to_sz = sizeof(final_to) - 2;
-
-        if (mail->gran_to) {
-            int i = 0;
-            while (mail->gran_to[i] != NULL) {
-                if (mail->gran_set[i] != SMS_FORMAT) {
-                    i++;
-                    continue;
-                }
-
-                memset(snd_msg, '\0', 128);
-                snprintf(snd_msg, 127, RCPTTO, mail->gran_to[i]);
-                OS_SendTCP(socket, snd_msg);
-                msg = OS_RecvTCP(socket, OS_SIZE_1024);
-                if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-                    merror(TO_ERROR, mail->gran_to[i]);
-                    if (msg) {
-                        free(msg);
-                    }
-                    close(socket);
-                    return (OS_INVALID);
-                }
-                MAIL_DEBUG("DEBUG: Sent '%s', received: '%s'", snd_msg, msg);
-                free(msg);
-
-
-                /* Create header for to */
-                memset(snd_msg, '\0', 128);
-                snprintf(snd_msg, 127, TO, mail->gran_to[i]);
-                strncat(final_to, snd_msg, final_to_sz);
-                final_to_sz -= strlen(snd_msg) + 2;
-
-                i++;
-                continue;
-            }
-        }
-
-        /* Send the "DATA" msg */
-        OS_SendTCP(socket, DATAMSG);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDDATA, msg))) {
-            merror(DATA_ERROR);
-            if (msg) {
-                free(msg);
-            }
-
-            close(socket);
-            return (OS_INVALID);
-
-        }
-        MAIL_DEBUG("DEBUG: Sent '%s', received: '%s'", DATAMSG, msg);
-        free(msg);
-
-        /* Build "From" and "To" in the e-mail header */
-        OS_SendTCP(socket, final_to);
-    }
-
-    memset(snd_msg, '\0', 128);
-    snprintf(snd_msg, 127, FROM, mail->from);
-
-    if (sendmail) {
-        fprintf(sendmail, "%s", snd_msg);
-    } else {
-        OS_SendTCP(socket, snd_msg);
     }
 
-    /* Send reply-to if set */
-    if (mail->reply_to){
-        memset(snd_msg, '\0', 128);
-        snprintf(snd_msg, 127, REPLYTO, mail->reply_to);
-
-        if (sendmail) {
-            fprintf(sendmail, "%s", snd_msg);
-        } else {
-            OS_SendTCP(socket, snd_msg);
-        }
-    }
+    mail_headers(mail, &buffer, rcpt, p, sms_msg->subject, 0);
+    mail_append(&buffer, "%s", sms_msg->body);
 
-    /* Send date */
-    memset(snd_msg, '\0', 128);
+    result = mail_deliver(mail, rcpt, &buffer);
 
-    /* Solaris doesn't have the "%z", so we set the timezone to 0 */
-#ifdef SOLARIS
-    strftime(snd_msg, 127, "Date: %a, %d %b %Y %T -0000\r\n", p);
-#else
-    strftime(snd_msg, 127, "Date: %a, %d %b %Y %T %z\r\n", p);
-#endif
-
-    if (sendmail) {
-        fprintf(sendmail, "%s", snd_msg);
-    } else {
-        OS_SendTCP(socket, snd_msg);
-    }
-
-    /* Send subject */
-    memset(snd_msg, '\0', 128);
-    snprintf(snd_msg, 127, SUBJECT, sms_msg->subject);
-
-    if (sendmail) {
-        fprintf(sendmail, "%s", snd_msg);
-        fprintf(sendmail, ENDHEADER);
-        fprintf(sendmail, "%s", sms_msg->body);
-
-        if (pclose(sendmail) == -1) {
-            merror(WAITPID_ERROR, errno, strerror(errno));
-        }
-    } else {
-        OS_SendTCP(socket, snd_msg);
-        OS_SendTCP(socket, ENDHEADER);
-
-        /* Send body */
-        OS_SendTCP(socket, sms_msg->body);
-
-        /* Send end of data \r\n.\r\n */
-        OS_SendTCP(socket, ENDDATA);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if (mail->strict_checking && ((msg == NULL) || (!OS_Match(VALIDMAIL, msg)))) {
-            merror(END_DATA_ERROR);
-            if (msg) {
-                free(msg);
-            }
-            close(socket);
-            return (OS_INVALID);
-        }
-        /* Check msg, since it may be null */
-        if (msg) {
-            free(msg);
-        }
-
-        /* Quit and close socket */
-        OS_SendTCP(socket, QUITMSG);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-
-        if (msg) {
-            free(msg);
-        }
-
-        close(socket);
-    }
-
-    memset_secure(snd_msg, '\0', 128);
-    return (0);
+    free(buffer.data);
+    free(rcpt);
+    return result;
 }
 
+/* Send the queued alerts. The recipients that matched the same alerts
+ * share a digest of them, and the main one goes to the global recipients.
+ */
 int OS_Sendmail(MailConfig *mail, struct tm *p)
 {
-    FILE *sendmail = NULL;
-    int socket = -1;
-    unsigned int i = 0;
-    char *msg;
-    char snd_msg[256];
-
     MailNode *mailmsg;
+    MailMsg **msgs = NULL;
+    int *digest;
+    int gran_count;
+    int count = 0;
+    int digests = 1;
+    int result = 0;
+    int d, i, j, m;
+
+    /* Take the emails from the list, from the oldest one */
+    while (mailmsg = OS_PopLastMail(), mailmsg) {
+        os_realloc(msgs, sizeof(MailMsg *) * (count + 1), msgs);
+        msgs[count++] = mailmsg->mail;
+        free(mailmsg);
+    }
 
-    /* If there is no sms message, attempt to get from the email list */
-    mailmsg = OS_PopLastMail();
-
-    if (mailmsg == NULL) {
+    if (count == 0) {
         merror("No email to be sent. Inconsistent state.");
         return (OS_INVALID);
     }
 
-    if (mail->smtpserver[0] == '/') {
-        sendmail = popen(mail->smtpserver, "w");
-        if (!sendmail) {
-            return (OS_INVALID);
-        }
-    } else {
-        /* Connect to the SMTP server */
-        socket = OS_ConnectTCP(SMTP_DEFAULT_PORT, mail->smtpserver, 0);
-        if (socket < 0) {
-            return (socket);
-        }
+    if (mail->to && mail->to[0] == NULL) {
+        merror(INTERNAL_ERROR);
+        result = OS_INVALID;
+        goto end;
+    }
 
-        if (OS_SetRecvTimeout(socket, SOCK_RECV_TIME0, 0) < 0) {
-            merror("Couldn't set receiving timeout for socket.");
-        }
+    for (gran_count = 0; mail->gran_to && mail->gran_to[gran_count]; gran_count++);
+    os_calloc(gran_count + 1, sizeof(int), digest);
 
-        /* Receive the banner */
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDBANNER, msg))) {
-            merror(BANNER_ERROR);
-            if (msg) {
-                free(msg);
-            }
-            close(socket);
-            return (OS_INVALID);
-        }
-        MAIL_DEBUG("DEBUG: Received banner: '%s' %s", msg, "");
-        free(msg);
-
-        /* Send HELO message */
-        memset(snd_msg, '\0', 256);
-        if (mail->heloserver) {
-            snprintf(snd_msg, 256, "Helo %s\r\n", mail->heloserver);
-        } else {
-            snprintf(snd_msg, 256, "Helo %s\r\n", "notify.ossec.net");
-        }
-        OS_SendTCP(socket, snd_msg);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-            if (msg) {
-                /* In some cases (with virus scans in the middle)
-                 * we may get two banners. Check for that in here.
-                 */
-                if (OS_Match(VALIDBANNER, msg)) {
-                    free(msg);
-
-                    /* Try again */
-                    msg = OS_RecvTCP(socket, OS_SIZE_1024);
-                    if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-                        merror("%s:%s", HELO_ERROR, msg != NULL ? msg : "null");
-                        if (msg) {
-                            free(msg);
-                        }
-                        close(socket);
-                        return (OS_INVALID);
-                    }
-                } else {
-                    merror("%s:%s", HELO_ERROR, msg);
-                    free(msg);
-                    close(socket);
-                    return (OS_INVALID);
-                }
-            } else {
-                merror("%s:%s", HELO_ERROR, "null");
-                close(socket);
-                return (OS_INVALID);
-            }
-        }
+    /* Digest of each granular recipient: 0 is the main one, with all the alerts */
+    for (i = 0; i < gran_count; i++) {
+        for (m = 0; m < count && mail_gran(msgs[m], i); m++);
 
-        MAIL_DEBUG("Sent '%s', received: '%s'", snd_msg, msg);
-        free(msg);
-
-        /* Build "Mail from" msg */
-        memset(snd_msg, '\0', 256);
-        snprintf(snd_msg, 256, MAILFROM, mail->from);
-        OS_SendTCP(socket, snd_msg);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-            merror(FROM_ERROR);
-            if (msg) {
-                free(msg);
-            }
-            close(socket);
-            return (OS_INVALID);
+        if (m == count) {
+            digest[i] = 0;
+            continue;
         }
-        MAIL_DEBUG("Sent '%s', received: '%s'", snd_msg, msg);
-        free(msg);
-
-        /* Build "RCPT TO" msg */
-        while (1) {
-            if (mail->to == NULL) break;
-            if (mail->to[i] == NULL) {
-                if (i == 0) {
-                    merror(INTERNAL_ERROR);
-                    close(socket);
-                    return (OS_INVALID);
-                }
-                break;
-            }
-            memset(snd_msg, '\0', 256);
-            snprintf(snd_msg, 256, RCPTTO, mail->to[i++]);
-            OS_SendTCP(socket, snd_msg);
-            msg = OS_RecvTCP(socket, OS_SIZE_1024);
-            if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-                merror(TO_ERROR, mail->to[i - 1]);
-                if (msg) {
-                    free(msg);
-                }
-                close(socket);
-                return (OS_INVALID);
-            }
-            MAIL_DEBUG("DEBUG: Sent '%s', received: '%s'", snd_msg, msg);
-            free(msg);
+
+        for (m = 0; m < count && !mail_gran(msgs[m], i); m++);
+
+        if (m == count) {
+            digest[i] = -1;
+            continue;
         }
 
-        /* Additional RCPT to */
-        if (mail->gran_to) {
-            i = 0;
-            while (mail->gran_to[i] != NULL) {
-                if (mail->gran_set[i] != FULL_FORMAT) {
-                    i++;
-                    continue;
-                }
+        for (j = 0; j < i; j++) {
+            if (digest[j] > 0) {
+                for (m = 0; m < count && mail_gran(msgs[m], i) == mail_gran(msgs[m], j); m++);
 
-                memset(snd_msg, '\0', 256);
-                snprintf(snd_msg, 256, RCPTTO, mail->gran_to[i]);
-                OS_SendTCP(socket, snd_msg);
-                msg = OS_RecvTCP(socket, OS_SIZE_1024);
-                if ((msg == NULL) || (!OS_Match(VALIDMAIL, msg))) {
-                    merror(TO_ERROR, mail->gran_to[i]);
-                    if (msg) {
-                        free(msg);
-                    }
-
-                    i++;
-                    continue;
+                if (m == count) {
+                    break;
                 }
-
-                MAIL_DEBUG("DEBUG: Sent '%s', received: '%s'", snd_msg, msg);
-                free(msg);
-                i++;
-                continue;
             }
         }
 
-        /* Send the "DATA" msg */
-        OS_SendTCP(socket, DATAMSG);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if ((msg == NULL) || (!OS_Match(VALIDDATA, msg))) {
-            merror(DATA_ERROR);
-            if (msg) {
-                free(msg);
-            }
-            close(socket);
-            return (OS_INVALID);
+        digest[i] = j < i ? digest[j] : digests++;
+    }
+
+    for (d = 0; d < digests; d++) {
+        if (mail_digest(mail, p, msgs, count, digest, gran_count, d) < 0) {
+            result = OS_INVALID;
         }
-        MAIL_DEBUG("DEBUG: Sent '%s', received: '%s'", DATAMSG, msg);
-        free(msg);
     }
 
-    if (mail->to) {
-        /* Building "From" and "To" in the e-mail header */
-        memset(snd_msg, '\0', 256);
-        snprintf(snd_msg, 256, TO, mail->to[0]);
+    free(digest);
 
-        if (sendmail) {
-            fprintf(sendmail, "%s", snd_msg);
-        } else {
-            OS_SendTCP(socket, snd_msg);
-        }
+end:
+    for (m = 0; m < count; m++) {
+        FreeMailMsg(msgs[m]);
     }
 
-    memset(snd_msg, '\0', 256);
-    snprintf(snd_msg, 255, FROM, mail->from);
+    free(msgs);
+    return result;
+}
 
-    if (sendmail) {
-        fprintf(sendmail, "%s", snd_msg);
-    } else {
-        OS_SendTCP(socket, snd_msg);
+/* Compose and send a digest to its recipients
+ * Returns 0 on success or -1 on error
+ */
+static int mail_digest(const MailConfig *mail, const struct tm *p, MailMsg **msgs, int count, const int *digest, int gran_count, int d)
+{
+    mail_buffer buffer = { NULL, 0, 0 };
+    const MailMsg *top = NULL;
+    char **rcpt = NULL;
+    int rcpt_count = 0;
+    int first = -1;
+    int result;
+    int i, m;
+
+    os_calloc(1, sizeof(char *), rcpt);
+
+    for (i = 0; d == 0 && mail->to && mail->to[i]; i++) {
+        os_realloc(rcpt, sizeof(char *) * (rcpt_count + 2), rcpt);
+        rcpt[rcpt_count++] = mail->to[i];
+        rcpt[rcpt_count] = NULL;
     }
 
-    /* Send reply-to if set */
-    if (mail->reply_to){
-        memset(snd_msg, '\0', 256);
-        snprintf(snd_msg, 256, REPLYTO, mail->reply_to);
-        if (sendmail) {
-            fprintf(sendmail, "%s", snd_msg);
-        } else {
-            OS_SendTCP(socket, snd_msg);
+    for (i = 0; i < gran_count; i++) {
+        if (digest[i] == d) {
+            os_realloc(rcpt, sizeof(char *) * (rcpt_count + 2), rcpt);
+            rcpt[rcpt_count++] = mail->gran_to[i];
+            rcpt[rcpt_count] = NULL;
+
+            if (first < 0) {
+                first = i;
+            }
         }
     }
 
-    if (mail->to) {
-        /* Add CCs */
-        if (mail->to[1]) {
-            i = 1;
-            while (1) {
-                if (mail->to[i] == NULL) {
-                    break;
-                }
+    if (rcpt_count == 0) {
+        free(rcpt);
+        return 0;
+    }
 
-                memset(snd_msg, '\0', 256);
-                snprintf(snd_msg, 256, TO, mail->to[i]);
+    /* The subject is the one of the highest level alert */
+    for (m = 0; m < count; m++) {
+        if ((d == 0 || mail_gran(msgs[m], first)) && (!top || msgs[m]->level > top->level)) {
+            top = msgs[m];
+        }
+    }
 
-                if (sendmail) {
-                    fprintf(sendmail, "%s", snd_msg);
-                } else {
-                    OS_SendTCP(socket, snd_msg);
-                }
+    mail_headers(mail, &buffer, rcpt, p, top->subject, 1);
 
-                i++;
-            }
+    /* Send multiple emails together if we have to */
+    for (m = 0; m < count; m++) {
+        if (d == 0 || mail_gran(msgs[m], first)) {
+            mail_append(&buffer, "%s", msgs[m]->body);
         }
     }
 
-    /* More CCs - from granular options */
-    if (mail->gran_to) {
-        i = 0;
-        while (mail->gran_to[i] != NULL) {
-            if (mail->gran_set[i] != FULL_FORMAT) {
-                i++;
-                continue;
-            }
+    result = mail_deliver(mail, rcpt, &buffer);
 
-            memset(snd_msg, '\0', 256);
-            snprintf(snd_msg, 256, TO, mail->gran_to[i]);
+    free(buffer.data);
+    free(rcpt);
+    return result;
+}
 
-            if (sendmail) {
-                fprintf(sendmail, "%s", snd_msg);
-            } else {
-                OS_SendTCP(socket, snd_msg);
-            }
+/* Build the headers of an e-mail */
+static void mail_headers(const MailConfig *mail, mail_buffer *buffer, char **rcpt, const struct tm *p, const char *subject, int xheader)
+{
+    char date[128];
+    int i;
 
-            i++;
-            continue;
-        }
+    /* Building "From" and "To" in the e-mail header */
+    for (i = 0; rcpt[i]; i++) {
+        mail_append(buffer, TO, rcpt[i]);
     }
 
-    /* Send date */
-    memset(snd_msg, '\0', 256);
+    mail_append(buffer, FROM, mail->from);
+
+    /* Send reply-to if set */
+    if (mail->reply_to) {
+        mail_append(buffer, REPLYTO, mail->reply_to);
+    }
 
     /* Solaris doesn't have the "%z", so we set the timezone to 0 */
 #ifdef SOLARIS
-    strftime(snd_msg, 255, "Date: %a, %d %b %Y %T -0000\r\n", p);
+    strftime(date, sizeof(date), "Date: %a, %d %b %Y %T -0000\r\n", p);
 #else
-    strftime(snd_msg, 255, "Date: %a, %d %b %Y %T %z\r\n", p);
+    strftime(date, sizeof(date), "Date: %a, %d %b %Y %T %z\r\n", p);
 #endif
 
-    if (sendmail) {
-        fprintf(sendmail, "%s", snd_msg);
-    } else {
-        OS_SendTCP(socket, snd_msg);
-    }
+    mail_append(buffer, "%s", date);
 
-    if (mail->idsname) {
+    if (xheader && mail->idsname) {
         /* Send server name header */
-        memset(snd_msg, '\0', 256);
-        snprintf(snd_msg, 256, XHEADER, mail->idsname);
-
-        if (sendmail) {
-            fprintf(sendmail, "%s", snd_msg);
-        } else {
-            OS_SendTCP(socket, snd_msg);
-        }
+        mail_append(buffer, XHEADER, mail->idsname);
     }
 
-    /* Send subject */
-    memset(snd_msg, '\0', 256);
+    mail_append(buffer, SUBJECT, subject);
+    mail_append(buffer, ENDHEADER);
+}
 
-    /* Check if global subject is available */
-    if ((_g_subject_level != 0) && (_g_subject[0] != '\0')) {
-        snprintf(snd_msg, 256, SUBJECT, _g_subject);
+/* Hand an e-mail over to the sendmail command, or to the SMTP session */
+static int mail_deliver(const MailConfig *mail, char **rcpt, const mail_buffer *buffer)
+{
+    FILE *sendmail;
 
-        /* Clear global values */
-        _g_subject[0] = '\0';
-        _g_subject_level = 0;
-    } else {
-        snprintf(snd_msg, 256, SUBJECT, mailmsg->mail->subject);
+    if (mail->smtpserver[0] != '/') {
+        return OS_SmtpSend(mail, rcpt, buffer->data, buffer->length);
     }
 
-    if (sendmail) {
-        fprintf(sendmail, "%s", snd_msg);
-        fprintf(sendmail, ENDHEADER);
-    } else {
-        OS_SendTCP(socket, snd_msg);
-        OS_SendTCP(socket, ENDHEADER);
+    sendmail = popen(mail->smtpserver, "w");
+    if (!sendmail) {
+        return (OS_INVALID);
     }
 
-    /* Send body */
+    fwrite(buffer->data, 1, buffer->length, sendmail);
 
-    /* Send multiple emails together if we have to */
-    do {
-        if (sendmail) {
-            fprintf(sendmail, "%s", mailmsg->mail->body);
-        } else {
-            OS_SendTCP(socket, mailmsg->mail->body);
-        }
-        mailmsg = OS_PopLastMail();
-    } while (mailmsg);
+    if (pclose(sendmail) == -1) {
+        merror(WAITPID_ERROR, errno, strerror(errno));
+    }
 
-    if (sendmail) {
-        if (pclose(sendmail) == -1) {
-            merror(WAITPID_ERROR,errno, strerror(errno));
-        }
-    } else {
-        /* Send end of data \r\n.\r\n */
-        OS_SendTCP(socket, ENDDATA);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
-        if (mail->strict_checking && ((msg == NULL) || (!OS_Match(VALIDMAIL, msg)))) {
-            merror(END_DATA_ERROR);
-            if (msg) {
-                free(msg);
-            }
-            close(socket);
-            return (OS_INVALID);
-        }
+    return (0);
+}
 
-        /* Check msg, since it may be null */
-        if (msg) {
-            free(msg);
-        }
+/* Append formatted text to an e-mail */
+static void mail_append(mail_buffer *buffer, const char *format, ...)
+{
+    va_list args;
+    int length;
 
-        /* Quit and close socket */
-        OS_SendTCP(socket, QUITMSG);
-        msg = OS_RecvTCP(socket, OS_SIZE_1024);
+    va_start(args, format);
+    length = vsnprintf(buffer->data ? buffer->data + buffer->length : NULL, buffer->size - buffer->length, format, args);
+    va_end(args);
 
-        if (msg) {
-            free(msg);
-        }
+    if (length < 0) {
+        return;
+    }
+
+    if (buffer->length + length >= buffer->size) {
+        buffer->size = buffer->length + length + OS_SIZE_8192;
+        os_realloc(buffer->data, buffer->size, buffer->data);
 
-        close(socket);
+        va_start(args, format);
+        vsnprintf(buffer->data + buffer->length, buffer->size - buffer->length, format, args);
+        va_end(args);
     }
 
-    memset_secure(snd_msg, '\0', 256);
-    return (0);
+    buffer->length += length;
+}
+
+/* Check whether an email goes to a granular recipient */
+static int mail_gran(const MailMsg *msg, int i)
+{
+    return msg->gran && msg->gran[i];
 }
@@ -0,0 +1,405 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+/* SMTP session, kept open between e-mails */
+
+#include "shared.h"
+#include "os_net/os_net.h"
+#include "maild.h"
+
+/* Return codes (from SMTP server) */
+#define VALIDBANNER     220
+#define VALIDMAIL       250
+#define VALIDDATA       354
+#define CLOSING         421
+
+/* Default values used to connect */
+#define SMTP_DEFAULT_PORT   25
+#define EHLOMSG             "EHLO %s\r\n"
+#define HELOMSG             "Helo %s\r\n"
+#define MAILFROM            "Mail From: <%s>\r\n"
+#define RCPTTO              "Rcpt To: <%s>\r\n"
+#define DATAMSG             "DATA\r\n"
+#define ENDDATA             "\r\n.\r\n"
+#define QUITMSG             "QUIT\r\n"
+#define HELO_DEFAULT        "notify.ossec.net"
+
+/* Error messages - Can be translated */
+#define BANNER_ERROR    "(1762): Banner not received from server"
+#define HELO_ERROR      "(1763): Hello not accepted by server"
+#define FROM_ERROR      "(1764): Mail from not accepted by server"
+#define TO_ERROR        "(1765): RCPT TO not accepted by server - '%s'."
+#define DATA_ERROR      "(1766): DATA not accepted by server"
+#define END_DATA_ERROR  "(1767): End of DATA not accepted by server"
+#define NORCPT_ERROR    "No recipient accepted by server"
+
+/* Results of a transaction */
+#define SMTP_SENT       0
+#define SMTP_ERROR      -1
+#define SMTP_LOST       -2      /* The connection was lost before the data was accepted */
+
+static struct {
+    int socket;
+    int pipelining;             /* The server takes the commands without waiting for each reply */
+    time_t last;                /* End of the last transaction */
+    size_t length;
+    char input[OS_SIZE_4096];
+} session = { .socket = -1 };
+
+static int smtp_connect(const MailConfig *mail);
+static int smtp_transaction(const MailConfig *mail, char **rcpt, const char *data, size_t length);
+static int smtp_step(char **rcpt, int step, int *accepted);
+static int smtp_write(const char *data, size_t length);
+static int smtp_command(const char *format, const char *arg);
+static int smtp_reply(char *text, size_t size);
+static int smtp_keyword(const char *text, const char *keyword);
+static void smtp_quit(void);
+static void smtp_drop(void);
+
+
+/* Send a message through the SMTP session, and open it if needed.
+ * A session that was closed by the server while idle is opened again.
+ */
+int OS_SmtpSend(const MailConfig *mail, char **rcpt, const char *data, size_t length)
+{
+    int reused = session.socket >= 0;
+    int result;
+
+    result = smtp_transaction(mail, rcpt, data, length);
+
+    if (result == SMTP_LOST && reused) {
+        mdebug1("The SMTP session was closed by the server. Connecting again.");
+        result = smtp_transaction(mail, rcpt, data, length);
+    }
+
+    if (result == SMTP_LOST) {
+        merror("Connection to the SMTP server '%s' was lost.", mail->smtpserver);
+    }
+
+    if (result != SMTP_SENT || !mail->smtp_keepalive) {
+        smtp_quit();
+    } else {
+        session.last = time(NULL);
+    }
+
+    return result == SMTP_SENT ? 0 : OS_INVALID;
+}
+
+/* Close the SMTP session once it has been idle for the keepalive time */
+void OS_SmtpIdle(const MailConfig *mail)
+{
+    if (session.socket >= 0 && time(NULL) - session.last >= mail->smtp_keepalive) {
+        mdebug2("Closing the idle SMTP session.");
+        smtp_quit();
+    }
+}
+
+/* Connect to the server, and greet it
+ * Returns 0 on success or -1 on error
+ */
+static int smtp_connect(const MailConfig *mail)
+{
+    const char *helo = mail->heloserver ? mail->heloserver : HELO_DEFAULT;
+    char reply[OS_SIZE_2048];
+    int code;
+
+    session.socket = OS_ConnectTCP(SMTP_DEFAULT_PORT, mail->smtpserver, 0);
+    if (session.socket < 0) {
+        session.socket = -1;
+        return -1;
+    }
+
+    if (OS_SetRecvTimeout(session.socket, SOCK_RECV_TIME0, 0) < 0) {
+        merror("Couldn't set receiving timeout for socket.");
+    }
+
+    session.length = 0;
+    session.pipelining = 0;
+
+    /* Receive the banner */
+    if (smtp_reply(reply, sizeof(reply)) != VALIDBANNER) {
+        merror(BANNER_ERROR);
+        goto fail;
+    }
+
+    /* Ask for the extensions of the server, to pipeline the commands */
+    if (smtp_command(EHLOMSG, helo) < 0) {
+        merror("%s:%s", HELO_ERROR, "null");
+        goto fail;
+    }
+
+    code = smtp_reply(reply, sizeof(reply));
+
+    /* In some cases (with virus scans in the middle)
+     * we may get two banners. Check for that in here.
+     */
+    if (code == VALIDBANNER) {
+        code = smtp_reply(reply, sizeof(reply));
+    }
+
+    if (code == VALIDMAIL) {
+        session.pipelining = smtp_keyword(reply, "PIPELINING");
+    } else if (code >= 500) {
+        /* The server doesn't know ESMTP */
+        if (smtp_command(HELOMSG, helo) < 0 || (code = smtp_reply(reply, sizeof(reply)), code != VALIDMAIL)) {
+            merror("%s:%s", HELO_ERROR, code < 0 ? "null" : reply);
+            goto fail;
+        }
+    } else {
+        merror("%s:%s", HELO_ERROR, code < 0 ? "null" : reply);
+        goto fail;
+    }
+
+    mdebug1("Connected to the SMTP server '%s'%s.", mail->smtpserver, session.pipelining ? " (pipelining)" : "");
+    return 0;
+
+fail:
+    smtp_drop();
+    return -1;
+}
+
+/* Send a message: MAIL, each RCPT and DATA are steps that get a reply.
+ * With pipelining all of them are written before reading the replies.
+ */
+static int smtp_transaction(const MailConfig *mail, char **rcpt, const char *data, size_t length)
+{
+    char reply[OS_SIZE_1024];
+    int accepted = 0;
+    int steps;
+    int result;
+    int i;
+
+    if (session.socket < 0 && smtp_connect(mail) < 0) {
+        return SMTP_ERROR;
+    }
+
+    for (steps = 2; rcpt[steps - 2]; steps++);
+
+    for (i = 0; i < steps; i++) {
+        if (i == 0) {
+            result = smtp_command(MAILFROM, mail->from);
+        } else if (rcpt[i - 1]) {
+            result = smtp_command(RCPTTO, rcpt[i - 1]);
+        } else if (!session.pipelining && !accepted) {
+            merror(NORCPT_ERROR);
+            return SMTP_ERROR;
+        } else {
+            result = smtp_write(DATAMSG, strlen(DATAMSG));
+        }
+
+        if (result < 0) {
+            return SMTP_LOST;
+        }
+
+        if (!session.pipelining && (result = smtp_step(rcpt, i, &accepted), result != SMTP_SENT)) {
+            return result;
+        }
+    }
+
+    for (i = 0; session.pipelining && i < steps; i++) {
+        if (result = smtp_step(rcpt, i, &accepted), result != SMTP_SENT) {
+            return result;
+        }
+    }
+
+    if (!accepted) {
+        /* The server took DATA without recipients. It can't be ended cleanly. */
+        merror(NORCPT_ERROR);
+        smtp_drop();
+        return SMTP_ERROR;
+    }
+
+    /* Send the message and the end of data \r\n.\r\n */
+    if (smtp_write(data, length) < 0 || smtp_write(ENDDATA, strlen(ENDDATA)) < 0) {
+        if (mail->strict_checking) {
+            merror(END_DATA_ERROR);
+            return SMTP_ERROR;
+        }
+
+        return SMTP_SENT;
+    }
+
+    if (smtp_reply(reply, sizeof(reply)) != VALIDMAIL && mail->strict_checking) {
+        merror(END_DATA_ERROR);
+        return SMTP_ERROR;
+    }
+
+    return SMTP_SENT;
+}
+
+/* Check the reply to a step of a transaction
+ * Returns SMTP_SENT to go on, SMTP_ERROR or SMTP_LOST
+ */
+static int smtp_step(char **rcpt, int step, int *accepted)
+{
+    char reply[OS_SIZE_1024];
+    int code;
+
+    if (code = smtp_reply(reply, sizeof(reply)), code < 0 || code == CLOSING) {
+        smtp_drop();
+        return SMTP_LOST;
+    }
+
+    if (step == 0) {
+        if (code != VALIDMAIL) {
+            merror(FROM_ERROR);
+            return SMTP_ERROR;
+        }
+    } else if (rcpt[step - 1]) {
+        /* A rejected recipient doesn't hold back the others */
+        if (code / 100 == 2) {
+            (*accepted)++;
+        } else {
+            merror(TO_ERROR, rcpt[step - 1]);
+        }
+    } else if (code != VALIDDATA) {
+        merror(*accepted ? DATA_ERROR : NORCPT_ERROR);
+        return SMTP_ERROR;
+    }
+
+    return SMTP_SENT;
+}
+
+/* Write data to the server
+ * Returns 0 on success or -1 on error
+ */
+static int smtp_write(const char *data, size_t length)
+{
+    ssize_t n;
+
+    while (length > 0) {
+        if (n = send(session.socket, data, length, MSG_NOSIGNAL), n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            mdebug1("Couldn't send data to the SMTP server: %s (%d)", strerror(errno), errno);
+            smtp_drop();
+            return -1;
+        }
+
+        data += n;
+        length -= n;
+    }
+
+    return 0;
+}
+
+/* Write a command that takes an argument */
+static int smtp_command(const char *format, const char *arg)
+{
+    char command[OS_SIZE_1024];
+    int length;
+
+    length = snprintf(command, sizeof(command), format, arg);
+
+    if (length < 0 || (size_t)length >= sizeof(command)) {
+        merror("SMTP command too long: '%s'", arg);
+        return -1;
+    }
+
+    return smtp_write(command, length);
+}
+
+/* Read a reply. The lines of a multiline reply are joined in the text.
+ * Returns the reply code, or -1 on error.
+ */
+static int smtp_reply(char *text, size_t size)
+{
+    size_t used = 0;
+    size_t line;
+    char *eol;
+    ssize_t n;
+    int code;
+    int last;
+
+    *text = '\0';
+
+    while (1) {
+        while (eol = memchr(session.input, '\n', session.length), !eol) {
+            if (session.socket < 0 || session.length == sizeof(session.input)) {
+                return -1;
+            }
+
+            if (n = recv(session.socket, session.input + session.length, sizeof(session.input) - session.length, 0), n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                return -1;
+            }
+
+            session.length += n;
+        }
+
+        line = eol - session.input + 1;
+
+        if (line < 4 || !isdigit((unsigned char)session.input[0]) || !isdigit((unsigned char)session.input[1]) || !isdigit((unsigned char)session.input[2])) {
+            return -1;
+        }
+
+        code = (session.input[0] - '0') * 100 + (session.input[1] - '0') * 10 + session.input[2] - '0';
+        last = session.input[3] != '-';
+
+        if (used + line < size) {
+            memcpy(text + used, session.input, line);
+            used += line;
+            text[used] = '\0';
+        }
+
+        session.length -= line;
+        memmove(session.input, session.input + line, session.length);
+
+        if (last) {
+            return code;
+        }
+    }
+}
+
+/* Look for a keyword in the lines of an EHLO reply */
+static int smtp_keyword(const char *text, const char *keyword)
+{
+    size_t length = strlen(keyword);
+    const char *line;
+
+    for (line = text; *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : line + strlen(line)) {
+        if (strlen(line) > 4 + length && !strncasecmp(line + 4, keyword, length) && strchr(" \r\n", line[4 + length])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* End the session politely */
+static void smtp_quit()
+{
+    char reply[OS_SIZE_1024];
+
+    if (session.socket < 0) {
+        return;
+    }
+
+    if (smtp_write(QUITMSG, strlen(QUITMSG)) == 0) {
+        smtp_reply(reply, sizeof(reply));
+    }
+
+    smtp_drop();
+}
+
+/* Close the connection */
+static void smtp_drop()
+{
+    if (session.socket >= 0) {
+        close(session.socket);
+        session.socket = -1;
+    }
+
+    session.length = 0;
+}
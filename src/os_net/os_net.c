@@ -22,7 +22,7 @@
 #endif
 
 /* Prototypes */
-static int OS_Bindport(u_int16_t _port, unsigned int _proto, const char *_ip, int ipv6);
+static int OS_Bindport(u_int16_t _port, unsigned int _proto, const char *_ip, int ipv6, int reuseport);
 static int OS_Connect(u_int16_t _port, unsigned int protocol, const char *_ip, int ipv6);
 
 /* Unix socket -- not for windows */
@@ -45,11 +45,26 @@ static int OS_Connect(u_int16_t _port, unsigned int protocol, const char *_ip, i
 #define RECV_SOCK 0
 #define SEND_SOCK 1
 
+#ifndef WIN32
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#else
+struct iovec {
+    void * iov_base;
+    size_t iov_len;
+};
+#endif
+
+static int os_send_iov(int sock, struct iovec * iov, int count);
+static int os_secure_frame(const os_secure_reader_t * reader, uint32_t * length);
+
 
 /* Bind a specific port */
-static int OS_Bindport(u_int16_t _port, unsigned int _proto, const char *_ip, int ipv6)
+static int OS_Bindport(u_int16_t _port, unsigned int _proto, const char *_ip, int ipv6, int reuseport)
 {
     int ossock;
+    int flag = 1;
     struct sockaddr_in server;
 
 #ifndef WIN32
@@ -67,7 +82,6 @@ static int OS_Bindport(u_int16_t _port, unsigned int _proto, const char *_ip, in
             return OS_SOCKTERR;
         }
     } else if (_proto == IPPROTO_TCP) {
-        int flag = 1;
 #ifndef WIN32
         if ((ossock = socket(ipv6 == 1 ? PF_INET6 : PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
 #else
@@ -85,6 +99,19 @@ static int OS_Bindport(u_int16_t _port, unsigned int _proto, const char *_ip, in
         return (OS_INVALID);
     }
 
+#ifdef SO_REUSEPORT
+    if (reuseport && setsockopt(ossock, SOL_SOCKET, SO_REUSEPORT,
+                                (char *)&flag, sizeof(flag)) < 0) {
+        OS_CloseSocket(ossock);
+        return (OS_SOCKTERR);
+    }
+#else
+    if (reuseport) {
+        OS_CloseSocket(ossock);
+        return (OS_INVALID);
+    }
+#endif
+
     if (ipv6) {
 #ifndef WIN32
         memset(&server6, 0, sizeof(server6));
@@ -127,13 +154,25 @@ static int OS_Bindport(u_int16_t _port, unsigned int _proto, const char *_ip, in
 /* Bind a TCP port, using the OS_Bindport */
 int OS_Bindporttcp(u_int16_t _port, const char *_ip, int ipv6)
 {
-    return (OS_Bindport(_port, IPPROTO_TCP, _ip, ipv6));
+    return (OS_Bindport(_port, IPPROTO_TCP, _ip, ipv6, 0));
+}
+
+/* Bind a TCP port that other sockets can share, using the OS_Bindport */
+int OS_Bindporttcp_reuse(u_int16_t _port, const char *_ip, int ipv6)
+{
+    return (OS_Bindport(_port, IPPROTO_TCP, _ip, ipv6, 1));
 }
 
 /* Bind a UDP port, using the OS_Bindport */
 int OS_Bindportudp(u_int16_t _port, const char *_ip, int ipv6)
 {
-    return (OS_Bindport(_port, IPPROTO_UDP, _ip, ipv6));
+    return (OS_Bindport(_port, IPPROTO_UDP, _ip, ipv6, 0));
+}
+
+/* Bind a UDP port that other sockets can share, using the OS_Bindport */
+int OS_Bindportudp_reuse(u_int16_t _port, const char *_ip, int ipv6)
+{
+    return (OS_Bindport(_port, IPPROTO_UDP, _ip, ipv6, 1));
 }
 
 #ifndef WIN32
@@ -502,6 +541,138 @@ int OS_SendUnix(int socket, const char *msg, int size)
 
     return (OS_SUCCESS);
 }
+
+/* Receive up to n messages via a Unix socket, in a single call where possible
+ * Every buffer must hold sizet + 1 bytes. Returns the number of messages, or 0 on error
+ */
+int OS_RecvUnixBatch(int socket, int sizet, char **buffers, int *lengths, int n, int flags)
+{
+#ifdef __linux__
+    struct mmsghdr hdr[n];
+    struct iovec iov[n];
+    int recvd;
+    int i;
+
+    memset(hdr, 0, sizeof(hdr));
+
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = sizet - 1;
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Wait for the first message only */
+    if (recvd = recvmmsg(socket, hdr, n, flags | MSG_WAITFORONE, NULL), recvd < 0) {
+        return (0);
+    }
+
+    for (i = 0; i < recvd; i++) {
+        lengths[i] = (int)hdr[i].msg_len;
+        buffers[i][lengths[i]] = '\0';
+    }
+
+    return (recvd);
+#else
+    ssize_t recvd;
+
+    if (n < 1 || (recvd = recv(socket, buffers[0], sizet - 1, flags)) < 0) {
+        return (0);
+    }
+
+    lengths[0] = (int)recvd;
+    buffers[0][recvd] = '\0';
+    return (1);
+#endif
+}
+
+/* Send n messages using a Unix socket, in a single call where possible
+ * Returns the number of messages sent. If it's less than n, errno tells why
+ */
+int OS_SendUnixBatch(int socket, char * const *msgs, const int *sizes, int n)
+{
+    int sent = 0;
+
+#ifdef __linux__
+    struct mmsghdr hdr[n];
+    struct iovec iov[n];
+    int i;
+    int result;
+
+    memset(hdr, 0, sizeof(hdr));
+
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = msgs[i];
+        iov[i].iov_len = sizes[i];
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (sent < n) {
+        if (result = sendmmsg(socket, hdr + sent, n - sent, 0), result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        sent += result;
+    }
+#else
+    while (sent < n && send(socket, msgs[sent], sizes[sent], 0) == sizes[sent]) {
+        sent++;
+    }
+#endif
+
+    return (sent);
+}
+
+/* Receive up to n datagrams via a UDP socket, in a single call where possible
+ * Every buffer must hold sizet + 1 bytes. Returns the number of datagrams, or 0 on error
+ */
+int OS_RecvUDPBatch(int socket, int sizet, char **buffers, int *lengths, struct sockaddr_in *peers, int n)
+{
+#ifdef __linux__
+    struct mmsghdr hdr[n];
+    struct iovec iov[n];
+    int recvd;
+    int i;
+
+    memset(hdr, 0, sizeof(hdr));
+
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = sizet;
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+        hdr[i].msg_hdr.msg_name = &peers[i];
+        hdr[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+
+    /* Wait for the first datagram only */
+    if (recvd = recvmmsg(socket, hdr, n, MSG_WAITFORONE, NULL), recvd < 0) {
+        return (0);
+    }
+
+    for (i = 0; i < recvd; i++) {
+        lengths[i] = (int)hdr[i].msg_len;
+        buffers[i][lengths[i]] = '\0';
+    }
+
+    return (recvd);
+#else
+    socklen_t peer_size = sizeof(struct sockaddr_in);
+    ssize_t recvd;
+
+    if (n < 1 || (recvd = recvfrom(socket, buffers[0], sizet, 0, (struct sockaddr *)&peers[0], &peer_size)) < 0) {
+        return (0);
+    }
+
+    lengths[0] = (int)recvd;
+    buffers[0][recvd] = '\0';
+    return (1);
+#endif
+}
 #endif
 
 /* Calls gethostbyname (tries x attempts) */
@@ -634,17 +805,72 @@ int OS_SetSendTimeout(int socket, int seconds)
  * Return 0 on success or OS_SOCKTERR on error.
  */
 int OS_SendSecureTCP(int sock, uint32_t size, const void * msg) {
-    int retval;
-    void * buffer;
-    size_t bufsz = size + sizeof(uint32_t);
+    uint32_t header = wnet_order(size);
+    struct iovec iov[2] = {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)msg, .iov_len = size }
+    };
+
+    return os_send_iov(sock, iov, 2);
+}
+
+/* Send many secure TCP messages in a single call where possible
+ * Return 0 on success or OS_SOCKTERR on error.
+ */
+int OS_SendSecureTCPBatch(int sock, char * const * msgs, const uint32_t * sizes, int n) {
+    if (n <= 0) {
+        return 0;
+    }
+
+    uint32_t headers[n];
+    struct iovec iov[2 * n];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        headers[i] = wnet_order(sizes[i]);
+        iov[2 * i].iov_base = &headers[i];
+        iov[2 * i].iov_len = sizeof(uint32_t);
+        iov[2 * i + 1].iov_base = msgs[i];
+        iov[2 * i + 1].iov_len = sizes[i];
+    }
+
+    return os_send_iov(sock, iov, 2 * n);
+}
+
+/* Write a list of buffers, without copying them together
+ * Return 0 on success or OS_SOCKTERR on error.
+ */
+static int os_send_iov(int sock, struct iovec * iov, int count) {
+    ssize_t sent;
 
-    os_malloc(bufsz, buffer);
-    *(uint32_t *)buffer = wnet_order(size);
-    memcpy(buffer + sizeof(uint32_t), msg, size);
     errno = 0;
-    retval = send(sock, buffer, bufsz, 0) == (ssize_t)bufsz ? 0 : OS_SOCKTERR;
-    free(buffer);
-    return retval;
+
+    while (count > 0) {
+#ifndef WIN32
+        struct msghdr hdr = { .msg_iov = iov, .msg_iovlen = count < IOV_MAX ? count : IOV_MAX };
+
+        if (sent = sendmsg(sock, &hdr, 0), sent < 0) {
+#else
+        if (sent = send(sock, iov->iov_base, iov->iov_len, 0), sent < 0) {
+#endif
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return OS_SOCKTERR;
+        }
+
+        for (; count > 0 && (size_t)sent >= iov->iov_len; count--, iov++) {
+            sent -= iov->iov_len;
+        }
+
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+
+    return 0;
 }
 
 
@@ -688,6 +914,110 @@ int OS_RecvSecureTCP(int sock, char * ret,uint32_t size) {
     return recvb;
 }
 
+/* Allocate a reader for messages of up to max_size bytes */
+void OS_SecureReaderInit(os_secure_reader_t * reader, uint32_t max_size) {
+    reader->size = (size_t)max_size + sizeof(uint32_t);
+    os_malloc(reader->size + 1, reader->data);
+    OS_SecureReaderReset(reader);
+}
+
+/* Drop the data of a reader, when its socket is closed or replaced */
+void OS_SecureReaderReset(os_secure_reader_t * reader) {
+    reader->start = 0;
+    reader->end = 0;
+    reader->held = -1;
+}
+
+void OS_SecureReaderFree(os_secure_reader_t * reader) {
+    os_free(reader->data);
+    reader->size = 0;
+    OS_SecureReaderReset(reader);
+}
+
+/* Return 1 if a whole message was already received, or 0 if not */
+int OS_SecureReaderPending(const os_secure_reader_t * reader) {
+    uint32_t length;
+    return os_secure_frame(reader, &length) != 0;
+}
+
+/* Check the message at the start of a reader
+ * Return 1 if it was fully received, 0 if not, or -1 if it's bigger than the reader.
+ */
+static int os_secure_frame(const os_secure_reader_t * reader, uint32_t * length) {
+    if (reader->end - reader->start < sizeof(uint32_t)) {
+        return 0;
+    }
+
+    memcpy(length, reader->data + reader->start, sizeof(uint32_t));
+
+    /* The first byte may be under the terminator of the last message */
+    if (reader->held >= 0) {
+        *(unsigned char *)length = (unsigned char)reader->held;
+    }
+
+    *length = wnet_order(*length);
+
+    if (*length > reader->size - sizeof(uint32_t)) {
+        return -1;
+    }
+
+    return reader->end - reader->start - sizeof(uint32_t) >= *length;
+}
+
+/* Receive up to n secure TCP messages, and wait for the first one only
+ * Return the number of messages, 0 on socket disconnected or timeout, -1 on socket error,
+ * or OS_SOCKTERR if a message is bigger than the reader.
+ */
+int OS_RecvSecureTCPBatch(int sock, os_secure_reader_t * reader, char ** msgs, uint32_t * lengths, int n) {
+    uint32_t length;
+    ssize_t recvb;
+    int count;
+    int i;
+
+    if (reader->held >= 0) {
+        reader->data[reader->start] = (char)reader->held;
+        reader->held = -1;
+    }
+
+    /* A single large read usually brings many messages */
+    while (count = os_secure_frame(reader, &length), count == 0) {
+        if (reader->start > 0) {
+            memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+
+        if (recvb = recv(sock, reader->data + reader->end, reader->size - reader->end, 0), recvb <= 0) {
+            if (recvb < 0 && errno == EINTR) {
+                continue;
+            }
+
+            return recvb;
+        }
+
+        reader->end += recvb;
+    }
+
+    if (count < 0) {
+        return OS_SOCKTERR;
+    }
+
+    for (count = 0; count < n && os_secure_frame(reader, &length) == 1; count++) {
+        msgs[count] = reader->data + reader->start + sizeof(uint32_t);
+        lengths[count] = length;
+        reader->start += sizeof(uint32_t) + length;
+    }
+
+    /* Each terminator lands on the header of the next message, which was already read */
+    reader->held = reader->start < reader->end ? (unsigned char)reader->data[reader->start] : -1;
+
+    for (i = 0; i < count; i++) {
+        msgs[i][lengths[i]] = '\0';
+    }
+
+    return count;
+}
+
 // Byte ordering
 
 uint32_t wnet_order(uint32_t value) {
@@ -755,11 +1085,11 @@ int OS_SendSecureTCPCluster(int sock, const void * command, const void * payload
     const unsigned COMMAND_SIZE = 12;
     const unsigned HEADER_SIZE =  8;
     const unsigned MAX_PAYLOAD_SIZE = 1000000;
-    int retval;
-    char * buffer = NULL;
+    char header[HEADER_SIZE + COMMAND_SIZE];
+    struct iovec iov[2];
     uint32_t counter = (uint32_t)os_random();
+    uint32_t value;
     size_t cmd_length = 0;
-    size_t buffer_size = 0;
 
     if(!command){
         merror("Empty command, not sending message to cluster");
@@ -779,19 +1109,20 @@ int OS_SendSecureTCPCluster(int sock, const void * command, const void * payload
     }
 
     // Cluster message: [counter:4][length:4][command:12][payload]
-    buffer_size = HEADER_SIZE + COMMAND_SIZE + length;
-    os_malloc(buffer_size, buffer);
-    *(uint32_t *)buffer = wnet_order_big(counter);
-    *(uint32_t *)(buffer + 4) = wnet_order_big(length);
-    memcpy(buffer + HEADER_SIZE, command, cmd_length);
-    buffer[HEADER_SIZE + cmd_length] = ' ';
-    memset(buffer + HEADER_SIZE + cmd_length + 1, '-', COMMAND_SIZE - cmd_length - 1);
-    memcpy(buffer + HEADER_SIZE + COMMAND_SIZE, payload, length);
-
-    retval = send(sock, buffer, buffer_size, 0) == (ssize_t)buffer_size ? 0 : OS_SOCKTERR;
-
-    free(buffer);
-    return retval;
+    value = wnet_order_big(counter);
+    memcpy(header, &value, sizeof(value));
+    value = wnet_order_big(length);
+    memcpy(header + 4, &value, sizeof(value));
+    memcpy(header + HEADER_SIZE, command, cmd_length);
+    header[HEADER_SIZE + cmd_length] = ' ';
+    memset(header + HEADER_SIZE + cmd_length + 1, '-', COMMAND_SIZE - cmd_length - 1);
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = HEADER_SIZE + COMMAND_SIZE;
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = length;
+
+    return os_send_iov(sock, iov, 2);
 }
 
 
@@ -23,6 +23,20 @@
 int OS_Bindporttcp(u_int16_t _port, const char *_ip, int ipv6);
 int OS_Bindportudp(u_int16_t _port, const char *_ip, int ipv6);
 
+/* OS_Bindporttcp_reuse
+ * Bind a TCP port with SO_REUSEPORT, so that several listening sockets
+ * share it and the kernel spreads the incoming connections among them.
+ * Return the socket, or OS_INVALID if the system has no SO_REUSEPORT.
+ */
+int OS_Bindporttcp_reuse(u_int16_t _port, const char *_ip, int ipv6);
+
+/* OS_Bindportudp_reuse
+ * Bind a UDP port with SO_REUSEPORT, so that several sockets share it
+ * and the kernel spreads the incoming datagrams among them by source.
+ * Return the socket, or OS_INVALID if the system has no SO_REUSEPORT.
+ */
+int OS_Bindportudp_reuse(u_int16_t _port, const char *_ip, int ipv6);
+
 /* OS_BindUnixDomain
  * Bind to a specific file, using the "mode" permissions in
  * a Unix Domain socket.
@@ -48,6 +62,19 @@ int OS_RecvConnUDP(int socket, char *buffer, int buffer_size) __attribute__((non
  */
 int OS_RecvUnix(int socket, int sizet, char *ret) __attribute__((nonnull));
 
+/* OS_RecvUnixBatch
+ * Receive up to n messages via a Unix socket. Every buffer must hold sizet + 1 bytes
+ * Returns the number of messages, or 0 on error
+ */
+int OS_RecvUnixBatch(int socket, int sizet, char **buffers, int *lengths, int n, int flags) __attribute__((nonnull));
+
+/* OS_RecvUDPBatch
+ * Receive up to n datagrams via a UDP socket, along with their sources.
+ * Every buffer must hold sizet + 1 bytes
+ * Returns the number of datagrams, or 0 on error
+ */
+int OS_RecvUDPBatch(int socket, int sizet, char **buffers, int *lengths, struct sockaddr_in *peers, int n) __attribute__((nonnull));
+
 /* OS_RecvTCP
  * Receive a TCP packet
  */
@@ -63,6 +90,9 @@ int OS_SendTCPbySize(int socket, int size, const char *msg) __attribute__((nonnu
 
 int OS_SendUnix(int socket, const char *msg, int size) __attribute__((nonnull));
 
+/* Send n messages using a Unix socket. Returns the number of messages sent */
+int OS_SendUnixBatch(int socket, char * const *msgs, const int *sizes, int n) __attribute__((nonnull));
+
 int OS_SendUDPbySize(int socket, int size, const char *msg) __attribute__((nonnull));
 
 /* OS_GetHost
@@ -114,6 +144,40 @@ int OS_SendSecureTCP(int sock, uint32_t size, const void * msg);
  */
 int OS_RecvSecureTCP(int sock, char * ret,uint32_t size);
 
+/* Send many secure TCP messages in a single call where possible
+ * Return 0 on success or OS_SOCKTERR on error.
+ */
+int OS_SendSecureTCPBatch(int sock, char * const * msgs, const uint32_t * sizes, int n);
+
+/* Reader of the secure TCP messages of a socket. It reads as much as it can
+ * at once, and returns the messages from its buffer in place.
+ */
+typedef struct os_secure_reader_t {
+    char * data;
+    size_t size;                // Maximum message size plus the header
+    size_t start;               // First byte not returned yet
+    size_t end;                 // End of the data received
+    int held;                   // Byte under the terminator of the last message, or -1
+} os_secure_reader_t;
+
+/* Allocate a reader for messages of up to max_size bytes */
+void OS_SecureReaderInit(os_secure_reader_t * reader, uint32_t max_size);
+
+/* Drop the data of a reader, when its socket is closed or replaced */
+void OS_SecureReaderReset(os_secure_reader_t * reader);
+
+void OS_SecureReaderFree(os_secure_reader_t * reader);
+
+/* Return 1 if a whole message was already received, or 0 if not */
+int OS_SecureReaderPending(const os_secure_reader_t * reader);
+
+/* Receive up to n secure TCP messages, and wait for the first one only
+ * The messages are NUL-terminated and point into the reader, until the next call.
+ * Return the number of messages, 0 on socket disconnected or timeout, -1 on socket error,
+ * or OS_SOCKTERR if a message is bigger than the reader.
+ */
+int OS_RecvSecureTCPBatch(int sock, os_secure_reader_t * reader, char ** msgs, uint32_t * lengths, int n);
+
 
 /* Send secure TCP Cluster message
  * Return 0 on success or OS_SOCKTERR on error.
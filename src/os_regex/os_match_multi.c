@@ -0,0 +1,424 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All right reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "os_regex.h"
+#include "os_regex_internal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OS_MULTIMATCH_SSSE3
+#include <tmmintrin.h>
+#endif
+
+/* Above this number of distinct first bytes, skipping at the root doesn't pay off */
+#define OS_MULTIMATCH_SIMD_MAXSTART 48
+
+#define SET_ID(found, id) ((found)[(id) / 64] |= (uint64_t)1 << ((id) % 64))
+
+static size_t _os_multimatch_skip(const OSMultiMatch *reg, const uchar *str, size_t i, size_t len);
+static void _os_multimatch_build_start(OSMultiMatch *reg);
+
+#ifdef OS_MULTIMATCH_SSSE3
+static size_t _os_multimatch_skip_ssse3(const OSMultiMatch *reg, const uchar *str, size_t i, size_t len) __attribute__((target("ssse3")));
+#endif
+
+
+void OSMultiMatch_Init(OSMultiMatch *reg)
+{
+    memset(reg, 0, sizeof(OSMultiMatch));
+}
+
+int OSMultiMatch_Add(OSMultiMatch *reg, const char *literal, unsigned int id)
+{
+    char **literals;
+    unsigned int *ids;
+    char *pt;
+
+    if (*literal == '\0') {
+        reg->error = OS_REGEX_PATTERN_NULL;
+        return (0);
+    }
+
+    literals = (char **) realloc(reg->literals, (reg->n_literals + 1) * sizeof(char *));
+    if (!literals) {
+        reg->error = OS_REGEX_OUTOFMEMORY;
+        return (0);
+    }
+    reg->literals = literals;
+
+    ids = (unsigned int *) realloc(reg->literal_ids, (reg->n_literals + 1) * sizeof(unsigned int));
+    if (!ids) {
+        reg->error = OS_REGEX_OUTOFMEMORY;
+        return (0);
+    }
+    reg->literal_ids = ids;
+
+    if (reg->literals[reg->n_literals] = strdup(literal), !reg->literals[reg->n_literals]) {
+        reg->error = OS_REGEX_OUTOFMEMORY;
+        return (0);
+    }
+
+    /* Matching is always case insensitive */
+    for (pt = reg->literals[reg->n_literals]; *pt != '\0'; pt++) {
+        *pt = (char) charmap[(uchar) *pt];
+    }
+
+    reg->literal_ids[reg->n_literals++] = id;
+
+    if (id > reg->max_id) {
+        reg->max_id = id;
+    }
+
+    return (1);
+}
+
+int OSMultiMatch_AddMatch(OSMultiMatch *reg, const OSMatch *match, unsigned int id)
+{
+    size_t i;
+    unsigned int n_literals = reg->n_literals;
+
+    if (match->negate || !match->patterns || !match->patterns[0]) {
+        return (0);
+    }
+
+    /* "^abc", "abc$" and "^abc$" also need "abc" to be in the string */
+    for (i = 0; match->patterns[i]; i++) {
+        if (match->size[i] == 0) {
+            return (0);
+        }
+    }
+
+    for (i = 0; match->patterns[i]; i++) {
+        if (!OSMultiMatch_Add(reg, match->patterns[i], id)) {
+            /* Roll back the alternatives of this pattern */
+            while (reg->n_literals > n_literals) {
+                free(reg->literals[--reg->n_literals]);
+            }
+
+            return (0);
+        }
+    }
+
+    return (1);
+}
+
+int OSMultiMatch_Compile(OSMultiMatch *reg)
+{
+    unsigned int class_of[256] = { 0 };
+    unsigned int *fail = NULL;
+    unsigned int *queue = NULL;
+    unsigned int *end_state = NULL;
+    unsigned int max_states = 1;
+    unsigned int head = 0;
+    unsigned int tail = 0;
+    unsigned int i;
+    unsigned int c;
+    const uchar *pt;
+
+    if (reg->n_literals == 0) {
+        reg->error = OS_REGEX_PATTERN_NULL;
+        return (0);
+    }
+
+    /* One class per distinct (folded) byte, class 0 for the rest */
+    reg->n_classes = 1;
+
+    for (i = 0; i < reg->n_literals; i++) {
+        for (pt = (const uchar *) reg->literals[i]; *pt != '\0'; pt++) {
+            if (!class_of[*pt]) {
+                class_of[*pt] = reg->n_classes++;
+            }
+
+            max_states++;
+        }
+    }
+
+    if (max_states > OS_MULTIMATCH_MAXSTATES) {
+        reg->error = OS_REGEX_MAXSIZE;
+        return (0);
+    }
+
+    for (i = 0; i < 256; i++) {
+        reg->classes[i] = (unsigned char) class_of[charmap[i]];
+    }
+
+    reg->delta = (unsigned int *) calloc((size_t) max_states * reg->n_classes, sizeof(unsigned int));
+    reg->out_start = (unsigned int *) calloc(max_states + 1, sizeof(unsigned int));
+    reg->out_link = (unsigned int *) calloc(max_states, sizeof(unsigned int));
+    reg->outputs = (unsigned int *) calloc(reg->n_literals, sizeof(unsigned int));
+    fail = (unsigned int *) calloc(max_states, sizeof(unsigned int));
+    queue = (unsigned int *) calloc(max_states, sizeof(unsigned int));
+    end_state = (unsigned int *) calloc(reg->n_literals, sizeof(unsigned int));
+
+    if (!reg->delta || !reg->out_start || !reg->out_link || !reg->outputs || !fail || !queue || !end_state) {
+        reg->error = OS_REGEX_OUTOFMEMORY;
+        goto compile_error;
+    }
+
+    /* Trie. State 0 is the root, so a 0 transition means "no edge" */
+    reg->n_states = 1;
+
+    for (i = 0; i < reg->n_literals; i++) {
+        unsigned int state = 0;
+
+        for (pt = (const uchar *) reg->literals[i]; *pt != '\0'; pt++) {
+            unsigned int *next = &reg->delta[state * reg->n_classes + class_of[*pt]];
+
+            if (*next == 0) {
+                *next = reg->n_states++;
+            }
+
+            state = *next;
+        }
+
+        end_state[i] = state;
+        reg->out_start[state + 1]++;
+    }
+
+    /* Outputs of every state, as a compressed row */
+    for (i = 0; i < reg->n_states; i++) {
+        reg->out_start[i + 1] += reg->out_start[i];
+    }
+
+    for (i = 0; i < reg->n_literals; i++) {
+        reg->outputs[reg->out_start[end_state[i]]++] = reg->literal_ids[i];
+    }
+
+    for (i = reg->n_states; i > 0; i--) {
+        reg->out_start[i] = reg->out_start[i - 1];
+    }
+    reg->out_start[0] = 0;
+
+    /* Breadth-first: failure links and full transition table */
+    for (c = 0; c < reg->n_classes; c++) {
+        unsigned int next = reg->delta[c];
+
+        if (next) {
+            fail[next] = 0;
+            queue[tail++] = next;
+        }
+    }
+
+    while (head < tail) {
+        unsigned int state = queue[head++];
+        unsigned int suffix = fail[state];
+
+        reg->out_link[state] = reg->out_start[suffix] != reg->out_start[suffix + 1] ? suffix : reg->out_link[suffix];
+
+        for (c = 0; c < reg->n_classes; c++) {
+            unsigned int *next = &reg->delta[state * reg->n_classes + c];
+
+            if (*next) {
+                fail[*next] = reg->delta[suffix * reg->n_classes + c];
+                queue[tail++] = *next;
+            } else {
+                *next = reg->delta[suffix * reg->n_classes + c];
+            }
+        }
+    }
+
+    _os_multimatch_build_start(reg);
+
+    free(fail);
+    free(queue);
+    free(end_state);
+
+    /* The literals are not needed anymore */
+    for (i = 0; i < reg->n_literals; i++) {
+        free(reg->literals[i]);
+    }
+    free(reg->literals);
+    free(reg->literal_ids);
+    reg->literals = NULL;
+    reg->literal_ids = NULL;
+
+    return (1);
+
+compile_error:
+    free(fail);
+    free(queue);
+    free(end_state);
+    OSMultiMatch_FreePattern(reg);
+
+    return (0);
+}
+
+void OSMultiMatch_Execute(const char *str, size_t str_len, const OSMultiMatch *reg, uint64_t *found)
+{
+    const uchar *s = (const uchar *) str;
+    unsigned int state = 0;
+    unsigned int t;
+    unsigned int k;
+    size_t i = 0;
+
+    if (!reg->delta) {
+        return;
+    }
+
+    /* The OSMatch functions may read up to str_len or up to the
+     * terminator, whatever is farther.
+     */
+    while (i < str_len || s[i] != '\0') {
+        if (state == 0 && i < str_len) {
+            if (i = _os_multimatch_skip(reg, s, i, str_len), i == str_len) {
+                continue;
+            }
+        }
+
+        state = reg->delta[state * reg->n_classes + reg->classes[s[i++]]];
+
+        for (t = state; t; t = reg->out_link[t]) {
+            for (k = reg->out_start[t]; k < reg->out_start[t + 1]; k++) {
+                SET_ID(found, reg->outputs[k]);
+            }
+        }
+    }
+}
+
+void OSMultiMatch_FreePattern(OSMultiMatch *reg)
+{
+    unsigned int i;
+
+    if (reg->literals) {
+        for (i = 0; i < reg->n_literals; i++) {
+            free(reg->literals[i]);
+        }
+    }
+
+    free(reg->literals);
+    free(reg->literal_ids);
+    free(reg->delta);
+    free(reg->out_start);
+    free(reg->outputs);
+    free(reg->out_link);
+
+    reg->literals = NULL;
+    reg->literal_ids = NULL;
+    reg->delta = NULL;
+    reg->out_start = NULL;
+    reg->outputs = NULL;
+    reg->out_link = NULL;
+    reg->n_literals = 0;
+    reg->n_states = 0;
+}
+
+/* Bytes that leave the root, and their nibble masks for the SIMD filter.
+ * High nibbles with the same set of low nibbles share one of the 8 buckets;
+ * once they are exhausted the last one is shared, which only adds false
+ * positives to the filter.
+ */
+static void _os_multimatch_build_start(OSMultiMatch *reg)
+{
+    unsigned int lows[16] = { 0 };
+    unsigned int bucket_lows[8];
+    unsigned int n_buckets = 0;
+    unsigned int n_start = 0;
+    unsigned int b;
+    unsigned int h;
+    unsigned int l;
+
+    for (b = 0; b < 256; b++) {
+        reg->start[b] = reg->delta[reg->classes[b]] != 0;
+
+        if (reg->start[b]) {
+            lows[b >> 4] |= 1 << (b & 0xf);
+            n_start++;
+        }
+    }
+
+    memset(reg->start_lo, 0, sizeof(reg->start_lo));
+    memset(reg->start_hi, 0, sizeof(reg->start_hi));
+
+    for (h = 0; h < 16; h++) {
+        if (!lows[h]) {
+            continue;
+        }
+
+        for (b = 0; b < n_buckets && bucket_lows[b] != lows[h]; b++);
+
+        if (b == n_buckets) {
+            if (n_buckets < 8) {
+                bucket_lows[n_buckets++] = lows[h];
+            } else {
+                b = 7;
+            }
+        }
+
+        reg->start_hi[h] |= 1 << b;
+
+        for (l = 0; l < 16; l++) {
+            if (lows[h] & (1 << l)) {
+                reg->start_lo[l] |= 1 << b;
+            }
+        }
+    }
+
+    reg->use_simd = 0;
+
+#ifdef OS_MULTIMATCH_SSSE3
+    if (n_start <= OS_MULTIMATCH_SIMD_MAXSTART) {
+        __builtin_cpu_init();
+        reg->use_simd = __builtin_cpu_supports("ssse3");
+    }
+#endif
+}
+
+/* Get the next position, from i, where a literal may start */
+static size_t _os_multimatch_skip(const OSMultiMatch *reg, const uchar *str, size_t i, size_t len)
+{
+#ifdef OS_MULTIMATCH_SSSE3
+    if (reg->use_simd) {
+        return _os_multimatch_skip_ssse3(reg, str, i, len);
+    }
+#endif
+
+    while (i < len && !reg->start[str[i]]) {
+        i++;
+    }
+
+    return i;
+}
+
+#ifdef OS_MULTIMATCH_SSSE3
+static size_t _os_multimatch_skip_ssse3(const OSMultiMatch *reg, const uchar *str, size_t i, size_t len)
+{
+    const __m128i lo_mask = _mm_loadu_si128((const __m128i *) reg->start_lo);
+    const __m128i hi_mask = _mm_loadu_si128((const __m128i *) reg->start_hi);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    while (i + 16 <= len) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (str + i));
+        __m128i lo = _mm_shuffle_epi8(lo_mask, _mm_and_si128(chunk, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_mask, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble));
+        unsigned int candidates = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)) & 0xffff;
+
+        while (candidates) {
+            size_t j = i + __builtin_ctz(candidates);
+
+            if (reg->start[str[j]]) {
+                return j;
+            }
+
+            candidates &= candidates - 1;
+        }
+
+        i += 16;
+    }
+
+    while (i < len && !reg->start[str[i]]) {
+        i++;
+    }
+
+    return i;
+}
+#endif
@@ -15,15 +15,23 @@
 
 /* size_t */
 #include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
 
 /* OSRegex_Compile flags */
 #define OS_RETURN_SUBSTRING     0000200
 #define OS_CASE_SENSITIVE       0000400
+#define OS_REGEX_DFA            0001000
 
 /* Pattern maximum size */
 #define OS_PATTERN_MAXSIZE      20480
 
+/* Maximum number of states of a multi-literal automaton */
+#define OS_MULTIMATCH_MAXSTATES 65536
+
+/* Maximum number of states of a regex automaton */
+#define OS_REGEX_DFA_MAXSTATES  4096
+
 /* Error codes */
 #define OS_REGEX_REG_NULL       1
 #define OS_REGEX_PATTERN_NULL   2
@@ -48,14 +56,28 @@ typedef struct regex_matching {
     regex_dynamic_size d_size;
 } regex_matching;
 
+/* OSRegexDFA structure: deterministic automaton of a compiled OSRegex.
+ * It accepts every string where some sub pattern, read as a plain regular
+ * expression, matches, so the others can be discarded in linear time.
+ * Read-only once compiled.
+ */
+typedef struct _OSRegexDFA {
+    unsigned int n_states;          /* State 0 is dead, state 1 is the start */
+    unsigned int n_classes;
+    unsigned char classes[256];     /* Byte -> character class */
+    uint16_t *delta;                /* n_states * n_classes transitions */
+    unsigned char *accept;
+} OSRegexDFA;
+
 /* OSRegex structure */
 typedef struct _OSRegex {
     int error;
     char *raw;
     int *flags;
     char **patterns;
+    OSRegexDFA *dfa;                // Only with OS_REGEX_DFA
     const char ** *prts_closure;
-    pthread_mutex_t mutex;
+    pthread_mutex_t mutex;          // Only for executions without external regex_matching
     // Dynamic variables
     char **d_sub_strings;
     const char ***d_prts_str;
@@ -72,17 +94,64 @@ typedef struct _OSMatch {
     int (**match_fp)(const char *str, const char *str2, size_t str_len, size_t size);
 } OSMatch;
 
+/* OSMultiMatch structure: case insensitive Aho-Corasick automaton
+ * that finds, in one pass, which of many literals appear in a string.
+ * Read-only once compiled.
+ */
+typedef struct _OSMultiMatch {
+    int error;
+    unsigned int max_id;            /* Highest literal ID added */
+
+    /* Compilation input */
+    unsigned int n_literals;
+    char **literals;
+    unsigned int *literal_ids;
+
+    /* Automaton */
+    unsigned int n_states;
+    unsigned int n_classes;
+    unsigned char classes[256];     /* Byte -> character class (case folded) */
+    unsigned int *delta;            /* n_states * n_classes transitions */
+    unsigned int *out_start;        /* IDs ending at state s: outputs[out_start[s]..out_start[s+1]] */
+    unsigned int *outputs;
+    unsigned int *out_link;         /* Longest proper suffix state with outputs (0 = none) */
+
+    /* First byte filter for the root state */
+    unsigned char start[256];
+    unsigned char start_lo[16];
+    unsigned char start_hi[16];
+    int use_simd;
+} OSMultiMatch;
+
 /*** Prototypes ***/
 
 /* Compile a regular expression to be used later
  * Allowed flags are:
  *      - OS_CASE_SENSITIVE
  *      - OS_RETURN_SUBSTRING
+ *      - OS_REGEX_DFA: also build an automaton that discards the strings
+ *        no sub pattern can match before running the interpreter.
+ *        Strings that the interpreter matches in spite of the pattern
+ *        (e.g. "\w+\S\d" on "ab!") are not matched.
  * Returns 1 on success or 0 on error.
  * The error code is set on reg->error.
  */
 int OSRegex_Compile(const char *pattern, OSRegex *reg, int flags);
 
+/* Set OS_REGEX_DFA for every regex compiled from now on (enable != 0) */
+void OSRegex_SetDFA(int enable);
+
+/* Build the automaton of a compiled regex.
+ * Returns NULL if it would have more than OS_REGEX_DFA_MAXSTATES states.
+ */
+OSRegexDFA *OSRegexDFA_Compile(const OSRegex *reg) __attribute__((nonnull));
+
+/* Returns 1 if some sub pattern of the regex may match str, else 0 */
+int OSRegexDFA_Execute(const OSRegexDFA *dfa, const char *str) __attribute__((nonnull));
+
+/* Release an automaton */
+void OSRegexDFA_Free(OSRegexDFA *dfa);
+
 /* Compare an already compiled regular expression with
  * a not NULL string.
  * Returns end of str on success or NULL on error.
@@ -92,14 +161,25 @@ const char *OSRegex_Execute(const char *str, OSRegex *reg) __attribute__((nonnul
 
 /* Extension of OSRegex_Execute that allows to choose
  * external sub_strings and prts_str.
+ * With an external regex_match no lock is taken and the regex is only
+ * read, so it can be shared by many threads (one regex_match each).
+ * Otherwise the results are left in reg, under its mutex.
  * Returns end of str on success or NULL on error.
  * The error code is set on reg->error.
  */
  const char *OSRegex_Execute_ex(const char *str, OSRegex *reg, regex_matching *regex_match) __attribute__((nonnull(2)));
 
+/* Number of partial matches the calling thread has abandoned so far.
+ * The difference around an execution measures how much it backtracked.
+ */
+unsigned long OSRegex_Backtracks(void);
+
 /* Release all the memory created by the compilation/execution phases */
 void OSRegex_FreePattern(OSRegex *reg) __attribute__((nonnull));
 
+/* Release the results stored in an external regex_matching by OSRegex_Execute_ex */
+void OSRegex_free_regex_matching(regex_matching *reg) __attribute__((nonnull));
+
 /* This function is a wrapper around the compile/execute
  * functions. It should only be used when the pattern is
  * only going to be used once.
@@ -126,6 +206,36 @@ void OSMatch_FreePattern(OSMatch *reg) __attribute__((nonnull));
 
 int OS_Match2(const char *pattern, const char *str)  __attribute__((nonnull(2)));
 
+/* Initialize an empty multi-literal automaton */
+void OSMultiMatch_Init(OSMultiMatch *reg) __attribute__((nonnull));
+
+/* Add a literal, tagged with an ID, to a not yet compiled automaton.
+ * Returns 1 on success or 0 on error (empty literal).
+ */
+int OSMultiMatch_Add(OSMultiMatch *reg, const char *literal, unsigned int id) __attribute__((nonnull));
+
+/* Add every alternative of a compiled OSMatch, tagged with an ID.
+ * Anchors are dropped, so the ID is found whenever the OSMatch could match.
+ * Returns 1 on success, or 0 if the OSMatch has no mandatory literal
+ * (negated, or with an empty alternative). Nothing is added in that case.
+ */
+int OSMultiMatch_AddMatch(OSMultiMatch *reg, const OSMatch *match, unsigned int id) __attribute__((nonnull));
+
+/* Build the automaton once all the literals are added.
+ * Returns 1 on success or 0 on error.
+ * The error code is set on reg->error.
+ */
+int OSMultiMatch_Compile(OSMultiMatch *reg) __attribute__((nonnull));
+
+/* Scan a string and set, in the found bitmap, the bit of the ID of
+ * every literal that appears in it. found must have room for
+ * reg->max_id + 1 bits, and it is not cleared.
+ */
+void OSMultiMatch_Execute(const char *str, size_t str_len, const OSMultiMatch *reg, uint64_t *found) __attribute__((nonnull));
+
+/* Release all the memory created by the compilation phase */
+void OSMultiMatch_FreePattern(OSMultiMatch *reg) __attribute__((nonnull));
+
 /* Searches for pattern in the string */
 int OS_WordMatch(const char *pattern, const char *str) __attribute__((nonnull));
 #define OS_Match OS_WordMatch
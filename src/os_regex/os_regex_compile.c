@@ -17,6 +17,14 @@
 #include "shared.h"
 #include "os_regex_internal.h"
 
+/* OS_REGEX_DFA for every regex */
+static int os_regex_dfa;
+
+/* Set OS_REGEX_DFA for every regex compiled from now on */
+void OSRegex_SetDFA(int enable)
+{
+    os_regex_dfa = enable != 0;
+}
 
 /* Compile a regular expression to be used later
  * Allowed flags are:
@@ -45,6 +53,7 @@ int OSRegex_Compile(const char *pattern, OSRegex *reg, int flags)
     /* Initialize OSRegex structure */
     reg->error = 0;
     reg->patterns = NULL;
+    reg->dfa = NULL;
     reg->flags = NULL;
     reg->d_prts_str = NULL;
     reg->d_sub_strings = NULL;
@@ -325,6 +334,11 @@ int OSRegex_Compile(const char *pattern, OSRegex *reg, int flags)
         goto compile_error;
     }
 
+    /* Without the automaton (too large), only the interpreter runs */
+    if ((flags & OS_REGEX_DFA) || os_regex_dfa) {
+        reg->dfa = OSRegexDFA_Compile(reg);
+    }
+
     /* Success return */
     free(new_str_free);
     return (1);
@@ -0,0 +1,402 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All right reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+/* Deterministic automaton of a compiled OSRegex.
+ *
+ * Every sub pattern is read as a plain regular expression: literals and
+ * classes match one byte (as _OS_Regex compares them), '+' and '*' repeat
+ * the class before them, parentheses are ignored, '^' and '$' anchor it.
+ * The automaton tells whether some sub pattern matches anywhere in a
+ * string, without backtracking. The interpreter still gives the result,
+ * so the automaton is only used to discard strings.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "shared.h"
+#include "os_regex_internal.h"
+
+/* Maximum number of NFA states (pieces of all the sub patterns) */
+#define DFA_MAX_NFA     2048
+
+#define DFA_SET_WORDS(n) (((n) + 63) / 64)
+
+/* A byte set, optionally repeated */
+typedef struct dfa_piece {
+    uint64_t bytes[4];
+    int star;
+} dfa_piece;
+
+/* NFA: state s reads piece[s] (or is final when piece[s] is -1) */
+typedef struct dfa_nfa {
+    unsigned int n_states;
+    int *piece;
+    unsigned char *final;           /* OS_DFA_ACCEPT or OS_DFA_ACCEPT_END */
+    unsigned int n_pieces;
+    dfa_piece *pieces;
+} dfa_nfa;
+
+/* DFA under construction */
+typedef struct dfa_builder {
+    unsigned int words;
+    unsigned int n_states;
+    uint64_t *sets;                 /* NFA states of each DFA state */
+    unsigned int *table;            /* Open addressing: DFA state + 1, or 0 */
+    unsigned int table_size;
+} dfa_builder;
+
+static int dfa_add_piece(dfa_nfa *nfa, const uint64_t *bytes, int star);
+static int dfa_parse(const OSRegex *reg, dfa_nfa *nfa);
+static void dfa_closure(const dfa_nfa *nfa, uint64_t *set, unsigned int s);
+static unsigned int dfa_find(dfa_builder *builder, const uint64_t *set, int *added);
+
+static void dfa_set_byte(uint64_t *bytes, unsigned int b)
+{
+    bytes[b >> 6] |= (uint64_t)1 << (b & 63);
+}
+
+static int dfa_has_byte(const uint64_t *bytes, unsigned int b)
+{
+    return (bytes[b >> 6] >> (b & 63)) & 1;
+}
+
+/* Build the automaton of a compiled regex.
+ * Returns NULL if the automaton would be too large.
+ */
+OSRegexDFA *OSRegexDFA_Compile(const OSRegex *reg)
+{
+    OSRegexDFA *dfa = NULL;
+    dfa_builder builder;
+    dfa_nfa nfa;
+    uint64_t *restart = NULL;
+    uint64_t *next = NULL;
+    uint64_t *reads = NULL;
+    uint64_t *finals = NULL;
+    unsigned int i;
+    unsigned int s;
+    unsigned int c;
+    unsigned int w;
+    int added;
+
+    memset(&nfa, 0, sizeof(nfa));
+    memset(&builder, 0, sizeof(builder));
+
+    if (!dfa_parse(reg, &nfa)) {
+        goto end;
+    }
+
+    os_calloc(1, sizeof(OSRegexDFA), dfa);
+
+    /* Bytes that no piece tells apart share a class */
+    {
+        unsigned short remap[512];
+        unsigned char representative[256];
+        unsigned int b;
+
+        memset(dfa->classes, 0, sizeof(dfa->classes));
+        dfa->n_classes = 1;
+
+        for (i = 0; i < nfa.n_pieces; i++) {
+            unsigned int n_classes = 0;
+
+            memset(remap, 0xff, sizeof(remap));
+
+            for (b = 0; b < 256; b++) {
+                unsigned int key = dfa->classes[b] * 2 + dfa_has_byte(nfa.pieces[i].bytes, b);
+
+                if (remap[key] == 0xffff) {
+                    remap[key] = n_classes++;
+                }
+
+                dfa->classes[b] = remap[key];
+            }
+
+            dfa->n_classes = n_classes;
+        }
+
+        for (b = 0; b < 256; b++) {
+            representative[dfa->classes[b]] = b;
+        }
+
+        /* NFA states that read each class, and final states */
+        builder.words = DFA_SET_WORDS(nfa.n_states);
+        os_calloc(dfa->n_classes * builder.words, sizeof(uint64_t), reads);
+        os_calloc(2 * builder.words, sizeof(uint64_t), finals);
+
+        for (s = 0; s < nfa.n_states; s++) {
+            if (nfa.piece[s] < 0) {
+                finals[(nfa.final[s] == OS_DFA_ACCEPT_END) * builder.words + (s >> 6)] |= (uint64_t)1 << (s & 63);
+                continue;
+            }
+
+            for (c = 0; c < dfa->n_classes; c++) {
+                if (dfa_has_byte(nfa.pieces[nfa.piece[s]].bytes, representative[c])) {
+                    reads[c * builder.words + (s >> 6)] |= (uint64_t)1 << (s & 63);
+                }
+            }
+        }
+    }
+
+    builder.table_size = 2 * OS_REGEX_DFA_MAXSTATES;
+    os_calloc(builder.table_size, sizeof(unsigned int), builder.table);
+    os_calloc(OS_REGEX_DFA_MAXSTATES * builder.words, sizeof(uint64_t), builder.sets);
+    os_calloc(builder.words, sizeof(uint64_t), restart);
+    os_calloc(builder.words, sizeof(uint64_t), next);
+    os_calloc(OS_REGEX_DFA_MAXSTATES * dfa->n_classes, sizeof(uint16_t), dfa->delta);
+    os_calloc(OS_REGEX_DFA_MAXSTATES, sizeof(unsigned char), dfa->accept);
+
+    /* State 0 is the dead state (no NFA state), state 1 the start */
+    dfa_find(&builder, next, &added);
+
+    for (i = 0, s = 0; s < nfa.n_states; s++) {
+        /* First state of each sub pattern */
+        if (s == 0 || nfa.piece[s - 1] < 0) {
+            dfa_closure(&nfa, next, s);
+
+            if (!(reg->flags[i] & BEGIN_SET)) {
+                dfa_closure(&nfa, restart, s);
+            }
+            i++;
+        }
+    }
+
+    dfa_find(&builder, next, &added);
+
+    for (s = 1; s < builder.n_states; s++) {
+        const uint64_t *set = builder.sets + s * builder.words;
+
+        for (w = 0; w < builder.words; w++) {
+            if (set[w] & finals[w]) {
+                dfa->accept[s] |= OS_DFA_ACCEPT;
+            }
+
+            if (set[w] & finals[builder.words + w]) {
+                dfa->accept[s] |= OS_DFA_ACCEPT_END;
+            }
+        }
+
+        /* A match was found: the rest of the string does not matter */
+        if (dfa->accept[s] & OS_DFA_ACCEPT) {
+            continue;
+        }
+
+        for (c = 0; c < dfa->n_classes; c++) {
+            unsigned int target;
+
+            memcpy(next, restart, builder.words * sizeof(uint64_t));
+
+            for (w = 0; w < builder.words; w++) {
+                uint64_t bits = set[w] & reads[c * builder.words + w];
+
+                while (bits) {
+                    unsigned int t = w * 64 + (unsigned int)__builtin_ctzll(bits);
+
+                    dfa_closure(&nfa, next, nfa.pieces[nfa.piece[t]].star ? t : t + 1);
+                    bits &= bits - 1;
+                }
+            }
+
+            if (target = dfa_find(&builder, next, &added), !target && added < 0) {
+                goto fail;
+            }
+
+            dfa->delta[s * dfa->n_classes + c] = (uint16_t)target;
+        }
+    }
+
+    dfa->n_states = builder.n_states;
+    os_realloc(dfa->delta, dfa->n_states * dfa->n_classes * sizeof(uint16_t), dfa->delta);
+    os_realloc(dfa->accept, dfa->n_states, dfa->accept);
+    goto end;
+
+fail:
+    OSRegexDFA_Free(dfa);
+    dfa = NULL;
+
+end:
+    os_free(nfa.piece);
+    os_free(nfa.final);
+    os_free(nfa.pieces);
+    os_free(builder.table);
+    os_free(builder.sets);
+    os_free(restart);
+    os_free(next);
+    os_free(reads);
+    os_free(finals);
+    return dfa;
+}
+
+/* Tell whether some sub pattern may match str */
+int OSRegexDFA_Execute(const OSRegexDFA *dfa, const char *str)
+{
+    const unsigned char *p = (const unsigned char *)str;
+    unsigned int s = 1;
+
+    for (; *p != '\0'; p++) {
+        if (dfa->accept[s] & OS_DFA_ACCEPT) {
+            return 1;
+        }
+
+        if (s = dfa->delta[s * dfa->n_classes + dfa->classes[*p]], s == 0) {
+            return 0;
+        }
+    }
+
+    return dfa->accept[s] != 0;
+}
+
+void OSRegexDFA_Free(OSRegexDFA *dfa)
+{
+    if (dfa) {
+        os_free(dfa->delta);
+        os_free(dfa->accept);
+        os_free(dfa);
+    }
+}
+
+/* Split every sub pattern into pieces. Returns 0 if too large. */
+static int dfa_parse(const OSRegex *reg, dfa_nfa *nfa)
+{
+    unsigned int i;
+    unsigned int b;
+
+    for (i = 0; reg->patterns[i]; i++) {
+        const char *pt;
+
+        for (pt = reg->patterns[i]; *pt != '\0'; pt++) {
+            uint64_t bytes[4] = { 0, 0, 0, 0 };
+
+            if (prts(*pt)) {
+                continue;
+            }
+
+            if (*pt == BACKSLASH) {
+                pt++;
+
+                for (b = 1; b < 256; b++) {
+                    if (Regex((uchar)*pt, b)) {
+                        dfa_set_byte(bytes, b);
+                    }
+                }
+
+                if (isPlus(*(pt + 1))) {
+                    pt++;
+
+                    /* \x+ is \x\x* */
+                    if (*pt == '+' && !dfa_add_piece(nfa, bytes, 0)) {
+                        return 0;
+                    }
+
+                    if (!dfa_add_piece(nfa, bytes, 1)) {
+                        return 0;
+                    }
+
+                    continue;
+                }
+            } else {
+                for (b = 1; b < 256; b++) {
+                    if (charmap[b] == (uchar)*pt) {
+                        dfa_set_byte(bytes, b);
+                    }
+                }
+            }
+
+            if (!dfa_add_piece(nfa, bytes, 0)) {
+                return 0;
+            }
+        }
+
+        /* Final state of the sub pattern */
+        if (!dfa_add_piece(nfa, NULL, 0)) {
+            return 0;
+        }
+
+        nfa->final[nfa->n_states - 1] = (reg->flags[i] & END_SET) ? OS_DFA_ACCEPT_END : OS_DFA_ACCEPT;
+    }
+
+    return nfa->n_states > 0;
+}
+
+/* Append a state reading bytes (or a final state, if bytes is NULL) */
+static int dfa_add_piece(dfa_nfa *nfa, const uint64_t *bytes, int star)
+{
+    if (nfa->n_states >= DFA_MAX_NFA) {
+        return 0;
+    }
+
+    if (!nfa->piece) {
+        os_calloc(DFA_MAX_NFA, sizeof(int), nfa->piece);
+        os_calloc(DFA_MAX_NFA, sizeof(unsigned char), nfa->final);
+        os_calloc(DFA_MAX_NFA, sizeof(dfa_piece), nfa->pieces);
+    }
+
+    if (bytes) {
+        memcpy(nfa->pieces[nfa->n_pieces].bytes, bytes, sizeof(nfa->pieces[0].bytes));
+        nfa->pieces[nfa->n_pieces].star = star;
+        nfa->piece[nfa->n_states] = (int)nfa->n_pieces++;
+    } else {
+        nfa->piece[nfa->n_states] = -1;
+    }
+
+    nfa->n_states++;
+    return 1;
+}
+
+/* Add a state, and the ones after the repeated pieces it may skip */
+static void dfa_closure(const dfa_nfa *nfa, uint64_t *set, unsigned int s)
+{
+    for (;;) {
+        set[s >> 6] |= (uint64_t)1 << (s & 63);
+
+        if (nfa->piece[s] < 0 || !nfa->pieces[nfa->piece[s]].star) {
+            return;
+        }
+
+        s++;
+    }
+}
+
+/* Get the DFA state of a set of NFA states, adding it if new.
+ * added is 1 if it was added, 0 if it existed, -1 if there is no room.
+ */
+static unsigned int dfa_find(dfa_builder *builder, const uint64_t *set, int *added)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    unsigned int i;
+    unsigned int slot;
+
+    for (i = 0; i < builder->words; i++) {
+        hash = (hash ^ set[i]) * 0x100000001b3ULL;
+    }
+
+    for (slot = (unsigned int)(hash % builder->table_size);; slot = (slot + 1) % builder->table_size) {
+        unsigned int state = builder->table[slot];
+
+        if (!state) {
+            break;
+        }
+
+        if (!memcmp(builder->sets + (state - 1) * builder->words, set, builder->words * sizeof(uint64_t))) {
+            *added = 0;
+            return state - 1;
+        }
+    }
+
+    if (builder->n_states >= OS_REGEX_DFA_MAXSTATES) {
+        *added = -1;
+        return 0;
+    }
+
+    memcpy(builder->sets + builder->n_states * builder->words, set, builder->words * sizeof(uint64_t));
+    builder->table[slot] = ++builder->n_states;
+    *added = 1;
+    return builder->n_states - 1;
+}
@@ -16,9 +16,18 @@
 #include "os_regex_internal.h"
 
 /* Internal prototypes */
+static const char *_OSRegex_Execute(const char *str, OSRegex *reg, char ***sub_strings, const char ***prts_str,
+                                    const regex_dynamic_size *str_sizes) __attribute__((nonnull(2, 3, 5)));
 static const char *_OS_Regex(const char *pattern, const char *str, const char **prts_closure,
                              const char **prts_str, int flags) __attribute__((nonnull(1, 2)));
 
+/* Partial matches abandoned by the calling thread */
+static __thread unsigned long regex_backtracks;
+
+unsigned long OSRegex_Backtracks(void)
+{
+    return regex_backtracks;
+}
 
 /* Compare an already compiled regular expression with
  * a not NULL string.
@@ -32,70 +41,82 @@ const char *OSRegex_Execute(const char *str, OSRegex *reg)
 
 const char *OSRegex_Execute_ex(const char *str, OSRegex *reg, regex_matching *regex_match)
 {
-    char ***sub_strings;
-    const char ****prts_str;
     regex_dynamic_size *str_sizes;
     const char *ret;
     int i;
 
-    if (regex_match) {
-        sub_strings = &regex_match->sub_strings;
-        prts_str = &regex_match->prts_str;
-        str_sizes = &regex_match->d_size;
-    } else {
-        sub_strings = &reg->d_sub_strings;
-        prts_str = &reg->d_prts_str;
-        str_sizes = &reg->d_size;
+    /* Without external storage the results are left in the regex itself */
+    if (!regex_match) {
+        w_mutex_lock(&reg->mutex);
+        w_FreeArray(reg->d_sub_strings);
+        ret = _OSRegex_Execute(str, reg, &reg->d_sub_strings, reg->d_prts_str, &reg->d_size);
+        w_mutex_unlock(&reg->mutex);
+        return (ret);
     }
 
-    if (regex_match) {
-        if (str_sizes->sub_strings_size < reg->d_size.sub_strings_size) {
-            if (!*sub_strings) {
-                os_calloc(1, reg->d_size.sub_strings_size, *sub_strings);
-            } else {
-                os_realloc(*sub_strings, reg->d_size.sub_strings_size, *sub_strings);
-                memset((void*)*sub_strings + str_sizes->sub_strings_size, 0, reg->d_size.sub_strings_size - str_sizes->sub_strings_size);
-            }
-            str_sizes->sub_strings_size = reg->d_size.sub_strings_size;
+    /* The regex is read-only from here on: grow the caller's storage to fit it */
+    str_sizes = &regex_match->d_size;
+
+    if (str_sizes->sub_strings_size < reg->d_size.sub_strings_size) {
+        if (!regex_match->sub_strings) {
+            os_calloc(1, reg->d_size.sub_strings_size, regex_match->sub_strings);
+        } else {
+            os_realloc(regex_match->sub_strings, reg->d_size.sub_strings_size, regex_match->sub_strings);
+            memset((void*)regex_match->sub_strings + str_sizes->sub_strings_size, 0, reg->d_size.sub_strings_size - str_sizes->sub_strings_size);
         }
+        str_sizes->sub_strings_size = reg->d_size.sub_strings_size;
     }
-    w_FreeArray(*sub_strings);
-
-    if (regex_match && prts_str) {
-        if (str_sizes->prts_str_alloc_size < reg->d_size.prts_str_alloc_size) {
-            os_realloc(*prts_str, reg->d_size.prts_str_alloc_size, *prts_str);
-            memset((void*)*prts_str + str_sizes->prts_str_alloc_size, 0, reg->d_size.prts_str_alloc_size - str_sizes->prts_str_alloc_size);
-            str_sizes->prts_str_alloc_size = reg->d_size.prts_str_alloc_size;
-            if (!str_sizes->prts_str_size) {
-                os_calloc(str_sizes->prts_str_alloc_size, sizeof(int), str_sizes->prts_str_size);
-            } else {
-                os_realloc(str_sizes->prts_str_size, str_sizes->prts_str_alloc_size * sizeof(int), str_sizes->prts_str_size);
-            }
+    w_FreeArray(regex_match->sub_strings);
+
+    if (str_sizes->prts_str_alloc_size < reg->d_size.prts_str_alloc_size) {
+        os_realloc(regex_match->prts_str, reg->d_size.prts_str_alloc_size, regex_match->prts_str);
+        memset((void*)regex_match->prts_str + str_sizes->prts_str_alloc_size, 0, reg->d_size.prts_str_alloc_size - str_sizes->prts_str_alloc_size);
+        str_sizes->prts_str_alloc_size = reg->d_size.prts_str_alloc_size;
+        if (!str_sizes->prts_str_size) {
+            os_calloc(str_sizes->prts_str_alloc_size, sizeof(int), str_sizes->prts_str_size);
+        } else {
+            os_realloc(str_sizes->prts_str_size, str_sizes->prts_str_alloc_size * sizeof(int), str_sizes->prts_str_size);
         }
+    }
 
-        if (reg->d_size.prts_str_size) {
-            // It is a pattern from which to extract substrings
-            for (i = 0; reg->d_size.prts_str_size[i]; i++) {
-                if (!str_sizes->prts_str_size[i]) {
-                    os_calloc(reg->d_size.prts_str_size[i], sizeof(char *), (*prts_str)[i]);
-                    str_sizes->prts_str_size[i] = reg->d_size.prts_str_size[i];
-                } else if (str_sizes->prts_str_size[i] < reg->d_size.prts_str_size[i]) {
-                    os_realloc((*prts_str)[i], reg->d_size.prts_str_size[i], (*prts_str)[i]);
-                    memset((void*)(*prts_str)[i] + str_sizes->prts_str_size[i], 0, reg->d_size.prts_str_size[i] - str_sizes->prts_str_size[i]);
-                    str_sizes->prts_str_size[i] = reg->d_size.prts_str_size[i];
-                }
+    if (reg->d_size.prts_str_size) {
+        // It is a pattern from which to extract substrings
+        for (i = 0; reg->d_size.prts_str_size[i]; i++) {
+            if (!str_sizes->prts_str_size[i]) {
+                os_calloc(reg->d_size.prts_str_size[i], sizeof(char *), regex_match->prts_str[i]);
+                str_sizes->prts_str_size[i] = reg->d_size.prts_str_size[i];
+            } else if (str_sizes->prts_str_size[i] < reg->d_size.prts_str_size[i]) {
+                os_realloc(regex_match->prts_str[i], reg->d_size.prts_str_size[i], regex_match->prts_str[i]);
+                memset((void*)regex_match->prts_str[i] + str_sizes->prts_str_size[i], 0, reg->d_size.prts_str_size[i] - str_sizes->prts_str_size[i]);
+                str_sizes->prts_str_size[i] = reg->d_size.prts_str_size[i];
             }
         }
     }
-    w_mutex_lock((pthread_mutex_t *)&reg->mutex);
+
+    return _OSRegex_Execute(str, reg, &regex_match->sub_strings, regex_match->prts_str, str_sizes);
+}
+
+/* Run every sub pattern, using the given storage for the parenthesis
+ * locations and the sub strings. Nothing in the regex is modified but
+ * the error code.
+ */
+static const char *_OSRegex_Execute(const char *str, OSRegex *reg, char ***sub_strings, const char ***prts_str,
+                                    const regex_dynamic_size *str_sizes)
+{
+    const char *ret;
+    int i;
 
     /* The string can't be NULL */
     if (str == NULL) {
         reg->error = OS_REGEX_STR_NULL;
-        w_mutex_unlock((pthread_mutex_t *)&reg->mutex);
         return (0);
     }
 
+    /* No sub pattern can match */
+    if (reg->dfa && !OSRegexDFA_Execute(reg->dfa, str)) {
+        return (NULL);
+    }
+
     /* If we need the sub strings */
     if (reg->prts_closure) {
         int k = 0;
@@ -106,26 +127,24 @@ const char *OSRegex_Execute_ex(const char *str, OSRegex *reg, regex_matching *re
             int j = 0;
 
             /* Clean the prts_str */
-            memset((void*)(*prts_str)[i], 0, (str_sizes) ? str_sizes->prts_str_size[i] : reg->d_size.prts_str_size[i]);
+            memset((void*)prts_str[i], 0, str_sizes->prts_str_size[i]);
 
             if ((ret = _OS_Regex(reg->patterns[i], str, reg->prts_closure[i],
-                                 (*prts_str)[i], reg->flags[i]))) {
+                                 prts_str[i], reg->flags[i]))) {
                 j = 0;
 
                 /* We must always have the open and the close */
-                while ((*prts_str)[i][j] && (*prts_str)[i][j + 1]) {
-                    size_t length = (size_t) ((*prts_str)[i][j + 1] - (*prts_str)[i][j]);
+                while (prts_str[i][j] && prts_str[i][j + 1]) {
+                    size_t length = (size_t) (prts_str[i][j + 1] - prts_str[i][j]);
                     if (*sub_strings == NULL) {
-                        w_mutex_unlock((pthread_mutex_t *)&reg->mutex);
                         return (NULL);
                     }
                     (*sub_strings)[k] = (char *) malloc((length + 1) * sizeof(char));
                     if (!(*sub_strings)[k]) {
                         w_FreeArray(*sub_strings);
-                        w_mutex_unlock((pthread_mutex_t *)&reg->mutex);
                         return (NULL);
                     }
-                    strncpy((*sub_strings)[k], (*prts_str)[i][j], length);
+                    strncpy((*sub_strings)[k], prts_str[i][j], length);
                     (*sub_strings)[k][length] = '\0';
 
                     /* Set the next one to null */
@@ -136,12 +155,10 @@ const char *OSRegex_Execute_ex(const char *str, OSRegex *reg, regex_matching *re
                     /* Go two by two */
                     j += 2;
                 }
-                w_mutex_unlock((pthread_mutex_t *)&reg->mutex);
                 return (ret);
             }
             i++;
         }
-        w_mutex_unlock((pthread_mutex_t *)&reg->mutex);
         return (0);
     }
 
@@ -150,12 +167,10 @@ const char *OSRegex_Execute_ex(const char *str, OSRegex *reg, regex_matching *re
     /* Loop on all sub patterns */
     for (i = 0; reg->patterns[i]; i++) {
         if ((ret = _OS_Regex(reg->patterns[i], str, NULL, NULL, reg->flags[i]))) {
-            w_mutex_unlock((pthread_mutex_t *)&reg->mutex);
             return (ret);
         }
     }
 
-    w_mutex_unlock((pthread_mutex_t *)&reg->mutex);
     return (NULL);
 }
 
@@ -400,6 +415,10 @@ static const char *_OS_Regex(const char *pattern, const char *str, const char **
         }
 
         /* Error Handling */
+        if (pt != pattern) {
+            regex_backtracks++;
+        }
+
         if (pt_error[3]) {
             pt = pt_error[3];
             st = pt_error_str[3];
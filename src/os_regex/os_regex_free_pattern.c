@@ -34,6 +34,10 @@ void OSRegex_FreePattern(OSRegex *reg)
     /* Free the flags */
     os_free(reg->flags);
 
+    /* Free the automaton */
+    OSRegexDFA_Free(reg->dfa);
+    reg->dfa = NULL;
+
     if (reg->raw) {
         os_free(reg->raw);
     }
@@ -71,3 +75,26 @@ void OSRegex_FreePattern(OSRegex *reg)
 
     return;
 }
+
+/* Release the results left by OSRegex_Execute_ex in an external regex_matching */
+void OSRegex_free_regex_matching(regex_matching *reg)
+{
+    int i = 0;
+
+    if (reg->prts_str) {
+        while (reg->prts_str[i]) {
+            free(reg->prts_str[i]);
+            i++;
+        }
+        os_free(reg->prts_str);
+    }
+
+    if (reg->sub_strings) {
+        w_FreeArray(reg->sub_strings);
+        os_free(reg->sub_strings);
+    }
+
+    os_free(reg->d_size.prts_str_size);
+    reg->d_size.sub_strings_size = 0;
+    reg->d_size.prts_str_alloc_size = 0;
+}
@@ -33,6 +33,10 @@ int _os_strmatch(const char *pattern, const char *str, size_t str_len, size_t si
 #define BEGIN_SET   0000200
 #define END_SET     0000400
 
+/* OSRegexDFA accepting states */
+#define OS_DFA_ACCEPT       1   /* Some sub pattern matched */
+#define OS_DFA_ACCEPT_END   2   /* Some sub pattern matches if the string ends here */
+
 /* uchar */
 typedef unsigned char uchar;
 
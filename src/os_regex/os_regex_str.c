@@ -15,6 +15,31 @@
 #include "os_regex.h"
 #include "os_regex_internal.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OS_STR_SSE2
+#include <emmintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define OS_STR_NEON
+#include <arm_neon.h>
+#endif
+
+/* Blocks are compared only if they don't cross a page of any string */
+#define OS_STR_PAGE  4096
+#define OS_STR_BLOCK 16
+#define OS_STR_CROSSES(p) ((((uintptr_t)(p)) & (OS_STR_PAGE - 1)) > OS_STR_PAGE - OS_STR_BLOCK)
+
+#ifdef __clang__
+#define OS_STR_NO_ASAN __attribute__((no_sanitize("address")))
+#else
+#define OS_STR_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+
+#ifdef OS_STR_SSE2
+static size_t _os_str_prefix_sse2(const char *str1, const char *str2) __attribute__((target("sse2"))) OS_STR_NO_ASAN;
+#elif defined(OS_STR_NEON)
+static size_t _os_str_prefix_neon(const char *str1, const char *str2) OS_STR_NO_ASAN;
+#endif
+
 
 /* Check if a specific string is numeric (like "129544") */
 int OS_StrIsNum(const char *str)
@@ -36,21 +61,85 @@ int OS_StrIsNum(const char *str)
 /* Return the number of characters that both strings have in common */
 size_t OS_StrHowClosedMatch(const char *str1, const char *str2)
 {
-    size_t count = 0;
+    size_t count;
 
     /* They don't match if any of them is null */
     if (!str1 || !str2) {
         return (0);
     }
 
-    do {
-        if (str1[count] != str2[count]) {
-            break;
-        }
+    /* Two empty strings have always matched in one */
+    if (*str1 == '\0' && *str2 == '\0') {
+        return (1);
+    }
+
+#ifdef OS_STR_SSE2
+    if (__builtin_cpu_supports("sse2")) {
+        return _os_str_prefix_sse2(str1, str2);
+    }
+#elif defined(OS_STR_NEON)
+    return _os_str_prefix_neon(str1, str2);
+#endif
 
-        count++;
-    } while ((str1[count] != '\0') && (str2[count] != '\0'));
+    for (count = 0; str1[count] == str2[count] && str1[count] != '\0'; count++);
 
     return (count);
 }
 
+/* Length of the common prefix, one block at a time */
+#ifdef OS_STR_SSE2
+static size_t _os_str_prefix_sse2(const char *str1, const char *str2)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t count = 0;
+
+    while (1) {
+        if (OS_STR_CROSSES(str1 + count) || OS_STR_CROSSES(str2 + count)) {
+            if (str1[count] != str2[count] || str1[count] == '\0') {
+                return count;
+            }
+
+            count++;
+            continue;
+        }
+
+        __m128i a = _mm_loadu_si128((const __m128i *)(str1 + count));
+        __m128i b = _mm_loadu_si128((const __m128i *)(str2 + count));
+        unsigned int stop = ~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) | _mm_movemask_epi8(_mm_cmpeq_epi8(a, zero));
+
+        if (stop & 0xffff) {
+            return count + __builtin_ctz(stop);
+        }
+
+        count += OS_STR_BLOCK;
+    }
+}
+#elif defined(OS_STR_NEON)
+static size_t _os_str_prefix_neon(const char *str1, const char *str2)
+{
+    size_t count = 0;
+
+    while (1) {
+        if (OS_STR_CROSSES(str1 + count) || OS_STR_CROSSES(str2 + count)) {
+            if (str1[count] != str2[count] || str1[count] == '\0') {
+                return count;
+            }
+
+            count++;
+            continue;
+        }
+
+        uint8x16_t a = vld1q_u8((const uint8_t *)(str1 + count));
+        uint8x16_t b = vld1q_u8((const uint8_t *)(str2 + count));
+        uint8x16_t stop = vorrq_u8(vmvnq_u8(vceqq_u8(a, b)), vceqzq_u8(a));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+
+        if (mask) {
+            return count + (__builtin_ctzll(mask) >> 2);
+        }
+
+        count += OS_STR_BLOCK;
+    }
+}
+#endif
+
@@ -15,48 +15,37 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "os_xml.h"
 #include "os_xml_internal.h"
-#include "file_op.h"
 
 /* Prototypes */
 static int _oscomment(OS_XML *_lxml) __attribute__((nonnull));
 static int _writecontent(const char *str, size_t size, unsigned int parent, OS_XML *_lxml) __attribute__((nonnull));
 static int _writememory(const char *str, XML_TYPE type, size_t size,
                         unsigned int parent, OS_XML *_lxml) __attribute__((nonnull));
-static int _xml_fgetc(FILE *fp, OS_XML *_lxml) __attribute__((nonnull));
-int _xml_sgetc(OS_XML *_lxml)  __attribute__((nonnull));
 static int _ReadElem(unsigned int parent, OS_XML *_lxml) __attribute__((nonnull));
 static int _getattributes(unsigned int parent, OS_XML *_lxml) __attribute__((nonnull));
 static void xml_error(OS_XML *_lxml, const char *msg, ...) __attribute__((format(printf, 2, 3), nonnull));
 
-/* Local fgetc */
-static int _xml_fgetc(FILE *fp, OS_XML *_lxml)
+/* Get a character of the input, which is always in memory */
+static inline int _xml_getc(OS_XML *_lxml)
 {
     int c;
 
     // If there is any character in the stash, get it
-    c = (_lxml->stash_i > 0) ? _lxml->stash[--_lxml->stash_i] : fgetc(fp);
-
-    if (c == '\n') { /* add newline */
-        _lxml->line++;
-    }
-
-    return (c);
-}
-
-int _xml_sgetc(OS_XML *_lxml){
-    int c;
-
     if (_lxml->stash_i > 0) {
         c = _lxml->stash[--_lxml->stash_i];
-    }
-    else if (_lxml->string) {
-        c = *(_lxml->string++);
-    }
-    else {
-        c = -1;
+    } else if (_lxml->string && _lxml->string < _lxml->string_end) {
+        c = (unsigned char)*(_lxml->string++);
+    } else {
+        c = EOF;
     }
 
     if (c == '\n') { /* add newline */
@@ -93,15 +82,62 @@ static void xml_error(OS_XML *_lxml, const char *msg, ...)
     _lxml->err_line = _lxml->line;
 }
 
+/* Copy a string into the arena, in a new block if it doesn't fit */
+char *xml_arena_strndup(OS_XML *_lxml, const char *str, size_t len)
+{
+    xml_arena *block = _lxml->arena;
+    char *copy;
+
+    if (!block || block->size - block->used < len + 1) {
+        size_t size = len + 1 > XML_ARENA_SIZE ? len + 1 : XML_ARENA_SIZE;
+
+        if (block = malloc(sizeof(xml_arena) + size), !block) {
+            return NULL;
+        }
+
+        block->next = _lxml->arena;
+        block->used = 0;
+        block->size = size;
+        _lxml->arena = block;
+    }
+
+    copy = block->data + block->used;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+    return copy;
+}
+
+/* Release the input of the parser */
+static void xml_close_input(OS_XML *_lxml)
+{
+#ifndef WIN32
+    if (_lxml->input_map) {
+        munmap(_lxml->input, _lxml->input_map);
+    } else
+#endif
+    {
+        free(_lxml->input);
+    }
+
+    _lxml->input = NULL;
+    _lxml->input_map = 0;
+    _lxml->string = NULL;
+    _lxml->string_end = NULL;
+}
+
 /* Clear memory */
 void OS_ClearXML(OS_XML *_lxml)
 {
-    unsigned int i;
-    for (i = 0; i < _lxml->cur; i++) {
-        free(_lxml->el[i]);
-        free(_lxml->ct[i]);
+    xml_arena *block;
+
+    while (block = _lxml->arena, block) {
+        _lxml->arena = block->next;
+        free(block);
     }
+
     _lxml->cur = 0;
+    _lxml->size = 0;
     _lxml->fol = 0;
     _lxml->err_line = 0;
 
@@ -131,7 +167,12 @@ void OS_ClearXML(OS_XML *_lxml)
 int ParseXML(OS_XML *_lxml){
     int r;
     unsigned int i;
-    char *str_base = _lxml->string;
+
+    /* A string set by the caller */
+    if (_lxml->string && !_lxml->string_end) {
+        _lxml->input = _lxml->string;
+        _lxml->string_end = _lxml->string + strlen(_lxml->string);
+    }
 
     /* Zero the line */
     _lxml->line = 1;
@@ -141,13 +182,7 @@ int ParseXML(OS_XML *_lxml){
 
     if ((r = _ReadElem(0, _lxml)) < 0) { /* First position */
         if (r != LEOF) {
-
-            if(_lxml->fp){
-                fclose(_lxml->fp);
-            } else if (str_base){
-                free(str_base);
-            }
-
+            xml_close_input(_lxml);
             return (-1);
         }
     }
@@ -155,23 +190,12 @@ int ParseXML(OS_XML *_lxml){
     for (i = 0; i < _lxml->cur; i++) {
         if (_lxml->ck[i] == 0) {
             xml_error(_lxml, "XMLERR: Element '%s' not closed.", _lxml->el[i]);
-
-            if(_lxml->fp){
-                fclose(_lxml->fp);
-            } else if (str_base){
-                free(str_base);
-            }
-
+            xml_close_input(_lxml);
             return (-1);
         }
     }
 
-    if(_lxml->fp){
-        fclose(_lxml->fp);
-    } else if (str_base){
-        free(str_base);
-    }
-
+    xml_close_input(_lxml);
     return (0);
 }
 
@@ -179,28 +203,79 @@ int OS_ReadXMLString(const char *string, OS_XML *_lxml){
     /* Initialize xml structure */
     memset(_lxml, 0, sizeof(OS_XML));
 
-    _lxml->string = strdup(string);
+    /* The string is parsed in place, as it's never written */
+    _lxml->string = (char *)string;
+    _lxml->string_end = string + strlen(string);
     _lxml->fp = NULL;
 
     return ParseXML(_lxml);
 }
 
-/* Read na XML file and generate the necessary structs */
+/* Read na XML file and generate the necessary structs.
+ * The whole file is mapped (or read) at once, and parsed from memory.
+ */
 int OS_ReadXML(const char *file, OS_XML *_lxml)
 {
-    FILE *fp;
+    size_t length = 0;
 
     /* Initialize xml structure */
     memset(_lxml, 0, sizeof(OS_XML));
 
-    fp = fopen(file, "r");
+#ifndef WIN32
+    struct stat st;
+    int fd;
+
+    if (fd = open(file, O_RDONLY | O_CLOEXEC), fd < 0) {
+        xml_error(_lxml, "XMLERR: File '%s' not found.", file);
+        return (-2);
+    }
+
+    if (fstat(fd, &st) < 0) {
+        xml_error(_lxml, "XMLERR: File '%s' could not be read.", file);
+        close(fd);
+        return (-1);
+    }
+
+    if (st.st_size > 0) {
+        _lxml->input = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (_lxml->input == MAP_FAILED) {
+            _lxml->input = NULL;
+            xml_error(_lxml, "XMLERR: File '%s' could not be read.", file);
+            close(fd);
+            return (-1);
+        }
+
+        _lxml->input_map = length = (size_t)st.st_size;
+    }
+
+    close(fd);
+#else
+    FILE *fp;
+    long size;
+
+    fp = fopen(file, "rb");
     if (!fp) {
         xml_error(_lxml, "XMLERR: File '%s' not found.", file);
         return (-2);
     }
-    w_file_cloexec(fp);
-    _lxml->fp = fp;
-    _lxml->string = NULL;
+
+    if (fseek(fp, 0, SEEK_END) < 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) < 0
+        || !(_lxml->input = malloc(size + 1)) || fread(_lxml->input, 1, size, fp) != (size_t)size) {
+        xml_error(_lxml, "XMLERR: File '%s' could not be read.", file);
+        free(_lxml->input);
+        _lxml->input = NULL;
+        fclose(fp);
+        return (-1);
+    }
+
+    length = (size_t)size;
+    fclose(fp);
+#endif
+
+    _lxml->fp = NULL;
+    _lxml->string = _lxml->input;
+    _lxml->string_end = _lxml->input + length;
 
     return ParseXML(_lxml);
 }
@@ -208,16 +283,16 @@ int OS_ReadXML(const char *file, OS_XML *_lxml)
 static int _oscomment(OS_XML *_lxml)
 {
     int c;
-    if ((c = xml_getc_fun(_lxml->fp, _lxml)) == _R_COM) {
-        while ((c = xml_getc_fun(_lxml->fp, _lxml)) != EOF) {
+    if ((c = _xml_getc(_lxml)) == _R_COM) {
+        while ((c = _xml_getc(_lxml)) != EOF) {
             if (c == _R_COM) {
-                if ((c = xml_getc_fun(_lxml->fp, _lxml)) == _R_CONFE) {
+                if ((c = _xml_getc(_lxml)) == _R_CONFE) {
                     return (1);
                 }
                 _xml_ungetc(c, _lxml);
             } else if (c == '-') {  /* W3C way of finishing comments */
-                if ((c = xml_getc_fun(_lxml->fp, _lxml)) == '-') {
-                    if ((c = xml_getc_fun(_lxml->fp, _lxml)) == _R_CONFE) {
+                if ((c = _xml_getc(_lxml)) == '-') {
+                    if ((c = _xml_getc(_lxml)) == _R_CONFE) {
                         return (1);
                     }
                     _xml_ungetc(c, _lxml);
@@ -240,25 +315,18 @@ static int _ReadElem(unsigned int parent, OS_XML *_lxml)
     unsigned int count = 0;
     unsigned int _currentlycont = 0;
     short int location = -1;
-    int cmp = 0;
 
     int prevv = 1;
     char elem[XML_MAXSIZE + 1];
     char cont[XML_MAXSIZE + 1];
     char closedelim[XML_MAXSIZE + 1];
 
-    memset(elem, '\0', XML_MAXSIZE + 1);
-    memset(cont, '\0', XML_MAXSIZE + 1);
-    memset(closedelim, '\0', XML_MAXSIZE + 1);
-
-    if (_lxml->fp){
-        cmp = EOF;
-        _lxml->string = NULL;
-    } else if (_lxml->string){
-        cmp = '\0';
-    }
+    /* Each buffer is terminated when it's complete */
+    elem[0] = '\0';
+    cont[0] = '\0';
+    closedelim[0] = '\0';
 
-    while ((c = xml_getc_fun(_lxml->fp, _lxml)) != cmp) {
+    while ((c = _xml_getc(_lxml)) != EOF) {
         if (c == '\\') {
             prevv *= -1;
         } else if (c != _R_CONFS && prevv == -1){
@@ -285,7 +353,7 @@ static int _ReadElem(unsigned int parent, OS_XML *_lxml)
         /* Real checking */
         if ((location == -1) && (prevv == 1)) {
             if (c == _R_CONFS) {
-                if ((c = xml_getc_fun(_lxml->fp, _lxml)) == '/') {
+                if ((c = _xml_getc(_lxml)) == '/') {
                     xml_error(_lxml, "XMLERR: Element not opened.");
                     return (-1);
                 } else {
@@ -328,10 +396,6 @@ static int _ReadElem(unsigned int parent, OS_XML *_lxml)
                 count = 0;
                 location = -1;
 
-                memset(elem, '\0', XML_MAXSIZE);
-                memset(closedelim, '\0', XML_MAXSIZE);
-                memset(cont, '\0', XML_MAXSIZE);
-
                 if (parent > 0) {
                     return (0);
                 }
@@ -351,9 +415,6 @@ static int _ReadElem(unsigned int parent, OS_XML *_lxml)
                 return (-1);
             }
             _lxml->ck[_currentlycont] = 1;
-            memset(elem, '\0', XML_MAXSIZE);
-            memset(closedelim, '\0', XML_MAXSIZE);
-            memset(cont, '\0', XML_MAXSIZE);
             _currentlycont = 0;
             count = 0;
             location = -1;
@@ -361,7 +422,7 @@ static int _ReadElem(unsigned int parent, OS_XML *_lxml)
                 return (0);
             }
         } else if ((location == 1) && (c == _R_CONFS) && (prevv == 1)) {
-            if ((c = xml_getc_fun(_lxml->fp, _lxml)) == '/') {
+            if ((c = _xml_getc(_lxml)) == '/') {
                 cont[count] = '\0';
                 count = 0;
                 location = 2;
@@ -399,61 +460,56 @@ static int _ReadElem(unsigned int parent, OS_XML *_lxml)
 static int _writememory(const char *str, XML_TYPE type, size_t size,
                         unsigned int parent, OS_XML *_lxml)
 {
-    char **tmp;
-    int *tmp2;
-    unsigned int *tmp3;
-    XML_TYPE *tmp4;
-
-    /* Allocate for the element */
-    tmp = (char **)realloc(_lxml->el, (_lxml->cur + 1) * sizeof(char *));
-    if (tmp == NULL) {
-        goto fail;
-    }
-    _lxml->el = tmp;
-    _lxml->el[_lxml->cur] = (char *)calloc(size, sizeof(char));
-    if (_lxml->el[_lxml->cur] == NULL) {
-        goto fail;
-    }
-    strncpy(_lxml->el[_lxml->cur], str, size - 1);
+    /* Grow the arrays geometrically */
+    if (_lxml->cur >= _lxml->size) {
+        unsigned int size = _lxml->size ? _lxml->size * 2 : 64;
+        char **tmp;
+        int *tmp2;
+        unsigned int *tmp3;
+        XML_TYPE *tmp4;
+
+        if (tmp = (char **)realloc(_lxml->el, size * sizeof(char *)), !tmp) {
+            goto fail;
+        }
+        _lxml->el = tmp;
 
-    /* Allocate for the content */
-    tmp = (char **)realloc(_lxml->ct, (_lxml->cur + 1) * sizeof(char *));
-    if (tmp == NULL) {
-        goto fail;
-    }
-    _lxml->ct = tmp;
-    _lxml->ct[_lxml->cur] = NULL;
+        if (tmp = (char **)realloc(_lxml->ct, size * sizeof(char *)), !tmp) {
+            goto fail;
+        }
+        _lxml->ct = tmp;
 
-    /* Allocate for the type */
-    tmp4 = (XML_TYPE *) realloc(_lxml->tp, (_lxml->cur + 1) * sizeof(XML_TYPE));
-    if (tmp4 == NULL) {
-        goto fail;
-    }
-    _lxml->tp = tmp4;
-    _lxml->tp[_lxml->cur] = type;
+        if (tmp4 = (XML_TYPE *)realloc(_lxml->tp, size * sizeof(XML_TYPE)), !tmp4) {
+            goto fail;
+        }
+        _lxml->tp = tmp4;
 
-    /* Allocate for the relation */
-    tmp3 = (unsigned int *) realloc(_lxml->rl, (_lxml->cur + 1) * sizeof(unsigned int));
-    if (tmp3 == NULL) {
-        goto fail;
-    }
-    _lxml->rl = tmp3;
-    _lxml->rl[_lxml->cur] = parent;
+        if (tmp3 = (unsigned int *)realloc(_lxml->rl, size * sizeof(unsigned int)), !tmp3) {
+            goto fail;
+        }
+        _lxml->rl = tmp3;
 
-    /* Allocate for the "check" */
-    tmp2 = (int *) realloc(_lxml->ck, (_lxml->cur + 1) * sizeof(int));
-    if (tmp2 == NULL) {
-        goto fail;
+        if (tmp2 = (int *)realloc(_lxml->ck, size * sizeof(int)), !tmp2) {
+            goto fail;
+        }
+        _lxml->ck = tmp2;
+
+        if (tmp3 = (unsigned int *)realloc(_lxml->ln, size * sizeof(unsigned int)), !tmp3) {
+            goto fail;
+        }
+        _lxml->ln = tmp3;
+
+        _lxml->size = size;
     }
-    _lxml->ck = tmp2;
-    _lxml->ck[_lxml->cur] = 0;
 
-    /* Allocate for the line */
-    tmp3 = (unsigned int *) realloc(_lxml->ln, (_lxml->cur + 1) * sizeof(unsigned int));
-    if (tmp3 == NULL) {
+    /* Element name */
+    if (_lxml->el[_lxml->cur] = xml_arena_strndup(_lxml, str, strnlen(str, size - 1)), !_lxml->el[_lxml->cur]) {
         goto fail;
     }
-    _lxml->ln = tmp3;
+
+    _lxml->ct[_lxml->cur] = NULL;
+    _lxml->tp[_lxml->cur] = type;
+    _lxml->rl[_lxml->cur] = parent;
+    _lxml->ck[_lxml->cur] = 0;
     _lxml->ln[_lxml->cur] = _lxml->line;
 
     /* Attributes does not need to be closed */
@@ -476,12 +532,11 @@ fail:
 
 static int _writecontent(const char *str, size_t size, unsigned int parent, OS_XML *_lxml)
 {
-    _lxml->ct[parent] = (char *)calloc(size, sizeof(char));
+    _lxml->ct[parent] = xml_arena_strndup(_lxml, str, strnlen(str, size - 1));
     if ( _lxml->ct[parent] == NULL) {
         snprintf(_lxml->err, XML_ERR_LENGTH, "XMLERR: Memory error.");
         return (-1);
     }
-    strncpy(_lxml->ct[parent], str, size - 1);
 
     return (0);
 }
@@ -497,10 +552,10 @@ static int _getattributes(unsigned int parent, OS_XML *_lxml)
     char attr[XML_MAXSIZE + 1];
     char value[XML_MAXSIZE + 1];
 
-    memset(attr, '\0', XML_MAXSIZE + 1);
-    memset(value, '\0', XML_MAXSIZE + 1);
+    attr[0] = '\0';
+    value[0] = '\0';
 
-    while ((c = xml_getc_fun(_lxml->fp, _lxml)) != EOF) {
+    while ((c = _xml_getc(_lxml)) != EOF) {
         if (count >= XML_MAXSIZE) {
             attr[count - 1] = '\0';
             xml_error(_lxml,
@@ -514,6 +569,7 @@ static int _getattributes(unsigned int parent, OS_XML *_lxml)
                           attr);
                 return (-1);
             } else if ((location == 0) && (count > 0)) {
+                attr[count] = '\0';
                 xml_error(_lxml, "XMLERR: Attribute '%s' has no value.",
                           attr);
                 return (-1);
@@ -541,11 +597,11 @@ static int _getattributes(unsigned int parent, OS_XML *_lxml)
                 i--;
             }
 
-            c = xml_getc_fun(_lxml->fp, _lxml);
+            c = _xml_getc(_lxml);
             if ((c != '"') && (c != '\'')) {
                 unsigned short int _err = 1;
                 if (isspace(c)) {
-                    while ((c = xml_getc_fun(_lxml->fp, _lxml)) != EOF) {
+                    while ((c = _xml_getc(_lxml)) != EOF) {
                         if (isspace(c)) {
                             continue;
                         } else if ((c == '"') || (c == '\'')) {
@@ -571,6 +627,7 @@ static int _getattributes(unsigned int parent, OS_XML *_lxml)
             if (count == 0) {
                 continue;
             } else {
+                attr[count] = '\0';
                 xml_error(_lxml, "XMLERR: Attribute '%s' has no value.", attr);
                 return (-1);
             }
@@ -583,7 +640,7 @@ static int _getattributes(unsigned int parent, OS_XML *_lxml)
             if (_writecontent(value, count + 1, _lxml->cur - 1, _lxml) < 0) {
                 return (-1);
             }
-            c = xml_getc_fun(_lxml->fp, _lxml);
+            c = _xml_getc(_lxml);
             if (isspace(c)) {
                 return (_getattributes(parent, _lxml));
             } else if (c == _R_CONFE) {
@@ -26,7 +26,6 @@ typedef struct _xml_node {
 
 #define XML_ERR_LENGTH  128
 #define XML_STASH_LEN   2
-#define xml_getc_fun(x,y) (x)? _xml_fgetc(x,y) : _xml_sgetc(y)
 typedef enum _XML_TYPE { XML_ATTR, XML_ELEM, XML_VARIABLE_BEGIN = '$' } XML_TYPE;
 
 /* XML structure */
@@ -46,13 +45,53 @@ typedef struct _OS_XML {
     int stash_i;                /* Stash index */
     FILE *fp;                   /* File descriptor */
     char *string;               /* XML string */
+    const char *string_end;     /* End of the XML string */
+    char *input;                /* Buffer or mapping of the input */
+    size_t input_map;           /* Size of the mapping, or 0 if it's a buffer */
+    struct _xml_arena *arena;   /* Blocks where the names and contents are stored */
+    unsigned int size;          /* Items allocated */
 } OS_XML;
 
 typedef xml_node **XML_NODE;
 
+/* Cursor to walk the parsed tree without copying it. The nodes it returns
+ * point to the strings of the OS_XML, and are overwritten by the next call
+ * on the same cursor, so each nesting level needs its own cursor.
+ */
+typedef struct _xml_cursor {
+    const OS_XML *xml;
+    xml_node **nodes;           /* Children found, NULL-terminated */
+    xml_node *items;            /* Storage of the children */
+    char **strings;             /* Attributes and values of the children */
+    unsigned int size;          /* Children allocated */
+    unsigned int strings_size;  /* Strings allocated */
+} xml_cursor;
+
 /* Start the XML structure reading a file */
 int OS_ReadXML(const char *file, OS_XML *lxml) __attribute__((nonnull));
 
+/* Start the XML structure reading a file, through a parse snapshot kept in
+ * cache_dir. The snapshot is used if it was made from the same content,
+ * else the file is parsed and the snapshot written again.
+ */
+int OS_ReadXMLCached(const char *file, OS_XML *_lxml, const char *cache_dir) __attribute__((nonnull));
+
+/* Callbacks of the streaming reader. Both get the element with its
+ * attributes, and the end callback also gets its content. The node and its
+ * strings are only valid during the call. A negative value stops the reading.
+ */
+typedef struct _OS_XML_HANDLER {
+    int (*start)(xml_node *node, unsigned int depth, void *data);
+    int (*end)(xml_node *node, unsigned int depth, void *data);
+} OS_XML_HANDLER;
+
+/* Read a XML file element by element, without building the structure.
+ * Variables are not applied. Returns 0 on success, -2 if the file can't be
+ * opened or -1 on error. The error is left in _lxml->err, unless a callback
+ * stopped the reading.
+ */
+int OS_ReadXMLStream(const char *file, OS_XML *_lxml, const OS_XML_HANDLER *handler, void *data) __attribute__((nonnull(1, 2, 3)));
+
 /* Start the XML structure reading a string */
 int OS_ReadXMLString(const char *string, OS_XML *_lxml) __attribute__((nonnull));
 
@@ -80,6 +119,17 @@ char **OS_GetElements(const OS_XML *_lxml, const char **element_name) __attribut
 /* Return the elements "children" of the element_name */
 xml_node **OS_GetElementsbyNode(const OS_XML *_lxml, const xml_node *node) __attribute__((nonnull(1)));
 
+/* Start a cursor over a parsed XML */
+void OS_CursorInit(xml_cursor *cursor, const OS_XML *_lxml) __attribute__((nonnull));
+
+/* Same as OS_GetElementsbyNode, but the nodes belong to the cursor and must
+ * not be freed. Returns NULL if there are no children or on memory error.
+ */
+xml_node **OS_CursorGetElements(xml_cursor *cursor, const xml_node *node) __attribute__((nonnull(1)));
+
+/* Free the buffers of a cursor */
+void OS_CursorClear(xml_cursor *cursor) __attribute__((nonnull));
+
 /* Return the attributes of the element name */
 char **OS_GetAttributes(const OS_XML *_lxml, const char **element_name) __attribute__((nonnull(1)));
 
@@ -0,0 +1,326 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+/* Binary snapshots of parsed XML files */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "os_xml.h"
+#include "os_xml_internal.h"
+
+#ifndef WIN32
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+#define XML_CACHE_MAGIC     0x4c4d5857  /* "WXML" */
+#define XML_CACHE_VERSION   1
+#define XML_CACHE_NULL      0xffffffff
+
+/* Snapshot layout: header, then cur records, then the strings of each record.
+ * Strings are stored as a length and the bytes (no terminator), NULL contents
+ * as XML_CACHE_NULL. Every number is in host order: a snapshot made on another
+ * platform fails the header check and is rebuilt.
+ */
+typedef struct xml_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t cur;
+    uint32_t line;
+    uint32_t _reserved;
+    uint64_t source_size;
+    uint64_t source_hash;
+} xml_cache_header;
+
+typedef struct xml_cache_record {
+    uint32_t tp;
+    uint32_t rl;
+    uint32_t ln;
+} xml_cache_record;
+
+static uint64_t xml_hash(const void *data, size_t len, uint64_t hash);
+static int xml_read_source(const char *file, uint64_t *size, uint64_t *hash);
+static int xml_load_cache(const char *path, uint64_t size, uint64_t hash, OS_XML *_lxml);
+static void xml_save_cache(const char *path, uint64_t size, uint64_t hash, const OS_XML *_lxml);
+
+int OS_ReadXMLCached(const char *file, OS_XML *_lxml, const char *cache_dir)
+{
+    char path[4096];
+    uint64_t size;
+    uint64_t hash;
+    int r;
+
+    /* Missing or unreadable files get the errors of OS_ReadXML() */
+    if (xml_read_source(file, &size, &hash) < 0) {
+        return OS_ReadXML(file, _lxml);
+    }
+
+    if ((size_t)snprintf(path, sizeof(path), "%s/%016llx.xmlc", cache_dir,
+                         (unsigned long long)xml_hash(file, strlen(file), 0)) >= sizeof(path)) {
+        return OS_ReadXML(file, _lxml);
+    }
+
+    if (xml_load_cache(path, size, hash, _lxml) == 0) {
+        return 0;
+    }
+
+    if (r = OS_ReadXML(file, _lxml), r == 0) {
+        xml_save_cache(path, size, hash, _lxml);
+    }
+
+    return r;
+}
+
+/* FNV-1a, 64 bits */
+static uint64_t xml_hash(const void *data, size_t len, uint64_t hash)
+{
+    const unsigned char *p = data;
+    size_t i;
+
+    if (!hash) {
+        hash = 0xcbf29ce484222325ULL;
+    }
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static int xml_read_source(const char *file, uint64_t *size, uint64_t *hash)
+{
+    char buffer[65536];
+    ssize_t n;
+    int fd;
+
+    if (fd = open(file, O_RDONLY | O_CLOEXEC), fd < 0) {
+        return -1;
+    }
+
+    *size = 0;
+    *hash = 0;
+
+    while (n = read(fd, buffer, sizeof(buffer)), n > 0) {
+        *hash = xml_hash(buffer, (size_t)n, *hash);
+        *size += (uint64_t)n;
+    }
+
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+/* String of a record, or -1 if the snapshot is truncated */
+static int xml_load_string(const char **p, const char *end, OS_XML *_lxml, char **str)
+{
+    uint32_t len;
+
+    if (end - *p < (long)sizeof(len)) {
+        return -1;
+    }
+
+    memcpy(&len, *p, sizeof(len));
+    *p += sizeof(len);
+
+    if (len == XML_CACHE_NULL) {
+        *str = NULL;
+        return 0;
+    }
+
+    if ((uint64_t)(end - *p) < len || (*str = xml_arena_strndup(_lxml, *p, len), !*str)) {
+        return -1;
+    }
+
+    *p += len;
+    return 0;
+}
+
+static int xml_load_cache(const char *path, uint64_t size, uint64_t hash, OS_XML *_lxml)
+{
+    const xml_cache_header *header;
+    const xml_cache_record *records;
+    const char *base;
+    const char *p;
+    const char *end;
+    struct stat st;
+    unsigned int i;
+    int retval = -1;
+    int fd;
+
+    if (fd = open(path, O_RDONLY | O_CLOEXEC), fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(xml_cache_header)) {
+        close(fd);
+        return -1;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    header = (const xml_cache_header *)base;
+    end = base + st.st_size;
+
+    if (header->magic != XML_CACHE_MAGIC || header->version != XML_CACHE_VERSION
+        || header->record_size != sizeof(xml_cache_record)
+        || header->source_size != size || header->source_hash != hash
+        || (uint64_t)(st.st_size - sizeof(xml_cache_header)) / sizeof(xml_cache_record) < header->cur) {
+        goto end;
+    }
+
+    memset(_lxml, 0, sizeof(OS_XML));
+
+    if (header->cur > 0) {
+        _lxml->tp = calloc(header->cur, sizeof(XML_TYPE));
+        _lxml->rl = calloc(header->cur, sizeof(unsigned int));
+        _lxml->ck = calloc(header->cur, sizeof(int));
+        _lxml->ln = calloc(header->cur, sizeof(unsigned int));
+        _lxml->el = calloc(header->cur, sizeof(char *));
+        _lxml->ct = calloc(header->cur, sizeof(char *));
+        _lxml->size = header->cur;
+
+        if (!(_lxml->tp && _lxml->rl && _lxml->ck && _lxml->ln && _lxml->el && _lxml->ct)) {
+            goto fail;
+        }
+    }
+
+    records = (const xml_cache_record *)(header + 1);
+    p = (const char *)(records + header->cur);
+
+    /* Every element was closed, or the snapshot wouldn't exist */
+    for (i = 0; i < header->cur; i++) {
+        _lxml->tp[i] = (XML_TYPE)records[i].tp;
+        _lxml->rl[i] = records[i].rl;
+        _lxml->ln[i] = records[i].ln;
+        _lxml->ck[i] = 1;
+
+        if (records[i].rl >= header->cur || xml_load_string(&p, end, _lxml, &_lxml->el[i]) < 0
+            || !_lxml->el[i] || xml_load_string(&p, end, _lxml, &_lxml->ct[i]) < 0) {
+            _lxml->cur = i + 1;
+            goto fail;
+        }
+    }
+
+    _lxml->cur = header->cur;
+    _lxml->line = header->line;
+    retval = 0;
+    goto end;
+
+fail:
+    OS_ClearXML(_lxml);
+
+end:
+    munmap((void *)base, (size_t)st.st_size);
+    return retval;
+}
+
+static int xml_save_string(FILE *fp, const char *str)
+{
+    uint32_t len = str ? (uint32_t)strlen(str) : XML_CACHE_NULL;
+
+    if (fwrite(&len, sizeof(len), 1, fp) != 1) {
+        return -1;
+    }
+
+    return str && len && fwrite(str, len, 1, fp) != 1 ? -1 : 0;
+}
+
+/* Written aside and renamed, so readers never see a partial snapshot */
+static void xml_save_cache(const char *path, uint64_t size, uint64_t hash, const OS_XML *_lxml)
+{
+    xml_cache_header header;
+    xml_cache_record record;
+    char tmp_path[4096 + 8];
+    unsigned int i;
+    FILE *fp;
+    int fd;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+
+    if (fd = mkstemp(tmp_path), fd < 0) {
+        return;
+    }
+
+    if (fp = fdopen(fd, "w"), !fp) {
+        close(fd);
+        unlink(tmp_path);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = XML_CACHE_MAGIC;
+    header.version = XML_CACHE_VERSION;
+    header.record_size = sizeof(xml_cache_record);
+    header.cur = _lxml->cur;
+    header.line = _lxml->line;
+    header.source_size = size;
+    header.source_hash = hash;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        goto fail;
+    }
+
+    for (i = 0; i < _lxml->cur; i++) {
+        record.tp = (uint32_t)_lxml->tp[i];
+        record.rl = _lxml->rl[i];
+        record.ln = _lxml->ln[i];
+
+        if (fwrite(&record, sizeof(record), 1, fp) != 1) {
+            goto fail;
+        }
+    }
+
+    for (i = 0; i < _lxml->cur; i++) {
+        if (xml_save_string(fp, _lxml->el[i]) < 0 || xml_save_string(fp, _lxml->ct[i]) < 0) {
+            goto fail;
+        }
+    }
+
+    if (fclose(fp) != 0) {
+        unlink(tmp_path);
+        return;
+    }
+
+    chmod(tmp_path, 0640);
+
+    if (rename(tmp_path, path) < 0) {
+        unlink(tmp_path);
+    }
+
+    return;
+
+fail:
+    fclose(fp);
+    unlink(tmp_path);
+}
+
+#else
+
+/* No snapshots on Windows */
+int OS_ReadXMLCached(const char *file, OS_XML *_lxml, __attribute__((unused)) const char *cache_dir)
+{
+    return OS_ReadXML(file, _lxml);
+}
+
+#endif /* WIN32 */
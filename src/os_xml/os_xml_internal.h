@@ -23,6 +23,21 @@
 #define XML_VAR              "var"
 #define XML_VAR_ATTRIBUTE    "name"
 
+/* Block of strings of an OS_XML, all freed at once */
+typedef struct _xml_arena {
+    struct _xml_arena *next;
+    size_t used;
+    size_t size;
+    char data[];
+} xml_arena;
+
+#define XML_ARENA_SIZE       65536
+
+/* Copy a string of a given length into the arena of an OS_XML.
+ * Returns NULL on memory error.
+ */
+char *xml_arena_strndup(OS_XML *_lxml, const char *str, size_t len);
+
 //#define XML_ELEM                101
 //#define XML_ATTR                102
 //#define XML_VARIABLE_BEGIN      '$'
@@ -160,3 +160,128 @@ fail:
     OS_ClearNode(ret);
     return (NULL);
 }
+
+/* Walk the children of a node, counting them and their attributes. They are
+ * stored in the cursor too if it has room for them.
+ */
+static unsigned int xml_cursor_scan(xml_cursor *cursor, const xml_node *node, int fill, unsigned int *attrs)
+{
+    const OS_XML *_lxml = cursor->xml;
+    unsigned int i, k = 0, s = 0, m;
+
+    if (node == NULL) {
+        m = 0;
+        i = 0;
+    } else {
+        i = node->key;
+        m = _lxml->rl[i++] + 1;
+    }
+
+    for (; i < _lxml->cur; i++) {
+        if (_lxml->tp[i] == XML_ELEM && _lxml->rl[i] == m && _lxml->el[i] != NULL) {
+            unsigned int l = i + 1;
+            unsigned int n;
+
+            /* Attributes follow the element */
+            while (l < _lxml->cur && _lxml->tp[l] == XML_ATTR && _lxml->rl[l] == m &&
+                   _lxml->el[l] && _lxml->ct[l]) {
+                l++;
+            }
+
+            n = l - i - 1;
+
+            if (fill) {
+                xml_node *item = &cursor->items[k];
+
+                item->key = i;
+                item->element = _lxml->el[i];
+                item->content = _lxml->ct[i];
+                item->attributes = NULL;
+                item->values = NULL;
+
+                if (n > 0) {
+                    item->attributes = &cursor->strings[s];
+                    item->values = &cursor->strings[s + n + 1];
+                    memcpy(item->attributes, &_lxml->el[i + 1], n * sizeof(char *));
+                    memcpy(item->values, &_lxml->ct[i + 1], n * sizeof(char *));
+                    item->attributes[n] = NULL;
+                    item->values[n] = NULL;
+                }
+
+                cursor->nodes[k] = item;
+            }
+
+            if (n > 0) {
+                s += 2 * (n + 1);
+            }
+
+            k++;
+            continue;
+        }
+
+        if ((_lxml->tp[i] == XML_ELEM) && (m > _lxml->rl[i]) && node != NULL) {
+            break;
+        }
+    }
+
+    *attrs = s;
+    return k;
+}
+
+void OS_CursorInit(xml_cursor *cursor, const OS_XML *_lxml)
+{
+    memset(cursor, 0, sizeof(xml_cursor));
+    cursor->xml = _lxml;
+}
+
+/* Get the elements by node, reusing the buffers of the cursor */
+xml_node **OS_CursorGetElements(xml_cursor *cursor, const xml_node *node)
+{
+    unsigned int count;
+    unsigned int strings;
+
+    /* Count first, so that the buffers are never moved while filled */
+    if (count = xml_cursor_scan(cursor, node, 0, &strings), count == 0) {
+        return (NULL);
+    }
+
+    if (count + 1 > cursor->size) {
+        xml_node **nodes;
+        xml_node *items;
+
+        if (nodes = (xml_node **)realloc(cursor->nodes, (count + 1) * sizeof(xml_node *)), !nodes) {
+            return (NULL);
+        }
+        cursor->nodes = nodes;
+
+        if (items = (xml_node *)realloc(cursor->items, (count + 1) * sizeof(xml_node)), !items) {
+            return (NULL);
+        }
+        cursor->items = items;
+
+        cursor->size = count + 1;
+    }
+
+    if (strings > cursor->strings_size) {
+        char **tmp;
+
+        if (tmp = (char **)realloc(cursor->strings, strings * sizeof(char *)), !tmp) {
+            return (NULL);
+        }
+
+        cursor->strings = tmp;
+        cursor->strings_size = strings;
+    }
+
+    xml_cursor_scan(cursor, node, 1, &strings);
+    cursor->nodes[count] = NULL;
+    return (cursor->nodes);
+}
+
+void OS_CursorClear(xml_cursor *cursor)
+{
+    free(cursor->nodes);
+    free(cursor->items);
+    free(cursor->strings);
+    memset(cursor, 0, sizeof(xml_cursor));
+}
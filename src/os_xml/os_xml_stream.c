@@ -0,0 +1,498 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+/* Streaming XML reader */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "os_xml.h"
+#include "os_xml_internal.h"
+
+/* The file is read once, and each element is handed to the callbacks as it's
+ * opened and closed, instead of being stored into the tree. Only the elements
+ * that are open at a time are kept: the memory depends on the depth of the
+ * document, not on its size. The syntax is the same one ParseXML() reads.
+ */
+
+typedef struct xml_frame {
+    xml_node node;
+    unsigned int attrs;                 /* Attributes read */
+    size_t length;                      /* Content length */
+    size_t size;                        /* Content buffer size */
+} xml_frame;
+
+typedef struct xml_stream {
+    OS_XML *xml;
+    const OS_XML_HANDLER *handler;
+    void *data;
+    xml_frame *stack;                   /* Open elements, the root first */
+    unsigned int depth;                 /* Open elements */
+    unsigned int size;                  /* Stack size */
+    unsigned int key;                   /* Elements read */
+} xml_stream;
+
+static void xml_stream_error(OS_XML *_lxml, const char *msg, ...) __attribute__((format(printf, 2, 3), nonnull));
+
+static void xml_stream_error(OS_XML *_lxml, const char *msg, ...)
+{
+    va_list args;
+    va_start(args, msg);
+
+    memset(_lxml->err, '\0', XML_ERR_LENGTH);
+    vsnprintf(_lxml->err, XML_ERR_LENGTH - 1, msg, args);
+    va_end(args);
+    _lxml->err_line = _lxml->line;
+}
+
+static int xml_stream_getc(OS_XML *_lxml)
+{
+    int c = (_lxml->stash_i > 0) ? _lxml->stash[--_lxml->stash_i] : getc(_lxml->fp);
+
+    if (c == '\n') {
+        _lxml->line++;
+    }
+
+    return c;
+}
+
+static void xml_stream_ungetc(int c, OS_XML *_lxml)
+{
+    if (c == EOF || _lxml->stash_i >= XML_STASH_LEN) {
+        return;
+    }
+
+    _lxml->stash[_lxml->stash_i++] = (char)c;
+
+    if (c == '\n') {
+        _lxml->line--;
+    }
+}
+
+/* Skip a comment, after "<!", up to "!>" or "-->" */
+static int xml_stream_comment(OS_XML *_lxml)
+{
+    int c;
+
+    while ((c = xml_stream_getc(_lxml)) != EOF) {
+        if (c == _R_COM) {
+            if ((c = xml_stream_getc(_lxml)) == _R_CONFE) {
+                return 0;
+            }
+            xml_stream_ungetc(c, _lxml);
+        } else if (c == '-') {
+            if ((c = xml_stream_getc(_lxml)) == '-' && (c = xml_stream_getc(_lxml)) == _R_CONFE) {
+                return 0;
+            }
+            xml_stream_ungetc(c, _lxml);
+        }
+    }
+
+    xml_stream_error(_lxml, "XMLERR: Comment not closed.");
+    return -1;
+}
+
+/* Skip a processing instruction, after "<?", up to "?>" */
+static int xml_stream_instruction(OS_XML *_lxml)
+{
+    int c;
+
+    while ((c = xml_stream_getc(_lxml)) != EOF) {
+        if (c == '?') {
+            if ((c = xml_stream_getc(_lxml)) == _R_CONFE) {
+                return 0;
+            }
+            xml_stream_ungetc(c, _lxml);
+        }
+    }
+
+    xml_stream_error(_lxml, "XMLERR: End of file and some elements were not closed.");
+    return -1;
+}
+
+static void xml_frame_clear(xml_frame *frame)
+{
+    unsigned int i;
+
+    for (i = 0; i < frame->attrs; i++) {
+        free(frame->node.attributes[i]);
+        free(frame->node.values[i]);
+    }
+
+    free(frame->node.attributes);
+    free(frame->node.values);
+    free(frame->node.element);
+    free(frame->node.content);
+    memset(frame, 0, sizeof(xml_frame));
+}
+
+static int xml_frame_add_attribute(xml_stream *stream, xml_frame *frame, const char *attr, const char *value)
+{
+    char **attributes;
+    char **values;
+    unsigned int i;
+
+    for (i = 0; i < frame->attrs; i++) {
+        if (strcmp(frame->node.attributes[i], attr) == 0) {
+            xml_stream_error(stream->xml, "XMLERR: Attribute '%s' already defined.", attr);
+            return -1;
+        }
+    }
+
+    if (attributes = realloc(frame->node.attributes, (frame->attrs + 2) * sizeof(char *)), !attributes) {
+        goto fail;
+    }
+    frame->node.attributes = attributes;
+
+    if (values = realloc(frame->node.values, (frame->attrs + 2) * sizeof(char *)), !values) {
+        goto fail;
+    }
+    frame->node.values = values;
+
+    attributes[frame->attrs] = strdup(attr);
+    values[frame->attrs] = strdup(value);
+    attributes[frame->attrs + 1] = NULL;
+    values[frame->attrs + 1] = NULL;
+
+    if (!attributes[frame->attrs] || !values[frame->attrs]) {
+        /* The frame owns both pointers, so it can be cleared */
+        frame->attrs++;
+        goto fail;
+    }
+
+    frame->attrs++;
+    return 0;
+
+fail:
+    snprintf(stream->xml->err, XML_ERR_LENGTH, "XMLERR: Memory error.");
+    return -1;
+}
+
+/* Read the attributes of the element being opened. Returns '/' if the
+ * element is closed already, 0 if it's open or -1 on error */
+static int xml_stream_attributes(xml_stream *stream, xml_frame *frame)
+{
+    OS_XML *_lxml = stream->xml;
+    int location = 0;
+    unsigned int count = 0;
+    int c;
+    int c_to_match = 0;
+    char attr[XML_MAXSIZE + 1];
+    char value[XML_MAXSIZE + 1];
+
+    attr[0] = '\0';
+
+    while ((c = xml_stream_getc(_lxml)) != EOF) {
+        if (count >= XML_MAXSIZE) {
+            attr[count - 1] = '\0';
+            xml_stream_error(_lxml, "XMLERR: Overflow attempt at attribute '%.20s'.", attr);
+            return -1;
+        } else if ((c == _R_CONFE) || ((location == 0) && (c == '/'))) {
+            if (location == 1) {
+                xml_stream_error(_lxml, "XMLERR: Attribute '%s' not closed.", attr);
+                return -1;
+            } else if (count > 0) {
+                attr[count] = '\0';
+                xml_stream_error(_lxml, "XMLERR: Attribute '%s' has no value.", attr);
+                return -1;
+            }
+
+            return (c == '/') ? '/' : 0;
+        } else if ((location == 0) && (c == '=')) {
+            attr[count] = '\0';
+
+            /* Spaces are allowed before the quote */
+            while (isspace(c = xml_stream_getc(_lxml)));
+
+            if ((c != '"') && (c != '\'')) {
+                xml_stream_error(_lxml, "XMLERR: Attribute '%s' not followed by a \" or \'.", attr);
+                return -1;
+            }
+
+            c_to_match = c;
+            location = 1;
+            count = 0;
+        } else if ((location == 0) && (isspace(c))) {
+            if (count > 0) {
+                attr[count] = '\0';
+                xml_stream_error(_lxml, "XMLERR: Attribute '%s' has no value.", attr);
+                return -1;
+            }
+        } else if ((location == 1) && (c == c_to_match)) {
+            value[count] = '\0';
+
+            if (xml_frame_add_attribute(stream, frame, attr, value) < 0) {
+                return -1;
+            }
+
+            c = xml_stream_getc(_lxml);
+
+            if (isspace(c)) {
+                location = 0;
+                count = 0;
+            } else if (c == _R_CONFE) {
+                return 0;
+            } else if (c == '/') {
+                return '/';
+            } else {
+                xml_stream_error(_lxml, "XMLERR: Bad attribute closing for '%s'='%s'.", attr, value);
+                return -1;
+            }
+        } else if (location == 0) {
+            attr[count++] = (char)c;
+        } else {
+            value[count++] = (char)c;
+        }
+    }
+
+    xml_stream_error(_lxml, "XMLERR: End of file while reading an attribute.");
+    return -1;
+}
+
+static int xml_stream_append(xml_stream *stream, xml_frame *frame, char c)
+{
+    if (frame->length >= XML_MAXSIZE) {
+        xml_stream_error(stream->xml, "XMLERR: String overflow.");
+        return -1;
+    }
+
+    if (frame->length + 1 >= frame->size) {
+        size_t size = frame->size ? frame->size * 2 : 64;
+        char *content;
+
+        if (content = realloc(frame->node.content, size), !content) {
+            snprintf(stream->xml->err, XML_ERR_LENGTH, "XMLERR: Memory error.");
+            return -1;
+        }
+
+        frame->node.content = content;
+        frame->size = size;
+    }
+
+    frame->node.content[frame->length++] = c;
+    return 0;
+}
+
+/* Hand the element on top to the end callback, and pop it */
+static int xml_stream_close(xml_stream *stream)
+{
+    xml_frame *frame = stream->stack + stream->depth - 1;
+    int r = 0;
+
+    if (xml_stream_append(stream, frame, '\0') < 0) {
+        return -1;
+    }
+
+    if (stream->handler->end) {
+        r = stream->handler->end(&frame->node, stream->depth - 1, stream->data);
+    }
+
+    xml_frame_clear(frame);
+    stream->depth--;
+    return r < 0 ? -1 : 0;
+}
+
+/* Read an element being opened, after the "<" */
+static int xml_stream_open(xml_stream *stream)
+{
+    OS_XML *_lxml = stream->xml;
+    char elem[XML_MAXSIZE + 1];
+    unsigned int count = 0;
+    xml_frame *frame;
+    int closed = 0;
+    int c;
+
+    while ((c = xml_stream_getc(_lxml)) != EOF && c != _R_CONFE && !isspace(c)) {
+        if (count >= XML_MAXSIZE) {
+            xml_stream_error(_lxml, "XMLERR: String overflow.");
+            return -1;
+        }
+
+        elem[count++] = (char)c;
+    }
+
+    if (c == EOF) {
+        xml_stream_error(_lxml, "XMLERR: End of file and some elements were not closed.");
+        return -1;
+    }
+
+    elem[count] = '\0';
+
+    /* Remove the / at the end of the element name */
+    if (count > 0 && elem[count - 1] == '/') {
+        elem[count - 1] = '\0';
+        closed = 1;
+    }
+
+    if (stream->depth == stream->size) {
+        unsigned int size = stream->size ? stream->size * 2 : 16;
+
+        if (frame = realloc(stream->stack, size * sizeof(xml_frame)), !frame) {
+            snprintf(_lxml->err, XML_ERR_LENGTH, "XMLERR: Memory error.");
+            return -1;
+        }
+
+        memset(frame + stream->size, 0, (size - stream->size) * sizeof(xml_frame));
+        stream->stack = frame;
+        stream->size = size;
+    }
+
+    /* Only the content after the last child is kept, as ParseXML() does */
+    if (stream->depth > 0) {
+        stream->stack[stream->depth - 1].length = 0;
+    }
+
+    frame = stream->stack + stream->depth++;
+    frame->node.key = stream->key++;
+
+    if (frame->node.element = strdup(elem), !frame->node.element) {
+        snprintf(_lxml->err, XML_ERR_LENGTH, "XMLERR: Memory error.");
+        return -1;
+    }
+
+    if (isspace(c)) {
+        int r;
+
+        if (r = xml_stream_attributes(stream, frame), r < 0) {
+            return -1;
+        } else if (r == '/') {
+            closed = 1;
+
+            /* The closing '>' after the '/' */
+            if (c = xml_stream_getc(_lxml), c != _R_CONFE) {
+                xml_stream_ungetc(c, _lxml);
+            }
+        }
+    }
+
+    if (stream->handler->start && stream->handler->start(&frame->node, stream->depth - 1, stream->data) < 0) {
+        return -1;
+    }
+
+    return closed ? xml_stream_close(stream) : 0;
+}
+
+/* Read a closing tag, after the "</" */
+static int xml_stream_end(xml_stream *stream)
+{
+    OS_XML *_lxml = stream->xml;
+    char elem[XML_MAXSIZE + 1];
+    unsigned int count = 0;
+    int c;
+
+    if (stream->depth == 0) {
+        xml_stream_error(_lxml, "XMLERR: Element not opened.");
+        return -1;
+    }
+
+    while ((c = xml_stream_getc(_lxml)) != EOF && c != _R_CONFE) {
+        if (count >= XML_MAXSIZE) {
+            xml_stream_error(_lxml, "XMLERR: String overflow.");
+            return -1;
+        }
+
+        elem[count++] = (char)c;
+    }
+
+    elem[count] = '\0';
+
+    if (c == EOF) {
+        xml_stream_error(_lxml, "XMLERR: End of file and some elements were not closed.");
+        return -1;
+    } else if (strcmp(elem, stream->stack[stream->depth - 1].node.element) != 0) {
+        xml_stream_error(_lxml, "XMLERR: Element '%s' not closed.", stream->stack[stream->depth - 1].node.element);
+        return -1;
+    }
+
+    return xml_stream_close(stream);
+}
+
+static int xml_stream_parse(xml_stream *stream)
+{
+    OS_XML *_lxml = stream->xml;
+    int escaped = 0;
+    int c;
+
+    while ((c = xml_stream_getc(_lxml)) != EOF) {
+        if (c == _R_CONFS && !escaped) {
+            switch (c = xml_stream_getc(_lxml)) {
+            case _R_COM:
+                if (xml_stream_comment(_lxml) < 0) {
+                    return -1;
+                }
+                continue;
+
+            case '?':
+                if (xml_stream_instruction(_lxml) < 0) {
+                    return -1;
+                }
+                continue;
+
+            case '/':
+                if (xml_stream_end(stream) < 0) {
+                    return -1;
+                }
+                continue;
+
+            default:
+                xml_stream_ungetc(c, _lxml);
+
+                if (xml_stream_open(stream) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+        }
+
+        /* A backslash escapes the next '<' */
+        escaped = (c == '\\') ? !escaped : 0;
+
+        /* Text out of the elements is ignored */
+        if (stream->depth > 0 && xml_stream_append(stream, stream->stack + stream->depth - 1, (char)c) < 0) {
+            return -1;
+        }
+    }
+
+    if (stream->depth > 0) {
+        xml_stream_error(_lxml, "XMLERR: End of file and some elements were not closed.");
+        return -1;
+    }
+
+    return 0;
+}
+
+int OS_ReadXMLStream(const char *file, OS_XML *_lxml, const OS_XML_HANDLER *handler, void *data)
+{
+    xml_stream stream = { .xml = _lxml, .handler = handler, .data = data };
+    int r;
+
+    /* Initialize xml structure */
+    memset(_lxml, 0, sizeof(OS_XML));
+
+    if (_lxml->fp = fopen(file, "r"), !_lxml->fp) {
+        xml_stream_error(_lxml, "XMLERR: File '%s' not found.", file);
+        return -2;
+    }
+
+    _lxml->line = 1;
+
+    r = xml_stream_parse(&stream);
+
+    while (stream.depth > 0) {
+        xml_frame_clear(stream.stack + --stream.depth);
+    }
+
+    free(stream.stack);
+    fclose(_lxml->fp);
+    _lxml->fp = NULL;
+    return r;
+}
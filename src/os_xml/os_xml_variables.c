@@ -148,29 +148,34 @@ int OS_ApplyVariables(OS_XML *_lxml)
 
                                 size_t tsize = strlen(_lxml->ct[i]) +
                                                strlen(value[j]) - tp + 1;
-                                var_placeh = strdup(_lxml->ct[i]);
-                                free(_lxml->ct[i]);
-                                _lxml->ct[i] = (char *)calloc(tsize + 2,
-                                                              sizeof(char));
+                                /* The old content stays in the arena until the XML is cleared */
+                                var_placeh = (char *)calloc(tsize + 2, sizeof(char));
 
-                                if (_lxml->ct[i] == NULL || var_placeh == NULL) {
+                                if (var_placeh == NULL) {
                                     snprintf(_lxml->err, XML_ERR_LENGTH, "XMLERR: Memory "
                                              "error.");
                                     goto fail;
                                 }
 
-                                strncpy(_lxml->ct[i], var_placeh, tsize);
+                                strncpy(var_placeh, _lxml->ct[i], tsize);
 
-                                _lxml->ct[i][init] = '\0';
-                                strncat(_lxml->ct[i], value[j], tsize - init);
+                                var_placeh[init] = '\0';
+                                strncat(var_placeh, value[j], tsize - init);
 
-                                init = strlen(_lxml->ct[i]);
-                                strncat(_lxml->ct[i], p,
-                                        tsize - strlen(_lxml->ct[i]));
+                                init = strlen(var_placeh);
+                                strncat(var_placeh, p,
+                                        tsize - strlen(var_placeh));
 
+                                _lxml->ct[i] = xml_arena_strndup(_lxml, var_placeh, strlen(var_placeh));
                                 free(var_placeh);
                                 var_placeh = NULL;
 
+                                if (_lxml->ct[i] == NULL) {
+                                    snprintf(_lxml->err, XML_ERR_LENGTH, "XMLERR: Memory "
+                                             "error.");
+                                    goto fail;
+                                }
+
                                 break;
                             }
 
@@ -8,37 +8,156 @@
  * Foundation
  */
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "os_zlib.h"
 
 #include "../external/zlib/zlib.h"
 
+/* Streams of a thread, kept between messages. Setting up a stream costs
+ * far more than compressing a message of a few hundred bytes.
+ */
+typedef struct os_zlib_streams_t {
+    z_stream deflate;
+    z_stream inflate;
+    int deflate_level;      // -1 while the deflate stream is not set up
+    int inflate_ready;
+} os_zlib_streams_t;
+
+static int zlib_level = OS_ZLIB_LEVEL;
+static pthread_once_t zlib_once = PTHREAD_ONCE_INIT;
+static pthread_key_t zlib_key;
+static __thread os_zlib_streams_t *zlib_streams;
+
+static void os_zlib_destroy(void *arg)
+{
+    os_zlib_streams_t *streams = arg;
+
+    if (streams->deflate_level >= 0) {
+        deflateEnd(&streams->deflate);
+    }
+
+    if (streams->inflate_ready) {
+        inflateEnd(&streams->inflate);
+    }
+
+    free(streams);
+}
+
+static void os_zlib_init(void)
+{
+    pthread_key_create(&zlib_key, os_zlib_destroy);
+}
+
+static os_zlib_streams_t *os_zlib_get_streams(void)
+{
+    if (!zlib_streams) {
+        pthread_once(&zlib_once, os_zlib_init);
+
+        if (zlib_streams = calloc(1, sizeof(os_zlib_streams_t)), !zlib_streams) {
+            return NULL;
+        }
+
+        zlib_streams->deflate_level = -1;
+        pthread_setspecific(zlib_key, zlib_streams);
+    }
+
+    return zlib_streams;
+}
+
+void os_zlib_set_level(int level)
+{
+    zlib_level = level;
+}
+
 unsigned long int os_zlib_compress(const char *src, char *dst,
                                    unsigned long int src_size,
                                    unsigned long int dst_size)
 {
-    if (compress2((Bytef *)dst,
-                  &dst_size,
-                  (const Bytef *)src,
-                  src_size,
-                  Z_BEST_COMPRESSION) == Z_OK) {
-        dst[dst_size] = '\0';
-        return (dst_size);
+    os_zlib_streams_t *streams;
+    z_stream *strm;
+    int level = zlib_level;
+
+    if (!src || !dst || !dst_size) {
+        return (0);
+    }
+
+    if (streams = os_zlib_get_streams(), !streams) {
+        return (0);
+    }
+
+    strm = &streams->deflate;
+
+    if (streams->deflate_level != level) {
+        if (streams->deflate_level >= 0) {
+            deflateEnd(strm);
+            streams->deflate_level = -1;
+        }
+
+        memset(strm, 0, sizeof(z_stream));
+
+        if (deflateInit(strm, level) != Z_OK) {
+            return (0);
+        }
+
+        streams->deflate_level = level;
+    } else if (deflateReset(strm) != Z_OK) {
+        return (0);
+    }
+
+    strm->next_in = (Bytef *)src;
+    strm->avail_in = (uInt)src_size;
+    strm->next_out = (Bytef *)dst;
+    strm->avail_out = (uInt)dst_size;
+
+    if (deflate(strm, Z_FINISH) != Z_STREAM_END) {
+        return (0);
     }
 
-    return (0);
+    dst[strm->total_out] = '\0';
+    return (strm->total_out);
 }
 
 unsigned long int os_zlib_uncompress(const char *src, char *dst,
                                      unsigned long int src_size,
                                      unsigned long int dst_size)
 {
-    if (uncompress((Bytef *)dst,
-                   &dst_size,
-                   (const Bytef *)src,
-                   src_size) == Z_OK) {
-        dst[dst_size] = '\0';
-        return (dst_size);
+    os_zlib_streams_t *streams;
+    z_stream *strm;
+
+    if (!src || !dst || !src_size || !dst_size) {
+        return (0);
+    }
+
+    if (streams = os_zlib_get_streams(), !streams) {
+        return (0);
+    }
+
+    strm = &streams->inflate;
+
+    if (!streams->inflate_ready) {
+        memset(strm, 0, sizeof(z_stream));
+
+        if (inflateInit(strm) != Z_OK) {
+            return (0);
+        }
+
+        streams->inflate_ready = 1;
+    } else if (inflateReset(strm) != Z_OK) {
+        return (0);
+    }
+
+    strm->next_in = (Bytef *)src;
+    strm->avail_in = (uInt)src_size;
+    strm->next_out = (Bytef *)dst;
+    strm->avail_out = (uInt)dst_size;
+
+    if (inflate(strm, Z_FINISH) != Z_STREAM_END) {
+        return (0);
     }
 
-    return (0);
+    dst[strm->total_out] = '\0';
+    return (strm->total_out);
 }
@@ -11,7 +11,15 @@
 #ifndef OS_ZLIB_H
 #define OS_ZLIB_H
 
-/* Compress a string with zlib
+/* Default compression level. Higher levels take several times longer on
+ * short messages and barely make them smaller.
+ */
+#define OS_ZLIB_LEVEL 6
+
+/* Set the compression level (1-9) of the next messages */
+void os_zlib_set_level(int level);
+
+/* Compress a string with zlib, reusing the stream of the calling thread
  * src: the source string to compress
  * dst: the destination buffer for the compressed string, will be
  *      null-terminated on success
@@ -23,7 +31,7 @@ unsigned long int os_zlib_compress(const char *src, char *dst,
                                    unsigned long int src_size,
                                    unsigned long int dst_size);
 
-/* Uncompress a string with zlib
+/* Uncompress a string with zlib, reusing the stream of the calling thread
  * src: the source string to uncompress
  * dst: the destination buffer for the uncompressed string, will be
  *      null-terminated on success
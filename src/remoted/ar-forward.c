@@ -14,149 +14,166 @@
 #include "remoted.h"
 #include "os_net/os_net.h"
 
+/* Maximum number of requests received at once */
+#define AR_FORWARD_BATCH 64
 
-/* Start of a new thread. Only returns on unrecoverable errors. */
-void *AR_Forward(__attribute__((unused)) void *arg)
+
+/* Forward an active response request to its agents */
+static void ar_forward_message(char *msg, char *msg_to_send)
 {
-    int arq = 0;
     int key_id = 0;
     int ar_location = 0;
-    const char * path = isChroot() ? ARQUEUE : DEFAULTDIR ARQUEUE;
-    char *msg_to_send;
-    os_calloc(OS_MAXSTR, sizeof(char), msg_to_send);
-    char *msg;
-    os_calloc(OS_MAXSTR, sizeof(char), msg);
     char *location = NULL;
     char *ar_location_str = NULL;
     char *ar_agent_id = NULL;
     char *tmp_str = NULL;
     char agent_id[KEYSIZE + 1] = "";
 
-    /* Create the unix queue */
-    if ((arq = StartMQ(path, READ)) < 0) {
-        merror_exit(QUEUE_ERROR, path, strerror(errno));
-    }
+    mdebug2("Active response request received: %s", msg);
 
-    /* Daemon loop */
-    while (1) {
-        if (OS_RecvUnix(arq, OS_MAXSTR - 1, msg)) {
+    /* Always zero the location */
+    ar_location = 0;
 
-            mdebug2("Active response request received: %s", msg);
+    /* Get the location */
+    location = msg;
 
-            /* Always zero the location */
-            ar_location = 0;
+    /* Location is going to be the agent name */
+    tmp_str = strchr(msg, ')');
+    if (!tmp_str) {
+        mwarn(EXECD_INV_MSG, msg);
+        return;
+    }
+    *tmp_str = '\0';
 
-            /* Get the location */
-            location = msg;
+    /* Going after the ')' and space */
+    tmp_str += 2;
 
-            /* Location is going to be the agent name */
-            tmp_str = strchr(msg, ')');
-            if (!tmp_str) {
-                mwarn(EXECD_INV_MSG, msg);
-                continue;
-            }
-            *tmp_str = '\0';
+    /* Extract the source IP */
+    tmp_str = strchr(tmp_str, ' ');
+    if (!tmp_str) {
+        mwarn(EXECD_INV_MSG, msg);
+        return;
+    }
+    tmp_str++;
+    location++;
 
-            /* Going after the ')' and space */
-            tmp_str += 2;
+    /* Set ar_location */
+    ar_location_str = tmp_str;
+    if (*tmp_str == ALL_AGENTS_C) {
+        ar_location |= ALL_AGENTS;
+    }
+    tmp_str++;
+    if (*tmp_str == REMOTE_AGENT_C) {
+        ar_location |= REMOTE_AGENT;
+    } else if (*tmp_str == NO_AR_C) {
+        ar_location |= NO_AR_MSG;
+    }
+    tmp_str++;
+    if (*tmp_str == SPECIFIC_AGENT_C) {
+        ar_location |= SPECIFIC_AGENT;
+    }
 
-            /* Extract the source IP */
-            tmp_str = strchr(tmp_str, ' ');
-            if (!tmp_str) {
-                mwarn(EXECD_INV_MSG, msg);
-                continue;
-            }
-            tmp_str++;
-            location++;
+    /* Extract the active response location */
+    tmp_str = strchr(ar_location_str, ' ');
+    if (!tmp_str) {
+        mwarn(EXECD_INV_MSG, msg);
+        return;
+    }
+    *tmp_str = '\0';
+    tmp_str++;
+
+    /* Extract the agent id */
+    ar_agent_id = tmp_str;
+    tmp_str = strchr(tmp_str, ' ');
+    if (!tmp_str) {
+        mwarn(EXECD_INV_MSG, msg);
+        return;
+    }
+    *tmp_str = '\0';
+    tmp_str++;
+
+    /* Create the new message */
+    if (ar_location & NO_AR_MSG) {
+        snprintf(msg_to_send, OS_MAXSTR, "%s%s",
+                 CONTROL_HEADER,
+                 tmp_str);
+    } else {
+        snprintf(msg_to_send, OS_MAXSTR, "%s%s%s",
+                 CONTROL_HEADER,
+                 EXECD_HEADER,
+                 tmp_str);
+    }
 
-            /* Set ar_location */
-            ar_location_str = tmp_str;
-            if (*tmp_str == ALL_AGENTS_C) {
-                ar_location |= ALL_AGENTS;
-            }
-            tmp_str++;
-            if (*tmp_str == REMOTE_AGENT_C) {
-                ar_location |= REMOTE_AGENT;
-            } else if (*tmp_str == NO_AR_C) {
-                ar_location |= NO_AR_MSG;
-            }
-            tmp_str++;
-            if (*tmp_str == SPECIFIC_AGENT_C) {
-                ar_location |= SPECIFIC_AGENT;
-            }
+    mdebug2("Active response sent: %s", msg_to_send);
 
-            /* Extract the active response location */
-            tmp_str = strchr(ar_location_str, ' ');
-            if (!tmp_str) {
-                mwarn(EXECD_INV_MSG, msg);
-                continue;
-            }
-            *tmp_str = '\0';
-            tmp_str++;
-
-            /* Extract the agent id */
-            ar_agent_id = tmp_str;
-            tmp_str = strchr(tmp_str, ' ');
-            if (!tmp_str) {
-                mwarn(EXECD_INV_MSG, msg);
-                continue;
-            }
-            *tmp_str = '\0';
-            tmp_str++;
-
-            /* Create the new message */
-            if (ar_location & NO_AR_MSG) {
-                snprintf(msg_to_send, OS_MAXSTR, "%s%s",
-                         CONTROL_HEADER,
-                         tmp_str);
-            } else {
-                snprintf(msg_to_send, OS_MAXSTR, "%s%s%s",
-                         CONTROL_HEADER,
-                         EXECD_HEADER,
-                         tmp_str);
+    /* Send to ALL agents */
+    if (ar_location & ALL_AGENTS) {
+        unsigned int i;
+
+        /* Lock use of keys */
+        key_lock_read();
+
+        for (i = 0; i < keys.keysize; i++) {
+            if (keys.keyentries[i]->rcvd >= (time(0) - DISCON_TIME)) {
+                strncpy(agent_id, keys.keyentries[i]->id, KEYSIZE);
+                key_unlock();
+                send_msg(agent_id, msg_to_send, -1);
+                key_lock_read();
             }
+        }
 
-            mdebug2("Active response sent: %s", msg_to_send);
+        key_unlock();
+    }
 
-            /* Send to ALL agents */
-            if (ar_location & ALL_AGENTS) {
-                unsigned int i;
+    /* Send to the remote agent that generated the event */
+    else if ((ar_location & REMOTE_AGENT) && (location != NULL)) {
+        key_lock_read();
+        key_id = OS_IsAllowedName(&keys, location);
 
-                /* Lock use of keys */
-                key_lock_read();
+        if (key_id < 0) {
+            key_unlock();
+            merror(AR_NOAGENT_ERROR, location);
+            return;
+        }
 
-                for (i = 0; i < keys.keysize; i++) {
-                    if (keys.keyentries[i]->rcvd >= (time(0) - DISCON_TIME)) {
-                        strncpy(agent_id, keys.keyentries[i]->id, KEYSIZE);
-                        key_unlock();
-                        send_msg(agent_id, msg_to_send, -1);
-                        key_lock_read();
-                    }
-                }
+        strncpy(agent_id, keys.keyentries[key_id]->id, KEYSIZE);
+        key_unlock();
+        send_msg(agent_id, msg_to_send, -1);
+    }
 
-                key_unlock();
-            }
+    /* Send to a pre-defined agent */
+    else if (ar_location & SPECIFIC_AGENT) {
+        ar_location++;
+        send_msg(ar_agent_id, msg_to_send, -1);
+    }
+}
 
-            /* Send to the remote agent that generated the event */
-            else if ((ar_location & REMOTE_AGENT) && (location != NULL)) {
-                key_lock_read();
-                key_id = OS_IsAllowedName(&keys, location);
+/* Start of a new thread. Only returns on unrecoverable errors. */
+void *AR_Forward(__attribute__((unused)) void *arg)
+{
+    int arq = 0;
+    const char * path = isChroot() ? ARQUEUE : DEFAULTDIR ARQUEUE;
+    char *msg_to_send;
+    os_calloc(OS_MAXSTR, sizeof(char), msg_to_send);
+    char *msgs[AR_FORWARD_BATCH];
+    int lengths[AR_FORWARD_BATCH];
+    int count;
+    int i;
 
-                if (key_id < 0) {
-                    key_unlock();
-                    merror(AR_NOAGENT_ERROR, location);
-                    continue;
-                }
+    for (i = 0; i < AR_FORWARD_BATCH; i++) {
+        os_calloc(OS_MAXSTR + 1, sizeof(char), msgs[i]);
+    }
 
-                strncpy(agent_id, keys.keyentries[key_id]->id, KEYSIZE);
-                key_unlock();
-                send_msg(agent_id, msg_to_send, -1);
-            }
+    /* Create the unix queue */
+    if ((arq = StartMQ(path, READ)) < 0) {
+        merror_exit(QUEUE_ERROR, path, strerror(errno));
+    }
 
-            /* Send to a pre-defined agent */
-            else if (ar_location & SPECIFIC_AGENT) {
-                ar_location++;
-                send_msg(ar_agent_id, msg_to_send, -1);
+    /* Daemon loop: analysisd sends the requests in batches */
+    while (1) {
+        if (count = OS_RecvUnixBatch(arq, OS_MAXSTR, msgs, lengths, AR_FORWARD_BATCH, 0), count > 0) {
+            for (i = 0; i < count; i++) {
+                ar_forward_message(msgs[i], msg_to_send);
             }
         }
     }
@@ -12,6 +12,7 @@
 #include "os_xml/os_xml.h"
 #include "os_regex/os_regex.h"
 #include "os_net/os_net.h"
+#include "os_zlib/os_zlib.h"
 #include "remoted.h"
 #include "config/config.h"
 
@@ -34,6 +35,11 @@ int buffer_relax;
 int tcp_keepidle;
 int tcp_keepintvl;
 int tcp_keepcnt;
+int tcp_reactors;
+int udp_receivers;
+int batch_events;
+int credit_max;
+int shared_delta;
 
 /* Read the config file (the remote access) */
 int RemotedConfig(const char *cfgfile, remoted *cfg)
@@ -51,6 +57,10 @@ int RemotedConfig(const char *cfgfile, remoted *cfg)
 
     receive_chunk = (unsigned)getDefine_Int("remoted", "receive_chunk", 1024, 16384);
     buffer_relax = getDefine_Int("remoted", "buffer_relax", 0, 2);
+    batch_events = getDefine_Int("remoted", "batch_events", 0, 1);
+    credit_max = getDefine_Int("remoted", "credit_max", 0, 1000);
+    shared_delta = getDefine_Int("remoted", "shared_delta", 0, 1);
+    os_zlib_set_level(getDefine_Int("remoted", "compress_level", 1, 9));
 
     if (ReadConfig(modules, cfgfile, cfg, NULL) < 0) {
         return (OS_INVALID);
@@ -157,6 +167,11 @@ cJSON *getRemoteInternalConfig(void) {
     cJSON_AddNumberToObject(remoted,"tcp_keepidle",tcp_keepidle);
     cJSON_AddNumberToObject(remoted,"tcp_keepintvl",tcp_keepintvl);
     cJSON_AddNumberToObject(remoted,"tcp_keepcnt",tcp_keepcnt);
+    cJSON_AddNumberToObject(remoted,"tcp_reactors",tcp_reactors);
+    cJSON_AddNumberToObject(remoted,"udp_receivers",udp_receivers);
+    cJSON_AddNumberToObject(remoted,"batch_events",batch_events);
+    cJSON_AddNumberToObject(remoted,"credit_max",credit_max);
+    cJSON_AddNumberToObject(remoted,"shared_delta",shared_delta);
 
     cJSON_AddItemToObject(internals,"remoted",remoted);
     cJSON_AddItemToObject(root,"internal",internals);
@@ -32,7 +32,28 @@ typedef struct group_t {
     file_sum **f_sum;
 } group_t;
 
+/* Checksum of a shared file, valid while its inode, time and size stay */
+typedef struct file_md5_t {
+    ino_t inode;
+    time_t mtime;
+    off_t size;
+    os_md5 sum;
+    os_md5 inputs;  // Merged files: checksum of the list of files that were merged into it
+    merged_sum_t * manifest;    // Merged files: their files, once an agent needed a delta
+    char * tag;                 // Merged files: their first line
+} file_md5_t;
+
+/* Files of a merged file to send to an agent, and the manifest to rebuild it */
+typedef struct shared_delta_t {
+    FILE * fp;                  // Merged file, opened while its checksum was known
+    merged_sum_t * files;       // Files that the agent lacks, or NULL
+    char * manifest;
+    int count;                  // Files to send
+    int total;                  // Files in the merged file
+} shared_delta_t;
+
 static OSHash *invalid_files;
+static OSHash *md5_cache;
 
 /* Internal functions prototypes */
 static void read_controlmsg(const char *agent_id, char *msg);
@@ -40,6 +61,13 @@ static int send_file_toagent(const char *agent_id, const char *group, const char
 static void c_group(const char *group, char ** files, file_sum ***_f_sum,char * sharedcfg_dir);
 static void c_multi_group(char *multi_group,file_sum ***_f_sum,char *hash_multigroup);
 static void c_files(void);
+static file_md5_t * c_md5_file(const char *path, int *cached);
+static void c_md5_free(void * entry);
+static void shared_file_path(char file[OS_SIZE_1024 + 1], const char *group, const char *name, const char *sharedcfg_dir);
+static int send_data_toagent(const char *agent_id, FILE *fp, size_t size, const char *name, const char *sum);
+static shared_delta_t * c_delta(const char *group, const char *sharedcfg_dir, const char *sum, const char *agent_files);
+static int send_delta_toagent(const char *agent_id, shared_delta_t *delta);
+static void free_delta(shared_delta_t *delta);
 
 /*
  *  Read queue/agent-groups and delete this group for all the agents.
@@ -82,6 +110,93 @@ void cleaner(void* data){
     os_free(data);
 }
 
+/* Agent-info files with a pending write, linked through next_dirty */
+static pending_data_t * dirty_list;
+static int agentinfo_interval;
+
+/* Queue an agent-info write for the flusher thread. Call with lastmsg_mutex held */
+static void agentinfo_mark(pending_data_t * data, int flag) {
+    if (!data->dirty) {
+        data->next_dirty = dirty_list;
+        dirty_list = data;
+    }
+
+    data->dirty |= flag;
+}
+
+/* Create an agent-info file without changing its content */
+static void agentinfo_create(const char * path) {
+    mode_t oldmask = umask(0006);
+    FILE * fp;
+
+    if (fp = fopen(path, "a"), fp) {
+        fclose(fp);
+    } else {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+    }
+
+    umask(oldmask);
+}
+
+/* Write the uname of an agent, the manager hostname and the node name to its agent-info file */
+static void agentinfo_write(const char * path, const char * uname, const char * hostname) {
+    mode_t oldmask = umask(0006);
+    FILE * fp = fopen(path, "w");
+
+    umask(oldmask);
+
+    if (fp) {
+        fprintf(fp, "%s\n", uname);
+
+        /* Write manager hostname to the file */
+
+        if (hostname) {
+            fprintf(fp, "#\"_manager_hostname\":%s\n", hostname);
+        }
+
+        /* Write Cluster's node name to the agent-info file */
+        fprintf(fp, "#\"_node_name\":%s\n", node_name);
+
+        fclose(fp);
+    } else {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+    }
+}
+
+/* Get the manager hostname, or NULL on error */
+static const char * agentinfo_hostname(char hostname[HOST_NAME_MAX + 1]) {
+    if (gethostname(hostname, HOST_NAME_MAX) < 0){
+        mwarn("Unable to get hostname due to: '%s'", strerror(errno));
+        return NULL;
+    }
+
+    hostname[HOST_NAME_MAX] = '\0';
+    return hostname;
+}
+
+/* Rate credit for the agents, as a percentage of their events_per_second.
+ * It's credit_max while the message queue is mostly empty, and shrinks to
+ * CREDIT_MIN as it fills up. The handlers block when analysisd is behind,
+ * so the queue reflects its load too. It's rounded to tens, so that agents
+ * are told only about meaningful changes.
+ */
+static int rem_credit() {
+    size_t total = rem_get_tsize();
+    unsigned int usage = total ? (unsigned int)(rem_get_qsize() * 100 / total) : 0;
+    int credit;
+
+    if (usage <= CREDIT_LOW) {
+        credit = credit_max;
+    } else if (usage >= CREDIT_HIGH) {
+        credit = CREDIT_MIN;
+    } else {
+        credit = CREDIT_MIN + (credit_max - CREDIT_MIN) * (int)(CREDIT_HIGH - usage) / (CREDIT_HIGH - CREDIT_LOW);
+    }
+
+    credit = credit / 10 * 10;
+    return credit > CREDIT_MIN ? credit : CREDIT_MIN;
+}
+
 /* Save a control message received from an agent
  * read_controlmsg (other thread) is going to deal with it
  * (only if message changed)
@@ -92,8 +207,6 @@ void save_controlmsg(const keyentry * key, char *r_msg, size_t msg_length)
     char *end;
     char *uname = "";
     pending_data_t *data;
-    FILE * fp;
-    mode_t oldmask;
     int is_startup = 0;
 
     if (strncmp(r_msg, HC_REQUEST, strlen(HC_REQUEST)) == 0) {
@@ -116,13 +229,22 @@ void save_controlmsg(const keyentry * key, char *r_msg, size_t msg_length)
     snprintf(msg_ack, OS_FLSIZE, "%s%s", CONTROL_HEADER, HC_ACK);
     send_msg(key->id, msg_ack, -1);
 
-    /* Filter UTF-8 characters */
-    char * clean = w_utf8_filter(r_msg, true);
-    r_msg = clean;
+    /* Filter UTF-8 characters. Valid messages are used as they are */
+    char * clean = w_utf8_filter_invalid(r_msg, true);
+
+    if (clean) {
+        r_msg = clean;
+    }
 
     if (strcmp(r_msg, HC_STARTUP) == 0) {
         mdebug1("Agent %s sent HC_STARTUP from %s.", key->name, inet_ntoa(key->peer_info.sin_addr));
         is_startup = 1;
+
+        /* Tell the agent that it may send batches. Older agents ignore it */
+        if (batch_events) {
+            snprintf(msg_ack, OS_FLSIZE, "%s%s", CONTROL_HEADER, HC_BATCH);
+            send_msg(key->id, msg_ack, -1);
+        }
     } else {
         /* Clean uname and shared files (remove random string) */
         uname = r_msg;
@@ -138,13 +260,39 @@ void save_controlmsg(const keyentry * key, char *r_msg, size_t msg_length)
         }
     }
 
+    /* Tell the agent its rate credit, if it changed since the last one it got */
+    if (credit_max) {
+        int credit = rem_credit();
+        int changed;
+
+        w_mutex_lock(&lastmsg_mutex);
+        data = OSHash_Get(pending_data, key->id);
+        changed = is_startup || !data || data->credit != credit;
+
+        if (data) {
+            data->credit = credit;
+        }
+
+        w_mutex_unlock(&lastmsg_mutex);
+
+        if (changed) {
+            snprintf(msg_ack, OS_FLSIZE, "%s%s%d", CONTROL_HEADER, HC_CREDIT, credit);
+            send_msg(key->id, msg_ack, -1);
+        }
+    }
+
     /* Lock mutex */
     w_mutex_lock(&lastmsg_mutex)
 
     /* Check if there is a keep alive already for this agent */
     if (data = OSHash_Get(pending_data, key->id), data && data->changed && data->message && strcmp(data->message, uname) == 0) {
-        w_mutex_unlock(&lastmsg_mutex);
-        utimes(data->keep_alive, NULL);
+        if (agentinfo_interval) {
+            agentinfo_mark(data, AGENTINFO_TOUCH);
+            w_mutex_unlock(&lastmsg_mutex);
+        } else {
+            w_mutex_unlock(&lastmsg_mutex);
+            utimes(data->keep_alive, NULL);
+        }
     } else {
         if (!data) {
             os_calloc(1, sizeof(pending_data_t), data);
@@ -174,16 +322,13 @@ void save_controlmsg(const keyentry * key, char *r_msg, size_t msg_length)
         }
 
         if (is_startup) {
-            w_mutex_unlock(&lastmsg_mutex);
-            oldmask = umask(0006);
-
-            if (fp = fopen(data->keep_alive, "a"), fp) {
-                fclose(fp);
+            if (agentinfo_interval) {
+                agentinfo_mark(data, AGENTINFO_CREATE);
+                w_mutex_unlock(&lastmsg_mutex);
             } else {
-                merror(FOPEN_ERROR, data->keep_alive, errno, strerror(errno));
+                w_mutex_unlock(&lastmsg_mutex);
+                agentinfo_create(data->keep_alive);
             }
-
-            umask(oldmask);
         } else {
             /* Update message */
             mdebug2("save_controlmsg(): inserting '%s'", uname);
@@ -206,47 +351,82 @@ void save_controlmsg(const keyentry * key, char *r_msg, size_t msg_length)
                 }
             }
 
-            /* Unlock mutex */
-            w_mutex_unlock(&lastmsg_mutex);
-
-            /* Write uname to the file */
-
-            oldmask = umask(0006);
-            fp = fopen(data->keep_alive, "w");
-            umask(oldmask);
+            /* Write uname to the file, now or with the next flush */
 
-            if (fp) {
-                /* Get manager name before chroot */
+            if (agentinfo_interval) {
+                agentinfo_mark(data, AGENTINFO_WRITE);
+                w_mutex_unlock(&lastmsg_mutex);
+            } else {
                 char hostname[HOST_NAME_MAX + 1];
 
-                fprintf(fp, "%s\n", uname);
+                /* Unlock mutex */
+                w_mutex_unlock(&lastmsg_mutex);
+
+                agentinfo_write(data->keep_alive, uname, agentinfo_hostname(hostname));
+            }
+        }
+    }
 
-                /* Write manager hostname to the file */
+    free(clean);
+}
 
-                if (gethostname(hostname, HOST_NAME_MAX) < 0){
-                    mwarn("Unable to get hostname due to: '%s'", strerror(errno));
-                } else {
-                    fprintf(fp, "#\"_manager_hostname\":%s\n", hostname);
-                }
+/* Get the checksum of a file, computing it only if the file changed since the last call */
+file_md5_t * c_md5_file(const char *path, int *cached) {
+    struct stat attrib;
+    file_md5_t *entry;
 
-                /* Write Cluster's node name to the agent-info file */
-                char nodename[OS_MAXSTR];
+    if (cached) {
+        *cached = 0;
+    }
 
-                snprintf(nodename, OS_MAXSTR - 1, "#\"_node_name\":%s\n", node_name);
-                fprintf(fp, "%s", nodename);
+    if (stat(path, &attrib) < 0) {
+        return NULL;
+    }
 
-                fclose(fp);
-            } else {
-                merror(FOPEN_ERROR, data->keep_alive, errno, strerror(errno));
+    if (entry = (file_md5_t *)OSHash_Get(md5_cache, path), entry) {
+        if (entry->inode == attrib.st_ino && entry->mtime == attrib.st_mtime && entry->size == attrib.st_size) {
+            if (cached) {
+                *cached = 1;
             }
+
+            return entry;
+        }
+    } else {
+        os_calloc(1, sizeof(file_md5_t), entry);
+
+        if (OSHash_Add(md5_cache, path, entry) != 2) {
+            os_free(entry);
+            return NULL;
         }
     }
 
-    free(clean);
+    if (OS_MD5_File(path, entry->sum, OS_TEXT) != 0) {
+        c_md5_free(OSHash_Delete(md5_cache, path));
+        return NULL;
+    }
+
+    entry->inode = attrib.st_ino;
+    entry->mtime = attrib.st_mtime;
+    entry->size = attrib.st_size;
+    entry->inputs[0] = '\0';
+    OS_MD5_Merged_Free(entry->manifest);
+    entry->manifest = NULL;
+    os_free(entry->tag);
+    return entry;
+}
+
+/* Free an entry of md5_cache */
+void c_md5_free(void * entry) {
+    file_md5_t * md5_entry = (file_md5_t *)entry;
+
+    if (md5_entry) {
+        OS_MD5_Merged_Free(md5_entry->manifest);
+        free(md5_entry->tag);
+        free(md5_entry);
+    }
 }
 
 void c_group(const char *group, char ** files, file_sum ***_f_sum,char * sharedcfg_dir) {
-    os_md5 md5sum;
     unsigned int f_size = 0;
     file_sum **f_sum;
     char merged_tmp[PATH_MAX + 1];
@@ -337,42 +517,40 @@ void c_group(const char *group, char ** files, file_sum ***_f_sum,char * sharedc
     if(r_group && r_group->merged_is_downloaded){
 
         // Validate the file
-        if (OS_MD5_File(merged, md5sum, OS_TEXT) != 0) {
+        file_md5_t *md5_entry;
+
+        // Validate the file
+        if (md5_entry = c_md5_file(merged, NULL), !md5_entry) {
             f_sum[0]->sum[0] = '\0';
             merror("Accessing file '%s'", merged);
         }
         else{
-            strncpy(f_sum[0]->sum, md5sum, 32);
+            strncpy(f_sum[0]->sum, md5_entry->sum, 32);
             os_strdup(SHAREDCFG_FILENAME, f_sum[0]->name);
         }
 
         f_sum[f_size] = NULL;
     }
     else{
-        // Merge ar.conf always
-        if (!logr.nocmerged) {
-            snprintf(merged_tmp, PATH_MAX + 1, "%s/%s/%s.tmp", sharedcfg_dir, group, SHAREDCFG_FILENAME);
-            // First call, truncate merged file
-            MergeAppendFile(merged_tmp, NULL, group, -1);
-        }
+        file_md5_t *md5_entry;
+        char *inputs = NULL;
+        size_t inputs_len = 0;
+        int ar_found = 0;
+        int cached;
+        int ignored;
 
-        if (OS_MD5_File(DEFAULTAR, md5sum, OS_TEXT) == 0) {
+        // Merge ar.conf always
+        if (md5_entry = c_md5_file(DEFAULTAR, NULL), md5_entry) {
             os_realloc(f_sum, (f_size + 2) * sizeof(file_sum *), f_sum);
             *_f_sum = f_sum;
             os_calloc(1, sizeof(file_sum), f_sum[f_size]);
-            strncpy(f_sum[f_size]->sum, md5sum, 32);
+            strncpy(f_sum[f_size]->sum, md5_entry->sum, 32);
             os_strdup(DEFAULTAR_FILE, f_sum[f_size]->name);
             f_sum[f_size + 1] = NULL;
-
-            if (!logr.nocmerged) {
-                MergeAppendFile(merged_tmp, DEFAULTAR, NULL, -1);
-            }
-
+            ar_found = 1;
             f_size++;
         }
 
-        int ignored;
-
         /* Read directory */
         for (i = 0; files[i]; ++i) {
             /* Ignore hidden files  */
@@ -386,7 +564,7 @@ void c_group(const char *group, char ** files, file_sum ***_f_sum,char * sharedc
 
             snprintf(file, PATH_MAX + 1, "%s/%s/%s", sharedcfg_dir, group, files[i]);
 
-            if (OS_MD5_File(file, md5sum, OS_TEXT) != 0) {
+            if (md5_entry = c_md5_file(file, &cached), !md5_entry) {
                 merror("Accessing file '%s'", file);
                 continue;
             }
@@ -413,8 +591,8 @@ void c_group(const char *group, char ** files, file_sum ***_f_sum,char * sharedc
                         ignored = 0;
                     }
                 }
-            } else {
-
+            } else if (!cached) {
+                /* An unchanged file that isn't invalid passed this check already */
                 if(checkBinaryFile(file)){
                     struct stat attrib;
 
@@ -440,32 +618,69 @@ void c_group(const char *group, char ** files, file_sum ***_f_sum,char * sharedc
                 os_realloc(f_sum, (f_size + 2) * sizeof(file_sum *), f_sum);
                 *_f_sum = f_sum;
                 os_calloc(1, sizeof(file_sum), f_sum[f_size]);
-                strncpy(f_sum[f_size]->sum, md5sum, 32);
+                strncpy(f_sum[f_size]->sum, md5_entry->sum, 32);
                 os_strdup(files[i], f_sum[f_size]->name);
-
-                if (!logr.nocmerged) {
-                    MergeAppendFile(merged_tmp, file, NULL, -1);
-                }
-
                 f_size++;
             }
         }
 
         f_sum[f_size] = NULL;
 
+        /* The merged file depends on the names and contents of the files in it */
+        for (i = 1; i < f_size; i++) {
+            size_t length = strlen(f_sum[i]->name) + 34;
+
+            os_realloc(inputs, inputs_len + length + 1, inputs);
+            inputs_len += snprintf(inputs + inputs_len, length + 1, "%s %s\n", f_sum[i]->name, f_sum[i]->sum);
+        }
+
         if (!logr.nocmerged) {
-            OS_MoveFile(merged_tmp, merged);
+            os_md5 inputs_sum;
+
+            OS_MD5_Str(inputs ? inputs : "", -1, inputs_sum);
+
+            /* Build it again only if its files changed, or it was modified */
+            if (md5_entry = c_md5_file(merged, NULL), !md5_entry || strcmp(md5_entry->inputs, inputs_sum) != 0) {
+                snprintf(merged_tmp, PATH_MAX + 1, "%s/%s/%s.tmp", sharedcfg_dir, group, SHAREDCFG_FILENAME);
+                // First call, truncate merged file
+                MergeAppendFile(merged_tmp, NULL, group, -1);
+
+                for (i = 1; i < f_size; i++) {
+                    if (i == 1 && ar_found) {
+                        MergeAppendFile(merged_tmp, DEFAULTAR, NULL, -1);
+                    } else {
+                        snprintf(file, PATH_MAX + 1, "%s/%s/%s", sharedcfg_dir, group, f_sum[i]->name);
+                        MergeAppendFile(merged_tmp, file, NULL, -1);
+                    }
+                }
+
+                OS_MoveFile(merged_tmp, merged);
+
+                /* The new file may get the inode of the old one: don't trust its checksum */
+                c_md5_free(OSHash_Delete(md5_cache, merged));
+
+                if (md5_entry = c_md5_file(merged, NULL), md5_entry) {
+                    strncpy(md5_entry->inputs, inputs_sum, 32);
+                }
+            } else {
+                mdebug2("Shared files of group '%s' are unchanged.", group);
+            }
+        } else {
+            md5_entry = c_md5_file(merged, NULL);
         }
 
-        if (OS_MD5_File(merged, md5sum, OS_TEXT) != 0) {
+        os_free(inputs);
+
+        if (!md5_entry) {
             if (!logr.nocmerged) {
                 merror("Accessing file '%s'", merged);
             }
 
             f_sum[0]->sum[0] = '\0';
+        } else {
+            strncpy(f_sum[0]->sum, md5_entry->sum, 32);
         }
 
-        strncpy(f_sum[0]->sum, md5sum, 32);
         os_strdup(SHAREDCFG_FILENAME, f_sum[0]->name);
     }
 }
@@ -647,6 +862,10 @@ static void c_files()
             OSHash_Clean(m_hash, cleaner);
             m_hash = OSHash_Create();
 
+            // Drop the checksums of files that may be gone
+            OSHash_Clean(md5_cache, c_md5_free);
+            md5_cache = OSHash_Create();
+
             reported_non_existing_group = 0;
 
             dp = opendir(MULTIGROUPS_DIR);
@@ -878,16 +1097,9 @@ file_sum ** find_group(const char * file, const char * md5, char group[OS_SIZE_6
     return NULL;
 }
 
-/* Send a file to the agent
- * Returns -1 on error
- */
-int send_file_toagent(const char *agent_id, const char *group, const char *name, const char *sum,char *sharedcfg_dir)
+/* Get the path of a shared file of a group */
+void shared_file_path(char file[OS_SIZE_1024 + 1], const char *group, const char *name, const char *sharedcfg_dir)
 {
-    int i = 0;
-    size_t n = 0;
-    char file[OS_SIZE_1024 + 1];
-    char buf[OS_SIZE_1024 + 1];
-    FILE *fp;
     os_sha256 multi_group_hash;
     char *multi_group_hash_pt = NULL;
 
@@ -895,7 +1107,7 @@ int send_file_toagent(const char *agent_id, const char *group, const char *name,
     if(strchr(group,MULTIGROUP_SEPARATOR)){
 
         if(multi_group_hash_pt = OSHash_Get(m_hash,group),multi_group_hash_pt){
-            mdebug1("At send_file_toagent(): Hash is '%s'",multi_group_hash_pt);
+            mdebug1("At shared_file_path(): Hash is '%s'",multi_group_hash_pt);
             snprintf(file, OS_SIZE_1024, "%s/%s/%s", sharedcfg_dir, multi_group_hash_pt, name);
         }
         else{
@@ -909,29 +1121,31 @@ int send_file_toagent(const char *agent_id, const char *group, const char *name,
     else{
         snprintf(file, OS_SIZE_1024, "%s/%s/%s", sharedcfg_dir, group, name);
     }
+}
 
-
-    fp = fopen(file, "r");
-    if (!fp) {
-        mdebug1(FOPEN_ERROR, file, errno, strerror(errno));
-        return (-1);
-    }
+/* Send up to size bytes from the current position of a stream, as a file of the agent
+ * Returns -1 on error
+ */
+int send_data_toagent(const char *agent_id, FILE *fp, size_t size, const char *name, const char *sum)
+{
+    int i = 0;
+    size_t n = 0;
+    char buf[OS_SIZE_1024 + 1];
 
     /* Send the file name first */
     snprintf(buf, OS_SIZE_1024, "%s%s%s %s\n",
              CONTROL_HEADER, FILE_UPDATE_HEADER, sum, name);
 
     if (send_msg(agent_id, buf, -1) < 0) {
-        fclose(fp);
         return (-1);
     }
 
     /* Send the file contents */
-    while ((n = fread(buf, 1, 900, fp)) > 0) {
+    while (size > 0 && (n = fread(buf, 1, size < 900 ? size : 900, fp)) > 0) {
         buf[n] = '\0';
+        size -= n;
 
         if (send_msg(agent_id, buf, -1) < 0) {
-            fclose(fp);
             return (-1);
         }
 
@@ -949,13 +1163,151 @@ int send_file_toagent(const char *agent_id, const char *group, const char *name,
     snprintf(buf, OS_SIZE_1024, "%s%s", CONTROL_HEADER, FILE_CLOSE_HEADER);
 
     if (send_msg(agent_id, buf, -1) < 0) {
-        fclose(fp);
         return (-1);
     }
 
+    return (0);
+}
+
+/* Send a file to the agent
+ * Returns -1 on error
+ */
+int send_file_toagent(const char *agent_id, const char *group, const char *name, const char *sum,char *sharedcfg_dir)
+{
+    char file[OS_SIZE_1024 + 1];
+    FILE *fp;
+    int result;
+
+    shared_file_path(file, group, name, sharedcfg_dir);
+
+    fp = fopen(file, "r");
+    if (!fp) {
+        mdebug1(FOPEN_ERROR, file, errno, strerror(errno));
+        return (-1);
+    }
+
+    result = send_data_toagent(agent_id, fp, SIZE_MAX, name, sum);
     fclose(fp);
 
-    return (0);
+    return (result);
+}
+
+/* Prepare the delta of a merged file for an agent that listed its files.
+ * Call it with files_mutex locked: the merged file must still have the given sum.
+ * Returns NULL if the whole merged file should be sent instead.
+ */
+shared_delta_t * c_delta(const char *group, const char *sharedcfg_dir, const char *sum, const char *agent_files)
+{
+    char file[OS_SIZE_1024 + 1];
+    char line[OS_SIZE_2048 + 1];
+    file_md5_t *md5_entry;
+    shared_delta_t *delta;
+    size_t length;
+    size_t size;
+    int n = 0;
+    int i;
+
+    shared_file_path(file, group, SHAREDCFG_FILENAME, sharedcfg_dir);
+
+    if (md5_entry = c_md5_file(file, NULL), !md5_entry || strcmp(md5_entry->sum, sum) != 0) {
+        return NULL;
+    }
+
+    if (!md5_entry->manifest && (md5_entry->manifest = OS_MD5_Merged(file, &md5_entry->tag, OS_TEXT), !md5_entry->manifest)) {
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(shared_delta_t), delta);
+
+    if (delta->fp = fopen(file, "r"), !delta->fp) {
+        mdebug1(FOPEN_ERROR, file, errno, strerror(errno));
+        free(delta);
+        return NULL;
+    }
+
+    /* The manifest lists every file, in order, after the sum and the tag */
+    size = OS_SIZE_1024;
+    os_malloc(size, delta->manifest);
+    length = snprintf(delta->manifest, size, "%s%s%s\n%s\n", CONTROL_HEADER, FILE_MANIFEST_HEADER, sum, md5_entry->tag ? md5_entry->tag : "");
+
+    for (i = 0; md5_entry->manifest[i].name; i++) {
+        const merged_sum_t *entry = md5_entry->manifest + i;
+
+        while (length + strlen(entry->name) + 2 > size) {
+            size *= 2;
+            os_realloc(delta->manifest, size, delta->manifest);
+        }
+
+        length += snprintf(delta->manifest + length, size - length, "%s\n", entry->name);
+
+        /* The agent has it already */
+        snprintf(line, sizeof(line), "\n%s %s\n", entry->sum, entry->name);
+
+        if (strstr(agent_files, line)) {
+            continue;
+        }
+
+        os_realloc(delta->files, (n + 2) * sizeof(merged_sum_t), delta->files);
+        memcpy(delta->files + n, entry, sizeof(merged_sum_t));
+        os_strdup(entry->name, delta->files[n].name);
+        delta->files[++n].name = NULL;
+    }
+
+    delta->count = n;
+    delta->total = i;
+
+    if (length > OS_MAXSTR - OS_SIZE_1024) {
+        mdebug1("Too many files in '%s' to send a delta.", file);
+        free_delta(delta);
+        return NULL;
+    }
+
+    return delta;
+}
+
+/* Send the changed files of a merged file and the manifest to rebuild it
+ * Returns -1 on error
+ */
+int send_delta_toagent(const char *agent_id, shared_delta_t *delta)
+{
+    int i;
+
+    for (i = 0; delta->files && delta->files[i].name; i++) {
+        if (fseek(delta->fp, delta->files[i].offset, SEEK_SET) < 0 ||
+            send_data_toagent(agent_id, delta->fp, delta->files[i].size, delta->files[i].name, delta->files[i].sum) < 0) {
+            return (-1);
+        }
+    }
+
+    return send_msg(agent_id, delta->manifest, -1) < 0 ? -1 : 0;
+}
+
+void free_delta(shared_delta_t *delta)
+{
+    if (delta) {
+        fclose(delta->fp);
+        OS_MD5_Merged_Free(delta->files);
+        free(delta->manifest);
+        free(delta);
+    }
+}
+
+/* Whether an agent listed its shared files after merged.mg (it takes deltas) */
+static int agent_lists_files(const char *msg)
+{
+    const char *end;
+
+    for (; *msg; msg = end + 1) {
+        if (*msg != '\"' && *msg != '!' && *msg != '#' && *msg != '\n') {
+            return 1;
+        }
+
+        if (end = strchr(msg, '\n'), !end) {
+            break;
+        }
+    }
+
+    return 0;
 }
 
 /* Read the available control message from the agent */
@@ -1067,6 +1419,18 @@ static void read_controlmsg(const char *agent_id, char *msg)
 
         /* New agents only have merged.mg */
         if (strcmp(file, SHAREDCFG_FILENAME) == 0) {
+            shared_delta_t *delta = NULL;
+
+            /* If the agent has multi group, change the shared path */
+            char *multi_group = strchr(group,MULTIGROUP_SEPARATOR);
+            char sharedcfg_dir[128] = {0};
+
+            if(multi_group) {
+                strcpy(sharedcfg_dir,MULTIGROUPS_DIR);
+            } else {
+                strcpy(sharedcfg_dir,SHAREDCFG_DIR);
+            }
+
             for (i = 0; f_sum[i]; i++) {
                 f_sum[i]->mark = 0;
             }
@@ -1076,22 +1440,30 @@ static void read_controlmsg(const char *agent_id, char *msg)
                 memcpy(tmp_sum, f_sum[0]->sum, sizeof(tmp_sum));
             }
 
+            /* Agents that list their files after merged.mg take only the changed ones */
+            if (shared_delta && tmp_sum[0] && strcmp(tmp_sum, md5) != 0 && *md5 != 'x' && agent_lists_files(msg)) {
+                char *agent_files;
+
+                os_malloc(strlen(msg) + 2, agent_files);
+                snprintf(agent_files, strlen(msg) + 2, "\n%s", msg);
+                delta = c_delta(group, sharedcfg_dir, tmp_sum, agent_files);
+                free(agent_files);
+            }
+
             /* Unlock mutex */
             w_mutex_unlock(&files_mutex);
 
-            if (tmp_sum[0] && strcmp(tmp_sum, md5) != 0) {
-                mdebug1("Sending file '%s/%s' to agent '%s'.", group, SHAREDCFG_FILENAME, agent_id);
-
-                /* If the agent has multi group, change the shared path */
-                char *multi_group = strchr(group,MULTIGROUP_SEPARATOR);
-                char sharedcfg_dir[128] = {0};
+            if (delta) {
+                mdebug1("Sending %d of %d files in '%s/%s' to agent '%s'.", delta->count, delta->total, group, SHAREDCFG_FILENAME, agent_id);
 
-                if(multi_group) {
-                    strcpy(sharedcfg_dir,MULTIGROUPS_DIR);
-                } else {
-                    strcpy(sharedcfg_dir,SHAREDCFG_DIR);
+                if (send_delta_toagent(agent_id, delta) < 0) {
+                    mwarn(SHARED_ERROR, SHAREDCFG_FILENAME, agent_id);
                 }
 
+                free_delta(delta);
+            } else if (tmp_sum[0] && strcmp(tmp_sum, md5) != 0) {
+                mdebug1("Sending file '%s/%s' to agent '%s'.", group, SHAREDCFG_FILENAME, agent_id);
+
                 if (send_file_toagent(agent_id, group, SHAREDCFG_FILENAME, tmp_sum,sharedcfg_dir) < 0) {
                     mwarn(SHARED_ERROR, SHAREDCFG_FILENAME, agent_id);
                 }
@@ -1199,6 +1571,78 @@ void *wait_for_msgs(__attribute__((unused)) void *none)
 
     return (NULL);
 }
+/* Write the pending agent-info files every agentinfo_interval seconds,
+ * so that a keepalive costs no file operation of its own
+ */
+void *save_agentinfo_main(__attribute__((unused)) void *none)
+{
+    typedef struct {
+        char * path;
+        char * message;
+        int flags;
+    } agentinfo_t;
+
+    agentinfo_t * batch = NULL;
+    size_t size = 0;
+
+    while (1) {
+        char hostname[HOST_NAME_MAX + 1];
+        const char * host = NULL;
+        pending_data_t * data;
+        size_t n = 0;
+        size_t i;
+
+        sleep(agentinfo_interval);
+
+        /* Take the pending writes, with a copy of what to write */
+        w_mutex_lock(&lastmsg_mutex);
+
+        for (data = dirty_list; data; data = data->next_dirty) {
+            if (n == size) {
+                size = size ? size * 2 : 256;
+                os_realloc(batch, size * sizeof(agentinfo_t), batch);
+            }
+
+            os_strdup(data->keep_alive, batch[n].path);
+            batch[n].message = NULL;
+            batch[n].flags = data->dirty;
+
+            if ((data->dirty & AGENTINFO_WRITE) && data->message) {
+                os_strdup(data->message, batch[n].message);
+            }
+
+            data->dirty = 0;
+            n++;
+        }
+
+        dirty_list = NULL;
+        w_mutex_unlock(&lastmsg_mutex);
+
+        if (n > 0) {
+            mdebug2("Writing %zu agent-info files.", n);
+        }
+
+        for (i = 0; i < n; i++) {
+            if (batch[i].message) {
+                if (!host) {
+                    host = agentinfo_hostname(hostname);
+                }
+
+                agentinfo_write(batch[i].path, batch[i].message, host);
+            } else if (batch[i].flags & AGENTINFO_CREATE) {
+                agentinfo_create(batch[i].path);
+            } else {
+                utimes(batch[i].path, NULL);
+            }
+
+            free(batch[i].path);
+            free(batch[i].message);
+        }
+    }
+
+    return NULL;
+}
+
 /* Update shared files */
 void *update_shared_files(__attribute__((unused)) void *none) {
     INTERVAL = getDefine_Int("remoted", "shared_reload", 1, 18000);
@@ -1338,6 +1782,10 @@ void manager_init()
     _clean_time = time(0);
     m_hash = OSHash_Create();
     invalid_files = OSHash_Create();
+    md5_cache = OSHash_Create();
+
+    if (!invalid_files || !md5_cache) merror_exit("At manager_init(): OSHash_Create() failed");
+
     mdebug1("Running manager_init");
     c_files();
     w_yaml_create_groups();
@@ -1347,4 +1795,10 @@ void manager_init()
     if (!m_hash || !pending_data) merror_exit("At manager_init(): OSHash_Create() failed");
 
     OSHash_SetFreeDataPointer(pending_data, (void (*)(void *))free_pending_data);
+
+    agentinfo_interval = getDefine_Int("remoted", "agentinfo_interval", 0, 60);
+
+    if (agentinfo_interval) {
+        w_create_named_thread(save_agentinfo_main, NULL, "rem-agentinfo");
+    }
 }
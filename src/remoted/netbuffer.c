@@ -14,31 +14,65 @@
 #include <os_net/os_net.h>
 #include "remoted.h"
 
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+// Buffer of a socket, or NULL if the descriptor was never opened
+static sockbuffer_t * nb_get(netbuffer_t * buffer, int sock) {
+    if (sock < 0 || (unsigned int)sock >= buffer->max_fd) {
+        return NULL;
+    }
+
+    return __atomic_load_n(buffer->buffers + sock, __ATOMIC_ACQUIRE);
+}
+
+void nb_init(netbuffer_t * buffer, unsigned int max_fd) {
+    os_calloc(max_fd, sizeof(sockbuffer_t *), buffer->buffers);
+    buffer->max_fd = max_fd;
+}
+
+/*
+ * Reset the buffer of a new socket.
+ * Returns 0 on success, or -1 if the descriptor is out of the table.
+ */
+int nb_open(netbuffer_t * buffer, int sock, const struct sockaddr_in * peer_info) {
+    sockbuffer_t * sockbuf;
+
+    if (sock < 0 || (unsigned int)sock >= buffer->max_fd) {
+        return -1;
+    }
 
-void nb_open(netbuffer_t * buffer, int sock, const struct sockaddr_in * peer_info) {
-    w_mutex_lock(&mutex);
+    // A descriptor is reused only after nb_close() closes it, so no other thread opens it now
 
-    if (sock >= buffer->max_fd) {
-        os_realloc(buffer->buffers, sizeof(sockbuffer_t) * (sock + 1), buffer->buffers);
-        buffer->max_fd = sock;
+    if (sockbuf = nb_get(buffer, sock), !sockbuf) {
+        os_calloc(1, sizeof(sockbuffer_t), sockbuf);
+        w_mutex_init(&sockbuf->mutex, NULL);
+        __atomic_store_n(buffer->buffers + sock, sockbuf, __ATOMIC_RELEASE);
     }
 
-    memset(buffer->buffers + sock, 0, sizeof(sockbuffer_t));
-    memcpy(&buffer->buffers[sock].peer_info, peer_info, sizeof(struct sockaddr_in));
-    w_mutex_unlock(&mutex);
+    w_mutex_lock(&sockbuf->mutex);
+    memcpy(&sockbuf->peer_info, peer_info, sizeof(struct sockaddr_in));
+    sockbuf->data_len = 0;
+    w_mutex_unlock(&sockbuf->mutex);
+    return 0;
 }
 
 int nb_close(netbuffer_t * buffer, int sock) {
-    int retval = close(sock);
-    w_mutex_lock(&mutex);
+    sockbuffer_t * sockbuf = nb_get(buffer, sock);
+    int retval;
 
-    if (!retval) {
-        free(buffer->buffers[sock].data);
-        memset(buffer->buffers + sock, 0, sizeof(sockbuffer_t));
+    if (!sockbuf) {
+        return close(sock);
     }
 
-    w_mutex_unlock(&mutex);
+    // Close under the lock, so the descriptor can't be accepted again before it's cleared
+
+    w_mutex_lock(&sockbuf->mutex);
+
+    if (retval = close(sock), !retval) {
+        os_free(sockbuf->data);
+        sockbuf->data_size = 0;
+        sockbuf->data_len = 0;
+    }
+
+    w_mutex_unlock(&sockbuf->mutex);
     return retval;
 }
 
@@ -50,14 +84,20 @@ int nb_close(netbuffer_t * buffer, int sock) {
  * Returns the number of bytes received on success.
 */
 int nb_recv(netbuffer_t * buffer, int sock) {
-    sockbuffer_t * sockbuf = &buffer->buffers[sock];
-    unsigned long data_ext = sockbuf->data_len + receive_chunk;
+    sockbuffer_t * sockbuf = nb_get(buffer, sock);
+    unsigned long data_ext;
     long recv_len;
     unsigned long i;
     unsigned long cur_offset;
     uint32_t cur_len;
 
-    w_mutex_lock(&mutex);
+    if (!sockbuf) {
+        errno = EBADF;
+        return -1;
+    }
+
+    w_mutex_lock(&sockbuf->mutex);
+    data_ext = sockbuf->data_len + receive_chunk;
 
     // Extend data buffer
 
@@ -129,6 +169,6 @@ int nb_recv(netbuffer_t * buffer, int sock) {
 
 end:
 
-    w_mutex_unlock(&mutex);
+    w_mutex_unlock(&sockbuf->mutex);
     return recv_len;
 }
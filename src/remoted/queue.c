@@ -11,46 +11,87 @@
 #include <shared.h>
 #include "remoted.h"
 
-static w_queue_t * queue;
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t available = PTHREAD_COND_INITIALIZER;
+static w_mpmc_queue_t ** shards;
+static unsigned int n_shards;
+
+/* Released messages, kept to be reused with their buffers */
+static w_mpmc_queue_t * pool;
+
+/* Control messages, one lane per control thread */
+static w_mpmc_queue_t ** lanes;
+static unsigned int n_lanes;
 
 size_t global_counter;
 
-// Init message queue
-void rem_msginit(size_t size) {
-    queue = queue_init(size);
+/* Pick the shard of a message: messages from the same agent always go to the same handler */
+static unsigned int rem_msgshard(const char * buffer, unsigned long size, const struct sockaddr_in * addr, int sock) {
+    unsigned long id = 0;
+    unsigned long i;
+
+    if (n_shards == 1) {
+        return 0;
+    }
+
+    /* Agent ID in the header */
+    if (size > 1 && buffer[0] == '!') {
+        for (i = 1; i < size && isdigit((unsigned char)buffer[i]); i++) {
+            id = id * 10 + (unsigned long)(buffer[i] - '0');
+        }
+
+        return id % n_shards;
+    }
+
+    /* A TCP connection belongs to a single agent */
+    if (sock >= 0) {
+        return (unsigned int)sock % n_shards;
+    }
+
+    /* Agent found by its source address */
+    return (unsigned int)(((uint32_t)addr->sin_addr.s_addr * 2654435761U) >> 16) % n_shards;
 }
 
-// Push message into queue
-int rem_msgpush(const char * buffer, unsigned long size, struct sockaddr_in * addr, int sock) {
-    message_t * message;
-    int result;
-    static int reported = 0;
+// Init message queue
+void rem_msginit(size_t size, unsigned int shard_count) {
+    unsigned int i;
 
-    os_malloc(sizeof(message_t), message);
-    os_malloc(size, message->buffer);
-    memcpy(message->buffer, buffer, size);
-    message->size = size;
-    memcpy(&message->addr, addr, sizeof(struct sockaddr_in));
-    message->sock = sock;
+    n_shards = shard_count > 0 ? shard_count : 1;
+    size = size / n_shards > 0 ? size / n_shards : 1;
 
-    w_mutex_lock(&mutex);
+    os_calloc(n_shards, sizeof(w_mpmc_queue_t *), shards);
+
+    for (i = 0; i < n_shards; i++) {
+        shards[i] = mpmc_queue_init(size);
+    }
+
+    pool = mpmc_queue_init(REM_MSGPOOL_SIZE);
+}
 
-    message->counter = ++global_counter;
+// Get an empty message, reusing a released one if possible
+message_t * rem_msgget() {
+    message_t * message = NULL;
 
-    if (result = queue_push(queue, message), result == 0) {
-        w_cond_signal(&available);
+    if (!pool || (message = (message_t *)mpmc_queue_pop(pool), !message)) {
+        os_malloc(sizeof(message_t) + OS_MAXSTR + 1, message);
+        message->buffer = (char *)(message + 1);
     }
 
-    w_mutex_unlock(&mutex);
+    return message;
+}
+
+// Push a filled message into the queue of its handler. The queue takes the message
+int rem_msgqueue(message_t * message) {
+    int result;
+    static int reported = 0;
+
+    message->counter = __atomic_add_fetch(&global_counter, 1, __ATOMIC_RELAXED);
+    w_trace_begin(&rem_tracer, &message->trace);
 
-    if (result < 0) {
+    if (result = mpmc_queue_push_ex(shards[rem_msgshard(message->buffer, message->size, &message->addr, message->sock)], message), result < 0) {
+        mdebug2("Discarding event from host '%s'", inet_ntoa(message->addr.sin_addr));
         rem_msgfree(message);
-        mdebug2("Discarding event from host '%s'", inet_ntoa(addr->sin_addr));
         rem_inc_discarded();
         if (!reported) {
-            mwarn("Message queue is full (%zu). Events may be lost.", queue->size);
+            mwarn("Message queue is full (%zu). Events may be lost.", rem_get_tsize());
             reported = 1;
         }
     }
@@ -58,44 +99,94 @@ int rem_msgpush(const char * buffer, unsigned long size, struct sockaddr_in * ad
     return result;
 }
 
+// Push message into queue
+int rem_msgpush(const char * buffer, unsigned long size, struct sockaddr_in * addr, int sock) {
+    message_t * message = rem_msgget();
+
+    memcpy(message->buffer, buffer, size);
+    message->buffer[size] = '\0';
+    message->size = size;
+    memcpy(&message->addr, addr, sizeof(struct sockaddr_in));
+    message->sock = sock;
+
+    return rem_msgqueue(message);
+}
+
 // Get current queue size
 size_t rem_get_qsize() {
     size_t size = 0;
-    w_mutex_lock(&mutex);
-    size = (queue->begin - queue->end + queue->size) % queue->size;
-    w_mutex_unlock(&mutex);
+    unsigned int i;
+
+    for (i = 0; i < n_shards; i++) {
+        size += mpmc_queue_elements(shards[i]);
+    }
+
     return size;
 }
 
 // Get total queue size
 size_t rem_get_tsize() {
-    static size_t size = 0;
-    if (!size) {
-        w_mutex_lock(&mutex);
-        size = queue->size;
-        w_mutex_unlock(&mutex);
+    size_t size = 0;
+    unsigned int i;
+
+    for (i = 0; i < n_shards; i++) {
+        size += shards[i]->size;
     }
+
     return size;
 }
 
-// Pop message from queue
-message_t * rem_msgpop() {
-    message_t * message;
+// Pop message from the queue of a handler
+message_t * rem_msgpop(unsigned int shard) {
+    return (message_t *)mpmc_queue_pop_ex(shards[shard]);
+}
 
-    w_mutex_lock(&mutex);
+// Free message
+void rem_msgfree(message_t * message) {
+    if (message && mpmc_queue_push_ex(pool, message) < 0) {
+        free(message);
+    }
+}
+
+// Init the control lanes
+void rem_ctrlinit(unsigned int lane_count) {
+    unsigned int i;
 
-    while (message = (message_t *)queue_pop(queue), !message) {
-        w_cond_wait(&available, &mutex);
+    n_lanes = lane_count > 0 ? lane_count : 1;
+    os_calloc(n_lanes, sizeof(w_mpmc_queue_t *), lanes);
+
+    for (i = 0; i < n_lanes; i++) {
+        lanes[i] = mpmc_queue_init(REM_CTRLQUEUE_SIZE);
     }
+}
 
-    w_mutex_unlock(&mutex);
-    return message;
+// Push a control message into the lane of its agent, so they are handled in order
+int rem_ctrlpush(keyentry * key, const char * buffer, size_t length) {
+    control_msg_t * message;
+
+    os_malloc(sizeof(control_msg_t) + length + 1, message);
+    message->key = key;
+    message->length = length;
+    memcpy(message->buffer, buffer, length);
+    message->buffer[length] = '\0';
+
+    if (mpmc_queue_push_ex(lanes[strtoul(key->id, NULL, 10) % n_lanes], message) < 0) {
+        free(message);
+        return -1;
+    }
+
+    return 0;
 }
 
-// Free message
-void rem_msgfree(message_t * message) {
+// Pop message from a control lane
+control_msg_t * rem_ctrlpop(unsigned int lane) {
+    return (control_msg_t *)mpmc_queue_pop_ex(lanes[lane]);
+}
+
+// Free control message and its key
+void rem_ctrlfree(control_msg_t * message) {
     if (message) {
-        free(message->buffer);
+        OS_FreeKey(message->key);
         free(message);
     }
 }
@@ -24,6 +24,7 @@ rlim_t nofile;
 int tcp_keepidle;
 int tcp_keepintvl;
 int tcp_keepcnt;
+int tcp_reactors;
 
 /* Handle remote connections */
 void HandleRemote(int uid)
@@ -68,31 +69,76 @@ void HandleRemote(int uid)
 
     /* Bind TCP */
     if (logr.proto[position] == IPPROTO_TCP) {
-        if ((logr.sock = OS_Bindporttcp(logr.port[position], logr.lip[position], logr.ipv6[position])) < 0) {
-            merror_exit(BIND_ERROR, logr.port[position], errno, strerror(errno));
-        } else if (logr.conn[position] == SECURE_CONN) {
+        int i;
 
-            if (OS_SetKeepalive(logr.sock) < 0){
-                merror("OS_SetKeepalive failed with error '%s'", strerror(errno));
-            }
+        // Connections may be spread among several listeners sharing the port
+        tcp_reactors = getDefine_Int("remoted", logr.conn[position] == SECURE_CONN ? "tcp_reactors" : "syslog_tcp_reactors", 1, 16);
+
+#ifndef SO_REUSEPORT
+        if (tcp_reactors > 1) {
+            mwarn("SO_REUSEPORT is not supported on this system. Using a single TCP reactor.");
+            tcp_reactors = 1;
+        }
+#endif
+
+        os_calloc(tcp_reactors, sizeof(int), logr.tcp_socks);
+
+        for (i = 0; i < tcp_reactors; i++) {
+            int sock = tcp_reactors > 1 ? OS_Bindporttcp_reuse(logr.port[position], logr.lip[position], logr.ipv6[position])
+                                        : OS_Bindporttcp(logr.port[position], logr.lip[position], logr.ipv6[position]);
+
+            if (sock < 0) {
+                merror_exit(BIND_ERROR, logr.port[position], errno, strerror(errno));
+            } else if (logr.conn[position] == SECURE_CONN) {
+
+                if (OS_SetKeepalive(sock) < 0){
+                    merror("OS_SetKeepalive failed with error '%s'", strerror(errno));
+                }
 #ifndef CLIENT
-            else {
-                OS_SetKeepalive_Options(logr.sock, tcp_keepidle, tcp_keepintvl, tcp_keepcnt);
-            }
+                else {
+                    OS_SetKeepalive_Options(sock, tcp_keepidle, tcp_keepintvl, tcp_keepcnt);
+                }
 #endif
-            if (OS_SetRecvTimeout(logr.sock, recv_timeout, 0) < 0){
-                merror("OS_SetRecvTimeout failed with error '%s'", strerror(errno));
-            }
-            if (OS_SetSendTimeout(logr.sock, send_timeout) < 0){
-                merror("OS_SetSendTimeout failed with error '%s'", strerror(errno));
+                if (OS_SetRecvTimeout(sock, recv_timeout, 0) < 0){
+                    merror("OS_SetRecvTimeout failed with error '%s'", strerror(errno));
+                }
+                if (OS_SetSendTimeout(sock, send_timeout) < 0){
+                    merror("OS_SetSendTimeout failed with error '%s'", strerror(errno));
+                }
             }
+
+            logr.tcp_socks[i] = sock;
         }
+
+        logr.sock = logr.tcp_socks[0];
     } else {
+        int i;
+
+        // Secure datagrams may be spread among several receivers sharing the port
+        udp_receivers = logr.conn[position] == SECURE_CONN ? getDefine_Int("remoted", "udp_receivers", 1, 16) : 1;
+
+#ifndef SO_REUSEPORT
+        if (udp_receivers > 1) {
+            mwarn("SO_REUSEPORT is not supported on this system. Using a single UDP receiver.");
+            udp_receivers = 1;
+        }
+#endif
+
+        os_calloc(udp_receivers, sizeof(int), logr.udp_socks);
+
         /* Using UDP. Fast, unreliable... perfect */
-        if ((logr.sock =
-                    OS_Bindportudp(logr.port[position], logr.lip[position], logr.ipv6[position])) < 0) {
-            merror_exit(BIND_ERROR, logr.port[position], errno, strerror(errno));
+        for (i = 0; i < udp_receivers; i++) {
+            int sock = udp_receivers > 1 ? OS_Bindportudp_reuse(logr.port[position], logr.lip[position], logr.ipv6[position])
+                                         : OS_Bindportudp(logr.port[position], logr.lip[position], logr.ipv6[position]);
+
+            if (sock < 0) {
+                merror_exit(BIND_ERROR, logr.port[position], errno, strerror(errno));
+            }
+
+            logr.udp_socks[i] = sock;
         }
+
+        logr.sock = logr.udp_socks[0];
     }
 
     /* Revoke privileges */
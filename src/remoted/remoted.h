@@ -29,20 +29,42 @@
 
 /* Pending data structure */
 
+/* Pending agent-info file operations */
+#define AGENTINFO_TOUCH     1   // Keepalive: update the modification time
+#define AGENTINFO_CREATE    2   // Startup: create the file if missing
+#define AGENTINFO_WRITE     4   // New uname: rewrite the file
+
+/* Rate credit bounds, as a percentage of events_per_second of the agents */
+#define CREDIT_MIN          10
+#define CREDIT_LOW          25      // Queue usage up to which agents get credit_max
+#define CREDIT_HIGH         90      // Queue usage from which agents get CREDIT_MIN
+
 typedef struct pending_data_t {
     char *message;
     char *keep_alive;
     int changed;
+    int dirty;                              // AGENTINFO_* to apply at the next flush
+    struct pending_data_t *next_dirty;
+    int credit;                             // Rate credit last sent to the agent
 } pending_data_t;
 
 typedef struct message_t {
-    char * buffer;
+    char * buffer;              // OS_MAXSTR + 1 bytes, allocated along with the message
     unsigned int size;
     struct sockaddr_in addr;
     int sock;
     size_t counter;
+    w_trace_t trace;
 } message_t;
 
+/* Decrypted control message, waiting in a control lane */
+
+typedef struct control_msg_t {
+    keyentry * key;             // Copy of the agent key, owned by the message
+    size_t length;
+    char buffer[];
+} control_msg_t;
+
 /* Status structure */
 
 typedef struct remoted_state_t {
@@ -57,16 +79,22 @@ typedef struct remoted_state_t {
 
 /* Network buffer structure */
 
+/* Buffer of one socket. Its mutex syncs the reactor that reads the socket
+ * with the handler thread that may close it. */
 typedef struct sockbuffer_t {
+    pthread_mutex_t mutex;
     struct sockaddr_in peer_info;
     char * data;
     unsigned long data_size;
     unsigned long data_len;
 } sockbuffer_t;
 
+/* Buffers indexed by file descriptor. The table is sized once to the file
+ * limit, so it's never moved, and a buffer is allocated on the first use of
+ * its descriptor and then kept for the following ones. */
 typedef struct netbuffer_t {
-    int max_fd;
-    sockbuffer_t * buffers;
+    unsigned int max_fd;
+    sockbuffer_t ** buffers;
 } netbuffer_t;
 
 /** Function prototypes **/
@@ -98,6 +126,9 @@ void manager_init();
 /* Wait for messages from the agent to analyze */
 void *wait_for_msgs(void *none);
 
+/* Write the pending agent-info files periodically */
+void *save_agentinfo_main(void *none);
+
 /* Update shared files */
 void *update_shared_files(void *none);
 
@@ -124,14 +155,38 @@ void key_lock_write(void);
 
 void key_unlock(void);
 
-// Init message queue
-void rem_msginit(size_t size);
+// Released messages kept for reuse
+#define REM_MSGPOOL_SIZE 256
+
+// Init message queue, split into one shard per message handler
+void rem_msginit(size_t size, unsigned int shard_count);
+
+// Get an empty message, with room for OS_MAXSTR bytes
+message_t * rem_msgget();
+
+// Push a filled message into the queue of its handler. The queue takes the message
+int rem_msgqueue(message_t * message);
 
 // Push message into queue
 int rem_msgpush(const char * buffer, unsigned long size, struct sockaddr_in * addr, int sock);
 
-// Pop message from queue
-message_t * rem_msgpop();
+// Pop message from the queue of a handler
+message_t * rem_msgpop(unsigned int shard);
+
+// Slots of each control lane
+#define REM_CTRLQUEUE_SIZE 1024
+
+// Init the control lanes: control messages skip the handlers' wait on analysisd
+void rem_ctrlinit(unsigned int lane_count);
+
+// Push a control message into the lane of its agent. The lane takes the key on success
+int rem_ctrlpush(keyentry * key, const char * buffer, size_t length);
+
+// Pop message from a control lane
+control_msg_t * rem_ctrlpop(unsigned int lane);
+
+// Free control message and its key
+void rem_ctrlfree(control_msg_t * message);
 
 // Get queue size
 size_t rem_get_qsize();
@@ -152,18 +207,55 @@ void rem_inc_msg_sent();
 void rem_inc_discarded();
 void rem_add_recv(unsigned long bytes);
 void rem_inc_dequeued();
+void rem_metrics_init();
+
+/* Stages of the messages traced, from the reception to analysisd */
+enum {
+    REM_TRACE_QUEUE,
+    REM_TRACE_DECRYPT,
+    REM_TRACE_FORWARD,
+    REM_TRACE_STAGES
+};
+
+extern w_tracer_t rem_tracer;
 
 // Read config
 size_t rem_getconfig(const char * section, char ** output);
+
+// Render the metrics
+size_t rem_getmetrics(char ** output);
 cJSON *getRemoteConfig(void);
 cJSON *getRemoteInternalConfig(void);
 
 /* Network buffer */
 
-void nb_open(netbuffer_t * buffer, int sock, const struct sockaddr_in * peer_info);
+void nb_init(netbuffer_t * buffer, unsigned int max_fd);
+int nb_open(netbuffer_t * buffer, int sock, const struct sockaddr_in * peer_info);
 int nb_close(netbuffer_t * buffer, int sock);
 int nb_recv(netbuffer_t * buffer, int sock);
 
+/* UDP reception */
+
+// Datagrams read with a single call
+#define REM_UDP_BATCH 64
+
+// Ring of messages that the datagrams are received into
+typedef struct rem_udp_batch_t {
+    message_t * messages[REM_UDP_BATCH];
+    char * buffers[REM_UDP_BATCH];
+    int lengths[REM_UDP_BATCH];
+    struct sockaddr_in peers[REM_UDP_BATCH];
+} rem_udp_batch_t;
+
+// Fill every slot of the ring with an empty message
+void rem_udp_init(rem_udp_batch_t * batch);
+
+// Receive datagrams into the messages of the ring. Returns how many
+int rem_udp_recv(rem_udp_batch_t * batch, int sock);
+
+// Take a received message out of the ring, and put an empty one in its slot
+message_t * rem_udp_take(rem_udp_batch_t * batch, int index);
+
 /* Network counter */
 
 void rem_initList(size_t initial_size);
@@ -193,6 +285,11 @@ extern int buffer_relax;
 extern int tcp_keepidle;
 extern int tcp_keepintvl;
 extern int tcp_keepcnt;
+extern int tcp_reactors;
+extern int udp_receivers;
+extern int batch_events;
+extern int credit_max;
+extern int shared_delta;
 extern size_t global_counter;
 
 #endif /* LOGREMOTE_H */
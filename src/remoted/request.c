@@ -204,6 +204,18 @@ void * req_dispatch(req_node_t * node) {
 
     w_mutex_lock(&node->mutex);
 
+    // Local command without arguments
+
+    if (strcmp(node->buffer, "getmetrics") == 0) {
+        node->length = rem_getmetrics(&output);
+
+        if (OS_SendSecureTCP(node->sock, node->length, output) != 0) {
+            merror("At req_dispatch(): OS_SendSecureTCP(): %s", strerror(errno));
+        }
+
+        goto cleanup;
+    }
+
     if (_payload = strchr(node->buffer, ' '), !_payload) {
         merror("Request has no agent id.");
         goto cleanup;
@@ -445,3 +457,12 @@ error:
     os_strdup("err Could not get requested section", *output);
     return strlen(*output);
 }
+
+size_t rem_getmetrics(char ** output) {
+    char *metrics = w_metrics_render();
+
+    *output = strdup("ok");
+    wm_strcat(output, metrics, ' ');
+    free(metrics);
+    return strlen(*output);
+}
@@ -20,13 +20,28 @@ static netbuffer_t netbuffer;
 size_t global_counter;
 
 // Message handler thread
-static void * rem_handler_main(__attribute__((unused)) void * args);
+static void * rem_handler_main(void * args);
+
+// TCP reactor thread
+static void * rem_reactor_main(void * args);
+
+// UDP receiver thread
+static void * rem_receiver_main(void * args);
+
+// Control message thread
+static void * rem_control_main(void * args);
 
 // Key reloader thread
 void * rem_keyupdate_main(__attribute__((unused)) void * args);
 
 /* Handle each message received */
-static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *peer_info, int sock_client);
+static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *peer_info, int sock_client, w_trace_t *trace);
+
+/* Forward an event to analysisd */
+static void rem_forward(const char *msg, const char *srcmsg);
+
+/* Forward every event of a batch */
+static void rem_forward_batch(char *batch, size_t length, const char *srcmsg);
 
 // Close and remove socket from keystore
 int _close_sock(keystore * keys, int sock);
@@ -53,42 +68,46 @@ static int key_request_reconnect();
 void HandleSecure()
 {
     const int protocol = logr.proto[logr.position];
-    int sock_client;
-    int n_events = 0;
-    char buffer[OS_MAXSTR + 1];
-    ssize_t recv_b;
-    struct sockaddr_in peer_info;
-    memset(&peer_info, 0, sizeof(struct sockaddr_in));
-    wnotify_t * notify = NULL;
+    int worker_pool;
 
     /* Initialize manager */
     manager_init();
 
-    // Initialize messag equeue
-    rem_msginit(logr.queue_size);
+    /* Register the metrics before any thread updates them */
+    rem_metrics_init();
+
+    // Initialize message queue, with a shard per handler thread
+    worker_pool = getDefine_Int("remoted", "worker_pool", 1, 64);
+    w_affinity_enter("remoted", "handler");
+    rem_msginit(logr.queue_size, worker_pool);
+    w_affinity_leave();
 
     /* Initialize the agent key table mutex */
     key_lock_init();
 
     /* Create shared file updating thread */
-    w_create_thread(update_shared_files, NULL);
+    w_create_named_thread(update_shared_files, NULL, "rem-shared");
 
     /* Create Active Response forwarder thread */
-    w_create_thread(AR_Forward, NULL);
+    w_create_named_thread(AR_Forward, NULL, "rem-ar");
 
     /* Create Security configuration assessment forwarder thread */
-    w_create_thread(SCFGA_Forward, NULL);
+    w_create_named_thread(SCFGA_Forward, NULL, "rem-scfga");
 
     // Create Request listener thread
-    w_create_thread(req_main, NULL);
+    w_create_named_thread(req_main, NULL, "rem-request");
 
     // Create State writer thread
-    w_create_thread(rem_state_main, NULL);
+    w_create_named_thread(rem_state_main, NULL, "rem-state");
+
+    // Serve the metrics, if enabled
+    w_metrics_http_start("remoted");
 
     key_request_queue = queue_init(1024);
+    queue_metrics_register(key_request_queue, "key_request");
 
     // Create key request thread
-    w_create_thread(w_key_request_thread, NULL);
+    w_create_named_thread(w_key_request_thread, NULL, "rem-keyreq");
 
     /* Create wait_for_msgs threads */
 
@@ -99,20 +118,38 @@ void HandleSecure()
         mdebug2("Creating %d sender threads.", sender_pool);
 
         for (i = 0; i < sender_pool; i++) {
-            w_create_thread(wait_for_msgs, NULL);
+            w_create_named_thread(wait_for_msgs, NULL, "rem-sender-%d", i);
         }
     }
 
     // Create message handler thread pool
     {
-        int worker_pool = getDefine_Int("remoted", "worker_pool", 1, 16);
+        int i;
         // Initialize FD list and counter.
         global_counter = 0;
         rem_initList(FD_LIST_INIT_VALUE);
-        while (worker_pool > 0) {
-            w_create_thread(rem_handler_main, NULL);
-            worker_pool--;
+        w_affinity_enter("remoted", "handler");
+
+        for (i = 0; i < worker_pool; i++) {
+            w_create_named_thread(rem_handler_main, (void *)(intptr_t)i, "rem-handler-%d", i);
+        }
+
+        w_affinity_leave();
+    }
+
+    // Create control message thread pool, with a lane per thread
+    {
+        int i;
+        int control_pool = getDefine_Int("remoted", "control_pool", 1, 16);
+
+        w_affinity_enter("remoted", "control");
+        rem_ctrlinit(control_pool);
+
+        for (i = 0; i < control_pool; i++) {
+            w_create_named_thread(rem_control_main, (void *)(intptr_t)i, "rem-control-%d", i);
         }
+
+        w_affinity_leave();
     }
 
     /* Connect to the message queue
@@ -130,122 +167,191 @@ void HandleSecure()
     OS_StartCounter(&keys);
 
     // Key reloader thread
-    w_create_thread(rem_keyupdate_main, NULL);
+    w_create_named_thread(rem_keyupdate_main, NULL, "rem-keyupdate");
 
     /* Set up peer size */
-    logr.peer_size = sizeof(peer_info);
+    logr.peer_size = sizeof(struct sockaddr_in);
 
-    /* Initialize some variables */
-    memset(buffer, '\0', OS_MAXSTR + 1);
+    // This thread becomes a receiver, and keeps the receivers' CPUs
+    w_affinity_enter("remoted", "receiver");
+    w_thread_register(pthread_self(), "%s", protocol == IPPROTO_TCP ? "rem-reactor-0" : "rem-receiver-0");
 
     if (protocol == IPPROTO_TCP) {
-        if (notify = wnotify_init(MAX_EVENTS), !notify) {
-            merror_exit("wnotify_init(): %s (%d)", strerror(errno), errno);
+        struct rlimit rlimit;
+        int i;
+
+        // Socket buffers for every descriptor this process can open
+        nb_init(&netbuffer, getrlimit(RLIMIT_NOFILE, &rlimit) == 0 && rlimit.rlim_cur < 1048576 ? rlimit.rlim_cur : nofile);
+
+        mdebug2("Creating %d TCP reactor threads.", tcp_reactors);
+
+        for (i = 1; i < tcp_reactors; i++) {
+            w_create_named_thread(rem_reactor_main, (void *)(intptr_t)i, "rem-reactor-%d", i);
         }
 
-        if (wnotify_add(notify, logr.sock) < 0) {
-            merror_exit("wnotify_add(%d): %s (%d)", logr.sock, strerror(errno), errno);
+        rem_reactor_main((void *)0);
+    }
+
+    {
+        int i;
+
+        mdebug2("Creating %d UDP receiver threads.", udp_receivers);
+
+        for (i = 1; i < udp_receivers; i++) {
+            w_create_named_thread(rem_receiver_main, (void *)(intptr_t)i, "rem-receiver-%d", i);
         }
     }
 
+    rem_receiver_main((void *)0);
+}
+
+// UDP receiver thread: datagrams are read in batches right into the messages queued
+void * rem_receiver_main(void * args) {
+    const int sock = logr.udp_socks[(intptr_t)args];
+    rem_udp_batch_t * batch;
+    unsigned long bytes;
+    int count;
+    int i;
+
+    os_calloc(1, sizeof(rem_udp_batch_t), batch);
+    rem_udp_init(batch);
+
     while (1) {
-        /* Receive message  */
-        if (protocol == IPPROTO_TCP) {
-            if (n_events = wnotify_wait(notify, EPOLL_MILLIS), n_events < 0) {
-                if (errno != EINTR) {
-                    merror("Waiting for connection: %s (%d)", strerror(errno), errno);
-                    sleep(1);
-                }
+        count = rem_udp_recv(batch, sock);
+        bytes = 0;
 
+        for (i = 0; i < count; i++) {
+            /* Nothing received */
+            if (batch->messages[i]->size == 0) {
                 continue;
             }
 
-            int i;
-            for (i = 0; i < n_events; i++) {
-                int fd = wnotify_get(notify, i);
-
-                if (fd == logr.sock) {
-                    sock_client = accept(logr.sock, (struct sockaddr *)&peer_info, &logr.peer_size);
-                    if (sock_client < 0) {
-                        switch (errno) {
-                        case ECONNABORTED:
-                            mdebug1(ACCEPT_ERROR, strerror(errno), errno);
-                            break;
-                        default:
-                            merror(ACCEPT_ERROR, strerror(errno), errno);
-                        }
-
-                        continue;
-                    }
+            bytes += batch->messages[i]->size;
+            rem_msgqueue(rem_udp_take(batch, i));
+        }
+
+        if (bytes > 0) {
+            rem_add_recv(bytes);
+        }
+    }
+
+    return NULL;
+}
+
+// TCP reactor thread: accepts on its own listener and reads the sockets it accepted
+void * rem_reactor_main(void * args) {
+    const int listener = logr.tcp_socks[(intptr_t)args];
+    socklen_t peer_size = sizeof(struct sockaddr_in);
+    struct sockaddr_in peer_info;
+    wnotify_t * notify;
+    int sock_client;
+    int n_events;
+    ssize_t recv_b;
+
+    memset(&peer_info, 0, sizeof(struct sockaddr_in));
+
+    if (notify = wnotify_init(MAX_EVENTS), !notify) {
+        merror_exit("wnotify_init(): %s (%d)", strerror(errno), errno);
+    }
+
+    if (wnotify_add(notify, listener) < 0) {
+        merror_exit("wnotify_add(%d): %s (%d)", listener, strerror(errno), errno);
+    }
+
+    while (1) {
+        if (n_events = wnotify_wait(notify, EPOLL_MILLIS), n_events < 0) {
+            if (errno != EINTR) {
+                merror("Waiting for connection: %s (%d)", strerror(errno), errno);
+                sleep(1);
+            }
 
-                    nb_open(&netbuffer, sock_client, &peer_info);
-                    rem_inc_tcp();
-                    mdebug1("New TCP connection at %s [%d]", inet_ntoa(peer_info.sin_addr), sock_client);
+            continue;
+        }
 
-                    if (wnotify_add(notify, sock_client) < 0) {
-                        merror("wnotify_add(%d, %d): %s (%d)", notify->fd, sock_client, strerror(errno), errno);
-                        _close_sock(&keys, sock_client);
+        int i;
+        for (i = 0; i < n_events; i++) {
+            int fd = wnotify_get(notify, i);
+
+            if (fd == listener) {
+                sock_client = accept(listener, (struct sockaddr *)&peer_info, &peer_size);
+                if (sock_client < 0) {
+                    switch (errno) {
+                    case ECONNABORTED:
+                        mdebug1(ACCEPT_ERROR, strerror(errno), errno);
+                        break;
+                    default:
+                        merror(ACCEPT_ERROR, strerror(errno), errno);
                     }
-                } else {
-                    sock_client = fd;
-
-                    switch (recv_b = nb_recv(&netbuffer, sock_client), recv_b) {
-                    case -2:
-                        mwarn("Too big message size from %s [%d].", inet_ntoa(peer_info.sin_addr), sock_client);
-                        _close_sock(&keys, sock_client);
-                        continue;
-
-                    case -1:
-                        switch (errno) {
-                        case ECONNRESET:
-                        case ENOTCONN:
-                        case EAGAIN:
+
+                    continue;
+                }
+
+                if (nb_open(&netbuffer, sock_client, &peer_info) < 0) {
+                    merror("Socket %d at %s is out of the file descriptor limit.", sock_client, inet_ntoa(peer_info.sin_addr));
+                    close(sock_client);
+                    continue;
+                }
+
+                rem_inc_tcp();
+                mdebug1("New TCP connection at %s [%d]", inet_ntoa(peer_info.sin_addr), sock_client);
+
+                if (wnotify_add(notify, sock_client) < 0) {
+                    merror("wnotify_add(%d, %d): %s (%d)", notify->fd, sock_client, strerror(errno), errno);
+                    _close_sock(&keys, sock_client);
+                }
+            } else {
+                sock_client = fd;
+
+                switch (recv_b = nb_recv(&netbuffer, sock_client), recv_b) {
+                case -2:
+                    mwarn("Too big message size from %s [%d].", inet_ntoa(peer_info.sin_addr), sock_client);
+                    _close_sock(&keys, sock_client);
+                    continue;
+
+                case -1:
+                    switch (errno) {
+                    case ECONNRESET:
+                    case ENOTCONN:
+                    case EAGAIN:
 #if EAGAIN != EWOULDBLOCK
-                        case EWOULDBLOCK:
+                    case EWOULDBLOCK:
 #endif
 #if ETIMEDOUT
-                        case ETIMEDOUT:
+                    case ETIMEDOUT:
 #endif
-                            mdebug2("TCP peer [%d] at %s: %s (%d)", sock_client, inet_ntoa(peer_info.sin_addr), strerror(errno), errno);
-                            break;
-                        default:
-                            merror("TCP peer [%d] at %s: %s (%d)", sock_client, inet_ntoa(peer_info.sin_addr), strerror(errno), errno);
-                        }
-                        fallthrough;
-                    case 0:
-                        _close_sock(&keys, sock_client);
-                        continue;
-
+                        mdebug2("TCP peer [%d] at %s: %s (%d)", sock_client, inet_ntoa(peer_info.sin_addr), strerror(errno), errno);
+                        break;
                     default:
-                        rem_add_recv((unsigned long)recv_b);
+                        merror("TCP peer [%d] at %s: %s (%d)", sock_client, inet_ntoa(peer_info.sin_addr), strerror(errno), errno);
                     }
-                }
-            }
-        } else {
-            recv_b = recvfrom(logr.sock, buffer, OS_MAXSTR, 0, (struct sockaddr *)&peer_info, &logr.peer_size);
+                    fallthrough;
+                case 0:
+                    _close_sock(&keys, sock_client);
+                    continue;
 
-            /* Nothing received */
-            if (recv_b <= 0) {
-                continue;
-            } else {
-                rem_msgpush(buffer, recv_b, &peer_info, -1);
-                rem_add_recv((unsigned long)recv_b);
+                default:
+                    rem_add_recv((unsigned long)recv_b);
+                }
             }
         }
     }
+
+    return NULL;
 }
 
 // Message handler thread
-void * rem_handler_main(__attribute__((unused)) void * args) {
+void * rem_handler_main(void * args) {
+    unsigned int shard = (unsigned int)(intptr_t)args;
     message_t * message;
-    char buffer[OS_MAXSTR + 1] = "";
     mdebug1("Message handler thread started.");
 
     while (1) {
-        message = rem_msgpop();
+        message = rem_msgpop(shard);
+        w_trace_stage(&rem_tracer, &message->trace, REM_TRACE_QUEUE);
+
         if (message->sock == -1 || message->counter > rem_getCounter(message->sock)) {
-            memcpy(buffer, message->buffer, message->size);
-            HandleSecureMessage(buffer, message->size, &message->addr, message->sock);
+            // The message buffer has room for the payload uncompressed in place
+            HandleSecureMessage(message->buffer, message->size, &message->addr, message->sock, &message->trace);
         } else {
             rem_inc_dequeued();
         }
@@ -255,6 +361,21 @@ void * rem_handler_main(__attribute__((unused)) void * args) {
     return NULL;
 }
 
+// Control message thread: keepalives and requests, away from events waiting for analysisd
+void * rem_control_main(void * args) {
+    unsigned int lane = (unsigned int)(intptr_t)args;
+    control_msg_t * message;
+    mdebug1("Control message thread started.");
+
+    while (1) {
+        message = rem_ctrlpop(lane);
+        save_controlmsg(message->key, message->buffer, message->length);
+        rem_ctrlfree(message);
+    }
+
+    return NULL;
+}
+
 // Key reloader thread
 void * rem_keyupdate_main(__attribute__((unused)) void * args) {
     int seconds;
@@ -269,7 +390,7 @@ void * rem_keyupdate_main(__attribute__((unused)) void * args) {
     }
 }
 
-static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *peer_info, int sock_client) {
+static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *peer_info, int sock_client, w_trace_t *trace) {
     int agentid;
     int protocol = logr.proto[logr.position];
     char cleartext_msg[OS_MAXSTR + 1];
@@ -284,9 +405,8 @@ static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *pe
     /* Set the source IP */
     inet_ntop(peer_info->sin_family, &peer_info->sin_addr, srcip, IPSIZE);
 
-    /* Initialize some variables */
-    memset(cleartext_msg, '\0', OS_MAXSTR + 1);
-    memset(srcmsg, '\0', OS_FLSIZE + 1);
+    /* Initialize some variables: the decrypted text spans no more than the input */
+    memset(cleartext_msg, '\0', recv_b + 1);
     tmp_msg = NULL;
 
     /* Get a valid agent id */
@@ -380,6 +500,8 @@ static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *pe
         return;
     }
 
+    w_trace_stage(&rem_tracer, trace, REM_TRACE_DECRYPT);
+
     /* Check if it is a control message */
     if (IsValidHeader(tmp_msg)) {
 
@@ -403,11 +525,14 @@ static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *pe
 
         key_unlock();
 
-        // The critical section for readers closes within this function
-        save_controlmsg(key, tmp_msg, msg_length - 3);
-        rem_inc_ctrl_msg();
+        // Hand the message to its control lane, or handle it here if the lane is full
+        if (rem_ctrlpush(key, tmp_msg, msg_length - 3) < 0) {
+            save_controlmsg(key, tmp_msg, msg_length - 3);
+            OS_FreeKey(key);
+        }
 
-        OS_FreeKey(key);
+        rem_inc_ctrl_msg();
+        w_trace_end(&rem_tracer, trace);
         return;
     }
 
@@ -418,10 +543,21 @@ static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *pe
 
     key_unlock();
 
+    if (strncmp(tmp_msg, BATCH_HEADER, strlen(BATCH_HEADER)) == 0) {
+        rem_forward_batch(tmp_msg + strlen(BATCH_HEADER), msg_length - strlen(BATCH_HEADER), srcmsg);
+    } else {
+        rem_forward(tmp_msg, srcmsg);
+    }
+
+    w_trace_stage(&rem_tracer, trace, REM_TRACE_FORWARD);
+    w_trace_end(&rem_tracer, trace);
+}
+
+void rem_forward(const char *msg, const char *srcmsg) {
     /* If we can't send the message, try to connect to the
      * socket again. If it not exit.
      */
-    if (SendMSG(logr.m_queue, tmp_msg, srcmsg,
+    if (SendMSG(logr.m_queue, msg, srcmsg,
                 SECURE_MQ) < 0) {
         merror(QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
 
@@ -433,6 +569,43 @@ static void HandleSecureMessage(char *buffer, int recv_b, struct sockaddr_in *pe
     }
 }
 
+/* Each event is terminated in place, over the first byte of the next record,
+ * which is restored after the event is sent. The buffer has room for a
+ * terminator after the last one. */
+void rem_forward_batch(char *batch, size_t length, const char *srcmsg) {
+    size_t offset = 0;
+
+    while (offset + sizeof(uint32_t) <= length) {
+        uint32_t size;
+        char *event;
+        char saved;
+
+        memcpy(&size, batch + offset, sizeof(uint32_t));
+        size = wnet_order(size);
+        offset += sizeof(uint32_t);
+
+        if (size > length - offset) {
+            mwarn("Corrupt event batch from %s: record of %u bytes exceeds the %zu left.", srcmsg, size, length - offset);
+            return;
+        }
+
+        event = batch + offset;
+        offset += size;
+        saved = batch[offset];
+        batch[offset] = '\0';
+
+        if (size > 0) {
+            rem_forward(event, srcmsg);
+        }
+
+        batch[offset] = saved;
+    }
+
+    if (offset != length) {
+        mwarn("Corrupt event batch from %s: %zu trailing bytes.", srcmsg, length - offset);
+    }
+}
+
 // Close and remove socket from keystore
 int _close_sock(keystore * keys, int sock) {
     int retval;
@@ -445,7 +618,7 @@ int _close_sock(keystore * keys, int sock) {
         rem_dec_tcp();
     }
 
-    rem_setCounter(sock, global_counter);
+    rem_setCounter(sock, __atomic_load_n(&global_counter, __ATOMIC_RELAXED));
 
     mdebug1("TCP peer disconnected [%d]", sock);
 
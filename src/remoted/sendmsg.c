@@ -56,9 +56,7 @@ int check_keyupdate()
     }
 
     minfo(ENCFILE_CHANGED);
-    key_lock_write();
-    OS_UpdateKeys(&keys);
-    key_unlock();
+    OS_UpdateKeysDelta(&keys, key_lock_write, key_unlock);
     return 1;
 }
 
@@ -18,6 +18,21 @@ static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int rem_write_state();
 static char *refresh_time;
 
+static w_metric_t * m_tcp_sessions;
+static w_metric_t * m_evt;
+static w_metric_t * m_ctrl_msg;
+static w_metric_t * m_msg_sent;
+static w_metric_t * m_discarded;
+static w_metric_t * m_recv_bytes;
+static w_metric_t * m_dequeued;
+
+static const char * const rem_trace_stages[REM_TRACE_STAGES] = { "queue", "decrypt", "forward" };
+
+w_tracer_t rem_tracer;
+
+static double rem_metric_qsize(void * arg);
+static double rem_metric_tsize(void * arg);
+
 void * rem_state_main() {
     int interval = getDefine_Int("remoted", "state_interval", 0, 86400);
 
@@ -121,46 +136,75 @@ void rem_inc_tcp() {
     w_mutex_lock(&state_mutex);
     remoted_state.tcp_sessions++;
     w_mutex_unlock(&state_mutex);
+    w_metrics_set(m_tcp_sessions, remoted_state.tcp_sessions);
 }
 
 void rem_dec_tcp() {
     w_mutex_lock(&state_mutex);
     remoted_state.tcp_sessions--;
     w_mutex_unlock(&state_mutex);
+    w_metrics_set(m_tcp_sessions, remoted_state.tcp_sessions);
 }
 
 void rem_inc_evt() {
     w_mutex_lock(&state_mutex);
     remoted_state.evt_count++;
     w_mutex_unlock(&state_mutex);
+    w_metrics_inc(m_evt);
 }
 
 void rem_inc_ctrl_msg() {
     w_mutex_lock(&state_mutex);
     remoted_state.ctrl_msg_count++;
     w_mutex_unlock(&state_mutex);
+    w_metrics_inc(m_ctrl_msg);
 }
 
 void rem_inc_msg_sent() {
     w_mutex_lock(&state_mutex);
     remoted_state.msg_sent++;
     w_mutex_unlock(&state_mutex);
+    w_metrics_inc(m_msg_sent);
 }
 
 void rem_inc_discarded() {
     w_mutex_lock(&state_mutex);
     remoted_state.discarded_count++;
     w_mutex_unlock(&state_mutex);
+    w_metrics_inc(m_discarded);
 }
 
 void rem_add_recv(unsigned long bytes) {
     w_mutex_lock(&state_mutex);
     remoted_state.recv_bytes += bytes;
     w_mutex_unlock(&state_mutex);
+    w_metrics_add(m_recv_bytes, bytes);
 }
 
 void rem_inc_dequeued() {
     w_mutex_lock(&state_mutex);
     remoted_state.dequeued_after_close++;
     w_mutex_unlock(&state_mutex);
+    w_metrics_inc(m_dequeued);
+}
+
+void rem_metrics_init() {
+    m_tcp_sessions = w_metrics_gauge("wazuh_remoted_tcp_sessions", "Open TCP sessions.", NULL, NULL, NULL);
+    m_evt = w_metrics_counter("wazuh_remoted_events", "Events sent to analysisd.", NULL);
+    m_ctrl_msg = w_metrics_counter("wazuh_remoted_control_messages", "Control messages received.", NULL);
+    m_msg_sent = w_metrics_counter("wazuh_remoted_messages_sent", "Messages sent to the agents.", NULL);
+    m_discarded = w_metrics_counter("wazuh_remoted_messages_discarded", "Messages discarded, by reason.", "reason=\"queue_full\"");
+    m_recv_bytes = w_metrics_counter("wazuh_remoted_received_bytes", "Bytes received from the agents.", NULL);
+    m_dequeued = w_metrics_counter("wazuh_remoted_dequeued_after_close", "Messages dequeued after the agent closed the connection.", NULL);
+    w_metrics_gauge("wazuh_remoted_queue_elements", "Messages waiting in the queue.", NULL, rem_metric_qsize, NULL);
+    w_metrics_gauge("wazuh_remoted_queue_size", "Capacity of the queue.", NULL, rem_metric_tsize, NULL);
+    w_tracer_init(&rem_tracer, "remoted", "wazuh_remoted", rem_trace_stages, REM_TRACE_STAGES);
+}
+
+double rem_metric_qsize(__attribute__((unused)) void * arg) {
+    return rem_get_qsize();
+}
+
+double rem_metric_tsize(__attribute__((unused)) void * arg) {
+    return rem_get_tsize();
 }
@@ -37,19 +37,17 @@ static int OS_IPNotAllowed(const char *srcip)
 /* Handle syslog connections */
 void HandleSyslog()
 {
-    char buffer[OS_MAXSTR + 2];
     char srcip[IPSIZE + 1];
+    char *buffer;
     char *buffer_pt = NULL;
-    ssize_t recv_b;
-    struct sockaddr_in peer_info;
-    socklen_t peer_size;
+    rem_udp_batch_t *batch;
+    int recv_b;
+    int count;
+    int i;
 
-    /* Set peer size */
-    peer_size = sizeof(peer_info);
-
-    /* Initialize some variables */
-    memset(buffer, '\0', OS_MAXSTR + 2);
-    memset(&peer_info, 0, sizeof(struct sockaddr_in));
+    /* Datagrams are read in batches, into buffers that are reused */
+    os_calloc(1, sizeof(rem_udp_batch_t), batch);
+    rem_udp_init(batch);
 
     /* Connect to the message queue
      * Exit if it fails.
@@ -60,50 +58,51 @@ void HandleSyslog()
 
     /* Infinite loop */
     while (1) {
-        /* Receive message */
-        recv_b = recvfrom(logr.sock, buffer, OS_MAXSTR, 0,
-                          (struct sockaddr *)&peer_info, &peer_size);
-
-        /* Nothing received */
-        if (recv_b <= 0) {
-            continue;
-        }
+        /* Receive messages */
+        count = rem_udp_recv(batch, logr.sock);
 
-        /* Null-terminate the message */
-        buffer[recv_b] = '\0';
+        for (i = 0; i < count; i++) {
+            buffer = batch->buffers[i];
+            recv_b = batch->lengths[i];
 
-        /* Remove newline */
-        if (buffer[recv_b - 1] == '\n') {
-            buffer[recv_b - 1] = '\0';
-        }
+            /* Nothing received */
+            if (recv_b <= 0) {
+                continue;
+            }
 
-        /* Set the source IP */
-        strncpy(srcip, inet_ntoa(peer_info.sin_addr), IPSIZE);
-        srcip[IPSIZE] = '\0';
+            /* Remove newline */
+            if (buffer[recv_b - 1] == '\n') {
+                buffer[recv_b - 1] = '\0';
+            }
 
-        /* Remove syslog header */
-        if (buffer[0] == '<') {
-            buffer_pt = strchr(buffer + 1, '>');
-            if (buffer_pt) {
-                buffer_pt++;
+            /* Set the source IP */
+            strncpy(srcip, inet_ntoa(batch->peers[i].sin_addr), IPSIZE);
+            srcip[IPSIZE] = '\0';
+
+            /* Remove syslog header */
+            if (buffer[0] == '<') {
+                buffer_pt = strchr(buffer + 1, '>');
+                if (buffer_pt) {
+                    buffer_pt++;
+                } else {
+                    buffer_pt = buffer;
+                }
             } else {
                 buffer_pt = buffer;
             }
-        } else {
-            buffer_pt = buffer;
-        }
 
-        /* Check if IP is allowed here */
-        if (OS_IPNotAllowed(srcip)) {
-            mwarn(DENYIP_WARN, srcip);
-            continue;
-        }
+            /* Check if IP is allowed here */
+            if (OS_IPNotAllowed(srcip)) {
+                mwarn(DENYIP_WARN, srcip);
+                continue;
+            }
 
-        if (SendMSG(logr.m_queue, buffer_pt, srcip, SYSLOG_MQ) < 0) {
-            merror(QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
+            if (SendMSG(logr.m_queue, buffer_pt, srcip, SYSLOG_MQ) < 0) {
+                merror(QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
 
-            if ((logr.m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
-                merror_exit(QUEUE_FATAL, DEFAULTQUEUE);
+                if ((logr.m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
+                    merror_exit(QUEUE_FATAL, DEFAULTQUEUE);
+                }
             }
         }
     }
@@ -12,6 +12,24 @@
 #include "os_net/os_net.h"
 #include "remoted.h"
 
+/* Longest length prefix of an octet-counted frame (RFC 6587) */
+#define SYSLOG_FRAME_DIGITS 10
+
+/* Data received from a peer and not split in messages yet */
+typedef struct syslog_peer_t {
+    char srcip[IPSIZE + 1];
+    size_t length;
+    char buffer[OS_MAXSTR + 1];     // One more byte to end the last message
+} syslog_peer_t;
+
+/* Peers by socket. Each socket belongs to the reactor that accepted it */
+static syslog_peer_t ** syslog_peers;
+static unsigned int syslog_peers_size;
+
+/* Prototypes */
+static int OS_IPNotAllowed(char *srcip);
+static void * syslog_reactor_main(void * args);
+
 
 /* Checks if an IP is not allowed */
 static int OS_IPNotAllowed(char *srcip)
@@ -31,177 +49,248 @@ static int OS_IPNotAllowed(char *srcip)
     return (1);
 }
 
-/* Handle each client */
-static void HandleClient(int client_socket, char *srcip)
+/* Send a message to the queue, reconnecting to it if needed */
+static void syslog_send(int * m_queue, char * message, size_t length, const char * srcip)
 {
-    int sb_size = OS_MAXSTR;
-    int r_sz = 0;
-
-    char buffer[OS_MAXSTR + 2];
-    char storage_buffer[OS_MAXSTR + 2];
-    char tmp_buffer[OS_MAXSTR + 2];
+    char * buffer_pt;
 
-    char *buffer_pt = NULL;
+    message[length] = '\0';
 
-    /* Create PID file */
-    if (CreatePID(ARGV0, getpid()) < 0) {
-        merror_exit(PID_ERROR);
+    /* Remove carriage returns too */
+    if (buffer_pt = memchr(message, '\r', length), buffer_pt) {
+        *buffer_pt = '\0';
     }
 
-    /* Initialize some variables */
-    memset(buffer, '\0', OS_MAXSTR + 2);
-    memset(storage_buffer, '\0', OS_MAXSTR + 2);
-    memset(tmp_buffer, '\0', OS_MAXSTR + 2);
-
-
-    while (1) {
-        /* If an error occurred, or received 0 bytes, we need to return and close the socket */
-        r_sz = OS_RecvTCPBuffer(client_socket, buffer, OS_MAXSTR - 2);
-        switch (r_sz) {
-        case -1:
-            merror(RECV_ERROR, strerror(errno), errno);
-            // Fallthrough
-        case 0:
-            close(client_socket);
-            DeletePID(ARGV0);
-            return;
-        default:
-            mdebug2("Received %d bytes from '%s'", r_sz, srcip);
-            break;
+    /* Remove syslog header */
+    if (message[0] == '<') {
+        buffer_pt = strchr(message + 1, '>');
+        if (buffer_pt) {
+            buffer_pt++;
+        } else {
+            buffer_pt = message;
         }
+    } else {
+        buffer_pt = message;
+    }
 
-        /* We must have a new line at the end */
-        buffer_pt = strchr(buffer, '\n');
-        if (!buffer_pt) {
-            /* Buffer is full */
-            if ((sb_size - r_sz) <= 2) {
-                merror("Full buffer receiving from: '%s'", srcip);
-                sb_size = OS_MAXSTR;
-                storage_buffer[0] = '\0';
-                continue;
-            }
+    /* Send to the queue */
+    if (SendMSG(*m_queue, buffer_pt, srcip, SYSLOG_MQ) < 0) {
+        merror(QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
 
-            strncat(storage_buffer, buffer, sb_size);
-            sb_size -= r_sz;
-            continue;
-        }
-
-        /* See if we received more than just one message */
-        if (*(buffer_pt + 1) != '\0') {
-            *buffer_pt = '\0';
-            buffer_pt++;
-            strncpy(tmp_buffer, buffer_pt, OS_MAXSTR);
+        if ((*m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
+            merror_exit(QUEUE_FATAL, DEFAULTQUEUE);
         }
+    }
+}
 
-        /* Store everything in the storage_buffer
-         * Check if buffer will be full
-         */
-        if ((sb_size - r_sz) <= 2) {
-            merror("Full buffer receiving from: '%s'.", srcip);
-            sb_size = OS_MAXSTR;
-            storage_buffer[0] = '\0';
-            tmp_buffer[0] = '\0';
-            continue;
-        }
+/*
+ * Forward every whole message received from a peer. Messages are either
+ * octet-counted ("LEN MSG", RFC 6587) or terminated by a newline.
+ * Returns 0 on success, or -1 if the peer sent a frame too big.
+ */
+static int syslog_peer_parse(syslog_peer_t * peer, int * m_queue)
+{
+    size_t offset = 0;
+    size_t avail;
+    size_t length;
+    size_t digits;
+    char * frame;
+    char * end;
+    char saved;
 
-        strncat(storage_buffer, buffer, sb_size);
+    while (offset < peer->length) {
+        frame = peer->buffer + offset;
+        avail = peer->length - offset;
 
-        /* Remove carriage returns too */
-        buffer_pt = strchr(storage_buffer, '\r');
-        if (buffer_pt) {
-            *buffer_pt = '\0';
-        }
+        if (isdigit((unsigned char)frame[0])) {
+            /* Octet counting: the message follows the length and a space */
+            for (digits = 0, length = 0; digits < avail && digits < SYSLOG_FRAME_DIGITS && isdigit((unsigned char)frame[digits]); digits++) {
+                length = length * 10 + (size_t)(frame[digits] - '0');
+            }
 
-        /* Remove syslog header */
-        if (storage_buffer[0] == '<') {
-            buffer_pt = strchr(storage_buffer + 1, '>');
-            if (buffer_pt) {
-                buffer_pt++;
-            } else {
-                buffer_pt = storage_buffer;
+            if (digits == avail) {
+                break;
             }
-        } else {
-            buffer_pt = storage_buffer;
-        }
 
-        /* Send to the queue */
-        if (SendMSG(logr.m_queue, buffer_pt, srcip, SYSLOG_MQ) < 0) {
-            merror(QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
+            if (frame[digits] != ' ' || length > OS_MAXSTR - digits - 1) {
+                merror("Invalid syslog frame length receiving from: '%s'.", peer->srcip);
+                return -1;
+            }
 
-            if ((logr.m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
-                merror_exit(QUEUE_FATAL, DEFAULTQUEUE);
+            if (avail < digits + 1 + length) {
+                break;
             }
-        }
 
-        /* Clean up the buffers */
-        if (tmp_buffer[0] != '\0') {
-            strncpy(storage_buffer, tmp_buffer, OS_MAXSTR);
-            sb_size = OS_MAXSTR - (strlen(storage_buffer) + 1);
-            tmp_buffer[0] = '\0';
+            /* The byte after the message belongs to the next frame */
+            saved = frame[digits + 1 + length];
+            syslog_send(m_queue, frame + digits + 1, length, peer->srcip);
+            frame[digits + 1 + length] = saved;
+            offset += digits + 1 + length;
         } else {
-            storage_buffer[0] = '\0';
-            sb_size = OS_MAXSTR;
+            /* Non-transparent framing: up to the newline */
+            if (end = memchr(frame, '\n', avail), !end) {
+                break;
+            }
+
+            syslog_send(m_queue, frame, (size_t)(end - frame), peer->srcip);
+            offset += (size_t)(end - frame) + 1;
         }
     }
+
+    /* Keep the start of the next message */
+    if (offset > 0) {
+        memmove(peer->buffer, peer->buffer + offset, peer->length - offset);
+        peer->length -= offset;
+    }
+
+    /* The buffer is full and still holds no whole message */
+    if (peer->length == OS_MAXSTR) {
+        merror("Full buffer receiving from: '%s'.", peer->srcip);
+        peer->length = 0;
+    }
+
+    return 0;
 }
 
-/* Handle syslog TCP connections */
-void HandleSyslogTCP()
+static void syslog_peer_close(int sock)
+{
+    os_free(syslog_peers[sock]);
+    close(sock);
+}
+
+/* Syslog TCP reactor: accepts on its own listener and reads the peers it accepted */
+void * syslog_reactor_main(void * args)
 {
-    int childcount = 0;
+    const int listener = logr.tcp_socks[(intptr_t)args];
     char srcip[IPSIZE + 1];
+    syslog_peer_t * peer;
+    wnotify_t * notify;
+    int m_queue;
+    int client_socket;
+    int n_events;
+    ssize_t recv_b;
+    int i;
 
-    /* Initialize some variables */
     memset(srcip, '\0', IPSIZE + 1);
 
     /* Connecting to the message queue
      * Exit if it fails.
      */
-    if ((logr.m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
+    if ((m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
         merror_exit(QUEUE_FATAL, DEFAULTQUEUE);
     }
 
+    /* Messages are sent at once after each round of events */
+    SendMSGBatch(MQ_BATCH_MAX);
+
+    if (notify = wnotify_init(MAX_EVENTS), !notify) {
+        merror_exit("wnotify_init(): %s (%d)", strerror(errno), errno);
+    }
+
+    if (wnotify_add(notify, listener) < 0) {
+        merror_exit("wnotify_add(%d): %s (%d)", listener, strerror(errno), errno);
+    }
+
     while (1) {
-        /* Wait for the children */
-        while (childcount) {
-            int wp;
-            wp = waitpid((pid_t) - 1, NULL, WNOHANG);
-            if (wp < 0) {
-                merror(WAITPID_ERROR, errno, strerror(errno));
+        if (n_events = wnotify_wait(notify, EPOLL_MILLIS), n_events < 0) {
+            if (errno != EINTR) {
+                merror("Waiting for connection: %s (%d)", strerror(errno), errno);
+                sleep(1);
             }
 
-            /* if = 0, we still need to wait for the child process */
-            else if (wp == 0) {
-                break;
-            } else {
-                childcount--;
-            }
-        }
-
-        /* Accept new connections */
-        int client_socket = OS_AcceptTCP(logr.sock, srcip, IPSIZE);
-        if (client_socket < 0) {
-            mwarn("Accepting TCP connection from client failed: %s (%d)", strerror(errno), errno);
             continue;
         }
 
-        /* Check if IP is allowed here */
-        if (OS_IPNotAllowed(srcip)) {
-            mwarn(DENYIP_WARN, srcip);
-            close(client_socket);
-            continue;
+        for (i = 0; i < n_events; i++) {
+            int fd = wnotify_get(notify, i);
+
+            if (fd == listener) {
+                /* Accept new connections */
+                client_socket = OS_AcceptTCP(listener, srcip, IPSIZE);
+                if (client_socket < 0) {
+                    mwarn("Accepting TCP connection from client failed: %s (%d)", strerror(errno), errno);
+                    continue;
+                }
+
+                /* Check if IP is allowed here */
+                if (OS_IPNotAllowed(srcip)) {
+                    mwarn(DENYIP_WARN, srcip);
+                    close(client_socket);
+                    continue;
+                }
+
+                if ((unsigned int)client_socket >= syslog_peers_size) {
+                    merror("Socket %d at %s is out of the file descriptor limit.", client_socket, srcip);
+                    close(client_socket);
+                    continue;
+                }
+
+                os_malloc(sizeof(syslog_peer_t), peer);
+                strncpy(peer->srcip, srcip, IPSIZE);
+                peer->srcip[IPSIZE] = '\0';
+                peer->length = 0;
+                syslog_peers[client_socket] = peer;
+
+                if (wnotify_add(notify, client_socket) < 0) {
+                    merror("wnotify_add(%d, %d): %s (%d)", notify->fd, client_socket, strerror(errno), errno);
+                    syslog_peer_close(client_socket);
+                }
+
+                continue;
+            }
+
+            peer = syslog_peers[fd];
+
+            /* If an error occurred, or received 0 bytes, we need to close the socket */
+            switch (recv_b = recv(fd, peer->buffer + peer->length, OS_MAXSTR - peer->length, 0), recv_b) {
+            case -1:
+                if (errno == EINTR || errno == EAGAIN) {
+                    continue;
+                }
+
+                merror(RECV_ERROR, strerror(errno), errno);
+                fallthrough;
+            case 0:
+                syslog_peer_close(fd);
+                continue;
+            default:
+                mdebug2("Received %zd bytes from '%s'", recv_b, peer->srcip);
+                peer->length += (size_t)recv_b;
+            }
+
+            if (syslog_peer_parse(peer, &m_queue) < 0) {
+                syslog_peer_close(fd);
+            }
         }
 
-        /* Fork to deal with new client */
-        if (fork() == 0) {
-            HandleClient(client_socket, srcip);
-            exit(0);
-        } else {
-            childcount++;
+        if (SendMSGFlush(m_queue) < 0) {
+            merror(QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
 
-            /* Close client socket, since the child is handling it */
-            close(client_socket);
-            continue;
+            if ((m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
+                merror_exit(QUEUE_FATAL, DEFAULTQUEUE);
+            }
         }
     }
+
+    return NULL;
+}
+
+/* Handle syslog TCP connections */
+void HandleSyslogTCP()
+{
+    struct rlimit rlimit;
+    int i;
+
+    // A peer for every descriptor this process can open
+    syslog_peers_size = getrlimit(RLIMIT_NOFILE, &rlimit) == 0 && rlimit.rlim_cur < 1048576 ? rlimit.rlim_cur : nofile;
+    os_calloc(syslog_peers_size, sizeof(syslog_peer_t *), syslog_peers);
+
+    mdebug2("Creating %d syslog TCP reactor threads.", tcp_reactors);
+
+    for (i = 1; i < tcp_reactors; i++) {
+        w_create_named_thread(syslog_reactor_main, (void *)(intptr_t)i, "rem-syslog-%d", i);
+    }
+
+    w_thread_register(pthread_self(), "rem-syslog-0");
+    syslog_reactor_main((void *)0);
 }
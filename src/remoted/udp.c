@@ -0,0 +1,53 @@
+/* Remoted UDP reception
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+#include "os_net/os_net.h"
+#include "remoted.h"
+
+static void rem_udp_fill(rem_udp_batch_t * batch, int index) {
+    batch->messages[index] = rem_msgget();
+    batch->buffers[index] = batch->messages[index]->buffer;
+}
+
+// Fill every slot of the ring with an empty message
+void rem_udp_init(rem_udp_batch_t * batch) {
+    int i;
+
+    for (i = 0; i < REM_UDP_BATCH; i++) {
+        rem_udp_fill(batch, i);
+    }
+}
+
+// Receive datagrams into the messages of the ring. Returns how many
+int rem_udp_recv(rem_udp_batch_t * batch, int sock) {
+    message_t * message;
+    int count;
+    int i;
+
+    count = OS_RecvUDPBatch(sock, OS_MAXSTR, batch->buffers, batch->lengths, batch->peers, REM_UDP_BATCH);
+
+    for (i = 0; i < count; i++) {
+        message = batch->messages[i];
+        message->size = (unsigned int)batch->lengths[i];
+        message->addr = batch->peers[i];
+        message->sock = -1;
+    }
+
+    return count;
+}
+
+// Take a received message out of the ring, and put an empty one in its slot
+message_t * rem_udp_take(rem_udp_batch_t * batch, int index) {
+    message_t * message = batch->messages[index];
+
+    rem_udp_fill(batch, index);
+    return message;
+}
@@ -16,7 +16,11 @@
 static int  proc_read(int pid);
 static int  proc_chdir(int pid);
 static int  proc_stat(int pid);
+static int  check_pid(const char *ps, pid_t pid, pid_t my_pid, int *_errors);
 static void loop_all_pids(const char *ps, pid_t max_pid, int *_errors, int *_total);
+#ifdef __linux__
+static int  loop_proc_pids(const char *ps, int *_errors, int *_total);
+#endif
 
 /* Global variables */
 static int noproc;
@@ -86,8 +90,8 @@ static int proc_stat(int pid)
     return (0);
 }
 
-/* Check all the available PIDs for hidden stuff */
-static void loop_all_pids(const char *ps, pid_t max_pid, int *_errors, int *_total)
+/* Check a PID for hidden stuff. Returns -1 past the maximum of errors */
+static int check_pid(const char *ps, pid_t pid, pid_t my_pid, int *_errors)
 {
     int _kill0 = 0;
     int _kill1 = 0;
@@ -100,188 +104,344 @@ static void loop_all_pids(const char *ps, pid_t max_pid, int *_errors, int *_tot
     int _proc_read  = 0;
     int _proc_chdir = 0;
 
-    pid_t i = 1;
-    pid_t my_pid;
-
     char command[OS_SIZE_1024 + 64];
 
-    my_pid = getpid();
+    /* kill test */
+    if (!((kill(pid, 0) == -1) && (errno == ESRCH))) {
+        _kill0 = 1;
+    }
 
-    for (;; i++) {
-        if ((i <= 0) || (i > max_pid)) {
-            break;
-        }
+    /* getsid test */
+    if (!((getsid(pid) == -1) && (errno == ESRCH))) {
+        _gsid0 = 1;
+    }
 
-        (*_total)++;
+    /* getpgid test */
+    if (!((getpgid(pid) == -1) && (errno == ESRCH))) {
+        _gpid0 = 1;
+    }
 
-        _kill0 = 0;
-        _kill1 = 0;
-        _gsid0 = 0;
-        _gsid1 = 0;
-        _gpid0 = 0;
-        _gpid1 = 0;
-        _ps0 = -1;
-
-        /* kill test */
-        if (!((kill(i, 0) == -1) && (errno == ESRCH))) {
-            _kill0 = 1;
+    /* /proc test */
+    _proc_stat = proc_stat(pid);
+    _proc_read = proc_read(pid);
+    _proc_chdir = proc_chdir(pid);
+
+    /* If PID does not exist, move on */
+    if (!_kill0     && !_gsid0     && !_gpid0 &&
+            !_proc_stat && !_proc_read && !_proc_chdir) {
+        return 0;
+    }
+
+    /* Ignore our own pid */
+    if (pid == my_pid) {
+        return 0;
+    }
+
+    /* Check the number of errors */
+    if ((*_errors) > 15) {
+        char op_msg[OS_SIZE_1024 + 1];
+        snprintf(op_msg, OS_SIZE_1024, "Excessive number of hidden processes"
+                 ". It maybe a false-positive or "
+                 "something really bad is going on.");
+        notify_rk(ALERT_SYSTEM_CRIT, op_msg);
+        return -1;
+    }
+
+    /* Check if the process appears in ps(1) output */
+    if (*ps) {
+        snprintf(command, sizeof(command), "%s -p %d > /dev/null 2>&1", ps, (int)pid);
+        _ps0 = 0;
+        if (system(command) == 0) {
+            _ps0 = 1;
         }
+    }
+
+    /* If we are run in the context of OSSEC-HIDS, sleep here (no rush) */
+#ifdef OSSECHIDS
+#ifdef WIN32
+    Sleep(rootcheck.tsleep);
+#else
+    struct timeval timeout = {0, rootcheck.tsleep * 1000};
+    select(0, NULL, NULL, NULL, &timeout);
+#endif
+#endif
+
+    /* Everything fine, move on */
+    if (_ps0 && _kill0 && _gsid0 && _gpid0 && _proc_stat && _proc_read) {
+        return 0;
+    }
+
+    /*
+     * If our kill or getsid system call got the PID but ps(1) did not,
+     * find out if the PID is deleted (not used anymore)
+     */
+    if (!((getsid(pid) == -1) && (errno == ESRCH))) {
+        _gsid1 = 1;
+    }
+    if (!((kill(pid, 0) == -1) && (errno == ESRCH))) {
+        _kill1 = 1;
+    }
+    if (!((getpgid(pid) == -1) && (errno == ESRCH))) {
+        _gpid1 = 1;
+    }
+
+    _proc_stat = proc_stat(pid);
+    _proc_read = proc_read(pid);
+    _proc_chdir = proc_chdir(pid);
+
+    /* If it matches, process was terminated in the meantime, so move on */
+    if (!_gsid1 && !_kill1 && !_gpid1 && !_proc_stat &&
+            !_proc_read && !_proc_chdir) {
+        return 0;
+    }
+
+#ifdef AIX
+    /* Ignore AIX wait and sched programs */
+    if (_gsid0 == _gsid1 &&
+            _kill0 == _kill1 &&
+            _gpid0 == _gpid1 &&
+            _ps0 == 1 &&
+            _gsid0 == 1 &&
+            _kill0 == 0) {
+        /* The wait and sched programs do not respond to kill 0.
+         * So if everything else finds it, including ps, getpid, getsid,
+         * but not kill, we can safely ignore on AIX.
+         * A malicious program would specially try to hide from ps.
+         */
+        return 0;
+    }
+#endif
+
+    if (_gsid0 == _gsid1 &&
+            _kill0 == _kill1 &&
+            _gsid0 != _kill0) {
+        /* If kill worked, but getsid and getpgid did not, it may
+         * be a defunct process -- ignore.
+         */
+        if (! (_kill0 == 1 && _gsid0 == 0 && _gpid0 == 0 && _gsid1 == 0) ) {
+            char op_msg[OS_SIZE_1024 + 1];
 
-        /* getsid test */
-        if (!((getsid(i) == -1) && (errno == ESRCH))) {
-            _gsid0 = 1;
+            snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
+                     "kill (%d) or getsid (%d). Possible kernel-level"
+                     " rootkit.", (int)pid, _kill0, _gsid0);
+            notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
+            (*_errors)++;
         }
+    } else if (_kill1 != _gsid1 ||
+               _gpid1 != _kill1 ||
+               _gpid1 != _gsid1) {
+        /* See defunct process comment above */
+        if (! (_kill1 == 1 && _gsid1 == 0 && _gpid0 == 0) ) {
+            char op_msg[OS_SIZE_1024 + 1];
 
-        /* getpgid test */
-        if (!((getpgid(i) == -1) && (errno == ESRCH))) {
-            _gpid0 = 1;
+            snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
+                     "kill (%d), getsid (%d) or getpgid. Possible "
+                     "kernel-level rootkit.", (int)pid, _kill1, _gsid1);
+            notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
+            (*_errors)++;
         }
+    } else if (_proc_read != _proc_stat  ||
+               _proc_read != _proc_chdir ||
+               _proc_stat != _kill1) {
+        /* Check if the pid is a thread (not showing in /proc */
+        if (!noproc && !check_rc_readproc((int)pid)) {
+            char op_msg[OS_SIZE_1024 + 1];
 
-        /* /proc test */
-        _proc_stat = proc_stat(i);
-        _proc_read = proc_read(i);
-        _proc_chdir = proc_chdir(i);
+            snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
+                     "/proc. Possible kernel level rootkit.", (int)pid);
+            notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
+            (*_errors)++;
+        }
+    } else if (_gsid1 && _kill1 && !_ps0) {
+        /* checking if the pid is a thread (not showing on ps */
+        if (!check_rc_readproc((int)pid)) {
+            char op_msg[OS_SIZE_1024 + 1];
 
-        /* If PID does not exist, move on */
-        if (!_kill0     && !_gsid0     && !_gpid0 &&
-                !_proc_stat && !_proc_read && !_proc_chdir) {
-            continue;
+            snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
+                     "ps. Possible trojaned version installed.",
+                     (int)pid);
+            notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
+            (*_errors)++;
         }
+    }
 
-        /* Ignore our own pid */
-        if (i == my_pid) {
-            continue;
+    return 0;
+}
+
+/* Check all the available PIDs for hidden stuff */
+static void loop_all_pids(const char *ps, pid_t max_pid, int *_errors, int *_total)
+{
+    pid_t i = 1;
+    pid_t my_pid;
+
+    my_pid = getpid();
+
+    for (;; i++) {
+        if ((i <= 0) || (i > max_pid)) {
+            break;
         }
 
-        /* Check the number of errors */
-        if ((*_errors) > 15) {
-            char op_msg[OS_SIZE_1024 + 1];
-            snprintf(op_msg, OS_SIZE_1024, "Excessive number of hidden processes"
-                     ". It maybe a false-positive or "
-                     "something really bad is going on.");
-            notify_rk(ALERT_SYSTEM_CRIT, op_msg);
+        (*_total)++;
+
+        if (check_pid(ps, i, my_pid, _errors) < 0) {
             return;
         }
+    }
+}
 
-        /* Check if the process appears in ps(1) output */
-        if (*ps) {
-            snprintf(command, sizeof(command), "%s -p %d > /dev/null 2>&1", ps, (int)i);
-            _ps0 = 0;
-            if (system(command) == 0) {
-                _ps0 = 1;
-            }
+#ifdef __linux__
+/* Range of PIDs probed by a thread, and the PIDs found in it */
+typedef struct pid_probe_t {
+    const unsigned char *listed;
+    pid_t first;
+    pid_t last;
+    pid_t *found;
+    size_t count;
+    pthread_t thread;
+    int joinable;
+} pid_probe_t;
+
+#define PID_LISTED(map, pid) ((map)[(pid) >> 3] & (1 << ((pid) & 7)))
+
+/* Probe the PIDs that /proc did not list. Only a process that is hiding,
+ * or that started after the listing, answers here.
+ */
+static void * probe_pid_gaps(void *arg)
+{
+    pid_probe_t *probe = (pid_probe_t *)arg;
+    size_t size = 0;
+    char proc_dir[OS_SIZE_64];
+    struct stat statbuf;
+    pid_t pid;
+
+    for (pid = probe->first; pid <= probe->last && pid > 0; pid++) {
+        if (PID_LISTED(probe->listed, pid)) {
+            continue;
         }
 
-        /* If we are run in the context of OSSEC-HIDS, sleep here (no rush) */
-#ifdef OSSECHIDS
-#ifdef WIN32
-        Sleep(rootcheck.tsleep);
-#else
-        struct timeval timeout = {0, rootcheck.tsleep * 1000};
-        select(0, NULL, NULL, NULL, &timeout);
-#endif
-#endif
+        snprintf(proc_dir, sizeof(proc_dir), "/proc/%d", (int)pid);
 
-        /* Everything fine, move on */
-        if (_ps0 && _kill0 && _gsid0 && _gpid0 && _proc_stat && _proc_read) {
+        if ((kill(pid, 0) == -1 && errno == ESRCH) &&
+                (getsid(pid) == -1 && errno == ESRCH) &&
+                (getpgid(pid) == -1 && errno == ESRCH) &&
+                stat(proc_dir, &statbuf) == -1) {
             continue;
         }
 
-        /*
-         * If our kill or getsid system call got the PID but ps(1) did not,
-         * find out if the PID is deleted (not used anymore)
-         */
-        if (!((getsid(i) == -1) && (errno == ESRCH))) {
-            _gsid1 = 1;
+        if (probe->count == size) {
+            size = size ? size * 2 : 64;
+            os_realloc(probe->found, size * sizeof(pid_t), probe->found);
         }
-        if (!((kill(i, 0) == -1) && (errno == ESRCH))) {
-            _kill1 = 1;
+
+        probe->found[probe->count++] = pid;
+    }
+
+    return NULL;
+}
+
+/* Highest PID of the running kernel, rather than the one of the build */
+static pid_t get_max_pid(void)
+{
+    FILE *fp;
+    int max_pid = 0;
+
+    if (fp = fopen("/proc/sys/kernel/pid_max", "r"), fp) {
+        if (fscanf(fp, "%d", &max_pid) != 1) {
+            max_pid = 0;
         }
-        if (!((getpgid(i) == -1) && (errno == ESRCH))) {
-            _gpid1 = 1;
+        fclose(fp);
+    }
+
+    return max_pid > 0 ? (pid_t)max_pid : MAX_PID;
+}
+
+/* List /proc once, probe the gaps in parallel and fully check only the PIDs
+ * found by either. Returns -1 if /proc could not be listed.
+ */
+static int loop_proc_pids(const char *ps, int *_errors, int *_total)
+{
+    pid_t max_pid = get_max_pid();
+    unsigned char *listed;
+    pid_probe_t *probes;
+    struct dirent *entry;
+    size_t next;
+    pid_t my_pid = getpid();
+    pid_t pid;
+    pid_t slice;
+    char *end;
+    long value;
+    DIR *dp;
+    int stop = 0;
+    int i;
+
+    if (dp = opendir("/proc"), !dp) {
+        return -1;
+    }
+
+    os_calloc(max_pid / 8 + 1, sizeof(unsigned char), listed);
+
+    while ((entry = readdir(dp)) != NULL) {
+        value = strtol(entry->d_name, &end, 10);
+
+        if (*end == '\0' && value > 0 && value <= max_pid) {
+            listed[value >> 3] |= (unsigned char)(1 << (value & 7));
         }
+    }
 
-        _proc_stat = proc_stat(i);
-        _proc_read = proc_read(i);
-        _proc_chdir = proc_chdir(i);
+    closedir(dp);
 
-        /* If it matches, process was terminated in the meantime, so move on */
-        if (!_gsid1 && !_kill1 && !_gpid1 && !_proc_stat &&
-                !_proc_read && !_proc_chdir) {
-            continue;
+    os_calloc(rootcheck.pid_threads, sizeof(pid_probe_t), probes);
+    slice = max_pid / rootcheck.pid_threads + 1;
+
+    for (i = 0; i < rootcheck.pid_threads; i++) {
+        probes[i].listed = listed;
+        probes[i].first = (pid_t)i * slice + 1;
+        probes[i].last = probes[i].first + slice - 1 < max_pid ? probes[i].first + slice - 1 : max_pid;
+
+        if (pthread_create(&probes[i].thread, NULL, probe_pid_gaps, &probes[i]) == 0) {
+            probes[i].joinable = 1;
+        } else {
+            merror(THREAD_ERROR);
+            probe_pid_gaps(&probes[i]);
         }
+    }
 
-#ifdef AIX
-        /* Ignore AIX wait and sched programs */
-        if (_gsid0 == _gsid1 &&
-                _kill0 == _kill1 &&
-                _gpid0 == _gpid1 &&
-                _ps0 == 1 &&
-                _gsid0 == 1 &&
-                _kill0 == 0) {
-            /* The wait and sched programs do not respond to kill 0.
-             * So if everything else finds it, including ps, getpid, getsid,
-             * but not kill, we can safely ignore on AIX.
-             * A malicious program would specially try to hide from ps.
-             */
-            continue;
+    for (i = 0; i < rootcheck.pid_threads; i++) {
+        if (probes[i].joinable) {
+            pthread_join(probes[i].thread, NULL);
         }
-#endif
+    }
 
-        if (_gsid0 == _gsid1 &&
-                _kill0 == _kill1 &&
-                _gsid0 != _kill0) {
-            /* If kill worked, but getsid and getpgid did not, it may
-             * be a defunct process -- ignore.
-             */
-            if (! (_kill0 == 1 && _gsid0 == 0 && _gpid0 == 0 && _gsid1 == 0) ) {
-                char op_msg[OS_SIZE_1024 + 1];
-
-                snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
-                         "kill (%d) or getsid (%d). Possible kernel-level"
-                         " rootkit.", (int)i, _kill0, _gsid0);
-                notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
-                (*_errors)++;
-            }
-        } else if (_kill1 != _gsid1 ||
-                   _gpid1 != _kill1 ||
-                   _gpid1 != _gsid1) {
-            /* See defunct process comment above */
-            if (! (_kill1 == 1 && _gsid1 == 0 && _gpid0 == 0) ) {
-                char op_msg[OS_SIZE_1024 + 1];
-
-                snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
-                         "kill (%d), getsid (%d) or getpgid. Possible "
-                         "kernel-level rootkit.", (int)i, _kill1, _gsid1);
-                notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
-                (*_errors)++;
-            }
-        } else if (_proc_read != _proc_stat  ||
-                   _proc_read != _proc_chdir ||
-                   _proc_stat != _kill1) {
-            /* Check if the pid is a thread (not showing in /proc */
-            if (!noproc && !check_rc_readproc((int)i)) {
-                char op_msg[OS_SIZE_1024 + 1];
-
-                snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
-                         "/proc. Possible kernel level rootkit.", (int)i);
-                notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
-                (*_errors)++;
+    /* Slices are in order, so both sources are merged by walking them once */
+    for (i = 0; i < rootcheck.pid_threads && !stop; i++) {
+        next = 0;
+
+        for (pid = probes[i].first; pid <= probes[i].last && pid > 0; pid++) {
+            (*_total)++;
+
+            if (!PID_LISTED(listed, pid)) {
+                if (next == probes[i].count || probes[i].found[next] != pid) {
+                    continue;
+                }
+                next++;
             }
-        } else if (_gsid1 && _kill1 && !_ps0) {
-            /* checking if the pid is a thread (not showing on ps */
-            if (!check_rc_readproc((int)i)) {
-                char op_msg[OS_SIZE_1024 + 1];
-
-                snprintf(op_msg, OS_SIZE_1024, "Process '%d' hidden from "
-                         "ps. Possible trojaned version installed.",
-                         (int)i);
-                notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
-                (*_errors)++;
+
+            if (check_pid(ps, pid, my_pid, _errors) < 0) {
+                stop = 1;
+                break;
             }
         }
     }
+
+    for (i = 0; i < rootcheck.pid_threads; i++) {
+        os_free(probes[i].found);
+    }
+
+    os_free(probes);
+    os_free(listed);
+    return 0;
 }
+#endif
 
 /* Scan the whole filesystem looking for possible issues */
 void check_rc_pids()
@@ -312,7 +472,13 @@ void check_rc_pids()
         noproc = 0;
     }
 
+#ifdef __linux__
+    if (noproc || rootcheck.pid_threads == 0 || loop_proc_pids(ps, &_errors, &_total) < 0) {
+        loop_all_pids(ps, max_pid, &_errors, &_total);
+    }
+#else
     loop_all_pids(ps, max_pid, &_errors, &_total);
+#endif
 
     if (_errors == 0) {
         char op_msg[OS_SIZE_2048];
@@ -13,43 +13,185 @@
 #include "shared.h"
 #include "rootcheck.h"
 
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#endif
+
 #if defined(sun) || defined(__sun__)
-#define NETSTAT         "netstat -an -P %s | "\
-                        "grep \"[^0-9]%d \" > /dev/null 2>&1"
+#define NETSTAT         "netstat -an -P %s"
 #else
-#define NETSTAT         "netstat -an | grep \"^%s\" | " \
-                        "grep \"[^0-9]%d \" > /dev/null 2>&1"
+#define NETSTAT         "netstat -an"
 #endif
 
+/* Ports in use as seen by netstat(1) and, on Linux, by the kernel socket
+ * table (sock_diag). Each view is taken once per scan.
+ */
+typedef struct port_view {
+    char netstat[65535 + 1];
+    char diag[65535 + 1];
+    int has_netstat;
+    int has_diag;
+} port_view;
+
 /* Prototypes */
-static int  run_netstat(int proto, int port);
+static void netstat_line_ports(const char *line, char *ports);
+static int  run_netstat(int proto, char *ports);
+static int  diag_ports(int proto, char *ports);
+static void get_port_view(int proto, port_view *view);
+static int  port_hidden(const port_view *view, int port);
 static int  conn_port(int proto, int port);
 static void test_ports(int proto, int *_errors, int *_total);
 
 
-static int run_netstat(int proto, int port)
+/* Mark the ports that the former grep "[^0-9]<port> " would find in a line */
+static void netstat_line_ports(const char *line, char *ports)
+{
+    const char *p;
+    const char *q;
+    long port;
+
+    for (p = line + 1; *p != '\0'; p++) {
+        if (!isdigit((unsigned char)*p) || isdigit((unsigned char)p[-1])) {
+            continue;
+        }
+
+        for (q = p, port = 0; isdigit((unsigned char)*q) && port <= 65535; q++) {
+            port = port * 10 + (*q - '0');
+        }
+
+        /* A leading zero would not have matched either */
+        if (*q == ' ' && port <= 65535 && (*p != '0' || q - p == 1)) {
+            ports[port] = 1;
+        }
+    }
+}
+
+/* Run netstat once and collect the ports of the protocol in use */
+static int run_netstat(int proto, char *ports)
 {
-    int ret;
-    char nt[OS_SIZE_1024 + 1];
+    char line[OS_SIZE_2048 + 1];
+    const char *name;
+    FILE *fp;
 
     if (proto == IPPROTO_TCP) {
-        snprintf(nt, OS_SIZE_1024, NETSTAT, "tcp", port);
+        name = "tcp";
     } else if (proto == IPPROTO_UDP) {
-        snprintf(nt, OS_SIZE_1024, NETSTAT, "udp", port);
+        name = "udp";
     } else {
         mterror(ARGV0, "Netstat error (wrong protocol)");
-        return (0);
+        return (-1);
     }
 
-    ret = system(nt);
+#if defined(sun) || defined(__sun__)
+    snprintf(line, OS_SIZE_2048, NETSTAT, name);
+#else
+    snprintf(line, OS_SIZE_2048, "%s", NETSTAT);
+#endif
 
-    if (ret == 0) {
-        return (1);
-    } else if (ret == 1) {
-        return (0);
+    if (fp = popen(line, "r"), !fp) {
+        return (-1);
+    }
+
+    while (fgets(line, OS_SIZE_2048, fp) != NULL) {
+#if !defined(sun) && !defined(__sun__)
+        if (strncmp(line, name, 3) != 0) {
+            continue;
+        }
+#endif
+        netstat_line_ports(line, ports);
     }
 
-    return (1);
+    /* Without a usable netstat, only the kernel view is compared */
+    if (pclose(fp) != 0) {
+        return (-1);
+    }
+
+    return (0);
+}
+
+#ifdef __linux__
+/* Dump the sockets of the protocol, IPv4 and IPv6, in any state */
+static int diag_ports(int proto, char *ports)
+{
+    static const int families[] = { AF_INET, AF_INET6 };
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+    } request;
+    struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+    char buffer[OS_SIZE_8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    struct nlmsghdr *nlh;
+    struct inet_diag_msg *msg;
+    ssize_t length;
+    unsigned int i;
+    int done;
+    int fd;
+
+    if (fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_SOCK_DIAG), fd < 0) {
+        return (-1);
+    }
+
+    for (i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+        memset(&request, 0, sizeof(request));
+        request.nlh.nlmsg_len = sizeof(request);
+        request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+        request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.req.sdiag_family = families[i];
+        request.req.sdiag_protocol = proto;
+        request.req.idiag_states = ~0U;
+
+        if (sendto(fd, &request, sizeof(request), 0, (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+            close(fd);
+            return (-1);
+        }
+
+        for (done = 0; !done;) {
+            if (length = recv(fd, buffer, sizeof(buffer), 0), length <= 0) {
+                close(fd);
+                return (-1);
+            }
+
+            for (nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, length); nlh = NLMSG_NEXT(nlh, length)) {
+                if (nlh->nlmsg_type == NLMSG_DONE) {
+                    done = 1;
+                    break;
+                }
+
+                /* E.g. no UDP support for sock_diag in the kernel */
+                if (nlh->nlmsg_type == NLMSG_ERROR) {
+                    close(fd);
+                    return (-1);
+                }
+
+                msg = (struct inet_diag_msg *)NLMSG_DATA(nlh);
+                ports[ntohs(msg->id.idiag_sport)] = 1;
+            }
+        }
+    }
+
+    close(fd);
+    return (0);
+}
+#else
+static int diag_ports(__attribute__((unused)) int proto, __attribute__((unused)) char *ports)
+{
+    return (-1);
+}
+#endif
+
+static void get_port_view(int proto, port_view *view)
+{
+    memset(view, 0, sizeof(port_view));
+    view->has_netstat = run_netstat(proto, view->netstat) == 0;
+    view->has_diag = diag_ports(proto, view->diag) == 0;
+}
+
+/* The port is in use but some view does not show it */
+static int port_hidden(const port_view *view, int port)
+{
+    return (view->has_netstat && !view->netstat[port]) || (view->has_diag && !view->diag[port]);
 }
 
 static int conn_port(int proto, int port)
@@ -91,42 +233,49 @@ static int conn_port(int proto, int port)
     return (rc);
 }
 
+/* Probe every port, compare with the views taken before, and check again
+ * the ports missing from them against new views, in case they just closed.
+ */
 static void test_ports(int proto, int *_errors, int *_total)
 {
+    port_view *view;
+    int *suspects;
+    int count = 0;
     int i;
 
+    os_calloc(1, sizeof(port_view), view);
+    os_malloc((65535 + 1) * sizeof(int), suspects);
+
+    get_port_view(proto, view);
+
     for (i = 0; i <= 65535; i++) {
         (*_total)++;
-        if (conn_port(proto, i)) {
-            /* Check if we can find it using netstat. If not,
-             * check again to see if the port is still being used.
-             */
-            if (run_netstat(proto, i)) {
-                continue;
-            }
+        if (conn_port(proto, i) && port_hidden(view, i)) {
+            suspects[count++] = i;
+        }
+    }
 
+    if (count > 0) {
 #ifdef OSSECHIDS
-            /* If we are in the context of OSSEC-HIDS, sleep here (no rush) */
-#ifdef WIN32
-        Sleep(rootcheck.tsleep);
-#else
+        /* If we are in the context of OSSEC-HIDS, sleep here (no rush) */
         struct timeval timeout = {0, rootcheck.tsleep * 1000};
         select(0, NULL, NULL, NULL, &timeout);
 #endif
-#endif
+        get_port_view(proto, view);
+    }
 
-            if (!run_netstat(proto, i) && conn_port(proto, i)) {
-                char op_msg[OS_SIZE_1024 + 1];
+    for (i = 0; i < count; i++) {
+        if (port_hidden(view, suspects[i]) && conn_port(proto, suspects[i])) {
+            char op_msg[OS_SIZE_1024 + 1];
 
-                (*_errors)++;
+            (*_errors)++;
 
-                snprintf(op_msg, OS_SIZE_1024, "Port '%d'(%s) hidden. "
-                         "Kernel-level rootkit or trojaned "
-                         "version of netstat.", i,
-                         (proto == IPPROTO_UDP) ? "udp" : "tcp");
+            snprintf(op_msg, OS_SIZE_1024, "Port '%d'(%s) hidden. "
+                     "Kernel-level rootkit or trojaned "
+                     "version of netstat.", suspects[i],
+                     (proto == IPPROTO_UDP) ? "udp" : "tcp");
 
-                notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
-            }
+            notify_rk(ALERT_ROOTKIT_FOUND, op_msg);
         }
 
         if ((*_errors) > 20) {
@@ -137,10 +286,12 @@ static void test_ports(int proto, int *_errors, int *_total)
                      "something really bad is going on.",
                      (proto == IPPROTO_UDP) ? "udp" : "tcp" );
             notify_rk(ALERT_SYSTEM_CRIT, op_msg);
-            return;
+            break;
         }
     }
 
+    os_free(suspects);
+    os_free(view);
 }
 
 void check_rc_ports()
@@ -12,8 +12,177 @@
 #include "rootcheck.h"
 
 
+/* A binary named by rootkit_trojans, with the regexes to look for in it.
+ * Results are kept until the next scan, and reused if the binary is the same.
+ */
+typedef struct trojan_target {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    off_t size;
+    char **regexes;
+    char *matched;
+    char *known;                // Result already known, no need to scan
+    int count;
+} trojan_target;
+
+/* Binaries with a regex not known yet, shared by the scan threads */
+typedef struct trojan_jobs {
+    trojan_target **targets;
+    int count;
+    int next;
+} trojan_jobs;
+
+/* Targets of the last scan, by path */
+static OSHash *trojan_cache;
+
+static void trojan_target_free(void *data)
+{
+    trojan_target *target = (trojan_target *)data;
+    int i;
+
+    for (i = 0; i < target->count; i++) {
+        os_free(target->regexes[i]);
+    }
+
+    os_free(target->regexes);
+    os_free(target->matched);
+    os_free(target->known);
+    os_free(target->path);
+    os_free(target);
+}
+
+/* Index of a regex in a target, adding it if it's new */
+static int trojan_target_regex(trojan_target *target, const char *regex)
+{
+    int i;
+
+    for (i = 0; i < target->count; i++) {
+        if (strcmp(target->regexes[i], regex) == 0) {
+            return i;
+        }
+    }
+
+    os_realloc(target->regexes, (target->count + 1) * sizeof(char *), target->regexes);
+    os_realloc(target->matched, target->count + 1, target->matched);
+    os_realloc(target->known, target->count + 1, target->known);
+    os_strdup(regex, target->regexes[target->count]);
+    target->matched[target->count] = 0;
+    target->known[target->count] = 0;
+
+    return target->count++;
+}
+
+/* Take the results of the last scan if the binary did not change */
+static void trojan_target_reuse(trojan_target *target)
+{
+    trojan_target *last;
+    int i;
+    int j;
+
+    if (!trojan_cache || (last = OSHash_Get(trojan_cache, target->path), !last)) {
+        return;
+    }
+
+    if (last->dev != target->dev || last->ino != target->ino ||
+            last->mtime != target->mtime || last->size != target->size) {
+        return;
+    }
+
+    for (i = 0; i < target->count; i++) {
+        for (j = 0; j < last->count; j++) {
+            if (last->known[j] && strcmp(target->regexes[i], last->regexes[j]) == 0) {
+                target->matched[i] = last->matched[j];
+                target->known[i] = 1;
+                break;
+            }
+        }
+    }
+}
+
+/* Read the strings of a binary once for all its unknown regexes */
+static void trojan_target_scan(trojan_target *target)
+{
+    char **regexes;
+    char *matched;
+    int *index;
+    int count = 0;
+    int i;
+
+    os_malloc(target->count * sizeof(char *), regexes);
+    os_malloc(target->count, matched);
+    os_malloc(target->count * sizeof(int), index);
+
+    for (i = 0; i < target->count; i++) {
+        if (!target->known[i]) {
+            regexes[count] = target->regexes[i];
+            index[count++] = i;
+        }
+    }
+
+    if (count > 0 && os_string_scan(target->path, regexes, count, matched) >= 0) {
+        for (i = 0; i < count; i++) {
+            target->matched[index[i]] = matched[i];
+            target->known[index[i]] = 1;
+        }
+    }
+
+    os_free(regexes);
+    os_free(matched);
+    os_free(index);
+}
+
+static void * trojan_scan_worker(void *arg)
+{
+    trojan_jobs *jobs = (trojan_jobs *)arg;
+    int i;
+
+    while (i = __atomic_fetch_add(&jobs->next, 1, __ATOMIC_RELAXED), i < jobs->count) {
+        trojan_target_scan(jobs->targets[i]);
+    }
+
+    return NULL;
+}
+
+/* Scan the binaries on up to rootcheck.scan_threads threads */
+static void trojan_scan(trojan_jobs *jobs)
+{
+    pthread_t *threads;
+    int nthreads = rootcheck.scan_threads < jobs->count ? rootcheck.scan_threads : jobs->count;
+    int started = 0;
+    int i;
+
+    if (nthreads <= 1) {
+        trojan_scan_worker(jobs);
+        return;
+    }
+
+    os_calloc(nthreads, sizeof(pthread_t), threads);
+
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, trojan_scan_worker, jobs) == 0) {
+            started++;
+        } else {
+            mterror(ARGV0, THREAD_ERROR);
+            break;
+        }
+    }
+
+    /* Whatever is left if some thread could not start */
+    trojan_scan_worker(jobs);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    os_free(threads);
+}
+
 /* Read the file pointer specified (rootkit_trojans)
- * and check if any trojan entry is in the configured files
+ * and check if any trojan entry is in the configured files.
+ * Each binary is read once for all its entries, in parallel, and not read
+ * again while its inode, size and modification time stay the same.
  */
 void check_rc_trojans(const char *basedir, FILE *fp)
 {
@@ -22,6 +191,13 @@ void check_rc_trojans(const char *basedir, FILE *fp)
     char file_path[OS_SIZE_1024 + 1];
     char *file;
     char *string_to_look;
+    char **entries = NULL;
+    int entry_count = 0;
+    int e;
+    trojan_jobs jobs = { NULL, 0, 0 };
+    trojan_target *target;
+    struct stat statbuf;
+    OSHash *targets;
 
 #ifndef WIN32
     const char *(all_paths[]) = {"bin", "sbin", "usr/bin", "usr/sbin", NULL};
@@ -31,11 +207,19 @@ void check_rc_trojans(const char *basedir, FILE *fp)
 
     mtdebug1(ARGV0, "Starting on check_rc_trojans");
 
+    if (targets = OSHash_Create(), !targets) {
+        mterror(ARGV0, "At check_rc_trojans(): OSHash_Create()");
+        return;
+    }
+
+    OSHash_SetFreeDataPointer(targets, trojan_target_free);
+
+    /* Collect the entries, as file, regex and message separated by NULs */
     while (fgets(buf, OS_SIZE_1024, fp) != NULL) {
         char *nbuf;
         char *message = NULL;
+        size_t file_len, regex_len, message_len;
 
-        i = 0;
         /* Remove end of line */
         nbuf = strchr(buf, '\n');
         if (nbuf) {
@@ -74,10 +258,73 @@ void check_rc_trojans(const char *basedir, FILE *fp)
             continue;
         }
 
-        _total++;
+        file_len = strlen(file) + 1;
+        regex_len = strlen(string_to_look) + 1;
+        message_len = strlen(message) + 1;
+
+        os_realloc(entries, (entry_count + 1) * sizeof(char *), entries);
+        os_malloc(file_len + regex_len + message_len, entries[entry_count]);
+        memcpy(entries[entry_count], file, file_len);
+        memcpy(entries[entry_count] + file_len, string_to_look, regex_len);
+        memcpy(entries[entry_count] + file_len + regex_len, message, message_len);
+        entry_count++;
+    }
+
+    /* Group the regexes by binary */
+    for (e = 0; e < entry_count; e++) {
+        file = entries[e];
+        string_to_look = file + strlen(file) + 1;
 
         /* Try with all possible paths */
-        while (all_paths[i] != NULL) {
+        for (i = 0; all_paths[i] != NULL; i++) {
+            if (*file != PATH_SEP) {
+                snprintf(file_path, OS_SIZE_1024, "%s%c%s%c%s", basedir, PATH_SEP,
+                         all_paths[i], PATH_SEP,
+                         file);
+            } else {
+                strncpy(file_path, file, OS_SIZE_1024);
+                file_path[OS_SIZE_1024 - 1] = '\0';
+            }
+
+            if (target = OSHash_Get(targets, file_path), !target && is_file(file_path) && stat(file_path, &statbuf) == 0) {
+                os_calloc(1, sizeof(trojan_target), target);
+                os_strdup(file_path, target->path);
+                target->dev = statbuf.st_dev;
+                target->ino = statbuf.st_ino;
+                target->mtime = statbuf.st_mtime;
+                target->size = statbuf.st_size;
+                OSHash_Add(targets, file_path, target);
+
+                os_realloc(jobs.targets, (jobs.count + 1) * sizeof(trojan_target *), jobs.targets);
+                jobs.targets[jobs.count++] = target;
+            }
+
+            if (target) {
+                trojan_target_regex(target, string_to_look);
+            }
+
+            if (*file == '/') {
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < jobs.count; i++) {
+        trojan_target_reuse(jobs.targets[i]);
+    }
+
+    trojan_scan(&jobs);
+
+    /* Report in the order of the entries */
+    for (e = 0; e < entry_count; e++) {
+        char *message;
+
+        file = entries[e];
+        string_to_look = file + strlen(file) + 1;
+        message = string_to_look + strlen(string_to_look) + 1;
+        _total++;
+
+        for (i = 0; all_paths[i] != NULL; i++) {
             if (*file != PATH_SEP) {
                 snprintf(file_path, OS_SIZE_1024, "%s%c%s%c%s", basedir, PATH_SEP,
                          all_paths[i], PATH_SEP,
@@ -88,7 +335,7 @@ void check_rc_trojans(const char *basedir, FILE *fp)
             }
 
             /* Check if entry is found */
-            if (is_file(file_path) && os_string(file_path, string_to_look)) {
+            if (target = OSHash_Get(targets, file_path), target && target->matched[trojan_target_regex(target, string_to_look)]) {
                 char op_msg[OS_SIZE_2048];
                 _errors = 1;
 
@@ -105,9 +352,7 @@ void check_rc_trojans(const char *basedir, FILE *fp)
             if (*file == '/') {
                 break;
             }
-            i++;
         }
-        continue;
     }
 
     if (_errors == 0) {
@@ -116,4 +361,18 @@ void check_rc_trojans(const char *basedir, FILE *fp)
                  "Analyzed %d files.", _total);
         notify_rk(ALERT_OK, op_msg);
     }
+
+    /* Keep the results for the next scan */
+    if (trojan_cache) {
+        OSHash_Free(trojan_cache);
+    }
+
+    trojan_cache = targets;
+
+    for (e = 0; e < entry_count; e++) {
+        os_free(entries[e]);
+    }
+
+    os_free(entries);
+    os_free(jobs.targets);
 }
@@ -141,35 +141,76 @@ typedef struct _os_strings {
 /* Read each character from a binary file */
 int os_getch(os_strings *oss);
 
+int os_string_scan(char *file, char **regexes, int count, char *matched);
+
 
 /* List the strings of a binary and check if the regex given is there */
 int os_string(char *file, char *regex)
 {
-    int ch, cnt;
+    char matched = 0;
+
+    if (!file || !regex) {
+        return (0);
+    }
+
+    return (os_string_scan(file, &regex, 1, &matched) > 0);
+}
+
+/* List the strings of a binary once, checking all the regexes given */
+int os_string_scan(char *file, char **regexes, int count, char *matched)
+{
+    int ch, cnt, i;
+    int pending = 0;
+    int found = 0;
     unsigned char *C;
     unsigned char *bfr;
     char line[OS_SIZE_1024 + 1];
     char *buf;
     EXEC *head = NULL;
     os_strings oss;
+    regex_t *preg;
+    char *compiled;
 
-    /* Return didn't match */
-    if (!file || !regex) {
-        return (0);
+    if (!file || !regexes || count <= 0) {
+        return (-1);
     }
 
     /* Allocate the buffer */
     bfr = (unsigned char *) calloc(STR_MINLEN + 2, sizeof(unsigned char));
     if (!bfr) {
         mterror(ARGV0, MEM_ERROR, errno, strerror(errno));
-        return (0);
+        return (-1);
     }
 
     /* Open the file */
     oss.fp = fopen(file, "r");
     if (!oss.fp) {
         free(bfr);
-        return (0);
+        return (-1);
+    }
+
+    /* Compile each regex once for all the strings */
+    preg = (regex_t *) calloc(count, sizeof(regex_t));
+    compiled = (char *) calloc(count, sizeof(char));
+    if (!preg || !compiled) {
+        mterror(ARGV0, MEM_ERROR, errno, strerror(errno));
+        free(preg);
+        free(compiled);
+        fclose(oss.fp);
+        free(bfr);
+        return (-1);
+    }
+
+    for (i = 0; i < count; i++) {
+        matched[i] = 0;
+
+        if (regcomp(&preg[i], regexes[i], REG_EXTENDED | REG_NOSUB) != 0) {
+            mterror(ARGV0, "Posix Regex compile error (%s).", regexes[i]);
+            continue;
+        }
+
+        compiled[i] = 1;
+        pending++;
     }
 
     /* Clean the line */
@@ -202,7 +243,7 @@ int os_string(char *file, char *regex)
     }
 
     /* Read the file and perform the regex comparison */
-    for (cnt = 0, C = bfr; (ch = os_getch(&oss)) != EOF;) {
+    for (cnt = 0, C = bfr; pending > 0 && (ch = os_getch(&oss)) != EOF;) {
         if (ISSTR(ch)) {
             if (!cnt) {
                 C = bfr;
@@ -229,23 +270,31 @@ int os_string(char *file, char *regex)
 
             *buf = '\0';
 
-            if (OS_PRegex(line, regex)) {
-                if (oss.fp) {
-                    fclose(oss.fp);
+            for (i = 0; i < count; i++) {
+                if (compiled[i] && !matched[i] && regexec(&preg[i], line, 0, NULL, 0) == 0) {
+                    matched[i] = 1;
+                    pending--;
+                    found++;
                 }
-                free(bfr);
-                return (1);
             }
         }
 
         cnt = 0;
     }
 
+    for (i = 0; i < count; i++) {
+        if (compiled[i]) {
+            regfree(&preg[i]);
+        }
+    }
+
+    free(preg);
+    free(compiled);
     if (oss.fp) {
         fclose(oss.fp);
     }
     free(bfr);
-    return (0);
+    return (found);
 }
 
 /* Get next character from wherever */
@@ -259,7 +308,7 @@ int os_getch(os_strings *oss)
         oss->head_len = 0;
     }
     if (oss->read_len == -1 || oss->read_len-- > 0) {
-        return (fgetc(oss->fp));
+        return (getc_unlocked(oss->fp));
     }
     return (EOF);
 }
@@ -269,4 +318,15 @@ int os_string(__attribute__((unused)) char *file, __attribute__((unused)) char *
 {
     return (0);
 }
+
+int os_string_scan(__attribute__((unused)) char *file, __attribute__((unused)) char **regexes, int count, char *matched)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        matched[i] = 0;
+    }
+
+    return (0);
+}
 #endif
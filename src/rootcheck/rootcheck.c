@@ -184,6 +184,8 @@ int rootcheck_init(int test_config)
 #endif
 
     rootcheck.tsleep = getDefine_Int("rootcheck", "sleep", 0, 1000);
+    rootcheck.pid_threads = getDefine_Int("rootcheck", "pid_threads", 0, 64);
+    rootcheck.scan_threads = getDefine_Int("rootcheck", "scan_threads", 1, 64);
 
     /* If testing config, exit here */
     if (test_config) {
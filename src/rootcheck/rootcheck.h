@@ -79,6 +79,12 @@ char *normalize_string(char *str);
  */
 int os_string(char *file, char *regex);
 
+/* Check several regexes reading the strings of a file once.
+ * matched[i] tells if regexes[i] was found. Returns the number of regexes
+ * found, or -1 if the file could not be read.
+ */
+int os_string_scan(char *file, char **regexes, int count, char *matched);
+
 /* Check for NTFS ADS (Windows only) */
 int os_check_ads(const char *full_path);
 
@@ -0,0 +1,154 @@
+/*
+ * Placement of thread groups on CPU sets
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+
+#ifdef __linux__
+
+#define NODE_CPULIST "/sys/devices/system/node/node%d/cpulist"
+
+/* Thread groups are laid out by the main thread at startup, so there is a single origin */
+static cpu_set_t affinity_origin;
+static int affinity_saved;
+
+static int cpulist_parse(const char * list, cpu_set_t * set) {
+    const char * c = list;
+    char * end;
+    long first;
+    long last;
+
+    CPU_ZERO(set);
+
+    while (*c != '\0') {
+        if (!isdigit((int)*c)) {
+            return -1;
+        }
+
+        first = last = strtol(c, &end, 10);
+
+        if (*end == '-') {
+            if (!isdigit((int)end[1])) {
+                return -1;
+            }
+
+            last = strtol(end + 1, &end, 10);
+        }
+
+        if (first > last || last >= CPU_SETSIZE) {
+            return -1;
+        }
+
+        for (; first <= last; first++) {
+            CPU_SET(first, set);
+        }
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+
+        c = end;
+    }
+
+    return CPU_COUNT(set) > 0 ? CPU_COUNT(set) : -1;
+}
+
+int w_cpuset_parse(const char * spec, cpu_set_t * set) {
+    char path[PATH_MAX];
+    char list[OS_SIZE_1024];
+    char * end;
+    long node;
+    FILE * fp;
+
+    if (strncmp(spec, "node:", 5) != 0) {
+        return cpulist_parse(spec, set);
+    }
+
+    if (node = strtol(spec + 5, &end, 10), end == spec + 5 || *end != '\0' || node < 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), NODE_CPULIST, (int)node);
+
+    if (fp = fopen(path, "r"), !fp) {
+        mdebug1("Cannot open '%s': %s (%d)", path, strerror(errno), errno);
+        return -1;
+    }
+
+    if (!fgets(list, sizeof(list), fp)) {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+
+    if (end = strchr(list, '\n'), end) {
+        *end = '\0';
+    }
+
+    return cpulist_parse(list, set);
+}
+
+void w_affinity_enter(const char * section, const char * group) {
+    char name[OS_SIZE_128];
+    char * spec;
+    cpu_set_t set;
+    int count;
+
+    snprintf(name, sizeof(name), "cpu_set_%s", group);
+    spec = getDefine_String(section, name);
+
+    if (*spec == '\0') {
+        free(spec);
+        return;
+    }
+
+    if (count = w_cpuset_parse(spec, &set), count < 0) {
+        mwarn("Invalid CPU set '%s' for the %s threads. They won't be pinned.", spec, group);
+        free(spec);
+        return;
+    }
+
+    if (!affinity_saved) {
+        if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &affinity_origin) != 0) {
+            merror("Cannot get the CPU affinity of the thread.");
+            free(spec);
+            return;
+        }
+
+        affinity_saved = 1;
+    }
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) != 0) {
+        mwarn("Cannot pin the %s threads to the CPU set '%s'.", group, spec);
+    } else {
+        mdebug1("Pinning the %s threads to %d CPUs (%s).", group, count, spec);
+    }
+
+    free(spec);
+}
+
+void w_affinity_leave(void) {
+    if (affinity_saved && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &affinity_origin) != 0) {
+        merror("Cannot restore the CPU affinity of the thread.");
+    }
+}
+
+#else
+
+void w_affinity_enter(__attribute__((unused)) const char * section, __attribute__((unused)) const char * group) {
+}
+
+void w_affinity_leave(void) {
+}
+
+#endif /* __linux__ */
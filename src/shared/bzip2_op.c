@@ -136,3 +136,137 @@ int bzip2_uncompress(const char *filebz2, const char *file) {
     BZ2_bzReadClose(&bzerror, compressfile);
     return 0;
 }
+
+bzip2_file * bzip2_open(const char *file) {
+    bzip2_file *bzfile;
+    int bzerror;
+
+    if (!file) {
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(bzip2_file), bzfile);
+
+    if (bzfile->fp = fopen(file, "rb"), !bzfile->fp) {
+        mdebug2(FOPEN_ERROR, file, errno, strerror(errno));
+        free(bzfile);
+        return NULL;
+    }
+
+    bzfile->bz = BZ2_bzReadOpen(&bzerror, bzfile->fp, 0, 0, NULL, 0);
+    if (bzfile->bz == NULL || bzerror != BZ_OK) {
+        mdebug2("BZ2_bzReadOpen(%d)'%s': (%d)-%s",
+                bzerror, file, errno, strerror(errno));
+        fclose(bzfile->fp);
+        free(bzfile);
+        return NULL;
+    }
+
+    return bzfile;
+}
+
+/* Refill the buffer and return the number of bytes read, 0 at the end */
+static int bzip2_fill(bzip2_file *bzfile) {
+    int bzerror;
+
+    bzfile->offset = 0;
+    bzfile->length = 0;
+
+    if (bzfile->eof) {
+        return 0;
+    }
+
+    if (!bzfile->bz) {
+        bzfile->length = fread(bzfile->buffer, sizeof(char), sizeof(bzfile->buffer), bzfile->fp);
+
+        if (bzfile->length < (int)sizeof(bzfile->buffer)) {
+            bzfile->eof = 1;
+            bzfile->error = ferror(bzfile->fp) ? 1 : 0;
+        }
+
+        return bzfile->length;
+    }
+
+    bzfile->length = BZ2_bzRead(&bzerror, bzfile->bz, bzfile->buffer, sizeof(bzfile->buffer));
+
+    switch (bzerror) {
+    case BZ_OK:
+        break;
+    case BZ_STREAM_END:
+        bzfile->eof = 1;
+        break;
+    case BZ_DATA_ERROR_MAGIC:
+        if (!bzfile->started) {
+            // The file isn't compressed: read it from the beginning
+            BZ2_bzReadClose(&bzerror, bzfile->bz);
+            bzfile->bz = NULL;
+            rewind(bzfile->fp);
+            return bzip2_fill(bzfile);
+        }
+        // Fallthrough
+    default:
+        mdebug2("BZ2_bzRead(%d): (%d)-%s", bzerror, errno, strerror(errno));
+        bzfile->length = 0;
+        bzfile->eof = 1;
+        bzfile->error = 1;
+    }
+
+    bzfile->started = 1;
+    return bzfile->length;
+}
+
+char * bzip2_gets(char *str, int size, bzip2_file *bzfile) {
+    int n = 0;
+
+    while (n < size - 1) {
+        char *newline;
+        int length;
+
+        if (bzfile->offset == bzfile->length && !bzip2_fill(bzfile)) {
+            break;
+        }
+
+        length = bzfile->length - bzfile->offset;
+        if (length > size - 1 - n) {
+            length = size - 1 - n;
+        }
+
+        if (newline = memchr(bzfile->buffer + bzfile->offset, '\n', length), newline) {
+            length = newline - (bzfile->buffer + bzfile->offset) + 1;
+        }
+
+        memcpy(str + n, bzfile->buffer + bzfile->offset, length);
+        bzfile->offset += length;
+        n += length;
+
+        if (newline) {
+            break;
+        }
+    }
+
+    if (n == 0) {
+        return NULL;
+    }
+
+    str[n] = '\0';
+    return str;
+}
+
+int bzip2_close(bzip2_file *bzfile) {
+    int bzerror;
+    int retval;
+
+    if (!bzfile) {
+        return -1;
+    }
+
+    retval = bzfile->error ? -1 : 0;
+
+    if (bzfile->bz) {
+        BZ2_bzReadClose(&bzerror, bzfile->bz);
+    }
+
+    fclose(bzfile->fp);
+    free(bzfile);
+    return retval;
+}
@@ -13,95 +13,96 @@
 #include "../config/config.h"
 #include "../config/global-config.h"
 
-// Returns 1 if the node is a worker, 0 if it is not and -1 if error.
-int w_is_worker(void) {
+/* Cluster role and master node, read once from the configuration */
+static struct {
+    int loaded;
+    int is_worker;
+    char * master_node;
+} cluster_info;
+
+static pthread_mutex_t cluster_info_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Read the cluster settings from the configuration file.
+static void cluster_info_load(void) {
 
     OS_XML xml;
     const char * xmlf[] = {"ossec_config", "cluster", NULL};
     const char * xmlf2[] = {"ossec_config", "cluster", "node_type", NULL};
     const char * xmlf3[] = {"ossec_config", "cluster", "disabled", NULL};
+    const char * xmlf4[] = {"ossec_config", "cluster", "nodes", "node", NULL};
     const char *cfgfile = DEFAULTCPATH;
     int modules = 0;
-    int is_worker = 0;
     _Config cfg;
     memset(&cfg, 0, sizeof(_Config));
 
     modules |= CCLUSTER;
 
-    if (ReadConfig(modules, cfgfile, &cfg, NULL) < 0) {
-        return (OS_INVALID);
-    }
+    cluster_info.is_worker = ReadConfig(modules, cfgfile, &cfg, NULL) < 0 ? OS_INVALID : 0;
+    cluster_info.master_node = NULL;
 
     if (OS_ReadXML(cfgfile, &xml) < 0) {
         mdebug1(XML_ERROR, cfgfile, xml.err, xml.err_line);
     } else {
         char * cl_config = OS_GetOneContentforElement(&xml, xmlf);
-        if (cl_config && cl_config[0] != '\0') {
+
+        if (cluster_info.is_worker == 0 && cl_config && cl_config[0] != '\0') {
             char * cl_type = OS_GetOneContentforElement(&xml, xmlf2);
-                if (cl_type && cl_type[0] != '\0') {
-                    char * cl_status = OS_GetOneContentforElement(&xml, xmlf3);
-                    if(cl_status && cl_status[0] != '\0'){
-                	    if (!strcmp(cl_status, "no")) {
-                            if (!strcmp(cl_type, "client") || !strcmp(cl_type, "worker")) {
-                                is_worker = 1;
-                            } else {
-                                is_worker = 0;
-                            }
-                        } else {
-                            is_worker = 0;
-                        }
-                	} else {
-                        if (!strcmp(cl_type, "client") || !strcmp(cl_type, "worker")) {
-                            is_worker = 1;
-                        } else {
-                        	is_worker = 0;
-                        }
-                	}
-                    free(cl_status);
-                    free(cl_type);
+
+            if (cl_type && cl_type[0] != '\0') {
+                char * cl_status = OS_GetOneContentforElement(&xml, xmlf3);
+
+                // A cluster is enabled unless it says otherwise
+                if (!cl_status || cl_status[0] == '\0' || !strcmp(cl_status, "no")) {
+                    cluster_info.is_worker = !strcmp(cl_type, "client") || !strcmp(cl_type, "worker");
                 }
-            free(cl_config);
-        } else {
-            is_worker = 0;
+
+                free(cl_status);
+            }
+
+            free(cl_type);
         }
+
+        free(cl_config);
+        cluster_info.master_node = OS_GetOneContentforElement(&xml, xmlf4);
     }
+
     OS_ClearXML(&xml);
-    config_free(&cfg);
 
-    return is_worker;
+    if (!cluster_info.master_node) {
+        cluster_info.master_node = strdup("undefined");
+    }
+
+    config_free(&cfg);
+    cluster_info.loaded = 1;
 }
 
+// Returns 1 if the node is a worker, 0 if it is not and -1 if error.
+int w_is_worker(void) {
+    int is_worker;
 
-char *get_master_node(void) {
+    w_mutex_lock(&cluster_info_mutex);
 
-    OS_XML xml;
-    const char * xmlf[] = {"ossec_config", "cluster", "nodes", "node", NULL};
-    const char *cfgfile = DEFAULTCPATH;
-    _Config cfg;
-    int modules = 0;
-    char *master_node = NULL;
-    memset(&cfg, 0, sizeof(_Config));
+    if (!cluster_info.loaded) {
+        cluster_info_load();
+    }
 
-    modules |= CCLUSTER;
+    is_worker = cluster_info.is_worker;
+    w_mutex_unlock(&cluster_info_mutex);
 
-    if (ReadConfig(modules, cfgfile, &cfg, NULL) < 0) {
-        master_node = strdup("undefined");
-    }
+    return is_worker;
+}
 
-    if (OS_ReadXML(cfgfile, &xml) < 0) {
-        mdebug1(XML_ERROR, cfgfile, xml.err, xml.err_line);
-    } else {
-        os_free(master_node);
-        master_node = OS_GetOneContentforElement(&xml, xmlf);
-    }
+char *get_master_node(void) {
+    char *master_node;
 
-    OS_ClearXML(&xml);
+    w_mutex_lock(&cluster_info_mutex);
 
-    if (!master_node) {
-        master_node = strdup("undefined");
+    if (!cluster_info.loaded) {
+        cluster_info_load();
     }
 
-    config_free(&cfg);
+    master_node = strdup(cluster_info.master_node);
+    w_mutex_unlock(&cluster_info_mutex);
 
     return master_node;
 }
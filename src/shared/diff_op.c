@@ -0,0 +1,390 @@
+/*
+ * In-process line diff
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "../external/zlib/zlib.h"
+
+/* Bytes searched for a NUL to tell binary content, as diff(1) does */
+#define DIFF_BINARY_PROBE 8192
+
+/* Output of a difference */
+typedef struct diff_output_t {
+    char * buffer;
+    size_t size;
+    size_t length;
+    int truncated;
+} diff_output_t;
+
+/* FNV-1a */
+static uint32_t diff_hash(const char * data, size_t size) {
+    uint32_t hash = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+static void diff_text_index(w_diff_text_t * text) {
+    size_t allocated = 64;
+    size_t start = 0;
+    char * end;
+
+    os_malloc(allocated * sizeof(size_t), text->lines);
+    text->count = 0;
+
+    while (start < text->size) {
+        if (text->count + 1 >= allocated) {
+            allocated *= 2;
+            os_realloc(text->lines, allocated * sizeof(size_t), text->lines);
+        }
+
+        text->lines[text->count++] = start;
+        end = memchr(text->data + start, '\n', text->size - start);
+        start = end ? (size_t)(end - text->data) + 1 : text->size;
+    }
+
+    text->lines[text->count] = text->size;
+    os_malloc((text->count + 1) * sizeof(uint32_t), text->hashes);
+
+    for (start = 0; start < text->count; start++) {
+        text->hashes[start] = diff_hash(text->data + text->lines[start], text->lines[start + 1] - text->lines[start]);
+    }
+}
+
+int w_diff_text_load(w_diff_text_t * text, const char * path, size_t max_size) {
+    size_t allocated = OS_SIZE_8192;
+    gzFile gz_fd;
+    int length;
+
+    memset(text, 0, sizeof(w_diff_text_t));
+
+    /* gzread() reads plain files as they are */
+    if (gz_fd = gzopen(path, "rb"), !gz_fd) {
+        return -1;
+    }
+
+    os_malloc(allocated, text->data);
+
+    while (length = gzread(gz_fd, text->data + text->size, (unsigned)(allocated - text->size)), length > 0) {
+        text->size += (size_t)length;
+
+        if (text->size > max_size) {
+            gzclose(gz_fd);
+            w_diff_text_free(text);
+            return 1;
+        }
+
+        if (text->size == allocated) {
+            allocated *= 2;
+            os_realloc(text->data, allocated, text->data);
+        }
+    }
+
+    gzclose(gz_fd);
+
+    if (length < 0) {
+        w_diff_text_free(text);
+        return -1;
+    }
+
+    diff_text_index(text);
+    return 0;
+}
+
+void w_diff_text_set(w_diff_text_t * text, char * data, size_t size) {
+    memset(text, 0, sizeof(w_diff_text_t));
+    text->data = data;
+    text->size = size;
+    diff_text_index(text);
+}
+
+int w_diff_text_save(const w_diff_text_t * text, const char * path) {
+    size_t written = 0;
+    gzFile gz_fd;
+    unsigned chunk;
+
+    if (gz_fd = gzopen(path, "wb"), !gz_fd) {
+        return -1;
+    }
+
+    while (written < text->size) {
+        chunk = text->size - written < OS_SIZE_65536 ? (unsigned)(text->size - written) : OS_SIZE_65536;
+
+        if (gzwrite(gz_fd, text->data + written, chunk) != (int)chunk) {
+            gzclose(gz_fd);
+            return -1;
+        }
+
+        written += chunk;
+    }
+
+    return gzclose(gz_fd) == Z_OK ? 0 : -1;
+}
+
+void w_diff_text_free(w_diff_text_t * text) {
+    os_free(text->data);
+    os_free(text->lines);
+    os_free(text->hashes);
+    text->size = 0;
+    text->count = 0;
+}
+
+int w_diff_text_equal(const w_diff_text_t * a, const w_diff_text_t * b) {
+    return a->size == b->size && (a->size == 0 || memcmp(a->data, b->data, a->size) == 0);
+}
+
+static int diff_line_equal(const w_diff_text_t * a, size_t i, const w_diff_text_t * b, size_t j) {
+    size_t size = a->lines[i + 1] - a->lines[i];
+
+    return a->hashes[i] == b->hashes[j] && size == b->lines[j + 1] - b->lines[j] && memcmp(a->data + a->lines[i], b->data + b->lines[j], size) == 0;
+}
+
+static int diff_binary(const w_diff_text_t * text) {
+    return memchr(text->data, '\0', text->size < DIFF_BINARY_PROBE ? text->size : DIFF_BINARY_PROBE) != NULL;
+}
+
+/* Append a line to the output, only if it fits whole */
+static int diff_print(diff_output_t * output, const char * format, ...) {
+    va_list args;
+    int n;
+
+    if (output->truncated) {
+        return -1;
+    }
+
+    va_start(args, format);
+    n = vsnprintf(output->buffer + output->length, output->size - output->length, format, args);
+    va_end(args);
+
+    if (n < 0 || (size_t)n >= output->size - output->length) {
+        output->buffer[output->length] = '\0';
+        output->truncated = 1;
+        return -1;
+    }
+
+    output->length += (size_t)n;
+    return 0;
+}
+
+static void diff_print_range(char * buffer, size_t size, size_t first, size_t last) {
+    if (first == last) {
+        snprintf(buffer, size, "%zu", first);
+    } else {
+        snprintf(buffer, size, "%zu,%zu", first, last);
+    }
+}
+
+static void diff_print_lines(diff_output_t * output, const w_diff_text_t * text, size_t first, size_t last, const char * mark) {
+    size_t i;
+
+    for (i = first; i < last; i++) {
+        const char * line = text->data + text->lines[i];
+        size_t size = text->lines[i + 1] - text->lines[i];
+        int newline = size > 0 && line[size - 1] == '\n';
+
+        if (diff_print(output, "%s %.*s\n", mark, (int)(size - newline), line) < 0) {
+            return;
+        }
+
+        if (!newline && diff_print(output, "\\ No newline at end of file\n") < 0) {
+            return;
+        }
+    }
+}
+
+/* Print a hunk: lines [i, i_end) of the former text became lines [j, j_end) */
+static void diff_print_hunk(diff_output_t * output, const w_diff_text_t * old, size_t i, size_t i_end, const w_diff_text_t * new, size_t j, size_t j_end) {
+    char range_old[OS_SIZE_64];
+    char range_new[OS_SIZE_64];
+
+    diff_print_range(range_old, sizeof(range_old), i + 1, i_end);
+    diff_print_range(range_new, sizeof(range_new), j + 1, j_end);
+
+    if (j == j_end) {
+        diff_print(output, "%sd%zu\n", range_old, j);
+    } else if (i == i_end) {
+        diff_print(output, "%zua%s\n", i, range_new);
+    } else {
+        diff_print(output, "%sc%s\n", range_old, range_new);
+    }
+
+    diff_print_lines(output, old, i, i_end, "<");
+
+    if (i != i_end && j != j_end) {
+        diff_print(output, "---\n");
+    }
+
+    diff_print_lines(output, new, j, j_end, ">");
+}
+
+/*
+ * Mark the lines kept between [begin_a, begin_a + n) and [begin_b, begin_b + m),
+ * following the greedy algorithm of Myers. V[k] of each step d is stored at
+ * trace[d * d + k + d], so that the path can be walked back.
+ * Returns -1 if the texts need more than W_DIFF_MAX_EDITS edits.
+ */
+static int diff_myers(const w_diff_text_t * a, size_t begin_a, size_t n, const w_diff_text_t * b, size_t begin_b, size_t m, char * keep_a, char * keep_b) {
+    int * trace = NULL;
+    int * v;
+    int * v_prev;
+    int d;
+    int k;
+    int x;
+    int y;
+    int found = -1;
+
+    for (d = 0; d <= W_DIFF_MAX_EDITS && found < 0; d++) {
+        os_realloc(trace, (size_t)(d + 1) * (d + 1) * sizeof(int), trace);
+        v = trace + d * d + d;
+        v_prev = trace + (d - 1) * (d - 1) + (d - 1);
+
+        for (k = -d; k <= d; k += 2) {
+            if (d == 0) {
+                x = 0;
+            } else if (k == -d || (k != d && v_prev[k - 1] < v_prev[k + 1])) {
+                x = v_prev[k + 1];
+            } else {
+                x = v_prev[k - 1] + 1;
+            }
+
+            y = x - k;
+
+            while ((size_t)x < n && (size_t)y < m && diff_line_equal(a, begin_a + x, b, begin_b + y)) {
+                x++;
+                y++;
+            }
+
+            v[k] = x;
+
+            if ((size_t)x >= n && (size_t)y >= m) {
+                found = d;
+                break;
+            }
+        }
+    }
+
+    if (found < 0) {
+        os_free(trace);
+        return -1;
+    }
+
+    x = (int)n;
+    y = (int)m;
+
+    for (d = found; d > 0; d--) {
+        int prev_k;
+        int start_x;
+
+        v_prev = trace + (d - 1) * (d - 1) + (d - 1);
+        k = x - y;
+        prev_k = (k == -d || (k != d && v_prev[k - 1] < v_prev[k + 1])) ? k + 1 : k - 1;
+
+        /* The snake begins after the insertion (down) or the deletion (right) */
+        start_x = prev_k == k + 1 ? v_prev[prev_k] : v_prev[prev_k] + 1;
+
+        while (x > start_x) {
+            x--;
+            y--;
+            keep_a[x] = 1;
+            keep_b[y] = 1;
+        }
+
+        x = v_prev[prev_k];
+        y = x - prev_k;
+    }
+
+    while (x > 0 && y > 0) {
+        x--;
+        y--;
+        keep_a[x] = 1;
+        keep_b[y] = 1;
+    }
+
+    os_free(trace);
+    return found;
+}
+
+int w_diff_lines(const w_diff_text_t * old, const w_diff_text_t * new, char * buffer, size_t size) {
+    diff_output_t output = { buffer, size, 0, 0 };
+    size_t prefix = 0;
+    size_t suffix = 0;
+    size_t n;
+    size_t m;
+    size_t i = 0;
+    size_t j = 0;
+    size_t i_end;
+    size_t j_end;
+    char * keep_a;
+    char * keep_b;
+
+    if (size == 0) {
+        return 1;
+    }
+
+    buffer[0] = '\0';
+
+    if (w_diff_text_equal(old, new)) {
+        return 0;
+    }
+
+    if (diff_binary(old) || diff_binary(new)) {
+        diff_print(&output, "Binary files differ\n");
+        return output.truncated;
+    }
+
+    /* Lines in common at both ends need no search */
+    while (prefix < old->count && prefix < new->count && diff_line_equal(old, prefix, new, prefix)) {
+        prefix++;
+    }
+
+    while (suffix < old->count - prefix && suffix < new->count - prefix && diff_line_equal(old, old->count - suffix - 1, new, new->count - suffix - 1)) {
+        suffix++;
+    }
+
+    n = old->count - prefix - suffix;
+    m = new->count - prefix - suffix;
+
+    os_calloc(n + 1, sizeof(char), keep_a);
+    os_calloc(m + 1, sizeof(char), keep_b);
+
+    /* Beyond the maximum edits, the middle is reported as a single change */
+    diff_myers(old, prefix, n, new, prefix, m, keep_a, keep_b);
+
+    while (i < n || j < m) {
+        while (i < n && j < m && keep_a[i] && keep_b[j]) {
+            i++;
+            j++;
+        }
+
+        for (i_end = i; i_end < n && !keep_a[i_end]; i_end++);
+        for (j_end = j; j_end < m && !keep_b[j_end]; j_end++);
+
+        if (i_end == i && j_end == j) {
+            break;
+        }
+
+        diff_print_hunk(&output, old, prefix + i, prefix + i_end, new, prefix + j, prefix + j_end);
+
+        if (output.truncated) {
+            break;
+        }
+
+        i = i_end;
+        j = j_end;
+    }
+
+    os_free(keep_a);
+    os_free(keep_b);
+    return output.truncated;
+}
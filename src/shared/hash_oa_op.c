@@ -0,0 +1,469 @@
+/*
+ * Open-addressing hash table
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 14, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+
+#define CTRL_EMPTY      0x80
+#define CTRL_DELETED    0xFE
+#define GROUP_LSBS      0x0101010101010101ULL
+#define GROUP_MSBS      0x8080808080808080ULL
+#define MIN_CAPACITY    16
+
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((uint8_t)((hash) & 0x7F))
+
+/* Multipliers for the hash mixing, odd and with balanced bits */
+static const uint64_t P0 = 0xa0761d6478bd642fULL;
+static const uint64_t P1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t P2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t P3 = 0x589965cc75374cc3ULL;
+
+static uint64_t w_mum(uint64_t a, uint64_t b);
+static int oa_find(const OSHashOATable * table, const char * key, uint64_t hash);
+static unsigned int oa_find_free(const OSHashOATable * table, uint64_t hash);
+static int oa_insert(OSHashOATable * table, const char * key, uint64_t hash, void * data, int update);
+static void oa_rehash(OSHashOATable * table, unsigned int capacity);
+static OSHashOATable * oa_table(const OSHashOA * self, uint64_t hash);
+
+/* Load of the control bytes of a group, byte i in bits 8i .. 8i+7 */
+static inline uint64_t group_load(const uint8_t * ctrl) {
+    uint64_t group;
+
+    memcpy(&group, ctrl, sizeof(group));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+/* Bit 7 of each byte equal to h2. There may be false positives, never false negatives */
+static inline uint64_t group_match(uint64_t group, uint8_t h2) {
+    uint64_t x = group ^ (GROUP_LSBS * h2);
+    return (x - GROUP_LSBS) & ~x & GROUP_MSBS;
+}
+
+static inline uint64_t group_match_empty(uint64_t group) {
+    return group & ~(group << 6) & GROUP_MSBS;
+}
+
+static inline uint64_t group_match_free(uint64_t group) {
+    return group & GROUP_MSBS;
+}
+
+static inline unsigned int group_next(uint64_t * mask) {
+    unsigned int i = __builtin_ctzll(*mask) >> 3;
+    *mask &= *mask - 1;
+    return i;
+}
+
+static inline uint64_t r8(const uint8_t * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t r4(const uint8_t * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+/* Word-at-a-time multiply-mix hash, after wyhash */
+uint64_t w_hash64(const void * key, size_t len, uint64_t seed) {
+    const uint8_t * p = key;
+    size_t i = len;
+    uint64_t a;
+    uint64_t b;
+
+    seed ^= w_mum(seed ^ P0, P1);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (r4(p) << 32) | r4(p + ((len >> 3) << 2));
+            b = (r4(p + len - 4) << 32) | r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        if (i > 48) {
+            uint64_t s1 = seed;
+            uint64_t s2 = seed;
+
+            do {
+                seed = w_mum(r8(p) ^ P1, r8(p + 8) ^ seed);
+                s1 = w_mum(r8(p + 16) ^ P2, r8(p + 24) ^ s1);
+                s2 = w_mum(r8(p + 32) ^ P3, r8(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+
+            seed ^= s1 ^ s2;
+        }
+
+        while (i > 16) {
+            seed = w_mum(r8(p) ^ P1, r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        a = r8(p + i - 16);
+        b = r8(p + i - 8);
+    }
+
+    return w_mum(P1 ^ len, w_mum(a ^ P1, b ^ seed));
+}
+
+/* Fold of the 128-bit product */
+static uint64_t w_mum(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+
+    c += lo < t;
+    return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+OSHashOA * OSHashOA_Create(unsigned int n_stripes) {
+    OSHashOA * self;
+    unsigned int i;
+
+    os_calloc(1, sizeof(OSHashOA), self);
+    os_calloc(n_stripes ? n_stripes : 1, sizeof(OSHashOATable), self->tables);
+    self->n_stripes = n_stripes;
+    self->seed = ((uint64_t)(unsigned)os_random() << 32) | (unsigned)os_random();
+
+    for (i = 0; i < (n_stripes ? n_stripes : 1); i++) {
+        oa_rehash(&self->tables[i], MIN_CAPACITY);
+
+        if (n_stripes) {
+            w_rwlock_init(&self->tables[i].mutex, NULL);
+        }
+    }
+
+    return self;
+}
+
+void OSHashOA_Free(OSHashOA * self) {
+    unsigned int i;
+    unsigned int j;
+
+    if (!self) {
+        return;
+    }
+
+    for (i = 0; i < (self->n_stripes ? self->n_stripes : 1); i++) {
+        OSHashOATable * table = &self->tables[i];
+
+        for (j = 0; j < table->capacity; j++) {
+            if (!(table->ctrl[j] & CTRL_EMPTY)) {
+                free(table->slots[j].key);
+
+                if (table->slots[j].data && self->free_data_function) {
+                    self->free_data_function(table->slots[j].data);
+                }
+            }
+        }
+
+        free(table->ctrl);
+        free(table->slots);
+
+        if (self->n_stripes) {
+            pthread_rwlock_destroy(&table->mutex);
+        }
+    }
+
+    free(self->tables);
+    free(self);
+}
+
+void OSHashOA_SetFreeDataPointer(OSHashOA * self, void (*free_data_function)(void *)) {
+    self->free_data_function = free_data_function;
+}
+
+int OSHashOA_Add(OSHashOA * self, const char * key, void * data) {
+    uint64_t hash = w_hash64(key, strlen(key), self->seed);
+    OSHashOATable * table = oa_table(self, hash);
+    int result;
+
+    if (self->n_stripes) {
+        w_rwlock_wrlock(&table->mutex);
+    }
+
+    result = oa_insert(table, key, hash, data, 0);
+
+    if (self->n_stripes) {
+        w_rwlock_unlock(&table->mutex);
+    }
+
+    return result;
+}
+
+int OSHashOA_Set(OSHashOA * self, const char * key, void * data) {
+    uint64_t hash = w_hash64(key, strlen(key), self->seed);
+    OSHashOATable * table = oa_table(self, hash);
+    int result;
+
+    if (self->n_stripes) {
+        w_rwlock_wrlock(&table->mutex);
+    }
+
+    result = oa_insert(table, key, hash, data, 1);
+
+    if (self->n_stripes) {
+        w_rwlock_unlock(&table->mutex);
+    }
+
+    return result;
+}
+
+int OSHashOA_Update(OSHashOA * self, const char * key, void * data) {
+    uint64_t hash = w_hash64(key, strlen(key), self->seed);
+    OSHashOATable * table = oa_table(self, hash);
+    int i;
+
+    if (self->n_stripes) {
+        w_rwlock_wrlock(&table->mutex);
+    }
+
+    if (i = oa_find(table, key, hash), i >= 0) {
+        if (table->slots[i].data && self->free_data_function) {
+            self->free_data_function(table->slots[i].data);
+        }
+
+        table->slots[i].data = data;
+    }
+
+    if (self->n_stripes) {
+        w_rwlock_unlock(&table->mutex);
+    }
+
+    return i >= 0;
+}
+
+void * OSHashOA_Get(OSHashOA * self, const char * key) {
+    uint64_t hash = w_hash64(key, strlen(key), self->seed);
+    OSHashOATable * table = oa_table(self, hash);
+    void * data = NULL;
+    int i;
+
+    if (self->n_stripes) {
+        w_rwlock_rdlock(&table->mutex);
+    }
+
+    if (i = oa_find(table, key, hash), i >= 0) {
+        data = table->slots[i].data;
+    }
+
+    if (self->n_stripes) {
+        w_rwlock_unlock(&table->mutex);
+    }
+
+    return data;
+}
+
+void * OSHashOA_Delete(OSHashOA * self, const char * key) {
+    uint64_t hash = w_hash64(key, strlen(key), self->seed);
+    OSHashOATable * table = oa_table(self, hash);
+    void * data = NULL;
+    int i;
+
+    if (self->n_stripes) {
+        w_rwlock_wrlock(&table->mutex);
+    }
+
+    if (i = oa_find(table, key, hash), i >= 0) {
+        data = table->slots[i].data;
+        free(table->slots[i].key);
+        table->slots[i].key = NULL;
+
+        /* Probes may go through this slot: it can't be empty again until a rehash */
+        table->ctrl[i] = CTRL_DELETED;
+        table->elements--;
+    }
+
+    if (self->n_stripes) {
+        w_rwlock_unlock(&table->mutex);
+    }
+
+    return data;
+}
+
+unsigned int OSHashOA_Get_Elem(OSHashOA * self) {
+    unsigned int elements = 0;
+    unsigned int i;
+
+    for (i = 0; i < (self->n_stripes ? self->n_stripes : 1); i++) {
+        if (self->n_stripes) {
+            w_rwlock_rdlock(&self->tables[i].mutex);
+        }
+
+        elements += self->tables[i].elements;
+
+        if (self->n_stripes) {
+            w_rwlock_unlock(&self->tables[i].mutex);
+        }
+    }
+
+    return elements;
+}
+
+void OSHashOA_It(OSHashOA * self, void * arg, void (*iterating_function)(const char * key, void * data, void * arg)) {
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < (self->n_stripes ? self->n_stripes : 1); i++) {
+        OSHashOATable * table = &self->tables[i];
+
+        if (self->n_stripes) {
+            w_rwlock_rdlock(&table->mutex);
+        }
+
+        for (j = 0; j < table->capacity; j++) {
+            if (!(table->ctrl[j] & CTRL_EMPTY)) {
+                iterating_function(table->slots[j].key, table->slots[j].data, arg);
+            }
+        }
+
+        if (self->n_stripes) {
+            w_rwlock_unlock(&table->mutex);
+        }
+    }
+}
+
+/* The stripe is chosen with the top bits, the slot with the lower ones */
+static OSHashOATable * oa_table(const OSHashOA * self, uint64_t hash) {
+    return self->n_stripes ? &self->tables[(hash >> 56) % self->n_stripes] : self->tables;
+}
+
+/* Slot of a key, or -1 if not found */
+static int oa_find(const OSHashOATable * table, const char * key, uint64_t hash) {
+    unsigned int mask = table->capacity / OSHASHOA_GROUP - 1;
+    unsigned int group = H1(hash) & mask;
+    unsigned int step = 0;
+    uint8_t h2 = H2(hash);
+    uint64_t ctrl;
+    uint64_t match;
+    unsigned int i;
+
+    /* Triangular probing visits every group once */
+    while (1) {
+        ctrl = group_load(table->ctrl + group * OSHASHOA_GROUP);
+
+        for (match = group_match(ctrl, h2); match; ) {
+            i = group * OSHASHOA_GROUP + group_next(&match);
+
+            if (table->ctrl[i] == h2 && table->slots[i].hash == hash && strcmp(table->slots[i].key, key) == 0) {
+                return i;
+            }
+        }
+
+        if (group_match_empty(ctrl) || ++step > mask) {
+            return -1;
+        }
+
+        group = (group + step) & mask;
+    }
+}
+
+/* First empty or deleted slot in the probe sequence of a hash */
+static unsigned int oa_find_free(const OSHashOATable * table, uint64_t hash) {
+    unsigned int mask = table->capacity / OSHASHOA_GROUP - 1;
+    unsigned int group = H1(hash) & mask;
+    unsigned int step = 0;
+    uint64_t match;
+
+    /* There is always a free slot: the table never gets full */
+    while (match = group_match_free(group_load(table->ctrl + group * OSHASHOA_GROUP)), !match) {
+        group = (group + ++step) & mask;
+    }
+
+    return group * OSHASHOA_GROUP + group_next(&match);
+}
+
+static int oa_insert(OSHashOATable * table, const char * key, uint64_t hash, void * data, int update) {
+    unsigned int i;
+    int found;
+
+    if (found = oa_find(table, key, hash), found >= 0) {
+        if (update) {
+            table->slots[found].data = data;
+        }
+
+        return 1;
+    }
+
+    i = oa_find_free(table, hash);
+
+    if (table->ctrl[i] == CTRL_EMPTY && table->growth_left == 0) {
+        /* Grow if the keys take half of the usable slots, else just drop the deleted ones */
+        oa_rehash(table, table->elements >= (table->capacity - table->capacity / 8) / 2 ? table->capacity * 2 : table->capacity);
+        i = oa_find_free(table, hash);
+    }
+
+    if (table->slots[i].key = strdup(key), !table->slots[i].key) {
+        mdebug1("hash_op: strdup() failed!");
+        return 0;
+    }
+
+    if (table->ctrl[i] == CTRL_EMPTY) {
+        table->growth_left--;
+    }
+
+    table->ctrl[i] = H2(hash);
+    table->slots[i].hash = hash;
+    table->slots[i].data = data;
+    table->elements++;
+    return 2;
+}
+
+/* Move every key to a new array, leaving out the deleted slots */
+static void oa_rehash(OSHashOATable * table, unsigned int capacity) {
+    uint8_t * old_ctrl = table->ctrl;
+    OSHashOASlot * old_slots = table->slots;
+    unsigned int old_capacity = table->capacity;
+    unsigned int i;
+    unsigned int j;
+
+    os_malloc(capacity, table->ctrl);
+    os_calloc(capacity, sizeof(OSHashOASlot), table->slots);
+    memset(table->ctrl, CTRL_EMPTY, capacity);
+    table->capacity = capacity;
+
+    /* Up to 7/8 of the slots in use */
+    table->growth_left = capacity - capacity / 8 - table->elements;
+
+    for (i = 0; i < old_capacity; i++) {
+        if (!(old_ctrl[i] & CTRL_EMPTY)) {
+            j = oa_find_free(table, old_slots[i].hash);
+            table->ctrl[j] = old_ctrl[i];
+            table->slots[j] = old_slots[i];
+        }
+    }
+
+    free(old_ctrl);
+    free(old_slots);
+}
@@ -15,6 +15,10 @@
 static unsigned int _os_genhash(const OSHash *self, const char *key) __attribute__((nonnull));
 
 int _OSHash_Add(OSHash *self, const char *key, void *data, int update);
+static void _OSHash_Free_Retired(OSHashNode *node);
+
+/* Deleted nodes kept before waiting for a grace period */
+#define OSHASH_RCU_BATCH 64
 
 /* Create hash
  * Returns NULL on error
@@ -51,8 +55,8 @@ OSHash *OSHash_Create()
 
     /* Get seed */
     srandom((unsigned int)time(0));
-    self->initial_seed = os_getprime((unsigned)os_random() % self->rows);
-    self->constant = os_getprime((unsigned)os_random() % self->rows);
+    self->initial_seed = (unsigned int)os_random();
+    self->constant = (unsigned int)os_random();
     w_rwlock_init(&self->mutex, NULL);
     return (self);
 }
@@ -86,6 +90,8 @@ void *OSHash_Free(OSHash *self)
         i++;
     }
 
+    _OSHash_Free_Retired(self->retired);
+
     /* Free the hash table */
     free(self->table);
     pthread_rwlock_destroy(&self->mutex);
@@ -93,21 +99,30 @@ void *OSHash_Free(OSHash *self)
     return (NULL);
 }
 
+/* Free nodes once no reader can reach them */
+static void _OSHash_Free_Retired(OSHashNode *node)
+{
+    OSHashNode *next;
+
+    for (; node; node = next) {
+        next = node->prev;
+        free(node->key);
+        free(node);
+    }
+}
+
+void OSHash_SetRCU(OSHash *self)
+{
+    self->rcu = 1;
+}
+
 /* Generates hash for key */
 static unsigned int _os_genhash(const OSHash *self, const char *key)
 {
-    unsigned int hash_key = self->initial_seed;
-
-    /* What we have here is a simple polynomial hash.
-     * x0 * a^k-1 .. xk * a^k-k +1
-     */
-    while (*key) {
-        hash_key *= self->constant;
-        hash_key += (unsigned int) * key;
-        key++;
-    }
+    uint64_t hash = w_hash64(key, strlen(key), ((uint64_t)self->initial_seed << 32) | self->constant);
 
-    return (hash_key);
+    /* The index is taken modulo a prime, the fold keeps all the bits in play */
+    return (unsigned int)(hash ^ (hash >> 32));
 }
 
 /* Set new size for hash
@@ -123,6 +138,11 @@ int OSHash_setSize(OSHash *self, unsigned int new_size)
         return (1);
     }
 
+    /* Readers may be going through the table */
+    if (self->rcu) {
+        return (0);
+    }
+
     /* Get next prime */
     self->rows = os_getprime(new_size);
     if (self->rows == 0) {
@@ -157,10 +177,6 @@ int OSHash_setSize(OSHash *self, unsigned int new_size)
         self->table[i] = NULL;
     }
 
-    /* New seed */
-    self->initial_seed = os_getprime(456 % self->rows);
-    self->constant = os_getprime(789 % self->rows);
-
     return (1);
 }
 
@@ -199,7 +215,7 @@ int OSHash_Update(OSHash *self, const char *key, void *data)
             if (curr_node->data && self->free_data_function) {
                 self->free_data_function(curr_node->data);
             }
-            curr_node->data = data;
+            __atomic_store_n(&curr_node->data, data, __ATOMIC_RELEASE);
             return (1);
         }
         curr_node = curr_node->next;
@@ -262,7 +278,7 @@ int _OSHash_Add(OSHash *self, const char *key, void *data, int update)
         /* Checking for duplicated key */
         if (strcmp(curr_node->key, key) == 0) {
             if (update) {
-                 curr_node->data = data;
+                __atomic_store_n(&curr_node->data, data, __ATOMIC_RELEASE);
             }
             return (1);
         }
@@ -285,15 +301,15 @@ int _OSHash_Add(OSHash *self, const char *key, void *data, int update)
         return (0);
     }
 
-    /* Add to table */
+    /* Add to table. The node must be complete before readers can see it */
     if (!self->table[index]) {
-        self->table[index] = new_node;
+        __atomic_store_n(&self->table[index], new_node, __ATOMIC_RELEASE);
     }
     /* If there is duplicated, add to the beginning */
     else {
         new_node->next = self->table[index];
         self->table[index]->prev = new_node;
-        self->table[index] = new_node;
+        __atomic_store_n(&self->table[index], new_node, __ATOMIC_RELEASE);
     }
 
     self->elements = self->elements + 1;
@@ -424,6 +440,25 @@ void *OSHash_Numeric_Get_ex(const OSHash *self, int key)
 void *OSHash_Get_ex(const OSHash *self, const char *key)
 {
     void *result;
+
+    if (self->rcu) {
+        unsigned int index = _os_genhash(self, key) % self->rows;
+        const OSHashNode *curr_node;
+
+        result = NULL;
+        w_rcu_thread_read_lock();
+
+        for (curr_node = __atomic_load_n(&self->table[index], __ATOMIC_ACQUIRE); curr_node; curr_node = __atomic_load_n(&curr_node->next, __ATOMIC_ACQUIRE)) {
+            if (strcmp(curr_node->key, key) == 0) {
+                result = __atomic_load_n(&curr_node->data, __ATOMIC_ACQUIRE);
+                break;
+            }
+        }
+
+        w_rcu_thread_read_unlock();
+        return result;
+    }
+
     w_rwlock_rdlock((pthread_rwlock_t *)&self->mutex);
     result = OSHash_Get(self,key);
     w_rwlock_unlock((pthread_rwlock_t *)&self->mutex);
@@ -475,17 +510,25 @@ void *OSHash_Delete(OSHash *self, const char *key)
     while ( curr_node != NULL ) {
         if (strcmp(curr_node->key, key) == 0) {
             if ( prev_node == NULL ) {
-                self->table[index] = curr_node->next;
+                __atomic_store_n(&self->table[index], curr_node->next, __ATOMIC_RELEASE);
             } else {
-                prev_node->next = curr_node->next;
+                __atomic_store_n(&prev_node->next, curr_node->next, __ATOMIC_RELEASE);
             }
             if (curr_node->next) {
                 curr_node->next->prev = prev_node;
             }
-            free(curr_node->key);
             data = curr_node->data;
-            free(curr_node);
             self->elements = self->elements - 1;
+
+            if (self->rcu) {
+                /* Readers may still be on it: keep it with its next pointer */
+                curr_node->prev = self->retired;
+                self->retired = curr_node;
+                self->n_retired++;
+            } else {
+                free(curr_node->key);
+                free(curr_node);
+            }
             return data;
         }
         prev_node = curr_node;
@@ -509,11 +552,24 @@ void *OSHash_Numeric_Delete_ex(OSHash *self, int key)
 /* Return a pointer to a hash node if found, that hash node is removed from the table */
 void *OSHash_Delete_ex(OSHash *self, const char *key)
 {
+    OSHashNode *retired = NULL;
     void *result;
     w_rwlock_wrlock((pthread_rwlock_t *)&self->mutex);
     result = OSHash_Delete(self,key);
+
+    if (self->n_retired >= OSHASH_RCU_BATCH) {
+        retired = self->retired;
+        self->retired = NULL;
+        self->n_retired = 0;
+    }
+
     w_rwlock_unlock((pthread_rwlock_t *)&self->mutex);
 
+    if (retired) {
+        w_rcu_thread_synchronize();
+        _OSHash_Free_Retired(retired);
+    }
+
     return result;
 }
 
@@ -625,6 +681,8 @@ void *OSHash_Clean(OSHash *self, void (*cleaner)(void*)){
         } while (curr_node);
     }
 
+    _OSHash_Free_Retired(self->retired);
+
     /* Free the hash table */
     free(self->table);
     pthread_rwlock_destroy(&self->mutex);
@@ -0,0 +1,104 @@
+/*
+ * String interning
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+
+/* Shared copy, found from the string it holds */
+typedef struct intern_node_t {
+    unsigned int refs;
+    unsigned int stripe;
+    char str[];
+} intern_node_t;
+
+typedef struct intern_stripe_t {
+    pthread_mutex_t mutex;
+    OSHashOA * table;
+} intern_stripe_t;
+
+static intern_stripe_t intern_stripes[W_INTERN_STRIPES];
+static pthread_once_t intern_once = PTHREAD_ONCE_INIT;
+
+static void intern_init() {
+    int i;
+
+    for (i = 0; i < W_INTERN_STRIPES; i++) {
+        w_mutex_init(&intern_stripes[i].mutex, NULL);
+        intern_stripes[i].table = OSHashOA_Create(0);
+    }
+}
+
+const char * w_intern(const char * str) {
+    intern_stripe_t * stripe;
+    intern_node_t * node;
+    unsigned int index;
+    size_t length;
+
+    if (str == NULL) {
+        return NULL;
+    }
+
+    pthread_once(&intern_once, intern_init);
+
+    length = strlen(str);
+    index = (unsigned int)(w_hash64(str, length, 0) % W_INTERN_STRIPES);
+    stripe = &intern_stripes[index];
+
+    w_mutex_lock(&stripe->mutex);
+
+    if (node = OSHashOA_Get(stripe->table, str), node) {
+        node->refs++;
+    } else {
+        os_malloc(sizeof(intern_node_t) + length + 1, node);
+        node->refs = 1;
+        node->stripe = index;
+        memcpy(node->str, str, length + 1);
+        OSHashOA_Add(stripe->table, str, node);
+    }
+
+    w_mutex_unlock(&stripe->mutex);
+    return node->str;
+}
+
+void w_intern_release(const char * str) {
+    intern_stripe_t * stripe;
+    intern_node_t * node;
+
+    if (str == NULL) {
+        return;
+    }
+
+    node = (intern_node_t *)(str - offsetof(intern_node_t, str));
+    stripe = &intern_stripes[node->stripe];
+
+    w_mutex_lock(&stripe->mutex);
+
+    if (--node->refs == 0) {
+        OSHashOA_Delete(stripe->table, node->str);
+        free(node);
+    }
+
+    w_mutex_unlock(&stripe->mutex);
+}
+
+unsigned int w_intern_count() {
+    unsigned int count = 0;
+    int i;
+
+    pthread_once(&intern_once, intern_init);
+
+    for (i = 0; i < W_INTERN_STRIPES; i++) {
+        w_mutex_lock(&intern_stripes[i].mutex);
+        count += OSHashOA_Get_Elem(intern_stripes[i].table);
+        w_mutex_unlock(&intern_stripes[i].mutex);
+    }
+
+    return count;
+}
@@ -9,6 +9,16 @@
 
 #include "shared.h"
 
+static int jqueue_scan(const char * line, jqueue_fields_t * fields);
+
+#ifndef WIN32
+#define JQUEUE_WAIT 1000    /* Milliseconds to wait for an alert on the ring */
+
+static void jqueue_attach(file_queue * queue);
+static void jqueue_resume(file_queue * queue);
+static void jqueue_sync(file_queue * queue);
+#endif
+
 // Initializes queue. Equivalent to initialize every field to 0.
 void jqueue_init(file_queue * queue) {
     memset(queue, 0, sizeof(file_queue));
@@ -46,22 +56,66 @@ int jqueue_open(file_queue * queue, int tail) {
         return -1;
     }
 
+#ifndef WIN32
+    /* New alerts come from the ring of analysisd, if it publishes one */
+    if (tail && !queue->ring) {
+        jqueue_attach(queue);
+        queue->resync = 0;
+        queue->mark_id = queue->f_status.st_ino;
+        queue->mark_offset = ftell(queue->fp);
+    }
+#endif
+
     return 0;
 }
 
 /*
- * Return next JSON object from the queue, or NULL if it is not available.
+ * Read the next alert line into a buffer of OS_MAXSTR + 1 bytes.
+ * Returns 1 on success, or 0 if no alert is available.
  * If no more data is available and the inode has changed, queue is reloaded.
  */
-cJSON * jqueue_next(file_queue * queue) {
+static int jqueue_read(file_queue * queue, char * buffer) {
     struct stat buf;
-    char buffer[OS_MAXSTR + 1];
     char *end;
-    const char *jsonErrPtr;
+#ifndef WIN32
+    shm_bcast_origin_t origin;
+#endif
 
     if (!queue->fp && jqueue_open(queue, 1) < 0) {
-        return NULL;
+        return 0;
+    }
+
+#ifndef WIN32
+    if (queue->ring && !queue->resync) {
+        switch (shm_bcast_recv(queue->ring, buffer, OS_MAXSTR + 1, &origin, JQUEUE_WAIT)) {
+        case SHM_BCAST_EMPTY:
+            return 0;
+
+        case SHM_BCAST_LOST:
+            mwarn("Alerts ring overrun. Reading the alerts from '%s'.", queue->file_name);
+            jqueue_resume(queue);
+            shm_bcast_skip(queue->ring);
+            queue->resync = 1;
+            break;
+
+        case SHM_BCAST_CLOSED:
+            mdebug1("Alerts ring closed. Reading the alerts from '%s'.", queue->file_name);
+            jqueue_resume(queue);
+            shm_bcast_close(queue->ring);
+            queue->ring = NULL;
+            break;
+
+        default:
+            queue->mark_id = origin.file_id;
+            queue->mark_offset = origin.end;
+            return 1;
+        }
+
+        if (!queue->fp) {
+            return 0;
+        }
     }
+#endif
 
     clearerr(queue->fp);
 
@@ -70,14 +124,20 @@ cJSON * jqueue_next(file_queue * queue) {
             *end = '\0';
         }
 
-        return cJSON_ParseWithOpts(buffer, &jsonErrPtr, 0);
+#ifndef WIN32
+        if (queue->resync) {
+            jqueue_sync(queue);
+        }
+#endif
+
+        return 1;
     } else {
 
         if (stat(queue->file_name, &buf) < 0) {
             merror(FSTAT_ERROR, queue->file_name, errno, strerror(errno));
             fclose(queue->fp);
             queue->fp = NULL;
-            return NULL;
+            return 0;
         }
 
         // If the inode has changed, reopen and retry to open
@@ -86,7 +146,7 @@ cJSON * jqueue_next(file_queue * queue) {
             mdebug2("jqueue_next(): Alert file inode changed. Reloading.");
 
             if (jqueue_open(queue, 0) < 0) {
-                return NULL;
+                return 0;
             }
 
             if (fgets(buffer, OS_MAXSTR + 1, queue->fp)) {
@@ -94,19 +154,347 @@ cJSON * jqueue_next(file_queue * queue) {
                     *end = '\0';
                 }
 
-                return cJSON_ParseWithOpts(buffer, &jsonErrPtr, 0);
+#ifndef WIN32
+                if (queue->resync) {
+                    jqueue_sync(queue);
+                }
+#endif
+
+                return 1;
             } else {
-                return NULL;
+                return 0;
             }
         } else {
+#ifndef WIN32
+            if (!queue->ring) {
+                jqueue_attach(queue);
+            } else if (queue->resync) {
+                jqueue_sync(queue);
+            }
+
+            if (queue->ring && !queue->resync) {
+                return 0;
+            }
+#endif
             sleep(1);
-            return NULL;
+            return 0;
+        }
+    }
+}
+
+/*
+ * Return next JSON object from the queue, or NULL if it is not available.
+ * If no more data is available and the inode has changed, queue is reloaded.
+ */
+cJSON * jqueue_next(file_queue * queue) {
+    char buffer[OS_MAXSTR + 1];
+    const char *jsonErrPtr;
+
+    return jqueue_read(queue, buffer) ? cJSON_ParseWithOpts(buffer, &jsonErrPtr, 0) : NULL;
+}
+
+// Like jqueue_next(), but only the alerts that pass the filter are parsed
+cJSON * jqueue_next_filtered(file_queue * queue, jqueue_filter_t filter, void * arg) {
+    char buffer[OS_MAXSTR + 1];
+    const char *jsonErrPtr;
+    jqueue_fields_t fields;
+
+    while (jqueue_read(queue, buffer)) {
+        /* A line that can't be scanned wouldn't parse either */
+        if (jqueue_scan(buffer, &fields) == 0 && filter(&fields, arg)) {
+            return cJSON_ParseWithOpts(buffer, &jsonErrPtr, 0);
         }
     }
+
+    return NULL;
 }
 
 // Close queue
 void jqueue_close(file_queue * queue) {
     fclose(queue->fp);
     queue->fp = NULL;
+
+#ifndef WIN32
+    if (queue->ring) {
+        shm_bcast_close(queue->ring);
+        queue->ring = NULL;
+    }
+#endif
+}
+
+/* Pass a JSON string. Returns the character after it, or NULL. */
+static const char * jqueue_skip_string(const char * p) {
+    for (p++; *p != '"'; p++) {
+        if (*p == '\0' || (*p == '\\' && *++p == '\0')) {
+            return NULL;
+        }
+    }
+
+    return p + 1;
 }
+
+/* Pass any JSON value. Returns the character after it, or NULL. */
+static const char * jqueue_skip_value(const char * p) {
+    int depth = 0;
+
+    do {
+        switch (*p) {
+        case '"':
+            if (p = jqueue_skip_string(p), !p) {
+                return NULL;
+            }
+            continue;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if (--depth < 0) {
+                return NULL;
+            }
+            break;
+        case ',':
+            if (depth == 0) {
+                return NULL;
+            }
+            break;
+        case '\0':
+            return NULL;
+        }
+
+        p++;
+
+        /* A scalar ends where a separator starts */
+        if (depth == 0) {
+            while (*p && !strchr(",}] \t\r\n", *p)) {
+                p++;
+            }
+        }
+    } while (depth > 0);
+
+    return p;
+}
+
+static const char * jqueue_skip_ws(const char * p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+
+    return p;
+}
+
+/* Unescape a JSON string into a buffer, truncating it if needed */
+static void jqueue_copy_string(const char * p, const char * end, char * buffer, size_t size) {
+    size_t n = 0;
+
+    for (p++, end--; p < end && n + 2 < size; p++) {
+        if (*p == '\\') {
+            switch (*++p) {
+            case 'n':
+                buffer[n++] = '\n';
+                continue;
+            case 't':
+                buffer[n++] = '\t';
+                continue;
+            case 'r':
+                buffer[n++] = '\r';
+                continue;
+            case 'b':
+                buffer[n++] = '\b';
+                continue;
+            case 'f':
+                buffer[n++] = '\f';
+                continue;
+            case 'u':
+                /* Non-ASCII characters aren't needed to match a location: keep them escaped */
+                buffer[n++] = '\\';
+                break;
+            }
+        }
+
+        buffer[n++] = *p;
+    }
+
+    buffer[n] = '\0';
+}
+
+/* Walk the members of an object. Returns 0 on success or -1 if it's malformed. */
+static int jqueue_scan_object(const char * p, const char ** end, jqueue_fields_t * fields, int rule) {
+    const char * key;
+    const char * value;
+    size_t key_length;
+
+    if (p = jqueue_skip_ws(p), *p != '{') {
+        return -1;
+    }
+
+    for (p = jqueue_skip_ws(p + 1); *p != '}'; p = jqueue_skip_ws(p + 1)) {
+        key = p + 1;
+
+        if (*p != '"' || (p = jqueue_skip_string(p), !p)) {
+            return -1;
+        }
+
+        key_length = p - key - 1;
+
+        if (p = jqueue_skip_ws(p), *p != ':') {
+            return -1;
+        }
+
+        value = jqueue_skip_ws(p + 1);
+
+        if (!rule && key_length == 4 && !strncmp(key, "rule", 4) && *value == '{') {
+            fields->has_rule = 1;
+
+            if (jqueue_scan_object(value, &p, fields, 1) < 0) {
+                return -1;
+            }
+        } else {
+            if (p = jqueue_skip_value(value), !p) {
+                return -1;
+            }
+
+            if (rule && key_length == 5 && !strncmp(key, "level", 5)) {
+                fields->has_level = 1;
+                fields->level = strtoul(value, NULL, 10);
+            } else if (rule && key_length == 2 && !strncmp(key, "id", 2) && *value == '"') {
+                fields->has_rule_id = 1;
+                fields->rule_id = strtoul(value + 1, NULL, 10);
+            } else if (rule && key_length == 6 && !strncmp(key, "groups", 6) && *value == '[') {
+                fields->groups = value;
+                fields->groups_length = p - value;
+            } else if (!rule && key_length == 8 && !strncmp(key, "location", 8) && *value == '"') {
+                fields->has_location = 1;
+                jqueue_copy_string(value, p, fields->location, sizeof(fields->location));
+            }
+        }
+
+        if (p = jqueue_skip_ws(p), *p != ',') {
+            if (*p != '}') {
+                return -1;
+            }
+            break;
+        }
+    }
+
+    *end = p + 1;
+    return 0;
+}
+
+/* Take the fields of an alert without parsing it. Returns 0 on success or -1 if it's malformed. */
+static int jqueue_scan(const char * line, jqueue_fields_t * fields) {
+    const char * end;
+
+    fields->has_rule = 0;
+    fields->has_level = 0;
+    fields->has_rule_id = 0;
+    fields->groups = NULL;
+    fields->groups_length = 0;
+    fields->has_location = 0;
+    *fields->location = '\0';
+
+    return jqueue_scan_object(line, &end, fields, 0);
+}
+
+int jqueue_fields_group(const jqueue_fields_t * fields, const char * group, size_t length) {
+    const char * p;
+    const char * end;
+
+    if (!fields->groups) {
+        return 0;
+    }
+
+    /* Group names have no escapes, so they can be compared as they are written */
+    for (p = jqueue_skip_ws(fields->groups + 1); *p == '"'; p = jqueue_skip_ws(p + 1)) {
+        if (end = jqueue_skip_string(p), !end) {
+            return 0;
+        }
+
+        if ((size_t)(end - p - 2) == length && !strncmp(p + 1, group, length)) {
+            return 1;
+        }
+
+        if (p = jqueue_skip_ws(end), *p != ',') {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+#ifndef WIN32
+
+/* Attach to the ring. Until the file reaches the first alert of the ring, it's read from the file. */
+void jqueue_attach(file_queue * queue) {
+    if (queue->ring = shm_bcast_attach(isChroot() ? ALERTSQUEUE : DEFAULTDIR ALERTSQUEUE), queue->ring) {
+        mdebug1("Reading the alerts from the ring of analysisd.");
+        queue->resync = 1;
+    }
+}
+
+/* Read the file from the end of the last alert taken from the ring */
+void jqueue_resume(file_queue * queue) {
+    if (!queue->mark_id) {
+        return;
+    }
+
+    /* The log was rotated meanwhile: go on with the current one */
+    if (queue->mark_id != (uint64_t)queue->f_status.st_ino) {
+        if (jqueue_open(queue, 0) < 0 || queue->mark_id != (uint64_t)queue->f_status.st_ino) {
+            return;
+        }
+    }
+
+    if (fseek(queue->fp, queue->mark_offset, SEEK_SET) == -1) {
+        merror("Could not seek '%s': %s (%d)", queue->file_name, strerror(errno), errno);
+    }
+}
+
+/* Go back to the ring once the file is read up to its next alert */
+void jqueue_sync(file_queue * queue) {
+    char discard[OS_SIZE_128];
+    shm_bcast_origin_t origin;
+    long offset;
+    int result;
+
+    while (result = shm_bcast_peek(queue->ring, &origin), result == 1) {
+        /* The ring can't be matched with the file: take the alerts from there */
+        if (!origin.file_id || (offset = ftell(queue->fp), offset < 0)) {
+            break;
+        }
+
+        if (origin.file_id != (uint64_t)queue->f_status.st_ino || origin.start > (uint64_t)offset) {
+            return;
+        }
+
+        if (origin.start == (uint64_t)offset) {
+            queue->mark_id = origin.file_id;
+            queue->mark_offset = offset;
+            break;
+        }
+
+        /* Already read from the file */
+        if (shm_bcast_recv(queue->ring, discard, sizeof(discard), &origin, 0) <= 0) {
+            return;
+        }
+    }
+
+    if (result == SHM_BCAST_LOST) {
+        shm_bcast_skip(queue->ring);
+        return;
+    }
+
+    if (result == SHM_BCAST_CLOSED) {
+        shm_bcast_close(queue->ring);
+        queue->ring = NULL;
+        return;
+    }
+
+    if (result == 1) {
+        mdebug1("Alerts ring caught up with '%s'.", queue->file_name);
+        queue->resync = 0;
+    }
+}
+
+#endif /* WIN32 */
@@ -114,3 +114,364 @@ void json_strip(char * json) {
         }
     }
 }
+
+/* Scanner of JSON text, with the same grammar that cJSON_ParseWithOpts()
+ * accepts, but without building the tree.
+ */
+
+#define JSON_SCAN_DEPTH 1000
+
+static const char * json_scan_value(const char * p, unsigned int depth, json_member_cb member, void * arg);
+
+static const char * json_skip(const char * p) {
+    while (*p && (unsigned char)*p <= 32) {
+        p++;
+    }
+
+    return p;
+}
+
+static int json_hex4(const char * p, unsigned int * code) {
+    int i;
+
+    for (*code = 0, i = 0; i < 4; i++) {
+        char c = p[i];
+
+        if (c >= '0' && c <= '9') {
+            *code = (*code << 4) | (c - '0');
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            *code = (*code << 4) | ((c | 0x20) - 'a' + 10);
+        } else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// p points to the opening quote. Return the position after the closing quote
+static const char * json_scan_string(const char * p) {
+    unsigned int code;
+
+    for (p++; *p != '"'; p++) {
+        if (*p == '\0') {
+            return NULL;
+        }
+
+        if (*p == '\\') {
+            switch (*++p) {
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+            case '"':
+            case '\\':
+            case '/':
+                break;
+
+            case 'u':
+                if (json_hex4(p + 1, &code) < 0 || (code >= 0xDC00 && code <= 0xDFFF)) {
+                    return NULL;
+                }
+
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    // A high surrogate needs a low one
+                    if (p[5] != '\\' || p[6] != 'u' || json_hex4(p + 7, &code) < 0 || code < 0xDC00 || code > 0xDFFF) {
+                        return NULL;
+                    }
+
+                    p += 6;
+                }
+
+                p += 4;
+                break;
+
+            default:
+                return NULL;
+            }
+        }
+    }
+
+    return p + 1;
+}
+
+static const char * json_scan_number(const char * p) {
+    char number[64];
+    char * end;
+    size_t n = strspn(p, "0123456789+-eE.");
+
+    if (n >= sizeof(number)) {
+        n = sizeof(number) - 1;
+    }
+
+    memcpy(number, p, n);
+    number[n] = '\0';
+    strtod(number, &end);
+
+    return end == number ? NULL : p + (end - number);
+}
+
+static const char * json_scan_array(const char * p, unsigned int depth) {
+    if (p = json_skip(p + 1), *p == ']') {
+        return p + 1;
+    }
+
+    while (1) {
+        if (p = json_scan_value(json_skip(p), depth, NULL, NULL), !p) {
+            return NULL;
+        }
+
+        switch (*(p = json_skip(p))) {
+        case ',':
+            p++;
+            break;
+        case ']':
+            return p + 1;
+        default:
+            return NULL;
+        }
+    }
+}
+
+static const char * json_scan_object_members(const char * p, unsigned int depth, json_member_cb member, void * arg) {
+    const char * key;
+
+    if (p = json_skip(p + 1), *p == '}') {
+        return p + 1;
+    }
+
+    while (1) {
+        if (key = json_skip(p), *key != '"' || (p = json_scan_string(key), !p)) {
+            return NULL;
+        }
+
+        if (member) {
+            member(key + 1, p - key - 2, arg);
+        }
+
+        if (p = json_skip(p), *p != ':') {
+            return NULL;
+        }
+
+        if (p = json_scan_value(json_skip(p + 1), depth, NULL, NULL), !p) {
+            return NULL;
+        }
+
+        switch (*(p = json_skip(p))) {
+        case ',':
+            p++;
+            break;
+        case '}':
+            return p + 1;
+        default:
+            return NULL;
+        }
+    }
+}
+
+static const char * json_scan_value(const char * p, unsigned int depth, json_member_cb member, void * arg) {
+    switch (*p) {
+    case '{':
+        return depth < JSON_SCAN_DEPTH ? json_scan_object_members(p, depth + 1, member, arg) : NULL;
+    case '[':
+        return depth < JSON_SCAN_DEPTH ? json_scan_array(p, depth + 1) : NULL;
+    case '"':
+        return json_scan_string(p);
+    case 'n':
+        return strncmp(p, "null", 4) ? NULL : p + 4;
+    case 't':
+        return strncmp(p, "true", 4) ? NULL : p + 4;
+    case 'f':
+        return strncmp(p, "false", 5) ? NULL : p + 5;
+    default:
+        return (*p == '-' || (*p >= '0' && *p <= '9')) ? json_scan_number(p) : NULL;
+    }
+}
+
+// Check that a string starts with a JSON object, without parsing it into a tree
+const char * json_scan_object(const char * json, const char ** begin, json_member_cb member, void * arg) {
+    // Skip the UTF-8 BOM
+    if (strncmp(json, "\xEF\xBB\xBF", 3) == 0) {
+        json += 3;
+    }
+
+    if (json = json_skip(json), *json != '{') {
+        return NULL;
+    }
+
+    if (begin) {
+        *begin = json;
+    }
+
+    return json_scan_value(json, 0, member, arg);
+}
+
+// Find a member of the JSON object that starts a string, without parsing it into a tree
+const char * json_scan_member(const char * json, const char * key, size_t * length) {
+    size_t key_length = strlen(key);
+    const char * name;
+    const char * value;
+    const char * p;
+    int found;
+
+    // Skip the UTF-8 BOM
+    if (strncmp(json, "\xEF\xBB\xBF", 3) == 0) {
+        json += 3;
+    }
+
+    if (p = json_skip(json), *p != '{') {
+        return NULL;
+    }
+
+    if (p = json_skip(p + 1), *p == '}') {
+        return NULL;
+    }
+
+    while (1) {
+        if (name = json_skip(p), *name != '"' || (p = json_scan_string(name), !p)) {
+            return NULL;
+        }
+
+        found = (size_t)(p - name) == key_length + 2 && strncmp(name + 1, key, key_length) == 0;
+
+        if (p = json_skip(p), *p != ':') {
+            return NULL;
+        }
+
+        if (value = json_skip(p + 1), p = json_scan_value(value, 1, NULL, NULL), !p) {
+            return NULL;
+        }
+
+        if (found) {
+            *length = p - value;
+            return value;
+        }
+
+        if (p = json_skip(p), *p != ',') {
+            return NULL;
+        }
+
+        p++;
+    }
+}
+
+// Arena scopes for cJSON
+
+#define JSON_ARENA_BLOCK 65536
+#define JSON_ARENA_ALIGN 16
+
+typedef struct json_arena_block_t {
+    struct json_arena_block_t * next;
+    size_t size;
+    size_t used;
+    char * data;
+} json_arena_block_t;
+
+typedef struct json_arena_t {
+    json_arena_block_t * blocks;
+    unsigned int depth;
+} json_arena_t;
+
+static pthread_once_t json_arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t json_arena_key;
+static __thread json_arena_t * json_arena;
+
+static void json_arena_release(json_arena_t * arena, int keep) {
+    json_arena_block_t * block;
+
+    while (block = arena->blocks, block && (!keep || block->next)) {
+        arena->blocks = block->next;
+        free(block);
+    }
+
+    if (block) {
+        block->used = 0;
+    }
+}
+
+static void json_arena_destroy(void * arg) {
+    json_arena_release(arg, 0);
+    free(arg);
+}
+
+static void * json_arena_malloc(size_t size) {
+    json_arena_t * arena = json_arena;
+    json_arena_block_t * block;
+    void * ptr;
+
+    if (!arena || arena->depth == 0) {
+        return malloc(size);
+    }
+
+    // Every pointer must fall inside its block, even for empty allocations
+    size = size ? (size + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1) : JSON_ARENA_ALIGN;
+
+    if (block = arena->blocks, !block || block->size - block->used < size) {
+        // Big allocations get a block of their own, behind the current one
+        size_t block_size = size > JSON_ARENA_BLOCK / 4 ? size : JSON_ARENA_BLOCK;
+        size_t header = (sizeof(json_arena_block_t) + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+
+        if (block = malloc(header + block_size), !block) {
+            return NULL;
+        }
+
+        block->size = block_size;
+        block->used = 0;
+        block->data = (char *)block + header;
+
+        if (block_size > JSON_ARENA_BLOCK / 4 && arena->blocks) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+static void json_arena_free(void * ptr) {
+    json_arena_t * arena = json_arena;
+    json_arena_block_t * block;
+
+    // Memory of the arena is released when the scope is closed
+    if (ptr && arena && arena->depth > 0) {
+        for (block = arena->blocks; block; block = block->next) {
+            if ((char *)ptr >= block->data && (char *)ptr < block->data + block->size) {
+                return;
+            }
+        }
+    }
+
+    free(ptr);
+}
+
+static void json_arena_init(void) {
+    cJSON_Hooks hooks = { json_arena_malloc, json_arena_free };
+
+    pthread_key_create(&json_arena_key, json_arena_destroy);
+    cJSON_InitHooks(&hooks);
+}
+
+void json_arena_open(void) {
+    pthread_once(&json_arena_once, json_arena_init);
+
+    if (!json_arena) {
+        os_calloc(1, sizeof(json_arena_t), json_arena);
+        pthread_setspecific(json_arena_key, json_arena);
+    }
+
+    json_arena->depth++;
+}
+
+void json_arena_close(void) {
+    assert(json_arena != NULL && json_arena->depth > 0);
+
+    if (--json_arena->depth == 0) {
+        json_arena_release(json_arena, 1);
+    }
+}
@@ -0,0 +1,221 @@
+/*
+ * Streaming JSON writer
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * June 2, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "json_writer_op.h"
+
+#define JSON_WRITER_MIN_SIZE 4096
+
+/* Characters that cJSON escapes: quotes, backslashes and control codes */
+static const unsigned char json_escape[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+};
+
+/* Make room for n more bytes and the terminator */
+static inline void json_reserve(w_json_writer_t * writer, size_t n) {
+    if (writer->length + n + 1 > writer->size) {
+        size_t size = writer->size ? writer->size : JSON_WRITER_MIN_SIZE;
+
+        while (writer->length + n + 1 > size) {
+            size *= 2;
+        }
+
+        os_realloc(writer->buffer, size, writer->buffer);
+        writer->size = size;
+    }
+}
+
+static inline void json_put(w_json_writer_t * writer, const char * data, size_t n) {
+    json_reserve(writer, n);
+    memcpy(writer->buffer + writer->length, data, n);
+    writer->length += n;
+}
+
+static inline void json_putc(w_json_writer_t * writer, char c) {
+    json_reserve(writer, 1);
+    writer->buffer[writer->length++] = c;
+}
+
+/* Separate from the previous member, unless this is the first or a value */
+static inline void json_separate(w_json_writer_t * writer) {
+    if (writer->length > 0) {
+        switch (writer->buffer[writer->length - 1]) {
+        case '{':
+        case '[':
+        case ':':
+            break;
+        default:
+            json_putc(writer, ',');
+        }
+    }
+}
+
+static void json_put_string(w_json_writer_t * writer, const char * str, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char * p = (const unsigned char *)str;
+    const unsigned char * end = p + n;
+
+    /* Room for the usual case, where nothing has to be escaped */
+    json_reserve(writer, n + 2);
+    writer->buffer[writer->length++] = '"';
+
+    while (p < end) {
+        const unsigned char * run = p;
+
+        while (p < end && !json_escape[*p]) {
+            p++;
+        }
+
+        if (p > run) {
+            json_put(writer, (const char *)run, (size_t)(p - run));
+        }
+
+        if (p == end) {
+            break;
+        }
+
+        switch (*p) {
+        case '"':
+            json_put(writer, "\\\"", 2);
+            break;
+        case '\\':
+            json_put(writer, "\\\\", 2);
+            break;
+        case '\b':
+            json_put(writer, "\\b", 2);
+            break;
+        case '\f':
+            json_put(writer, "\\f", 2);
+            break;
+        case '\n':
+            json_put(writer, "\\n", 2);
+            break;
+        case '\r':
+            json_put(writer, "\\r", 2);
+            break;
+        case '\t':
+            json_put(writer, "\\t", 2);
+            break;
+        default: {
+            char code[6] = { '\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 0xf] };
+            json_put(writer, code, sizeof(code));
+        }
+        }
+
+        p++;
+    }
+
+    json_putc(writer, '"');
+}
+
+static inline void json_put_key(w_json_writer_t * writer, const char * key) {
+    json_separate(writer);
+
+    if (key) {
+        json_put_string(writer, key, strlen(key));
+        json_putc(writer, ':');
+    }
+}
+
+void w_json_writer_reset(w_json_writer_t * writer) {
+    writer->length = 0;
+}
+
+void w_json_writer_free(w_json_writer_t * writer) {
+    os_free(writer->buffer);
+    writer->length = 0;
+    writer->size = 0;
+}
+
+const char * w_json_writer_str(w_json_writer_t * writer) {
+    json_reserve(writer, 0);
+    writer->buffer[writer->length] = '\0';
+    return writer->buffer;
+}
+
+void w_json_open_object(w_json_writer_t * writer, const char * key) {
+    json_put_key(writer, key);
+    json_putc(writer, '{');
+}
+
+void w_json_open_array(w_json_writer_t * writer, const char * key) {
+    json_put_key(writer, key);
+    json_putc(writer, '[');
+}
+
+void w_json_close_object(w_json_writer_t * writer) {
+    json_putc(writer, '}');
+}
+
+void w_json_close_array(w_json_writer_t * writer) {
+    json_putc(writer, ']');
+}
+
+int w_json_drop_empty(w_json_writer_t * writer, size_t mark) {
+    switch (writer->buffer[writer->length - 1]) {
+    case '{':
+    case '[':
+        writer->length = mark;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void w_json_add_string(w_json_writer_t * writer, const char * key, const char * value) {
+    if (value) {
+        json_put_key(writer, key);
+        json_put_string(writer, value, strlen(value));
+    }
+}
+
+void w_json_add_string_n(w_json_writer_t * writer, const char * key, const char * value, size_t length) {
+    json_put_key(writer, key);
+    json_put_string(writer, value, length);
+}
+
+void w_json_add_key_n(w_json_writer_t * writer, const char * key, size_t length) {
+    json_separate(writer);
+    json_put_string(writer, key, length);
+    json_putc(writer, ':');
+}
+
+void w_json_add_number(w_json_writer_t * writer, const char * key, long long value) {
+    char number[24];
+    int n = snprintf(number, sizeof(number), "%lld", value);
+
+    json_put_key(writer, key);
+    json_put(writer, number, (size_t)n);
+}
+
+void w_json_add_raw(w_json_writer_t * writer, const char * key, const char * json) {
+    json_put_key(writer, key);
+    json_put(writer, json, strlen(json));
+}
+
+void w_json_add_bool(w_json_writer_t * writer, const char * key, int value) {
+    json_put_key(writer, key);
+
+    if (value) {
+        json_put(writer, "true", 4);
+    } else {
+        json_put(writer, "false", 5);
+    }
+}
+
+void w_json_put_n(w_json_writer_t * writer, const char * json, size_t length) {
+    json_put(writer, json, length);
+}
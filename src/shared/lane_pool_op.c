@@ -0,0 +1,155 @@
+/*
+ * Elastic pool of workers over several queues
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+
+// Upper bound of a sleep, in case a wake-up is lost (seconds)
+#define LANE_POOL_NAP 1
+
+static unsigned int lane_worker_seq;
+
+static void lane_pool_notify(void * arg) {
+    w_lane_pool_t * pool = arg;
+
+    // Pairs with the fence of a worker going to sleep: either we see it or it sees the item
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pool->idle, __ATOMIC_RELAXED) > 0) {
+        w_mutex_lock(&pool->mutex);
+        w_cond_signal(&pool->available);
+        w_mutex_unlock(&pool->mutex);
+    }
+}
+
+w_lane_t * w_lane_init(w_mpmc_queue_t * queue, w_lane_work_t work, void * context, unsigned int weight) {
+    w_lane_t * lane;
+
+    os_calloc(1, sizeof(w_lane_t), lane);
+    lane->queue = queue;
+    lane->work = work;
+    lane->context = context;
+    lane->weight = weight > 0 ? weight : 1;
+    return lane;
+}
+
+void * w_lane_main(void * arg) {
+    w_lane_t * lane = arg;
+    void * items[W_LANE_BATCH];
+    size_t n;
+
+    while (1) {
+        if (n = mpmc_queue_pop_ex_batch(lane->queue, items, W_LANE_BATCH, NULL), n > 0) {
+            lane->work(lane, items, n);
+        }
+    }
+
+    return NULL;
+}
+
+void w_lane_pool_init(w_lane_pool_t * pool) {
+    memset(pool, 0, sizeof(w_lane_pool_t));
+    w_mutex_init(&pool->mutex, NULL);
+    w_cond_init(&pool->available, NULL);
+}
+
+void w_lane_pool_add(w_lane_pool_t * pool, w_lane_t * lane) {
+    os_realloc(pool->lanes, (pool->count + 1) * sizeof(w_lane_t *), pool->lanes);
+    pool->lanes[pool->count++] = lane;
+    mpmc_queue_set_notify(lane->queue, lane_pool_notify, pool);
+}
+
+w_lane_t * w_lane_pool_take(w_lane_pool_t * pool, unsigned int start) {
+    w_lane_t * best;
+    w_lane_t * lane;
+    uint64_t best_score;
+    uint64_t score;
+    size_t elements;
+    unsigned int i;
+
+    do {
+        best = NULL;
+        best_score = 0;
+
+        for (i = 0; i < pool->count; i++) {
+            lane = pool->lanes[(start + i) % pool->count];
+
+            if (__atomic_load_n(&lane->busy, __ATOMIC_RELAXED) || (elements = mpmc_queue_elements(lane->queue), elements == 0)) {
+                continue;
+            }
+
+            // Occupancy in 1/1024ths, so that small queues don't starve behind big ones
+            score = ((uint64_t)elements * 1024 / lane->queue->size + 1) * lane->weight;
+
+            if (score > best_score) {
+                best = lane;
+                best_score = score;
+            }
+        }
+
+        if (!best) {
+            return NULL;
+        }
+
+        // Another worker may have taken it meanwhile: look again
+    } while (__atomic_exchange_n(&best->busy, 1, __ATOMIC_ACQUIRE));
+
+    __atomic_add_fetch(&pool->busy, 1, __ATOMIC_RELAXED);
+    return best;
+}
+
+void w_lane_pool_release(w_lane_pool_t * pool, w_lane_t * lane) {
+    __atomic_sub_fetch(&pool->busy, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&lane->busy, 0, __ATOMIC_RELEASE);
+
+    // Items that arrived while we held the lane may have sent others to sleep
+    if (!mpmc_queue_empty(lane->queue)) {
+        lane_pool_notify(pool);
+    }
+}
+
+void * w_lane_pool_main(void * arg) {
+    w_lane_pool_t * pool = arg;
+    unsigned int start = __atomic_fetch_add(&lane_worker_seq, 1, __ATOMIC_RELAXED);
+    void * items[W_LANE_BATCH];
+    struct timespec abstime;
+    w_lane_t * lane;
+    size_t n;
+
+    while (1) {
+        if (lane = w_lane_pool_take(pool, start), !lane) {
+            w_mutex_lock(&pool->mutex);
+            __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+            if (lane = w_lane_pool_take(pool, start), !lane) {
+                gettime(&abstime);
+                abstime.tv_sec += LANE_POOL_NAP;
+                pthread_cond_timedwait(&pool->available, &pool->mutex, &abstime);
+            }
+
+            __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+            w_mutex_unlock(&pool->mutex);
+
+            if (!lane) {
+                continue;
+            }
+        }
+
+        if (n = mpmc_queue_pop_batch(lane->queue, items, W_LANE_BATCH), n > 0) {
+            lane->work(lane, items, n);
+        }
+
+        w_lane_pool_release(pool, lane);
+        start++;
+    }
+
+    return NULL;
+}
@@ -86,18 +86,8 @@ int log_builder_update(log_builder_t * builder) {
 
 // Build a log string
 char * log_builder_build(log_builder_t * builder, const char * pattern, const char * logmsg, const char * location) {
+    log_template_t * tmpl;
     char * final;
-    char * _pattern;
-    char * cur;
-    char * tok;
-    char * end;
-    char * param;
-    const char * field;
-    char _timestamp[64];
-    char * escaped_log = NULL;
-    size_t n = 0;
-    size_t z;
-    time_t timestamp = time(NULL);
 
     if (!pattern) {
         return strdup(logmsg);
@@ -106,119 +96,261 @@ char * log_builder_build(log_builder_t * builder, const char * pattern, const ch
     assert(&builder->rwlock != NULL);
 
     os_malloc(OS_MAXSTR, final);
-    os_strdup(pattern, _pattern);
+    tmpl = log_builder_compile(pattern);
+    log_builder_render(builder, tmpl, logmsg, location, final, OS_MAXSTR);
+    log_template_free(tmpl);
 
-    w_rwlock_rdlock(&builder->rwlock);
+    return final;
+}
 
-    for (cur = _pattern; tok = strstr(cur, "$("), tok; cur = end) {
-        field = NULL;
-        *tok = '\0';
+// Append a token to a log template
+static void log_template_add(log_template_t * tmpl, log_token_type_t type, const char * text, size_t length) {
+    log_token_t * token;
 
-        // Skip $(
-        param = tok + 2;
+    if (type == LOG_TOKEN_TEXT && length == 0) {
+        return;
+    }
 
-        // Copy anything before the token
-        z = strlen(cur);
+    token = tmpl->tokens + tmpl->count++;
+    token->type = type;
+    token->text = NULL;
+    token->length = length;
 
-        if (n + z >= OS_MAXSTR) {
-            goto fail;
-        }
+    if (text) {
+        os_malloc(length + 1, token->text);
+        memcpy(token->text, text, length);
+        token->text[length] = '\0';
+    }
+}
 
-        strncpy(final + n, cur, OS_MAXSTR - n);
-        n += z;
+// Check whether a token parameter is a given name
+static bool log_param_is(const char * param, size_t length, const char * name) {
+    return strlen(name) == length && strncmp(param, name, length) == 0;
+}
+
+// Parse a log format into a template
+log_template_t * log_builder_compile(const char * pattern) {
+    log_template_t * tmpl;
+    const char * cur;
+    const char * tok;
+    const char * end;
+    const char * param;
+    const char * format;
+    size_t z;
+
+    os_calloc(1, sizeof(log_template_t), tmpl);
+
+    // Each variable may follow a literal, and a literal may end the pattern
+    for (z = 1, cur = pattern; cur = strstr(cur, "$("), cur; cur += 2) {
+        z += 2;
+    }
+
+    os_malloc(z * sizeof(log_token_t), tmpl->tokens);
+
+    for (cur = pattern; tok = strstr(cur, "$("), tok; cur = end + 1) {
+        // Skip $(
+        param = tok + 2;
+
+        // Add anything before the token
+        log_template_add(tmpl, LOG_TOKEN_TEXT, cur, tok - cur);
 
         if (end = strchr(param, ')'), !end) {
-            // Token not closed: break
-            *tok = '$';
+            // Token not closed: keep it as text
             cur = tok;
             break;
         }
 
-        *end++ = '\0';
+        z = end - param;
 
         // Find parameter
 
-        if (strcmp(param, "log") == 0 || strcmp(param, "output") == 0) {
+        if (log_param_is(param, z, "log") || log_param_is(param, z, "output")) {
+            log_template_add(tmpl, LOG_TOKEN_LOG, NULL, 0);
+        } else if (log_param_is(param, z, "location") || log_param_is(param, z, "command")) {
+            log_template_add(tmpl, LOG_TOKEN_LOCATION, NULL, 0);
+        } else if (z >= 9 && strncmp(param, "timestamp", 9) == 0) {
+            // If format is not speficied, use RFC3164
+            if (format = memchr(param, ' ', z), format) {
+                format++;
+                log_template_add(tmpl, LOG_TOKEN_TIMESTAMP, format, end - format);
+            } else {
+                log_template_add(tmpl, LOG_TOKEN_TIMESTAMP, NULL, 0);
+            }
+        } else if (log_param_is(param, z, "hostname")) {
+            log_template_add(tmpl, LOG_TOKEN_HOSTNAME, NULL, 0);
+            tmpl->host = true;
+        } else if (log_param_is(param, z, "host_ip")) {
+            log_template_add(tmpl, LOG_TOKEN_HOST_IP, NULL, 0);
+            tmpl->host = true;
+        } else if (log_param_is(param, z, "json_escaped_log")) {
+            log_template_add(tmpl, LOG_TOKEN_JSON_LOG, NULL, 0);
+        } else {
+            mdebug1("Invalid parameter '%.*s' for log format.", (int)z, param);
+        }
+    }
+
+    // Add rest of the pattern
+    log_template_add(tmpl, LOG_TOKEN_TEXT, cur, strlen(cur));
+
+    return tmpl;
+}
+
+// Free a log template
+void log_template_free(log_template_t * tmpl) {
+    size_t i;
+
+    if (tmpl) {
+        for (i = 0; i < tmpl->count; i++) {
+            free(tmpl->tokens[i].text);
+        }
+
+        free(tmpl->tokens);
+        free(tmpl);
+    }
+}
+
+// Write a string with JSON escapes into a buffer. Return its length, or size if it doesn't fit
+static size_t log_builder_escape(char * buffer, size_t size, const char * string) {
+    const char escape_map[] = {
+        ['\b'] = 'b',
+        ['\t'] = 't',
+        ['\n'] = 'n',
+        ['\f'] = 'f',
+        ['\r'] = 'r',
+        ['\"'] = '\"',
+        ['\\'] = '\\'
+    };
+
+    size_t j = 0;   // Write position
+    size_t z;       // Span length
+
+    while (1) {
+        z = strcspn(string, "\b\t\n\f\r\"\\");
+
+        if (j + z >= size) {
+            return size;
+        }
+
+        memcpy(buffer + j, string, z);
+        j += z;
+        string += z;
+
+        if (*string == '\0') {
+            return j;
+        }
+
+        // Reserved character
+        if (j + 2 >= size) {
+            return size;
+        }
+
+        buffer[j++] = '\\';
+        buffer[j++] = escape_map[(int)*string++];
+    }
+}
+
+// Render a log template into a buffer
+size_t log_builder_render(log_builder_t * builder, const log_template_t * tmpl, const char * logmsg, const char * location, char * buffer, size_t size) {
+    const log_token_t * token;
+    const char * field;
+    char _timestamp[64];
+    const w_time_cache_t * now = NULL;
+    size_t n = 0;
+    size_t z;
+    size_t i;
+
+    // Only the host fields may change under the template
+    if (tmpl->host) {
+        w_rwlock_rdlock(&builder->rwlock);
+    }
+
+    for (i = 0; i < tmpl->count; i++) {
+        token = tmpl->tokens + i;
+        field = NULL;
+
+        switch (token->type) {
+        case LOG_TOKEN_TEXT:
+            if (n + token->length >= size) {
+                goto fail;
+            }
+
+            memcpy(buffer + n, token->text, token->length);
+            n += token->length;
+            continue;
+
+        case LOG_TOKEN_LOG:
             field = logmsg;
-        } else if (strcmp(param, "location") == 0 || strcmp(param, "command") == 0) {
+            break;
+
+        case LOG_TOKEN_JSON_LOG:
+            if (logmsg) {
+                if (z = log_builder_escape(buffer + n, size - n, logmsg), z == size - n) {
+                    goto fail;
+                }
+
+                n += z;
+            }
+
+            continue;
+
+        case LOG_TOKEN_LOCATION:
             field = location;
-        } else if (strncmp(param, "timestamp", 9) == 0) {
-            struct tm tm;
-            char * format;
+            break;
 
-            localtime_r(&timestamp, &tm);
+        case LOG_TOKEN_TIMESTAMP:
+            if (!now) {
+                now = w_time_cache_get(time(NULL));
+            }
 
-            if (format = strchr(param, ' '), format) {
-                if (strftime(_timestamp, sizeof(_timestamp), format + 1, &tm)) {
+            if (token->text) {
+                if (strftime(_timestamp, sizeof(_timestamp), token->text, &now->tm)) {
                     field = _timestamp;
                 } else {
-                    mdebug1("Cannot format time '%s': %s (%d)", format, strerror(errno), errno);
+                    mdebug1("Cannot format time '%s': %s (%d)", token->text, strerror(errno), errno);
                 }
             } else {
-                // If format is not speficied, use RFC3164
-#ifdef WIN32
-                // strfrime() does not allow %e in Windows
-                const char * MONTHS[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
-
-                if (snprintf(_timestamp, sizeof(_timestamp), "%s %s%d %02d:%02d:%02d", MONTHS[tm.tm_mon], tm.tm_mday < 10 ? " " : "", tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec) < (int)sizeof(_timestamp)) {
-                    field = _timestamp;
-                }
-#else
-                if (strftime(_timestamp, sizeof(_timestamp), "%b %e %T", &tm)) {
-                    field = _timestamp;
-                }
-#endif // WIN32
+                field = now->syslog;
             }
-        } else if (strcmp(param, "hostname") == 0) {
+
+            break;
+
+        case LOG_TOKEN_HOSTNAME:
             field = builder->host_name;
-        } else if (strcmp(param, "host_ip") == 0) {
+            break;
+
+        case LOG_TOKEN_HOST_IP:
             field = builder->host_ip;
-        } else if (strcmp(param, "json_escaped_log") == 0) {
-            field = escaped_log = wstr_escape_json(logmsg);
-        } else {
-            mdebug1("Invalid parameter '%s' for log format.", param);
-            continue;
+            break;
         }
 
         if (field) {
             z = strlen(field);
 
-            if (n + z >= OS_MAXSTR) {
+            if (n + z >= size) {
                 goto fail;
             }
 
-            strncpy(final + n, field, OS_MAXSTR - n);
+            memcpy(buffer + n, field, z);
             n += z;
         }
-
-        os_free(escaped_log);
     }
 
-    // Copy rest of the pattern
-
-    z = strlen(cur);
-
-    if (n + z >= OS_MAXSTR) {
-        goto fail;
+    if (tmpl->host) {
+        w_rwlock_unlock(&builder->rwlock);
     }
 
-    w_rwlock_unlock(&builder->rwlock);
-
-    strncpy(final + n, cur, OS_MAXSTR - n);
-    final[n + z] = '\0';
-
-    free(_pattern);
-    return final;
+    buffer[n] = '\0';
+    return n;
 
 fail:
-    w_rwlock_unlock(&builder->rwlock);
+    if (tmpl->host) {
+        w_rwlock_unlock(&builder->rwlock);
+    }
 
     mdebug1("Too long message format");
-    strncpy(final, logmsg ? logmsg : "Too long message format", OS_MAXSTR - 1);
-    final[OS_MAXSTR - 1] = '\0';
-    free(_pattern);
-    free(escaped_log);
-    return final;
+    strncpy(buffer, logmsg ? logmsg : "Too long message format", size - 1);
+    buffer[size - 1] = '\0';
+    return strlen(buffer);
 }
 
 // Update the hostname value
@@ -0,0 +1,411 @@
+/*
+ * Process metrics: counters, gauges and latency histograms
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+#include "os_net/os_net.h"
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+typedef struct metrics_buffer_t {
+    char * data;
+    size_t length;
+    size_t size;
+} metrics_buffer_t;
+
+static w_metric_t * metrics;
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int metrics_next_shard;
+static __thread int metrics_shard = -1;
+
+static void metrics_printf(metrics_buffer_t * buffer, const char * format, ...) __attribute__((format(printf, 2, 3)));
+
+/* Threads take the shards in turn */
+static unsigned int metrics_get_shard(void) {
+    if (metrics_shard < 0) {
+        metrics_shard = __atomic_fetch_add(&metrics_next_shard, 1, __ATOMIC_RELAXED) % METRICS_SHARDS;
+    }
+
+    return metrics_shard;
+}
+
+static unsigned int metrics_bucket(uint64_t usec) {
+    unsigned int exponent;
+
+    if (usec < METRICS_SUB_BUCKETS) {
+        return usec;
+    }
+
+    if (usec > UINT32_MAX) {
+        usec = UINT32_MAX;
+    }
+
+    exponent = 63 - __builtin_clzll(usec);
+    return (exponent - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS + ((usec >> (exponent - METRICS_SUB_BITS)) & (METRICS_SUB_BUCKETS - 1));
+}
+
+/* Smallest value above the bucket */
+static uint64_t metrics_bucket_limit(unsigned int bucket) {
+    unsigned int exponent;
+
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return bucket + 1;
+    }
+
+    exponent = bucket / METRICS_SUB_BUCKETS + METRICS_SUB_BITS - 1;
+    return (uint64_t)(METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS + 1) << (exponent - METRICS_SUB_BITS);
+}
+
+/* Number of buckets below 2^exponent microseconds */
+static unsigned int metrics_buckets_below(unsigned int exponent) {
+    return exponent < METRICS_SUB_BITS ? 1U << exponent : (exponent - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS;
+}
+
+/* Sum the shards of a histogram */
+static uint64_t metrics_histogram_sum(const w_metric_t * metric, uint64_t * buckets) {
+    uint64_t sum = 0;
+    unsigned int shard;
+    unsigned int i;
+
+    memset(buckets, 0, METRICS_BUCKETS * sizeof(uint64_t));
+
+    for (shard = 0; shard < METRICS_SHARDS; shard++) {
+        for (i = 0; i < METRICS_BUCKETS; i++) {
+            buckets[i] += __atomic_load_n(&metric->histograms[shard].buckets[i], __ATOMIC_RELAXED);
+        }
+
+        sum += __atomic_load_n(&metric->histograms[shard].sum, __ATOMIC_RELAXED);
+    }
+
+    return sum;
+}
+
+static w_metric_t * metrics_register(w_metric_type_t type, const char * name, const char * help, const char * labels) {
+    w_metric_t * metric;
+    w_metric_t * family = NULL;
+    w_metric_t ** prev;
+
+    w_mutex_lock(&metrics_mutex);
+
+    /* Members of a family are kept together, after its first one */
+    for (prev = &metrics; *prev; prev = &(*prev)->next) {
+        if (strcmp((*prev)->name, name) == 0) {
+            if ((*prev)->labels ? labels && strcmp((*prev)->labels, labels) == 0 : !labels) {
+                metric = *prev;
+                w_mutex_unlock(&metrics_mutex);
+                return metric;
+            }
+
+            family = *prev;
+        } else if (family) {
+            break;
+        }
+    }
+
+    os_calloc(1, sizeof(w_metric_t), metric);
+    os_strdup(name, metric->name);
+    os_strdup(help, metric->help);
+
+    if (labels) {
+        os_strdup(labels, metric->labels);
+    }
+
+    metric->type = type;
+
+    switch (type) {
+    case W_METRIC_COUNTER:
+        os_calloc(METRICS_SHARDS, sizeof(w_metric_slot_t), metric->slots);
+        break;
+    case W_METRIC_HISTOGRAM:
+        os_calloc(METRICS_SHARDS, sizeof(w_metric_histogram_t), metric->histograms);
+        break;
+    default:
+        break;
+    }
+
+    metric->next = *prev;
+    *prev = metric;
+
+    w_mutex_unlock(&metrics_mutex);
+    return metric;
+}
+
+w_metric_t * w_metrics_counter(const char * name, const char * help, const char * labels) {
+    return metrics_register(W_METRIC_COUNTER, name, help, labels);
+}
+
+w_metric_t * w_metrics_counter_fn(const char * name, const char * help, const char * labels, double (*read)(void *), void * arg) {
+    w_metric_t * metric = metrics_register(W_METRIC_COUNTER, name, help, labels);
+
+    metric->read = read;
+    metric->arg = arg;
+    return metric;
+}
+
+w_metric_t * w_metrics_gauge(const char * name, const char * help, const char * labels, double (*read)(void *), void * arg) {
+    w_metric_t * metric = metrics_register(W_METRIC_GAUGE, name, help, labels);
+
+    metric->read = read;
+    metric->arg = arg;
+    return metric;
+}
+
+w_metric_t * w_metrics_histogram(const char * name, const char * help, const char * labels) {
+    return metrics_register(W_METRIC_HISTOGRAM, name, help, labels);
+}
+
+void w_metrics_add(w_metric_t * metric, uint64_t n) {
+    __atomic_add_fetch(&metric->slots[metrics_get_shard()].value, n, __ATOMIC_RELAXED);
+}
+
+void w_metrics_set(w_metric_t * metric, int64_t value) {
+    __atomic_store_n(&metric->value, value, __ATOMIC_RELAXED);
+}
+
+void w_metrics_observe(w_metric_t * metric, uint64_t usec) {
+    w_metric_histogram_t * histogram = &metric->histograms[metrics_get_shard()];
+
+    __atomic_add_fetch(&histogram->buckets[metrics_bucket(usec)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&histogram->sum, usec, __ATOMIC_RELAXED);
+}
+
+void w_metrics_observe_since(w_metric_t * metric, const struct timespec * start) {
+    struct timespec now;
+    long long usec;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_nsec - start->tv_nsec) / 1000;
+    w_metrics_observe(metric, usec > 0 ? usec : 0);
+}
+
+uint64_t w_metrics_value(const w_metric_t * metric) {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t value = 0;
+    unsigned int i;
+
+    switch (metric->type) {
+    case W_METRIC_COUNTER:
+        if (metric->read) {
+            return metric->read(metric->arg);
+        }
+
+        for (i = 0; i < METRICS_SHARDS; i++) {
+            value += __atomic_load_n(&metric->slots[i].value, __ATOMIC_RELAXED);
+        }
+        break;
+
+    case W_METRIC_GAUGE:
+        value = metric->read ? metric->read(metric->arg) : __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+        break;
+
+    case W_METRIC_HISTOGRAM:
+        metrics_histogram_sum(metric, buckets);
+
+        for (i = 0; i < METRICS_BUCKETS; i++) {
+            value += buckets[i];
+        }
+    }
+
+    return value;
+}
+
+uint64_t w_metrics_percentile(const w_metric_t * metric, double percentile) {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t count = 0;
+    uint64_t rank;
+    unsigned int i;
+
+    metrics_histogram_sum(metric, buckets);
+
+    for (i = 0; i < METRICS_BUCKETS; i++) {
+        count += buckets[i];
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    rank = (uint64_t)(percentile * (count - 1)) + 1;
+
+    for (i = 0, count = 0; i < METRICS_BUCKETS - 1; i++) {
+        if (count += buckets[i], count >= rank) {
+            break;
+        }
+    }
+
+    return metrics_bucket_limit(i);
+}
+
+static void metrics_printf(metrics_buffer_t * buffer, const char * format, ...) {
+    va_list args;
+    int length;
+
+    while (1) {
+        va_start(args, format);
+        length = vsnprintf(buffer->data + buffer->length, buffer->size - buffer->length, format, args);
+        va_end(args);
+
+        if (length < 0) {
+            return;
+        }
+
+        if ((size_t)length < buffer->size - buffer->length) {
+            buffer->length += length;
+            return;
+        }
+
+        buffer->size = buffer->size * 2 + length;
+        os_realloc(buffer->data, buffer->size, buffer->data);
+    }
+}
+
+static void metrics_render_histogram(metrics_buffer_t * buffer, const w_metric_t * metric) {
+    uint64_t buckets[METRICS_BUCKETS];
+    const char * comma = metric->labels ? "," : "";
+    const char * labels = metric->labels ? metric->labels : "";
+    uint64_t count = 0;
+    uint64_t sum;
+    unsigned int exponent;
+    unsigned int i = 0;
+
+    sum = metrics_histogram_sum(metric, buckets);
+
+    /* Buckets are rendered at every power of two microseconds */
+    for (exponent = 0; exponent <= 32; exponent++) {
+        for (; i < metrics_buckets_below(exponent); i++) {
+            count += buckets[i];
+        }
+
+        metrics_printf(buffer, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", metric->name, labels, comma, (double)(1ULL << exponent) / 1000000, (unsigned long long)count);
+    }
+
+    metrics_printf(buffer, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", metric->name, labels, comma, (unsigned long long)count);
+    metrics_printf(buffer, "%s_count%s%s%s %llu\n", metric->name, *labels ? "{" : "", labels, *labels ? "}" : "", (unsigned long long)count);
+    metrics_printf(buffer, "%s_sum%s%s%s %.6f\n", metric->name, *labels ? "{" : "", labels, *labels ? "}" : "", (double)sum / 1000000);
+}
+
+char * w_metrics_render(void) {
+    static const char * types[] = { "counter", "gauge", "histogram" };
+    metrics_buffer_t buffer = { NULL, 0, OS_SIZE_8192 };
+    const char * family = NULL;
+    const char * labels;
+    w_metric_t * metric;
+
+    os_malloc(buffer.size, buffer.data);
+    *buffer.data = '\0';
+
+    w_mutex_lock(&metrics_mutex);
+
+    for (metric = metrics; metric; metric = metric->next) {
+        if (!family || strcmp(family, metric->name) != 0) {
+            family = metric->name;
+            metrics_printf(&buffer, "# TYPE %s %s\n# HELP %s %s\n", metric->name, types[metric->type], metric->name, metric->help);
+        }
+
+        labels = metric->labels ? metric->labels : "";
+
+        switch (metric->type) {
+        case W_METRIC_COUNTER:
+            if (metric->read) {
+                metrics_printf(&buffer, "%s_total%s%s%s %.9g\n", metric->name, *labels ? "{" : "", labels, *labels ? "}" : "", metric->read(metric->arg));
+            } else {
+                metrics_printf(&buffer, "%s_total%s%s%s %llu\n", metric->name, *labels ? "{" : "", labels, *labels ? "}" : "", (unsigned long long)w_metrics_value(metric));
+            }
+            break;
+
+        case W_METRIC_GAUGE:
+            if (metric->read) {
+                metrics_printf(&buffer, "%s%s%s%s %g\n", metric->name, *labels ? "{" : "", labels, *labels ? "}" : "", metric->read(metric->arg));
+            } else {
+                metrics_printf(&buffer, "%s%s%s%s %lld\n", metric->name, *labels ? "{" : "", labels, *labels ? "}" : "", (long long)__atomic_load_n(&metric->value, __ATOMIC_RELAXED));
+            }
+            break;
+
+        case W_METRIC_HISTOGRAM:
+            metrics_render_histogram(&buffer, metric);
+        }
+    }
+
+    w_mutex_unlock(&metrics_mutex);
+
+    metrics_printf(&buffer, "# EOF\n");
+    return buffer.data;
+}
+
+#ifndef WIN32
+
+/* Answer every connection with the metrics. Only GET /metrics is served. */
+static void * metrics_http_main(void * arg) {
+    int sock = (int)(intptr_t)arg;
+    char request[OS_SIZE_1024];
+    char header[OS_SIZE_256];
+    char * body;
+    ssize_t length;
+    int peer;
+
+    while (1) {
+        if (peer = accept(sock, NULL, NULL), peer < 0) {
+            if (errno != EINTR) {
+                merror("At metrics_http_main(): accept(): %s", strerror(errno));
+            }
+
+            continue;
+        }
+
+        if (length = recv(peer, request, sizeof(request) - 1, 0), length <= 0) {
+            close(peer);
+            continue;
+        }
+
+        request[length] = '\0';
+
+        if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+            body = w_metrics_render();
+            length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: " METRICS_CONTENT_TYPE "\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", strlen(body));
+
+            if (send(peer, header, length, MSG_NOSIGNAL) == length) {
+                send(peer, body, strlen(body), MSG_NOSIGNAL);
+            }
+
+            free(body);
+        } else {
+            length = snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            send(peer, header, length, MSG_NOSIGNAL);
+        }
+
+        close(peer);
+    }
+
+    return NULL;
+}
+
+void w_metrics_http_start(const char * section) {
+    int port = getDefine_Int(section, "metrics_port", 0, 65535);
+    int sock;
+
+    if (!port) {
+        return;
+    }
+
+    if (sock = OS_Bindporttcp(port, "127.0.0.1", 0), sock < 0) {
+        merror("Unable to bind the metrics endpoint to port %d: %s (%d)", port, strerror(errno), errno);
+        return;
+    }
+
+    minfo("Serving metrics at http://127.0.0.1:%d/metrics", port);
+    w_create_named_thread(metrics_http_main, (void *)(intptr_t)sock, "metrics-http");
+}
+
+#else
+
+void w_metrics_http_start(__attribute__((unused)) const char * section) {
+}
+
+#endif /* WIN32 */
@@ -0,0 +1,342 @@
+/*
+ * Bounded lock-free MPMC queue
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * May 26, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+
+// Number of lock-free attempts before parking the thread
+#define MPMC_SPIN_TRIES 64
+
+static int mpmc_queue_try_push(w_mpmc_queue_t * queue, void * data);
+static void * mpmc_queue_try_pop(w_mpmc_queue_t * queue);
+static void mpmc_queue_wake_consumer(w_mpmc_queue_t * queue, int all);
+static void mpmc_queue_wake_producer(w_mpmc_queue_t * queue, int all);
+
+w_mpmc_queue_t * mpmc_queue_init(size_t n) {
+    w_mpmc_queue_t * queue;
+    size_t size;
+    size_t i;
+
+    for (size = 2; size < n; size <<= 1);
+
+    os_calloc(1, sizeof(w_mpmc_queue_t), queue);
+    os_malloc(size * sizeof(mpmc_cell_t), queue->cells);
+
+    for (i = 0; i < size; i++) {
+        queue->cells[i].sequence = i;
+        queue->cells[i].data = NULL;
+    }
+
+    queue->size = size;
+    queue->mask = size - 1;
+    w_mutex_init(&queue->mutex, NULL);
+    w_cond_init(&queue->available, NULL);
+    w_cond_init(&queue->available_not_full, NULL);
+    return queue;
+}
+
+void mpmc_queue_free(w_mpmc_queue_t * queue) {
+    if (queue) {
+        free(queue->cells);
+        w_mutex_destroy(&queue->mutex);
+        w_cond_destroy(&queue->available);
+        w_cond_destroy(&queue->available_not_full);
+        free(queue);
+    }
+}
+
+size_t mpmc_queue_elements(const w_mpmc_queue_t * queue) {
+    size_t dequeue_pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    size_t enqueue_pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+
+    if (enqueue_pos <= dequeue_pos) {
+        return 0;
+    }
+
+    return enqueue_pos - dequeue_pos > queue->size ? queue->size : enqueue_pos - dequeue_pos;
+}
+
+size_t mpmc_queue_take_high_water(w_mpmc_queue_t * queue) {
+    return __atomic_exchange_n(&queue->high_water, mpmc_queue_elements(queue), __ATOMIC_RELAXED);
+}
+
+int mpmc_queue_full(const w_mpmc_queue_t * queue) {
+    return mpmc_queue_elements(queue) >= queue->size;
+}
+
+int mpmc_queue_empty(const w_mpmc_queue_t * queue) {
+    return mpmc_queue_elements(queue) == 0;
+}
+
+int mpmc_queue_push_ex(w_mpmc_queue_t * queue, void * data) {
+    if (mpmc_queue_try_push(queue, data) < 0) {
+        return -1;
+    }
+
+    mpmc_queue_wake_consumer(queue, 0);
+    return 0;
+}
+
+int mpmc_queue_push_ex_block(w_mpmc_queue_t * queue, void * data) {
+    int i;
+
+    for (i = 0; i < MPMC_SPIN_TRIES; i++) {
+        if (mpmc_queue_try_push(queue, data) == 0) {
+            mpmc_queue_wake_consumer(queue, 0);
+            return 0;
+        }
+    }
+
+    w_mutex_lock(&queue->mutex);
+    __atomic_add_fetch(&queue->producers_waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    while (mpmc_queue_try_push(queue, data) < 0) {
+        w_cond_wait(&queue->available_not_full, &queue->mutex);
+    }
+
+    __atomic_sub_fetch(&queue->producers_waiting, 1, __ATOMIC_SEQ_CST);
+    w_mutex_unlock(&queue->mutex);
+
+    mpmc_queue_wake_consumer(queue, 0);
+    return 0;
+}
+
+void * mpmc_queue_pop(w_mpmc_queue_t * queue) {
+    void * data;
+
+    if (data = mpmc_queue_try_pop(queue), data) {
+        mpmc_queue_wake_producer(queue, 0);
+    }
+
+    return data;
+}
+
+void * mpmc_queue_pop_ex(w_mpmc_queue_t * queue) {
+    void * data;
+    int i;
+
+    for (i = 0; i < MPMC_SPIN_TRIES; i++) {
+        if (data = mpmc_queue_try_pop(queue), data) {
+            mpmc_queue_wake_producer(queue, 0);
+            return data;
+        }
+    }
+
+    w_mutex_lock(&queue->mutex);
+    __atomic_add_fetch(&queue->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    while (data = mpmc_queue_try_pop(queue), !data) {
+        w_cond_wait(&queue->available, &queue->mutex);
+    }
+
+    __atomic_sub_fetch(&queue->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+    w_mutex_unlock(&queue->mutex);
+
+    mpmc_queue_wake_producer(queue, 0);
+    return data;
+}
+
+void * mpmc_queue_pop_ex_timedwait(w_mpmc_queue_t * queue, const struct timespec * abstime) {
+    void * data;
+
+    if (data = mpmc_queue_try_pop(queue), data) {
+        mpmc_queue_wake_producer(queue, 0);
+        return data;
+    }
+
+    w_mutex_lock(&queue->mutex);
+    __atomic_add_fetch(&queue->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    while (data = mpmc_queue_try_pop(queue), !data) {
+        if (pthread_cond_timedwait(&queue->available, &queue->mutex, abstime) != 0) {
+            data = mpmc_queue_try_pop(queue);
+            break;
+        }
+    }
+
+    __atomic_sub_fetch(&queue->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+    w_mutex_unlock(&queue->mutex);
+
+    if (data) {
+        mpmc_queue_wake_producer(queue, 0);
+    }
+
+    return data;
+}
+
+size_t mpmc_queue_pop_batch(w_mpmc_queue_t * queue, void ** items, size_t max) {
+    size_t n;
+
+    for (n = 0; n < max && (items[n] = mpmc_queue_try_pop(queue), items[n]); n++);
+
+    if (n > 0) {
+        mpmc_queue_wake_producer(queue, n > 1);
+    }
+
+    return n;
+}
+
+size_t mpmc_queue_pop_ex_batch(w_mpmc_queue_t * queue, void ** items, size_t max, const struct timespec * abstime) {
+    size_t n;
+
+    if (max == 0) {
+        return 0;
+    }
+
+    if (items[0] = abstime ? mpmc_queue_pop_ex_timedwait(queue, abstime) : mpmc_queue_pop_ex(queue), !items[0]) {
+        return 0;
+    }
+
+    for (n = 1; n < max && (items[n] = mpmc_queue_try_pop(queue), items[n]); n++);
+
+    if (n > 1) {
+        mpmc_queue_wake_producer(queue, 1);
+    }
+
+    return n;
+}
+
+int mpmc_queue_push_ex_batch(w_mpmc_queue_t * queue, void ** items, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (mpmc_queue_try_push(queue, items[i]) < 0) {
+            // Let consumers drain what we have pushed so far
+            mpmc_queue_wake_consumer(queue, 1);
+            mpmc_queue_push_ex_block(queue, items[i]);
+        }
+    }
+
+    if (n > 0) {
+        mpmc_queue_wake_consumer(queue, n > 1);
+    }
+
+    return 0;
+}
+
+void mpmc_queue_set_notify(w_mpmc_queue_t * queue, void (*notify)(void * arg), void * arg) {
+    queue->notify_arg = arg;
+    __atomic_store_n(&queue->notify, notify, __ATOMIC_RELEASE);
+}
+
+/* Claim the next free cell and publish the item into it */
+static int mpmc_queue_try_push(w_mpmc_queue_t * queue, void * data) {
+    mpmc_cell_t * cell;
+    size_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    size_t elements;
+    size_t high_water;
+    size_t seq;
+    intptr_t dif;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            // The cell still holds an item from the previous lap: queue full
+            return -1;
+        } else {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = data;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    // Track the peak usage. The CAS only runs while a new peak is being set
+    elements = pos + 1 - __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    high_water = __atomic_load_n(&queue->high_water, __ATOMIC_RELAXED);
+
+    if (elements <= queue->size) {
+        while (high_water < elements && !__atomic_compare_exchange_n(&queue->high_water, &high_water, elements, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+
+    return 0;
+}
+
+/* Claim the next filled cell and release it for the next lap */
+static void * mpmc_queue_try_pop(w_mpmc_queue_t * queue) {
+    mpmc_cell_t * cell;
+    size_t pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    size_t seq;
+    intptr_t dif;
+    void * data;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            // The cell has not been published yet: queue empty
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    data = cell->data;
+    __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    return data;
+}
+
+/*
+ * The fence pairs with the one taken by the waiting thread after it
+ * registers itself: either we see the waiter or the waiter sees our item.
+ */
+static void mpmc_queue_wake_consumer(w_mpmc_queue_t * queue, int all) {
+    void (*notify)(void *) = __atomic_load_n(&queue->notify, __ATOMIC_ACQUIRE);
+
+    if (notify) {
+        notify(queue->notify_arg);
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&queue->consumers_waiting, __ATOMIC_RELAXED) > 0) {
+        w_mutex_lock(&queue->mutex);
+
+        if (all) {
+            w_cond_broadcast(&queue->available);
+        } else {
+            w_cond_signal(&queue->available);
+        }
+
+        w_mutex_unlock(&queue->mutex);
+    }
+}
+
+static void mpmc_queue_wake_producer(w_mpmc_queue_t * queue, int all) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&queue->producers_waiting, __ATOMIC_RELAXED) > 0) {
+        w_mutex_lock(&queue->mutex);
+
+        if (all) {
+            w_cond_broadcast(&queue->available_not_full);
+        } else {
+            w_cond_signal(&queue->available_not_full);
+        }
+
+        w_mutex_unlock(&queue->mutex);
+    }
+}
@@ -15,8 +15,129 @@
 static log_builder_t * mq_log_builder;
 int sock_fail_time;
 
+/* Apply the output format of a target into a buffer, or return the message as is.
+ * The format is parsed the first time: a target is only sent by one thread */
+static const char * mq_log_format(logtarget * target, const char * message, const char * locmsg, char * buffer, size_t size) {
+    if (!target->format) {
+        return message;
+    }
+
+    if (!target->compiled) {
+        target->compiled = log_builder_compile(target->format);
+    }
+
+    log_builder_render(mq_log_builder, target->compiled, message, locmsg, buffer, size);
+    return buffer;
+}
+
 #ifndef WIN32
 
+/* Shared-memory rings of a queue, and the sockets that StartMQ() connected to it */
+static w_shm_queue_t * mq_shm;
+static char * mq_shm_path;
+static char * mq_shm_socks;
+static int mq_shm_socks_size;
+static pthread_mutex_t mq_shm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Messages that SendMSG() keeps to send at once, per thread */
+typedef struct mq_batch_t {
+    char * buffer;
+    size_t length;
+    char * msgs[MQ_BATCH_MAX];
+    int sizes[MQ_BATCH_MAX];
+    unsigned int n;
+    unsigned int max;
+    int queue;
+} mq_batch_t;
+
+static __thread mq_batch_t mq_batch;
+
+/* Use the shared-memory rings of a queue, if its reader offers them */
+static void mq_shm_attach(const char * path, int sock) {
+    char shm_path[PATH_MAX + 1];
+
+    snprintf(shm_path, sizeof(shm_path), "%s" SHM_QUEUE_SUFFIX, path);
+
+    w_mutex_lock(&mq_shm_mutex);
+
+    /* The reader may have restarted with a new segment */
+    if (mq_shm && __atomic_load_n(&mq_shm->header->closed, __ATOMIC_ACQUIRE)) {
+        shm_queue_close(mq_shm);
+        mq_shm = NULL;
+    }
+
+    if (!mq_shm && (mq_shm = shm_queue_attach(shm_path), mq_shm)) {
+        os_free(mq_shm_path);
+        os_strdup(shm_path, mq_shm_path);
+        mdebug1("Sending messages through the shared queue '%s'.", shm_path);
+    }
+
+    if (sock >= mq_shm_socks_size) {
+        os_realloc(mq_shm_socks, sock + 1, mq_shm_socks);
+        memset(mq_shm_socks + mq_shm_socks_size, 0, sock + 1 - mq_shm_socks_size);
+        mq_shm_socks_size = sock + 1;
+    }
+
+    mq_shm_socks[sock] = mq_shm && !strcmp(mq_shm_path, shm_path);
+
+    w_mutex_unlock(&mq_shm_mutex);
+}
+
+/* Send a message through the shared-memory rings of a socket.
+ * Returns 1 if the socket has no rings, or -1 if the reader is gone.
+ */
+static int mq_shm_send(int queue, char loc, const char * locmsg, const char * separator, const char * message) {
+    char prefix[2] = { loc, ':' };
+    struct iovec iov[4] = {
+        { prefix, sizeof(prefix) },
+        { (char *)locmsg, strlen(locmsg) },
+        { (char *)separator, strlen(separator) },
+        { (char *)message, strlen(message) }
+    };
+    size_t room = OS_MAXSTR - 1;
+    int result = 1;
+    int i;
+
+    w_mutex_lock(&mq_shm_mutex);
+
+    if (mq_shm && queue < mq_shm_socks_size && mq_shm_socks[queue]) {
+        /* Truncate as snprintf() into the socket buffer would */
+        for (i = 0; i < 4; i++) {
+            if (iov[i].iov_len > room) {
+                iov[i].iov_len = room;
+            }
+            room -= iov[i].iov_len;
+        }
+
+        switch (shm_queue_push(mq_shm, iov, 4)) {
+        case SHM_QUEUE_WAKEUP:
+            /* An empty datagram wakes the parked reader up */
+            if (send(queue, "", 0, 0) < 0 && errno != ENOBUFS && errno != EAGAIN) {
+                result = -1;
+                break;
+            }
+            result = 0;
+            break;
+
+        case 0:
+            result = 0;
+            break;
+
+        default:
+            result = -1;
+        }
+
+        if (result < 0) {
+            shm_queue_close(mq_shm);
+            mq_shm = NULL;
+            mq_shm_socks[queue] = 0;
+        }
+    }
+
+    w_mutex_unlock(&mq_shm_mutex);
+    return result;
+}
+
 /* Start the Message Queue. type: WRITE||READ */
 int StartMQ(const char *path, short int type)
 {
@@ -44,6 +165,7 @@ int StartMQ(const char *path, short int type)
          }
 
         mdebug1(MSG_SOCKET_SIZE, OS_getsocketsize(rc));
+        mq_shm_attach(path, rc);
         return (rc);
     }
 }
@@ -53,6 +175,7 @@ int SendMSG(int queue, const char *message, const char *locmsg, char loc)
 {
     int __mq_rcode;
     char tmpstr[OS_MAXSTR + 1];
+    const char * separator = ":";
     static int reported = 0;
 
     tmpstr[OS_MAXSTR] = '\0';
@@ -74,9 +197,7 @@ int SendMSG(int queue, const char *message, const char *locmsg, char loc)
             return (0);
         }
 
-        snprintf(tmpstr, OS_MAXSTR, "%c:%s->%s", loc, locmsg, message);
-    } else {
-        snprintf(tmpstr, OS_MAXSTR, "%c:%s:%s", loc, locmsg, message);
+        separator = "->";
     }
 
     /* Queue not available */
@@ -84,6 +205,44 @@ int SendMSG(int queue, const char *message, const char *locmsg, char loc)
         return (-1);
     }
 
+    /* Write straight into the shared rings when the reader offers them */
+    if (__mq_rcode = mq_shm_send(queue, loc, locmsg, separator, message), __mq_rcode <= 0) {
+        if (__mq_rcode < 0) {
+            merror("Shared queue not available.");
+            close(queue);
+            return (-1);
+        }
+
+        return (0);
+    }
+
+    /* Batched mode: format into the batch, and send it when it's full */
+    if (mq_batch.max) {
+        char * slot;
+        int size;
+
+        if (mq_batch.n && mq_batch.queue != queue) {
+            SendMSGFlush(mq_batch.queue);
+        }
+
+        slot = mq_batch.buffer + mq_batch.length;
+        size = snprintf(slot, OS_MAXSTR, "%c:%s%s%s", loc, locmsg, separator, message);
+        size = (size < OS_MAXSTR - 1 ? size : OS_MAXSTR - 1) + 1;
+
+        mq_batch.msgs[mq_batch.n] = slot;
+        mq_batch.sizes[mq_batch.n++] = size;
+        mq_batch.length += size;
+        mq_batch.queue = queue;
+
+        if (mq_batch.n == mq_batch.max || MQ_BATCH_BUFFER - mq_batch.length < OS_MAXSTR) {
+            return SendMSGFlush(queue);
+        }
+
+        return (0);
+    }
+
+    snprintf(tmpstr, OS_MAXSTR, "%c:%s%s%s", loc, locmsg, separator, message);
+
     if ((__mq_rcode = OS_SendUnix(queue, tmpstr, 0)) < 0) {
         /* Error on the socket */
         if (__mq_rcode == OS_SOCKTERR) {
@@ -104,26 +263,75 @@ int SendMSG(int queue, const char *message, const char *locmsg, char loc)
     return (0);
 }
 
+/* Send the messages batched by this thread */
+int SendMSGFlush(int queue)
+{
+    static int reported = 0;
+    int sent;
+    int n = mq_batch.n;
+
+    if (n == 0) {
+        return (0);
+    }
+
+    sent = OS_SendUnixBatch(mq_batch.queue, mq_batch.msgs, mq_batch.sizes, n);
+    mq_batch.n = 0;
+    mq_batch.length = 0;
+
+    if (sent < n) {
+        /* Error on the socket */
+        if (errno != ENOBUFS) {
+            merror("socketerr (not available).");
+            close(queue);
+            return (-1);
+        }
+
+        /* Unable to send. Socket busy */
+        mdebug2("Socket busy, discarding %d messages.", n - sent);
+
+        if (!reported) {
+            reported = 1;
+            mwarn("Socket busy, discarding message.");
+        }
+    }
+
+    return (0);
+}
+
+void SendMSGBatch(unsigned int n)
+{
+    if (n > MQ_BATCH_MAX) {
+        n = MQ_BATCH_MAX;
+    }
+
+    if (n && !mq_batch.buffer) {
+        os_malloc(MQ_BATCH_BUFFER, mq_batch.buffer);
+    }
+
+    if (!n) {
+        SendMSGFlush(mq_batch.queue);
+    }
+
+    mq_batch.max = n;
+}
+
 /* Send a message to socket */
 int SendMSGtoSCK(int queue, const char *message, const char *locmsg, __attribute__((unused)) char loc, logtarget * target)
 {
     int __mq_rcode;
     char tmpstr[OS_MAXSTR + 1];
     time_t mtime;
-    char * _message = NULL;
-
-    _message = log_builder_build(mq_log_builder, target->format, message, locmsg);
 
     tmpstr[OS_MAXSTR] = '\0';
 
     if (strcmp(target->log_socket->name, "agent") == 0) {
-        if(SendMSG(queue, _message, locmsg, loc) != 0) {
-            free(_message);
+        if (SendMSG(queue, mq_log_format(target, message, locmsg, tmpstr, OS_MAXSTR), locmsg, loc) != 0) {
             return -1;
         }
     }else{
         int sock_type;
         const char * strmode;
+        int prefix = 0;
 
         switch (target->log_socket->mode) {
         case IPPROTO_UDP:
@@ -136,15 +344,17 @@ int SendMSGtoSCK(int queue, const char *message, const char *locmsg, __attribute
             break;
         default:
             merror("At %s(): undefined protocol. This shouldn't happen.", __FUNCTION__);
-            free(_message);
             return -1;
         }
 
         // create message and add prefix
         if (target->log_socket->prefix && *target->log_socket->prefix) {
-            snprintf(tmpstr, OS_MAXSTR, "%s%s", target->log_socket->prefix, _message);
-        } else {
-            snprintf(tmpstr, OS_MAXSTR, "%s", _message);
+            prefix = snprintf(tmpstr, OS_MAXSTR, "%s", target->log_socket->prefix);
+            prefix = prefix < OS_MAXSTR - 1 ? prefix : OS_MAXSTR - 1;
+        }
+
+        if (mq_log_format(target, message, locmsg, tmpstr + prefix, OS_MAXSTR - prefix) == message) {
+            snprintf(tmpstr + prefix, OS_MAXSTR - prefix, "%s", message);
         }
 
         // Connect to socket if disconnected
@@ -153,14 +363,12 @@ int SendMSGtoSCK(int queue, const char *message, const char *locmsg, __attribute
                 if (target->log_socket->socket = OS_ConnectUnixDomain(target->log_socket->location, sock_type, OS_MAXSTR + 256), target->log_socket->socket < 0) {
                     target->log_socket->last_attempt = mtime;
                     merror("Unable to connect to socket '%s': %s (%s)", target->log_socket->name, target->log_socket->location, strmode);
-                    free(_message);
                     return -1;
                 }
 
                 mdebug1("Connected to socket '%s' (%s)", target->log_socket->name, target->log_socket->location);
             } else {
                 mdebug2("Discarding event from '%s' due to connection issue with '%s'", locmsg, target->log_socket->name);
-                free(_message);
                 return 0;
             }
         }
@@ -192,28 +400,22 @@ int SendMSGtoSCK(int queue, const char *message, const char *locmsg, __attribute
             }
         }
 
-        free(_message);
         return (0);
     }
-    free(_message);
     return (0);
 }
 
 #else
 
 int SendMSGtoSCK(int queue, const char *message, const char *locmsg, char loc, logtarget * targets) {
-    char * _message;
-    int retval;
+    char buffer[OS_MAXSTR];
 
     if (!targets[0].log_socket) {
         merror("No targets defined for a localfile.");
         return -1;
     }
 
-    _message = log_builder_build(mq_log_builder, targets[0].format, message, locmsg);
-    retval = SendMSG(queue, _message, locmsg, loc);
-    free(_message);
-    return retval;
+    return SendMSG(queue, mq_log_format(&targets[0], message, locmsg, buffer, sizeof(buffer)), locmsg, loc);
 }
 
 #endif /* !WIN32 */
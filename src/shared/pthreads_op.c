@@ -13,6 +13,59 @@
 #include <pthread.h>
 #include <sys/resource.h>
 
+#ifdef __linux__
+/* CPU clock of a thread. The last value is kept for threads that already exited */
+typedef struct w_thread_clock_t {
+    clockid_t clock;
+    double last;
+} w_thread_clock_t;
+
+static double thread_cpu_seconds(void * arg)
+{
+    w_thread_clock_t * thread = arg;
+    struct timespec ts;
+
+    if (clock_gettime(thread->clock, &ts) == 0) {
+        thread->last = ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    return thread->last;
+}
+#endif
+
+static void thread_vregister(pthread_t thread, const char * format, va_list args)
+{
+#ifdef __linux__
+    char name[16];
+    char labels[OS_SIZE_128];
+    w_thread_clock_t * clock;
+    clockid_t clock_id;
+
+    vsnprintf(name, sizeof(name), format, args);
+    pthread_setname_np(thread, name);
+
+    if (pthread_getcpuclockid(thread, &clock_id) == 0) {
+        os_calloc(1, sizeof(w_thread_clock_t), clock);
+        clock->clock = clock_id;
+        snprintf(labels, sizeof(labels), "thread=\"%s\"", name);
+        w_metrics_counter_fn("wazuh_thread_cpu_seconds", "CPU time used by each thread.", labels, thread_cpu_seconds, clock);
+    }
+#else
+    (void)thread;
+    (void)format;
+    (void)args;
+#endif
+}
+
+void w_thread_register(pthread_t thread, const char * format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    thread_vregister(thread, format, args);
+    va_end(args);
+}
+
 /* Create a new thread and give the argument passed to the function
  * Returns 0 on success or -1 on error
  */
@@ -71,4 +124,25 @@ int CreateThread(void * (*function_pointer)(void *), void *data)
     return 1;
 }
 
+int CreateThreadNamed(void * (*function_pointer)(void *), void *data, const char * format, ...)
+{
+    pthread_t lthread;
+    va_list args;
+
+    if (CreateThreadJoinable(&lthread, function_pointer, data) < 0) {
+        return 0;
+    }
+
+    va_start(args, format);
+    thread_vregister(lthread, format, args);
+    va_end(args);
+
+    if (pthread_detach(lthread) != 0) {
+        merror(THREAD_ERROR " Cannot detach thread.");
+        return 0;
+    }
+
+    return 1;
+}
+
 #endif /* !WIN32 */
@@ -11,6 +11,29 @@
 
 #include <shared.h>
 
+static uint64_t queue_now(void) {
+    struct timespec ts;
+
+    gettime(&ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Statistics have a single writer, the holder of the lock, and readers without it */
+static void queue_stat_add(uint64_t * stat, uint64_t n) {
+    __atomic_store_n(stat, *stat + n, __ATOMIC_RELAXED);
+}
+
+static void queue_stat_since(uint64_t * stat, const struct timespec * start) {
+    struct timespec now;
+    double elapsed;
+
+    gettime(&now);
+
+    if (elapsed = time_diff(start, &now), elapsed > 0) {
+        queue_stat_add(stat, (uint64_t)(elapsed * 1000000));
+    }
+}
+
 w_queue_t * queue_init(size_t size) {
     w_queue_t * queue;
     os_calloc(1, sizeof(w_queue_t), queue);
@@ -43,11 +66,21 @@ int queue_empty(const w_queue_t * queue) {
 
 int queue_push(w_queue_t * queue, void * data) {
     if (queue_full(queue)) {
+        queue_stat_add(&queue->stats.rejected, 1);
         return -1;
     } else {
         queue->data[queue->begin] = data;
         queue->begin = (queue->begin + 1) % queue->size;
         queue->elements++;
+
+        if (queue->elements > queue->stats.high_water) {
+            __atomic_store_n(&queue->stats.high_water, queue->elements, __ATOMIC_RELAXED);
+        }
+
+        if (queue_full(queue)) {
+            __atomic_store_n(&queue->full_since, queue_now(), __ATOMIC_RELAXED);
+        }
+
         return 0;
     }
 }
@@ -68,10 +101,18 @@ int queue_push_ex(w_queue_t * queue, void * data) {
 int queue_push_ex_block(w_queue_t * queue, void * data) {
     int result;
 
+    struct timespec start;
+
     w_mutex_lock(&queue->mutex);
 
-    while (result = queue_full(queue), result) {
-        w_cond_wait(&queue->available_not_empty, &queue->mutex);
+    if (queue_full(queue)) {
+        gettime(&start);
+
+        while (queue_full(queue)) {
+            w_cond_wait(&queue->available_not_empty, &queue->mutex);
+        }
+
+        queue_stat_since(&queue->stats.push_wait_usec, &start);
     }
 
     result = queue_push(queue,data);
@@ -93,17 +134,35 @@ void * queue_pop(w_queue_t * queue) {
         queue->data[queue->begin] = data;
         queue->end = (queue->end + 1) % queue->size;
         queue->elements--;
+
+        if (queue->full_since) {
+            uint64_t now = queue_now();
+
+            if (now > queue->full_since) {
+                queue_stat_add(&queue->stats.full_usec, now - queue->full_since);
+            }
+
+            __atomic_store_n(&queue->full_since, 0, __ATOMIC_RELAXED);
+        }
+
         return data;
     }
 }
 
 void * queue_pop_ex(w_queue_t * queue) {
+    struct timespec start;
     void * data;
 
     w_mutex_lock(&queue->mutex);
 
-    while (data = queue_pop(queue), !data) {
-        w_cond_wait(&queue->available, &queue->mutex);
+    if (data = queue_pop(queue), !data) {
+        gettime(&start);
+
+        while (data = queue_pop(queue), !data) {
+            w_cond_wait(&queue->available, &queue->mutex);
+        }
+
+        queue_stat_since(&queue->stats.pop_wait_usec, &start);
     }
 
     w_cond_signal(&queue->available_not_empty);
@@ -113,15 +172,23 @@ void * queue_pop_ex(w_queue_t * queue) {
 }
 
 void * queue_pop_ex_timedwait(w_queue_t * queue, const struct timespec * abstime) {
+    struct timespec start;
     void * data;
 
     w_mutex_lock(&queue->mutex);
 
-    while (data = queue_pop(queue), !data) {
-        if (pthread_cond_timedwait(&queue->available, &queue->mutex, abstime) != 0) {
-            w_mutex_unlock(&queue->mutex);
-            return NULL;
+    if (data = queue_pop(queue), !data) {
+        gettime(&start);
+
+        while (data = queue_pop(queue), !data) {
+            if (pthread_cond_timedwait(&queue->available, &queue->mutex, abstime) != 0) {
+                queue_stat_since(&queue->stats.pop_wait_usec, &start);
+                w_mutex_unlock(&queue->mutex);
+                return NULL;
+            }
         }
+
+        queue_stat_since(&queue->stats.pop_wait_usec, &start);
     }
 
     w_cond_signal(&queue->available_not_empty);
@@ -129,3 +196,140 @@ void * queue_pop_ex_timedwait(w_queue_t * queue, const struct timespec * abstime
 
     return data;
 }
+
+size_t queue_pop_ex_batch(w_queue_t * queue, void ** items, size_t max, const struct timespec * abstime) {
+    struct timespec start;
+    size_t n = 0;
+
+    if (max == 0) {
+        return 0;
+    }
+
+    w_mutex_lock(&queue->mutex);
+
+    if (queue_empty(queue)) {
+        gettime(&start);
+
+        while (queue_empty(queue)) {
+            if (abstime) {
+                if (pthread_cond_timedwait(&queue->available, &queue->mutex, abstime) != 0) {
+                    queue_stat_since(&queue->stats.pop_wait_usec, &start);
+                    w_mutex_unlock(&queue->mutex);
+                    return 0;
+                }
+            } else {
+                w_cond_wait(&queue->available, &queue->mutex);
+            }
+        }
+
+        queue_stat_since(&queue->stats.pop_wait_usec, &start);
+    }
+
+    while (n < max && (items[n] = queue_pop(queue), items[n])) {
+        n++;
+    }
+
+    w_cond_broadcast(&queue->available_not_empty);
+    w_mutex_unlock(&queue->mutex);
+
+    return n;
+}
+
+int queue_push_ex_batch(w_queue_t * queue, void ** items, size_t n) {
+    struct timespec start;
+    size_t i = 0;
+
+    w_mutex_lock(&queue->mutex);
+
+    while (i < n) {
+        if (queue_full(queue)) {
+            gettime(&start);
+
+            while (queue_full(queue)) {
+                // Let consumers drain what we have pushed so far
+                w_cond_broadcast(&queue->available);
+                w_cond_wait(&queue->available_not_empty, &queue->mutex);
+            }
+
+            queue_stat_since(&queue->stats.push_wait_usec, &start);
+        }
+
+        // A full queue here is a wait, not a rejection
+        while (i < n && !queue_full(queue)) {
+            queue_push(queue, items[i++]);
+        }
+    }
+
+    w_cond_broadcast(&queue->available);
+    w_mutex_unlock(&queue->mutex);
+
+    return 0;
+}
+
+void queue_get_stats(const w_queue_t * queue, w_queue_stats_t * stats) {
+    uint64_t full_since = __atomic_load_n(&queue->full_since, __ATOMIC_RELAXED);
+    uint64_t now;
+
+    stats->high_water = __atomic_load_n(&queue->stats.high_water, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&queue->stats.rejected, __ATOMIC_RELAXED);
+    stats->full_usec = __atomic_load_n(&queue->stats.full_usec, __ATOMIC_RELAXED);
+    stats->push_wait_usec = __atomic_load_n(&queue->stats.push_wait_usec, __ATOMIC_RELAXED);
+    stats->pop_wait_usec = __atomic_load_n(&queue->stats.pop_wait_usec, __ATOMIC_RELAXED);
+
+    if (full_since && (now = queue_now(), now > full_since)) {
+        stats->full_usec += now - full_since;
+    }
+}
+
+size_t queue_take_high_water(w_queue_t * queue) {
+    return __atomic_exchange_n(&queue->stats.high_water, (size_t)__atomic_load_n(&queue->elements, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+void queue_add_pop_wait(w_queue_t * queue, const struct timespec * start) {
+    queue_stat_since(&queue->stats.pop_wait_usec, start);
+}
+
+static double queue_metric_elements(void * queue) {
+    return __atomic_load_n(&((w_queue_t *)queue)->elements, __ATOMIC_RELAXED);
+}
+
+static double queue_metric_size(void * queue) {
+    return ((w_queue_t *)queue)->size - 1;
+}
+
+static double queue_metric_high_water(void * queue) {
+    return __atomic_load_n(&((w_queue_t *)queue)->stats.high_water, __ATOMIC_RELAXED);
+}
+
+static double queue_metric_rejected(void * queue) {
+    return __atomic_load_n(&((w_queue_t *)queue)->stats.rejected, __ATOMIC_RELAXED);
+}
+
+static double queue_metric_full(void * queue) {
+    w_queue_stats_t stats;
+
+    queue_get_stats(queue, &stats);
+    return stats.full_usec / 1e6;
+}
+
+static double queue_metric_push_wait(void * queue) {
+    return __atomic_load_n(&((w_queue_t *)queue)->stats.push_wait_usec, __ATOMIC_RELAXED) / 1e6;
+}
+
+static double queue_metric_pop_wait(void * queue) {
+    return __atomic_load_n(&((w_queue_t *)queue)->stats.pop_wait_usec, __ATOMIC_RELAXED) / 1e6;
+}
+
+void queue_metrics_register(w_queue_t * queue, const char * name) {
+    char labels[OS_SIZE_256];
+
+    snprintf(labels, sizeof(labels), "queue=\"%s\"", name);
+
+    w_metrics_gauge("wazuh_queue_elements", "Items waiting in the queue.", labels, queue_metric_elements, queue);
+    w_metrics_gauge("wazuh_queue_size", "Capacity of the queue.", labels, queue_metric_size, queue);
+    w_metrics_gauge("wazuh_queue_high_water", "Peak number of items in the queue.", labels, queue_metric_high_water, queue);
+    w_metrics_counter_fn("wazuh_queue_rejected", "Items refused because the queue was full.", labels, queue_metric_rejected, queue);
+    w_metrics_counter_fn("wazuh_queue_full_seconds", "Time the queue has been full.", labels, queue_metric_full, queue);
+    w_metrics_counter_fn("wazuh_queue_push_wait_seconds", "Time producers have been blocked by a full queue.", labels, queue_metric_push_wait, queue);
+    w_metrics_counter_fn("wazuh_queue_pop_wait_seconds", "Time consumers have waited on an empty queue.", labels, queue_metric_pop_wait, queue);
+}
@@ -0,0 +1,632 @@
+/*
+ * Adaptive radix tree
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+
+/* Keys are stored with their terminator, so no key is a prefix of another
+ * and a leaf is always at the end of a path. Inner nodes keep the whole
+ * prefix that their keys share after the byte of their parent, right after
+ * the node structure. A leaf is tagged in the lowest bit of its pointer. */
+
+enum { RADIX_NODE4, RADIX_NODE16, RADIX_NODE48, RADIX_NODE256 };
+
+struct radix_node {
+    uint8_t type;
+    uint16_t count;                     // Number of children
+    uint32_t prefix_len;
+};
+
+typedef struct radix_node4 {
+    radix_node node;
+    unsigned char keys[4];              // Sorted
+    radix_node * children[4];
+} radix_node4;
+
+typedef struct radix_node16 {
+    radix_node node;
+    unsigned char keys[16];             // Sorted
+    radix_node * children[16];
+} radix_node16;
+
+typedef struct radix_node48 {
+    radix_node node;
+    unsigned char index[256];           // Slot of each byte plus one, 0 if none
+    radix_node * children[48];
+} radix_node48;
+
+typedef struct radix_node256 {
+    radix_node node;
+    radix_node * children[256];
+} radix_node256;
+
+typedef struct radix_leaf {
+    void * value;
+    size_t length;                      // Including the terminator
+    char key[];
+} radix_leaf;
+
+#define IS_LEAF(x) ((uintptr_t)(x) & 1)
+#define LEAF(x) ((radix_leaf *)((uintptr_t)(x) & ~(uintptr_t)1))
+#define TAG_LEAF(x) ((radix_node *)((uintptr_t)(x) | 1))
+
+static const size_t node_sizes[] = { sizeof(radix_node4), sizeof(radix_node16), sizeof(radix_node48), sizeof(radix_node256) };
+static const unsigned int node_capacity[] = { 4, 16, 48, 256 };
+
+static inline unsigned char * node_prefix(radix_node * node) {
+    return (unsigned char *)node + node_sizes[node->type];
+}
+
+static radix_node * node_alloc(int type, const unsigned char * prefix, uint32_t prefix_len) {
+    radix_node * node;
+
+    os_calloc(1, node_sizes[type] + prefix_len, node);
+    node->type = type;
+    node->prefix_len = prefix_len;
+
+    if (prefix_len) {
+        memcpy(node_prefix(node), prefix, prefix_len);
+    }
+
+    return node;
+}
+
+/* Get the slot of the child at a byte, or NULL */
+static radix_node ** node_find(radix_node * node, unsigned char byte) {
+    unsigned char * keys;
+    radix_node ** children;
+    unsigned int i;
+
+    switch (node->type) {
+    case RADIX_NODE4:
+        keys = ((radix_node4 *)node)->keys;
+        children = ((radix_node4 *)node)->children;
+        break;
+
+    case RADIX_NODE16:
+        keys = ((radix_node16 *)node)->keys;
+        children = ((radix_node16 *)node)->children;
+        break;
+
+    case RADIX_NODE48:
+        i = ((radix_node48 *)node)->index[byte];
+        return i ? &((radix_node48 *)node)->children[i - 1] : NULL;
+
+    default:
+        return ((radix_node256 *)node)->children[byte] ? &((radix_node256 *)node)->children[byte] : NULL;
+    }
+
+    for (i = 0; i < node->count && keys[i] <= byte; i++) {
+        if (keys[i] == byte) {
+            return &children[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Iterate the children of a node in key order, starting with *pos = 0 */
+static radix_node * node_next(radix_node * node, unsigned int * pos, unsigned char * byte) {
+    radix_node48 * node48;
+    radix_node256 * node256;
+
+    switch (node->type) {
+    case RADIX_NODE4:
+        if (*pos < node->count) {
+            *byte = ((radix_node4 *)node)->keys[*pos];
+            return ((radix_node4 *)node)->children[(*pos)++];
+        }
+        break;
+
+    case RADIX_NODE16:
+        if (*pos < node->count) {
+            *byte = ((radix_node16 *)node)->keys[*pos];
+            return ((radix_node16 *)node)->children[(*pos)++];
+        }
+        break;
+
+    case RADIX_NODE48:
+        node48 = (radix_node48 *)node;
+
+        for (; *pos < 256; (*pos)++) {
+            if (node48->index[*pos]) {
+                *byte = *pos;
+                return node48->children[node48->index[(*pos)++] - 1];
+            }
+        }
+        break;
+
+    default:
+        node256 = (radix_node256 *)node;
+
+        for (; *pos < 256; (*pos)++) {
+            if (node256->children[*pos]) {
+                *byte = *pos;
+                return node256->children[(*pos)++];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void sorted_insert(unsigned char * keys, radix_node ** children, unsigned int count, unsigned char byte, radix_node * child) {
+    unsigned int i;
+
+    for (i = count; i > 0 && keys[i - 1] > byte; i--) {
+        keys[i] = keys[i - 1];
+        children[i] = children[i - 1];
+    }
+
+    keys[i] = byte;
+    children[i] = child;
+}
+
+static void sorted_remove(unsigned char * keys, radix_node ** children, unsigned int count, unsigned char byte) {
+    unsigned int i;
+
+    for (i = 0; keys[i] != byte; i++);
+
+    memmove(keys + i, keys + i + 1, count - i - 1);
+    memmove(children + i, children + i + 1, (count - i - 1) * sizeof(radix_node *));
+}
+
+/* Add a child to a node that has room for it */
+static void node_append(radix_node * node, unsigned char byte, radix_node * child) {
+    radix_node48 * node48;
+    unsigned int i;
+
+    switch (node->type) {
+    case RADIX_NODE4:
+        sorted_insert(((radix_node4 *)node)->keys, ((radix_node4 *)node)->children, node->count, byte, child);
+        break;
+
+    case RADIX_NODE16:
+        sorted_insert(((radix_node16 *)node)->keys, ((radix_node16 *)node)->children, node->count, byte, child);
+        break;
+
+    case RADIX_NODE48:
+        node48 = (radix_node48 *)node;
+
+        for (i = 0; node48->children[i]; i++);
+
+        node48->children[i] = child;
+        node48->index[byte] = i + 1;
+        break;
+
+    default:
+        ((radix_node256 *)node)->children[byte] = child;
+    }
+
+    node->count++;
+}
+
+/* Move the children and the prefix of a node into a node of another type */
+static radix_node * node_resize(radix_node * node, int type) {
+    radix_node * resized = node_alloc(type, node_prefix(node), node->prefix_len);
+    radix_node * child;
+    unsigned int pos = 0;
+    unsigned char byte;
+
+    while (child = node_next(node, &pos, &byte), child) {
+        node_append(resized, byte, child);
+    }
+
+    free(node);
+    return resized;
+}
+
+/* Add a child to the node at a slot, growing it if it's full */
+static void node_add(radix_node ** ref, unsigned char byte, radix_node * child) {
+    radix_node * node = *ref;
+
+    if (node->count == node_capacity[node->type]) {
+        node = *ref = node_resize(node, node->type + 1);
+    }
+
+    node_append(node, byte, child);
+}
+
+/* Remove a child from the node at a slot, shrinking it if it has few left */
+static void node_remove(radix_node ** ref, unsigned char byte) {
+    radix_node * node = *ref;
+    radix_node48 * node48;
+    radix_node * child;
+    unsigned char * prefix;
+    uint32_t prefix_len;
+
+    switch (node->type) {
+    case RADIX_NODE4:
+        sorted_remove(((radix_node4 *)node)->keys, ((radix_node4 *)node)->children, node->count, byte);
+        break;
+
+    case RADIX_NODE16:
+        sorted_remove(((radix_node16 *)node)->keys, ((radix_node16 *)node)->children, node->count, byte);
+        break;
+
+    case RADIX_NODE48:
+        node48 = (radix_node48 *)node;
+        node48->children[node48->index[byte] - 1] = NULL;
+        node48->index[byte] = 0;
+        break;
+
+    default:
+        ((radix_node256 *)node)->children[byte] = NULL;
+    }
+
+    node->count--;
+
+    switch (node->type) {
+    case RADIX_NODE4:
+        if (node->count > 1) {
+            break;
+        }
+
+        if (node->count == 0) {
+            *ref = NULL;
+            free(node);
+            break;
+        }
+
+        /* A single child takes the place of the node, along with its prefix and byte */
+        byte = ((radix_node4 *)node)->keys[0];
+        child = ((radix_node4 *)node)->children[0];
+
+        if (!IS_LEAF(child)) {
+            prefix_len = node->prefix_len + 1 + child->prefix_len;
+            os_realloc(child, node_sizes[child->type] + prefix_len, child);
+            prefix = node_prefix(child);
+            memmove(prefix + node->prefix_len + 1, prefix, child->prefix_len);
+            memcpy(prefix, node_prefix(node), node->prefix_len);
+            prefix[node->prefix_len] = byte;
+            child->prefix_len = prefix_len;
+        }
+
+        *ref = child;
+        free(node);
+        break;
+
+    case RADIX_NODE16:
+        if (node->count <= 3) {
+            *ref = node_resize(node, RADIX_NODE4);
+        }
+        break;
+
+    case RADIX_NODE48:
+        if (node->count <= 12) {
+            *ref = node_resize(node, RADIX_NODE16);
+        }
+        break;
+
+    default:
+        if (node->count <= 37) {
+            *ref = node_resize(node, RADIX_NODE48);
+        }
+    }
+}
+
+/* Free a subtree, handing each key to a callback. Returns the number of keys */
+static unsigned int node_free(radix_tree * tree, radix_node * node, void (*callback)(const char *, void *, void *), void * arg) {
+    radix_node * child;
+    unsigned int count = 0;
+    unsigned int pos = 0;
+    unsigned char byte;
+
+    if (!node) {
+        return 0;
+    }
+
+    if (IS_LEAF(node)) {
+        radix_leaf * leaf = LEAF(node);
+
+        if (callback) {
+            callback(leaf->key, leaf->value, arg);
+        }
+
+        if (tree->dispose) {
+            tree->dispose(leaf->value);
+        }
+
+        free(leaf);
+        return 1;
+    }
+
+    while (child = node_next(node, &pos, &byte), child) {
+        count += node_free(tree, child, callback, arg);
+    }
+
+    free(node);
+    return count;
+}
+
+/* Visit the keys of a subtree in order. Returns non-zero if the callback stopped */
+static int node_walk(radix_node * node, int (*callback)(const char *, void *, void *), void * arg, unsigned int * count) {
+    radix_node * child;
+    unsigned int pos = 0;
+    unsigned char byte;
+
+    if (IS_LEAF(node)) {
+        (*count)++;
+        return callback(LEAF(node)->key, LEAF(node)->value, arg);
+    }
+
+    while (child = node_next(node, &pos, &byte), child) {
+        if (node_walk(child, callback, arg, count)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Get the slot of the subtree whose keys start with a prefix, and the slot of its parent node */
+static radix_node ** find_prefix(radix_node ** ref, const char * prefix, radix_node *** parent, unsigned char * byte) {
+    const unsigned char * key = (const unsigned char *)prefix;
+    size_t length = strlen(prefix);
+    size_t depth = 0;
+    radix_node ** slot;
+    radix_node * node;
+    unsigned char * node_key;
+    uint32_t i;
+
+    *parent = NULL;
+
+    while (node = *ref, node) {
+        if (IS_LEAF(node)) {
+            return strncmp(LEAF(node)->key, prefix, length) == 0 ? ref : NULL;
+        }
+
+        node_key = node_prefix(node);
+
+        for (i = 0; i < node->prefix_len; i++) {
+            if (depth + i == length) {
+                return ref;
+            }
+
+            if (node_key[i] != key[depth + i]) {
+                return NULL;
+            }
+        }
+
+        depth += node->prefix_len;
+
+        if (depth == length) {
+            return ref;
+        }
+
+        if (slot = node_find(node, key[depth]), !slot) {
+            return NULL;
+        }
+
+        *parent = ref;
+        *byte = key[depth++];
+        ref = slot;
+    }
+
+    return NULL;
+}
+
+radix_tree * radix_init() {
+    radix_tree * tree;
+    os_calloc(1, sizeof(radix_tree), tree);
+    return tree;
+}
+
+void radix_destroy(radix_tree * tree) {
+    if (tree == NULL) {
+        return;
+    }
+
+    node_free(tree, tree->root, NULL, NULL);
+    free(tree);
+}
+
+void radix_set_dispose(radix_tree * tree, void (*dispose)(void *)) {
+    tree->dispose = dispose;
+}
+
+void * radix_insert(radix_tree * tree, const char * key, void * value) {
+    const unsigned char * bytes = (const unsigned char *)key;
+    radix_node ** ref = &tree->root;
+    radix_node ** slot;
+    radix_node * node;
+    radix_node * split;
+    radix_leaf * leaf;
+    radix_leaf * other;
+    unsigned char * prefix;
+    size_t length = strlen(key) + 1;
+    size_t depth = 0;
+    size_t common;
+    unsigned char byte;
+    uint32_t i;
+
+    os_malloc(sizeof(radix_leaf) + length, leaf);
+    leaf->value = value;
+    leaf->length = length;
+    memcpy(leaf->key, key, length);
+
+    while (node = *ref, node) {
+        if (IS_LEAF(node)) {
+            other = LEAF(node);
+
+            if (other->length == length && memcmp(other->key, key, length) == 0) {
+                free(leaf);
+                return NULL;
+            }
+
+            /* Both keys end in a terminator, so they differ before the end of any of them */
+            for (common = 0; (unsigned char)other->key[depth + common] == bytes[depth + common]; common++);
+
+            split = node_alloc(RADIX_NODE4, bytes + depth, common);
+            node_append(split, other->key[depth + common], node);
+            node_append(split, bytes[depth + common], TAG_LEAF(leaf));
+            *ref = split;
+            goto inserted;
+        }
+
+        prefix = node_prefix(node);
+
+        for (i = 0; i < node->prefix_len && prefix[i] == bytes[depth + i]; i++);
+
+        if (i < node->prefix_len) {
+            /* The key leaves the prefix: a new node takes the shared part */
+            split = node_alloc(RADIX_NODE4, prefix, i);
+            byte = prefix[i];
+            memmove(prefix, prefix + i + 1, node->prefix_len - i - 1);
+            node->prefix_len -= i + 1;
+
+            node_append(split, byte, node);
+            node_append(split, bytes[depth + i], TAG_LEAF(leaf));
+            *ref = split;
+            goto inserted;
+        }
+
+        depth += node->prefix_len;
+
+        if (slot = node_find(node, bytes[depth]), !slot) {
+            node_add(ref, bytes[depth], TAG_LEAF(leaf));
+            goto inserted;
+        }
+
+        ref = slot;
+        depth++;
+    }
+
+    *ref = TAG_LEAF(leaf);
+
+inserted:
+    tree->size++;
+    return value;
+}
+
+void * radix_get(const radix_tree * tree, const char * key) {
+    const unsigned char * bytes = (const unsigned char *)key;
+    radix_node * node = tree->root;
+    radix_node ** slot;
+    radix_leaf * leaf;
+    size_t length = strlen(key) + 1;
+    size_t depth = 0;
+
+    while (node) {
+        if (IS_LEAF(node)) {
+            leaf = LEAF(node);
+            return leaf->length == length && memcmp(leaf->key, key, length) == 0 ? leaf->value : NULL;
+        }
+
+        if (depth + node->prefix_len >= length || memcmp(node_prefix(node), bytes + depth, node->prefix_len) != 0) {
+            return NULL;
+        }
+
+        depth += node->prefix_len;
+
+        if (slot = node_find(node, bytes[depth]), !slot) {
+            return NULL;
+        }
+
+        node = *slot;
+        depth++;
+    }
+
+    return NULL;
+}
+
+int radix_delete(radix_tree * tree, const char * key) {
+    const unsigned char * bytes = (const unsigned char *)key;
+    radix_node ** ref = &tree->root;
+    radix_node ** parent = NULL;
+    radix_node ** slot;
+    radix_node * node;
+    radix_leaf * leaf;
+    size_t length = strlen(key) + 1;
+    size_t depth = 0;
+    unsigned char byte = 0;
+
+    while (node = *ref, node) {
+        if (IS_LEAF(node)) {
+            leaf = LEAF(node);
+
+            if (leaf->length != length || memcmp(leaf->key, key, length) != 0) {
+                return 0;
+            }
+
+            if (parent) {
+                node_remove(parent, byte);
+            } else {
+                tree->root = NULL;
+            }
+
+            if (tree->dispose) {
+                tree->dispose(leaf->value);
+            }
+
+            free(leaf);
+            tree->size--;
+            return 1;
+        }
+
+        if (depth + node->prefix_len >= length || memcmp(node_prefix(node), bytes + depth, node->prefix_len) != 0) {
+            return 0;
+        }
+
+        depth += node->prefix_len;
+
+        if (slot = node_find(node, bytes[depth]), !slot) {
+            return 0;
+        }
+
+        parent = ref;
+        byte = bytes[depth++];
+        ref = slot;
+    }
+
+    return 0;
+}
+
+unsigned int radix_walk_prefix(const radix_tree * tree, const char * prefix, int (*callback)(const char * key, void * value, void * arg), void * arg) {
+    radix_node * root = tree->root;
+    radix_node ** parent;
+    radix_node ** ref;
+    unsigned int count = 0;
+    unsigned char byte;
+
+    if (ref = find_prefix(&root, prefix, &parent, &byte), ref) {
+        node_walk(*ref, callback, arg, &count);
+    }
+
+    return count;
+}
+
+unsigned int radix_delete_prefix(radix_tree * tree, const char * prefix, void (*callback)(const char * key, void * value, void * arg), void * arg) {
+    radix_node ** parent;
+    radix_node ** ref;
+    radix_node * subtree;
+    unsigned int count;
+    unsigned char byte;
+
+    if (ref = find_prefix(&tree->root, prefix, &parent, &byte), !ref) {
+        return 0;
+    }
+
+    subtree = *ref;
+
+    if (parent) {
+        node_remove(parent, byte);
+    } else {
+        tree->root = NULL;
+    }
+
+    count = node_free(tree, subtree, callback, arg);
+    tree->size -= count;
+    return count;
+}
+
+unsigned int radix_size(const radix_tree * tree) {
+    return tree->size;
+}
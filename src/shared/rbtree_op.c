@@ -550,6 +550,33 @@ void * rbtree_get(const rb_tree * tree, const char * key) {
     return node ? node->value : NULL;
 }
 
+// Retrieve the value of the least key not less than a given key
+
+void * rbtree_ceiling(const rb_tree * tree, const char * key) {
+    assert(tree != NULL);
+    assert(key != NULL);
+
+    rb_node * ceiling = NULL;
+    rb_node * node = tree->root;
+
+    while (node != NULL) {
+        int cmp = strcmp(key, node->key);
+
+        if (cmp == 0) {
+            return node->value;
+        }
+
+        if (cmp < 0) {
+            ceiling = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    return ceiling ? ceiling->value : NULL;
+}
+
 // Remove a value from the tree
 
 int rbtree_delete(rb_tree * tree, const char * key) {
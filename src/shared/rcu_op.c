@@ -0,0 +1,156 @@
+/*
+ * Read-copy-update with registered readers
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 14, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+
+// Milliseconds between checks while waiting for the readers
+#define RCU_WAIT_DELAY 1
+
+// Thread domain
+static w_rcu_thread_slot_t * rcu_thread_slots;
+static unsigned long rcu_thread_generation = 1;
+static pthread_mutex_t rcu_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t rcu_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rcu_thread_key;
+static __thread w_rcu_thread_slot_t * rcu_thread_slot;
+
+static w_rcu_thread_slot_t * w_rcu_thread_register(void);
+
+w_rcu_t * w_rcu_init(unsigned int n_readers) {
+    w_rcu_t * rcu;
+
+    os_calloc(1, sizeof(w_rcu_t), rcu);
+    os_calloc(n_readers ? n_readers : 1, sizeof(w_rcu_slot_t), rcu->slots);
+
+    rcu->n_readers = n_readers;
+    rcu->generation = 1;
+    w_mutex_init(&rcu->mutex, NULL);
+    return rcu;
+}
+
+void w_rcu_free(w_rcu_t * rcu) {
+    if (rcu) {
+        free(rcu->slots);
+        w_mutex_destroy(&rcu->mutex);
+        free(rcu);
+    }
+}
+
+void w_rcu_read_lock(w_rcu_t * rcu, unsigned int reader) {
+    __atomic_store_n(&rcu->slots[reader].generation, __atomic_load_n(&rcu->generation, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+    // The slot must be visible before reading any protected pointer
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void w_rcu_read_unlock(w_rcu_t * rcu, unsigned int reader) {
+    __atomic_store_n(&rcu->slots[reader].generation, 0, __ATOMIC_RELEASE);
+}
+
+void w_rcu_synchronize(w_rcu_t * rcu) {
+    unsigned long target;
+    unsigned long current;
+    unsigned int i;
+
+    w_mutex_lock(&rcu->mutex);
+
+    // Also orders the writer's previous stores before reading the slots
+    target = __atomic_add_fetch(&rcu->generation, 1, __ATOMIC_SEQ_CST);
+
+    for (i = 0; i < rcu->n_readers; i++) {
+        // Readers that entered after the increment can only see the new version
+        while (current = __atomic_load_n(&rcu->slots[i].generation, __ATOMIC_ACQUIRE), current != 0 && current < target) {
+            w_time_delay(RCU_WAIT_DELAY);
+        }
+    }
+
+    w_mutex_unlock(&rcu->mutex);
+}
+
+void w_rcu_thread_read_lock(void) {
+    w_rcu_thread_slot_t * slot = rcu_thread_slot;
+
+    if (!slot) {
+        slot = w_rcu_thread_register();
+    }
+
+    if (slot->depth++ == 0) {
+        __atomic_store_n(&slot->generation, __atomic_load_n(&rcu_thread_generation, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+void w_rcu_thread_read_unlock(void) {
+    w_rcu_thread_slot_t * slot = rcu_thread_slot;
+
+    if (--slot->depth == 0) {
+        __atomic_store_n(&slot->generation, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void w_rcu_thread_synchronize(void) {
+    w_rcu_thread_slot_t * slot;
+    unsigned long target;
+    unsigned long current;
+
+    w_mutex_lock(&rcu_thread_mutex);
+
+    target = __atomic_add_fetch(&rcu_thread_generation, 1, __ATOMIC_SEQ_CST);
+
+    for (slot = __atomic_load_n(&rcu_thread_slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+        while (current = __atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE), current != 0 && current < target) {
+            w_time_delay(RCU_WAIT_DELAY);
+        }
+    }
+
+    w_mutex_unlock(&rcu_thread_mutex);
+}
+
+// The slot of a finished thread is left for another one
+static void w_rcu_thread_release(void * arg) {
+    w_rcu_thread_slot_t * slot = arg;
+
+    __atomic_store_n(&slot->generation, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void w_rcu_thread_key_init(void) {
+    pthread_key_create(&rcu_thread_key, w_rcu_thread_release);
+}
+
+// Slots are never freed, so the writers may walk the list without locking it
+static w_rcu_thread_slot_t * w_rcu_thread_register(void) {
+    w_rcu_thread_slot_t * slot;
+    int free_slot;
+
+    pthread_once(&rcu_thread_once, w_rcu_thread_key_init);
+
+    for (slot = __atomic_load_n(&rcu_thread_slots, __ATOMIC_ACQUIRE); slot; slot = slot->next) {
+        free_slot = 0;
+
+        if (__atomic_compare_exchange_n(&slot->in_use, &free_slot, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!slot) {
+        os_calloc(1, sizeof(w_rcu_thread_slot_t), slot);
+        slot->in_use = 1;
+        slot->next = __atomic_load_n(&rcu_thread_slots, __ATOMIC_RELAXED);
+
+        while (!__atomic_compare_exchange_n(&rcu_thread_slots, &slot->next, slot, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    slot->depth = 0;
+    pthread_setspecific(rcu_thread_key, slot);
+    rcu_thread_slot = slot;
+    return slot;
+}
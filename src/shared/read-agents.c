@@ -14,6 +14,15 @@
 #include "wazuhdb_op.h"
 
 #ifndef WIN32
+#include "wazuh_db/wdb.h"
+
+/* Seconds that the keepalives read from the global database are reused */
+#define KEEPALIVE_CACHE_TIME 10
+
+static OSHash *keepalive_cache;
+static time_t keepalive_cache_time;
+
+static time_t _get_agent_keepalive_db(const char *agent_file) __attribute__((nonnull));
 static int _do_print_attrs_syscheck(const char *prev_attrs, const char *attrs, int csv_output, cJSON *json_output,
                                     int is_win, int number_of_changes) __attribute__((nonnull(2)));
 static int _do_print_file_syscheck(FILE *fp, const char *fname, int update_counter,
@@ -1228,9 +1237,40 @@ agent_info *get_agent_info(const char *agent_name, const char *agent_ip, const c
 }
 #endif
 
+#ifndef WIN32
+/* Get the last keepalive of an agent from the global database, or 0 if it is
+ * unknown. The database is synchronized from the agent-info files, so it is
+ * never newer than the time of the file. A single query serves every agent.
+ */
+static time_t _get_agent_keepalive_db(const char *agent_file)
+{
+    time_t now = time(0);
+    time_t *keepalive;
+
+    if (!keepalive_cache || now - keepalive_cache_time >= KEEPALIVE_CACHE_TIME) {
+        if (keepalive_cache) {
+            OSHash_Free(keepalive_cache);
+        }
+
+        if (keepalive_cache = wdb_get_agents_keepalive(), !keepalive_cache) {
+            mdebug1("Cannot read the agent keepalives from the global database.");
+        }
+
+        keepalive_cache_time = now;
+    }
+
+    if (!keepalive_cache || (keepalive = OSHash_Get(keepalive_cache, agent_file), !keepalive)) {
+        return 0;
+    }
+
+    return *keepalive;
+}
+#endif
+
 /* Gets the status of an agent, based on the name / IP address */
 agent_status_t get_agent_status(const char *agent_name, const char *agent_ip)
 {
+    char agent_file[OS_SIZE_512];
     char tmp_file[513];
     char *agent_ip_pt = NULL;
     struct stat file_status;
@@ -1247,13 +1287,24 @@ agent_status_t get_agent_status(const char *agent_name, const char *agent_ip)
         *agent_ip_pt = '\0';
     }
 
-    snprintf(tmp_file, 512, "%s/%s-%s", AGENTINFO_DIR, agent_name, agent_ip);
+    snprintf(agent_file, sizeof(agent_file), "%s-%s", agent_name, agent_ip);
 
     /* Set back the IP address */
     if (agent_ip_pt) {
         *agent_ip_pt = '/';
     }
 
+#ifndef WIN32
+    /* A recent keepalive in the database is enough. Otherwise, the file may
+     * be newer, so it has the last word.
+     */
+    if (_get_agent_keepalive_db(agent_file) >= time(0) - DISCON_TIME) {
+        return (GA_STATUS_ACTIVE);
+    }
+#endif
+
+    snprintf(tmp_file, 512, "%s/%s", AGENTINFO_DIR, agent_file);
+
     if (stat(tmp_file, &file_status) < 0) {
         return (GA_STATUS_INV);
     }
@@ -1300,13 +1351,24 @@ char **get_agents(int flag,int mon_time)
 
         if (flag != GA_ALL) {
             struct stat file_status;
+            time_t now = time(0);
+            time_t keepalive = 0;
+
+#ifndef WIN32
+            keepalive = _get_agent_keepalive_db(entry->d_name);
+#endif
 
-            if (stat(tmp_file, &file_status) < 0) {
+            /* The file is at least as recent as the database, so a keepalive
+             * that passes both checks below takes the same decisions.
+             */
+            if (keepalive > now - DISCON_TIME && (flag != GA_NOTACTIVE || mon_time <= 0 || keepalive >= now - mon_time * 60)) {
+                file_status.st_mtime = keepalive;
+            } else if (stat(tmp_file, &file_status) < 0) {
                 continue;
             }
 
-            if( !(flag == GA_NOTACTIVE && (file_status.st_mtime < (time(0) - (mon_time * 60)) && mon_time > 0))) {
-                if (file_status.st_mtime > (time(0) - DISCON_TIME)) {
+            if( !(flag == GA_NOTACTIVE && (file_status.st_mtime < (now - (mon_time * 60)) && mon_time > 0))) {
+                if (file_status.st_mtime > (now - DISCON_TIME)) {
                     status = 1;
                     if (flag == GA_NOTACTIVE) {
                         continue;
@@ -1351,7 +1413,6 @@ time_t scantime_fim (const char *agent_id, const char *scan) {
     char *response = NULL;
     char *message;
     time_t ts = -1;
-    int wdb_socket = -1;
 
     os_calloc(OS_SIZE_6144 + 1, sizeof(char), wazuhdb_query);
     os_calloc(OS_SIZE_6144, sizeof(char), response);
@@ -1360,7 +1421,7 @@ time_t scantime_fim (const char *agent_id, const char *scan) {
             agent_id, scan
     );
 
-    if (wdbc_query_ex(&wdb_socket, wazuhdb_query, response, OS_SIZE_6144) == 0) {
+    if (wdbc_pool_query(wdbc_pool_default(), wazuhdb_query, response, OS_SIZE_6144) == 0) {
         if (wdbc_parse_result(response, &message) == WDBC_OK) {
             ts = atol(message);
             mdebug2("Agent '%s' FIM '%s' timestamp:'%ld'", agent_id, scan, (long int)ts);
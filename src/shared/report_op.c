@@ -17,10 +17,35 @@ static void _os_header_print(int t, const char *hname) __attribute__((nonnull));
 static int _os_report_str_int_compare(const char *str, int id) __attribute__((nonnull));
 static int _os_report_check_filters(const alert_data *al_data, const report_filter *r_filter) __attribute__((nonnull));
 static int _report_filter_value(const char *filter_by, int prev_filter) __attribute__((nonnull));
-static int _os_report_print_related(int print_related, OSList *st_data) __attribute__((nonnull));
-static int _os_report_add_tostore(const char *key, OSStore *top, void *data) __attribute__((nonnull(1, 2)));
+static int _os_report_related_line(int relation, const alert_data *al_data, char *line, size_t size) __attribute__((nonnull));
+static int _os_report_add_tostore(const char *key, OSStore *top, const alert_data *al_data, int related, OSHash *seen) __attribute__((nonnull(1, 2, 3)));
 static FILE *__g_rtype = NULL;
 
+/* Related fields, in the order they are printed */
+static const int REPORT_RELATIONS[] = {
+    REPORT_REL_LOCATION,
+    REPORT_REL_SRCIP,
+    REPORT_REL_USER,
+    REPORT_REL_RULE,
+    REPORT_REL_GROUP,
+    REPORT_REL_LEVEL,
+    REPORT_REL_FILE
+};
+
+#define REPORT_RELATIONS_SIZE (sizeof(REPORT_RELATIONS) / sizeof(REPORT_RELATIONS[0]))
+
+/* Rows of the table of related values already seen */
+#define REPORT_SEEN_SIZE 65536
+
+/* Totals of a top entry. The alerts are not kept: only their count and
+ * the distinct related values, in the order they first appeared.
+ */
+typedef struct report_top_t {
+    int count;
+    char **related[REPORT_RELATIONS_SIZE];
+    size_t related_size[REPORT_RELATIONS_SIZE];
+} report_top_t;
+
 
 static void l_print_out(const char *msg, ...)
 {
@@ -42,11 +67,11 @@ static void l_print_out(const char *msg, ...)
  */
 static void *_os_report_sort_compare(void *d1, void *d2)
 {
-    OSList *d1l = (OSList *)d1;
-    OSList *d2l = (OSList *)d2;
+    report_top_t *d1t = (report_top_t *)d1;
+    report_top_t *d2t = (report_top_t *)d2;
 
-    if (d1l->currently_size > d2l->currently_size) {
-        return d1l;
+    if (d1t->count > d2t->count) {
+        return d1t;
     }
 
     return NULL;
@@ -199,114 +224,89 @@ static int _report_filter_value(const char *filter_by, int prev_filter)
     }
 }
 
-/* Print related entries */
-static int _os_report_print_related(int print_related, OSList *st_data)
+/* Print the related value of an alert, as it's shown in the report.
+ * Returns 0 if the alert has no such value.
+ */
+static int _os_report_related_line(int relation, const alert_data *al_data, char *line, size_t size)
 {
-    OSListNode *list_entry;
-    alert_data *list_aldata;
-    alert_data *saved_aldata;
-
-    list_entry = OSList_GetFirstNode(st_data);
-    while (list_entry) {
-        saved_aldata = (alert_data *)list_entry->data;
-
-        /* Remove duplicates */
-        list_entry = list_entry->prev;
-        while (list_entry) {
-            if (print_related & REPORT_REL_LOCATION) {
-                list_aldata = (alert_data *)list_entry->data;
-                if (strcmp(list_aldata->location, saved_aldata->location) == 0) {
-                    break;
-                }
-            }
-
-            else if (print_related & REPORT_REL_GROUP) {
-                list_aldata = (alert_data *)list_entry->data;
-                if (strcmp(list_aldata->group, saved_aldata->group) == 0) {
-                    break;
-                }
-            }
-
-            else if (print_related & REPORT_REL_RULE) {
-                list_aldata = (alert_data *)list_entry->data;
-                if (list_aldata->rule == saved_aldata->rule) {
-                    break;
-                }
-            }
+    switch (relation) {
+    case REPORT_REL_LOCATION:
+        snprintf(line, size, "   location: '%s'", al_data->location);
+        return 1;
+    case REPORT_REL_GROUP:
+        snprintf(line, size, "   group: '%s'", al_data->group);
+        return 1;
+    case REPORT_REL_RULE:
+        snprintf(line, size, "   rule: '%d'", al_data->rule);
+        return 1;
+    case REPORT_REL_SRCIP:
+        if (!al_data->srcip) {
+            return 0;
+        }
+        snprintf(line, size, "   srcip: '%s'", al_data->srcip);
+        return 1;
+    case REPORT_REL_USER:
+        if (!al_data->user) {
+            return 0;
+        }
+        snprintf(line, size, "   user: '%s'", al_data->user);
+        return 1;
+    case REPORT_REL_LEVEL:
+        snprintf(line, size, "   level: '%d'", al_data->level);
+        return 1;
+    case REPORT_REL_FILE:
+        if (!al_data->filename) {
+            return 0;
+        }
+        snprintf(line, size, "   filename: '%s'", al_data->filename);
+        return 1;
+    default:
+        return 0;
+    }
+}
 
-            else if (print_related & REPORT_REL_USER) {
-                list_aldata = (alert_data *)list_entry->data;
-                if (list_aldata->user == NULL || saved_aldata->user == NULL) {
-                } else if (strcmp(list_aldata->user, saved_aldata->user) == 0) {
-                    break;
-                }
-            }
+/* Count the alert on its top entry, and save the related values not seen before.
+ * The keys of seen are the top entry and the line of each value.
+ */
+static int _os_report_add_tostore(const char *key, OSStore *top, const alert_data *al_data, int related, OSHash *seen)
+{
+    report_top_t *top_data;
+    char line[OS_SIZE_1024];
+    char *seen_key;
+    size_t i;
 
-            else if (print_related & REPORT_REL_SRCIP) {
-                list_aldata = (alert_data *)list_entry->data;
-                if (list_aldata->srcip == NULL || saved_aldata->srcip == NULL) {
-                } else if (strcmp(list_aldata->srcip, saved_aldata->srcip) == 0) {
-                    break;
-                }
-            }
+    /* Add data to the hash */
+    top_data = (report_top_t *) OSStore_Get(top, key);
+    if (!top_data) {
+        os_calloc(1, sizeof(report_top_t), top_data);
 
-            else if (print_related & REPORT_REL_LEVEL) {
-                list_aldata = (alert_data *)list_entry->data;
-                if (list_aldata->level == saved_aldata->level) {
-                    break;
-                }
-            } else if (print_related & REPORT_REL_FILE) {
-                list_aldata = (alert_data *)list_entry->data;
-                if (list_aldata->filename == NULL || saved_aldata->filename == NULL) {
-                } else if (strcmp(list_aldata->filename, saved_aldata->filename) == 0) {
-                    break;
-                }
-            }
-            list_entry = list_entry->prev;
-        }
-
-        if (!list_entry) {
-            if (print_related & REPORT_REL_LOCATION) {
-                l_print_out("   location: '%s'", saved_aldata->location);
-            } else if (print_related & REPORT_REL_GROUP) {
-                l_print_out("   group: '%s'", saved_aldata->group);
-            } else if (print_related & REPORT_REL_RULE) {
-                l_print_out("   rule: '%d'", saved_aldata->rule);
-            } else if ((print_related & REPORT_REL_SRCIP) && saved_aldata->srcip) {
-                l_print_out("   srcip: '%s'", saved_aldata->srcip);
-            } else if ((print_related & REPORT_REL_USER) && saved_aldata->user) {
-                l_print_out("   user: '%s'", saved_aldata->user);
-            } else if (print_related & REPORT_REL_LEVEL) {
-                l_print_out("   level: '%d'", saved_aldata->level);
-            } else if ((print_related & REPORT_REL_FILE) && saved_aldata->filename) {
-                l_print_out("   filename: '%s'", saved_aldata->filename);
-            }
+        if (!OSStore_Put(top, key, top_data)) {
+            free(top_data);
+            return 0;
         }
+    }
+
+    top_data->count++;
 
-        list_entry = OSList_GetNextNode(st_data);
+    if (!related || !seen) {
+        return 1;
     }
 
-    return 0;
-}
+    for (i = 0; i < REPORT_RELATIONS_SIZE; i++) {
+        if (!(related & REPORT_RELATIONS[i]) || !_os_report_related_line(REPORT_RELATIONS[i], al_data, line, sizeof(line))) {
+            continue;
+        }
 
-/* Add the entry to the hash */
-static int _os_report_add_tostore(const char *key, OSStore *top, void *data)
-{
-    OSList *top_list;
+        os_malloc(strlen(key) + strlen(line) + 2, seen_key);
+        sprintf(seen_key, "%s\n%s", key, line);
 
-    /* Add data to the hash */
-    top_list = (OSList *) OSStore_Get(top, key);
-    if (top_list) {
-        OSList_AddData(top_list, data);
-    } else {
-        top_list = OSList_Create();
-        if (!top_list) {
-            merror(MEM_ERROR, errno, strerror(errno));
-            return 0;
+        if (OSHash_Add(seen, seen_key, top) == 2) {
+            os_realloc(top_data->related[i], (top_data->related_size[i] + 1) * sizeof(char *), top_data->related[i]);
+            os_strdup(line, top_data->related[i][top_data->related_size[i]]);
+            top_data->related_size[i]++;
         }
-        OSList_AddData(top_list, data);
 
-        OSStore_Put(top, key, top_list);
+        free(seen_key);
     }
 
     return 1;
@@ -317,10 +317,12 @@ void os_report_printtop(void *topstore_pt, const char *hname, int print_related)
     int dopdout = 0;
     OSStore *topstore = (OSStore *)topstore_pt;
     OSStoreNode *next_node;
+    size_t i;
+    size_t j;
 
     next_node = OSStore_GetFirstNode(topstore);
     while (next_node) {
-        OSList *st_data = (OSList *)next_node->data;
+        report_top_t *st_data = (report_top_t *)next_node->data;
         char *lkey = (char *)next_node->key;
 
         /* With location we leave more space to be clearer */
@@ -335,7 +337,7 @@ void os_report_printtop(void *topstore_pt, const char *hname, int print_related)
                 _os_header_print(print_related, hname);
                 dopdout = 1;
             }
-            l_print_out("%-78s|%-8d|", (char *)next_node->key, st_data->currently_size);
+            l_print_out("%-78s|%-8d|", (char *)next_node->key, st_data->count);
         }
 
         /* Print each destination */
@@ -344,28 +346,14 @@ void os_report_printtop(void *topstore_pt, const char *hname, int print_related)
                 _os_header_print(print_related, hname);
                 dopdout = 1;
             }
-            l_print_out("%-78s|%-8d|", (char *)next_node->key, st_data->currently_size);
+            l_print_out("%-78s|%-8d|", (char *)next_node->key, st_data->count);
 
-            if (print_related & REPORT_REL_LOCATION) {
-                _os_report_print_related(REPORT_REL_LOCATION, st_data);
-            }
-            if (print_related & REPORT_REL_SRCIP) {
-                _os_report_print_related(REPORT_REL_SRCIP, st_data);
-            }
-            if (print_related & REPORT_REL_USER) {
-                _os_report_print_related(REPORT_REL_USER, st_data);
-            }
-            if (print_related & REPORT_REL_RULE) {
-                _os_report_print_related(REPORT_REL_RULE, st_data);
-            }
-            if (print_related & REPORT_REL_GROUP) {
-                _os_report_print_related(REPORT_REL_GROUP, st_data);
-            }
-            if (print_related & REPORT_REL_LEVEL) {
-                _os_report_print_related(REPORT_REL_LEVEL, st_data);
-            }
-            if (print_related & REPORT_REL_FILE) {
-                _os_report_print_related(REPORT_REL_FILE, st_data);
+            for (i = 0; i < REPORT_RELATIONS_SIZE; i++) {
+                if (print_related & REPORT_RELATIONS[i]) {
+                    for (j = 0; j < st_data->related_size[i]; j++) {
+                        l_print_out("%s", st_data->related[i][j]);
+                    }
+                }
             }
         }
 
@@ -386,6 +374,7 @@ void os_ReportdStart(report_filter *r_filter)
     char *first_alert = NULL;
     char *last_alert = NULL;
     alert_data **data_to_clean = NULL;
+    OSHash *related_seen = NULL;
 
     time_t tm;
     struct tm tm_result = { .tm_sec = 0 };
@@ -451,7 +440,14 @@ void os_ReportdStart(report_filter *r_filter)
         goto cleanup;
     }
 
-
+    /* Related values are saved only if they are going to be printed */
+    if (r_filter->related_srcip || r_filter->related_user || r_filter->related_level || r_filter->related_group
+            || r_filter->related_location || r_filter->related_rule || r_filter->related_file) {
+        if (related_seen = OSHash_Create(), !related_seen || !OSHash_setSize(related_seen, REPORT_SEEN_SIZE)) {
+            merror(MEM_ERROR, errno, strerror((errno)));
+            goto cleanup;
+        }
+    }
 
     Init_FileQueue(fileq, &tm_result, CRALERT_READ_ALL | CRALERT_FP_SET);
 
@@ -472,22 +468,22 @@ void os_ReportdStart(report_filter *r_filter)
         }
 
         alerts_filtered++;
-        data_to_clean = (alert_data **) os_AddPtArray(al_data, (void **)data_to_clean);
 
         /* Set first and last alert for summary */
         if (!first_alert) {
-            first_alert = al_data->date;
+            os_strdup(al_data->date, first_alert);
         }
-        last_alert = al_data->date;
+        os_free(last_alert);
+        os_strdup(al_data->date, last_alert);
 
         /* Add source IP if it is set properly */
         if (al_data->srcip != NULL && strcmp(al_data->srcip, "(none)") != 0) {
-            _os_report_add_tostore(al_data->srcip, r_filter->top_srcip, al_data);
+            _os_report_add_tostore(al_data->srcip, r_filter->top_srcip, al_data, r_filter->related_srcip, related_seen);
         }
 
         /* Add user if it is set properly */
         if (al_data->user != NULL && strcmp(al_data->user, "(none)") != 0) {
-            _os_report_add_tostore(al_data->user, r_filter->top_user, al_data);
+            _os_report_add_tostore(al_data->user, r_filter->top_user, al_data, r_filter->related_user, related_seen);
         }
 
         /* Add level and severity */
@@ -499,9 +495,9 @@ void os_ReportdStart(report_filter *r_filter)
             snprintf(mrule, 76, "%d - %s" , al_data->rule, al_data->comment);
 
             _os_report_add_tostore(mlevel, r_filter->top_level,
-                                   al_data);
+                                   al_data, r_filter->related_level, related_seen);
             _os_report_add_tostore(mrule, r_filter->top_rule,
-                                   al_data);
+                                   al_data, r_filter->related_rule, related_seen);
         }
 
         /* Deal with the group */
@@ -524,7 +520,7 @@ void os_ReportdStart(report_filter *r_filter)
                     }
 
                     _os_report_add_tostore(tmp_str, r_filter->top_group,
-                                           al_data);
+                                           al_data, r_filter->related_group, related_seen);
 
                     free(*mgroup);
                     mgroup++;
@@ -538,18 +534,25 @@ void os_ReportdStart(report_filter *r_filter)
                 }
                 if (*tmp_str != '\0') {
                     _os_report_add_tostore(tmp_str, r_filter->top_group,
-                                           al_data);
+                                           al_data, r_filter->related_group, related_seen);
                 }
             }
         }
 
         /* Add to the location top filter */
         _os_report_add_tostore(al_data->location, r_filter->top_location,
-                               al_data);
+                               al_data, r_filter->related_location, related_seen);
 
         if (al_data->filename != NULL) {
             _os_report_add_tostore(al_data->filename, r_filter->top_files,
-                                   al_data);
+                                   al_data, r_filter->related_file, related_seen);
+        }
+
+        /* The alerts are kept only to dump them */
+        if (r_filter->show_alerts) {
+            data_to_clean = (alert_data **) os_AddPtArray(al_data, (void **)data_to_clean);
+        } else {
+            FreeAlertData(al_data);
         }
     }
 
@@ -657,6 +660,12 @@ void os_ReportdStart(report_filter *r_filter)
         fclose(fileq->fp);
     }
 
+    if (related_seen) {
+        OSHash_Free(related_seen);
+    }
+
+    os_free(first_alert);
+    os_free(last_alert);
     free(fileq);
 }
 
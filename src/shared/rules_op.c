@@ -34,6 +34,10 @@ int OS_ReadXMLRules(const char *rulefile,
     int retval = 0;
     XML_NODE rule = NULL;
     XML_NODE rule_opt = NULL;
+    xml_cursor node_cursor;
+    xml_cursor rule_cursor;
+    xml_cursor opt_cursor;
+    xml_cursor mitre_cursor;
     RuleInfo *config_ruleinfo = NULL;
 
     char *regex = NULL, *match = NULL, *url = NULL,
@@ -160,6 +164,12 @@ int OS_ReadXMLRules(const char *rulefile,
         mdebug1("Not modifing the rule path");
     }
 
+    /* The nodes of each level are kept by its own cursor */
+    OS_CursorInit(&node_cursor, &xml);
+    OS_CursorInit(&rule_cursor, &xml);
+    OS_CursorInit(&opt_cursor, &xml);
+    OS_CursorInit(&mitre_cursor, &xml);
+
     /* Read the XML */
     if (OS_ReadXML(rulepath, &xml) < 0) {
         merror(XML_ERROR, rulepath, xml.err, xml.err_line);
@@ -183,7 +193,7 @@ int OS_ReadXMLRules(const char *rulefile,
     }
 
     /* Get the root elements */
-    node = OS_GetElementsbyNode(&xml, NULL);
+    node = OS_CursorGetElements(&node_cursor, NULL);
     if (!node) {
         merror(CONFIG_ERROR, rulepath);
         retval = -1;
@@ -227,7 +237,7 @@ int OS_ReadXMLRules(const char *rulefile,
         int j = 0;
 
         /* Get all rules for a global group */
-        rule = OS_GetElementsbyNode(&xml, node[i]);
+        rule = OS_CursorGetElements(&rule_cursor, node[i]);
         if (rule == NULL) {
             i++;
             continue;
@@ -282,7 +292,7 @@ int OS_ReadXMLRules(const char *rulefile,
             os_strdup(node[i]->values[0], config_ruleinfo->group);
 
             /* Get rules options */
-            rule_opt =  OS_GetElementsbyNode(&xml, rule[j]);
+            rule_opt = OS_CursorGetElements(&opt_cursor, rule[j]);
             if (rule_opt == NULL) {
                 merror(RL_NO_OPT, config_ruleinfo->sigid);
                 retval = -1;
@@ -939,7 +949,7 @@ int OS_ReadXMLRules(const char *rulefile,
                     int ind;
                     int l;
                     XML_NODE mitre_opt = NULL;
-                    mitre_opt = OS_GetElementsbyNode(&xml, rule_opt[k]);
+                    mitre_opt = OS_CursorGetElements(&mitre_cursor, rule_opt[k]);
 
                     if (mitre_opt == NULL) {
                         mwarn("Empty Mitre information for rule '%d'",
@@ -979,11 +989,9 @@ int OS_ReadXMLRules(const char *rulefile,
                                 os_free(config_ruleinfo->mitre_id[l]);
                             }
                             os_free(config_ruleinfo->mitre_id);
-                            OS_ClearNode(mitre_opt);
                             goto cleanup;
                         }
                     }
-                    OS_ClearNode(mitre_opt);
                 }
                 /* XXX As new features are added into ../analysisd/rules.c
                  * This code needs to be updated to match, but is out of date
@@ -1208,13 +1216,11 @@ int OS_ReadXMLRules(const char *rulefile,
             /* Call the function provided */
             ruleact_function(config_ruleinfo, data);
 
-            OS_ClearNode(rule_opt);
             rule_opt = NULL;
 
             j++; /* Next rule */
 
         } /* while(rule[j]) */
-        OS_ClearNode(rule);
         rule = NULL;
         i++;
 
@@ -1238,11 +1244,11 @@ cleanup:
     free(user);
     free(location);
 
-    OS_ClearNode(rule_opt);
-    OS_ClearNode(rule);
-
-    /* Clean global node */
-    OS_ClearNode(node);
+    /* The nodes belong to the cursors */
+    OS_CursorClear(&mitre_cursor);
+    OS_CursorClear(&opt_cursor);
+    OS_CursorClear(&rule_cursor);
+    OS_CursorClear(&node_cursor);
     OS_ClearXML(&xml);
 
     if (retval != 0) {
@@ -6,6 +6,7 @@ static const char *XML_INTERVAL = "interval";
 static const char *XML_SCAN_DAY = "day";
 static const char *XML_WEEK_DAY = "wday";
 static const char *XML_TIME = "time";
+static const char *XML_SPREAD = "spread";
 
 #ifdef UNIT_TESTING
 // Remove static for unit testing
@@ -14,12 +15,13 @@ static const char *XML_TIME = "time";
 
 static int _sched_scan_validate_parameters(sched_scan_config *scan_config);
 static time_t _get_next_time(const sched_scan_config *config, const char *MODULE_TAG,  const int run_on_start);
+static unsigned int _sched_scan_seed();
 
 /**
  * Check if the input tag is used for scheduling
  * */
 int is_sched_tag(const char* tag){
-    return !strcmp(tag, XML_INTERVAL) || !strcmp(tag, XML_SCAN_DAY) || !strcmp(tag, XML_WEEK_DAY) || !strcmp(tag, XML_TIME);
+    return !strcmp(tag, XML_INTERVAL) || !strcmp(tag, XML_SCAN_DAY) || !strcmp(tag, XML_WEEK_DAY) || !strcmp(tag, XML_TIME) || !strcmp(tag, XML_SPREAD);
 }
 
 /**
@@ -34,6 +36,8 @@ void sched_scan_init(sched_scan_config *scan_config){
     scan_config->month_interval = false;
     scan_config->time_start = 0;
     scan_config->next_scheduled_scan_time = 0;
+    scan_config->spread = 0;
+    scan_config->spread_applied = false;
 }
 
 /**
@@ -69,6 +73,15 @@ int sched_scan_read(sched_scan_config *scan_config, xml_node **nodes, const char
                 merror(XML_VALUEERR, nodes[i]->element, nodes[i]->content);
                 return (OS_INVALID);
             }
+        } else if (!strcmp(nodes[i]->element, XML_SPREAD)) { // <spread></spread>
+            long spread = w_parse_time(nodes[i]->content);
+
+            if (spread < 0 || spread >= UINT_MAX) {
+                merror(XML_VALUEERR, nodes[i]->element, nodes[i]->content);
+                return OS_INVALID;
+            }
+
+            scan_config->spread = (unsigned int)spread;
         } else if (!strcmp(nodes[i]->element, XML_INTERVAL)) { //<interval></interval>
             char *endptr;
             scan_config->interval = strtoul(nodes[i]->content, &endptr, 0);
@@ -109,11 +122,53 @@ int sched_scan_read(sched_scan_config *scan_config, xml_node **nodes, const char
 }
 
 time_t sched_scan_get_time_until_next_scan(sched_scan_config *config, const char *MODULE_TAG,  const int run_on_start) {
-    const time_t next_time = _get_next_time(config, MODULE_TAG, run_on_start); 
+    time_t next_time = _get_next_time(config, MODULE_TAG, run_on_start);
+
+    if (config->spread && !(run_on_start && !config->next_scheduled_scan_time)) {
+        if (config->scan_day || config->scan_wday >= 0 || config->scan_time) {
+            next_time += _sched_scan_seed() % config->spread;
+        } else if (!config->spread_applied && next_time) {
+            // Later scans keep the phase of the first one
+            next_time += _sched_scan_seed() % (config->spread < config->interval ? config->spread : config->interval);
+            config->spread_applied = true;
+        }
+    }
+
     config->next_scheduled_scan_time = time(NULL) + next_time;
     return next_time;
 }
 
+/**
+ * Seed of the scan spread: the agent ID on agents, the host name otherwise.
+ * It's the same on every run, so a host keeps its place in the window.
+ * */
+static unsigned int _sched_scan_seed() {
+    unsigned int hash = 2166136261U;
+    char id[OS_SIZE_256] = "";
+    const char *p;
+
+#ifdef CLIENT
+    FILE *fp;
+
+    if (fp = fopen(KEYSFILE_PATH, "r"), fp) {
+        if (fscanf(fp, "%255s", id) != 1) {
+            id[0] = '\0';
+        }
+        fclose(fp);
+    }
+#endif
+
+    if (id[0] == '\0' && gethostname(id, sizeof(id) - 1) != 0) {
+        return 0;
+    }
+
+    for (p = id; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619U;
+    }
+
+    return hash;
+}
+
 static time_t _get_next_time(const sched_scan_config *config, const char *MODULE_TAG,  const int run_on_start) {
     if (run_on_start && !config->next_scheduled_scan_time) {
         // If scan on start then initial waiting time is 0
@@ -220,5 +275,6 @@ void sched_scan_dump(const sched_scan_config* scan_config, cJSON *cjson_object){
             break;
     }
     if (scan_config->scan_time) cJSON_AddStringToObject(cjson_object, "time", scan_config->scan_time);
+    if (scan_config->spread) cJSON_AddNumberToObject(cjson_object, "spread", scan_config->spread);
 
 }
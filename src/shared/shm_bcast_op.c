@@ -0,0 +1,357 @@
+/*
+ * Shared-memory broadcast ring
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * June 18, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef WIN32
+
+#include "shared.h"
+#include "shm_bcast_op.h"
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define SHM_BCAST_MAGIC 0x42435357      /* "WSCB" */
+#define SHM_BCAST_PAGE 4096
+#define SHM_BCAST_POLL 10               /* Milliseconds between checks where there is no futex */
+
+/* Every record starts with its length and its origin */
+typedef struct shm_bcast_record_t {
+    uint32_t length;
+    uint32_t _unused;
+    shm_bcast_origin_t origin;
+} shm_bcast_record_t;
+
+/* The ring data starts on its own page */
+static inline size_t shm_bcast_data_offset() {
+    return (sizeof(shm_bcast_header_t) + SHM_BCAST_PAGE - 1) & ~(size_t)(SHM_BCAST_PAGE - 1);
+}
+
+static void shm_bcast_copy_in(char * data, size_t mask, uint64_t pos, const void * src, size_t n) {
+    size_t offset = pos & mask;
+    size_t first = mask + 1 - offset;
+
+    if (n <= first) {
+        memcpy(data + offset, src, n);
+    } else {
+        memcpy(data + offset, src, first);
+        memcpy(data, (const char *)src + first, n - first);
+    }
+}
+
+static void shm_bcast_copy_out(const char * data, size_t mask, uint64_t pos, void * dst, size_t n) {
+    size_t offset = pos & mask;
+    size_t first = mask + 1 - offset;
+
+    if (n <= first) {
+        memcpy(dst, data + offset, n);
+    } else {
+        memcpy(dst, data + offset, first);
+        memcpy((char *)dst + first, data, n - first);
+    }
+}
+
+/* Wait until seq changes, or the timeout expires */
+static void shm_bcast_wait(shm_bcast_header_t * header, uint32_t seq, int timeout) {
+#ifdef __linux__
+    struct timespec ts = { timeout / 1000, (timeout % 1000) * 1000000 };
+    syscall(SYS_futex, &header->seq, FUTEX_WAIT, seq, &ts, NULL, 0);
+#else
+    int waited;
+
+    for (waited = 0; waited < timeout && __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE) == seq; waited += SHM_BCAST_POLL) {
+        w_time_delay(SHM_BCAST_POLL);
+    }
+#endif
+}
+
+static void shm_bcast_wake(shm_bcast_header_t * header) {
+    __atomic_add_fetch(&header->seq, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    syscall(SYS_futex, &header->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+w_shm_bcast_t * shm_bcast_create(const char * path, size_t ring_size) {
+    w_shm_bcast_t * bcast;
+    shm_bcast_header_t * header;
+    size_t size = 4 * SHM_BCAST_PAGE;
+    size_t map_size;
+    int fd;
+
+    while (size < ring_size) {
+        size <<= 1;
+    }
+
+    map_size = shm_bcast_data_offset() + size;
+    shm_bcast_unlink(path);
+
+    if (fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0660), fd < 0) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        return NULL;
+    }
+
+    if (ftruncate(fd, map_size) < 0) {
+        merror("Could not resize the shared ring '%s': %s (%d)", path, strerror(errno), errno);
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    header = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (header == MAP_FAILED) {
+        merror("Could not map the shared ring '%s': %s (%d)", path, strerror(errno), errno);
+        unlink(path);
+        return NULL;
+    }
+
+    header->producer = getpid();
+    header->ring_size = size;
+
+    /* Readers don't look at a segment until its magic is set */
+    __atomic_store_n(&header->magic, SHM_BCAST_MAGIC, __ATOMIC_RELEASE);
+
+    os_calloc(1, sizeof(w_shm_bcast_t), bcast);
+    bcast->header = header;
+    bcast->data = (char *)header + shm_bcast_data_offset();
+    bcast->map_size = map_size;
+    bcast->ring_size = size;
+
+    return bcast;
+}
+
+void shm_bcast_unlink(const char * path) {
+    shm_bcast_header_t * header;
+    struct stat buf;
+    int fd;
+
+    if (fd = open(path, O_RDWR), fd < 0) {
+        return;
+    }
+
+    /* Readers of the old segment see it closed, and wake up to notice it */
+    if (fstat(fd, &buf) == 0 && (size_t)buf.st_size >= sizeof(shm_bcast_header_t)) {
+        header = mmap(NULL, sizeof(shm_bcast_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (header != MAP_FAILED) {
+            __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+            shm_bcast_wake(header);
+            munmap(header, sizeof(shm_bcast_header_t));
+        }
+    }
+
+    close(fd);
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        mwarn(UNLINK_ERROR, path, errno, strerror(errno));
+    }
+}
+
+w_shm_bcast_t * shm_bcast_attach(const char * path) {
+    w_shm_bcast_t * bcast;
+    shm_bcast_header_t * header;
+    struct stat buf;
+    size_t size;
+    int fd;
+
+    if (fd = open(path, O_RDWR), fd < 0) {
+        if (errno != ENOENT) {
+            mdebug1(FOPEN_ERROR, path, errno, strerror(errno));
+        }
+        return NULL;
+    }
+
+    if (fstat(fd, &buf) < 0 || (size_t)buf.st_size < shm_bcast_data_offset()) {
+        close(fd);
+        return NULL;
+    }
+
+    header = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (header == MAP_FAILED) {
+        mdebug1("Could not map the shared ring '%s': %s (%d)", path, strerror(errno), errno);
+        return NULL;
+    }
+
+    size = header->ring_size;
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_BCAST_MAGIC || __atomic_load_n(&header->closed, __ATOMIC_ACQUIRE)
+        || size < SHM_BCAST_PAGE || (size & (size - 1)) || (size_t)buf.st_size < shm_bcast_data_offset() + size) {
+        munmap(header, buf.st_size);
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(w_shm_bcast_t), bcast);
+    bcast->header = header;
+    bcast->data = (char *)header + shm_bcast_data_offset();
+    bcast->map_size = buf.st_size;
+    bcast->ring_size = size;
+    bcast->pos = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+    return bcast;
+}
+
+void shm_bcast_close(w_shm_bcast_t * bcast) {
+    munmap(bcast->header, bcast->map_size);
+    os_free(bcast);
+}
+
+void shm_bcast_publish(w_shm_bcast_t * bcast, const char * message, size_t length, const shm_bcast_origin_t * origin) {
+    shm_bcast_header_t * header = bcast->header;
+    size_t mask = bcast->ring_size - 1;
+    shm_bcast_record_t record = { .origin = *origin };
+    uint64_t head = header->head;
+
+    if (length == 0) {
+        return;
+    }
+
+    if (length > bcast->ring_size / 4 - sizeof(record)) {
+        length = bcast->ring_size / 4 - sizeof(record);
+    }
+
+    record.length = length;
+
+    /* Readers check the reserve after copying a record: if it went past
+     * their record plus a whole ring, what they copied may be garbage */
+    __atomic_store_n(&header->reserve, head + sizeof(record) + length, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    shm_bcast_copy_in(bcast->data, mask, head, &record, sizeof(record));
+    shm_bcast_copy_in(bcast->data, mask, head + sizeof(record), message, length);
+
+    __atomic_store_n(&header->head, head + sizeof(record) + length, __ATOMIC_RELEASE);
+
+    /* Pairs with the fence of a parking reader: either it sees the new
+     * head, or we see it waiting */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&header->waiting, __ATOMIC_RELAXED)) {
+        shm_bcast_wake(header);
+    }
+}
+
+/* Copy the record at the position of a reader. Returns 1 on success, 0 if there
+ * is none, or SHM_BCAST_LOST. */
+static int shm_bcast_read(w_shm_bcast_t * bcast, shm_bcast_record_t * record, char * buffer, size_t size) {
+    shm_bcast_header_t * header = bcast->header;
+    size_t mask = bcast->ring_size - 1;
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    size_t n;
+
+    if (head == bcast->pos) {
+        return 0;
+    }
+
+    if (head - bcast->pos > bcast->ring_size || head - bcast->pos < sizeof(*record)) {
+        return SHM_BCAST_LOST;
+    }
+
+    shm_bcast_copy_out(bcast->data, mask, bcast->pos, record, sizeof(*record));
+
+    if (buffer) {
+        n = record->length < size - 1 ? record->length : size - 1;
+
+        if (n > head - bcast->pos - sizeof(*record)) {
+            return SHM_BCAST_LOST;
+        }
+
+        shm_bcast_copy_out(bcast->data, mask, bcast->pos + sizeof(*record), buffer, n);
+        buffer[n] = '\0';
+    }
+
+    /* Pairs with the fence of the producer after it moves the reserve */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&header->reserve, __ATOMIC_RELAXED) - bcast->pos > bcast->ring_size) {
+        return SHM_BCAST_LOST;
+    }
+
+    return 1;
+}
+
+int shm_bcast_recv(w_shm_bcast_t * bcast, char * buffer, size_t size, shm_bcast_origin_t * origin, int timeout) {
+    shm_bcast_header_t * header = bcast->header;
+    shm_bcast_record_t record;
+    struct timespec deadline;
+    struct timespec now;
+    long remaining;
+    uint32_t seq;
+    int result;
+
+    if (__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE)) {
+        return SHM_BCAST_CLOSED;
+    }
+
+    if (result = shm_bcast_read(bcast, &record, buffer, size), result == 0 && timeout > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (timeout % 1000) * 1000000L;
+
+        /* Park, then look again in case the producer published before seeing us parked */
+        __atomic_add_fetch(&header->waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        /* The wake-up of a message that was already read may end a wait early */
+        do {
+            seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+
+            if (result = shm_bcast_read(bcast, &record, buffer, size), result != 0) {
+                break;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+
+            if (remaining <= 0) {
+                break;
+            }
+
+            shm_bcast_wait(header, seq, remaining);
+        } while (!__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE));
+
+        __atomic_sub_fetch(&header->waiting, 1, __ATOMIC_RELAXED);
+    }
+
+    if (result <= 0) {
+        return __atomic_load_n(&header->closed, __ATOMIC_ACQUIRE) ? SHM_BCAST_CLOSED : result;
+    }
+
+    bcast->pos += sizeof(record) + record.length;
+    *origin = record.origin;
+
+    return record.length < size - 1 ? (int)record.length : (int)(size - 1);
+}
+
+int shm_bcast_peek(w_shm_bcast_t * bcast, shm_bcast_origin_t * origin) {
+    shm_bcast_record_t record;
+    int result;
+
+    if (__atomic_load_n(&bcast->header->closed, __ATOMIC_ACQUIRE)) {
+        return SHM_BCAST_CLOSED;
+    }
+
+    if (result = shm_bcast_read(bcast, &record, NULL, 0), result == 1) {
+        *origin = record.origin;
+    }
+
+    return result;
+}
+
+void shm_bcast_skip(w_shm_bcast_t * bcast) {
+    bcast->pos = __atomic_load_n(&bcast->header->head, __ATOMIC_ACQUIRE);
+}
+
+#endif /* WIN32 */
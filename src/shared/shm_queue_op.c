@@ -0,0 +1,420 @@
+/*
+ * Shared-memory message rings
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * June 4, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#ifndef WIN32
+
+#include "shared.h"
+#include "shm_queue_op.h"
+#include <sys/mman.h>
+
+#define SHM_QUEUE_MAGIC 0x514d5357      /* "WSMQ" */
+#define SHM_QUEUE_PAGE 4096
+#define SHM_QUEUE_WAIT 1000             /* Microseconds between checks of a full ring */
+#define SHM_QUEUE_CHECK 1024            /* Pushes between checks that the consumer is alive */
+
+typedef uint32_t shm_length_t;
+
+/* The ring data starts on its own page */
+static inline size_t shm_data_offset() {
+    return (sizeof(shm_header_t) + SHM_QUEUE_PAGE - 1) & ~(size_t)(SHM_QUEUE_PAGE - 1);
+}
+
+static inline int shm_process_gone(pid_t pid) {
+    return kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+static void shm_copy_in(char * data, size_t mask, size_t pos, const void * src, size_t n) {
+    size_t offset = pos & mask;
+    size_t first = mask + 1 - offset;
+
+    if (n <= first) {
+        memcpy(data + offset, src, n);
+    } else {
+        memcpy(data + offset, src, first);
+        memcpy(data, (const char *)src + first, n - first);
+    }
+}
+
+static void shm_copy_out(const char * data, size_t mask, size_t pos, void * dst, size_t n) {
+    size_t offset = pos & mask;
+    size_t first = mask + 1 - offset;
+
+    if (n <= first) {
+        memcpy(dst, data + offset, n);
+    } else {
+        memcpy(dst, data + offset, first);
+        memcpy((char *)dst + first, data, n - first);
+    }
+}
+
+w_shm_queue_t * shm_queue_create(const char * path, size_t ring_size) {
+    w_shm_queue_t * queue;
+    shm_header_t * header;
+    size_t size = SHM_QUEUE_PAGE;
+    size_t map_size;
+    int fd;
+
+    while (size < ring_size) {
+        size <<= 1;
+    }
+
+    map_size = shm_data_offset() + SHM_QUEUE_RINGS * size;
+    shm_queue_unlink(path);
+
+    if (fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0660), fd < 0) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        return NULL;
+    }
+
+    /* The file is sparse: ring pages are only backed once they are written */
+    if (ftruncate(fd, map_size) < 0) {
+        merror("Could not resize the shared queue '%s': %s (%d)", path, strerror(errno), errno);
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    header = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (header == MAP_FAILED) {
+        merror("Could not map the shared queue '%s': %s (%d)", path, strerror(errno), errno);
+        unlink(path);
+        return NULL;
+    }
+
+    header->consumer = getpid();
+    header->ring_size = size;
+
+    /* Producers don't look at a segment until its magic is set */
+    __atomic_store_n(&header->magic, SHM_QUEUE_MAGIC, __ATOMIC_RELEASE);
+
+    os_calloc(1, sizeof(w_shm_queue_t), queue);
+    queue->header = header;
+    queue->data = (char *)header + shm_data_offset();
+    queue->map_size = map_size;
+    queue->ring_size = size;
+    queue->ring = -1;
+    queue->pending = -1;
+
+    return queue;
+}
+
+void shm_queue_unlink(const char * path) {
+    shm_header_t * header;
+    struct stat buf;
+    int fd;
+
+    if (fd = open(path, O_RDWR), fd < 0) {
+        return;
+    }
+
+    /* Producers still using the old segment see it closed and reattach */
+    if (fstat(fd, &buf) == 0 && (size_t)buf.st_size >= sizeof(shm_header_t)) {
+        header = mmap(NULL, sizeof(shm_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (header != MAP_FAILED) {
+            __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+            munmap(header, sizeof(shm_header_t));
+        }
+    }
+
+    close(fd);
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        mwarn(UNLINK_ERROR, path, errno, strerror(errno));
+    }
+}
+
+w_shm_queue_t * shm_queue_attach(const char * path) {
+    w_shm_queue_t * queue;
+    shm_header_t * header;
+    struct stat buf;
+    size_t size;
+    pid_t pid = getpid();
+    pid_t owner;
+    unsigned int used;
+    int fd;
+    int i;
+    int j;
+
+    if (fd = open(path, O_RDWR), fd < 0) {
+        if (errno != ENOENT) {
+            mdebug1(FOPEN_ERROR, path, errno, strerror(errno));
+        }
+        return NULL;
+    }
+
+    if (fstat(fd, &buf) < 0 || (size_t)buf.st_size < shm_data_offset()) {
+        close(fd);
+        return NULL;
+    }
+
+    header = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (header == MAP_FAILED) {
+        mdebug1("Could not map the shared queue '%s': %s (%d)", path, strerror(errno), errno);
+        return NULL;
+    }
+
+    size = header->ring_size;
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_QUEUE_MAGIC || __atomic_load_n(&header->closed, __ATOMIC_ACQUIRE)
+        || size < SHM_QUEUE_PAGE || (size & (size - 1)) || (size_t)buf.st_size < shm_data_offset() + SHM_QUEUE_RINGS * size) {
+        munmap(header, buf.st_size);
+        return NULL;
+    }
+
+    /* Claim a free ring, or else a drained one whose producer is gone */
+    for (i = 0; i < SHM_QUEUE_RINGS; i++) {
+        owner = 0;
+
+        if (__atomic_compare_exchange_n(&header->ring[i].owner, &owner, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    for (j = 0; i == SHM_QUEUE_RINGS && j < SHM_QUEUE_RINGS; j++) {
+        owner = __atomic_load_n(&header->ring[j].owner, __ATOMIC_ACQUIRE);
+
+        if (owner != pid && shm_process_gone(owner)
+            && __atomic_load_n(&header->ring[j].head, __ATOMIC_ACQUIRE) == __atomic_load_n(&header->ring[j].tail, __ATOMIC_ACQUIRE)
+            && __atomic_compare_exchange_n(&header->ring[j].owner, &owner, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            i = j;
+        }
+    }
+
+    if (i == SHM_QUEUE_RINGS) {
+        mdebug1("All the rings of the shared queue '%s' are taken.", path);
+        munmap(header, buf.st_size);
+        return NULL;
+    }
+
+    for (used = __atomic_load_n(&header->rings_used, __ATOMIC_RELAXED); used < (unsigned int)i + 1;) {
+        __atomic_compare_exchange_n(&header->rings_used, &used, i + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+
+    os_calloc(1, sizeof(w_shm_queue_t), queue);
+    queue->header = header;
+    queue->data = (char *)header + shm_data_offset() + i * size;
+    queue->map_size = buf.st_size;
+    queue->ring_size = size;
+    queue->ring = i;
+
+    return queue;
+}
+
+void shm_queue_close(w_shm_queue_t * queue) {
+    if (queue->ring >= 0) {
+        pid_t owner = getpid();
+        __atomic_compare_exchange_n(&queue->header->ring[queue->ring].owner, &owner, 0, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+
+    munmap(queue->header, queue->map_size);
+    os_free(queue);
+}
+
+int shm_queue_push(w_shm_queue_t * queue, const struct iovec * iov, int iovcnt) {
+    static int reported = 0;
+    shm_header_t * header = queue->header;
+    shm_ring_t * ring = &header->ring[queue->ring];
+    size_t mask = queue->ring_size - 1;
+    size_t total = 0;
+    size_t head;
+    size_t tail;
+    shm_length_t length;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    if (total > queue->ring_size - sizeof(shm_length_t) || total > UINT32_MAX) {
+        return -1;
+    }
+
+    /* A ring with room doesn't tell that its consumer died */
+    if (++queue->pushes == SHM_QUEUE_CHECK) {
+        queue->pushes = 0;
+
+        if (shm_process_gone(header->consumer)) {
+            return -1;
+        }
+    }
+
+    head = ring->head;
+
+    for (;;) {
+        if (__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE)) {
+            return -1;
+        }
+
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        if (queue->ring_size - (head - tail) >= sizeof(shm_length_t) + total) {
+            break;
+        }
+
+        if (shm_process_gone(header->consumer)) {
+            return -1;
+        }
+
+        if (!reported) {
+            reported = 1;
+            mwarn("Shared queue is full, waiting for its reader.");
+        }
+
+        usleep(SHM_QUEUE_WAIT);
+    }
+
+    length = total;
+    shm_copy_in(queue->data, mask, head, &length, sizeof(length));
+    head += sizeof(length);
+
+    for (i = 0; i < iovcnt; i++) {
+        shm_copy_in(queue->data, mask, head, iov[i].iov_base, iov[i].iov_len);
+        head += iov[i].iov_len;
+    }
+
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+    /* Pairs with the fence of a parking consumer: either it sees the new
+     * head, or we see it waiting */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&header->waiting, __ATOMIC_RELAXED) && __atomic_exchange_n(&header->waiting, 0, __ATOMIC_ACQ_REL)) {
+        return SHM_QUEUE_WAKEUP;
+    }
+
+    return 0;
+}
+
+/* Find the next message, visiting the rings in turn. It stays in its ring
+ * until shm_queue_release(), and only goes to the buffer if it wraps */
+static const char * shm_queue_next(w_shm_queue_t * queue, char * buffer, size_t size, size_t * out) {
+    shm_header_t * header = queue->header;
+    unsigned int rings = __atomic_load_n(&header->rings_used, __ATOMIC_ACQUIRE);
+    size_t mask = queue->ring_size - 1;
+    shm_length_t length;
+    shm_ring_t * ring;
+    unsigned int i;
+    unsigned int k;
+    size_t head;
+    size_t tail;
+    size_t offset;
+    size_t n;
+
+    if (rings > SHM_QUEUE_RINGS) {
+        rings = SHM_QUEUE_RINGS;
+    }
+
+    for (k = 0; k < rings; k++) {
+        i = (queue->next + k) % rings;
+        ring = &header->ring[i];
+        tail = ring->tail;
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        while (head != tail) {
+            char * data = queue->data + i * queue->ring_size;
+
+            if (head - tail < sizeof(length) || head - tail > queue->ring_size) {
+                goto invalid;
+            }
+
+            shm_copy_out(data, mask, tail, &length, sizeof(length));
+
+            if (length > head - tail - sizeof(length)) {
+                goto invalid;
+            }
+
+            if (length == 0) {
+                tail += sizeof(length);
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+                continue;
+            }
+
+            queue->next = i + 1;
+            queue->pending = i;
+            queue->pending_tail = tail + sizeof(length) + length;
+            offset = (tail + sizeof(length)) & mask;
+
+            if (offset + length <= queue->ring_size) {
+                *out = length;
+                return data + offset;
+            }
+
+            n = length < size - 1 ? length : size - 1;
+            shm_copy_out(data, mask, tail + sizeof(length), buffer, n);
+            buffer[n] = '\0';
+            *out = n;
+            return buffer;
+        }
+
+        continue;
+
+invalid:
+        merror("Invalid record in the ring %u of the shared queue. Discarding %zu bytes.", i, head - tail);
+        __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+const char * shm_queue_peek(w_shm_queue_t * queue, char * buffer, size_t size, size_t * length) {
+    shm_header_t * header = queue->header;
+    const char * message;
+
+    if (message = shm_queue_next(queue, buffer, size, length), message) {
+        if (__atomic_load_n(&header->waiting, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&header->waiting, 0, __ATOMIC_RELAXED);
+        }
+
+        return message;
+    }
+
+    /* Park, then look again in case a producer pushed before seeing us parked */
+    __atomic_store_n(&header->waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (message = shm_queue_next(queue, buffer, size, length), message) {
+        __atomic_store_n(&header->waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    return message;
+}
+
+void shm_queue_release(w_shm_queue_t * queue) {
+    if (queue->pending >= 0) {
+        __atomic_store_n(&queue->header->ring[queue->pending].tail, queue->pending_tail, __ATOMIC_RELEASE);
+        queue->pending = -1;
+    }
+}
+
+size_t shm_queue_recv(w_shm_queue_t * queue, char * buffer, size_t size) {
+    const char * message;
+    size_t length;
+
+    if (message = shm_queue_peek(queue, buffer, size, &length), !message) {
+        return 0;
+    }
+
+    if (message != buffer) {
+        length = length < size - 1 ? length : size - 1;
+        memcpy(buffer, message, length);
+        buffer[length] = '\0';
+    }
+
+    shm_queue_release(queue);
+    return length;
+}
+
+#endif /* WIN32 */
@@ -9,7 +9,7 @@
  */
 
 /* Common API for dealing with ordered lists
- * Provides a fast search on average (n/2)
+ * The nodes are also indexed by key, for a search in O(log n)
  */
 
 #include "shared.h"
@@ -33,6 +33,7 @@ OSStore *OSStore_Create()
     my_list->currently_size = 0;
     my_list->max_size = 0;
     my_list->free_data_function = NULL;
+    my_list->index = rbtree_init();
 
     return (my_list);
 }
@@ -64,6 +65,7 @@ OSStore *OSStore_Free(OSStore *list)
     list->first_node = NULL;
     list->last_node = NULL;
 
+    rbtree_destroy(list->index);
     free(list);
     list = NULL;
 
@@ -100,85 +102,91 @@ int OSStore_SetFreeDataPointer(OSStore *list, void (free_data_function)(void *))
     return (1);
 }
 
-/* Sort the storage by size */
+/* Sort the storage by size
+ * Merge sort of the linked nodes: it's stable, as the former insertion
+ * sort, and it takes O(n log n) comparisons
+ */
 int OSStore_Sort(OSStore *list, void *(sort_data_function)(void *d1, void *d2))
 {
-    OSStoreNode *newnode = NULL;
-    OSStoreNode *movenode = NULL;
-    list->cur_node = list->first_node;
-
-    while (list->cur_node) {
-        movenode = list->cur_node->prev;
+    OSStoreNode *head = list->first_node;
+    OSStoreNode *left;
+    OSStoreNode *right;
+    OSStoreNode *tail;
+    OSStoreNode *newhead;
+    size_t run;
+    size_t merges;
+    size_t left_size;
+    size_t right_size;
+
+    if (!head) {
+        return (1);
+    }
 
-        /* Check for all the previous entries, using sort */
-        while (movenode) {
+    /* Merge runs of 1, 2, 4... nodes, linked by next, until a single one is left */
+    for (run = 1; ; run *= 2) {
+        left = head;
+        newhead = NULL;
+        tail = NULL;
+        merges = 0;
 
-            if (sort_data_function(list->cur_node->data, movenode->data)) {
-                movenode = movenode->prev;
-            }
+        while (left) {
+            merges++;
+            right = left;
 
-            /* This node should stay where it is */
-            else if (movenode == list->cur_node->prev) {
-                break;
+            for (left_size = 0; right && left_size < run; left_size++) {
+                right = right->next;
             }
 
-            /* Replace the nodes */
-            else {
-                newnode = list->cur_node;
+            right_size = run;
 
-                if (list->cur_node->prev) {
-                    list->cur_node->prev->next = list->cur_node->next;
-                }
+            while (left_size > 0 || (right_size > 0 && right)) {
+                OSStoreNode *node;
 
-                if (list->cur_node->next) {
-                    list->cur_node->next->prev = list->cur_node->prev;
+                /* A right node goes first only if it is greater */
+                if (left_size > 0 && right_size > 0 && right && sort_data_function(right->data, left->data)) {
+                    node = right;
+                    right = right->next;
+                    right_size--;
+                } else if (left_size > 0) {
+                    node = left;
+                    left = left->next;
+                    left_size--;
                 } else {
-                    list->last_node = list->cur_node->prev;
+                    node = right;
+                    right = right->next;
+                    right_size--;
                 }
 
-                list->cur_node = list->cur_node->prev;
-
-                newnode->next = movenode->next;
-                newnode->prev = movenode;
-
-                if (movenode->next) {
-                    movenode->next->prev = newnode;
+                if (tail) {
+                    tail->next = node;
+                } else {
+                    newhead = node;
                 }
 
-                movenode->next = newnode;
-
-                break;
+                tail = node;
             }
-        }
 
-        /* If movenode is not set, put the current node in first */
-        if (!movenode && (list->cur_node != list->first_node)) {
-            newnode = list->cur_node;
-
-            if (list->cur_node->prev) {
-                list->cur_node->prev->next = list->cur_node->next;
-            }
-
-            if (list->cur_node->next) {
-                list->cur_node->next->prev = list->cur_node->prev;
-            } else {
-                list->last_node = list->cur_node->prev;
-            }
-
-            if ((list->cur_node = list->cur_node->prev) == NULL) {
-                return (1);
-            }
+            left = right;
+        }
 
-            newnode->prev = NULL;
-            newnode->next = list->first_node;
-            list->first_node->prev = newnode;
+        tail->next = NULL;
+        head = newhead;
 
-            list->first_node = newnode;
+        if (merges <= 1) {
+            break;
         }
+    }
 
-        list->cur_node = list->cur_node->next;
+    /* Restore the previous links */
+    list->first_node = head;
+
+    for (tail = NULL, left = head; left; tail = left, left = left->next) {
+        left->prev = tail;
     }
 
+    list->last_node = tail;
+    list->cur_node = NULL;
+
     return (1);
 }
 
@@ -188,24 +196,18 @@ int OSStore_Sort(OSStore *list, void *(sort_data_function)(void *d1, void *d2))
  */
 int OSStore_GetPosition(OSStore *list, const char *key)
 {
-    int chk_rc, pos = 1;
-    list->cur_node = list->first_node;
+    OSStoreNode *node;
+    int pos = 1;
 
-    while (list->cur_node) {
-        if ((chk_rc = strcmp(list->cur_node->key, key)) >= 0) {
-            /* Found */
-            if (chk_rc == 0) {
-                return (pos);
-            }
-
-            /* Not found */
-            return (0);
-        }
+    if (node = rbtree_get(list->index, key), !node) {
+        return (0);
+    }
 
-        list->cur_node = list->cur_node->next;
+    for (list->cur_node = list->first_node; list->cur_node != node; list->cur_node = list->cur_node->next) {
         pos++;
     }
-    return (0);
+
+    return (pos);
 }
 
 /* Get first node from storage
@@ -221,23 +223,8 @@ OSStoreNode *OSStore_GetFirstNode(OSStore *list)
  */
 void *OSStore_Get(OSStore *list, const char *key)
 {
-    int chk_rc;
-    list->cur_node = list->first_node;
-
-    while (list->cur_node) {
-        if ((chk_rc = strcmp(list->cur_node->key, key)) >= 0) {
-            /* Found */
-            if (chk_rc == 0) {
-                return (list->cur_node->data);
-            }
-
-            /* Not found */
-            return (NULL);
-        }
-
-        list->cur_node = list->cur_node->next;
-    }
-    return (NULL);
+    list->cur_node = rbtree_get(list->index, key);
+    return (list->cur_node ? list->cur_node->data : NULL);
 }
 
 /* Check if key is present on storage
@@ -245,23 +232,8 @@ void *OSStore_Get(OSStore *list, const char *key)
  */
 int OSStore_Check(OSStore *list, const char *key)
 {
-    int chk_rc;
-    list->cur_node = list->first_node;
-
-    while (list->cur_node) {
-        if ((chk_rc = strcmp(list->cur_node->key, key)) >= 0) {
-            /* Found */
-            if (chk_rc == 0) {
-                return (1);
-            }
-
-            /* Not found */
-            return (0);
-        }
-
-        list->cur_node = list->cur_node->next;
-    }
-    return (0);
+    list->cur_node = rbtree_get(list->index, key);
+    return (list->cur_node != NULL);
 }
 
 /* Check if key is present on storage (using strncmp)
@@ -313,7 +285,6 @@ int OSStore_NCaseCheck(OSStore *list, const char *key)
  */
 int OSStore_Put(OSStore *list, const char *key, void *data)
 {
-    int chk_rc;
     OSStoreNode *newnode;
 
     /* Allocate memory for new node */
@@ -334,49 +305,39 @@ int OSStore_Put(OSStore *list, const char *key, void *data)
     }
     newnode->key_size = strlen(key);
 
-    /* If we don't have first node, assign it */
-    if (!list->first_node) {
-        list->first_node = newnode;
-        list->last_node = newnode;
-    }
-
-    /* Store the data in order */
-    else {
-        list->cur_node = list->first_node;
-        while (list->cur_node) {
-            if ((chk_rc = strcmp(list->cur_node->key, key)) >= 0) {
-                /* Duplicate entry */
-                if (chk_rc == 0) {
-                    free(newnode->key);
-                    free(newnode);
-                    return (1);
-                }
-
-                /* If there is no prev node, this is the first node */
-                if (list->cur_node->prev) {
-                    list->cur_node->prev->next = newnode;
-                } else {
-                    list->first_node = newnode;
-                }
-
-                newnode->prev = list->cur_node->prev;
-
-                list->cur_node->prev = newnode;
-                newnode->next = list->cur_node;
-                break;
-            }
-
-            list->cur_node = list->cur_node->next;
-        }
+    /* Store the data in order: before the least greater key */
+    list->cur_node = rbtree_ceiling(list->index, key);
 
+    if (!list->cur_node) {
         /* New node is the higher key */
-        if (!newnode->next) {
+        if (list->last_node) {
             list->last_node->next = newnode;
-            newnode->prev = list->last_node;
-            list->last_node = newnode;
+        } else {
+            list->first_node = newnode;
         }
+
+        newnode->prev = list->last_node;
+        list->last_node = newnode;
+    } else if (strcmp(list->cur_node->key, key) == 0) {
+        /* Duplicate entry */
+        free(newnode->key);
+        free(newnode);
+        return (1);
+    } else {
+        /* If there is no prev node, this is the first node */
+        if (list->cur_node->prev) {
+            list->cur_node->prev->next = newnode;
+        } else {
+            list->first_node = newnode;
+        }
+
+        newnode->prev = list->cur_node->prev;
+        list->cur_node->prev = newnode;
+        newnode->next = list->cur_node;
     }
 
+    rbtree_insert(list->index, key, newnode);
+
     /* Increment list size */
     list->currently_size++;
 
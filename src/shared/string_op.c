@@ -18,6 +18,32 @@
 #endif
 #endif
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WSTR_SCAN_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define WSTR_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+/* The vector scanners load whole aligned blocks, which never cross a page
+ * but may read past the end of the string. Those bytes are discarded.
+ */
+#ifdef __clang__
+#define WSTR_NO_ASAN __attribute__((no_sanitize("address")))
+#else
+#define WSTR_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+
+static const char *wstr_scan(const char *str, char a, char b, unsigned char below);
+
+#ifdef WSTR_SCAN_X86
+static const char *wstr_scan_sse2(const char *str, char a, char b, unsigned char below) __attribute__((target("sse2"))) WSTR_NO_ASAN;
+static const char *wstr_scan_avx2(const char *str, char a, char b, unsigned char below) __attribute__((target("avx2"))) WSTR_NO_ASAN;
+#elif defined(WSTR_SCAN_NEON)
+static const char *wstr_scan_neon(const char *str, char a, char b, unsigned char below) WSTR_NO_ASAN;
+#endif
+
 /* Trim CR and/or LF from the last positions of a string */
 void os_trimcrlf(char *str)
 {
@@ -47,33 +73,24 @@ void os_trimcrlf(char *str)
 char *os_strip_char(const char *source, char remove)
 {
     char *clean;
-    const char *iterator = source;
+    const char *next;
     size_t length = 0;
-    int i;
-
-    /* Figure out how much memory to allocate */
-    for ( ; *iterator; iterator++ ) {
-        if ( *iterator != remove ) {
-            length++;
-        }
-    }
 
-    /* Allocate the memory */
-    if ( (clean = (char *) malloc( length + 1 )) == NULL ) {
+    /* Allocate the memory, at most as the source */
+    if ( (clean = (char *) malloc( strlen(source) + 1 )) == NULL ) {
         // Return NULL
         return NULL;
     }
-    memset(clean, '\0', length + 1);
 
-    /* Remove the characters */
-    iterator = source;
-    for ( i = 0; *iterator; iterator++ ) {
-        if ( *iterator != remove ) {
-            clean[i] = *iterator;
-            i++;
-        }
+    /* Copy the spans between the characters */
+    for ( ; next = wstr_scan(source, remove, remove, 1), *next; source = next + 1 ) {
+        memcpy(clean + length, source, next - source);
+        length += next - source;
     }
 
+    memcpy(clean + length, source, next - source);
+    clean[length + (next - source)] = '\0';
+
     return clean;
 }
 
@@ -262,6 +279,7 @@ char * wstr_replace(const char * string, const char * search, const char * repla
     const char * snext;
     size_t wi = 0;
     size_t zcur;
+    size_t count = 0;
 
     if (!(string && search && replace)) {
         return NULL;
@@ -270,11 +288,16 @@ char * wstr_replace(const char * string, const char * search, const char * repla
     const size_t ZSEARCH = strlen(search);
     const size_t ZREPLACE = strlen(replace);
 
-    os_malloc(sizeof(char), result);
+    // Count the occurrences first, so the result is allocated once
+
+    for (scur = string; snext = strstr(scur, search), snext; scur = snext + ZSEARCH) {
+        count++;
+    }
+
+    os_malloc(strlen(string) - count * ZSEARCH + count * ZREPLACE + 1, result);
 
     for (scur = string; snext = strstr(scur, search), snext; scur = snext + ZSEARCH) {
         zcur = snext - scur;
-        os_realloc(result, wi + zcur + ZREPLACE + 1, result);
         memcpy(result + wi, scur, zcur);
         wi += zcur;
         memcpy(result + wi, replace, ZREPLACE);
@@ -284,7 +307,6 @@ char * wstr_replace(const char * string, const char * search, const char * repla
     // Copy last chunk
 
     zcur = strlen(scur);
-    os_realloc(result, wi + zcur + 1, result);
     memcpy(result + wi, scur, zcur);
     wi += zcur;
 
@@ -295,22 +317,25 @@ char * wstr_replace(const char * string, const char * search, const char * repla
 // Locate first occurrence of non escaped character in string
 
 char * wstr_chr(char * str, int character) {
-    char escaped = 0;
+    const char *next;
 
-    for (;*str != '\0'; str++) {
-        if (!escaped) {
-            if (*str == character) {
-                return str;
-            }
-            if (*str == '\\') {
-                escaped = 1;
-            }
-        } else {
-            escaped = 0;
+    // Jump from a candidate to the next one, skipping the escaped characters
+
+    for (;; str = (char *)next + 2) {
+        next = wstr_scan(str, (char)character, '\\', 1);
+
+        if (*next == '\0') {
+            return NULL;
         }
-    }
 
-    return NULL;
+        if (*next == (char)character) {
+            return (char *)next;
+        }
+
+        if (next[1] == '\0') {
+            return NULL;
+        }
+    }
 }
 
 #ifdef WIN32
@@ -786,22 +811,17 @@ char* decode_hex_buffer_2_ascii_buffer(const char * const encoded_buffer, const
 // Length of the initial segment of s which consists entirely of non-escaped bytes different from reject
 
 size_t strcspn_escaped(const char * s, char reject) {
-    char charset[3] = { '\\', reject };
-
-    size_t len = strlen(s);
-    size_t spn_len = 0;
+    const char *next = s;
 
-    do {
-        spn_len += strcspn(s + spn_len, charset);
-
-        if (s[spn_len] == '\\') {
-            spn_len += 2;
-        } else {
-            return spn_len;
+    while (next = wstr_scan(next, reject, '\\', 1), *next == '\\') {
+        if (next[1] == '\0') {
+            return next + 1 - s;
         }
-    } while (spn_len < len);
 
-    return len;
+        next += 2;
+    }
+
+    return next - s;
 }
 
 // Escape JSON reserved characters
@@ -817,33 +837,33 @@ char * wstr_escape_json(const char * string) {
         ['\\'] = '\\'
     };
 
-    size_t i = 0;   // Read position
+    const char * next;
     size_t j = 0;   // Write position
     size_t z;       // Span length
 
+    // Every byte is escaped in two at most
+
     char * output;
-    os_malloc(1, output);
+    os_malloc(2 * strlen(string) + 1, output);
 
-    do {
-        z = strcspn(string + i, "\b\t\n\f\r\"\\");
+    // Candidates are quotes, backslashes and control characters
+
+    for (; next = wstr_scan(string, '\"', '\\', 0x20), *next != '\0'; string = next + 1) {
+        z = next - string;
+        memcpy(output + j, string, z);
+        j += z;
 
-        if (string[i + z] == '\0') {
-            // End of string
-            os_realloc(output, j + z + 1, output);
-            strncpy(output + j, string + i, z);
+        if ((unsigned char)*next < sizeof(escape_map) && escape_map[(unsigned char)*next]) {
+            output[j++] = '\\';
+            output[j++] = escape_map[(unsigned char)*next];
         } else {
-            // Reserved character
-            os_realloc(output, j + z + 3, output);
-            strncpy(output + j, string + i, z);
-            output[j + z] = '\\';
-            output[j + z + 1] = escape_map[(int)string[i + z]];
-            z++;
-            j++;
+            output[j++] = *next;
         }
+    }
 
-        j += z;
-        i += z;
-    } while (string[i] != '\0');
+    z = next - string;
+    memcpy(output + j, string, z);
+    j += z;
 
     output[j] = '\0';
     return output;
@@ -931,3 +951,89 @@ char * w_tolower_str(const char *string) {
 
     return tolower_str;
 }
+
+/* First byte of str equal to a or b, or below the given value (the
+ * terminator is always below). The vector versions are chosen at runtime.
+ */
+static const char *wstr_scan(const char *str, char a, char b, unsigned char below)
+{
+#ifdef WSTR_SCAN_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return wstr_scan_avx2(str, a, b, below);
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return wstr_scan_sse2(str, a, b, below);
+    }
+#elif defined(WSTR_SCAN_NEON)
+    return wstr_scan_neon(str, a, b, below);
+#endif
+
+    for (; *str != a && *str != b && (unsigned char)*str >= below; str++);
+    return str;
+}
+
+#ifdef WSTR_SCAN_X86
+static const char *wstr_scan_sse2(const char *str, char a, char b, unsigned char below)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vlast = _mm_set1_epi8((char)(below - 1));
+    size_t offset = (uintptr_t)str & 15;
+    const char *block = str - offset;
+    unsigned int mask;
+
+    // The first block starts before the string
+
+    for (mask = 0xffff << offset;; block += 16, mask = 0xffff) {
+        __m128i chunk = _mm_load_si128((const __m128i *)block);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+                                    _mm_cmpeq_epi8(_mm_min_epu8(chunk, vlast), chunk));
+
+        if (mask &= _mm_movemask_epi8(hits), mask) {
+            return block + __builtin_ctz(mask);
+        }
+    }
+}
+
+static const char *wstr_scan_avx2(const char *str, char a, char b, unsigned char below)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vlast = _mm256_set1_epi8((char)(below - 1));
+    size_t offset = (uintptr_t)str & 31;
+    const char *block = str - offset;
+    unsigned int mask;
+
+    for (mask = 0xffffffffU << offset;; block += 32, mask = 0xffffffffU) {
+        __m256i chunk = _mm256_load_si256((const __m256i *)block);
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)),
+                                       _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, vlast), chunk));
+
+        if (mask &= (unsigned int)_mm256_movemask_epi8(hits), mask) {
+            return block + __builtin_ctz(mask);
+        }
+    }
+}
+#elif defined(WSTR_SCAN_NEON)
+static const char *wstr_scan_neon(const char *str, char a, char b, unsigned char below)
+{
+    const uint8x16_t va = vdupq_n_u8((uint8_t)a);
+    const uint8x16_t vb = vdupq_n_u8((uint8_t)b);
+    const uint8x16_t vbelow = vdupq_n_u8(below);
+    size_t offset = (uintptr_t)str & 15;
+    const char *block = str - offset;
+    uint64_t mask;
+
+    // Each byte gives a nibble of the mask
+
+    for (mask = ~(uint64_t)0 << (offset * 4);; block += 16, mask = ~(uint64_t)0) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)block);
+        uint8x16_t hits = vorrq_u8(vorrq_u8(vceqq_u8(chunk, va), vceqq_u8(chunk, vb)), vcltq_u8(chunk, vbelow));
+
+        if (mask &= vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0), mask) {
+            return block + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+}
+#endif
@@ -97,6 +97,29 @@ char *w_get_timestamp(time_t time) {
     return timestamp;
 }
 
+static __thread w_time_cache_t time_cache = { .second = -1 };
+
+const w_time_cache_t * w_time_cache_get(time_t second) {
+    static const char * MONTHS[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    w_time_cache_t * cache = &time_cache;
+
+    if (cache->second == second) {
+        return cache;
+    }
+
+    localtime_r(&second, &cache->tm);
+
+    snprintf(cache->hour, sizeof(cache->hour), "%02d:%02d:%02d", cache->tm.tm_hour, cache->tm.tm_min, cache->tm.tm_sec);
+    snprintf(cache->syslog, sizeof(cache->syslog), "%s %2d %s", MONTHS[cache->tm.tm_mon], cache->tm.tm_mday, cache->hour);
+    snprintf(cache->datetime, sizeof(cache->datetime), "%d-%02d-%02dT%s", cache->tm.tm_year + 1900, cache->tm.tm_mon + 1, cache->tm.tm_mday, cache->hour);
+
+    if (!strftime(cache->timezone, sizeof(cache->timezone), "%z", &cache->tm)) {
+        *cache->timezone = '\0';
+    }
+
+    cache->second = second;
+    return cache;
+}
 
 void w_sleep_until(const time_t abs_time) {
     while( time(NULL) < abs_time ) {
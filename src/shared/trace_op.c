@@ -0,0 +1,138 @@
+/*
+ * Sampled tracing of events through the stages of a daemon
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <shared.h>
+
+/* Marks a probe taken by a producer that is still filling it */
+#define TRACE_PROBE_BUSY ((const void *)1)
+
+static uint64_t trace_next_id;
+static __thread uint32_t trace_seed;
+
+/* Sampling must not add a shared counter to the hot path: each thread draws from its own xorshift */
+static uint32_t trace_random(void) {
+    uint32_t x = trace_seed;
+
+    if (x == 0) {
+        x = (uint32_t)(uintptr_t)&trace_seed ^ (uint32_t)time(NULL) ^ 0x9E3779B9;
+    }
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return trace_seed = x;
+}
+
+static uint64_t trace_elapsed(const struct timespec * from, const struct timespec * to) {
+    long long usec = (to->tv_sec - from->tv_sec) * 1000000LL + (to->tv_nsec - from->tv_nsec) / 1000;
+    return usec > 0 ? (uint64_t)usec : 0;
+}
+
+void w_tracer_init(w_tracer_t * tracer, const char * section, const char * prefix, const char * const * names, unsigned int count) {
+    char name[OS_SIZE_128];
+    char labels[OS_SIZE_128];
+    unsigned int i;
+
+    memset(tracer, 0, sizeof(w_tracer_t));
+    tracer->rate = getDefine_Int(section, "trace_sample_rate", 0, 1000000);
+    tracer->names = names;
+    tracer->count = count < W_TRACE_MAX_STAGES ? count : W_TRACE_MAX_STAGES;
+
+    snprintf(name, sizeof(name), "%s_trace_stage_seconds", prefix);
+
+    for (i = 0; i < tracer->count; i++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", names[i]);
+        tracer->stages[i] = w_metrics_histogram(name, "Time sampled events spend in each stage.", labels);
+    }
+
+    snprintf(name, sizeof(name), "%s_trace_total_seconds", prefix);
+    tracer->total = w_metrics_histogram(name, "Time sampled events spend in the daemon.", NULL);
+}
+
+int w_trace_begin(const w_tracer_t * tracer, w_trace_t * trace) {
+    if (tracer->rate == 0 || trace_random() % tracer->rate != 0) {
+        trace->id = 0;
+        return 0;
+    }
+
+    trace->id = (uint64_t)getpid() << 40 | (__atomic_add_fetch(&trace_next_id, 1, __ATOMIC_RELAXED) & 0xFFFFFFFFFFULL);
+    trace->done = 0;
+    clock_gettime(CLOCK_MONOTONIC, &trace->start);
+    trace->last = trace->start;
+    return 1;
+}
+
+void w_trace_stage(const w_tracer_t * tracer, w_trace_t * trace, unsigned int stage) {
+    struct timespec now;
+    uint64_t usec;
+
+    if (trace->id == 0 || stage >= tracer->count) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = trace_elapsed(&trace->last, &now);
+    trace->last = now;
+    trace->usec[stage] = usec < UINT32_MAX ? usec : UINT32_MAX;
+    trace->done |= 1U << stage;
+    w_metrics_observe(tracer->stages[stage], usec);
+}
+
+void w_trace_end(const w_tracer_t * tracer, w_trace_t * trace) {
+    char record[OS_SIZE_1024];
+    size_t length = 0;
+    uint64_t total;
+    unsigned int i;
+    int n;
+
+    if (trace->id == 0) {
+        return;
+    }
+
+    total = trace_elapsed(&trace->start, &trace->last);
+    w_metrics_observe(tracer->total, total);
+
+    if (isDebug() >= 2) {
+        for (i = 0; i < tracer->count; i++) {
+            if (trace->done & (1U << i)) {
+                n = snprintf(record + length, sizeof(record) - length, " %s=%u", tracer->names[i], trace->usec[i]);
+                length += n > 0 && (size_t)n < sizeof(record) - length ? (size_t)n : 0;
+            }
+        }
+
+        record[length] = '\0';
+        mdebug2("Trace %016llx (us):%s total=%llu", (unsigned long long)trace->id, record, (unsigned long long)total);
+    }
+
+    trace->id = 0;
+}
+
+int w_trace_probe_set(w_trace_probe_t * probe, const void * item, const w_trace_t * trace) {
+    const void * expected = NULL;
+
+    if (!__atomic_compare_exchange_n(&probe->item, &expected, TRACE_PROBE_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    probe->trace = *trace;
+    __atomic_store_n(&probe->item, item, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int w_trace_probe_take(w_trace_probe_t * probe, const void * item, w_trace_t * trace) {
+    if (__atomic_load_n(&probe->item, __ATOMIC_ACQUIRE) != item) {
+        return 0;
+    }
+
+    *trace = probe->trace;
+    __atomic_store_n(&probe->item, NULL, __ATOMIC_RELEASE);
+    return 1;
+}
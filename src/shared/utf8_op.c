@@ -31,6 +31,31 @@
 /* Starting bytes 111101xx are forbidden (Unicode limit) */
 #define valid_4(x) (x[0] & 0xF8) == 0xF0 && x[0] != (char)0xF0 && (x[0] & 0x04) == 0 && (x[1] & 0xC0) == 0x80 && (x[2] & 0xC0) == 0x80 && (x[3] & 0xC0) == 0x80
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_ASCII_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define UTF8_ASCII_NEON
+#include <arm_neon.h>
+#endif
+
+/* The vector versions load aligned blocks, which may go past the end of the
+ * string but never cross a page */
+#ifdef __clang__
+#define UTF8_NO_ASAN __attribute__((no_sanitize("address")))
+#else
+#define UTF8_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+
+static const char * w_utf8_ascii(const char * string);
+
+#ifdef UTF8_ASCII_X86
+static const char * w_utf8_ascii_sse2(const char * string) __attribute__((target("sse2"))) UTF8_NO_ASAN;
+static const char * w_utf8_ascii_avx2(const char * string) __attribute__((target("avx2"))) UTF8_NO_ASAN;
+#elif defined(UTF8_ASCII_NEON)
+static const char * w_utf8_ascii_neon(const char * string) UTF8_NO_ASAN;
+#endif
+
 /* Return whether a string is UTF-8 */
 bool w_utf8_valid(const char * string) {
     assert(string != NULL);
@@ -41,10 +66,9 @@ bool w_utf8_valid(const char * string) {
 const char * w_utf8_drop(const char * string) {
     assert(string != NULL);
 
-    while (*string) {
-        if (valid_1(string)) {
-            string++;
-        } else if (valid_2(string)) {
+    /* ASCII spans are skipped at once, then the next character is decoded */
+    while (string = w_utf8_ascii(string), *string) {
+        if (valid_2(string)) {
             string += 2;
         } else if (valid_3(string)) {
             string += 3;
@@ -62,12 +86,23 @@ const char * w_utf8_drop(const char * string) {
 char * w_utf8_filter(const char * string, bool replacement) {
     assert(string != NULL);
 
+    char * copy = w_utf8_filter_invalid(string, replacement);
+
+    if (copy == NULL) {
+        os_strdup(string, copy);
+    }
+
+    return copy;
+}
+
+/* Return a new string with valid UTF-8 characters only, or NULL if the string is already valid */
+char * w_utf8_filter_invalid(const char * string, bool replacement) {
+    assert(string != NULL);
+
     const char * valid = w_utf8_drop(string);
 
     if (*valid == '\0') {
-        char * copy;
-        os_strdup(string, copy);
-        return copy;
+        return NULL;
     }
 
     size_t size = strlen(string) + 1;
@@ -79,8 +114,14 @@ char * w_utf8_filter(const char * string, bool replacement) {
     memcpy(copy, string, i);
 
     while (*valid) {
-        if (valid_1(valid)) {
-            copy[i++] = *valid++;
+        const char * next = w_utf8_ascii(valid);
+
+        memcpy(copy + i, valid, next - valid);
+        i += next - valid;
+        valid = next;
+
+        if (*valid == '\0') {
+            break;
         } else if (valid_2(valid)) {
             copy[i++] = *valid++;
             copy[i++] = *valid++;
@@ -114,3 +155,75 @@ char * w_utf8_filter(const char * string, bool replacement) {
     copy[i] = '\0';
     return copy;
 }
+
+/* Return pointer to the first byte that is not ASCII, or the last byte (0) */
+static const char * w_utf8_ascii(const char * string) {
+#ifdef UTF8_ASCII_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return w_utf8_ascii_avx2(string);
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return w_utf8_ascii_sse2(string);
+    }
+#elif defined(UTF8_ASCII_NEON)
+    return w_utf8_ascii_neon(string);
+#endif
+
+    while (*string && valid_1(string)) {
+        string++;
+    }
+
+    return string;
+}
+
+#ifdef UTF8_ASCII_X86
+static const char * w_utf8_ascii_sse2(const char * string) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t offset = (uintptr_t)string & 15;
+    const char * block = string - offset;
+    unsigned int mask;
+
+    /* The high bit of each byte tells whether it's ASCII */
+    for (mask = 0xffff << offset;; block += 16, mask = 0xffff) {
+        __m128i chunk = _mm_load_si128((const __m128i *)block);
+
+        if (mask &= _mm_movemask_epi8(chunk) | _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero)), mask) {
+            return block + __builtin_ctz(mask);
+        }
+    }
+}
+
+static const char * w_utf8_ascii_avx2(const char * string) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t offset = (uintptr_t)string & 31;
+    const char * block = string - offset;
+    unsigned int mask;
+
+    for (mask = 0xffffffffU << offset;; block += 32, mask = 0xffffffffU) {
+        __m256i chunk = _mm256_load_si256((const __m256i *)block);
+
+        if (mask &= (unsigned int)(_mm256_movemask_epi8(chunk) | _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, zero))), mask) {
+            return block + __builtin_ctz(mask);
+        }
+    }
+}
+#elif defined(UTF8_ASCII_NEON)
+static const char * w_utf8_ascii_neon(const char * string) {
+    const uint8x16_t one = vdupq_n_u8(1);
+    const uint8x16_t limit = vdupq_n_u8(0x7F);
+    size_t offset = (uintptr_t)string & 15;
+    const char * block = string - offset;
+    uint64_t mask;
+
+    /* Bytes 0 and 0x80-0xFF wrap to 0x7F-0xFF when decremented. Each byte gives a nibble of the mask */
+    for (mask = ~(uint64_t)0 << (offset * 4);; block += 16, mask = ~(uint64_t)0) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)block);
+        uint8x16_t hits = vcgeq_u8(vsubq_u8(chunk, one), limit);
+
+        if (mask &= vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0), mask) {
+            return block + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+}
+#endif
@@ -241,6 +241,25 @@ int getDefine_Int(const char *high_name, const char *low_name, int min, int max)
     return (ret);
 }
 
+/* Get a string definition. This function always return on
+ * success or exits on error. The value must be freed.
+ */
+char *getDefine_String(const char *high_name, const char *low_name)
+{
+    char *value;
+
+    /* Try to read from the local define file */
+    value = _read_file(high_name, low_name, OSSEC_LDEFINES);
+    if (!value) {
+        value = _read_file(high_name, low_name, OSSEC_DEFINES);
+        if (!value) {
+            merror_exit(DEF_NOT_FOUND, high_name, low_name);
+        }
+    }
+
+    return (value);
+}
+
 /* Check if IP_address is present at that_IP
  * Returns 1 on success or 0 on failure
  */
@@ -10,6 +10,16 @@
 
 #include "wazuhdb_op.h"
 
+static pthread_once_t wdbc_metrics_once = PTHREAD_ONCE_INIT;
+static w_metric_t * wdbc_metric_latency;
+static w_metric_t * wdbc_metric_errors;
+
+// Register the metrics of the queries, in any process that queries Wazuh DB
+static void wdbc_metrics_init() {
+    wdbc_metric_latency = w_metrics_histogram("wazuh_db_query_seconds", "Time to get the response of Wazuh DB.", NULL);
+    wdbc_metric_errors = w_metrics_counter("wazuh_db_query_errors", "Queries to Wazuh DB that failed.", NULL);
+}
+
 /**
  * @brief Connects to Wazuh-DB socket
  *
@@ -64,6 +74,10 @@ int wdbc_query(const int sock, const char *query, char *response, const int len)
     int size = strlen(query);
     int retval = -2;
     ssize_t recv_len;
+    struct timespec start;
+
+    pthread_once(&wdbc_metrics_once, wdbc_metrics_init);
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     // Send query to Wazuh DB
     if (OS_SendSecureTCP(sock, size + 1, query) != 0) {
@@ -94,6 +108,12 @@ int wdbc_query(const int sock, const char *query, char *response, const int len)
     }
 
 end:
+    if (retval == 0) {
+        w_metrics_observe_since(wdbc_metric_latency, &start);
+    } else {
+        w_metrics_inc(wdbc_metric_errors);
+    }
+
     return retval;
 }
 
@@ -189,3 +209,1030 @@ int wdbc_parse_result(char *result, char **payload) {
 
     return retval;
 }
+
+
+/* Upper bound of a batch, so that it fits into a single wazuh-db message */
+#define WDBC_BATCH_MAX (OS_MAXSTR - OS_SIZE_256)
+
+/**
+ * @brief Send a query right away and check the result
+ *
+ * @param sock[in,out] Pointer to the socket descriptor.
+ * @param query Query to send.
+ * @return 0 on success, -1 on error.
+ */
+static int wdbc_batch_send(int *sock, const char *query) {
+
+    char *response;
+    int retval = -1;
+
+    os_malloc(OS_SIZE_6144, response);
+
+    if (wdbc_query_ex(sock, query, response, OS_SIZE_6144) == 0) {
+        if (wdbc_parse_result(response, NULL) == WDBC_OK) {
+            retval = 0;
+        } else {
+            mdebug1("Bad response from wazuh-db to query '%.64s'.", query);
+        }
+    }
+
+    os_free(response);
+    return retval;
+}
+
+/**
+ * @brief Queue a query of an agent database into a batch
+ *
+ * The query is appended to the batch, which is sent first if it belonged to
+ * another agent or if the query doesn't fit into it. Queries that aren't
+ * addressed to an agent, or that are too long to be batched, are sent right
+ * away. The results of the batched queries can't be read by the caller.
+ *
+ * @param sock[in,out] Pointer to the socket descriptor.
+ * @param batch Batch to append the query to.
+ * @param query Query to queue, starting with "agent <id> ".
+ * @return 0 on success, -1 on error.
+ */
+int wdbc_batch_add(int *sock, wdbc_batch_t *batch, const char *query) {
+
+    const char *id;
+    const char *item;
+    size_t id_length;
+    size_t item_length;
+    size_t needed;
+    char prefix[24];
+    int prefix_length;
+    int retval = 0;
+
+    if (strncmp(query, "agent ", 6) != 0) {
+        return wdbc_batch_send(sock, query);
+    }
+
+    id = query + 6;
+
+    if (item = strchr(id, ' '), !item || (id_length = (size_t)(item - id)) >= sizeof(batch->agent_id)) {
+        return wdbc_batch_send(sock, query);
+    }
+
+    item++;
+    item_length = strlen(item);
+    prefix_length = snprintf(prefix, sizeof(prefix), "%zu ", item_length);
+
+    // Items are separated by a space
+    needed = (size_t)prefix_length + item_length + 1;
+
+    if (batch->items > 0 && (strncmp(batch->agent_id, id, id_length) != 0 || batch->agent_id[id_length] != '\0' ||
+                             batch->length + needed > WDBC_BATCH_MAX)) {
+        retval = wdbc_batch_flush(sock, batch);
+    }
+
+    if (batch->items == 0) {
+        memcpy(batch->agent_id, id, id_length);
+        batch->agent_id[id_length] = '\0';
+
+        if (!batch->buffer) {
+            os_malloc(OS_MAXSTR + 1, batch->buffer);
+        }
+
+        batch->length = (size_t)snprintf(batch->buffer, OS_MAXSTR + 1, "agent %s batch", batch->agent_id);
+
+        if (batch->length + needed > WDBC_BATCH_MAX) {
+            return wdbc_batch_send(sock, query) < 0 ? -1 : retval;
+        }
+    }
+
+    batch->buffer[batch->length++] = ' ';
+    memcpy(batch->buffer + batch->length, prefix, (size_t)prefix_length);
+    batch->length += (size_t)prefix_length;
+    memcpy(batch->buffer + batch->length, item, item_length);
+    batch->length += item_length;
+    batch->buffer[batch->length] = '\0';
+    batch->items++;
+
+    return retval;
+}
+
+/**
+ * @brief Check the response to a batch sent through an asynchronous connection
+ *
+ * @param response Response from wazuh-db, or NULL if the connection was lost.
+ * @param arg Batch that was sent.
+ */
+static void wdbc_batch_done(char *response, void *arg) {
+
+    wdbc_batch_t *batch = (wdbc_batch_t *)arg;
+    char *payload;
+    char *ptr;
+    unsigned int failed = 0;
+
+    if (!response) {
+        batch->failed++;
+        return;
+    }
+
+    switch (wdbc_parse_result(response, &payload)) {
+    case WDBC_OK:
+        for (ptr = payload; ptr = strstr(ptr, "-1"), ptr; ptr += 2) {
+            failed++;
+        }
+
+        if (failed) {
+            mdebug1("%u queries of a batch to an agent database failed.", failed);
+            batch->failed++;
+        }
+
+        break;
+    default:
+        merror("Bad response from wazuh-db to a batch of queries: %.64s", payload);
+        batch->failed++;
+    }
+}
+
+/**
+ * @brief Send the queries queued into a batch
+ *
+ * If the batch has an asynchronous connection, it's sent without waiting
+ * for its result, which is checked by wdbc_batch_wait().
+ *
+ * @param sock[in,out] Pointer to the socket descriptor.
+ * @param batch Batch to send. It's empty after the call.
+ * @return 0 on success, -1 if the batch, or any query in it, failed.
+ */
+int wdbc_batch_flush(int *sock, wdbc_batch_t *batch) {
+
+    char *response;
+    char *payload;
+    char *ptr;
+    unsigned int failed = 0;
+    int retval = -1;
+
+    if (batch->items == 0) {
+        return 0;
+    }
+
+    if (batch->async) {
+        if (wdbc_async_query(batch->async, batch->buffer, wdbc_batch_done, batch) < 0) {
+            merror("Cannot send a batch of %u queries to agent %s database.", batch->items, batch->agent_id);
+        } else {
+            retval = 0;
+        }
+
+        batch->length = 0;
+        batch->items = 0;
+
+        // Collect the results that already arrived, without waiting for the rest
+        wdbc_async_poll(batch->async);
+        return retval;
+    }
+
+    os_malloc(OS_MAXSTR + 1, response);
+
+    if (wdbc_query_ex(sock, batch->buffer, response, OS_MAXSTR + 1) == 0) {
+        switch (wdbc_parse_result(response, &payload)) {
+        case WDBC_OK:
+            for (ptr = payload; ptr = strstr(ptr, "-1"), ptr; ptr += 2) {
+                failed++;
+            }
+
+            if (failed) {
+                mdebug1("%u of %u queries to agent %s database failed.", failed, batch->items, batch->agent_id);
+            } else {
+                retval = 0;
+            }
+
+            break;
+        default:
+            merror("Bad response from wazuh-db to a batch of %u queries: %.64s", batch->items, payload);
+        }
+    }
+
+    os_free(response);
+    batch->length = 0;
+    batch->items = 0;
+
+    return retval;
+}
+
+/**
+ * @brief Send the queries queued into a batch and wait for the batches in flight
+ *
+ * Any query sent afterwards on another connection is served after them.
+ *
+ * @param sock[in,out] Pointer to the socket descriptor.
+ * @param batch Batch to send. It's empty after the call.
+ * @return 0 on success, -1 if this batch, or any batch sent since the last wait, failed.
+ */
+int wdbc_batch_wait(int *sock, wdbc_batch_t *batch) {
+
+    int retval = wdbc_batch_flush(sock, batch);
+
+    if (batch->async) {
+        if (wdbc_async_wait(batch->async) < 0) {
+            retval = -1;
+        }
+
+        if (batch->failed) {
+            batch->failed = 0;
+            retval = -1;
+        }
+    }
+
+    return retval;
+}
+
+/**
+ * @brief Release the buffer of a batch, dropping any query left in it
+ *
+ * @param batch Batch to release.
+ */
+void wdbc_batch_free(wdbc_batch_t *batch) {
+
+    os_free(batch->buffer);
+    batch->length = 0;
+    batch->items = 0;
+}
+
+
+/**
+ * @brief Initialize an asynchronous connection. It connects on the first query
+ *
+ * @param async Connection to initialize.
+ * @param window Queries in flight at most. The responses to them must fit into the socket buffers.
+ */
+void wdbc_async_init(wdbc_async_t *async, unsigned int window) {
+
+    memset(async, 0, sizeof(wdbc_async_t));
+    async->sock = -1;
+    async->window = window ? window : WDBC_ASYNC_WINDOW;
+    os_calloc(async->window, sizeof(wdbc_pending_t), async->pending);
+    OS_SecureReaderInit(&async->reader, OS_MAXSTR);
+}
+
+/**
+ * @brief Complete every query in flight as failed and close the connection
+ *
+ * @param async Connection whose queries are failed.
+ */
+static void wdbc_async_fail(wdbc_async_t *async) {
+
+    while (async->count > 0) {
+        wdbc_pending_t *pending = &async->pending[async->head];
+
+        async->head = (async->head + 1) % async->window;
+        async->count--;
+
+        if (pending->callback) {
+            pending->callback(NULL, pending->arg);
+        }
+    }
+
+    if (async->sock >= 0) {
+        close(async->sock);
+        async->sock = -1;
+    }
+
+    OS_SecureReaderReset(&async->reader);
+}
+
+/**
+ * @brief Receive the response to the oldest query in flight and complete it
+ *
+ * @param async Connection to read from.
+ * @return 0 on success, -1 if the connection was lost.
+ */
+static int wdbc_async_complete(wdbc_async_t *async) {
+
+    wdbc_pending_t *pending = &async->pending[async->head];
+    char *response;
+    uint32_t length;
+
+    // The responses that arrive together are read at once, and completed one by one
+    switch (OS_RecvSecureTCPBatch(async->sock, &async->reader, &response, &length, 1)) {
+    case OS_SOCKTERR:
+        merror("Cannot receive message: response size is bigger than expected");
+        wdbc_async_fail(async);
+        return -1;
+    case -1:
+    case 0:
+        merror("Cannot receive message: %s (%d)", strerror(errno), errno);
+        wdbc_async_fail(async);
+        return -1;
+    }
+
+    async->head = (async->head + 1) % async->window;
+    async->count--;
+
+    if (pending->callback) {
+        pending->callback(response, pending->arg);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send a query without waiting for its response
+ *
+ * The callback is run with the response by a later call on this connection,
+ * once the response arrives. If the window is full, the oldest queries are
+ * completed first. Only queries with a single response can be sent this way.
+ *
+ * @param async Connection to send the query through.
+ * @param query Query to send.
+ * @param callback Function to run with the response, or NULL to drop it.
+ * @param arg Argument for the callback.
+ * @return ID of the query, or -1 if it couldn't be sent.
+ */
+long wdbc_async_query(wdbc_async_t *async, const char *query, wdbc_callback_t callback, void *arg) {
+
+    wdbc_pending_t *pending;
+    int attempts;
+
+    for (attempts = 0; attempts < 2; attempts++) {
+        while (async->count >= async->window && async->sock >= 0) {
+            wdbc_async_complete(async);
+        }
+
+        if (async->sock < 0) {
+            if (async->sock = wdbc_connect(), async->sock < 0) {
+                return -1;
+            }
+        }
+
+        if (OS_SendSecureTCP(async->sock, strlen(query) + 1, query) == 0) {
+            break;
+        }
+
+        if (errno != EPIPE || attempts > 0) {
+            merror("Cannot send message: (%d) '%s'.", errno, strerror(errno));
+            wdbc_async_fail(async);
+            return -1;
+        }
+
+        // The queries in flight were lost with the connection
+        merror("Connection with wazuh-db lost. Reconnecting.");
+        wdbc_async_fail(async);
+    }
+
+    pending = &async->pending[(async->head + async->count) % async->window];
+    pending->id = async->next_id++;
+    pending->callback = callback;
+    pending->arg = arg;
+    async->count++;
+
+    return (long)(pending->id & LONG_MAX);
+}
+
+/**
+ * @brief Complete the queries whose responses already arrived, without blocking
+ *
+ * @param async Connection to read from.
+ * @return Number of queries completed, or -1 if the connection was lost.
+ */
+int wdbc_async_poll(wdbc_async_t *async) {
+
+    struct timeval timeout = { 0, 0 };
+    fd_set fdset;
+    int completed = 0;
+
+    while (async->count > 0) {
+        if (!OS_SecureReaderPending(&async->reader)) {
+            FD_ZERO(&fdset);
+            FD_SET(async->sock, &fdset);
+
+            if (select(async->sock + 1, &fdset, NULL, NULL, &timeout) <= 0) {
+                break;
+            }
+        }
+
+        if (wdbc_async_complete(async) < 0) {
+            return -1;
+        }
+
+        completed++;
+    }
+
+    return completed;
+}
+
+/**
+ * @brief Wait for the responses to every query in flight
+ *
+ * @param async Connection to read from.
+ * @return 0 on success, -1 if the connection was lost.
+ */
+int wdbc_async_wait(wdbc_async_t *async) {
+
+    while (async->count > 0) {
+        if (wdbc_async_complete(async) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Wait for the queries in flight and close an asynchronous connection
+ *
+ * @param async Connection to close.
+ */
+void wdbc_async_free(wdbc_async_t *async) {
+
+    if (async->sock >= 0) {
+        wdbc_async_wait(async);
+    }
+
+    wdbc_async_fail(async);
+    os_free(async->pending);
+    OS_SecureReaderFree(&async->reader);
+}
+
+
+/**
+ * @brief Initialize a pool of connections. They connect on the first query
+ *
+ * @param pool Pool to initialize.
+ * @param size Number of connections.
+ * @param path Socket of wazuh-db, or NULL for the default one.
+ */
+void wdbc_pool_init(wdbc_pool_t *pool, unsigned int size, const char *path) {
+
+    unsigned int i;
+
+    memset(pool, 0, sizeof(wdbc_pool_t));
+    w_mutex_init(&pool->mutex, NULL);
+    w_cond_init(&pool->available, NULL);
+
+    if (path) {
+        os_strdup(path, pool->path);
+    } else {
+        os_strdup(isChroot() ? WDB_LOCAL_SOCK : DEFAULTDIR WDB_LOCAL_SOCK, pool->path);
+    }
+
+    pool->size = size ? size : WDBC_POOL_SIZE;
+    os_calloc(pool->size, sizeof(wdbc_conn_t), pool->conns);
+    os_calloc(pool->size, sizeof(wdbc_conn_t *), pool->idle);
+
+    for (i = 0; i < pool->size; i++) {
+        pool->conns[i].sock = -1;
+        OS_SecureReaderInit(&pool->conns[i].reader, OS_MAXSTR);
+        pool->idle[i] = &pool->conns[i];
+    }
+
+    pool->idle_count = pool->size;
+}
+
+/**
+ * @brief Close the connections of a pool. None of them can be in use
+ *
+ * @param pool Pool to free.
+ */
+void wdbc_pool_free(wdbc_pool_t *pool) {
+
+    unsigned int i;
+
+    for (i = 0; i < pool->size; i++) {
+        if (pool->conns[i].sock >= 0) {
+            close(pool->conns[i].sock);
+        }
+
+        OS_SecureReaderFree(&pool->conns[i].reader);
+    }
+
+    os_free(pool->conns);
+    os_free(pool->idle);
+    os_free(pool->path);
+    w_mutex_destroy(&pool->mutex);
+    w_cond_destroy(&pool->available);
+}
+
+static wdbc_pool_t wdbc_default_pool;
+static pthread_once_t wdbc_default_once = PTHREAD_ONCE_INIT;
+
+static void wdbc_default_init(void) {
+    wdbc_pool_init(&wdbc_default_pool, WDBC_POOL_SIZE, NULL);
+}
+
+/**
+ * @brief Get the pool of the process, to share its connections among threads
+ *
+ * @return Pointer to the pool.
+ */
+wdbc_pool_t * wdbc_pool_default(void) {
+
+    pthread_once(&wdbc_default_once, wdbc_default_init);
+    return &wdbc_default_pool;
+}
+
+/* Close a connection of a pool, so the next query opens it again */
+static void wdbc_pool_close(wdbc_conn_t *conn) {
+
+    if (conn->sock >= 0) {
+        close(conn->sock);
+        conn->sock = -1;
+    }
+
+    OS_SecureReaderReset(&conn->reader);
+}
+
+/**
+ * @brief Connect a connection of a pool
+ *
+ * After a failed attempt, the next ones wait for a time that doubles
+ * each time, and the queries fail at once until then.
+ *
+ * @param pool Pool of the connection.
+ * @param conn Connection to open.
+ * @return 0 on success, or -1 on error.
+ */
+static int wdbc_pool_connect(wdbc_pool_t *pool, wdbc_conn_t *conn) {
+
+    time_t now = time(NULL);
+    int sock;
+
+    w_mutex_lock(&pool->mutex);
+
+    if (now < pool->retry) {
+        w_mutex_unlock(&pool->mutex);
+        mdebug2("Not connecting to wazuh-db for %ld seconds.", (long)(pool->retry - now));
+        return -1;
+    }
+
+    w_mutex_unlock(&pool->mutex);
+
+    sock = OS_ConnectUnixDomain(pool->path, SOCK_STREAM, OS_SIZE_6144);
+
+    w_mutex_lock(&pool->mutex);
+
+    if (sock < 0) {
+        if (!pool->backoff) {
+            merror("Unable to connect to socket '%s': %s (%d).", pool->path, strerror(errno), errno);
+        }
+
+        pool->backoff = pool->backoff ? pool->backoff * 2 : WDBC_POOL_RETRY_MIN;
+
+        if (pool->backoff > WDBC_POOL_RETRY_MAX) {
+            pool->backoff = WDBC_POOL_RETRY_MAX;
+        }
+
+        pool->retry = time(NULL) + pool->backoff;
+    } else {
+        if (pool->backoff) {
+            minfo("Connected to '%s' again.", pool->path);
+        }
+
+        pool->backoff = 0;
+        pool->retry = 0;
+    }
+
+    w_mutex_unlock(&pool->mutex);
+
+    conn->sock = sock;
+    return sock < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Take a connection of a pool, and wait for one if all of them are in use
+ *
+ * A connection that has been idle for a while is checked, and closed if lost.
+ *
+ * @param pool Pool to take the connection from.
+ * @return Connection taken, maybe not connected yet.
+ */
+static wdbc_conn_t * wdbc_pool_acquire(wdbc_pool_t *pool) {
+
+    wdbc_conn_t *conn;
+#ifndef WIN32
+    char byte;
+#endif
+
+    w_mutex_lock(&pool->mutex);
+
+    while (pool->idle_count == 0) {
+        w_cond_wait(&pool->available, &pool->mutex);
+    }
+
+    conn = pool->idle[--pool->idle_count];
+    w_mutex_unlock(&pool->mutex);
+
+#ifndef WIN32
+    // wazuh-db may have closed it meanwhile. Any data left would be out of sync.
+    if (conn->sock >= 0 && time(NULL) - conn->last >= WDBC_POOL_CHECK) {
+        if (recv(conn->sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            mdebug2("Connection with wazuh-db lost while idle. Reconnecting.");
+            wdbc_pool_close(conn);
+        }
+    }
+#endif
+
+    return conn;
+}
+
+/* Give a connection back to its pool */
+static void wdbc_pool_release(wdbc_pool_t *pool, wdbc_conn_t *conn) {
+
+    conn->last = time(NULL);
+
+    w_mutex_lock(&pool->mutex);
+    pool->idle[pool->idle_count++] = conn;
+    w_cond_signal(&pool->available);
+    w_mutex_unlock(&pool->mutex);
+}
+
+/* Send queries through a connection of a pool, and connect again once if it was lost */
+static int wdbc_pool_send(wdbc_pool_t *pool, wdbc_conn_t *conn, char * const *queries, int n) {
+
+    uint32_t sizes[n];
+    int attempts;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        sizes[i] = strlen(queries[i]) + 1;
+    }
+
+    for (attempts = 0; attempts < 2; attempts++) {
+        if (conn->sock < 0 && wdbc_pool_connect(pool, conn) < 0) {
+            return -1;
+        }
+
+        if (OS_SendSecureTCPBatch(conn->sock, queries, sizes, n) == 0) {
+            return 0;
+        }
+
+        if (errno != EPIPE || attempts > 0) {
+            merror("Cannot send message: (%d) '%s'.", errno, strerror(errno));
+            wdbc_pool_close(conn);
+            return -1;
+        }
+
+        merror("Connection with wazuh-db lost. Reconnecting.");
+        wdbc_pool_close(conn);
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Send a query through a pool of connections and store the response
+ *
+ * It's thread-safe: each thread takes a connection of the pool, and waits
+ * for one if all of them are in use.
+ *
+ * @param[in] pool Pool of connections.
+ * @param[in] query Query to be sent to Wazuh-DB.
+ * @param[out] response Char pointer where the response from Wazuh-DB will be stored.
+ * @param[in] len Length of the response param.
+ * @retval -2 Error in the communication.
+ * @retval -1 Error in the response from socket.
+ * @retval 0 Success.
+ */
+int wdbc_pool_query(wdbc_pool_t *pool, const char *query, char *response, const int len) {
+
+    wdbc_conn_t *conn = wdbc_pool_acquire(pool);
+    char *queries[] = { (char *)query };
+    int retval = -2;
+
+    if (wdbc_pool_send(pool, conn, queries, 1) == 0) {
+        retval = -1;
+
+        switch (OS_RecvSecureTCP(conn->sock, response, len)) {
+        case OS_SOCKTERR:
+            // The rest of the response is still in the socket
+            merror("Cannot receive message: response size is bigger than expected");
+            wdbc_pool_close(conn);
+            break;
+        case -1:
+        case 0:
+            merror("Cannot receive message: %s (%d)", strerror(errno), errno);
+            wdbc_pool_close(conn);
+            break;
+        default:
+            response[len - 1] = '\0';
+            retval = 0;
+        }
+    }
+
+    wdbc_pool_release(pool, conn);
+    return retval;
+}
+
+/**
+ * @brief Send many queries through a connection of a pool, without waiting for each response
+ *
+ * The callback is run with each response, in the order of the queries, and
+ * with NULL for the queries that got no response. The responses to the
+ * queries must fit into the socket buffers.
+ *
+ * @param pool Pool of connections.
+ * @param queries Queries to send.
+ * @param n Number of queries.
+ * @param callback Function to run with each response.
+ * @param arg Argument for the callback.
+ * @retval -2 Error in the communication.
+ * @retval -1 Error in the response from socket.
+ * @retval 0 Success.
+ */
+int wdbc_pool_pipeline(wdbc_pool_t *pool, char * const *queries, int n, wdbc_callback_t callback, void *arg) {
+
+    if (n <= 0) {
+        return 0;
+    }
+
+    wdbc_conn_t *conn = wdbc_pool_acquire(pool);
+    char *responses[n];
+    uint32_t lengths[n];
+    int retval = -2;
+    int done = 0;
+    int count;
+    int i;
+
+    if (wdbc_pool_send(pool, conn, queries, n) == 0) {
+        retval = 0;
+
+        while (done < n) {
+            if (count = OS_RecvSecureTCPBatch(conn->sock, &conn->reader, responses, lengths, n - done), count <= 0) {
+                if (count == OS_SOCKTERR) {
+                    merror("Cannot receive message: response size is bigger than expected");
+                } else {
+                    merror("Cannot receive message: %s (%d)", strerror(errno), errno);
+                }
+
+                wdbc_pool_close(conn);
+                retval = -1;
+                break;
+            }
+
+            for (i = 0; i < count; i++) {
+                callback(responses[i], arg);
+            }
+
+            done += count;
+        }
+    }
+
+    for (; done < n; done++) {
+        callback(NULL, arg);
+    }
+
+    wdbc_pool_release(pool, conn);
+    return retval;
+}
+
+
+/**
+ * @brief Switch the responses to SQL queries on a connection to the binary format
+ *
+ * @param sock Client socket descriptor.
+ * @return 0 on success, -1 on error.
+ */
+int wdbc_set_binary(int sock) {
+
+    char response[OS_SIZE_256];
+
+    if (wdbc_query(sock, "wazuhdb format binary", response, sizeof(response)) != 0) {
+        return -1;
+    }
+
+    if (wdbc_parse_result(response, NULL) != WDBC_OK) {
+        mdebug1("Bad response from wazuh-db to the binary format request.");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Check connection to Wazuh-DB, sends a SQL query and stores its binary result.
+ *
+ * New connections are switched to the binary format, so the socket should
+ * only be used through this function.
+ *
+ * @param[in] sock Pointer to the client socket descriptor.
+ * @param[in] query Query to be sent to Wazuh-DB.
+ * @param[out] response Buffer where the response from Wazuh-DB will be stored.
+ * @param[in] len Length of the response param.
+ * @retval -2 Error in the communication.
+ * @retval -1 Error in the response from socket.
+ * @return Length of the response, on success.
+ */
+int wdbc_query_binary(int *sock, const char *query, char *response, const int len) {
+
+    ssize_t recv_len;
+    int attempts;
+
+    for (attempts = 0; attempts < 2; attempts++) {
+        if (*sock < 0) {
+            if (*sock = wdbc_connect(), *sock < 0) {
+                return -2;
+            }
+
+            if (wdbc_set_binary(*sock) < 0) {
+                close(*sock);
+                *sock = -1;
+                return -2;
+            }
+        }
+
+        if (OS_SendSecureTCP(*sock, strlen(query) + 1, query) == 0) {
+            break;
+        }
+
+        if (errno != EPIPE || attempts > 0) {
+            merror("Cannot send message: (%d) '%s'.", errno, strerror(errno));
+            return -2;
+        }
+
+        merror("Connection with wazuh-db lost. Reconnecting.");
+        close(*sock);
+        *sock = -1;
+    }
+
+    switch (recv_len = OS_RecvSecureTCP(*sock, response, len), recv_len) {
+    case OS_SOCKTERR:
+        // The rest of the response is still in the socket
+        merror("Cannot receive message: response size is bigger than expected");
+        close(*sock);
+        *sock = -1;
+        return -1;
+    case -1:
+    case 0:
+        merror("Cannot receive message: %s (%d)", strerror(errno), errno);
+        close(*sock);
+        *sock = -1;
+        return -1;
+    default:
+        return (int)recv_len;
+    }
+}
+
+
+/* Read an unsigned integer of n bytes, little-endian */
+static uint64_t wdbc_get_uint(const unsigned char *src, int n) {
+
+    uint64_t value = 0;
+    int i;
+
+    for (i = n - 1; i >= 0; i--) {
+        value = (value << 8) | src[i];
+    }
+
+    return value;
+}
+
+/* Skip a value, or return NULL if it overruns the end of the response */
+static const unsigned char * wdbc_skip_value(const unsigned char *p, const unsigned char *end) {
+
+    if (p >= end) {
+        return NULL;
+    }
+
+    switch (*p) {
+    case WDBC_NULL:
+        return p + 1;
+    case WDBC_INTEGER:
+    case WDBC_FLOAT:
+        return end - p >= 9 ? p + 9 : NULL;
+    case WDBC_TEXT:
+    case WDBC_BLOB:
+        if (end - p < 5 || (uint64_t)(end - p - 5) < wdbc_get_uint(p + 1, 4)) {
+            return NULL;
+        }
+
+        return p + 5 + wdbc_get_uint(p + 1, 4);
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief Index a binary result, as received by wdbc_query_binary()
+ *
+ * The table points into the response, which must outlive it.
+ *
+ * @param table[out] Table to fill.
+ * @param response Response from Wazuh-DB.
+ * @param length Length of the response.
+ * @return 0 on success, -1 if the query failed or the response is malformed.
+ */
+int wdbc_table_parse(wdbc_table_t *table, const char *response, size_t length) {
+
+    const unsigned char *p = (const unsigned char *)response;
+    const unsigned char *end = p + length;
+    unsigned int i;
+    unsigned int j;
+
+    memset(table, 0, sizeof(wdbc_table_t));
+
+    if (length < 11 || memcmp(response, "ok ", 3) != 0) {
+        mdebug1("Bad response from wazuh-db to a binary query: %.*s", (int)(length < 64 ? length : 64), response);
+        return -1;
+    }
+
+    table->columns = (unsigned int)wdbc_get_uint(p + 3, 4);
+    table->rows = (unsigned int)wdbc_get_uint(p + 7, 4);
+    p += 11;
+
+    // Each column takes at least 2 bytes
+    if (table->columns > (size_t)(end - p) / 2) {
+        goto error;
+    }
+
+    os_calloc(table->columns ? table->columns : 1, sizeof(wdbc_column_t), table->column);
+
+    for (i = 0; i < table->columns; i++) {
+        if (end - p < 2 || (size_t)(end - p - 2) < wdbc_get_uint(p, 2)) {
+            goto error;
+        }
+
+        table->column[i].name_length = wdbc_get_uint(p, 2);
+        table->column[i].name = (const char *)p + 2;
+        p += 2 + table->column[i].name_length;
+        table->column[i].data = p;
+
+        for (j = 0; j < table->rows; j++) {
+            if (p = wdbc_skip_value(p, end), !p) {
+                goto error;
+            }
+        }
+    }
+
+    return 0;
+
+error:
+    mdebug1("Malformed binary response from wazuh-db.");
+    wdbc_table_free(table);
+    return -1;
+}
+
+/**
+ * @brief Find a column of a binary result by name
+ *
+ * @param table Table to search.
+ * @param name Name of the column.
+ * @return Index of the column, or -1 if it doesn't exist.
+ */
+int wdbc_table_find(const wdbc_table_t *table, const char *name) {
+
+    size_t length = strlen(name);
+    unsigned int i;
+
+    for (i = 0; i < table->columns; i++) {
+        if (table->column[i].name_length == length && memcmp(table->column[i].name, name, length) == 0) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Decode the values of a column of a binary result
+ *
+ * @param table Table, as filled by wdbc_table_parse().
+ * @param column Index of the column, lower than the number of columns.
+ * @param values[out] Array of one value per row.
+ */
+void wdbc_table_values(const wdbc_table_t *table, unsigned int column, wdbc_value_t *values) {
+
+    const unsigned char *p = table->column[column].data;
+    uint64_t bits;
+    unsigned int i;
+
+    for (i = 0; i < table->rows; i++) {
+        memset(values + i, 0, sizeof(wdbc_value_t));
+        values[i].type = (wdbc_type)*p;
+
+        switch (*p) {
+        case WDBC_INTEGER:
+            values[i].integer = (long long)wdbc_get_uint(p + 1, 8);
+            p += 9;
+            break;
+        case WDBC_FLOAT:
+            bits = wdbc_get_uint(p + 1, 8);
+            memcpy(&values[i].real, &bits, sizeof(bits));
+            p += 9;
+            break;
+        case WDBC_TEXT:
+        case WDBC_BLOB:
+            values[i].length = wdbc_get_uint(p + 1, 4);
+            values[i].data = (const char *)p + 5;
+            p += 5 + values[i].length;
+            break;
+        default:
+            p++;
+        }
+    }
+}
+
+/**
+ * @brief Release the index of a binary result
+ *
+ * @param table Table to release.
+ */
+void wdbc_table_free(wdbc_table_t *table) {
+
+    os_free(table->column);
+    table->columns = 0;
+    table->rows = 0;
+}
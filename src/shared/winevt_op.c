@@ -0,0 +1,688 @@
+/*
+ * Windows EventChannel event rendering
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 14, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include "shared.h"
+#include "winevt_op.h"
+
+/* Logging levels */
+#define WINEVT_AUDIT        0
+#define WINEVT_CRITICAL     1
+#define WINEVT_ERROR        2
+#define WINEVT_WARNING      3
+#define WINEVT_INFORMATION  4
+#define WINEVT_VERBOSE      5
+
+/* Audit types */
+#define WINEVT_AUDIT_FAILURE 0x10000000000000LL
+#define WINEVT_AUDIT_SUCCESS 0x20000000000000LL
+
+/* First audit category, and first subcategory ID of it. Each category has 256 subcategory IDs */
+#define WINEVT_CATEGORY_BASE    8272
+#define WINEVT_SUBCATEGORY_BASE 12288
+
+/* OS_XML gives up on names and texts this long (XML_MAXSIZE) */
+#define WINEVT_TOKEN_MAX    20479
+#define WINEVT_KEY_MAX      OS_SIZE_1024
+#define WINEVT_ATTRS_MAX    16
+
+static const char * const winevt_system[] = { "Security State Change", "Security System Extension", "System Integrity", "IPsec Driver", "Other System Events", NULL };
+static const char * const winevt_logon[] = { "Logon", "Logoff", "Account Lockout", "IPsec Main Mode", "Special Logon", "IPSec Extended Mode", "IPSec Quick Mode", "Other Logon/Logoff Events", "Network Policy Server", "User/Device Claims", "Group Membership", NULL };
+static const char * const winevt_object[] = { "File System", "Registry", "Kernel Object", "SAM", "Other Object Access Events", "Certification Services", "Application Generated", "Handle Manipulation", "File Share", "Filtering Platform Packet Drop", "Filtering Platform Connection", "Detailed File Share", "Removable Storage", "Central Policy Staging", NULL };
+static const char * const winevt_privilege[] = { "Sensitive Privilege Use", "Non Sensitive Privilege Use", "Other Privilege Use Events", NULL };
+static const char * const winevt_tracking[] = { "Process Creation", "Process Termination", "DPAPI Activity", "RPC Events", "Plug and Play Events", "Token Right Adjusted Events", NULL };
+static const char * const winevt_policy[] = { "Audit Policy Change", "Authentication Policy Change", "Authorization Policy Change", "MPSSVC Rule-Level Policy Change", "Filtering Platform Policy Change", "Other Policy Change Events", NULL };
+static const char * const winevt_account[] = { "User Account Management", "Computer Account Management", "Security Group Management", "Distribution Group Management", "Application Group Management", "Other Account Management Events", NULL };
+static const char * const winevt_ds[] = { "Directory Service Access", "Directory Service Changes", "Directory Service Replication", "Detailed Directory Service Replication", NULL };
+static const char * const winevt_logon_account[] = { "Credential Validation", "Kerberos Service Ticket Operations", "Other Account Logon Events", "Kerberos Authentication Service", NULL };
+
+static const struct {
+    const char * name;
+    const char * const * subcategories;
+} winevt_categories[] = {
+    { "System", winevt_system },
+    { "Logon/Logoff", winevt_logon },
+    { "Object Access", winevt_object },
+    { "Privilege Use", winevt_privilege },
+    { "Detailed Tracking", winevt_tracking },
+    { "Policy Change", winevt_policy },
+    { "Account Management", winevt_account },
+    { "DS Access", winevt_ds },
+    { "Account Logon", winevt_logon_account }
+};
+
+typedef enum winevt_kind {
+    WINEVT_SYSTEM,
+    WINEVT_EVENTDATA,
+    WINEVT_OTHER
+} winevt_kind;
+
+typedef struct winevt_attr {
+    const char * name;
+    size_t name_length;
+    const char * value;
+    size_t value_length;
+} winevt_attr;
+
+typedef struct winevt_node {
+    const char * name;
+    size_t name_length;
+    const char * content;
+    size_t content_length;
+    winevt_attr attrs[WINEVT_ATTRS_MAX];
+    int n_attrs;
+    winevt_kind kind;
+} winevt_node;
+
+/* Text copied from the event while it's scanned */
+typedef struct winevt_text {
+    const char * str;
+    size_t length;
+} winevt_text;
+
+typedef struct winevt_ctx {
+    w_json_writer_t * system;
+    w_json_writer_t * eventdata;
+    w_json_writer_t * extra;
+    winevt_text level;
+    winevt_text keywords;
+    winevt_text category_id;
+    winevt_text subcategory_id;
+    winevt_text audit_changes;
+    winevt_text extra_name;
+    char * join;
+    size_t join_length;
+    size_t join_size;
+    int failed;
+    char key[WINEVT_KEY_MAX];
+} winevt_ctx;
+
+static __thread w_json_writer_t winevt_system_writer;
+static __thread w_json_writer_t winevt_eventdata_writer;
+static __thread w_json_writer_t winevt_extra_writer;
+
+/* Parse an ID after removing the "%%" marks */
+static long winevt_id(const char * str) {
+    char * filtered = wstr_replace(str, "%%", "");
+    long id = strtol(filtered, NULL, 10);
+
+    os_free(filtered);
+    return id;
+}
+
+const char * w_winevt_severity(const char * level, const char * keywords) {
+    unsigned long long int keywords_n = strtoull(keywords, NULL, 16);
+
+    switch (strtol(level, NULL, 10)) {
+    case WINEVT_CRITICAL:
+        return "CRITICAL";
+    case WINEVT_ERROR:
+        return "ERROR";
+    case WINEVT_WARNING:
+        return "WARNING";
+    case WINEVT_INFORMATION:
+        return "INFORMATION";
+    case WINEVT_VERBOSE:
+        return "VERBOSE";
+    case WINEVT_AUDIT:
+        if (keywords_n & WINEVT_AUDIT_FAILURE) {
+            return "AUDIT_FAILURE";
+        } else if (keywords_n & WINEVT_AUDIT_SUCCESS) {
+            return "AUDIT_SUCCESS";
+        }
+        // fall through
+    default:
+        return "UNKNOWN";
+    }
+}
+
+void w_winevt_category(const char * category_id, const char * subcategory_id, const char ** category, const char ** subcategory) {
+    long category_n = winevt_id(category_id) - WINEVT_CATEGORY_BASE;
+    long subcategory_n = winevt_id(subcategory_id);
+    long i;
+
+    *category = NULL;
+    *subcategory = NULL;
+
+    if (category_n < 0 || category_n >= (long)(sizeof(winevt_categories) / sizeof(winevt_categories[0]))) {
+        return;
+    }
+
+    *category = winevt_categories[category_n].name;
+    subcategory_n -= WINEVT_SUBCATEGORY_BASE + 256 * category_n;
+
+    for (i = 0; subcategory_n >= 0 && winevt_categories[category_n].subcategories[i] != NULL; i++) {
+        if (i == subcategory_n) {
+            *subcategory = winevt_categories[category_n].subcategories[i];
+            break;
+        }
+    }
+}
+
+char * w_winevt_audit_changes(const char * changes) {
+    char * filtered = wstr_replace(changes, "%%", "");
+    char ** split = OS_StrBreak(',', filtered, 4);
+    char * output = NULL;
+    size_t length = 0;
+    const char * change;
+    int i;
+
+    for (i = 0; split && split[i]; i++) {
+        switch (strtol(split[i], NULL, 10)) {
+        case 8448:
+            change = "Success removed";
+            break;
+        case 8449:
+            change = "Success added";
+            break;
+        case 8450:
+            change = "Failure removed";
+            break;
+        case 8451:
+            change = "Failure added";
+            break;
+        default:
+            continue;
+        }
+
+        os_realloc(output, length + strlen(change) + 3, output);
+        length += (size_t)sprintf(output + length, length ? ", %s" : "%s", change);
+    }
+
+    free_strarray(split);
+    os_free(filtered);
+    return output;
+}
+
+static int winevt_is(const char * str, size_t length, const char * literal) {
+    return strlen(literal) == length && memcmp(str, literal, length) == 0;
+}
+
+/* Values that the decoder treats as empty */
+static int winevt_is_null(const char * str, size_t length) {
+    return length == 0 || winevt_is(str, length, "(NULL)") || winevt_is(str, length, "-");
+}
+
+/* Length without the trailing spaces, like replace_win_format() */
+static size_t winevt_trim(const char * str, size_t length) {
+    while (length > 1 && isspace((unsigned char)str[length - 1])) {
+        length--;
+    }
+
+    return length;
+}
+
+/* Copy a key to ctx->key with its first letter in lowercase */
+static int winevt_key(winevt_ctx * ctx, const char * key, size_t length) {
+    if (length >= WINEVT_KEY_MAX) {
+        ctx->failed = 1;
+        return -1;
+    }
+
+    memcpy(ctx->key, key, length);
+
+    if (length > 0) {
+        ctx->key[0] = (char)tolower((unsigned char)ctx->key[0]);
+    }
+
+    return 0;
+}
+
+/* Add a member whose key gets its first letter in lowercase */
+static void winevt_add(winevt_ctx * ctx, w_json_writer_t * writer, const char * key, size_t key_length, const char * value, size_t value_length) {
+    if (winevt_key(ctx, key, key_length) == 0) {
+        w_json_add_key_n(writer, ctx->key, key_length);
+        w_json_add_string_n(writer, NULL, value, value_length);
+    }
+}
+
+static void winevt_system_member(winevt_ctx * ctx, const winevt_node * node) {
+    const winevt_attr * attrs = node->attrs;
+    int i;
+
+    if (winevt_is(node->name, node->name_length, "Provider")) {
+        for (i = 0; i < node->n_attrs; i++) {
+            if (winevt_is(attrs[i].name, attrs[i].name_length, "Name")) {
+                w_json_add_key_n(ctx->system, "providerName", 12);
+            } else if (winevt_is(attrs[i].name, attrs[i].name_length, "Guid")) {
+                w_json_add_key_n(ctx->system, "providerGuid", 12);
+            } else if (winevt_is(attrs[i].name, attrs[i].name_length, "EventSourceName")) {
+                w_json_add_key_n(ctx->system, "eventSourceName", 15);
+            } else {
+                continue;
+            }
+
+            w_json_add_string_n(ctx->system, NULL, attrs[i].value, attrs[i].value_length);
+        }
+    } else if (winevt_is(node->name, node->name_length, "TimeCreated")) {
+        if (node->n_attrs > 0 && winevt_is(attrs[0].name, attrs[0].name_length, "SystemTime")) {
+            w_json_add_key_n(ctx->system, "systemTime", 10);
+            w_json_add_string_n(ctx->system, NULL, attrs[0].value, attrs[0].value_length);
+        }
+    } else if (winevt_is(node->name, node->name_length, "Execution")) {
+        if (node->n_attrs > 0 && winevt_is(attrs[0].name, attrs[0].name_length, "ProcessID")) {
+            w_json_add_key_n(ctx->system, "processID", 9);
+            w_json_add_string_n(ctx->system, NULL, attrs[0].value, attrs[0].value_length);
+        }
+
+        if (node->n_attrs > 1 && winevt_is(attrs[1].name, attrs[1].name_length, "ThreadID")) {
+            w_json_add_key_n(ctx->system, "threadID", 8);
+            w_json_add_string_n(ctx->system, NULL, attrs[1].value, attrs[1].value_length);
+        }
+    } else if (winevt_is(node->name, node->name_length, "Channel")) {
+        w_json_add_key_n(ctx->system, "channel", 7);
+        w_json_add_string_n(ctx->system, NULL, node->content, node->content_length);
+
+        if (node->n_attrs > 0 && winevt_is(attrs[0].value, attrs[0].value_length, "UserID")) {
+            w_json_add_key_n(ctx->system, "userID", 6);
+            w_json_add_string_n(ctx->system, NULL, attrs[0].value, attrs[0].value_length);
+        }
+    } else if (winevt_is(node->name, node->name_length, "Security")) {
+        if (node->n_attrs > 0 && winevt_is(attrs[0].value, attrs[0].value_length, "UserID")) {
+            w_json_add_key_n(ctx->system, "securityUserID", 14);
+            w_json_add_string_n(ctx->system, NULL, attrs[0].value, attrs[0].value_length);
+        }
+    } else if (winevt_is(node->name, node->name_length, "Level")) {
+        ctx->level.str = node->content;
+        ctx->level.length = node->content_length;
+        winevt_add(ctx, ctx->system, node->name, node->name_length, node->content, node->content_length);
+    } else if (winevt_is(node->name, node->name_length, "Keywords")) {
+        ctx->keywords.str = node->content;
+        ctx->keywords.length = node->content_length;
+        winevt_add(ctx, ctx->system, node->name, node->name_length, node->content, node->content_length);
+    } else if (!winevt_is(node->name, node->name_length, "Correlation") && node->content_length > 0) {
+        winevt_add(ctx, ctx->system, node->name, node->name_length, node->content, node->content_length);
+    }
+}
+
+/* Join the values of the Data elements that have no name */
+static void winevt_join(winevt_ctx * ctx, const char * value, size_t length) {
+    size_t separator = ctx->join_length ? 2 : 0;
+
+    if (ctx->join_length + separator + length >= OS_MAXSTR) {
+        return;
+    }
+
+    if (ctx->join_length + separator + length + 1 > ctx->join_size) {
+        ctx->join_size = ctx->join_length + separator + length + 1;
+        os_realloc(ctx->join, ctx->join_size, ctx->join);
+    }
+
+    if (separator) {
+        memcpy(ctx->join + ctx->join_length, ", ", 2);
+    }
+
+    memcpy(ctx->join + ctx->join_length + separator, value, length);
+    ctx->join_length += separator + length;
+}
+
+static void winevt_eventdata_member(winevt_ctx * ctx, const winevt_node * node) {
+    const winevt_attr * attrs = node->attrs;
+    const char * key = ctx->key;
+    size_t length;
+    int i;
+
+    if (winevt_is_null(node->content, node->content_length)) {
+        return;
+    }
+
+    length = winevt_trim(node->content, node->content_length);
+
+    if (!winevt_is(node->name, node->name_length, "Data")) {
+        winevt_add(ctx, ctx->eventdata, node->name, node->name_length, node->content, length);
+        return;
+    }
+
+    if (node->n_attrs == 0) {
+        winevt_join(ctx, node->content, length);
+        return;
+    }
+
+    for (i = 0; i < node->n_attrs; i++) {
+        if (!winevt_is(attrs[i].name, attrs[i].name_length, "Name")) {
+            mdebug2("Unexpected attribute at EventData (%.*s).", (int)attrs[i].name_length, attrs[i].name);
+            winevt_add(ctx, ctx->eventdata, attrs[i].value, attrs[i].value_length, node->content, length);
+            continue;
+        }
+
+        if (winevt_key(ctx, attrs[i].value, attrs[i].value_length) < 0) {
+            return;
+        }
+
+        if (winevt_is(key, attrs[i].value_length, "categoryId")) {
+            ctx->category_id.str = node->content;
+            ctx->category_id.length = length;
+        } else if (winevt_is(key, attrs[i].value_length, "subcategoryId")) {
+            ctx->subcategory_id.str = node->content;
+            ctx->subcategory_id.length = length;
+        }
+
+        // The changes are described at the end, the IDs are kept under another name
+        if (winevt_is(key, attrs[i].value_length, "auditPolicyChanges")) {
+            ctx->audit_changes.str = node->content;
+            ctx->audit_changes.length = length;
+            w_json_add_key_n(ctx->eventdata, "auditPolicyChangesId", 20);
+        } else {
+            w_json_add_key_n(ctx->eventdata, key, attrs[i].value_length);
+        }
+
+        w_json_add_string_n(ctx->eventdata, NULL, node->content, length);
+        break;
+    }
+}
+
+static void winevt_extra_member(winevt_ctx * ctx, const winevt_node * node) {
+    if (!winevt_is_null(node->content, node->content_length)) {
+        winevt_add(ctx, ctx->extra, node->name, node->name_length, node->content, winevt_trim(node->content, node->content_length));
+    }
+}
+
+/* Scan the attributes after an element name, up to the closing '>' or '/'. Set *closed if the element is empty */
+static const char * winevt_attributes(winevt_node * node, const char * p, const char * end, int * closed) {
+    winevt_attr * attr;
+    const char * quote;
+    int i;
+
+    while (1) {
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+
+        if (p == end) {
+            return NULL;
+        } else if (*p == '>') {
+            return p + 1;
+        } else if (*p == '/') {
+            // OS_XML leaves the '>' to the parent text
+            *closed = 1;
+            return p + 1;
+        }
+
+        if (node->n_attrs == WINEVT_ATTRS_MAX) {
+            return NULL;
+        }
+
+        attr = node->attrs + node->n_attrs;
+        attr->name = p;
+
+        while (p < end && *p != '=') {
+            if (*p == '>' || *p == '/' || isspace((unsigned char)*p)) {
+                return NULL;
+            }
+
+            p++;
+        }
+
+        if (p == end || (attr->name_length = (size_t)(p - attr->name)) == 0 || attr->name_length >= WINEVT_TOKEN_MAX) {
+            return NULL;
+        }
+
+        for (p++; p < end && isspace((unsigned char)*p); p++);
+
+        if (p == end || (*p != '"' && *p != '\'')) {
+            return NULL;
+        }
+
+        if (quote = memchr(p + 1, *p, (size_t)(end - p - 1)), !quote) {
+            return NULL;
+        }
+
+        attr->value = p + 1;
+
+        if (attr->value_length = (size_t)(quote - attr->value), attr->value_length >= WINEVT_TOKEN_MAX) {
+            return NULL;
+        }
+
+        for (i = 0; i < node->n_attrs; i++) {
+            if (node->attrs[i].name_length == attr->name_length && memcmp(node->attrs[i].name, attr->name, attr->name_length) == 0) {
+                return NULL;
+            }
+        }
+
+        node->n_attrs++;
+
+        if (p = quote + 1, p == end) {
+            return NULL;
+        } else if (*p == '>') {
+            return p + 1;
+        } else if (*p == '/') {
+            *closed = 1;
+            return p + 1;
+        } else if (!isspace((unsigned char)*p)) {
+            return NULL;
+        }
+    }
+}
+
+/* An odd run of backslashes before a '<' makes OS_XML take it as text */
+static int winevt_escaped(const char * text, const char * p) {
+    const char * b;
+
+    for (b = p; b > text && b[-1] == '\\'; b--);
+    return (p - b) % 2;
+}
+
+/* Scan an element that starts at p, '<' included. Return the position after it, or NULL to give up */
+static const char * winevt_element(winevt_ctx * ctx, const char * p, const char * end, int depth, const winevt_node * parent) {
+    winevt_node node;
+    const char * text;
+    const char * close;
+    int closed = 0;
+
+    node.name = ++p;
+    node.content = "";
+    node.content_length = 0;
+    node.n_attrs = 0;
+
+    while (p < end && *p != '>' && !isspace((unsigned char)*p)) {
+        p++;
+    }
+
+    if (p == end || (node.name_length = (size_t)(p - node.name)) >= WINEVT_TOKEN_MAX) {
+        return NULL;
+    }
+
+    if (node.name_length > 0 && node.name[node.name_length - 1] == '/') {
+        node.name_length--;
+        closed = 1;
+    }
+
+    // OS_XML doesn't return the variables as elements
+    if (node.name_length == 0 || (node.name_length == 3 && strncasecmp(node.name, "var", 3) == 0)) {
+        return NULL;
+    }
+
+    if (*p == '>') {
+        p++;
+    } else if (p = winevt_attributes(&node, p + 1, end, &closed), !p) {
+        return NULL;
+    }
+
+    if (depth == 1) {
+        node.kind = winevt_is(node.name, node.name_length, "System") ? WINEVT_SYSTEM :
+                    winevt_is(node.name, node.name_length, "EventData") ? WINEVT_EVENTDATA : WINEVT_OTHER;
+    } else {
+        node.kind = parent ? parent->kind : WINEVT_OTHER;
+    }
+
+    while (!closed) {
+        for (text = p; p < end && *p != '<'; p++);
+
+        if (p + 1 >= end || p - text >= WINEVT_TOKEN_MAX || winevt_escaped(text, p)) {
+            return NULL;
+        }
+
+        if (p[1] == '/') {
+            close = p + 2;
+
+            if (p = memchr(close, '>', (size_t)(end - close)), !p) {
+                return NULL;
+            }
+
+            if ((size_t)(p - close) != node.name_length || memcmp(close, node.name, node.name_length) != 0) {
+                return NULL;
+            }
+
+            // The content is the text after the last child
+            node.content = text;
+            node.content_length = (size_t)(close - 2 - text);
+            p++;
+            break;
+        }
+
+        // Comments, declarations and deeper data are left to OS_XML
+        if (p[1] == '!' || p[1] == '?' || depth == 3 || (depth == 2 && node.kind != WINEVT_OTHER)) {
+            return NULL;
+        }
+
+        if (p = winevt_element(ctx, p, end, depth + 1, &node), !p) {
+            return NULL;
+        }
+    }
+
+    if (depth == 2) {
+        switch (node.kind) {
+        case WINEVT_SYSTEM:
+            winevt_system_member(ctx, &node);
+            break;
+        case WINEVT_EVENTDATA:
+            winevt_eventdata_member(ctx, &node);
+            break;
+        default:
+            mdebug1("Unexpected element (%.*s). Decoding it.", (int)parent->name_length, parent->name);
+            ctx->extra_name.str = node.name;
+            ctx->extra_name.length = node.name_length;
+        }
+    } else if (depth == 3) {
+        winevt_extra_member(ctx, &node);
+    }
+
+    return p;
+}
+
+/* Copy a text into a string */
+static char * winevt_strdup(const winevt_text * text) {
+    char * str;
+
+    os_malloc(text->length + 1, str);
+    memcpy(str, text->str, text->length);
+    str[text->length] = '\0';
+    return str;
+}
+
+/* Add the members that depend on several elements */
+static void winevt_finish(winevt_ctx * ctx, const char * message) {
+    const char * category;
+    const char * subcategory;
+    char * level;
+    char * keywords;
+    char * category_id;
+    char * subcategory_id;
+    char * changes;
+    char * description;
+
+    if (ctx->level.str && ctx->keywords.str) {
+        level = winevt_strdup(&ctx->level);
+        keywords = winevt_strdup(&ctx->keywords);
+        w_json_add_string(ctx->system, "severityValue", w_winevt_severity(level, keywords));
+        os_free(level);
+        os_free(keywords);
+
+        if (ctx->category_id.str && ctx->subcategory_id.str) {
+            category_id = winevt_strdup(&ctx->category_id);
+            subcategory_id = winevt_strdup(&ctx->subcategory_id);
+            w_winevt_category(category_id, subcategory_id, &category, &subcategory);
+            w_json_add_string(ctx->eventdata, "category", category);
+            w_json_add_string(ctx->eventdata, "subcategory", subcategory);
+            os_free(category_id);
+            os_free(subcategory_id);
+        }
+    }
+
+    if (ctx->audit_changes.str) {
+        changes = winevt_strdup(&ctx->audit_changes);
+
+        if (description = w_winevt_audit_changes(changes), description) {
+            w_json_add_string(ctx->eventdata, "auditPolicyChanges", description);
+            os_free(description);
+        }
+
+        os_free(changes);
+    }
+
+    w_json_add_string(ctx->system, "message", message);
+
+    if (ctx->join_length > 0) {
+        w_json_add_string_n(ctx->eventdata, "data", ctx->join, ctx->join_length);
+    }
+}
+
+int w_winevt_render(const char * event, size_t length, const char * message, w_json_writer_t * writer) {
+    const char * end = event + length;
+    const char * p;
+    winevt_ctx ctx;
+
+    memset(&ctx, 0, offsetof(winevt_ctx, key));
+    ctx.system = &winevt_system_writer;
+    ctx.eventdata = &winevt_eventdata_writer;
+    ctx.extra = &winevt_extra_writer;
+
+    w_json_writer_reset(ctx.system);
+    w_json_writer_reset(ctx.eventdata);
+    w_json_writer_reset(ctx.extra);
+    w_json_open_object(ctx.system, NULL);
+    w_json_open_object(ctx.eventdata, NULL);
+    w_json_open_object(ctx.extra, NULL);
+
+    // Only the first root element is decoded, the text around it is skipped
+    for (p = event; p < end && *p != '<'; p++);
+
+    if (p < end) {
+        if (p + 1 == end || p[1] == '/' || p[1] == '!' || p[1] == '?' || winevt_escaped(event, p)) {
+            goto fail;
+        }
+
+        if (p = winevt_element(&ctx, p, end, 0, NULL), !p || ctx.failed || memchr(p, '<', (size_t)(end - p))) {
+            goto fail;
+        }
+    }
+
+    winevt_finish(&ctx, message);
+    w_json_close_object(ctx.system);
+    w_json_close_object(ctx.extra);
+
+    w_json_writer_reset(writer);
+    w_json_open_object(writer, NULL);
+    w_json_open_object(writer, "win");
+    w_json_add_raw(writer, "system", w_json_writer_str(ctx.system));
+
+    if (ctx.eventdata->length > 1) {
+        w_json_close_object(ctx.eventdata);
+        w_json_add_raw(writer, "eventdata", w_json_writer_str(ctx.eventdata));
+    }
+
+    if (ctx.extra_name.str) {
+        if (winevt_key(&ctx, ctx.extra_name.str, ctx.extra_name.length) < 0) {
+            goto fail;
+        }
+
+        w_json_add_key_n(writer, ctx.key, ctx.extra_name.length);
+        w_json_put_n(writer, ctx.extra->buffer, ctx.extra->length);
+    }
+
+    w_json_close_object(writer);
+    w_json_close_object(writer);
+    os_free(ctx.join);
+    return 0;
+
+fail:
+    os_free(ctx.join);
+    return -1;
+}
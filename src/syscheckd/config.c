@@ -368,6 +368,8 @@ cJSON *getSyscheckInternalOptions(void) {
     cJSON *rootcheckd = cJSON_CreateObject();
 
     cJSON_AddNumberToObject(rootcheckd,"sleep",rootcheck.tsleep);
+    cJSON_AddNumberToObject(rootcheckd,"pid_threads",rootcheck.pid_threads);
+    cJSON_AddNumberToObject(rootcheckd,"scan_threads",rootcheck.scan_threads);
     cJSON_AddItemToObject(internals,"rootcheck",rootcheckd);
     cJSON_AddItemToObject(root,"internal",internals);
 
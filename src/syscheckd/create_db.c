@@ -33,6 +33,10 @@ static int _base_line = 0;
 
 static fim_state_db _db_state = FIM_STATE_DB_EMPTY;
 
+#ifndef WIN32
+static pthread_mutex_t group_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static const char *FIM_EVENT_TYPE[] = {
     "added",
     "deleted",
@@ -52,6 +56,7 @@ static const char *FIM_ENTRY_TYPE[] = {
 
 void fim_scan() {
     int it = 0;
+    int trust_stat = 0;
     struct timespec start;
     struct timespec end;
     clock_t cputime_start;
@@ -62,6 +67,13 @@ void fim_scan() {
     minfo(FIM_FREQUENCY_STARTED);
     fim_send_scan_info(FIM_SCAN_START);
 
+#ifndef WIN32
+    // Every rehash_scans scans, hash all the files again. The ctime has no such meaning on Windows
+    static unsigned int scans = 0;
+    scans++;
+    trust_stat = syscheck.rehash_scans == 0 || (syscheck.rehash_scans > 1 && scans % syscheck.rehash_scans != 0);
+#endif
+
     w_mutex_lock(&syscheck.fim_scan_mutex);
 
     while (syscheck.dir[it] != NULL) {
@@ -69,6 +81,8 @@ void fim_scan() {
         os_calloc(1, sizeof(fim_element), item);
         item->mode = FIM_SCHEDULED;
         item->index = it;
+        item->trust_stat = trust_stat;
+        item->pooled = fim_scan_pool_active();
 #ifndef WIN32
         if (syscheck.opts[it] & REALTIME_ACTIVE) {
             realtime_adddir(syscheck.dir[it], 0, (syscheck.opts[it] & CHECK_FOLLOW) ? 1 : 0);
@@ -79,6 +93,7 @@ void fim_scan() {
         os_free(item);
     }
 
+    fim_scan_wait();
     w_mutex_unlock(&syscheck.fim_scan_mutex);
 
 
@@ -103,7 +118,10 @@ void fim_scan() {
                 os_calloc(1, sizeof(fim_element), item);
                 item->mode = FIM_SCHEDULED;
                 item->index = it;
+                item->trust_stat = trust_stat;
+                item->pooled = fim_scan_pool_active();
                 fim_checker(syscheck.dir[it], item, NULL, 0);
+                fim_scan_wait();
                 it++;
                 os_free(item);
 
@@ -143,6 +161,10 @@ void fim_scan() {
 
     if (_base_line == 0) {
         _base_line = 1;
+
+        w_mutex_lock(&syscheck.fim_entry_mutex);
+        fim_db_create_index(syscheck.database);
+        w_mutex_unlock(&syscheck.fim_entry_mutex);
     }
     else {
         // In the first scan, the fim inicialization is different between Linux and Windows.
@@ -199,6 +221,7 @@ void fim_checker(char *path, fim_element *item, whodata_evt *w_evt, int report)
 
         if (item->configuration & CHECK_SEECHANGES) {
             delete_target_file(path);
+            fim_diff_store_remove(path);
         }
 
         w_mutex_lock(&syscheck.fim_entry_mutex);
@@ -247,6 +270,11 @@ void fim_checker(char *path, fim_element *item, whodata_evt *w_evt, int report)
         break;
 
     case FIM_DIRECTORY:
+        if (item->pooled) {
+            // A scan worker will add the watch and read it
+            fim_scan_push(path, item, report);
+            break;
+        }
 #ifndef WIN32
         if (item->configuration & REALTIME_ACTIVE) {
             realtime_adddir(path, 0, (item->configuration & CHECK_FOLLOW) ? 1 : 0);
@@ -317,39 +345,69 @@ int fim_file(char *file, fim_element *item, whodata_evt *w_evt, int report) {
     char *json_formated;
     int alert_type;
     int result;
+    int refresh = 0;
     char *diff = NULL;
 
     w_mutex_lock(&syscheck.fim_entry_mutex);
 
+    // The stored data is needed first to know if the hashes can be reused
+    if (item->trust_stat) {
+        saved = fim_db_get_path(syscheck.database, file);
+        item->saved = saved ? saved->data : NULL;
+    }
+
     //Get file attributes
-    if (new = fim_get_data(file, item), !new) {
+    if (item->pooled) {
+        // Scan workers hash the files out of the lock. The stored data may change meanwhile
+        w_mutex_unlock(&syscheck.fim_entry_mutex);
+        new = fim_scan_get_data(file, item);
+        w_mutex_lock(&syscheck.fim_entry_mutex);
+
+        free_entry(saved);
+        saved = NULL;
+    } else {
+        new = fim_get_data(file, item);
+    }
+
+    item->saved = NULL;
+
+    if (!new) {
         mdebug1(FIM_GET_ATTRIBUTES, file);
+        free_entry(saved);
         w_mutex_unlock(&syscheck.fim_entry_mutex);
         return 0;
     }
 
-    if (saved = fim_db_get_path(syscheck.database, file), !saved) {
+    if (!item->trust_stat || item->pooled) {
+        saved = fim_db_get_path(syscheck.database, file);
+    }
+
+    if (!saved) {
         // New entry. Insert into hash table
         alert_type = FIM_ADD;
     } else {
         // Checking for changes
         alert_type = FIM_MODIFICATION;
+        // Store the new stat data of files that were hashed again with no changes, so they can be trusted next time
+        refresh = item->trust_stat && !fim_stat_trusted(saved->data, new);
     }
 
     if (item->configuration & CHECK_SEECHANGES) {
         diff = seechanges_addfile(file);
     }
 
+    // The event is built and printed in an arena, released after sending it
+    json_arena_open();
     json_event = fim_json_event(file, saved ? saved->data : NULL, new, item->index, alert_type, item->mode, w_evt, diff);
 
     os_free(diff);
 
-    if (json_event) {
+    if (json_event || refresh) {
         if (result = fim_db_insert(syscheck.database, file, new, alert_type), result < 0) {
             free_entry_data(new);
             free_entry(saved);
             w_mutex_unlock(&syscheck.fim_entry_mutex);
-            cJSON_Delete(json_event);
+            json_arena_close();
 
             return (result == FIMDB_FULL) ? 0 : OS_INVALID;
         }
@@ -362,10 +420,9 @@ int fim_file(char *file, fim_element *item, whodata_evt *w_evt, int report) {
     if (json_event && _base_line && report) {
         json_formated = cJSON_PrintUnformatted(json_event);
         send_syscheck_msg(json_formated);
-        os_free(json_formated);
     }
 
-    cJSON_Delete(json_event);
+    json_arena_close();
     free_entry_data(new);
     free_entry(saved);
 
@@ -374,6 +431,15 @@ int fim_file(char *file, fim_element *item, whodata_evt *w_evt, int report) {
 
 
 void fim_realtime_event(char *file) {
+    // Bursts of events of the same file are checked once
+    if (fim_debounce_push(file, FIM_REALTIME, NULL) == 0) {
+        return;
+    }
+
+    fim_realtime_check(file);
+}
+
+void fim_realtime_check(char *file) {
 
     struct stat file_stat;
 
@@ -394,6 +460,14 @@ void fim_realtime_event(char *file) {
 }
 
 void fim_whodata_event(whodata_evt * w_evt) {
+    if (fim_debounce_push(w_evt->path, FIM_WHODATA, w_evt) == 0) {
+        return;
+    }
+
+    fim_whodata_check(w_evt);
+}
+
+void fim_whodata_check(whodata_evt * w_evt) {
 
     struct stat file_stat;
 
@@ -754,7 +828,10 @@ fim_entry_data * fim_get_data(const char *file, fim_element *item) {
         snprintf(aux, OS_SIZE_64, "%u", item->statbuf.st_gid);
         os_strdup(aux, data->gid);
 
+        // The group database is not reentrant, and the scan workers may look it up at the same time
+        w_mutex_lock(&group_mutex);
         os_strdup((char*)get_group(item->statbuf.st_gid), data->group_name);
+        w_mutex_unlock(&group_mutex);
     }
 #endif
 
@@ -765,6 +842,11 @@ fim_entry_data * fim_get_data(const char *file, fim_element *item) {
     // The file exists and we don't have to delete it from the hash tables
     data->scanned = 1;
 
+    data->inode = item->statbuf.st_ino;
+    data->dev = item->statbuf.st_dev;
+    data->ctime = item->statbuf.st_ctime;
+    data->options = item->configuration;
+
     // We won't calculate hash for symbolic links, empty or large files
     if ((item->statbuf.st_mode & S_IFMT) == FIM_REGULAR)
         if (item->statbuf.st_size > 0 &&
@@ -772,12 +854,17 @@ fim_entry_data * fim_get_data(const char *file, fim_element *item) {
                 ( item->configuration & CHECK_MD5SUM ||
                 item->configuration & CHECK_SHA1SUM ||
                 item->configuration & CHECK_SHA256SUM ) ) {
-            if (OS_MD5_SHA1_SHA256_File(file,
+            if (item->saved && fim_stat_trusted(item->saved, data)) {
+                // Unchanged file: reuse the stored hashes
+                memcpy(data->hash_md5, item->saved->hash_md5, sizeof(os_md5));
+                memcpy(data->hash_sha1, item->saved->hash_sha1, sizeof(os_sha1));
+                memcpy(data->hash_sha256, item->saved->hash_sha256, sizeof(os_sha256));
+            } else if (OS_MD5_SHA1_SHA256_File(file,
                                         syscheck.prefilter_cmd,
                                         data->hash_md5,
                                         data->hash_sha1,
                                         data->hash_sha256,
-                                        OS_BINARY,
+                                        OS_BINARY | (syscheck.hash_drop_cache ? OS_HASH_NOCACHE : 0),
                                         syscheck.file_max_size) < 0) {
                 mdebug1(FIM_HASHES_FAIL, file);
                 free_entry_data(data);
@@ -797,10 +884,7 @@ fim_entry_data * fim_get_data(const char *file, fim_element *item) {
         data->hash_sha256[0] = '\0';
     }
 
-    data->inode = item->statbuf.st_ino;
-    data->dev = item->statbuf.st_dev;
     data->mode = item->mode;
-    data->options = item->configuration;
     data->last_event = time(NULL);
     data->scanned = 1;
     // Set file entry type, registry or file
@@ -811,6 +895,17 @@ fim_entry_data * fim_get_data(const char *file, fim_element *item) {
     return data;
 }
 
+int fim_stat_trusted(const fim_entry_data *saved, const fim_entry_data *data) {
+    // A change made in the same second the file was hashed might not update its ctime
+    return saved->options == data->options &&
+           saved->inode == data->inode &&
+           saved->dev == data->dev &&
+           saved->size == data->size &&
+           saved->mtime == data->mtime &&
+           saved->ctime == data->ctime &&
+           (time_t)saved->ctime < saved->last_event;
+}
+
 void init_fim_data_entry(fim_entry_data *data) {
     data->size = 0;
     data->perm = NULL;
@@ -820,6 +915,7 @@ void init_fim_data_entry(fim_entry_data *data) {
     data->user_name = NULL;
     data->group_name = NULL;
     data->mtime = 0;
+    data->ctime = 0;
     data->inode = 0;
     data->hash_md5[0] = '\0';
     data->hash_sha1[0] = '\0';
@@ -23,18 +23,18 @@
 
 static const char *SQL_STMT[] = {
 #ifdef WIN32
-    [FIMDB_STMT_INSERT_DATA] = "INSERT INTO entry_data (dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime) VALUES (NULL, NULL, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+    [FIMDB_STMT_INSERT_DATA] = "INSERT INTO entry_data (dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime, ctime) VALUES (NULL, NULL, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
 #else
-    [FIMDB_STMT_INSERT_DATA] = "INSERT INTO entry_data (dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+    [FIMDB_STMT_INSERT_DATA] = "INSERT INTO entry_data (dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime, ctime) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
 #endif
     [FIMDB_STMT_INSERT_PATH] = "INSERT INTO entry_path (path, inode_id, mode, last_event, entry_type, scanned, options, checksum) VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
-    [FIMDB_STMT_GET_PATH] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime FROM entry_path INNER JOIN entry_data ON path = ? AND entry_data.rowid = entry_path.inode_id;",
-    [FIMDB_STMT_UPDATE_DATA] = "UPDATE entry_data SET size = ?, perm = ?, attributes = ?, uid = ?, gid = ?, user_name = ?, group_name = ?, hash_md5 = ?, hash_sha1 = ?, hash_sha256 = ?, mtime = ? WHERE rowid = ?;",
+    [FIMDB_STMT_GET_PATH] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime, ctime FROM entry_path INNER JOIN entry_data ON path = ? AND entry_data.rowid = entry_path.inode_id;",
+    [FIMDB_STMT_UPDATE_DATA] = "UPDATE entry_data SET size = ?, perm = ?, attributes = ?, uid = ?, gid = ?, user_name = ?, group_name = ?, hash_md5 = ?, hash_sha1 = ?, hash_sha256 = ?, mtime = ?, ctime = ? WHERE rowid = ?;",
     [FIMDB_STMT_UPDATE_PATH] = "UPDATE entry_path SET inode_id = ?, mode = ?, last_event = ?, entry_type = ?, scanned = ?, options = ?, checksum = ? WHERE path = ?;",
     [FIMDB_STMT_GET_LAST_PATH] = "SELECT path FROM entry_path ORDER BY path DESC LIMIT 1;",
     [FIMDB_STMT_GET_FIRST_PATH] = "SELECT path FROM entry_path ORDER BY path ASC LIMIT 1;",
-    [FIMDB_STMT_GET_ALL_ENTRIES] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime FROM entry_data INNER JOIN entry_path ON inode_id = entry_data.rowid ORDER BY PATH ASC;",
-    [FIMDB_STMT_GET_NOT_SCANNED] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime FROM entry_data INNER JOIN entry_path ON inode_id = entry_data.rowid WHERE scanned = 0 ORDER BY PATH ASC;",
+    [FIMDB_STMT_GET_ALL_ENTRIES] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime, ctime FROM entry_data INNER JOIN entry_path ON inode_id = entry_data.rowid ORDER BY PATH ASC;",
+    [FIMDB_STMT_GET_NOT_SCANNED] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime, ctime FROM entry_data INNER JOIN entry_path ON inode_id = entry_data.rowid WHERE scanned = 0 ORDER BY PATH ASC;",
     [FIMDB_STMT_SET_ALL_UNSCANNED] = "UPDATE entry_path SET scanned = 0;",
     [FIMDB_STMT_GET_PATH_COUNT] = "SELECT count(inode_id), inode_id FROM entry_path WHERE inode_id = (select inode_id from entry_path where path = ?);",
 #ifndef WIN32
@@ -42,8 +42,8 @@ static const char *SQL_STMT[] = {
 #else
     [FIMDB_STMT_GET_DATA_ROW] = "SELECT inode_id FROM entry_path WHERE path = ?",
 #endif
-    [FIMDB_STMT_GET_COUNT_RANGE] = "SELECT count(*) FROM entry_path INNER JOIN entry_data ON entry_data.rowid = entry_path.inode_id WHERE path BETWEEN ? and ? ORDER BY path;",
-    [FIMDB_STMT_GET_PATH_RANGE] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime FROM entry_path INNER JOIN entry_data ON entry_data.rowid = entry_path.inode_id WHERE path BETWEEN ? and ? ORDER BY path;",
+    [FIMDB_STMT_GET_COUNT_RANGE] = "SELECT count(*) FROM entry_path WHERE path BETWEEN ? and ?;",
+    [FIMDB_STMT_GET_PATH_RANGE] = "SELECT path, inode_id, mode, last_event, entry_type, scanned, options, checksum, dev, inode, size, perm, attributes, uid, gid, user_name, group_name, hash_md5, hash_sha1, hash_sha256, mtime, ctime FROM entry_path INNER JOIN entry_data ON entry_data.rowid = entry_path.inode_id WHERE path BETWEEN ? and ? ORDER BY path;",
     [FIMDB_STMT_DELETE_PATH] = "DELETE FROM entry_path WHERE path = ?;",
     [FIMDB_STMT_DELETE_DATA] = "DELETE FROM entry_data WHERE rowid = ?;",
     [FIMDB_STMT_GET_PATHS_INODE] = "SELECT path FROM entry_path INNER JOIN entry_data ON entry_data.rowid=entry_path.inode_id WHERE entry_data.inode=? AND entry_data.dev=?;",
@@ -53,6 +53,8 @@ static const char *SQL_STMT[] = {
     [FIMDB_STMT_GET_COUNT_PATH] = "SELECT count(*) FROM entry_path",
     [FIMDB_STMT_GET_COUNT_DATA] = "SELECT count(*) FROM entry_data",
     [FIMDB_STMT_GET_INODE] = "SELECT inode FROM entry_data where rowid=(SELECT inode_id FROM entry_path WHERE path = ?)",
+    [FIMDB_STMT_GET_ALL_CHECKSUMS] = "SELECT checksum FROM entry_path ORDER BY path ASC;",
+    [FIMDB_STMT_GET_CHECKSUM_RANGE] = "SELECT path, checksum FROM entry_path WHERE path BETWEEN ? and ? ORDER BY path;",
 };
 
 
@@ -90,6 +92,27 @@ static int fim_db_process_get_query(fdb_t *fim_sql, int index,
                                     int memory, void * arg);
 
 
+/**
+ * @brief Binds an hexadecimal digest as a blob, half the size of the text.
+ *
+ * @param stmt Statement to bind.
+ * @param index Index of the parameter.
+ * @param digest Hexadecimal digest. It may be empty.
+ */
+static void fim_db_bind_digest(sqlite3_stmt *stmt, int index, const char *digest);
+
+
+/**
+ * @brief Reads a blob digest back to its hexadecimal form.
+ *
+ * @param stmt Statement being stepped.
+ * @param index Index of the column.
+ * @param digest Output buffer.
+ * @param size Size of the output buffer, including the terminator.
+ */
+static void fim_db_column_digest(sqlite3_stmt *stmt, int index, char *digest, size_t size);
+
+
 /**
  * @brief Binds data into a insert data statement.
  *
@@ -249,6 +272,11 @@ fdb_t *fim_db_init(int storage) {
     fdb_t *fim;
     char *path = (storage == FIM_DB_MEMORY) ? FIM_DB_MEMORY_PATH : FIM_DB_DISK_PATH;
 
+    // A temporary database stays in memory up to its cache size, and spills to a file past it
+    if (storage == FIM_DB_MEMORY && syscheck.database_cache > 0) {
+        path = FIM_DB_TEMP_PATH;
+    }
+
     os_calloc(1, sizeof(fdb_t), fim);
     fim->transaction.interval = COMMIT_INTERVAL;
 
@@ -270,7 +298,7 @@ fdb_t *fim_db_init(int storage) {
     }
 
     char *error;
-    sqlite3_exec(fim->db, "PRAGMA synchronous = OFF", NULL, NULL, &error);
+    sqlite3_exec(fim->db, storage == FIM_DB_MEMORY ? FIM_DB_PRAGMAS_MEMORY : FIM_DB_PRAGMAS_DISK, NULL, NULL, &error);
 
     if (error) {
         merror("SQL ERROR: %s", error);
@@ -279,6 +307,17 @@ fdb_t *fim_db_init(int storage) {
         goto free_fim;
     }
 
+    if (storage == FIM_DB_MEMORY && syscheck.database_cache > 0) {
+        char pragmas[OS_SIZE_128];
+
+        snprintf(pragmas, sizeof(pragmas), FIM_DB_PRAGMAS_TEMP, syscheck.database_cache * 1024);
+
+        if (fim_db_exec_simple_wquery(fim, pragmas) == FIMDB_ERR) {
+            fim_db_finalize_stmt(fim);
+            goto free_fim;
+        }
+    }
+
     if (fim_db_exec_simple_wquery(fim, "BEGIN;") == FIMDB_ERR) {
         fim_db_finalize_stmt(fim);
         goto free_fim;
@@ -460,6 +499,10 @@ end:
     return retval;
 }
 
+int fim_db_create_index(fdb_t *fim_sql) {
+    return fim_db_exec_simple_wquery(fim_sql, "CREATE INDEX IF NOT EXISTS inode_index ON entry_path (inode_id);");
+}
+
 void fim_db_check_transaction(fdb_t *fim_sql) {
     time_t now = time(NULL);
 
@@ -532,8 +575,25 @@ int fim_db_get_not_scanned(fdb_t * fim_sql, fim_tmp_file **file, int storage) {
 }
 
 int fim_db_get_data_checksum(fdb_t *fim_sql, void * arg) {
-    fim_db_clean_stmt(fim_sql, FIMDB_STMT_GET_ALL_ENTRIES);
-    return fim_db_process_get_query(fim_sql, FIMDB_STMT_GET_ALL_ENTRIES, fim_db_callback_calculate_checksum, 0, arg);
+    EVP_MD_CTX *ctx = (EVP_MD_CTX *)arg;
+    os_sha1 checksum;
+    int result;
+
+    // Only the checksums are hashed: don't decode the whole rows
+    fim_db_clean_stmt(fim_sql, FIMDB_STMT_GET_ALL_CHECKSUMS);
+
+    while (result = sqlite3_step(fim_sql->stmt[FIMDB_STMT_GET_ALL_CHECKSUMS]), result == SQLITE_ROW) {
+        fim_db_column_digest(fim_sql->stmt[FIMDB_STMT_GET_ALL_CHECKSUMS], 0, checksum, sizeof(os_sha1));
+        EVP_DigestUpdate(ctx, checksum, strlen(checksum));
+    }
+
+    fim_db_check_transaction(fim_sql);
+
+    return result != SQLITE_DONE ? FIMDB_ERR : FIMDB_OK;
+}
+
+int fim_db_get_changes(fdb_t *fim_sql) {
+    return sqlite3_total_changes(fim_sql->db);
 }
 
 int fim_db_process_get_query(fdb_t *fim_sql, int index, void (*callback)(fdb_t *, fim_entry *, int , void *), int storage, void * arg) {
@@ -648,7 +708,7 @@ fim_entry *fim_db_decode_full_row(sqlite3_stmt *stmt) {
     entry->data->entry_type = sqlite3_column_int(stmt, 4);
     entry->data->scanned = (time_t)sqlite3_column_int(stmt, 5);
     entry->data->options = (time_t)sqlite3_column_int(stmt, 6);
-    strncpy(entry->data->checksum, (char *)sqlite3_column_text(stmt, 7), sizeof(os_sha1) - 1);
+    fim_db_column_digest(stmt, 7, entry->data->checksum, sizeof(os_sha1));
     entry->data->dev = (unsigned long int)sqlite3_column_int(stmt, 8);
     entry->data->inode = (unsigned long int)sqlite3_column_int64(stmt, 9);
     entry->data->size = (unsigned int)sqlite3_column_int(stmt, 10);
@@ -658,14 +718,46 @@ fim_entry *fim_db_decode_full_row(sqlite3_stmt *stmt) {
     sqlite_strdup((char *)sqlite3_column_text(stmt, 14), entry->data->gid);
     sqlite_strdup((char *)sqlite3_column_text(stmt, 15), entry->data->user_name);
     sqlite_strdup((char *)sqlite3_column_text(stmt, 16), entry->data->group_name);
-    strncpy(entry->data->hash_md5, (char *)sqlite3_column_text(stmt, 17), sizeof(os_md5) - 1);
-    strncpy(entry->data->hash_sha1, (char *)sqlite3_column_text(stmt, 18), sizeof(os_sha1) - 1);
-    strncpy(entry->data->hash_sha256, (char *)sqlite3_column_text(stmt, 19), sizeof(os_sha256) - 1);
+    fim_db_column_digest(stmt, 17, entry->data->hash_md5, sizeof(os_md5));
+    fim_db_column_digest(stmt, 18, entry->data->hash_sha1, sizeof(os_sha1));
+    fim_db_column_digest(stmt, 19, entry->data->hash_sha256, sizeof(os_sha256));
     entry->data->mtime = (unsigned int)sqlite3_column_int(stmt, 20);
+    entry->data->ctime = (unsigned int)sqlite3_column_int(stmt, 21);
 
     return entry;
 }
 
+void fim_db_bind_digest(sqlite3_stmt *stmt, int index, const char *digest) {
+    unsigned char blob[sizeof(os_sha256) / 2];
+    char pair[3] = { '\0' };
+    size_t length;
+
+    // Digests are lowercase hex, so that they can be restored as they were
+    for (length = 0; length < sizeof(blob) && isxdigit((unsigned char)digest[2 * length]) && isxdigit((unsigned char)digest[2 * length + 1]); length++) {
+        pair[0] = digest[2 * length];
+        pair[1] = digest[2 * length + 1];
+        blob[length] = (unsigned char)strtoul(pair, NULL, 16);
+    }
+
+    sqlite3_bind_blob(stmt, index, blob, (int)length, SQLITE_TRANSIENT);
+}
+
+void fim_db_column_digest(sqlite3_stmt *stmt, int index, char *digest, size_t size) {
+    const unsigned char *blob = sqlite3_column_blob(stmt, index);
+    size_t length = (size_t)sqlite3_column_bytes(stmt, index);
+    size_t i;
+
+    if (length > (size - 1) / 2) {
+        length = (size - 1) / 2;
+    }
+
+    for (i = 0; i < length; i++) {
+        snprintf(digest + 2 * i, 3, "%02x", blob[i]);
+    }
+
+    digest[2 * length] = '\0';
+}
+
 /* No needed bind FIMDB_STMT_GET_LAST_ROWID, FIMDB_STMT_GET_ALL_ENTRIES, FIMDB_STMT_GET_NOT_SCANNED,
    FIMDB_STMT_SET_ALL_UNSCANNED, FIMDB_STMT_DELETE_UNSCANNED */
 
@@ -681,10 +773,11 @@ void fim_db_bind_insert_data(fdb_t *fim_sql, fim_entry_data *entry) {
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 7, entry->gid, -1, NULL);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 8, entry->user_name, -1, NULL);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 9, entry->group_name, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 10, entry->hash_md5, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 11, entry->hash_sha1, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 12, entry->hash_sha256, -1, NULL);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 10, entry->hash_md5);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 11, entry->hash_sha1);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 12, entry->hash_sha256);
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 13, entry->mtime);
+    sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 14, entry->ctime);
 #else
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 1, entry->size);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 2, entry->perm, -1, NULL);
@@ -693,10 +786,11 @@ void fim_db_bind_insert_data(fdb_t *fim_sql, fim_entry_data *entry) {
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 5, entry->gid, -1, NULL);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 6, entry->user_name, -1, NULL);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 7, entry->group_name, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 8, entry->hash_md5, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 9, entry->hash_sha1, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 10, entry->hash_sha256, -1, NULL);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 8, entry->hash_md5);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 9, entry->hash_sha1);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 10, entry->hash_sha256);
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 11, entry->mtime);
+    sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_DATA], 12, entry->ctime);
 #endif
 }
 
@@ -709,7 +803,7 @@ void fim_db_bind_insert_path(fdb_t *fim_sql, const char *file_path, int row_id,
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_PATH], 5, entry->entry_type);
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_PATH], 6, entry->scanned);
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_INSERT_PATH], 7, entry->options);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_INSERT_PATH], 8, entry->checksum, -1, NULL);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_INSERT_PATH], 8, entry->checksum);
 }
 
 /* FIMDB_STMT_GET_PATH, FIMDB_STMT_GET_PATH_COUNT, FIMDB_STMT_DELETE_PATH, FIMDB_STMT_GET_DATA_ROW */
@@ -738,11 +832,12 @@ void fim_db_bind_update_data(fdb_t *fim_sql, fim_entry_data *entry, int *row_id)
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 5, entry->gid, -1, NULL);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 6, entry->user_name, -1, NULL);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 7, entry->group_name, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 8, entry->hash_md5, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 9, entry->hash_sha1, -1, NULL);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 10, entry->hash_sha256, -1, NULL);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 8, entry->hash_md5);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 9, entry->hash_sha1);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 10, entry->hash_sha256);
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 11, entry->mtime);
-    sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 12, *row_id);
+    sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 12, entry->ctime);
+    sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_UPDATE_DATA], 13, *row_id);
 }
 
 /* FIMDB_STMT_UPDATE_ENTRY_PATH */
@@ -753,7 +848,7 @@ void fim_db_bind_update_path(fdb_t *fim_sql, const char *file_path, fim_entry_da
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_UPDATE_PATH], 4, entry->entry_type);
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_UPDATE_PATH], 5, entry->scanned);
     sqlite3_bind_int(fim_sql->stmt[FIMDB_STMT_UPDATE_PATH], 6, entry->options);
-    sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_PATH], 7, entry->checksum, -1, NULL);
+    fim_db_bind_digest(fim_sql->stmt[FIMDB_STMT_UPDATE_PATH], 7, entry->checksum);
     sqlite3_bind_text(fim_sql->stmt[FIMDB_STMT_UPDATE_PATH], 8, file_path, -1, NULL);
 }
 
@@ -779,7 +874,8 @@ void fim_db_bind_get_path_inode(fdb_t *fim_sql, const char *file_path) {
 
 void fim_db_bind_range(fdb_t *fim_sql, int index, const char *start, const char *top) {
     if (index == FIMDB_STMT_GET_PATH_RANGE ||
-        index == FIMDB_STMT_GET_COUNT_RANGE ) {
+        index == FIMDB_STMT_GET_COUNT_RANGE ||
+        index == FIMDB_STMT_GET_CHECKSUM_RANGE) {
         sqlite3_bind_text(fim_sql->stmt[index], 1, start, -1, NULL);
         sqlite3_bind_text(fim_sql->stmt[index], 2, top, -1, NULL);
     }
@@ -1022,7 +1118,9 @@ void fim_db_callback_calculate_checksum(__attribute__((unused)) fdb_t *fim_sql,
 
 int fim_db_data_checksum_range(fdb_t *fim_sql, const char *start, const char *top,
                                 const long id, const int n, pthread_mutex_t *mutex) {
-    fim_entry *entry = NULL;
+    sqlite3_stmt *stmt = fim_sql->stmt[FIMDB_STMT_GET_CHECKSUM_RANGE];
+    const char *path;
+    os_sha1 checksum;
     int m = n / 2;
     int i;
     int retval = FIMDB_ERR;
@@ -1042,41 +1140,40 @@ int fim_db_data_checksum_range(fdb_t *fim_sql, const char *start, const char *to
     w_mutex_lock(mutex);
 
     // Clean statements
-    fim_db_clean_stmt(fim_sql, FIMDB_STMT_GET_PATH_RANGE);
+    fim_db_clean_stmt(fim_sql, FIMDB_STMT_GET_CHECKSUM_RANGE);
 
-    fim_db_bind_range(fim_sql, FIMDB_STMT_GET_PATH_RANGE, start, top);
+    // Only the paths and checksums are needed: don't decode the whole rows
+    fim_db_bind_range(fim_sql, FIMDB_STMT_GET_CHECKSUM_RANGE, start, top);
 
     // Calculate checksum of the first half
     for (i = 0; i < m; i++) {
-        if (sqlite3_step(fim_sql->stmt[FIMDB_STMT_GET_PATH_RANGE]) != SQLITE_ROW) {
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
             merror("SQL ERROR: %s", sqlite3_errmsg(fim_sql->db));
             w_mutex_unlock(mutex);
             goto end;
         }
-        entry = fim_db_decode_full_row(fim_sql->stmt[FIMDB_STMT_GET_PATH_RANGE]);
-        if (i == (m - 1) && entry->path) {
-            os_strdup(entry->path, str_pathlh);
+        path = (const char *)sqlite3_column_text(stmt, 0);
+        if (i == (m - 1) && path) {
+            os_strdup(path, str_pathlh);
         }
-        //Type of storage not required
-        fim_db_callback_calculate_checksum(fim_sql, entry, FIM_DB_DISK, (void *)ctx_left);
-        free_entry(entry);
+        fim_db_column_digest(stmt, 1, checksum, sizeof(os_sha1));
+        EVP_DigestUpdate(ctx_left, checksum, strlen(checksum));
     }
 
     //Calculate checksum of the second half
     for (i = m; i < n; i++) {
-        if (sqlite3_step(fim_sql->stmt[FIMDB_STMT_GET_PATH_RANGE]) != SQLITE_ROW) {
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
             merror("SQL ERROR: %s", sqlite3_errmsg(fim_sql->db));
             w_mutex_unlock(mutex);
             goto end;
         }
-        entry = fim_db_decode_full_row(fim_sql->stmt[FIMDB_STMT_GET_PATH_RANGE]);
-        if (i == m && entry->path) {
+        path = (const char *)sqlite3_column_text(stmt, 0);
+        if (i == m && path) {
             os_free(str_pathuh);
-            os_strdup(entry->path, str_pathuh);
+            os_strdup(path, str_pathuh);
         }
-        //Type of storage not required
-        fim_db_callback_calculate_checksum(fim_sql, entry, FIM_DB_DISK, (void *)ctx_right);
-        free_entry(entry);
+        fim_db_column_digest(stmt, 1, checksum, sizeof(os_sha1));
+        EVP_DigestUpdate(ctx_right, checksum, strlen(checksum));
     }
 
     w_mutex_unlock(mutex);
@@ -1210,6 +1307,7 @@ void fim_db_remove_path(fdb_t *fim_sql, fim_entry *entry, pthread_mutex_t *mutex
         if (!strcmp(FIM_ENTRY_TYPE[entry->data->entry_type], "file") &&
             syscheck.opts[pos] & CHECK_SEECHANGES) {
             delete_target_file(entry->path);
+            fim_diff_store_remove(entry->path);
         }
 
         if (json_event) {
@@ -15,6 +15,7 @@
 #include "config/syscheck-config.h"
 
 #define FIM_DB_MEMORY_PATH  ":memory:"
+#define FIM_DB_TEMP_PATH    ""
 
 #ifndef WIN32
 #define FIM_DB_DISK_PATH    DEFAULTDIR "/queue/fim/db/fim.db"
@@ -26,6 +27,11 @@
 
 #define COMMIT_INTERVAL     2
 
+// The database is created again when the daemon starts, so it doesn't need to survive a crash
+#define FIM_DB_PRAGMAS_DISK     "PRAGMA synchronous = OFF; PRAGMA journal_mode = MEMORY; PRAGMA cache_size = -16384;"
+#define FIM_DB_PRAGMAS_MEMORY   "PRAGMA synchronous = OFF"
+#define FIM_DB_PRAGMAS_TEMP     "PRAGMA journal_mode = MEMORY; PRAGMA cache_size = -%d;"
+
 #define FIMDB_OK 0   // Successful result.
 #define FIMDB_ERR -1 // Generic error.
 #define FIMDB_FULL -2 // DB is full.
@@ -83,6 +89,17 @@ int fim_db_cache(fdb_t *fim_sql);
  */
 int fim_db_finalize_stmt(fdb_t *fim_sql);
 
+/**
+ * @brief Create the indexes that are not needed by the baseline scan.
+ *
+ * The baseline inserts every entry: maintaining these indexes meanwhile would
+ * cost more than building them at once afterwards.
+ *
+ * @param fim_sql FIM database struct.
+ * @return FIMDB_OK on success, FIMDB_ERR otherwise.
+ */
+int fim_db_create_index(fdb_t *fim_sql);
+
 /**
  * @brief End transaction and commit.
  *
@@ -114,6 +131,17 @@ int fim_db_clean_stmt(fdb_t *fim_sql, int index);
  */
 int fim_db_get_data_checksum(fdb_t *fim_sql, void * arg);
 
+/**
+ * @brief Get the number of rows changed since the database was opened.
+ *
+ * Every insertion, update and deletion counts, so an unchanged value means
+ * that the data checksum is still valid.
+ *
+ * @param fim_sql FIM database struct.
+ * @return Number of rows changed.
+ */
+int fim_db_get_changes(fdb_t *fim_sql);
+
 /**
  * @brief Get entry data using path.
  *
@@ -0,0 +1,234 @@
+/* Coalescing of real-time and whodata events
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * July 13, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+#include "shared.h"
+#include "syscheck.h"
+
+/* A file that is written many times in a row would be hashed, compared and
+ * reported once per event. Instead, each event is kept in a table by path,
+ * replacing any previous event of that path, and a thread checks the file
+ * once it has been quiet for a while, or once the first event gets too old.
+ * Whodata events keep the attribution of the last writer.
+ */
+
+#ifndef WIN32
+
+#define DEBOUNCE_MIN_WAIT 10
+
+typedef struct fim_debounce_entry {
+    fim_event_mode mode;
+    whodata_evt *w_evt;                 // Last writer, for whodata events
+    long long first;                    // Time of the first event, in milliseconds
+    long long last;                     // Time of the last event, in milliseconds
+} fim_debounce_entry;
+
+static struct {
+    OSHash *table;                      // Entries by path, NULL if events are checked right away
+    pthread_mutex_t mutex;
+    pthread_cond_t available;           // The table was empty and got an entry
+} debounce = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .available = PTHREAD_COND_INITIALIZER
+};
+
+static long long fim_debounce_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static char * fim_debounce_strdup(const char *str) {
+    char *copy = NULL;
+
+    if (str) {
+        os_strdup(str, copy);
+    }
+
+    return copy;
+}
+
+/* The event may be reused by the caller for the next one, so it's copied */
+static whodata_evt * fim_debounce_copy(const whodata_evt *w_evt) {
+    whodata_evt *copy;
+
+    os_calloc(1, sizeof(whodata_evt), copy);
+    copy->user_id = fim_debounce_strdup(w_evt->user_id);
+    copy->user_name = fim_debounce_strdup(w_evt->user_name);
+    copy->group_id = fim_debounce_strdup(w_evt->group_id);
+    copy->group_name = fim_debounce_strdup(w_evt->group_name);
+    copy->process_name = fim_debounce_strdup(w_evt->process_name);
+    copy->path = fim_debounce_strdup(w_evt->path);
+    copy->audit_uid = fim_debounce_strdup(w_evt->audit_uid);
+    copy->audit_name = fim_debounce_strdup(w_evt->audit_name);
+    copy->effective_uid = fim_debounce_strdup(w_evt->effective_uid);
+    copy->effective_name = fim_debounce_strdup(w_evt->effective_name);
+    copy->inode = fim_debounce_strdup(w_evt->inode);
+    copy->dev = fim_debounce_strdup(w_evt->dev);
+    copy->parent_name = fim_debounce_strdup(w_evt->parent_name);
+    copy->parent_cwd = fim_debounce_strdup(w_evt->parent_cwd);
+    copy->cwd = fim_debounce_strdup(w_evt->cwd);
+    copy->ppid = w_evt->ppid;
+    copy->process_id = w_evt->process_id;
+
+    return copy;
+}
+
+/* free_whodata_event() doesn't own the group name, but the copy does */
+static void fim_debounce_free_evt(whodata_evt *w_evt) {
+    if (w_evt) {
+        os_free(w_evt->group_name);
+        free_whodata_event(w_evt);
+    }
+}
+
+static void fim_debounce_free(fim_debounce_entry *entry) {
+    fim_debounce_free_evt(entry->w_evt);
+    free(entry);
+}
+
+/* Check the entries that are due and return the time to wait for the next one */
+static long long fim_debounce_flush() {
+    W_Vector *due = W_Vector_init(64);
+    OSHashNode *node;
+    unsigned int it = 0;
+    long long now = fim_debounce_now();
+    long long wait = syscheck.rt_debounce;
+    int i;
+
+    assert(due != NULL);
+    w_mutex_lock(&debounce.mutex);
+
+    for (node = OSHash_Begin(debounce.table, &it); node; node = OSHash_Next(debounce.table, &it, node)) {
+        fim_debounce_entry *entry = node->data;
+        long long quiet = entry->last + syscheck.rt_debounce;
+        long long limit = entry->first + syscheck.rt_debounce_max;
+        long long due_time = (quiet < limit) ? quiet : limit;
+
+        if (due_time <= now) {
+            W_Vector_insert(due, node->key);
+        } else if (due_time - now < wait) {
+            wait = due_time - now;
+        }
+    }
+
+    for (i = 0; i < W_Vector_length(due); i++) {
+        const char *path = W_Vector_get(due, i);
+        fim_debounce_entry *entry = OSHash_Delete_ex(debounce.table, path);
+
+        w_mutex_unlock(&debounce.mutex);
+
+        if (entry->mode == FIM_WHODATA) {
+            fim_whodata_check(entry->w_evt);
+        } else {
+            fim_realtime_check((char *)path);
+        }
+
+        fim_debounce_free(entry);
+        w_mutex_lock(&debounce.mutex);
+    }
+
+    w_mutex_unlock(&debounce.mutex);
+    W_Vector_free(due);
+
+    return (wait > DEBOUNCE_MIN_WAIT) ? wait : DEBOUNCE_MIN_WAIT;
+}
+
+static void * fim_debounce_thread(__attribute__((unused)) void * args) {
+    long long wait;
+
+    while (1) {
+        w_mutex_lock(&debounce.mutex);
+
+        while (OSHash_Get_Elem_ex(debounce.table) == 0) {
+            w_cond_wait(&debounce.available, &debounce.mutex);
+        }
+
+        w_mutex_unlock(&debounce.mutex);
+
+        wait = fim_debounce_flush();
+
+        struct timeval timeout = { wait / 1000, (wait % 1000) * 1000 };
+        select(0, NULL, NULL, NULL, &timeout);
+    }
+
+    return NULL;
+}
+
+int fim_debounce_init() {
+    if (!syscheck.rt_debounce) {
+        return -1;
+    }
+
+    if (debounce.table = OSHash_Create(), !debounce.table) {
+        merror("At fim_debounce_init(): OSHash_Create()");
+        return -1;
+    }
+
+    if (syscheck.rt_debounce_max < syscheck.rt_debounce) {
+        syscheck.rt_debounce_max = syscheck.rt_debounce;
+    }
+
+    w_create_thread(fim_debounce_thread, NULL);
+    mdebug1("Real-time events are coalesced for %d ms, up to %d ms.", syscheck.rt_debounce, syscheck.rt_debounce_max);
+    return 0;
+}
+
+int fim_debounce_push(const char *path, fim_event_mode mode, const whodata_evt *w_evt) {
+    fim_debounce_entry *entry;
+    long long now;
+
+    if (!debounce.table) {
+        return -1;
+    }
+
+    now = fim_debounce_now();
+    w_mutex_lock(&debounce.mutex);
+
+    if (entry = OSHash_Get_ex(debounce.table, path), entry) {
+        // The last writer is the one to report
+        fim_debounce_free_evt(entry->w_evt);
+        entry->w_evt = w_evt ? fim_debounce_copy(w_evt) : NULL;
+        entry->mode = mode;
+        entry->last = now;
+    } else {
+        os_calloc(1, sizeof(fim_debounce_entry), entry);
+        entry->mode = mode;
+        entry->w_evt = w_evt ? fim_debounce_copy(w_evt) : NULL;
+        entry->first = now;
+        entry->last = now;
+
+        if (OSHash_Add_ex(debounce.table, path, entry) != 2) {
+            w_mutex_unlock(&debounce.mutex);
+            fim_debounce_free(entry);
+            return -1;
+        }
+
+        if (OSHash_Get_Elem_ex(debounce.table) == 1) {
+            w_cond_signal(&debounce.available);
+        }
+    }
+
+    w_mutex_unlock(&debounce.mutex);
+    return 0;
+}
+
+#else
+
+int fim_debounce_init() {
+    return -1;
+}
+
+int fim_debounce_push(__attribute__((unused)) const char *path, __attribute__((unused)) fim_event_mode mode,
+                      __attribute__((unused)) const whodata_evt *w_evt) {
+    return -1;
+}
+
+#endif /* WIN32 */
@@ -0,0 +1,448 @@
+/* Deduplicated snapshot store for report_changes
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * October 15, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+#include "shared.h"
+#include "syscheck.h"
+#include "../external/zlib/zlib.h"
+#include <openssl/sha.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+/* Snapshots are cut in chunks at content-defined boundaries, so an edit only
+ * changes the chunks around it. Chunks are stored compressed once, by hash,
+ * whatever the files they belong to, and each snapshot is the list of its
+ * chunks. When the chunks exceed the quota, the least recently used snapshots
+ * are dropped. queue/diff is cleared on start, so the index lives in memory.
+ */
+
+#define STORE_DIR           DIFF_DIR_PATH "/store"
+#define STORE_MIN_CHUNK     2048
+#define STORE_MAX_CHUNK     65536
+#define STORE_CHUNK_MASK    0x1FFFULL           // 8 KiB chunks on average
+
+typedef struct fim_store_chunk {
+    char key[SHA_DIGEST_LENGTH * 2 + 1];
+    size_t size;                                // Uncompressed
+    size_t disk_size;
+    unsigned int refs;
+} fim_store_chunk;
+
+typedef struct fim_store_snapshot {
+    char *path;
+    fim_store_chunk **chunks;
+    size_t count;
+    size_t size;
+    struct fim_store_snapshot *prev;            // More recently used
+    struct fim_store_snapshot *next;            // Less recently used
+} fim_store_snapshot;
+
+static struct {
+    OSHash *chunks;                             // Chunks by hash, NULL if the store is disabled
+    OSHash *snapshots;                          // Snapshots by path
+    fim_store_snapshot *head;
+    fim_store_snapshot *tail;
+    size_t used;                                // Bytes of the chunks on disk
+    uint64_t gear[256];
+    w_metric_t *m_bytes;
+    w_metric_t *m_snapshots;
+    w_metric_t *m_evicted;
+    pthread_mutex_t mutex;
+} store = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+static void fim_diff_store_chunk_path(char *buffer, size_t size, const char *key) {
+    snprintf(buffer, size, "%s/%.2s/%s", STORE_DIR, key, key + 2);
+}
+
+static void fim_diff_store_mkdir(const char *path) {
+#ifndef WIN32
+    if (mkdir(path, 0770) == -1 && errno != EEXIST) {
+#else
+    if (mkdir(path) == -1 && errno != EEXIST) {
+#endif
+        merror(MKDIR_ERROR, path, errno, strerror(errno));
+    }
+}
+
+int fim_diff_store_init() {
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    uint64_t z;
+    int i;
+
+    if (cldir_ex(STORE_DIR) == -1 && errno != ENOENT) {
+        merror("Unable to clear directory '%s': %s (%d)", STORE_DIR, strerror(errno), errno);
+    }
+
+    if (syscheck.diff_store_size == 0 || syscheck.diff_max_size == 0) {
+        return -1;
+    }
+
+    fim_diff_store_mkdir(STORE_DIR);
+
+    /* Gear table of the rolling hash (splitmix64) */
+    for (i = 0; i < 256; i++) {
+        z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        store.gear[i] = z ^ (z >> 31);
+    }
+
+    if (store.snapshots = OSHash_Create(), !store.snapshots) {
+        merror("At fim_diff_store_init(): OSHash_Create()");
+        return -1;
+    }
+
+    if (store.chunks = OSHash_Create(), !store.chunks) {
+        merror("At fim_diff_store_init(): OSHash_Create()");
+        OSHash_Free(store.snapshots);
+        store.snapshots = NULL;
+        return -1;
+    }
+
+    store.m_bytes = w_metrics_gauge("wazuh_syscheck_diff_store_bytes", "Size of the report_changes snapshot chunks on disk.", NULL, NULL, NULL);
+    store.m_snapshots = w_metrics_gauge("wazuh_syscheck_diff_store_snapshots", "Files with a report_changes snapshot in the store.", NULL, NULL, NULL);
+    store.m_evicted = w_metrics_counter("wazuh_syscheck_diff_store_evicted_total", "Snapshots dropped to keep the store within its quota.", NULL);
+
+    mdebug1("report_changes snapshots are kept in a store of up to %zu MB.", syscheck.diff_store_size / (1024 * 1024));
+    return 0;
+}
+
+/* Length of the chunk at the start of data, cut where the gear hash has its low bits clear */
+static size_t fim_diff_store_cut(const unsigned char *data, size_t size) {
+    uint64_t hash = 0;
+    size_t i;
+
+    if (size <= STORE_MIN_CHUNK) {
+        return size;
+    }
+
+    if (size > STORE_MAX_CHUNK) {
+        size = STORE_MAX_CHUNK;
+    }
+
+    for (i = 0; i < size; i++) {
+        hash = (hash << 1) + store.gear[data[i]];
+
+        if (i >= STORE_MIN_CHUNK && (hash & STORE_CHUNK_MASK) == 0) {
+            return i + 1;
+        }
+    }
+
+    return size;
+}
+
+/* Get a chunk, writing it if it isn't stored yet. The caller holds a reference */
+static fim_store_chunk * fim_diff_store_put_chunk(const char *data, size_t size) {
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    fim_store_chunk *chunk;
+    char key[SHA_DIGEST_LENGTH * 2 + 1];
+    uLongf disk_size;
+    Bytef *compressed;
+    FILE *fp;
+    int i;
+
+    SHA1((const unsigned char *)data, size, digest);
+
+    for (i = 0; i < SHA_DIGEST_LENGTH; i++) {
+        snprintf(key + i * 2, 3, "%02x", digest[i]);
+    }
+
+    if (chunk = OSHash_Get(store.chunks, key), chunk) {
+        chunk->refs++;
+        return chunk;
+    }
+
+    disk_size = compressBound(size);
+    os_malloc(disk_size, compressed);
+
+    if (compress2(compressed, &disk_size, (const Bytef *)data, size, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        merror("Unable to compress a chunk of a snapshot.");
+        os_free(compressed);
+        return NULL;
+    }
+
+    snprintf(path, sizeof(path), "%s/%.2s", STORE_DIR, key);
+    fim_diff_store_mkdir(path);
+    fim_diff_store_chunk_path(path, sizeof(path), key);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    /* Written aside and renamed, so a chunk file is always whole */
+    if (fp = fopen(tmp_path, "wb"), !fp) {
+        merror(FOPEN_ERROR, tmp_path, errno, strerror(errno));
+        os_free(compressed);
+        return NULL;
+    }
+
+    if (fwrite(compressed, 1, disk_size, fp) != disk_size) {
+        merror(FIM_ERROR_GENDIFF_WRITING_DATA, tmp_path);
+        fclose(fp);
+        unlink(tmp_path);
+        os_free(compressed);
+        return NULL;
+    }
+
+    fclose(fp);
+    os_free(compressed);
+
+    if (rename_ex(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(fim_store_chunk), chunk);
+    strcpy(chunk->key, key);
+    chunk->size = size;
+    chunk->disk_size = disk_size;
+    chunk->refs = 1;
+    OSHash_Add(store.chunks, key, chunk);
+    store.used += disk_size;
+
+    return chunk;
+}
+
+static void fim_diff_store_release_chunk(fim_store_chunk *chunk) {
+    char path[PATH_MAX];
+
+    if (--chunk->refs > 0) {
+        return;
+    }
+
+    fim_diff_store_chunk_path(path, sizeof(path), chunk->key);
+    unlink(path);
+    OSHash_Delete(store.chunks, chunk->key);
+    store.used -= chunk->disk_size;
+    os_free(chunk);
+}
+
+/* Uncompress a chunk into buffer, which has room for chunk->size bytes.
+ * The chunk is mapped rather than read: chunk files are never changed once
+ * written, unlike the monitored files, which may shrink under a mapping.
+ */
+static int fim_diff_store_read_chunk(const fim_store_chunk *chunk, char *buffer) {
+    char path[PATH_MAX];
+    uLongf size = chunk->size;
+    Bytef *data;
+    int retval;
+    int fd;
+
+    fim_diff_store_chunk_path(path, sizeof(path), chunk->key);
+
+    if (fd = open(path, O_RDONLY), fd < 0) {
+        merror(FOPEN_ERROR, path, errno, strerror(errno));
+        return -1;
+    }
+
+#ifndef WIN32
+    if (data = mmap(NULL, chunk->disk_size, PROT_READ, MAP_PRIVATE, fd, 0), data == MAP_FAILED) {
+        merror("Unable to map '%s': %s (%d)", path, strerror(errno), errno);
+        close(fd);
+        return -1;
+    }
+#else
+    os_malloc(chunk->disk_size, data);
+
+    if (read(fd, data, chunk->disk_size) != (int)chunk->disk_size) {
+        merror(FREAD_ERROR, path, errno, strerror(errno));
+        os_free(data);
+        close(fd);
+        return -1;
+    }
+#endif
+
+    retval = uncompress((Bytef *)buffer, &size, data, chunk->disk_size) == Z_OK && size == chunk->size ? 0 : -1;
+
+#ifndef WIN32
+    munmap(data, chunk->disk_size);
+#else
+    os_free(data);
+#endif
+    close(fd);
+    return retval;
+}
+
+static void fim_diff_store_unlink(fim_store_snapshot *snapshot) {
+    if (snapshot->prev) {
+        snapshot->prev->next = snapshot->next;
+    } else {
+        store.head = snapshot->next;
+    }
+
+    if (snapshot->next) {
+        snapshot->next->prev = snapshot->prev;
+    } else {
+        store.tail = snapshot->prev;
+    }
+
+    snapshot->prev = snapshot->next = NULL;
+}
+
+static void fim_diff_store_touch(fim_store_snapshot *snapshot) {
+    if (store.head == snapshot) {
+        return;
+    }
+
+    /* New snapshots aren't in the list yet */
+    if (snapshot->prev) {
+        fim_diff_store_unlink(snapshot);
+    }
+    snapshot->next = store.head;
+
+    if (store.head) {
+        store.head->prev = snapshot;
+    } else {
+        store.tail = snapshot;
+    }
+
+    store.head = snapshot;
+}
+
+static void fim_diff_store_release_chunks(fim_store_chunk **chunks, size_t count) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        fim_diff_store_release_chunk(chunks[i]);
+    }
+
+    os_free(chunks);
+}
+
+static void fim_diff_store_drop(fim_store_snapshot *snapshot) {
+    fim_diff_store_unlink(snapshot);
+    OSHash_Delete(store.snapshots, snapshot->path);
+    fim_diff_store_release_chunks(snapshot->chunks, snapshot->count);
+    os_free(snapshot->path);
+    os_free(snapshot);
+}
+
+static void fim_diff_store_update_metrics() {
+    w_metrics_set(store.m_bytes, (int64_t)store.used);
+    w_metrics_set(store.m_snapshots, OSHash_Get_Elem_ex(store.snapshots));
+}
+
+int fim_diff_store_enabled() {
+    return store.chunks != NULL;
+}
+
+int fim_diff_store_load(const char *path, w_diff_text_t *text) {
+    fim_store_snapshot *snapshot;
+    size_t offset = 0;
+    char *data;
+    size_t i;
+
+    if (!store.chunks) {
+        return -1;
+    }
+
+    w_mutex_lock(&store.mutex);
+
+    if (snapshot = OSHash_Get(store.snapshots, path), !snapshot) {
+        w_mutex_unlock(&store.mutex);
+        return -1;
+    }
+
+    os_malloc(snapshot->size + 1, data);
+
+    for (i = 0; i < snapshot->count; i++) {
+        if (fim_diff_store_read_chunk(snapshot->chunks[i], data + offset) != 0) {
+            /* A broken snapshot is dropped, and taken again */
+            fim_diff_store_drop(snapshot);
+            fim_diff_store_update_metrics();
+            w_mutex_unlock(&store.mutex);
+            os_free(data);
+            return -1;
+        }
+
+        offset += snapshot->chunks[i]->size;
+    }
+
+    fim_diff_store_touch(snapshot);
+    w_mutex_unlock(&store.mutex);
+
+    w_diff_text_set(text, data, offset);
+    return 0;
+}
+
+int fim_diff_store_save(const char *path, const w_diff_text_t *text) {
+    fim_store_snapshot *snapshot;
+    fim_store_chunk **chunks = NULL;
+    size_t count = 0;
+    size_t offset = 0;
+    size_t length;
+
+    if (!store.chunks) {
+        return -1;
+    }
+
+    w_mutex_lock(&store.mutex);
+
+    /* Take the new chunks before releasing the old ones, as most are the same */
+    while (offset < text->size) {
+        length = fim_diff_store_cut((const unsigned char *)text->data + offset, text->size - offset);
+        os_realloc(chunks, (count + 1) * sizeof(fim_store_chunk *), chunks);
+
+        if (chunks[count] = fim_diff_store_put_chunk(text->data + offset, length), !chunks[count]) {
+            fim_diff_store_release_chunks(chunks, count);
+            w_mutex_unlock(&store.mutex);
+            return -1;
+        }
+
+        count++;
+        offset += length;
+    }
+
+    if (snapshot = OSHash_Get(store.snapshots, path), snapshot) {
+        fim_diff_store_release_chunks(snapshot->chunks, snapshot->count);
+    } else {
+        os_calloc(1, sizeof(fim_store_snapshot), snapshot);
+        os_strdup(path, snapshot->path);
+        OSHash_Add(store.snapshots, path, snapshot);
+    }
+
+    snapshot->chunks = chunks;
+    snapshot->count = count;
+    snapshot->size = text->size;
+    fim_diff_store_touch(snapshot);
+
+    /* Drop the least recently used snapshots, this one the last */
+    while (store.used > syscheck.diff_store_size && store.tail) {
+        if (store.tail == snapshot) {
+            mdebug1("The snapshot of '%s' doesn't fit in the report_changes store.", path);
+        }
+
+        fim_diff_store_drop(store.tail);
+        w_metrics_inc(store.m_evicted);
+    }
+
+    fim_diff_store_update_metrics();
+    w_mutex_unlock(&store.mutex);
+    return 0;
+}
+
+void fim_diff_store_remove(const char *path) {
+    fim_store_snapshot *snapshot;
+
+    if (!store.chunks) {
+        return;
+    }
+
+    w_mutex_lock(&store.mutex);
+
+    if (snapshot = OSHash_Get(store.snapshots, path), snapshot) {
+        fim_diff_store_drop(snapshot);
+        fim_diff_store_update_metrics();
+    }
+
+    w_mutex_unlock(&store.mutex);
+}
@@ -0,0 +1,187 @@
+/* Parallel traversal of scheduled scans
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ * July 6, 2020
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+#include "shared.h"
+#include "syscheck.h"
+
+/* The directories found by a scheduled scan are pushed into a stack shared
+ * by the scan workers, instead of being read recursively. Any idle worker
+ * takes the last directory pushed, reads it and checks its files, so the
+ * traversal stays depth-first and the stack small. The scan waits for the
+ * stack to drain before it moves to the next stage.
+ *
+ * The database accesses are still serialized by fim_entry_mutex and batched
+ * by its transaction, but the files are hashed out of that lock. The number
+ * of files hashed at the same time can be limited to bound the disk load.
+ */
+
+#ifndef WIN32
+
+typedef struct fim_scan_dir {
+    char *path;
+    int index;
+    int configuration;
+    int trust_stat;
+    int report;
+    struct fim_scan_dir *next;
+} fim_scan_dir;
+
+static struct {
+    int threads;                        // Scan workers, 0 if the scans are sequential
+    fim_scan_dir *stack;                // Directories waiting for a worker
+    unsigned int pending;               // Directories pushed and not read up yet
+    unsigned int hashing;               // Files being hashed
+    pthread_mutex_t mutex;
+    pthread_cond_t available;           // A directory was pushed
+    pthread_cond_t done;                // The last pending directory was read
+    pthread_cond_t hash_slot;           // A file was hashed
+} pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .available = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .hash_slot = PTHREAD_COND_INITIALIZER
+};
+
+static void * fim_scan_worker(__attribute__((unused)) void * args) {
+    fim_scan_dir *dir;
+
+    while (1) {
+        w_mutex_lock(&pool.mutex);
+
+        while (!pool.stack) {
+            w_cond_wait(&pool.available, &pool.mutex);
+        }
+
+        dir = pool.stack;
+        pool.stack = dir->next;
+        w_mutex_unlock(&pool.mutex);
+
+        fim_element item = { .mode = FIM_SCHEDULED, .index = dir->index, .configuration = dir->configuration,
+                             .trust_stat = dir->trust_stat, .pooled = 1 };
+
+        if (dir->configuration & REALTIME_ACTIVE) {
+            w_mutex_lock(&syscheck.fim_realtime_mutex);
+            realtime_adddir(dir->path, 0, (dir->configuration & CHECK_FOLLOW) ? 1 : 0);
+            w_mutex_unlock(&syscheck.fim_realtime_mutex);
+        }
+
+        fim_directory(dir->path, &item, NULL, dir->report);
+
+        os_free(dir->path);
+        os_free(dir);
+
+        w_mutex_lock(&pool.mutex);
+
+        if (--pool.pending == 0) {
+            w_cond_broadcast(&pool.done);
+        }
+
+        w_mutex_unlock(&pool.mutex);
+    }
+
+    return NULL;
+}
+
+int fim_scan_pool_init() {
+    int i;
+
+    if (syscheck.scan_threads <= 1) {
+        return -1;
+    }
+
+    for (i = 0; i < syscheck.scan_threads; i++) {
+        w_create_thread(fim_scan_worker, NULL);
+    }
+
+    pool.threads = syscheck.scan_threads;
+    mdebug1("Scheduled scans run on %d threads.", pool.threads);
+    return 0;
+}
+
+int fim_scan_pool_active() {
+    return pool.threads > 0;
+}
+
+void fim_scan_push(const char *path, const fim_element *item, int report) {
+    fim_scan_dir *dir;
+
+    os_calloc(1, sizeof(fim_scan_dir), dir);
+    os_strdup(path, dir->path);
+    dir->index = item->index;
+    dir->configuration = item->configuration;
+    dir->trust_stat = item->trust_stat;
+    dir->report = report;
+
+    w_mutex_lock(&pool.mutex);
+    dir->next = pool.stack;
+    pool.stack = dir;
+    pool.pending++;
+    w_cond_signal(&pool.available);
+    w_mutex_unlock(&pool.mutex);
+}
+
+void fim_scan_wait() {
+    w_mutex_lock(&pool.mutex);
+
+    while (pool.pending > 0) {
+        w_cond_wait(&pool.done, &pool.mutex);
+    }
+
+    w_mutex_unlock(&pool.mutex);
+}
+
+fim_entry_data * fim_scan_get_data(const char *file, fim_element *item) {
+    fim_entry_data *data;
+
+    if (!syscheck.scan_hash_limit) {
+        return fim_get_data(file, item);
+    }
+
+    w_mutex_lock(&pool.mutex);
+
+    while (pool.hashing >= (unsigned int)syscheck.scan_hash_limit) {
+        w_cond_wait(&pool.hash_slot, &pool.mutex);
+    }
+
+    pool.hashing++;
+    w_mutex_unlock(&pool.mutex);
+
+    data = fim_get_data(file, item);
+
+    w_mutex_lock(&pool.mutex);
+    pool.hashing--;
+    w_cond_signal(&pool.hash_slot);
+    w_mutex_unlock(&pool.mutex);
+
+    return data;
+}
+
+#else
+
+int fim_scan_pool_init() {
+    return -1;
+}
+
+int fim_scan_pool_active() {
+    return 0;
+}
+
+void fim_scan_push(__attribute__((unused)) const char *path, __attribute__((unused)) const fim_element *item,
+                   __attribute__((unused)) int report) {
+}
+
+void fim_scan_wait() {
+}
+
+fim_entry_data * fim_scan_get_data(const char *file, fim_element *item) {
+    return fim_get_data(file, item);
+}
+
+#endif /* WIN32 */
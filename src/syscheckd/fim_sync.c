@@ -35,6 +35,8 @@ extern void mock_assert(const int result, const char* const expression,
 
 static long fim_sync_cur_id;
 static w_queue_t * fim_sync_queue;
+static os_sha1 fim_sync_digest;         // Data checksum of the last synchronization
+static int fim_sync_changes = -1;       // Database changes when that checksum was calculated
 
 // LCOV_EXCL_START
 // Starting data synchronization thread
@@ -49,6 +51,7 @@ void * fim_run_integrity(void * args) {
     struct timespec end;
 
     fim_sync_queue = queue_init(syscheck.sync_queue_size);
+    queue_metrics_register(fim_sync_queue, "fim_sync");
 
     while (1) {
         bool sync_successful = true;
@@ -98,6 +101,7 @@ void * fim_run_integrity(void * args) {
 void fim_sync_checksum() {
     char *start = NULL;
     char *top = NULL;
+    int changes;
     EVP_MD_CTX * ctx = EVP_MD_CTX_create();
     EVP_DigestInit(ctx, EVP_sha1());
 
@@ -117,24 +121,30 @@ void fim_sync_checksum() {
         goto end;
     }
 
-    if (fim_db_get_data_checksum(syscheck.database, (void*) ctx) != FIMDB_OK) {
-        merror(FIM_DB_ERROR_CALC_CHECKSUM);
-        w_mutex_unlock(&syscheck.fim_entry_mutex);
-        goto end;
-    }
+    // Don't go through the whole database again if nothing has changed since the last time
+    changes = fim_db_get_changes(syscheck.database);
 
-    w_mutex_unlock(&syscheck.fim_entry_mutex);
-    fim_sync_cur_id = time(NULL);
+    if (changes != fim_sync_changes) {
+        if (fim_db_get_data_checksum(syscheck.database, (void*) ctx) != FIMDB_OK) {
+            merror(FIM_DB_ERROR_CALC_CHECKSUM);
+            fim_sync_changes = -1;
+            w_mutex_unlock(&syscheck.fim_entry_mutex);
+            goto end;
+        }
 
-    if (start && top) {
         unsigned char digest[EVP_MAX_MD_SIZE] = {0};
         unsigned int digest_size;
-        os_sha1 hexdigest  = {0};
 
         EVP_DigestFinal_ex(ctx, digest, &digest_size);
-        OS_SHA1_Hexdigest(digest, hexdigest);
+        OS_SHA1_Hexdigest(digest, fim_sync_digest);
+        fim_sync_changes = changes;
+    }
+
+    w_mutex_unlock(&syscheck.fim_entry_mutex);
+    fim_sync_cur_id = time(NULL);
 
-        char * plain = dbsync_check_msg("syscheck", INTEGRITY_CHECK_GLOBAL, fim_sync_cur_id, start, top, NULL, hexdigest);
+    if (start && top) {
+        char * plain = dbsync_check_msg("syscheck", INTEGRITY_CHECK_GLOBAL, fim_sync_cur_id, start, top, NULL, fim_sync_digest);
         fim_send_sync_msg(plain);
 
         os_free(plain);
@@ -164,6 +164,7 @@ int main(int argc, char **argv)
 
     // Start com request thread
     w_create_thread(syscom_main, NULL);
+    w_metrics_http_start("syscheck");
 
     /* Create pid */
     if (CreatePID(ARGV0, getpid()) < 0) {
@@ -111,6 +111,8 @@ void fim_send_sync_msg(const char * msg) {
 // Send a message related to syscheck change/addition
 void send_syscheck_msg(const char *msg)
 {
+    static pthread_mutex_t eps_mutex = PTHREAD_MUTEX_INITIALIZER;
+
     mdebug2(FIM_SEND, msg);
     fim_send_msg(SYSCHECK_MQ, SYSCHECK, msg);
 
@@ -120,10 +122,15 @@ void send_syscheck_msg(const char *msg)
 
     static unsigned n_msg_sent = 0;
 
+    // The scan workers send at the same time: the one that sleeps holds the others
+    w_mutex_lock(&eps_mutex);
+
     if (++n_msg_sent == syscheck.max_eps) {
         sleep(1);
         n_msg_sent = 0;
     }
+
+    w_mutex_unlock(&eps_mutex);
 }
 
 // Send a scan info event
@@ -195,11 +202,15 @@ void start_daemon()
         merror("Unable to clear directory '%s': %s (%d)", diff_dir, strerror(errno), errno);
     }
 
+    fim_diff_store_init();
+
     if (syscheck.disabled) {
         return;
     }
 
     minfo(FIM_DAEMON_STARTED);
+    fim_scan_pool_init();
+    fim_debounce_init();
 
     // Create File integrity monitoring base-line
     minfo(FIM_FREQUENCY_TIME, syscheck.time);
@@ -366,11 +377,18 @@ void * fim_run_realtime(__attribute__((unused)) void * args) {
             selecttime.tv_sec = SYSCHECK_WAIT;
             selecttime.tv_usec = 0;
 
+            int nfds = syscheck.realtime->fd;
+
             // zero-out the fd_set
             FD_ZERO (&rfds);
             FD_SET(syscheck.realtime->fd, &rfds);
 
-            run_now = select(syscheck.realtime->fd + 1,
+            if (syscheck.realtime->fanotify) {
+                FD_SET(syscheck.realtime->fanotify_fd, &rfds);
+                nfds = (syscheck.realtime->fanotify_fd > nfds) ? syscheck.realtime->fanotify_fd : nfds;
+            }
+
+            run_now = select(nfds + 1,
                             &rfds,
                             NULL,
                             NULL,
@@ -380,8 +398,14 @@ void * fim_run_realtime(__attribute__((unused)) void * args) {
                 merror(FIM_ERROR_SELECT);
             } else if (run_now == 0) {
                 // Timeout
-            } else if (FD_ISSET (syscheck.realtime->fd, &rfds)) {
-                realtime_process();
+            } else {
+                if (FD_ISSET (syscheck.realtime->fd, &rfds)) {
+                    realtime_process();
+                }
+
+                if (syscheck.realtime->fanotify && FD_ISSET (syscheck.realtime->fanotify_fd, &rfds)) {
+                    realtime_process_fanotify();
+                }
             }
 
 #elif defined WIN32
@@ -664,7 +688,9 @@ STATIC void fim_delete_realtime_watches(__attribute__((unused)) int pos) {
             assert(wd_str != NULL);
 
             inotify_rm_watch(syscheck.realtime->fd, atol(wd_str));
-            free(OSHash_Delete_ex(syscheck.realtime->dirtb, wd_str));
+            data = OSHash_Delete_ex(syscheck.realtime->dirtb, wd_str);
+            realtime_watch_unindex(data, atoi(wd_str));
+            free(data);
             deletion_it--;
         }
         w_mutex_unlock(&syscheck.fim_realtime_mutex);
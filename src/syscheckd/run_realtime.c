@@ -44,6 +44,63 @@ volatile int audit_db_consistency_flag;
 #define REALTIME_EVENT_SIZE     (sizeof (struct inotify_event))
 #define REALTIME_EVENT_BUFFER   (2048 * (REALTIME_EVENT_SIZE + 16))
 
+#include <sys/fanotify.h>
+#include <sys/vfs.h>
+
+/* Directories that are not reached through links may be monitored through
+ * fanotify instead of inotify: a single mark covers a whole filesystem, so
+ * there is no watch per directory to exhaust. Each event carries the handle
+ * of the parent directory and the name of the entry, and is resolved through
+ * a descriptor kept open on that filesystem. Events outside the configured
+ * directories are discarded by fim_checker(). Directories on filesystems
+ * that can't be marked keep using inotify.
+ */
+
+#if defined(FAN_REPORT_DFID_NAME) && defined(FAN_MARK_FILESYSTEM)
+#define REALTIME_FANOTIFY
+#define REALTIME_FANOTIFY_MASK  (FAN_MODIFY | FAN_ATTRIB | FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR)
+#define REALTIME_FANOTIFY_FS    64
+
+static struct {
+    __kernel_fsid_t fsid;
+    int fd;                                 // Directory on the filesystem, to open the handles
+} fanotify_fs[REALTIME_FANOTIFY_FS];
+
+static int fanotify_fs_count;
+#endif
+
+/* Directories that could not be watched since the last watch was added */
+static unsigned int watches_missed;
+
+/* Guards syscheck.realtime->dirpaths. Taken after syscheck.fim_realtime_mutex */
+static pthread_mutex_t dirpaths_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Index the watch of a directory by its path, so the watches under a directory are found at once */
+static void realtime_watch_index(const char *dir, int wd) {
+    w_mutex_lock(&dirpaths_mutex);
+
+    if (!radix_insert(syscheck.realtime->dirpaths, dir, (void *)(intptr_t)wd)) {
+        radix_delete(syscheck.realtime->dirpaths, dir);
+        radix_insert(syscheck.realtime->dirpaths, dir, (void *)(intptr_t)wd);
+    }
+
+    w_mutex_unlock(&dirpaths_mutex);
+}
+
+void realtime_watch_unindex(const char *dir, int wd) {
+    if (!dir || !syscheck.realtime->dirpaths) {
+        return;
+    }
+
+    w_mutex_lock(&dirpaths_mutex);
+
+    if ((intptr_t)radix_get(syscheck.realtime->dirpaths, dir) == wd) {
+        radix_delete(syscheck.realtime->dirpaths, dir);
+    }
+
+    w_mutex_unlock(&dirpaths_mutex);
+}
+
 int realtime_start() {
     os_calloc(1, sizeof(rtfim), syscheck.realtime);
 
@@ -55,15 +112,73 @@ int realtime_start() {
 
     OSHash_SetFreeDataPointer(syscheck.realtime->dirtb, (void (*)(void *))free);
 
+    syscheck.realtime->dirpaths = radix_init();
+
     syscheck.realtime->fd = inotify_init();
     if (syscheck.realtime->fd < 0) {
         merror(FIM_ERROR_INOTIFY_INITIALIZE);
         return (-1);
     }
 
+#ifdef REALTIME_FANOTIFY
+    if (syscheck.rt_fanotify) {
+        syscheck.realtime->fanotify_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_REPORT_DFID_NAME, O_RDONLY | O_LARGEFILE);
+
+        if (syscheck.realtime->fanotify_fd < 0) {
+            mwarn("Cannot initialize fanotify: %s (%d). Real-time monitoring uses inotify.", strerror(errno), errno);
+        } else {
+            syscheck.realtime->fanotify = 1;
+            mdebug1("Real-time monitoring marks whole filesystems through fanotify.");
+        }
+    }
+#endif
+
     return (0);
 }
 
+#ifdef REALTIME_FANOTIFY
+/* Cover a directory with a filesystem mark. Returns 1 if it's covered, 0 if it needs an inotify watch */
+static int realtime_fanotify_add(const char *dir) {
+    struct statfs fs;
+    __kernel_fsid_t fsid;
+    int fd;
+    int i;
+
+    if (statfs(dir, &fs) < 0) {
+        return 0;
+    }
+
+    memcpy(&fsid, &fs.f_fsid, sizeof(fsid));
+
+    for (i = 0; i < fanotify_fs_count; i++) {
+        if (!memcmp(&fanotify_fs[i].fsid, &fsid, sizeof(fsid))) {
+            return 1;
+        }
+    }
+
+    if (fanotify_fs_count == REALTIME_FANOTIFY_FS) {
+        return 0;
+    }
+
+    if (fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC), fd < 0) {
+        return 0;
+    }
+
+    if (fanotify_mark(syscheck.realtime->fanotify_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, REALTIME_FANOTIFY_MASK, AT_FDCWD, dir) < 0) {
+        mdebug1("Cannot mark the filesystem of '%s' through fanotify: %s (%d). Using inotify.", dir, strerror(errno), errno);
+        close(fd);
+        return 0;
+    }
+
+    fanotify_fs[fanotify_fs_count].fsid = fsid;
+    fanotify_fs[fanotify_fs_count].fd = fd;
+    fanotify_fs_count++;
+
+    mdebug1("Filesystem of '%s' marked for real time monitoring.", dir);
+    return 1;
+}
+#endif
+
 /* Add a directory to real time checking */
 int realtime_adddir(const char *dir, __attribute__((unused)) int whodata, __attribute__((unused))int followsl) {
     if (whodata && audit_thread_active) {
@@ -91,12 +206,34 @@ int realtime_adddir(const char *dir, __attribute__((unused)) int whodata, __attr
         else {
             int wd = 0;
 
+#ifdef REALTIME_FANOTIFY
+            // The events of a filesystem mark come with the real paths, that links would not match
+            if (syscheck.realtime->fanotify && !followsl && realtime_fanotify_add(dir)) {
+                return (1);
+            }
+#endif
+
+            /* Past the watch budget, the rest of the directories are left to the scheduled scans */
+            if (syscheck.rt_max_watches > 0 && syscheck.realtime->dirtb->elements >= (unsigned int)syscheck.rt_max_watches) {
+                if (watches_missed++ == 0) {
+                    mwarn("Real-time watch budget (%d) reached. Directories not watched will be checked by the scheduled scans.", syscheck.rt_max_watches);
+                }
+
+                mdebug2(FIM_REALTIME_ADD, dir);
+                return (1);
+            }
+
             wd = inotify_add_watch(syscheck.realtime->fd,
                                    dir,
                                    (0 == followsl) ? (REALTIME_MONITOR_FLAGS|IN_DONT_FOLLOW) : REALTIME_MONITOR_FLAGS);
             if (wd < 0) {
                 if (errno == 28) {
-                    merror(FIM_ERROR_INOTIFY_ADD_MAX_REACHED, dir, wd, errno);
+                    // Report the limit once, not for every directory of a large tree
+                    if (watches_missed++ == 0) {
+                        merror(FIM_ERROR_INOTIFY_ADD_MAX_REACHED, dir, wd, errno);
+                    } else {
+                        mdebug2(FIM_REALTIME_ADD, dir);
+                    }
                 }
                 else {
                     mdebug1(FIM_INOTIFY_ADD_WATCH, dir, wd, errno, strerror(errno));
@@ -104,6 +241,7 @@ int realtime_adddir(const char *dir, __attribute__((unused)) int whodata, __attr
             }
             else {
                 char wdchar[33];
+                watches_missed = 0;
                 char *data;
                 int retval;
                 snprintf(wdchar, 33, "%d", wd);
@@ -128,6 +266,8 @@ int realtime_adddir(const char *dir, __attribute__((unused)) int whodata, __attr
                         return (-1);
                     }
                 }
+
+                realtime_watch_index(dir, wd);
             }
         }
     }
@@ -202,6 +342,7 @@ void realtime_process() {
 
                         char * data = OSHash_Delete_ex(syscheck.realtime->dirtb, wdchar);
                         mdebug2(FIM_INOTIFY_WATCH_DELETED, entry);
+                        realtime_watch_unindex(data, event->wd);
                         os_free(data);
 
                         w_mutex_unlock(&syscheck.fim_realtime_mutex);
@@ -222,62 +363,141 @@ void realtime_process() {
     }
 }
 
-void free_syscheck_dirtb_data(char *data) {
-    free(data);
-}
+#ifdef REALTIME_FANOTIFY
+/* Resolve the path of an event: parent directory followed by the entry name */
+static int realtime_fanotify_path(const struct fanotify_event_info_fid *fid, char *path, size_t size) {
+    struct file_handle *handle = (struct file_handle *)fid->handle;
+    const char *name = (const char *)handle->f_handle + handle->handle_bytes;
+    char link[PATH_MAX];
+    ssize_t length;
+    int mount_fd = -1;
+    int fd;
+    int i;
+
+    for (i = 0; i < fanotify_fs_count; i++) {
+        if (!memcmp(&fanotify_fs[i].fsid, &fid->fsid, sizeof(fid->fsid))) {
+            mount_fd = fanotify_fs[i].fd;
+            break;
+        }
+    }
 
-void delete_subdirectories_watches(char *dir) {
-    OSHashNode *hash_node;
-    char *data;
-    unsigned int inode_it = 0;
-    char *dir_slash = NULL;
-    int dir_len = strlen(dir) + 1;
+    // The directory may be gone already: its entries will be found missing by the scans
+    if (mount_fd < 0 || (fd = open_by_handle_at(mount_fd, handle, O_PATH), fd < 0)) {
+        return -1;
+    }
 
-    /*
-        If the directory already ends with an slash, there is no need for adding
-        an extra one
-     */
-    if (dir[dir_len - 1] != '/') {
-        os_calloc(dir_len + 2, sizeof(char), dir_slash);  // Length of dir plus an extra slash
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    length = readlink(link, path, size - 1);
+    close(fd);
 
-        /*
-            Copy the content of dir into dir_slash and add an extra slash
-        */
-        strncpy(dir_slash, dir, dir_len);
-        strncat(dir_slash, "/", strlen(dir_slash) + 1);
+    if (length < 0) {
+        return -1;
     }
-    else {
-        os_calloc(dir_len, sizeof(char), dir_slash);
-        strncpy(dir_slash, dir, dir_len);
+
+    path[length] = '\0';
+
+    // Events of a directory itself name it "."
+    if (*name != '\0' && strcmp(name, ".") != 0) {
+        size_t used = (size_t)length;
+        snprintf(path + used, size - used, "%s%s", (used > 0 && path[used - 1] == PATH_SEP) ? "" : "/", name);
     }
 
-    if(syscheck.realtime->fd) {
-        w_mutex_lock(&syscheck.fim_entry_mutex);
-        hash_node = OSHash_Begin(syscheck.realtime->dirtb, &inode_it);
+    return 0;
+}
 
-        while(hash_node) {
-            data = hash_node->data;
-
-            if (strncmp(dir_slash, data, strlen(dir_slash)) == 0) {
-                char * data_node = OSHash_Delete_ex(syscheck.realtime->dirtb, hash_node->key);
-                mdebug2(FIM_INOTIFY_WATCH_DELETED, data);
-                os_free(data_node);
-
-                /*
-                    If an element of the hash table is deleted, it needs to start from the
-                    beginning again to prevent going out of boundaries.
-                */
-                hash_node = OSHash_Begin(syscheck.realtime->dirtb, &inode_it);
+void realtime_process_fanotify() {
+    char buf[REALTIME_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+    struct fanotify_event_metadata *event;
+    char final_name[MAX_LINE + 1];
+    ssize_t len;
+
+    len = read(syscheck.realtime->fanotify_fd, buf, sizeof(buf));
+
+    if (len < 0) {
+        merror(FIM_ERROR_REALTIME_READ_BUFFER);
+        return;
+    }
+
+    rb_tree * tree = rbtree_init();
+
+    for (event = (struct fanotify_event_metadata *)buf; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+        const struct fanotify_event_info_fid *fid = (const struct fanotify_event_info_fid *)(event + 1);
+
+        if (event->mask & FAN_Q_OVERFLOW) {
+            mwarn("Real-time fanotify kernel queue is full. Some events may be lost. Next scheduled scan will recover lost data.");
+            send_log_msg("ossec: Real-time fanotify kernel queue is full. Some events may be lost. Next scheduled scan will recover lost data.");
+            continue;
+        }
+
+        if (event->event_len <= sizeof(*event) || fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+            continue;
+        }
+
+        if (realtime_fanotify_path(fid, final_name, sizeof(final_name)) == 0) {
+            int node = fim_configuration_directory(final_name, "file");
+
+            // Most of the events of a filesystem are outside the monitored directories
+            if (node < 0 || !(syscheck.opts[node] & REALTIME_ACTIVE)) {
                 continue;
             }
 
-            hash_node = OSHash_Next(syscheck.realtime->dirtb, &inode_it, hash_node);
+            if (rbtree_insert(tree, final_name, (void *)1) == NULL) {
+                mdebug2("Duplicate event in real-time buffer: %s", final_name);
+            }
         }
+    }
 
-        w_mutex_unlock(&syscheck.fim_entry_mutex);
+    char ** paths = rbtree_keys(tree);
+
+    for (int i = 0; paths[i] != NULL; i++) {
+        fim_realtime_event(paths[i]);
     }
 
-    os_free(dir_slash);
+    free_strarray(paths);
+    rbtree_destroy(tree);
+}
+#else
+void realtime_process_fanotify() {
+}
+#endif
+
+void free_syscheck_dirtb_data(char *data) {
+    free(data);
+}
+
+/* Drop the watch of a directory under a moved one, unless its descriptor went to another directory */
+static void delete_subdirectory_watch(const char *dir, void *wd, __attribute__((unused)) void *arg) {
+    char wdchar[33];
+    char *data;
+
+    snprintf(wdchar, 33, "%d", (int)(intptr_t)wd);
+
+    if (data = OSHash_Get(syscheck.realtime->dirtb, wdchar), data && strcmp(data, dir) == 0) {
+        free(OSHash_Delete_ex(syscheck.realtime->dirtb, wdchar));
+        mdebug2(FIM_INOTIFY_WATCH_DELETED, dir);
+    }
+}
+
+void delete_subdirectories_watches(char *dir) {
+    char dir_slash[PATH_MAX + 2];
+    size_t dir_len = strlen(dir);
+
+    if (!syscheck.realtime->fd) {
+        return;
+    }
+
+    /*
+        If the directory already ends with an slash, there is no need for adding
+        an extra one
+     */
+    snprintf(dir_slash, sizeof(dir_slash), "%s%s", dir, dir_len > 0 && dir[dir_len - 1] == '/' ? "" : "/");
+
+    /* The watches under the directory are a single subtree of the path index */
+    w_mutex_lock(&syscheck.fim_realtime_mutex);
+    w_mutex_lock(&dirpaths_mutex);
+    radix_delete_prefix(syscheck.realtime->dirpaths, dir_slash, delete_subdirectory_watch, NULL);
+    w_mutex_unlock(&dirpaths_mutex);
+    w_mutex_unlock(&syscheck.fim_realtime_mutex);
 }
 
 #elif defined(WIN32)
@@ -14,12 +14,17 @@ CREATE TABLE IF NOT EXISTS entry_path (
     entry_type INTEGER,
     scanned INTEGER,
     options INTEGER,
-    checksum TEXT NOT NULL,
+    checksum BLOB NOT NULL,
     PRIMARY KEY(path)
-);
+) WITHOUT ROWID;
 
-CREATE INDEX IF NOT EXISTS path_index ON entry_path (path);
-CREATE INDEX IF NOT EXISTS inode_index ON entry_path (inode_id);
+/* The primary keys index the paths and the inodes. The index on inode_id is
+ * created by fim_db_create_index() after the baseline scan.
+ *
+ * entry_path is stored in path order with no rowid, so the path ranges of the
+ * synchronization read the paths and checksums straight from the table.
+ * Digests are stored as binary blobs, half the size of their hex form.
+ */
 
 CREATE TABLE IF NOT EXISTS entry_data (
     dev INTEGER,
@@ -31,11 +36,10 @@ CREATE TABLE IF NOT EXISTS entry_data (
     gid INTEGER,
     user_name TEXT,
     group_name TEXT,
-    hash_md5 TEXT,
-    hash_sha1 TEXT,
-    hash_sha256 TEXT,
+    hash_md5 BLOB,
+    hash_sha1 BLOB,
+    hash_sha256 BLOB,
     mtime INTEGER,
+    ctime INTEGER,
     PRIMARY KEY(dev, inode)
 );
-
-CREATE INDEX IF NOT EXISTS dev_inode_index ON entry_data (dev, inode);
@@ -25,6 +25,7 @@
 static char *gen_diff_alert(const char *filename, time_t alert_diff_time, __attribute__((unused)) int status) __attribute__((nonnull));
 static int seechanges_dupfile(const char *old, const char *current) __attribute__((nonnull));
 static int seechanges_createpath(const char *filename) __attribute__((nonnull));
+static char *seechanges_diff(const char *filename, const char *old_location, const char *compressed_file) __attribute__((nonnull));
 #ifdef WIN32
 static char *adapt_win_fc_output(char *command_output);
 #endif
@@ -345,6 +346,69 @@ static int seechanges_createpath(const char *filename)
     return (1);
 }
 
+/* Compare a file with its compressed snapshot in-process, and replace the snapshot */
+static char *seechanges_diff(const char *filename, const char *old_location, const char *compressed_file)
+{
+    w_diff_text_t old_text;
+    w_diff_text_t new_text;
+    char *diff_str = NULL;
+    size_t size = OS_MAXSTR - OS_SK_HEADER - strlen(STR_MORE_CHANGES);
+
+    if (w_diff_text_load(&new_text, filename, syscheck.diff_max_size) != 0) {
+        merror(FIM_ERROR_GENDIFF_OPEN, filename);
+        return NULL;
+    }
+
+    /* If there is no snapshot, create it */
+    if (fim_diff_store_enabled()) {
+        if (fim_diff_store_load(filename, &old_text) != 0) {
+            if (fim_diff_store_save(filename, &new_text) != 0) {
+                mwarn(FIM_WARN_GENDIFF_SNAPSHOT, filename);
+            }
+
+            w_diff_text_free(&new_text);
+            return NULL;
+        }
+    } else if (w_diff_text_load(&old_text, compressed_file, SIZE_MAX) != 0) {
+        seechanges_createpath(old_location);
+
+        if (w_diff_text_save(&new_text, compressed_file) != 0) {
+            mwarn(FIM_WARN_GENDIFF_SNAPSHOT, filename);
+        }
+
+        w_diff_text_free(&new_text);
+        return NULL;
+    }
+
+    if (w_diff_text_equal(&old_text, &new_text)) {
+        goto end;
+    }
+
+#ifndef WIN32
+    if (is_nodiff(filename) || symlink_to_dir(filename)) {
+#else
+    if (is_nodiff((filename))) {
+#endif
+        /* Dont leak sensible data with a diff hanging around */
+        os_strdup("<Diff truncated because nodiff option>", diff_str);
+    } else {
+        os_malloc(size + strlen(STR_MORE_CHANGES), diff_str);
+
+        if (w_diff_lines(&old_text, &new_text, diff_str, size)) {
+            strcat(diff_str, STR_MORE_CHANGES);
+        }
+    }
+
+    if ((fim_diff_store_enabled() ? fim_diff_store_save(filename, &new_text) : w_diff_text_save(&new_text, compressed_file)) != 0) {
+        mwarn(FIM_WARN_GENDIFF_SNAPSHOT, filename);
+    }
+
+end:
+    w_diff_text_free(&old_text);
+    w_diff_text_free(&new_text);
+    return diff_str;
+}
+
 /* Check if the file has changed */
 char *seechanges_addfile(const char *filename)
 {
@@ -410,6 +474,18 @@ char *seechanges_addfile(const char *filename)
         DIFF_LAST_FILE
     );
 
+    /* Files up to diff_max_size are compared without copies nor running diff */
+    if (syscheck.diff_max_size > 0) {
+        off_t size = FileSize(filename);
+
+        if (size >= 0 && (size_t)size <= syscheck.diff_max_size) {
+            return seechanges_diff(filename, old_location, compressed_file);
+        }
+
+        /* The file outgrew the store */
+        fim_diff_store_remove(filename);
+    }
+
     /* If the file is not there, create compressed file*/
     if (w_uncompress_gzfile(compressed_file, old_location) != 0) {
         seechanges_createpath(old_location);
@@ -55,10 +55,22 @@ void read_internal(int debug_level)
     syscheck.rt_delay = getDefine_Int("syscheck", "rt_delay", 0, 1000);
     syscheck.max_depth = getDefine_Int("syscheck", "default_max_depth", 1, 320);
     syscheck.file_max_size = (size_t)getDefine_Int("syscheck", "file_max_size", 0, 4095) * 1024 * 1024;
+    syscheck.diff_max_size = (size_t)getDefine_Int("syscheck", "diff_max_size", 0, 4095) * 1024 * 1024;
+    syscheck.diff_store_size = (size_t)getDefine_Int("syscheck", "diff_store_size", 0, 1048576) * 1024 * 1024;
+    syscheck.database_cache = getDefine_Int("syscheck", "db_memory_cache", 0, 65536);
     syscheck.sym_checker_interval = getDefine_Int("syscheck", "symlink_scan_interval", 1, 2592000);
+    syscheck.rehash_scans = getDefine_Int("syscheck", "rehash_scans", 0, 1000);
 
 #ifndef WIN32
     syscheck.max_audit_entries = getDefine_Int("syscheck", "max_audit_entries", 1, 4096);
+    syscheck.audit_queue_size = getDefine_Int("syscheck", "audit_queue_size", 0, 1048576);
+    syscheck.scan_threads = getDefine_Int("syscheck", "scan_threads", 1, 64);
+    syscheck.scan_hash_limit = getDefine_Int("syscheck", "scan_hash_limit", 0, 64);
+    syscheck.hash_drop_cache = getDefine_Int("syscheck", "hash_drop_cache", 0, 1);
+    syscheck.rt_fanotify = getDefine_Int("syscheck", "rt_fanotify", 0, 1);
+    syscheck.rt_max_watches = getDefine_Int("syscheck", "rt_max_watches", 0, 1048576);
+    syscheck.rt_debounce = getDefine_Int("syscheck", "rt_debounce", 0, 60000);
+    syscheck.rt_debounce_max = getDefine_Int("syscheck", "rt_debounce_max", 0, 600000);
 #endif
     sys_debug_level = getDefine_Int("syscheck", "debug", 0, 2);
 
@@ -59,6 +59,9 @@ typedef struct fim_element {
     int index;
     int configuration;
     int mode;
+    int trust_stat;                     // Reuse the stored hashes of files whose stat data hasn't changed
+    int pooled;                         // Directories are handed to the scan workers
+    const fim_entry_data *saved;        // Stored data of the file being checked, if trust_stat is set
 } fim_element;
 
 typedef struct fim_tmp_file {
@@ -127,6 +130,43 @@ void read_internal(int debug_level);
  */
 void fim_scan();
 
+/**
+ * @brief Start the scan workers, if syscheck.scan_threads is greater than 1
+ *
+ * @return 0 if the workers were started, -1 if scans are sequential
+ */
+int fim_scan_pool_init();
+
+/**
+ * @brief Check if scheduled scans are handed to the scan workers
+ *
+ * @return 1 if the workers are running, 0 otherwise
+ */
+int fim_scan_pool_active();
+
+/**
+ * @brief Hand a directory of a scheduled scan to the scan workers
+ *
+ * @param [in] path Path of the directory
+ * @param [in] item FIM item of the directory
+ * @param [in] report 0 Dont report alert in the scan, otherwise an alert is generated
+ */
+void fim_scan_push(const char *path, const fim_element *item, int report);
+
+/**
+ * @brief Wait until the scan workers have read every directory handed to them
+ */
+void fim_scan_wait();
+
+/**
+ * @brief Get data from file, within the limit of files hashed at the same time
+ *
+ * @param file_name Name of the file to get the data from
+ * @param item FIM item asociated with the file
+ *
+ * @return A fim_entry_data structure with the data from the file
+ */
+fim_entry_data * fim_scan_get_data(const char *file_name, fim_element *item);
 
 /**
  * @brief
@@ -174,6 +214,39 @@ void fim_realtime_event(char *file);
  */
 void fim_whodata_event(whodata_evt *w_evt);
 
+/**
+ * @brief Check a file after a realtime event, without coalescing it
+ *
+ * @param [in] file Path of the file to check
+ */
+void fim_realtime_check(char *file);
+
+/**
+ * @brief Check a file after a whodata event, without coalescing it
+ *
+ * @param w_evt Whodata event
+ */
+void fim_whodata_check(whodata_evt *w_evt);
+
+/**
+ * @brief Start coalescing realtime and whodata events, if enabled
+ *
+ * @return 0 if events are coalesced, -1 if they are checked right away
+ */
+int fim_debounce_init();
+
+/**
+ * @brief Keep an event until its path has been quiet for a while
+ *
+ * A later event of the same path replaces this one, so the last writer is reported.
+ *
+ * @param [in] path Path of the event
+ * @param [in] mode FIM_REALTIME or FIM_WHODATA
+ * @param [in] w_evt Whodata event, or NULL. It's copied
+ * @return 0 if the event was kept, -1 if it must be checked right away
+ */
+int fim_debounce_push(const char *path, fim_event_mode mode, const whodata_evt *w_evt);
+
 /**
  * @brief Process a path that has possibly been deleted
  *
@@ -222,6 +295,16 @@ int fim_check_depth(char *path, int dir_position);
  */
 fim_entry_data * fim_get_data(const char *file_name, fim_element *item);
 
+/**
+ * @brief Check if the stored hashes of a file can be trusted
+ *
+ * @param saved Data stored in the database
+ * @param data Data just taken from the file
+ *
+ * @return 1 if the file has the same stat data and checks, and it wasn't changed while being hashed, 0 otherwise
+ */
+int fim_stat_trusted(const fim_entry_data *saved, const fim_entry_data *data);
+
 /**
  * @brief Initialize a fim_entry_data structure
  *
@@ -337,6 +420,12 @@ int realtime_adddir(const char *dir, int whodata, int followsl) __attribute__((n
  */
 void realtime_process(void);
 
+/**
+ * @brief Process the events of the fanotify filesystem marks
+ *
+ */
+void realtime_process_fanotify(void);
+
 /**
  * @brief Delete data form dir_tb hash table
  *
@@ -352,6 +441,16 @@ void free_syscheck_dirtb_data(char *data);
 
 void delete_subdirectories_watches(char *dir);
 
+/**
+ * @brief Remove a directory from the path index of the inotify watches
+ *
+ * The directory is kept if it's indexed with another watch descriptor.
+ *
+ * @param dir Path of the watched directory
+ * @param wd Watch descriptor of the directory
+ */
+void realtime_watch_unindex(const char *dir, int wd);
+
 /**
  * @brief Count inotify watches
  *
@@ -367,6 +466,45 @@ unsigned int count_watches();
  */
 char *seechanges_addfile(const char *filename) __attribute__((nonnull));
 
+/**
+ * @brief Clear the report_changes snapshot store, and set it up if enabled
+ *
+ * @return 0 if snapshots are kept in the store, -1 otherwise
+ */
+int fim_diff_store_init();
+
+/**
+ * @brief Check whether snapshots are kept in the store
+ *
+ * @return 1 if the store is enabled, 0 otherwise
+ */
+int fim_diff_store_enabled();
+
+/**
+ * @brief Get the snapshot of a file from the store
+ *
+ * @param [in] path Path of the file
+ * @param [out] text Content of the snapshot
+ * @return 0 on success, -1 if there is no snapshot of the file
+ */
+int fim_diff_store_load(const char *path, w_diff_text_t *text);
+
+/**
+ * @brief Replace the snapshot of a file, dropping the least recently used ones past the quota
+ *
+ * @param [in] path Path of the file
+ * @param [in] text New content
+ * @return 0 on success, -1 on error
+ */
+int fim_diff_store_save(const char *path, const w_diff_text_t *text);
+
+/**
+ * @brief Drop the snapshot of a file, if any
+ *
+ * @param [in] path Path of the file
+ */
+void fim_diff_store_remove(const char *path);
+
 /**
  * @brief Frees the memory of a Whodata event structure
  *
@@ -650,6 +788,14 @@ size_t syscom_dispatch(char *command, char **output);
  */
 size_t syscom_getconfig(const char *section, char **output);
 
+/**
+ * @brief Render the metrics of the process
+ *
+ * @param [out] output The metrics, after "ok"
+ * @return Size of the output
+ */
+size_t syscom_getmetrics(char **output);
+
 #ifdef WIN_WHODATA
 /**
  * @brief Updates the SACL of an specific file
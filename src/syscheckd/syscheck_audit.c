@@ -51,6 +51,24 @@ static unsigned int count_reload_retries;
 
 #ifdef ENABLE_AUDIT
 
+#define AUDIT_EVENT_SLOTS 8 // Events being read at the same time
+#define AUDIT_EVENT_TIMEOUT 50 // Milliseconds to wait for more records of an event
+
+typedef struct audit_event_slot {
+    char id[64];                // Serial of the event
+    char * text;                // Records of the event, one per line
+    size_t length;              // 0 if the slot is free
+    long long last;             // Time of the last record, in milliseconds
+} audit_event_slot;
+
+static w_queue_t * audit_queue; // Events waiting for audit_worker(), NULL if the reader parses them
+static char audit_worker_stop[] = "";
+static int audit_worker_running;
+static pthread_mutex_t audit_worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t audit_worker_done = PTHREAD_COND_INITIALIZER;
+
+static void * audit_worker(void * args);
+
 static regex_t regexCompiled_uid;
 static regex_t regexCompiled_pid;
 static regex_t regexCompiled_ppid;
@@ -1180,9 +1198,32 @@ void * audit_main(int *audit_sock) {
 
     minfo(FIM_WHODATA_STARTED);
 
+    if (syscheck.audit_queue_size > 0) {
+        audit_queue = queue_init(syscheck.audit_queue_size);
+        queue_metrics_register(audit_queue, "audit");
+        audit_worker_running = 1;
+        w_create_thread(audit_worker, NULL);
+    }
+
     // Read events
     audit_read_events(audit_sock, READING_MODE);
 
+    // Let the worker parse what was read before the expressions are freed
+    if (audit_queue) {
+        queue_push_ex_block(audit_queue, audit_worker_stop);
+
+        w_mutex_lock(&audit_worker_mutex);
+
+        while (audit_worker_running) {
+            w_cond_wait(&audit_worker_done, &audit_worker_mutex);
+        }
+
+        w_mutex_unlock(&audit_worker_mutex);
+
+        queue_free(audit_queue);
+        audit_queue = NULL;
+    }
+
     // Auditd is not runnig or socket closed.
     mdebug1(FIM_AUDIT_THREAD_STOPED);
     close(*audit_sock);
@@ -1240,31 +1281,98 @@ void * audit_main(int *audit_sock) {
 // LCOV_EXCL_STOP
 
 
+/* Serial of a record, in place: node=... type=CWD msg=audit(1529332881.955:3867): cwd="..." */
+static const char * audit_line_id(const char * line, size_t * length) {
+    const char * begin;
+    const char * end;
+
+    if (begin = strstr(line, "msg=audit("), !begin) {
+        return NULL;
+    }
+
+    begin += 10;
+
+    if (end = strchr(begin, ')'), !end) {
+        return NULL;
+    }
+
+    *length = end - begin;
+    return begin;
+}
+
+static long long audit_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Hand a complete event to the parser and free its slot */
+static void audit_dispatch(audit_event_slot * slot, int mode) {
+    if (slot->length) {
+        if (mode == READING_MODE && audit_queue) {
+            char * event;
+
+            os_malloc(slot->length + 1, event);
+            memcpy(event, slot->text, slot->length + 1);
+            queue_push_ex_block(audit_queue, event);
+        } else {
+            audit_parse(slot->text);
+        }
+    }
+
+    slot->id[0] = '\0';
+    slot->length = 0;
+}
+
+/* Parse the events handed by the reader, so that it keeps draining the socket */
+static void * audit_worker(__attribute__((unused)) void * args) {
+    char * event;
+
+    while (event = queue_pop_ex(audit_queue), event != audit_worker_stop) {
+        audit_parse(event);
+        free(event);
+    }
+
+    w_mutex_lock(&audit_worker_mutex);
+    audit_worker_running = 0;
+    w_cond_signal(&audit_worker_done);
+    w_mutex_unlock(&audit_worker_mutex);
+
+    return NULL;
+}
+
 void audit_read_events(int *audit_sock, int mode) {
     size_t byteRead;
-    char * cache;
-    char * cache_id = NULL;
+    audit_event_slot slots[AUDIT_EVENT_SLOTS];
     char * line;
     char * endline;
-    size_t cache_i = 0;
     size_t buffer_i = 0; // Buffer offset
     size_t len;
     fd_set fdset;
     struct timeval timeout;
     count_reload_retries = 0;
     int conn_retries;
+    int pending = 0;
+    int i;
 
     char *buffer;
     os_malloc(BUF_SIZE * sizeof(char), buffer);
-    os_malloc(BUF_SIZE, cache);
+
+    for (i = 0; i < AUDIT_EVENT_SLOTS; i++) {
+        slots[i].id[0] = '\0';
+        slots[i].length = 0;
+        os_malloc(BUF_SIZE, slots[i].text);
+    }
 
     while ((mode == READING_MODE && audit_thread_active)
        || (mode == HEALTHCHECK_MODE && hc_thread_active)) {
         FD_ZERO(&fdset);
         FD_SET(*audit_sock, &fdset);
 
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
+        // Events without an end record wait a little for the rest of them
+        timeout.tv_sec = pending ? 0 : 1;
+        timeout.tv_usec = pending ? AUDIT_EVENT_TIMEOUT * 1000 : 0;
 
         switch (select(*audit_sock + 1, &fdset, NULL, NULL, &timeout)) {
         case -1:
@@ -1273,12 +1381,12 @@ void audit_read_events(int *audit_sock, int mode) {
             continue;
 
         case 0:
-            if (cache_i) {
-                // Flush cache
-                audit_parse(cache);
-                cache_i = 0;
+            // Flush cache
+            for (i = 0; i < AUDIT_EVENT_SLOTS; i++) {
+                audit_dispatch(&slots[i], mode);
             }
 
+            pending = 0;
             continue;
 
         default:
@@ -1328,32 +1436,61 @@ void audit_read_events(int *audit_sock, int mode) {
         // Get all the lines
         line = buffer;
 
-        char * id;
+        long long now = audit_now();
+        const char * id;
+        size_t id_len;
 
         do {
             *endline = '\0';
 
-            if (id = audit_get_id(line), id) {
-                // If there was cached data and the ID is different, parse cache first
+            if (id = audit_line_id(line, &id_len), id && id_len < sizeof(slots[0].id)) {
+                audit_event_slot * slot = NULL;
+                audit_event_slot * oldest = &slots[0];
+
+                /* The records of several events may be interleaved: each event fills a slot, found by serial */
+                for (i = 0; i < AUDIT_EVENT_SLOTS; i++) {
+                    if (slots[i].length) {
+                        if (strlen(slots[i].id) == id_len && !memcmp(slots[i].id, id, id_len)) {
+                            slot = &slots[i];
+                            break;
+                        }
 
-                if (cache_id && strcmp(cache_id, id) && cache_i) {
-                    audit_parse(cache);
-                    cache_i = 0;
+                        if (oldest->length && slots[i].last < oldest->last) {
+                            oldest = &slots[i];
+                        }
+                    } else if (oldest->length) {
+                        oldest = &slots[i];
+                    }
                 }
 
-                // Append to cache
-                len = endline - line;
-                if (cache_i + len + 1 <= BUF_SIZE) {
-                    strncpy(cache + cache_i, line, len);
-                    cache_i += len;
-                    cache[cache_i++] = '\n';
-                    cache[cache_i] = '\0';
-                } else {
-                    merror(FIM_ERROR_WHODATA_EVENT_TOOLONG);
+                if (!slot) {
+                    // Every slot is taken: the oldest event is complete by now
+                    if (oldest->length) {
+                        audit_dispatch(oldest, mode);
+                    }
+
+                    slot = oldest;
+                    memcpy(slot->id, id, id_len);
+                    slot->id[id_len] = '\0';
                 }
 
-                free(cache_id);
-                cache_id = id;
+                if (strstr(line, "type=EOE ")) {
+                    // End of a multi-record event
+                    audit_dispatch(slot, mode);
+                } else {
+                    // Append to cache
+                    len = endline - line;
+                    if (slot->length + len + 1 < BUF_SIZE) {
+                        memcpy(slot->text + slot->length, line, len);
+                        slot->length += len;
+                        slot->text[slot->length++] = '\n';
+                        slot->text[slot->length] = '\0';
+                    } else {
+                        merror(FIM_ERROR_WHODATA_EVENT_TOOLONG);
+                    }
+
+                    slot->last = now;
+                }
             } else {
                 merror(FIM_ERROR_WHODATA_GETID, line);
             }
@@ -1370,10 +1507,20 @@ void audit_read_events(int *audit_sock, int mode) {
             buffer_i = 0;
         }
 
+        // Events that got no records for a while are complete
+        for (pending = 0, i = 0; i < AUDIT_EVENT_SLOTS; i++) {
+            if (slots[i].length && now - slots[i].last >= AUDIT_EVENT_TIMEOUT) {
+                audit_dispatch(&slots[i], mode);
+            }
+
+            pending |= slots[i].length > 0;
+        }
+    }
+
+    for (i = 0; i < AUDIT_EVENT_SLOTS; i++) {
+        free(slots[i].text);
     }
 
-    free(cache_id);
-    free(cache);
     free(buffer);
 }
 
@@ -54,6 +54,8 @@ size_t syscom_dispatch(char * command, char ** output){
     } else if (strcmp(rcv_comm, "restart") == 0) {
         os_set_restart_syscheck();
         return 0;
+    } else if (strcmp(rcv_comm, "getmetrics") == 0) {
+        return syscom_getmetrics(output);
     } else {
         mdebug1(FIM_SYSCOM_UNRECOGNIZED_COMMAND, rcv_comm);
         os_strdup("err Unrecognized command", *output);
@@ -61,6 +63,17 @@ size_t syscom_dispatch(char * command, char ** output){
     }
 }
 
+size_t syscom_getmetrics(char ** output) {
+    assert(output != NULL);
+
+    char *metrics = w_metrics_render();
+
+    os_strdup("ok", *output);
+    wm_strcat(output, metrics, ' ');
+    free(metrics);
+    return strlen(*output);
+}
+
 size_t syscom_getconfig(const char * section, char ** output) {
     assert(section != NULL);
     assert(output != NULL);
@@ -119,6 +132,8 @@ void * syscom_main(__attribute__((unused)) void * arg) {
     char *response = NULL;
     ssize_t length;
     fd_set fdset;
+    fd_set peers;
+    int maxfd;
 
     mdebug1(FIM_SYSCOM_REQUEST_READY);
 
@@ -127,13 +142,16 @@ void * syscom_main(__attribute__((unused)) void * arg) {
         return NULL;
     }
 
+    FD_ZERO(&peers);
+    maxfd = sock;
+
     while (1) {
 
-        // Wait for socket
-        FD_ZERO(&fdset);
+        // Wait for a new client, or for a request from a client that kept its connection
+        fdset = peers;
         FD_SET(sock, &fdset);
 
-        switch (select(sock + 1, &fdset, NULL, NULL, NULL)) {
+        switch (select(maxfd + 1, &fdset, NULL, NULL, NULL)) {
         case -1:
             if (errno != EINTR) {
                 merror_exit(FIM_CRITICAL_ERROR_SELECT, "syscom_main()", strerror(errno));
@@ -145,45 +163,61 @@ void * syscom_main(__attribute__((unused)) void * arg) {
             continue;
         }
 
-        if (peer = accept(sock, NULL, NULL), peer < 0) {
-            if (errno != EINTR) {
-                merror(FIM_ERROR_SYSCOM_ACCEPT, strerror(errno));
+        if (FD_ISSET(sock, &fdset)) {
+            if (peer = accept(sock, NULL, NULL), peer < 0) {
+                if (errno != EINTR) {
+                    merror(FIM_ERROR_SYSCOM_ACCEPT, strerror(errno));
+                }
+            } else if (peer >= FD_SETSIZE) {
+                merror("At syscom_main(): Too many connections.");
+                close(peer);
+            } else {
+                FD_SET(peer, &peers);
+                maxfd = peer > maxfd ? peer : maxfd;
             }
-
-            continue;
         }
 
-        os_calloc(OS_MAXSTR, sizeof(char), buffer);
-        switch (length = OS_RecvSecureTCP(peer, buffer,OS_MAXSTR), length) {
-        case OS_SOCKTERR:
-            merror(FIM_ERROR_SYSCOM_RECV_TOOLONG);
-            break;
-
-        case -1:
-            merror(FIM_ERROR_SYSCOM_RECV, strerror(errno));
-            break;
-
-        case 0:
-            mdebug1(FIM_SYSCOM_EMPTY_MESSAGE);
-            close(peer);
-            break;
-
-        case OS_MAXLEN:
-            merror(FIM_ERROR_SYSCOM_RECV_MAXLEN, MAX_DYN_STR);
-            close(peer);
-            break;
-
-        default:
-            length = syscom_dispatch(buffer, &response);
-
-            if (length > 0) {
-                OS_SendSecureTCP(peer, length, response);
+        for (peer = 0; peer <= maxfd; peer++) {
+            if (peer == sock || !FD_ISSET(peer, &fdset)) {
+                continue;
             }
-            os_free(response);
 
-            close(peer);
+            os_calloc(OS_MAXSTR, sizeof(char), buffer);
+            switch (length = OS_RecvSecureTCP(peer, buffer,OS_MAXSTR), length) {
+            case OS_SOCKTERR:
+                merror(FIM_ERROR_SYSCOM_RECV_TOOLONG);
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            case -1:
+                merror(FIM_ERROR_SYSCOM_RECV, strerror(errno));
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            case 0:
+                // The client closed the connection
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            case OS_MAXLEN:
+                merror(FIM_ERROR_SYSCOM_RECV_MAXLEN, MAX_DYN_STR);
+                close(peer);
+                FD_CLR(peer, &peers);
+                break;
+
+            default:
+                // Keep the connection open for the next request
+                length = syscom_dispatch(buffer, &response);
+
+                // Answer even if there is nothing to tell, since the client is waiting
+                OS_SendSecureTCP(peer, length, response ? response : "");
+                os_free(response);
+            }
+            free(buffer);
         }
-        free(buffer);
     }
 
     mdebug1(FIM_SYSCOM_THREAD_FINISED);
@@ -12,6 +12,7 @@
 
 #include "shared.h"
 #include "syscheck.h"
+#include "fim_db.h"
 #include "os_crypto/md5/md5_op.h"
 #include "os_crypto/sha1/sha1_op.h"
 #include "os_crypto/md5_sha1/md5_sha1_op.h"
@@ -38,7 +39,11 @@
 #define MAX_VALUE_NAME 16383
 
 /* Global variables */
-HKEY sub_tree;
+static __thread HKEY sub_tree;
+
+/* Next registry entry for the scan workers */
+static int next_entry;
+static pthread_mutex_t next_entry_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 // SQLite Development
 /*
@@ -94,6 +99,39 @@ char *os_winreg_sethkey(char *reg_entry)
     return (ret);
 }
 
+/* Check whether the values of a key are still the ones in the database.
+ * The last write time of a key changes with its values, but is stored in
+ * seconds, so it is only trusted if the values were read at least a second
+ * later: then any new write must have a later second. The entry is marked
+ * as scanned if so.
+ */
+static int os_winreg_unchanged(char *path, FILETIME *file_time)
+{
+    fim_entry *saved;
+    unsigned int mtime;
+    int unchanged;
+
+    if (file_time->dwLowDateTime == 0 && file_time->dwHighDateTime == 0) {
+        return 0;
+    }
+
+    mtime = get_windows_file_time_epoch(*file_time);
+
+    w_mutex_lock(&syscheck.fim_entry_mutex);
+
+    saved = fim_db_get_path(syscheck.database, path);
+    unchanged = saved && saved->data && saved->data->mtime == mtime && (time_t)mtime + 1 < saved->data->last_event;
+
+    if (unchanged) {
+        fim_db_set_scanned(syscheck.database, path);
+    }
+
+    w_mutex_unlock(&syscheck.fim_entry_mutex);
+    free_entry(saved);
+
+    return unchanged;
+}
+
 /* Query the key and get all its values */
 void os_winreg_querykey(HKEY hKey, char *p_key, char *full_key_name, int pos)
 {
@@ -201,7 +239,17 @@ void os_winreg_querykey(HKEY hKey, char *p_key, char *full_key_name, int pos)
     if (value_count) {
         char *mt_data;
         char buffer[OS_SIZE_2048];
-        EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+        char path[MAX_PATH + 7];
+        EVP_MD_CTX *ctx;
+
+        snprintf(path, MAX_PATH + 7, "%s%s", syscheck.registry[pos].arch == ARCH_64BIT ? "[x64] " : "[x32] ", full_key_name);
+
+        /* Values not written since the last scan need no hashing */
+        if (os_winreg_unchanged(path, &file_time)) {
+            return;
+        }
+
+        ctx = EVP_MD_CTX_create();
         EVP_DigestInit(ctx, EVP_sha1());
 
         /* Clear the values for value_size and data_size */
@@ -263,7 +311,6 @@ void os_winreg_querykey(HKEY hKey, char *p_key, char *full_key_name, int pos)
         }
 
         fim_entry_data *data;
-        char path[MAX_PATH + 7];
         unsigned char digest[EVP_MAX_MD_SIZE];
         int result;
         unsigned int digest_size;
@@ -274,7 +321,6 @@ void os_winreg_querykey(HKEY hKey, char *p_key, char *full_key_name, int pos)
         // Set registry entry type
         data->entry_type = FIM_TYPE_REGISTRY;
         data->mode = FIM_SCHEDULED;
-        snprintf(path, MAX_PATH + 7, "%s%s", syscheck.registry[pos].arch == ARCH_64BIT ? "[x64] " : "[x32] ", full_key_name);
         data->last_event = time(NULL);
         data->options |= CHECK_SHA1SUM | CHECK_MTIME;
         data->mtime = get_windows_file_time_epoch(file_time);
@@ -309,38 +355,86 @@ void os_winreg_open_key(char *subkey, char *fullkey_name, int pos)
     return;
 }
 
-void os_winreg_check()
+/* Scan a configured registry entry */
+static void os_winreg_check_entry(int i)
 {
-    int i = 0;
     char *rk;
 
+    /* Ignored entries are zeroed */
+    if (*syscheck.registry[i].entry == '\0') {
+        return;
+    }
+
+    sub_tree = NULL;
+
+    /* Read syscheck registry entry */
+    mdebug2(FIM_READING_REGISTRY, syscheck.registry[i].arch == ARCH_64BIT ? "[x64] " : "[x32] ", syscheck.registry[i].entry);
+
+    rk = os_winreg_sethkey(syscheck.registry[i].entry);
+    if (sub_tree == NULL) {
+        mdebug1(FIM_INV_REG, syscheck.registry[i].entry, syscheck.registry[i].arch == ARCH_64BIT ? "[x64] " : "[x32]");
+        *syscheck.registry[i].entry = '\0';
+        return;
+    }
+
+    os_winreg_open_key(rk, syscheck.registry[i].entry, i);
+}
+
+/* Take configured entries until none is left */
+static DWORD WINAPI os_winreg_check_worker(__attribute__((unused)) LPVOID arg)
+{
+    int i;
+
+    while (1) {
+        w_mutex_lock(&next_entry_mutex);
+        i = syscheck.registry[next_entry].entry != NULL ? next_entry++ : -1;
+        w_mutex_unlock(&next_entry_mutex);
+
+        if (i < 0) {
+            return 0;
+        }
+
+        os_winreg_check_entry(i);
+    }
+}
+
+void os_winreg_check()
+{
+    HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+    int entries = 0;
+    int count;
+    int i;
+
     /* Debug entries */
     mdebug1(FIM_WINREGISTRY_START);
 
-    /* Get sub class and a valid registry entry */
-    while (syscheck.registry[i].entry != NULL) {
-        sub_tree = NULL;
-        rk = NULL;
+    while (syscheck.registry[entries].entry != NULL) {
+        entries++;
+    }
 
-        /* Ignored entries are zeroed */
-        if (*syscheck.registry[i].entry == '\0') {
-            i++;
-            continue;
-        }
+    /* Each configured entry is walked by one thread, up to scan_threads at once */
+    count = syscheck.scan_threads < entries ? syscheck.scan_threads : entries;
 
-        /* Read syscheck registry entry */
-        mdebug2(FIM_READING_REGISTRY, syscheck.registry[i].arch == ARCH_64BIT ? "[x64] " : "[x32] ", syscheck.registry[i].entry);
+    if (count > MAXIMUM_WAIT_OBJECTS) {
+        count = MAXIMUM_WAIT_OBJECTS;
+    }
+
+    if (count <= 1) {
+        for (i = 0; i < entries; i++) {
+            os_winreg_check_entry(i);
+        }
+    } else {
+        next_entry = 0;
 
-        rk = os_winreg_sethkey(syscheck.registry[i].entry);
-        if (sub_tree == NULL) {
-            mdebug1(FIM_INV_REG, syscheck.registry[i].entry, syscheck.registry[i].arch == ARCH_64BIT ? "[x64] " : "[x32]");
-            *syscheck.registry[i].entry = '\0';
-            i++;
-            continue;
+        for (i = 0; i < count; i++) {
+            threads[i] = w_create_thread(NULL, 0, os_winreg_check_worker, NULL, 0, NULL);
         }
 
-        os_winreg_open_key(rk, syscheck.registry[i].entry, i);
-        i++;
+        WaitForMultipleObjects(count, threads, TRUE, INFINITE);
+
+        for (i = 0; i < count; i++) {
+            CloseHandle(threads[i]);
+        }
     }
 
     mdebug1(FIM_WINREGISTRY_ENDED);
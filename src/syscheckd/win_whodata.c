@@ -117,6 +117,7 @@ void restore_sacls();
 int set_privilege(HANDLE hdle, LPCTSTR privilege, int enable);
 int is_valid_sacl(PACL sacl, int is_file);
 unsigned long WINAPI whodata_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, __attribute__((unused)) void *_void, EVT_HANDLE event);
+STATIC int whodata_event_owner(const EVT_VARIANT *buffer, char **user_name, char **process_name, unsigned __int64 *process_id, char **user_id);
 int set_policies();
 void set_subscription_query(wchar_t *query);
 extern int wm_exec(char *command, char **output, int *exitcode, int secs, const char * add_path);
@@ -505,6 +506,54 @@ int restore_audit_policies() {
     return 0;
 }
 
+/*
+ * Only the opening of a handle (4656) carries who opened it; the rest of the
+ * events of the handle are matched by its identifier.
+ */
+STATIC int whodata_event_owner(const EVT_VARIANT *buffer, char **user_name, char **process_name, unsigned __int64 *process_id, char **user_id) {
+    if (buffer[1].Type != EvtVarTypeString) {
+        mwarn(FIM_WHODATA_PARAMETER, buffer[1].Type, "user_name");
+        *user_name = NULL;
+    } else {
+        *user_name = convert_windows_string(buffer[1].XmlVal);
+    }
+
+    if (buffer[3].Type != EvtVarTypeString) {
+        mwarn(FIM_WHODATA_PARAMETER, buffer[3].Type, "process_name");
+        *process_name = NULL;
+    } else {
+        *process_name = convert_windows_string(buffer[3].XmlVal);
+    }
+
+    // In 32-bit Windows we find EvtVarTypeSizeT
+    if (buffer[4].Type != EvtVarTypeHexInt64) {
+        if (buffer[4].Type == EvtVarTypeSizeT) {
+            *process_id = (unsigned __int64) buffer[4].SizeTVal;
+        } else if (buffer[4].Type == EvtVarTypeHexInt32) {
+            *process_id = (unsigned __int64) buffer[4].UInt32Val;
+        } else {
+            mwarn(FIM_WHODATA_PARAMETER, buffer[4].Type, "process_id");
+            *process_id = 0;
+        }
+    } else {
+        *process_id = buffer[4].UInt64Val;
+    }
+
+    if (buffer[7].Type != EvtVarTypeSid) {
+        mwarn(FIM_WHODATA_PARAMETER, buffer[7].Type, "user_id");
+        *user_id = NULL;
+    } else if (!ConvertSidToStringSid(buffer[7].SidVal, user_id)) {
+        if (*user_name) {
+            mdebug1(FIM_WHODATA_INVALID_UID, *user_name);
+        } else {
+            mdebug1(FIM_WHODATA_INVALID_UNKNOWN_UID);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
 unsigned long WINAPI whodata_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, __attribute__((unused)) void *_void, EVT_HANDLE event) {
     unsigned int retval = 1;
     int result;
@@ -516,7 +565,7 @@ unsigned long WINAPI whodata_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, __attr
     char *user_name = NULL;
     char *path = NULL;
     char *process_name = NULL;
-    unsigned __int64 process_id;
+    unsigned __int64 process_id = 0;
     unsigned __int64 handle_id;
     char *user_id = NULL;
     char is_directory;
@@ -574,34 +623,6 @@ unsigned long WINAPI whodata_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, __attr
         }
 
 
-        if (buffer[1].Type != EvtVarTypeString) {
-            mwarn(FIM_WHODATA_PARAMETER, buffer[1].Type, "user_name");
-            user_name = NULL;
-        } else {
-            user_name = convert_windows_string(buffer[1].XmlVal);
-        }
-
-        if (buffer[3].Type != EvtVarTypeString) {
-            mwarn(FIM_WHODATA_PARAMETER, buffer[3].Type, "process_name");
-            process_name = NULL;
-        } else {
-            process_name = convert_windows_string(buffer[3].XmlVal);
-        }
-
-        // In 32-bit Windows we find EvtVarTypeSizeT
-        if (buffer[4].Type != EvtVarTypeHexInt64) {
-            if (buffer[4].Type == EvtVarTypeSizeT) {
-                process_id = (unsigned __int64) buffer[4].SizeTVal;
-            } else if (buffer[4].Type == EvtVarTypeHexInt32) {
-                process_id = (unsigned __int64) buffer[4].UInt32Val;
-            } else {
-                mwarn(FIM_WHODATA_PARAMETER, buffer[4].Type, "process_id");
-                process_id = 0;
-            }
-        } else {
-            process_id = buffer[4].UInt64Val;
-        }
-
         // In 32-bit Windows we find EvtVarTypeSizeT or EvtVarTypeHexInt32
         if (buffer[5].Type != EvtVarTypeHexInt64) {
             if (buffer[5].Type == EvtVarTypeSizeT) {
@@ -627,17 +648,6 @@ unsigned long WINAPI whodata_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, __attr
             mask = buffer[6].UInt32Val;
         }
 
-        if (buffer[7].Type != EvtVarTypeSid) {
-            mwarn(FIM_WHODATA_PARAMETER, buffer[7].Type, "user_id");
-            user_id = NULL;
-        } else if (!ConvertSidToStringSid(buffer[7].SidVal, &user_id)) {
-            if (user_name) {
-                mdebug1(FIM_WHODATA_INVALID_UID, user_name);
-            } else {
-                mdebug1(FIM_WHODATA_INVALID_UNKNOWN_UID);
-            }
-            goto clean;
-        }
         snprintf(hash_id, 21, "%llu", handle_id);
 
 
@@ -666,6 +676,11 @@ unsigned long WINAPI whodata_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, __attr
                     goto clean;
                 }
 
+                // Only the events that are kept pay for the user and process names
+                if (whodata_event_owner(buffer, &user_name, &process_name, &process_id, &user_id)) {
+                    goto clean;
+                }
+
                 int device_type;
 
                 // If it is an existing directory, check_path_type returns 2
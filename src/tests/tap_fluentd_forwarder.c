@@ -164,8 +164,16 @@ int test_check_send() {
     w_assert_int_eq((simple_configuration_defaut_handshake = wm_fluent_handshake(fluent)), 0);
 
     char *msg = "{\"json\":\"message\"}";
-    w_assert_int_ge((simple_configuration_send = wm_fluent_send(fluent,msg,strlen(msg))), 0);
+    msgpack_sbuffer entries;
+    msgpack_packer pk;
+    msgpack_sbuffer_init(&entries);
+    msgpack_packer_init(&pk, &entries, msgpack_sbuffer_write);
+    fluent->object_key = "message";
+    wm_fluent_pack_entry(fluent, &pk, time(NULL), msg, strlen(msg));
 
+    w_assert_int_ge((simple_configuration_send = wm_fluent_send(fluent, entries.data, entries.size, 1)), 0);
+
+    msgpack_sbuffer_destroy(&entries);
     os_free(fluent);
 
     return 1;
@@ -6,6 +6,7 @@
 #include <defs.h>
 
 #include "../os_crypto/blowfish/bf_op.h"
+#include "../os_crypto/aes/aes_op.h"
 #include "../os_crypto/md5/md5_op.h"
 #include "../os_crypto/sha1/sha1_op.h"
 #include "../os_crypto/md5_sha1/md5_sha1_op.h"
@@ -25,6 +26,67 @@ int test_blowfish() {
     return 1;
 }
 
+int test_aes_cache() {
+    const char *key = "0123456789abcdef0123456789abcdef";
+    const char *string = "test string";
+    char buffer1[64];
+    char buffer2[64];
+    char buffer3[64];
+    int length;
+
+    os_aes_cache *cache = OS_AES_CacheNew(key);
+    w_assert_ptr_ne(cache, NULL);
+
+    /* The cached contexts give the same output as a fresh one */
+    length = OS_AES_CacheStr(cache, string, buffer1, strlen(string), OS_ENCRYPT);
+    w_assert_int_eq(length, 16);
+    w_assert_int_eq(OS_AES_Str(string, buffer2, key, strlen(string), OS_ENCRYPT), length);
+    w_assert_int_eq(memcmp(buffer1, buffer2, length), 0);
+
+    /* Twice, to reuse them */
+    w_assert_int_eq(OS_AES_CacheStr(cache, buffer1, buffer3, length, OS_DECRYPT), (int)strlen(string));
+    w_assert_int_eq(OS_AES_CacheStr(cache, buffer1, buffer2, length, OS_DECRYPT), (int)strlen(string));
+    w_assert_int_eq(memcmp(buffer2, string, strlen(string)), 0);
+    w_assert_int_eq(memcmp(buffer3, string, strlen(string)), 0);
+
+    OS_AES_CacheFree(cache);
+    return 1;
+}
+
+int test_aes_gcm() {
+    const char *key = "0123456789abcdef0123456789abcdef";
+    const char *string = "test string";
+    char buffer1[64];
+    char buffer2[64];
+    char buffer3[64];
+    int length;
+
+    os_aes_cache *cache = OS_AES_CacheNew(key);
+    w_assert_ptr_ne(cache, NULL);
+
+    length = OS_AES_GCM_Encrypt(cache, string, strlen(string), buffer1);
+    w_assert_int_eq(length, (int)strlen(string) + OS_AES_GCM_OVERHEAD);
+    w_assert_int_eq(OS_AES_GCM_Decrypt(cache, buffer1, length, buffer2), (int)strlen(string));
+    w_assert_int_eq(memcmp(buffer2, string, strlen(string)), 0);
+
+    /* Each message has its own nonce */
+    w_assert_int_eq(OS_AES_GCM_Encrypt(cache, string, strlen(string), buffer3), length);
+    w_assert_int_ne(memcmp(buffer1, buffer3, OS_AES_GCM_NONCE), 0);
+
+    /* A modified message is rejected */
+    buffer1[OS_AES_GCM_NONCE] ^= 1;
+    w_assert_int_eq(OS_AES_GCM_Decrypt(cache, buffer1, length, buffer2), 0);
+    buffer1[OS_AES_GCM_NONCE] ^= 1;
+    buffer1[length - 1] ^= 1;
+    w_assert_int_eq(OS_AES_GCM_Decrypt(cache, buffer1, length, buffer2), 0);
+
+    /* So is a short one */
+    w_assert_int_eq(OS_AES_GCM_Decrypt(cache, buffer1, OS_AES_GCM_OVERHEAD, buffer2), 0);
+
+    OS_AES_CacheFree(cache);
+    return 1;
+}
+
 int test_md5_string() {
     const char *string = "teststring";
     const char *string_md5 = "d67c5cbf5b01c9f91932e3b8def5e5f8";
@@ -165,6 +227,12 @@ int main(void) {
     // Encrypts and decrypts a string using blowfish algorithm
     TAP_TEST_MSG(test_blowfish(), "Blowfish encryption test.");
 
+    // Encrypts and decrypts a string using the cached AES contexts
+    TAP_TEST_MSG(test_aes_cache(), "AES cached contexts test.");
+
+    // Encrypts, authenticates and decrypts a string using AES-GCM
+    TAP_TEST_MSG(test_aes_gcm(), "AES-GCM encryption test.");
+
     // Encrypts a string using MD5 algorithm
     TAP_TEST_MSG(test_md5_string(), "MD5 encryption test.");
 
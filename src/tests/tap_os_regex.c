@@ -748,6 +748,312 @@ int test_fail_str_starts_with() {
     return 1;
 }
 
+int test_multimatch() {
+
+    int i;
+    int j;
+    const char *patterns[] = {
+        "failed password",
+        "^accepted|session opened$",
+        "he|she|his|hers",
+        "^bin$|^shell$",
+        "ABC",
+        "aaa",
+        NULL
+    };
+    const char *tests[] = {
+        "Failed password for root from 10.0.0.1",
+        "Accepted publickey for user",
+        "pam_unix(sshd:session): session opened",
+        "ushers",
+        "shell",
+        "abc",
+        "xaaax",
+        "aa",
+        "",
+        "nothing to see here",
+        NULL
+    };
+    OSMatch match[6];
+    OSMultiMatch multi;
+
+    OSMultiMatch_Init(&multi);
+
+    for (i = 0; patterns[i] != NULL; i++) {
+        w_assert_int_eq(OSMatch_Compile(patterns[i], &match[i], 0), 1);
+        w_assert_int_eq(OSMultiMatch_AddMatch(&multi, &match[i], i), 1);
+    }
+
+    w_assert_int_eq(OSMultiMatch_Compile(&multi), 1);
+
+    /* Every alternative contains its whole literal, so the automaton finds
+     * the same IDs as long as anchors are not in the way.
+     */
+    for (j = 0; tests[j] != NULL; j++) {
+        uint64_t found = 0;
+
+        OSMultiMatch_Execute(tests[j], strlen(tests[j]), &multi, &found);
+
+        for (i = 0; patterns[i] != NULL; i++) {
+            int expected = OSMatch_Execute(tests[j], strlen(tests[j]), &match[i]);
+
+            if (expected) {
+                w_assert_int_eq((found >> i) & 1, 1);
+            } else if (i != 1 && i != 3) {
+                w_assert_int_eq((found >> i) & 1, 0);
+            }
+        }
+    }
+
+    for (i = 0; patterns[i] != NULL; i++) {
+        OSMatch_FreePattern(&match[i]);
+    }
+
+    OSMultiMatch_FreePattern(&multi);
+    return 1;
+}
+
+int test_multimatch_not_indexable() {
+
+    int i;
+    const char *patterns[] = { "!test", "abc|", "", NULL };
+    OSMatch match;
+    OSMultiMatch multi;
+
+    OSMultiMatch_Init(&multi);
+
+    for (i = 0; patterns[i] != NULL; i++) {
+        w_assert_int_eq(OSMatch_Compile(patterns[i], &match, 0), 1);
+        w_assert_int_eq(OSMultiMatch_AddMatch(&multi, &match, i), 0);
+        OSMatch_FreePattern(&match);
+    }
+
+    w_assert_int_eq(multi.n_literals, 0);
+    w_assert_int_eq(OSMultiMatch_Compile(&multi), 0);
+
+    OSMultiMatch_FreePattern(&multi);
+    return 1;
+}
+
+int test_multimatch_long_input() {
+
+    char str[300];
+    uint64_t found = 0;
+    OSMultiMatch multi;
+
+    /* Literals that start with several nibble combinations */
+    OSMultiMatch_Init(&multi);
+    w_assert_int_eq(OSMultiMatch_Add(&multi, "Zq!", 0), 1);
+    w_assert_int_eq(OSMultiMatch_Add(&multi, "~x", 1), 1);
+    w_assert_int_eq(OSMultiMatch_Add(&multi, "0end", 2), 1);
+    w_assert_int_eq(OSMultiMatch_Compile(&multi), 1);
+
+    memset(str, '.', sizeof(str) - 1);
+    str[sizeof(str) - 1] = '\0';
+    memcpy(str + 17, "zQ!", 3);
+    memcpy(str + sizeof(str) - 5, "0END", 4);
+
+    OSMultiMatch_Execute(str, strlen(str), &multi, &found);
+    w_assert_int_eq(found, 5);
+
+    OSMultiMatch_FreePattern(&multi);
+    return 1;
+}
+
+/* Plain regular expression semantics (see os_regex_dfa.c), by backtracking */
+static int dfa_reference_here(const char *pt, const char *st, int end) {
+
+    while (prts(*pt)) {
+        pt++;
+    }
+
+    if (*pt == '\0') {
+        return !end || *st == '\0';
+    }
+
+    if (*pt == BACKSLASH) {
+        uchar code = (uchar) *(pt + 1);
+
+        if (isPlus(*(pt + 2))) {
+            if (*(pt + 2) == '+') {
+                if (*st == '\0' || !Regex(code, (uchar) *st)) {
+                    return 0;
+                }
+                st++;
+            }
+
+            for (;; st++) {
+                if (dfa_reference_here(pt + 3, st, end)) {
+                    return 1;
+                }
+                if (*st == '\0' || !Regex(code, (uchar) *st)) {
+                    return 0;
+                }
+            }
+        }
+
+        return *st != '\0' && Regex(code, (uchar) *st) && dfa_reference_here(pt + 2, st + 1, end);
+    }
+
+    return *st != '\0' && charmap[(uchar) *st] == (uchar) *pt && dfa_reference_here(pt + 1, st + 1, end);
+}
+
+static int dfa_reference(const OSRegex *reg, const char *str) {
+
+    const char *st;
+    int i;
+
+    for (i = 0; reg->patterns[i]; i++) {
+        for (st = str; ; st++) {
+            if (dfa_reference_here(reg->patterns[i], st, reg->flags[i] & END_SET)) {
+                return 1;
+            }
+            if (*st == '\0' || reg->flags[i] & BEGIN_SET) {
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+int test_dfa_regex() {
+
+    int i;
+    /*
+     * Please note that all strings are \ escaped
+     */
+    const char *tests[][3] = {
+        {"abc|cde", "cde", ""},
+        {"^bin$|^shell$|^ftp$", "ftp", ""},
+        {"^bin$|^shell$", "ashell", ""},
+        {"ABC", "ABc", ""},
+        {"^\\s*\\s lal\\w$", "  lala", ""},
+        {"\\w+\\s+\\w+\\d+\\s$", "a aa11  ", ""},
+        {"test123test\\d+$", "test123test", ""},
+        {"(\\w+)(\\d+)", "1 1", ""},
+        {"123 (\\d+.\\d.\\d.\\d\\d*\\d*)", "123 45.6.5.567", ""},
+        {"^sshd[\\d+]: Accepted \\S+ for (\\S+) from (\\S+) port ", "sshd[21405]: Accepted password for root from 192.1.1.1 port 6023", ""},
+        {"^sshd[\\d+]: Accepted \\S+ for (\\S+) from (\\S+) port ", "sshd[21405]: Failed password for root from 192.1.1.1 port 6023", ""},
+        {"^\\S+ [(\\d+:\\d+:\\d+)] \\.+ (\\d+.\\d+.\\d+.\\d+)\\p*\\d* -> (\\d+.\\d+.\\d+.\\d+)\\p*", "snort: [1:1420:11] SNMP trap tcp [Classification: Attempted Information Leak] [Priority: 2]: {TCP} 10.4.12.26:37020 -> 10.4.10.231:162", ""},
+        {NULL, NULL, NULL}
+    };
+
+    /* The interpreter matches these, but no sub pattern does */
+    const char *quirks[][3] = {
+        {"\\w+\\S\\d", "ab!", ""},
+        {"\\w*\\d\\s*", "a", ""},
+        {NULL, NULL, NULL}
+    };
+
+    for (i = 0; tests[i][0] != NULL; i++) {
+        OSRegex reg;
+        OSRegex reg_dfa;
+        const char *ret;
+        int j;
+
+        w_assert_int_eq(OSRegex_Compile(tests[i][0], &reg, OS_RETURN_SUBSTRING), 1);
+        w_assert_int_eq(OSRegex_Compile(tests[i][0], &reg_dfa, OS_RETURN_SUBSTRING | OS_REGEX_DFA), 1);
+        w_assert_ptr_ne(reg_dfa.dfa, NULL);
+
+        ret = OSRegex_Execute(tests[i][1], &reg);
+        w_assert_ptr_eq((void *)OSRegex_Execute(tests[i][1], &reg_dfa), (void *)ret);
+
+        for (j = 0; ret && reg.d_sub_strings[j]; j++) {
+            w_assert_str_eq(reg_dfa.d_sub_strings[j], reg.d_sub_strings[j]);
+        }
+
+        OSRegex_FreePattern(&reg);
+        OSRegex_FreePattern(&reg_dfa);
+    }
+
+    for (i = 0; quirks[i][0] != NULL; i++) {
+        OSRegex reg;
+
+        w_assert_int_eq(OS_Regex(quirks[i][0], quirks[i][1]), 1);
+        w_assert_int_eq(OSRegex_Compile(quirks[i][0], &reg, OS_REGEX_DFA), 1);
+        w_assert_ptr_eq((void *)OSRegex_Execute(quirks[i][1], &reg), NULL);
+        OSRegex_FreePattern(&reg);
+    }
+    return 1;
+}
+
+/* Random patterns: the automaton must agree with the reference, and
+ * OS_REGEX_DFA must return what the interpreter does when it agrees.
+ */
+int test_dfa_random() {
+
+    static const char *pieces[] = { "a", "b", " ", "\\d", "\\w", "\\s", "\\S", "\\p", "\\.", "\\d+", "\\w+", "\\s*", "\\S+", "\\.*", "(", ")" };
+    static const char chars[] = "ab A1!";
+    char pattern[128];
+    char str[16];
+    int i;
+    int j;
+    int k;
+
+    srandom(1);
+
+    for (i = 0; i < 2000; i++) {
+        OSRegex reg;
+        OSRegex reg_dfa;
+        int n = 1 + random() % 6;
+        int open = 0;
+
+        *pattern = '\0';
+
+        if (random() % 4 == 0) {
+            strcat(pattern, "^");
+        }
+
+        for (k = 0; k < n; k++) {
+            const char *piece = pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+
+            /* One level of balanced parenthesis */
+            if ((*piece == '(' && open) || (*piece == ')' && !open)) {
+                continue;
+            }
+            if (*piece == '(' || *piece == ')') {
+                open = !open;
+            }
+            strcat(pattern, piece);
+
+            if (!open && random() % 8 == 0) {
+                strcat(pattern, random() % 2 ? "|" : "|^");
+            }
+        }
+
+        if (open) {
+            strcat(pattern, ")");
+        }
+
+        if (random() % 4 == 0) {
+            strcat(pattern, "$");
+        }
+
+        w_assert_int_eq(OSRegex_Compile(pattern, &reg, 0), 1);
+        w_assert_int_eq(OSRegex_Compile(pattern, &reg_dfa, OS_REGEX_DFA), 1);
+        w_assert_ptr_ne(reg_dfa.dfa, NULL);
+
+        for (j = 0; j < 50; j++) {
+            int len = random() % (sizeof(str) - 1);
+            const char *expected;
+
+            for (k = 0; k < len; k++) {
+                str[k] = chars[random() % (sizeof(chars) - 1)];
+            }
+            str[len] = '\0';
+
+            w_assert_int_eq(OSRegexDFA_Execute(reg_dfa.dfa, str), dfa_reference(&reg, str));
+
+            expected = dfa_reference(&reg, str) ? OSRegex_Execute(str, &reg) : NULL;
+            w_assert_ptr_eq((void *)OSRegex_Execute(str, &reg_dfa), (void *)expected);
+        }
+
+        OSRegex_FreePattern(&reg);
+        OSRegex_FreePattern(&reg_dfa);
+    }
+    return 1;
+}
+
 void *test_no_rc_exec_thread(__attribute__((unused)) void *regex){
     pthread_barrier_wait (&barrier);
     OSRegex_Execute_ex("Pattern", (OSRegex *) regex, NULL);
@@ -781,6 +1087,76 @@ end:
     return 1;
 }
 
+void *test_reentrant_exec_thread(void *regex){
+    regex_matching match;
+    char str[64];
+    int i;
+    int *result;
+
+    result = calloc(1, sizeof(int));
+    memset(&match, 0, sizeof(regex_matching));
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(str, sizeof(str), "user u%d from 10.0.0.%d", i, i % 256);
+
+        if (!OSRegex_Execute_ex(str, (OSRegex *) regex, &match) || !match.sub_strings[0] || !match.sub_strings[1]) {
+            *result = 1;
+            break;
+        }
+
+        if (atoi(match.sub_strings[0] + 1) != i || atoi(strrchr(match.sub_strings[1], '.') + 1) != i % 256) {
+            *result = 1;
+            break;
+        }
+    }
+
+    for (i = 0; match.sub_strings[i]; i++) {
+        free(match.sub_strings[i]);
+    }
+
+    free(match.sub_strings);
+
+    for (i = 0; match.d_size.prts_str_size && match.d_size.prts_str_size[i]; i++) {
+        free(match.prts_str[i]);
+    }
+
+    free(match.prts_str);
+    free(match.d_size.prts_str_size);
+    return result;
+}
+
+int test_reentrant_execute() {
+    int i;
+    int error;
+    void *result;
+    pthread_t threads[MAX_TEST_THREADS];
+    OSRegex regex;
+
+    if ((error = !OSRegex_Compile("user (\\S+) from (\\S+)$", &regex, OS_RETURN_SUBSTRING))) {
+        goto end;
+    }
+
+    pthread_barrier_init (&barrier, NULL, MAX_TEST_THREADS);
+
+    for (i = 0; i < MAX_TEST_THREADS; i++) {
+        if (error = CreateThreadJoinable(&threads[i], test_reentrant_exec_thread, &regex), error) {
+            goto end;
+        }
+    }
+
+    for (i = 0; i < MAX_TEST_THREADS; i++) {
+        pthread_join(threads[i], &result);
+        error |= *(int *)result;
+        free(result);
+    }
+
+    OSRegex_FreePattern(&regex);
+end:
+    w_assert_int_eq(error, 0);
+    return 1;
+}
+
 int main(void) {
     printf("\n\n    STARTING TEST - OS_REGEX   \n\n");
 
@@ -877,6 +1253,24 @@ int main(void) {
     // There is no race condition in OSRegex_Execute_ex
     TAP_TEST_MSG(test_no_rc_execute(), "There is no race condition in OSRegex_Execute_ex().");
 
+    // Threads with their own regex_matching share a compiled OSRegex
+    TAP_TEST_MSG(test_reentrant_execute(), "OSRegex_Execute_ex() is reentrant with external regex_matching.");
+
+    // Find many literals at once using OSMultiMatch
+    TAP_TEST_MSG(test_multimatch(), "Finding literals using OSMultiMatch_Execute test.");
+
+    // Patterns without mandatory literals are rejected by OSMultiMatch
+    TAP_TEST_MSG(test_multimatch_not_indexable(), "Rejecting patterns without mandatory literal in OSMultiMatch test.");
+
+    // OSMultiMatch skips long runs of bytes that don't start a literal
+    TAP_TEST_MSG(test_multimatch_long_input(), "OSMultiMatch_Execute on long strings test.");
+
+    // The automaton of OS_REGEX_DFA only discards strings
+    TAP_TEST_MSG(test_dfa_regex(), "Matching regex with OS_REGEX_DFA test.");
+
+    // The automaton recognizes the language of the sub patterns
+    TAP_TEST_MSG(test_dfa_random(), "OSRegexDFA_Execute on random patterns test.");
+
     TAP_PLAN;
     int r = tap_summary();
     printf("\n    ENDING TEST  - OS_REGEX   \n\n");
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <dirent.h>
 
 #include "../os_xml/os_xml.h"
 #include "../os_xml/os_xml_internal.h"
@@ -872,6 +874,365 @@ int test_node_attribute_value_overflow() {
     return 1;
 }
 
+static int stream_start(xml_node *node, unsigned int depth, void *data) {
+    char *buffer = data;
+    int i;
+
+    snprintf(buffer + strlen(buffer), 6144 - strlen(buffer), "%u<%s", depth, node->element);
+
+    for (i = 0; node->attributes && node->attributes[i]; i++) {
+        snprintf(buffer + strlen(buffer), 6144 - strlen(buffer), " %s=\"%s\"", node->attributes[i], node->values[i]);
+    }
+
+    strcat(buffer, ">");
+    return 0;
+}
+
+static int stream_end(xml_node *node, __attribute__((unused)) unsigned int depth, void *data) {
+    char *buffer = data;
+
+    snprintf(buffer + strlen(buffer), 6144 - strlen(buffer), "%s</%s>", node->content, node->element);
+    return strcmp(node->element, "stop") == 0 ? -1 : 0;
+}
+
+int assert_os_xml_stream_eq(const char *parse_str, const char *events) {
+    static const OS_XML_HANDLER handler = { stream_start, stream_end };
+    char xml_file_name[256];
+    char buffer[6144] = "";
+    OS_XML xml;
+
+    create_xml_file(parse_str, xml_file_name, 256);
+    w_assert_int_eq(OS_ReadXMLStream(xml_file_name, &xml, &handler, buffer), 0);
+    unlink(xml_file_name);
+    w_assert_str_eq(buffer, events);
+    return 1;
+}
+
+int assert_os_xml_stream_err(const char *parse_str, const char *err) {
+    static const OS_XML_HANDLER handler = { stream_start, stream_end };
+    char xml_file_name[256];
+    char buffer[6144] = "";
+    OS_XML xml;
+
+    create_xml_file(parse_str, xml_file_name, 256);
+    w_assert_int_eq(OS_ReadXMLStream(xml_file_name, &xml, &handler, buffer), -1);
+    unlink(xml_file_name);
+    w_assert_str_eq(xml.err, err);
+    return 1;
+}
+
+int test_os_read_xml_stream() {
+    if (!assert_os_xml_stream_eq("", "")) return 0;
+    if (!assert_os_xml_stream_eq(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<root attr1=\"test\" attr2='1'>\n"
+        "<!--comment-->"
+        "<child>value1</child>"
+        "<child2/>"
+        "<child3 attr=\"1\" />"
+        "value2"
+        "</root>",
+        "0<root attr1=\"test\" attr2=\"1\">"
+        "1<child>value1</child>"
+        "1<child2></child2>"
+        "1<child3 attr=\"1\"></child3>"
+        "value2</root>")) return 0;
+
+    return 1;
+}
+
+int test_os_read_xml_stream_failures() {
+    static const OS_XML_HANDLER handler = { stream_start, stream_end };
+    char buffer[6144] = "";
+    OS_XML xml;
+
+    w_assert_int_eq(OS_ReadXMLStream("/tmp/non-existing-file.xml", &xml, &handler, buffer), -2);
+    w_assert_str_eq(xml.err, "XMLERR: File '/tmp/non-existing-file.xml' not found.");
+
+    if (!assert_os_xml_stream_err("<root>", "XMLERR: End of file and some elements were not closed.")) return 0;
+    if (!assert_os_xml_stream_err("<root></root2>", "XMLERR: Element 'root' not closed.")) return 0;
+    if (!assert_os_xml_stream_err("</root>", "XMLERR: Element not opened.")) return 0;
+    if (!assert_os_xml_stream_err("<root attr=\"1\" attr=\"2\"/>", "XMLERR: Attribute 'attr' already defined.")) return 0;
+    if (!assert_os_xml_stream_err("<root attr></root>", "XMLERR: Attribute 'attr' has no value.")) return 0;
+    if (!assert_os_xml_stream_err("<root><!--comment</root>", "XMLERR: Comment not closed.")) return 0;
+
+    // Stopped by the handler
+    if (!assert_os_xml_stream_err("<root><stop/><child/></root>", "")) return 0;
+
+    return 1;
+}
+
+/* Compare two lists of nodes, the second one got through a cursor */
+static int assert_os_xml_nodes_eq(XML_NODE expected, XML_NODE node) {
+    int i, j;
+
+    if (!expected || !node) {
+        w_assert_ptr_eq(expected, node);
+        return 1;
+    }
+
+    for (i = 0; expected[i]; i++) {
+        w_assert_ptr_ne(node[i], NULL);
+        w_assert_uint_eq(expected[i]->key, node[i]->key);
+        w_assert_str_eq(expected[i]->element, node[i]->element);
+
+        if (expected[i]->content) {
+            w_assert_str_eq(expected[i]->content, node[i]->content);
+        } else {
+            w_assert_ptr_eq(node[i]->content, NULL);
+        }
+
+        if (!expected[i]->attributes) {
+            w_assert_ptr_eq(node[i]->attributes, NULL);
+            w_assert_ptr_eq(node[i]->values, NULL);
+            continue;
+        }
+
+        for (j = 0; expected[i]->attributes[j]; j++) {
+            w_assert_str_eq(expected[i]->attributes[j], node[i]->attributes[j]);
+            w_assert_str_eq(expected[i]->values[j], node[i]->values[j]);
+        }
+
+        w_assert_ptr_eq(node[i]->attributes[j], NULL);
+        w_assert_ptr_eq(node[i]->values[j], NULL);
+    }
+
+    w_assert_ptr_eq(node[i], NULL);
+    return 1;
+}
+
+int test_os_cursor_get_elements() {
+    OS_XML xml;
+    xml_cursor root_cursor;
+    xml_cursor child_cursor;
+    XML_NODE expected;
+    XML_NODE root;
+    XML_NODE child;
+    int i;
+
+    w_assert_int_eq(OS_ReadXMLString(
+        "<root a=\"1\" b=\"2\"><child1 c=\"3\">value1</child1><child2/><child3><leaf>v</leaf></child3></root>"
+        "<root2>value2</root2>", &xml), 0);
+
+    OS_CursorInit(&root_cursor, &xml);
+    OS_CursorInit(&child_cursor, &xml);
+
+    expected = OS_GetElementsbyNode(&xml, NULL);
+    root = OS_CursorGetElements(&root_cursor, NULL);
+    if (!assert_os_xml_nodes_eq(expected, root)) return 0;
+    OS_ClearNode(expected);
+
+    for (i = 0; root[i]; i++) {
+        expected = OS_GetElementsbyNode(&xml, root[i]);
+        child = OS_CursorGetElements(&child_cursor, root[i]);
+        if (!assert_os_xml_nodes_eq(expected, child)) return 0;
+        OS_ClearNode(expected);
+    }
+
+    // The buffers of the cursor are reused
+    w_assert_ptr_eq(OS_CursorGetElements(&child_cursor, root[1]), NULL);
+    w_assert_ptr_ne(child = OS_CursorGetElements(&child_cursor, root[0]), NULL);
+    w_assert_str_eq(child[2]->element, "child3");
+    w_assert_ptr_ne(child = OS_CursorGetElements(&child_cursor, child[2]), NULL);
+    w_assert_str_eq(child[0]->content, "v");
+
+    OS_CursorClear(&child_cursor);
+    OS_CursorClear(&root_cursor);
+    OS_ClearXML(&xml);
+    return 1;
+}
+
+/* Path of the only snapshot in a cache directory */
+static int find_snapshot(const char *cache_dir, char *path, size_t size) {
+    struct dirent *entry;
+    DIR *dir;
+    int found = 0;
+
+    if (dir = opendir(cache_dir), !dir) {
+        return 0;
+    }
+
+    while (entry = readdir(dir), entry) {
+        if (entry->d_name[0] != '.') {
+            snprintf(path, size, "%s/%s", cache_dir, entry->d_name);
+            found++;
+        }
+    }
+
+    closedir(dir);
+    return found == 1;
+}
+
+static size_t read_snapshot(const char *path, char *buffer, size_t size) {
+    FILE *fp = fopen(path, "r");
+    size_t length;
+
+    if (!fp) {
+        return 0;
+    }
+
+    length = fread(buffer, 1, size, fp);
+    fclose(fp);
+    return length;
+}
+
+static int write_snapshot(const char *path, const char *buffer, size_t length) {
+    FILE *fp = fopen(path, "w");
+    int retval;
+
+    if (!fp) {
+        return 0;
+    }
+
+    retval = fwrite(buffer, 1, length, fp) == length;
+    fclose(fp);
+    return retval;
+}
+
+/* Mark the content of a snapshot, so reading it back tells whether it was used */
+static int tamper_snapshot(char *buffer, size_t length) {
+    char *value = memmem(buffer, length, "value", 5);
+
+    if (!value) {
+        return 0;
+    }
+
+    memcpy(value, "VALUE", 5);
+    return 1;
+}
+
+static int rewrite_source(const char *file_name, const char *str) {
+    return write_snapshot(file_name, str, strlen(str));
+}
+
+int test_os_read_xml_cached() {
+    char cache_dir[] = "/tmp/tmp_cache-XXXXXX";
+    char file_name[256];
+    char snapshot[512];
+    char buffer[1024];
+    size_t length;
+    size_t saved;
+    OS_XML xml;
+
+    w_assert_ptr_ne(mkdtemp(cache_dir), NULL);
+    create_xml_file("<root><node a=\"1\">value</node><other/></root>", file_name, sizeof(file_name));
+
+    // The first read parses the file and writes the snapshot
+    w_assert_int_eq(OS_ReadXMLCached(file_name, &xml, cache_dir), 0);
+    w_assert_str_eq(xml.ct[1], "value");
+    OS_ClearXML(&xml);
+    w_assert_int_eq(find_snapshot(cache_dir, snapshot, sizeof(snapshot)), 1);
+    w_assert_uint_ne(saved = read_snapshot(snapshot, buffer, sizeof(buffer)), 0);
+
+    // A matching snapshot is used
+    w_assert_int_eq(tamper_snapshot(buffer, saved), 1);
+    w_assert_int_eq(write_snapshot(snapshot, buffer, saved), 1);
+    w_assert_int_eq(OS_ReadXMLCached(file_name, &xml, cache_dir), 0);
+    w_assert_str_eq(xml.ct[1], "VALUE");
+    w_assert_uint_eq(xml.cur, 4);
+    w_assert_str_eq(xml.el[2], "a");
+    w_assert_str_eq(xml.ct[2], "1");
+    OS_ClearXML(&xml);
+
+    // Stale: the source changed with the same size
+    w_assert_int_eq(rewrite_source(file_name, "<root><node a=\"2\">value</node><other/></root>"), 1);
+    w_assert_int_eq(OS_ReadXMLCached(file_name, &xml, cache_dir), 0);
+    w_assert_str_eq(xml.ct[1], "value");
+    w_assert_str_eq(xml.ct[2], "2");
+    OS_ClearXML(&xml);
+
+    // Stale: the source changed its size
+    w_assert_int_eq(read_snapshot(snapshot, buffer, sizeof(buffer)) == saved, 1);
+    w_assert_int_eq(tamper_snapshot(buffer, saved), 1);
+    w_assert_int_eq(write_snapshot(snapshot, buffer, saved), 1);
+    w_assert_int_eq(rewrite_source(file_name, "<root><node a=\"2\">value</node><other>x</other></root>"), 1);
+    w_assert_int_eq(OS_ReadXMLCached(file_name, &xml, cache_dir), 0);
+    w_assert_str_eq(xml.ct[1], "value");
+    w_assert_str_eq(xml.ct[3], "x");
+    OS_ClearXML(&xml);
+
+    // Truncated: parsed again, and the snapshot is written whole
+    w_assert_uint_ne(saved = read_snapshot(snapshot, buffer, sizeof(buffer)), 0);
+    w_assert_int_eq(tamper_snapshot(buffer, saved), 1);
+    w_assert_int_eq(write_snapshot(snapshot, buffer, saved - 3), 1);
+    w_assert_int_eq(OS_ReadXMLCached(file_name, &xml, cache_dir), 0);
+    w_assert_str_eq(xml.ct[1], "value");
+    OS_ClearXML(&xml);
+    w_assert_uint_eq(read_snapshot(snapshot, buffer, sizeof(buffer)), saved);
+
+    // Wrong magic: parsed again, and the snapshot is replaced
+    w_assert_int_eq(tamper_snapshot(buffer, saved), 1);
+    buffer[0] ^= 0xff;
+    w_assert_int_eq(write_snapshot(snapshot, buffer, saved), 1);
+    w_assert_int_eq(OS_ReadXMLCached(file_name, &xml, cache_dir), 0);
+    w_assert_str_eq(xml.ct[1], "value");
+    OS_ClearXML(&xml);
+    length = read_snapshot(snapshot, buffer, sizeof(buffer));
+    w_assert_uint_eq(length, saved);
+    w_assert_ptr_ne(memmem(buffer, length, "value", 5), NULL);
+
+    unlink(snapshot);
+    rmdir(cache_dir);
+    unlink(file_name);
+    return 1;
+}
+
+/* Parse a rule set like the ones loaded at startup, from a file and from a string */
+int test_os_read_xml_benchmark() {
+    const unsigned int rules = 20000;
+    const unsigned int rounds = 10;
+    char file_name[256];
+    struct timespec t0, t1;
+    double elapsed;
+    size_t length = 0;
+    unsigned int i;
+    char *str;
+    OS_XML xml;
+
+    str = malloc(rules * 256 + 64);
+    w_assert_ptr_ne(str, NULL);
+
+    length += sprintf(str + length, "<var name=\"LEVEL\">5</var><group name=\"bench,\">");
+
+    for (i = 0; i < rules; i++) {
+        length += sprintf(str + length, "<rule id=\"%u\" level=\"3\"><if_sid>530</if_sid>"
+                          "<match>ossec: output: 'df -P'</match><description>Rule %u: $LEVEL</description></rule>", 100000 + i, i);
+    }
+
+    length += sprintf(str + length, "</group>");
+    create_xml_file(str, file_name, sizeof(file_name));
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (i = 0; i < rounds; i++) {
+        w_assert_int_eq(OS_ReadXML(file_name, &xml), 0);
+        w_assert_int_eq(OS_ApplyVariables(&xml), 0);
+        w_assert_uint_eq(xml.cur, 4 + rules * 6);
+        w_assert_str_eq(xml.ct[xml.cur - 1], "Rule 19999: 5");
+        OS_ClearXML(&xml);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("    OS_ReadXML: %u rules in %.3f ms\n", rules, elapsed * 1000 / rounds);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (i = 0; i < rounds; i++) {
+        w_assert_int_eq(OS_ReadXMLString(str, &xml), 0);
+        w_assert_uint_eq(xml.cur, 4 + rules * 6);
+        OS_ClearXML(&xml);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("    OS_ReadXMLString: %u rules in %.3f ms\n", rules, elapsed * 1000 / rounds);
+
+    unlink(file_name);
+    free(str);
+    return 1;
+}
+
 int main(void) {
 
     printf("\n\n   STARTING TEST - OS_XML   \n\n");
@@ -1005,6 +1366,20 @@ int main(void) {
     // Node attribute value inside XML overflow test
     TAP_TEST_MSG(test_node_attribute_value_overflow(), "Node attribute value inside XML overflow test.");
 
+    // OS_ReadXMLStream test
+    TAP_TEST_MSG(test_os_read_xml_stream(), "OS_ReadXMLStream test.");
+
+    // OS_ReadXMLStream failures test
+    TAP_TEST_MSG(test_os_read_xml_stream_failures(), "OS_ReadXMLStream failures test.");
+
+    // OS_CursorGetElements test
+    TAP_TEST_MSG(test_os_cursor_get_elements(), "OS_CursorGetElements test.");
+
+    // OS_ReadXML and OS_ReadXMLString benchmark
+    TAP_TEST_MSG(test_os_read_xml_cached(), "OS_ReadXMLCached snapshots test.");
+
+    TAP_TEST_MSG(test_os_read_xml_benchmark(), "OS_ReadXML benchmark.");
+
     TAP_PLAN;
     int r = tap_summary();
     printf("\n   ENDING TEST  - OS_XML   \n\n");
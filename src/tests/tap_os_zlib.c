@@ -39,6 +39,30 @@ int test_success_compress_special_string() {
     return 1;
 }
 
+int test_success_compress_several() {
+    char buffer[BUFFER_LENGTH];
+    char buffer2[BUFFER_LENGTH];
+    const char *strings[] = { TEST_STRING_1, TEST_STRING_2, TEST_STRING_1 };
+    unsigned long int i1;
+    unsigned long int i2;
+    int i;
+
+    // The streams of the thread are reused between messages and levels
+    for (i = 0; i < 3; i++) {
+        os_zlib_set_level(i == 2 ? 1 : OS_ZLIB_LEVEL);
+
+        i1 = os_zlib_compress(strings[i], buffer, strlen(strings[i]), BUFFER_LENGTH);
+        w_assert_uint_ne(i1, 0);
+
+        i2 = os_zlib_uncompress(buffer, buffer2, i1, BUFFER_LENGTH);
+        w_assert_uint_eq(i2, strlen(strings[i]));
+        w_assert_str_eq(buffer2, strings[i]);
+    }
+
+    os_zlib_set_level(OS_ZLIB_LEVEL);
+    return 1;
+}
+
 int test_fail_compress_null_src() {
     char buffer[BUFFER_LENGTH];
     unsigned long int i1 = os_zlib_compress(NULL, buffer, strlen(TEST_STRING_1), BUFFER_LENGTH);
@@ -112,6 +136,9 @@ int main(void) {
     // Compress and uncompress a regular string with \n, \t and \r test
     TAP_TEST_MSG(test_success_compress_special_string(), "Compress and uncompress a regular string with '\\n', '\\t' and '\\r' test.");
 
+    // Compress and uncompress several strings in a row
+    TAP_TEST_MSG(test_success_compress_several(), "Compress and uncompress several strings in a row.");
+
     // Try to compress using NULL as source
     TAP_TEST_MSG(test_fail_compress_null_src(), "Try to compress using ((void *)0) as source.");
 
@@ -50,6 +50,24 @@ int test_utf8_random(bool replacement) {
     return r;
 }
 
+int test_utf8_filter_invalid() {
+    char * copy;
+
+    /* Valid strings are not copied */
+    w_assert_ptr_eq(w_utf8_filter_invalid("Plain ASCII log line, long enough to fill a few vector blocks", true), NULL);
+    w_assert_ptr_eq(w_utf8_filter_invalid("Caf\xC3\xA9 \xE2\x82\xAC \xF1\x80\x80\x80", false), NULL);
+
+    w_assert_ptr_ne(copy = w_utf8_filter_invalid("Invalid \xFF byte in a long ASCII line", false), NULL);
+    w_assert_str_eq(copy, "Invalid  byte in a long ASCII line");
+    free(copy);
+
+    w_assert_ptr_ne(copy = w_utf8_filter_invalid("\xC0\xAF", true), NULL);
+    w_assert_str_eq(copy, "\xEF\xBF\xBD\xEF\xBF\xBD");
+    free(copy);
+
+    return 1;
+}
+
 static int compare(const struct statfs * statfs) {
     for (int i = 0; network_file_systems[i].name; i++) {
         if (network_file_systems[i].f_type == statfs->f_type) {
@@ -158,6 +176,80 @@ int test_log_builder() {
     return retval;
 }
 
+int test_log_template() {
+    const char * PATTERN = "$(bad)[$(location)] $(json_escaped_log) $(log";
+    const char * LOG = "Hello \"World\"";
+    const char * LOCATION = "test";
+    const char * EXPECTED_OUTPUT = "[test] Hello \\\"World\\\" $(log";
+
+    int retval = 1;
+    char output[64];
+    log_builder_t * builder = log_builder_init(false);
+    log_template_t * tmpl = log_builder_compile(PATTERN);
+
+    if (log_builder_render(builder, tmpl, LOG, LOCATION, output, sizeof(output)) != strlen(EXPECTED_OUTPUT) || strcmp(output, EXPECTED_OUTPUT) != 0) {
+        retval = 0;
+    }
+
+    // The log doesn't fit: it's written as is, truncated
+    if (log_builder_render(builder, tmpl, LOG, LOCATION, output, 8) != 7 || strcmp(output, "Hello \"") != 0) {
+        retval = 0;
+    }
+
+    log_template_free(tmpl);
+    log_builder_destroy(builder);
+    return retval;
+}
+
+int test_json_scan_object() {
+    const char * VALID = " {\"a\": [1, -2.5e3, true, null, {}], \"b\": \"\\u00e9\\\"\"} tail";
+    const char * INVALID[] = { "[1]", "{\"a\":}", "{\"a\":1,}", "{\"a\":\"\\x\"}", "{\"a\":\"\\udc00\"}", "{\"a\":+1}", "{\"a\":1", NULL };
+    const char * begin;
+    const char * end;
+    int i;
+
+    if (end = json_scan_object(VALID, &begin, NULL, NULL), !end || begin != VALID + 1 || strcmp(end, " tail") != 0) {
+        return 0;
+    }
+
+    for (i = 0; INVALID[i]; i++) {
+        if (json_scan_object(INVALID[i], NULL, NULL, NULL)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int test_json_scan_member() {
+    const char * JSON = "{\"type\": \"event\", \"dat\": 1, \"data\": {\"path\": \"/a\"} , \"data\": 2}";
+    const char * DATA = "{\"path\": \"/a\"}";
+    const char * value;
+    size_t length;
+
+    if (value = json_scan_member(JSON, "data", &length), !value || length != strlen(DATA) || strncmp(value, DATA, length) != 0) {
+        return 0;
+    }
+
+    return !json_scan_member(JSON, "path", &length) && !json_scan_member("{\"data\": }", "data", &length);
+}
+
+int test_winevt_render() {
+    const char * EVENT = "\"<Event xmlns='x'><System><Provider Name='P'/><EventID>4719</EventID><Level>0</Level><Keywords>0x8020000000000000</Keywords><Correlation/></System>"
+                         "<EventData><Data Name='CategoryId'>%%8274</Data><Data Name='SubcategoryId'>%%12801</Data><Data>a</Data><Data>b </Data></EventData></Event>\"";
+    const char * EXPECTED = "{\"win\":{\"system\":{\"providerName\":\"P\",\"eventID\":\"4719\",\"level\":\"0\",\"keywords\":\"0x8020000000000000\",\"severityValue\":\"AUDIT_SUCCESS\",\"message\":\"\\\"m\\\"\"},"
+                            "\"eventdata\":{\"categoryId\":\"%%8274\",\"subcategoryId\":\"%%12801\",\"category\":\"Object Access\",\"subcategory\":\"Registry\",\"data\":\"a, b\"}}}";
+    const char * COMMENT = "\"<Event><!-- OS_XML --><System/></Event>\"";
+    w_json_writer_t writer = { NULL, 0, 0 };
+    int retval;
+
+    retval = w_winevt_render(EVENT, strlen(EVENT), "\"m\"", &writer) == 0 && strcmp(w_json_writer_str(&writer), EXPECTED) == 0;
+    retval = retval && w_winevt_render(COMMENT, strlen(COMMENT), NULL, &writer) == -1;
+
+    w_json_writer_free(&writer);
+    return retval;
+}
+
 int test_get_file_content() {
     int max_size = 100;
     const char * expected = "{\n"
@@ -205,6 +297,105 @@ int test_get_file_content() {
     return 1;
 }
 
+/* Byte-at-a-time versions of the string scanners, as a reference */
+static char * ref_wstr_chr(char * str, int character) {
+    char escaped = 0;
+
+    for (;*str != '\0'; str++) {
+        if (!escaped) {
+            if (*str == character) {
+                return str;
+            }
+            if (*str == '\\') {
+                escaped = 1;
+            }
+        } else {
+            escaped = 0;
+        }
+    }
+
+    return NULL;
+}
+
+static size_t ref_escape_json(const char * string, char * output) {
+    size_t j = 0;
+
+    for (; *string; string++) {
+        const char * reserved = strchr("\b\t\n\f\r\"\\", *string);
+
+        if (reserved) {
+            output[j++] = '\\';
+            output[j++] = "btnfr\"\\"[reserved - "\b\t\n\f\r\"\\"];
+        } else {
+            output[j++] = *string;
+        }
+    }
+
+    output[j] = '\0';
+    return j;
+}
+
+static double elapsed_ms(const struct timespec * t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/* Compare the string scanners with the byte loops on real log lines */
+int test_string_scan_benchmark() {
+    const char * LOGS[] = {
+        "Dec 19 17:20:08 User-PC sshd[18345]: Accepted publickey for root from 192.168.1.120 port 53620 ssh2: RSA SHA256:O7TwlhGvwLJfZyWR8Z6UG3D2E4Qz0GT5Vc9sQ8Hq",
+        "2020/03/10 12:06:55 ossec-syscheckd: INFO: (6009): File integrity monitoring scan ended. \"/etc/passwd\" checksum changed from '7e2f' to 'a1b3'",
+        "{\"win\":{\"system\":{\"providerName\":\"Microsoft-Windows-Security-Auditing\",\"eventID\":\"4625\",\"message\":\"\\\"An account failed to log on.\\r\\n\\r\\nSubject:\\r\\n\\tSecurity ID:\\t\\tS-1-0-0\\\"\"}}}",
+        "192.168.2.190 - - [18/Jan/2020:07:54:56 +0100] \"GET /index.php?option=com_content&view=article&id=1 HTTP/1.1\" 200 12453 \"-\" \"Mozilla/5.0 (X11; Linux x86_64)\"",
+        NULL
+    };
+    const int ROUNDS = 200000;
+    char output[1024];
+    struct timespec t0;
+    double t_ref, t_new;
+    int i, j;
+
+    for (i = 0; LOGS[i]; i++) {
+        char * line = strdup(LOGS[i]);
+        char * escaped = wstr_escape_json(line);
+        char * stripped = os_strip_char(line, '"');
+
+        ref_escape_json(line, output);
+        w_assert_str_eq(escaped, output);
+        w_assert_ptr_eq(wstr_chr(line, '"'), ref_wstr_chr(line, '"'));
+        w_assert_ptr_eq(strchr(stripped, '"'), NULL);
+
+        free(escaped);
+        free(stripped);
+        free(line);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (j = 0; j < ROUNDS; j++) {
+        for (i = 0; LOGS[i]; i++) {
+            ref_escape_json(LOGS[i], output);
+            ref_wstr_chr((char *)LOGS[i], '#');
+        }
+    }
+
+    t_ref = elapsed_ms(&t0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (j = 0; j < ROUNDS; j++) {
+        for (i = 0; LOGS[i]; i++) {
+            free(wstr_escape_json(LOGS[i]));
+            wstr_chr((char *)LOGS[i], '#');
+        }
+    }
+
+    t_new = elapsed_ms(&t0);
+    printf("    wstr_escape_json + wstr_chr: %.1f ms (byte loops: %.1f ms)\n", t_new, t_ref);
+
+    return 1;
+}
+
 int main(void) {
     printf("\n\n   STARTING TEST - OS_SHARED   \n\n");
 
@@ -217,6 +408,9 @@ int main(void) {
     /* Test UTF-8 string operations */
     TAP_TEST_MSG(test_utf8_random(false), "Filter a random string into UTF-8 without character replacement.");
 
+    /* Test UTF-8 filtering of invalid strings only */
+    TAP_TEST_MSG(test_utf8_filter_invalid(), "Filter a string into UTF-8 only if it has invalid characters.");
+
     /* Test filesystem magic code searching */
     TAP_TEST_MSG(test_fs_magic(), "Filesystem magic code searching.");
 
@@ -232,9 +426,22 @@ int main(void) {
     /* Test log builder */
     TAP_TEST_MSG(test_log_builder(), "Test log builder.");
 
+    /* Test log builder templates */
+    TAP_TEST_MSG(test_log_template(), "Test log builder templates.");
+
+    /* Test JSON object scanning */
+    TAP_TEST_MSG(test_json_scan_object(), "Check JSON objects without parsing them.");
+
+    TAP_TEST_MSG(test_json_scan_member(), "Find a member of a JSON object without parsing it.");
+
+    TAP_TEST_MSG(test_winevt_render(), "Render an EventChannel event without an XML tree.");
+
     /* Test get_file_content function */
     TAP_TEST_MSG(test_get_file_content(), "Get the content of a file.");
 
+    /* Benchmark the string scanners */
+    TAP_TEST_MSG(test_string_scan_benchmark(), "Scan log lines with the vector string functions.");
+
     TAP_PLAN;
     int r = tap_summary();
     printf("\n   ENDING TEST  - OS_SHARED   \n\n");
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/eventinfo.h"
+#include "../analysisd/accumulator.h"
+
+#define N_THREADS 8
+#define N_EVENTS 200
+
+static OSDecoderInfo decoder = { .name = "test-decoder", .accumulate = 1 };
+
+/* setup */
+
+static int setup_accumulator(void **state) {
+    return Accumulate_Init() ? 0 : -1;
+}
+
+/* auxiliary */
+
+static void init_event(Eventinfo * lf, char * hostname, char * id) {
+    memset(lf, 0, sizeof(Eventinfo));
+    lf->decoder_info = &decoder;
+    lf->hostname = hostname;
+    lf->id = id;
+}
+
+static void free_event(Eventinfo * lf) {
+    os_free(lf->srcip);
+    os_free(lf->dstuser);
+}
+
+static void * accumulate_thread(void * arg) {
+    char hostname[32];
+    char id[32];
+    Eventinfo lf;
+    long * failures = arg;
+    int i;
+
+    snprintf(hostname, sizeof(hostname), "host-%ld", *failures);
+    *failures = 0;
+
+    for (i = 0; i < N_EVENTS; i++) {
+        snprintf(id, sizeof(id), "%d", i);
+
+        init_event(&lf, hostname, id);
+        os_strdup(hostname, lf.srcip);
+        Accumulate(&lf);
+        free_event(&lf);
+
+        init_event(&lf, hostname, id);
+        Accumulate(&lf);
+        *failures += !lf.srcip || strcmp(lf.srcip, hostname) != 0;
+        free_event(&lf);
+    }
+
+    return NULL;
+}
+
+/* tests */
+
+void test_accumulate_same_id(void **state) {
+    Eventinfo lf;
+
+    init_event(&lf, "agent", "1234");
+    os_strdup("10.0.0.1", lf.srcip);
+    assert_ptr_equal(Accumulate(&lf), &lf);
+    free_event(&lf);
+
+    /* The second event gets the source IP, and contributes the user */
+    init_event(&lf, "agent", "1234");
+    os_strdup("root", lf.dstuser);
+    Accumulate(&lf);
+    assert_string_equal(lf.srcip, "10.0.0.1");
+    free_event(&lf);
+
+    init_event(&lf, "agent", "1234");
+    Accumulate(&lf);
+    assert_string_equal(lf.srcip, "10.0.0.1");
+    assert_string_equal(lf.dstuser, "root");
+    free_event(&lf);
+}
+
+void test_accumulate_different_host(void **state) {
+    Eventinfo lf;
+
+    init_event(&lf, "agent-a", "5678");
+    os_strdup("10.0.0.2", lf.srcip);
+    Accumulate(&lf);
+    free_event(&lf);
+
+    init_event(&lf, "agent-b", "5678");
+    Accumulate(&lf);
+    assert_null(lf.srcip);
+    free_event(&lf);
+}
+
+void test_accumulate_no_id(void **state) {
+    Eventinfo lf;
+
+    init_event(&lf, "agent", NULL);
+    os_strdup("10.0.0.3", lf.srcip);
+    assert_ptr_equal(Accumulate(&lf), &lf);
+    free_event(&lf);
+}
+
+void test_accumulate_concurrent(void **state) {
+    pthread_t threads[N_THREADS];
+    long failures[N_THREADS];
+    int i;
+
+    for (i = 0; i < N_THREADS; i++) {
+        failures[i] = i;
+        assert_int_equal(pthread_create(&threads[i], NULL, accumulate_thread, &failures[i]), 0);
+    }
+
+    for (i = 0; i < N_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        assert_int_equal(failures[i], 0);
+    }
+
+    Accumulate_CleanUp();
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_accumulate_same_id),
+        cmocka_unit_test(test_accumulate_different_host),
+        cmocka_unit_test(test_accumulate_no_id),
+        cmocka_unit_test(test_accumulate_concurrent),
+    };
+    return cmocka_run_group_tests(tests, setup_accumulator, NULL);
+}
@@ -37,7 +37,7 @@ int fim_fetch_attributes_state(cJSON *attr, Eventinfo *lf, char new_state);
 int fim_fetch_attributes(cJSON *new_attrs, cJSON *old_attrs, Eventinfo *lf);
 size_t fim_generate_comment(char * str, long size, const char * format, const char * a1, const char * a2);
 int fim_generate_alert(Eventinfo *lf, char *event_type, cJSON *attributes, cJSON *old_attributes, cJSON *audit);
-int fim_process_alert(_sdb *sdb, Eventinfo *lf, cJSON *event);
+int fim_process_alert(_sdb *sdb, Eventinfo *lf, cJSON *event, const char *payload, size_t payload_length);
 int decode_fim_event(_sdb *sdb, Eventinfo *lf);
 void fim_adjust_checksum(sk_sum_t *newsum, char **checksum);
 
@@ -1923,7 +1923,7 @@ static void test_fim_process_alert_added_success(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2022,7 +2022,7 @@ static void test_fim_process_alert_modified_success(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2117,7 +2117,7 @@ static void test_fim_process_alert_deleted_success(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2191,7 +2191,7 @@ static void test_fim_process_alert_no_event_type(void **state) {
     /* Inside fim_send_db_delete */
     expect_string(__wrap__mdebug1, formatted_msg, "No member 'type' in Syscheck JSON payload");
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, -1);
 }
@@ -2212,7 +2212,7 @@ static void test_fim_process_alert_invalid_event_type(void **state) {
     /* Inside fim_send_db_delete */
     expect_string(__wrap__mdebug1, formatted_msg, "Invalid 'type' value 'invalid' in JSON payload.");
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, -1);
 }
@@ -2234,7 +2234,7 @@ static void test_fim_process_alert_invalid_object(void **state) {
     /* Inside fim_send_db_delete */
     expect_string(__wrap__mdebug1, formatted_msg, "FIM event contains an item with no key.");
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, -1);
 }
@@ -2276,7 +2276,7 @@ static void test_fim_process_alert_no_path(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2373,7 +2373,7 @@ static void test_fim_process_alert_no_hard_links(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2471,7 +2471,7 @@ static void test_fim_process_alert_no_mode(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2568,7 +2568,7 @@ static void test_fim_process_alert_no_tags(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2667,7 +2667,7 @@ static void test_fim_process_alert_no_content_changes(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2765,7 +2765,7 @@ static void test_fim_process_alert_no_changed_attributes(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2848,7 +2848,7 @@ static void test_fim_process_alert_no_attributes(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -2961,7 +2961,7 @@ static void test_fim_process_alert_no_old_attributes(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -3072,7 +3072,7 @@ static void test_fim_process_alert_no_audit(void **state) {
     expect_string(__wrap_wdbc_parse_result, result, result);
     will_return(__wrap_wdbc_parse_result, WDBC_OK);
 
-    ret = fim_process_alert(&sdb, input->lf, data);
+    ret = fim_process_alert(&sdb, input->lf, data, NULL, 0);
 
     assert_int_equal(ret, 0);
 
@@ -3142,7 +3142,7 @@ static void test_fim_process_alert_null_event(void **state) {
     /* Inside fim_send_db_save */
     expect_string(__wrap__mdebug1, formatted_msg, "No member 'type' in Syscheck JSON payload");
 
-    ret = fim_process_alert(&sdb, input->lf, NULL);
+    ret = fim_process_alert(&sdb, input->lf, NULL, NULL, 0);
 
     assert_int_equal(ret, -1);
 }
@@ -3159,10 +3159,38 @@ static void test_decode_fim_event_type_event(void **state) {
 
     lf->decoder_info->fields[FIM_MODE] = strdup("mode");
 
-    /* Inside fim_process_alert */
+    /* Inside fim_process_alert, the data member is sent as the agent wrote it */
     expect_string(__wrap_wdbc_query_ex, query, "agent 007 syscheck save2 "
-        "{\"path\":\"/a/path\","
+        "{"
+        "\"path\":\"/a/path\","
+        "\"mode\":\"whodata\","
+        "\"type\":\"added\","
         "\"timestamp\":123456789,"
+        "\"changed_attributes\":["
+            "\"size\",\"permission\",\"uid\","
+            "\"user_name\",\"gid\",\"group_name\","
+            "\"mtime\",\"inode\",\"md5\",\"sha1\",\"sha256\"],"
+        "\"tags\":\"tags\","
+        "\"hard_links\":["
+            "\"/a/hard1.file\","
+            "\"/b/hard2.file\"],"
+        "\"content_changes\":\"some_changes\","
+        "\"old_attributes\":{"
+            "\"type\":\"file\","
+            "\"size\":1234,"
+            "\"perm\":\"old_perm\","
+            "\"user_name\":\"old_user_name\","
+            "\"group_name\":\"old_group_name\","
+            "\"uid\":\"old_uid\","
+            "\"gid\":\"old_gid\","
+            "\"inode\":2345,"
+            "\"mtime\":3456,"
+            "\"hash_md5\":\"old_hash_md5\","
+            "\"hash_sha1\":\"old_hash_sha1\","
+            "\"hash_sha256\":\"old_hash_sha256\","
+            "\"win_attributes\":\"old_win_attributes\","
+            "\"symlink_path\":\"old_symlink_path\","
+            "\"checksum\":\"old_checksum\"},"
         "\"attributes\":{"
             "\"type\":\"file\","
             "\"size\":4567,"
@@ -3178,7 +3206,22 @@ static void test_decode_fim_event_type_event(void **state) {
             "\"hash_sha256\":\"hash_sha256\","
             "\"win_attributes\":\"win_attributes\","
             "\"symlink_path\":\"symlink_path\","
-            "\"checksum\":\"checksum\"}}");
+            "\"checksum\":\"checksum\"},"
+        "\"audit\":{"
+            "\"user_id\":\"user_id\","
+            "\"user_name\":\"user_name\","
+            "\"group_id\":\"group_id\","
+            "\"group_name\":\"group_name\","
+            "\"process_name\":\"process_name\","
+            "\"audit_uid\":\"audit_uid\","
+            "\"audit_name\":\"audit_name\","
+            "\"effective_uid\":\"effective_uid\","
+            "\"effective_name\":\"effective_name\","
+            "\"ppid\":12345,"
+            "\"process_id\":23456,"
+            "\"cwd\":\"cwd\","
+            "\"parent_name\":\"parent_name\","
+            "\"parent_cwd\":\"parent_cwd\"}}");
     will_return(__wrap_wdbc_query_ex, result);
     will_return(__wrap_wdbc_query_ex, 0);
 
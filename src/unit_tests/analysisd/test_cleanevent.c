@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/analysisd.h"
+#include "../analysisd/config.h"
+#include "../analysisd/cleanevent.h"
+
+/* setup */
+
+static int setup_clean(void **state) {
+    Config.decoder_order_size = 16;
+    strncpy(__shost, "manager", sizeof(__shost) - 1);
+    return 0;
+}
+
+/* auxiliary */
+
+static int in_buffer(const Eventinfo * lf, const char * str) {
+    return str >= lf->msg_buffer && str < lf->msg_buffer + lf->msg_buffer_size;
+}
+
+/* wraps */
+
+void __wrap__merror(const char * file, int line, const char * func, const char *msg, ...) {
+    char formatted_msg[OS_MAXSTR];
+    va_list args;
+
+    va_start(args, msg);
+    vsnprintf(formatted_msg, OS_MAXSTR, msg, args);
+    va_end(args);
+
+    check_expected(formatted_msg);
+}
+
+/* tests */
+
+void test_clean_msg_agent(void **state) {
+    char msg[] = "1:[001] (agent1) any->/var/log/syslog:Dec 29 10:00:01 host sshd[123]: Accepted";
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    assert_int_equal(OS_CleanMSG(msg, lf), 0);
+
+    assert_string_equal(lf->agent_id, "001");
+    assert_string_equal(lf->location, "(agent1) any->/var/log/syslog");
+    assert_string_equal(lf->hostname, "agent1");
+    assert_string_equal(lf->full_log, "Dec 29 10:00:01 host sshd[123]: Accepted");
+    assert_string_equal(lf->log, "Accepted");
+
+    /* Nothing was copied out of the message buffer */
+    assert_true(in_buffer(lf, lf->agent_id));
+    assert_true(in_buffer(lf, lf->location));
+    assert_true(in_buffer(lf, lf->hostname));
+    assert_true(in_buffer(lf, lf->full_log));
+
+    Free_Eventinfo(lf);
+}
+
+void test_clean_msg_local(void **state) {
+    char msg[] = "1:/var/log/syslog:Dec 29 10:00:01 host sshd[123]: Accepted";
+    char msg_nohost[] = "1:ossec-monitord:Agent disconnected";
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    assert_int_equal(OS_CleanMSG(msg, lf), 0);
+
+    assert_string_equal(lf->agent_id, "000");
+    assert_string_equal(lf->location, "/var/log/syslog");
+    assert_string_equal(lf->hostname, "host");
+    assert_true(in_buffer(lf, lf->hostname));
+
+    Free_Eventinfo(lf);
+    lf = Alloc_Eventinfo();
+
+    assert_int_equal(OS_CleanMSG(msg_nohost, lf), 0);
+    assert_string_equal(lf->hostname, "manager");
+    assert_string_equal(lf->full_log, "Agent disconnected");
+
+    Free_Eventinfo(lf);
+}
+
+void test_clean_msg_invalid_agent(void **state) {
+    char msg[] = "1:[001 (agent1) any->/var/log/syslog:Accepted";
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    expect_string(__wrap__merror, formatted_msg, "(1106): String not correctly formatted.");
+    assert_int_equal(OS_CleanMSG(msg, lf), -1);
+
+    /* The views are not freed */
+    Free_Eventinfo(lf);
+}
+
+void test_clean_msg_reuses_buffer(void **state) {
+    char msg[] = "1:[001] (agent1) any->/var/log/syslog:Accepted";
+    char msg_short[] = "1:[002] (agent2) any->syslog:Failed";
+    Eventinfo * lf = Alloc_Eventinfo();
+    char * buffer;
+
+    assert_int_equal(OS_CleanMSG(msg, lf), 0);
+    buffer = lf->msg_buffer;
+    Free_Eventinfo(lf);
+
+    /* The recycled event keeps its buffer */
+    assert_ptr_equal(Alloc_Eventinfo(), lf);
+    assert_ptr_equal(lf->msg_buffer, buffer);
+    assert_null(lf->location);
+
+    assert_int_equal(OS_CleanMSG(msg_short, lf), 0);
+    assert_ptr_equal(lf->msg_buffer, buffer);
+    assert_string_equal(lf->agent_id, "002");
+    assert_string_equal(lf->hostname, "agent2");
+    assert_string_equal(lf->full_log, "Failed");
+
+    Free_Eventinfo(lf);
+}
+
+void test_clean_msg_headers(void **state) {
+    char msg_iso[] = "1:/var/log/messages:2009-05-22T09:36:46.214994-07:00 myhost sshd[123]: Accepted";
+    char msg_xferlog[] = "1:/var/log/xferlog:Mon Apr 17 18:27:14 2006 1 64.160.42.130 5 /tmp/x b _ o r anon ftp 0 * c";
+    char msg_snort[] = "1:/var/log/snort:01/28-09:13:16.240702  [**] [1:1:1] x [**]";
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    assert_int_equal(OS_CleanMSG(msg_iso, lf), 0);
+    assert_string_equal(lf->dec_timestamp, "2009-05-22T09:36:46.214994-07:00");
+    assert_string_equal(lf->hostname, "myhost");
+    assert_string_equal(lf->program_name, "sshd");
+    assert_string_equal(lf->log, "Accepted");
+
+    Free_Eventinfo(lf);
+    lf = Alloc_Eventinfo();
+
+    /* Headers without hostname only cut the timestamp */
+    assert_int_equal(OS_CleanMSG(msg_xferlog, lf), 0);
+    assert_string_equal(lf->dec_timestamp, "Mon Apr 17 18:27:14 2006");
+    assert_string_equal(lf->log, "1 64.160.42.130 5 /tmp/x b _ o r anon ftp 0 * c");
+
+    Free_Eventinfo(lf);
+    lf = Alloc_Eventinfo();
+
+    assert_int_equal(OS_CleanMSG(msg_snort, lf), 0);
+    assert_string_equal(lf->dec_timestamp, "01/28-09:13:16.240702");
+    assert_string_equal(lf->log, "[**] [1:1:1] x [**]");
+
+    Free_Eventinfo(lf);
+}
+
+void test_free_eventinfo_field(void **state) {
+    char msg[] = "1:[001] (agent1) any->/var/log/syslog:Accepted";
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    assert_int_equal(OS_CleanMSG(msg, lf), 0);
+
+    /* A view is dropped, and the new value is owned by the event */
+    Free_EventinfoField(lf, &lf->location);
+    assert_null(lf->location);
+    os_strdup("(agent1) any->/var/log/secure", lf->location);
+
+    Free_EventinfoField(lf, &lf->full_log);
+    os_strdup("Accepted password", lf->full_log);
+    lf->log = lf->full_log;
+
+    assert_false(in_buffer(lf, lf->location));
+    assert_string_equal(lf->hostname, "agent1");
+
+    Free_Eventinfo(lf);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_clean_msg_agent),
+        cmocka_unit_test(test_clean_msg_local),
+        cmocka_unit_test(test_clean_msg_invalid_agent),
+        cmocka_unit_test(test_clean_msg_reuses_buffer),
+        cmocka_unit_test(test_clean_msg_headers),
+        cmocka_unit_test(test_free_eventinfo_field),
+    };
+    return cmocka_run_group_tests(tests, setup_clean, NULL);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/decoders/decoder.h"
+
+extern OSDecoderNode *osdecodernode_forpname;
+
+static const char * pnames[] = { "sshd", "^sshd$", "^cron", "sudo|su", "d$" };
+
+/* auxiliary */
+
+static OSDecoderInfo * new_decoder(const char * name, const char * pname) {
+    OSDecoderInfo * pi;
+
+    os_calloc(1, sizeof(OSDecoderInfo), pi);
+    os_strdup(name, pi->name);
+    os_calloc(1, sizeof(OSMatch), pi->program_name);
+    OSMatch_Compile(pname, pi->program_name, 0);
+
+    return pi;
+}
+
+static int setup(void **state) {
+    char name[16];
+    unsigned int i;
+
+    OS_CreateOSDecoderList();
+
+    for (i = 0; i < sizeof(pnames) / sizeof(pnames[0]); i++) {
+        snprintf(name, sizeof(name), "dec-%u", i);
+        assert_int_equal(OS_AddOSDecoder(new_decoder(name, pnames[i])), 1);
+    }
+
+    return 0;
+}
+
+static int teardown(void **state) {
+    OSDecoderNode * node = osdecodernode_forpname;
+    OSDecoderNode * next;
+
+    for (; node; node = next) {
+        next = node->next;
+        OSMatch_FreePattern(node->osdecoder->program_name);
+        free(node->osdecoder->program_name);
+        free(node->osdecoder->name);
+        free(node->osdecoder);
+        free(node);
+    }
+
+    return 0;
+}
+
+/* tests */
+
+void test_decoder_candidates(void **state) {
+    OSDecoderNode ** candidates = OS_GetOSDecoderCandidates("sshd", 4);
+
+    /* List order is kept */
+    assert_non_null(candidates);
+    assert_string_equal(candidates[0]->osdecoder->name, "dec-0");
+    assert_string_equal(candidates[1]->osdecoder->name, "dec-1");
+    assert_string_equal(candidates[2]->osdecoder->name, "dec-4");
+    assert_null(candidates[3]);
+
+    /* Computed once */
+    assert_ptr_equal(OS_GetOSDecoderCandidates("sshd", 4), candidates);
+
+    candidates = OS_GetOSDecoderCandidates("sudo", 4);
+    assert_string_equal(candidates[0]->osdecoder->name, "dec-3");
+    assert_null(candidates[1]);
+
+    candidates = OS_GetOSDecoderCandidates("CRON", 4);
+    assert_string_equal(candidates[0]->osdecoder->name, "dec-2");
+    assert_null(candidates[1]);
+
+    candidates = OS_GetOSDecoderCandidates("kernel", 6);
+    assert_non_null(candidates);
+    assert_null(candidates[0]);
+}
+
+void test_decoder_candidates_full(void **state) {
+    char pname[32];
+    int i;
+
+    for (i = 0; i < DECODER_PNAME_INDEX_MAX; i++) {
+        snprintf(pname, sizeof(pname), "prog-%d", i);
+        OS_GetOSDecoderCandidates(pname, strlen(pname));
+    }
+
+    /* Already indexed names are still found, the rest are scanned */
+    assert_non_null(OS_GetOSDecoderCandidates("prog-0", 6));
+    assert_null(OS_GetOSDecoderCandidates("sshd2", 5));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_decoder_candidates, setup, teardown),
+        cmocka_unit_test_setup_teardown(test_decoder_candidates_full, setup, teardown),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
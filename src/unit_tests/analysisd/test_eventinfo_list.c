@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/config.h"
+#include "../analysisd/eventinfo.h"
+#include "../analysisd/memory_budget.h"
+
+/* auxiliary */
+
+static Eventinfo * new_event(time_t generate_time, int id) {
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    lf->generate_time = generate_time;
+    lf->r_firedtimes = id;
+    return lf;
+}
+
+static EventList * new_list(int maxsize, int timeframe) {
+    EventList * list;
+
+    os_calloc(1, sizeof(EventList), list);
+    OS_CreateEventList(maxsize, list);
+    OS_SetEventListTimeframe(list, timeframe);
+    return list;
+}
+
+/* Collect the IDs found by a search, newest first */
+static int search_ids(EventList * list, time_t oldest, int * ids, int max) {
+    EventListSearch search;
+    Eventinfo * lf;
+    int n = 0;
+
+    for (lf = OS_SearchFirstEvent(list, oldest, &search); lf && n < max; lf = OS_SearchNextEvent(&search)) {
+        ids[n++] = lf->r_firedtimes;
+    }
+
+    OS_SearchEnd(&search);
+    return n;
+}
+
+/* setup */
+
+static int setup_list(void **state) {
+    Config.decoder_order_size = 8;
+    return 0;
+}
+
+/* tests */
+
+void test_event_list_empty(void **state) {
+    EventList * list = new_list(100, 10);
+    EventListSearch search;
+
+    assert_null(OS_SearchFirstEvent(list, 0, &search));
+    OS_SearchEnd(&search);
+}
+
+void test_event_list_order(void **state) {
+    EventList * list = new_list(100, 10);
+    int ids[8];
+
+    OS_AddEvent(new_event(1000, 1), list);
+    OS_AddEvent(new_event(1000, 2), list);
+    OS_AddEvent(new_event(1002, 3), list);
+    OS_AddEvent(new_event(1001, 4), list);
+
+    assert_int_equal(search_ids(list, 0, ids, 8), 4);
+    assert_int_equal(ids[0], 3);
+    assert_int_equal(ids[1], 4);
+    assert_int_equal(ids[2], 2);
+    assert_int_equal(ids[3], 1);
+}
+
+void test_event_list_timeframe(void **state) {
+    EventList * list = new_list(100, 10);
+    int ids[8];
+
+    OS_AddEvent(new_event(1000, 1), list);
+    OS_AddEvent(new_event(1005, 2), list);
+    OS_AddEvent(new_event(1008, 3), list);
+
+    /* Older buckets are not visited */
+    assert_int_equal(search_ids(list, 1005, ids, 8), 2);
+    assert_int_equal(ids[0], 3);
+    assert_int_equal(ids[1], 2);
+}
+
+void test_event_list_expire_bucket(void **state) {
+    EventList * list = new_list(100, 2);
+    int ids[8];
+
+    /* 4 buckets: second 1004 reuses the bucket of 1000 */
+    OS_AddEvent(new_event(1000, 1), list);
+    OS_AddEvent(new_event(1000, 2), list);
+    OS_AddEvent(new_event(1003, 3), list);
+    OS_AddEvent(new_event(1004, 4), list);
+
+    assert_int_equal(list->_memoryused, 2);
+    assert_int_equal(search_ids(list, 0, ids, 8), 2);
+    assert_int_equal(ids[0], 4);
+    assert_int_equal(ids[1], 3);
+
+    /* Too old to be stored */
+    OS_AddEvent(new_event(1000, 5), list);
+    assert_int_equal(list->_memoryused, 2);
+}
+
+void test_event_list_evict(void **state) {
+    EventList * list = new_list(20, 10);
+    int ids[32];
+    int i;
+
+    for (i = 0; i < 21; i++) {
+        OS_AddEvent(new_event(1000 + i / 10, i), list);
+    }
+
+    /* At least 10 of the oldest events are released */
+    assert_int_equal(list->_memoryused, 11);
+    assert_int_equal(search_ids(list, 0, ids, 32), 11);
+    assert_int_equal(ids[0], 20);
+    assert_int_equal(ids[10], 10);
+}
+
+void test_event_list_hold(void **state) {
+    EventList * first = new_list(100, 10);
+    EventList * second = new_list(100, 10);
+    Eventinfo * lf = new_event(1000, 1);
+    int ids[8];
+
+    os_strdup("full log", lf->full_log);
+
+    OS_AddEvent(Hold_Eventinfo(lf), first);
+    OS_AddEvent(lf, second);
+    assert_int_equal(lf->refs, 2);
+
+    /* The second list drops it, the first one keeps it */
+    OS_AddEvent(new_event(1012, 2), second);
+    assert_int_equal(lf->refs, 1);
+    assert_string_equal(lf->full_log, "full log");
+    assert_int_equal(search_ids(first, 0, ids, 8), 1);
+    assert_int_equal(ids[0], 1);
+}
+
+void test_hold_eventinfo(void **state) {
+    Eventinfo * lf = new_event(1000, 1);
+
+    assert_ptr_equal(Hold_Eventinfo(lf), lf);
+    assert_int_equal(lf->refs, 2);
+    Hold_Eventinfo(lf);
+    assert_int_equal(lf->refs, 3);
+
+    Free_Eventinfo(lf);
+    Free_Eventinfo(lf);
+    assert_int_equal(lf->refs, 1);
+    Free_Eventinfo(lf);
+}
+
+void test_event_list_memory(void **state) {
+    EventList * list = new_list(40, 10);
+    size_t used = w_mem_used(W_MEM_EVENT_LISTS);
+    Eventinfo * lf = new_event(1000, 1);
+    int ids[16];
+    int i;
+
+    /* Shared events are accounted once */
+    OS_AddEvent(Hold_Eventinfo(lf), new_list(8, 10));
+    OS_AddEvent(lf, new_list(8, 10));
+    assert_int_equal(w_mem_used(W_MEM_EVENT_LISTS), used + lf->mem_size);
+
+    /* Over the budget, the list keeps a quarter of its size */
+    w_mem_budget_init(1);
+    assert_int_equal(w_mem_update(), W_MEM_REJECT);
+
+    for (i = 1; i <= 11; i++) {
+        OS_AddEvent(new_event(1000 + i, i), list);
+    }
+
+    assert_int_equal(search_ids(list, 0, ids, 16), 1);
+    assert_int_equal(ids[0], 11);
+
+    w_mem_budget_init(0);
+    assert_int_equal(w_mem_update(), W_MEM_NORMAL);
+
+    for (i = 12; i <= 21; i++) {
+        OS_AddEvent(new_event(1011, i), list);
+    }
+
+    assert_int_equal(search_ids(list, 0, ids, 16), 11);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_event_list_empty),
+        cmocka_unit_test(test_event_list_order),
+        cmocka_unit_test(test_event_list_timeframe),
+        cmocka_unit_test(test_event_list_expire_bucket),
+        cmocka_unit_test(test_event_list_evict),
+        cmocka_unit_test(test_event_list_hold),
+        cmocka_unit_test(test_hold_eventinfo),
+        cmocka_unit_test(test_event_list_memory),
+    };
+    return cmocka_run_group_tests(tests, setup_list, NULL);
+}
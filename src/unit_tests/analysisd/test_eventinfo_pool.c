@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/config.h"
+#include "../analysisd/eventinfo.h"
+
+/* setup */
+
+static int setup_pool(void **state) {
+    Config.decoder_order_size = 16;
+    Init_EventinfoPool(4);
+    return 0;
+}
+
+/* auxiliary */
+
+static void * free_events(void * lfs) {
+    int i;
+
+    for (i = 0; i <= EVENTINFO_CACHE_SIZE; i++) {
+        Free_Eventinfo(((Eventinfo **)lfs)[i]);
+    }
+
+    return NULL;
+}
+
+/* tests */
+
+void test_alloc_eventinfo_fields(void **state) {
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    assert_non_null(lf->fields);
+    assert_int_equal(lf->fields_size, 16);
+    assert_int_equal(lf->nfields, 0);
+
+    Free_Eventinfo(lf);
+}
+
+void test_alloc_eventinfo_recycled_is_clean(void **state) {
+    Eventinfo * lf = Alloc_Eventinfo();
+    Eventinfo * recycled;
+    DynamicField * fields = lf->fields;
+
+    os_strdup("sshd", lf->program_name);
+    os_strdup("srcip", lf->fields[0].key);
+    os_strdup("10.0.0.1", lf->fields[0].value);
+    lf->nfields = 1;
+    lf->matched = 3;
+
+    /* program_name is only owned by copies */
+    lf->is_a_copy = 1;
+
+    Free_Eventinfo(lf);
+    recycled = Alloc_Eventinfo();
+
+    assert_ptr_equal(recycled, lf);
+    assert_ptr_equal(recycled->fields, fields);
+    assert_null(recycled->program_name);
+    assert_null(recycled->fields[0].key);
+    assert_null(recycled->fields[0].value);
+    assert_int_equal(recycled->nfields, 0);
+    assert_int_equal(recycled->matched, 0);
+    assert_int_equal(recycled->is_a_copy, 0);
+
+    Free_Eventinfo(recycled);
+}
+
+void test_alloc_eventinfo_recycled_indexed_fields(void **state) {
+    Eventinfo * lf = Alloc_Eventinfo();
+    Eventinfo * recycled;
+
+    /* A decoder that fills fields by index and fails before setting nfields */
+    os_strdup("/etc/passwd", lf->fields[0].value);
+    os_strdup("size", lf->fields[5].value);
+    os_strdup("hard_links", lf->fields[15].key);
+    os_strdup("[\"/etc/shadow\"]", lf->fields[15].value);
+    assert_int_equal(lf->nfields, 0);
+
+    Free_Eventinfo(lf);
+    recycled = Alloc_Eventinfo();
+
+    assert_ptr_equal(recycled, lf);
+    assert_null(recycled->fields[0].value);
+    assert_null(recycled->fields[5].value);
+    assert_null(recycled->fields[15].key);
+    assert_null(recycled->fields[15].value);
+
+    /* Zeroing the event clears them too */
+    os_strdup("/etc/group", recycled->fields[3].value);
+    Zero_Eventinfo(recycled);
+    assert_null(recycled->fields[3].value);
+
+    Free_Eventinfo(recycled);
+}
+
+void test_alloc_eventinfo_from_other_thread(void **state) {
+    Eventinfo * lfs[EVENTINFO_CACHE_SIZE + 1];
+    Eventinfo * cached;
+    pthread_t thread;
+    int i;
+
+    /* Empty this thread's cache */
+    cached = Alloc_Eventinfo();
+
+    for (i = 0; i <= EVENTINFO_CACHE_SIZE; i++) {
+        lfs[i] = Alloc_Eventinfo();
+    }
+
+    /* The last one doesn't fit in the other thread's cache */
+    assert_int_equal(pthread_create(&thread, NULL, free_events, lfs), 0);
+    pthread_join(thread, NULL);
+
+    assert_ptr_equal(Alloc_Eventinfo(), lfs[EVENTINFO_CACHE_SIZE]);
+
+    Free_Eventinfo(lfs[EVENTINFO_CACHE_SIZE]);
+    Free_Eventinfo(cached);
+}
+
+void test_free_eventinfo_not_recyclable(void **state) {
+    Eventinfo * lf;
+
+    os_calloc(1, sizeof(Eventinfo), lf);
+    os_calloc(2, sizeof(DynamicField), lf->fields);
+    os_strdup("key", lf->fields[0].key);
+    os_strdup("value", lf->fields[0].value);
+    lf->nfields = 1;
+
+    /* Freed as usual: nothing to check but the absence of leaks */
+    Free_Eventinfo(lf);
+}
+
+void test_free_eventinfo_shared(void **state) {
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    os_strdup("full log", lf->full_log);
+    lf->refs = 2;
+
+    /* The first holder leaves it untouched */
+    Free_Eventinfo(lf);
+    assert_int_equal(lf->refs, 1);
+    assert_string_equal(lf->full_log, "full log");
+
+    /* The last one releases it (back to the cache) */
+    Free_Eventinfo(lf);
+    assert_ptr_equal(Alloc_Eventinfo(), lf);
+    assert_null(lf->full_log);
+
+    Free_Eventinfo(lf);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_alloc_eventinfo_fields),
+        cmocka_unit_test(test_alloc_eventinfo_recycled_is_clean),
+        cmocka_unit_test(test_alloc_eventinfo_recycled_indexed_fields),
+        cmocka_unit_test(test_alloc_eventinfo_from_other_thread),
+        cmocka_unit_test(test_free_eventinfo_not_recyclable),
+        cmocka_unit_test(test_free_eventinfo_shared),
+    };
+    return cmocka_run_group_tests(tests, setup_pool, NULL);
+}
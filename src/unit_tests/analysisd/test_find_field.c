@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/analysisd.h"
+#include "../analysisd/config.h"
+#include "../analysisd/eventinfo.h"
+#include "../analysisd/decoders/plugin_decoders.h"
+
+/* setup */
+
+static int setup_fields(void **state) {
+    Config.decoder_order_size = 16;
+    return 0;
+}
+
+/* tests */
+
+void test_field_id_interned(void **state) {
+    int id = FieldId_Add("user.name");
+    char name[16];
+    int i;
+
+    assert_true(id > 0);
+    assert_int_equal(FieldId_Add("User.Name"), id);
+    assert_int_equal(FieldId_Get("USER.NAME"), id);
+    assert_int_equal(FieldId_Get("user"), 0);
+    assert_int_equal(FieldId_Get(NULL), 0);
+
+    /* The IDs survive the growth of the table */
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "field%d", i);
+        assert_int_not_equal(FieldId_Add(name), id);
+    }
+
+    assert_int_equal(FieldId_Get("user.name"), id);
+    assert_int_equal(FieldId_Get("FIELD999"), FieldId_Add("field999"));
+}
+
+void test_find_field(void **state) {
+    OSDecoderInfo decoder;
+    Eventinfo * lf = Alloc_Eventinfo();
+    int id = FieldId_Add("srcuser.domain");
+
+    memset(&decoder, 0, sizeof(OSDecoderInfo));
+    decoder.flags = SHOW_STRING;
+    lf->decoder_info = &decoder;
+    lf->log = "{\"srcuser\":{\"domain\":\"corp\"},\"other\":\"value\"}";
+
+    JSON_Decoder_Exec(lf, NULL);
+    assert_int_equal(lf->nfields, 2);
+
+    /* Interned names get their ID, other ones are compared by name */
+    assert_int_equal(lf->fields[0].id, id);
+    assert_int_equal(lf->fields[1].id, 0);
+
+    assert_string_equal(FindFieldId(lf, id, "srcuser.domain"), "corp");
+    assert_string_equal(FindField(lf, "SRCUSER.DOMAIN"), "corp");
+    assert_string_equal(FindField(lf, "Other"), "value");
+    assert_null(FindField(lf, "srcuser"));
+    assert_null(FindFieldId(lf, FieldId_Add("missing"), "missing"));
+
+    lf->log = NULL;
+    lf->decoder_info = NULL;
+    Free_Eventinfo(lf);
+}
+
+void test_find_field_no_id(void **state) {
+    DynamicField field = { .key = "Dst.Port", .value = "22" };
+    Eventinfo lf = { .fields = &field, .nfields = 1 };
+
+    FieldId_Add("dst.port");
+
+    /* Fields filled by hand still match by name */
+    assert_string_equal(FindField(&lf, "dst.port"), "22");
+    assert_null(FindField(&lf, "src.port"));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_field_id_interned),
+        cmocka_unit_test(test_find_field),
+        cmocka_unit_test(test_find_field_no_id),
+    };
+    return cmocka_run_group_tests(tests, setup_fields, NULL);
+}
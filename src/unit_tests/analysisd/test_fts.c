@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/config.h"
+#include "../analysisd/eventinfo.h"
+#include "../analysisd/fts.h"
+
+#define TEST_FTS_QUEUE "/tmp/test_fts-queue"
+#define TEST_IG_QUEUE  "/tmp/test_ig-queue"
+
+FILE * __real_fopen(const char * path, const char * mode);
+
+/* wrappers */
+
+FILE * __wrap_fopen(const char * path, const char * mode) {
+    if (strcmp(path, FTS_QUEUE) == 0) {
+        path = TEST_FTS_QUEUE;
+    } else if (strcmp(path, IG_QUEUE) == 0) {
+        path = TEST_IG_QUEUE;
+    }
+
+    return __real_fopen(path, mode);
+}
+
+int __wrap_getDefine_Int(const char * high_name, const char * low_name, int min, int max) {
+    /* fts_list_size, fts_min_size_for_str */
+    return min;
+}
+
+/* auxiliary */
+
+static char * fts_line(const char * name, const char * location) {
+    static OSDecoderInfo decoder;
+    Eventinfo lf;
+
+    memset(&lf, 0, sizeof(lf));
+    decoder.name = (char *)name;
+    decoder.type = IDS;
+    decoder.fts = FTS_LOCATION;
+    lf.decoder_info = &decoder;
+    lf.location = (char *)location;
+
+    return FTS(&lf);
+}
+
+static void assert_fts_line(const char * name, const char * location, const char * expected) {
+    char * line = fts_line(name, location);
+
+    if (expected) {
+        assert_string_equal(line, expected);
+    } else {
+        assert_null(line);
+    }
+
+    free(line);
+}
+
+/* setup/teardown */
+
+static int setup_fts(void **state) {
+    fclose(__real_fopen(TEST_FTS_QUEUE, "w"));
+    fclose(__real_fopen(TEST_IG_QUEUE, "w"));
+    Config.decoder_order_size = 0;
+    return FTS_Init(1) ? 0 : -1;
+}
+
+static int teardown_fts(void **state) {
+    unlink(TEST_FTS_QUEUE);
+    unlink(TEST_IG_QUEUE);
+    return 0;
+}
+
+/* tests */
+
+void test_fts_first_time(void **state) {
+    assert_fts_line("first", "loc1", "first        loc1");
+
+    /* Already seen */
+    assert_null(fts_line("first", "loc1"));
+}
+
+void test_fts_similar(void **state) {
+    assert_fts_line("similar", "loc1", "similar        loc1");
+    assert_fts_line("similar", "loc2", "similar        loc2");
+    assert_fts_line("similar", "loc3", "similar        loc3");
+
+    /* The fourth similar line is cut to the minimum size, just once */
+    assert_fts_line("similar", "loc4", "simila");
+    assert_null(fts_line("similar", "loc5"));
+}
+
+void test_fts_similar_expire(void **state) {
+    char name[16];
+    int i;
+
+    assert_fts_line("expire", "loc1", "expire        loc1");
+    assert_fts_line("expire", "loc2", "expire        loc2");
+    assert_fts_line("expire", "loc3", "expire        loc3");
+
+    /* Push them out of the last fts_list_size lines */
+    for (i = 0; i < fts_list_size; i++) {
+        snprintf(name, sizeof(name), "other%02d", i);
+        free(fts_line(name, "loc"));
+    }
+
+    assert_fts_line("expire", "loc4", "expire        loc4");
+}
+
+void test_fts_batch(void **state) {
+    char * lines[] = { "line one", "line two" };
+    char buffer[64];
+    FILE * fp;
+
+    FTS_Fprintf_Batch(lines, 2);
+
+    fp = __real_fopen(TEST_FTS_QUEUE, "r");
+    assert_non_null(fp);
+    assert_non_null(fgets(buffer, sizeof(buffer), fp));
+    assert_string_equal(buffer, "line one\n");
+    assert_non_null(fgets(buffer, sizeof(buffer), fp));
+    assert_string_equal(buffer, "line two\n");
+    fclose(fp);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_fts_first_time),
+        cmocka_unit_test(test_fts_similar),
+        cmocka_unit_test(test_fts_similar_expire),
+        cmocka_unit_test(test_fts_batch),
+    };
+    return cmocka_run_group_tests(tests, setup_fts, teardown_fts);
+}
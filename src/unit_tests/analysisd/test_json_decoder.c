@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/analysisd.h"
+#include "../analysisd/config.h"
+#include "../analysisd/eventinfo.h"
+#include "../analysisd/decoders/plugin_decoders.h"
+
+/* setup */
+
+static int setup_json(void **state) {
+    Config.decoder_order_size = 16;
+    return 0;
+}
+
+/* auxiliary */
+
+static Eventinfo * decode(OSDecoderInfo * decoder, u_int8_t flags, char * log) {
+    Eventinfo * lf = Alloc_Eventinfo();
+
+    memset(decoder, 0, sizeof(OSDecoderInfo));
+    decoder->flags = flags;
+    lf->decoder_info = decoder;
+    lf->log = log;
+
+    JSON_Decoder_Exec(lf, NULL);
+    return lf;
+}
+
+static void release(Eventinfo * lf) {
+    lf->log = NULL;
+    lf->decoder_info = NULL;
+    Free_Eventinfo(lf);
+}
+
+/* tests */
+
+void test_json_decoder_fields(void **state) {
+    char log[] = "{\"srcip\":\"10.0.0.1\",\"a\":1,\"b\":{\"c\":\"x\\u00e9\\n\",\"d\":1.5,\"e\":{\"f\":true}},\"g\":null}";
+    OSDecoderInfo decoder;
+    Eventinfo * lf = decode(&decoder, 0, log);
+
+    assert_string_equal(lf->srcip, "10.0.0.1");
+    assert_int_equal(lf->nfields, 4);
+    assert_string_equal(lf->fields[0].key, "a");
+    assert_string_equal(lf->fields[0].value, "1");
+    assert_string_equal(lf->fields[1].key, "b.c");
+    assert_string_equal(lf->fields[1].value, "x\xC3\xA9\n");
+    assert_string_equal(lf->fields[2].key, "b.d");
+    assert_string_equal(lf->fields[2].value, "1.500000");
+    assert_string_equal(lf->fields[3].key, "b.e.f");
+    assert_string_equal(lf->fields[3].value, "true");
+
+    release(lf);
+}
+
+void test_json_decoder_csv_array(void **state) {
+    char log[] = "{\"list\":[1,\"two\",null,false,{\"x\":1},[2]],\"empty\":[],\"g\":null}";
+    OSDecoderInfo decoder;
+    Eventinfo * lf = decode(&decoder, CSV_STRING | SHOW_STRING, log);
+
+    assert_int_equal(lf->nfields, 2);
+    assert_string_equal(lf->fields[0].key, "list");
+    assert_string_equal(lf->fields[0].value, "1,two,null,false,");
+    assert_string_equal(lf->fields[1].key, "g");
+    assert_string_equal(lf->fields[1].value, "null");
+
+    release(lf);
+}
+
+void test_json_decoder_malformed(void **state) {
+    char log[] = "{\"a\":\"1\",\"b\":[1,}";
+    OSDecoderInfo decoder;
+    Eventinfo * lf = decode(&decoder, 0, log);
+
+    /* Nothing is filled from an invalid event */
+    assert_int_equal(lf->nfields, 0);
+
+    release(lf);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_json_decoder_fields),
+        cmocka_unit_test(test_json_decoder_csv_array),
+        cmocka_unit_test(test_json_decoder_malformed),
+    };
+    return cmocka_run_group_tests(tests, setup_json, NULL);
+}
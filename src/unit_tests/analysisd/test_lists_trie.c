@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <utime.h>
+
+#include "../analysisd/rules.h"
+#include "../analysisd/lists.h"
+#include "../analysisd/lists_trie.h"
+#include "../analysisd/lists_make.h"
+
+#define TEST_TXT_FILE "/tmp/test_lists_trie"
+#define TEST_CDB_FILE "/tmp/test_lists_trie.cdb"
+
+static const char * test_list =
+    "10.0.0.1:host\n"
+    "192.168.:lan\n"
+    "192.168.1.:office\n"
+    "172.16.0.0/12:private\n"
+    "\"2001:db8::/32\":doc\n"
+    "\"2001:db8:1::1\":doc-host\n"
+    "01.:not canonical\n"
+    "abc.:not an address\n";
+
+/* setup/teardown */
+
+static int write_list(const char * content, time_t mtime) {
+    struct utimbuf times = { mtime, mtime };
+    FILE * fp;
+
+    if (fp = fopen(TEST_TXT_FILE, "w"), !fp) {
+        return -1;
+    }
+
+    fputs(content, fp);
+    fclose(fp);
+    return utime(TEST_TXT_FILE, &times);
+}
+
+static int setup_cdb(void **state) {
+    if (write_list(test_list, time(NULL) - 10) < 0) {
+        return -1;
+    }
+
+    Lists_OP_MakeCDB(TEST_TXT_FILE, TEST_CDB_FILE, 1, 0);
+    OS_CreateListsList();
+    return 0;
+}
+
+static int teardown_cdb(void **state) {
+    unlink(TEST_TXT_FILE);
+    unlink(TEST_CDB_FILE);
+    return 0;
+}
+
+/* auxiliary */
+
+static ListRule * new_list_rule(int lookup_type, const char * pattern) {
+    static ListNode * node = NULL;
+    OSMatch * matcher = NULL;
+
+    if (!node) {
+        os_calloc(1, sizeof(ListNode), node);
+        os_strdup(TEST_CDB_FILE, node->cdb_filename);
+        os_strdup(TEST_TXT_FILE, node->txt_filename);
+        OS_AddList(node);
+    }
+
+    if (pattern) {
+        os_calloc(1, sizeof(OSMatch), matcher);
+        OSMatch_Compile(pattern, matcher, 0);
+    }
+
+    return OS_AddListRule(NULL, lookup_type, 0, NULL, TEST_CDB_FILE, matcher);
+}
+
+static char * search_value(list_trie * trie, ListCDB * db, const char * address) {
+    static char value[64];
+    uint32 dpos;
+    uint32 dlen;
+
+    if (list_trie_search(trie, address, &dpos, &dlen) != 1 || dlen >= sizeof(value)) {
+        return NULL;
+    }
+
+    cdb_read(&db->cdb, value, dlen, dpos);
+    value[dlen] = '\0';
+    return value;
+}
+
+/* tests */
+
+void test_list_trie_prefixes(void **state) {
+    ListRule * lrule = new_list_rule(LR_ADDRESS_MATCH, NULL);
+    ListCDB * db = lrule->db->current;
+    list_trie * trie = db->trie;
+
+    assert_non_null(trie);
+    assert_int_equal(trie->n_prefixes, 4);
+
+    /* Longest prefix wins */
+    assert_string_equal(search_value(trie, db, "192.168.1.20"), "office");
+    assert_string_equal(search_value(trie, db, "192.168.2.20"), "lan");
+    assert_string_equal(search_value(trie, db, "172.31.255.1"), "private");
+    assert_null(search_value(trie, db, "172.32.0.1"));
+    assert_string_equal(search_value(trie, db, "2001:db8:ffff::1"), "doc");
+    assert_null(search_value(trie, db, "2001:db9::1"));
+
+    /* Single hosts are left to the CDB */
+    assert_null(search_value(trie, db, "10.0.0.1"));
+    assert_int_equal(list_trie_search(trie, "not-an-ip", NULL, NULL), -1);
+}
+
+void test_list_address_match(void **state) {
+    ListRule * lrule = new_list_rule(LR_ADDRESS_MATCH, NULL);
+
+    assert_int_equal(OS_DBSearch(lrule, "10.0.0.1"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "10.0.0.2"), 0);
+    assert_int_equal(OS_DBSearch(lrule, "192.168.7.7"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "172.20.0.1"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "2001:db8:1::1"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "2001:db8:2::1"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "1.2.3.4"), 0);
+
+    /* Keys that are not addresses keep the dot-truncation semantics */
+    assert_int_equal(OS_DBSearch(lrule, "abc.def"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "01.2.3.4"), 1);
+}
+
+void test_list_address_not_match(void **state) {
+    ListRule * lrule = new_list_rule(LR_ADDRESS_NOT_MATCH, NULL);
+
+    assert_int_equal(OS_DBSearch(lrule, "192.168.7.7"), 0);
+    assert_int_equal(OS_DBSearch(lrule, "8.8.8.8"), 1);
+}
+
+void test_list_address_match_value(void **state) {
+    ListRule * lrule = new_list_rule(LR_ADDRESS_MATCH_VALUE, "office");
+
+    /* The value of the longest prefix is checked. A matching value gives 0, as it always did */
+    assert_int_equal(OS_DBSearch(lrule, "192.168.1.5"), 0);
+    assert_int_equal(OS_DBSearch(lrule, "192.168.2.5"), 1);
+}
+
+void test_list_string_match_value(void **state) {
+    ListRule * lrule = new_list_rule(LR_STRING_MATCH_VALUE, "host");
+
+    assert_int_equal(OS_DBSearch(lrule, "10.0.0.1"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "192.168."), 0);
+    assert_int_equal(OS_DBSearch(lrule, "missing"), 0);
+}
+
+void test_list_reload(void **state) {
+    ListRule * lrule = new_list_rule(LR_ADDRESS_MATCH, NULL);
+    ListCDB * old = lrule->db->current;
+
+    /* Nothing changed */
+    Lists_OP_InitReaders(1);
+    assert_int_equal(Lists_OP_ReloadLists(), 0);
+    assert_ptr_equal(lrule->db->current, old);
+
+    assert_int_equal(write_list("8.8.8.:dns\n", time(NULL) + 10), 0);
+    assert_int_equal(Lists_OP_ReloadLists(), 1);
+
+    Lists_OP_ReadBegin(0);
+    assert_int_equal(OS_DBSearch(lrule, "8.8.8.8"), 1);
+    assert_int_equal(OS_DBSearch(lrule, "192.168.1.5"), 0);
+    Lists_OP_ReadEnd(0);
+}
+
+void test_list_make_unchanged(void **state) {
+    struct stat before;
+    struct stat after;
+
+    /* Same text with a newer date */
+    assert_int_equal(write_list("8.8.8.:dns\n", time(NULL) + 20), 0);
+    assert_int_equal(stat(TEST_CDB_FILE, &before), 0);
+    Lists_OP_MakeCDB(TEST_TXT_FILE, TEST_CDB_FILE, 0, 0);
+    assert_int_equal(stat(TEST_CDB_FILE, &after), 0);
+    assert_int_equal(after.st_ino, before.st_ino);
+
+    assert_int_equal(write_list("9.9.9.:dns\n", time(NULL) + 30), 0);
+    Lists_OP_MakeCDB(TEST_TXT_FILE, TEST_CDB_FILE, 0, 0);
+    assert_int_equal(stat(TEST_CDB_FILE, &after), 0);
+    assert_int_not_equal(after.st_ino, before.st_ino);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_list_trie_prefixes),
+        cmocka_unit_test(test_list_address_match),
+        cmocka_unit_test(test_list_address_not_match),
+        cmocka_unit_test(test_list_address_match_value),
+        cmocka_unit_test(test_list_string_match_value),
+        cmocka_unit_test(test_list_reload),
+        cmocka_unit_test(test_list_make_unchanged),
+    };
+    return cmocka_run_group_tests(tests, setup_cdb, teardown_cdb);
+}
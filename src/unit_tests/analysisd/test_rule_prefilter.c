@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/rules.h"
+#include "../analysisd/config.h"
+#include "../analysisd/eventinfo.h"
+#include "../analysisd/rule_prefilter.h"
+
+#define N_CHILDREN 15
+
+static const char * matches[] = { "failed password|invalid user", "^accepted", "session opened$", "!nothing", "for root" };
+
+/* Children 0-7 require field "id" to be "<i>" (or "1<i>" too when even),
+ * 8 requires a decoder, 9 a program name and 10-14 a <match>.
+ */
+static RuleNode * build_tree(void) {
+    RuleNode * parent;
+    RuleNode ** last;
+    char pattern[32];
+    int i;
+
+    os_calloc(1, sizeof(RuleNode), parent);
+    os_calloc(1, sizeof(RuleInfo), parent->ruleinfo);
+    os_calloc(Config.decoder_order_size + 1, sizeof(FieldInfo *), parent->ruleinfo->fields);
+    last = &parent->child;
+
+    for (i = 0; i < N_CHILDREN; i++) {
+        RuleNode * node;
+        RuleInfo * rule;
+
+        os_calloc(1, sizeof(RuleNode), node);
+        os_calloc(1, sizeof(RuleInfo), rule);
+        os_calloc(Config.decoder_order_size + 1, sizeof(FieldInfo *), rule->fields);
+        rule->sigid = 100 + i;
+        node->ruleinfo = rule;
+
+        if (i < 8) {
+            os_calloc(1, sizeof(FieldInfo), rule->fields[0]);
+            os_strdup("id", rule->fields[0]->name);
+            os_calloc(1, sizeof(OSRegex), rule->fields[0]->regex);
+
+            if (i % 2) {
+                snprintf(pattern, sizeof(pattern), "^%d$", i);
+            } else {
+                snprintf(pattern, sizeof(pattern), "^%d$|^1%d$", i, i);
+            }
+
+            OSRegex_Compile(pattern, rule->fields[0]->regex, 0);
+        } else if (i == 8) {
+            rule->decoded_as = 7;
+        } else if (i == 9) {
+            os_calloc(1, sizeof(OSMatch), rule->program_name);
+            OSMatch_Compile("sshd", rule->program_name, 0);
+        } else {
+            os_calloc(1, sizeof(OSMatch), rule->match);
+            OSMatch_Compile(matches[i - 10], rule->match, 0);
+        }
+
+        *last = node;
+        last = &node->next;
+    }
+
+    return parent;
+}
+
+static int get_bit(const uint64_t * set, int i) {
+    return (set[i / 64] >> (i % 64)) & 1;
+}
+
+/* setup/teardown */
+
+static int setup(void **state) {
+    Config.decoder_order_size = 8;
+    *state = build_tree();
+    return 0;
+}
+
+/* tests */
+
+void test_rule_prefilter_build(void **state) {
+    RuleNode * parent = *state;
+    rule_prefilter * prefilter;
+
+    assert_int_equal(OS_CompileRulePrefilters(parent), 1);
+
+    prefilter = parent->prefilter;
+    assert_non_null(prefilter);
+    assert_int_equal(prefilter->count, N_CHILDREN);
+    assert_int_equal(prefilter->words, 1);
+    assert_string_equal(prefilter->field, "id");
+    assert_int_equal(prefilter->n_decoders, 1);
+    assert_int_equal(prefilter->n_values, 12);
+    assert_non_null(prefilter->match);
+    assert_int_equal(prefilter->match_any[0], 0x23ff);
+}
+
+void test_rule_prefilter_candidates_field(void **state) {
+    RuleNode * parent = *state;
+    OSDecoderInfo decoder = { .id = 3 };
+    DynamicField field = { .key = "ID", .value = "12" };
+    Eventinfo lf = { .decoder_info = &decoder, .fields = &field, .nfields = 1, .program_name = "sshd", .log = "", .size = 0 };
+    uint64_t candidates[RULE_PREFILTER_MAX_WORDS];
+    int i;
+
+    rule_prefilter_candidates(parent->prefilter, &lf, candidates);
+
+    for (i = 0; i < 8; i++) {
+        assert_int_equal(get_bit(candidates, i), i == 2);
+    }
+
+    /* Wrong decoder */
+    assert_int_equal(get_bit(candidates, 8), 0);
+    /* No field constraint, program name present */
+    assert_int_equal(get_bit(candidates, 9), 1);
+    /* Literals not found, except for the negated one */
+    assert_int_equal(get_bit(candidates, 10), 0);
+    assert_int_equal(get_bit(candidates, 11), 0);
+    assert_int_equal(get_bit(candidates, 12), 0);
+    assert_int_equal(get_bit(candidates, 13), 1);
+    assert_int_equal(get_bit(candidates, 14), 0);
+}
+
+void test_rule_prefilter_candidates_no_field(void **state) {
+    RuleNode * parent = *state;
+    OSDecoderInfo decoder = { .id = 7 };
+    Eventinfo lf = { .decoder_info = &decoder, .log = "", .size = 0 };
+    uint64_t candidates[RULE_PREFILTER_MAX_WORDS];
+    int i;
+
+    rule_prefilter_candidates(parent->prefilter, &lf, candidates);
+
+    for (i = 0; i < 8; i++) {
+        assert_int_equal(get_bit(candidates, i), 0);
+    }
+
+    assert_int_equal(get_bit(candidates, 8), 1);
+    /* Program name required but missing */
+    assert_int_equal(get_bit(candidates, 9), 0);
+}
+
+void test_rule_prefilter_candidates_match(void **state) {
+    RuleNode * parent = *state;
+    OSDecoderInfo decoder = { .id = 7 };
+    char log[] = "sshd[123]: Invalid user admin from 10.0.0.1: session opened";
+    Eventinfo lf = { .decoder_info = &decoder, .log = log, .size = sizeof(log) - 1 };
+    uint64_t candidates[RULE_PREFILTER_MAX_WORDS];
+
+    rule_prefilter_candidates(parent->prefilter, &lf, candidates);
+
+    assert_int_equal(get_bit(candidates, 10), 1);
+    /* The anchor is checked by the rule itself */
+    assert_int_equal(get_bit(candidates, 11), 0);
+    assert_int_equal(get_bit(candidates, 12), 1);
+    assert_int_equal(get_bit(candidates, 13), 1);
+    assert_int_equal(get_bit(candidates, 14), 0);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_rule_prefilter_build),
+        cmocka_unit_test(test_rule_prefilter_candidates_field),
+        cmocka_unit_test(test_rule_prefilter_candidates_no_field),
+        cmocka_unit_test(test_rule_prefilter_candidates_match),
+    };
+    return cmocka_run_group_tests(tests, setup, NULL);
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../analysisd/rules.h"
+#include "../analysisd/rule_profile.h"
+
+/* A parent rule (100) with two children (101 and 102) */
+static RuleNode * build_tree(void) {
+    RuleNode * nodes[3];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        os_calloc(1, sizeof(RuleNode), nodes[i]);
+        os_calloc(1, sizeof(RuleInfo), nodes[i]->ruleinfo);
+        nodes[i]->ruleinfo->sigid = 100 + i;
+    }
+
+    nodes[0]->child = nodes[1];
+    nodes[1]->next = nodes[2];
+    return nodes[0];
+}
+
+static int setup(void **state) {
+    *state = build_tree();
+    return 0;
+}
+
+void test_rule_profile_init(void **state) {
+    RuleNode * parent = *state;
+    RuleInfo unnumbered = { .sigid = 1 };
+
+    assert_int_equal(rule_profile_init(parent), 3);
+    assert_int_equal(parent->ruleinfo->profile_id, 1);
+    assert_int_equal(parent->child->ruleinfo->profile_id, 2);
+    assert_int_equal(parent->child->next->ruleinfo->profile_id, 3);
+
+    /* Numbering again keeps the same IDs */
+    assert_int_equal(rule_profile_init(parent), 3);
+    assert_int_equal(parent->child->next->ruleinfo->profile_id, 3);
+
+    assert_null(rule_profile_local(&unnumbered));
+    assert_null(rule_profile_local(NULL));
+}
+
+void test_rule_profile_report(void **state) {
+    RuleNode * parent = *state;
+    rule_profile_counters * counters;
+    cJSON * report;
+    cJSON * rules;
+    cJSON * top;
+
+    counters = rule_profile_local(parent->ruleinfo);
+    assert_non_null(counters);
+    rule_profile_add(&counters->evaluations, 4);
+    rule_profile_add(&counters->self_ns, 100);
+
+    counters = rule_profile_local(parent->child->next->ruleinfo);
+    rule_profile_add(&counters->evaluations, 2);
+    rule_profile_add(&counters->matches, 1);
+    rule_profile_add(&counters->self_ns, 500);
+    rule_profile_add(&counters->phase_ns[RULE_PROFILE_REGEX], 300);
+
+    report = rule_profile_report(RULE_PROFILE_DEFAULT_TOP);
+    assert_non_null(report);
+    assert_int_equal(cJSON_GetObjectItem(report, "threads")->valueint, 1);
+    assert_int_equal(cJSON_GetObjectItem(report, "total_rules")->valueint, 3);
+
+    /* Rules never evaluated are left out */
+    rules = cJSON_GetObjectItem(report, "rules");
+    assert_int_equal(cJSON_GetArraySize(rules), 2);
+
+    top = cJSON_GetArrayItem(rules, 0);
+    assert_int_equal(cJSON_GetObjectItem(top, "id")->valueint, 102);
+    assert_int_equal(cJSON_GetObjectItem(top, "evaluations")->valueint, 2);
+    assert_int_equal(cJSON_GetObjectItem(top, "matches")->valueint, 1);
+    assert_int_equal(cJSON_GetObjectItem(top, "time_ns")->valueint, 500);
+    assert_int_equal(cJSON_GetObjectItem(top, "regex_ns")->valueint, 300);
+    assert_int_equal(cJSON_GetObjectItem(cJSON_GetArrayItem(rules, 1), "id")->valueint, 100);
+    cJSON_Delete(report);
+
+    report = rule_profile_report(1);
+    assert_int_equal(cJSON_GetArraySize(cJSON_GetObjectItem(report, "rules")), 1);
+    cJSON_Delete(report);
+}
+
+void test_rule_profile_cost_report(void **state) {
+    RuleNode * parent = *state;
+    rule_profile_counters * counters;
+    cJSON * report;
+    cJSON * list;
+    cJSON * item;
+
+    /* On top of the previous test: 100 matched once, 101 never and 102 once */
+    counters = rule_profile_local(parent->ruleinfo);
+    rule_profile_add(&counters->matches, 1);
+
+    counters = rule_profile_local(parent->child->ruleinfo);
+    rule_profile_add(&counters->evaluations, 3);
+    rule_profile_add(&counters->regex_backtracks, 50);
+
+    report = rule_profile_cost_report(parent, RULE_PROFILE_DEFAULT_TOP);
+    assert_non_null(report);
+
+    list = cJSON_GetObjectItem(report, "evaluated");
+    assert_int_equal(cJSON_GetArraySize(list), 3);
+    assert_int_equal(cJSON_GetObjectItem(cJSON_GetArrayItem(list, 0), "id")->valueint, 100);
+    assert_int_equal(cJSON_GetObjectItem(cJSON_GetArrayItem(list, 1), "id")->valueint, 101);
+
+    list = cJSON_GetObjectItem(report, "backtracking");
+    assert_int_equal(cJSON_GetArraySize(list), 1);
+    assert_int_equal(cJSON_GetObjectItem(cJSON_GetArrayItem(list, 0), "regex_backtracks")->valueint, 50);
+
+    /* Top-level rules aren't branches */
+    assert_int_equal(cJSON_GetObjectItem(report, "total_never_matched")->valueint, 1);
+    list = cJSON_GetObjectItem(report, "never_matched");
+    assert_int_equal(cJSON_GetObjectItem(cJSON_GetArrayItem(list, 0), "id")->valueint, 101);
+    assert_int_equal(cJSON_GetObjectItem(report, "total_never_reached")->valueint, 0);
+
+    /* 102 matches more than 101, that comes first */
+    list = cJSON_GetObjectItem(report, "reorder");
+    assert_int_equal(cJSON_GetArraySize(list), 1);
+    item = cJSON_GetArrayItem(list, 0);
+    assert_int_equal(cJSON_GetObjectItem(item, "parent")->valueint, 100);
+    assert_int_equal(cJSON_GetObjectItem(item, "checks_saved")->valueint, 1);
+    assert_int_equal(cJSON_GetArrayItem(cJSON_GetObjectItem(item, "current"), 0)->valueint, 101);
+    assert_int_equal(cJSON_GetArrayItem(cJSON_GetObjectItem(item, "suggested"), 0)->valueint, 102);
+    assert_int_equal(cJSON_GetArrayItem(cJSON_GetObjectItem(item, "suggested"), 1)->valueint, 101);
+    cJSON_Delete(report);
+
+    /* Children of a parent never matched aren't reached */
+    counters = rule_profile_local(parent->ruleinfo);
+    rule_profile_add(&counters->matches, -1);
+    counters = rule_profile_local(parent->child->next->ruleinfo);
+    rule_profile_add(&counters->evaluations, -2);
+    rule_profile_add(&counters->matches, -1);
+
+    report = rule_profile_cost_report(parent, RULE_PROFILE_DEFAULT_TOP);
+    assert_int_equal(cJSON_GetObjectItem(report, "total_never_reached")->valueint, 1);
+    assert_int_equal(cJSON_GetArrayItem(cJSON_GetObjectItem(report, "never_reached"), 0)->valueint, 102);
+    assert_int_equal(cJSON_GetArraySize(cJSON_GetObjectItem(report, "reorder")), 0);
+    cJSON_Delete(report);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_rule_profile_init),
+        cmocka_unit_test(test_rule_profile_report),
+        cmocka_unit_test(test_rule_profile_cost_report),
+    };
+    return cmocka_run_group_tests(tests, setup, NULL);
+}
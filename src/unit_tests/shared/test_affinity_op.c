@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+/* tests */
+
+void test_cpuset_parse_list(void **state)
+{
+    cpu_set_t set;
+
+    assert_int_equal(w_cpuset_parse("0-3,8,10-11", &set), 7);
+    assert_true(CPU_ISSET(0, &set));
+    assert_true(CPU_ISSET(3, &set));
+    assert_false(CPU_ISSET(4, &set));
+    assert_true(CPU_ISSET(8, &set));
+    assert_true(CPU_ISSET(11, &set));
+
+    assert_int_equal(w_cpuset_parse("5", &set), 1);
+    assert_true(CPU_ISSET(5, &set));
+}
+
+void test_cpuset_parse_invalid(void **state)
+{
+    cpu_set_t set;
+
+    assert_int_equal(w_cpuset_parse("", &set), -1);
+    assert_int_equal(w_cpuset_parse("3-1", &set), -1);
+    assert_int_equal(w_cpuset_parse("1-", &set), -1);
+    assert_int_equal(w_cpuset_parse("0,,1", &set), -1);
+    assert_int_equal(w_cpuset_parse("a", &set), -1);
+    assert_int_equal(w_cpuset_parse("0-100000", &set), -1);
+    assert_int_equal(w_cpuset_parse("node:", &set), -1);
+    assert_int_equal(w_cpuset_parse("node:x", &set), -1);
+}
+
+void test_cpuset_parse_node(void **state)
+{
+    cpu_set_t set;
+
+    /* Every Linux system with sysfs has node 0 */
+    if (access("/sys/devices/system/node/node0/cpulist", R_OK) == 0) {
+        assert_true(w_cpuset_parse("node:0", &set) > 0);
+    }
+
+    assert_int_equal(w_cpuset_parse("node:100000", &set), -1);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_cpuset_parse_list),
+        cmocka_unit_test(test_cpuset_parse_invalid),
+        cmocka_unit_test(test_cpuset_parse_node),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
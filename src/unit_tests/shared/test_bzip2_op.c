@@ -51,6 +51,22 @@ int __wrap_fclose() {
     return 0;
 }
 
+extern void __real_rewind(FILE *stream);
+void __wrap_rewind(FILE *stream) {
+    if (unit_testing) {
+        return;
+    }
+    __real_rewind(stream);
+}
+
+extern int __real_ferror(FILE *stream);
+int __wrap_ferror(FILE *stream) {
+    if (unit_testing) {
+        return mock();
+    }
+    return __real_ferror(stream);
+}
+
 BZFILE* __wrap_BZ2_bzWriteOpen(int* bzerror,
                                FILE* f,
                                int blockSize100k,
@@ -450,6 +466,155 @@ void test_bzip2_uncompress_bzReadfail(void **state) {
     assert_int_equal(ret, -1);
 }
 
+void test_bzip2_open_nullfile(void **state) {
+    bzip2_file *bzfile;
+
+    bzfile = bzip2_open(NULL);
+    assert_null(bzfile);
+}
+
+void test_bzip2_open_fopenfail(void **state) {
+    bzip2_file *bzfile;
+    char *string = "testfile";
+
+    expect_value(__wrap_fopen, path, string);
+    expect_string(__wrap_fopen, mode, "rb");
+    will_return(__wrap_fopen, NULL);
+
+    expect_string(__wrap__mdebug2, formatted_msg,
+                  "(1103): Could not open file 'testfile' due to [(0)-(Success)].");
+    bzfile = bzip2_open(string);
+    assert_null(bzfile);
+}
+
+void test_bzip2_open_bzReadOpen(void **state) {
+    bzip2_file *bzfile;
+    char *string = "testfile";
+
+    expect_value(__wrap_fopen, path, string);
+    expect_string(__wrap_fopen, mode, "rb");
+    will_return(__wrap_fopen, 1);
+
+    expect_value(__wrap_BZ2_bzReadOpen, f, 1);
+    will_return(__wrap_BZ2_bzReadOpen, BZ_MEM_ERROR);
+    will_return(__wrap_BZ2_bzReadOpen, NULL);
+    expect_string(__wrap__mdebug2, formatted_msg,
+                  "BZ2_bzReadOpen(-3)'testfile': (0)-Success");
+
+    bzfile = bzip2_open(string);
+    assert_null(bzfile);
+}
+
+void test_bzip2_gets_compressed(void **state) {
+    bzip2_file *bzfile;
+    char buffer[OS_SIZE_128];
+    char *string = "testfile";
+
+    expect_value(__wrap_fopen, path, string);
+    expect_string(__wrap_fopen, mode, "rb");
+    will_return(__wrap_fopen, 1);
+
+    expect_value(__wrap_BZ2_bzReadOpen, f, 1);
+    will_return(__wrap_BZ2_bzReadOpen, BZ_OK);
+    will_return(__wrap_BZ2_bzReadOpen, 3);
+
+    bzfile = bzip2_open(string);
+    assert_non_null(bzfile);
+
+    expect_value(__wrap_BZ2_bzRead, f, 3);
+    will_return(__wrap_BZ2_bzRead, BZ_STREAM_END);
+    will_return(__wrap_BZ2_bzRead, 11);
+    will_return(__wrap_BZ2_bzRead, "line1\nline2");
+
+    assert_string_equal(bzip2_gets(buffer, sizeof(buffer), bzfile), "line1\n");
+    assert_string_equal(bzip2_gets(buffer, sizeof(buffer), bzfile), "line2");
+    assert_null(bzip2_gets(buffer, sizeof(buffer), bzfile));
+    assert_int_equal(bzip2_close(bzfile), 0);
+}
+
+void test_bzip2_gets_long_line(void **state) {
+    bzip2_file *bzfile;
+    char buffer[4];
+    char *string = "testfile";
+
+    expect_value(__wrap_fopen, path, string);
+    expect_string(__wrap_fopen, mode, "rb");
+    will_return(__wrap_fopen, 1);
+
+    expect_value(__wrap_BZ2_bzReadOpen, f, 1);
+    will_return(__wrap_BZ2_bzReadOpen, BZ_OK);
+    will_return(__wrap_BZ2_bzReadOpen, 3);
+
+    bzfile = bzip2_open(string);
+    assert_non_null(bzfile);
+
+    expect_value(__wrap_BZ2_bzRead, f, 3);
+    will_return(__wrap_BZ2_bzRead, BZ_STREAM_END);
+    will_return(__wrap_BZ2_bzRead, 5);
+    will_return(__wrap_BZ2_bzRead, "line1");
+
+    assert_string_equal(bzip2_gets(buffer, sizeof(buffer), bzfile), "lin");
+    assert_string_equal(bzip2_gets(buffer, sizeof(buffer), bzfile), "e1");
+    assert_null(bzip2_gets(buffer, sizeof(buffer), bzfile));
+    assert_int_equal(bzip2_close(bzfile), 0);
+}
+
+void test_bzip2_gets_uncompressed(void **state) {
+    bzip2_file *bzfile;
+    char buffer[OS_SIZE_128];
+    char *string = "testfile";
+
+    expect_value(__wrap_fopen, path, string);
+    expect_string(__wrap_fopen, mode, "rb");
+    will_return(__wrap_fopen, 1);
+
+    expect_value(__wrap_BZ2_bzReadOpen, f, 1);
+    will_return(__wrap_BZ2_bzReadOpen, BZ_OK);
+    will_return(__wrap_BZ2_bzReadOpen, 3);
+
+    bzfile = bzip2_open(string);
+    assert_non_null(bzfile);
+
+    expect_value(__wrap_BZ2_bzRead, f, 3);
+    will_return(__wrap_BZ2_bzRead, BZ_DATA_ERROR_MAGIC);
+    will_return(__wrap_BZ2_bzRead, 0);
+    will_return(__wrap_BZ2_bzRead, "");
+
+    will_return(__wrap_fread, "plain\n");
+    will_return(__wrap_fread, 6);
+    will_return(__wrap_ferror, 0);
+
+    assert_string_equal(bzip2_gets(buffer, sizeof(buffer), bzfile), "plain\n");
+    assert_null(bzip2_gets(buffer, sizeof(buffer), bzfile));
+    assert_int_equal(bzip2_close(bzfile), 0);
+}
+
+void test_bzip2_gets_bzReadfail(void **state) {
+    bzip2_file *bzfile;
+    char buffer[OS_SIZE_128];
+    char *string = "testfile";
+
+    expect_value(__wrap_fopen, path, string);
+    expect_string(__wrap_fopen, mode, "rb");
+    will_return(__wrap_fopen, 1);
+
+    expect_value(__wrap_BZ2_bzReadOpen, f, 1);
+    will_return(__wrap_BZ2_bzReadOpen, BZ_OK);
+    will_return(__wrap_BZ2_bzReadOpen, 3);
+
+    bzfile = bzip2_open(string);
+    assert_non_null(bzfile);
+
+    expect_value(__wrap_BZ2_bzRead, f, 3);
+    will_return(__wrap_BZ2_bzRead, BZ_MEM_ERROR);
+    will_return(__wrap_BZ2_bzRead, 0);
+    will_return(__wrap_BZ2_bzRead, "");
+    expect_string(__wrap__mdebug2, formatted_msg, "BZ2_bzRead(-3): (0)-Success");
+
+    assert_null(bzip2_gets(buffer, sizeof(buffer), bzfile));
+    assert_int_equal(bzip2_close(bzfile), -1);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_bzip2_compress_nullfile),
@@ -467,6 +632,13 @@ int main(void) {
         cmocka_unit_test(test_bzip2_uncompress_bzReadOpen),
         cmocka_unit_test(test_bzip2_uncompress_bzReadsuccess),
         cmocka_unit_test(test_bzip2_uncompress_bzReadfail),
+        cmocka_unit_test(test_bzip2_open_nullfile),
+        cmocka_unit_test(test_bzip2_open_fopenfail),
+        cmocka_unit_test(test_bzip2_open_bzReadOpen),
+        cmocka_unit_test(test_bzip2_gets_compressed),
+        cmocka_unit_test(test_bzip2_gets_long_line),
+        cmocka_unit_test(test_bzip2_gets_uncompressed),
+        cmocka_unit_test(test_bzip2_gets_bzReadfail),
     };
     return cmocka_run_group_tests(tests, setup_group, teardown_group);
 }
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+static char path[] = "/tmp/test_diff_op.XXXXXX";
+
+/* Load a text through a temporary file */
+static void load(w_diff_text_t * text, const char * content) {
+    FILE * fp = fopen(path, "w");
+
+    assert_non_null(fp);
+    fputs(content, fp);
+    fclose(fp);
+    assert_int_equal(w_diff_text_load(text, path, 1024), 0);
+}
+
+static void check_diff(const char * old, const char * new, const char * expected) {
+    w_diff_text_t a;
+    w_diff_text_t b;
+    char buffer[OS_SIZE_1024];
+
+    load(&a, old);
+    load(&b, new);
+    assert_int_equal(w_diff_lines(&a, &b, buffer, sizeof(buffer)), 0);
+    assert_string_equal(buffer, expected);
+    w_diff_text_free(&a);
+    w_diff_text_free(&b);
+}
+
+static int setup(void **state) {
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+static int teardown(void **state) {
+    unlink(path);
+    return 0;
+}
+
+/* tests */
+
+void test_diff_equal(void **state)
+{
+    check_diff("a\nb\n", "a\nb\n", "");
+    check_diff("", "", "");
+}
+
+void test_diff_change(void **state)
+{
+    check_diff("a\nb\nc\n", "a\nB\nc\n", "2c2\n< b\n---\n> B\n");
+    check_diff("a\nb\nc\nd\n", "a\nx\ny\nd\n", "2,3c2,3\n< b\n< c\n---\n> x\n> y\n");
+}
+
+void test_diff_add_delete(void **state)
+{
+    check_diff("a\nc\n", "a\nb\nc\n", "1a2\n> b\n");
+    check_diff("a\nb\nc\n", "a\n", "2,3d1\n< b\n< c\n");
+    check_diff("", "a\n", "0a1\n> a\n");
+    check_diff("a\nb\nc\nd\ne\n", "b\nc\nx\ne\nf\n", "1d0\n< a\n4c3\n< d\n---\n> x\n5a5\n> f\n");
+}
+
+void test_diff_no_newline(void **state)
+{
+    check_diff("a\nb\n", "a\nb", "2c2\n< b\n---\n> b\n\\ No newline at end of file\n");
+}
+
+void test_diff_binary(void **state)
+{
+    w_diff_text_t a;
+    w_diff_text_t b;
+    char buffer[OS_SIZE_128];
+
+    load(&a, "a\n");
+    load(&b, "b\n");
+    b.data[1] = '\0';
+    assert_int_equal(w_diff_lines(&a, &b, buffer, sizeof(buffer)), 0);
+    assert_string_equal(buffer, "Binary files differ\n");
+    w_diff_text_free(&a);
+    w_diff_text_free(&b);
+}
+
+void test_diff_truncated(void **state)
+{
+    w_diff_text_t a;
+    w_diff_text_t b;
+    char buffer[16];
+
+    load(&a, "a\nb\nc\n");
+    load(&b, "x\ny\nz\n");
+
+    /* Only whole lines */
+    assert_int_equal(w_diff_lines(&a, &b, buffer, sizeof(buffer)), 1);
+    assert_string_equal(buffer, "1,3c1,3\n< a\n");
+    w_diff_text_free(&a);
+    w_diff_text_free(&b);
+}
+
+void test_diff_load_gzip(void **state)
+{
+    w_diff_text_t a;
+    w_diff_text_t b;
+
+    load(&a, "a\nb\n");
+    assert_int_equal(w_diff_text_save(&a, path), 0);
+
+    assert_int_equal(w_diff_text_load(&b, path, 1024), 0);
+    assert_int_equal(b.count, 2);
+    assert_true(w_diff_text_equal(&a, &b));
+    w_diff_text_free(&b);
+
+    assert_int_equal(w_diff_text_load(&b, path, 3), 1);
+    assert_int_equal(w_diff_text_load(&b, "/nonexistent/file", 1024), -1);
+    w_diff_text_free(&a);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_diff_equal),
+        cmocka_unit_test(test_diff_change),
+        cmocka_unit_test(test_diff_add_delete),
+        cmocka_unit_test(test_diff_no_newline),
+        cmocka_unit_test(test_diff_binary),
+        cmocka_unit_test(test_diff_truncated),
+        cmocka_unit_test(test_diff_load_gzip),
+    };
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
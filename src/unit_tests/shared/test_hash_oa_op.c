@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../headers/shared.h"
+
+#define N_KEYS 5000
+#define N_THREADS 4
+
+typedef struct thread_args {
+    OSHashOA * hash;
+    int id;
+} thread_args;
+
+static int freed;
+
+/* auxiliary */
+
+static void count_free(void * data) {
+    freed++;
+}
+
+static void count_key(const char * key, void * data, void * arg) {
+    assert_string_equal(key, (char *)data);
+    (*(int *)arg)++;
+}
+
+static char * key_n(int n) {
+    static __thread char key[32];
+
+    snprintf(key, sizeof(key), "key-%d", n);
+    return key;
+}
+
+static void * add_keys(void * arg) {
+    thread_args * args = arg;
+    int i;
+
+    for (i = args->id; i < N_KEYS; i += N_THREADS) {
+        int result = OSHashOA_Add(args->hash, key_n(i), (void *)(intptr_t)(i + 1));
+
+        if (result != 2) {
+            return (void *)1;
+        }
+
+        if ((intptr_t)OSHashOA_Get(args->hash, key_n(i)) != i + 1) {
+            return (void *)1;
+        }
+    }
+
+    return NULL;
+}
+
+/* tests */
+
+void test_hash64(void **state) {
+    char buffer[100];
+    size_t len;
+
+    memset(buffer, 'a', sizeof(buffer));
+
+    /* Stable for a seed, different across seeds and lengths */
+    for (len = 0; len < sizeof(buffer); len++) {
+        assert_true(w_hash64(buffer, len, 1) == w_hash64(buffer, len, 1));
+        assert_true(w_hash64(buffer, len, 1) != w_hash64(buffer, len, 2));
+        assert_true(w_hash64(buffer, len, 1) != w_hash64(buffer, len + 1, 1));
+    }
+
+    assert_true(w_hash64("key-1", 5, 0) != w_hash64("key-2", 5, 0));
+}
+
+void test_hash_oa_add_get(void **state) {
+    OSHashOA * hash = OSHashOA_Create(0);
+
+    assert_int_equal(OSHashOA_Add(hash, "a", "first"), 2);
+    assert_int_equal(OSHashOA_Add(hash, "a", "second"), 1);
+    assert_string_equal(OSHashOA_Get(hash, "a"), "first");
+    assert_null(OSHashOA_Get(hash, "b"));
+
+    assert_int_equal(OSHashOA_Set(hash, "a", "third"), 1);
+    assert_int_equal(OSHashOA_Set(hash, "b", "fourth"), 2);
+    assert_string_equal(OSHashOA_Get(hash, "a"), "third");
+    assert_string_equal(OSHashOA_Get(hash, "b"), "fourth");
+    assert_int_equal(OSHashOA_Get_Elem(hash), 2);
+
+    assert_int_equal(OSHashOA_Update(hash, "c", "fifth"), 0);
+
+    assert_string_equal(OSHashOA_Delete(hash, "a"), "third");
+    assert_null(OSHashOA_Delete(hash, "a"));
+    assert_null(OSHashOA_Get(hash, "a"));
+    assert_int_equal(OSHashOA_Get_Elem(hash), 1);
+
+    OSHashOA_Free(hash);
+}
+
+void test_hash_oa_update_free(void **state) {
+    OSHashOA * hash = OSHashOA_Create(4);
+    char * data;
+
+    OSHashOA_SetFreeDataPointer(hash, count_free);
+    freed = 0;
+
+    os_strdup("data", data);
+    assert_int_equal(OSHashOA_Add(hash, "key", data), 2);
+    assert_int_equal(OSHashOA_Update(hash, "key", data), 1);
+    assert_int_equal(freed, 1);
+
+    OSHashOA_Add(hash, "other", data);
+    OSHashOA_Free(hash);
+    assert_int_equal(freed, 3);
+    free(data);
+}
+
+void test_hash_oa_grow(void **state) {
+    OSHashOA * hash = OSHashOA_Create(0);
+    int count = 0;
+    int round;
+    int i;
+
+    for (i = 0; i < N_KEYS; i++) {
+        assert_int_equal(OSHashOA_Add(hash, key_n(i), strdup(key_n(i))), 2);
+    }
+
+    OSHashOA_SetFreeDataPointer(hash, free);
+    assert_int_equal(OSHashOA_Get_Elem(hash), N_KEYS);
+
+    /* Churn leaves deleted slots behind, they must be reused */
+    for (round = 0; round < 10; round++) {
+        for (i = 0; i < N_KEYS; i += 2) {
+            free(OSHashOA_Delete(hash, key_n(i)));
+        }
+
+        for (i = 0; i < N_KEYS; i += 2) {
+            assert_int_equal(OSHashOA_Add(hash, key_n(i), strdup(key_n(i))), 2);
+        }
+    }
+
+    for (i = 0; i < N_KEYS; i++) {
+        assert_string_equal(OSHashOA_Get(hash, key_n(i)), key_n(i));
+    }
+
+    assert_null(OSHashOA_Get(hash, key_n(N_KEYS)));
+    assert_true(hash->tables[0].capacity <= 4 * N_KEYS);
+
+    OSHashOA_It(hash, &count, count_key);
+    assert_int_equal(count, N_KEYS);
+
+    OSHashOA_Free(hash);
+}
+
+void test_hash_oa_striped(void **state) {
+    OSHashOA * hash = OSHashOA_Create(8);
+    thread_args args[N_THREADS];
+    pthread_t threads[N_THREADS];
+    void * result;
+    int i;
+
+    for (i = 0; i < N_THREADS; i++) {
+        args[i].hash = hash;
+        args[i].id = i;
+        assert_int_equal(pthread_create(&threads[i], NULL, add_keys, &args[i]), 0);
+    }
+
+    for (i = 0; i < N_THREADS; i++) {
+        pthread_join(threads[i], &result);
+        assert_null(result);
+    }
+
+    assert_int_equal(OSHashOA_Get_Elem(hash), N_KEYS);
+
+    for (i = 0; i < N_KEYS; i++) {
+        assert_int_equal((intptr_t)OSHashOA_Get(hash, key_n(i)), i + 1);
+    }
+
+    OSHashOA_Free(hash);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_hash64),
+        cmocka_unit_test(test_hash_oa_add_get),
+        cmocka_unit_test(test_hash_oa_update_free),
+        cmocka_unit_test(test_hash_oa_grow),
+        cmocka_unit_test(test_hash_oa_striped),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../headers/shared.h"
+
+#define N_KEYS 5000
+#define N_READERS 4
+#define N_STABLE 100
+
+static int running;
+
+/* auxiliary */
+
+static char * key_n(int n) {
+    static __thread char key[32];
+
+    snprintf(key, sizeof(key), "key-%d", n);
+    return key;
+}
+
+/* The stable keys are always there, the others come and go */
+static void * read_keys(void * arg) {
+    OSHash * hash = arg;
+    long failures = 0;
+    int i = 0;
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        failures += (intptr_t)OSHash_Get_ex(hash, key_n(i % N_STABLE)) != i % N_STABLE + 1;
+        OSHash_Get_ex(hash, key_n(N_STABLE + i % N_KEYS));
+        i++;
+    }
+
+    return (void *)failures;
+}
+
+/* tests */
+
+void test_oshash_keys(void **state) {
+    OSHash * hash = OSHash_Create();
+    int i;
+
+    assert_non_null(hash);
+    assert_int_not_equal(OSHash_setSize(hash, 1024), 0);
+
+    for (i = 0; i < N_KEYS; i++) {
+        assert_int_equal(OSHash_Add(hash, key_n(i), (void *)(intptr_t)(i + 1)), 2);
+    }
+
+    for (i = 0; i < N_KEYS; i++) {
+        assert_int_equal((intptr_t)OSHash_Get(hash, key_n(i)), i + 1);
+    }
+
+    assert_int_equal((intptr_t)OSHash_Delete(hash, key_n(0)), 1);
+    assert_null(OSHash_Get(hash, key_n(0)));
+
+    OSHash_Free(hash);
+}
+
+void test_oshash_rcu(void **state) {
+    OSHash * hash = OSHash_Create();
+
+    OSHash_SetRCU(hash);
+
+    /* The size is fixed in read-optimized mode */
+    assert_int_equal(OSHash_setSize(hash, 1024), 0);
+
+    assert_int_equal(OSHash_Add_ex(hash, "a", "first"), 2);
+    assert_int_equal(OSHash_Update_ex(hash, "a", "second"), 1);
+    assert_string_equal(OSHash_Get_ex(hash, "a"), "second");
+    assert_string_equal(OSHash_Delete_ex(hash, "a"), "second");
+    assert_null(OSHash_Get_ex(hash, "a"));
+    assert_int_equal(hash->n_retired, 1);
+
+    OSHash_Free(hash);
+}
+
+void test_oshash_rcu_readers(void **state) {
+    OSHash * hash = OSHash_Create();
+    pthread_t threads[N_READERS];
+    void * failures;
+    int round;
+    int i;
+
+    OSHash_SetRCU(hash);
+
+    for (i = 0; i < N_STABLE; i++) {
+        OSHash_Add_ex(hash, key_n(i), (void *)(intptr_t)(i + 1));
+    }
+
+    running = 1;
+
+    for (i = 0; i < N_READERS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, read_keys, hash), 0);
+    }
+
+    /* Deleted nodes are freed in batches while the readers go through the chains */
+    for (round = 0; round < 4; round++) {
+        for (i = N_STABLE; i < N_STABLE + N_KEYS; i++) {
+            OSHash_Add_ex(hash, key_n(i), (void *)(intptr_t)(i + 1));
+        }
+
+        for (i = N_STABLE; i < N_STABLE + N_KEYS; i++) {
+            assert_int_equal((intptr_t)OSHash_Delete_ex(hash, key_n(i)), i + 1);
+        }
+    }
+
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+    for (i = 0; i < N_READERS; i++) {
+        pthread_join(threads[i], &failures);
+        assert_int_equal((long)failures, 0);
+    }
+
+    assert_int_equal(OSHash_Get_Elem_ex(hash), N_STABLE);
+    OSHash_Free(hash);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_oshash_keys),
+        cmocka_unit_test(test_oshash_rcu),
+        cmocka_unit_test(test_oshash_rcu_readers),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../headers/shared.h"
+
+#define N_STRINGS 1000
+#define N_THREADS 4
+
+/* auxiliary */
+
+static void * intern_strings(void * arg) {
+    char str[32];
+    const char * interned[N_STRINGS];
+    int i;
+
+    for (i = 0; i < N_STRINGS; i++) {
+        snprintf(str, sizeof(str), "agent-%d", i);
+        interned[i] = w_intern(str);
+    }
+
+    for (i = 0; i < N_STRINGS; i++) {
+        snprintf(str, sizeof(str), "agent-%d", i);
+
+        if (strcmp(interned[i], str) != 0 || w_intern(str) != interned[i]) {
+            return (void *)1;
+        }
+
+        w_intern_release(interned[i]);
+        w_intern_release(interned[i]);
+    }
+
+    return NULL;
+}
+
+/* tests */
+
+void test_intern_same_pointer(void **state) {
+    char location[] = "/var/log/syslog";
+    const char * a = w_intern(location);
+    const char * b = w_intern("/var/log/syslog");
+    const char * c = w_intern("/var/log/messages");
+
+    assert_ptr_not_equal(a, location);
+    assert_ptr_equal(a, b);
+    assert_ptr_not_equal(a, c);
+    assert_string_equal(a, location);
+    assert_int_equal(w_intern_count(), 2);
+
+    w_intern_release(a);
+    assert_int_equal(w_intern_count(), 2);
+    w_intern_release(b);
+    w_intern_release(c);
+    assert_int_equal(w_intern_count(), 0);
+}
+
+void test_intern_null(void **state) {
+    assert_null(w_intern(NULL));
+    w_intern_release(NULL);
+}
+
+void test_intern_threads(void **state) {
+    pthread_t threads[N_THREADS];
+    void * result;
+    int i;
+
+    for (i = 0; i < N_THREADS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, intern_strings, NULL), 0);
+    }
+
+    for (i = 0; i < N_THREADS; i++) {
+        pthread_join(threads[i], &result);
+        assert_null(result);
+    }
+
+    assert_int_equal(w_intern_count(), 0);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_intern_same_pointer),
+        cmocka_unit_test(test_intern_null),
+        cmocka_unit_test(test_intern_threads),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
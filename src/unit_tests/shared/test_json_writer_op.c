@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+/* setup/teardowns */
+
+static int setup_writer(void **state)
+{
+    w_json_writer_t * writer;
+
+    os_calloc(1, sizeof(w_json_writer_t), writer);
+    *state = writer;
+    return 0;
+}
+
+static int teardown_writer(void **state)
+{
+    w_json_writer_t * writer = *state;
+
+    w_json_writer_free(writer);
+    os_free(writer);
+    return 0;
+}
+
+/* tests */
+
+void test_json_writer_members(void **state)
+{
+    w_json_writer_t * writer = *state;
+
+    w_json_writer_reset(writer);
+    w_json_open_object(writer, NULL);
+    w_json_add_string(writer, "a", "x");
+    w_json_add_string(writer, "null", NULL);
+    w_json_add_number(writer, "n", -12);
+    w_json_add_bool(writer, "t", 1);
+    w_json_open_array(writer, "list");
+    w_json_add_string(writer, NULL, "y");
+    w_json_add_number(writer, NULL, 3);
+    w_json_open_object(writer, NULL);
+    w_json_close_object(writer);
+    w_json_close_array(writer);
+    w_json_add_key_n(writer, "key.sub", 3);
+    w_json_add_string_n(writer, NULL, "value", 2);
+    w_json_add_raw(writer, "raw", "{\"b\":false}");
+    w_json_close_object(writer);
+
+    assert_string_equal(w_json_writer_str(writer),
+        "{\"a\":\"x\",\"n\":-12,\"t\":true,\"list\":[\"y\",3,{}],\"key\":\"va\",\"raw\":{\"b\":false}}");
+}
+
+void test_json_writer_escape(void **state)
+{
+    w_json_writer_t * writer = *state;
+
+    w_json_writer_reset(writer);
+    w_json_open_object(writer, NULL);
+    w_json_add_string(writer, "k\"", "\"\\/\b\f\n\r\t\x01\x1f\x7f\xc3\xb1");
+    w_json_close_object(writer);
+
+    /* Same output as cJSON_PrintUnformatted() */
+    assert_string_equal(w_json_writer_str(writer),
+        "{\"k\\\"\":\"\\\"\\\\/\\b\\f\\n\\r\\t\\u0001\\u001f\x7f\xc3\xb1\"}");
+}
+
+void test_json_writer_drop_empty(void **state)
+{
+    w_json_writer_t * writer = *state;
+    size_t mark;
+
+    w_json_writer_reset(writer);
+    w_json_open_object(writer, NULL);
+    w_json_add_string(writer, "a", "x");
+
+    mark = writer->length;
+    w_json_open_object(writer, "empty");
+    assert_int_equal(w_json_drop_empty(writer, mark), 1);
+
+    mark = writer->length;
+    w_json_open_array(writer, "full");
+    w_json_add_string(writer, NULL, "y");
+    assert_int_equal(w_json_drop_empty(writer, mark), 0);
+    w_json_close_array(writer);
+
+    w_json_add_string(writer, "b", "z");
+    w_json_close_object(writer);
+
+    assert_string_equal(w_json_writer_str(writer), "{\"a\":\"x\",\"full\":[\"y\"],\"b\":\"z\"}");
+}
+
+void test_json_writer_grow(void **state)
+{
+    w_json_writer_t * writer = *state;
+    char * value;
+    char * expected;
+    size_t size;
+    int i;
+
+    os_malloc(OS_SIZE_65536 + 1, value);
+    memset(value, 'a', OS_SIZE_65536);
+    value[OS_SIZE_65536] = '\0';
+
+    w_json_writer_reset(writer);
+    w_json_add_string(writer, NULL, value);
+    assert_int_equal(strlen(w_json_writer_str(writer)), OS_SIZE_65536 + 2);
+    size = writer->size;
+
+    /* A reset keeps the buffer */
+    for (i = 0; i < 4; i++) {
+        w_json_writer_reset(writer);
+        w_json_add_string(writer, NULL, value);
+        assert_int_equal(writer->size, size);
+    }
+
+    os_malloc(OS_SIZE_65536 + 3, expected);
+    snprintf(expected, OS_SIZE_65536 + 3, "\"%s\"", value);
+    assert_string_equal(w_json_writer_str(writer), expected);
+
+    os_free(expected);
+    os_free(value);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_json_writer_members),
+        cmocka_unit_test(test_json_writer_escape),
+        cmocka_unit_test(test_json_writer_drop_empty),
+        cmocka_unit_test(test_json_writer_grow),
+    };
+    return cmocka_run_group_tests(tests, setup_writer, teardown_writer);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+#define LANES 4
+#define ITEMS 20000
+#define WORKERS 3
+
+typedef struct lane_state_t {
+    uintptr_t last;
+    size_t count;
+    int inside;
+    int overlaps;
+    int unordered;
+} lane_state_t;
+
+static void work(w_lane_t * lane, void ** items, size_t n)
+{
+    lane_state_t * state = lane->context;
+    size_t i;
+
+    if (__atomic_add_fetch(&state->inside, 1, __ATOMIC_SEQ_CST) > 1) {
+        state->overlaps++;
+    }
+
+    for (i = 0; i < n; i++) {
+        if ((uintptr_t)items[i] != state->last + 1) {
+            state->unordered++;
+        }
+
+        state->last = (uintptr_t)items[i];
+    }
+
+    __atomic_add_fetch(&state->count, n, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&state->inside, 1, __ATOMIC_SEQ_CST);
+}
+
+static void nothing(w_lane_t * lane, void ** items, size_t n)
+{
+}
+
+/* tests */
+
+void test_lane_pool_take(void **state)
+{
+    w_lane_pool_t pool;
+    w_mpmc_queue_t * small = mpmc_queue_init(16);
+    w_mpmc_queue_t * big = mpmc_queue_init(1024);
+    w_lane_t * event = w_lane_init(big, nothing, NULL, 4);
+    w_lane_t * inventory = w_lane_init(small, nothing, NULL, 1);
+    int i;
+
+    w_lane_pool_init(&pool);
+    w_lane_pool_add(&pool, event);
+    w_lane_pool_add(&pool, inventory);
+
+    assert_null(w_lane_pool_take(&pool, 0));
+
+    /* A half-full small queue beats a big one with more items */
+    for (i = 1; i <= 8; i++) {
+        mpmc_queue_push_ex(small, (void *)(uintptr_t)i);
+    }
+
+    for (i = 1; i <= 32; i++) {
+        mpmc_queue_push_ex(big, (void *)(uintptr_t)i);
+    }
+
+    assert_ptr_equal(w_lane_pool_take(&pool, 0), inventory);
+
+    /* A held lane is skipped */
+    assert_ptr_equal(w_lane_pool_take(&pool, 0), event);
+    assert_null(w_lane_pool_take(&pool, 0));
+    assert_int_equal(pool.busy, 2);
+
+    w_lane_pool_release(&pool, inventory);
+    assert_ptr_equal(w_lane_pool_take(&pool, 1), inventory);
+}
+
+void test_lane_pool_workers(void **state)
+{
+    w_lane_pool_t pool;
+    w_mpmc_queue_t * queues[LANES];
+    lane_state_t lanes[LANES];
+    pthread_t thread;
+    uintptr_t i;
+    int j;
+
+    memset(lanes, 0, sizeof(lanes));
+    w_lane_pool_init(&pool);
+
+    for (j = 0; j < LANES; j++) {
+        queues[j] = mpmc_queue_init(256);
+        w_lane_pool_add(&pool, w_lane_init(queues[j], work, &lanes[j], j + 1));
+    }
+
+    for (j = 0; j < WORKERS; j++) {
+        assert_int_equal(pthread_create(&thread, NULL, w_lane_pool_main, &pool), 0);
+        pthread_detach(thread);
+    }
+
+    for (i = 1; i <= ITEMS; i++) {
+        for (j = 0; j < LANES; j++) {
+            mpmc_queue_push_ex_block(queues[j], (void *)i);
+        }
+    }
+
+    for (j = 0; j < LANES; j++) {
+        while (__atomic_load_n(&lanes[j].count, __ATOMIC_SEQ_CST) < ITEMS) {
+            usleep(1000);
+        }
+
+        /* Each lane is served by one thread at a time, in order */
+        assert_int_equal(lanes[j].overlaps, 0);
+        assert_int_equal(lanes[j].unordered, 0);
+    }
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_lane_pool_take),
+        cmocka_unit_test(test_lane_pool_workers),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+#define THREADS 8
+#define ITERATIONS 100000
+
+static double read_depth(void * arg)
+{
+    return *(int *)arg;
+}
+
+static void * add_values(void * arg)
+{
+    w_metric_t * metric = arg;
+    int i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        w_metrics_inc(metric);
+    }
+
+    return NULL;
+}
+
+/* tests */
+
+void test_metrics_counter_threads(void **state)
+{
+    pthread_t threads[THREADS];
+    w_metric_t * metric = w_metrics_counter("test_threads", "Test.", NULL);
+    int i;
+
+    for (i = 0; i < THREADS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, add_values, metric), 0);
+    }
+
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    assert_int_equal(w_metrics_value(metric), THREADS * ITERATIONS);
+}
+
+void test_metrics_register_twice(void **state)
+{
+    w_metric_t * first = w_metrics_counter("test_twice", "Test.", "queue=\"a\"");
+    w_metric_t * second = w_metrics_counter("test_twice", "Test.", "queue=\"b\"");
+
+    assert_ptr_equal(w_metrics_counter("test_twice", "Test.", "queue=\"a\""), first);
+    assert_ptr_not_equal(first, second);
+
+    w_metrics_add(first, 3);
+    assert_int_equal(w_metrics_value(second), 0);
+}
+
+void test_metrics_gauge(void **state)
+{
+    int depth = 12;
+    w_metric_t * metric = w_metrics_gauge("test_gauge", "Test.", NULL, NULL, NULL);
+    w_metric_t * callback = w_metrics_gauge("test_gauge_read", "Test.", NULL, read_depth, &depth);
+
+    w_metrics_set(metric, 5);
+    assert_int_equal(w_metrics_value(metric), 5);
+    assert_int_equal(w_metrics_value(callback), 12);
+}
+
+void test_metrics_percentile(void **state)
+{
+    w_metric_t * metric = w_metrics_histogram("test_latency", "Test.", NULL);
+    uint64_t value;
+    int i;
+
+    assert_int_equal(w_metrics_percentile(metric, 0.5), 0);
+
+    for (i = 0; i < 99; i++) {
+        w_metrics_observe(metric, 100);
+    }
+
+    w_metrics_observe(metric, 100000);
+
+    assert_int_equal(w_metrics_value(metric), 100);
+
+    /* Buckets are 1/8 of a power of two wide */
+    value = w_metrics_percentile(metric, 0.5);
+    assert_true(value >= 100 && value <= 112);
+    value = w_metrics_percentile(metric, 1);
+    assert_true(value >= 100000 && value <= 112000);
+}
+
+void test_metrics_render(void **state)
+{
+    w_metric_t * metric = w_metrics_counter("test_render", "Rendered.", "queue=\"event\"");
+    w_metric_t * latency = w_metrics_histogram("test_render_seconds", "Rendered.", NULL);
+    char * output;
+
+    w_metrics_add(metric, 7);
+    w_metrics_observe(latency, 3);
+
+    output = w_metrics_render();
+
+    assert_non_null(strstr(output, "# TYPE test_render counter\n# HELP test_render Rendered.\n"));
+    assert_non_null(strstr(output, "test_render_total{queue=\"event\"} 7\n"));
+    assert_non_null(strstr(output, "test_render_seconds_bucket{le=\"2e-06\"} 0\n"));
+    assert_non_null(strstr(output, "test_render_seconds_bucket{le=\"4e-06\"} 1\n"));
+    assert_non_null(strstr(output, "test_render_seconds_bucket{le=\"+Inf\"} 1\n"));
+    assert_non_null(strstr(output, "test_render_seconds_count 1\n"));
+    assert_string_equal(output + strlen(output) - 6, "# EOF\n");
+
+    free(output);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_metrics_counter_threads),
+        cmocka_unit_test(test_metrics_register_twice),
+        cmocka_unit_test(test_metrics_gauge),
+        cmocka_unit_test(test_metrics_percentile),
+        cmocka_unit_test(test_metrics_render),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
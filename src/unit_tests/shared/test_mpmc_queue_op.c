@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 10000
+
+/* setup/teardowns */
+
+static int create_queue(void **state)
+{
+    *state = mpmc_queue_init(6);
+    return 0;
+}
+
+static int delete_queue(void **state)
+{
+    mpmc_queue_free(*state);
+    return 0;
+}
+
+/* auxiliary */
+
+static void * push_items(void * arg)
+{
+    w_mpmc_queue_t * queue = arg;
+    uintptr_t i;
+
+    for (i = 1; i <= ITEMS_PER_PRODUCER; i++) {
+        mpmc_queue_push_ex_block(queue, (void *)i);
+    }
+
+    return NULL;
+}
+
+/* tests */
+
+void test_mpmc_queue_init_rounds_size(void **state)
+{
+    w_mpmc_queue_t * queue = *state;
+
+    assert_int_equal(queue->size, 8);
+    assert_int_equal(queue->mask, 7);
+    assert_true(mpmc_queue_empty(queue));
+    assert_int_equal(mpmc_queue_elements(queue), 0);
+}
+
+void test_mpmc_queue_fifo_order(void **state)
+{
+    w_mpmc_queue_t * queue = *state;
+    char items[3][8] = { "first", "second", "third" };
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        assert_int_equal(mpmc_queue_push_ex(queue, items[i]), 0);
+    }
+
+    assert_int_equal(mpmc_queue_elements(queue), 3);
+
+    for (i = 0; i < 3; i++) {
+        assert_ptr_equal(mpmc_queue_pop_ex(queue), items[i]);
+    }
+
+    assert_null(mpmc_queue_pop(queue));
+}
+
+void test_mpmc_queue_push_full(void **state)
+{
+    w_mpmc_queue_t * queue = *state;
+    int item;
+    size_t i;
+
+    for (i = 0; i < queue->size; i++) {
+        assert_int_equal(mpmc_queue_push_ex(queue, &item), 0);
+    }
+
+    assert_true(mpmc_queue_full(queue));
+    assert_int_equal(mpmc_queue_push_ex(queue, &item), -1);
+
+    assert_ptr_equal(mpmc_queue_pop(queue), &item);
+    assert_int_equal(mpmc_queue_push_ex(queue, &item), 0);
+}
+
+void test_mpmc_queue_high_water(void **state)
+{
+    w_mpmc_queue_t * queue = *state;
+    int item;
+
+    assert_int_equal(mpmc_queue_take_high_water(queue), 0);
+
+    assert_int_equal(mpmc_queue_push_ex(queue, &item), 0);
+    assert_int_equal(mpmc_queue_push_ex(queue, &item), 0);
+    assert_int_equal(mpmc_queue_push_ex(queue, &item), 0);
+    mpmc_queue_pop(queue);
+    mpmc_queue_pop(queue);
+    assert_int_equal(mpmc_queue_push_ex(queue, &item), 0);
+
+    /* The peak is kept after the pops, and restarts from the current usage */
+    assert_int_equal(mpmc_queue_take_high_water(queue), 3);
+    assert_int_equal(mpmc_queue_take_high_water(queue), 2);
+}
+
+void test_mpmc_queue_timedwait_empty(void **state)
+{
+    w_mpmc_queue_t * queue = *state;
+    struct timespec abstime;
+
+    clock_gettime(CLOCK_REALTIME, &abstime);
+    abstime.tv_nsec += 1000000;
+
+    if (abstime.tv_nsec >= 1000000000) {
+        abstime.tv_sec++;
+        abstime.tv_nsec -= 1000000000;
+    }
+
+    assert_null(mpmc_queue_pop_ex_timedwait(queue, &abstime));
+}
+
+void test_mpmc_queue_batch(void **state)
+{
+    w_mpmc_queue_t * queue = *state;
+    char items[5][8] = { "a", "b", "c", "d", "e" };
+    void * in[5] = { items[0], items[1], items[2], items[3], items[4] };
+    void * out[8];
+    size_t n;
+
+    assert_int_equal(mpmc_queue_push_ex_batch(queue, in, 5), 0);
+
+    n = mpmc_queue_pop_ex_batch(queue, out, 3, NULL);
+    assert_int_equal(n, 3);
+    assert_ptr_equal(out[0], items[0]);
+    assert_ptr_equal(out[2], items[2]);
+
+    n = mpmc_queue_pop_ex_batch(queue, out, 8, NULL);
+    assert_int_equal(n, 2);
+    assert_ptr_equal(out[0], items[3]);
+    assert_ptr_equal(out[1], items[4]);
+    assert_true(mpmc_queue_empty(queue));
+}
+
+void test_mpmc_queue_multiple_producers(void **state)
+{
+    w_mpmc_queue_t * queue = *state;
+    pthread_t threads[PRODUCERS];
+    uintptr_t sum = 0;
+    int i;
+
+    for (i = 0; i < PRODUCERS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, push_items, queue), 0);
+    }
+
+    for (i = 0; i < PRODUCERS * ITEMS_PER_PRODUCER; i++) {
+        sum += (uintptr_t)mpmc_queue_pop_ex(queue);
+    }
+
+    for (i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    assert_int_equal(sum, (uintptr_t)PRODUCERS * ITEMS_PER_PRODUCER * (ITEMS_PER_PRODUCER + 1) / 2);
+    assert_true(mpmc_queue_empty(queue));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_mpmc_queue_init_rounds_size, create_queue, delete_queue),
+        cmocka_unit_test_setup_teardown(test_mpmc_queue_fifo_order, create_queue, delete_queue),
+        cmocka_unit_test_setup_teardown(test_mpmc_queue_push_full, create_queue, delete_queue),
+        cmocka_unit_test_setup_teardown(test_mpmc_queue_high_water, create_queue, delete_queue),
+        cmocka_unit_test_setup_teardown(test_mpmc_queue_timedwait_empty, create_queue, delete_queue),
+        cmocka_unit_test_setup_teardown(test_mpmc_queue_batch, create_queue, delete_queue),
+        cmocka_unit_test_setup_teardown(test_mpmc_queue_multiple_producers, create_queue, delete_queue),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "../headers/shared.h"
+#include "../os_net/os_net.h"
+
+/* tests */
+
+void test_secure_tcp_roundtrip(void **state)
+{
+    char buffer[OS_SIZE_256];
+    int fds[2];
+
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    assert_int_equal(OS_SendSecureTCP(fds[0], 5, "hello"), 0);
+    assert_int_equal(OS_RecvSecureTCP(fds[1], buffer, sizeof(buffer)), 5);
+    assert_string_equal(buffer, "hello");
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void test_secure_tcp_batch(void **state)
+{
+    char * msgs[] = { "first", "", "third message" };
+    uint32_t sizes[] = { 5, 0, 13 };
+    os_secure_reader_t reader;
+    char * received[4];
+    uint32_t lengths[4];
+    int fds[2];
+
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    OS_SecureReaderInit(&reader, OS_SIZE_256);
+
+    assert_int_equal(OS_SendSecureTCPBatch(fds[0], msgs, sizes, 3), 0);
+    assert_int_equal(OS_SendSecureTCP(fds[0], 4, "last"), 0);
+
+    // All the messages arrive with a single read, and are returned n at a time
+    assert_int_equal(OS_RecvSecureTCPBatch(fds[1], &reader, received, lengths, 2), 2);
+    assert_int_equal(lengths[0], 5);
+    assert_string_equal(received[0], "first");
+    assert_int_equal(lengths[1], 0);
+    assert_string_equal(received[1], "");
+    assert_true(OS_SecureReaderPending(&reader));
+
+    assert_int_equal(OS_RecvSecureTCPBatch(fds[1], &reader, received, lengths, 4), 2);
+    assert_string_equal(received[0], "third message");
+    assert_string_equal(received[1], "last");
+    assert_false(OS_SecureReaderPending(&reader));
+
+    close(fds[0]);
+    assert_int_equal(OS_RecvSecureTCPBatch(fds[1], &reader, received, lengths, 4), 0);
+
+    close(fds[1]);
+    OS_SecureReaderFree(&reader);
+}
+
+void test_secure_tcp_batch_partial(void **state)
+{
+    os_secure_reader_t reader;
+    char * received[2];
+    uint32_t lengths[2];
+    uint32_t header = wnet_order(6);
+    int fds[2];
+
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    OS_SecureReaderInit(&reader, 8);
+
+    // A message cut between reads is completed by the next one
+    assert_int_equal(OS_SendSecureTCP(fds[0], 3, "abc"), 0);
+    assert_int_equal(send(fds[0], &header, 3, 0), 3);
+
+    assert_int_equal(OS_RecvSecureTCPBatch(fds[1], &reader, received, lengths, 2), 1);
+    assert_string_equal(received[0], "abc");
+    assert_false(OS_SecureReaderPending(&reader));
+
+    assert_int_equal(send(fds[0], (char *)&header + 3, 1, 0), 1);
+    assert_int_equal(send(fds[0], "abcdef", 6, 0), 6);
+
+    assert_int_equal(OS_RecvSecureTCPBatch(fds[1], &reader, received, lengths, 2), 1);
+    assert_int_equal(lengths[0], 6);
+    assert_string_equal(received[0], "abcdef");
+
+    // A message bigger than the reader is rejected
+    assert_int_equal(OS_SendSecureTCP(fds[0], 9, "123456789"), 0);
+    assert_int_equal(OS_RecvSecureTCPBatch(fds[1], &reader, received, lengths, 2), OS_SOCKTERR);
+
+    close(fds[0]);
+    close(fds[1]);
+    OS_SecureReaderFree(&reader);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_secure_tcp_roundtrip),
+        cmocka_unit_test(test_secure_tcp_batch),
+        cmocka_unit_test(test_secure_tcp_batch_partial),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+static int stop;
+
+static void * spin(void * arg)
+{
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED));
+    return NULL;
+}
+
+/* tests */
+
+void test_thread_register(void **state)
+{
+    pthread_t thread;
+    char name[16];
+    char * output;
+    char * line;
+
+    assert_int_equal(pthread_create(&thread, NULL, spin, NULL), 0);
+    w_thread_register(thread, "test-worker-%d", 12345);
+
+    /* Names are truncated to what the kernel keeps */
+    assert_int_equal(pthread_getname_np(thread, name, sizeof(name)), 0);
+    assert_string_equal(name, "test-worker-123");
+
+    usleep(50000);
+    output = w_metrics_render();
+    line = strstr(output, "wazuh_thread_cpu_seconds_total{thread=\"test-worker-123\"} ");
+    assert_non_null(line);
+    assert_true(strtod(line + strlen("wazuh_thread_cpu_seconds_total{thread=\"test-worker-123\"} "), NULL) > 0);
+    free(output);
+
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_thread_register),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
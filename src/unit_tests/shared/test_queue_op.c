@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+static int item = 1;
+
+static void * push_blocked(void * arg)
+{
+    queue_push_ex_block((w_queue_t *)arg, &item);
+    return NULL;
+}
+
+/* tests */
+
+void test_queue_rejected(void **state)
+{
+    w_queue_t * queue = queue_init(3);
+    w_queue_stats_t stats;
+
+    assert_int_equal(queue_push(queue, &item), 0);
+    assert_int_equal(queue_push(queue, &item), 0);
+    assert_int_equal(queue_push(queue, &item), -1);
+    assert_int_equal(queue_push_ex(queue, &item), -1);
+
+    queue_get_stats(queue, &stats);
+    assert_int_equal(stats.rejected, 2);
+    assert_int_equal(stats.high_water, 2);
+
+    queue_free(queue);
+}
+
+void test_queue_high_water(void **state)
+{
+    w_queue_t * queue = queue_init(8);
+    w_queue_stats_t stats;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        queue_push(queue, &item);
+    }
+
+    for (i = 0; i < 4; i++) {
+        queue_pop(queue);
+    }
+
+    queue_get_stats(queue, &stats);
+    assert_int_equal(stats.high_water, 5);
+
+    /* Taking the mark restarts it from the current depth */
+    assert_int_equal(queue_take_high_water(queue), 5);
+    queue_get_stats(queue, &stats);
+    assert_int_equal(stats.high_water, 1);
+
+    queue_free(queue);
+}
+
+void test_queue_full_time(void **state)
+{
+    w_queue_t * queue = queue_init(2);
+    w_queue_stats_t stats;
+    uint64_t full;
+
+    queue_push(queue, &item);
+    usleep(20000);
+
+    /* An ongoing full period is accounted for */
+    queue_get_stats(queue, &stats);
+    assert_true(stats.full_usec >= 10000);
+
+    queue_pop(queue);
+    queue_get_stats(queue, &stats);
+    full = stats.full_usec;
+    assert_true(full >= 10000);
+
+    /* Not full anymore */
+    usleep(20000);
+    queue_get_stats(queue, &stats);
+    assert_int_equal(stats.full_usec, full);
+
+    queue_free(queue);
+}
+
+void test_queue_push_wait(void **state)
+{
+    w_queue_t * queue = queue_init(2);
+    w_queue_stats_t stats;
+    pthread_t thread;
+
+    queue_push_ex(queue, &item);
+    assert_int_equal(pthread_create(&thread, NULL, push_blocked, queue), 0);
+
+    usleep(20000);
+    assert_ptr_equal(queue_pop_ex(queue), &item);
+    pthread_join(thread, NULL);
+
+    queue_get_stats(queue, &stats);
+    assert_true(stats.push_wait_usec >= 10000);
+    assert_int_equal(stats.rejected, 0);
+
+    queue_free(queue);
+}
+
+void test_queue_pop_wait(void **state)
+{
+    w_queue_t * queue = queue_init(2);
+    w_queue_stats_t stats;
+    struct timespec abstime;
+
+    gettime(&abstime);
+    abstime.tv_nsec += 20000000;
+
+    if (abstime.tv_nsec >= 1000000000) {
+        abstime.tv_sec++;
+        abstime.tv_nsec -= 1000000000;
+    }
+
+    assert_null(queue_pop_ex_timedwait(queue, &abstime));
+
+    queue_get_stats(queue, &stats);
+    assert_true(stats.pop_wait_usec >= 10000);
+
+    queue_free(queue);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_queue_rejected),
+        cmocka_unit_test(test_queue_high_water),
+        cmocka_unit_test(test_queue_full_time),
+        cmocka_unit_test(test_queue_push_wait),
+        cmocka_unit_test(test_queue_pop_wait),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
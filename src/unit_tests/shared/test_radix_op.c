@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+/* setup/teardowns */
+
+static int create_radix(void **state)
+{
+    radix_tree *tree = radix_init();
+    *state = tree;
+    return 0;
+}
+
+static int create_radix_with_dispose(void **state)
+{
+    radix_tree *tree = radix_init();
+
+    radix_set_dispose(tree, free);
+
+    *state = tree;
+    return 0;
+}
+
+static int delete_radix(void **state)
+{
+    radix_tree *tree = *state;
+    radix_destroy(tree);
+    return 0;
+}
+
+/* auxiliary */
+
+struct walk_result {
+    char keys[16][32];
+    unsigned int count;
+    unsigned int stop_at;
+};
+
+static int collect_key(const char *key, __attribute__((unused)) void *value, void *arg)
+{
+    struct walk_result *result = arg;
+
+    snprintf(result->keys[result->count], sizeof(result->keys[0]), "%s", key);
+    return ++result->count == result->stop_at;
+}
+
+static void collect_deleted(const char *key, void *value, void *arg)
+{
+    collect_key(key, value, arg);
+}
+
+static void insert_paths(radix_tree *tree)
+{
+    static const char *paths[] = { "/etc", "/etc/ssh", "/etc/ssh/sshd_config", "/etcetera", "/etc/sshd", "/home", "/" };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(paths) / sizeof(char *); i++) {
+        assert_non_null(radix_insert(tree, paths[i], (void *)(intptr_t)(i + 1)));
+    }
+}
+
+/* tests */
+
+void test_radix_insert_get(void **state)
+{
+    radix_tree *tree = *state;
+    char *value = strdup("testing");
+
+    assert_ptr_equal(radix_insert(tree, "test", value), value);
+    assert_ptr_equal(radix_get(tree, "test"), value);
+    assert_null(radix_get(tree, "tes"));
+    assert_null(radix_get(tree, "testing"));
+    assert_int_equal(radix_size(tree), 1);
+}
+
+void test_radix_insert_duplicate(void **state)
+{
+    radix_tree *tree = *state;
+    char *value = strdup("testing");
+    char *other = strdup("other");
+
+    radix_insert(tree, "test", value);
+
+    assert_null(radix_insert(tree, "test", other));
+    assert_ptr_equal(radix_get(tree, "test"), value);
+    assert_int_equal(radix_size(tree), 1);
+
+    free(other);
+}
+
+void test_radix_keys_prefix_of_others(void **state)
+{
+    radix_tree *tree = *state;
+
+    // Keys that end where others go on, both before and after them
+    assert_non_null(radix_insert(tree, "abc", (void *)3));
+    assert_non_null(radix_insert(tree, "a", (void *)1));
+    assert_non_null(radix_insert(tree, "ab", (void *)2));
+    assert_non_null(radix_insert(tree, "", (void *)4));
+
+    assert_int_equal((intptr_t)radix_get(tree, ""), 4);
+    assert_int_equal((intptr_t)radix_get(tree, "a"), 1);
+    assert_int_equal((intptr_t)radix_get(tree, "ab"), 2);
+    assert_int_equal((intptr_t)radix_get(tree, "abc"), 3);
+
+    assert_int_equal(radix_delete(tree, "ab"), 1);
+    assert_null(radix_get(tree, "ab"));
+    assert_int_equal((intptr_t)radix_get(tree, "abc"), 3);
+    assert_int_equal((intptr_t)radix_get(tree, "a"), 1);
+    assert_int_equal(radix_size(tree), 3);
+}
+
+void test_radix_delete(void **state)
+{
+    radix_tree *tree = *state;
+
+    radix_insert(tree, "test", strdup("testing"));
+
+    assert_int_equal(radix_delete(tree, "other"), 0);
+    assert_int_equal(radix_delete(tree, "tes"), 0);
+    assert_int_equal(radix_delete(tree, "test"), 1);
+    assert_int_equal(radix_delete(tree, "test"), 0);
+    assert_null(tree->root);
+    assert_int_equal(radix_size(tree), 0);
+}
+
+void test_radix_grow_shrink(void **state)
+{
+    radix_tree *tree = *state;
+    char key[8];
+    int i;
+
+    // Every byte value after a shared prefix takes nodes through all their sizes
+    for (i = 1; i < 256; i++) {
+        snprintf(key, sizeof(key), "/%c", i);
+        assert_non_null(radix_insert(tree, key, (void *)(intptr_t)i));
+    }
+
+    assert_int_equal(radix_size(tree), 255);
+
+    for (i = 1; i < 256; i++) {
+        snprintf(key, sizeof(key), "/%c", i);
+        assert_int_equal((intptr_t)radix_get(tree, key), i);
+    }
+
+    for (i = 255; i > 1; i--) {
+        snprintf(key, sizeof(key), "/%c", i);
+        assert_int_equal(radix_delete(tree, key), 1);
+    }
+
+    snprintf(key, sizeof(key), "/%c", 1);
+    assert_int_equal((intptr_t)radix_get(tree, key), 1);
+    assert_int_equal(radix_size(tree), 1);
+}
+
+void test_radix_walk_prefix(void **state)
+{
+    radix_tree *tree = *state;
+    struct walk_result result = { .count = 0 };
+
+    insert_paths(tree);
+
+    // In order, and only the keys starting with the prefix
+    assert_int_equal(radix_walk_prefix(tree, "/etc/", collect_key, &result), 3);
+    assert_string_equal(result.keys[0], "/etc/ssh");
+    assert_string_equal(result.keys[1], "/etc/ssh/sshd_config");
+    assert_string_equal(result.keys[2], "/etc/sshd");
+
+    result.count = 0;
+    assert_int_equal(radix_walk_prefix(tree, "", collect_key, &result), 7);
+    assert_string_equal(result.keys[0], "/");
+    assert_string_equal(result.keys[1], "/etc");
+    assert_string_equal(result.keys[6], "/home");
+
+    result.count = 0;
+    assert_int_equal(radix_walk_prefix(tree, "/usr", collect_key, &result), 0);
+    assert_int_equal(radix_walk_prefix(tree, "/etc/ssh/sshd_config/", collect_key, &result), 0);
+}
+
+void test_radix_walk_prefix_stop(void **state)
+{
+    radix_tree *tree = *state;
+    struct walk_result result = { .count = 0, .stop_at = 2 };
+
+    insert_paths(tree);
+
+    assert_int_equal(radix_walk_prefix(tree, "/etc", collect_key, &result), 2);
+    assert_string_equal(result.keys[0], "/etc");
+    assert_string_equal(result.keys[1], "/etc/ssh");
+}
+
+void test_radix_delete_prefix(void **state)
+{
+    radix_tree *tree = *state;
+    struct walk_result result = { .count = 0 };
+
+    insert_paths(tree);
+
+    assert_int_equal(radix_delete_prefix(tree, "/etc/ssh", collect_deleted, &result), 3);
+    assert_int_equal(result.count, 3);
+    assert_string_equal(result.keys[0], "/etc/ssh");
+    assert_string_equal(result.keys[2], "/etc/sshd");
+
+    assert_int_equal(radix_size(tree), 4);
+    assert_null(radix_get(tree, "/etc/ssh/sshd_config"));
+    assert_non_null(radix_get(tree, "/etc"));
+    assert_non_null(radix_get(tree, "/etcetera"));
+
+    assert_int_equal(radix_delete_prefix(tree, "/etc/", NULL, NULL), 0);
+    assert_int_equal(radix_delete_prefix(tree, "", NULL, NULL), 4);
+    assert_null(tree->root);
+    assert_int_equal(radix_size(tree), 0);
+}
+
+void test_radix_dispose(void **state)
+{
+    radix_tree *tree = *state;
+
+    // The tree owns the values: the sanitizers report any that is lost
+    radix_insert(tree, "/etc", strdup("a"));
+    radix_insert(tree, "/etc/ssh", strdup("b"));
+    radix_insert(tree, "/etc/ssh/sshd_config", strdup("c"));
+    radix_insert(tree, "/home", strdup("d"));
+
+    assert_int_equal(radix_delete(tree, "/home"), 1);
+    assert_int_equal(radix_delete_prefix(tree, "/etc/", NULL, NULL), 2);
+    assert_int_equal(radix_size(tree), 1);
+}
+
+void test_radix_destroy_null(void **state)
+{
+    (void) state;
+
+    radix_destroy(NULL);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_radix_insert_get, create_radix_with_dispose, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_insert_duplicate, create_radix_with_dispose, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_keys_prefix_of_others, create_radix, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_delete, create_radix_with_dispose, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_grow_shrink, create_radix, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_walk_prefix, create_radix, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_walk_prefix_stop, create_radix, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_delete_prefix, create_radix, delete_radix),
+        cmocka_unit_test_setup_teardown(test_radix_dispose, create_radix_with_dispose, delete_radix),
+        cmocka_unit_test(test_radix_destroy_null),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
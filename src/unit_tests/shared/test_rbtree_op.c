@@ -220,6 +220,30 @@ void test_rbtree_get_null_key(void **state)
     expect_assert_failure(rbtree_get(tree, NULL));
 }
 
+void test_rbtree_ceiling(void **state)
+{
+    (void) state;
+    rb_tree *tree = *state;
+    char *value_b = strdup("b");
+    char *value_d = strdup("d");
+
+    rbtree_insert(tree, "b", value_b);
+    rbtree_insert(tree, "d", value_d);
+
+    assert_ptr_equal(rbtree_ceiling(tree, "a"), value_b);
+    assert_ptr_equal(rbtree_ceiling(tree, "b"), value_b);
+    assert_ptr_equal(rbtree_ceiling(tree, "c"), value_d);
+    assert_ptr_equal(rbtree_ceiling(tree, "d"), value_d);
+    assert_null(rbtree_ceiling(tree, "e"));
+}
+
+void test_rbtree_ceiling_null_key(void **state)
+{
+    (void) state;
+    rb_tree *tree = *state;
+
+    expect_assert_failure(rbtree_ceiling(tree, NULL));
+}
 
 void test_rbtree_delete_success(void **state)
 {
@@ -643,6 +667,8 @@ int main(void) {
         cmocka_unit_test_setup_teardown(test_rbtree_get_failure, create_rbtree_with_dispose, delete_rbtree),
         cmocka_unit_test_setup_teardown(test_rbtree_get_null_tree, create_rbtree_with_dispose, delete_rbtree),
         cmocka_unit_test_setup_teardown(test_rbtree_get_null_key, create_rbtree_with_dispose, delete_rbtree),
+        cmocka_unit_test_setup_teardown(test_rbtree_ceiling, create_rbtree_with_dispose, delete_rbtree),
+        cmocka_unit_test_setup_teardown(test_rbtree_ceiling_null_key, create_rbtree_with_dispose, delete_rbtree),
 
         /* rbtree_delete tests */
         cmocka_unit_test_setup_teardown(test_rbtree_delete_success, create_rbtree_with_dispose, delete_rbtree),
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+#define READERS 4
+#define ITERATIONS 20000
+
+static w_rcu_t * rcu;
+static int * volatile shared_value;
+static int running;
+
+/* setup/teardowns */
+
+static int create_rcu(void **state)
+{
+    rcu = w_rcu_init(READERS);
+    return 0;
+}
+
+static int delete_rcu(void **state)
+{
+    w_rcu_free(rcu);
+    return 0;
+}
+
+/* auxiliary */
+
+static void * read_values(void * arg)
+{
+    unsigned int reader = (uintptr_t)arg;
+    long failures = 0;
+    int * value;
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        w_rcu_read_lock(rcu, reader);
+        value = __atomic_load_n(&shared_value, __ATOMIC_ACQUIRE);
+        failures += *value != 42;
+        w_rcu_read_unlock(rcu, reader);
+    }
+
+    return (void *)failures;
+}
+
+static void * read_values_thread(void * arg)
+{
+    long failures = 0;
+    int * value;
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        w_rcu_thread_read_lock();
+
+        /* Nested sections end with the outermost one */
+        w_rcu_thread_read_lock();
+        w_rcu_thread_read_unlock();
+
+        value = __atomic_load_n(&shared_value, __ATOMIC_ACQUIRE);
+        failures += *value != 42;
+        w_rcu_thread_read_unlock();
+    }
+
+    return (void *)failures;
+}
+
+/* tests */
+
+void test_rcu_synchronize_idle(void **state)
+{
+    /* No reader inside a section: returns at once */
+    w_rcu_synchronize(rcu);
+    w_rcu_synchronize(rcu);
+    assert_int_equal(rcu->generation, 3);
+}
+
+void test_rcu_replace(void **state)
+{
+    pthread_t threads[READERS];
+    void * failures;
+    int * old;
+    int * value;
+    int i;
+
+    os_malloc(sizeof(int), value);
+    *value = 42;
+    shared_value = value;
+    running = 1;
+
+    for (i = 0; i < READERS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, read_values, (void *)(uintptr_t)i), 0);
+    }
+
+    /* Old values are overwritten once freed: readers would notice */
+    for (i = 0; i < ITERATIONS / 100; i++) {
+        os_malloc(sizeof(int), value);
+        *value = 42;
+        old = shared_value;
+        __atomic_store_n(&shared_value, value, __ATOMIC_RELEASE);
+        w_rcu_synchronize(rcu);
+        *old = 0;
+        free(old);
+    }
+
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+    for (i = 0; i < READERS; i++) {
+        pthread_join(threads[i], &failures);
+        assert_int_equal((long)failures, 0);
+    }
+
+    free(shared_value);
+}
+
+void test_rcu_thread_replace(void **state)
+{
+    pthread_t threads[READERS];
+    void * failures;
+    int * old;
+    int * value;
+    int round;
+    int i;
+
+    os_malloc(sizeof(int), value);
+    *value = 42;
+    shared_value = value;
+
+    /* The second round reuses the slots of the first one */
+    for (round = 0; round < 2; round++) {
+        running = 1;
+
+        for (i = 0; i < READERS; i++) {
+            assert_int_equal(pthread_create(&threads[i], NULL, read_values_thread, NULL), 0);
+        }
+
+        for (i = 0; i < ITERATIONS / 200; i++) {
+            os_malloc(sizeof(int), value);
+            *value = 42;
+            old = shared_value;
+            __atomic_store_n(&shared_value, value, __ATOMIC_RELEASE);
+            w_rcu_thread_synchronize();
+            *old = 0;
+            free(old);
+        }
+
+        __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+        for (i = 0; i < READERS; i++) {
+            pthread_join(threads[i], &failures);
+            assert_int_equal((long)failures, 0);
+        }
+    }
+
+    free(shared_value);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_rcu_synchronize_idle, create_rcu, delete_rcu),
+        cmocka_unit_test_setup_teardown(test_rcu_replace, create_rcu, delete_rcu),
+        cmocka_unit_test(test_rcu_thread_replace),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
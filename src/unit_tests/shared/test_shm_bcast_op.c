@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include "../headers/shared.h"
+
+#define MESSAGES 100000
+
+static char path[64];
+
+/* setup/teardowns */
+
+static int setup_path(void **state)
+{
+    snprintf(path, sizeof(path), "/tmp/test_shm_bcast_op.%d", (int)getpid());
+    return 0;
+}
+
+static int teardown_path(void **state)
+{
+    unlink(path);
+    return 0;
+}
+
+/* auxiliary */
+
+static void publish_string(w_shm_bcast_t * bcast, const char * str, uint64_t offset)
+{
+    shm_bcast_origin_t origin = { 1, offset, offset + strlen(str) + 1 };
+    shm_bcast_publish(bcast, str, strlen(str), &origin);
+}
+
+/* tests */
+
+void test_shm_bcast_publish_recv(void **state)
+{
+    w_shm_bcast_t * producer = shm_bcast_create(path, 0);
+    w_shm_bcast_t * reader1;
+    w_shm_bcast_t * reader2;
+    shm_bcast_origin_t origin;
+    char buffer[OS_MAXSTR + 1];
+
+    assert_non_null(producer);
+
+    /* A reader starts at the next message */
+    publish_string(producer, "before", 0);
+    assert_non_null(reader1 = shm_bcast_attach(path));
+    assert_non_null(reader2 = shm_bcast_attach(path));
+    assert_int_equal(shm_bcast_recv(reader1, buffer, sizeof(buffer), &origin, 0), SHM_BCAST_EMPTY);
+
+    publish_string(producer, "first", 7);
+    publish_string(producer, "second", 13);
+
+    /* Every reader gets every message */
+    assert_int_equal(shm_bcast_peek(reader1, &origin), 1);
+    assert_int_equal(origin.start, 7);
+    assert_int_equal(shm_bcast_recv(reader1, buffer, sizeof(buffer), &origin, 0), 5);
+    assert_string_equal(buffer, "first");
+    assert_int_equal(origin.file_id, 1);
+    assert_int_equal(origin.end, 13);
+    assert_int_equal(shm_bcast_recv(reader1, buffer, sizeof(buffer), &origin, 0), 6);
+    assert_string_equal(buffer, "second");
+    assert_int_equal(shm_bcast_recv(reader2, buffer, sizeof(buffer), &origin, 0), 5);
+    assert_string_equal(buffer, "first");
+
+    /* Truncated to the buffer */
+    assert_int_equal(shm_bcast_recv(reader2, buffer, 4, &origin, 0), 3);
+    assert_string_equal(buffer, "sec");
+    assert_int_equal(shm_bcast_peek(reader2, &origin), 0);
+
+    shm_bcast_close(reader1);
+    shm_bcast_close(reader2);
+    shm_bcast_close(producer);
+}
+
+void test_shm_bcast_lost(void **state)
+{
+    w_shm_bcast_t * producer = shm_bcast_create(path, 0);
+    w_shm_bcast_t * reader = shm_bcast_attach(path);
+    shm_bcast_origin_t origin;
+    char message[1000];
+    char buffer[sizeof(message) + 1];
+    int i;
+
+    assert_non_null(reader);
+    memset(message, 'a', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+
+    /* The producer doesn't wait: a reader that falls a ring behind loses its place */
+    for (i = 0; i * sizeof(message) < 2 * producer->ring_size; i++) {
+        publish_string(producer, message, i * sizeof(message));
+    }
+
+    assert_int_equal(shm_bcast_peek(reader, &origin), SHM_BCAST_LOST);
+    assert_int_equal(shm_bcast_recv(reader, buffer, sizeof(buffer), &origin, 0), SHM_BCAST_LOST);
+
+    shm_bcast_skip(reader);
+    publish_string(producer, "next", 0);
+    assert_int_equal(shm_bcast_recv(reader, buffer, sizeof(buffer), &origin, 0), 4);
+    assert_string_equal(buffer, "next");
+
+    shm_bcast_close(reader);
+    shm_bcast_close(producer);
+}
+
+void test_shm_bcast_closed(void **state)
+{
+    w_shm_bcast_t * producer = shm_bcast_create(path, 0);
+    w_shm_bcast_t * reader = shm_bcast_attach(path);
+    w_shm_bcast_t * producer2;
+    shm_bcast_origin_t origin;
+    char buffer[OS_MAXSTR + 1];
+
+    assert_non_null(reader);
+
+    /* A new producer drops the old segment, and its readers notice */
+    assert_non_null(producer2 = shm_bcast_create(path, 0));
+    assert_int_equal(shm_bcast_recv(reader, buffer, sizeof(buffer), &origin, 0), SHM_BCAST_CLOSED);
+    shm_bcast_close(reader);
+
+    unlink(path);
+    assert_null(shm_bcast_attach(path));
+
+    shm_bcast_close(producer);
+    shm_bcast_close(producer2);
+}
+
+void test_shm_bcast_processes(void **state)
+{
+    w_shm_bcast_t * producer = shm_bcast_create(path, 1 << 23);
+    shm_bcast_origin_t origin;
+    int status;
+    pid_t pid[2];
+    int ready[2];
+    char message[32];
+    long n;
+    int i;
+
+    assert_non_null(producer);
+    assert_int_equal(pipe(ready), 0);
+
+    /* Two reader processes wait for the messages as they are published. The
+     * ring holds all of them, so that a slow reader can't fall behind */
+    for (i = 0; i < 2; i++) {
+        if (pid[i] = fork(), pid[i] == 0) {
+            w_shm_bcast_t * reader = shm_bcast_attach(path);
+            char buffer[OS_MAXSTR + 1];
+            long expected = 0;
+            int result;
+
+            if (!reader || write(ready[1], "", 1) != 1) {
+                _exit(1);
+            }
+
+            while (expected < MESSAGES) {
+                if (result = shm_bcast_recv(reader, buffer, sizeof(buffer), &origin, 1000), result <= 0) {
+                    _exit(result == SHM_BCAST_EMPTY ? 2 : 3);
+                }
+
+                if (atol(buffer) != expected++) {
+                    _exit(4);
+                }
+            }
+
+            shm_bcast_close(reader);
+            _exit(0);
+        }
+    }
+
+    /* Let the readers attach before the first message */
+    assert_int_equal(read(ready[0], message, 1), 1);
+    assert_int_equal(read(ready[0], message, 1), 1);
+
+    for (n = 0; n < MESSAGES; n++) {
+        snprintf(message, sizeof(message), "%ld", n);
+        publish_string(producer, message, n);
+    }
+
+    for (i = 0; i < 2; i++) {
+        assert_int_equal(waitpid(pid[i], &status, 0), pid[i]);
+        assert_true(WIFEXITED(status));
+        assert_int_equal(WEXITSTATUS(status), 0);
+    }
+
+    close(ready[0]);
+    close(ready[1]);
+    shm_bcast_close(producer);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_teardown(test_shm_bcast_publish_recv, teardown_path),
+        cmocka_unit_test_teardown(test_shm_bcast_lost, teardown_path),
+        cmocka_unit_test_teardown(test_shm_bcast_closed, teardown_path),
+        cmocka_unit_test_teardown(test_shm_bcast_processes, teardown_path),
+    };
+    return cmocka_run_group_tests(tests, setup_path, NULL);
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include "../headers/shared.h"
+
+#define MESSAGES 100000
+
+static char path[64];
+
+/* setup/teardowns */
+
+static int setup_path(void **state)
+{
+    snprintf(path, sizeof(path), "/tmp/test_shm_queue_op.%d", (int)getpid());
+    return 0;
+}
+
+static int teardown_path(void **state)
+{
+    unlink(path);
+    return 0;
+}
+
+/* auxiliary */
+
+static int push_string(w_shm_queue_t * queue, const char * str)
+{
+    struct iovec iov[2] = {
+        { (char *)str, strlen(str) / 2 },
+        { (char *)str + strlen(str) / 2, strlen(str) - strlen(str) / 2 }
+    };
+
+    return shm_queue_push(queue, iov, 2);
+}
+
+/* tests */
+
+void test_shm_queue_push_recv(void **state)
+{
+    w_shm_queue_t * consumer = shm_queue_create(path, 0);
+    w_shm_queue_t * producer1;
+    w_shm_queue_t * producer2;
+    char buffer[OS_MAXSTR + 1];
+
+    assert_non_null(consumer);
+    assert_non_null(producer1 = shm_queue_attach(path));
+    assert_non_null(producer2 = shm_queue_attach(path));
+    assert_int_not_equal(producer1->ring, producer2->ring);
+
+    /* Nothing queued: the consumer parks, and the next push must wake it up */
+    assert_int_equal(shm_queue_recv(consumer, buffer, sizeof(buffer)), 0);
+    assert_int_equal(push_string(producer1, "1:first"), SHM_QUEUE_WAKEUP);
+    assert_int_equal(push_string(producer1, "1:second"), 0);
+    assert_int_equal(push_string(producer2, "1:third"), 0);
+
+    /* The rings are read in turn */
+    assert_int_equal(shm_queue_recv(consumer, buffer, sizeof(buffer)), 7);
+    assert_string_equal(buffer, "1:first");
+    assert_int_equal(shm_queue_recv(consumer, buffer, sizeof(buffer)), 7);
+    assert_string_equal(buffer, "1:third");
+    assert_int_equal(shm_queue_recv(consumer, buffer, sizeof(buffer)), 8);
+    assert_string_equal(buffer, "1:second");
+
+    /* Truncated to the buffer */
+    assert_int_equal(push_string(producer2, "1:truncated"), 0);
+    assert_int_equal(shm_queue_recv(consumer, buffer, 5), 4);
+    assert_string_equal(buffer, "1:tr");
+    assert_int_equal(shm_queue_recv(consumer, buffer, sizeof(buffer)), 0);
+
+    shm_queue_close(producer1);
+    shm_queue_close(producer2);
+    shm_queue_close(consumer);
+}
+
+void test_shm_queue_wrap(void **state)
+{
+    w_shm_queue_t * consumer = shm_queue_create(path, 0);
+    w_shm_queue_t * producer = shm_queue_attach(path);
+    char message[1000];
+    char buffer[sizeof(message) + 1];
+    int i;
+
+    assert_non_null(producer);
+
+    /* Records of odd sizes cross the end of the ring many times */
+    for (i = 0; i < 200; i++) {
+        memset(message, 'a' + i % 26, sizeof(message) - 1);
+        message[sizeof(message) - 1 - i] = '\0';
+
+        assert_true(push_string(producer, message) >= 0);
+        assert_int_equal(shm_queue_recv(consumer, buffer, sizeof(buffer)), strlen(message));
+        assert_string_equal(buffer, message);
+    }
+
+    /* A message that could never fit is refused */
+    {
+        char * big;
+        struct iovec iov;
+
+        os_calloc(producer->ring_size + 1, 1, big);
+        iov.iov_base = big;
+        iov.iov_len = producer->ring_size;
+        assert_int_equal(shm_queue_push(producer, &iov, 1), -1);
+        os_free(big);
+    }
+
+    shm_queue_close(producer);
+    shm_queue_close(consumer);
+}
+
+void test_shm_queue_peek_release(void **state)
+{
+    w_shm_queue_t * consumer = shm_queue_create(path, 0);
+    w_shm_queue_t * producer = shm_queue_attach(path);
+    char message[1000];
+    char buffer[sizeof(message) + 1];
+    const char * peeked;
+    size_t length;
+    int wrapped = 0;
+    int i;
+
+    assert_non_null(producer);
+    assert_null(shm_queue_peek(consumer, buffer, sizeof(buffer), &length));
+    assert_int_equal(push_string(producer, "1:first"), SHM_QUEUE_WAKEUP);
+
+    /* The message is read in place, and its room is kept until it's released */
+    assert_non_null(peeked = shm_queue_peek(consumer, buffer, sizeof(buffer), &length));
+    assert_ptr_not_equal(peeked, buffer);
+    assert_int_equal(length, 7);
+    assert_memory_equal(peeked, "1:first", 7);
+
+    assert_int_equal(consumer->header->ring[producer->ring].tail, 0);
+    shm_queue_release(consumer);
+    assert_int_equal(consumer->header->ring[producer->ring].tail, sizeof(uint32_t) + 7);
+
+    /* Only the messages that cross the end of the ring are copied */
+    for (i = 0; i < 200; i++) {
+        memset(message, 'a' + i % 26, sizeof(message) - 1);
+        message[sizeof(message) - 1 - i] = '\0';
+
+        assert_true(push_string(producer, message) >= 0);
+        assert_non_null(peeked = shm_queue_peek(consumer, buffer, sizeof(buffer), &length));
+        assert_int_equal(length, strlen(message));
+        assert_memory_equal(peeked, message, length);
+        wrapped += peeked == buffer;
+        shm_queue_release(consumer);
+    }
+
+    assert_true(wrapped > 0);
+    assert_null(shm_queue_peek(consumer, buffer, sizeof(buffer), &length));
+
+    shm_queue_close(producer);
+    shm_queue_close(consumer);
+}
+
+void test_shm_queue_reclaim(void **state)
+{
+    w_shm_queue_t * consumer = shm_queue_create(path, 0);
+    w_shm_queue_t * producers[SHM_QUEUE_RINGS];
+    w_shm_queue_t * producer;
+    int i;
+
+    for (i = 0; i < SHM_QUEUE_RINGS; i++) {
+        assert_non_null(producers[i] = shm_queue_attach(path));
+    }
+
+    assert_null(shm_queue_attach(path));
+
+    /* A closed ring can be claimed again */
+    shm_queue_close(producers[3]);
+    assert_non_null(producer = shm_queue_attach(path));
+    assert_int_equal(producer->ring, 3);
+    producers[3] = producer;
+
+    for (i = 0; i < SHM_QUEUE_RINGS; i++) {
+        shm_queue_close(producers[i]);
+    }
+
+    shm_queue_close(consumer);
+}
+
+void test_shm_queue_closed(void **state)
+{
+    w_shm_queue_t * consumer = shm_queue_create(path, 0);
+    w_shm_queue_t * producer = shm_queue_attach(path);
+    w_shm_queue_t * consumer2;
+
+    assert_non_null(producer);
+    assert_int_equal(push_string(producer, "1:before"), 0);
+
+    /* A new consumer drops the old segment, and its producers notice */
+    assert_non_null(consumer2 = shm_queue_create(path, 0));
+    assert_int_equal(push_string(producer, "1:after"), -1);
+    shm_queue_close(producer);
+
+    unlink(path);
+    assert_null(shm_queue_attach(path));
+
+    shm_queue_close(consumer);
+    shm_queue_close(consumer2);
+}
+
+void test_shm_queue_processes(void **state)
+{
+    w_shm_queue_t * consumer = shm_queue_create(path, 0);
+    char buffer[OS_MAXSTR + 1];
+    long expected[2] = { 0, 0 };
+    int status;
+    pid_t pid[2];
+    int received = 0;
+    int i;
+
+    assert_non_null(consumer);
+
+    /* Two producer processes fill their small rings faster than they are drained */
+    for (i = 0; i < 2; i++) {
+        if (pid[i] = fork(), pid[i] == 0) {
+            w_shm_queue_t * producer = shm_queue_attach(path);
+            char message[32];
+            long n;
+
+            if (!producer) {
+                _exit(1);
+            }
+
+            for (n = 0; n < MESSAGES; n++) {
+                snprintf(message, sizeof(message), "%d:%ld", i, n);
+
+                if (push_string(producer, message) < 0) {
+                    _exit(1);
+                }
+            }
+
+            shm_queue_close(producer);
+            _exit(0);
+        }
+    }
+
+    while (received < 2 * MESSAGES) {
+        if (shm_queue_recv(consumer, buffer, sizeof(buffer)) == 0) {
+            usleep(100);
+            continue;
+        }
+
+        /* Order is kept within a producer, and nothing is lost */
+        i = buffer[0] - '0';
+        assert_in_range(i, 0, 1);
+        assert_int_equal(atol(buffer + 2), expected[i]);
+        expected[i]++;
+        received++;
+    }
+
+    for (i = 0; i < 2; i++) {
+        assert_int_equal(waitpid(pid[i], &status, 0), pid[i]);
+        assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    shm_queue_close(consumer);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_teardown(test_shm_queue_push_recv, teardown_path),
+        cmocka_unit_test_teardown(test_shm_queue_wrap, teardown_path),
+        cmocka_unit_test_teardown(test_shm_queue_peek_release, teardown_path),
+        cmocka_unit_test_teardown(test_shm_queue_reclaim, teardown_path),
+        cmocka_unit_test_teardown(test_shm_queue_closed, teardown_path),
+        cmocka_unit_test_teardown(test_shm_queue_processes, teardown_path),
+    };
+    return cmocka_run_group_tests(tests, setup_path, NULL);
+}
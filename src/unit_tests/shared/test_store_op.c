@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+/* tests */
+
+void test_store_order(void **state)
+{
+    const char * keys[] = { "m", "c", "x", "a", "p" };
+    const char * sorted[] = { "a", "c", "m", "p", "x" };
+    OSStore * store = OSStore_Create();
+    OSStoreNode * node;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        assert_int_equal(OSStore_Put(store, keys[i], strdup(keys[i])), 1);
+    }
+
+    for (i = 0, node = OSStore_GetFirstNode(store); node; i++, node = node->next) {
+        assert_string_equal(node->key, sorted[i]);
+        assert_true(node->next == NULL || node->next->prev == node);
+    }
+
+    assert_int_equal(i, 5);
+    assert_string_equal(store->last_node->key, "x");
+    assert_int_equal(store->currently_size, 5);
+
+    OSStore_Free(store);
+}
+
+void test_store_get(void **state)
+{
+    OSStore * store = OSStore_Create();
+    char * value = strdup("value");
+    char * other = strdup("other");
+
+    OSStore_Put(store, "b", value);
+    OSStore_Put(store, "d", strdup("d"));
+
+    /* A duplicate key keeps the former value */
+    assert_int_equal(OSStore_Put(store, "b", other), 1);
+    assert_ptr_equal(OSStore_Get(store, "b"), value);
+    assert_int_equal(store->currently_size, 2);
+
+    assert_null(OSStore_Get(store, "c"));
+    assert_int_equal(OSStore_Check(store, "d"), 1);
+    assert_int_equal(OSStore_Check(store, "a"), 0);
+
+    assert_int_equal(OSStore_GetPosition(store, "b"), 1);
+    assert_int_equal(OSStore_GetPosition(store, "d"), 2);
+    assert_int_equal(OSStore_GetPosition(store, "e"), 0);
+
+    free(other);
+    OSStore_Free(store);
+}
+
+static void * greater(void * d1, void * d2)
+{
+    return *(int *)d1 > *(int *)d2 ? d1 : NULL;
+}
+
+void test_store_sort(void **state)
+{
+    const char * keys[] = { "a", "b", "c", "d", "e", "f" };
+    const int counts[] = { 2, 5, 2, 7, 5, 1 };
+    const char * sorted[] = { "d", "b", "e", "a", "c", "f" };
+    OSStore * store = OSStore_Create();
+    OSStoreNode * node;
+    int * data;
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        os_malloc(sizeof(int), data);
+        *data = counts[i];
+        OSStore_Put(store, keys[i], data);
+    }
+
+    assert_int_equal(OSStore_Sort(store, greater), 1);
+
+    /* Descending, and equal entries keep the key order */
+    for (i = 0, node = OSStore_GetFirstNode(store); node; i++, node = node->next) {
+        assert_string_equal(node->key, sorted[i]);
+        assert_true(node->prev == NULL || node->prev->next == node);
+    }
+
+    assert_int_equal(i, 6);
+    assert_string_equal(store->last_node->key, "f");
+
+    /* The index still finds the nodes */
+    assert_int_equal(*(int *)OSStore_Get(store, "e"), 5);
+
+    OSStore_Free(store);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_store_order),
+        cmocka_unit_test(test_store_get),
+        cmocka_unit_test(test_store_sort),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
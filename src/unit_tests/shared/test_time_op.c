@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+static void assert_formats(time_t second) {
+    const w_time_cache_t * cache = w_time_cache_get(second);
+    struct tm tm;
+    char expected[64];
+
+    localtime_r(&second, &tm);
+
+    strftime(expected, sizeof(expected), "%T", &tm);
+    assert_string_equal(cache->hour, expected);
+    strftime(expected, sizeof(expected), "%b %e %T", &tm);
+    assert_string_equal(cache->syslog, expected);
+    strftime(expected, sizeof(expected), "%FT%T", &tm);
+    assert_string_equal(cache->datetime, expected);
+    strftime(expected, sizeof(expected), "%z", &tm);
+    assert_string_equal(cache->timezone, expected);
+}
+
+/* tests */
+
+void test_time_cache_formats(void **state)
+{
+    /* Single and double digit days */
+    assert_formats(1583020800);
+    assert_formats(1606780799);
+    assert_formats(time(NULL));
+}
+
+void test_time_cache_second(void **state)
+{
+    const w_time_cache_t * cache = w_time_cache_get(1583020800);
+    char hour[sizeof(cache->hour)];
+
+    strcpy(hour, cache->hour);
+
+    /* The same second is not formatted again */
+    assert_ptr_equal(w_time_cache_get(1583020800), cache);
+    assert_string_equal(cache->hour, hour);
+
+    w_time_cache_get(1583020801);
+    assert_int_equal(cache->second, 1583020801);
+    assert_string_not_equal(cache->hour, hour);
+
+    /* Going back in time is formatted as well */
+    w_time_cache_get(1583020800);
+    assert_string_equal(cache->hour, hour);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_time_cache_formats),
+        cmocka_unit_test(test_time_cache_second),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../headers/shared.h"
+
+static const char * const stages[] = { "queue", "work" };
+
+int __wrap_getDefine_Int(const char * high_name, const char * low_name, int min, int max) {
+    return mock();
+}
+
+/* tests */
+
+void test_trace_disabled(void **state)
+{
+    w_tracer_t tracer;
+    w_trace_t trace;
+    int i;
+
+    will_return(__wrap_getDefine_Int, 0);
+    w_tracer_init(&tracer, "test", "test_disabled", stages, 2);
+
+    for (i = 0; i < 1000; i++) {
+        assert_int_equal(w_trace_begin(&tracer, &trace), 0);
+        assert_int_equal(trace.id, 0);
+    }
+
+    /* Stages of an event not sampled are ignored */
+    w_trace_stage(&tracer, &trace, 0);
+    w_trace_end(&tracer, &trace);
+    assert_int_equal(w_metrics_value(tracer.stages[0]), 0);
+    assert_int_equal(w_metrics_value(tracer.total), 0);
+}
+
+void test_trace_stages(void **state)
+{
+    w_tracer_t tracer;
+    w_trace_t trace;
+
+    will_return(__wrap_getDefine_Int, 1);
+    w_tracer_init(&tracer, "test", "test_stages", stages, 2);
+
+    assert_int_equal(w_trace_begin(&tracer, &trace), 1);
+    assert_int_not_equal(trace.id, 0);
+
+    w_trace_stage(&tracer, &trace, 0);
+    w_trace_stage(&tracer, &trace, 1);
+    assert_int_equal(trace.done, 3);
+
+    w_trace_end(&tracer, &trace);
+    assert_int_equal(trace.id, 0);
+    assert_int_equal(w_metrics_value(tracer.stages[0]), 1);
+    assert_int_equal(w_metrics_value(tracer.stages[1]), 1);
+    assert_int_equal(w_metrics_value(tracer.total), 1);
+}
+
+void test_trace_sample_rate(void **state)
+{
+    w_tracer_t tracer;
+    w_trace_t trace;
+    int sampled = 0;
+    int i;
+
+    will_return(__wrap_getDefine_Int, 10);
+    w_tracer_init(&tracer, "test", "test_rate", stages, 2);
+
+    for (i = 0; i < 10000; i++) {
+        sampled += w_trace_begin(&tracer, &trace);
+    }
+
+    assert_in_range(sampled, 700, 1300);
+}
+
+void test_trace_probe(void **state)
+{
+    w_trace_probe_t probe = { NULL };
+    w_trace_t trace = { .id = 42 };
+    w_trace_t other = { .id = 43 };
+    w_trace_t output = { .id = 0 };
+    int first = 0;
+    int second = 0;
+
+    assert_int_equal(w_trace_probe_set(&probe, &first, &trace), 1);
+
+    /* Only one item at a time */
+    assert_int_equal(w_trace_probe_set(&probe, &second, &other), 0);
+
+    assert_int_equal(w_trace_probe_take(&probe, &second, &output), 0);
+    assert_int_equal(output.id, 0);
+
+    assert_int_equal(w_trace_probe_take(&probe, &first, &output), 1);
+    assert_int_equal(output.id, 42);
+
+    /* The probe is free again */
+    assert_int_equal(w_trace_probe_take(&probe, &first, &output), 0);
+    assert_int_equal(w_trace_probe_set(&probe, &second, &other), 1);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_trace_disabled),
+        cmocka_unit_test(test_trace_stages),
+        cmocka_unit_test(test_trace_sample_rate),
+        cmocka_unit_test(test_trace_probe),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
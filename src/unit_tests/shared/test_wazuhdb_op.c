@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "../headers/shared.h"
+#include "../headers/wazuhdb_op.h"
+
+/* "ok " 2 columns, 2 rows: id = [1, NULL], name = ["ab", 0.5] */
+static const char binary_response[] = {
+    'o', 'k', ' ',
+    2, 0, 0, 0, 2, 0, 0, 0,
+    2, 0, 'i', 'd',
+    WDBC_INTEGER, 1, 0, 0, 0, 0, 0, 0, 0,
+    WDBC_NULL,
+    4, 0, 'n', 'a', 'm', 'e',
+    WDBC_TEXT, 2, 0, 0, 0, 'a', 'b',
+    WDBC_FLOAT, 0, 0, 0, 0, 0, 0, (char)0xe0, 0x3f,
+};
+
+/* tests */
+
+void test_wdbc_table_parse(void **state)
+{
+    wdbc_table_t table;
+    wdbc_value_t values[2];
+
+    assert_int_equal(wdbc_table_parse(&table, binary_response, sizeof(binary_response)), 0);
+    assert_int_equal(table.columns, 2);
+    assert_int_equal(table.rows, 2);
+
+    assert_int_equal(wdbc_table_find(&table, "id"), 0);
+    assert_int_equal(wdbc_table_find(&table, "name"), 1);
+    assert_int_equal(wdbc_table_find(&table, "nam"), -1);
+
+    wdbc_table_values(&table, 0, values);
+    assert_int_equal(values[0].type, WDBC_INTEGER);
+    assert_int_equal(values[0].integer, 1);
+    assert_int_equal(values[1].type, WDBC_NULL);
+
+    wdbc_table_values(&table, 1, values);
+    assert_int_equal(values[0].type, WDBC_TEXT);
+    assert_int_equal(values[0].length, 2);
+    assert_memory_equal(values[0].data, "ab", 2);
+    assert_int_equal(values[1].type, WDBC_FLOAT);
+    assert_true(values[1].real == 0.5);
+
+    wdbc_table_free(&table);
+}
+
+void test_wdbc_table_parse_error(void **state)
+{
+    wdbc_table_t table;
+    const char error[] = "err Cannot execute SQL query";
+
+    assert_int_equal(wdbc_table_parse(&table, error, sizeof(error) - 1), -1);
+    assert_null(table.column);
+}
+
+void test_wdbc_table_parse_truncated(void **state)
+{
+    wdbc_table_t table;
+    size_t length;
+
+    /* Any cut must be detected, except at the end of the last value */
+    for (length = 0; length < sizeof(binary_response); length++) {
+        assert_int_equal(wdbc_table_parse(&table, binary_response, length), -1);
+        assert_null(table.column);
+    }
+}
+
+void test_wdbc_table_parse_empty(void **state)
+{
+    wdbc_table_t table;
+    const char empty[] = { 'o', 'k', ' ', 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    assert_int_equal(wdbc_table_parse(&table, empty, sizeof(empty)), 0);
+    assert_int_equal(table.columns, 0);
+    assert_int_equal(table.rows, 0);
+    assert_int_equal(wdbc_table_find(&table, "id"), -1);
+
+    wdbc_table_free(&table);
+}
+
+/* Records the responses of the asynchronous queries, in the order they complete */
+typedef struct async_log_t {
+    char responses[4][16];
+    int count;
+} async_log_t;
+
+static void async_callback(char *response, void *arg)
+{
+    async_log_t *log = (async_log_t *)arg;
+
+    snprintf(log->responses[log->count++], 16, "%s", response ? response : "(null)");
+}
+
+void test_wdbc_async_query(void **state)
+{
+    wdbc_async_t async;
+    async_log_t log = { .count = 0 };
+    char buffer[OS_SIZE_256];
+    int fds[2];
+
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    wdbc_async_init(&async, 2);
+    async.sock = fds[0];
+
+    // The responses are already there, so the client never blocks
+    assert_int_equal(OS_SendSecureTCP(fds[1], 5, "ok 1"), 0);
+    assert_int_equal(OS_SendSecureTCP(fds[1], 5, "ok 2"), 0);
+    assert_int_equal(OS_SendSecureTCP(fds[1], 6, "err 3"), 0);
+
+    assert_int_equal(wdbc_async_query(&async, "query 1", async_callback, &log), 0);
+    assert_int_equal(wdbc_async_query(&async, "query 2", async_callback, &log), 1);
+    assert_int_equal(log.count, 0);
+
+    // The window is full, so the oldest query is completed first
+    assert_int_equal(wdbc_async_query(&async, "query 3", async_callback, &log), 2);
+    assert_int_equal(log.count, 1);
+    assert_int_equal(async.count, 2);
+
+    assert_int_equal(wdbc_async_poll(&async), 2);
+    assert_int_equal(log.count, 3);
+    assert_string_equal(log.responses[0], "ok 1");
+    assert_string_equal(log.responses[1], "ok 2");
+    assert_string_equal(log.responses[2], "err 3");
+    assert_int_equal(wdbc_async_poll(&async), 0);
+
+    assert_true(OS_RecvSecureTCP(fds[1], buffer, sizeof(buffer)) > 0);
+    assert_string_equal(buffer, "query 1");
+    assert_true(OS_RecvSecureTCP(fds[1], buffer, sizeof(buffer)) > 0);
+    assert_string_equal(buffer, "query 2");
+    assert_true(OS_RecvSecureTCP(fds[1], buffer, sizeof(buffer)) > 0);
+    assert_string_equal(buffer, "query 3");
+
+    close(fds[1]);
+    wdbc_async_free(&async);
+}
+
+void test_wdbc_async_connection_lost(void **state)
+{
+    wdbc_async_t async;
+    async_log_t log = { .count = 0 };
+    int fds[2];
+
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    wdbc_async_init(&async, 4);
+    async.sock = fds[0];
+
+    assert_int_equal(OS_SendSecureTCP(fds[1], 5, "ok 1"), 0);
+    assert_int_equal(wdbc_async_query(&async, "query 1", async_callback, &log), 0);
+    assert_int_equal(wdbc_async_query(&async, "query 2", async_callback, &log), 1);
+    close(fds[1]);
+
+    // The second query is failed along with the connection
+    assert_int_equal(wdbc_async_wait(&async), -1);
+    assert_int_equal(log.count, 2);
+    assert_string_equal(log.responses[0], "ok 1");
+    assert_string_equal(log.responses[1], "(null)");
+    assert_int_equal(async.sock, -1);
+    assert_int_equal(async.count, 0);
+
+    wdbc_async_free(&async);
+}
+
+/* Answers "ok <query>" to each query of a single client, until it disconnects */
+static void * pool_server(void *arg)
+{
+    int sock = *(int *)arg;
+    char buffer[OS_SIZE_256];
+    char response[OS_SIZE_512];
+    int peer;
+
+    if (peer = accept(sock, NULL, NULL), peer < 0) {
+        return NULL;
+    }
+
+    while (OS_RecvSecureTCP(peer, buffer, sizeof(buffer) - 1) > 0) {
+        snprintf(response, sizeof(response), "ok %s", buffer);
+        OS_SendSecureTCP(peer, strlen(response) + 1, response);
+    }
+
+    close(peer);
+    return NULL;
+}
+
+void test_wdbc_pool_query(void **state)
+{
+    const char *path = "/tmp/test_wdbc_pool.sock";
+    char *queries[] = { "query 2", "query 3", "query 4" };
+    async_log_t log = { .count = 0 };
+    char response[OS_SIZE_256];
+    wdbc_pool_t pool;
+    pthread_t server;
+    int sock;
+
+    assert_true((sock = OS_BindUnixDomain(path, SOCK_STREAM, OS_MAXSTR)) >= 0);
+    assert_int_equal(pthread_create(&server, NULL, pool_server, &sock), 0);
+
+    wdbc_pool_init(&pool, 1, path);
+
+    assert_int_equal(wdbc_pool_query(&pool, "query 1", response, sizeof(response)), 0);
+    assert_string_equal(response, "ok query 1");
+
+    // The queries go out together, and the responses come back in order
+    assert_int_equal(wdbc_pool_pipeline(&pool, queries, 3, async_callback, &log), 0);
+    assert_int_equal(log.count, 3);
+    assert_string_equal(log.responses[0], "ok query 2");
+    assert_string_equal(log.responses[1], "ok query 3");
+    assert_string_equal(log.responses[2], "ok query 4");
+
+    wdbc_pool_free(&pool);
+    pthread_join(server, NULL);
+    close(sock);
+    unlink(path);
+}
+
+void test_wdbc_pool_backoff(void **state)
+{
+    char *queries[] = { "query 1", "query 2" };
+    async_log_t log = { .count = 0 };
+    char response[OS_SIZE_256];
+    wdbc_pool_t pool;
+
+    wdbc_pool_init(&pool, 2, "/tmp/test_wdbc_pool_missing.sock");
+
+    assert_int_equal(wdbc_pool_query(&pool, "query", response, sizeof(response)), -2);
+    assert_int_equal(pool.backoff, WDBC_POOL_RETRY_MIN);
+    assert_true(pool.retry > 0);
+
+    // No new attempt is made until the retry time
+    assert_int_equal(wdbc_pool_pipeline(&pool, queries, 2, async_callback, &log), -2);
+    assert_int_equal(pool.backoff, WDBC_POOL_RETRY_MIN);
+    assert_int_equal(log.count, 2);
+    assert_string_equal(log.responses[0], "(null)");
+    assert_string_equal(log.responses[1], "(null)");
+
+    wdbc_pool_free(&pool);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_wdbc_table_parse),
+        cmocka_unit_test(test_wdbc_table_parse_error),
+        cmocka_unit_test(test_wdbc_table_parse_truncated),
+        cmocka_unit_test(test_wdbc_table_parse_empty),
+        cmocka_unit_test(test_wdbc_async_query),
+        cmocka_unit_test(test_wdbc_async_connection_lost),
+        cmocka_unit_test(test_wdbc_pool_query),
+        cmocka_unit_test(test_wdbc_pool_backoff),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
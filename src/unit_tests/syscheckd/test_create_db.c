@@ -163,6 +163,15 @@ int __wrap_realtime_adddir(const char *dir, __attribute__((unused)) int whodata)
     return 0;
 }
 
+int __wrap_fim_db_create_index(__attribute__((unused)) fdb_t *fim_sql) {
+    return 0;
+}
+
+void __wrap_fim_scan_push(const char *path, __attribute__((unused)) const fim_element *item, int report) {
+    check_expected(path);
+    check_expected(report);
+}
+
 bool __wrap_HasFilesystem(__attribute__((unused))const char * path, __attribute__((unused))fs_set set) {
     check_expected(path);
 
@@ -1328,12 +1337,38 @@ static void test_init_fim_data_entry(void **state) {
     assert_null(fim_data->local_data->user_name);
     assert_null(fim_data->local_data->group_name);
     assert_int_equal(fim_data->local_data->mtime, 0);
+    assert_int_equal(fim_data->local_data->ctime, 0);
     assert_int_equal(fim_data->local_data->inode, 0);
     assert_int_equal(fim_data->local_data->hash_md5[0], 0);
     assert_int_equal(fim_data->local_data->hash_sha1[0], 0);
     assert_int_equal(fim_data->local_data->hash_sha256[0], 0);
 }
 
+static void test_fim_stat_trusted(void **state) {
+    (void) state;
+    fim_entry_data saved = { .size = 1500, .mtime = 1570184220, .ctime = 1570184220, .inode = 606060,
+                             .dev = 12345678, .options = 511, .last_event = 1570184221 };
+    fim_entry_data data = saved;
+
+    assert_int_equal(fim_stat_trusted(&saved, &data), 1);
+
+    data.ctime++;
+    assert_int_equal(fim_stat_trusted(&saved, &data), 0);
+
+    data = saved;
+    data.options = 127;
+    assert_int_equal(fim_stat_trusted(&saved, &data), 0);
+}
+
+static void test_fim_stat_trusted_changed_while_hashed(void **state) {
+    (void) state;
+    fim_entry_data saved = { .size = 1500, .mtime = 1570184220, .ctime = 1570184220, .inode = 606060,
+                             .dev = 12345678, .options = 511, .last_event = 1570184220 };
+    fim_entry_data data = saved;
+
+    assert_int_equal(fim_stat_trusted(&saved, &data), 0);
+}
+
 static void test_fim_file_add(void **state) {
     fim_data_t *fim_data = *state;
     int ret;
@@ -1935,6 +1970,31 @@ static void test_fim_checker_fim_directory(void **state) {
     fim_checker(path, fim_data->item, NULL, 1);
 }
 
+static void test_fim_checker_fim_directory_pooled(void **state) {
+    fim_data_t *fim_data = *state;
+
+    char * path = "/media/";
+    struct stat buf;
+    buf.st_mode = S_IFDIR;
+    fim_data->item->index = 3;
+    fim_data->item->statbuf = buf;
+    fim_data->item->mode = FIM_SCHEDULED;
+    fim_data->item->pooled = 1;
+
+    will_return(__wrap_lstat, 0);
+
+    expect_string(__wrap_HasFilesystem, path, "/media/");
+    will_return(__wrap_HasFilesystem, 0);
+
+    // The directory is handed to a scan worker, which adds the watch and reads it
+    expect_string(__wrap_fim_scan_push, path, "/media/");
+    expect_value(__wrap_fim_scan_push, report, 1);
+
+    fim_checker(path, fim_data->item, NULL, 1);
+
+    fim_data->item->pooled = 0;
+}
+
 static void test_fim_scan_db_full_double_scan(void **state) {
     expect_string(__wrap__minfo, formatted_msg, FIM_FREQUENCY_STARTED);
 
@@ -3931,6 +3991,10 @@ int main(void) {
         /* init_fim_data_entry */
         cmocka_unit_test_setup_teardown(test_init_fim_data_entry, setup_fim_entry, teardown_fim_entry),
 
+        /* fim_stat_trusted */
+        cmocka_unit_test(test_fim_stat_trusted),
+        cmocka_unit_test(test_fim_stat_trusted_changed_while_hashed),
+
         /* fim_file */
         cmocka_unit_test(test_fim_file_add),
         cmocka_unit_test_setup(test_fim_file_modify, setup_fim_entry),
@@ -3992,6 +4056,9 @@ int main(void) {
         cmocka_unit_test(test_fim_checker_fim_regular_ignore),
         cmocka_unit_test(test_fim_checker_fim_regular_restrict),
         cmocka_unit_test_setup_teardown(test_fim_checker_fim_directory, setup_struct_dirent, teardown_struct_dirent),
+        #ifndef TEST_WINAGENT
+        cmocka_unit_test(test_fim_checker_fim_directory_pooled),
+        #endif
 
         /* fim_directory */
         cmocka_unit_test_setup_teardown(test_fim_directory, setup_struct_dirent, teardown_struct_dirent),
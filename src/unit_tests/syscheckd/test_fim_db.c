@@ -31,6 +31,8 @@ int fim_db_process_get_query(fdb_t *fim_sql, int index,
                                     void * arg);
 int fim_db_exec_simple_wquery(fdb_t *fim_sql, const char *query);
 fim_entry *fim_db_decode_full_row(sqlite3_stmt *stmt);
+void fim_db_bind_digest(sqlite3_stmt *stmt, int index, const char *digest);
+void fim_db_column_digest(sqlite3_stmt *stmt, int index, char *digest, size_t size);
 fim_tmp_file *fim_db_create_temp_file(int storage);
 void fim_db_clean_file(fim_tmp_file **file, int storage);
 
@@ -227,6 +229,33 @@ const char *__wrap_sqlite3_column_text(sqlite3_stmt* pStmt, int iCol) {
     return mock_ptr_type(const char *);
 }
 
+/* Last blob bound. The caller's buffer is gone once it returns, as SQLITE_TRANSIENT allows */
+static unsigned char bound_blob[64];
+static int bound_blob_size = -1;
+
+int __wrap_sqlite3_bind_blob(sqlite3_stmt* pStmt, int a, const void* b, int n, void (*d)(void*)) {
+    assert_in_range(n, 0, sizeof(bound_blob));
+    assert_ptr_equal(d, SQLITE_TRANSIENT);
+
+    if (n > 0) {
+        assert_non_null(b);
+        memcpy(bound_blob, b, n);
+    }
+
+    bound_blob_size = n;
+    return mock();
+}
+
+const void *__wrap_sqlite3_column_blob(sqlite3_stmt* pStmt, int iCol) {
+    check_expected(iCol);
+    return mock_ptr_type(const void *);
+}
+
+int __wrap_sqlite3_column_bytes(sqlite3_stmt* pStmt, int iCol) {
+    check_expected(iCol);
+    return mock();
+}
+
 int __wrap_sqlite3_last_insert_rowid(sqlite3* db){
     return mock();
 }
@@ -418,6 +447,16 @@ static void wraps_fim_db_check_transaction() {
     wraps_fim_db_exec_simple_wquery("BEGIN;");
 }
 
+/**
+ * Successfully wrappes a fim_db_column_digest() call
+ * */
+static void wraps_fim_db_column_digest(int iCol, const char *blob) {
+    expect_value(__wrap_sqlite3_column_blob, iCol, iCol);
+    will_return(__wrap_sqlite3_column_blob, blob);
+    expect_value(__wrap_sqlite3_column_bytes, iCol, iCol);
+    will_return(__wrap_sqlite3_column_bytes, strlen(blob));
+}
+
 /**
  * Successfully wrappes a fim_db_decode_full_row() call
  * */
@@ -434,8 +473,7 @@ static void wraps_fim_db_decode_full_row() {
     will_return(__wrap_sqlite3_column_int, 1000001); // scanned
     expect_value(__wrap_sqlite3_column_int, iCol, 6);
     will_return(__wrap_sqlite3_column_int, 1000002); // options
-    expect_value(__wrap_sqlite3_column_text, iCol, 7);
-    will_return(__wrap_sqlite3_column_text, "checksum"); // checksum
+    wraps_fim_db_column_digest(7, "\xc0\xff\xee\x01"); // checksum
     expect_value(__wrap_sqlite3_column_int, iCol, 8);
     will_return(__wrap_sqlite3_column_int, 111); // dev
     expect_value(__wrap_sqlite3_column_int64, iCol, 9);
@@ -454,14 +492,13 @@ static void wraps_fim_db_decode_full_row() {
     will_return_count(__wrap_sqlite3_column_text, "user_name", 2); // user_name
     expect_value_count(__wrap_sqlite3_column_text, iCol, 16, 2);
     will_return_count(__wrap_sqlite3_column_text, "group_name", 2); // group_name
-    expect_value(__wrap_sqlite3_column_text, iCol, 17);
-    will_return(__wrap_sqlite3_column_text, "hash_md5"); // hash_md5
-    expect_value(__wrap_sqlite3_column_text, iCol, 18);
-    will_return(__wrap_sqlite3_column_text, "hash_sha1"); // hash_sha1
-    expect_value(__wrap_sqlite3_column_text, iCol, 19);
-    will_return(__wrap_sqlite3_column_text, "hash_sha256"); // hash_sha256
+    wraps_fim_db_column_digest(17, "\xd4\x1d\x8c\xd9"); // hash_md5
+    wraps_fim_db_column_digest(18, "\xda\x39\xa3\xee"); // hash_sha1
+    wraps_fim_db_column_digest(19, "\xe3\xb0\xc4\x42"); // hash_sha256
     expect_value(__wrap_sqlite3_column_int, iCol, 20);
     will_return(__wrap_sqlite3_column_int, 12345678); // mtime
+    expect_value(__wrap_sqlite3_column_int, iCol, 21);
+    will_return(__wrap_sqlite3_column_int, 12345679); // ctime
 }
 
 #ifndef TEST_WINAGENT
@@ -831,7 +868,7 @@ void test_fim_db_init_failed_execution(void **state) {
     will_return(__wrap_sqlite3_open_v2, NULL);
     will_return(__wrap_sqlite3_open_v2, SQLITE_OK);
     wraps_fim_db_cache();
-    expect_string(__wrap_sqlite3_exec, sql, "PRAGMA synchronous = OFF");
+    expect_string(__wrap_sqlite3_exec, sql, FIM_DB_PRAGMAS_DISK);
     will_return(__wrap_sqlite3_exec, "ERROR_MESSAGE");
     will_return(__wrap_sqlite3_exec, SQLITE_ERROR);
     expect_string(__wrap__merror, formatted_msg, "SQL ERROR: ERROR_MESSAGE");
@@ -852,7 +889,7 @@ void test_fim_db_init_failed_simple_query(void **state) {
     will_return(__wrap_sqlite3_open_v2, NULL);
     will_return(__wrap_sqlite3_open_v2, SQLITE_OK);
     wraps_fim_db_cache();
-    expect_string(__wrap_sqlite3_exec, sql, "PRAGMA synchronous = OFF");
+    expect_string(__wrap_sqlite3_exec, sql, FIM_DB_PRAGMAS_DISK);
     will_return(__wrap_sqlite3_exec, NULL);
     will_return(__wrap_sqlite3_exec, SQLITE_OK);
     // Simple query fails
@@ -877,7 +914,7 @@ void test_fim_db_init_success(void **state) {
     will_return(__wrap_sqlite3_open_v2, NULL);
     will_return(__wrap_sqlite3_open_v2, SQLITE_OK);
     wraps_fim_db_cache();
-    expect_string(__wrap_sqlite3_exec, sql, "PRAGMA synchronous = OFF");
+    expect_string(__wrap_sqlite3_exec, sql, FIM_DB_PRAGMAS_DISK);
     will_return(__wrap_sqlite3_exec, NULL);
     will_return(__wrap_sqlite3_exec, SQLITE_OK);
     wraps_fim_db_exec_simple_wquery("BEGIN;");
@@ -945,6 +982,7 @@ void test_fim_db_insert_data_no_rowid_error(void **state) {
         will_return_always(__wrap_sqlite3_bind_int64, 0);
         #endif
         will_return_always(__wrap_sqlite3_bind_text, 0);
+        will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     }
 
     will_return(__wrap_sqlite3_step, SQLITE_ERROR);
@@ -975,6 +1013,7 @@ void test_fim_db_insert_data_no_rowid_success(void **state) {
         will_return_always(__wrap_sqlite3_bind_int64, 0);
         #endif
         will_return_always(__wrap_sqlite3_bind_text, 0);
+        will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     }
 
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
@@ -992,6 +1031,7 @@ void test_fim_db_insert_data_rowid_error(void **state) {
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ERROR);
     will_return(__wrap_sqlite3_errmsg, "ERROR MESSAGE");
     expect_string(__wrap__merror, formatted_msg, "SQL ERROR: (1)ERROR MESSAGE");
@@ -1008,6 +1048,7 @@ void test_fim_db_insert_data_rowid_success(void **state) {
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
     int ret;
     int row_id = 1;
@@ -1023,6 +1064,7 @@ void test_fim_db_insert_path_error(void **state) {
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ERROR);
     will_return(__wrap_sqlite3_errmsg, "ERROR MESSAGE");
     expect_string(__wrap__merror, formatted_msg, "SQL ERROR: (1)ERROR MESSAGE");
@@ -1037,6 +1079,7 @@ void test_fim_db_insert_path_constraint_error(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_CONSTRAINT);
     will_return(__wrap_sqlite3_step, SQLITE_ERROR);
     will_return(__wrap_sqlite3_errmsg, "ERROR MESSAGE");
@@ -1052,6 +1095,7 @@ void test_fim_db_insert_path_constraint_success(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_CONSTRAINT);
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
     int ret;
@@ -1065,6 +1109,7 @@ void test_fim_db_insert_path_success(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
     int ret;
     ret = fim_db_insert_path(test_data->fim_sql, test_data->entry->path, test_data->entry->data, 1);
@@ -1141,6 +1186,7 @@ void test_fim_db_insert_inode_id_nonull(void **state) {
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);    // Needed for fim_db_insert_path()
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
 
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
@@ -1164,6 +1210,7 @@ void test_fim_db_insert_inode_id_null(void **state) {
     will_return_count(__wrap_sqlite3_clear_bindings, SQLITE_OK, 2);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_bind_int64, 0);
 
     will_return_count(__wrap_sqlite3_step, SQLITE_DONE, 2);
@@ -1186,6 +1233,7 @@ void test_fim_db_insert_inode_id_null_error(void **state) {
     will_return_count(__wrap_sqlite3_clear_bindings, SQLITE_OK, 2);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_bind_int64, 0);
 
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
@@ -1205,6 +1253,7 @@ void test_fim_db_insert_inode_id_null_delete(void **state) {
     will_return_count(__wrap_sqlite3_clear_bindings, SQLITE_OK, 4);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_bind_int64, 0);
 
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
@@ -1240,6 +1289,7 @@ void test_fim_db_insert_inode_id_null_delete_error(void **state) {
     will_return_count(__wrap_sqlite3_clear_bindings, SQLITE_OK, 4);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_bind_int64, 0);
 
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
@@ -1269,6 +1319,7 @@ void test_fim_db_insert_inode_id_null_delete_row_error(void **state) {
     will_return_count(__wrap_sqlite3_clear_bindings, SQLITE_OK, 3);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_bind_int64, 0);
 
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
@@ -1300,6 +1351,7 @@ void test_fim_db_remove_path_no_entry(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 0);
@@ -1323,6 +1375,7 @@ void test_fim_db_remove_path_one_entry(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 1);
@@ -1347,6 +1400,7 @@ void test_fim_db_remove_path_one_entry_step_fail(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 1);
@@ -1373,6 +1427,7 @@ void test_fim_db_remove_path_one_entry_alert_fail(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 1);
@@ -1407,6 +1462,7 @@ void test_fim_db_remove_path_one_entry_alert_fail_invalid_pos(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 1);
@@ -1433,6 +1489,7 @@ void test_fim_db_remove_path_one_entry_alert_success(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_int, 0);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 1);
@@ -1468,6 +1525,7 @@ void test_fim_db_remove_path_multiple_entry(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 5);
@@ -1491,6 +1549,7 @@ void test_fim_db_remove_path_multiple_entry_step_fail(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 5);
@@ -1515,6 +1574,7 @@ void test_fim_db_remove_path_failed_path(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_maybe(__wrap_sqlite3_bind_int, 0);
     will_return_maybe(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ERROR);
     expect_string(__wrap_sqlite3_exec, sql, "END;");
     will_return(__wrap_sqlite3_exec, "ERROR MESSAGE");
@@ -1545,6 +1605,7 @@ void test_fim_db_remove_path_no_entry_realtime_file(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 0);
@@ -1567,6 +1628,7 @@ void test_fim_db_remove_path_no_entry_scheduled_file(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     expect_value(__wrap_sqlite3_column_int, iCol, 0);
     will_return(__wrap_sqlite3_column_int, 0);
@@ -1587,6 +1649,7 @@ void test_fim_db_get_path_inexistent(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_maybe(__wrap_sqlite3_bind_int, 0);
     will_return_maybe(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ERROR);
     fim_entry *ret = fim_db_get_path(test_data->fim_sql, test_data->entry->path);
     state[1] = ret;
@@ -1599,6 +1662,7 @@ void test_fim_db_get_path_existent(void **state) {
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_maybe(__wrap_sqlite3_bind_int, 0);
     will_return_maybe(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     wraps_fim_db_decode_full_row();
     fim_entry *ret = fim_db_get_path(test_data->fim_sql, test_data->entry->path);
@@ -1610,7 +1674,7 @@ void test_fim_db_get_path_existent(void **state) {
     assert_int_equal(2, ret->data->entry_type);
     assert_int_equal(1000001, ret->data->scanned);
     assert_int_equal(1000002, ret->data->options);
-    assert_string_equal("checksum", ret->data->checksum);
+    assert_string_equal("c0ffee01", ret->data->checksum);
     assert_int_equal(111, ret->data->dev);
     assert_int_equal(1024, ret->data->inode);
     assert_int_equal(4096, ret->data->size);
@@ -1620,9 +1684,9 @@ void test_fim_db_get_path_existent(void **state) {
     assert_string_equal("gid", ret->data->gid);
     assert_string_equal("user_name", ret->data->user_name);
     assert_string_equal("group_name", ret->data->group_name);
-    assert_string_equal("hash_md5", ret->data->hash_md5);
-    assert_string_equal("hash_sha1", ret->data->hash_sha1);
-    assert_string_equal("hash_sha256", ret->data->hash_sha256);
+    assert_string_equal("d41d8cd9", ret->data->hash_md5);
+    assert_string_equal("da39a3ee", ret->data->hash_sha1);
+    assert_string_equal("e3b0c442", ret->data->hash_sha256);
     assert_int_equal(12345678, ret->data->mtime);
 }
 /*----------------------------------------------*/
@@ -1674,6 +1738,7 @@ void test_fim_db_get_path_range_success(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
 
     will_return(__wrap_sqlite3_step, SQLITE_DONE);
     wraps_fim_db_check_transaction();
@@ -1745,15 +1810,25 @@ void test_fim_db_get_data_checksum_success(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
-    wraps_fim_db_decode_full_row();
-    expect_string(__wrap_EVP_DigestUpdate, d, "checksum");
+    wraps_fim_db_column_digest(0, "\xc0\xff\xee\x01");
+    expect_string(__wrap_EVP_DigestUpdate, d, "c0ffee01");
     expect_value(__wrap_EVP_DigestUpdate, cnt, 8);
     will_return(__wrap_EVP_DigestUpdate, 0);
-    will_return(__wrap_sqlite3_step, SQLITE_DONE);  // Ending the loop at fim_db_process_get_query()
+    will_return(__wrap_sqlite3_step, SQLITE_DONE);  // Ending the loop at fim_db_get_data_checksum()
     wraps_fim_db_check_transaction();
     int ret = fim_db_get_data_checksum(test_data->fim_sql, NULL);
     assert_int_equal(ret, FIMDB_OK);
 }
+/*----------------------------------------------*/
+/*----------fim_db_create_index()------------------*/
+void test_fim_db_create_index_success(void **state) {
+    test_fim_db_insert_data *test_data = *state;
+    wraps_fim_db_exec_simple_wquery("CREATE INDEX IF NOT EXISTS inode_index ON entry_path (inode_id);");
+
+    int ret = fim_db_create_index(test_data->fim_sql);
+    assert_int_equal(ret, FIMDB_OK);
+}
+
 /*----------------------------------------------*/
 /*----------fim_db_check_transaction()------------------*/
 void test_fim_db_check_transaction_last_commit_is_0(void **state) {
@@ -2016,6 +2091,7 @@ void test_fim_db_data_checksum_range_first_half_failed(void **state) {
     will_return(__wrap_sqlite3_reset, SQLITE_OK);
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ERROR);
     will_return(__wrap_sqlite3_errmsg, "ERROR MESSAGE");
     expect_string(__wrap__merror, formatted_msg, "SQL ERROR: ERROR MESSAGE");
@@ -2029,11 +2105,14 @@ void test_fim_db_data_checksum_range_second_half_failed(void **state) {
     will_return(__wrap_sqlite3_reset, SQLITE_OK);
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
 
     // First half
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
-    wraps_fim_db_decode_full_row();
-    expect_string(__wrap_EVP_DigestUpdate, d, "checksum");
+    expect_value(__wrap_sqlite3_column_text, iCol, 0);
+    will_return(__wrap_sqlite3_column_text, "/some/random/path");
+    wraps_fim_db_column_digest(1, "\xc0\xff\xee\x01");
+    expect_string(__wrap_EVP_DigestUpdate, d, "c0ffee01");
     expect_value(__wrap_EVP_DigestUpdate, cnt, 8);
     will_return(__wrap_EVP_DigestUpdate, 0);
 
@@ -2052,11 +2131,14 @@ void test_fim_db_data_checksum_range_null_path(void **state) {
     will_return(__wrap_sqlite3_reset, SQLITE_OK);
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
 
     // Fist half
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
-    wraps_fim_db_decode_full_row();
-    expect_string(__wrap_EVP_DigestUpdate, d, "checksum");
+    expect_value(__wrap_sqlite3_column_text, iCol, 0);
+    will_return(__wrap_sqlite3_column_text, "/some/random/path");
+    wraps_fim_db_column_digest(1, "\xc0\xff\xee\x01");
+    expect_string(__wrap_EVP_DigestUpdate, d, "c0ffee01");
     expect_value(__wrap_EVP_DigestUpdate, cnt, 8);
     will_return(__wrap_EVP_DigestUpdate, 0);
 
@@ -2072,18 +2154,23 @@ void test_fim_db_data_checksum_range_success(void **state) {
     will_return(__wrap_sqlite3_reset, SQLITE_OK);
     will_return(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
 
     // Fist half
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
-    wraps_fim_db_decode_full_row();
-    expect_string(__wrap_EVP_DigestUpdate, d, "checksum");
+    expect_value(__wrap_sqlite3_column_text, iCol, 0);
+    will_return(__wrap_sqlite3_column_text, "/some/random/path");
+    wraps_fim_db_column_digest(1, "\xc0\xff\xee\x01");
+    expect_string(__wrap_EVP_DigestUpdate, d, "c0ffee01");
     expect_value(__wrap_EVP_DigestUpdate, cnt, 8);
     will_return(__wrap_EVP_DigestUpdate, 0);
 
     // Second half
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
-    wraps_fim_db_decode_full_row();
-    expect_string(__wrap_EVP_DigestUpdate, d, "checksum");
+    expect_value(__wrap_sqlite3_column_text, iCol, 0);
+    will_return(__wrap_sqlite3_column_text, "/some/random/path");
+    wraps_fim_db_column_digest(1, "\xc0\xff\xee\x01");
+    expect_string(__wrap_EVP_DigestUpdate, d, "c0ffee01");
     expect_value(__wrap_EVP_DigestUpdate, cnt, 8);
     will_return(__wrap_EVP_DigestUpdate, 0);
 
@@ -2244,6 +2331,7 @@ void test_fim_db_sync_path_range_disk(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     wraps_fim_db_decode_full_row();
 
@@ -2270,6 +2358,7 @@ void test_fim_db_sync_path_range_memory(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     wraps_fim_db_decode_full_row();
 
@@ -2301,6 +2390,7 @@ void test_fim_db_delete_range_success(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     wraps_fim_db_decode_full_row();
 
@@ -2331,6 +2421,7 @@ void test_fim_db_delete_range_error(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     wraps_fim_db_decode_full_row();
 
@@ -2376,6 +2467,7 @@ void test_fim_db_delete_not_scanned(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     wraps_fim_db_decode_full_row();
 
@@ -2404,6 +2496,7 @@ void test_fim_db_process_missing_entry(void **state) {
     will_return_always(__wrap_sqlite3_reset, SQLITE_OK);
     will_return_always(__wrap_sqlite3_clear_bindings, SQLITE_OK);
     will_return_always(__wrap_sqlite3_bind_text, 0);
+    will_return_maybe(__wrap_sqlite3_bind_blob, 0);
     will_return(__wrap_sqlite3_step, SQLITE_ROW);
     wraps_fim_db_decode_full_row();
 
@@ -2622,7 +2715,7 @@ void test_fim_db_decode_full_row(void **state) {
     assert_int_equal(test_data->entry->data->entry_type, 2);
     assert_int_equal(test_data->entry->data->scanned, 1000001);
     assert_int_equal(test_data->entry->data->options, 1000002);
-    assert_string_equal(test_data->entry->data->checksum, "checksum");
+    assert_string_equal(test_data->entry->data->checksum, "c0ffee01");
     assert_int_equal(test_data->entry->data->dev, 111);
     assert_int_equal(test_data->entry->data->inode, 1024);
     assert_int_equal(test_data->entry->data->size, 4096);
@@ -2632,12 +2725,81 @@ void test_fim_db_decode_full_row(void **state) {
     assert_string_equal(test_data->entry->data->gid, "gid");
     assert_string_equal(test_data->entry->data->user_name, "user_name");
     assert_string_equal(test_data->entry->data->group_name, "group_name");
-    assert_string_equal(test_data->entry->data->hash_md5, "hash_md5");
-    assert_string_equal(test_data->entry->data->hash_sha1, "hash_sha1");
-    assert_string_equal(test_data->entry->data->hash_sha256, "hash_sha256");
+    assert_string_equal(test_data->entry->data->hash_md5, "d41d8cd9");
+    assert_string_equal(test_data->entry->data->hash_sha1, "da39a3ee");
+    assert_string_equal(test_data->entry->data->hash_sha256, "e3b0c442");
     assert_int_equal(test_data->entry->data->mtime, 12345678);
 }
 
+/*----------------------------------------------*/
+/*----------fim_db_bind_digest()----------------*/
+/*----------fim_db_column_digest()--------------*/
+void test_fim_db_digest_sha1(void **state) {
+    // SHA-1 of "abc"
+    const char *hex = "a9993e364706816aba3e25717850c26c9cd0d89d";
+    const unsigned char blob[] = {
+        0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+        0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d
+    };
+    os_sha1 digest;
+
+    will_return(__wrap_sqlite3_bind_blob, 0);
+    fim_db_bind_digest(NULL, 1, hex);
+
+    assert_int_equal(bound_blob_size, sizeof(blob));
+    assert_memory_equal(bound_blob, blob, sizeof(blob));
+
+    expect_value(__wrap_sqlite3_column_blob, iCol, 7);
+    will_return(__wrap_sqlite3_column_blob, bound_blob);
+    expect_value(__wrap_sqlite3_column_bytes, iCol, 7);
+    will_return(__wrap_sqlite3_column_bytes, bound_blob_size);
+    fim_db_column_digest(NULL, 7, digest, sizeof(digest));
+
+    assert_string_equal(digest, hex);
+}
+
+void test_fim_db_digest_sha256(void **state) {
+    // SHA-256 of "abc"
+    const char *hex = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+    const unsigned char blob[] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    os_sha256 digest;
+
+    will_return(__wrap_sqlite3_bind_blob, 0);
+    fim_db_bind_digest(NULL, 19, hex);
+
+    assert_int_equal(bound_blob_size, sizeof(blob));
+    assert_memory_equal(bound_blob, blob, sizeof(blob));
+
+    expect_value(__wrap_sqlite3_column_blob, iCol, 19);
+    will_return(__wrap_sqlite3_column_blob, bound_blob);
+    expect_value(__wrap_sqlite3_column_bytes, iCol, 19);
+    will_return(__wrap_sqlite3_column_bytes, bound_blob_size);
+    fim_db_column_digest(NULL, 19, digest, sizeof(digest));
+
+    assert_string_equal(digest, hex);
+}
+
+void test_fim_db_digest_empty(void **state) {
+    os_sha1 digest;
+
+    // Files with no hash keep an empty digest
+    will_return(__wrap_sqlite3_bind_blob, 0);
+    fim_db_bind_digest(NULL, 1, "");
+
+    assert_int_equal(bound_blob_size, 0);
+
+    expect_value(__wrap_sqlite3_column_blob, iCol, 7);
+    will_return(__wrap_sqlite3_column_blob, NULL);
+    expect_value(__wrap_sqlite3_column_bytes, iCol, 7);
+    will_return(__wrap_sqlite3_column_bytes, 0);
+    fim_db_column_digest(NULL, 7, digest, sizeof(digest));
+
+    assert_string_equal(digest, "");
+}
+
 /*----------------------------------------------*/
 /*----------fim_db_set_scanned_error()------------*/
 void test_fim_db_set_scanned_error(void **state) {
@@ -2817,6 +2979,8 @@ int main(void) {
         // fim_db_get_data_checksum
         cmocka_unit_test_setup_teardown(test_fim_db_get_data_checksum_failed, test_fim_db_setup, test_fim_db_teardown),
         cmocka_unit_test_setup_teardown(test_fim_db_get_data_checksum_success, test_fim_db_setup, test_fim_db_teardown),
+        // fim_db_create_index
+        cmocka_unit_test_setup_teardown(test_fim_db_create_index_success, test_fim_db_setup, test_fim_db_teardown),
         // fim_db_check_transaction
         cmocka_unit_test_setup_teardown(test_fim_db_check_transaction_last_commit_is_0, test_fim_db_setup, test_fim_db_teardown),
         cmocka_unit_test_setup_teardown(test_fim_db_check_transaction_failed, test_fim_db_setup, test_fim_db_teardown),
@@ -2885,6 +3049,10 @@ int main(void) {
         cmocka_unit_test_setup_teardown(test_fim_db_get_count_entry_path_error, test_fim_db_setup, test_fim_db_teardown),
         // fim_db_decode_full_row
         cmocka_unit_test_teardown(test_fim_db_decode_full_row, test_fim_db_teardown),
+        // fim_db_bind_digest / fim_db_column_digest
+        cmocka_unit_test(test_fim_db_digest_sha1),
+        cmocka_unit_test(test_fim_db_digest_sha256),
+        cmocka_unit_test(test_fim_db_digest_empty),
         // fim_db_set_scanned
         cmocka_unit_test_setup_teardown(test_fim_db_set_scanned_error, test_fim_db_setup, test_fim_db_teardown),
         cmocka_unit_test_setup_teardown(test_fim_db_set_scanned_success, test_fim_db_setup, test_fim_db_teardown),
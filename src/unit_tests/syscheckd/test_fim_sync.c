@@ -103,6 +103,11 @@ int __wrap_fim_db_get_data_checksum(fdb_t *fim_sql, void * arg) {
     return mock();
 }
 
+int __wrap_fim_db_get_changes(fdb_t *fim_sql) {
+    check_expected_ptr(fim_sql);
+    return mock();
+}
+
 char * __wrap_dbsync_check_msg(const char * component, dbsync_msg msg, long id, const char * start, const char * top, const char * tail, const char * checksum) {
     check_expected(component);
     check_expected(msg);
@@ -302,6 +307,9 @@ static void test_fim_sync_checksum_checksum_error(void **state) {
     will_return(__wrap_fim_db_get_row_path, NULL);
     will_return(__wrap_fim_db_get_row_path, FIMDB_OK);
 
+    expect_value(__wrap_fim_db_get_changes, fim_sql, syscheck.database);
+    will_return(__wrap_fim_db_get_changes, 1);
+
     expect_value(__wrap_fim_db_get_data_checksum, fim_sql, syscheck.database);
     will_return(__wrap_fim_db_get_data_checksum, FIMDB_ERR);
 
@@ -319,6 +327,9 @@ static void test_fim_sync_checksum_empty_db(void **state) {
     will_return(__wrap_fim_db_get_row_path, NULL);
     will_return(__wrap_fim_db_get_row_path, FIMDB_OK);
 
+    expect_value(__wrap_fim_db_get_changes, fim_sql, syscheck.database);
+    will_return(__wrap_fim_db_get_changes, 2);
+
     expect_value(__wrap_fim_db_get_data_checksum, fim_sql, syscheck.database);
     will_return(__wrap_fim_db_get_data_checksum, FIMDB_OK);
 
@@ -343,6 +354,9 @@ static void test_fim_sync_checksum_success(void **state) {
     will_return(__wrap_fim_db_get_row_path, strdup("stop"));
     will_return(__wrap_fim_db_get_row_path, FIMDB_OK);
 
+    expect_value(__wrap_fim_db_get_changes, fim_sql, syscheck.database);
+    will_return(__wrap_fim_db_get_changes, 3);
+
     expect_value(__wrap_fim_db_get_data_checksum, fim_sql, syscheck.database);
     will_return(__wrap_fim_db_get_data_checksum, FIMDB_OK);
 
@@ -359,6 +373,32 @@ static void test_fim_sync_checksum_success(void **state) {
     fim_sync_checksum();
 }
 
+static void test_fim_sync_checksum_unchanged(void **state) {
+    expect_value_count(__wrap_fim_db_get_row_path, fim_sql, syscheck.database, 2);
+    expect_value(__wrap_fim_db_get_row_path, mode, FIM_FIRST_ROW);
+    expect_value(__wrap_fim_db_get_row_path, mode, FIM_LAST_ROW);
+    will_return(__wrap_fim_db_get_row_path, strdup("start"));
+    will_return(__wrap_fim_db_get_row_path, FIMDB_OK);
+    will_return(__wrap_fim_db_get_row_path, strdup("stop"));
+    will_return(__wrap_fim_db_get_row_path, FIMDB_OK);
+
+    // Same changes as in the last test: the checksum is not calculated again
+    expect_value(__wrap_fim_db_get_changes, fim_sql, syscheck.database);
+    will_return(__wrap_fim_db_get_changes, 3);
+
+    expect_string(__wrap_dbsync_check_msg, component, "syscheck");
+    expect_value(__wrap_dbsync_check_msg, msg, INTEGRITY_CHECK_GLOBAL);
+    expect_value(__wrap_dbsync_check_msg, id, 1572521857);
+    expect_string(__wrap_dbsync_check_msg, start, "start");
+    expect_string(__wrap_dbsync_check_msg, top, "stop");
+    expect_value(__wrap_dbsync_check_msg, tail, NULL);
+    will_return(__wrap_dbsync_check_msg, strdup("A mock message"));
+
+    expect_string(__wrap_fim_send_sync_msg, msg, "A mock message");
+
+    fim_sync_checksum();
+}
+
 /* fim_sync_checksum_split */
 static void test_fim_sync_checksum_split_get_count_range_error(void **state) {
     expect_value(__wrap_fim_db_get_count_range, fim_sql, syscheck.database);
@@ -627,6 +667,7 @@ int main(void) {
         cmocka_unit_test(test_fim_sync_checksum_checksum_error),
         cmocka_unit_test(test_fim_sync_checksum_empty_db),
         cmocka_unit_test(test_fim_sync_checksum_success),
+        cmocka_unit_test(test_fim_sync_checksum_unchanged),
 
         /* fim_sync_checksum_split */
         cmocka_unit_test(test_fim_sync_checksum_split_get_count_range_error),
@@ -297,10 +297,13 @@ static int setup_group(void **state) {
     if(syscheck.realtime == NULL)
         return -1;
 
+    syscheck.realtime->dirpaths = radix_init();
+
     return 0;
 }
 
 static int teardown_group(void **state) {
+    radix_destroy(syscheck.realtime->dirpaths);
     Free_Syscheck(&syscheck);
 
     return 0;
@@ -392,6 +395,12 @@ static int teardown_realtime_start(void **state) {
     return 0;
 }
 
+static int teardown_dirpaths(void **state) {
+    radix_delete_prefix(syscheck.realtime->dirpaths, "", NULL, NULL);
+
+    return 0;
+}
+
 static int setup_hash_node(void **state) {
     OSHashNode *node = (OSHashNode *)calloc(1, sizeof(OSHashNode));
 
@@ -651,10 +660,13 @@ void test_realtime_adddir_realtime_add(void **state)
     expect_string(__wrap__mdebug2, formatted_msg, "(6224): Entry '/etc/folder' already exists in the RT hash table.");
     expect_string(__wrap__mdebug1, formatted_msg, "(6227): Directory added for real time monitoring: '/etc/folder'");
     will_return(__wrap__mdebug1, 1);
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
 
     ret = realtime_adddir(path, 0, 0);
 
     assert_int_equal(ret, 1);
+    assert_int_equal((intptr_t)radix_get(syscheck.realtime->dirpaths, path), 1);
 }
 
 
@@ -671,6 +683,8 @@ void test_realtime_adddir_realtime_add_hash_failure(void **state)
     will_return(__wrap_OSHash_Add_ex, 0);
     expect_string(__wrap__merror_exit, formatted_msg, "(6697): Out of memory. Exiting.");
     will_return_always(__wrap__mdebug1, 0);
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
 
     ret = realtime_adddir(path, 0, 0);
 
@@ -686,13 +700,18 @@ void test_realtime_adddir_realtime_update(void **state)
     const char * path = "/etc/folder";
 
     syscheck.realtime->fd = 1;
-    will_return(__wrap_inotify_add_watch, 1);
+    will_return(__wrap_inotify_add_watch, 2);
     will_return(__wrap_OSHash_Get_ex, 1);
     will_return(__wrap_OSHash_Update_ex, 1);
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
 
     ret = realtime_adddir(path, 0, 0);
 
     assert_int_equal(ret, 1);
+
+    // The directory got a new watch descriptor
+    assert_int_equal((intptr_t)radix_get(syscheck.realtime->dirpaths, path), 2);
 }
 
 
@@ -851,6 +870,8 @@ void test_realtime_process_delete(void **state)
     char *data;
     will_return_always(__wrap_OSHash_Delete_ex, data);
     expect_string(__wrap__mdebug2, formatted_msg, "(6344): Inotify watch deleted for 'test'");
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
     expect_function_call(__wrap_pthread_mutex_unlock);
     char **paths = NULL;
     paths = os_AddStrArray("/test", paths);
@@ -875,43 +896,31 @@ void test_realtime_process_move_self(void **state) {
     expect_string(__wrap__mdebug2, formatted_msg, "Duplicate event in real-time buffer: test/test");
 
     // In delete_subdirectories_watches
-    OSHashNode *node = *state;
-
-    node->data = "test/sub";
-
-    syscheck.realtime->fd = 1;
-
-    expect_value(__wrap_OSHash_Begin, self, syscheck.realtime->dirtb);
-    will_return(__wrap_OSHash_Begin, node);
-
-    char *data = strdup("delete this");
-    // will_return_always(__wrap_OSHash_Delete_ex, data);
-    expect_string(__wrap__mdebug2, formatted_msg, "(6344): Inotify watch deleted for 'test/sub'");
-
-    expect_value(__wrap_OSHash_Begin, self, syscheck.realtime->dirtb);
-    will_return(__wrap_OSHash_Begin, NULL);
+    radix_insert(syscheck.realtime->dirpaths, "test/sub", (void *)2);
 
     expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_lock);
+    will_return(__wrap_OSHash_Get, "test/sub");
+    will_return_always(__wrap_OSHash_Delete_ex, NULL);
+    expect_string(__wrap__mdebug2, formatted_msg, "(6344): Inotify watch deleted for 'test/sub'");
+    expect_function_call(__wrap_pthread_mutex_unlock);
     expect_function_call(__wrap_pthread_mutex_unlock);
-
-    free(data);
 
     // Back to realtime_process
     expect_function_call(__wrap_pthread_mutex_lock);
-    expect_function_call(__wrap_pthread_mutex_unlock);
-
-    data = strdup("delete this");
-    will_return_always(__wrap_OSHash_Delete_ex, data);
     expect_string(__wrap__mdebug2, formatted_msg, "(6344): Inotify watch deleted for 'test'");
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
 
     char **paths = NULL;
     paths = os_AddStrArray("/test", paths);
     will_return(__wrap_rbtree_keys, paths);
     expect_string(__wrap_fim_realtime_event, file, "/test");
 
-    free(data);
-
     realtime_process();
+
+    assert_int_equal(radix_size(syscheck.realtime->dirpaths), 0);
 }
 
 void test_realtime_process_failure(void **state)
@@ -937,18 +946,15 @@ void test_delete_subdirectories_watches_realtime_fd_null(void **state) {
     delete_subdirectories_watches(dir);
 }
 
-void test_delete_subdirectories_watches_hash_node_null(void **state) {
+void test_delete_subdirectories_watches_no_watches(void **state) {
     (void) state;
     char *dir = "/test";
-    int inode_it = 0;
 
     syscheck.realtime->fd = 1;
 
     expect_function_call(__wrap_pthread_mutex_lock);
-
-    expect_value(__wrap_OSHash_Begin, self, syscheck.realtime->dirtb);
-    will_return(__wrap_OSHash_Begin, NULL);
-
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
     expect_function_call(__wrap_pthread_mutex_unlock);
 
     delete_subdirectories_watches(dir);
@@ -957,50 +963,71 @@ void test_delete_subdirectories_watches_hash_node_null(void **state) {
 void test_delete_subdirectories_watches_not_same_name(void **state) {
     (void) state;
     char *dir = "/test/";
-    OSHashNode *node = *state;
 
-    node->data = "/other/sub";
+    radix_insert(syscheck.realtime->dirpaths, "/other/sub", (void *)1);
+    radix_insert(syscheck.realtime->dirpaths, "/test", (void *)2);
+    radix_insert(syscheck.realtime->dirpaths, "/testing/sub", (void *)3);
 
     syscheck.realtime->fd = 1;
 
     expect_function_call(__wrap_pthread_mutex_lock);
-    expect_value(__wrap_OSHash_Begin, self, syscheck.realtime->dirtb);
-    will_return(__wrap_OSHash_Begin, node);
-
-    expect_value(__wrap_OSHash_Next, self, syscheck.realtime->dirtb);
-    will_return(__wrap_OSHash_Next, NULL);
-
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
     expect_function_call(__wrap_pthread_mutex_unlock);
 
     delete_subdirectories_watches(dir);
+
+    assert_int_equal(radix_size(syscheck.realtime->dirpaths), 3);
 }
 
 void test_delete_subdirectories_watches_deletes(void **state) {
     (void) state;
     char *dir = "/test";
-    OSHashNode *node = *state;
 
-    node->data = "/test/sub";
+    radix_insert(syscheck.realtime->dirpaths, "/test/sub", (void *)1);
+    radix_insert(syscheck.realtime->dirpaths, "/test/sub/deeper", (void *)2);
+    radix_insert(syscheck.realtime->dirpaths, "/testing", (void *)3);
 
     syscheck.realtime->fd = 1;
 
+    expect_function_call(__wrap_pthread_mutex_lock);
     expect_function_call(__wrap_pthread_mutex_lock);
 
-    expect_value(__wrap_OSHash_Begin, self, syscheck.realtime->dirtb);
-    will_return(__wrap_OSHash_Begin, node);
-
-    char *data = strdup("delete this");
-    will_return_always(__wrap_OSHash_Delete_ex, data);
+    will_return(__wrap_OSHash_Get, "/test/sub");
+    will_return(__wrap_OSHash_Get, "/test/sub/deeper");
+    will_return_always(__wrap_OSHash_Delete_ex, NULL);
     expect_string(__wrap__mdebug2, formatted_msg, "(6344): Inotify watch deleted for '/test/sub'");
+    expect_string(__wrap__mdebug2, formatted_msg, "(6344): Inotify watch deleted for '/test/sub/deeper'");
 
-    expect_value(__wrap_OSHash_Begin, self, syscheck.realtime->dirtb);
-    will_return(__wrap_OSHash_Begin, NULL);
-
     expect_function_call(__wrap_pthread_mutex_unlock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
+
+    delete_subdirectories_watches(dir);
+
+    assert_int_equal(radix_size(syscheck.realtime->dirpaths), 1);
+    assert_non_null(radix_get(syscheck.realtime->dirpaths, "/testing"));
+}
+
+void test_delete_subdirectories_watches_reused_descriptor(void **state) {
+    (void) state;
+    char *dir = "/test";
 
-    free(data);
+    radix_insert(syscheck.realtime->dirpaths, "/test/old", (void *)4);
+
+    syscheck.realtime->fd = 1;
+
+    expect_function_call(__wrap_pthread_mutex_lock);
+    expect_function_call(__wrap_pthread_mutex_lock);
+
+    // The descriptor now watches another directory: it's kept
+    will_return(__wrap_OSHash_Get, "/other");
+
+    expect_function_call(__wrap_pthread_mutex_unlock);
+    expect_function_call(__wrap_pthread_mutex_unlock);
 
     delete_subdirectories_watches(dir);
+
+    assert_int_equal(radix_size(syscheck.realtime->dirpaths), 0);
 }
 
 #else // TEST_WINAGENT
@@ -1390,9 +1417,9 @@ int main(void) {
         cmocka_unit_test(test_realtime_adddir_realtime_failure),
         cmocka_unit_test(test_realtime_adddir_realtime_watch_max_reached_failure),
         cmocka_unit_test(test_realtime_adddir_realtime_watch_generic_failure),
-        cmocka_unit_test(test_realtime_adddir_realtime_add),
-        cmocka_unit_test(test_realtime_adddir_realtime_add_hash_failure),
-        cmocka_unit_test(test_realtime_adddir_realtime_update),
+        cmocka_unit_test_teardown(test_realtime_adddir_realtime_add, teardown_dirpaths),
+        cmocka_unit_test_teardown(test_realtime_adddir_realtime_add_hash_failure, teardown_dirpaths),
+        cmocka_unit_test_teardown(test_realtime_adddir_realtime_update, teardown_dirpaths),
         cmocka_unit_test(test_realtime_adddir_realtime_update_failure),
 
         /* free_syscheck_dirtb_data */
@@ -1406,14 +1433,15 @@ int main(void) {
         cmocka_unit_test(test_realtime_process_len_path_separator),
         cmocka_unit_test(test_realtime_process_overflow),
         cmocka_unit_test(test_realtime_process_delete),
-        cmocka_unit_test_setup_teardown(test_realtime_process_move_self, setup_hash_node, teardown_hash_node),
+        cmocka_unit_test_teardown(test_realtime_process_move_self, teardown_dirpaths),
         cmocka_unit_test(test_realtime_process_failure),
 
         /* delete_subdirectories_watches */
         cmocka_unit_test_setup_teardown(test_delete_subdirectories_watches_realtime_fd_null, setup_hash_node, teardown_hash_node),
-        cmocka_unit_test_setup_teardown(test_delete_subdirectories_watches_hash_node_null, setup_hash_node, teardown_hash_node),
-        cmocka_unit_test_setup_teardown(test_delete_subdirectories_watches_not_same_name, setup_hash_node, teardown_hash_node),
-        cmocka_unit_test_setup_teardown(test_delete_subdirectories_watches_deletes, setup_hash_node, teardown_hash_node),
+        cmocka_unit_test(test_delete_subdirectories_watches_no_watches),
+        cmocka_unit_test_teardown(test_delete_subdirectories_watches_not_same_name, teardown_dirpaths),
+        cmocka_unit_test_teardown(test_delete_subdirectories_watches_deletes, teardown_dirpaths),
+        cmocka_unit_test_teardown(test_delete_subdirectories_watches_reused_descriptor, teardown_dirpaths),
 
         #else
         // realtime_win32read
@@ -76,6 +76,16 @@ int __wrap_fim_registry_event(char *key, fim_entry_data *data, int pos) {
     return mock();
 }
 
+fim_entry *__wrap_fim_db_get_path(fdb_t *fim_sql, const char *file_path) {
+    check_expected(file_path);
+    return mock_type(fim_entry *);
+}
+
+int __wrap_fim_db_set_scanned(fdb_t *fim_sql, char *path) {
+    check_expected(path);
+    return mock();
+}
+
 int __wrap_EVP_DigestUpdate(EVP_MD_CTX *ctx, const void *data, size_t count)
 {
    check_expected(data);
@@ -241,6 +251,42 @@ void test_os_winreg_querykey_values_string(void **state) {
     os_winreg_querykey(oshkey, subkey, fullname, pos);
 }
 
+void test_os_winreg_querykey_values_unchanged(void **state) {
+    HKEY oshkey = NULL;
+    int pos = 0;
+    char *subkey = strdup("command");
+    char *fullname = strdup("HKEY_LOCAL_MACHINE\\Software\\Classes\\batfile\\shell\\open\\command");
+    char path[MAX_PATH + 7];
+    FILETIME file_time = { .dwLowDateTime = 0x2E8BC6A0, .dwHighDateTime = 0x01D6A2E4 };
+    fim_entry *saved;
+
+    snprintf(path, sizeof(path), "%s%s", syscheck.registry[pos].arch == ARCH_64BIT ? "[x64] " : "[x32] ", fullname);
+
+    os_calloc(1, sizeof(fim_entry), saved);
+    os_calloc(1, sizeof(fim_entry_data), saved->data);
+    saved->data->mtime = get_windows_file_time_epoch(file_time);
+    saved->data->last_event = saved->data->mtime + 60;
+
+    w_mutex_init(&syscheck.fim_entry_mutex, NULL);
+
+    will_return(wrap_RegQueryInfoKey, NULL); // class_name_b
+    will_return(wrap_RegQueryInfoKey, NULL); // class_name_s
+    will_return(wrap_RegQueryInfoKey, 0); // subkey_count
+    will_return(wrap_RegQueryInfoKey, 1); // value_count
+    will_return(wrap_RegQueryInfoKey, &file_time); // file_time
+    will_return(wrap_RegQueryInfoKey,ERROR_SUCCESS);
+
+    // The values are neither read nor hashed
+    expect_string(__wrap_fim_db_get_path, file_path, path);
+    will_return(__wrap_fim_db_get_path, saved);
+    expect_string(__wrap_fim_db_set_scanned, path, path);
+    will_return(__wrap_fim_db_set_scanned, 0);
+
+    os_winreg_querykey(oshkey, subkey, fullname, pos);
+
+    w_mutex_destroy(&syscheck.fim_entry_mutex);
+}
+
 void test_os_winreg_querykey_values_multi_string(void **state) {
     HKEY oshkey = NULL;
     int pos = 0;
@@ -545,6 +591,7 @@ int main(void) {
         cmocka_unit_test(test_os_winreg_querykey_ignored_registry),
         cmocka_unit_test(test_os_winreg_querykey_ignored_regex),
         cmocka_unit_test(test_os_winreg_querykey_values_string),
+        cmocka_unit_test(test_os_winreg_querykey_values_unchanged),
         cmocka_unit_test(test_os_winreg_querykey_values_multi_string),
         cmocka_unit_test(test_os_winreg_querykey_values_number),
         cmocka_unit_test(test_os_winreg_querykey_values_binary),
@@ -4196,8 +4196,6 @@ void test_whodata_callback_invalid_parameter_mask(void **state) {
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_name'.");
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'process_name'.");
     expect_string(__wrap__merror, formatted_msg, "(6681): Invalid parameter type (0) for 'mask'.");
 
     int ret = whodata_callback(action, NULL, event);
@@ -4224,7 +4222,7 @@ void test_whodata_callback_invalid_user_id(void **state) {
     /* EvtRender second call */
     memset(buffer, 0, SIZE_EVENTS);
     buffer[0].Type = EvtVarTypeUInt16; // Correct buffer type
-    buffer[0].Int16Val = 0;
+    buffer[0].Int16Val = 4656;
     buffer[1].Type = EvtVarTypeString;
     buffer[1].XmlVal = L"user_name";
     buffer[2].Type = EvtVarTypeString;
@@ -4259,6 +4257,11 @@ void test_whodata_callback_invalid_user_id(void **state) {
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
+    expect_function_call(__wrap_fim_configuration_directory);
+    expect_string(__wrap_fim_configuration_directory, path, "c:\\another\\path.file");
+    expect_string(__wrap_fim_configuration_directory, entry, "file");
+    will_return(__wrap_fim_configuration_directory, 0);
+
     expect_memory(__wrap_convert_windows_string, string, L"user_name", wcslen(L"user_name"));
     will_return(__wrap_convert_windows_string, strdup("user_name"));
 
@@ -4293,7 +4296,7 @@ void test_whodata_callback_unknown_user_id(void **state) {
     /* EvtRender second call */
     memset(buffer, 0, SIZE_EVENTS);
     buffer[0].Type = EvtVarTypeUInt16; // Correct buffer type
-    buffer[0].Int16Val = 0;
+    buffer[0].Int16Val = 4656;
     buffer[1].Type = EvtVarTypeNull;
     buffer[2].Type = EvtVarTypeString;
     buffer[2].XmlVal = L"C:\\a\\path";
@@ -4327,6 +4330,11 @@ void test_whodata_callback_unknown_user_id(void **state) {
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
+    expect_function_call(__wrap_fim_configuration_directory);
+    expect_string(__wrap_fim_configuration_directory, path, "c:\\another\\path.file");
+    expect_string(__wrap_fim_configuration_directory, entry, "file");
+    will_return(__wrap_fim_configuration_directory, 0);
+
     expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_name'.");
     expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'process_name'.");
 
@@ -4389,9 +4397,6 @@ void test_whodata_callback_path(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_name'.");
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'process_name'.");
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'process_id'.");
     expect_string(__wrap__merror, formatted_msg, "(6681): Invalid parameter type (0) for 'handle_id'.");
 
     int ret = whodata_callback(action, NULL, event);
@@ -4454,13 +4459,6 @@ void test_whodata_callback_event_wrong_id(void **state) {
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
     expect_string(__wrap__merror, formatted_msg, "(6628): Invalid EventID. The whodata cannot be extracted.");
 
     int ret = whodata_callback(action, NULL, event);
@@ -4523,14 +4521,6 @@ void test_whodata_callback_event_4656_not_active(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_function_call(__wrap_fim_configuration_directory);
     expect_string(__wrap_fim_configuration_directory, path, "c:\\another\\path.file");
     expect_string(__wrap_fim_configuration_directory, entry, "file");
@@ -4598,14 +4588,6 @@ void test_whodata_callback_event_4656_canceled(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_function_call(__wrap_fim_configuration_directory);
     expect_string(__wrap_fim_configuration_directory, path, "c:\\windows");
     expect_string(__wrap_fim_configuration_directory, entry, "file");
@@ -4935,14 +4917,6 @@ void test_whodata_callback_event_4660_deleted_file(void **state) {
     will_return(wrap_win_whodata_EvtRender, SIZE_EVENTS);// BufferUsed
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     whodata_evt w_evt;
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
@@ -4995,14 +4969,6 @@ void test_whodata_callback_event_4660_not_deleted(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, NULL);
@@ -5054,14 +5020,6 @@ void test_whodata_callback_event_4658_no_event_to_delete(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, (whodata_evt *)NULL);
@@ -5121,14 +5079,6 @@ void test_whodata_callback_event_4658_file_deleted(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5194,14 +5144,6 @@ void test_whodata_callback_event_4658_file_moved_or_renamed(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5267,14 +5209,6 @@ void test_whodata_callback_event_4658_file_not_modified(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5338,14 +5272,6 @@ void test_whodata_callback_event_4658_trigger_directory_scan(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5411,14 +5337,6 @@ void test_whodata_callback_event_4658_rename_dir(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5496,14 +5414,6 @@ void test_whodata_callback_event_4658_new_file_added(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5576,14 +5486,6 @@ void test_whodata_callback_event_4658_no_new_files(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5647,14 +5549,6 @@ void test_whodata_callback_event_4658_scan_aborted(void **state) {
     will_return(wrap_win_whodata_EvtRender, 9); // PropertyCount
     will_return(wrap_win_whodata_EvtRender, 1);
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Delete_ex, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Delete_ex, key, "1234567890123456789");
     will_return(__wrap_OSHash_Delete_ex, w_evt);
@@ -5726,14 +5620,6 @@ void test_whodata_callback_event_4663_invalid_param(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -5811,14 +5697,6 @@ void test_whodata_callback_event_4663_wrong_event_time_param(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -5896,12 +5774,6 @@ void test_whodata_callback_event_4663_file_time_error(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
     /* get_file_time */
     {
         SYSTEMTIME systime;
@@ -5925,8 +5797,6 @@ void test_whodata_callback_event_4663_file_time_error(void **state){
         will_return(wrap_win_whodata_FileTimeToSystemTime, 0);
     }
 
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -6003,12 +5873,6 @@ void test_whodata_callback_event_4663_timestamp_ok(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
     /* get_file_time */
     {
         SYSTEMTIME systime;
@@ -6032,8 +5896,6 @@ void test_whodata_callback_event_4663_timestamp_ok(void **state){
         will_return(wrap_win_whodata_FileTimeToSystemTime, 1);
     }
 
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -6111,14 +5973,6 @@ void test_whodata_callback_event_4663_no_event(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -6199,14 +6053,6 @@ void test_whodata_callback_event_4663_no_dir(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -6295,14 +6141,6 @@ void test_whodata_callback_event_4663_dir(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -6391,14 +6229,6 @@ void test_whodata_callback_event_4663_dir_removed(void **state){
         will_return(wrap_win_whodata_WideCharToMultiByte, 21);
     }
 
-    expect_memory(__wrap_convert_windows_string, string, L"USERNAME", wcslen(L"USERNAME"));
-    will_return(__wrap_convert_windows_string, strdup("USERNAME"));
-
-    expect_memory(__wrap_convert_windows_string, string, L"PROCESS_NAME", wcslen(L"PROCESS_NAME"));
-    will_return(__wrap_convert_windows_string, strdup("PROCESS_NAME"));
-
-    expect_string(__wrap__mwarn, formatted_msg, "(6681): Invalid parameter type (0) for 'user_id'.");
-
     expect_value(__wrap_OSHash_Get, self, syscheck.wdata.fd);
     expect_string(__wrap_OSHash_Get, key, "1234567890123456789");
     will_return(__wrap_OSHash_Get, &w_evt);
@@ -85,6 +85,16 @@ int __wrap_wdbi_query_clear(wdb_t *wdb, wdb_component_t component, const char *p
     return mock();
 }
 
+int __wrap_wdb_begin2(wdb_t *wdb)
+{
+    return mock();
+}
+
+int __wrap_wdb_commit2(wdb_t *wdb)
+{
+    return mock();
+}
+
 
 typedef struct test_struct {
     wdb_t *socket;
@@ -584,6 +594,88 @@ void test_invalid_command(void **state){
 
     os_free(query);
 }
+void test_batch_ok(void **state)
+{
+    int ret;
+    test_struct_t *data  = (test_struct_t *)*state;
+    char *query = strdup("17 syscheck save2 {} 17 syscheck save2 {}");
+
+    data->socket->transaction = 1;
+    will_return(__wrap_wdb_syscheck_save2, 1);
+    will_return(__wrap_wdb_syscheck_save2, -1);
+    will_return(__wrap_wdb_commit2, 0);
+    ret = wdb_parse_batch(data->socket, "000", query, data->output);
+
+    assert_string_equal(data->output, "ok [0,-1]");
+    assert_int_equal(ret, 0);
+
+    os_free(query);
+}
+
+void test_batch_begin_error(void **state)
+{
+    int ret;
+    test_struct_t *data  = (test_struct_t *)*state;
+    char *query = strdup("17 syscheck save2 {}");
+
+    data->socket->transaction = 0;
+    will_return(__wrap_wdb_begin2, -1);
+    ret = wdb_parse_batch(data->socket, "000", query, data->output);
+
+    assert_string_equal(data->output, "err Cannot begin transaction");
+    assert_int_equal(ret, -1);
+
+    os_free(query);
+}
+
+void test_batch_invalid_length(void **state)
+{
+    int ret;
+    test_struct_t *data  = (test_struct_t *)*state;
+    char *query = strdup("99 syscheck save2 {}");
+
+    data->socket->transaction = 1;
+    ret = wdb_parse_batch(data->socket, "000", query, data->output);
+
+    assert_string_equal(data->output, "err Invalid batch query syntax, near '99 syscheck save2 {}'");
+    assert_int_equal(ret, -1);
+
+    os_free(query);
+}
+
+void test_batch_nested_command(void **state)
+{
+    int ret;
+    test_struct_t *data  = (test_struct_t *)*state;
+    char *query = strdup("6 commit 17 syscheck save2 {}");
+
+    data->socket->transaction = 1;
+    will_return(__wrap_wdb_syscheck_save2, 1);
+    will_return(__wrap_wdb_commit2, 0);
+    ret = wdb_parse_batch(data->socket, "000", query, data->output);
+
+    assert_string_equal(data->output, "ok [-1,0]");
+    assert_int_equal(ret, 0);
+
+    os_free(query);
+}
+
+void test_batch_commit_error(void **state)
+{
+    int ret;
+    test_struct_t *data  = (test_struct_t *)*state;
+    char *query = strdup("17 syscheck save2 {}");
+
+    data->socket->transaction = 1;
+    will_return(__wrap_wdb_syscheck_save2, 1);
+    will_return(__wrap_wdb_commit2, -1);
+    ret = wdb_parse_batch(data->socket, "000", query, data->output);
+
+    assert_string_equal(data->output, "err Cannot end transaction");
+    assert_int_equal(ret, -1);
+
+    os_free(query);
+}
 
 int main()
 {
@@ -620,7 +712,12 @@ int main()
         cmocka_unit_test_setup_teardown(test_integrity_check_ok, test_setup, test_teardown),
         cmocka_unit_test_setup_teardown(test_integrity_clear_error, test_setup, test_teardown),
         cmocka_unit_test_setup_teardown(test_integrity_clear_ok, test_setup, test_teardown),
-        cmocka_unit_test_setup_teardown(test_invalid_command, test_setup, test_teardown)
+        cmocka_unit_test_setup_teardown(test_invalid_command, test_setup, test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_ok, test_setup, test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_begin_error, test_setup, test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_invalid_length, test_setup, test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_nested_command, test_setup, test_teardown),
+        cmocka_unit_test_setup_teardown(test_batch_commit_error, test_setup, test_teardown)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
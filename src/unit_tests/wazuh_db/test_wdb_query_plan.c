@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include "../wazuh_db/wdb.h"
+#include "../headers/shared.h"
+#include "../external/sqlite/sqlite3.h"
+
+/* Statements that walk a whole table by design */
+static const int full_scan_allowed[] = {
+    WDB_STMT_FIM_GET_ATTRIBUTES,            // Only run by the upgrade to v4
+    WDB_STMT_SET_HOTFIX_MET,                // vuln_metadata has a single row
+    WDB_STMT_SCA_CHECK_COMPLIANCE_DELETE,   // Orphans left by a deleted policy
+    WDB_STMT_SCA_CHECK_RULES_DELETE,
+};
+
+/* Hot statements that must be answered from an index alone */
+static const int covering_required[] = {
+    WDB_STMT_FIM_FIND_ENTRY,
+    WDB_STMT_FIM_SELECT_CHECKSUM_RANGE,
+    WDB_STMT_SCA_CHECK_GET_ALL_RESULTS,
+    WDB_STMT_SCA_CHECK_FIND,
+};
+
+static int in_list(const int * list, size_t size, int index) {
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (list[i] == index) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Print the plan of a query, and tell whether it scans a table or uses no covering index */
+static void explain(sqlite3 * db, const char * sql, int * table_scan, int * covering) {
+    char query[OS_MAXSTR];
+    sqlite3_stmt * stmt;
+    const char * detail;
+
+    *table_scan = 0;
+    *covering = 0;
+
+    snprintf(query, sizeof(query), "EXPLAIN QUERY PLAN %s", sql);
+    assert_int_equal(sqlite3_prepare_v2(db, query, -1, &stmt, NULL), SQLITE_OK);
+
+    printf("%s\n", sql);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        detail = (const char *)sqlite3_column_text(stmt, 3);
+        printf("    %s\n", detail);
+
+        if (strncmp(detail, "SCAN ", 5) == 0 && !strstr(detail, "COVERING INDEX")) {
+            *table_scan = 1;
+        }
+
+        if (strstr(detail, "COVERING INDEX")) {
+            *covering = 1;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+}
+
+/* setup/teardown */
+
+static int setup_agent_db(void **state) {
+    sqlite3 * db;
+
+    if (sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+        return -1;
+    }
+
+    if (sqlite3_exec(db, schema_agents_sql, NULL, NULL, NULL) != SQLITE_OK) {
+        sqlite3_close_v2(db);
+        return -1;
+    }
+
+    *state = wdb_init(db, "000");
+    return 0;
+}
+
+static int teardown_agent_db(void **state) {
+    wdb_t * wdb = *state;
+    int index;
+
+    for (index = 0; index < WDB_STMT_SIZE; index++) {
+        sqlite3_finalize(wdb->stmt[index]);
+    }
+
+    sqlite3_close_v2(wdb->db);
+    wdb_destroy(wdb);
+    return 0;
+}
+
+/* tests */
+
+void test_agent_statements_use_indexes(void **state) {
+    wdb_t * wdb = *state;
+    int table_scan;
+    int covering;
+    int index;
+
+    for (index = 0; index < WDB_STMT_SIZE; index++) {
+        assert_int_equal(wdb_stmt_cache(wdb, index), 0);
+        explain(wdb->db, sqlite3_sql(wdb->stmt[index]), &table_scan, &covering);
+
+        if (table_scan && !in_list(full_scan_allowed, sizeof(full_scan_allowed) / sizeof(int), index)) {
+            fail_msg("Statement %d scans a whole table: %s", index, sqlite3_sql(wdb->stmt[index]));
+        }
+
+        if (!covering && in_list(covering_required, sizeof(covering_required) / sizeof(int), index)) {
+            fail_msg("Statement %d reads the table: %s", index, sqlite3_sql(wdb->stmt[index]));
+        }
+    }
+}
+
+void test_agent_upgrade_is_idempotent(void **state) {
+    wdb_t * wdb = *state;
+    char * error = NULL;
+
+    // The last upgrade must apply on a database created from the latest schema
+    assert_int_equal(sqlite3_exec(wdb->db, schema_upgrade_v6_sql, NULL, NULL, &error), SQLITE_OK);
+    assert_null(error);
+}
+
+void test_global_group_lookups(void **state) {
+    const char * queries[] = {
+        "SELECT id FROM `group` WHERE name = ?;",
+        "DELETE FROM belongs WHERE id_group = (SELECT id FROM 'group' WHERE name = ? );",
+        "SELECT id FROM agent WHERE `group` = ?;",
+    };
+    sqlite3 * db;
+    int table_scan;
+    int covering;
+    size_t i;
+
+    assert_int_equal(sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL), SQLITE_OK);
+    assert_int_equal(sqlite3_exec(db, schema_global_sql, NULL, NULL, NULL), SQLITE_OK);
+    assert_int_equal(sqlite3_exec(db, schema_global_upgrade_sql, NULL, NULL, NULL), SQLITE_OK);
+
+    for (i = 0; i < sizeof(queries) / sizeof(char *); i++) {
+        explain(db, queries[i], &table_scan, &covering);
+        assert_false(table_scan);
+    }
+
+    sqlite3_close_v2(db);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_agent_statements_use_indexes, setup_agent_db, teardown_agent_db),
+        cmocka_unit_test_setup_teardown(test_agent_upgrade_is_idempotent, setup_agent_db, teardown_agent_db),
+        cmocka_unit_test(test_global_group_lookups),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -134,6 +134,7 @@ void test_tag_successfull(void **state) {
     assert_int_equal(is_sched_tag("day"), 1);
     assert_int_equal(is_sched_tag("wday"), 1);
     assert_int_equal(is_sched_tag("time"), 1);
+    assert_int_equal(is_sched_tag("spread"), 1);
 }
 
 void test_tag_failure(void **state) {
@@ -153,6 +154,7 @@ void test_sched_scan_init(void **state){
     assert_int_equal(scan_config.month_interval,false);
     assert_int_equal(scan_config.time_start, 0);
     assert_int_equal(scan_config.next_scheduled_scan_time, 0);
+    assert_int_equal(scan_config.spread, 0);
 }
 
 void test_sched_scan_read_correct_day(void **state) {
@@ -413,6 +415,76 @@ void test_get_next_time_interval_configuration(void **state) {
     assert_int_equal((int) ret, 3600);
 }
 
+void test_sched_scan_read_spread(void **state) {
+    test_structure *test = ( test_structure *) *state;
+    sched_scan_init(test->scan_config);
+    xml_node **nodes = test->nodes;
+    nodes[0]->element = strdup("spread");
+    nodes[0]->content = strdup("2h");
+    int ret = sched_scan_read(test->scan_config, nodes, "TEST_MODULE");
+    assert_int_equal(ret, 0);
+    assert_int_equal(test->scan_config->spread, 7200);
+}
+
+void test_sched_scan_read_wrong_spread(void **state) {
+    test_structure *test = ( test_structure *) *state;
+    sched_scan_init(test->scan_config);
+    xml_node **nodes = test->nodes;
+    nodes[0]->element = strdup("spread");
+    nodes[0]->content = strdup("2x");
+
+    expect_string(__wrap__merror, formatted_msg, "(1235): Invalid value for element 'spread': 2x.");
+    int ret = sched_scan_read(test->scan_config, nodes, "TEST_MODULE");
+    assert_int_equal(ret, -1);
+}
+
+void test_get_time_until_next_scan_spread_interval(void **state) {
+    sched_scan_config *scan_config = (sched_scan_config *)  *state;
+    scan_config->interval = 3600;
+    scan_config->spread = 600;
+
+    time_t first = sched_scan_get_time_until_next_scan(scan_config, "TEST_MODULE", 0);
+    assert_true(first >= 3600 && first < 4200);
+
+    // The offset depends only on the host
+    sched_scan_config other;
+    sched_scan_init(&other);
+    other.interval = 3600;
+    other.spread = 600;
+    assert_int_equal((int) sched_scan_get_time_until_next_scan(&other, "TEST_MODULE", 0), (int) first);
+
+    // Later scans keep the phase
+    current_time = scan_config->next_scheduled_scan_time;
+    assert_int_equal((int) sched_scan_get_time_until_next_scan(scan_config, "TEST_MODULE", 0), 3600);
+}
+
+void test_get_time_until_next_scan_spread_run_on_start(void **state) {
+    sched_scan_config *scan_config = (sched_scan_config *)  *state;
+    scan_config->interval = 3600;
+    scan_config->spread = 600;
+
+    assert_int_equal((int) sched_scan_get_time_until_next_scan(scan_config, "TEST_MODULE", 1), 0);
+
+    time_t second = sched_scan_get_time_until_next_scan(scan_config, "TEST_MODULE", 1);
+    assert_true(second >= 3600 && second < 4200);
+}
+
+void test_get_time_until_next_scan_spread_daytime(void **state) {
+    sched_scan_config *scan_config = (sched_scan_config *)  *state;
+    scan_config->scan_time = strdup("05:00");
+    scan_config->spread = 600;
+
+    expect_string(__wrap_get_time_to_hour, hour, "05:00");
+    will_return(__wrap_get_time_to_hour, 8);
+    time_t first = sched_scan_get_time_until_next_scan(scan_config, "TEST_MODULE", 0);
+    assert_true(first >= 8 && first < 608);
+
+    // Every scan at a given time is delayed by the same offset
+    current_time = scan_config->next_scheduled_scan_time;
+    expect_string(__wrap_get_time_to_hour, hour, "05:00");
+    will_return(__wrap_get_time_to_hour, 8);
+    assert_int_equal((int) sched_scan_get_time_until_next_scan(scan_config, "TEST_MODULE", 0), (int) first);
+}
 
 int main(void) {
     const struct CMUnitTest tests[] = {
@@ -440,7 +512,12 @@ int main(void) {
         cmocka_unit_test_setup_teardown(test_get_next_time_day_configuration, test_sched_scan_validate_setup, test_sched_scan_validate_teardown),
         cmocka_unit_test_setup_teardown(test_get_next_time_wday_configuration, test_sched_scan_validate_setup, test_sched_scan_validate_teardown),
         cmocka_unit_test_setup_teardown(test_get_next_time_daytime_configuration, test_sched_scan_validate_setup, test_sched_scan_validate_teardown),
-        cmocka_unit_test_setup_teardown(test_get_next_time_interval_configuration, test_sched_scan_validate_setup, test_sched_scan_validate_teardown)
+        cmocka_unit_test_setup_teardown(test_get_next_time_interval_configuration, test_sched_scan_validate_setup, test_sched_scan_validate_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_scan_read_spread, test_scan_read_setup, test_scan_read_teardown),
+        cmocka_unit_test_setup_teardown(test_sched_scan_read_wrong_spread, test_scan_read_setup, test_scan_read_teardown),
+        cmocka_unit_test_setup_teardown(test_get_time_until_next_scan_spread_interval, test_sched_scan_validate_setup, test_sched_scan_validate_teardown),
+        cmocka_unit_test_setup_teardown(test_get_time_until_next_scan_spread_run_on_start, test_sched_scan_validate_setup, test_sched_scan_validate_teardown),
+        cmocka_unit_test_setup_teardown(test_get_time_until_next_scan_spread_daytime, test_sched_scan_validate_setup, test_sched_scan_validate_teardown)
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
\ No newline at end of file
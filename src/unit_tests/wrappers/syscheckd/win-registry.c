@@ -24,13 +24,20 @@ LONG WINAPI wrap_RegQueryInfoKey(
     __attribute__ ((unused)) LPDWORD lpcbMaxValueNameLen,
     __attribute__ ((unused)) LPDWORD lpcbMaxValueLen,
     __attribute__ ((unused)) LPDWORD lpcbSecurityDescriptor,
-    __attribute__ ((unused)) PFILETIME lpftLastWriteTime)
+    PFILETIME lpftLastWriteTime)
 {
+    PFILETIME last_write_time;
+
     lpClass = mock_type(char *);
     lpcchClass = mock_type(unsigned long *);
     *lpcSubKeys = mock_type(long);
     *lpcValues = mock_type(long);
-    lpftLastWriteTime = mock_type(PFILETIME);
+    last_write_time = mock_type(PFILETIME);
+
+    if (last_write_time) {
+        *lpftLastWriteTime = *last_write_time;
+    }
+
     return mock();
 }
 
@@ -0,0 +1,689 @@
+/* Copyright (C) 2015-2020, Wazuh Inc.
+ * All right reserved.
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+/* This tool simulates many agents against a manager, to measure its capacity */
+
+#include "shared.h"
+#include "sec.h"
+#include "rc.h"
+#include "os_net/os_net.h"
+#include <poll.h>
+
+#undef ARGV0
+#define ARGV0 "agent-loadgen"
+
+#define SIM_LOCATION    "agent-loadgen"
+#define SIM_POLL_MS     100         /* Longest wait for replies */
+#define SIM_BURST       1000        /* Events sent to an agent in a row, if we are late */
+#define SIM_RETRY       5           /* Seconds before reconnecting an agent */
+#define SIM_STATE_FILE  DEFAULTDIR OS_PIDFILE "/ossec-remoted.state"
+#define NS_PER_SEC      1000000000ULL
+
+/* Counters of the agents of a thread */
+typedef struct sim_stats {
+    unsigned long events;           // Events sent
+    unsigned long keepalives;       // Keepalives sent
+    unsigned long startups;         // Startup messages sent
+    unsigned long acks;             // Acks of our control messages
+    unsigned long lost_acks;        // Control messages not acknowledged in time
+    unsigned long credits;          // Rate credits granted by the manager
+    unsigned long updates;          // Shared files pushed by the manager
+    unsigned long invalid;          // Messages we couldn't read
+    unsigned long send_errors;
+    unsigned long connect_errors;
+    unsigned long disconnections;
+} sim_stats;
+
+/* A simulated agent */
+typedef struct sim_agent {
+    unsigned int id;                // Position in the keystore
+    int sock;
+    int connected;                  // The manager acknowledged the startup
+    uint64_t pending;               // Time the control message waiting for an ack was sent
+    uint64_t next_event;
+    uint64_t next_keepalive;
+    uint64_t retry;                 // Time to reconnect
+    char merged_sum[33];            // Sum of the shared files the manager sent us
+} sim_agent;
+
+typedef struct sim_thread {
+    pthread_t thread;
+    sim_agent *agents;
+    unsigned int nagents;
+    sim_stats stats;
+    uint32_t *latencies;            // Ack latencies in microseconds
+    size_t nlatencies;
+    size_t latencies_size;
+} sim_thread;
+
+/* Counters of the remoted state file */
+typedef struct sim_remoted {
+    unsigned long evt_count;
+    unsigned long ctrl_msg_count;
+    unsigned long discarded_count;
+    unsigned long msg_sent;
+    unsigned long recv_bytes;
+} sim_remoted;
+
+/* Prototypes */
+static void helpmsg(void) __attribute__((noreturn));
+
+static keystore keys = KEYSTORE_INITIALIZER;
+static pthread_mutex_t crypt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char *manager;
+static int port = 1514;
+static int protocol = IPPROTO_TCP;
+static double rate = 1;
+static uint64_t event_interval;
+static uint64_t keepalive_interval;
+static uint64_t ack_timeout;
+static uint64_t deadline;
+
+
+static void helpmsg()
+{
+    printf("\n%s %s: Simulate agents to put load on a manager.\n", __ossec_name, ARGV0);
+    printf("Available options:\n");
+    printf("\t-h                This help message.\n");
+    printf("\t-d                Execute in debug mode.\n");
+    printf("\t-m <manager>      Address of the manager.\n");
+    printf("\t-p <port>         Port of the manager (1514).\n");
+    printf("\t-P <tcp|udp>      Protocol (tcp).\n");
+    printf("\t-n <agents>       Number of agents to simulate (all the keys).\n");
+    printf("\t-r <events>       Events per second of each agent (1). Zero sends only keepalives.\n");
+    printf("\t-k <seconds>      Keepalive interval (10).\n");
+    printf("\t-a <seconds>      Time to wait for an ack before counting it as lost (10).\n");
+    printf("\t-D <seconds>      Duration of the test (60).\n");
+    printf("\t-t <threads>      Number of threads (4).\n");
+    printf("\t-c <method>       Crypto method: aes, aes-gcm or blowfish (aes).\n");
+    printf("\t-s <file>         State file of remoted (%s).\n", SIM_STATE_FILE);
+    printf("\t-w <seconds>      Time to wait for remoted to update its state file (10).\n\n");
+    printf("The agents are read from %s. Use keys registered only for testing: the\n", KEYSFILE_PATH);
+    printf("message counters of a real agent sharing them would be rejected afterwards.\n\n");
+    exit(1);
+}
+
+static uint64_t sim_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/* Read the counters of remoted. Returns 0 on success or -1 if the file is missing. */
+static int sim_read_state(const char *path, sim_remoted *state)
+{
+    char buffer[OS_SIZE_1024];
+    char *value;
+    FILE *fp;
+
+    if (fp = fopen(path, "r"), !fp) {
+        return -1;
+    }
+
+    memset(state, 0, sizeof(sim_remoted));
+
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        if (buffer[0] == '#' || (value = strchr(buffer, '='), !value)) {
+            continue;
+        }
+
+        *value++ = '\0';
+        value += *value == '\'';
+
+        if (strcmp(buffer, "evt_count") == 0) {
+            state->evt_count = strtoul(value, NULL, 10);
+        } else if (strcmp(buffer, "ctrl_msg_count") == 0) {
+            state->ctrl_msg_count = strtoul(value, NULL, 10);
+        } else if (strcmp(buffer, "discarded_count") == 0) {
+            state->discarded_count = strtoul(value, NULL, 10);
+        } else if (strcmp(buffer, "msg_sent") == 0) {
+            state->msg_sent = strtoul(value, NULL, 10);
+        } else if (strcmp(buffer, "recv_bytes") == 0) {
+            state->recv_bytes = strtoul(value, NULL, 10);
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/* Encrypt and send a message as an agent */
+static int sim_send(sim_thread *thread, sim_agent *agent, const char *msg)
+{
+    char crypt_msg[OS_MAXSTR + 1];
+    size_t msg_size;
+    int retval;
+
+    /* The sender counter is shared by all the agents */
+    w_mutex_lock(&crypt_mutex);
+    msg_size = CreateSecMSG(&keys, msg, strlen(msg), crypt_msg, agent->id);
+    w_mutex_unlock(&crypt_mutex);
+
+    if (msg_size == 0) {
+        merror(SEC_ERROR);
+        thread->stats.send_errors++;
+        return -1;
+    }
+
+    if (protocol == IPPROTO_UDP) {
+        retval = OS_SendUDPbySize(agent->sock, msg_size, crypt_msg);
+    } else {
+        retval = OS_SendSecureTCP(agent->sock, msg_size, crypt_msg);
+    }
+
+    if (retval) {
+        thread->stats.send_errors++;
+    }
+
+    return retval;
+}
+
+static void sim_disconnect(sim_thread *thread, sim_agent *agent, uint64_t now)
+{
+    mdebug1("Agent '%s' disconnected.", keys.keyentries[agent->id]->name);
+    CloseSocket(agent->sock);
+    agent->sock = -1;
+    agent->connected = 0;
+    agent->pending = 0;
+    agent->retry = now + SIM_RETRY * NS_PER_SEC;
+    thread->stats.disconnections++;
+}
+
+/* Connect an agent and send its startup message */
+static void sim_connect(sim_thread *thread, sim_agent *agent, uint64_t now)
+{
+    char msg[OS_SIZE_128];
+
+    if (protocol == IPPROTO_UDP) {
+        agent->sock = OS_ConnectUDP(port, manager, 0);
+    } else {
+        agent->sock = OS_ConnectTCP(port, manager, 0);
+    }
+
+    if (agent->sock < 0) {
+        mdebug1("Cannot connect agent '%s' to %s:%d.", keys.keyentries[agent->id]->name, manager, port);
+        agent->sock = -1;
+        agent->retry = now + SIM_RETRY * NS_PER_SEC;
+        thread->stats.connect_errors++;
+        return;
+    }
+
+    snprintf(msg, sizeof(msg), "%s%s", CONTROL_HEADER, HC_STARTUP);
+
+    if (sim_send(thread, agent, msg) == 0) {
+        agent->pending = now;
+        thread->stats.startups++;
+    } else if (protocol == IPPROTO_TCP) {
+        sim_disconnect(thread, agent, now);
+    }
+}
+
+static void sim_latency(sim_thread *thread, uint64_t latency)
+{
+    if (thread->nlatencies == thread->latencies_size) {
+        thread->latencies_size = thread->latencies_size ? thread->latencies_size * 2 : OS_SIZE_1024;
+        os_realloc(thread->latencies, thread->latencies_size * sizeof(uint32_t), thread->latencies);
+    }
+
+    latency /= 1000;
+    thread->latencies[thread->nlatencies++] = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+}
+
+/* Read a message of the manager */
+static void sim_receive(sim_thread *thread, sim_agent *agent, uint64_t now)
+{
+    char buffer[OS_MAXSTR + 1];
+    char cleartext[OS_MAXSTR + 1];
+    char *msg;
+    char *end;
+    size_t size;
+    ssize_t length;
+
+    if (protocol == IPPROTO_UDP) {
+        if (length = recv(agent->sock, buffer, OS_MAXSTR, MSG_DONTWAIT), length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+    } else {
+        length = OS_RecvSecureTCP(agent->sock, buffer, OS_MAXSTR);
+    }
+
+    if (length <= 0) {
+        sim_disconnect(thread, agent, now);
+        return;
+    }
+
+    buffer[length] = '\0';
+
+    if (ReadSecMSG(&keys, buffer, cleartext, agent->id, length - 1, &size, manager, &msg) != KS_VALID) {
+        thread->stats.invalid++;
+        return;
+    }
+
+    if (!IsValidHeader(msg)) {
+        return;
+    }
+
+    if (strcmp(msg, HC_ACK) == 0) {
+        thread->stats.acks++;
+
+        if (agent->pending) {
+            sim_latency(thread, now - agent->pending);
+            agent->pending = 0;
+        }
+
+        /* Spread the first event and keepalive of the agents over their intervals */
+        if (!agent->connected) {
+            agent->connected = 1;
+            agent->next_event = now + event_interval * (agent->id % 64) / 64;
+            agent->next_keepalive = now + keepalive_interval * (agent->id % 64) / 64;
+        }
+    } else if (strncmp(msg, HC_CREDIT, strlen(HC_CREDIT)) == 0) {
+        thread->stats.credits++;
+    } else if (strncmp(msg, FILE_UPDATE_HEADER, strlen(FILE_UPDATE_HEADER)) == 0) {
+        /* Report the sum in the next keepalives, as if we had applied it */
+        msg += strlen(FILE_UPDATE_HEADER);
+
+        if (end = strchr(msg, ' '), end && end - msg == 32) {
+            memcpy(agent->merged_sum, msg, 32);
+            agent->merged_sum[32] = '\0';
+            thread->stats.updates++;
+        }
+    }
+}
+
+/* Send the events and keepalives that are due. Returns the time of the next one. */
+static uint64_t sim_tick(sim_thread *thread, sim_agent *agent, uint64_t now)
+{
+    char msg[OS_SIZE_2048];
+    uint64_t wake = now + SIM_POLL_MS * 1000000ULL;
+    int burst;
+
+    if (agent->sock < 0) {
+        if (now >= agent->retry) {
+            sim_connect(thread, agent, now);
+        }
+
+        return wake;
+    }
+
+    if (agent->pending && now - agent->pending > ack_timeout) {
+        thread->stats.lost_acks++;
+        agent->pending = 0;
+    }
+
+    if (!agent->connected) {
+        if (!agent->pending) {
+            snprintf(msg, sizeof(msg), "%s%s", CONTROL_HEADER, HC_STARTUP);
+
+            if (sim_send(thread, agent, msg) == 0) {
+                agent->pending = now;
+                thread->stats.startups++;
+            } else if (protocol == IPPROTO_TCP) {
+                sim_disconnect(thread, agent, now);
+            }
+        }
+
+        return wake;
+    }
+
+    if (event_interval) {
+        for (burst = 0; burst < SIM_BURST && agent->next_event <= now; burst++) {
+            snprintf(msg, sizeof(msg), "%c:%s:%s: Simulated event %lu of agent %s", LOCALFILE_MQ, SIM_LOCATION, ARGV0,
+                     thread->stats.events, keys.keyentries[agent->id]->name);
+
+            if (sim_send(thread, agent, msg) != 0) {
+                if (protocol == IPPROTO_TCP) {
+                    sim_disconnect(thread, agent, now);
+                    return wake;
+                }
+            } else {
+                thread->stats.events++;
+            }
+
+            agent->next_event += event_interval;
+        }
+
+        wake = agent->next_event < wake ? agent->next_event : wake;
+    }
+
+    if (now >= agent->next_keepalive) {
+        if (!agent->pending) {
+            if (agent->merged_sum[0]) {
+                snprintf(msg, sizeof(msg), "%s%s\n%s merged.mg\n", CONTROL_HEADER, getuname(), agent->merged_sum);
+            } else {
+                snprintf(msg, sizeof(msg), "%s%s\n", CONTROL_HEADER, getuname());
+            }
+
+            if (sim_send(thread, agent, msg) == 0) {
+                agent->pending = now;
+                thread->stats.keepalives++;
+            } else if (protocol == IPPROTO_TCP) {
+                sim_disconnect(thread, agent, now);
+                return wake;
+            }
+        }
+
+        agent->next_keepalive += keepalive_interval;
+    }
+
+    return agent->next_keepalive < wake ? agent->next_keepalive : wake;
+}
+
+static void * sim_main(sim_thread *thread)
+{
+    struct pollfd *fds;
+    sim_agent **polled;
+    uint64_t now;
+    uint64_t wake;
+    uint64_t next;
+    unsigned int i;
+    unsigned int nfds;
+    int timeout;
+
+    os_calloc(thread->nagents, sizeof(struct pollfd), fds);
+    os_calloc(thread->nagents, sizeof(sim_agent *), polled);
+
+    for (now = sim_now(), i = 0; i < thread->nagents; i++) {
+        sim_connect(thread, &thread->agents[i], now);
+    }
+
+    while (now = sim_now(), now < deadline) {
+        wake = deadline;
+
+        for (nfds = 0, i = 0; i < thread->nagents; i++) {
+            next = sim_tick(thread, &thread->agents[i], now);
+            wake = next < wake ? next : wake;
+
+            if (thread->agents[i].sock >= 0) {
+                fds[nfds].fd = thread->agents[i].sock;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                polled[nfds++] = &thread->agents[i];
+            }
+        }
+
+        now = sim_now();
+        timeout = wake > now ? (int)((wake - now + 999999) / 1000000) : 0;
+
+        if (poll(fds, nfds, timeout) <= 0) {
+            continue;
+        }
+
+        for (now = sim_now(), i = 0; i < nfds; i++) {
+            if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                sim_receive(thread, polled[i], now);
+            }
+        }
+    }
+
+    for (i = 0; i < thread->nagents; i++) {
+        if (thread->agents[i].sock >= 0) {
+            CloseSocket(thread->agents[i].sock);
+        }
+    }
+
+    free(fds);
+    free(polled);
+    return NULL;
+}
+
+static int sim_compare_latency(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double sim_percentile(const uint32_t *latencies, size_t count, double percentile)
+{
+    return count ? latencies[(size_t)((count - 1) * percentile)] / 1000.0 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *state_file = SIM_STATE_FILE;
+    unsigned int nagents = 0;
+    unsigned int nthreads = 4;
+    unsigned int keepalive = 10;
+    unsigned int ack_wait = 10;
+    unsigned int duration = 60;
+    unsigned int state_wait = 10;
+    int crypto_method = W_METH_AES;
+    int has_state;
+    sim_remoted state_start;
+    sim_remoted state_end;
+    sim_thread *threads;
+    sim_agent *agents;
+    sim_stats total;
+    uint32_t *latencies;
+    size_t nlatencies = 0;
+    uint64_t start;
+    double elapsed;
+    unsigned int i;
+    unsigned int j;
+    int c;
+
+    /* Set the name */
+    OS_SetName(ARGV0);
+
+    while ((c = getopt(argc, argv, "hdm:p:P:n:r:k:a:D:t:c:s:w:")) != -1) {
+        switch (c) {
+            case 'h':
+                helpmsg();
+                break;
+            case 'd':
+                nowDebug();
+                break;
+            case 'm':
+                manager = optarg;
+                break;
+            case 'p':
+                if (port = atoi(optarg), port <= 0 || port > 65535) {
+                    merror_exit("Invalid port: %s", optarg);
+                }
+                break;
+            case 'P':
+                if (strcmp(optarg, "tcp") == 0) {
+                    protocol = IPPROTO_TCP;
+                } else if (strcmp(optarg, "udp") == 0) {
+                    protocol = IPPROTO_UDP;
+                } else {
+                    merror_exit("Invalid protocol: %s", optarg);
+                }
+                break;
+            case 'n':
+                if (nagents = atoi(optarg), nagents == 0) {
+                    merror_exit("Invalid number of agents: %s", optarg);
+                }
+                break;
+            case 'r':
+                if (rate = atof(optarg), rate < 0) {
+                    merror_exit("Invalid event rate: %s", optarg);
+                }
+                break;
+            case 'k':
+                if (keepalive = atoi(optarg), keepalive == 0) {
+                    merror_exit("Invalid keepalive interval: %s", optarg);
+                }
+                break;
+            case 'a':
+                if (ack_wait = atoi(optarg), ack_wait == 0) {
+                    merror_exit("Invalid ack timeout: %s", optarg);
+                }
+                break;
+            case 'D':
+                if (duration = atoi(optarg), duration == 0) {
+                    merror_exit("Invalid duration: %s", optarg);
+                }
+                break;
+            case 't':
+                if (nthreads = atoi(optarg), nthreads == 0) {
+                    merror_exit("Invalid number of threads: %s", optarg);
+                }
+                break;
+            case 'c':
+                if (strcmp(optarg, "aes") == 0) {
+                    crypto_method = W_METH_AES;
+                } else if (strcmp(optarg, "aes-gcm") == 0) {
+                    crypto_method = W_METH_AES_GCM;
+                } else if (strcmp(optarg, "blowfish") == 0) {
+                    crypto_method = W_METH_BLOWFISH;
+                } else {
+                    merror_exit("Invalid crypto method: %s", optarg);
+                }
+                break;
+            case 's':
+                state_file = optarg;
+                break;
+            case 'w':
+                state_wait = atoi(optarg);
+                break;
+            default:
+                helpmsg();
+        }
+    }
+
+    if (!manager) {
+        helpmsg();
+    }
+
+    OS_ReadKeys(&keys, 1, 0, 1);
+
+    if (nagents == 0 || nagents > keys.keysize) {
+        nagents = keys.keysize;
+    }
+
+    if (nthreads > nagents) {
+        nthreads = nagents;
+    }
+
+    /* The counters live in memory. The sender counter starts at the current
+     * time so that it's ahead of the one of any previous run.
+     */
+    for (i = 0; i <= keys.keysize; i++) {
+        keys.keyentries[i]->counter = &keys.keyentries[i]->counter_mem;
+        keys.keyentries[i]->crypto_method = crypto_method;
+    }
+
+    keys.keyentries[keys.keysize]->counter_mem.global = (uint32_t)time(NULL);
+    _s_verify_counter = 0;
+
+    event_interval = rate > 0 ? (uint64_t)(NS_PER_SEC / rate) : 0;
+    keepalive_interval = keepalive * NS_PER_SEC;
+    ack_timeout = ack_wait * NS_PER_SEC;
+
+    os_calloc(nagents, sizeof(sim_agent), agents);
+    os_calloc(nthreads, sizeof(sim_thread), threads);
+
+    for (i = 0; i < nagents; i++) {
+        agents[i].id = i;
+        agents[i].sock = -1;
+    }
+
+    /* Each thread gets a contiguous range of agents */
+    for (i = 0, j = 0; i < nthreads; i++) {
+        threads[i].agents = agents + j;
+        threads[i].nagents = nagents / nthreads + (i < nagents % nthreads);
+        j += threads[i].nagents;
+    }
+
+    has_state = sim_read_state(state_file, &state_start) == 0;
+
+    if (!has_state) {
+        mwarn("Cannot read the state file '%s'. The counters of remoted won't be reported.", state_file);
+    }
+
+    minfo("Simulating %u agents against %s:%d/%s for %u seconds.", nagents, manager, port,
+          protocol == IPPROTO_UDP ? "udp" : "tcp", duration);
+
+    start = sim_now();
+    deadline = start + duration * NS_PER_SEC;
+
+    for (i = 0; i < nthreads; i++) {
+        if (CreateThreadJoinable(&threads[i].thread, (void * (*)(void *))sim_main, &threads[i]) < 0) {
+            merror_exit(THREAD_ERROR);
+        }
+    }
+
+    memset(&total, 0, sizeof(sim_stats));
+
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i].thread, NULL);
+
+        total.events += threads[i].stats.events;
+        total.keepalives += threads[i].stats.keepalives;
+        total.startups += threads[i].stats.startups;
+        total.acks += threads[i].stats.acks;
+        total.lost_acks += threads[i].stats.lost_acks;
+        total.credits += threads[i].stats.credits;
+        total.updates += threads[i].stats.updates;
+        total.invalid += threads[i].stats.invalid;
+        total.send_errors += threads[i].stats.send_errors;
+        total.connect_errors += threads[i].stats.connect_errors;
+        total.disconnections += threads[i].stats.disconnections;
+        nlatencies += threads[i].nlatencies;
+    }
+
+    elapsed = (double)(sim_now() - start) / NS_PER_SEC;
+
+    os_calloc(nlatencies + 1, sizeof(uint32_t), latencies);
+
+    for (i = 0, nlatencies = 0; i < nthreads; i++) {
+        memcpy(latencies + nlatencies, threads[i].latencies, threads[i].nlatencies * sizeof(uint32_t));
+        nlatencies += threads[i].nlatencies;
+        free(threads[i].latencies);
+    }
+
+    qsort(latencies, nlatencies, sizeof(uint32_t), sim_compare_latency);
+
+    printf("\nAgents:            %u (%s, %u threads)\n", nagents, protocol == IPPROTO_UDP ? "udp" : "tcp", nthreads);
+    printf("Duration:          %.1f s\n", elapsed);
+    printf("Events sent:       %lu (%.1f EPS)\n", total.events, total.events / elapsed);
+    printf("Startups sent:     %lu\n", total.startups);
+    printf("Keepalives sent:   %lu\n", total.keepalives);
+    printf("Acks received:     %lu (%lu lost)\n", total.acks, total.lost_acks);
+    printf("Ack latency:       p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", sim_percentile(latencies, nlatencies, 0.50),
+           sim_percentile(latencies, nlatencies, 0.99), sim_percentile(latencies, nlatencies, 1));
+    printf("Credits received:  %lu\n", total.credits);
+    printf("Shared files:      %lu\n", total.updates);
+    printf("Invalid replies:   %lu\n", total.invalid);
+    printf("Send errors:       %lu\n", total.send_errors);
+    printf("Connect errors:    %lu\n", total.connect_errors);
+    printf("Disconnections:    %lu\n", total.disconnections);
+
+    /* remoted writes its state at intervals */
+    if (has_state) {
+        minfo("Waiting %u seconds for remoted to update its state file.", state_wait);
+        sleep(state_wait);
+
+        if (sim_read_state(state_file, &state_end) == 0) {
+            unsigned long received = state_end.evt_count - state_start.evt_count;
+
+            printf("\nremoted (includes the traffic of any other agent):\n");
+            printf("Events received:   %lu\n", received);
+            printf("Control messages:  %lu\n", state_end.ctrl_msg_count - state_start.ctrl_msg_count);
+            printf("Discarded:         %lu\n", state_end.discarded_count - state_start.discarded_count);
+            printf("Messages sent:     %lu\n", state_end.msg_sent - state_start.msg_sent);
+            printf("Bytes received:    %lu\n", state_end.recv_bytes - state_start.recv_bytes);
+            printf("Dropped events:    %ld (%.2f%%)\n", (long)(total.events - received),
+                   total.events ? 100.0 * ((double)total.events - received) / total.events : 0);
+        } else {
+            merror("Cannot read the state file '%s'.", state_file);
+        }
+    }
+
+    free(latencies);
+    free(threads);
+    free(agents);
+    OS_FreeKeys(&keys);
+    return 0;
+}
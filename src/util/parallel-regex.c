@@ -15,6 +15,8 @@
 
 static void helpmsg(void) __attribute__((noreturn));
 OSRegex regex, second_regex, third_regex;
+OSMultiMatch multi_match;
+const char *match_patterns[] = { "test pattern", "^this is the|regex$", "substrings", "PARALLEL", NULL };
 int input_number = 11;
 char *inputs[] = {
     "This is a test pattern for testing the parallel regex.",
@@ -43,6 +45,7 @@ void *t_regex(__attribute__((unused)) void * id){
     char *ptr;
     int size;
     int i;
+    uint64_t found;
     regex_matching str_match;
     memset(&str_match, 0, sizeof(regex_matching));
 
@@ -83,6 +86,22 @@ void *t_regex(__attribute__((unused)) void * id){
             }
             printf("%s\n", msg);
         }
+
+        found = 0;
+        OSMultiMatch_Execute(inputs[counter], strlen(inputs[counter]), &multi_match, &found);
+
+        if (found) {
+            ptr = msg;
+            size = snprintf(ptr, 1024, "+ [Thread %d][MULTI_MATCH]: %s\n", t_id, inputs[counter]);
+            ptr += size;
+            for (i = 0; match_patterns[i]; i++) {
+                if (found & ((uint64_t)1 << i)) {
+                    size = snprintf(ptr, 1024, " -Literal of: %s\n", match_patterns[i]);
+                    ptr += size;
+                }
+            }
+            printf("%s\n", msg);
+        }
     }
 }
 
@@ -129,6 +148,24 @@ int main(int argc, char **argv)
         return (-1);
     }
 
+    OSMultiMatch_Init(&multi_match);
+
+    for (i = 0; match_patterns[i]; i++) {
+        OSMatch match;
+
+        if (!OSMatch_Compile(match_patterns[i], &match, 0) || !OSMultiMatch_AddMatch(&multi_match, &match, i)) {
+            printf("Pattern '%s' can not be added to OSMultiMatch\n", match_patterns[i]);
+            return (-1);
+        }
+
+        OSMatch_FreePattern(&match);
+    }
+
+    if (!OSMultiMatch_Compile(&multi_match)) {
+        printf("OSMultiMatch_Compile failed\n");
+        return (-1);
+    }
+
     for(i = 0; i < threads; i++){
         w_create_thread(t_regex,(void *) (intptr_t)i);
     }
@@ -19,12 +19,20 @@ static void * run_dealer(void * args);
 static void * run_worker(void * args);
 static void * run_gc(void * args);
 static void * run_up(void * args);
+static void * run_maintenance(void * args);
 
-//int wazuhdb_fdsock;
-wnotify_t * notify_queue;
-//static w_queue_t * sock_queue;
-static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-//static pthread_cond_t sock_cond = PTHREAD_COND_INITIALIZER;
+// Events taken by a worker per wait
+#define WDB_WORKER_EVENTS 64
+
+/* Each worker owns the connections that the dealer hands it, and polls them
+ * on its own queue. The dealer gives every new connection to the worker that
+ * has the fewest, so no lock is taken to serve a request. */
+typedef struct wdb_worker_t {
+    wnotify_t * notify;         // Connections of this worker
+    unsigned int peers;         // Connections open, to balance the new ones
+} wdb_worker_t;
+
+static wdb_worker_t * workers;
 static volatile int running = 1;
 rlim_t nofile;
 
@@ -37,6 +45,7 @@ int main(int argc, char ** argv) {
     pthread_t thread_dealer;
     pthread_t * worker_pool = NULL;
     pthread_t thread_gc;
+    pthread_t thread_maintenance;
     pthread_t thread_up;
 
     OS_SetName(ARGV0);
@@ -82,6 +91,11 @@ int main(int argc, char ** argv) {
     config.commit_time_max = getDefine_Int("wazuh_db", "commit_time_max", 1, 3600);
     config.open_db_limit = getDefine_Int("wazuh_db", "open_db_limit", 1, 4096);
     nofile = getDefine_Int("wazuh_db", "rlimit_nofile", 1024, 1048576);
+    config.maintenance_interval = getDefine_Int("wazuh_db", "maintenance_interval", 0, 86400);
+    config.maintenance_quiet = getDefine_Int("wazuh_db", "maintenance_quiet", 1, 3600);
+    config.vacuum_pages = getDefine_Int("wazuh_db", "vacuum_pages", 1, 1000000);
+    config.vacuum_ratio = getDefine_Int("wazuh_db", "vacuum_ratio", 0, 100);
+    config.read_replicas = getDefine_Int("wazuh_db", "read_replicas", 0, 1);
 
     if (!isDebug()) {
         int debug_level;
@@ -97,8 +111,8 @@ int main(int argc, char ** argv) {
 
     // Initialize variables
 
-    open_dbs = OSHash_Create();
-    if (!open_dbs) merror_exit("wazuh_db: OSHash_Create() failed");
+    wdb_pool_init();
+    wdb_peer_init((int)nofile);
 
     mdebug1(STARTED_MSG);
 
@@ -121,6 +135,9 @@ int main(int argc, char ** argv) {
         merror("Could not set resource limit for file descriptors to %d: %s (%d)", (int)nofile, strerror(errno), errno);
     }
 
+    // Serve the metrics, if enabled. The option is read before chrooting
+    w_metrics_http_start("wazuh_db");
+
     // Set user and group
 
     {
@@ -168,9 +185,13 @@ int main(int argc, char ** argv) {
 
     minfo(STARTUP_MSG, (int)getpid());
 
-    if (notify_queue = wnotify_init(1), !notify_queue) {
-        merror_exit("at run_dealer(): wnotify_init(): %s (%d)",
-                strerror(errno), errno);
+    os_calloc(config.worker_pool_size, sizeof(wdb_worker_t), workers);
+
+    for (i = 0; i < config.worker_pool_size; i++) {
+        if (workers[i].notify = wnotify_init(WDB_WORKER_EVENTS), !workers[i].notify) {
+            merror_exit("at main(): wnotify_init(): %s (%d)",
+                    strerror(errno), errno);
+        }
     }
 
     // Start threads
@@ -180,13 +201,17 @@ int main(int argc, char ** argv) {
         goto failure;
     }
 
+    w_thread_register(thread_dealer, "wdb-dealer");
+
     os_malloc(sizeof(pthread_t) * config.worker_pool_size, worker_pool);
 
     for (i = 0; i < config.worker_pool_size; i++) {
-        if (status = pthread_create(worker_pool + i, NULL, run_worker, NULL), status != 0) {
+        if (status = pthread_create(worker_pool + i, NULL, run_worker, workers + i), status != 0) {
             merror("Couldn't create thread: %s", strerror(status));
             goto failure;
         }
+
+        w_thread_register(worker_pool[i], "wdb-worker-%d", i);
     }
 
     if (status = pthread_create(&thread_gc, NULL, run_gc, NULL), status != 0) {
@@ -194,11 +219,24 @@ int main(int argc, char ** argv) {
         goto failure;
     }
 
+    w_thread_register(thread_gc, "wdb-gc");
+
     if (status = pthread_create(&thread_up, NULL, run_up, NULL), status != 0) {
         merror("Couldn't create thread: %s", strerror(status));
         goto failure;
     }
 
+    w_thread_register(thread_up, "wdb-up");
+
+    if (config.maintenance_interval > 0) {
+        if (status = pthread_create(&thread_maintenance, NULL, run_maintenance, NULL), status != 0) {
+            merror("Couldn't create thread: %s", strerror(status));
+            goto failure;
+        }
+
+        w_thread_register(thread_maintenance, "wdb-maintenance");
+    }
+
     // Join threads
 
     pthread_join(thread_dealer, NULL);
@@ -207,13 +245,22 @@ int main(int argc, char ** argv) {
         pthread_join(worker_pool[i], NULL);
     }
 
-    wnotify_close(notify_queue);
+    for (i = 0; i < config.worker_pool_size; i++) {
+        wnotify_close(workers[i].notify);
+    }
+
+    free(workers);
     free(worker_pool);
     pthread_join(thread_up, NULL);
     pthread_join(thread_gc, NULL);
+
+    if (config.maintenance_interval > 0) {
+        pthread_join(thread_maintenance, NULL);
+    }
+
     wdb_close_all();
 
-    OSHash_Free(open_dbs);
+    wdb_pool_free();
 
     // Reset template here too, remove queue/db/.template.db again
     // Without the prefix, because chrooted at that point
@@ -272,33 +319,93 @@ void * run_dealer(__attribute__((unused)) void * args) {
 
             continue;
         }
-        if (wnotify_add(notify_queue, peer) < 0) {
+        // Hand the peer to the least busy worker
+
+        wdb_worker_t * worker = workers;
+        int i;
+
+        for (i = 1; i < config.worker_pool_size; i++) {
+            if (__atomic_load_n(&workers[i].peers, __ATOMIC_RELAXED) < __atomic_load_n(&worker->peers, __ATOMIC_RELAXED)) {
+                worker = workers + i;
+            }
+        }
+
+        __atomic_add_fetch(&worker->peers, 1, __ATOMIC_RELAXED);
+
+        if (wnotify_add(worker->notify, peer) < 0) {
             merror("at run_dealer(): wnotify_add(%d): %s (%d)",
                     peer, strerror(errno), errno);
-            goto error;
+            __atomic_sub_fetch(&worker->peers, 1, __ATOMIC_RELAXED);
+            close(peer);
+            continue;
         }
 
         mdebug1("New client connected (%d).", peer);
     }
 
-error:
     close(sock);
     unlink(WDB_LOCAL_SOCK);
     return NULL;
 }
 
-void * run_worker(__attribute__((unused)) void * args) {
-    char buffer[OS_MAXSTR + 1];
-    char response[OS_MAXSTR + 1];
+/* Serve a request of a peer. Returns -1 if the peer has to be closed */
+static int wdb_serve(int peer, char * buffer, char * response) {
     ssize_t length;
     int terminal;
+
+    length = OS_RecvSecureTCP(peer, buffer, OS_MAXSTR);
+
+    switch (length) {
+    case OS_SOCKTERR:
+        mwarn("at run_worker(): received string size is bigger than %d bytes",
+                OS_MAXSTR);
+        return -1;
+
+    case -1:
+        merror("at run_worker(): at recv(): %s (%d)", strerror(errno), errno);
+        return -1;
+
+    case 0:
+        mdebug1("Client %d disconnected.", peer);
+        return -1;
+    }
+
+    if (buffer[length - 1] == '\n') {
+        buffer[length - 1] = '\0';
+        terminal = 1;
+    } else {
+        buffer[length] = '\0';
+        terminal = 0;
+    }
+
+    *response = '\0';
+    wdb_parse(buffer, response, peer);
+
+    if (length = strlen(response), length > 0) {
+        if (terminal && length < OS_MAXSTR - 1) {
+            response[length++] = '\n';
+        }
+        if (OS_SendSecureTCP(peer,length,response) < 0) {
+            merror("at run_worker(): OS_SendSecureTCP(%d): %s (%d)",
+                    peer, strerror(errno), errno);
+        }
+    }
+
+    return 0;
+}
+
+void * run_worker(void * args) {
+    wdb_worker_t * worker = (wdb_worker_t *)args;
+    char buffer[OS_MAXSTR + 1];
+    char response[OS_MAXSTR + 1];
+    int count;
     int peer;
+    int i;
 
     while (running) {
-        // Dequeue peer
-        w_mutex_lock(&queue_mutex);
+        // Wait for requests of the peers of this worker
 
-        switch (wnotify_wait(notify_queue, 100)) {
+        switch (count = wnotify_wait(worker->notify, 100), count) {
         case -1:
             if (errno == EINTR) {
                 mdebug1("at run_worker(): wnotify_wait(): %s", strerror(EINTR));
@@ -306,70 +413,27 @@ void * run_worker(__attribute__((unused)) void * args) {
                 merror("at run_worker(): wnotify_wait(): %s", strerror(errno));
             }
 
-            w_mutex_unlock(&queue_mutex);
             continue;
 
         case 0:
-            w_mutex_unlock(&queue_mutex);
             continue;
         }
 
-        peer = wnotify_get(notify_queue, 0);
-        if (wnotify_delete(notify_queue, peer) < 0) {
-            merror("at run_worker(): wnotify_delete(%d): %s (%d)",
-                    peer, strerror(errno), errno);
-        }
+        // The queue is level-triggered: each peer is served one request per round
 
-        w_mutex_unlock(&queue_mutex);
+        for (i = 0; i < count; i++) {
+            peer = wnotify_get(worker->notify, i);
 
-        ssize_t count;
-        length = 0;
-        count = OS_RecvSecureTCP(peer, buffer, OS_MAXSTR);
-
-        if(count == OS_SOCKTERR){
-            mwarn("at run_worker(): received string size is bigger than %d bytes",
-                    OS_MAXSTR);
-            break;
-        }
-        length+=count;
-
-        switch (length) {
-        case -1:
-            merror("at run_worker(): at recv(): %s (%d)", strerror(errno), errno);
-            close(peer);
-            continue;
-
-        case 0:
-            mdebug1("Client %d disconnected.", peer);
-            close(peer);
-            continue;
-
-        default:
-            if (length > 0 && buffer[length - 1] == '\n') {
-                buffer[length - 1] = '\0';
-                terminal = 1;
-            } else {
-                buffer[length] = '\0';
-                terminal = 0;
-            }
-
-            *response = '\0';
-            wdb_parse(buffer, response);
-            if (length = strlen(response), length > 0) {
-                if (terminal && length < OS_MAXSTR - 1) {
-                    response[length++] = '\n';
-                }
-                if (OS_SendSecureTCP(peer,length,response) < 0) {
-                    merror("at run_worker(): OS_SendSecureTCP(%d): %s (%d)",
+            if (wdb_serve(peer, buffer, response) < 0) {
+                if (wnotify_delete(worker->notify, peer) < 0) {
+                    merror("at run_worker(): wnotify_delete(%d): %s (%d)",
                             peer, strerror(errno), errno);
                 }
-            }
-            break;
-        }
 
-        if (wnotify_add(notify_queue, peer) < 0) {
-            merror("at run_worker(): wnotify_add(%d): %s (%d)",
-                    peer, strerror(errno), errno);
+                wdb_peer_reset(peer);
+                close(peer);
+                __atomic_sub_fetch(&worker->peers, 1, __ATOMIC_RELAXED);
+            }
         }
     }
 
@@ -386,6 +450,21 @@ void * run_gc(__attribute__((unused)) void * args) {
     return NULL;
 }
 
+void * run_maintenance(__attribute__((unused)) void * args) {
+    int elapsed = 0;
+
+    while (running) {
+        sleep(1);
+
+        if (++elapsed >= config.maintenance_interval) {
+            wdb_maintenance();
+            elapsed = 0;
+        }
+    }
+
+    return NULL;
+}
+
 void * run_up(__attribute__((unused)) void * args) {
     DIR *fd;
     struct dirent *db = NULL;
@@ -426,8 +505,9 @@ void * run_up(__attribute__((unused)) void * args) {
         }
 
         *(name++) = '\0';
-        wdb = wdb_open_agent2(atoi(entry));
-        wdb_leave(wdb);
+        if (wdb = wdb_open_agent2(atoi(entry)), wdb) {
+            wdb_leave(wdb);
+        }
         free(entry);
     }
 
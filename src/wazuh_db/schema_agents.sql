@@ -6,6 +6,8 @@
  * and/or modify it under the terms of GPLv2.
  */
 
+PRAGMA auto_vacuum = INCREMENTAL;
+
 CREATE TABLE IF NOT EXISTS fim_entry (
     file TEXT PRIMARY KEY,
     type TEXT NOT NULL CHECK (type IN ('file', 'registry')),
@@ -27,7 +29,7 @@ CREATE TABLE IF NOT EXISTS fim_entry (
     checksum TEXT
 );
 
-CREATE INDEX IF NOT EXISTS fim_file_index ON fim_entry (file);
+CREATE INDEX IF NOT EXISTS fim_file_checksum_index ON fim_entry (file, checksum);
 CREATE INDEX IF NOT EXISTS fim_date_index ON fim_entry (date);
 
 CREATE TABLE IF NOT EXISTS pm_event (
@@ -160,8 +162,6 @@ CREATE TABLE IF NOT EXISTS sys_programs (
     PRIMARY KEY (scan_id, name, version, architecture)
 );
 
-CREATE INDEX IF NOT EXISTS programs_id ON sys_programs (scan_id);
-
 CREATE TABLE IF NOT EXISTS sys_hotfixes (
     scan_id INTEGER,
     scan_time TEXT,
@@ -169,8 +169,6 @@ CREATE TABLE IF NOT EXISTS sys_hotfixes (
     PRIMARY KEY (scan_id, scan_time, hotfix)
 );
 
-CREATE INDEX IF NOT EXISTS hotfix_id ON sys_hotfixes (scan_id);
-
 CREATE TABLE IF NOT EXISTS sys_processes (
     scan_id INTEGER,
     scan_time TEXT,
@@ -205,8 +203,6 @@ CREATE TABLE IF NOT EXISTS sys_processes (
     PRIMARY KEY (scan_id, pid)
 );
 
-CREATE INDEX IF NOT EXISTS processes_id ON sys_processes (scan_id);
-
 CREATE TABLE IF NOT EXISTS ciscat_results (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
     scan_id INTEGER,
@@ -248,6 +244,8 @@ CREATE TABLE IF NOT EXISTS sca_policy (
    hash_file TEXT
 );
 
+CREATE INDEX IF NOT EXISTS sca_policy_id_index ON sca_policy (id);
+
 CREATE TABLE IF NOT EXISTS sca_scan_info (
    id INTEGER PRIMARY KEY,
    start_scan INTEGER,
@@ -261,6 +259,8 @@ CREATE TABLE IF NOT EXISTS sca_scan_info (
    hash TEXT
 );
 
+CREATE INDEX IF NOT EXISTS sca_scan_info_policy_index ON sca_scan_info (policy_id);
+
 CREATE TABLE IF NOT EXISTS sca_check (
    scan_id INTEGER REFERENCES sca_scan_info (id),
    id INTEGER PRIMARY KEY,
@@ -281,7 +281,7 @@ CREATE TABLE IF NOT EXISTS sca_check (
    condition TEXT
 );
 
-CREATE INDEX IF NOT EXISTS policy_id_index ON sca_check (policy_id);
+CREATE INDEX IF NOT EXISTS sca_check_policy_index ON sca_check (policy_id, id, result);
 
 CREATE TABLE IF NOT EXISTS sca_check_rules (
   id_check INTEGER REFERENCES sca_check (id),
@@ -290,8 +290,6 @@ CREATE TABLE IF NOT EXISTS sca_check_rules (
   PRIMARY KEY (id_check, `type`, rule)
 );
 
-CREATE INDEX IF NOT EXISTS rules_id_check_index ON sca_check_rules (id_check);
-
 CREATE TABLE IF NOT EXISTS sca_check_compliance (
    id_check INTEGER REFERENCES sca_check (id),
   `key` TEXT,
@@ -299,8 +297,6 @@ CREATE TABLE IF NOT EXISTS sca_check_compliance (
    PRIMARY KEY (id_check, `key`, `value`)
 );
 
-CREATE INDEX IF NOT EXISTS comp_id_check_index ON sca_check_compliance (id_check);
-
 CREATE TABLE IF NOT EXISTS vuln_metadata (
     LAST_SCAN INTEGER,
     WAZUH_VERSION TEXT,
@@ -321,7 +317,7 @@ CREATE TABLE IF NOT EXISTS sync_info (
 
 BEGIN;
 
-INSERT INTO metadata (key, value) VALUES ('db_version', '5');
+INSERT INTO metadata (key, value) VALUES ('db_version', '6');
 INSERT INTO scan_info (module) VALUES ('fim');
 INSERT INTO scan_info (module) VALUES ('syscollector');
 INSERT INTO sync_info (component) VALUES ('fim');
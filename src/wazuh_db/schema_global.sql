@@ -36,6 +36,7 @@ CREATE TABLE IF NOT EXISTS agent (
 
 CREATE INDEX IF NOT EXISTS agent_name ON agent (name);
 CREATE INDEX IF NOT EXISTS agent_ip ON agent (ip);
+CREATE INDEX IF NOT EXISTS agent_group ON agent (`group`);
 
 INSERT INTO agent (id, ip, register_ip, name, date_add, last_keepalive, `group`) VALUES (0, '127.0.0.1', '127.0.0.1', 'localhost', strftime('%s','now'), 253402300799, NULL);
 
@@ -50,6 +51,8 @@ CREATE TABLE IF NOT EXISTS `group`
     name TEXT
     );
 
+CREATE INDEX IF NOT EXISTS group_name ON `group` (name);
+
 CREATE TABLE IF NOT EXISTS belongs
     (
     id_agent INTEGER,
@@ -57,4 +60,6 @@ CREATE TABLE IF NOT EXISTS belongs
     PRIMARY KEY (id_agent, id_group)
     );
 
+CREATE INDEX IF NOT EXISTS belongs_id_group ON belongs (id_group, id_agent);
+
 PRAGMA journal_mode=WAL;
@@ -0,0 +1,17 @@
+/*
+ * SQL Schema for upgrading the global database
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * October 15, 2026.
+ *
+ * This program is a free software, you can redistribute it
+ * and/or modify it under the terms of GPLv2.
+ *
+ * The global database has no version: this is run every time it's opened,
+ * so every statement must be idempotent.
+*/
+
+/* Agents and memberships are looked up by group */
+CREATE INDEX IF NOT EXISTS agent_group ON agent (`group`);
+CREATE INDEX IF NOT EXISTS group_name ON `group` (name);
+CREATE INDEX IF NOT EXISTS belongs_id_group ON belongs (id_group, id_agent);
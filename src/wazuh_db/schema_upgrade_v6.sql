@@ -0,0 +1,29 @@
+/*
+ * SQL Schema for upgrading databases
+ * Copyright (C) 2015-2020, Wazuh Inc.
+ *
+ * October 15, 2026.
+ *
+ * This program is a free software, you can redistribute it
+ * and/or modify it under the terms of GPLv2.
+*/
+
+/* The checksum ranges of the synchronization are read from the index only */
+DROP INDEX IF EXISTS fim_file_index;
+CREATE INDEX IF NOT EXISTS fim_file_checksum_index ON fim_entry (file, checksum);
+
+/* The primary keys already start by these columns */
+DROP INDEX IF EXISTS programs_id;
+DROP INDEX IF EXISTS hotfix_id;
+DROP INDEX IF EXISTS processes_id;
+DROP INDEX IF EXISTS rules_id_check_index;
+DROP INDEX IF EXISTS comp_id_check_index;
+
+/* The checks of a policy and their results are read from the index only */
+DROP INDEX IF EXISTS policy_id_index;
+CREATE INDEX IF NOT EXISTS sca_check_policy_index ON sca_check (policy_id, id, result);
+
+CREATE INDEX IF NOT EXISTS sca_scan_info_policy_index ON sca_scan_info (policy_id);
+CREATE INDEX IF NOT EXISTS sca_policy_id_index ON sca_policy (id);
+
+INSERT OR REPLACE INTO metadata (key, value) VALUES ('db_version', 6);
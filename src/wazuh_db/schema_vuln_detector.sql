@@ -48,6 +48,11 @@ CREATE INDEX IF NOT EXISTS IN_AGH_HOTFIX ON AGENT_HOTFIXES (HOTFIX);
  );
  CREATE INDEX IF NOT EXISTS IN_MET_TARGET ON METADATA (TARGET);
 
+ CREATE TABLE IF NOT EXISTS FEED_UPDATES (
+    TARGET TEXT PRIMARY KEY NOT NULL,
+    UPDATED INTEGER NOT NULL
+ );
+
  CREATE TABLE IF NOT EXISTS VULNERABILITIES_INFO (
     ID TEXT NOT NULL,
     TITLE TEXT,
@@ -11,6 +11,7 @@
 
 #include "wdb.h"
 #include "wazuh_modules/wmodules.h"
+#include "os_net/os_net.h"
 
 #ifdef WIN32
 #define getuid() 0
@@ -38,26 +39,26 @@ static const char *SQL_STMT[] = {
     [WDB_STMT_OSINFO_INSERT] = "INSERT INTO sys_osinfo (scan_id, scan_time, hostname, architecture, os_name, os_version, os_codename, os_major, os_minor, os_build, os_platform, sysname, release, version, os_release) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
     [WDB_STMT_OSINFO_DEL] = "DELETE FROM sys_osinfo;",
     [WDB_STMT_PROGRAM_INSERT] = "INSERT INTO sys_programs (scan_id, scan_time, format, name, priority, section, size, vendor, install_time, version, architecture, multiarch, source, description, location, triaged) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
-    [WDB_STMT_PROGRAM_DEL] = "DELETE FROM sys_programs WHERE scan_id != ?;",
+    [WDB_STMT_PROGRAM_DEL] = "DELETE FROM sys_programs WHERE scan_id < ?1 OR scan_id > ?1;",
     [WDB_STMT_PROGRAM_UPD] = "UPDATE SYS_PROGRAMS SET CPE = ?, MSU_NAME = ?, TRIAGED = ? WHERE SCAN_ID = ? AND FORMAT IS ? AND NAME IS ? AND VENDOR IS ? AND VERSION IS ? AND ARCHITECTURE IS ?;",
-    [WDB_STMT_PROGRAM_GET] = "SELECT CPE, MSU_NAME, TRIAGED, FORMAT, NAME, VENDOR, VERSION, ARCHITECTURE FROM SYS_PROGRAMS WHERE SCAN_ID != ?;",
+    [WDB_STMT_PROGRAM_GET] = "SELECT CPE, MSU_NAME, TRIAGED, FORMAT, NAME, VENDOR, VERSION, ARCHITECTURE FROM SYS_PROGRAMS WHERE SCAN_ID < ?1 OR SCAN_ID > ?1;",
     [WDB_STMT_HWINFO_INSERT] = "INSERT INTO sys_hwinfo (scan_id, scan_time, board_serial, cpu_name, cpu_cores, cpu_mhz, ram_total, ram_free, ram_usage) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);",
     [WDB_STMT_HOTFIX_INSERT] = "INSERT INTO sys_hotfixes (scan_id, scan_time, hotfix) VALUES (?, ?, ?);",
     [WDB_STMT_HWINFO_DEL] = "DELETE FROM sys_hwinfo;",
-    [WDB_STMT_HOTFIX_DEL] = "DELETE FROM sys_hotfixes WHERE scan_id != ?;",
+    [WDB_STMT_HOTFIX_DEL] = "DELETE FROM sys_hotfixes WHERE scan_id < ?1 OR scan_id > ?1;",
     [WDB_STMT_SET_HOTFIX_MET] = "UPDATE vuln_metadata SET HOTFIX_SCAN_ID = ?;",
     [WDB_STMT_PORT_INSERT] = "INSERT INTO sys_ports (scan_id, scan_time, protocol, local_ip, local_port, remote_ip, remote_port, tx_queue, rx_queue, inode, state, PID, process) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
-    [WDB_STMT_PORT_DEL] = "DELETE FROM sys_ports WHERE scan_id != ?;",
+    [WDB_STMT_PORT_DEL] = "DELETE FROM sys_ports WHERE scan_id < ?1 OR scan_id > ?1;",
     [WDB_STMT_PROC_INSERT] = "INSERT INTO sys_processes (scan_id, scan_time, pid, name, state, ppid, utime, stime, cmd, argvs, euser, ruser, suser, egroup, rgroup, sgroup, fgroup, priority, nice, size, vm_size, resident, share, start_time, pgrp, session, nlwp, tgid, tty, processor) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
-    [WDB_STMT_PROC_DEL] = "DELETE FROM sys_processes WHERE scan_id != ?;",
+    [WDB_STMT_PROC_DEL] = "DELETE FROM sys_processes WHERE scan_id < ?1 OR scan_id > ?1;",
     [WDB_STMT_NETINFO_INSERT] = "INSERT INTO sys_netiface (scan_id, scan_time, name, adapter, type, state, mtu, mac, tx_packets, rx_packets, tx_bytes, rx_bytes, tx_errors, rx_errors, tx_dropped, rx_dropped) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
     [WDB_STMT_PROTO_INSERT] = "INSERT INTO sys_netproto (scan_id, iface, type, gateway, dhcp, metric) VALUES (?, ?, ?, ?, ?, ?);",
     [WDB_STMT_ADDR_INSERT] = "INSERT INTO sys_netaddr (scan_id, iface, proto, address, netmask, broadcast) VALUES (?, ?, ?, ?, ?, ?);",
-    [WDB_STMT_NETINFO_DEL] = "DELETE FROM sys_netiface WHERE scan_id != ?;",
-    [WDB_STMT_PROTO_DEL] = "DELETE FROM sys_netproto WHERE scan_id != ?;",
-    [WDB_STMT_ADDR_DEL] = "DELETE FROM sys_netaddr WHERE scan_id != ?;",
+    [WDB_STMT_NETINFO_DEL] = "DELETE FROM sys_netiface WHERE scan_id < ?1 OR scan_id > ?1;",
+    [WDB_STMT_PROTO_DEL] = "DELETE FROM sys_netproto WHERE scan_id < ?1 OR scan_id > ?1;",
+    [WDB_STMT_ADDR_DEL] = "DELETE FROM sys_netaddr WHERE scan_id < ?1 OR scan_id > ?1;",
     [WDB_STMT_CISCAT_INSERT] = "INSERT INTO ciscat_results (scan_id, scan_time, benchmark, profile, pass, fail, error, notchecked, unknown, score) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
-    [WDB_STMT_CISCAT_DEL] = "DELETE FROM ciscat_results WHERE scan_id != ?;",
+    [WDB_STMT_CISCAT_DEL] = "DELETE FROM ciscat_results WHERE scan_id < ?1 OR scan_id > ?1;",
     [WDB_STMT_SCAN_INFO_UPDATEFS] = "UPDATE scan_info SET first_start = ?, start_scan = ? WHERE module = ?;",
     [WDB_STMT_SCAN_INFO_UPDATEFE] = "UPDATE scan_info SET first_end = ?, end_scan = ? WHERE module = ?;",
     [WDB_STMT_SCAN_INFO_UPDATESS] = "UPDATE scan_info SET start_scan = ? WHERE module = ?;",
@@ -104,15 +105,129 @@ static const char *SQL_STMT[] = {
 
 sqlite3 *wdb_global = NULL;
 wdb_config config;
-pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
-wdb_t * db_pool_begin;
-wdb_t * db_pool_last;
 int db_pool_size;
-OSHash * open_dbs;
+
+/* The open databases are spread into shards by ID. Each shard has its own
+ * lock, hash table and list, sorted from the least to the most recently used.
+ * The lock of a shard is only held to find, add or remove a database: the
+ * database lock is taken afterwards, so a slow query only blocks its own
+ * database. A database is pinned by its reference count while it's in use,
+ * so it can't be closed. */
+typedef struct wdb_pool_shard_t {
+    pthread_mutex_t mutex;
+    OSHash * table;             // Databases by ID
+    OSHash * checked;           // Inode of the files already upgraded, by ID
+    wdb_t * first;              // Least recently used
+    wdb_t * last;               // Most recently used
+    int size;
+} wdb_pool_shard_t;
+
+static wdb_pool_shard_t pool_shards[WDB_POOL_SHARDS];
+
+// Statements prepared and reused by the caches of all the databases
+static unsigned long stmt_prepared;
+static unsigned long stmt_cached;
+
+static wdb_pool_shard_t * wdb_pool_shard(const char * id) {
+    unsigned int hash = 2166136261u;
+
+    for (; *id; id++) {
+        hash = (hash ^ (unsigned char)*id) * 16777619u;
+    }
+
+    return pool_shards + hash % WDB_POOL_SHARDS;
+}
+
+/* Pin a database and mark it as the most recently used. The shard must be locked */
+static void wdb_pool_take(wdb_pool_shard_t * shard, wdb_t * wdb) {
+    __atomic_add_fetch(&wdb->refcount, 1, __ATOMIC_RELAXED);
+
+    if (wdb != shard->last) {
+        // Unlink
+        if (wdb->prev) {
+            wdb->prev->next = wdb->next;
+        } else {
+            shard->first = wdb->next;
+        }
+
+        wdb->next->prev = wdb->prev;
+
+        // Append
+        wdb->prev = shard->last;
+        wdb->next = NULL;
+        shard->last->next = wdb;
+        shard->last = wdb;
+    }
+}
+
+void wdb_pool_init() {
+    int i;
+
+    for (i = 0; i < WDB_POOL_SHARDS; i++) {
+        w_mutex_init(&pool_shards[i].mutex, NULL);
+
+        if (pool_shards[i].table = OSHash_Create(), !pool_shards[i].table) {
+            merror_exit("wazuh_db: OSHash_Create() failed");
+        }
+
+        if (pool_shards[i].checked = OSHash_Create(), !pool_shards[i].checked) {
+            merror_exit("wazuh_db: OSHash_Create() failed");
+        }
+
+        OSHash_SetFreeDataPointer(pool_shards[i].checked, free);
+    }
+}
+
+void wdb_pool_free() {
+    int i;
+
+    for (i = 0; i < WDB_POOL_SHARDS; i++) {
+        OSHash_Free(pool_shards[i].table);
+        pool_shards[i].table = NULL;
+        OSHash_Free(pool_shards[i].checked);
+        pool_shards[i].checked = NULL;
+    }
+}
+
+/* A database that was upgraded doesn't need to be checked again when it's
+ * reopened, unless its file was replaced. Databases that are removed and
+ * created again come from the profile, which is up to date. The shard must
+ * be locked. */
+static int wdb_pool_checked(wdb_pool_shard_t * shard, const char * id, const char * path) {
+    ino_t * inode;
+    struct stat buf;
+
+    return (inode = OSHash_Get(shard->checked, id), inode) && stat(path, &buf) == 0 && buf.st_ino == *inode;
+}
+
+static void wdb_pool_set_checked(wdb_pool_shard_t * shard, const char * id, const char * path) {
+    ino_t * inode;
+    struct stat buf;
+
+    if (stat(path, &buf) < 0) {
+        return;
+    }
+
+    if (inode = OSHash_Get(shard->checked, id), !inode) {
+        os_malloc(sizeof(ino_t), inode);
+
+        if (OSHash_Add(shard->checked, id, inode) != 2) {
+            free(inode);
+            return;
+        }
+    }
+
+    *inode = buf.st_ino;
+}
+
+pthread_mutex_t * wdb_pool_mutex(const char * id) {
+    return &wdb_pool_shard(id)->mutex;
+}
 
 /* Open global database. Returns 0 on success or -1 on failure. */
 int wdb_open_global() {
     char dir[OS_FLSIZE + 1];
+    char * error = NULL;
 
     if (!wdb_global) {
         // Database dir
@@ -141,6 +256,12 @@ int wdb_open_global() {
         }
 
         sqlite3_busy_timeout(wdb_global, BUSY_SLEEP);
+
+        // Add the indexes of the newer versions to a database created before them
+        if (sqlite3_exec(wdb_global, schema_global_upgrade_sql, NULL, NULL, &error) != SQLITE_OK) {
+            mwarn("Can't upgrade the global database: %s", error ? error : sqlite3_errmsg(wdb_global));
+            sqlite3_free(error);
+        }
     }
 
     return 0;
@@ -150,12 +271,13 @@ wdb_t * wdb_open_mitre() {
     char path[PATH_MAX + 1];
     sqlite3 *db;
     wdb_t * wdb = NULL;
+    wdb_pool_shard_t * shard = wdb_pool_shard(WDB_MITRE_NAME);
 
     // Find BD in pool
 
-    w_mutex_lock(&pool_mutex);
+    w_mutex_lock(&shard->mutex);
 
-    if (wdb = (wdb_t *)OSHash_Get(open_dbs, WDB_MITRE_NAME), wdb) {
+    if (wdb = (wdb_t *)OSHash_Get(shard->table, WDB_MITRE_NAME), wdb) {
         goto success;
     }
 
@@ -174,11 +296,15 @@ wdb_t * wdb_open_mitre() {
     }
 
 success:
-    w_mutex_lock(&wdb->mutex);
-    wdb->refcount++;
+    wdb_pool_take(shard, wdb);
 
 end:
-    w_mutex_unlock(&pool_mutex);
+    w_mutex_unlock(&shard->mutex);
+
+    if (wdb) {
+        w_mutex_lock(&wdb->mutex);
+    }
+
     return wdb;
 }
 
@@ -223,20 +349,56 @@ sqlite3* wdb_open_agent(int id_agent, const char *name) {
     return db;
 }
 
+// Check whether a database uses write-ahead logging
+static int wdb_is_wal(sqlite3 * db) {
+    sqlite3_stmt * stmt;
+    int result = 0;
+
+    if (sqlite3_prepare_v2(db, "PRAGMA journal_mode;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char * mode = (const char *)sqlite3_column_text(stmt, 0);
+        result = mode && strcmp(mode, "wal") == 0;
+    }
+
+    sqlite3_finalize(stmt);
+    return result;
+}
+
 // Open database for agent and store in DB pool. It returns a locked database or NULL
 wdb_t * wdb_open_agent2(int agent_id) {
+    wdb_t * wdb = wdb_pin_agent2(agent_id);
+
+    // Wait for the database out of the shard lock
+
+    if (wdb) {
+        w_mutex_lock(&wdb->mutex);
+    }
+
+    return wdb;
+}
+
+/* Readers see the committed data only: the transaction of the writer is out
+ * of their snapshot. With a rollback journal, a reader would block the commits
+ * of the writer, so only databases in WAL mode get one. The reader is opened
+ * on the first read-only query, and closed with the database. */
+wdb_t * wdb_pin_agent2(int agent_id) {
     char sagent_id[64];
     char path[PATH_MAX + 1];
     sqlite3 * db;
     wdb_t * wdb = NULL;
+    wdb_pool_shard_t * shard;
 
     snprintf(sagent_id, sizeof(sagent_id), "%03d", agent_id);
+    shard = wdb_pool_shard(sagent_id);
 
     // Find BD in pool
 
-    w_mutex_lock(&pool_mutex);
+    w_mutex_lock(&shard->mutex);
 
-    if (wdb = (wdb_t *)OSHash_Get(open_dbs, sagent_id), wdb) {
+    if (wdb = (wdb_t *)OSHash_Get(shard->table, sagent_id), wdb) {
         goto success;
     }
 
@@ -263,26 +425,77 @@ wdb_t * wdb_open_agent2(int agent_id) {
 
         wdb = wdb_init(db, sagent_id);
         wdb_pool_append(wdb);
+        wdb_pool_set_checked(shard, sagent_id, path);
     }
     else {
         wdb = wdb_init(db, sagent_id);
         wdb_pool_append(wdb);
-        wdb = wdb_upgrade(wdb);
 
-        if (wdb == NULL) {
-            goto end;
+        if (!wdb_pool_checked(shard, sagent_id, path)) {
+            if (wdb = wdb_upgrade(wdb), !wdb) {
+                goto end;
+            }
+
+            wdb_pool_set_checked(shard, sagent_id, path);
         }
     }
 
+    if (config.read_replicas) {
+        wdb_journal_wal(wdb->db);
+        wdb->wal = wdb_is_wal(wdb->db);
+    }
+
 success:
-    w_mutex_lock(&wdb->mutex);
-    wdb->refcount++;
+    wdb_pool_take(shard, wdb);
 
 end:
-    w_mutex_unlock(&pool_mutex);
+    w_mutex_unlock(&shard->mutex);
     return wdb;
 }
 
+void wdb_unpin(wdb_t * wdb) {
+    __atomic_sub_fetch(&wdb->refcount, 1, __ATOMIC_RELEASE);
+}
+
+wdb_t * wdb_reader(wdb_t * wdb, const char * sql) {
+    wdb_pool_shard_t * shard = wdb_pool_shard(wdb->id);
+    char path[PATH_MAX + 1];
+    sqlite3_stmt * stmt;
+    sqlite3 * db;
+    wdb_t * reader;
+
+    w_mutex_lock(&shard->mutex);
+
+    if (wdb->wal && !wdb->reader) {
+        snprintf(path, sizeof(path), "%s/%s.db", WDB2_DIR, wdb->id);
+
+        if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL)) {
+            mdebug1("DB(%s) Can't open reader: %s", wdb->id, sqlite3_errmsg(db));
+            sqlite3_close_v2(db);
+            wdb->wal = 0;
+        } else {
+            sqlite3_busy_timeout(db, BUSY_SLEEP);
+            wdb->reader = wdb_init(db, wdb->id);
+        }
+    }
+
+    reader = wdb->reader;
+    w_mutex_unlock(&shard->mutex);
+
+    if (!reader) {
+        return NULL;
+    }
+
+    w_mutex_lock(&reader->mutex);
+
+    if (stmt = wdb_sql_cache(reader, sql), !stmt || !sqlite3_stmt_readonly(stmt)) {
+        w_mutex_unlock(&reader->mutex);
+        return NULL;
+    }
+
+    return reader;
+}
+
 /* Create database for agent from profile. Returns 0 on success or -1 on error. */
 int wdb_create_agent_db2(const char * agent_id) {
     char path[OS_FLSIZE + 1];
@@ -404,6 +617,47 @@ int wdb_step(sqlite3_stmt *stmt) {
     return result;
 }
 
+/* Start a set of legacy statements on a database. None is prepared until it's used. */
+void wdb_legacy_init(wdb_legacy_t *legacy, sqlite3 *db) {
+    memset(legacy, 0, sizeof(wdb_legacy_t));
+    legacy->db = db;
+}
+
+/* Get a legacy statement, prepared at its first use and reset later. Returns NULL on error. */
+sqlite3_stmt * wdb_legacy_stmt_cache(wdb_legacy_t *legacy, wdb_legacy_stmt index, const char *sql) {
+    sqlite3_stmt **stmt = legacy->stmt + index;
+
+    if (*stmt) {
+        if (sqlite3_reset(*stmt) == SQLITE_OK && sqlite3_clear_bindings(*stmt) == SQLITE_OK) {
+            return *stmt;
+        }
+
+        // Retry to prepare
+        sqlite3_finalize(*stmt);
+        *stmt = NULL;
+    }
+
+    if (wdb_prepare(legacy->db, sql, -1, stmt, NULL)) {
+        mdebug1("SQLite: %s", sqlite3_errmsg(legacy->db));
+        sqlite3_finalize(*stmt);
+        *stmt = NULL;
+    }
+
+    return *stmt;
+}
+
+/* Finalize the legacy statements. The database is not closed. */
+void wdb_legacy_finalize(wdb_legacy_t *legacy) {
+    int i;
+
+    for (i = 0; i < WDB_LEGACY_STMT_SIZE; i++) {
+        if (legacy->stmt[i]) {
+            sqlite3_finalize(legacy->stmt[i]);
+            legacy->stmt[i] = NULL;
+        }
+    }
+}
+
 /* Begin transaction */
 int wdb_begin(sqlite3 *db) {
     sqlite3_stmt *stmt = NULL;
@@ -423,12 +677,30 @@ int wdb_begin(sqlite3 *db) {
     return result;
 }
 
+/* Run a statement without results through the cache of the database */
+static int wdb_sql_cache_step(wdb_t * wdb, const char * sql) {
+    sqlite3_stmt * stmt;
+    int result = 0;
+
+    if (stmt = wdb_sql_cache(wdb, sql), !stmt) {
+        return -1;
+    }
+
+    if (wdb_step(stmt) != SQLITE_DONE) {
+        mdebug1("wdb_step(): %s", sqlite3_errmsg(wdb->db));
+        result = -1;
+    }
+
+    sqlite3_reset(stmt);
+    return result;
+}
+
 int wdb_begin2(wdb_t * wdb) {
     if (wdb->transaction) {
         return 0;
     }
 
-    if (wdb_begin(wdb->db) == -1) {
+    if (wdb_sql_cache_step(wdb, SQL_BEGIN) == -1) {
         return -1;
     }
 
@@ -462,7 +734,7 @@ int wdb_commit2(wdb_t * wdb) {
         return 0;
     }
 
-    if (wdb_commit(wdb->db) == -1) {
+    if (wdb_sql_cache_step(wdb, SQL_COMMIT) == -1) {
         return -1;
     }
 
@@ -611,6 +883,12 @@ wdb_t * wdb_init(sqlite3 * db, const char * id) {
     wdb_t * wdb;
     os_calloc(1, sizeof(wdb_t), wdb);
     wdb->db = db;
+
+    // Checkpoints are run by the maintenance thread, out of the queries
+    if (config.maintenance_interval > 0) {
+        sqlite3_wal_autocheckpoint(db, 0);
+    }
+
     w_mutex_init(&wdb->mutex, NULL);
     os_strdup(id, wdb->id);
     return wdb;
@@ -622,152 +900,332 @@ void wdb_destroy(wdb_t * wdb) {
     free(wdb);
 }
 
+// Add a database to its shard, as the most recently used. The shard must be locked
 void wdb_pool_append(wdb_t * wdb) {
+    wdb_pool_shard_t * shard = wdb_pool_shard(wdb->id);
     int r;
 
-    if (db_pool_begin) {
-        db_pool_last->next = wdb;
-        db_pool_last = wdb;
+    wdb->prev = shard->last;
+    wdb->next = NULL;
+
+    if (shard->last) {
+        shard->last->next = wdb;
     } else {
-        db_pool_begin = db_pool_last = wdb;
+        shard->first = wdb;
     }
 
-    db_pool_size++;
+    shard->last = wdb;
+    shard->size++;
+    __atomic_add_fetch(&db_pool_size, 1, __ATOMIC_RELAXED);
 
-    if (r = OSHash_Add(open_dbs, wdb->id, wdb), r != 2) {
+    if (r = OSHash_Add(shard->table, wdb->id, wdb), r != 2) {
         merror_exit("OSHash_Add(%s) returned %d.", wdb->id, r);
     }
 }
 
+// Remove a database from its shard. The shard must be locked
 void wdb_pool_remove(wdb_t * wdb) {
-    wdb_t * prev;
+    wdb_pool_shard_t * shard = wdb_pool_shard(wdb->id);
 
-    if (!OSHash_Delete(open_dbs, wdb->id)) {
+    if (!OSHash_Delete(shard->table, wdb->id)) {
         merror("Database for agent '%s' was not in hash table.", wdb->id);
     }
 
-    if (wdb == db_pool_begin) {
-        db_pool_begin = wdb->next;
-
-        if (wdb == db_pool_last) {
-            db_pool_last = NULL;
-        }
-
-        db_pool_size--;
-    } else if (prev = wdb_pool_find_prev(wdb), prev) {
-        prev->next = wdb->next;
-
-        if (wdb == db_pool_last) {
-            db_pool_last = prev;
-        }
+    if (wdb->prev) {
+        wdb->prev->next = wdb->next;
+    } else {
+        shard->first = wdb->next;
+    }
 
-        db_pool_size--;
+    if (wdb->next) {
+        wdb->next->prev = wdb->prev;
     } else {
-        merror("Database for agent '%s' not found in the pool.", wdb->id);
+        shard->last = wdb->prev;
     }
+
+    wdb->prev = wdb->next = NULL;
+    shard->size--;
+    __atomic_sub_fetch(&db_pool_size, 1, __ATOMIC_RELAXED);
 }
 
 void wdb_close_all() {
     wdb_t * node;
+    int i;
 
     mdebug1("Closing all databases...");
-    w_mutex_lock(&pool_mutex);
 
-    while (node = db_pool_begin, node) {
-        mdebug2("Closing database for agent %s", node->id);
+    for (i = 0; i < WDB_POOL_SHARDS; i++) {
+        w_mutex_lock(&pool_shards[i].mutex);
 
-        if (wdb_close(node, TRUE) < 0) {
-            merror("Couldn't close DB for agent %s", node->id);
+        while (node = pool_shards[i].first, node) {
+            mdebug2("Closing database for agent %s", node->id);
 
+            if (wdb_close(node, TRUE) < 0) {
+                merror("Couldn't close DB for agent %s", node->id);
+                break;
+            }
         }
-    }
 
-    w_mutex_unlock(&pool_mutex);
+        w_mutex_unlock(&pool_shards[i].mutex);
+    }
 }
 
 void wdb_commit_old() {
+    wdb_t ** nodes = NULL;
     wdb_t * node;
+    int count;
+    int i;
+    int j;
+
+    for (i = 0; i < WDB_POOL_SHARDS; i++) {
+        wdb_pool_shard_t * shard = pool_shards + i;
+
+        // Pin the databases of the shard, so they can be committed out of its lock
+
+        w_mutex_lock(&shard->mutex);
+        os_realloc(nodes, sizeof(wdb_t *) * (shard->size + 1), nodes);
+
+        for (count = 0, node = shard->first; node; node = node->next) {
+            __atomic_add_fetch(&node->refcount, 1, __ATOMIC_RELAXED);
+            nodes[count++] = node;
+        }
+
+        w_mutex_unlock(&shard->mutex);
+
+        for (j = 0; j < count; j++) {
+            node = nodes[j];
+            w_mutex_lock(&node->mutex);
+            time_t cur_time = time(NULL);
+
+            // Commit condition: more than commit_time_min seconds elapsed from the last query, or more than commit_time_max elapsed from the transaction began.
+
+            if (node->transaction && (cur_time - node->last > config.commit_time_min || cur_time - node->transaction_begin_time > config.commit_time_max)) {
+                struct timespec ts_start, ts_end;
+
+                gettime(&ts_start);
+                wdb_commit2(node);
+                gettime(&ts_end);
+
+                mdebug2("Agent '%s' database commited. Time: %.3f ms.", node->id, time_diff(&ts_start, &ts_end) * 1e3);
+            }
 
-    w_mutex_lock(&pool_mutex);
+            w_mutex_unlock(&node->mutex);
+            __atomic_sub_fetch(&node->refcount, 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    os_free(nodes);
+}
+
+static struct {
+    unsigned long checkpoints;
+    unsigned long vacuums;
+    unsigned long vacuumed_pages;
+    unsigned long pages;            // Pages of the databases found in the last pass
+    unsigned long free_pages;       // Free pages of the databases found in the last pass
+} maintenance;
+
+// Read the integer value of a pragma, or return -1 on error
+static long wdb_pragma_int(sqlite3 * db, const char * sql) {
+    sqlite3_stmt * stmt;
+    long value = -1;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        mdebug1("sqlite3_prepare_v2(): %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        value = (long)sqlite3_column_int64(stmt, 0);
+    }
 
-    for (node = db_pool_begin; node; node = node->next) {
-        w_mutex_lock(&node->mutex);
-        time_t cur_time = time(NULL);
+    sqlite3_finalize(stmt);
+    return value;
+}
 
-        // Commit condition: more than commit_time_min seconds elapsed from the last query, or more than commit_time_max elapsed from the transaction began.
+/* Checkpoint the log of a database, and reclaim its free pages if it has been
+ * idle for a while. Databases created before incremental vacuum are rebuilt
+ * once when too many of their pages are free. The database must be locked. */
+static void wdb_maintain(wdb_t * wdb, unsigned long * pages, unsigned long * free_pages) {
+    struct timespec ts_start, ts_end;
+    char sql[OS_SIZE_64];
+    int log = -1;
+    long page_count;
+    long freelist;
+
+    if (sqlite3_wal_checkpoint_v2(wdb->db, NULL, SQLITE_CHECKPOINT_PASSIVE, &log, NULL) == SQLITE_OK && log > 0) {
+        __atomic_add_fetch(&maintenance.checkpoints, 1, __ATOMIC_RELAXED);
+    }
 
-        if (node->transaction && (cur_time - node->last > config.commit_time_min || cur_time - node->transaction_begin_time > config.commit_time_max)) {
-            struct timespec ts_start, ts_end;
+    if ((page_count = wdb_pragma_int(wdb->db, "PRAGMA page_count;")) <= 0 ||
+        (freelist = wdb_pragma_int(wdb->db, "PRAGMA freelist_count;")) < 0) {
+        return;
+    }
+
+    *pages += page_count;
+    *free_pages += freelist;
 
-            gettime(&ts_start);
-            wdb_commit2(node);
-            gettime(&ts_end);
+    if (freelist == 0 || wdb->transaction || time(NULL) - wdb->last < config.maintenance_quiet) {
+        return;
+    }
 
-            mdebug2("Agent '%s' database commited. Time: %.3f ms.", node->id, time_diff(&ts_start, &ts_end) * 1e3);
+    gettime(&ts_start);
+
+    switch (wdb_pragma_int(wdb->db, "PRAGMA auto_vacuum;")) {
+    case 2:
+        snprintf(sql, sizeof(sql), "PRAGMA incremental_vacuum(%d);", config.vacuum_pages);
+
+        if (sqlite3_exec(wdb->db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+            mdebug1("DB(%s) Cannot vacuum database: %s", wdb->id, sqlite3_errmsg(wdb->db));
+            return;
         }
 
-        w_mutex_unlock(&node->mutex);
+        break;
+
+    case 0:
+        if (config.vacuum_ratio == 0 || freelist * 100 < page_count * config.vacuum_ratio) {
+            return;
+        }
+
+        if (sqlite3_exec(wdb->db, "PRAGMA auto_vacuum = INCREMENTAL; VACUUM;", NULL, NULL, NULL) != SQLITE_OK) {
+            mdebug1("DB(%s) Cannot rebuild database: %s", wdb->id, sqlite3_errmsg(wdb->db));
+            return;
+        }
+
+        __atomic_add_fetch(&maintenance.vacuums, 1, __ATOMIC_RELAXED);
+        break;
+
+    default:
+        return;
     }
 
-    w_mutex_unlock(&pool_mutex);
+    gettime(&ts_end);
+
+    if (page_count = wdb_pragma_int(wdb->db, "PRAGMA freelist_count;"), page_count >= 0 && page_count < freelist) {
+        __atomic_add_fetch(&maintenance.vacuumed_pages, freelist - page_count, __ATOMIC_RELAXED);
+        *free_pages -= freelist - page_count;
+        mdebug2("DB(%s) Reclaimed %ld free pages. Time: %.3f ms.", wdb->id, freelist - page_count, time_diff(&ts_start, &ts_end) * 1e3);
+    }
+}
+
+void wdb_maintenance() {
+    wdb_t ** nodes = NULL;
+    wdb_t * node;
+    unsigned long pages = 0;
+    unsigned long free_pages = 0;
+    int count;
+    int i;
+    int j;
+
+    for (i = 0; i < WDB_POOL_SHARDS; i++) {
+        wdb_pool_shard_t * shard = pool_shards + i;
+
+        // Pin the databases of the shard, so they can be maintained out of its lock
+
+        w_mutex_lock(&shard->mutex);
+        os_realloc(nodes, sizeof(wdb_t *) * (shard->size + 1), nodes);
+
+        for (count = 0, node = shard->first; node; node = node->next) {
+            __atomic_add_fetch(&node->refcount, 1, __ATOMIC_RELAXED);
+            nodes[count++] = node;
+        }
+
+        w_mutex_unlock(&shard->mutex);
+
+        for (j = 0; j < count; j++) {
+            node = nodes[j];
+            w_mutex_lock(&node->mutex);
+            wdb_maintain(node, &pages, &free_pages);
+            w_mutex_unlock(&node->mutex);
+            __atomic_sub_fetch(&node->refcount, 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    os_free(nodes);
+
+    __atomic_store_n(&maintenance.pages, pages, __ATOMIC_RELAXED);
+    __atomic_store_n(&maintenance.free_pages, free_pages, __ATOMIC_RELAXED);
+}
+
+void wdb_maintenance_stats(cJSON * stats) {
+    cJSON_AddNumberToObject(stats, "checkpoints", __atomic_load_n(&maintenance.checkpoints, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(stats, "vacuums", __atomic_load_n(&maintenance.vacuums, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(stats, "vacuumed_pages", __atomic_load_n(&maintenance.vacuumed_pages, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(stats, "pages", __atomic_load_n(&maintenance.pages, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(stats, "free_pages", __atomic_load_n(&maintenance.free_pages, __ATOMIC_RELAXED));
 }
 
 void wdb_close_old() {
+    static int start;
     wdb_t * node;
     wdb_t * next;
+    int i;
 
-    w_mutex_lock(&pool_mutex);
+    // Start from a different shard each time, so the databases are closed evenly
 
-    for (node = db_pool_begin; node && db_pool_size > config.open_db_limit; node = next) {
-        next = node->next;
+    for (i = 0; i < WDB_POOL_SHARDS && __atomic_load_n(&db_pool_size, __ATOMIC_RELAXED) > config.open_db_limit; i++) {
+        wdb_pool_shard_t * shard = pool_shards + (start + i) % WDB_POOL_SHARDS;
 
-        if (node->refcount == 0 && !node->transaction) {
-            mdebug2("Closing database for agent %s", node->id);
-            wdb_close(node, FALSE);
+        w_mutex_lock(&shard->mutex);
+
+        for (node = shard->first; node && __atomic_load_n(&db_pool_size, __ATOMIC_RELAXED) > config.open_db_limit; node = next) {
+            next = node->next;
+
+            if (__atomic_load_n(&node->refcount, __ATOMIC_ACQUIRE) == 0 && !node->transaction) {
+                mdebug2("Closing database for agent %s", node->id);
+                wdb_close(node, FALSE);
+            }
         }
+
+        w_mutex_unlock(&shard->mutex);
     }
 
-    w_mutex_unlock(&pool_mutex);
+    start = (start + 1) % WDB_POOL_SHARDS;
 }
 
-cJSON * wdb_exec(sqlite3 * db, const char * sql) {
-    int r;
+// Build the object of the current row of a statement, or NULL if it has no columns
+static cJSON * wdb_exec_row(sqlite3_stmt * stmt) {
     int count;
     int i;
-    sqlite3_stmt * stmt;
-    cJSON * result;
     cJSON * row;
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        mdebug1("sqlite3_prepare_v2(): %s", sqlite3_errmsg(db));
-        mdebug2("SQL: %s", sql);
+    if (count = sqlite3_column_count(stmt), count <= 0) {
         return NULL;
     }
 
+    row = cJSON_CreateObject();
+
+    for (i = 0; i < count; i++) {
+        switch (sqlite3_column_type(stmt, i)) {
+        case SQLITE_INTEGER:
+        case SQLITE_FLOAT:
+            cJSON_AddNumberToObject(row, sqlite3_column_name(stmt, i), sqlite3_column_double(stmt, i));
+            break;
+
+        case SQLITE_TEXT:
+        case SQLITE_BLOB:
+            cJSON_AddStringToObject(row, sqlite3_column_name(stmt, i), (const char *)sqlite3_column_text(stmt, i));
+            break;
+
+        case SQLITE_NULL:
+        default:
+            ;
+        }
+    }
+
+    return row;
+}
+
+// Collect the rows of a statement, or return NULL on error
+static cJSON * wdb_exec_rows(sqlite3 * db, sqlite3_stmt * stmt) {
+    int r;
+    cJSON * result;
+    cJSON * row;
+
     result = cJSON_CreateArray();
 
     while (r = sqlite3_step(stmt), r == SQLITE_ROW) {
-        if (count = sqlite3_column_count(stmt), count > 0) {
-            row = cJSON_CreateObject();
-
-            for (i = 0; i < count; i++) {
-                switch (sqlite3_column_type(stmt, i)) {
-                case SQLITE_INTEGER:
-                case SQLITE_FLOAT:
-                    cJSON_AddNumberToObject(row, sqlite3_column_name(stmt, i), sqlite3_column_double(stmt, i));
-                    break;
-
-                case SQLITE_TEXT:
-                case SQLITE_BLOB:
-                    cJSON_AddStringToObject(row, sqlite3_column_name(stmt, i), (const char *)sqlite3_column_text(stmt, i));
-                    break;
-
-                case SQLITE_NULL:
-                default:
-                    ;
-                }
-            }
-
+        if (row = wdb_exec_row(stmt), row) {
             cJSON_AddItemToArray(result, row);
         }
     }
@@ -778,23 +1236,328 @@ cJSON * wdb_exec(sqlite3 * db, const char * sql) {
         result = NULL;
     }
 
+    return result;
+}
+
+cJSON * wdb_exec(sqlite3 * db, const char * sql) {
+    sqlite3_stmt * stmt;
+    cJSON * result;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        mdebug1("sqlite3_prepare_v2(): %s", sqlite3_errmsg(db));
+        mdebug2("SQL: %s", sql);
+        return NULL;
+    }
+
+    result = wdb_exec_rows(db, stmt);
     sqlite3_finalize(stmt);
     return result;
 }
 
+cJSON * wdb_exec2(wdb_t * wdb, const char * sql) {
+    sqlite3_stmt * stmt;
+    cJSON * result;
+
+    if (stmt = wdb_sql_cache(wdb, sql), !stmt) {
+        return NULL;
+    }
+
+    result = wdb_exec_rows(wdb->db, stmt);
+    sqlite3_reset(stmt);
+    return result;
+}
+
+/* Run a query and send its rows to a peer in chunks, as they are read.
+ * Every chunk but the last one is sent as "due [rows]". The last one is
+ * written into output as "ok [rows]", for the caller to send it. */
+int wdb_exec_stream(wdb_t * wdb, const char * sql, int peer, char * output) {
+    int r;
+    int result = 0;
+    size_t length;
+    sqlite3_stmt * stmt;
+    cJSON * row;
+    char * chunk;
+    char * out;
+
+    if (stmt = wdb_sql_cache(wdb, sql), !stmt) {
+        snprintf(output, OS_MAXSTR + 1, "err Cannot execute SQL query");
+        return -1;
+    }
+
+    os_malloc(WDB_STREAM_CHUNK + 1, chunk);
+    length = (size_t)snprintf(chunk, WDB_STREAM_CHUNK + 1, "due [");
+
+    while (r = sqlite3_step(stmt), r == SQLITE_ROW) {
+        if (row = wdb_exec_row(stmt), !row) {
+            continue;
+        }
+
+        out = cJSON_PrintUnformatted(row);
+        cJSON_Delete(row);
+        size_t row_length = strlen(out);
+
+        // Room for the separator and the closing bracket
+        if (length + row_length + 2 > WDB_STREAM_CHUNK) {
+            if (chunk[length - 1] == '[') {
+                mdebug1("Row too large to be streamed: %zu bytes.", row_length);
+                snprintf(output, OS_MAXSTR + 1, "err Row too large");
+                os_free(out);
+                result = -1;
+                goto end;
+            }
+
+            chunk[length++] = ']';
+
+            if (OS_SendSecureTCP(peer, length, chunk) < 0) {
+                merror("at wdb_exec_stream(): OS_SendSecureTCP(%d): %s (%d)", peer, strerror(errno), errno);
+                snprintf(output, OS_MAXSTR + 1, "err Cannot send response");
+                os_free(out);
+                result = -1;
+                goto end;
+            }
+
+            length = 5;
+        }
+
+        if (chunk[length - 1] != '[') {
+            chunk[length++] = ',';
+        }
+
+        memcpy(chunk + length, out, row_length);
+        length += row_length;
+        os_free(out);
+    }
+
+    if (r != SQLITE_DONE) {
+        mdebug1("sqlite3_step(): %s", sqlite3_errmsg(wdb->db));
+        snprintf(output, OS_MAXSTR + 1, "err Cannot execute SQL query");
+        result = -1;
+    } else {
+        chunk[length] = '\0';
+        snprintf(output, OS_MAXSTR + 1, "ok %s]", chunk + 4);
+    }
+
+end:
+    os_free(chunk);
+    sqlite3_reset(stmt);
+    return result;
+}
+
+/* Growable byte buffer of a column of a binary result */
+typedef struct wdb_bin_column_t {
+    unsigned char * data;
+    size_t length;
+    size_t size;
+} wdb_bin_column_t;
+
+static unsigned char * wdb_bin_reserve(wdb_bin_column_t * column, size_t n) {
+    if (column->length + n > column->size) {
+        size_t size = column->size ? column->size : OS_SIZE_1024;
+
+        while (column->length + n > size) {
+            size *= 2;
+        }
+
+        os_realloc(column->data, size, column->data);
+        column->size = size;
+    }
+
+    column->length += n;
+    return column->data + column->length - n;
+}
+
+/* Write an unsigned integer of n bytes, little-endian */
+static void wdb_bin_put_uint(unsigned char * dst, uint64_t value, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void wdb_bin_put_value(wdb_bin_column_t * column, sqlite3_stmt * stmt, int i) {
+    unsigned char * dst;
+    const void * bytes;
+    size_t length;
+    double real;
+    uint64_t bits;
+
+    switch (sqlite3_column_type(stmt, i)) {
+    case SQLITE_INTEGER:
+        dst = wdb_bin_reserve(column, 9);
+        dst[0] = WDB_BIN_INTEGER;
+        wdb_bin_put_uint(dst + 1, (uint64_t)sqlite3_column_int64(stmt, i), 8);
+        break;
+
+    case SQLITE_FLOAT:
+        real = sqlite3_column_double(stmt, i);
+        memcpy(&bits, &real, sizeof(bits));
+        dst = wdb_bin_reserve(column, 9);
+        dst[0] = WDB_BIN_FLOAT;
+        wdb_bin_put_uint(dst + 1, bits, 8);
+        break;
+
+    case SQLITE_TEXT:
+        // Get the pointer first: the length is the one of its value
+        bytes = sqlite3_column_text(stmt, i);
+        length = (size_t)sqlite3_column_bytes(stmt, i);
+        dst = wdb_bin_reserve(column, 5 + length);
+        dst[0] = WDB_BIN_TEXT;
+        wdb_bin_put_uint(dst + 1, length, 4);
+
+        if (length) {
+            memcpy(dst + 5, bytes, length);
+        }
+
+        break;
+
+    case SQLITE_BLOB:
+        bytes = sqlite3_column_blob(stmt, i);
+        length = (size_t)sqlite3_column_bytes(stmt, i);
+        dst = wdb_bin_reserve(column, 5 + length);
+        dst[0] = WDB_BIN_BLOB;
+        wdb_bin_put_uint(dst + 1, length, 4);
+
+        if (length) {
+            memcpy(dst + 5, bytes, length);
+        }
+
+        break;
+
+    case SQLITE_NULL:
+    default:
+        dst = wdb_bin_reserve(column, 1);
+        dst[0] = WDB_BIN_NULL;
+    }
+}
+
+/* Run a query and send its result to a peer in the binary format:
+ *
+ *   "ok " <columns:u32> <rows:u32>
+ *   then, for each column: <name length:u16> <name> and the value of every row.
+ *
+ * Each value is a type byte, followed by an 8-byte integer or double, or by
+ * a 4-byte length and the bytes of a text or blob. Nulls have no payload.
+ * Integers are little-endian. On error, output holds the text response. */
+int wdb_exec_binary(wdb_t * wdb, const char * sql, int peer, char * output) {
+    sqlite3_stmt * stmt;
+    wdb_bin_column_t * columns = NULL;
+    wdb_bin_column_t message = { NULL, 0, 0 };
+    unsigned char * dst;
+    uint32_t rows = 0;
+    size_t total = 0;
+    int count;
+    int result = -1;
+    int r;
+    int i;
+
+    if (stmt = wdb_sql_cache(wdb, sql), !stmt) {
+        snprintf(output, OS_MAXSTR + 1, "err Cannot execute SQL query");
+        return -1;
+    }
+
+    count = sqlite3_column_count(stmt);
+    os_calloc(count > 0 ? count : 1, sizeof(wdb_bin_column_t), columns);
+
+    while (r = sqlite3_step(stmt), r == SQLITE_ROW) {
+        for (i = 0; i < count; i++) {
+            total -= columns[i].length;
+            wdb_bin_put_value(columns + i, stmt, i);
+            total += columns[i].length;
+        }
+
+        rows++;
+
+        if (total > WDB_BIN_MAX_SIZE) {
+            mdebug1("Binary response too large: more than %d bytes.", WDB_BIN_MAX_SIZE);
+            snprintf(output, OS_MAXSTR + 1, "err Response too large");
+            goto end;
+        }
+    }
+
+    if (r != SQLITE_DONE) {
+        mdebug1("sqlite3_step(): %s", sqlite3_errmsg(wdb->db));
+        snprintf(output, OS_MAXSTR + 1, "err Cannot execute SQL query");
+        goto end;
+    }
+
+    // Assemble the message
+
+    dst = wdb_bin_reserve(&message, 11);
+    memcpy(dst, "ok ", 3);
+    wdb_bin_put_uint(dst + 3, (uint32_t)count, 4);
+    wdb_bin_put_uint(dst + 7, rows, 4);
+
+    for (i = 0; i < count; i++) {
+        const char * name = sqlite3_column_name(stmt, i);
+        size_t length = name ? strlen(name) : 0;
+
+        if (length > UINT16_MAX) {
+            length = UINT16_MAX;
+        }
+
+        dst = wdb_bin_reserve(&message, 2 + length + columns[i].length);
+        wdb_bin_put_uint(dst, length, 2);
+        memcpy(dst + 2, name, length);
+
+        if (columns[i].length) {
+            memcpy(dst + 2 + length, columns[i].data, columns[i].length);
+        }
+    }
+
+    if (OS_SendSecureTCP(peer, message.length, message.data) < 0) {
+        merror("at wdb_exec_binary(): OS_SendSecureTCP(%d): %s (%d)", peer, strerror(errno), errno);
+    }
+
+    // The response is already sent
+    *output = '\0';
+    result = 0;
+
+end:
+    for (i = 0; i < count; i++) {
+        os_free(columns[i].data);
+    }
+
+    os_free(columns);
+    os_free(message.data);
+    sqlite3_reset(stmt);
+    return result;
+}
+
+// Finalize the cached statements of a database
+static void wdb_finalize_all(wdb_t * wdb) {
+    int i;
+
+    for (i = 0; i < WDB_STMT_SIZE; i++) {
+        if (wdb->stmt[i]) {
+            sqlite3_finalize(wdb->stmt[i]);
+            wdb->stmt[i] = NULL;
+        }
+    }
+
+    for (i = 0; i < WDB_SQL_CACHE_SIZE; i++) {
+        if (wdb->sql_cache[i].sql) {
+            sqlite3_finalize(wdb->sql_cache[i].stmt);
+            os_free(wdb->sql_cache[i].sql);
+        }
+    }
+}
+
 int wdb_close(wdb_t * wdb, bool commit) {
     int result;
-    int i;
 
-    if (wdb->refcount == 0) {
+    if (__atomic_load_n(&wdb->refcount, __ATOMIC_ACQUIRE) == 0) {
         if (wdb->transaction && commit) {
             wdb_commit2(wdb);
         }
 
-        for (i = 0; i < WDB_STMT_SIZE; i++) {
-            if (wdb->stmt[i]) {
-                sqlite3_finalize(wdb->stmt[i]);
-            }
+        wdb_finalize_all(wdb);
+
+        if (wdb->reader) {
+            wdb_finalize_all(wdb->reader);
+            sqlite3_close_v2(wdb->reader->db);
+            wdb_destroy(wdb->reader);
+            wdb->reader = NULL;
         }
 
         result = sqlite3_close_v2(wdb->db);
@@ -814,21 +1577,9 @@ int wdb_close(wdb_t * wdb, bool commit) {
 }
 
 void wdb_leave(wdb_t * wdb) {
-    wdb->refcount--;
     wdb->last = time(NULL);
     w_mutex_unlock(&wdb->mutex);
-}
-
-wdb_t * wdb_pool_find_prev(wdb_t * wdb) {
-    wdb_t * node;
-
-    for (node = db_pool_begin; node && node->next; node = node->next) {
-        if (node->next == wdb) {
-            return node;
-        }
-    }
-
-    return NULL;
+    __atomic_sub_fetch(&wdb->refcount, 1, __ATOMIC_RELEASE);
 }
 
 int wdb_stmt_cache(wdb_t * wdb, int index) {
@@ -841,6 +1592,8 @@ int wdb_stmt_cache(wdb_t * wdb, int index) {
             merror("DB(%s) sqlite3_prepare_v2() stmt(%d): %s", wdb->id, index, sqlite3_errmsg(wdb->db));
             return -1;
         }
+
+        __atomic_add_fetch(&stmt_prepared, 1, __ATOMIC_RELAXED);
     } else if (sqlite3_reset(wdb->stmt[index]) != SQLITE_OK || sqlite3_clear_bindings(wdb->stmt[index]) != SQLITE_OK) {
         mdebug1("DB(%s) sqlite3_reset() stmt(%d): %s", wdb->id, index, sqlite3_errmsg(wdb->db));
 
@@ -852,11 +1605,78 @@ int wdb_stmt_cache(wdb_t * wdb, int index) {
             merror("DB(%s) sqlite3_prepare_v2() stmt(%d): %s", wdb->id, index, sqlite3_errmsg(wdb->db));
             return -1;
         }
+
+        __atomic_add_fetch(&stmt_prepared, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&stmt_cached, 1, __ATOMIC_RELAXED);
     }
 
     return 0;
 }
 
+/* Get a statement of a query built at run time, reset, from the cache of the
+ * database. The least recently used statement is finalized to make room for
+ * a new one. The statement must be reset after use, but not finalized. */
+sqlite3_stmt * wdb_sql_cache(wdb_t * wdb, const char * sql) {
+    wdb_sql_stmt_t * entry = NULL;
+    wdb_sql_stmt_t * empty = NULL;
+    int i;
+
+    for (i = 0; i < WDB_SQL_CACHE_SIZE; i++) {
+        if (!wdb->sql_cache[i].sql) {
+            empty = empty ? empty : wdb->sql_cache + i;
+        } else if (strcmp(wdb->sql_cache[i].sql, sql) == 0) {
+            entry = wdb->sql_cache + i;
+            break;
+        }
+    }
+
+    if (entry) {
+        if (sqlite3_reset(entry->stmt) == SQLITE_OK && sqlite3_clear_bindings(entry->stmt) == SQLITE_OK) {
+            entry->used = ++wdb->sql_clock;
+            __atomic_add_fetch(&stmt_cached, 1, __ATOMIC_RELAXED);
+            return entry->stmt;
+        }
+
+        // Retry to prepare
+        mdebug1("DB(%s) sqlite3_reset(): %s", wdb->id, sqlite3_errmsg(wdb->db));
+        sqlite3_finalize(entry->stmt);
+    } else if (empty) {
+        entry = empty;
+    } else {
+        for (entry = wdb->sql_cache, i = 1; i < WDB_SQL_CACHE_SIZE; i++) {
+            if (wdb->sql_cache[i].used < entry->used) {
+                entry = wdb->sql_cache + i;
+            }
+        }
+
+        sqlite3_finalize(entry->stmt);
+        os_free(entry->sql);
+    }
+
+    if (sqlite3_prepare_v2(wdb->db, sql, -1, &entry->stmt, NULL) != SQLITE_OK) {
+        mdebug1("DB(%s) sqlite3_prepare_v2(): %s", wdb->id, sqlite3_errmsg(wdb->db));
+        mdebug2("DB(%s) SQL: %s", wdb->id, sql);
+        sqlite3_finalize(entry->stmt);
+        entry->stmt = NULL;
+        os_free(entry->sql);
+        return NULL;
+    }
+
+    if (!entry->sql) {
+        os_strdup(sql, entry->sql);
+    }
+
+    entry->used = ++wdb->sql_clock;
+    __atomic_add_fetch(&stmt_prepared, 1, __ATOMIC_RELAXED);
+    return entry->stmt;
+}
+
+void wdb_stmt_stats(unsigned long * prepared, unsigned long * cached) {
+    *prepared = __atomic_load_n(&stmt_prepared, __ATOMIC_RELAXED);
+    *cached = __atomic_load_n(&stmt_cached, __ATOMIC_RELAXED);
+}
+
 // Execute SQL script into an database
 int wdb_sql_exec(wdb_t *wdb, const char *sql_exec) {
     char *sql_error;
@@ -925,16 +1745,18 @@ cJSON *wdb_remove_multiple_agents(char *agent_list) {
 
                 // Close the database only if it was open
 
-                w_mutex_lock(&pool_mutex);
+                wdb_pool_shard_t * shard = wdb_pool_shard(agent);
+
+                w_mutex_lock(&shard->mutex);
 
-                wdb = (wdb_t *)OSHash_Get(open_dbs, agent);
+                wdb = (wdb_t *)OSHash_Get(shard->table, agent);
                 if (wdb) {
                     if (wdb_close(wdb, FALSE) < 0) {
                         result = "Can't close";
                     }
                 }
 
-                w_mutex_unlock(&pool_mutex);
+                w_mutex_unlock(&shard->mutex);
 
                 mdebug1("Removing db for agent '%s'", agent);
 
@@ -44,6 +44,24 @@
 
 #define WDB_RESPONSE_BEGIN_SIZE 16
 
+#define WDB_POOL_SHARDS 16
+
+// Buckets of the agent keepalive table, sized for large deployments
+#define WDB_KEEPALIVE_HASH_SIZE 16384
+
+// Maximum size of a chunk of streamed rows, to fit in the client's buffer
+#define WDB_STREAM_CHUNK (OS_MAXSTR - WDB_RESPONSE_BEGIN_SIZE)
+
+// Value types of the binary result format
+#define WDB_BIN_NULL    0
+#define WDB_BIN_INTEGER 1
+#define WDB_BIN_FLOAT   2
+#define WDB_BIN_TEXT    3
+#define WDB_BIN_BLOB    4
+
+// Maximum size of a binary result
+#define WDB_BIN_MAX_SIZE (64 * 1024 * 1024)
+
 #define WDB_DATABASE_LOGTAG ARGV0 ":wdb_agent"
 
 typedef enum wdb_stmt {
@@ -125,24 +143,60 @@ typedef enum wdb_stmt {
     WDB_STMT_PRAGMA_JOURNAL_WAL,
 } wdb_stmt;
 
+// Statements of queries built at run time, cached by each database
+#define WDB_SQL_CACHE_SIZE 16
+
+typedef struct wdb_sql_stmt_t {
+    char * sql;                 // Text of the query, or NULL if the entry is free
+    sqlite3_stmt * stmt;
+    unsigned long used;         // Clock of the last use, to evict the least recently used
+} wdb_sql_stmt_t;
+
 typedef struct wdb_t {
     sqlite3 * db;
     sqlite3_stmt * stmt[WDB_STMT_SIZE];
+    wdb_sql_stmt_t sql_cache[WDB_SQL_CACHE_SIZE];
+    unsigned long sql_clock;
     char * id;
     unsigned int refcount;
     unsigned int transaction:1;
+    int wal;                                // Journal is write-ahead: it can have a reader
+    struct wdb_t * reader;                  // Read-only connection, not locked by the writer
     time_t last;
     time_t transaction_begin_time;
     pthread_mutex_t mutex;
+    struct wdb_t * prev;
     struct wdb_t * next;
 } wdb_t;
 
+// Statements of the legacy FIM and PM tables
+typedef enum wdb_legacy_stmt {
+    WDB_LEGACY_FIND_FILE,
+    WDB_LEGACY_INSERT_FILE,
+    WDB_LEGACY_LAST_FIM,
+    WDB_LEGACY_INSERT_FIM,
+    WDB_LEGACY_INSERT_PM,
+    WDB_LEGACY_UPDATE_PM,
+    WDB_LEGACY_STMT_SIZE
+} wdb_legacy_stmt;
+
+// Legacy statements of an agent database, kept prepared while a whole file is loaded
+typedef struct wdb_legacy_t {
+    sqlite3 * db;
+    sqlite3_stmt * stmt[WDB_LEGACY_STMT_SIZE];
+} wdb_legacy_t;
+
 typedef struct wdb_config {
     int sock_queue_size;
     int worker_pool_size;
     int commit_time_min;
     int commit_time_max;
     int open_db_limit;
+    int maintenance_interval;
+    int maintenance_quiet;
+    int vacuum_pages;
+    int vacuum_ratio;
+    int read_replicas;
 } wdb_config;
 
 /// Enumeration of components supported by the integrity library.
@@ -154,18 +208,17 @@ typedef enum {
 extern sqlite3 *wdb_global;
 
 extern char *schema_global_sql;
+extern char *schema_global_upgrade_sql;
 extern char *schema_agents_sql;
 extern char *schema_upgrade_v1_sql;
 extern char *schema_upgrade_v2_sql;
 extern char *schema_upgrade_v3_sql;
 extern char *schema_upgrade_v4_sql;
 extern char *schema_upgrade_v5_sql;
+extern char *schema_upgrade_v6_sql;
 
 extern wdb_config config;
-extern pthread_mutex_t pool_mutex;
-extern wdb_t * db_pool;
 extern int db_pool_size;
-extern OSHash * open_dbs;
 
 /* Open global database. Returns 0 on success or -1 on failure. */
 int wdb_open_global();
@@ -188,6 +241,16 @@ sqlite3* wdb_open_agent(int id_agent, const char *name);
 // Open database for agent and store in DB pool. It returns a locked database or NULL
 wdb_t * wdb_open_agent2(int agent_id);
 
+// Open database for agent and store in DB pool. It returns a pinned, but not locked, database or NULL
+wdb_t * wdb_pin_agent2(int agent_id);
+
+// Unpin a database that was not locked
+void wdb_unpin(wdb_t * wdb);
+
+/* Get the locked reader of a database, if the query only reads. Returns NULL
+ * if the query must run on the database itself. The database must be pinned. */
+wdb_t * wdb_reader(wdb_t * wdb, const char * sql);
+
 /* Get the file offset. Returns -1 on error or NULL. */
 long wdb_get_agent_offset(int id_agent, int type);
 
@@ -203,17 +266,26 @@ int wdb_set_agent_status(int id_agent, int status);
 /* Get agent name from location string */
 char* wdb_agent_loc2name(const char *location);
 
+/* Start a set of legacy statements on a database. None is prepared until it's used. */
+void wdb_legacy_init(wdb_legacy_t *legacy, sqlite3 *db);
+
+/* Get a legacy statement, prepared at its first use and reset later. Returns NULL on error. */
+sqlite3_stmt * wdb_legacy_stmt_cache(wdb_legacy_t *legacy, wdb_legacy_stmt index, const char *sql);
+
+/* Finalize the legacy statements. The database is not closed. */
+void wdb_legacy_finalize(wdb_legacy_t *legacy);
+
 /* Find file: returns ID, or 0 if it doesn't exists, or -1 on error. */
-int wdb_find_file(sqlite3 *db, const char *path, int type);
+int wdb_find_file(wdb_legacy_t *legacy, const char *path, int type);
 
 /* Find file, Returns ID, or -1 on error. */
-int wdb_insert_file(sqlite3 *db, const char *path, int type);
+int wdb_insert_file(wdb_legacy_t *legacy, const char *path, int type);
 
 /* Get last event from file: returns WDB_FIM_*, or -1 on error. */
-int wdb_get_last_fim(sqlite3 *db, const char *path, int type);
+int wdb_get_last_fim(wdb_legacy_t *legacy, const char *path, int type);
 
 /* Insert FIM entry. Returns ID, or -1 on error. */
-int wdb_insert_fim(sqlite3 *db, int type, long timestamp, const char *f_name, const char *event, const sk_sum_t *sum);
+int wdb_insert_fim(wdb_legacy_t *legacy, int type, long timestamp, const char *f_name, const char *event, const sk_sum_t *sum);
 
 int wdb_syscheck_load(wdb_t * wdb, const char * file, char * output, size_t size);
 
@@ -231,10 +303,10 @@ int wdb_fim_update_entry(wdb_t * wdb, const char * file, const sk_sum_t * sum);
 int wdb_fim_delete(wdb_t * wdb, const char * file);
 
 /* Insert configuration assessment entry. Returns ID on success or -1 on error. */
-int wdb_insert_pm(sqlite3 *db, const rk_event_t *event);
+int wdb_insert_pm(wdb_legacy_t *legacy, const rk_event_t *event);
 
 /* Update configuration assessment last date. Returns number of affected rows on success or -1 on error. */
-int wdb_update_pm(sqlite3 *db, const rk_event_t *event);
+int wdb_update_pm(wdb_legacy_t *legacy, const rk_event_t *event);
 
 /* Look for a configuration assessment entry in Wazuh DB. Returns 1 if found, 0 if not, or -1 on error. (new) */
 int wdb_sca_find(wdb_t * wdb, int pm_id, char * output);
@@ -392,6 +464,9 @@ int wdb_create_file(const char *path, const char *source);
 /* Get an array containing the ID of every agent (except 0), ended with -1 */
 int* wdb_get_all_agents();
 
+/* Get the last keepalive of every agent (except 0) that has reported its information, indexed by "name-address" as the agent-info files. Returns NULL on error. */
+OSHash * wdb_get_agents_keepalive();
+
 /* Fill belongs table on start */
 int wdb_agent_belongs_first_time();
 
@@ -519,6 +594,14 @@ wdb_t * wdb_init(sqlite3 * db, const char * id);
 
 void wdb_destroy(wdb_t * wdb);
 
+// Create the shards of the database pool
+void wdb_pool_init();
+
+void wdb_pool_free();
+
+// Lock of the shard that holds a database
+pthread_mutex_t * wdb_pool_mutex(const char * id);
+
 void wdb_pool_append(wdb_t * wdb);
 
 void wdb_pool_remove(wdb_t * wdb);
@@ -533,6 +616,21 @@ int wdb_remove_database(const char * agent_id);
 
 cJSON * wdb_exec(sqlite3 * db, const char * sql);
 
+// Run a query through the statement cache of the database
+cJSON * wdb_exec2(wdb_t * wdb, const char * sql);
+
+// Run a query and stream its rows to a peer. The last chunk is written into output
+int wdb_exec_stream(wdb_t * wdb, const char * sql, int peer, char * output);
+
+// Run a query and send its result to a peer in the binary format
+int wdb_exec_binary(wdb_t * wdb, const char * sql, int peer, char * output);
+
+// Prepare the table of response formats of the peers
+void wdb_peer_init(int size);
+
+// Set the response format of a peer back to JSON, when it disconnects
+void wdb_peer_reset(int peer);
+
 // Execute SQL script into an database
 int wdb_sql_exec(wdb_t *wdb, const char *sql_exec);
 
@@ -540,11 +638,24 @@ int wdb_close(wdb_t * wdb, bool commit);
 
 void wdb_leave(wdb_t * wdb);
 
-wdb_t * wdb_pool_find_prev(wdb_t * wdb);
-
 int wdb_stmt_cache(wdb_t * wdb, int index);
 
-int wdb_parse(char * input, char * output);
+// Get a statement of a query built at run time from the cache of the database
+sqlite3_stmt * wdb_sql_cache(wdb_t * wdb, const char * sql);
+
+// Get the number of statements prepared, and reused from the caches
+void wdb_stmt_stats(unsigned long * prepared, unsigned long * cached);
+
+// Checkpoint and vacuum the open databases that are idle
+void wdb_maintenance();
+
+// Get the counters of the maintenance, with the pages of the databases found in the last pass
+void wdb_maintenance_stats(cJSON * stats);
+
+// Parse a request. The rows of a "stream" query are sent to peer, if it isn't -1
+int wdb_parse(char * input, char * output, int peer);
+
+int wdb_parse_batch(wdb_t * wdb, const char * sagent_id, char * input, char * output);
 
 int wdb_parse_syscheck(wdb_t * wdb, char * input, char * output);
 
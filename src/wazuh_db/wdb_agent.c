@@ -36,6 +36,7 @@ static const char *SQL_UPDATE_REG_OFFSET = "UPDATE agent SET reg_offset = ? WHER
 static const char *SQL_DELETE_AGENT = "DELETE FROM agent WHERE id = ?;";
 static const char *SQL_SELECT_AGENT = "SELECT name FROM agent WHERE id = ?;";
 static const char *SQL_SELECT_AGENTS = "SELECT id FROM agent WHERE id != 0;";
+static const char *SQL_SELECT_AGENTS_KEEPALIVE = "SELECT name, register_ip, last_keepalive FROM agent WHERE id != 0 AND last_keepalive IS NOT NULL AND version IS NOT NULL;";
 static const char *SQL_FIND_AGENT = "SELECT id FROM agent WHERE name = ? AND (register_ip = ? OR register_ip LIKE ?2 || '/_%');";
 static const char *SQL_FIND_GROUP = "SELECT id FROM `group` WHERE name = ?;";
 static const char *SQL_SELECT_GROUPS = "SELECT name FROM `group`;";
@@ -422,6 +423,57 @@ int* wdb_get_all_agents() {
     return array;
 }
 
+/* Get the last keepalive of every agent (except 0) that has reported its information, indexed by "name-address" as the agent-info files. Returns NULL on error. */
+OSHash * wdb_get_agents_keepalive() {
+    sqlite3_stmt *stmt = NULL;
+    OSHash *keepalives;
+    char key[OS_SIZE_512];
+    const char *name;
+    const char *ip;
+    time_t *keepalive;
+
+    if (wdb_open_global() < 0) {
+        return NULL;
+    }
+
+    if (wdb_prepare(wdb_global, SQL_SELECT_AGENTS_KEEPALIVE, -1, &stmt, NULL)) {
+        mdebug1("SQLite: %s", sqlite3_errmsg(wdb_global));
+        wdb_close_global();
+        return NULL;
+    }
+
+    if (keepalives = OSHash_Create(), !keepalives) {
+        merror("wdb_get_agents_keepalive(): memory error");
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+
+    OSHash_SetFreeDataPointer(keepalives, free);
+    OSHash_setSize(keepalives, WDB_KEEPALIVE_HASH_SIZE);
+
+    while (wdb_step(stmt) == SQLITE_ROW) {
+        name = (const char *)sqlite3_column_text(stmt, 0);
+        ip = (const char *)sqlite3_column_text(stmt, 1);
+
+        if (!name || !ip) {
+            continue;
+        }
+
+        // The file names don't have the netmask
+        snprintf(key, sizeof(key), "%s-%.*s", name, (int)strcspn(ip, "/"), ip);
+
+        os_malloc(sizeof(time_t), keepalive);
+        *keepalive = (time_t)sqlite3_column_int64(stmt, 2);
+
+        if (OSHash_Add(keepalives, key, keepalive) != 2) {
+            free(keepalive);
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    return keepalives;
+}
+
 /* Find agent by name and address. Returns id if success, -1 on failure or -2 if it has not been found. */
 int wdb_find_agent(const char *name, const char *ip) {
     sqlite3_stmt *stmt = NULL;
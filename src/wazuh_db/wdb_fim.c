@@ -20,12 +20,10 @@ static const char *SQL_DELETE_FILE = "DELETE FROM fim_file;";
 
 /* Find file: returns ID, or 0 if it doesn't exists, or -1 on error. */
 // LCOV_EXCL_START
-int wdb_insert_file(sqlite3 *db, const char *path, int type) {
-    sqlite3_stmt *stmt = NULL;
-    int result;
+int wdb_insert_file(wdb_legacy_t *legacy, const char *path, int type) {
+    sqlite3_stmt *stmt;
 
-    if (wdb_prepare(db, SQL_INSERT_FILE, -1, &stmt, NULL)) {
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
+    if (!(stmt = wdb_legacy_stmt_cache(legacy, WDB_LEGACY_INSERT_FILE, SQL_INSERT_FILE))) {
         return -1;
     }
 
@@ -33,23 +31,17 @@ int wdb_insert_file(sqlite3 *db, const char *path, int type) {
     sqlite3_bind_text(stmt, 2, type == WDB_FILE_TYPE_FILE ? "file" : "registry", -1, NULL);
 
     if (wdb_step(stmt) == SQLITE_DONE)
-        result = (int)sqlite3_last_insert_rowid(db);
-    else {
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
-        result = -1;
-    }
+        return (int)sqlite3_last_insert_rowid(legacy->db);
 
-    sqlite3_finalize(stmt);
-    return result;
+    mdebug1("SQLite: %s", sqlite3_errmsg(legacy->db));
+    return -1;
 }
 
 /* Find file, Returns ID, or -1 on error. */
-int wdb_find_file(sqlite3 *db, const char *path, int type) {
-    sqlite3_stmt *stmt = NULL;
-    int result;
+int wdb_find_file(wdb_legacy_t *legacy, const char *path, int type) {
+    sqlite3_stmt *stmt;
 
-    if (wdb_prepare(db, SQL_FIND_FILE, -1, &stmt, NULL)) {
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
+    if (!(stmt = wdb_legacy_stmt_cache(legacy, WDB_LEGACY_FIND_FILE, SQL_FIND_FILE))) {
         return -1;
     }
 
@@ -58,28 +50,21 @@ int wdb_find_file(sqlite3 *db, const char *path, int type) {
 
     switch (wdb_step(stmt)) {
     case SQLITE_ROW:
-        result = sqlite3_column_int(stmt, 0);
-        break;
+        return sqlite3_column_int(stmt, 0);
     case SQLITE_DONE:
-        result = 0;
-        break;
+        return 0;
     default:
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
-        result = -1;
+        mdebug1("SQLite: %s", sqlite3_errmsg(legacy->db));
+        return -1;
     }
-
-    sqlite3_finalize(stmt);
-    return result;
 }
 
 /* Get last state from file: returns WDB_FIM_*, or -1 on error. */
-int wdb_get_last_fim(sqlite3 *db, const char *path, int type) {
-    sqlite3_stmt *stmt = NULL;
+int wdb_get_last_fim(wdb_legacy_t *legacy, const char *path, int type) {
+    sqlite3_stmt *stmt;
     const char *event = NULL;
-    int result;
 
-    if (wdb_prepare(db, SQL_SELECT_LAST_EVENT, -1, &stmt, NULL)) {
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
+    if (!(stmt = wdb_legacy_stmt_cache(legacy, WDB_LEGACY_LAST_FIM, SQL_SELECT_LAST_EVENT))) {
         return -1;
     }
 
@@ -89,41 +74,34 @@ int wdb_get_last_fim(sqlite3 *db, const char *path, int type) {
     switch (wdb_step(stmt)) {
     case SQLITE_ROW:
         event = (const char*)sqlite3_column_text(stmt, 0);
-        result = !strcmp(event, "modified") ? WDB_FIM_MODIFIED : !strcmp(event, "added") ? WDB_FIM_ADDED : !strcmp(event, "readded") ? WDB_FIM_READDED : WDB_FIM_DELETED;
-        break;
+        return !strcmp(event, "modified") ? WDB_FIM_MODIFIED : !strcmp(event, "added") ? WDB_FIM_ADDED : !strcmp(event, "readded") ? WDB_FIM_READDED : WDB_FIM_DELETED;
     case SQLITE_DONE:
-        result = WDB_FIM_NOT_FOUND;
-        break;
+        return WDB_FIM_NOT_FOUND;
     default:
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
-        result = -1;
+        mdebug1("SQLite: %s", sqlite3_errmsg(legacy->db));
+        return -1;
     }
-
-    sqlite3_finalize(stmt);
-    return result;
 }
 
 /* Insert FIM entry. Returns ID, or -1 on error. */
-int wdb_insert_fim(sqlite3 *db, int type, long timestamp, const char *f_name, const char *event, const sk_sum_t *sum) {
-    sqlite3_stmt *stmt = NULL;
+int wdb_insert_fim(wdb_legacy_t *legacy, int type, long timestamp, const char *f_name, const char *event, const sk_sum_t *sum) {
+    sqlite3_stmt *stmt;
     int id_file;
-    int result;
 
-    if (wdb_prepare(db, SQL_INSERT_EVENT, -1, &stmt, NULL)) {
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
-        return -1;
-    }
-
-    switch ((id_file = wdb_find_file(db, f_name, type))) {
+    switch ((id_file = wdb_find_file(legacy, f_name, type))) {
     case -1:
         return -1;
 
     case 0:
-        if ((id_file = wdb_insert_file(db, f_name, type)) < 0) {
+        if ((id_file = wdb_insert_file(legacy, f_name, type)) < 0) {
             return -1;
         }
     }
 
+    if (!(stmt = wdb_legacy_stmt_cache(legacy, WDB_LEGACY_INSERT_FIM, SQL_INSERT_EVENT))) {
+        return -1;
+    }
+
     sqlite3_bind_int(stmt, 1, id_file);
     sqlite3_bind_text(stmt, 2, event, -1, NULL);
     sqlite3_bind_int64(stmt, 3, timestamp);
@@ -133,7 +111,7 @@ int wdb_insert_fim(sqlite3 *db, int type, long timestamp, const char *f_name, co
         snprintf(perm, 7, "%06o", sum->perm);
 
         sqlite3_bind_int64(stmt, 4, atol(sum->size));
-        sqlite3_bind_text(stmt, 5, (!sum->win_perm) ? perm : sum->win_perm, -1, NULL);
+        sqlite3_bind_text(stmt, 5, (!sum->win_perm) ? perm : sum->win_perm, -1, SQLITE_TRANSIENT);
 
         // UID and GID from Windows is 0. It should be NULL
         sqlite3_bind_int(stmt, 6, atoi(sum->uid));
@@ -170,24 +148,11 @@ int wdb_insert_fim(sqlite3 *db, int type, long timestamp, const char *f_name, co
             sqlite3_bind_text(stmt, 15, sum->attributes, -1, NULL);
         else // Old agents
             sqlite3_bind_null(stmt, 15); // attributes
-    } else {
-        sqlite3_bind_null(stmt, 4);
-        sqlite3_bind_null(stmt, 5);
-        sqlite3_bind_null(stmt, 6);
-        sqlite3_bind_null(stmt, 7);
-        sqlite3_bind_null(stmt, 8);
-        sqlite3_bind_null(stmt, 9);
-        sqlite3_bind_null(stmt, 10);
-        sqlite3_bind_null(stmt, 11);
-        sqlite3_bind_null(stmt, 12);
-        sqlite3_bind_null(stmt, 13);
-        sqlite3_bind_null(stmt, 14);
-        sqlite3_bind_null(stmt, 15);
-    }
-
-    result = wdb_step(stmt) == SQLITE_DONE ? (int)sqlite3_last_insert_rowid(db) : -1;
-    sqlite3_finalize(stmt);
-    return result;
+    }
+
+    // Unbound parameters are NULL
+
+    return wdb_step(stmt) == SQLITE_DONE ? (int)sqlite3_last_insert_rowid(legacy->db) : -1;
 }
 
 /* Delete FIM events of an agent. Returns number of affected rows on success or -1 on error. */
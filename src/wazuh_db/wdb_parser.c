@@ -13,7 +13,325 @@
 #include "external/cJSON/cJSON.h"
 
 
-int wdb_parse(char * input, char * output) {
+/* Run a query of a component on the database of an agent. The database is locked by the caller */
+/* Response format of each peer, by descriptor: 0 for JSON, 1 for binary */
+static unsigned char * peer_binary;
+static int peer_binary_size;
+
+void wdb_peer_init(int size) {
+    os_calloc(size, sizeof(unsigned char), peer_binary);
+    peer_binary_size = size;
+}
+
+void wdb_peer_reset(int peer) {
+    if (peer >= 0 && peer < peer_binary_size) {
+        peer_binary[peer] = 0;
+    }
+}
+
+static int wdb_peer_binary(int peer) {
+    return peer >= 0 && peer < peer_binary_size && peer_binary[peer];
+}
+
+static int wdb_parse_agent_query(wdb_t * wdb, const char * sagent_id, char * query, char * next, char * output) {
+    char * sql;
+    cJSON * data;
+    char * out;
+    int result = 0;
+
+    if (strcmp(query, "syscheck") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid FIM query syntax.", sagent_id);
+            mdebug2("DB(%s) FIM query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid Syscheck query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            result = wdb_parse_syscheck(wdb, next, output);
+        }
+    } else if (strcmp(query, "sca") == 0) {
+        if (!next) {
+            mdebug1("Invalid DB query syntax.");
+            mdebug2("DB query error near: %s", query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            result = wdb_parse_sca(wdb, next, output);
+            if (result < 0){
+                merror("Unable to update 'sca_check' table for agent '%s'", sagent_id);
+            } else {
+                result = 0;
+            }
+        }
+    } else if (strcmp(query, "netinfo") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_netinfo(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_netiface' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_netiface' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "netproto") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_netproto(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_netproto' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_netproto' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "netaddr") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_netaddr(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_netaddr' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_netaddr' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "osinfo") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_osinfo(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_osinfo' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_osinfo' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "hardware") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_hardware(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_hwinfo' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_hwinfo' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "port") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_ports(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_ports' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_ports' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "package") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_packages(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_programs' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_programs' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "hotfix") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_hotfixes(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_hotfixes' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_hotfixes' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "process") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_processes(wdb, next, output) == 0){
+                mdebug2("Updated 'sys_processes' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'sys_processes' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "ciscat") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            if (wdb_parse_ciscat(wdb, next, output) == 0){
+                mdebug2("Updated 'ciscat_results' table for agent '%s'", sagent_id);
+            } else {
+                merror("Unable to update 'ciscat_results' table for agent '%s'", sagent_id);
+            }
+        }
+    } else if (strcmp(query, "sql") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else {
+            sql = next;
+
+            // The rows are built and printed in an arena, released after copying the response
+            json_arena_open();
+
+            if (data = wdb_exec2(wdb, sql), data) {
+                out = cJSON_PrintUnformatted(data);
+                snprintf(output, OS_MAXSTR + 1, "ok %s", out);
+                json_arena_close();
+            } else {
+                json_arena_close();
+                mdebug1("DB(%s) Cannot execute SQL query.", sagent_id);
+                mdebug2("DB(%s) SQL query: %s", sagent_id, sql);
+                snprintf(output, OS_MAXSTR + 1, "err Cannot execute SQL query");
+                result = -1;
+            }
+        }
+    } else {
+        mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+        mdebug2("DB(%s) query error near: %s", sagent_id, query);
+        snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+        result = -1;
+    }
+
+    return result;
+}
+
+// Run a query that only reads: a stream, or an SQL query in the format of the peer
+static int wdb_parse_read(wdb_t * wdb, const char * sagent_id, char * query, char * next, char * output, int peer) {
+    int result = 0;
+
+    if (strcmp(query, "stream") == 0) {
+        if (!next) {
+            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+            mdebug2("DB(%s) query error near: %s", sagent_id, query);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+            result = -1;
+        } else if (peer < 0) {
+            snprintf(output, OS_MAXSTR + 1, "err Cannot stream the response");
+            result = -1;
+        } else if (result = wdb_exec_stream(wdb, next, peer, output), result < 0) {
+            mdebug1("DB(%s) Cannot stream SQL query.", sagent_id);
+            mdebug2("DB(%s) SQL query: %s", sagent_id, next);
+        }
+    } else if (next && wdb_peer_binary(peer)) {
+        if (result = wdb_exec_binary(wdb, next, peer, output), result < 0) {
+            mdebug1("DB(%s) Cannot execute SQL query.", sagent_id);
+            mdebug2("DB(%s) SQL query: %s", sagent_id, next);
+        }
+    } else {
+        result = wdb_parse_agent_query(wdb, sagent_id, query, next, output);
+    }
+
+    return result;
+}
+
+/* Run a batch of queries, one after another, in a single transaction.
+ * Each item is "<length> <component> <op> <payload>", and the items are separated by a space.
+ */
+int wdb_parse_batch(wdb_t * wdb, const char * sagent_id, char * input, char * output) {
+    char * item_output;
+    char * next;
+    char * query;
+    char * end = input + strlen(input);
+    size_t length;
+    size_t used;
+    int count = 0;
+    int failed = 0;
+
+    if (!wdb->transaction && wdb_begin2(wdb) < 0) {
+        mdebug1("DB(%s) Cannot begin transaction.", sagent_id);
+        snprintf(output, OS_MAXSTR + 1, "err Cannot begin transaction");
+        return -1;
+    }
+
+    os_malloc(OS_MAXSTR + 1, item_output);
+    used = (size_t)snprintf(output, OS_MAXSTR + 1, "ok [");
+
+    while (input < end) {
+        length = strtoul(input, &next, 10);
+
+        if (next == input || *next != ' ' || length > (size_t)(end - next - 1) || (next[1 + length] != '\0' && next[1 + length] != ' ')) {
+            mdebug1("DB(%s) Invalid batch query syntax.", sagent_id);
+            mdebug2("DB(%s) batch query error near: %.32s", sagent_id, input);
+            snprintf(output, OS_MAXSTR + 1, "err Invalid batch query syntax, near '%.32s'", input);
+            // The items already run are committed by the usual transaction timeout
+            os_free(item_output);
+            return -1;
+        }
+
+        query = next + 1;
+        input = query + length;
+        *input = '\0';
+
+        if (next = wstr_chr(query, ' '), next) {
+            *next++ = '\0';
+        }
+
+        // The commands that manage the database itself can't be batched
+        if (!strcmp(query, "remove") || !strcmp(query, "close") || !strcmp(query, "begin") || !strcmp(query, "commit") || !strcmp(query, "batch") || !strcmp(query, "stream")) {
+            mdebug1("DB(%s) Cannot run '%s' in a batch.", sagent_id, query);
+            snprintf(item_output, OS_MAXSTR + 1, "err Cannot run '%.32s' in a batch", query);
+        } else {
+            *item_output = '\0';
+            wdb_parse_agent_query(wdb, sagent_id, query, next, item_output);
+        }
+
+        /* Each item reports 0 on success or -1 on error, in order */
+        int status = (strncmp(item_output, "err", 3) == 0) ? -1 : 0;
+        failed += status < 0;
+
+        if (used < OS_MAXSTR - 4) {
+            used += (size_t)snprintf(output + used, OS_MAXSTR + 1 - used, "%s%d", count ? "," : "", status);
+        }
+
+        count++;
+        input += input < end;
+    }
+
+    os_free(item_output);
+    snprintf(output + used, OS_MAXSTR + 1 - used, "]");
+
+    if (wdb_commit2(wdb) < 0) {
+        mdebug1("DB(%s) Cannot end transaction.", sagent_id);
+        snprintf(output, OS_MAXSTR + 1, "err Cannot end transaction");
+        return -1;
+    }
+
+    mdebug2("DB(%s) Batch of %d queries run, %d failed.", sagent_id, count, failed);
+    return 0;
+}
+
+int wdb_parse(char * input, char * output, int peer) {
     char * actor;
     char * id;
     char * query;
@@ -22,6 +340,7 @@ int wdb_parse(char * input, char * output) {
     int agent_id;
     char sagent_id[64];
     wdb_t * wdb;
+    wdb_t * reader;
     cJSON * data;
     char * out;
     int result = 0;
@@ -67,7 +386,7 @@ int wdb_parse(char * input, char * output) {
 
         snprintf(sagent_id, sizeof(sagent_id), "%03d", agent_id);
 
-        if (wdb = wdb_open_agent2(agent_id), !wdb) {
+        if (wdb = wdb_pin_agent2(agent_id), !wdb) {
             merror("Couldn't open DB for agent '%s'", sagent_id);
             snprintf(output, OS_MAXSTR + 1, "err Couldn't open DB for agent %d", agent_id);
             return -1;
@@ -79,186 +398,22 @@ int wdb_parse(char * input, char * output) {
             *next++ = '\0';
         }
 
-        if (strcmp(query, "syscheck") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid FIM query syntax.", sagent_id);
-                mdebug2("DB(%s) FIM query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid Syscheck query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                result = wdb_parse_syscheck(wdb, next, output);
-            }
-        } else if (strcmp(query, "sca") == 0) {
-            if (!next) {
-                mdebug1("Invalid DB query syntax.");
-                mdebug2("DB query error near: %s", query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                result = wdb_parse_sca(wdb, next, output);
-                if (result < 0){
-                    merror("Unable to update 'sca_check' table for agent '%s'", sagent_id);
-                } else {
-                    result = 0;
-                }
-            }
-        } else if (strcmp(query, "netinfo") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_netinfo(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_netiface' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_netiface' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "netproto") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_netproto(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_netproto' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_netproto' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "netaddr") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_netaddr(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_netaddr' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_netaddr' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "osinfo") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_osinfo(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_osinfo' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_osinfo' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "hardware") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_hardware(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_hwinfo' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_hwinfo' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "port") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_ports(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_ports' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_ports' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "package") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_packages(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_programs' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_programs' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "hotfix") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_hotfixes(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_hotfixes' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_hotfixes' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "process") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_processes(wdb, next, output) == 0){
-                    mdebug2("Updated 'sys_processes' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'sys_processes' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "ciscat") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                if (wdb_parse_ciscat(wdb, next, output) == 0){
-                    mdebug2("Updated 'ciscat_results' table for agent '%s'", sagent_id);
-                } else {
-                    merror("Unable to update 'ciscat_results' table for agent '%s'", sagent_id);
-                }
-            }
-        } else if (strcmp(query, "sql") == 0) {
-            if (!next) {
-                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-                mdebug2("DB(%s) query error near: %s", sagent_id, query);
-                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-                result = -1;
-            } else {
-                sql = next;
+        // Queries that only read don't wait for the writer
+        if (next && (strcmp(query, "sql") == 0 || strcmp(query, "stream") == 0) && (reader = wdb_reader(wdb, next), reader)) {
+            result = wdb_parse_read(reader, sagent_id, query, next, output, peer);
+            w_mutex_unlock(&reader->mutex);
+            wdb_unpin(wdb);
+            return result;
+        }
 
-                if (data = wdb_exec(wdb->db, sql), data) {
-                    out = cJSON_PrintUnformatted(data);
-                    snprintf(output, OS_MAXSTR + 1, "ok %s", out);
-                    os_free(out);
-                    cJSON_Delete(data);
-                } else {
-                    mdebug1("DB(%s) Cannot execute SQL query.", sagent_id);
-                    mdebug2("DB(%s) SQL query: %s", sagent_id, sql);
-                    snprintf(output, OS_MAXSTR + 1, "err Cannot execute SQL query");
-                    result = -1;
-                }
-            }
-        } else if (strcmp(query, "remove") == 0) {
+        w_mutex_lock(&wdb->mutex);
+
+        if (strcmp(query, "remove") == 0) {
             wdb_leave(wdb);
             snprintf(output, OS_MAXSTR + 1, "ok");
             result = 0;
 
-            w_mutex_lock(&pool_mutex);
+            w_mutex_lock(wdb_pool_mutex(sagent_id));
 
             if (wdb_close(wdb, FALSE) < 0) {
                 mdebug1("DB(%s) Cannot close database.", sagent_id);
@@ -271,7 +426,7 @@ int wdb_parse(char * input, char * output) {
                 result = -1;
             }
 
-            w_mutex_unlock(&pool_mutex);
+            w_mutex_unlock(wdb_pool_mutex(sagent_id));
             return result;
         } else if (strcmp(query, "begin") == 0) {
             if (wdb_begin2(wdb) < 0) {
@@ -291,7 +446,7 @@ int wdb_parse(char * input, char * output) {
             }
         } else if (strcmp(query, "close") == 0) {
             wdb_leave(wdb);
-            w_mutex_lock(&pool_mutex);
+            w_mutex_lock(wdb_pool_mutex(sagent_id));
 
             if (wdb_close(wdb, TRUE) < 0) {
                 mdebug1("DB(%s) Cannot close database.", sagent_id);
@@ -302,19 +457,47 @@ int wdb_parse(char * input, char * output) {
                 result = 0;
             }
 
-            w_mutex_unlock(&pool_mutex);
+            w_mutex_unlock(wdb_pool_mutex(sagent_id));
             return result;
+        } else if (strcmp(query, "stream") == 0 || strcmp(query, "sql") == 0) {
+            result = wdb_parse_read(wdb, sagent_id, query, next, output, peer);
+        } else if (strcmp(query, "batch") == 0) {
+            if (!next) {
+                mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
+                mdebug2("DB(%s) query error near: %s", sagent_id, query);
+                snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
+                result = -1;
+            } else {
+                result = wdb_parse_batch(wdb, sagent_id, next, output);
+            }
         } else {
-            mdebug1("DB(%s) Invalid DB query syntax.", sagent_id);
-            mdebug2("DB(%s) query error near: %s", sagent_id, query);
-            snprintf(output, OS_MAXSTR + 1, "err Invalid DB query syntax, near '%.32s'", query);
-            result = -1;
+            result = wdb_parse_agent_query(wdb, sagent_id, query, next, output);
         }
         wdb_leave(wdb);
         return result;
     } else if (strcmp(actor, "wazuhdb") == 0) {
         query = next;
 
+        if (strcmp(query, "stats") == 0) {
+            unsigned long prepared;
+            unsigned long cached;
+            cJSON * statements;
+
+            wdb_stmt_stats(&prepared, &cached);
+            data = cJSON_CreateObject();
+            cJSON_AddItemToObject(data, "statements", statements = cJSON_CreateObject());
+            cJSON_AddNumberToObject(statements, "prepared", prepared);
+            cJSON_AddNumberToObject(statements, "cached", cached);
+            cJSON_AddItemToObject(data, "maintenance", statements = cJSON_CreateObject());
+            wdb_maintenance_stats(statements);
+
+            out = cJSON_PrintUnformatted(data);
+            snprintf(output, OS_MAXSTR + 1, "ok %s", out);
+            os_free(out);
+            cJSON_Delete(data);
+            return 0;
+        }
+
         if (next = wstr_chr(query, ' '), !next) {
             mdebug1("Invalid DB query syntax.");
             mdebug2("DB query error near: %s", query);
@@ -329,6 +512,18 @@ int wdb_parse(char * input, char * output) {
             snprintf(output, OS_MAXSTR + 1, "ok %s", out);
             os_free(out);
             cJSON_Delete(data);
+        } else if (strcmp(query, "format") == 0) {
+            if (strcmp(next, "binary") != 0 && strcmp(next, "json") != 0) {
+                mdebug1("Invalid response format: %s", next);
+                snprintf(output, OS_MAXSTR + 1, "err Invalid response format, near '%.32s'", next);
+                return -1;
+            } else if (peer < 0 || peer >= peer_binary_size) {
+                snprintf(output, OS_MAXSTR + 1, "err Cannot set the response format");
+                return -1;
+            }
+
+            peer_binary[peer] = strcmp(next, "binary") == 0;
+            snprintf(output, OS_MAXSTR + 1, "ok");
         } else {
             mdebug1("Invalid DB query syntax.");
             mdebug2("DB query error near: %s", query);
@@ -363,7 +558,11 @@ int wdb_parse(char * input, char * output) {
             } else {
                 sql = next;
 
-                if (data = wdb_exec(wdb->db, sql), data) {
+                if (wdb_peer_binary(peer)) {
+                    if (result = wdb_exec_binary(wdb, sql, peer, output), result < 0) {
+                        mdebug2("Mitre DB SQL query: %s", sql);
+                    }
+                } else if (data = wdb_exec2(wdb, sql), data) {
                     out = cJSON_PrintUnformatted(data);
                     snprintf(output, OS_MAXSTR + 1, "ok %s", out);
                     os_free(out);
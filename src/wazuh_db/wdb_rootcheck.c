@@ -22,14 +22,13 @@ static char* get_pci_dss(const char *string);
 char* get_cis(const char *string);
 
 /* Insert configuration assessment entry. Returns ID on success or -1 on error. */
-int wdb_insert_pm(sqlite3 *db, const rk_event_t *event) {
-    sqlite3_stmt *stmt = NULL;
+int wdb_insert_pm(wdb_legacy_t *legacy, const rk_event_t *event) {
+    sqlite3_stmt *stmt;
     int result;
     char *pci_dss;
     char *cis;
 
-    if (wdb_prepare(db, SQL_INSERT_PM, -1, &stmt, NULL)) {
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
+    if (!(stmt = wdb_legacy_stmt_cache(legacy, WDB_LEGACY_INSERT_PM, SQL_INSERT_PM))) {
         return -1;
     }
 
@@ -42,29 +41,24 @@ int wdb_insert_pm(sqlite3 *db, const rk_event_t *event) {
     sqlite3_bind_text(stmt, 4, pci_dss, -1, NULL);
     sqlite3_bind_text(stmt, 5, cis, -1, NULL);
 
-    result = wdb_step(stmt) == SQLITE_DONE ? (int)sqlite3_last_insert_rowid(db) : -1;
-    sqlite3_finalize(stmt);
+    result = wdb_step(stmt) == SQLITE_DONE ? (int)sqlite3_last_insert_rowid(legacy->db) : -1;
     free(pci_dss);
     free(cis);
     return result;
 }
 
 /* Update configuration assessment last date. Returns number of affected rows on success or -1 on error. */
-int wdb_update_pm(sqlite3 *db, const rk_event_t *event) {
-    sqlite3_stmt *stmt = NULL;
-    int result;
+int wdb_update_pm(wdb_legacy_t *legacy, const rk_event_t *event) {
+    sqlite3_stmt *stmt;
 
-    if (wdb_prepare(db, SQL_UPDATE_PM, -1, &stmt, NULL)) {
-        mdebug1("SQLite: %s", sqlite3_errmsg(db));
+    if (!(stmt = wdb_legacy_stmt_cache(legacy, WDB_LEGACY_UPDATE_PM, SQL_UPDATE_PM))) {
         return -1;
     }
 
     sqlite3_bind_int(stmt, 1, event->date_last);
     sqlite3_bind_text(stmt, 2, event->log, -1, NULL);
 
-    result = wdb_step(stmt) == SQLITE_DONE ? sqlite3_changes(db) : -1;
-    sqlite3_finalize(stmt);
-    return result;
+    return wdb_step(stmt) == SQLITE_DONE ? sqlite3_changes(legacy->db) : -1;
 }
 
 /* Delete PM events of an agent. Returns 0 on success or -1 on error. */
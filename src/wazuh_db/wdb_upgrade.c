@@ -27,6 +27,7 @@ wdb_t * wdb_upgrade(wdb_t *wdb) {
         schema_upgrade_v3_sql,
         schema_upgrade_v4_sql,
         schema_upgrade_v5_sql,
+        schema_upgrade_v6_sql,
     };
 
     char db_version[OS_SIZE_256 + 2];
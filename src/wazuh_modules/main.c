@@ -95,11 +95,16 @@ int main(int argc, char **argv)
         if (CreateThreadJoinable(&cur_module->thread, cur_module->context->start, cur_module->data) < 0) {
             merror_exit("CreateThreadJoinable() for '%s': %s", cur_module->tag, strerror(errno));
         }
+
+        w_thread_register(cur_module->thread, "wm-%s", cur_module->tag);
         mdebug2("Created new thread for the '%s' module.", cur_module->tag);
     }
 
     // Start com request thread
-    w_create_thread(wmcom_main, NULL);
+    w_create_named_thread(wmcom_main, NULL, "wm-com");
+
+    // Serve the metrics, if enabled
+    w_metrics_http_start("wazuh_modules");
 
     // Wait for threads
 
@@ -70,6 +70,7 @@
 #define TAG_ARCH        1022
 
 #define WM_SYS_DEF_INTERVAL 3600            // Default cycle interval (1 hour)
+#define WM_SYS_RESYNC 86400                 // Maximum time between full inventories of a category (1 day)
 #define WM_SYS_LOGTAG ARGV0 ":syscollector" // Tag for log messages
 #define WM_SYS_IF_FILE "/etc/network/interfaces"
 #define WM_SYS_IF_DIR_RH "/etc/sysconfig/network-scripts/"
@@ -78,6 +79,9 @@
 #define WM_SYS_HW_DIR   "/sys/class/dmi/id"
 #define WM_SYS_NET_DIR  "/proc/net/"
 #define RPM_DATABASE    "/var/lib/rpm/Packages"
+#define RPM_SQLITE_DATABASE "/var/lib/rpm/rpmdb.sqlite"
+#define DPKG_STATUS     "/var/lib/dpkg/status"
+#define WM_SYS_PACKAGES_BATCH OS_SIZE_20480 // Maximum size of the packages of a message
 
 /* MAC package search paths */
 
@@ -120,6 +124,14 @@ typedef struct wm_sys_state_t {
     time_t next_time;                       // Absolute time for next scan
 } wm_sys_state_t;
 
+/* Digest of the last inventory of a category that was sent */
+typedef struct wm_sys_digest_t {
+    uint64_t hash;                          // Hash of the messages, without their scan ID and time
+    unsigned int count;                     // Number of messages
+    time_t sent;                            // Time of the last full inventory sent
+    uint64_t source;                        // Fingerprint of the sources of the last inventory, 0 if unknown
+} wm_sys_digest_t;
+
 typedef struct wm_sys_t {
     unsigned int interval;                  // Time interval between cycles (seconds)
     wm_sys_flags_t flags;                   // Flag bitfield
@@ -251,6 +263,15 @@ int getIfaceslist(char **ifaces_list, struct ifaddrs *ifaddr);
 
 // Generate a random ID
 int wm_sys_get_random_id();
+
+// Send an inventory message, or hold it while the scan of its category is held
+int sys_send(int usec, int queue, const char *message, const char *locmsg, char loc);
+// Hold the messages of the next scan of the category whose last inventory is given
+void sys_scan_hold(wm_sys_digest_t *last);
+// Report the fingerprint of the sources of the scan held. Returns 1 if they didn't change and the scan can be skipped
+int sys_scan_source(uint64_t source);
+// Send the messages held, unless they are the same as the last inventory sent
+void sys_scan_release(wm_sys_digest_t *last, const char *category);
 // Initialize hw_info struct values
 void init_hw_info(hw_info *info);
 
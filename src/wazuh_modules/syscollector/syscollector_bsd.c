@@ -95,7 +95,7 @@ void sys_packages_bsd(int queue_fd, const char* LOCATION){
                 if (string = sys_parse_pkg(path, timestamp, random_id), string) {
 
                     mtdebug2(WM_SYS_LOGTAG, "Sending '%s'", string);
-                    wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+                    sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
                     free(string);
 
                 } else
@@ -122,7 +122,7 @@ void sys_packages_bsd(int queue_fd, const char* LOCATION){
                 if (string = sys_parse_pkg(path, timestamp, random_id), string) {
 
                     mtdebug2(WM_SYS_LOGTAG, "sys_packages_bsd() sending '%s'", string);
-                    wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+                    sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
                     free(string);
 
                 } else
@@ -199,7 +199,7 @@ void sys_packages_bsd(int queue_fd, const char* LOCATION){
             char *string;
             string = cJSON_PrintUnformatted(object);
             mtdebug2(WM_SYS_LOGTAG, "sys_packages_bsd() sending '%s'", string);
-            wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+            sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
             cJSON_Delete(object);
             free(string);
         }
@@ -214,7 +214,7 @@ void sys_packages_bsd(int queue_fd, const char* LOCATION){
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_packages_bsd() sending '%s'", string);
-    wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
@@ -487,7 +487,7 @@ void sys_packages_bsd(int queue_fd, const char* LOCATION){
             string = cJSON_PrintUnformatted(object);
 
             mtdebug2(WM_SYS_LOGTAG, "sys_packages_bsd() sending '%s'", string);
-            wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+            sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
             cJSON_Delete(object);
 
             free(string);
@@ -509,7 +509,7 @@ void sys_packages_bsd(int queue_fd, const char* LOCATION){
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_packages_bsd() sending '%s'", string);
-    wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
@@ -842,7 +842,7 @@ void sys_network_bsd(int queue_fd, const char* LOCATION){
         /* Send interface data in JSON format */
         string = cJSON_PrintUnformatted(object);
         mtdebug2(WM_SYS_LOGTAG, "sys_network_bsd() sending '%s'", string);
-        wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+        sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
         cJSON_Delete(object);
         free(string);
     }
@@ -864,7 +864,7 @@ void sys_network_bsd(int queue_fd, const char* LOCATION){
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_network_bsd() sending '%s'", string);
-    wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
@@ -1500,7 +1500,7 @@ void sys_ports_mac(int queue_fd, const char* WM_SYS_LOCATION, int check_all) {
 
             char *string = cJSON_PrintUnformatted(object);
             mtdebug2(WM_SYS_LOGTAG, "sys_ports_mac() sending '%s'", string);
-            wm_sendmsg(usec, queue_fd, string, WM_SYS_LOCATION, SYSCOLLECTOR_MQ);
+            sys_send(usec, queue_fd, string, WM_SYS_LOCATION, SYSCOLLECTOR_MQ);
             os_free(string);
             cJSON_Delete(object);
         }
@@ -1638,7 +1638,7 @@ void sys_proc_mac(int queue_fd, const char* LOCATION){
     cJSON_ArrayForEach(item, proc_array) {
         char *string = cJSON_PrintUnformatted(item);
         mtdebug2(WM_SYS_LOGTAG, "sys_proc_mac() sending '%s'", string);
-        wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+        sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
         os_free(string);
     }
 
@@ -1651,7 +1651,7 @@ void sys_proc_mac(int queue_fd, const char* LOCATION){
 
     char *end_msg = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_proc_mac() sending '%s'", end_msg);
-    wm_sendmsg(usec, queue_fd, end_msg, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, queue_fd, end_msg, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     os_free(end_msg);
 }
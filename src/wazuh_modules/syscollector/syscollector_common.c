@@ -32,6 +32,29 @@ const wm_context WM_SYS_CONTEXT = {
 int queue_fd;                                   // Output queue file descriptor
 #endif
 
+/* Messages of the scan of a category, held until it ends */
+typedef struct wm_sys_held_t {
+    int usec;
+    int queue;
+    char *message;
+} wm_sys_held_t;
+
+static struct {
+    int active;
+    int skipped;                                // The sources didn't change, so the scan was skipped
+    wm_sys_digest_t *last;                      // Last inventory of the category sent
+    uint64_t source;                            // Fingerprint of the sources of the scan, 0 if unknown
+    const char *locmsg;
+    char loc;
+    wm_sys_held_t *messages;
+    unsigned int count;
+    unsigned int size;
+} held;
+
+static wm_sys_digest_t programs_digest;         // Last inventory of packages sent
+static wm_sys_digest_t hotfixes_digest;         // Last inventory of hotfixes sent
+static wm_sys_digest_t ports_digest;            // Last inventory of ports sent
+
 static void wm_sys_setup(wm_sys_t *_sys);       // Setup module
 static void wm_sys_check();                     // Check configuration, disable flag
 #ifndef WIN32
@@ -117,6 +140,8 @@ void* wm_sys_main(wm_sys_t *sys) {
 
         /* Installed programs inventory */
         if (sys->flags.programinfo){
+            sys_scan_hold(&programs_digest);
+
             #if defined(WIN32)
                 sys_programs_windows(WM_SYS_LOCATION);
             #elif defined(__linux__)
@@ -127,12 +152,16 @@ void* wm_sys_main(wm_sys_t *sys) {
                 sys->flags.programinfo = 0;
                 mtwarn(WM_SYS_LOGTAG, "Packages inventory is not available for this OS version.");
             #endif
+
+            sys_scan_release(&programs_digest, "packages");
         }
 
         /* Installed hotfixes inventory */
         if (sys->flags.hotfixinfo) {
             #ifdef WIN32
+                sys_scan_hold(&hotfixes_digest);
                 sys_hotfixes(WM_SYS_LOCATION);
+                sys_scan_release(&hotfixes_digest, "hotfixes");
             #endif
         }
         /* Opened ports inventory */
@@ -140,7 +169,9 @@ void* wm_sys_main(wm_sys_t *sys) {
             #if defined(WIN32)
                 sys_ports_windows(WM_SYS_LOCATION, sys->flags.allports);
             #elif defined(__linux__)
+                sys_scan_hold(&ports_digest);
                 sys_ports_linux(queue_fd, WM_SYS_LOCATION, sys->flags.allports);
+                sys_scan_release(&ports_digest, "ports");
             #elif defined(__MACH__)
                 sys_ports_mac(queue_fd, WM_SYS_LOCATION, sys->flags.allports);
             #else
@@ -322,3 +353,131 @@ int wm_sys_get_random_id() {
 
     return ID;
 }
+
+/* Hash a message, skipping its scan ID and time, that change on each scan */
+static uint64_t sys_digest(uint64_t hash, const char *message) {
+    const char *p;
+
+    for (p = message; *p; p++) {
+        if (*p == '"' && (strncmp(p, "\"ID\":", 5) == 0 || strncmp(p, "\"timestamp\":", 12) == 0)) {
+            p = strchr(p, ':') + 1;
+
+            if (*p == '"') {
+                if (p = strchr(p + 1, '"'), !p) {
+                    break;
+                }
+            } else {
+                while (p[1] && p[1] != ',' && p[1] != '}') {
+                    p++;
+                }
+            }
+
+            continue;
+        }
+
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+int sys_send(int usec, int queue, const char *message, const char *locmsg, char loc) {
+    if (!held.active) {
+        return wm_sendmsg(usec, queue, message, locmsg, loc);
+    }
+
+    if (held.count == held.size) {
+        held.size = held.size ? held.size * 2 : 256;
+        os_realloc(held.messages, held.size * sizeof(wm_sys_held_t), held.messages);
+    }
+
+    held.messages[held.count].usec = usec;
+    held.messages[held.count].queue = queue;
+    os_strdup(message, held.messages[held.count].message);
+    held.count++;
+
+    held.locmsg = locmsg;
+    held.loc = loc;
+    return 0;
+}
+
+void sys_scan_hold(wm_sys_digest_t *last) {
+    held.active = 1;
+    held.skipped = 0;
+    held.last = last;
+    held.source = 0;
+    held.count = 0;
+}
+
+/* A scanner that can tell cheaply whether its sources changed (e.g. by the
+ * time they were modified) reports their fingerprint before reading them. If
+ * it's the same as the one of the last inventory sent, the scan is skipped. */
+int sys_scan_source(uint64_t source) {
+    if (!held.active) {
+        return 0;
+    }
+
+    held.source = source;
+
+    if (source && source == held.last->source && held.last->count > 0 && time(NULL) - held.last->sent < WM_SYS_RESYNC) {
+        held.skipped = 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Inventories of packages and hotfixes rarely change, but each one that is
+ * sent is rewritten into the agent database. The messages of these scans are
+ * held, and dropped if they are the same as the last inventory sent. The
+ * manager keeps the previous rows. A full inventory is still sent at least
+ * once every WM_SYS_RESYNC seconds, in case the manager lost it. */
+void sys_scan_release(wm_sys_digest_t *last, const char *category) {
+    uint64_t hash = 14695981039346656037ULL;
+    time_t now = time(NULL);
+    unsigned int i;
+    int failed = 0;
+
+    held.active = 0;
+
+    if (held.skipped) {
+        mtdebug1(WM_SYS_LOGTAG, "The sources of the inventory of %s didn't change. Skipping it.", category);
+        held.count = 0;
+        return;
+    }
+
+    for (i = 0; i < held.count; i++) {
+        hash = sys_digest(hash, held.messages[i].message);
+    }
+
+    if (held.count > 0 && hash == last->hash && held.count == last->count && now - last->sent < WM_SYS_RESYNC) {
+        mtdebug1(WM_SYS_LOGTAG, "The inventory of %s didn't change. Skipping it.", category);
+
+        for (i = 0; i < held.count; i++) {
+            os_free(held.messages[i].message);
+        }
+
+        last->source = held.source;
+    } else {
+        for (i = 0; i < held.count; i++) {
+            if (wm_sendmsg(held.messages[i].usec, held.messages[i].queue, held.messages[i].message, held.locmsg, held.loc) < 0) {
+                failed = 1;
+            }
+
+            os_free(held.messages[i].message);
+        }
+
+        // If the scan or any message failed, send the next one anyway
+        if (held.count > 0 && !failed) {
+            last->hash = hash;
+            last->count = held.count;
+            last->sent = now;
+            last->source = held.source;
+        } else {
+            last->source = 0;
+        }
+    }
+
+    held.count = 0;
+}
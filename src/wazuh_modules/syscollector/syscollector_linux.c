@@ -24,8 +24,12 @@
 #include <net/if_arp.h>
 #include <netinet/tcp.h>
 #include <linux/if_packet.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
 #include "external/procps/readproc.h"
 #include "external/libdb/build_unix/db.h"
+#include "external/sqlite/sqlite3.h"
 
 hw_info *get_system_linux();                    // Get system information
 char* get_serial_number();                      // Get Motherboard serial number
@@ -83,9 +87,149 @@ char* get_port_state(int state){
     return port_state;
 }
 
+/* Context of a scan of opened ports */
+typedef struct ports_scan {
+    int queue_fd;
+    const char *LOCATION;
+    int random_id;
+    const char *timestamp;
+    int check_all;
+    int usec;                           // Time to sleep after each message sent
+} ports_scan;
+
+// Send an opened port. The state is only reported for TCP sockets
+
+static void sys_port_send(const ports_scan *scan, const char *protocol, const char *laddress, int local_port, const char *raddress,
+                          int rem_port, unsigned long txq, unsigned long rxq, unsigned long inode, int state) {
+
+    int listening = 0;
+
+    cJSON *object = cJSON_CreateObject();
+    cJSON *port = cJSON_CreateObject();
+    cJSON_AddStringToObject(object, "type", "port");
+    cJSON_AddNumberToObject(object, "ID", scan->random_id);
+    cJSON_AddStringToObject(object, "timestamp", scan->timestamp);
+    cJSON_AddItemToObject(object, "port", port);
+    cJSON_AddStringToObject(port, "protocol", protocol);
+    cJSON_AddStringToObject(port, "local_ip", laddress);
+    cJSON_AddNumberToObject(port, "local_port", local_port);
+    cJSON_AddStringToObject(port, "remote_ip", raddress);
+    cJSON_AddNumberToObject(port, "remote_port", rem_port);
+    cJSON_AddNumberToObject(port, "tx_queue", txq);
+    cJSON_AddNumberToObject(port, "rx_queue", rxq);
+    cJSON_AddNumberToObject(port, "inode", inode);
+
+    if (!strncmp(protocol, "tcp", 3)){
+        char *port_state;
+        port_state = get_port_state(state);
+        cJSON_AddStringToObject(port, "state", port_state);
+        if (!strcmp(port_state, "listening")) {
+            listening = 1;
+        }
+        free(port_state);
+    }
+
+    if (scan->check_all || listening) {
+
+        char *string;
+        string = cJSON_PrintUnformatted(object);
+        mtdebug2(WM_SYS_LOGTAG, "sys_ports_linux() sending '%s'", string);
+        sys_send(scan->usec, scan->queue_fd, string, scan->LOCATION, SYSCOLLECTOR_MQ);
+        free(string);
+    }
+
+    cJSON_Delete(object);
+}
+
+/* Dump the sockets of a protocol through NETLINK_SOCK_DIAG. The kernel
+ * filters them by state and sends them in binary, so neither the closed
+ * sockets nor the text of /proc/net have to be processed. Returns -1 if
+ * the dump isn't available, so the caller falls back to /proc/net. */
+
+static int get_diag_ports(const ports_scan *scan, const char *protocol, int family, int ip_protocol, char *buffer, size_t size) {
+
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+    } request;
+    struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+    char laddress[INET6_ADDRSTRLEN];
+    char raddress[INET6_ADDRSTRLEN];
+    int count = 0;
+    int done = 0;
+    int error = 0;
+    int fd;
+
+    if (fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG), fd < 0) {
+        mtdebug1(WM_SYS_LOGTAG, "Unable to open a netlink socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.nlh.nlmsg_len = sizeof(request);
+    request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.req.sdiag_family = family;
+    request.req.sdiag_protocol = ip_protocol;
+    request.req.idiag_states = (ip_protocol == IPPROTO_TCP && !scan->check_all) ? 1 << TCP_LISTEN : ~0U;
+
+    if (sendto(fd, &request, sizeof(request), 0, (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+        mtdebug1(WM_SYS_LOGTAG, "Unable to request the %s sockets: %s", protocol, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    while (!done && !error) {
+        int length = recv(fd, buffer, size, 0);
+        struct nlmsghdr *nlh;
+
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            mtdebug1(WM_SYS_LOGTAG, "Unable to read the %s sockets: %s", protocol, strerror(errno));
+            break;
+        }
+
+        if (length == 0) {
+            break;
+        }
+
+        for (nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, length); nlh = NLMSG_NEXT(nlh, length)) {
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                done = 1;
+                break;
+            }
+
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                // E.g. the module for the UDP sockets isn't loaded
+                mtdebug1(WM_SYS_LOGTAG, "The %s sockets can't be dumped through netlink.", protocol);
+                error = 1;
+                break;
+            }
+
+            struct inet_diag_msg *msg = NLMSG_DATA(nlh);
+
+            // Both families keep the addresses in network byte order, as /proc/net does
+            inet_ntop(family, msg->id.idiag_src, laddress, sizeof(laddress));
+            inet_ntop(family, msg->id.idiag_dst, raddress, sizeof(raddress));
+
+            sys_port_send(scan, protocol, laddress, ntohs(msg->id.idiag_sport), raddress, ntohs(msg->id.idiag_dport),
+                          msg->idiag_wqueue, msg->idiag_rqueue, msg->idiag_inode, msg->idiag_state);
+            count++;
+        }
+    }
+
+    close(fd);
+
+    // Sockets already sent are not read again from /proc/net
+    return (done || count > 0) ? 0 : -1;
+}
+
 // Get opened ports related to IPv4 sockets
 
-void get_ipv4_ports(int queue_fd, const char* LOCATION, const char* protocol, int random_id, const char* timestamp, int check_all){
+static void get_ipv4_ports(const ports_scan *scan, const char* protocol){
 
     unsigned long rxq, txq, time_len, retr, inode;
     int local_port, rem_port, d, state, uid, timer_run, timeout;
@@ -96,10 +240,6 @@ void get_ipv4_ports(int queue_fd, const char* LOCATION, const char* protocol, in
     char file[OS_MAXSTR];
     FILE *fp;
     int first_line = 1;
-    int listening;
-
-    // Define time to sleep between messages sent
-    int usec = 1000000 / wm_max_eps;
 
     snprintf(file, OS_MAXSTR, "%s%s", WM_SYS_NET_DIR, protocol);
 
@@ -112,8 +252,6 @@ void get_ipv4_ports(int queue_fd, const char* LOCATION, const char* protocol, in
 
         while(fgets(read_buff, OS_MAXSTR - 1, fp) != NULL){
 
-            listening = 0;
-
             if (first_line){
                 first_line = 0;
                 continue;
@@ -130,43 +268,7 @@ void get_ipv4_ports(int queue_fd, const char* LOCATION, const char* protocol, in
             snprintf(laddress, NI_MAXHOST, "%s", inet_ntoa(local));
             snprintf(raddress, NI_MAXHOST, "%s", inet_ntoa(remote));
 
-            cJSON *object = cJSON_CreateObject();
-            cJSON *port = cJSON_CreateObject();
-            cJSON_AddStringToObject(object, "type", "port");
-            cJSON_AddNumberToObject(object, "ID", random_id);
-            cJSON_AddStringToObject(object, "timestamp", timestamp);
-            cJSON_AddItemToObject(object, "port", port);
-            cJSON_AddStringToObject(port, "protocol", protocol);
-            cJSON_AddStringToObject(port, "local_ip", laddress);
-            cJSON_AddNumberToObject(port, "local_port", local_port);
-            cJSON_AddStringToObject(port, "remote_ip", raddress);
-            cJSON_AddNumberToObject(port, "remote_port", rem_port);
-            cJSON_AddNumberToObject(port, "tx_queue", txq);
-            cJSON_AddNumberToObject(port, "rx_queue", rxq);
-            cJSON_AddNumberToObject(port, "inode", inode);
-
-            if (!strncmp(protocol, "tcp", 3)){
-                char *port_state;
-                port_state = get_port_state(state);
-                cJSON_AddStringToObject(port, "state", port_state);
-                if (!strcmp(port_state, "listening")) {
-                    listening = 1;
-                }
-                free(port_state);
-            }
-
-            if (check_all || listening) {
-
-                char *string;
-                string = cJSON_PrintUnformatted(object);
-                mtdebug2(WM_SYS_LOGTAG, "sys_ports_linux() sending '%s'", string);
-                wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
-                cJSON_Delete(object);
-                free(string);
-
-            } else
-                cJSON_Delete(object);
-
+            sys_port_send(scan, protocol, laddress, local_port, raddress, rem_port, txq, rxq, inode, state);
         }
         fclose(fp);
     }else{
@@ -178,7 +280,7 @@ void get_ipv4_ports(int queue_fd, const char* LOCATION, const char* protocol, in
 
 // Get opened ports related to IPv6 sockets
 
-void get_ipv6_ports(int queue_fd, const char* LOCATION, const char* protocol, int random_id, const char * timestamp, int check_all){
+static void get_ipv6_ports(const ports_scan *scan, const char* protocol){
 
     unsigned long rxq, txq, time_len, retr, inode;
     int local_port, rem_port, d, state, uid, timer_run, timeout;
@@ -191,10 +293,6 @@ void get_ipv6_ports(int queue_fd, const char* LOCATION, const char* protocol, in
     char file[PATH_LENGTH];
     FILE *fp;
     int first_line = 1;
-    int listening;
-
-    // Define time to sleep between messages sent
-    int usec = 1000000 / wm_max_eps;
 
     snprintf(file, PATH_LENGTH - 1, "%s%s", WM_SYS_NET_DIR, protocol);
     memset(read_buff, 0, OS_MAXSTR);
@@ -203,8 +301,6 @@ void get_ipv6_ports(int queue_fd, const char* LOCATION, const char* protocol, in
 
         while(fgets(read_buff, OS_MAXSTR - 1, fp) != NULL){
 
-            listening = 0;
-
             if (first_line){
                 first_line = 0;
                 continue;
@@ -225,43 +321,7 @@ void get_ipv6_ports(int queue_fd, const char* LOCATION, const char* protocol, in
                 &rem.s6_addr32[2], &rem.s6_addr32[3]);
             inet_ntop(AF_INET6, &rem, raddress, sizeof(raddress));
 
-            cJSON *object = cJSON_CreateObject();
-            cJSON *port = cJSON_CreateObject();
-            cJSON_AddStringToObject(object, "type", "port");
-            cJSON_AddNumberToObject(object, "ID", random_id);
-            cJSON_AddStringToObject(object, "timestamp", timestamp);
-            cJSON_AddItemToObject(object, "port", port);
-            cJSON_AddStringToObject(port, "protocol", protocol);
-            cJSON_AddStringToObject(port, "local_ip", laddress);
-            cJSON_AddNumberToObject(port, "local_port", local_port);
-            cJSON_AddStringToObject(port, "remote_ip", raddress);
-            cJSON_AddNumberToObject(port, "remote_port", rem_port);
-            cJSON_AddNumberToObject(port, "tx_queue", txq);
-            cJSON_AddNumberToObject(port, "rx_queue", rxq);
-            cJSON_AddNumberToObject(port, "inode", inode);
-
-            if (!strncmp(protocol, "tcp6", 4)){
-                char *port_state;
-                port_state = get_port_state(state);
-                cJSON_AddStringToObject(port, "state", port_state);
-                if (!strcmp(port_state, "listening")) {
-                    listening = 1;
-                }
-                free(port_state);
-            }
-
-            if (check_all || listening) {
-
-                char *string;
-                string = cJSON_PrintUnformatted(object);
-                mtdebug2(WM_SYS_LOGTAG, "sys_ports_linux() sending '%s'", string);
-                wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
-                cJSON_Delete(object);
-                free(string);
-
-            } else
-                cJSON_Delete(object);
-
+            sys_port_send(scan, protocol, laddress, local_port, raddress, rem_port, txq, rxq, inode, state);
         }
         fclose(fp);
     }else{
@@ -273,38 +333,56 @@ void get_ipv6_ports(int queue_fd, const char* LOCATION, const char* protocol, in
 
 void sys_ports_linux(int queue_fd, const char* WM_SYS_LOCATION, int check_all){
 
-    char *protocol;
+    static const struct {
+        const char *protocol;
+        int family;
+        int ip_protocol;
+        int all_only;                   // Only scanned if all the ports are
+    } protocols[] = {
+        { "tcp", AF_INET, IPPROTO_TCP, 0 },
+        { "udp", AF_INET, IPPROTO_UDP, 1 },
+        { "tcp6", AF_INET6, IPPROTO_TCP, 0 },
+        { "udp6", AF_INET6, IPPROTO_UDP, 1 }
+    };
+
     int random_id = os_random();
     char *timestamp = w_get_timestamp(time(NULL));
+    char *buffer;
+    ports_scan scan;
+    unsigned int i;
 
     if (random_id < 0)
         random_id = -random_id;
 
     mtdebug1(WM_SYS_LOGTAG, "Starting ports inventory.");
 
-    os_calloc(PROTO_LENGTH + 1, sizeof(char), protocol);
+    scan.queue_fd = queue_fd;
+    scan.LOCATION = WM_SYS_LOCATION;
+    scan.random_id = random_id;
+    scan.timestamp = timestamp;
+    scan.check_all = check_all;
+    scan.usec = 1000000 / wm_max_eps;
 
-    /* TCP opened ports inventory */
-    snprintf(protocol, PROTO_LENGTH, "%s", "tcp");
-    get_ipv4_ports(queue_fd, WM_SYS_LOCATION, protocol, random_id, timestamp, check_all);
+    // The same buffer receives the sockets of every protocol
+    os_malloc(OS_SIZE_65536, buffer);
 
-    if (check_all) {
-        /* UDP opened ports inventory */
-        snprintf(protocol, PROTO_LENGTH, "%s", "udp");
-        get_ipv4_ports(queue_fd, WM_SYS_LOCATION, protocol, random_id, timestamp, check_all);
-    }
+    for (i = 0; i < sizeof(protocols) / sizeof(protocols[0]); i++) {
+        if (protocols[i].all_only && !check_all) {
+            continue;
+        }
 
-    /* TCP6 opened ports inventory */
-    snprintf(protocol, PROTO_LENGTH, "%s", "tcp6");
-    get_ipv6_ports(queue_fd, WM_SYS_LOCATION, protocol, random_id, timestamp, check_all);
+        if (get_diag_ports(&scan, protocols[i].protocol, protocols[i].family, protocols[i].ip_protocol, buffer, OS_SIZE_65536) == 0) {
+            continue;
+        }
 
-    if (check_all) {
-        /* UDP6 opened ports inventory */
-        snprintf(protocol, PROTO_LENGTH, "%s", "udp6");
-        get_ipv6_ports(queue_fd, WM_SYS_LOCATION, protocol, random_id, timestamp, check_all);
+        if (protocols[i].family == AF_INET) {
+            get_ipv4_ports(&scan, protocols[i].protocol);
+        } else {
+            get_ipv6_ports(&scan, protocols[i].protocol);
+        }
     }
 
-    free(protocol);
+    free(buffer);
 
     cJSON *object = cJSON_CreateObject();
     cJSON_AddStringToObject(object, "type", "port_end");
@@ -314,12 +392,114 @@ void sys_ports_linux(int queue_fd, const char* WM_SYS_LOCATION, int check_all){
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_ports_linux() sending '%s'", string);
-    SendMSG(queue_fd, string, WM_SYS_LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(scan.usec, queue_fd, string, WM_SYS_LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
 }
 
+/* Packages of a scan waiting to be sent in one message */
+typedef struct packages_batch {
+    int queue_fd;
+    const char *LOCATION;
+    int random_id;
+    const char *timestamp;
+    int usec;                           // Time to sleep after each message sent
+    char *buffer;                       // Packages of the batch, separated by commas
+    size_t length;
+    size_t size;
+    unsigned int count;
+} packages_batch;
+
+static void sys_packages_init(packages_batch *batch, int queue_fd, const char *LOCATION, int random_id, const char *timestamp) {
+    memset(batch, 0, sizeof(packages_batch));
+    batch->queue_fd = queue_fd;
+    batch->LOCATION = LOCATION;
+    batch->random_id = random_id;
+    batch->timestamp = timestamp;
+    batch->usec = 1000000 / wm_max_eps;
+}
+
+static void sys_packages_flush(packages_batch *batch) {
+    char *message;
+    size_t size;
+
+    if (!batch->count) {
+        return;
+    }
+
+    size = batch->length + strlen(batch->timestamp) + OS_SIZE_128;
+    os_malloc(size, message);
+    snprintf(message, size, "{\"type\":\"program\",\"ID\":%d,\"timestamp\":\"%s\",\"programs\":[%s]}", batch->random_id, batch->timestamp, batch->buffer);
+
+    mtdebug2(WM_SYS_LOGTAG, "sys_packages_linux() sending '%s'", message);
+    sys_send(batch->usec, batch->queue_fd, message, batch->LOCATION, SYSCOLLECTOR_MQ);
+    free(message);
+
+    batch->length = 0;
+    batch->count = 0;
+}
+
+/* Add a package to the batch, that takes it, and send the batch if it's full */
+static void sys_packages_add(packages_batch *batch, cJSON *package) {
+    char *string = cJSON_PrintUnformatted(package);
+    size_t length = strlen(string);
+    size_t needed;
+
+    cJSON_Delete(package);
+
+    if (batch->count && batch->length + length + 1 > WM_SYS_PACKAGES_BATCH) {
+        sys_packages_flush(batch);
+    }
+
+    if (needed = batch->length + length + 2, needed > batch->size) {
+        batch->size = needed > WM_SYS_PACKAGES_BATCH ? needed : WM_SYS_PACKAGES_BATCH;
+        os_realloc(batch->buffer, batch->size, batch->buffer);
+    }
+
+    if (batch->count) {
+        batch->buffer[batch->length++] = ',';
+    }
+
+    memcpy(batch->buffer + batch->length, string, length + 1);
+    batch->length += length;
+    batch->count++;
+    free(string);
+}
+
+static void sys_packages_free(packages_batch *batch) {
+    os_free(batch->buffer);
+}
+
+/* The package databases are only rewritten when a package is installed,
+ * removed or updated, so their inode, size and modification time tell
+ * whether the inventory may have changed without reading them. */
+static uint64_t sys_packages_source() {
+    const char *paths[] = { DPKG_STATUS, RPM_DATABASE, RPM_SQLITE_DATABASE, RPM_SQLITE_DATABASE "-wal", NULL };
+    uint64_t hash = 14695981039346656037ULL;
+    struct stat st;
+    int found = 0;
+    size_t i, j;
+
+    for (i = 0; paths[i]; i++) {
+        if (stat(paths[i], &st) < 0) {
+            continue;
+        }
+
+        uint64_t fields[] = { i, st.st_ino, st.st_size, st.st_mtime, st.st_mtim.tv_nsec };
+        const unsigned char *bytes = (const unsigned char *)fields;
+
+        for (j = 0; j < sizeof(fields); j++) {
+            hash ^= bytes[j];
+            hash *= 1099511628211ULL;
+        }
+
+        found = 1;
+    }
+
+    return found ? hash : 0;
+}
+
 // Get installed programs inventory
 
 void sys_packages_linux(int queue_fd, const char* LOCATION) {
@@ -339,6 +519,10 @@ void sys_packages_linux(int queue_fd, const char* LOCATION) {
 
     mtdebug1(WM_SYS_LOGTAG, "Starting installed packages inventory.");
 
+    if (sys_scan_source(sys_packages_source())) {
+        return;
+    }
+
     if ((dir = opendir("/var/lib/dpkg/"))){
         closedir(dir);
         if (end_dpkg = sys_deb_packages(queue_fd, LOCATION, random_id), !end_dpkg) {
@@ -354,7 +538,7 @@ void sys_packages_linux(int queue_fd, const char* LOCATION) {
 
     if (end_rpm) {
         mtdebug2(WM_SYS_LOGTAG, "sys_packages_linux() sending '%s'", end_rpm);
-        wm_sendmsg(usec, queue_fd, end_rpm, LOCATION, SYSCOLLECTOR_MQ);
+        sys_send(usec, queue_fd, end_rpm, LOCATION, SYSCOLLECTOR_MQ);
 
         free(end_rpm);
         if (end_dpkg) {
@@ -362,41 +546,154 @@ void sys_packages_linux(int queue_fd, const char* LOCATION) {
         }
     } else if (end_dpkg) {
         mtdebug2(WM_SYS_LOGTAG, "sys_packages_linux() sending '%s'", end_dpkg);
-        wm_sendmsg(usec, queue_fd, end_dpkg, LOCATION, SYSCOLLECTOR_MQ);
+        sys_send(usec, queue_fd, end_dpkg, LOCATION, SYSCOLLECTOR_MQ);
         free(end_dpkg);
     }
 }
 
-char * sys_rpm_packages(int queue_fd, const char* LOCATION, int random_id){
+/* Parse a RPM header, as stored by both the Berkeley DB and the SQLite
+ * backends. Returns NULL if it's not an actual package. */
+static cJSON * sys_rpm_header(u_int8_t* bytes) {
 
-    char *format = "rpm";
-    char *timestamp = w_get_timestamp(time(NULL));
-    cJSON *object = NULL;
     cJSON *package = NULL;
-
-    DBT key, data;
-    DBC *cursor;
-    DB *dbp;
     int ret, skip;
     int i;
-    u_int8_t* bytes;
     u_int8_t* store;
     int index, offset;
     rpm_data *info;
     rpm_data *next_info;
     rpm_data *head;
     int epoch;
-    char version[TYPE_LENGTH];
-    char release[TYPE_LENGTH];
+    char version[TYPE_LENGTH] = "";
+    char release[TYPE_LENGTH] = "";
     char final_version[V_LENGTH];
 
-    // Define time to sleep between messages sent
-    int usec = 1000000 / wm_max_eps;
+    // Read number of index entries (First 4 bytes)
+
+    index = four_bytes_to_int32(bytes);
+
+    // Set offset to first index entry
+
+    offset = 8;
+    bytes = &bytes[offset];
+
+    os_calloc(1, sizeof(rpm_data), info);
+    head = info;
+
+    // Read all indexes
+
+    for (i = 0; i < index; i++) {
+        offset = 16;
+        if ((ret = read_entry(bytes, info)), ret == 0) {
+            os_calloc(1, sizeof(rpm_data), info->next);
+            info = info->next;
+        }
+        bytes = &bytes[offset];
+    }
+
+    // Start reading the data
+
+    store = bytes;
+    epoch = 0;
+    skip = 0;
+
+    package = cJSON_CreateObject();
+    cJSON_AddStringToObject(package, "format", "rpm");
+
+    for (info = head; info; info = next_info) {
+        next_info = info->next;
+        bytes = &store[info->offset];
+        char * read;
+        int result;
+
+        switch(info->type) {
+            case 0:
+                break;
+            case 6:   // String
+
+                read = read_string(bytes);
+
+                if (!strncmp(info->tag, "name", 4) && !strncmp(read, "gpg-pubkey", 10))
+                    skip = 1;
+
+                if (!strncmp(info->tag, "version", 7)) {
+                    snprintf(version, TYPE_LENGTH - 1, "%s", read);
+                } else if (!strncmp(info->tag, "release", 7)) {
+                    snprintf(release, TYPE_LENGTH - 1, "%s", read);
+                } else {
+                    cJSON_AddStringToObject(package, info->tag, read);
+                }
+                free(read);
+                break;
+
+            case 4:   // int32
+                result = four_bytes_to_int32(bytes);
+
+                if (!strncmp(info->tag, "size", 4)) {
+                    result = result / 1024;   // Bytes to KBytes
+                }
+
+                if (!strncmp(info->tag, "install_time", 12)) {    // Format date
+                    char *installt = w_get_timestamp(result);
+
+                    cJSON_AddStringToObject(package, info->tag, installt);
+                    free(installt);
+                } else if (!strncmp(info->tag, "epoch", 5)) {
+                    epoch = result;
+                } else {
+                    cJSON_AddNumberToObject(package, info->tag, result);
+                }
+
+                break;
+
+            case 9:   // Vector of strings
+                read = read_string(bytes);
+                cJSON_AddStringToObject(package, info->tag, read);
+                free(read);
+                break;
+
+            default:
+                mterror(WM_SYS_LOGTAG, "Unknown type of data: %d", info->type);
+        }
+    }
+
+    if (epoch) {
+        snprintf(final_version, V_LENGTH, "%d:%s-%s", epoch, version, release);
+    } else {
+        snprintf(final_version, V_LENGTH, "%s-%s", version, release);
+    }
+    cJSON_AddStringToObject(package, "version", final_version);
+
+    // Free resources
+
+    for (info = head; info; info = next_info) {
+        next_info = info->next;
+        free(info->tag);
+        free(info);
+    }
+
+    if (skip) {
+        cJSON_Delete(package);
+        return NULL;
+    }
+
+    return package;
+}
+
+// Read the packages of the Berkeley DB database
+
+static int sys_rpm_bdb(packages_batch *batch) {
+
+    DBT key, data;
+    DBC *cursor;
+    DB *dbp;
+    cJSON *package;
+    int ret;
+    int j;
 
     if ((ret = db_create(&dbp, NULL, 0)) != 0) {
         mterror(WM_SYS_LOGTAG, "Failed to initialize the DB handler: %s", db_strerror(ret));
-        free(timestamp);
-        return NULL;
+        return -1;
     }
 
     // Set Little-endian order by default
@@ -406,21 +703,19 @@ char * sys_rpm_packages(int queue_fd, const char* LOCATION, int random_id){
 
     if ((ret = dbp->open(dbp, NULL, RPM_DATABASE, NULL, DB_HASH, DB_RDONLY, 0)) != 0) {
         mterror(WM_SYS_LOGTAG, "Failed to open database '%s': %s", RPM_DATABASE, db_strerror(ret));
-        free(timestamp);
-        return NULL;
+        dbp->close(dbp, 0);
+        return -1;
     }
 
     if ((ret = dbp->cursor(dbp, NULL, &cursor, 0)) != 0) {
         mterror(WM_SYS_LOGTAG, "Error creating cursor: %s", db_strerror(ret));
-        free(timestamp);
-        return NULL;
+        dbp->close(dbp, 0);
+        return -1;
     }
 
     memset(&key, 0, sizeof(DBT));
     memset(&data, 0, sizeof(DBT));
 
-    int j;
-
     for (j = 0; ret = cursor->c_get(cursor, &key, &data, DB_NEXT), ret == 0; j++) {
 
         // First header is not a package
@@ -429,138 +724,101 @@ char * sys_rpm_packages(int queue_fd, const char* LOCATION, int random_id){
             continue;
         }
 
-        bytes = (u_int8_t*)data.data;
-
-        // Read number of index entries (First 4 bytes)
-
-        index = four_bytes_to_int32(bytes);
-
-        // Set offset to first index entry
-
-        offset = 8;
-        bytes = &bytes[offset];
+        if (package = sys_rpm_header((u_int8_t*)data.data), package) {
+            sys_packages_add(batch, package);
+        }
+    }
 
-        os_calloc(1, sizeof(rpm_data), info);
-        head = info;
+    if (ret == DB_NOTFOUND && j <= 1) {
+        mtwarn(WM_SYS_LOGTAG, "Not found any record in database '%s'", RPM_DATABASE);
+    }
 
-        // Read all indexes
+    cursor->c_close(cursor);
+    dbp->close(dbp, 0);
 
-        for (i = 0; i < index; i++) {
-            offset = 16;
-            if ((ret = read_entry(bytes, info)), ret == 0) {
-                os_calloc(1, sizeof(rpm_data), info->next);
-                info = info->next;
-            }
-            bytes = &bytes[offset];
-        }
+    return 0;
+}
 
-        // Start reading the data
+// Read the packages of the SQLite database, used instead of the Berkeley DB since RPM 4.16
 
-        store = bytes;
-        epoch = 0;
-        skip = 0;
+static int sys_rpm_sqlite(packages_batch *batch) {
 
-        object = cJSON_CreateObject();
-        package = cJSON_CreateObject();
-        cJSON_AddStringToObject(object, "type", "program");
-        cJSON_AddNumberToObject(object, "ID", random_id);
-        cJSON_AddStringToObject(object, "timestamp", timestamp);
-        cJSON_AddItemToObject(object, "program", package);
-        cJSON_AddStringToObject(package, "format", format);
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    cJSON *package;
+    int result;
+    int count = 0;
 
-        for (info = head; info; info = next_info) {
-            next_info = info->next;
-            bytes = &store[info->offset];
-            char * read;
-            int result;
+    if (sqlite3_open_v2(RPM_SQLITE_DATABASE, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        mterror(WM_SYS_LOGTAG, "Failed to open database '%s': %s", RPM_SQLITE_DATABASE, sqlite3_errmsg(db));
+        sqlite3_close_v2(db);
+        return -1;
+    }
 
-            switch(info->type) {
-                case 0:
-                    break;
-                case 6:   // String
+    // Wait for a transaction of rpm to end instead of failing
+    sqlite3_busy_timeout(db, 1000);
 
-                    read = read_string(bytes);
+    if (sqlite3_prepare_v2(db, "SELECT blob FROM Packages;", -1, &stmt, NULL) != SQLITE_OK) {
+        mterror(WM_SYS_LOGTAG, "Failed to read database '%s': %s", RPM_SQLITE_DATABASE, sqlite3_errmsg(db));
+        sqlite3_close_v2(db);
+        return -1;
+    }
 
-                    if (!strncmp(info->tag, "name", 4) && !strncmp(read, "gpg-pubkey", 10))
-                        skip = 1;
+    while (result = sqlite3_step(stmt), result == SQLITE_ROW) {
+        const void *blob = sqlite3_column_blob(stmt, 0);
 
-                    if (!strncmp(info->tag, "version", 7)) {
-                        snprintf(version, TYPE_LENGTH - 1, "%s", read);
-                    } else if (!strncmp(info->tag, "release", 7)) {
-                        snprintf(release, TYPE_LENGTH - 1, "%s", read);
-                    } else {
-                        cJSON_AddStringToObject(package, info->tag, read);
-                    }
-                    free(read);
-                    break;
+        // A header starts with the number of entries and the size of the data
+        if (!blob || sqlite3_column_bytes(stmt, 0) < 8) {
+            continue;
+        }
 
-                case 4:   // int32
-                    result = four_bytes_to_int32(bytes);
+        count++;
 
-                    if (!strncmp(info->tag, "size", 4)) {
-                        result = result / 1024;   // Bytes to KBytes
-                    }
+        if (package = sys_rpm_header((u_int8_t*)blob), package) {
+            sys_packages_add(batch, package);
+        }
+    }
 
-                    if (!strncmp(info->tag, "install_time", 12)) {    // Format date
-                        char *installt = w_get_timestamp(result);
+    if (result != SQLITE_DONE) {
+        mterror(WM_SYS_LOGTAG, "Failed to read database '%s': %s", RPM_SQLITE_DATABASE, sqlite3_errmsg(db));
+    } else if (!count) {
+        mtwarn(WM_SYS_LOGTAG, "Not found any record in database '%s'", RPM_SQLITE_DATABASE);
+    }
 
-                        cJSON_AddStringToObject(package, info->tag, installt);
-                        free(installt);
-                    } else if (!strncmp(info->tag, "epoch", 5)) {
-                        epoch = result;
-                    } else {
-                        cJSON_AddNumberToObject(package, info->tag, result);
-                    }
+    sqlite3_finalize(stmt);
+    sqlite3_close_v2(db);
 
-                    break;
+    return result == SQLITE_DONE ? 0 : -1;
+}
 
-                case 9:   // Vector of strings
-                    read = read_string(bytes);
-                    cJSON_AddStringToObject(package, info->tag, read);
-                    free(read);
-                    break;
+char * sys_rpm_packages(int queue_fd, const char* LOCATION, int random_id){
 
-                default:
-                    mterror(WM_SYS_LOGTAG, "Unknown type of data: %d", info->type);
-            }
-        }
+    char *timestamp = w_get_timestamp(time(NULL));
+    cJSON *object = NULL;
+    packages_batch batch;
+    struct stat st;
+    int ret;
 
-        if (epoch) {
-            snprintf(final_version, V_LENGTH, "%d:%s-%s", epoch, version, release);
-        } else {
-            snprintf(final_version, V_LENGTH, "%s-%s", version, release);
-        }
-        cJSON_AddStringToObject(package, "version", final_version);
+    sys_packages_init(&batch, queue_fd, LOCATION, random_id, timestamp);
 
-        // Send RPM package information to the manager
+    // Newer distributions keep the database in SQLite
 
-        if (skip) {
-            cJSON_Delete(object);
-        } else {
-            char *string;
-            string = cJSON_PrintUnformatted(object);
-            mtdebug2(WM_SYS_LOGTAG, "sys_rpm_packages() sending '%s'", string);
-            wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
-            cJSON_Delete(object);
-            free(string);
-        }
+    if (stat(RPM_SQLITE_DATABASE, &st) == 0) {
+        ret = sys_rpm_sqlite(&batch);
+    } else {
+        ret = sys_rpm_bdb(&batch);
+    }
 
-        // Free resources
+    // The packages read before a failure are sent anyway
 
-        for (info = head; info; info = next_info) {
-            next_info = info->next;
-            free(info->tag);
-            free(info);
-        }
-    }
+    sys_packages_flush(&batch);
+    sys_packages_free(&batch);
 
-    if (ret == DB_NOTFOUND && j <= 1) {
-        mtwarn(WM_SYS_LOGTAG, "Not found any record in database '%s'", RPM_DATABASE);
+    if (ret < 0) {
+        free(timestamp);
+        return NULL;
     }
 
-    cursor->c_close(cursor);
-    dbp->close(dbp, 0);
-
     object = cJSON_CreateObject();
     cJSON_AddStringToObject(object, "type", "program_end");
     cJSON_AddNumberToObject(object, "ID", random_id);
@@ -578,7 +836,7 @@ char * sys_rpm_packages(int queue_fd, const char* LOCATION, int random_id){
 char * sys_deb_packages(int queue_fd, const char* LOCATION, int random_id){
 
     const char * format = "deb";
-    char file[PATH_LENGTH] = "/var/lib/dpkg/status";
+    char file[PATH_LENGTH] = DPKG_STATUS;
     char read_buff[OS_MAXSTR];
     FILE *fp;
     size_t length;
@@ -586,14 +844,13 @@ char * sys_deb_packages(int queue_fd, const char* LOCATION, int random_id){
     char *timestamp = w_get_timestamp(time(NULL));
     cJSON *object = NULL;
     cJSON *package = NULL;
-
-    // Define time to sleep between messages sent
-    int usec = 1000000 / wm_max_eps;
+    packages_batch batch;
 
     memset(read_buff, 0, OS_MAXSTR);
 
     if ((fp = fopen(file, "r"))) {
         w_file_cloexec(fp);
+        sys_packages_init(&batch, queue_fd, LOCATION, random_id, timestamp);
 
         while(fgets(read_buff, OS_MAXSTR, fp) != NULL){
 
@@ -603,16 +860,11 @@ char * sys_deb_packages(int queue_fd, const char* LOCATION, int random_id){
 
             if (!strncmp(read_buff, "Package: ", 9)) {
 
-                if(object){
-                    cJSON_Delete(object);
+                if(package){
+                    cJSON_Delete(package);
                 }
 
-                object = cJSON_CreateObject();
                 package = cJSON_CreateObject();
-                cJSON_AddStringToObject(object, "type", "program");
-                cJSON_AddNumberToObject(object, "ID", random_id);
-                cJSON_AddStringToObject(object, "timestamp", timestamp);
-                cJSON_AddItemToObject(object, "program", package);
                 cJSON_AddStringToObject(package, "format", format);
 
                 char ** parts = NULL;
@@ -730,23 +982,17 @@ char * sys_deb_packages(int queue_fd, const char* LOCATION, int random_id){
                 }
                 free(parts);
 
-                // Send message to the queue
+                // Add the package to the next message
 
                 if (installed) {
 
                     installed = 0;
-
-                    char *string;
-                    string = cJSON_PrintUnformatted(object);
-                    mtdebug2(WM_SYS_LOGTAG, "sys_deb_packages() sending '%s'", string);
-                    wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
-                    cJSON_Delete(object);
-                    object = NULL;
-                    free(string);
+                    sys_packages_add(&batch, package);
+                    package = NULL;
 
                 } else {
-                    cJSON_Delete(object);
-                    object = NULL;
+                    cJSON_Delete(package);
+                    package = NULL;
                     continue;
                 }
 
@@ -754,6 +1000,8 @@ char * sys_deb_packages(int queue_fd, const char* LOCATION, int random_id){
         }
 
         fclose(fp);
+        sys_packages_flush(&batch);
+        sys_packages_free(&batch);
 
     } else {
 
@@ -763,8 +1011,8 @@ char * sys_deb_packages(int queue_fd, const char* LOCATION, int random_id){
 
     }
 
-    if(object){
-        cJSON_Delete(object);
+    if(package){
+        cJSON_Delete(package);
     }
 
     object = cJSON_CreateObject();
@@ -953,7 +1201,7 @@ void sys_network_linux(int queue_fd, const char* LOCATION){
         /* Send interface data in JSON format */
         string = cJSON_PrintUnformatted(object);
         mtdebug2(WM_SYS_LOGTAG, "sys_network_linux() sending '%s'", string);
-        wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+        sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
         cJSON_Delete(object);
 
         free(string);
@@ -973,7 +1221,7 @@ void sys_network_linux(int queue_fd, const char* LOCATION){
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_network_linux() sending '%s'", string);
-    wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
@@ -1439,10 +1687,14 @@ void sys_proc_linux(int queue_fd, const char* LOCATION) {
     // Define time to sleep between messages sent
     int usec = 1000000 / wm_max_eps;
 
-    PROCTAB* proc = openproc(PROC_FILLMEM | PROC_FILLSTAT | PROC_FILLSTATUS | PROC_FILLARG | PROC_FILLGRP | PROC_FILLUSR | PROC_FILLCOM | PROC_FILLENV);
+    // The environment of the processes is not reported, so it's not read
+    PROCTAB* proc = openproc(PROC_FILLMEM | PROC_FILLSTAT | PROC_FILLSTATUS | PROC_FILLARG | PROC_FILLGRP | PROC_FILLUSR | PROC_FILLCOM);
 
     proc_t * proc_info;
-    char *string;
+    char **messages = NULL;
+    unsigned int count = 0;
+    unsigned int size = 0;
+    unsigned int j;
 
     if (!proc) {
         mterror(WM_SYS_LOGTAG, "Running process inventory: could not create libproc context.");
@@ -1451,8 +1703,6 @@ void sys_proc_linux(int queue_fd, const char* LOCATION) {
     }
 
     int i = 0;
-    cJSON *item;
-    cJSON *proc_array = cJSON_CreateArray();
 
     mtdebug1(WM_SYS_LOGTAG, "Starting running processes inventory.");
 
@@ -1504,19 +1754,27 @@ void sys_proc_linux(int queue_fd, const char* LOCATION) {
         cJSON_AddNumberToObject(process,"tty",proc_info->tty);
         cJSON_AddNumberToObject(process,"processor",proc_info->processor);
 
-        cJSON_AddItemToArray(proc_array, object);
+        // Each process is printed as soon as it's read, instead of keeping its tree until the end of the scan
+        if (count == size) {
+            size = size ? size * 2 : 256;
+            os_realloc(messages, size * sizeof(char *), messages);
+        }
+
+        messages[count++] = cJSON_PrintUnformatted(object);
+        cJSON_Delete(object);
         freeproc(proc_info);
     }
 
-    cJSON_ArrayForEach(item, proc_array) {
-        string = cJSON_PrintUnformatted(item);
-        mtdebug2(WM_SYS_LOGTAG, "sys_proc_linux() sending '%s'", string);
-        wm_sendmsg(usec, queue_fd, string, LOCATION, SYSCOLLECTOR_MQ);
-        free(string);
+    closeproc(proc);
+
+    // The processes are sent after the scan, so the delay between messages doesn't make it last longer
+    for (j = 0; j < count; j++) {
+        mtdebug2(WM_SYS_LOGTAG, "sys_proc_linux() sending '%s'", messages[j]);
+        sys_send(usec, queue_fd, messages[j], LOCATION, SYSCOLLECTOR_MQ);
+        free(messages[j]);
     }
 
-    cJSON_Delete(proc_array);
-    closeproc(proc);
+    os_free(messages);
 
     cJSON *object = cJSON_CreateObject();
     cJSON_AddStringToObject(object, "type", "process_end");
@@ -1526,7 +1784,7 @@ void sys_proc_linux(int queue_fd, const char* LOCATION) {
     char *end_msg;
     end_msg = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_proc_linux() sending '%s'", end_msg);
-    wm_sendmsg(usec, queue_fd, end_msg, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, queue_fd, end_msg, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(end_msg);
     free(timestamp);
@@ -390,7 +390,7 @@ void sys_ports_windows(const char* LOCATION, int check_all){
                 char *string;
                 string = cJSON_PrintUnformatted(object);
                 mtdebug2(WM_SYS_LOGTAG, "sys_ports_windows() sending '%s'", string);
-                wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+                sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
                 cJSON_Delete(object);
                 free(string);
 
@@ -512,7 +512,7 @@ void sys_ports_windows(const char* LOCATION, int check_all){
                 char *string;
                 string = cJSON_PrintUnformatted(object);
                 mtdebug2(WM_SYS_LOGTAG, "sys_ports_windows() sending '%s'", string);
-                wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+                sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
                 cJSON_Delete(object);
                 free(string);
             } else {
@@ -590,7 +590,7 @@ void sys_ports_windows(const char* LOCATION, int check_all){
 
             string = cJSON_PrintUnformatted(object);
             mtdebug2(WM_SYS_LOGTAG, "sys_ports_windows() sending '%s'", string);
-            wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+            sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
             cJSON_Delete(object);
 
             free(string);
@@ -676,7 +676,7 @@ void sys_ports_windows(const char* LOCATION, int check_all){
 
             string = cJSON_PrintUnformatted(object);
             mtdebug2(WM_SYS_LOGTAG, "sys_ports_windows() sending '%s'", string);
-            wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+            sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
             cJSON_Delete(object);
 
             free(string);
@@ -718,12 +718,92 @@ end:
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_ports_windows() sending '%s'", string);
-    wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
 }
 
+#define UNINSTALL_REG "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Uninstall"
+
+static uint64_t sys_reg_digest(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/* Fold the last write time of a key, and the name and last write time of
+ * each of its subkeys, into the hash. Adding or removing a subkey updates the
+ * time of the key, and updating its values updates the time of the subkey.
+ * Returns 0 if the key couldn't be read. */
+static int sys_reg_source(uint64_t *hash, HKEY root, const char *path, REGSAM access) {
+    char name[KEY_LENGTH];
+    long unsigned int name_size;
+    long unsigned int subkeys = 0;
+    long unsigned int i;
+    FILETIME last_write;
+    HKEY key;
+
+    if (RegOpenKeyEx(root, path, 0, access, &key) != ERROR_SUCCESS) {
+        return 0;
+    }
+
+    if (RegQueryInfoKey(key, NULL, NULL, NULL, &subkeys, NULL, NULL, NULL, NULL, NULL, NULL, &last_write) != ERROR_SUCCESS) {
+        RegCloseKey(key);
+        return 0;
+    }
+
+    *hash = sys_reg_digest(*hash, path, strlen(path) + 1);
+    *hash = sys_reg_digest(*hash, &last_write, sizeof(FILETIME));
+
+    for (i = 0; i < subkeys; i++) {
+        name_size = KEY_LENGTH;
+
+        if (RegEnumKeyEx(key, i, name, &name_size, NULL, NULL, NULL, &last_write) != ERROR_SUCCESS) {
+            break;
+        }
+
+        *hash = sys_reg_digest(*hash, name, name_size + 1);
+        *hash = sys_reg_digest(*hash, &last_write, sizeof(FILETIME));
+    }
+
+    RegCloseKey(key);
+    return 1;
+}
+
+/* The uninstall keys of the machine (both views) and of each loaded user */
+static uint64_t sys_programs_source() {
+    uint64_t hash = 14695981039346656037ULL;
+    char user_key[KEY_LENGTH];
+    char name[KEY_LENGTH];
+    long unsigned int name_size;
+    long unsigned int i;
+    int found = 0;
+    HKEY users;
+
+    found |= sys_reg_source(&hash, HKEY_LOCAL_MACHINE, UNINSTALL_REG, KEY_READ | KEY_WOW64_64KEY);
+    found |= sys_reg_source(&hash, HKEY_LOCAL_MACHINE, UNINSTALL_REG, KEY_READ | KEY_WOW64_32KEY);
+
+    if (RegOpenKeyEx(HKEY_USERS, NULL, 0, KEY_READ, &users) == ERROR_SUCCESS) {
+        for (i = 0; name_size = KEY_LENGTH, RegEnumKeyEx(users, i, name, &name_size, NULL, NULL, NULL, NULL) == ERROR_SUCCESS; i++) {
+            // A user is loaded or unloaded
+            hash = sys_reg_digest(hash, name, name_size + 1);
+            snprintf(user_key, KEY_LENGTH, "%s\\" UNINSTALL_REG, name);
+            sys_reg_source(&hash, HKEY_USERS, user_key, KEY_READ);
+        }
+
+        RegCloseKey(users);
+    }
+
+    return found ? hash : 0;
+}
+
 // Get installed programs inventory
 
 void sys_programs_windows(const char* LOCATION){
@@ -740,6 +820,11 @@ void sys_programs_windows(const char* LOCATION){
 
     mtdebug1(WM_SYS_LOGTAG, "Starting installed programs inventory.");
 
+    if (sys_scan_source(sys_programs_source())) {
+        free(timestamp);
+        return;
+    }
+
     HKEY main_key;
     int arch;
 
@@ -803,7 +888,7 @@ void sys_programs_windows(const char* LOCATION){
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_programs_windows() sending '%s'", string);
-    wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
@@ -821,12 +906,18 @@ void sys_hotfixes(const char* LOCATION){
     const char *HOTFIXES_REG;
     cJSON *end_evt;
     char *end_evt_str;
+    uint64_t source = 14695981039346656037ULL;
 
     HOTFIXES_REG = isVista ? "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Component Based Servicing\\Packages" :
                     "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\HotFix";
 
     mtdebug1(WM_SYS_LOGTAG, "Starting installed hotfixes inventory.");
 
+    if (sys_scan_source(sys_reg_source(&source, HKEY_LOCAL_MACHINE, HOTFIXES_REG, KEY_READ | KEY_WOW64_64KEY) ? source : 0)) {
+        free(timestamp);
+        return;
+    }
+
     if(result = RegOpenKeyEx(HKEY_LOCAL_MACHINE, TEXT(HOTFIXES_REG), 0, KEY_READ | KEY_WOW64_64KEY, &main_key), result == ERROR_SUCCESS) {
         mtdebug2(WM_SYS_LOGTAG, "Reading hotfixes from the registry.");
         list_hotfixes(main_key,usec, timestamp, ID, LOCATION);
@@ -841,7 +932,7 @@ void sys_hotfixes(const char* LOCATION){
 
     end_evt_str = cJSON_PrintUnformatted(end_evt);
     mtdebug2(WM_SYS_LOGTAG, "sys_hotfixes() sending '%s'", end_evt_str);
-    wm_sendmsg(usec, 0, end_evt_str, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, 0, end_evt_str, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(end_evt);
 
     free(end_evt_str);
@@ -1256,7 +1347,7 @@ void read_win_program(const char * sec_key, int arch, int root_key, int usec, co
             char *string;
             string = cJSON_PrintUnformatted(object);
             mtdebug2(WM_SYS_LOGTAG, "sys_programs_windows() sending '%s'", string);
-            wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+            sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
             cJSON_Delete(object);
             free(string);
 
@@ -1287,7 +1378,7 @@ void send_hotfix(const char *hotfix, int usec, const char *timestamp, int ID, co
 
     char *str_event = cJSON_PrintUnformatted(event);
     mtdebug2(WM_SYS_LOGTAG, "sys_hotfixes() sending '%s'", str_event);
-    wm_sendmsg(usec, 0, str_event, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, 0, str_event, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(event);
     free(str_event);
 }
@@ -1970,7 +2061,7 @@ void sys_network_windows(const char* LOCATION){
                 }
 
                 mtdebug2(WM_SYS_LOGTAG, "sys_network_windows() sending '%s'", string);
-                wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+                sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
 
                 free(string);
 
@@ -2009,7 +2100,7 @@ void sys_network_windows(const char* LOCATION){
     char *string;
     string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_network_windows() sending '%s'", string);
-    wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
     cJSON_Delete(object);
     free(string);
     free(timestamp);
@@ -2315,7 +2406,7 @@ void sys_proc_windows(const char* LOCATION) {
 			cJSON_ArrayForEach(item, proc_array) {
 				char *string = cJSON_PrintUnformatted(item);
 				mtdebug2(WM_SYS_LOGTAG, "sys_proc_windows() sending '%s'", string);
-				wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+				sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
 				free(string);
 			}
 
@@ -2345,7 +2436,7 @@ void sys_proc_windows(const char* LOCATION) {
 
     char *string = cJSON_PrintUnformatted(object);
     mtdebug2(WM_SYS_LOGTAG, "sys_proc_windows() sending '%s'", string);
-    wm_sendmsg(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
+    sys_send(usec, 0, string, LOCATION, SYSCOLLECTOR_MQ);
 
     cJSON_Delete(object);
     free(string);
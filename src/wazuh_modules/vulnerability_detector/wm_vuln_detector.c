@@ -37,7 +37,8 @@ STATIC int wm_vuldet_run_update(update_node **updates);
 STATIC char *wm_vuldet_oval_xml_preparser(char *path, vu_feed dist);
 STATIC int wm_vuldet_index_feed(update_node *update);
 STATIC int wm_vuldet_fetch_feed(update_node *update, int *need_update);
-STATIC int wm_vuldet_oval_xml_parser(OS_XML *xml, XML_NODE node, wm_vuldet_db *parsed_oval, update_node *update, vu_logic condition);
+STATIC int wm_vuldet_oval_xml_start(xml_node *node, unsigned int depth, void *data);
+STATIC int wm_vuldet_oval_xml_end(xml_node *node, unsigned int depth, void *data);
 STATIC int wm_vuldet_json_parser(char *json_path, wm_vuldet_db *uparsed_vulnerabilities, update_node *update);
 STATIC void wm_vuldet_add_rvulnerability(wm_vuldet_db *ctrl_block);
 STATIC void wm_vuldet_add_vulnerability_info(wm_vuldet_db *ctrl_block);
@@ -80,9 +81,54 @@ STATIC int wm_vuldet_report_agent_vulnerabilities(sqlite3 *db, agent_software *a
  * @brief Traverse the agents linked list, gather the installed packages and search
  * for known vulnerabilities.
  * @param agents_software Pointer to the new linked list.
+ * @param threads Number of agents scanned at the same time.
  * @return 0 on success, -1 otherwise.
  */
-STATIC int wm_vuldet_check_agent_vulnerabilities(agent_software *agents, wm_vuldet_flags *flags, time_t ignore_time);
+STATIC int wm_vuldet_check_agent_vulnerabilities(agent_software *agents, wm_vuldet_flags *flags, time_t ignore_time, unsigned int threads);
+
+/**
+ * @brief Shadow the tables filled for each agent with temporary copies.
+ * @param db CVE DB connection of a scan worker.
+ * @return 0 on success, -1 otherwise.
+ */
+STATIC int wm_vuldet_isolate_scan_tables(sqlite3 *db);
+
+/**
+ * @brief Gather the installed packages of an agent and report its vulnerabilities.
+ * @param db CVE DB connection.
+ * @param agent Agent being analyzed.
+ * @return 0 if the next agent can be scanned, -1 otherwise.
+ */
+STATIC int wm_vuldet_scan_agent(sqlite3 *db, agent_software *agent, wm_vuldet_flags *flags, time_t ignore_time);
+
+/**
+ * @brief Take the next agent to scan.
+ * @param pool Agents to scan.
+ * @return The agent, or NULL if there are no more or a worker failed.
+ */
+STATIC agent_software *wm_vuldet_next_agent(vu_scan_pool *pool);
+
+/**
+ * @brief Scan agents from the pool until there are no more.
+ * @param data Agents to scan (vu_scan_pool).
+ * @return NULL.
+ */
+STATIC void *wm_vuldet_scan_worker(void *data);
+
+/**
+ * @brief Record that the content of a feed has changed.
+ * @param tag Tag of the feed.
+ * @return 0 on success, -1 otherwise.
+ */
+STATIC int wm_vuldet_set_feed_update(vu_feed tag);
+
+/**
+ * @brief Get the last time any of the feeds used to scan an agent changed.
+ * @param db CVE DB connection.
+ * @param agent Agent being analyzed.
+ * @return The time of the last change, or the current time if it is unknown.
+ */
+STATIC time_t wm_vuldet_get_feed_update(sqlite3 *db, agent_software *agent);
 
 /**
  * @brief Discard any installed Linux kernel package which is not running.
@@ -123,6 +169,49 @@ STATIC void wm_vuldet_adapt_title(char *title, char *cve);
 STATIC char *vu_get_version();
 STATIC int wm_vuldet_fetch_redhat(update_node *update);
 STATIC int wm_vuldet_fetch_oval(update_node *update, char *repo);
+
+/**
+ * @brief Build the URL of an OVAL feed.
+ * @param update Feed to download.
+ * @param repo Buffer to store the URL.
+ * @param size Size of the buffer.
+ */
+STATIC void wm_vuldet_oval_repo(update_node *update, char *repo, size_t size);
+
+/**
+ * @brief Download an OVAL feed to its own temporary file, as long as it was
+ * modified since its last update.
+ * @param update Feed to download.
+ * @param repo URL of the feed.
+ * @return VU_NEED_UPDATE if it was downloaded, VU_NOT_NEED_UPDATE if it wasn't modified or VU_INV_FEED on error.
+ */
+STATIC int wm_vuldet_download_oval(update_node *update, const char *repo);
+
+/**
+ * @brief Download the OVAL feeds that are due for an update at the same time,
+ * before they are indexed one by one.
+ * @param updates Feeds list.
+ */
+STATIC void wm_vuldet_prefetch_oval(update_node **updates);
+
+/**
+ * @brief Thread that downloads an OVAL feed in advance.
+ * @param arg Feed to download.
+ */
+STATIC void *wm_vuldet_prefetch_oval_thread(void *arg);
+
+/**
+ * @brief Remove the feeds downloaded in advance that weren't used.
+ * @param updates Feeds list.
+ */
+STATIC void wm_vuldet_discard_prefetch(update_node **updates);
+
+/**
+ * @brief Get the last time that a feed was indexed.
+ * @param tag Feed tag.
+ * @return The time of the last update, 0 if it's unknown or its content isn't in the database.
+ */
+STATIC time_t wm_vuldet_get_feed_last_update(vu_feed tag);
 STATIC int wm_vuldet_oval_process(update_node *update, char *path, wm_vuldet_db *parsed_vulnerabilities);
 STATIC int wm_vuldet_json_rh_parser(cJSON *json_feed, wm_vuldet_db *parsed_vulnerabilities);
 
@@ -165,7 +254,7 @@ STATIC int wm_vuldet_get_oslinux_info(agent_software *agent);
 STATIC int wm_vuldet_request_hotfixes(sqlite3 *db, char *agent_id);
 STATIC void wm_vuldet_reset_tables(sqlite3 *db);
 STATIC int wm_vuldet_index_json(wm_vuldet_db *parsed_vulnerabilities, update_node *update, char *path, char multi_path);
-STATIC int wm_vuldet_index_nvd(sqlite3 *db, update_node *upd, nvd_vulnerability *nvd_it);
+STATIC int wm_vuldet_index_nvd(sqlite3 *db, update_node *upd, char **feeds);
 STATIC int wm_vuldet_index_redhat(sqlite3 *db, update_node *upd, rh_vulnerability *r_it);
 STATIC int wm_vuldet_clean_rh(sqlite3 *db);
 STATIC int wm_vuldet_clean_wcpe(sqlite3 *db);
@@ -178,7 +267,7 @@ STATIC int wm_vuldet_get_term_condition(char *i_term, char **term, char **comp_f
 STATIC void wm_vuldet_run_scan(wm_vuldet_t *vuldet);
 STATIC void wm_vuldet_run_sleep(wm_vuldet_t *vuldet);
 STATIC void wm_vuldet_init(wm_vuldet_t *vuldet);
-STATIC int wm_vuldet_select_scan_type(char *agent_id, time_t ignore_time, char *hotfix_config_enabled);
+STATIC int wm_vuldet_select_scan_type(char *agent_id, time_t ignore_time, time_t feed_update, char *hotfix_config_enabled);
 STATIC void wm_vuldet_update_last_scan(char *agent_id);
 STATIC char *wm_vuldet_get_hotfix_scan(char *agent_id);
 STATIC int wm_vuldet_get_last_software_scan(char *agent_id, char scan_id[OS_SIZE_128]);
@@ -189,10 +278,12 @@ STATIC void wm_vuldet_json_msu_parser_vuln(cJSON *json_feed, vu_msu_vul_entry **
 STATIC int wm_vulndet_insert_msu_dep_entry(sqlite3 *db, vu_msu_dep_entry *dep);
 STATIC void wm_vuln_check_msu_type(vu_msu_vul_entry *msu, cJSON *patchs);
 
-int wdb_sock = -1;
+__thread int wdb_sock = -1;
 int *vu_queue;
 // Define time to sleep between messages sent
 int usec;
+// The reports of all the scan workers share the queue to analysisd
+static pthread_mutex_t vu_report_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 const wm_context WM_VULNDETECTOR_CONTEXT = {
     "vulnerability-detector",
@@ -412,7 +503,94 @@ int wm_vuldet_check_update_period(update_node *upd) {
 }
 int wm_vuldet_sync_feed(update_node *upd) {
     int need_update = 1;
-    return wm_vuldet_fetch_feed(upd, &need_update) == OS_INVALID || (need_update && wm_vuldet_index_feed(upd));
+
+    if (wm_vuldet_fetch_feed(upd, &need_update) == OS_INVALID || (need_update && wm_vuldet_index_feed(upd))) {
+        return 1;
+    }
+
+    // The agents scanned with the previous content have to be fully scanned again
+    if (need_update) {
+        wm_vuldet_set_feed_update(upd->dist_tag_ref);
+    }
+
+    return 0;
+}
+
+int wm_vuldet_set_feed_update(vu_feed tag) {
+    sqlite3 *db;
+    sqlite3_stmt *stmt = NULL;
+
+    if (sqlite3_open_v2(CVE_DB, &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_FEED_UPDATE_ERROR, vu_feed_tag[tag]);
+        return wm_vuldet_sql_error(db, stmt);
+    }
+
+    if (wm_vuldet_prepare(db, vu_queries[VU_SET_FEED_UPDATE], -1, &stmt, NULL) != SQLITE_OK) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_FEED_UPDATE_ERROR, vu_feed_tag[tag]);
+        return wm_vuldet_sql_error(db, stmt);
+    }
+
+    sqlite3_bind_text(stmt, 1, vu_feed_tag[tag], -1, NULL);
+    sqlite3_bind_int64(stmt, 2, time(NULL));
+
+    if (wm_vuldet_step(stmt) != SQLITE_DONE) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_FEED_UPDATE_ERROR, vu_feed_tag[tag]);
+        return wm_vuldet_sql_error(db, stmt);
+    }
+
+    wdb_finalize(stmt);
+    sqlite3_close_v2(db);
+    return 0;
+}
+
+time_t wm_vuldet_get_feed_last_update(vu_feed tag) {
+    sqlite3 *db;
+    sqlite3_stmt *stmt = NULL;
+    time_t last_update = 0;
+
+    if (sqlite3_open_v2(CVE_DB, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        sqlite3_close_v2(db);
+        return 0;
+    }
+
+    if (wm_vuldet_prepare(db, vu_queries[VU_GET_FEED_LAST_UPDATE], -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, vu_feed_tag[tag], -1, NULL);
+
+        if (wm_vuldet_step(stmt) == SQLITE_ROW) {
+            last_update = (time_t) sqlite3_column_int64(stmt, 0);
+        }
+    }
+
+    wdb_finalize(stmt);
+    sqlite3_close_v2(db);
+    return last_update;
+}
+
+time_t wm_vuldet_get_feed_update(sqlite3 *db, agent_software *agent) {
+    sqlite3_stmt *stmt = NULL;
+    const char *target;
+    time_t feed_update = time(NULL);
+
+    if (wm_vuldet_prepare(db, vu_queries[VU_GET_FEED_UPDATE], -1, &stmt, NULL) != SQLITE_OK) {
+        wdb_finalize(stmt);
+        return feed_update;
+    }
+
+    target = vu_feed_tag[agent->dist == FEED_REDHAT ? FEED_REDHAT : agent->dist_ver];
+
+    // The NVD and the Wazuh CPE helper are used for every agent, the MSU only for Windows
+    sqlite3_bind_text(stmt, 1, target, -1, NULL);
+    sqlite3_bind_text(stmt, 2, vu_feed_tag[FEED_NVD], -1, NULL);
+    sqlite3_bind_text(stmt, 3, vu_feed_tag[FEED_CPEW], -1, NULL);
+    sqlite3_bind_text(stmt, 4, agent->dist == FEED_WIN ? vu_feed_tag[FEED_MSU] : target, -1, NULL);
+
+    // Feeds that were updated before they were recorded are taken as just changed
+    if (wm_vuldet_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        feed_update = (time_t) sqlite3_column_int64(stmt, 0);
+    }
+
+    wdb_finalize(stmt);
+    return feed_update;
 }
 
 int wm_vuldet_create_file(const char *path, const char *source) {
@@ -1387,6 +1565,8 @@ int wm_vuldet_send_cve_report(vu_report *report) {
             "exists");
     }
 
+    w_mutex_lock(&vu_report_mutex);
+
     if (wm_sendmsg(usec, *vu_queue, alert_msg, header, send_queue) < 0) {
         mterror(WM_VULNDETECTOR_LOGTAG, QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
         if ((*vu_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0) {
@@ -1394,6 +1574,8 @@ int wm_vuldet_send_cve_report(vu_report *report) {
         }
     }
 
+    w_mutex_unlock(&vu_report_mutex);
+
     retval = 0;
 end:
     os_free(str_json);
@@ -1853,79 +2035,192 @@ end:
     return retval;
 }
 
-int wm_vuldet_check_agent_vulnerabilities(agent_software *agents, wm_vuldet_flags *flags, time_t ignore_time) {
-    agent_software *agents_it;
-    sqlite3 *db;
+/* The tables filled for each agent are shadowed by temporary copies in the
+ * connection of each worker, so that the workers don't block each other on
+ * the CVE DB and the negative CPE indexes of each agent don't collide. The
+ * CPE index keeps the entries of the feeds. */
+STATIC int wm_vuldet_isolate_scan_tables(sqlite3 *db) {
     sqlite3_stmt *stmt = NULL;
     int result;
-    int i;
 
-    if (!agents) {
-        mtinfo(WM_VULNDETECTOR_LOGTAG, VU_AG_NO_TARGET);
-        return 0;
-    } else if (sqlite3_open_v2(CVE_DB, &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
-        mterror(WM_VULNDETECTOR_LOGTAG, VU_CVEDB_ERROR);
+    if (wm_vuldet_prepare(db, vu_queries[VU_SCAN_TABLES], -1, &stmt, NULL) != SQLITE_OK) {
         return wm_vuldet_sql_error(db, stmt);
     }
 
-    // Iterate agents to look for vulnerabilities
-    for (i = 0, agents_it = agents;; i++) {
-
-        mtinfo(WM_VULNDETECTOR_LOGTAG, VU_START_AG_AN, atoi(agents_it->agent_id));
-        time_t start = time(NULL);
-
-        // Check there is available vulnerabilities for this agent
-        if (agents_it->dist != FEED_WIN) {
-            result = wm_vuldet_db_empty(db, agents_it->dist_ver);
-            if (result == 0) {
-                // There is no data in the VULNERABILITIES table for this agent
-                // It has to be skipped instead of being scanned against the NVD to avoid false positives
-                mtwarn(WM_VULNDETECTOR_LOGTAG, VU_OVAL_UNAVAILABLE_DATA, atoi(agents_it->agent_id));
-                if (agents_it->next) {
-                    agents_it = agents_it->next;
-                    continue;
-                } else {
-                    break;
-                }
-            } else if (result == OS_INVALID) {
-                // DB error
-                break;
-            }
+    while (result = wm_vuldet_step(stmt), result == SQLITE_ROW) {
+        const char *sql = (const char *)sqlite3_column_text(stmt, 0);
+        char *tmp_sql;
+
+        if (!strncmp(sql, "CREATE TABLE ", 13)) {
+            tmp_sql = sqlite3_mprintf("CREATE TEMP TABLE %s", sql + 13);
+        } else if (!strncmp(sql, "CREATE INDEX ", 13)) {
+            tmp_sql = sqlite3_mprintf("CREATE INDEX temp.%s", sql + 13);
+        } else {
+            continue;
         }
 
-        // Reset the tables before scanning each agent
-        wm_vuldet_reset_tables(db);
+        result = sqlite3_exec(db, tmp_sql, NULL, NULL, NULL);
+        sqlite3_free(tmp_sql);
 
-        // First step: collect its software
-        if (result = wm_vuldet_get_software_info(agents_it, db, ignore_time, flags), result == OS_INVALID) {
-            mterror(WM_VULNDETECTOR_LOGTAG, VU_GET_SOFTWARE_ERROR, atoi(agents_it->agent_id));
-            break;
+        if (result != SQLITE_OK) {
+            return wm_vuldet_sql_error(db, stmt);
         }
+    }
 
-        // result == 2 skips the agent
-        // is used when no hotfixes are available or no packages have been marked for scanning
-        if (result != 2) {
-            // Second step: find and report vulnerabilities
-            if (wm_vuldet_report_agent_vulnerabilities(db, agents_it, flags) < 0) {
-                mterror(WM_VULNDETECTOR_LOGTAG, VU_REPORT_ERROR, atoi(agents_it->agent_id), sqlite3_errmsg(db));
-                break;
-            }
+    if (result != SQLITE_DONE) {
+        return wm_vuldet_sql_error(db, stmt);
+    }
+
+    wdb_finalize(stmt);
+
+    if (sqlite3_exec(db, vu_queries[VU_SCAN_COPY_CPES], NULL, NULL, NULL) != SQLITE_OK) {
+        return wm_vuldet_sql_error(db, NULL);
+    }
+
+    return 0;
+}
+
+/* Scan an agent. Returns 0 if the next agent can be scanned, OS_INVALID otherwise */
+STATIC int wm_vuldet_scan_agent(sqlite3 *db, agent_software *agent, wm_vuldet_flags *flags, time_t ignore_time) {
+    int result;
+
+    mtinfo(WM_VULNDETECTOR_LOGTAG, VU_START_AG_AN, atoi(agent->agent_id));
+    time_t start = time(NULL);
+
+    // Check there is available vulnerabilities for this agent
+    if (agent->dist != FEED_WIN) {
+        result = wm_vuldet_db_empty(db, agent->dist_ver);
+        if (result == 0) {
+            // There is no data in the VULNERABILITIES table for this agent
+            // It has to be skipped instead of being scanned against the NVD to avoid false positives
+            mtwarn(WM_VULNDETECTOR_LOGTAG, VU_OVAL_UNAVAILABLE_DATA, atoi(agent->agent_id));
+            return 0;
+        } else if (result == OS_INVALID) {
+            // DB error
+            return OS_INVALID;
         }
+    }
 
-        mtinfo(WM_VULNDETECTOR_LOGTAG, VU_AGENT_FINISH, atoi(agents_it->agent_id));
-        mtdebug1(WM_VULNDETECTOR_LOGTAG, VU_FUNCTION_TIME, time(NULL) - start, "scan", atoi(agents_it->agent_id));
+    // Reset the tables before scanning each agent
+    wm_vuldet_reset_tables(db);
 
-        if (agents_it->next) {
-            agents_it = agents_it->next;
-        } else {
+    // First step: collect its software
+    if (result = wm_vuldet_get_software_info(agent, db, ignore_time, flags), result == OS_INVALID) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_GET_SOFTWARE_ERROR, atoi(agent->agent_id));
+        return OS_INVALID;
+    }
+
+    // result == 2 skips the agent
+    // is used when no hotfixes are available or no packages have been marked for scanning
+    if (result != 2) {
+        // Second step: find and report vulnerabilities
+        if (wm_vuldet_report_agent_vulnerabilities(db, agent, flags) < 0) {
+            mterror(WM_VULNDETECTOR_LOGTAG, VU_REPORT_ERROR, atoi(agent->agent_id), sqlite3_errmsg(db));
+            return OS_INVALID;
+        }
+    }
+
+    mtinfo(WM_VULNDETECTOR_LOGTAG, VU_AGENT_FINISH, atoi(agent->agent_id));
+    mtdebug1(WM_VULNDETECTOR_LOGTAG, VU_FUNCTION_TIME, time(NULL) - start, "scan", atoi(agent->agent_id));
+
+    return 0;
+}
+
+STATIC agent_software *wm_vuldet_next_agent(vu_scan_pool *pool) {
+    agent_software *agent = NULL;
+
+    w_mutex_lock(&pool->mutex);
+
+    if (!pool->error && pool->next) {
+        agent = pool->next;
+        pool->next = agent->next;
+    }
+
+    w_mutex_unlock(&pool->mutex);
+    return agent;
+}
+
+STATIC void *wm_vuldet_scan_worker(void *data) {
+    vu_scan_pool *pool = data;
+    wm_vuldet_flags flags = pool->flags;
+    agent_software *agent;
+    sqlite3 *db;
+
+    if (sqlite3_open_v2(CVE_DB, &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_CVEDB_ERROR);
+        wm_vuldet_sql_error(db, NULL);
+        sqlite3_close_v2(db);
+        db = NULL;
+    } else if (pool->threads > 1 && wm_vuldet_isolate_scan_tables(db)) {
+        sqlite3_close_v2(db);
+        db = NULL;
+    }
+
+    if (!db) {
+        w_mutex_lock(&pool->mutex);
+        pool->error = 1;
+        w_mutex_unlock(&pool->mutex);
+        return NULL;
+    }
+
+    // Iterate agents to look for vulnerabilities
+    while (agent = wm_vuldet_next_agent(pool), agent) {
+        if (wm_vuldet_scan_agent(db, agent, &flags, pool->ignore_time)) {
+            w_mutex_lock(&pool->mutex);
+            pool->error = 1;
+            w_mutex_unlock(&pool->mutex);
             break;
         }
     }
 
     // Reset the tables
     wm_vuldet_reset_tables(db);
-
     sqlite3_close_v2(db);
+
+    if (pool->threads > 1) {
+        // The socket to wazuh-db belongs to this thread
+        wm_vuldet_close_wdb();
+    }
+
+    return NULL;
+}
+
+int wm_vuldet_check_agent_vulnerabilities(agent_software *agents, wm_vuldet_flags *flags, time_t ignore_time, unsigned int threads) {
+    vu_scan_pool pool = { .next = agents, .flags = *flags, .ignore_time = ignore_time, .threads = threads };
+    pthread_t *workers;
+    unsigned int i;
+
+    if (!agents) {
+        mtinfo(WM_VULNDETECTOR_LOGTAG, VU_AG_NO_TARGET);
+        return 0;
+    }
+
+    wm_vuldet_nvd_cache_init();
+
+    if (pool.threads <= 1) {
+        wm_vuldet_scan_worker(&pool);
+        wm_vuldet_nvd_cache_free();
+        return 0;
+    }
+
+    mtdebug1(WM_VULNDETECTOR_LOGTAG, "Scanning agents on %u threads.", pool.threads);
+    w_mutex_init(&pool.mutex, NULL);
+    os_calloc(pool.threads, sizeof(pthread_t), workers);
+
+    for (i = 0; i < pool.threads; i++) {
+        if (pthread_create(&workers[i], NULL, wm_vuldet_scan_worker, &pool)) {
+            merror_exit(THREAD_ERROR);
+        }
+    }
+
+    for (i = 0; i < pool.threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    os_free(workers);
+    w_mutex_destroy(&pool.mutex);
+    wm_vuldet_nvd_cache_free();
+
     return 0;
 }
 
@@ -2153,7 +2448,7 @@ int wm_vuldet_insert(wm_vuldet_db *parsed_oval, update_node *update) {
     info_test *test_it = parsed_oval->info_tests;
     info_cve *info_it = parsed_oval->info_cves;
     cpe_list *cpes_it = parsed_oval->nvd_cpes;
-    nvd_vulnerability *nvd_it = parsed_oval->nvd_vulnerabilities;
+    char **nvd_feeds = parsed_oval->nvd_feeds;
     vu_cpe_dic *w_cpes_it = parsed_oval->w_cpes;
     vu_msu_entries *msu_it = &parsed_oval->msu;
     variables *vars_it = parsed_oval->vars;
@@ -2220,12 +2515,11 @@ int wm_vuldet_insert(wm_vuldet_db *parsed_oval, update_node *update) {
         }
     }
 
-    if (nvd_it) {
+    if (nvd_feeds) {
         mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_INS_NVD_SEC);
-        if (wm_vuldet_index_nvd(db, update, nvd_it)) {
+        if (wm_vuldet_index_nvd(db, update, nvd_feeds)) {
             return OS_INVALID;
         }
-        parsed_oval->nvd_vulnerabilities = NULL;
     }
 
     // Adds the vulnerabilities
@@ -2589,7 +2883,8 @@ void wm_vuldet_add_vulnerability_info(wm_vuldet_db *ctrl_block) {
 }
 
 char *wm_vuldet_oval_xml_preparser(char *path, vu_feed dist) {
-    FILE *input, *output = NULL;
+    bzip2_file *input = NULL;
+    FILE *output = NULL;
     char buffer[OS_MAXSTR + 1];
     parser_state state = V_OVALDEFINITIONS;
     char *found;
@@ -2602,7 +2897,8 @@ char *wm_vuldet_oval_xml_preparser(char *path, vu_feed dist) {
 
     os_strdup(VU_FIT_TEMP_FILE, tmp_file);
 
-    if (input = fopen(path, "r" ), !input) {
+    // Compressed feeds are uncompressed as they are read
+    if (input = bzip2_open(path), !input) {
         mterror(WM_VULNDETECTOR_LOGTAG, VU_OPEN_FILE_ERROR, path);
         os_free(tmp_file);
         goto free_mem;
@@ -2612,7 +2908,7 @@ char *wm_vuldet_oval_xml_preparser(char *path, vu_feed dist) {
         goto free_mem;
     }
 
-    while (fgets(buffer, OS_MAXSTR, input)) {
+    while (bzip2_gets(buffer, OS_MAXSTR, input)) {
         if (dist == FEED_UBUNTU) { //5.11.1
             switch (state) {
                 case V_OBJECTS:
@@ -2676,8 +2972,10 @@ char *wm_vuldet_oval_xml_preparser(char *path, vu_feed dist) {
     }
 
 free_mem:
-    if (input) {
-        fclose(input);
+    // A feed that couldn't be read up to the end is discarded
+    if (input && bzip2_close(input)) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_OPEN_FILE_ERROR, path);
+        os_free(tmp_file);
     }
     if (output) {
         fclose(output);
@@ -2724,497 +3022,453 @@ void wm_vuldet_adapt_title(char *title, char *cve) {
     free(title_ofs);
 }
 
-int wm_vuldet_oval_xml_parser(OS_XML *xml, XML_NODE node, wm_vuldet_db *parsed_oval, update_node *update, vu_logic condition) {
-    int i, j;
-    int retval = 0;
-    int check = 0;
-    vulnerability *vuln;
-    XML_NODE chld_node = NULL;
-    vu_feed dist = update->dist_ref;
-
-    static const char *XML_OVAL_DEFINITIONS = "oval_definitions";
-    static const char *XML_GENERATOR = "generator";
-    static const char *XML_DEFINITIONS = "definitions";
-    static const char *XML_DEFINITION = "definition";
-    static const char *XML_OBJECTS = "objects";
-    static const char *XML_VARIABLES = "variables";
-    static const char *XML_CONST_VAR = "constant_variable";
-    static const char *XML_VALUE = "value";
-    static const char *XML_TITLE = "title";
-    static const char *XML_CLASS = "class";
-    static const char *XML_VULNERABILITY = "vulnerability"; //ub 15.11.1
-    static const char *XML_METADATA = "metadata";
-    static const char *XML_OVAL_DEF_METADATA = "oval-def:metadata";
-    static const char *XML_CRITERIA = "criteria";
-    static const char *XML_REFERENCE = "reference";
-    static const char *XML_REF_ID = "ref_id";
-    static const char *XML_REF_URL = "ref_url";
-    static const char *XML_OPERATOR = "operator";
-    static const char *XML_OR = "OR";
-    static const char *XML_AND = "AND";
-    static const char *XML_COMMENT = "comment";
-    static const char *XML_CRITERION = "criterion";
-    static const char *XML_TEST_REF = "test_ref";
-    static const char *XML_TESTS = "tests";
-    static const char *XML_DPKG_LINUX_INFO_TEST = "linux-def:dpkginfo_test";
-    static const char *XML_DPKG_LINUX_INFO_OBJ = "linux-def:dpkginfo_object";
-    static const char *XML_DPKG_LINUX_INFO_DEB_OBJ = "dpkginfo_object";
-    static const char *XML_DPKG_INFO_TEST = "dpkginfo_test";
-    static const char *XML_ID = "id";
-    static const char *XML_LINUX_STATE = "linux-def:state";
-    static const char *XML_LINUX_NAME = "linux-def:name";
-    static const char *XML_VAR_REF = "var_ref";
-    static const char *XML_VAR_CHECK = "var_check";
-    static const char *XML_LINUX_DEB_NAME = "name";
-    static const char *XML_LINUX_OBJ = "linux-def:object";
-    static const char *XML_LINUX_DEB_OBJ = "object";
-    static const char *XML_STATE = "state";
-    static const char *XML_STATE_REF = "state_ref";
-    static const char *XML_OBJECT_REF = "object_ref";
-    static const char *XML_STATES = "states";
-    static const char *XML_DPKG_LINUX_INFO_STATE = "linux-def:dpkginfo_state";
-    static const char *XML_DPKG_INFO_STATE = "dpkginfo_state";
-    static const char *XML_LINUX_DEF_EVR = "linux-def:evr";
-    static const char *XML_EVR = "evr";
-    static const char *XML_OPERATION = "operation";
-    static const char *XML_DATATYPE = "datatype";
-    static const char *XML_OVAL_PRODUCT_NAME = "oval:product_name";
-    static const char *XML_OVAL_PRODUCT_VERSION = "oval:product_version";
-    static const char *XML_OVAL_SCHEMA_VERSION = "oval:schema_version";
-    static const char *XML_OVAL_TIMESTAMP = "oval:timestamp";
-    static const char *XML_ADVISORY = "advisory";
-    static const char *XML_SEVERITY = "severity";
-    static const char *XML_PUBLIC_DATE = "public_date";
-    static const char *XML_BUG = "bug";
-    static const char *XML_REF = "ref";
-    static const char *XML_UPDATED = "updated";
-    static const char *XML_DESCRIPTION = "description";
-    static const char *XML_DATE = "date";
-    static const char *XML_DATES = "dates";
-    static const char *XML_OVAL_DEF_DATES = "oval-def:dates";
-    static const char *XML_DEBIAN = "debian";
-    static const char *XML_OVAL_REPOSITORY = "oval_repository";
-    static const char *XML_OVAL_DEF_OV_REPO = "oval-def:oval_repository";
-
-    for (i = 0; node[i]; i++) {
-        chld_node = NULL;
-        if (!node[i]->element) {
-            mterror(WM_VULNDETECTOR_LOGTAG, XML_ELEMNULL);
-            return OS_INVALID;
+/* The feed is read element by element. An element that holds others is
+ * handled when it's opened, and sets how its children are read: whether they
+ * are parsed at all and the condition they belong to. The rest are handled
+ * when they are closed, as they need their content. Only the branch being
+ * read is kept in memory. */
+typedef struct oval_frame {
+    vu_logic condition;         // Condition of the children
+    int descend;                // The children are parsed
+    int required;               // The element must have children
+    int children;               // Children read
+    variables *vars;            // Constant variable whose values are the children
+} oval_frame;
+
+typedef struct oval_stream {
+    wm_vuldet_db *parsed_oval;
+    vu_feed dist;
+    oval_frame *stack;          // Frame of each open element, by depth
+    unsigned int size;
+    unsigned int roots;         // Root elements read
+} oval_stream;
+
+static const char *XML_OVAL_DEFINITIONS = "oval_definitions";
+static const char *XML_GENERATOR = "generator";
+static const char *XML_DEFINITIONS = "definitions";
+static const char *XML_DEFINITION = "definition";
+static const char *XML_OBJECTS = "objects";
+static const char *XML_VARIABLES = "variables";
+static const char *XML_CONST_VAR = "constant_variable";
+static const char *XML_VALUE = "value";
+static const char *XML_TITLE = "title";
+static const char *XML_CLASS = "class";
+static const char *XML_VULNERABILITY = "vulnerability"; //ub 15.11.1
+static const char *XML_METADATA = "metadata";
+static const char *XML_OVAL_DEF_METADATA = "oval-def:metadata";
+static const char *XML_CRITERIA = "criteria";
+static const char *XML_REFERENCE = "reference";
+static const char *XML_REF_ID = "ref_id";
+static const char *XML_REF_URL = "ref_url";
+static const char *XML_OPERATOR = "operator";
+static const char *XML_OR = "OR";
+static const char *XML_AND = "AND";
+static const char *XML_COMMENT = "comment";
+static const char *XML_CRITERION = "criterion";
+static const char *XML_TEST_REF = "test_ref";
+static const char *XML_TESTS = "tests";
+static const char *XML_DPKG_LINUX_INFO_TEST = "linux-def:dpkginfo_test";
+static const char *XML_DPKG_LINUX_INFO_OBJ = "linux-def:dpkginfo_object";
+static const char *XML_DPKG_LINUX_INFO_DEB_OBJ = "dpkginfo_object";
+static const char *XML_DPKG_INFO_TEST = "dpkginfo_test";
+static const char *XML_ID = "id";
+static const char *XML_LINUX_STATE = "linux-def:state";
+static const char *XML_LINUX_NAME = "linux-def:name";
+static const char *XML_VAR_REF = "var_ref";
+static const char *XML_VAR_CHECK = "var_check";
+static const char *XML_LINUX_DEB_NAME = "name";
+static const char *XML_LINUX_OBJ = "linux-def:object";
+static const char *XML_LINUX_DEB_OBJ = "object";
+static const char *XML_STATE = "state";
+static const char *XML_STATE_REF = "state_ref";
+static const char *XML_OBJECT_REF = "object_ref";
+static const char *XML_STATES = "states";
+static const char *XML_DPKG_LINUX_INFO_STATE = "linux-def:dpkginfo_state";
+static const char *XML_DPKG_INFO_STATE = "dpkginfo_state";
+static const char *XML_LINUX_DEF_EVR = "linux-def:evr";
+static const char *XML_EVR = "evr";
+static const char *XML_OPERATION = "operation";
+static const char *XML_DATATYPE = "datatype";
+static const char *XML_OVAL_PRODUCT_NAME = "oval:product_name";
+static const char *XML_OVAL_PRODUCT_VERSION = "oval:product_version";
+static const char *XML_OVAL_SCHEMA_VERSION = "oval:schema_version";
+static const char *XML_OVAL_TIMESTAMP = "oval:timestamp";
+static const char *XML_ADVISORY = "advisory";
+static const char *XML_SEVERITY = "severity";
+static const char *XML_PUBLIC_DATE = "public_date";
+static const char *XML_BUG = "bug";
+static const char *XML_REF = "ref";
+static const char *XML_UPDATED = "updated";
+static const char *XML_DESCRIPTION = "description";
+static const char *XML_DATE = "date";
+static const char *XML_DATES = "dates";
+static const char *XML_OVAL_DEF_DATES = "oval-def:dates";
+static const char *XML_DEBIAN = "debian";
+static const char *XML_OVAL_REPOSITORY = "oval_repository";
+static const char *XML_OVAL_DEF_OV_REPO = "oval-def:oval_repository";
+
+// Get the value of an attribute of a node, or NULL
+static const char *wm_vuldet_oval_attr(const xml_node *node, const char *name) {
+    int i;
+
+    for (i = 0; node->attributes && node->attributes[i]; i++) {
+        if (!strcmp(node->attributes[i], name)) {
+            return node->values[i];
         }
+    }
 
-        if ((dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_DPKG_LINUX_INFO_STATE)) ||
-            (dist == FEED_DEBIAN && !strcmp(node[i]->element, XML_DPKG_INFO_STATE))) {
-            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                goto invalid_elem;
-            }
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_ID)) {
-                    info_state *infos;
-                    os_calloc(1, sizeof(info_state), infos);
-                    os_strdup(node[i]->values[j], infos->id);
-                    infos->operation = infos->operation_value = NULL;
-                    infos->prev = parsed_oval->info_states;
-                    parsed_oval->info_states = infos;
-                    if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, condition) == OS_INVALID) {
-                        goto end;
-                    }
-                }
-            }
-        } else if (!strcmp(node[i]->element, XML_CONST_VAR)) {
-            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                goto invalid_elem;
-            }
-            if (node[i]->attributes && node[i]->values) {
-                variables *vars = NULL;
-
-                for (j = 0; node[i]->attributes[j] && node[i]->values[j]; j++) {
-                    if (!strcmp(node[i]->attributes[j], XML_ID)) {
-                        os_calloc(1, sizeof(variables), vars);
-                        os_strdup(node[i]->values[j], vars->id);
-                        vars->prev = parsed_oval->vars;
-                        parsed_oval->vars =vars;
-
-                        for (j = 0; chld_node[j] && chld_node[j]->element &&
-                                    !strcmp(chld_node[j]->element, XML_VALUE) &&
-                                    chld_node[j]->content; j++) {
-                            os_realloc(vars->values, (j + 2) * sizeof(char *), vars->values);
-                            os_strdup(chld_node[j]->content, vars->values[j]);
-                            vars->values[j + 1] = NULL;
-                        }
+    return NULL;
+}
 
-                        vars->elements = j;
-                        break;
-                    }
-                }
-            }
-        } else if ((dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_DPKG_LINUX_INFO_TEST)) ||
-                   (dist == FEED_DEBIAN && !strcmp(node[i]->element, XML_DPKG_INFO_TEST))) {
-            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                goto invalid_elem;
-            }
-            info_test *infot;
-            os_calloc(1, sizeof(info_test), infot);
-            infot->state = NULL;
-            infot->prev = parsed_oval->info_tests;
-            parsed_oval->info_tests = infot;
+static void wm_vuldet_oval_add_ref(references **refs, const char *value) {
+    if (!*refs) {
+        os_calloc(1, sizeof(references), *refs);
+    }
 
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_ID)) {
-                    os_strdup(node[i]->values[j], parsed_oval->info_tests->id);
-                }
-            }
-            if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, VU_PACKG) == OS_INVALID) {
-                goto end;
-            }
-        } else if ((dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_DPKG_LINUX_INFO_OBJ)) ||
-                   (dist == FEED_DEBIAN && !strcmp(node[i]->element, XML_DPKG_LINUX_INFO_DEB_OBJ))) {
-            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                goto invalid_elem;
-            }
+    os_realloc((*refs)->values, ((*refs)->elements + 2) * sizeof(char *), (*refs)->values);
+    os_strdup(value, (*refs)->values[(*refs)->elements]);
+    (*refs)->values[++(*refs)->elements] = NULL;
+}
 
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_ID)) {
-                    info_obj *info_o;
-                    os_calloc(1, sizeof(info_obj), info_o);
-                    os_strdup(node[i]->values[j], info_o->id);
-                    info_o->prev = parsed_oval->info_objs;
-                    parsed_oval->info_objs = info_o;
-                    if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, VU_OBJ) == OS_INVALID) {
-                        goto end;
-                    }
-                }
+// Handle an element that holds others, as it's opened
+int wm_vuldet_oval_xml_start(xml_node *node, unsigned int depth, void *data) {
+    oval_stream *stream = data;
+    wm_vuldet_db *parsed_oval = stream->parsed_oval;
+    vu_feed dist = stream->dist;
+    oval_frame *frame;
+    oval_frame *parent;
+    vu_logic condition;
+    const char *value;
+    int i;
+
+    if (depth >= stream->size) {
+        os_realloc(stream->stack, (depth + 16) * sizeof(oval_frame), stream->stack);
+        stream->size = depth + 16;
+    }
+
+    frame = stream->stack + depth;
+    memset(frame, 0, sizeof(oval_frame));
+
+    // The children of the first root element are the ones to parse
+    if (depth == 0) {
+        frame->descend = !stream->roots++;
+        frame->condition = VU_TRUE;
+        return 0;
+    }
+
+    parent = stream->stack + depth - 1;
+    parent->children++;
+
+    if (!parent->descend) {
+        return 0;
+    }
+
+    condition = parent->condition;
+
+    if ((dist == FEED_UBUNTU && !strcmp(node->element, XML_DPKG_LINUX_INFO_STATE)) ||
+        (dist == FEED_DEBIAN && !strcmp(node->element, XML_DPKG_INFO_STATE))) {
+        frame->required = 1;
+
+        if (value = wm_vuldet_oval_attr(node, XML_ID), value) {
+            info_state *infos;
+            os_calloc(1, sizeof(info_state), infos);
+            os_strdup(value, infos->id);
+            infos->prev = parsed_oval->info_states;
+            parsed_oval->info_states = infos;
+            frame->descend = 1;
+            frame->condition = condition;
+        }
+    } else if (!strcmp(node->element, XML_CONST_VAR)) {
+        frame->required = 1;
+
+        if (value = wm_vuldet_oval_attr(node, XML_ID), value) {
+            variables *vars;
+            os_calloc(1, sizeof(variables), vars);
+            os_strdup(value, vars->id);
+            vars->prev = parsed_oval->vars;
+            parsed_oval->vars = vars;
+            frame->vars = vars;
+        }
+    } else if ((dist == FEED_UBUNTU && !strcmp(node->element, XML_DPKG_LINUX_INFO_TEST)) ||
+               (dist == FEED_DEBIAN && !strcmp(node->element, XML_DPKG_INFO_TEST))) {
+        info_test *infot;
+        os_calloc(1, sizeof(info_test), infot);
+        infot->prev = parsed_oval->info_tests;
+        parsed_oval->info_tests = infot;
+
+        if (value = wm_vuldet_oval_attr(node, XML_ID), value) {
+            os_strdup(value, infot->id);
+        }
+
+        frame->required = 1;
+        frame->descend = 1;
+        frame->condition = VU_PACKG;
+    } else if ((dist == FEED_UBUNTU && !strcmp(node->element, XML_DPKG_LINUX_INFO_OBJ)) ||
+               (dist == FEED_DEBIAN && !strcmp(node->element, XML_DPKG_LINUX_INFO_DEB_OBJ))) {
+        frame->required = 1;
+        frame->descend = 1;
+        frame->condition = VU_PACKG;
+
+        if (value = wm_vuldet_oval_attr(node, XML_ID), value) {
+            info_obj *info_o;
+            os_calloc(1, sizeof(info_obj), info_o);
+            os_strdup(value, info_o->id);
+            info_o->prev = parsed_oval->info_objs;
+            parsed_oval->info_objs = info_o;
+            frame->condition = VU_OBJ;
+        }
+    } else if (!strcmp(node->element, XML_DEFINITION)) {
+        frame->required = 1;
+
+        if (value = wm_vuldet_oval_attr(node, XML_CLASS), value && !strcmp(value, XML_VULNERABILITY)) {
+            vulnerability *vuln;
+            info_cve *cves;
+            os_calloc(1, sizeof(vulnerability), vuln);
+            os_calloc(1, sizeof(info_cve), cves);
+
+            vuln->prev = parsed_oval->vulnerabilities;
+            cves->prev = parsed_oval->info_cves;
+            parsed_oval->vulnerabilities = vuln;
+            parsed_oval->info_cves = cves;
+            frame->descend = 1;
+            frame->condition = condition;
+        }
+    } else if (!strcmp(node->element, XML_CRITERIA)) {
+        if (!node->attributes) {
+            frame->required = 1;
+            frame->descend = 1;
+            frame->condition = condition;
+        } else if (value = wm_vuldet_oval_attr(node, XML_OPERATOR), value) {
+            if (!strcmp(value, XML_OR)) {
+                frame->condition = VU_OR;
+            } else if (!strcmp(value, XML_AND)) {
+                frame->condition = VU_AND;
+            } else {
+                mterror(WM_VULNDETECTOR_LOGTAG, VU_INVALID_OPERATOR, value);
+                return OS_INVALID;
             }
-            if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, VU_PACKG) == OS_INVALID) {
-                goto end;
+
+            frame->descend = 1;
+        } else if (*node->values && !strcmp(*node->attributes, XML_COMMENT) && !strcmp(*node->values, "file version")) {
+            // Checks for version comparasions without operators
+            frame->descend = 1;
+            frame->condition = VU_AND;
+        }
+    } else {
+        static const char **containers[] = {
+            &XML_OVAL_DEFINITIONS, &XML_DEFINITIONS, &XML_OBJECTS, &XML_VARIABLES, &XML_METADATA,
+            &XML_OVAL_DEF_METADATA, &XML_TESTS, &XML_STATES, &XML_ADVISORY, &XML_DEBIAN, &XML_GENERATOR,
+            &XML_OVAL_REPOSITORY, &XML_OVAL_DEF_OV_REPO, &XML_DATES, &XML_OVAL_DEF_DATES
+        };
+
+        for (i = 0; i < (int)(sizeof(containers) / sizeof(containers[0])); i++) {
+            if (!strcmp(node->element, *containers[i])) {
+                frame->required = 1;
+                frame->descend = 1;
+                frame->condition = condition;
+                break;
             }
-        } else if (condition == VU_OBJ && ((dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_LINUX_NAME)) ||
-                   (dist == FEED_DEBIAN && !strcmp(node[i]->element, XML_LINUX_DEB_NAME)))) {
-            if (node[i]->content && *node[i]->content) {
-                w_strdup(node[i]->content, parsed_oval->info_objs->obj);
-            } else {
-                if (node[i]->attributes && node[i]->values) {
-                    int j;
-                    char *var_check = NULL;
-                    char *var_ref = NULL;
+        }
+    }
 
-                    for (j = 0; node[i]->attributes[j] && node[i]->values[j]; j++) {
-                        if (!strcmp(node[i]->attributes[j], XML_VAR_REF)) {
-                            if (!var_ref) {
-                                os_strdup(node[i]->values[j], var_ref);
-                            }
-                        } else if (!strcmp(node[i]->attributes[j], XML_VAR_CHECK)) {
-                            if (!var_check) {
-                                os_strdup(node[i]->values[j], var_check);
-                            }
-                        }
-                    }
+    return 0;
+}
 
-                    if (!var_check || !var_ref) {
-                        mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_OVAL_OBJ_INV, "Parameters 'var_check' and 'var_ref' were expected");
-                    } else {
-                        if (!strcmp(var_check, "at least one")) {
-                            parsed_oval->info_objs->need_vars = 1;
-                            parsed_oval->info_objs->obj = var_ref;
-                            var_ref = NULL;
-                        } else {
-                            char error_msg[OS_SIZE_128];
-                            snprintf(error_msg, OS_SIZE_128, "Unexpected var_check: '%s'", var_check);
-                            mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_OVAL_OBJ_INV, error_msg);
-                        }
-                    }
-                    free(var_ref);
-                    free(var_check);
-                } else {
-                    mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_OVAL_OBJ_INV, "Empty object");
-                }
-            }
-        } else if ((dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_LINUX_DEF_EVR)) ||
-                   (dist == FEED_DEBIAN && !strcmp(node[i]->element, XML_EVR))) {
-            if (node[i]->attributes && *node[i]->attributes) {
-                for (j = 0; node[i]->attributes[j]; j++) {
-                    if (!strcmp(node[i]->attributes[j], XML_OPERATION)) {
-                        os_strdup(node[i]->values[j], parsed_oval->info_states->operation);
-                        os_strdup(node[i]->content, parsed_oval->info_states->operation_value);
-                    }
-                }
-                if (!parsed_oval->info_states->operation && !strcmp(*node[i]->attributes, XML_DATATYPE) && !strcmp(*node[i]->values, "version")) {
-                    os_strdup(vu_package_comp[VU_COMP_EQ], parsed_oval->info_states->operation);
-                    os_strdup(node[i]->content, parsed_oval->info_states->operation_value);
-                }
+// Handle an element that doesn't hold others, as it's closed
+int wm_vuldet_oval_xml_end(xml_node *node, unsigned int depth, void *data) {
+    oval_stream *stream = data;
+    wm_vuldet_db *parsed_oval = stream->parsed_oval;
+    vu_feed dist = stream->dist;
+    oval_frame *parent;
+    vu_logic condition;
+    const char *value;
+    int j;
+
+    if (stream->stack[depth].required && !stream->stack[depth].children) {
+        mterror(WM_VULNDETECTOR_LOGTAG, XML_INVELEM, node->element);
+        return OS_INVALID;
+    }
+
+    if (depth == 0) {
+        return 0;
+    }
+
+    parent = stream->stack + depth - 1;
+
+    // The values of a constant variable are its first children
+    if (parent->vars) {
+        variables *vars = parent->vars;
+
+        if (!strcmp(node->element, XML_VALUE)) {
+            os_realloc(vars->values, (vars->elements + 2) * sizeof(char *), vars->values);
+            os_strdup(node->content, vars->values[vars->elements]);
+            vars->values[++vars->elements] = NULL;
+        } else {
+            parent->vars = NULL;
+        }
+
+        return 0;
+    }
+
+    if (!parent->descend) {
+        return 0;
+    }
 
+    condition = parent->condition;
+
+    if (condition == VU_OBJ && ((dist == FEED_UBUNTU && !strcmp(node->element, XML_LINUX_NAME)) ||
+        (dist == FEED_DEBIAN && !strcmp(node->element, XML_LINUX_DEB_NAME)))) {
+        if (*node->content) {
+            w_strdup(node->content, parsed_oval->info_objs->obj);
+        } else if (node->attributes) {
+            const char *var_check = wm_vuldet_oval_attr(node, XML_VAR_CHECK);
+            const char *var_ref = wm_vuldet_oval_attr(node, XML_VAR_REF);
+
+            if (!var_check || !var_ref) {
+                mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_OVAL_OBJ_INV, "Parameters 'var_check' and 'var_ref' were expected");
+            } else if (!strcmp(var_check, "at least one")) {
+                parsed_oval->info_objs->need_vars = 1;
+                os_strdup(var_ref, parsed_oval->info_objs->obj);
+            } else {
+                char error_msg[OS_SIZE_128];
+                snprintf(error_msg, OS_SIZE_128, "Unexpected var_check: '%s'", var_check);
+                mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_OVAL_OBJ_INV, error_msg);
             }
-        } else if ((condition == VU_PACKG) &&
-                   ((dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_LINUX_STATE)) ||
-                   (dist == FEED_DEBIAN && !strcmp(node[i]->element, XML_STATE)))) {
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_STATE_REF)) {
-                    if (!parsed_oval->info_tests->state) {
-                        os_strdup(node[i]->values[j], parsed_oval->info_tests->state);
-                    }
+        } else {
+            mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_OVAL_OBJ_INV, "Empty object");
+        }
+    } else if ((dist == FEED_UBUNTU && !strcmp(node->element, XML_LINUX_DEF_EVR)) ||
+               (dist == FEED_DEBIAN && !strcmp(node->element, XML_EVR))) {
+        if (node->attributes && *node->attributes && parsed_oval->info_states) {
+            for (j = 0; node->attributes[j]; j++) {
+                if (!strcmp(node->attributes[j], XML_OPERATION)) {
+                    os_strdup(node->values[j], parsed_oval->info_states->operation);
+                    os_strdup(node->content, parsed_oval->info_states->operation_value);
                 }
             }
-        } else if ((condition == VU_PACKG) &&
-                   ((dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_LINUX_OBJ)) ||
-                   (dist == FEED_DEBIAN && !strcmp(node[i]->element, XML_LINUX_DEB_OBJ)))) {
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_OBJECT_REF)) {
-                    if (!parsed_oval->info_tests->obj) {
-                        os_strdup(node[i]->values[j], parsed_oval->info_tests->obj);
-                    }
+            if (!parsed_oval->info_states->operation && !strcmp(*node->attributes, XML_DATATYPE) && !strcmp(*node->values, "version")) {
+                os_strdup(vu_package_comp[VU_COMP_EQ], parsed_oval->info_states->operation);
+                os_strdup(node->content, parsed_oval->info_states->operation_value);
+            }
+        }
+    } else if ((condition == VU_PACKG) &&
+               ((dist == FEED_UBUNTU && !strcmp(node->element, XML_LINUX_STATE)) ||
+               (dist == FEED_DEBIAN && !strcmp(node->element, XML_STATE)))) {
+        if (value = wm_vuldet_oval_attr(node, XML_STATE_REF), value && parsed_oval->info_tests && !parsed_oval->info_tests->state) {
+            os_strdup(value, parsed_oval->info_tests->state);
+        }
+    } else if ((condition == VU_PACKG) &&
+               ((dist == FEED_UBUNTU && !strcmp(node->element, XML_LINUX_OBJ)) ||
+               (dist == FEED_DEBIAN && !strcmp(node->element, XML_LINUX_DEB_OBJ)))) {
+        if (value = wm_vuldet_oval_attr(node, XML_OBJECT_REF), value && parsed_oval->info_tests && !parsed_oval->info_tests->obj) {
+            os_strdup(value, parsed_oval->info_tests->obj);
+        }
+    } else if (!parsed_oval->info_cves) {
+        // The rest belong to the definition of a vulnerability, or to the metadata
+        if (!strcmp(node->element, XML_OVAL_PRODUCT_VERSION)) {
+            os_strdup(node->content, parsed_oval->metadata.product_version);
+        } else if (!strcmp(node->element, XML_OVAL_PRODUCT_NAME)) {
+            os_strdup(node->content, parsed_oval->metadata.product_name);
+        } else if (!strcmp(node->element, XML_OVAL_TIMESTAMP)) {
+            os_strdup(node->content, parsed_oval->metadata.timestamp);
+        } else if (!strcmp(node->element, XML_OVAL_SCHEMA_VERSION)) {
+            os_strdup(node->content, parsed_oval->metadata.schema_version);
+        }
+    } else if (!strcmp(node->element, XML_REFERENCE)) {
+        for (j = 0; node->attributes && node->attributes[j]; j++) {
+            if (!strcmp(node->attributes[j], XML_REF_URL)) {
+                wm_vuldet_oval_add_ref(&parsed_oval->info_cves->refs, node->values[j]);
+            } else if (!strcmp(node->attributes[j], XML_REF_ID)){
+                if (!parsed_oval->info_cves->cveid) {
+                    os_strdup(node->values[j], parsed_oval->info_cves->cveid);
+                }
+                if (!parsed_oval->vulnerabilities->cve_id) {
+                    os_strdup(node->values[j], parsed_oval->vulnerabilities->cve_id);
                 }
             }
-        } else if (!strcmp(node[i]->element, XML_DEFINITION)) {
-            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                goto invalid_elem;
+        }
+    } else if (!strcmp(node->element, XML_TITLE)) {
+        os_strdup(node->content, parsed_oval->info_cves->title);
+        // Debian Wheezy OVAL has its CVE of the title
+        if (dist == FEED_DEBIAN && !strcmp(parsed_oval->OS, vu_feed_tag[FEED_WHEEZY])) {
+            if (!parsed_oval->info_cves->cveid) {
+                os_strdup(node->content, parsed_oval->info_cves->cveid);
+            }
+            if (!parsed_oval->vulnerabilities->cve_id) {
+                os_strdup(node->content, parsed_oval->vulnerabilities->cve_id);
             }
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_CLASS) &&
-                    !strcmp(node[i]->values[j], XML_VULNERABILITY)) {
+        }
+    } else if (!strcmp(node->element, XML_CRITERION)) {
+        for (j = 0; node->attributes && node->attributes[j]; j++) {
+            if (!strcmp(node->attributes[j], XML_TEST_REF)) {
+                if (parsed_oval->vulnerabilities->state_id) {
                     vulnerability *vuln;
-                    info_cve *cves;
                     os_calloc(1, sizeof(vulnerability), vuln);
-                    os_calloc(1, sizeof(info_cve), cves);
-
-                    vuln->cve_id = NULL;
-                    vuln->state_id = NULL;
-                    vuln->ignore = 0;
-                    vuln->package_name = NULL;
+                    os_strdup(parsed_oval->vulnerabilities->cve_id, vuln->cve_id);
                     vuln->prev = parsed_oval->vulnerabilities;
-                    cves->cveid = NULL;
-                    cves->title = NULL;
-                    cves->severity = NULL;
-                    cves->published = NULL;
-                    cves->updated = NULL;
-                    cves->refs = NULL;
-                    cves->flags = 0;
-                    cves->prev = parsed_oval->info_cves;
-
                     parsed_oval->vulnerabilities = vuln;
-                    parsed_oval->info_cves = cves;
-
-                    if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, condition) == OS_INVALID) {
-                        retval = OS_INVALID;
-                        goto end;
-                    }
-                }
-            }
-        } else if (!strcmp(node[i]->element, XML_REFERENCE)) {
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_REF_URL)) {
-                    if (!parsed_oval->info_cves->refs)
-                        os_calloc(1, sizeof(references), parsed_oval->info_cves->refs);
-
-                    references *refs = parsed_oval->info_cves->refs;
-                    os_realloc(refs->values, (refs->elements + 2) * sizeof(char *), refs->values);
-                    os_strdup(node[i]->values[j], refs->values[refs->elements]);
-                    refs->values[++refs->elements] = NULL;
-                } else if (!strcmp(node[i]->attributes[j], XML_REF_ID)){
-                    if (!parsed_oval->info_cves->cveid) {
-                        os_strdup(node[i]->values[j], parsed_oval->info_cves->cveid);
-                    }
-                    if (!parsed_oval->vulnerabilities->cve_id) {
-                        os_strdup(node[i]->values[j], parsed_oval->vulnerabilities->cve_id);
-                    }
-                }
-            }
-        } else if (!strcmp(node[i]->element, XML_TITLE)) {
-                os_strdup(node[i]->content, parsed_oval->info_cves->title);
-                // Debian Wheezy OVAL has its CVE of the title
-                if (dist == FEED_DEBIAN && !strcmp(parsed_oval->OS, vu_feed_tag[FEED_WHEEZY])) {
-                    if (!parsed_oval->info_cves->cveid) {
-                        os_strdup(node[i]->content, parsed_oval->info_cves->cveid);
-                    }
-                    if (!parsed_oval->vulnerabilities->cve_id) {
-                        os_strdup(node[i]->content, parsed_oval->vulnerabilities->cve_id);
-                    }
-                }
-        } else if (!strcmp(node[i]->element, XML_CRITERIA)) {
-            if (!node[i]->attributes) {
-                if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                    goto invalid_elem;
-                }
-                if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, condition) == OS_INVALID) {
-                    retval = OS_INVALID;
-                    goto end;
-                }
-            } else {
-                char operator_found = 0;
-                for (j = 0; node[i]->attributes[j]; j++) {
-                    if (!strcmp(node[i]->attributes[j], XML_OPERATOR)) {
-                        int result = VU_TRUE;
-                        operator_found = 1;
-                        if (!strcmp(node[i]->values[j], XML_OR)) {
-                            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                                continue;
-                            } else if (result = wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, VU_OR), result == OS_INVALID) {
-                                retval = OS_INVALID;
-                                goto end;
-                            }
-                            if (result == VU_TRUE) {
-                                retval = VU_TRUE;
-                                check = 1;
-                            }
-
-                        } else if (!strcmp(node[i]->values[j], XML_AND)) {
-                            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                                continue;
-                            } else if (result = wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, VU_AND), result == OS_INVALID) {
-                                retval = OS_INVALID;
-                                goto end;
-                            }
-                        } else {
-                            mterror(WM_VULNDETECTOR_LOGTAG, VU_INVALID_OPERATOR, node[i]->values[j]);
-                            retval = OS_INVALID;
-                            goto end;
-                        }
-
-                        if (result == VU_FALSE) {
-                            if (condition == VU_AND) {
-                                retval = VU_FALSE;
-                                goto end;
-                            } else if (condition == VU_OR && !check) {
-                                retval = VU_FALSE;
-                            }
-                        }
-                    }
-                }
-                // Checks for version comparasions without operators
-                if (!operator_found && node[i]->attributes && node[i]->values &&
-                    *node[i]->attributes && *node[i]->values &&
-                    !strcmp(*node[i]->attributes, XML_COMMENT) &&
-                    !strcmp(*node[i]->values, "file version")) {
-                    if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                        continue;
-                    } else if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, VU_AND) == OS_INVALID) {
-                        retval = OS_INVALID;
-                        goto end;
-                    }
+                    os_strdup(node->values[j], vuln->state_id);
+                } else {
+                    os_strdup(node->values[j], parsed_oval->vulnerabilities->state_id);
                 }
             }
-        } else if (!strcmp(node[i]->element, XML_CRITERION)) {
-            for (j = 0; node[i]->attributes[j]; j++) {
-                if (!strcmp(node[i]->attributes[j], XML_TEST_REF)) {
-                    if (parsed_oval->vulnerabilities->state_id) {
-                        os_calloc(1, sizeof(vulnerability), vuln);
-                        os_strdup(parsed_oval->vulnerabilities->cve_id, vuln->cve_id);
-                        vuln->prev = parsed_oval->vulnerabilities;
-                        vuln->state_id = NULL;
-                        vuln->ignore = 0;
-                        vuln->package_name = NULL;
-                        parsed_oval->vulnerabilities = vuln;
-                        os_strdup(node[i]->values[j], vuln->state_id);
+            // Checks if the package isn't vulnerable
+            else if (!strcmp(node->attributes[j], XML_COMMENT)) {
+                STATIC const char not_vulnerable[] = "while related to the CVE in some way, a decision has been made to ignore this issue";
+                STATIC const char needs_triage[] = "is affected and may need fixing";
+                STATIC const char deferred[] = "is affected, but a decision has been made to defer addressing it";
+
+                // Just for Ubuntu, where comment comes after test_ref
+                if (parsed_oval->vulnerabilities->state_id) {
+                    if (strstr(node->values[j], not_vulnerable)) {
+                        parsed_oval->vulnerabilities->ignore = 2;
+                    } else if (strstr(node->values[j], needs_triage) || strstr(node->values[j], deferred)) {
+                        parsed_oval->vulnerabilities->ignore = 1;
                     } else {
-                        os_strdup(node[i]->values[j], parsed_oval->vulnerabilities->state_id);
-                    }
-                }
-                // Checks if the package isn't vulnerable
-                else if (!strcmp(node[i]->attributes[j], XML_COMMENT)) {
-                    STATIC const char not_vulnerable[] = "while related to the CVE in some way, a decision has been made to ignore this issue";
-                    STATIC const char needs_triage[] = "is affected and may need fixing";
-                    STATIC const char deferred[] = "is affected, but a decision has been made to defer addressing it";
-
-                    // Just for Ubuntu, where comment comes after test_ref
-                    if (parsed_oval->vulnerabilities->state_id) {
-                        if (strstr(node[i]->values[j], not_vulnerable)) {
-                            parsed_oval->vulnerabilities->ignore = 2;
-                        } else if (strstr(node[i]->values[j], needs_triage) || strstr(node[i]->values[j], deferred)) {
-                            parsed_oval->vulnerabilities->ignore = 1;
-                        } else {
-                            parsed_oval->vulnerabilities->ignore = 0;
-                        }
+                        parsed_oval->vulnerabilities->ignore = 0;
                     }
                 }
             }
-        } else if (!strcmp(node[i]->element, XML_DESCRIPTION)) {
-            os_strdup(node[i]->content, parsed_oval->info_cves->description);
-        } else if (!strcmp(node[i]->element, XML_OVAL_PRODUCT_VERSION)) {
-            os_strdup(node[i]->content, parsed_oval->metadata.product_version);
-        } else if (!strcmp(node[i]->element, XML_OVAL_PRODUCT_NAME)) {
-            os_strdup(node[i]->content, parsed_oval->metadata.product_name);
-        } else if (!strcmp(node[i]->element, XML_DATE)) {
-            os_strdup(node[i]->content, parsed_oval->info_cves->published);
-        } else if (!strcmp(node[i]->element, XML_OVAL_TIMESTAMP)) {
-            os_strdup(node[i]->content, parsed_oval->metadata.timestamp);
-        } else if (!strcmp(node[i]->element, XML_OVAL_SCHEMA_VERSION)) {
-            os_strdup(node[i]->content, parsed_oval->metadata.schema_version);
-        } else if (!strcmp(node[i]->element, XML_SEVERITY)) {
-            if (*node[i]->content != '\0') {
-                os_strdup(node[i]->content, parsed_oval->info_cves->severity);
-            } else {
-                parsed_oval->info_cves->severity = NULL;
-            }
-        } else if (!strcmp(node[i]->element, XML_UPDATED)) {
-            if (node[i]->attributes) {
-                for (j = 0; node[i]->attributes[j]; j++) {
-                    if (!strcmp(node[i]->attributes[j], XML_DATE)) {
-                        os_strdup(node[i]->values[j], parsed_oval->info_cves->updated);
-                    }
-                }
-            }
-        } else if (dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_PUBLIC_DATE)) {
-            os_strdup(node[i]->content, parsed_oval->info_cves->published);
-        } else if (dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_BUG)) {
-            if (!parsed_oval->info_cves->bugzilla_references)
-                os_calloc(1, sizeof(references), parsed_oval->info_cves->bugzilla_references);
-
-            references *bugrefs = parsed_oval->info_cves->bugzilla_references;
-            os_realloc(bugrefs->values, (bugrefs->elements + 2) * sizeof(char *), bugrefs->values);
-            os_strdup(node[i]->content, bugrefs->values[bugrefs->elements]);
-            bugrefs->values[++bugrefs->elements] = NULL;
-        } else if (dist == FEED_UBUNTU && !strcmp(node[i]->element, XML_REF)) {
-            if (!parsed_oval->info_cves->refs)
-                os_calloc(1, sizeof(references), parsed_oval->info_cves->refs);
-
-            references *refs = parsed_oval->info_cves->refs;
-            os_realloc(refs->values, (refs->elements + 2) * sizeof(char *), refs->values);
-            os_strdup(node[i]->content, refs->values[refs->elements]);
-            refs->values[++refs->elements] = NULL;
-        } else if (!strcmp(node[i]->element, XML_OVAL_DEFINITIONS)  ||
-                   !strcmp(node[i]->element, XML_DEFINITIONS)       ||
-                   !strcmp(node[i]->element, XML_OBJECTS)           ||
-                   !strcmp(node[i]->element, XML_VARIABLES)         ||
-                   !strcmp(node[i]->element, XML_METADATA)          ||
-                   !strcmp(node[i]->element, XML_OVAL_DEF_METADATA) ||
-                   !strcmp(node[i]->element, XML_TESTS)             ||
-                   !strcmp(node[i]->element, XML_STATES)            ||
-                   !strcmp(node[i]->element, XML_ADVISORY)          ||
-                   !strcmp(node[i]->element, XML_DEBIAN)            ||
-                   !strcmp(node[i]->element, XML_GENERATOR)         ||
-                   !strcmp(node[i]->element, XML_OVAL_REPOSITORY)   ||
-                   !strcmp(node[i]->element, XML_OVAL_DEF_OV_REPO)  ||
-                   !strcmp(node[i]->element, XML_DATES)             ||
-                   !strcmp(node[i]->element, XML_OVAL_DEF_DATES)) {
-            if (chld_node = OS_GetElementsbyNode(xml, node[i]), !chld_node) {
-                goto invalid_elem;
-            } else if (wm_vuldet_oval_xml_parser(xml, chld_node, parsed_oval, update, condition) == OS_INVALID) {
-                retval = OS_INVALID;
-                goto end;
-            }
         }
-
-        OS_ClearNode(chld_node);
-        chld_node = NULL;
+    } else if (!strcmp(node->element, XML_DESCRIPTION)) {
+        os_strdup(node->content, parsed_oval->info_cves->description);
+    } else if (!strcmp(node->element, XML_OVAL_PRODUCT_VERSION)) {
+        os_strdup(node->content, parsed_oval->metadata.product_version);
+    } else if (!strcmp(node->element, XML_OVAL_PRODUCT_NAME)) {
+        os_strdup(node->content, parsed_oval->metadata.product_name);
+    } else if (!strcmp(node->element, XML_DATE)) {
+        os_strdup(node->content, parsed_oval->info_cves->published);
+    } else if (!strcmp(node->element, XML_OVAL_TIMESTAMP)) {
+        os_strdup(node->content, parsed_oval->metadata.timestamp);
+    } else if (!strcmp(node->element, XML_OVAL_SCHEMA_VERSION)) {
+        os_strdup(node->content, parsed_oval->metadata.schema_version);
+    } else if (!strcmp(node->element, XML_SEVERITY)) {
+        if (*node->content != '\0') {
+            os_strdup(node->content, parsed_oval->info_cves->severity);
+        } else {
+            parsed_oval->info_cves->severity = NULL;
+        }
+    } else if (!strcmp(node->element, XML_UPDATED)) {
+        if (value = wm_vuldet_oval_attr(node, XML_DATE), value) {
+            os_strdup(value, parsed_oval->info_cves->updated);
+        }
+    } else if (dist == FEED_UBUNTU && !strcmp(node->element, XML_PUBLIC_DATE)) {
+        os_strdup(node->content, parsed_oval->info_cves->published);
+    } else if (dist == FEED_UBUNTU && !strcmp(node->element, XML_BUG)) {
+        wm_vuldet_oval_add_ref(&parsed_oval->info_cves->bugzilla_references, node->content);
+    } else if (dist == FEED_UBUNTU && !strcmp(node->element, XML_REF)) {
+        wm_vuldet_oval_add_ref(&parsed_oval->info_cves->refs, node->content);
     }
 
-
-end:
-    OS_ClearNode(chld_node);
-    return retval;
-
-invalid_elem:
-    mterror(WM_VULNDETECTOR_LOGTAG, XML_INVELEM, node[i]->element);
-    return OS_INVALID;
+    return 0;
 }
 
 int wm_vuldet_oval_process(update_node *update, char *path, wm_vuldet_db *parsed_vulnerabilities) {
+    static const OS_XML_HANDLER handler = { wm_vuldet_oval_xml_start, wm_vuldet_oval_xml_end };
+    oval_stream stream = { .parsed_oval = parsed_vulnerabilities, .dist = update->dist_ref };
     int success = 0;
     char *tmp_file;
     OS_XML xml;
-    XML_NODE node = NULL;
-    XML_NODE chld_node = NULL;
-
-    memset(&xml, 0, sizeof(xml));
 
     mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_UPDATE_PRE, vu_feed_tag[update->dist_tag_ref]);
     if (tmp_file = wm_vuldet_oval_xml_preparser(path, update->dist_ref), !tmp_file) {
@@ -3222,36 +3476,25 @@ int wm_vuldet_oval_process(update_node *update, char *path, wm_vuldet_db *parsed
     }
 
     mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_UPDATE_PAR, vu_feed_tag[update->dist_tag_ref]);
-    if (OS_ReadXML(tmp_file, &xml) < 0) {
-        mterror(WM_VULNDETECTOR_LOGTAG, VU_LOAD_CVE_ERROR, vu_feed_tag[update->dist_tag_ref], xml.err);
-        goto free_mem;
-    }
-
-    if (node = OS_GetElementsbyNode(&xml, NULL), !node) {
-        goto free_mem;
-    };
-
-    // Reduces a level of recurrence
-    if (chld_node = OS_GetElementsbyNode(&xml, *node), !chld_node) {
-        goto free_mem;
-    }
-
-    if (wm_vuldet_oval_xml_parser(&xml, chld_node, parsed_vulnerabilities, update, 0) == OS_INVALID) {
+    if (OS_ReadXMLStream(tmp_file, &xml, &handler, &stream) < 0) {
+        // The handlers report their own errors
+        if (*xml.err) {
+            mterror(WM_VULNDETECTOR_LOGTAG, VU_LOAD_CVE_ERROR, vu_feed_tag[update->dist_tag_ref], xml.err);
+        }
         goto free_mem;
     }
 
     success = 1;
 free_mem:
     os_free(tmp_file);
-    OS_ClearNode(node);
-    OS_ClearNode(chld_node);
-    OS_ClearXML(&xml);
+    os_free(stream.stack);
     return !success;
 }
 
 int wm_vuldet_index_feed(update_node *update) {
     wm_vuldet_db parsed_vulnerabilities;
     const char *OS_VERSION;
+    char oval_path[PATH_MAX] = "";
     char *path;
     char success = 0;
 
@@ -3274,6 +3517,11 @@ int wm_vuldet_index_feed(update_node *update) {
         path = update->path ? update->path : VU_TEMP_FILE;
 
         if (update->dist_ref == FEED_UBUNTU || update->dist_ref == FEED_DEBIAN) {
+            if (!update->path) {
+                snprintf(oval_path, sizeof(oval_path), VU_OVAL_TEMP_FILE, vu_feed_tag[update->dist_tag_ref]);
+                path = oval_path;
+            }
+
             if (wm_vuldet_oval_process(update, path, &parsed_vulnerabilities)) {
                 goto free_mem;
             }
@@ -3300,10 +3548,12 @@ free_mem:
     if (remove(VU_FIT_TEMP_FILE) < 0) {
         mtdebug2(WM_VULNDETECTOR_LOGTAG, "remove(%s): %s", VU_FIT_TEMP_FILE, strerror(errno));
     }
-    if (remove(VU_TEMP_FILE_BZ2) < 0) {
-        mtdebug2(WM_VULNDETECTOR_LOGTAG, "remove(%s): %s", VU_TEMP_FILE_BZ2, strerror(errno));
+    if (*oval_path && remove(oval_path) < 0) {
+        mtdebug2(WM_VULNDETECTOR_LOGTAG, "remove(%s): %s", oval_path, strerror(errno));
     }
 
+    free_strarray(parsed_vulnerabilities.nvd_feeds);
+
     if (success) {
         return 0;
     }
@@ -3315,40 +3565,32 @@ int wm_vuldet_fetch_oval(update_node *update, char *repo) {
     STATIC const char *timestamp_tag = "timestamp>";
     char timestamp[OS_SIZE_256 + 1];
     char buffer[OS_MAXSTR + 1];
-    FILE *fp = NULL;
+    char path[PATH_MAX];
+    bzip2_file *bzfile = NULL;
     char *found;
-    int attempts;
     vu_logic retval = VU_INV_FEED;
 
-    for (attempts = 0;; attempts++) {
-        int res_url_request;
-        if (update->dist_ref == FEED_UBUNTU) {
-            res_url_request = wurl_request(repo, VU_TEMP_FILE_BZ2, NULL, NULL);
-        } else {
-            res_url_request = wurl_request(repo, VU_TEMP_FILE, NULL, NULL);
-        }
+    snprintf(path, sizeof(path), VU_OVAL_TEMP_FILE, vu_feed_tag[update->dist_tag_ref]);
 
-        if (!res_url_request) {
-            break;
-        } else if (attempts == WM_VULNDETECTOR_DOWN_ATTEMPTS) {
-            goto end;
-        }
-        mdebug1(VU_DOWNLOAD_FAIL, attempts);
-        sleep(attempts);
+    // The feed may have been downloaded along with the others
+    if (update->prefetch) {
+        retval = update->prefetch;
+        update->prefetch = 0;
+    } else {
+        retval = wm_vuldet_download_oval(update, repo);
     }
 
-    if (update->dist_ref == FEED_UBUNTU) {
-        int result;
-        if (result = bzip2_uncompress(VU_TEMP_FILE_BZ2, VU_TEMP_FILE), result == -1) {
-            goto end;
-        }
+    if (retval != VU_NEED_UPDATE) {
+        goto end;
     }
+    retval = VU_INV_FEED;
 
-    if (fp = fopen(VU_TEMP_FILE, "r"), !fp) {
+    // Compressed feeds are read as they are uncompressed
+    if (bzfile = bzip2_open(path), !bzfile) {
         goto end;
     }
 
-    while (fgets(buffer, OS_MAXSTR, fp)) {
+    while (bzip2_gets(buffer, OS_MAXSTR, bzfile)) {
         if (found = strstr(buffer, timestamp_tag), found) {
             char *close_tag;
             found+=strlen(timestamp_tag);
@@ -3378,13 +3620,118 @@ int wm_vuldet_fetch_oval(update_node *update, char *repo) {
 
     retval = VU_NEED_UPDATE;
 end:
-    if (fp) {
-        w_fclose(fp);
+    if (bzfile) {
+        bzip2_close(bzfile);
+    }
+
+    // The feed is only kept to be indexed
+    if (retval != VU_NEED_UPDATE && remove(path) < 0 && errno != ENOENT) {
+        mtdebug2(WM_VULNDETECTOR_LOGTAG, "remove(%s): %s", path, strerror(errno));
     }
 
     return retval;
 }
 
+void wm_vuldet_oval_repo(update_node *update, char *repo, size_t size) {
+    char *low_repo;
+
+    if (update->url) {
+        snprintf(repo, size, "%s", update->url);
+        return;
+    }
+
+    // Ubuntu and debian build their repos in a specific way
+    os_strdup(update->version, low_repo);
+    str_lowercase(low_repo);
+    snprintf(repo, size, update->dist_ref == FEED_UBUNTU ? CANONICAL_REPO : DEBIAN_REPO, low_repo);
+    free(low_repo);
+}
+
+int wm_vuldet_download_oval(update_node *update, const char *repo) {
+    char path[PATH_MAX];
+    char header[OS_SIZE_256] = "";
+    struct stat st;
+    time_t last_update;
+    int attempts;
+
+    snprintf(path, sizeof(path), VU_OVAL_TEMP_FILE, vu_feed_tag[update->dist_tag_ref]);
+
+    // Ask only for a feed newer than the one indexed
+    if (last_update = wm_vuldet_get_feed_last_update(update->dist_tag_ref), last_update > 0) {
+        struct tm tm_update;
+
+        gmtime_r(&last_update, &tm_update);
+        strftime(header, sizeof(header), "If-Modified-Since: %a, %d %b %Y %H:%M:%S GMT", &tm_update);
+    }
+
+    for (attempts = 0;; attempts++) {
+        if (!wurl_request(repo, path, *header ? header : NULL, NULL)) {
+            break;
+        } else if (attempts == WM_VULNDETECTOR_DOWN_ATTEMPTS) {
+            return VU_INV_FEED;
+        }
+        mdebug1(VU_DOWNLOAD_FAIL, attempts);
+        sleep(attempts);
+    }
+
+    // The server answers with an empty body if the feed wasn't modified
+    if (*header && !stat(path, &st) && st.st_size == 0) {
+        mtdebug1(WM_VULNDETECTOR_LOGTAG, VU_FEED_NOT_MODIFIED, update->dist_ext);
+        return VU_NOT_NEED_UPDATE;
+    }
+
+    return VU_NEED_UPDATE;
+}
+
+void *wm_vuldet_prefetch_oval_thread(void *arg) {
+    update_node *update = (update_node *) arg;
+    char repo[OS_SIZE_2048 + 1];
+
+    wm_vuldet_oval_repo(update, repo, sizeof(repo));
+    update->prefetch = wm_vuldet_download_oval(update, repo);
+    return NULL;
+}
+
+void wm_vuldet_prefetch_oval(update_node **updates) {
+    pthread_t thread[CVE_WHEEZY + 1];
+    int started[CVE_WHEEZY + 1] = { 0 };
+    int i;
+
+    for (i = CVE_PRECISE; i <= CVE_WHEEZY; i++) {
+        update_node *upd = updates[i];
+
+        // Local feeds aren't downloaded
+        if (!wm_vuldet_check_update_period(upd) || (!upd->url && upd->path)) {
+            continue;
+        }
+
+        // The feeds that couldn't be downloaded here will be downloaded in turn
+        started[i] = !CreateThreadJoinable(&thread[i], wm_vuldet_prefetch_oval_thread, upd);
+    }
+
+    for (i = CVE_PRECISE; i <= CVE_WHEEZY; i++) {
+        if (started[i]) {
+            pthread_join(thread[i], NULL);
+        }
+    }
+}
+
+void wm_vuldet_discard_prefetch(update_node **updates) {
+    char path[PATH_MAX];
+    int i;
+
+    for (i = CVE_PRECISE; i <= CVE_WHEEZY; i++) {
+        if (updates[i] && updates[i]->prefetch) {
+            updates[i]->prefetch = 0;
+            snprintf(path, sizeof(path), VU_OVAL_TEMP_FILE, vu_feed_tag[updates[i]->dist_tag_ref]);
+
+            if (remove(path) < 0 && errno != ENOENT) {
+                mtdebug2(WM_VULNDETECTOR_LOGTAG, "remove(%s): %s", path, strerror(errno));
+            }
+        }
+    }
+}
+
 int wm_vuldet_fetch_redhat(update_node *update) {
     int attempt = 0;
     int retval = VU_TRY_NEXT_PAGE;
@@ -3522,7 +3869,6 @@ end:
 
 int wm_vuldet_fetch_feed(update_node *update, int *need_update) {
     char repo[OS_SIZE_2048 + 1] = { '\0' };
-    char *low_repo;
     unsigned char success = 0;
     int result;
     *need_update = 1;
@@ -3532,23 +3878,14 @@ int wm_vuldet_fetch_feed(update_node *update, int *need_update) {
         return 0;
     }
 
-    if (!update->url) {
-        // Ubuntu and debian build their repos in a specific way
-        if (update->dist_ref == FEED_UBUNTU) {
-            os_strdup(update->version, low_repo);
-            str_lowercase(low_repo);
-            snprintf(repo, OS_SIZE_2048, CANONICAL_REPO, low_repo);
-            free(low_repo);
-        } else if (update->dist_ref == FEED_DEBIAN) {
-            os_strdup(update->version, low_repo);
-            str_lowercase(low_repo);
-            snprintf(repo, OS_SIZE_2048, DEBIAN_REPO, low_repo);
-            free(low_repo);
-        } else if (update->dist_ref != FEED_REDHAT &&
-                   update->dist_ref != FEED_CPED &&
-                   update->dist_ref != FEED_NVD &&
-                   update->dist_ref != FEED_CPEW &&
-                   update->dist_ref != FEED_MSU) {
+    if (update->dist_ref == FEED_UBUNTU || update->dist_ref == FEED_DEBIAN) {
+        wm_vuldet_oval_repo(update, repo, sizeof(repo));
+    } else if (!update->url) {
+        if (update->dist_ref != FEED_REDHAT &&
+            update->dist_ref != FEED_CPED &&
+            update->dist_ref != FEED_NVD &&
+            update->dist_ref != FEED_CPEW &&
+            update->dist_ref != FEED_MSU) {
             mterror(WM_VULNDETECTOR_LOGTAG, VU_OS_VERSION_ERROR);
             return OS_INVALID;
         }
@@ -3678,6 +4015,9 @@ int wm_vuldet_run_update(update_node **updates) {
     int error_code = 0;
     int ret = 0;
 
+    // The OVAL feeds are downloaded at the same time, but indexed in turn
+    wm_vuldet_prefetch_oval(updates);
+
         // Ubuntu
     if (wm_vuldet_check_feed(updates[CVE_FOCAL], &error_code)    ||
         wm_vuldet_check_feed(updates[CVE_BIONIC], &error_code)   ||
@@ -3708,6 +4048,9 @@ int wm_vuldet_run_update(update_node **updates) {
         ret = OS_INVALID;
     }
 
+    // The feeds after a failed one weren't checked
+    wm_vuldet_discard_prefetch(updates);
+
     // Remove Debian status feed
     if (remove(VU_DEB_TEMP_FILE) < 0 && errno != ENOENT) {
         mtdebug2(WM_VULNDETECTOR_LOGTAG, "remove(%s): %s", VU_DEB_TEMP_FILE, strerror(errno));
@@ -3888,17 +4231,9 @@ int wm_vuldet_json_parser(char *json_path, wm_vuldet_db *parsed_vulnerabilities,
     int retval = OS_INVALID;
 
     if (update->dist_ref == FEED_NVD) {
-        char *json_feed;
-
-        if (json_feed = w_get_file_content(json_path, JSON_MAX_FSIZE), !json_feed) {
-            mterror(WM_VULNDETECTOR_LOGTAG, VU_CONTENT_FEED_ERROR, update->dist_ext, json_path);
-            return retval;
-        }
-
-        if (retval = wm_vuldet_json_nvd_parser(json_feed, parsed_vulnerabilities), retval == OS_INVALID) {
-            mterror(WM_VULNDETECTOR_LOGTAG, VU_PARSED_FEED_ERROR, update->dist_ext, json_path);
-        }
-        free(json_feed);
+        // The NVD feeds are parsed while they are inserted
+        parsed_vulnerabilities->nvd_feeds = os_AddStrArray(json_path, parsed_vulnerabilities->nvd_feeds);
+        retval = 0;
     }
     else {
         cJSON *json_feed;
@@ -4010,7 +4345,7 @@ int wm_vuldet_get_software_info(agent_software *agent, sqlite3 *db, time_t ignor
     mtdebug1(WM_VULNDETECTOR_LOGTAG, VU_AGENT_SOFTWARE_REQ, atoi(agent->agent_id));
 
     // Check to see if the scan has already been reported
-    request = wm_vuldet_select_scan_type(agent->agent_id, ignore_time, &hotfix_config_enabled);
+    request = wm_vuldet_select_scan_type(agent->agent_id, ignore_time, wm_vuldet_get_feed_update(db, agent), &hotfix_config_enabled);
     switch (request) {
         case OS_INVALID:
             goto end;
@@ -4277,6 +4612,7 @@ end:
 
 void *wm_vuldet_main(wm_vuldet_t * vuldet) {
     wm_vuldet_init(vuldet);
+    vuldet->scan_threads = getDefine_Int("vulnerability_detector", "scan_threads", 1, 64);
 
     wm_vuldet_check_db();
 
@@ -6084,8 +6420,10 @@ int wm_vuldet_remove_table(sqlite3 *db, char *table) {
     return wm_vuldet_remove_sequence(db, table);
 }
 
-int wm_vuldet_index_nvd(sqlite3 *db, update_node *upd, nvd_vulnerability *nvd_it) {
+int wm_vuldet_index_nvd(sqlite3 *db, update_node *upd, char **feeds) {
     time_t index_time = time(NULL);
+    vu_nvd_stream *stream = NULL;
+    nvd_vulnerability *nvd_it;
     int result;
     int cve_count = 0;
 
@@ -6098,17 +6436,27 @@ int wm_vuldet_index_nvd(sqlite3 *db, update_node *upd, nvd_vulnerability *nvd_it
         goto error;
     }
 
-    while (nvd_it) {
-        nvd_vulnerability *r_node = nvd_it;
+    // The feeds are parsed by other threads while their CVEs are inserted
+    stream = wm_vuldet_nvd_stream_start(feeds, upd->dist_ext);
 
+    while (nvd_it = wm_vuldet_nvd_stream_next(stream), nvd_it) {
         if (wm_vuldet_insert_nvd_cve(db, nvd_it, upd->update_it)) {
+            wm_vuldet_free_nvd_node(nvd_it);
             goto error;
         }
-        nvd_it = nvd_it->next;
-        wm_vuldet_free_nvd_node(r_node);
+        wm_vuldet_free_nvd_node(nvd_it);
         cve_count++;
     }
 
+    result = wm_vuldet_nvd_stream_end(stream);
+    stream = NULL;
+
+    if (result) {
+        goto error;
+    }
+
+    wm_vuldet_nvd_release_stmts();
+
     if (wm_vuldet_index_nvd_metadata(db, upd->update_it, cve_count, upd->multi_path || upd->multi_url)) {
         goto error;
     }
@@ -6117,7 +6465,10 @@ int wm_vuldet_index_nvd(sqlite3 *db, update_node *upd, nvd_vulnerability *nvd_it
 
     return 0;
 error:
-    wm_vuldet_free_nvd_list(nvd_it);
+    if (stream) {
+        wm_vuldet_nvd_stream_end(stream);
+    }
+    wm_vuldet_nvd_release_stmts();
 
     return OS_INVALID;
 }
@@ -6568,7 +6919,7 @@ void wm_vuldet_run_scan(wm_vuldet_t *vuldet) {
     if (wm_vuldet_set_agents_info(&vuldet->agents_software, vuldet->updates)) {
         mterror(WM_VULNDETECTOR_LOGTAG, VU_NO_AGENT_ERROR);
     } else {
-        if (wm_vuldet_check_agent_vulnerabilities(vuldet->agents_software, &vuldet->flags, vuldet->ignore_time)) {
+        if (wm_vuldet_check_agent_vulnerabilities(vuldet->agents_software, &vuldet->flags, vuldet->ignore_time, vuldet->scan_threads)) {
             mterror(WM_VULNDETECTOR_LOGTAG, VU_AG_CHECK_ERR);
         } else {
             mtinfo(WM_VULNDETECTOR_LOGTAG, VU_END_SCAN);
@@ -6667,7 +7018,7 @@ void wm_vuldet_init(wm_vuldet_t * vuldet) {
     }
 }
 
-int wm_vuldet_select_scan_type(char *agent_id, time_t ignore_time, char *hotfix_config_enabled) {
+int wm_vuldet_select_scan_type(char *agent_id, time_t ignore_time, time_t feed_update, char *hotfix_config_enabled) {
     int retval = OS_INVALID;
     char request[OS_SIZE_6144];
     cJSON *obj = NULL;
@@ -6708,12 +7059,16 @@ int wm_vuldet_select_scan_type(char *agent_id, time_t ignore_time, char *hotfix_
         goto end;
     }
 
-    // Check if the agent needs to be completely scanned
+    // Check if the agent needs to be completely scanned. The packages already
+    // triaged can only have new vulnerabilities if any of its feeds changed.
     time_t last_scan = obj_it->valueint;
-    if ((last_scan + ignore_time) < time(NULL)) {
-        retval = VU_SOFTWARE_FULL_REQ;
-    } else {
+    if ((last_scan + ignore_time) >= time(NULL)) {
         retval = VU_SOFTWARE_REQUEST;
+    } else if (feed_update < last_scan) {
+        mtdebug1(WM_VULNDETECTOR_LOGTAG, VU_AG_FEEDS_UNCHANGED, atoi(agent_id));
+        retval = VU_SOFTWARE_REQUEST;
+    } else {
+        retval = VU_SOFTWARE_FULL_REQ;
     }
 
 end:
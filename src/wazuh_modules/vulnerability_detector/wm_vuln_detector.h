@@ -27,7 +27,7 @@
 #define WM_VULNDETECTOR_DOWN_ATTEMPTS  5
 #define VU_DEF_IGNORE_TIME 21600 // 6 hours
 #define VU_TEMP_FILE "tmp/vuln-temp"
-#define VU_TEMP_FILE_BZ2 VU_TEMP_FILE ".bz2"
+#define VU_OVAL_TEMP_FILE VU_TEMP_FILE "-%s"
 #define VU_FIT_TEMP_FILE VU_TEMP_FILE "-fitted"
 #define VU_TEMP_METADATA_FILE VU_TEMP_FILE "-metadata"
 #define VU_DEB_TEMP_FILE VU_TEMP_FILE "-deb"
@@ -45,6 +45,9 @@
 #define NVD_REPO_DEFAULT_MIN_YEAR 2010
 #define MULTI_URL_TAG "[-]"
 #define NVD_IT_COMMIT 10000
+#define NVD_STREAM_CHUNK 65536 // Bytes read at once from an NVD feed
+#define NVD_STREAM_QUEUE 256 // CVEs parsed and waiting to be inserted
+#define NVD_STREAM_PARSERS 4 // NVD feeds parsed at the same time
 #define RED_HAT_REPO_MIN_YEAR 1999
 #define NVD_REPO_MIN_YEAR 2002
 #define RED_HAT_REPO_MAX_ATTEMPTS 3
@@ -107,7 +110,7 @@ extern const char *vu_feed_ext[];
 extern const char *vu_package_comp[];
 extern const char *vu_severities[];
 extern const char *vu_cpe_tags[];
-extern int wdb_sock;
+extern __thread int wdb_sock;
 typedef struct cpe_list cpe_list;
 typedef struct nvd_vulnerability nvd_vulnerability;
 typedef struct cv_scoring_system cv_scoring_system;
@@ -315,6 +318,14 @@ typedef struct cve_vuln_pkg {
     uint8_t discard;
 } cve_vuln_pkg;
 
+/**
+ * @brief NVD matches of a package reference and version.
+ */
+typedef struct vu_nvd_match {
+    int vulnerable;
+    OSHash *cve_table;
+} vu_nvd_match;
+
 typedef struct wm_vuldet_flags {
     unsigned int enabled:1;
     unsigned int run_on_start:1;
@@ -371,6 +382,7 @@ typedef struct update_node {
     int update_from_year; // only for Red Hat and NVD feeds
     vu_logic update_state; // only for Red Hat feed
     int update_it; // only NVD feed
+    int prefetch; // only for OVAL feeds, result of the download made beforehand
     char *url;
     char *multi_url;
     int multi_url_start;
@@ -404,8 +416,35 @@ typedef struct wm_vuldet_t {
     int queue_fd;
     wm_vuldet_state state;
     wm_vuldet_flags flags;
+    unsigned int scan_threads;
 } wm_vuldet_t;
 
+/* Agents are taken from the list by the scan workers, one at a time */
+typedef struct vu_scan_pool {
+    agent_software *next;               // Next agent to scan, NULL when all were taken
+    wm_vuldet_flags flags;              // Each worker changes its own copy for each agent
+    time_t ignore_time;
+    unsigned int threads;
+    int error;                          // A worker failed, so the others stop taking agents
+    pthread_mutex_t mutex;
+} vu_scan_pool;
+
+typedef struct vu_nvd_stream {
+    char **feeds;                       // NVD feed files to parse
+    const char *feed_ext;
+    unsigned int next;                  // Next feed to be taken by a parser
+    nvd_vulnerability *head;            // Parsed CVEs waiting to be inserted
+    nvd_vulnerability *tail;
+    unsigned int queued;
+    unsigned int parsers;               // Parsers still running
+    unsigned int threads;
+    pthread_t thread[NVD_STREAM_PARSERS];
+    int error;                          // A parser failed or the indexing was cancelled
+    pthread_mutex_t mutex;
+    pthread_cond_t available;           // A CVE was queued or a parser finished
+    pthread_cond_t room;                // A CVE was taken from a full queue
+} vu_nvd_stream;
+
 typedef enum {
     V_OVALDEFINITIONS,
     V_DEFINITIONS,
@@ -549,7 +588,7 @@ struct vu_msu_entries {
 typedef struct wm_vuldet_db {
     vulnerability *vulnerabilities;
     rh_vulnerability *rh_vulnerabilities;
-    nvd_vulnerability *nvd_vulnerabilities;
+    char **nvd_feeds;
     nvd_metadata *nvd_met;
     vu_cpe_dic *w_cpes;
     vu_msu_entries msu;
@@ -773,12 +812,38 @@ int wm_vuldet_add_cpe(cpe *ncpe, char *cpe_raw, cpe_list *node_list, int index);
 int wm_vuldet_generate_agent_cpes(sqlite3 *db, agent_software *agent, char dic);
 int wm_vuldet_fetch_nvd_cve(update_node *update);
 int wm_vuldet_fetch_nvd_cpe(char *repo);
-int wm_vuldet_json_nvd_parser(char *json_feed, wm_vuldet_db *parsed_vulnerabilities);
 int wm_vuldet_clean_nvd_metadata(sqlite3 *db, int year);
 int wm_vuldet_insert_nvd_cve(sqlite3 *db, nvd_vulnerability *nvd_data, int year);
 void wm_vuldet_free_nvd_node(nvd_vulnerability *data);
 void wm_vuldet_free_nvd_list(nvd_vulnerability *nvd_it);
 
+/**
+ * @brief Start parsing NVD feeds on a pool of threads.
+ * @param feeds JSON feed files.
+ * @param feed_ext Name of the feed.
+ * @return The stream to take the parsed CVEs from.
+ */
+vu_nvd_stream *wm_vuldet_nvd_stream_start(char **feeds, const char *feed_ext);
+
+/**
+ * @brief Take the next parsed CVE, waiting for it if necessary.
+ * @param stream Stream of the NVD feeds.
+ * @return The CVE, which has to be freed, or NULL if there are no more.
+ */
+nvd_vulnerability *wm_vuldet_nvd_stream_next(vu_nvd_stream *stream);
+
+/**
+ * @brief Stop the parsers of a stream and free it.
+ * @param stream Stream of the NVD feeds.
+ * @return 0 if every feed was parsed and every CVE taken, -1 otherwise.
+ */
+int wm_vuldet_nvd_stream_end(vu_nvd_stream *stream);
+
+/**
+ * @brief Finalize the statements cached while inserting the NVD feeds.
+ */
+void wm_vuldet_nvd_release_stmts();
+
 /**
  * @brief Correlate OVAL and NVD feeds for a more fine tuned result.
  * @param db Vulnerability detector database.
@@ -788,6 +853,16 @@ void wm_vuldet_free_nvd_list(nvd_vulnerability *nvd_it);
  */
 int wm_vuldet_linux_rm_false_positivies(sqlite3 *db, agent_software *agent, OSHash *cve_table);
 
+/**
+ * @brief Start sharing the NVD matches of each package and version between the agents of a scan.
+ */
+void wm_vuldet_nvd_cache_init();
+
+/**
+ * @brief Drop the NVD matches shared during a scan.
+ */
+void wm_vuldet_nvd_cache_free();
+
 /**
  * @brief Check OVAL databases to find vulnerabilities for a specific Linux agent.
  * @param db Vulnerability detector database.
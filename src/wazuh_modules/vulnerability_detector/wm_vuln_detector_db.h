@@ -154,6 +154,13 @@ typedef enum vu_query {
     VU_HOTFX_SIMPLE,
     VU_HOTFX_WITHOUT_R2,
     VU_CHECK_AGENT_HOTFIX,
+    // SCAN WORKERS
+    VU_SCAN_TABLES,
+    VU_SCAN_COPY_CPES,
+    // FEED UPDATES
+    VU_SET_FEED_UPDATE,
+    VU_GET_FEED_UPDATE,
+    VU_GET_FEED_LAST_UPDATE,
     // TRANSACTIONS
     BEGIN_T,
     END_T
@@ -232,7 +239,7 @@ static const char *vu_queries[] = {
     "UPDATE AGENTS SET CPE_INDEX_ID = ? WHERE AGENT_ID = ? AND VENDOR IS ? AND PACKAGE_NAME = ? AND VERSION = ? AND ARCH = ?;",
     // NVD
     "SELECT COUNT(*) FROM NVD_CVE;",
-    "SELECT LAST_MODIFIED FROM NVD_METADATA WHERE YEAR = ?;",
+    "SELECT LAST_MODIFIED, SHA256 FROM NVD_METADATA WHERE YEAR = ?;",
     "REPLACE INTO NVD_METADATA VALUES(?,?,?,?,?,?,?,?);",
     "INSERT INTO NVD_CVE VALUES(NULL,?,?,?,?,?,?,?,?);",
     "SELECT MAX(ID) FROM NVD_CVE;",
@@ -320,6 +327,13 @@ static const char *vu_queries[] = {
     "SELECT DISTINCT M1.PATCH, SUPER FROM MSU M1 INNER JOIN MSU_SUPERSEDENCE ON MSU_SUPERSEDENCE.PATCH = M1.PATCH WHERE M1.CVEID = ? AND M1.PRODUCT REGEXP ?%s;",
     "SELECT DISTINCT M1.PATCH, SUPER FROM MSU M1 INNER JOIN MSU_SUPERSEDENCE ON MSU_SUPERSEDENCE.PATCH = M1.PATCH WHERE M1.CVEID = ? AND M1.PRODUCT REGEXP ? AND M1.PRODUCT NOT LIKE '% R2%%'%s;",
     "SELECT HOTFIX FROM AGENT_HOTFIXES WHERE AGENT_ID = ? AND HOTFIX LIKE ?;",
+    // SCAN WORKERS
+    "SELECT SQL FROM MAIN.SQLITE_MASTER WHERE TBL_NAME IN ('" AGENTS_TABLE "', 'AGENT_HOTFIXES', 'CPE_INDEX') AND SQL IS NOT NULL ORDER BY TYPE = 'index';",
+    "INSERT INTO TEMP.CPE_INDEX SELECT * FROM MAIN.CPE_INDEX;",
+    // FEED UPDATES
+    "REPLACE INTO FEED_UPDATES VALUES(?,?);",
+    "SELECT MAX(UPDATED) FROM FEED_UPDATES WHERE TARGET IN (?,?,?,?);",
+    "SELECT UPDATED FROM FEED_UPDATES WHERE TARGET = ?1 AND EXISTS (SELECT 1 FROM METADATA WHERE TARGET = ?1);",
     // TRANSACTIONS
     "BEGIN TRANSACTION;",
     "END TRANSACTION;"};
@@ -28,7 +28,8 @@
 #undef D
 #define D C_CTYPE_DIGIT
 
-static int (*comparator) (const char *, const char *, int);
+// Set for each comparison, by the thread that compares
+static __thread int (*comparator) (const char *, const char *, int);
 
 static unsigned short int c_ctype[256] = {
 /** 0 **/
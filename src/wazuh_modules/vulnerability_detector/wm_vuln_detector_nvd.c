@@ -25,6 +25,46 @@ STATIC int wm_vuldet_parse_nvd_configuration(cJSON *configuration, nvd_vulnerabi
 STATIC int wm_vuldet_parse_nvd_configuration_node(cJSON *config, const char *cve, nvd_configuration **data);
 STATIC int wm_vuldet_parse_nvd_impact(cJSON *impact, nvd_vulnerability *data);
 STATIC int wm_vuldet_parse_nvd_cve(cJSON *node, nvd_vulnerability *data);
+
+/**
+ * @brief Fill a CVE with an item of the NVD feed.
+ * @param item Item of the "CVE_Items" array.
+ * @param nvd_it CVE to fill.
+ * @return 0.
+ */
+STATIC int wm_vuldet_parse_nvd_item(cJSON *item, nvd_vulnerability *nvd_it);
+
+/**
+ * @brief Queue a parsed CVE, waiting while the queue is full.
+ * @param stream Stream of the NVD feeds.
+ * @param nvd_it CVE, which is freed if the stream was cancelled.
+ * @return 0 on success, -1 if the stream was cancelled.
+ */
+STATIC int wm_vuldet_nvd_stream_push(vu_nvd_stream *stream, nvd_vulnerability *nvd_it);
+
+/**
+ * @brief Parse the CVEs of an NVD feed file one by one.
+ * @param stream Stream of the NVD feeds.
+ * @param path Feed file.
+ * @return 0 on success, -1 otherwise.
+ */
+STATIC int wm_vuldet_nvd_stream_feed(vu_nvd_stream *stream, const char *path);
+
+/**
+ * @brief Parse the feeds of a stream until there are no more.
+ * @param data Stream of the NVD feeds (vu_nvd_stream).
+ * @return NULL.
+ */
+STATIC void *wm_vuldet_nvd_stream_parser(void *data);
+
+/**
+ * @brief Get a statement of the NVD insertions, preparing it if it wasn't cached.
+ * @param db CVE DB connection.
+ * @param query Query of the statement.
+ * @param stmt The statement, which mustn't be finalized.
+ * @return SQLITE_OK on success, the error of the preparation otherwise.
+ */
+STATIC int wm_vuldet_nvd_stmt(sqlite3 *db, vu_query query, sqlite3_stmt **stmt);
 STATIC int wm_vuldet_insert_nvd_cve_metric_cvss(sqlite3 *db, cv_scoring_system *nvd_data, int node_id);
 STATIC int wm_vuldet_insert_nvd_cve_configuration(sqlite3 *db, nvd_configuration *nvd_data, int node_id, int parent);
 STATIC int wm_vuldet_insert_nvd_cve_references(sqlite3 *db, nvd_references *nvd_data, int node_id);
@@ -75,6 +115,23 @@ STATIC int wm_vuldet_check_generic_package(sqlite3 *dbCVE, char *pkg_name, char
  */
 STATIC int wm_vuldet_check_specific_package(sqlite3 *dbCVE, char *pkg_name, char *pkg_source, char *pkg_version, char *pkg_arch, OSHash *cve_table, int8_t name_type, int *vuln_count);
 
+/**
+ * @brief Check if an NVD package is vulnerable, reusing the matches of the
+ * same package and version found for other agents during the scan.
+ * @param dbCVE Database with NVD information.
+ * @param pkg_name Name of package to check.
+ * @param pkg_source Source of package to check.
+ * @param pkg_version Version of package to check.
+ * @param pkg_arch Architecture of package to check.
+ * @param cve_table Vulnerability data hash table.
+ * @param name_type Package information: source or name.
+ * @param vuln_count Vulnerability counter.
+ * @param specific Check the specific versions instead of the generic ranges.
+ * @return 1 vulnerable, 0 no vulnerable, -1 otherwise.
+ */
+STATIC int wm_vuldet_check_nvd_package(sqlite3 *dbCVE, char *pkg_name, char *pkg_source, char *pkg_version, char *pkg_arch, OSHash *cve_table, int8_t name_type, int *vuln_count, int specific);
+STATIC void wm_vuldet_free_nvd_match(void *data);
+
 /**
  * @brief Fill an array with the children's IDs from a package.
  * @param dbCVE Database with NVD information.
@@ -127,6 +184,13 @@ static const char *V_DEBIAN = "debian";
 static const char *V_REDHAT = "redhat";
 static const char *V_KERNEL = "linux";
 
+// NVD matches by package reference and version, while a scan is running
+static OSHash *vu_nvd_cache;
+
+// Statements of the NVD insertions, prepared once for all the CVEs of an indexing.
+// Only the thread indexing the feeds uses them.
+static sqlite3_stmt *vu_nvd_stmts[END_T];
+
 // Common tags
 const char *vu_cpe_tags[] = {
     "vendor",
@@ -816,7 +880,9 @@ int wm_vuldet_fetch_nvd_cve(update_node *update) {
     sqlite3_stmt *stmt = NULL;
     sqlite3 *db = NULL;
     static char *feed_last_mod = "lastModifiedDate:";
-    char *last_mod = NULL;
+    static char *feed_sha256 = "sha256:";
+    char last_mod[OS_SIZE_256 + 1] = "";
+    char sha256[OS_SIZE_256 + 1] = "";
 
     if (update->multi_url) {
         char tag[10 + 1];
@@ -870,31 +936,41 @@ int wm_vuldet_fetch_nvd_cve(update_node *update) {
         }
 
         while (fgets(buffer, OS_MAXSTR, fp)) {
+            buffer[strcspn(buffer, "\r\n")] = '\0';
+
             if (found = strstr(buffer, feed_last_mod), found) {
-                last_mod = found + strlen(feed_last_mod);
+                snprintf(last_mod, OS_SIZE_256, "%s", found + strlen(feed_last_mod));
+            } else if (found = strstr(buffer, feed_sha256), found) {
+                snprintf(sha256, OS_SIZE_256, "%s", found + strlen(feed_sha256));
+            }
+        }
 
-                if (wm_vuldet_prepare(db, vu_queries[VU_GET_NVD_LASTMOD], -1, &stmt, NULL) != SQLITE_OK) {
-                    wm_vuldet_sql_error(db, stmt);
-                    db = NULL;
-                    return VU_INV_FEED;
-                }
-                sqlite3_bind_int(stmt, 1, update->update_it);
+        if (*last_mod) {
+            const char *db_last_mod;
+            const char *db_sha256;
 
-                if (wm_vuldet_step(stmt) == SQLITE_ROW) {
-                    found = (char *)sqlite3_column_text(stmt, 0);
+            if (wm_vuldet_prepare(db, vu_queries[VU_GET_NVD_LASTMOD], -1, &stmt, NULL) != SQLITE_OK) {
+                wm_vuldet_sql_error(db, stmt);
+                db = NULL;
+                goto end;
+            }
+            sqlite3_bind_int(stmt, 1, update->update_it);
 
-                    // Check if our feed is outdated
-                    if (!strncmp(last_mod, found, strlen(found))) {
-                        wdb_finalize(stmt);
-                        retval = VU_NOT_NEED_UPDATE;
-                        goto end;
-                    }
+            if (wm_vuldet_step(stmt) == SQLITE_ROW) {
+                db_last_mod = (const char *)sqlite3_column_text(stmt, 0);
+                db_sha256 = (const char *)sqlite3_column_text(stmt, 1);
+
+                // Skip the year if the feed wasn't modified, or if it was but its content is the same
+                if ((db_last_mod && !strcmp(last_mod, db_last_mod)) ||
+                    (*sha256 && db_sha256 && !strcasecmp(sha256, db_sha256))) {
+                    wdb_finalize(stmt);
+                    retval = VU_NOT_NEED_UPDATE;
+                    goto end;
                 }
-                snprintf(str_it, 20, " (%d)", update->update_it);
-                mtdebug1(WM_VULNDETECTOR_LOGTAG, VU_DB_TIMESTAMP_FEED, update->dist_ext, str_it);
-                wdb_finalize(stmt);
-                break;
             }
+            snprintf(str_it, 20, " (%d)", update->update_it);
+            mtdebug1(WM_VULNDETECTOR_LOGTAG, VU_DB_TIMESTAMP_FEED, update->dist_ext, str_it);
+            wdb_finalize(stmt);
         }
 
         if (fp_out = fopen(VU_TEMP_METADATA_FILE, "w"), !fp_out) {
@@ -982,10 +1058,8 @@ int wm_vuldet_clean_nvd_metadata(sqlite3 *db, int year) {
     return 0;
 }
 
-int wm_vuldet_json_nvd_parser(char *json_feed, wm_vuldet_db *parsed_vulnerabilities) {
+int wm_vuldet_parse_nvd_item(cJSON *item, nvd_vulnerability *nvd_it) {
     cJSON *cve_content;
-    nvd_vulnerability *nvd_it = NULL;
-    nvd_vulnerability *nvd_first = NULL;
     static char *JSON_CVE = "cve";
     static char *JSON_CONFIGURATIONS = "configurations";
     static char *JSON_IMPACT = "impact";
@@ -995,57 +1069,299 @@ int wm_vuldet_json_nvd_parser(char *json_feed, wm_vuldet_db *parsed_vulnerabilit
     static char *JSON_DATA_FORMAT = "data_format";
     static char *JSON_DATA_VERSION = "data_version";
 
-    const char * cve;
-    const char * next_cve;
-    const char * match_cve = " {\r\n    \"cve\" : {\r\n";
+    for (cve_content = item->child; json_tagged_obj(cve_content); cve_content = cve_content->next) {
+        if (!strcmp(cve_content->string, JSON_CVE)) {
+            wm_vuldet_parse_nvd_cve(cve_content, nvd_it);
+        } else if (!strcmp(cve_content->string, JSON_CONFIGURATIONS)) {
+            wm_vuldet_parse_nvd_configuration(cve_content, nvd_it);
+        } else if (!strcmp(cve_content->string, JSON_IMPACT)) {
+            wm_vuldet_parse_nvd_impact(cve_content, nvd_it);
+        } else if (!strcmp(cve_content->string, JSON_PUBLISHED)) {
+            w_strdup(cve_content->valuestring, nvd_it->published);
+        } else if (!strcmp(cve_content->string, JSON_LAST_MOD)) {
+            w_strdup(cve_content->valuestring, nvd_it->last_modified);
+        } else if (strcmp(cve_content->string, JSON_DATA_TYPE) &&
+                    strcmp(cve_content->string, JSON_DATA_FORMAT) &&
+                    strcmp(cve_content->string, JSON_DATA_VERSION)) {
+            mtwarn(WM_VULNDETECTOR_LOGTAG, VU_UNKNOWN_NVD_CVE_TAG, cve_content->string);
+        } else {
+            mtwarn(WM_VULNDETECTOR_LOGTAG, VU_UNKNOWN_NVD_TAG, cve_content->string);
+        }
+    }
 
-    for (cve = strstr(json_feed, match_cve); cve != NULL; cve = strstr(next_cve, match_cve)) {
+    return 0;
+}
 
-        cJSON * cve_list;
+int wm_vuldet_nvd_stream_push(vu_nvd_stream *stream, nvd_vulnerability *nvd_it) {
+    w_mutex_lock(&stream->mutex);
 
-        if (cve_list = cJSON_ParseWithOpts(cve, &next_cve, 0), !cve_list) {
-            wm_vuldet_free_nvd_list(nvd_first);
-            return OS_INVALID;
+    while (stream->queued >= NVD_STREAM_QUEUE && !stream->error) {
+        w_cond_wait(&stream->room, &stream->mutex);
+    }
+
+    if (stream->error) {
+        w_mutex_unlock(&stream->mutex);
+        wm_vuldet_free_nvd_node(nvd_it);
+        return OS_INVALID;
+    }
+
+    if (stream->tail) {
+        stream->tail->next = nvd_it;
+    } else {
+        stream->head = nvd_it;
+    }
+
+    stream->tail = nvd_it;
+    stream->queued++;
+    w_cond_signal(&stream->available);
+    w_mutex_unlock(&stream->mutex);
+
+    return 0;
+}
+
+/* The CVEs are the objects of the only array of the feed, "CVE_Items".
+ * The bytes of each one are collected while its braces are balanced,
+ * skipping those that are inside strings, and then parsed on their own. */
+int wm_vuldet_nvd_stream_feed(vu_nvd_stream *stream, const char *path) {
+    FILE *fp;
+    char *chunk = NULL;
+    char *item = NULL;
+    size_t item_len = 0;
+    size_t item_size = 0;
+    size_t length;
+    int depth = 0;
+    int in_items = 0;
+    int in_string = 0;
+    int escaped = 0;
+    int collecting = 0;
+    int retval = OS_INVALID;
+
+    if (fp = fopen(path, "r"), !fp) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_CONTENT_FEED_ERROR, stream->feed_ext, path);
+        return OS_INVALID;
+    }
+
+    os_malloc(NVD_STREAM_CHUNK, chunk);
+
+    while (length = fread(chunk, 1, NVD_STREAM_CHUNK, fp), length > 0) {
+        size_t start = 0;
+        size_t i;
+
+        for (i = 0; i < length; i++) {
+            char c = chunk[i];
+
+            if (in_string) {
+                if (escaped) {
+                    escaped = 0;
+                } else if (c == '\\') {
+                    escaped = 1;
+                } else if (c == '"') {
+                    in_string = 0;
+                }
+                continue;
+            }
+
+            switch (c) {
+            case '"':
+                in_string = 1;
+                break;
+            case '[':
+                if (++depth == 2) {
+                    in_items = 1;
+                }
+                break;
+            case '{':
+                if (++depth == 3 && in_items) {
+                    collecting = 1;
+                    start = i;
+                    item_len = 0;
+                }
+                break;
+            case ']':
+                if (depth-- == 2) {
+                    in_items = 0;
+                }
+                break;
+            case '}':
+                if (depth-- == 3 && collecting) {
+                    nvd_vulnerability *nvd_it;
+                    cJSON *json_item;
+                    size_t n = i + 1 - start;
+
+                    if (item_len + n + 1 > item_size) {
+                        item_size = item_len + n + 1;
+                        os_realloc(item, item_size, item);
+                    }
+
+                    memcpy(item + item_len, chunk + start, n);
+                    item[item_len + n] = '\0';
+                    collecting = 0;
+
+                    if (json_item = cJSON_Parse(item), !json_item) {
+                        mterror(WM_VULNDETECTOR_LOGTAG, VU_PARSED_FEED_ERROR, stream->feed_ext, path);
+                        goto end;
+                    }
+
+                    os_calloc(1, sizeof(nvd_vulnerability), nvd_it);
+                    wm_vuldet_parse_nvd_item(json_item, nvd_it);
+                    cJSON_Delete(json_item);
+
+                    if (wm_vuldet_nvd_stream_push(stream, nvd_it)) {
+                        goto end;
+                    }
+                }
+            }
         }
 
-        if (nvd_it) {
-            os_calloc(1, sizeof(nvd_vulnerability), nvd_it->next);
-            nvd_it = nvd_it->next;
-        } else {
-            os_calloc(1, sizeof(nvd_vulnerability), nvd_it);
-            nvd_first = nvd_it;
-        }
-        for (cve_content = cve_list->child; json_tagged_obj(cve_content); cve_content = cve_content->next) {
-            if (!strcmp(cve_content->string, JSON_CVE)) {
-                wm_vuldet_parse_nvd_cve(cve_content, nvd_it);
-            } else if (!strcmp(cve_content->string, JSON_CONFIGURATIONS)) {
-                wm_vuldet_parse_nvd_configuration(cve_content, nvd_it);
-            } else if (!strcmp(cve_content->string, JSON_IMPACT)) {
-                wm_vuldet_parse_nvd_impact(cve_content, nvd_it);
-            } else if (!strcmp(cve_content->string, JSON_PUBLISHED)) {
-                w_strdup(cve_content->valuestring, nvd_it->published);
-            } else if (!strcmp(cve_content->string, JSON_LAST_MOD)) {
-                w_strdup(cve_content->valuestring, nvd_it->last_modified);
-            } else if (strcmp(cve_content->string, JSON_DATA_TYPE) &&
-                        strcmp(cve_content->string, JSON_DATA_FORMAT) &&
-                        strcmp(cve_content->string, JSON_DATA_VERSION)) {
-                mtwarn(WM_VULNDETECTOR_LOGTAG, VU_UNKNOWN_NVD_CVE_TAG, cve_content->string);
-            } else {
-                mtwarn(WM_VULNDETECTOR_LOGTAG, VU_UNKNOWN_NVD_TAG, cve_content->string);
+        // Keep the part of the CVE that is in this chunk
+        if (collecting) {
+            size_t n = length - start;
+
+            if (item_len + n + 1 > item_size) {
+                item_size = (item_len + n) * 2 + 1;
+                os_realloc(item, item_size, item);
             }
+
+            memcpy(item + item_len, chunk + start, n);
+            item_len += n;
         }
+    }
 
-        cJSON_Delete(cve_list);
+    if (ferror(fp) || depth || collecting) {
+        mterror(WM_VULNDETECTOR_LOGTAG, VU_PARSED_FEED_ERROR, stream->feed_ext, path);
+        goto end;
     }
 
-    if (nvd_it) {
-        if (parsed_vulnerabilities->nvd_vulnerabilities) {
-            nvd_it->next = parsed_vulnerabilities->nvd_vulnerabilities;
+    retval = 0;
+end:
+    fclose(fp);
+    os_free(chunk);
+    os_free(item);
+
+    return retval;
+}
+
+void *wm_vuldet_nvd_stream_parser(void *data) {
+    vu_nvd_stream *stream = data;
+    const char *path;
+
+    while (1) {
+        w_mutex_lock(&stream->mutex);
+
+        if (stream->error || !stream->feeds[stream->next]) {
+            w_mutex_unlock(&stream->mutex);
+            break;
+        }
+
+        path = stream->feeds[stream->next++];
+        w_mutex_unlock(&stream->mutex);
+
+        if (wm_vuldet_nvd_stream_feed(stream, path)) {
+            w_mutex_lock(&stream->mutex);
+            stream->error = 1;
+            w_cond_broadcast(&stream->room);
+            w_mutex_unlock(&stream->mutex);
+            break;
         }
-        parsed_vulnerabilities->nvd_vulnerabilities = nvd_first;
     }
 
-    return 0;
+    w_mutex_lock(&stream->mutex);
+    stream->parsers--;
+    w_cond_signal(&stream->available);
+    w_mutex_unlock(&stream->mutex);
+
+    return NULL;
+}
+
+vu_nvd_stream *wm_vuldet_nvd_stream_start(char **feeds, const char *feed_ext) {
+    vu_nvd_stream *stream;
+    unsigned int count;
+
+    os_calloc(1, sizeof(vu_nvd_stream), stream);
+    stream->feeds = feeds;
+    stream->feed_ext = feed_ext;
+    w_mutex_init(&stream->mutex, NULL);
+    w_cond_init(&stream->available, NULL);
+    w_cond_init(&stream->room, NULL);
+
+    for (count = 0; feeds[count]; count++);
+
+    if (count > NVD_STREAM_PARSERS) {
+        count = NVD_STREAM_PARSERS;
+    }
+
+    stream->parsers = count;
+
+    for (stream->threads = 0; stream->threads < count; stream->threads++) {
+        if (pthread_create(&stream->thread[stream->threads], NULL, wm_vuldet_nvd_stream_parser, stream)) {
+            mterror(WM_VULNDETECTOR_LOGTAG, THREAD_ERROR);
+            w_mutex_lock(&stream->mutex);
+            stream->error = 1;
+            stream->parsers -= count - stream->threads;
+            w_mutex_unlock(&stream->mutex);
+            break;
+        }
+    }
+
+    return stream;
+}
+
+nvd_vulnerability *wm_vuldet_nvd_stream_next(vu_nvd_stream *stream) {
+    nvd_vulnerability *nvd_it;
+
+    w_mutex_lock(&stream->mutex);
+
+    while (!stream->head && stream->parsers > 0) {
+        w_cond_wait(&stream->available, &stream->mutex);
+    }
+
+    if (nvd_it = stream->head, nvd_it) {
+        if (stream->head = nvd_it->next, !stream->head) {
+            stream->tail = NULL;
+        }
+
+        nvd_it->next = NULL;
+
+        if (stream->queued-- == NVD_STREAM_QUEUE) {
+            w_cond_signal(&stream->room);
+        }
+    }
+
+    w_mutex_unlock(&stream->mutex);
+    return nvd_it;
+}
+
+int wm_vuldet_nvd_stream_end(vu_nvd_stream *stream) {
+    unsigned int i;
+    int retval;
+
+    if (!stream) {
+        return OS_INVALID;
+    }
+
+    // Stop the parsers if the CVEs were not taken up to the end
+    w_mutex_lock(&stream->mutex);
+
+    if (stream->head || stream->parsers > 0) {
+        stream->error = 1;
+        w_cond_broadcast(&stream->room);
+    }
+
+    w_mutex_unlock(&stream->mutex);
+
+    for (i = 0; i < stream->threads; i++) {
+        pthread_join(stream->thread[i], NULL);
+    }
+
+    retval = stream->error ? OS_INVALID : 0;
+
+    wm_vuldet_free_nvd_list(stream->head);
+    w_mutex_destroy(&stream->mutex);
+    w_cond_destroy(&stream->available);
+    w_cond_destroy(&stream->room);
+    free(stream);
+
+    return retval;
 }
 
 int wm_vuldet_parse_nvd_cve(cJSON *node, nvd_vulnerability *data) {
@@ -1271,13 +1587,34 @@ int wm_vuldet_parse_nvd_impact(cJSON *nvd_item, nvd_vulnerability *data) {
     return 0;
 }
 
+int wm_vuldet_nvd_stmt(sqlite3 *db, vu_query query, sqlite3_stmt **stmt) {
+    int result = SQLITE_OK;
+
+    if (vu_nvd_stmts[query]) {
+        sqlite3_reset(vu_nvd_stmts[query]);
+    } else {
+        result = wm_vuldet_prepare(db, vu_queries[query], -1, &vu_nvd_stmts[query], NULL);
+    }
+
+    *stmt = vu_nvd_stmts[query];
+    return result;
+}
+
+void wm_vuldet_nvd_release_stmts() {
+    unsigned int i;
+
+    for (i = 0; i < END_T; i++) {
+        wdb_finalize(vu_nvd_stmts[i]);
+    }
+}
+
 int wm_vuldet_insert_nvd_cve(sqlite3 *db, nvd_vulnerability *nvd_data, int year) {
     sqlite3_stmt *stmt = NULL;
     int result;
     int id_nvd_cve = 0;
 
-    if (wm_vuldet_prepare(db, vu_queries[VU_INSERT_NVD_CVE], -1, &stmt, NULL) != SQLITE_OK) {
-        return wm_vuldet_sql_error(db, stmt);
+    if (wm_vuldet_nvd_stmt(db, VU_INSERT_NVD_CVE, &stmt) != SQLITE_OK) {
+        return wm_vuldet_sql_error(db, NULL);
     }
 
     sqlite3_bind_int(stmt, 1, year);
@@ -1290,20 +1627,19 @@ int wm_vuldet_insert_nvd_cve(sqlite3 *db, nvd_vulnerability *nvd_data, int year)
     sqlite3_bind_text(stmt, 8, nvd_data->last_modified, -1, NULL);
 
     if (result = wm_vuldet_step(stmt), result != SQLITE_DONE && result != SQLITE_CONSTRAINT) {
-        return wm_vuldet_sql_error(db, stmt);
+        return wm_vuldet_sql_error(db, NULL);
     }
-    wdb_finalize(stmt);
 
-    if (wm_vuldet_prepare(db, vu_queries[VU_GET_MAX_NVD_CVE_ID], -1, &stmt, NULL) != SQLITE_OK) {
-        return wm_vuldet_sql_error(db, stmt);
+    if (wm_vuldet_nvd_stmt(db, VU_GET_MAX_NVD_CVE_ID, &stmt) != SQLITE_OK) {
+        return wm_vuldet_sql_error(db, NULL);
     }
 
     if (result = wm_vuldet_step(stmt), result != SQLITE_ROW) {
-        return wm_vuldet_sql_error(db, stmt);
+        return wm_vuldet_sql_error(db, NULL);
     }
 
     id_nvd_cve = sqlite3_column_int(stmt, 0);
-    wdb_finalize(stmt);
+    sqlite3_reset(stmt);
 
     if (id_nvd_cve > 0) {
         if (nvd_data->references) {
@@ -1342,17 +1678,16 @@ int wm_vuldet_insert_nvd_cve_references(sqlite3 *db, nvd_references *nvd_data, i
 
     node = nvd_data;
     while(node && node->url) {
-        if (wm_vuldet_prepare(db, vu_queries[VU_INSERT_NVD_REFERENCE], -1, &stmt, NULL) != SQLITE_OK) {
-            return wm_vuldet_sql_error(db, stmt);
+        if (wm_vuldet_nvd_stmt(db, VU_INSERT_NVD_REFERENCE, &stmt) != SQLITE_OK) {
+            return wm_vuldet_sql_error(db, NULL);
         }
         sqlite3_bind_int(stmt, 1, node_id);
         sqlite3_bind_text(stmt, 2, node->url, -1, NULL);
         sqlite3_bind_text(stmt, 3, node->refsource, -1, NULL);
 
         if (result = wm_vuldet_step(stmt), result != SQLITE_DONE && result != SQLITE_CONSTRAINT) {
-            return wm_vuldet_sql_error(db, stmt);
+            return wm_vuldet_sql_error(db, NULL);
         }
-        wdb_finalize(stmt);
         node = node->next;
     }
 
@@ -1363,8 +1698,8 @@ int wm_vuldet_insert_nvd_cve_metric_cvss(sqlite3 *db, cv_scoring_system *nvd_dat
     sqlite3_stmt *stmt = NULL;
     int result;
 
-    if (wm_vuldet_prepare(db, vu_queries[VU_INSERT_NVD_METRIC_CVSS], -1, &stmt, NULL) != SQLITE_OK) {
-        return wm_vuldet_sql_error(db, stmt);
+    if (wm_vuldet_nvd_stmt(db, VU_INSERT_NVD_METRIC_CVSS, &stmt) != SQLITE_OK) {
+        return wm_vuldet_sql_error(db, NULL);
     }
 
     sqlite3_bind_int(stmt, 1, node_id);
@@ -1375,9 +1710,8 @@ int wm_vuldet_insert_nvd_cve_metric_cvss(sqlite3 *db, cv_scoring_system *nvd_dat
     sqlite3_bind_double(stmt, 6, nvd_data->impact_score);
 
     if (result = wm_vuldet_step(stmt), result != SQLITE_DONE && result != SQLITE_CONSTRAINT) {
-        return wm_vuldet_sql_error(db, stmt);
+        return wm_vuldet_sql_error(db, NULL);
     }
-    wdb_finalize(stmt);
 
     return 0;
 }
@@ -1390,28 +1724,27 @@ int wm_vuldet_insert_nvd_cve_configuration(sqlite3 *db, nvd_configuration *nvd_d
 
     node = nvd_data;
     while(node) {
-        if (wm_vuldet_prepare(db, vu_queries[VU_INSERT_NVD_CVE_CONFIGURATION], -1, &stmt, NULL) != SQLITE_OK) {
-            return wm_vuldet_sql_error(db, stmt);
+        if (wm_vuldet_nvd_stmt(db, VU_INSERT_NVD_CVE_CONFIGURATION, &stmt) != SQLITE_OK) {
+            return wm_vuldet_sql_error(db, NULL);
         }
         sqlite3_bind_int(stmt, 1, cve_node_id);
         sqlite3_bind_int(stmt, 2, parent);
         sqlite3_bind_text(stmt, 3, node->operator, -1, NULL);
 
         if (result = wm_vuldet_step(stmt), result != SQLITE_DONE && result != SQLITE_CONSTRAINT) {
-            return wm_vuldet_sql_error(db, stmt);
+            return wm_vuldet_sql_error(db, NULL);
         }
-        wdb_finalize(stmt);
 
-        if (wm_vuldet_prepare(db, vu_queries[VU_GET_MAX_CONFIGURATION_ID], -1, &stmt, NULL) != SQLITE_OK) {
-            return wm_vuldet_sql_error(db, stmt);
+        if (wm_vuldet_nvd_stmt(db, VU_GET_MAX_CONFIGURATION_ID, &stmt) != SQLITE_OK) {
+            return wm_vuldet_sql_error(db, NULL);
         }
 
         if (result = wm_vuldet_step(stmt), result != SQLITE_ROW) {
-            return wm_vuldet_sql_error(db, stmt);
+            return wm_vuldet_sql_error(db, NULL);
         }
 
         conf_id = sqlite3_column_int(stmt, 0);
-        wdb_finalize(stmt);
+        sqlite3_reset(stmt);
 
         if (conf_id > 0) {
             if(node->children) {
@@ -1447,8 +1780,8 @@ int wm_vuldet_insert_nvd_cve_match(sqlite3 *db, nvd_conf_cpe_match *nvd_data, in
             return OS_INVALID;
         }
 
-        if (wm_vuldet_prepare(db, vu_queries[VU_INSERT_NVD_CVE_MATCHES], -1, &stmt, NULL) != SQLITE_OK) {
-            return wm_vuldet_sql_error(db, stmt);
+        if (wm_vuldet_nvd_stmt(db, VU_INSERT_NVD_CVE_MATCHES, &stmt) != SQLITE_OK) {
+            return wm_vuldet_sql_error(db, NULL);
         }
         sqlite3_bind_int(stmt, 1, conf_id);
         sqlite3_bind_int(stmt, 2, cpe_id);
@@ -1460,9 +1793,8 @@ int wm_vuldet_insert_nvd_cve_match(sqlite3 *db, nvd_conf_cpe_match *nvd_data, in
         sqlite3_bind_text(stmt, 8, node->version_end_excluding, -1, NULL);
 
         if (result = wm_vuldet_step(stmt), result != SQLITE_DONE && result != SQLITE_CONSTRAINT) {
-            return wm_vuldet_sql_error(db, stmt);
+            return wm_vuldet_sql_error(db, NULL);
         }
-        wdb_finalize(stmt);
         node = node->next;
     }
 
@@ -1474,8 +1806,8 @@ int wm_vuldet_insert_nvd_cve_cpe(sqlite3 *db, cpe *cpe_data) {
     int result;
     unsigned long int cpe_id = 0;
 
-    if (wm_vuldet_prepare(db, vu_queries[VU_GET_MAX_NVD_CPE_ID], -1, &stmt, NULL) != SQLITE_OK) {
-        return wm_vuldet_sql_error(db, stmt);
+    if (wm_vuldet_nvd_stmt(db, VU_GET_MAX_NVD_CPE_ID, &stmt) != SQLITE_OK) {
+        return wm_vuldet_sql_error(db, NULL);
     }
     result = wm_vuldet_step(stmt);
 
@@ -1488,12 +1820,12 @@ int wm_vuldet_insert_nvd_cve_cpe(sqlite3 *db, cpe *cpe_data) {
     } else if (result == SQLITE_DONE) {
         cpe_id = 1;
     } else {
-        return wm_vuldet_sql_error(db, stmt);
+        return wm_vuldet_sql_error(db, NULL);
     }
-    wdb_finalize(stmt);
+    sqlite3_reset(stmt);
 
-    if (wm_vuldet_prepare(db, vu_queries[VU_INSERT_NVD_CPE], -1, &stmt, NULL) != SQLITE_OK) {
-        return wm_vuldet_sql_error(db, stmt);
+    if (wm_vuldet_nvd_stmt(db, VU_INSERT_NVD_CPE, &stmt) != SQLITE_OK) {
+        return wm_vuldet_sql_error(db, NULL);
     }
     sqlite3_bind_int(stmt, 1, cpe_id);
     sqlite3_bind_text(stmt, 2, cpe_data->part, -1, NULL);
@@ -1509,13 +1841,12 @@ int wm_vuldet_insert_nvd_cve_cpe(sqlite3 *db, cpe *cpe_data) {
     sqlite3_bind_text(stmt, 12, cpe_data->other, -1, NULL);
 
     if (result = wm_vuldet_step(stmt), result != SQLITE_DONE && result != SQLITE_CONSTRAINT) {
-        return wm_vuldet_sql_error(db, stmt);
+        return wm_vuldet_sql_error(db, NULL);
     }
-    wdb_finalize(stmt);
 
     if(result == SQLITE_CONSTRAINT) {
-        if (wm_vuldet_prepare(db, vu_queries[VU_GET_AN_CPE_ID], -1, &stmt, NULL) != SQLITE_OK) {
-            return wm_vuldet_sql_error(db, stmt);
+        if (wm_vuldet_nvd_stmt(db, VU_GET_AN_CPE_ID, &stmt) != SQLITE_OK) {
+            return wm_vuldet_sql_error(db, NULL);
         }
         sqlite3_bind_text(stmt, 1, cpe_data->part, -1, NULL);
         sqlite3_bind_text(stmt, 2, cpe_data->vendor, -1, NULL);
@@ -1530,10 +1861,10 @@ int wm_vuldet_insert_nvd_cve_cpe(sqlite3 *db, cpe *cpe_data) {
         sqlite3_bind_text(stmt, 11, cpe_data->other, -1, NULL);
 
         if (result = wm_vuldet_step(stmt), result != SQLITE_ROW) {
-            return wm_vuldet_sql_error(db, stmt);
+            return wm_vuldet_sql_error(db, NULL);
         }
         cpe_id = sqlite3_column_int(stmt, 0);
-        wdb_finalize(stmt);
+        sqlite3_reset(stmt);
     }
 
     return cpe_id;
@@ -1652,22 +1983,22 @@ int wm_vuldet_linux_nvd_vulnerabilities(sqlite3 *db, agent_software *agent, OSHa
         }
 
         if(pkg_source) { //Source
-            vulnerable_generic = wm_vuldet_check_generic_package(db, pkg_name, pkg_source_version ? pkg_source_version : pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_SOURCE, vuln_count); //Generic source
+            vulnerable_generic = wm_vuldet_check_nvd_package(db, pkg_name, pkg_source_version ? pkg_source_version : pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_SOURCE, vuln_count, 0); //Generic source
             if(vulnerable_generic == OS_INVALID) {
                 goto end;
             }
-            vulnerable_specific = wm_vuldet_check_specific_package(db, pkg_name, pkg_source_version ? pkg_source_version : pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_SOURCE, vuln_count); //Specific source
+            vulnerable_specific = wm_vuldet_check_nvd_package(db, pkg_name, pkg_source_version ? pkg_source_version : pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_SOURCE, vuln_count, 1); //Specific source
             if(vulnerable_specific == OS_INVALID) {
                 goto end;
             }
         }
 
         if(pkg_name && !vulnerable_generic && !vulnerable_specific) { //Name
-            vulnerable_generic = wm_vuldet_check_generic_package(db, pkg_name, pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_NAME, vuln_count); //Generic name
+            vulnerable_generic = wm_vuldet_check_nvd_package(db, pkg_name, pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_NAME, vuln_count, 0); //Generic name
             if(vulnerable_generic == OS_INVALID) {
                 goto end;
             }
-            vulnerable_specific = wm_vuldet_check_specific_package(db, pkg_name, pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_NAME, vuln_count); //Specific name
+            vulnerable_specific = wm_vuldet_check_nvd_package(db, pkg_name, pkg_source, pkg_version, pkg_arch, cve_table, PACKAGE_NAME, vuln_count, 1); //Specific name
             if(vulnerable_specific == OS_INVALID) {
                 goto end;
             }
@@ -1705,6 +2036,142 @@ end:
     return OS_INVALID;
 }
 
+void wm_vuldet_nvd_cache_init() {
+    if (vu_nvd_cache = OSHash_Create(), !vu_nvd_cache) {
+        merror(LIST_ERROR);
+        return;
+    }
+
+    if (!OSHash_setSize(vu_nvd_cache, VU_CVE_TABLE_SIZE)) {
+        merror(LIST_ERROR);
+        OSHash_Free(vu_nvd_cache);
+        vu_nvd_cache = NULL;
+    }
+}
+
+void wm_vuldet_free_nvd_match(void *data) {
+    vu_nvd_match *match = data;
+
+    if (match) {
+        if (match->cve_table) {
+            OSHash_Clean(match->cve_table, wm_vuldet_free_cve_node);
+        }
+        free(match);
+    }
+}
+
+void wm_vuldet_nvd_cache_free() {
+    if (vu_nvd_cache) {
+        OSHash_Clean(vu_nvd_cache, wm_vuldet_free_nvd_match);
+        vu_nvd_cache = NULL;
+    }
+}
+
+/* The matches of a package reference and a version are the same for every
+ * agent: only the names and the architecture of the package change. The first
+ * check collects them into a table of its own, and every check adds a copy of
+ * them to the table of the agent. */
+int wm_vuldet_check_nvd_package(sqlite3 *dbCVE, char *pkg_name, char *pkg_source, char *pkg_version, char *pkg_arch, OSHash *cve_table, int8_t name_type, int *vuln_count, int specific) {
+    char key[OS_SIZE_1024];
+    vu_nvd_match *match;
+    OSHashNode *node;
+    unsigned int it = 0;
+    const char *pkg_reference = (name_type == PACKAGE_SOURCE) ? pkg_source : pkg_name;
+    vu_nvd_match *discard = NULL;
+    int scratch_count = 0;
+    int vulnerable;
+
+    if (!vu_nvd_cache || !pkg_reference || !pkg_version) {
+        return specific ? wm_vuldet_check_specific_package(dbCVE, pkg_name, pkg_source, pkg_version, pkg_arch, cve_table, name_type, vuln_count)
+                        : wm_vuldet_check_generic_package(dbCVE, pkg_name, pkg_source, pkg_version, pkg_arch, cve_table, name_type, vuln_count);
+    }
+
+    snprintf(key, sizeof(key), "%c|%s|%s", specific ? 's' : 'g', pkg_reference, pkg_version);
+
+    if (match = OSHash_Get(vu_nvd_cache, key), !match) {
+        os_calloc(1, sizeof(vu_nvd_match), match);
+
+        if (match->cve_table = OSHash_Create(), !match->cve_table) {
+            merror(LIST_ERROR);
+            free(match);
+            return OS_INVALID;
+        }
+
+        match->vulnerable = specific ? wm_vuldet_check_specific_package(dbCVE, pkg_name, pkg_source, pkg_version, pkg_arch, match->cve_table, name_type, &scratch_count)
+                                     : wm_vuldet_check_generic_package(dbCVE, pkg_name, pkg_source, pkg_version, pkg_arch, match->cve_table, name_type, &scratch_count);
+
+        if (match->vulnerable == OS_INVALID) {
+            wm_vuldet_free_nvd_match(match);
+            return OS_INVALID;
+        }
+
+        // Most packages have no matches: don't keep an empty table for them
+        if (OSHash_Get_Elem_ex(match->cve_table) == 0) {
+            OSHash_Free(match->cve_table);
+            match->cve_table = NULL;
+        }
+
+        switch (OSHash_Add(vu_nvd_cache, key, match)) {
+        case 2:
+            break;
+        case 1:
+            // Another worker added the same entry in the meantime
+            wm_vuldet_free_nvd_match(match);
+            match = OSHash_Get(vu_nvd_cache, key);
+            break;
+        default:
+            // Use the matches without keeping them
+            discard = match;
+        }
+    }
+
+    for (node = match->cve_table ? OSHash_Begin(match->cve_table, &it) : NULL; node; node = OSHash_Next(match->cve_table, &it, node)) {
+        cve_vuln_pkg *pkg;
+
+        for (pkg = node->data; pkg; pkg = pkg->next) {
+            cve_vuln_cond_NVD *cond = pkg->nvd_cond;
+            const char *operation = cond->end_version ? vu_package_comp[cond->end_operation == END_INCLUDED ? PKG_LESS_THAN_OR_EQUAL : PKG_LESS_THAN]
+                                  : cond->start_version ? vu_package_comp[cond->start_operation == START_INCLUDED ? PKG_GREATER_THAN_OR_EQUAL : PKG_GREATER_THAN]
+                                  : vu_package_comp[PKG_EQUAL];
+            const char *operation_value = cond->end_version ? cond->end_version : cond->start_version ? cond->start_version : "*";
+            cve_vuln_pkg *newPkg;
+
+            os_calloc(1, sizeof(cve_vuln_pkg), newPkg);
+            os_calloc(1, sizeof(cve_vuln_cond_NVD), newPkg->nvd_cond);
+            memcpy(newPkg->nvd_cond, cond, sizeof(cve_vuln_cond_NVD));
+            w_strdup(cond->operator, newPkg->nvd_cond->operator);
+            w_strdup(cond->start_version, newPkg->nvd_cond->start_version);
+            w_strdup(cond->end_version, newPkg->nvd_cond->end_version);
+            w_strdup(pkg_version, newPkg->version);
+            w_strdup(pkg_name, newPkg->bin_name);
+            w_strdup(pkg_source, newPkg->src_name);
+            w_strdup(pkg_arch, newPkg->arch);
+            newPkg->feed = pkg->feed;
+            newPkg->discard = pkg->discard;
+
+            switch (wm_vuldet_add_cve_node(newPkg, node->key, cve_table)) {
+            case -1:
+                mterror(WM_VULNDETECTOR_LOGTAG, VU_INSERT_PACKAGE_ERROR, pkg_reference, node->key, pkg_version, operation, operation_value, "NVD");
+                wm_vuldet_free_cve_node(newPkg);
+                break;
+            case 1:
+                mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_DUPLICATED_PACKAGE, pkg_reference, node->key, pkg_version, operation, operation_value, "NVD");
+                wm_vuldet_free_cve_node(newPkg);
+                break;
+            case 0:
+                mtdebug2(WM_VULNDETECTOR_LOGTAG, VU_PACKAGE_INSERT, pkg_reference, node->key, pkg_version, operation, operation_value, "NVD");
+                (*vuln_count)++;
+                break;
+            }
+        }
+    }
+
+    vulnerable = match->vulnerable;
+    wm_vuldet_free_nvd_match(discard);
+
+    return vulnerable;
+}
+
 int wm_vuldet_win_nvd_vulnerabilities(sqlite3 *db, agent_software *agent, wm_vuldet_flags *flags) {
     vu_nvd_report *nvd_report_list = NULL;
     time_t start_time;
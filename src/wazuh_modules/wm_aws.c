@@ -20,6 +20,10 @@
 
 static wm_aws *aws_config;                              // Pointer to aws_configuration
 static int queue_fd;                                    // Output queue file descriptor
+static wm_aws_bucket *next_bucket;                      // Next bucket to run in this scan
+static wm_aws_service *next_service;                    // Next service to run in this scan
+static int aws_threads = 1;                             // Buckets and services running at once
+static pthread_mutex_t aws_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static void* wm_aws_main(wm_aws *aws_config);           // Module main function. It won't return
 static void wm_aws_setup(wm_aws *_aws_config);          // Setup module
@@ -27,6 +31,10 @@ static void wm_aws_cleanup();                           // Cleanup function, doe
 static void wm_aws_check();                             // Check configuration, disable flag
 static void wm_aws_run_s3(wm_aws_bucket *bucket);       // Run a s3 bucket
 static void wm_aws_run_service(wm_aws_service *service);// Run a AWS service such as Inspector
+static void wm_aws_exec_bucket(wm_aws_bucket *bucket);  // Log and run a bucket
+static void wm_aws_exec_service(wm_aws_service *service);// Log and run a service
+static void* wm_aws_worker(void *arg);                  // Run pending buckets and services
+static void wm_aws_run_parallel();                      // Run buckets and services, up to max_parallel at once
 static void wm_aws_destroy(wm_aws *aws_config);         // Destroy data
 cJSON *wm_aws_dump(const wm_aws *aws_config);
 
@@ -42,9 +50,6 @@ const wm_context WM_AWS_CONTEXT = {
 // Module module main function. It won't return.
 
 void* wm_aws_main(wm_aws *aws_config) {
-    wm_aws_bucket *cur_bucket;
-    wm_aws_service *cur_service;
-    char *log_info;
     char * timestamp = NULL;
 
 
@@ -73,99 +78,184 @@ void* wm_aws_main(wm_aws *aws_config) {
         }
         mtinfo(WM_AWS_LOGTAG, "Starting fetching of logs.");
 
-        for (cur_bucket = aws_config->buckets; cur_bucket; cur_bucket = cur_bucket->next) {
+        next_bucket = aws_config->buckets;
+        next_service = aws_config->services;
+        wm_aws_run_parallel();
 
-            log_info = NULL;
+        mtinfo(WM_AWS_LOGTAG, "Fetching logs finished.");
 
-            wm_strcat(&log_info, "Executing Bucket Analysis: (Bucket:", '\0');
-            if (cur_bucket->bucket) {
-                wm_strcat(&log_info, cur_bucket->bucket, ' ');
-            }
-            else {
-                wm_strcat(&log_info, "unknown_bucket", ' ');
-            }
+    } while (FOREVER());
 
+    return NULL;
+}
 
-            if (cur_bucket->trail_prefix) {
-                wm_strcat(&log_info, ", Path:", '\0');
-                wm_strcat(&log_info, cur_bucket->trail_prefix, ' ');
-            }
 
-            if (cur_bucket->type) {
-                wm_strcat(&log_info, ", Type:", '\0');
-                wm_strcat(&log_info, cur_bucket->type, ' ');
-            }
+// Log and run a bucket
 
-            if (cur_bucket->aws_account_id) {
-                wm_strcat(&log_info, ", Account ID:", '\0');
-                wm_strcat(&log_info, cur_bucket->aws_account_id, ' ');
-            }
+void wm_aws_exec_bucket(wm_aws_bucket *bucket) {
+    char *log_info = NULL;
 
-            if (cur_bucket->aws_account_alias) {
-                wm_strcat(&log_info, ", Account Alias:", '\0');
-                wm_strcat(&log_info, cur_bucket->aws_account_alias, ' ');
-            }
+    wm_strcat(&log_info, "Executing Bucket Analysis: (Bucket:", '\0');
+    if (bucket->bucket) {
+        wm_strcat(&log_info, bucket->bucket, ' ');
+    }
+    else {
+        wm_strcat(&log_info, "unknown_bucket", ' ');
+    }
 
-            if (cur_bucket->aws_organization_id) {
-                wm_strcat(&log_info, ", Organization ID:", '\0');
-                wm_strcat(&log_info, cur_bucket->aws_organization_id, ' ');
-            }
 
-            if (cur_bucket->aws_profile) {
-                wm_strcat(&log_info, ", Profile:", '\0');
-                wm_strcat(&log_info, cur_bucket->aws_profile, ' ');
-            }
+    if (bucket->trail_prefix) {
+        wm_strcat(&log_info, ", Path:", '\0');
+        wm_strcat(&log_info, bucket->trail_prefix, ' ');
+    }
+
+    if (bucket->type) {
+        wm_strcat(&log_info, ", Type:", '\0');
+        wm_strcat(&log_info, bucket->type, ' ');
+    }
+
+    if (bucket->aws_account_id) {
+        wm_strcat(&log_info, ", Account ID:", '\0');
+        wm_strcat(&log_info, bucket->aws_account_id, ' ');
+    }
+
+    if (bucket->aws_account_alias) {
+        wm_strcat(&log_info, ", Account Alias:", '\0');
+        wm_strcat(&log_info, bucket->aws_account_alias, ' ');
+    }
+
+    if (bucket->aws_organization_id) {
+        wm_strcat(&log_info, ", Organization ID:", '\0');
+        wm_strcat(&log_info, bucket->aws_organization_id, ' ');
+    }
+
+    if (bucket->aws_profile) {
+        wm_strcat(&log_info, ", Profile:", '\0');
+        wm_strcat(&log_info, bucket->aws_profile, ' ');
+    }
+
+    wm_strcat(&log_info, ")", '\0');
+
+    mtinfo(WM_AWS_LOGTAG, "%s", log_info);
+    wm_aws_run_s3(bucket);
+    free(log_info);
+}
+
+// Log and run a service
+
+void wm_aws_exec_service(wm_aws_service *service) {
+    char *log_info = NULL;
+
+    wm_strcat(&log_info, "Executing Service Analysis: (Service:", '\0');
+    if (service->type) {
+        wm_strcat(&log_info, service->type, ' ');
+    }
+    else {
+        wm_strcat(&log_info, "unknown_type", ' ');
+    }
+
 
-            wm_strcat(&log_info, ")", '\0');
+    if (service->aws_account_id) {
+        wm_strcat(&log_info, ", Account ID:", '\0');
+        wm_strcat(&log_info, service->aws_account_id, ' ');
+    }
+
+    if (service->aws_account_alias) {
+        wm_strcat(&log_info, ", Account Alias:", '\0');
+        wm_strcat(&log_info, service->aws_account_alias, ' ');
+    }
+
+    if (service->aws_profile) {
+        wm_strcat(&log_info, ", Profile:", '\0');
+        wm_strcat(&log_info, service->aws_profile, ' ');
+    }
+
+    wm_strcat(&log_info, ")", '\0');
+
+    mtinfo(WM_AWS_LOGTAG, "%s", log_info);
+    wm_aws_run_service(service);
+    free(log_info);
+}
+
+// Run the pending buckets and services until none is left
 
-            mtinfo(WM_AWS_LOGTAG, "%s", log_info);
-            wm_aws_run_s3(cur_bucket);
-            free(log_info);
+void* wm_aws_worker(__attribute__((unused)) void *arg) {
+    wm_aws_bucket *bucket;
+    wm_aws_service *service;
+
+    while (1) {
+        bucket = NULL;
+        service = NULL;
+
+        w_mutex_lock(&aws_mutex);
+
+        if (next_bucket) {
+            bucket = next_bucket;
+            next_bucket = bucket->next;
+        } else if (next_service) {
+            service = next_service;
+            next_service = service->next;
         }
 
-        for (cur_service = aws_config->services; cur_service; cur_service = cur_service->next) {
+        w_mutex_unlock(&aws_mutex);
 
-            log_info = NULL;
+        if (bucket) {
+            wm_aws_exec_bucket(bucket);
+        } else if (service) {
+            wm_aws_exec_service(service);
+        } else {
+            return NULL;
+        }
+    }
+}
 
-            wm_strcat(&log_info, "Executing Service Analysis: (Service:", '\0');
-            if (cur_service->type) {
-                wm_strcat(&log_info, cur_service->type, ' ');
-            }
-            else {
-                wm_strcat(&log_info, "unknown_type", ' ');
-            }
+// Run buckets and services, up to max_parallel at once
 
+void wm_aws_run_parallel() {
+    pthread_t threads[WM_AWS_MAX_PARALLEL];
+    wm_aws_bucket *bucket;
+    wm_aws_service *service;
+    int count = 0;
+    int i;
 
-            if (cur_service->aws_account_id) {
-                wm_strcat(&log_info, ", Account ID:", '\0');
-                wm_strcat(&log_info, cur_service->aws_account_id, ' ');
-            }
+    for (bucket = next_bucket; bucket; bucket = bucket->next) {
+        count++;
+    }
 
-            if (cur_service->aws_account_alias) {
-                wm_strcat(&log_info, ", Account Alias:", '\0');
-                wm_strcat(&log_info, cur_service->aws_account_alias, ' ');
-            }
+    for (service = next_service; service; service = service->next) {
+        count++;
+    }
 
-            if (cur_service->aws_profile) {
-                wm_strcat(&log_info, ", Profile:", '\0');
-                wm_strcat(&log_info, cur_service->aws_profile, ' ');
-            }
+    aws_threads = aws_config->max_parallel < count ? aws_config->max_parallel : count;
 
-            wm_strcat(&log_info, ")", '\0');
+    // A single run keeps the module thread
+
+    if (aws_threads <= 1) {
+        aws_threads = 1;
+        wm_aws_worker(NULL);
+        return;
+    }
 
-            mtinfo(WM_AWS_LOGTAG, "%s", log_info);
-            wm_aws_run_service(cur_service);
-            free(log_info);
+    mtdebug1(WM_AWS_LOGTAG, "Running %d buckets and services, %d at once.", count, aws_threads);
+
+    for (i = 0; i < aws_threads; i++) {
+        if (pthread_create(&threads[i], NULL, wm_aws_worker, NULL) != 0) {
+            mterror(WM_AWS_LOGTAG, "Cannot create thread: %s (%d)", strerror(errno), errno);
+            break;
         }
+    }
 
-        mtinfo(WM_AWS_LOGTAG, "Fetching logs finished.");
+    // Without any thread, run them here
 
-    } while (FOREVER());
+    if (i == 0) {
+        wm_aws_worker(NULL);
+    }
 
-    return NULL;
+    while (i > 0) {
+        pthread_join(threads[--i], NULL);
+    }
 }
 
-
 // Get read data
 
 cJSON *wm_aws_dump(const wm_aws *aws_config) {
@@ -178,6 +268,7 @@ cJSON *wm_aws_dump(const wm_aws *aws_config) {
     if (aws_config->enabled) cJSON_AddStringToObject(wm_aws,"disabled","no"); else cJSON_AddStringToObject(wm_aws,"disabled","yes");
     if (aws_config->run_on_start) cJSON_AddStringToObject(wm_aws,"run_on_start","yes"); else cJSON_AddStringToObject(wm_aws,"run_on_start","no");
     if (aws_config->skip_on_error) cJSON_AddStringToObject(wm_aws,"skip_on_error","yes"); else cJSON_AddStringToObject(wm_aws,"skip_on_error","no");
+    cJSON_AddNumberToObject(wm_aws,"max_parallel",aws_config->max_parallel);
     if (aws_config->buckets) {
         wm_aws_bucket *iter;
         cJSON *arr_buckets = cJSON_CreateArray();
@@ -306,8 +397,8 @@ void wm_aws_run_s3(wm_aws_bucket *exec_bucket) {
     char *output = NULL;
     char *command = NULL;
 
-    // Define time to sleep between messages sent
-    int usec = 1000000 / wm_max_eps;
+    // Define time to sleep between messages sent, shared by the runs at once
+    int usec = 1000000 / wm_max_eps * aws_threads;
 
     // Create arguments
     mtdebug2(WM_AWS_LOGTAG, "Create argument list");
@@ -377,9 +468,11 @@ void wm_aws_run_s3(wm_aws_bucket *exec_bucket) {
     if (aws_config->skip_on_error) {
         wm_strcat(&command, "--skip_on_error", ' ');
     }
+    w_mutex_lock(&aws_mutex);
     if (wm_state_io(WM_AWS_CONTEXT.name, WM_IO_READ, &aws_config->state, sizeof(aws_config->state)) < 0) {
         memset(&aws_config->state, 0, sizeof(aws_config->state));
     }
+    w_mutex_unlock(&aws_mutex);
 
     // Execute
     char *trail_title = NULL;
@@ -452,8 +545,8 @@ void wm_aws_run_service(wm_aws_service *exec_service) {
     char *output = NULL;
     char *command = NULL;
 
-    // Define time to sleep between messages sent
-    int usec = 1000000 / wm_max_eps;
+    // Define time to sleep between messages sent, shared by the runs at once
+    int usec = 1000000 / wm_max_eps * aws_threads;
 
     // Create arguments
     mtdebug2(WM_AWS_LOGTAG, "Create argument list");
@@ -507,9 +600,11 @@ void wm_aws_run_service(wm_aws_service *exec_service) {
     if (aws_config->skip_on_error) {
         wm_strcat(&command, "--skip_on_error", ' ');
     }
+    w_mutex_lock(&aws_mutex);
     if (wm_state_io(WM_AWS_CONTEXT.name, WM_IO_READ, &aws_config->state, sizeof(aws_config->state)) < 0) {
         memset(&aws_config->state, 0, sizeof(aws_config->state));
     }
+    w_mutex_unlock(&aws_mutex);
 
     // Execute
     char *service_title = NULL;
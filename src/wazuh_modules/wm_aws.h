@@ -18,6 +18,7 @@
 #define WM_AWS_DEFAULT_INTERVAL 5
 #define WM_AWS_DEFAULT_DIR WM_DEFAULT_DIR "/aws"
 #define WM_AWS_SCRIPT_PATH WM_AWS_DEFAULT_DIR "/aws-s3"
+#define WM_AWS_MAX_PARALLEL 64
 
 typedef struct wm_aws_state_t {
     time_t next_time;               // Absolute time for next scan
@@ -64,6 +65,7 @@ typedef struct wm_aws {
     unsigned int run_on_start:1;
     unsigned int remove_from_bucket:1;  // DEPRECATE
     unsigned int skip_on_error:1;
+    int max_parallel;                   // Buckets and services fetched at once
     wm_aws_state_t state;
     wm_aws_bucket *buckets;      // buckets (linked list)
     wm_aws_service *services;      // services (linked list)
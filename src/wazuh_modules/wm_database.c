@@ -52,11 +52,21 @@ static void wm_inotify_setup(wm_database * data);
 // Real time inotify reader thread
 static void * wm_inotify_start(void * args);
 
+// Events of a pending path, kept as its value at the path table
+#define WM_SYNC_WRITE 1     // The file may have new content
+#define WM_SYNC_TOUCH 2     // Only the attributes of the file changed
+
 // Insert request into internal structure
-void wm_inotify_push(const char * dirname, const char * fname);
+void wm_inotify_push(const char * dirname, const char * fname, int events);
 
 // Extract enqueued path from internal structure
-char * wm_inotify_pop();
+char * wm_inotify_pop(int * events);
+
+// Extract enqueued path if there is any, without waiting
+static char * wm_inotify_trypop(int * events);
+
+// Synchronize the pending paths, putting the agent-info ones in shared transactions
+static void wm_inotify_sync(char * path, int events);
 
 #endif // INOTIFY_ENABLED
 
@@ -92,6 +102,8 @@ static int wm_sync_agent_group(int id_agent, const char *fname);
 static int wm_sync_shared_group(const char *fname);
 static void wm_scan_directory(const char *dirname);
 static int wm_sync_file(const char *dirname, const char *path);
+// Update the last keepalive of an agent from the time of its agent-info file.
+static int wm_sync_keepalive(const char *dirname, const char *fname);
 // Fill syscheck database from an offset. Returns offset at last successful read event, or -1 on error.
 static long wm_fill_syscheck(sqlite3 *db, const char *path, long offset, int is_registry);
 // Fill complete rootcheck database.
@@ -135,28 +147,14 @@ void* wm_database_main(wm_database *data) {
 #ifdef INOTIFY_ENABLED
     if (data->real_time) {
         char * path;
-        char * file;
 
         wm_inotify_setup(data);
 
         while (1) {
-            path = wm_inotify_pop();
-
-#ifndef LOCAL
-            if (!strcmp(path, KEYSFILE_PATH)) {
-                wm_sync_agents();
-            } else
-#endif // !LOCAL
-            {
-                if (file = strrchr(path, '/'), file) {
-                    *(file++) = '\0';
-                    wm_sync_file(path, file);
-                } else {
-                    mterror(WM_DATABASE_LOGTAG, "Couldn't extract file name from '%s'", path);
-                }
-            }
+            int events;
 
-            free(path);
+            path = wm_inotify_pop(&events);
+            wm_inotify_sync(path, events);
         }
     } else {
 #endif // INOTIFY_ENABLED
@@ -342,15 +340,26 @@ void wm_check_agents() {
     }
 }
 
-// Synchronize agents
+/* Synchronize agents. Only the keys that were added, changed or removed since
+ * the last synchronization are applied, in a single transaction. The first
+ * synchronization compares the whole keystore with the database.
+ */
 void wm_sync_agents() {
+    // Name, address and key of each agent synchronized, by ID
+    static OSHash * synced = NULL;
+    OSHash * current;
+    OSHashNode * node;
     unsigned int i;
     char path[PATH_MAX] = "";
+    char fingerprint[OS_SIZE_2048];
     char * group;
+    char * dup;
     char cidr[20];
     keystore keys = KEYSTORE_INITIALIZER;
     keyentry *entry;
     int *agents;
+    int transaction;
+    unsigned int changes = 0;
     clock_t clock0 = clock();
     struct timespec spec0;
     struct timespec spec1;
@@ -362,14 +371,36 @@ void wm_sync_agents() {
     OS_PassEmptyKeyfile();
     OS_ReadKeys(&keys, 0, 0, 0);
 
+    if (current = OSHash_Create(), !current) {
+        merror_exit("At wm_sync_agents(): OSHash_Create()");
+    }
+
+    OSHash_SetFreeDataPointer(current, free);
     os_calloc(OS_SIZE_65536 + 1, sizeof(char), group);
 
+    transaction = wdb_open_global() == 0 && wdb_begin(wdb_global) == 0;
+
     /* Insert new entries */
 
     for (i = 0; i < keys.keysize; i++) {
         entry = keys.keyentries[i];
         int id;
+        const char * last;
+
+        snprintf(fingerprint, sizeof(fingerprint), "%s %s %s", entry->name, entry->ip->ip, entry->key);
+        last = synced ? OSHash_Get(synced, entry->id) : NULL;
+
+        os_strdup(fingerprint, dup);
+
+        if (OSHash_Add(current, entry->id, dup) != 2) {
+            free(dup);
+        }
 
+        if (last && !strcmp(last, fingerprint)) {
+            continue;
+        }
+
+        changes++;
         mtdebug2(WM_DATABASE_LOGTAG, "Synchronizing agent %s '%s'.", entry->id, entry->name);
 
         if (!(id = atoi(entry->id))) {
@@ -408,7 +439,28 @@ void wm_sync_agents() {
 
     /* Delete old keys */
 
-    if ((agents = wdb_get_all_agents())) {
+    if (synced) {
+        for (node = OSHash_Begin(synced, &i); node; node = OSHash_Next(synced, &i, node)) {
+            if (OSHash_Get(current, node->key)) {
+                continue;
+            }
+
+            changes++;
+
+            if (wdb_remove_agent(atoi(node->key)) < 0) {
+                mtdebug1(WM_DATABASE_LOGTAG, "Couldn't remove agent %s", node->key);
+
+                // Retry on the next synchronization
+                os_strdup("", dup);
+
+                if (OSHash_Add(current, node->key, dup) != 2) {
+                    free(dup);
+                }
+            }
+        }
+
+        OSHash_Free(synced);
+    } else if ((agents = wdb_get_all_agents())) {
         char id[9];
 
         for (i = 0; agents[i] != -1; i++) {
@@ -424,9 +476,15 @@ void wm_sync_agents() {
         free(agents);
     }
 
+    // The database may have been closed on an error, dropping the transaction
+    if (transaction && wdb_global) {
+        wdb_commit(wdb_global);
+    }
+
+    synced = current;
     free(group);
     OS_FreeKeys(&keys);
-    mtdebug1(WM_DATABASE_LOGTAG, "Agent sync completed.");
+    mtdebug1(WM_DATABASE_LOGTAG, "Agent sync completed: %u changes.", changes);
     gettime(&spec1);
     time_sub(&spec1, &spec0);
     mtdebug1(WM_DATABASE_LOGTAG, "wm_sync_agents(): %.3f ms (%.3f clock ms).", spec1.tv_sec * 1000 + spec1.tv_nsec / 1000000.0, (double)(clock() - clock0) / CLOCKS_PER_SEC * 1000);
@@ -986,6 +1044,43 @@ int wm_sync_file(const char *dirname, const char *fname) {
     return result;
 }
 
+int wm_sync_keepalive(const char *dirname, const char *fname) {
+    char name[FILE_SIZE];
+    char addr[FILE_SIZE];
+    char path[PATH_MAX];
+    struct stat buffer;
+    int id_agent;
+    int is_registry;
+
+    if (snprintf(path, PATH_MAX, "%s/%s", dirname, fname) >= PATH_MAX) {
+        mterror(WM_DATABASE_LOGTAG, "At wm_sync_keepalive(): Path '%s/%s' exceeded length limit.", dirname, fname);
+        return -1;
+    }
+
+    switch (wm_extract_agent(fname, name, addr, &is_registry)) {
+    case 0:
+        break;
+    case 1:
+        mtdebug1(WM_DATABASE_LOGTAG, "Ignoring file '%s/%s'", dirname, fname);
+        return 0;
+    default:
+        mterror(WM_DATABASE_LOGTAG, "Couldn't extract agent name and address from file %s/%s", dirname, fname);
+        return -1;
+    }
+
+    if ((id_agent = wdb_find_agent(name, addr)) < 0) {
+        // Let the whole synchronization deal with unknown agents
+        return wm_sync_file(dirname, fname);
+    }
+
+    if (stat(path, &buffer) < 0) {
+        mtdebug2(WM_DATABASE_LOGTAG, FSTAT_ERROR, path, errno, strerror(errno));
+        return -1;
+    }
+
+    return wdb_update_agent_keepalive(id_agent, buffer.st_mtime) < 0 ? -1 : 0;
+}
+
 // Fill syscheck database from an offset. Returns offset at last successful read event, or -1 on error.
 long wm_fill_syscheck(sqlite3 *db, const char *path, long offset, int is_registry) {
     char buffer[OS_MAXSTR];
@@ -996,8 +1091,10 @@ long wm_fill_syscheck(sqlite3 *db, const char *path, long offset, int is_registr
     char *f_name;
     int count;
     long last_offset = offset;
+    long length = 0;
     clock_t clock_ini;
     int type = is_registry ? WDB_FILE_TYPE_REGISTRY : WDB_FILE_TYPE_FILE;
+    wdb_legacy_t legacy;
     FILE *fp;
 
     sk_sum_t sum;
@@ -1015,15 +1112,21 @@ long wm_fill_syscheck(sqlite3 *db, const char *path, long offset, int is_registr
     }
 
     clock_ini = clock();
+    wdb_legacy_init(&legacy, db);
     wdb_begin(db);
 
-    for (count = 0; fgets(buffer, OS_MAXSTR, fp); last_offset = ftell(fp)) {
+    // The offset follows the lengths of the lines read, as they end with a newline
+    for (count = 0; fgets(buffer, OS_MAXSTR, fp); last_offset += length) {
         end = strchr(buffer, '\n');
 
         if (!end) {
             mtwarn(WM_DATABASE_LOGTAG, "Corrupt line found parsing '%s' (incomplete). Breaking.", path);
             break;
-        } else if (end == buffer)
+        }
+
+        length = end - buffer + 1;
+
+        if (end == buffer)
             continue;
 
         *end = '\0';
@@ -1046,7 +1149,7 @@ long wm_fill_syscheck(sqlite3 *db, const char *path, long offset, int is_registr
 
         switch (sk_decode_sum(&sum, c_sum, NULL)) {
         case 0:
-            switch (wdb_get_last_fim(db, f_name, type)) {
+            switch (wdb_get_last_fim(&legacy, f_name, type)) {
             case WDB_FIM_NOT_FOUND:
                 event = buffer[0] == '+' || (buffer[0] == '#' && buffer[1] == '+') ? "added" : "modified";
                 break;
@@ -1072,13 +1175,14 @@ long wm_fill_syscheck(sqlite3 *db, const char *path, long offset, int is_registr
             continue;
         }
 
-        if (wdb_insert_fim(db, type, atol(timestamp), f_name, event, &sum) < 0)
+        if (wdb_insert_fim(&legacy, type, atol(timestamp), f_name, event, &sum) < 0)
             mterror(WM_DATABASE_LOGTAG, "Couldn't insert FIM event into database from file '%s'.", path);
 
         count++;
     }
 
     wdb_commit(db);
+    wdb_legacy_finalize(&legacy);
     mtdebug2(WM_DATABASE_LOGTAG, "Syscheck file sync finished. Count: %d. Time: %.3lf ms.", count, (double)(clock() - clock_ini) / CLOCKS_PER_SEC * 1000);
 
     fclose(fp);
@@ -1092,6 +1196,7 @@ int wm_fill_rootcheck(sqlite3 *db, const char *path) {
     int count = 0;
     rk_event_t event;
     clock_t clock_ini;
+    wdb_legacy_t legacy;
     FILE *fp;
 
     if (!(fp = fopen(path, "r"))) {
@@ -1100,6 +1205,7 @@ int wm_fill_rootcheck(sqlite3 *db, const char *path) {
     }
 
     clock_ini = clock();
+    wdb_legacy_init(&legacy, db);
     wdb_begin(db);
 
     while (fgets(buffer, OS_MAXSTR, fp)) {
@@ -1118,12 +1224,12 @@ int wm_fill_rootcheck(sqlite3 *db, const char *path) {
             continue;
         }
 
-        switch (wdb_update_pm(db, &event)) {
+        switch (wdb_update_pm(&legacy, &event)) {
             case -1:
                 mterror(WM_DATABASE_LOGTAG, "Updating PM tuple on SQLite database for file '%s'.", path);
                 continue;
             case 0:
-                if (wdb_insert_pm(db, &event) < 0) {
+                if (wdb_insert_pm(&legacy, &event) < 0) {
                     mterror(WM_DATABASE_LOGTAG, "Inserting PM tuple on SQLite database for file '%s'.", path);
                     continue;
                 }
@@ -1137,6 +1243,7 @@ int wm_fill_rootcheck(sqlite3 *db, const char *path) {
     }
 
     wdb_commit(db);
+    wdb_legacy_finalize(&legacy);
     mtdebug2(WM_DATABASE_LOGTAG, "Rootcheck file sync finished. Count: %d. Time: %.3lf ms.", count, (double)(clock() - clock_ini) / CLOCKS_PER_SEC * 1000);
 
     fclose(fp);
@@ -1221,6 +1328,7 @@ cJSON *wm_database_dump(const wm_database *data) {
     if (data->real_time) cJSON_AddStringToObject(wm_db,"real_time","yes"); else cJSON_AddStringToObject(wm_db,"real_time","no");
     cJSON_AddNumberToObject(wm_db,"interval",data->interval);
     cJSON_AddNumberToObject(wm_db,"max_queued_events",data->max_queued_events);
+    cJSON_AddNumberToObject(wm_db,"sync_batch",data->sync_batch);
 
     cJSON_AddItemToObject(root,"database",wm_db);
 
@@ -1250,6 +1358,7 @@ wmodule* wm_database_read() {
     data.real_time = getDefine_Int("wazuh_database", "real_time", 0, 1);
     data.interval = getDefine_Int("wazuh_database", "interval", 0, 86400);
     data.max_queued_events = getDefine_Int("wazuh_database", "max_queued_events", 0, INT_MAX);
+    data.sync_batch = getDefine_Int("wazuh_database", "sync_batch", 1, 65536);
 
     if (data.sync_agents || data.sync_syscheck || data.sync_rootcheck) {
         os_calloc(1, sizeof(wmodule), module);
@@ -1315,6 +1424,8 @@ void wm_inotify_setup(wm_database * data) {
         merror_exit("At wm_inotify_setup(): queue_init()");
     }
 
+    queue_metrics_register(queue, "database_inotify");
+
     // Set inotify queued events limit
 
     if (data->max_queued_events) {
@@ -1470,7 +1581,8 @@ static void * wm_inotify_start(__attribute__((unused)) void * args) {
                     continue;
                 }
 
-                wm_inotify_push(dirname, event->name);
+                // A keepalive only updates the time of the agent-info file
+                wm_inotify_push(dirname, event->name, (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) ? WM_SYNC_WRITE : WM_SYNC_TOUCH);
             }
         } while (count > 0);
     }
@@ -1479,9 +1591,10 @@ static void * wm_inotify_start(__attribute__((unused)) void * args) {
 }
 
 // Insert request into internal structure
-void wm_inotify_push(const char * dirname, const char * fname) {
+void wm_inotify_push(const char * dirname, const char * fname, int events) {
     char path[PATH_MAX + 1];
     char * dup;
+    intptr_t pending;
 
     if (snprintf(path, sizeof(path), "%s/%s", dirname, fname) >= (int)sizeof(path)) {
         mterror(WM_DATABASE_LOGTAG, "At wm_inotify_push(): Path too long: '%s'/'%s'", dirname, fname);
@@ -1495,13 +1608,19 @@ void wm_inotify_push(const char * dirname, const char * fname) {
         goto end;
     }
 
-    switch (OSHash_Add(ptable, path, (void *)1)) {
+    switch (OSHash_Add(ptable, path, (void *)(intptr_t)events)) {
     case 0:
         mterror(WM_DATABASE_LOGTAG, "Couldn't insert key into table.");
         break;
 
     case 1:
         mtdebug2(WM_DATABASE_LOGTAG, "Adding '%s': file already exists at path table.", path);
+
+        // Merge the events, so a write isn't taken for a touch
+        if (pending = (intptr_t)OSHash_Get(ptable, path), (pending | events) != pending) {
+            OSHash_Update(ptable, path, (void *)(pending | events));
+        }
+
         break;
 
     case 2:
@@ -1520,8 +1639,21 @@ end:
     w_mutex_unlock(&mutex_queue);
 }
 
+// Extract enqueued path from internal structure. Call with mutex_queue held
+static char * wm_inotify_take(int * events) {
+    char * path = queue_pop(queue);
+
+    *events = (int)(intptr_t)OSHash_Get(ptable, path);
+
+    if (!OSHash_Delete(ptable, path)) {
+        mterror(WM_DATABASE_LOGTAG, "Couldn't delete key '%s' from path table.", path);
+    }
+
+    return path;
+}
+
 // Extract enqueued path from internal structure
-char * wm_inotify_pop() {
+char * wm_inotify_pop(int * events) {
     char * path;
 
     w_mutex_lock(&mutex_queue);
@@ -1530,17 +1662,85 @@ char * wm_inotify_pop() {
         w_cond_wait(&cond_pending, &mutex_queue);
     }
 
-    path = queue_pop(queue);
+    path = wm_inotify_take(events);
 
-    if (!OSHash_Delete(ptable, path)) {
-        mterror(WM_DATABASE_LOGTAG, "Couldn't delete key '%s' from path table.", path);
+    w_mutex_unlock(&mutex_queue);
+    mtdebug2(WM_DATABASE_LOGTAG, "Taking '%s' from path table.", path);
+    return path;
+}
+
+// Extract enqueued path if there is any, without waiting
+char * wm_inotify_trypop(int * events) {
+    char * path = NULL;
+
+    w_mutex_lock(&mutex_queue);
+
+    if (!queue_empty(queue)) {
+        path = wm_inotify_take(events);
     }
 
     w_mutex_unlock(&mutex_queue);
-    mtdebug2(WM_DATABASE_LOGTAG, "Taking '%s' from path table.", path);
+
+    if (path) {
+        mtdebug2(WM_DATABASE_LOGTAG, "Taking '%s' from path table.", path);
+    }
+
     return path;
 }
 
+/* Synchronize a popped path and the ones that are already pending, up to
+ * sync_batch. Consecutive agent-info files share a transaction on the global
+ * database, instead of committing two updates per keepalive. Other files are
+ * synchronized out of the transaction, as their functions may close the database.
+ */
+void wm_inotify_sync(char * path, int events) {
+    static const char agentinfo_dir[] = DEFAULTDIR AGENTINFO_DIR "/";
+    int transaction = 0;
+    int n = 0;
+    char * file;
+
+    for (; path; path = ++n < module->sync_batch ? wm_inotify_trypop(&events) : NULL) {
+        int agentinfo = !strncmp(path, agentinfo_dir, sizeof(agentinfo_dir) - 1);
+
+        if (agentinfo && !transaction && module->sync_batch > 1) {
+            transaction = wdb_open_global() == 0 && wdb_begin(wdb_global) == 0;
+        } else if (!agentinfo && transaction) {
+            wdb_commit(wdb_global);
+            transaction = 0;
+        }
+
+#ifndef LOCAL
+        if (!strcmp(path, KEYSFILE_PATH)) {
+            wm_sync_agents();
+        } else
+#endif // !LOCAL
+        {
+            if (file = strrchr(path, '/'), file) {
+                *(file++) = '\0';
+
+                if (agentinfo && !(events & WM_SYNC_WRITE)) {
+                    wm_sync_keepalive(path, file);
+                } else {
+                    wm_sync_file(path, file);
+                }
+            } else {
+                mterror(WM_DATABASE_LOGTAG, "Couldn't extract file name from '%s'", path);
+            }
+        }
+
+        free(path);
+    }
+
+    // The database may have been closed on an error, dropping the transaction
+    if (transaction && wdb_global) {
+        wdb_commit(wdb_global);
+    }
+
+    if (n > 1) {
+        mtdebug2(WM_DATABASE_LOGTAG, "Synchronized %d pending files.", n);
+    }
+}
+
 #endif // INOTIFY_ENABLED
 
 #endif // !WIN32
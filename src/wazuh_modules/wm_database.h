@@ -22,6 +22,7 @@ typedef struct wm_database {
     int real_time;
     int interval;
     int max_queued_events;
+    int sync_batch;         // Maximum pending files synchronized in a row
 } wm_database;
 
 // Read configuration and return a module (if enabled) or NULL (if disabled)
@@ -31,6 +31,9 @@ cJSON *wm_download_dump();     // Read config
 // Dispatch request. Write the output into the same input buffer.
 static void wm_download_dispatch(char * buffer);
 
+// Serve a client connection
+static void * wm_download_serve(int * peer);
+
 const wm_context WM_DOWNLOAD_CONTEXT = {
     "download",
     (wm_routine)wm_download_main,
@@ -42,9 +45,7 @@ const wm_context WM_DOWNLOAD_CONTEXT = {
 
 void * wm_download_main(wm_download_t * data) {
     int sock;
-    int peer;
-    ssize_t length;
-    char buffer[OS_MAXSTR + 1];
+    int * peer;
 
     // If module is disabled, exit
 
@@ -67,43 +68,65 @@ void * wm_download_main(wm_download_t * data) {
         }
     } while (sock < 0);
 
+    // The downloads run at the same time, libcurl must be initialized before
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
     // Main loop: wait and dispatch clients
 
     while (1) {
 
         // Wait and accept a new connection
 
-        if (peer = accept(sock, NULL, NULL), peer < 0) {
+        os_malloc(sizeof(int), peer);
+
+        if (*peer = accept(sock, NULL, NULL), *peer < 0) {
             if (errno == EINTR) {
                 minfo("accept(): %s", strerror(errno));
             } else {
                 merror("accept(): %s", strerror(errno));
             }
 
+            free(peer);
             continue;
         }
 
-        // Receive request, process it and send answer
+        // Serve each client on its own thread, or here if it can't be created
 
-        switch (length = recv(peer, buffer, OS_MAXSTR, 0), length) {
-        case -1:
-            merror("recv(): %s (%d)", strerror(errno), errno);
-            break;
+        if (!CreateThread((void * (*)(void *))wm_download_serve, peer)) {
+            wm_download_serve(peer);
+        }
+    }
+    return NULL;
+}
 
-        case 0:
-            mdebug1("Client disconnected. This may be a healthcheck.");
-            break;
+// Serve a client connection
 
-        default:
-            buffer[length] = '\0';
-            wm_download_dispatch(buffer);
-            if( send(peer, buffer, strlen(buffer), 0) < 0) {
-                merror("send(): %s (%d)",strerror(errno), errno);
-            }
-        }
+void * wm_download_serve(int * peer) {
+    ssize_t length;
+    char buffer[OS_MAXSTR + 1];
+
+    // Receive request, process it and send answer
+
+    switch (length = recv(*peer, buffer, OS_MAXSTR, 0), length) {
+    case -1:
+        merror("recv(): %s (%d)", strerror(errno), errno);
+        break;
 
-        close(peer);
+    case 0:
+        mdebug1("Client disconnected. This may be a healthcheck.");
+        break;
+
+    default:
+        buffer[length] = '\0';
+        wm_download_dispatch(buffer);
+        if( send(*peer, buffer, strlen(buffer), 0) < 0) {
+            merror("send(): %s (%d)",strerror(errno), errno);
+        }
     }
+
+    close(*peer);
+    free(peer);
     return NULL;
 }
 
@@ -262,12 +262,18 @@ void wm_kill_children() {
 // Unix version ----------------------------------------------------------------
 
 #include <unistd.h>
+#include <sys/resource.h>
+
+#ifndef HPUX
+#include <spawn.h>
+#endif
 
 #ifndef _GNU_SOURCE
 extern char ** environ;
 #endif
 
 static void* reader(void *args);   // Reading thread's start point
+static pid_t wm_exec_spawn(char *command, int out_fd, const char * add_path);
 
 static volatile pid_t wm_children[WM_POOL_SIZE] = { 0 };                // Child process pool
 
@@ -275,7 +281,6 @@ static volatile pid_t wm_children[WM_POOL_SIZE] = { 0 };                // Child
 
 int wm_exec(char *command, char **output, int *exitcode, int secs, const char * add_path)
 {
-    char **argv;
     pid_t pid;
     int pipe_fd[2];
     ThreadInfo tinfo = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, NULL };
@@ -298,79 +303,23 @@ int wm_exec(char *command, char **output, int *exitcode, int secs, const char *
         w_descriptor_cloexec(pipe_fd[0]);
     }
 
-    // Fork
+    // Spawn
 
-    switch (pid = fork()) {
+    switch (pid = wm_exec_spawn(command, output ? pipe_fd[1] : -1, add_path)) {
     case -1:
 
         // Error
 
-        merror("Cannot run a subprocess: %s (%d)", strerror(errno), errno);
-
         if (output) {
             close(pipe_fd[0]);
             close(pipe_fd[1]);
         }
 
-        return -1;
-
-    case 0:
-
-        // Child
-
-        // Add environment variable if exists
-
-        if (add_path != NULL) {
-
-            char * new_path = NULL;
-            os_calloc(OS_SIZE_6144, sizeof(char), new_path);
-            char *env_path = getenv("PATH");
-
-            if (!env_path) {
-                snprintf(new_path, OS_SIZE_6144 - 1, "%s", add_path);
-            } else if (strlen(env_path) >= OS_SIZE_6144) {
-                merror("at wm_exec(): PATH environment variable too large.");
-            } else {
-                snprintf(new_path, OS_SIZE_6144 - 1, "%s:%s", add_path, env_path);
-            }
-
-            if (setenv("PATH", new_path, 1) < 0) {
-                merror("at wm_exec(): Unable to set new 'PATH' environment variable (%s).", strerror(errno));
-            }
-
-            char *new_env = getenv("PATH");
-            mdebug1("New 'PATH' environment variable set: '%s'", new_env);
-            free(new_path);
-        }
-
-        argv = wm_strtok(command);
-
-        int fd = open("/dev/null", O_RDWR, 0);
-
-        if (fd < 0) {
-            merror_exit(FOPEN_ERROR, "/dev/null", errno, strerror(errno));
-        }
-
-        dup2(fd, STDIN_FILENO);
-
-        if (output) {
-            close(pipe_fd[0]);
-            dup2(pipe_fd[1], STDOUT_FILENO);
-            dup2(pipe_fd[1], STDERR_FILENO);
-            close(pipe_fd[1]);
-        } else {
-            dup2(fd, STDOUT_FILENO);
-            dup2(fd, STDERR_FILENO);
+        if (exitcode) {
+            *exitcode = EXECVE_ERROR;
         }
 
-        close(fd);
-
-        setsid();
-        if (nice(wm_task_nice)) {}
-        execvp(argv[0], argv);
-        _exit(EXECVE_ERROR);
-
-        break;
+        return -1;
 
     default:
 
@@ -527,30 +476,45 @@ int wm_exec(char *command, char **output, int *exitcode, int secs, const char *
     return retval;
 }
 
-// Reading thread's start point
+// Reading thread's start point. The output grows by doubling up to
+// WM_STRING_MAX; past it the rest is read and dropped, so the child can finish.
 
 void* reader(void *args) {
     ThreadInfo *tinfo = (ThreadInfo *)args;
-    char buffer[WM_BUFFER_MAX + 1];
-    int length = 0;
-    int nbytes;
+    char *buffer;
+    size_t length = 0;
+    size_t size = 0;
+    ssize_t nbytes;
+    int truncated = 0;
 
-    while ((nbytes = read(tinfo->pipe, buffer, WM_BUFFER_MAX)) > 0) {
-        int nextsize = length + nbytes;
+    os_malloc(OS_SIZE_65536, buffer);
 
-        if (nextsize <= WM_STRING_MAX) {
-            tinfo->output = (char*)realloc(tinfo->output, nextsize + 1);
-            memcpy(tinfo->output + length, buffer, nbytes);
-            length = nextsize;
-        } else {
+    while ((nbytes = read(tinfo->pipe, buffer, OS_SIZE_65536)) > 0) {
+        if (truncated) {
+            continue;
+        }
+
+        if (length + nbytes > WM_STRING_MAX) {
             mwarn("String limit reached.");
-            break;
+            truncated = 1;
+            continue;
         }
+
+        if (length + nbytes + 1 > size) {
+            for (size = size ? size : OS_SIZE_8192; size < length + nbytes + 1; size *= 2);
+            size = size < WM_STRING_MAX + 1 ? size : WM_STRING_MAX + 1;
+            os_realloc(tinfo->output, size, tinfo->output);
+        }
+
+        memcpy(tinfo->output + length, buffer, nbytes);
+        length += nbytes;
     }
 
     if (tinfo->output)
         tinfo->output[length] = '\0';
 
+    os_free(buffer);
+
     w_mutex_lock(&tinfo->mutex);
     w_cond_signal(&tinfo->finished);
     w_mutex_unlock(&tinfo->mutex);
@@ -559,6 +523,233 @@ void* reader(void *args) {
     return NULL;
 }
 
+#ifndef HPUX
+
+// Find an executable in a PATH-like list of directories
+
+static int wm_exec_which(const char *file, const char *path, char *buffer, size_t size) {
+    const char *dir = path;
+    const char *end;
+    int length;
+
+    if (strchr(file, '/')) {
+        snprintf(buffer, size, "%s", file);
+        return 0;
+    }
+
+    while (dir) {
+        end = strchr(dir, ':');
+        length = end ? (int)(end - dir) : (int)strlen(dir);
+
+        // An empty entry is the working directory
+        if (length == 0) {
+            snprintf(buffer, size, "./%s", file);
+        } else {
+            snprintf(buffer, size, "%.*s/%s", length, dir, file);
+        }
+
+        if (access(buffer, X_OK) == 0) {
+            return 0;
+        }
+
+        dir = end ? end + 1 : NULL;
+    }
+
+    return -1;
+}
+
+// Start a command in a new session, without copying the address space of
+// the caller as fork() does. Output goes to out_fd, or is discarded if -1.
+// Returns the PID, or -1 if the command could not be run.
+
+static pid_t wm_exec_spawn(char *command, int out_fd, const char * add_path) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    char **envp = environ;
+    char **argv;
+    char *cmd;
+    char *new_path = NULL;
+    char file[PATH_MAX];
+    pid_t pid = -1;
+    short flags = 0;
+    int result;
+    int i;
+
+    // wm_strtok() splits the string in place
+
+    os_strdup(command, cmd);
+
+    if (argv = wm_strtok(cmd), !argv) {
+        merror("Cannot run a subprocess: %s (%d)", strerror(errno), errno);
+        os_free(cmd);
+        return -1;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDWR, 0);
+
+    if (out_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDERR_FILENO);
+        posix_spawn_file_actions_addclose(&actions, out_fd);
+    } else {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    }
+
+    // The process group is what wm_kill_children() terminates
+
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_SETSID
+    flags |= POSIX_SPAWN_SETSID;
+#else
+    flags |= POSIX_SPAWN_SETPGROUP;
+    posix_spawnattr_setpgroup(&attr, 0);
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+
+    // Add environment variable if exists
+
+    if (add_path != NULL) {
+        char *env_path = getenv("PATH");
+        int count;
+
+        os_calloc(OS_SIZE_6144, sizeof(char), new_path);
+
+        if (!env_path) {
+            snprintf(new_path, OS_SIZE_6144 - 1, "PATH=%s", add_path);
+        } else if (strlen(env_path) >= OS_SIZE_6144) {
+            merror("at wm_exec(): PATH environment variable too large.");
+            snprintf(new_path, OS_SIZE_6144 - 1, "PATH=%s", env_path);
+        } else {
+            snprintf(new_path, OS_SIZE_6144 - 1, "PATH=%s:%s", add_path, env_path);
+        }
+
+        mdebug1("New 'PATH' environment variable set: '%s'", new_path + 5);
+
+        for (count = 0; environ[count]; count++);
+        os_calloc(count + 2, sizeof(char *), envp);
+
+        for (i = 0, count = 0; environ[i]; i++) {
+            if (strncmp(environ[i], "PATH=", 5) != 0) {
+                envp[count++] = environ[i];
+            }
+        }
+
+        envp[count] = new_path;
+
+        // posix_spawnp() would search the PATH of this process
+
+        if (wm_exec_which(argv[0], new_path + 5, file, sizeof(file)) < 0) {
+            snprintf(file, sizeof(file), "%s", argv[0]);
+        }
+
+        result = posix_spawn(&pid, file, &actions, &attr, argv, envp);
+    } else {
+        result = posix_spawnp(&pid, argv[0], &actions, &attr, argv, envp);
+    }
+
+    if (result != 0) {
+        mdebug1("Invalid command: '%s': (%d) %s", command, result, strerror(result));
+        pid = -1;
+    } else if (wm_task_nice) {
+        errno = 0;
+        i = getpriority(PRIO_PROCESS, 0);
+
+        if (errno == 0 && setpriority(PRIO_PROCESS, pid, i + wm_task_nice) < 0) {
+            mdebug2("Cannot set the priority of process %d: %s (%d)", (int)pid, strerror(errno), errno);
+        }
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (envp != environ) {
+        os_free(envp);
+    }
+
+    os_free(new_path);
+    os_free(argv);
+    os_free(cmd);
+    return pid;
+}
+
+#else
+
+// Start a command in a new session. Output goes to out_fd, or is discarded if -1.
+// Returns the PID, or -1 if the command could not be run.
+
+static pid_t wm_exec_spawn(char *command, int out_fd, const char * add_path) {
+    char **argv;
+    pid_t pid;
+
+    switch (pid = fork()) {
+    case -1:
+        merror("Cannot run a subprocess: %s (%d)", strerror(errno), errno);
+        return -1;
+
+    case 0:
+
+        // Child
+
+        // Add environment variable if exists
+
+        if (add_path != NULL) {
+
+            char * new_path = NULL;
+            os_calloc(OS_SIZE_6144, sizeof(char), new_path);
+            char *env_path = getenv("PATH");
+
+            if (!env_path) {
+                snprintf(new_path, OS_SIZE_6144 - 1, "%s", add_path);
+            } else if (strlen(env_path) >= OS_SIZE_6144) {
+                merror("at wm_exec(): PATH environment variable too large.");
+            } else {
+                snprintf(new_path, OS_SIZE_6144 - 1, "%s:%s", add_path, env_path);
+            }
+
+            if (setenv("PATH", new_path, 1) < 0) {
+                merror("at wm_exec(): Unable to set new 'PATH' environment variable (%s).", strerror(errno));
+            }
+
+            char *new_env = getenv("PATH");
+            mdebug1("New 'PATH' environment variable set: '%s'", new_env);
+            free(new_path);
+        }
+
+        argv = wm_strtok(command);
+
+        int fd = open("/dev/null", O_RDWR, 0);
+
+        if (fd < 0) {
+            merror_exit(FOPEN_ERROR, "/dev/null", errno, strerror(errno));
+        }
+
+        dup2(fd, STDIN_FILENO);
+
+        if (out_fd >= 0) {
+            dup2(out_fd, STDOUT_FILENO);
+            dup2(out_fd, STDERR_FILENO);
+            close(out_fd);
+        } else {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+
+        close(fd);
+
+        setsid();
+        if (nice(wm_task_nice)) {}
+        execvp(argv[0], argv);
+        _exit(EXECVE_ERROR);
+
+    default:
+        return pid;
+    }
+}
+
+#endif // HPUX
+
 // Add process group to pool
 
 void wm_append_sid(pid_t sid) {
@@ -12,12 +12,15 @@
 
 #include "wmodules.h"
 #include <os_net/os_net.h>
+#include <poll.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include "os_crypto/md5/md5_op.h"
 #include "os_crypto/sha512/sha512_op.h"
 #include "shared.h"
 #include "msgpack.h"
+#include "../external/zlib/zlib.h"
 
 #undef minfo
 #undef mwarn
@@ -33,6 +36,8 @@
 #define merror_critical(msg, ...) _mterror_critical(WM_FLUENT_LOGTAG, __FILE__, __LINE__, __func__, msg, ##__VA_ARGS__)
 
 #define REQUEST_SIZE 4096
+#define WM_FLUENT_ENTRIES_MAX 1048576   // Bytes of events past which a message is sent without draining more
+#define WM_FLUENT_ACK_TIMEOUT 60        // Seconds to wait for an acknowledgment, if no timeout is set
 
 #define expect_type(obj, t, str) if (obj.type != t) { mdebug2("Expecting %s", str); goto error; }
 #define expect_string(obj, s) if (strncmp(obj.via.str.ptr, s, obj.via.str.size)) { mdebug2("Expecting string '%s'", s); goto error; }
@@ -56,7 +61,14 @@ static int wm_fluent_send_ping(wm_fluent_t * fluent, const wm_fluent_helo_t * he
 static wm_fluent_pong_t * wm_fluent_recv_pong(wm_fluent_t * fluent);
 static int wm_fluent_hs_tls(wm_fluent_t * fluent);
 static int wm_fluent_handshake(wm_fluent_t * fluent);
-static int wm_fluent_send(wm_fluent_t * fluent, const char * str, size_t size);
+static void wm_fluent_reconnect(wm_fluent_t * fluent);
+static int wm_fluent_write(wm_fluent_t * fluent, const char * data, size_t size);
+static void wm_fluent_pack_entry(wm_fluent_t * fluent, msgpack_packer * pk, time_t now, const char * str, size_t size);
+static char * wm_fluent_gzip(const char * data, size_t size, size_t * gz_size);
+static int wm_fluent_send(wm_fluent_t * fluent, const char * entries, size_t size, int count);
+static void wm_fluent_ack(wm_fluent_t * fluent, const msgpack_object * obj);
+static int wm_fluent_recv_acks(wm_fluent_t * fluent, int wait);
+static void wm_fluent_forward(wm_fluent_t * fluent, const char * entries, size_t size, int count);
 static int wm_fluent_check_config(wm_fluent_t * fluent);
 static void wm_fluent_poll_server(wm_fluent_t * fluent);
 
@@ -72,6 +84,10 @@ void * wm_fluent_main(wm_fluent_t * fluent) {
     int server_sock;
     char * buffer;
     ssize_t recv_b;
+    msgpack_sbuffer entries;
+    msgpack_packer pk;
+    time_t now;
+    int count;
 
     // If module is disabled, exit
     if (fluent->enabled) {
@@ -97,12 +113,22 @@ void * wm_fluent_main(wm_fluent_t * fluent) {
         pthread_exit(NULL);
     }
 
+    if (fluent->require_ack) {
+        os_calloc(fluent->retry_buffer, sizeof(wm_fluent_chunk_t), fluent->chunks);
+
+        if (fluent->ack_unp = msgpack_unpacker_new(REQUEST_SIZE), !fluent->ack_unp) {
+            merror_exit("Cannot allocate memory for unpacker.");
+        }
+    }
+
     while (wm_fluent_handshake(fluent) < 0) {
         mdebug2("Handshake failed. Waiting 30 seconds.");
         sleep(30);
     }
 
     os_malloc(OS_MAXSTR, buffer);
+    msgpack_sbuffer_init(&entries);
+    msgpack_packer_init(&pk, &entries, msgpack_sbuffer_write);
 
     /* Main loop */
     while (1) {
@@ -117,27 +143,33 @@ void * wm_fluent_main(wm_fluent_t * fluent) {
             break;
 
         case 1:
-            recv_b = recv(server_sock, buffer, OS_MAXSTR - 1, 0);
+            msgpack_sbuffer_clear(&entries);
+            now = time(NULL);
 
-            switch (recv_b) {
-            case -1:
-                merror("Cannot receive data from '%s': %s (%d)", fluent->sock_path, strerror(errno), errno);
-                continue;
-            case 0:
-                merror("Empty string received from '%s'", fluent->sock_path);
-                continue;
-            default:
-                if (wm_fluent_send(fluent, buffer, recv_b) < 0) {
-                    mwarn("Cannot send data to '%s': %s (%d). Reconnecting...", fluent->address, strerror(errno), errno);
+            /* Drain the pending events into a single message */
+
+            for (count = 0; count < fluent->batch_size && entries.size < WM_FLUENT_ENTRIES_MAX;) {
+                recv_b = recv(server_sock, buffer, OS_MAXSTR - 1, MSG_DONTWAIT);
 
-                    while (wm_fluent_handshake(fluent) < 0) {
-                        mdebug2("Handshake failed. Waiting 30 seconds.");
-                        sleep(30);
+                if (recv_b < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        merror("Cannot receive data from '%s': %s (%d)", fluent->sock_path, strerror(errno), errno);
                     }
 
-                    minfo("Connected to %s:%hu", fluent->address, fluent->port);
-                    wm_fluent_send(fluent, buffer, recv_b);
+                    break;
                 }
+
+                if (recv_b == 0) {
+                    merror("Empty string received from '%s'", fluent->sock_path);
+                    continue;
+                }
+
+                wm_fluent_pack_entry(fluent, &pk, now, buffer, recv_b);
+                count++;
+            }
+
+            if (count > 0) {
+                wm_fluent_forward(fluent, entries.data, entries.size, count);
             }
         }
 
@@ -156,6 +188,21 @@ void wm_fluent_destroy(wm_fluent_t * fluent) {
     free(fluent->certificate);
     free(fluent->user_name);
     free(fluent->user_pass);
+
+    if (fluent->chunks) {
+        int i;
+
+        for (i = 0; i < fluent->retry_buffer; i++) {
+            free(fluent->chunks[i].data);
+        }
+
+        free(fluent->chunks);
+    }
+
+    if (fluent->ack_unp) {
+        msgpack_unpacker_free(fluent->ack_unp);
+    }
+
     os_free(fluent);
 }
 
@@ -677,43 +724,352 @@ static int wm_fluent_handshake(wm_fluent_t * fluent) {
     return 0;
 }
 
-static int wm_fluent_send(wm_fluent_t * fluent, const char * str, size_t size) {
+// Reconnect until the server takes back the unacknowledged messages
+static void wm_fluent_reconnect(wm_fluent_t * fluent) {
+    wm_fluent_chunk_t * chunk;
+    int i;
+
+    while (1) {
+        while (wm_fluent_handshake(fluent) < 0) {
+            mdebug2("Handshake failed. Waiting 30 seconds.");
+            sleep(30);
+        }
+
+        minfo("Connected to %s:%hu", fluent->address, fluent->port);
+
+        if (!fluent->require_ack) {
+            return;
+        }
+
+        /* Acknowledgments of the former connection will not come */
+
+        msgpack_unpacker_free(fluent->ack_unp);
+
+        if (fluent->ack_unp = msgpack_unpacker_new(REQUEST_SIZE), !fluent->ack_unp) {
+            merror_exit("Cannot allocate memory for unpacker.");
+        }
+
+        for (i = 0; i < fluent->chunk_count; i++) {
+            chunk = &fluent->chunks[(fluent->chunk_first + i) % fluent->retry_buffer];
+
+            if (chunk->data) {
+                if (wm_fluent_write(fluent, chunk->data, chunk->size) < 0) {
+                    break;
+                }
+
+                chunk->sent = time(NULL);
+            }
+        }
+
+        if (i == fluent->chunk_count) {
+            if (i > 0) {
+                mdebug1("Resent %d unacknowledged messages to '%s'.", i, fluent->address);
+            }
+
+            return;
+        }
+
+        mwarn("Cannot resend data to '%s': %s (%d). Reconnecting...", fluent->address, strerror(errno), errno);
+    }
+}
+
+static int wm_fluent_write(wm_fluent_t * fluent, const char * data, size_t size) {
+    ssize_t sent_b;
+
+    if (fluent->shared_key) {
+        assert(fluent->ssl);
+        return SSL_write(fluent->ssl, data, size) == (ssize_t)size ? 0 : -1;
+    }
+
+    /* A send timeout may cut the message */
+
+    while (size > 0) {
+        if (sent_b = send(fluent->client_sock, data, size, 0), sent_b <= 0) {
+            return -1;
+        }
+
+        data += sent_b;
+        size -= sent_b;
+    }
+
+    return 0;
+}
+
+// Pack an event as [time, {object_key: str}]
+static void wm_fluent_pack_entry(wm_fluent_t * fluent, msgpack_packer * pk, time_t now, const char * str, size_t size) {
+    size_t keylen = strlen(fluent->object_key);
+
+    msgpack_pack_array(pk, 2);
+    msgpack_pack_unsigned_int(pk, now);
+    msgpack_pack_map(pk, 1);
+    msgpack_pack_str(pk, keylen);
+    msgpack_pack_str_body(pk, fluent->object_key, keylen);
+    msgpack_pack_str(pk, size);
+    msgpack_pack_str_body(pk, str, size);
+}
+
+static char * wm_fluent_gzip(const char * data, size_t size, size_t * gz_size) {
+    z_stream strm;
+    size_t bound;
+    char * gz;
+
+    memset(&strm, 0, sizeof(strm));
+
+    /* Window bits above 15 make a gzip wrapper */
+
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+
+    bound = deflateBound(&strm, size);
+    os_malloc(bound, gz);
+
+    strm.next_in = (Bytef *)data;
+    strm.avail_in = size;
+    strm.next_out = (Bytef *)gz;
+    strm.avail_out = bound;
+
+    if (deflate(&strm, Z_FINISH) != Z_STREAM_END) {
+        deflateEnd(&strm);
+        free(gz);
+        return NULL;
+    }
+
+    *gz_size = strm.total_out;
+    deflateEnd(&strm);
+    return gz;
+}
+
+/*
+ * Send packed entries as a PackedForward message: [tag, entries, options],
+ * or CompressedPackedForward if compression is enabled. If the server must
+ * acknowledge it, the message is kept in the retry buffer, that must have room.
+ */
+static int wm_fluent_send(wm_fluent_t * fluent, const char * entries, size_t size, int count) {
     size_t taglen = strlen(fluent->tag);
-    int retval = -1;
+    char id[WM_FLUENT_CHUNK_LEN] = "";
+    wm_fluent_chunk_t * chunk;
+    char * gz = NULL;
+    int retval;
 
     msgpack_sbuffer sbuf;
-    msgpack_sbuffer_init(&sbuf);
-
     msgpack_packer pk;
+
+    if (fluent->compress) {
+        if (gz = wm_fluent_gzip(entries, size, &size), !gz) {
+            merror("Cannot compress data for '%s'.", fluent->address);
+            return -1;
+        }
+
+        entries = gz;
+    }
+
+    if (fluent->require_ack) {
+        unsigned char nonce[16];
+
+        randombytes(nonce, sizeof(nonce));
+        EVP_EncodeBlock((unsigned char *)id, nonce, sizeof(nonce));
+    }
+
+    msgpack_sbuffer_init(&sbuf);
     msgpack_packer_init(&pk, &sbuf, msgpack_sbuffer_write);
 
-    msgpack_pack_array(&pk, 4);
+    msgpack_pack_array(&pk, 3);
     msgpack_pack_str(&pk, taglen);
     msgpack_pack_str_body(&pk, fluent->tag, taglen);
-    msgpack_pack_unsigned_int(&pk, time(NULL));
-    msgpack_pack_map(&pk, 1);
-    msgpack_pack_str(&pk, strlen(fluent->object_key));
-    msgpack_pack_str_body(&pk, fluent->object_key, strlen(fluent->object_key));
-    msgpack_pack_str(&pk, size);
-    msgpack_pack_str_body(&pk, str, size);
-    msgpack_pack_map(&pk, 1);
-    msgpack_pack_str(&pk, 6);
-    msgpack_pack_str_body(&pk, "option", 6);
-    msgpack_pack_str(&pk, 8);
-    msgpack_pack_str_body(&pk, "optional", 8);
+    msgpack_pack_bin(&pk, size);
+    msgpack_pack_bin_body(&pk, entries, size);
+    msgpack_pack_map(&pk, 1 + fluent->require_ack + fluent->compress);
+    msgpack_pack_str(&pk, 4);
+    msgpack_pack_str_body(&pk, "size", 4);
+    msgpack_pack_int(&pk, count);
+
+    if (fluent->require_ack) {
+        msgpack_pack_str(&pk, 5);
+        msgpack_pack_str_body(&pk, "chunk", 5);
+        msgpack_pack_str(&pk, strlen(id));
+        msgpack_pack_str_body(&pk, id, strlen(id));
+    }
 
-    if (fluent->shared_key) {
-        assert(fluent->ssl);
-        retval = SSL_write(fluent->ssl, sbuf.data, sbuf.size) == (ssize_t)sbuf.size ? 0 : -1;
-    } else {
-        if(sbuf.data)
-            retval = send(fluent->client_sock, sbuf.data, sbuf.size, 0) == (ssize_t)sbuf.size ? 0 : -1;
+    if (fluent->compress) {
+        msgpack_pack_str(&pk, 10);
+        msgpack_pack_str_body(&pk, "compressed", 10);
+        msgpack_pack_str(&pk, 4);
+        msgpack_pack_str_body(&pk, "gzip", 4);
     }
 
-    msgpack_sbuffer_destroy(&sbuf);
+    free(gz);
+
+    if (!fluent->require_ack) {
+        retval = wm_fluent_write(fluent, sbuf.data, sbuf.size);
+        msgpack_sbuffer_destroy(&sbuf);
+        return retval;
+    }
+
+    assert(fluent->chunk_count < fluent->retry_buffer);
+
+    chunk = &fluent->chunks[(fluent->chunk_first + fluent->chunk_count) % fluent->retry_buffer];
+    chunk->size = sbuf.size;
+    chunk->data = msgpack_sbuffer_release(&sbuf);
+    chunk->sent = time(NULL);
+    strcpy(chunk->id, id);
+    fluent->chunk_count++;
+
+    return wm_fluent_write(fluent, chunk->data, chunk->size);
+}
+
+// Release the message acknowledged by {"ack": chunk}
+static void wm_fluent_ack(wm_fluent_t * fluent, const msgpack_object * obj) {
+    wm_fluent_chunk_t * chunk;
+    msgpack_object_kv * map;
+    unsigned int i;
+    int j;
+
+    if (obj->type != MSGPACK_OBJECT_MAP) {
+        mdebug2("Expecting map");
+        return;
+    }
+
+    map = obj->via.map.ptr;
+
+    for (i = 0; i < obj->via.map.size; i++) {
+        if (map[i].key.type != MSGPACK_OBJECT_STR || map[i].val.type != MSGPACK_OBJECT_STR || strncmp(map[i].key.via.str.ptr, "ack", map[i].key.via.str.size)) {
+            continue;
+        }
+
+        for (j = 0; j < fluent->chunk_count; j++) {
+            chunk = &fluent->chunks[(fluent->chunk_first + j) % fluent->retry_buffer];
+
+            if (chunk->data && strlen(chunk->id) == map[i].val.via.str.size && memcmp(chunk->id, map[i].val.via.str.ptr, map[i].val.via.str.size) == 0) {
+                os_free(chunk->data);
+                break;
+            }
+        }
+
+        if (j == fluent->chunk_count) {
+            mdebug2("Unknown acknowledgment: %.*s", map[i].val.via.str.size, map[i].val.via.str.ptr);
+        }
+    }
+
+    /* The server may acknowledge out of order */
+
+    while (fluent->chunk_count > 0 && !fluent->chunks[fluent->chunk_first].data) {
+        fluent->chunk_first = (fluent->chunk_first + 1) % fluent->retry_buffer;
+        fluent->chunk_count--;
+    }
+}
+
+/*
+ * Process the acknowledgments available. If wait is set, block until the retry
+ * buffer has room. Returns 0 on success, or -1 on connection error or timeout.
+ */
+static int wm_fluent_recv_acks(wm_fluent_t * fluent, int wait) {
+    int timeout = (fluent->timeout ? fluent->timeout : WM_FLUENT_ACK_TIMEOUT) * 1000;
+    msgpack_unpacked result;
+    msgpack_unpack_return ret;
+    struct pollfd pfd = { fluent->client_sock, POLLIN, 0 };
+    int retval = 0;
+    int read_b;
+
+    msgpack_unpacked_init(&result);
+
+    while (1) {
+        while (ret = msgpack_unpacker_next(fluent->ack_unp, &result), ret == MSGPACK_UNPACK_SUCCESS) {
+            wm_fluent_ack(fluent, &result.data);
+        }
+
+        if (ret != MSGPACK_UNPACK_CONTINUE) {
+            merror("Invalid data received from the server.");
+            retval = -1;
+            break;
+        }
+
+        if (wait && fluent->chunk_count < fluent->retry_buffer) {
+            break;
+        }
+
+        /* TLS may hold decrypted data that the socket no longer shows */
+
+        if (!(fluent->shared_key && SSL_pending(fluent->ssl))) {
+            int ready = poll(&pfd, 1, wait ? timeout : 0);
+
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (ready < 0) {
+                merror("Cannot poll connection with '%s': %s (%d)", fluent->address, strerror(errno), errno);
+                retval = -1;
+                break;
+            }
+
+            if (ready == 0) {
+                retval = wait ? -1 : 0;
+                break;
+            }
+        }
+
+        if (msgpack_unpacker_buffer_capacity(fluent->ack_unp) < REQUEST_SIZE && !msgpack_unpacker_reserve_buffer(fluent->ack_unp, REQUEST_SIZE)) {
+            merror_exit("Cannot extend memory for unpacker.");
+        }
+
+        if (fluent->shared_key) {
+            /* Do not block if the input was only a TLS record, like a session ticket */
+
+            SSL_clear_mode(fluent->ssl, SSL_MODE_AUTO_RETRY);
+            read_b = SSL_read(fluent->ssl, msgpack_unpacker_buffer(fluent->ack_unp), REQUEST_SIZE);
+            SSL_set_mode(fluent->ssl, SSL_MODE_AUTO_RETRY);
+
+            if (read_b <= 0 && SSL_get_error(fluent->ssl, read_b) == SSL_ERROR_WANT_READ) {
+                continue;
+            }
+        } else {
+            read_b = recv(fluent->client_sock, msgpack_unpacker_buffer(fluent->ack_unp), REQUEST_SIZE, 0);
+        }
+
+        if (read_b <= 0) {
+            mdebug1("Connection with '%s' closed.", fluent->address);
+            retval = -1;
+            break;
+        }
+
+        msgpack_unpacker_buffer_consumed(fluent->ack_unp, read_b);
+    }
+
+    msgpack_unpacked_destroy(&result);
     return retval;
 }
 
+// Send packed entries, reconnecting until the server takes them
+static void wm_fluent_forward(wm_fluent_t * fluent, const char * entries, size_t size, int count) {
+    if (fluent->require_ack) {
+        /* Flow control: wait for the server to acknowledge older messages */
+
+        while (fluent->chunk_count == fluent->retry_buffer) {
+            if (wm_fluent_recv_acks(fluent, 1) < 0) {
+                mwarn("No acknowledgment from '%s'. Reconnecting...", fluent->address);
+                wm_fluent_reconnect(fluent);
+            }
+        }
+    }
+
+    if (wm_fluent_send(fluent, entries, size, count) < 0) {
+        mwarn("Cannot send data to '%s': %s (%d). Reconnecting...", fluent->address, strerror(errno), errno);
+        wm_fluent_reconnect(fluent);
+
+        /* The retry buffer already had the message resent */
+
+        if (!fluent->require_ack) {
+            wm_fluent_send(fluent, entries, size, count);
+        }
+    }
+
+    if (fluent->require_ack && wm_fluent_recv_acks(fluent, 0) < 0) {
+        mwarn("Cannot receive acknowledgments from '%s'. Reconnecting...", fluent->address);
+        wm_fluent_reconnect(fluent);
+    }
+}
+
 static int wm_fluent_check_config(wm_fluent_t * fluent) {
     /* Tag is required */
 
@@ -770,10 +1126,28 @@ static int wm_fluent_check_config(wm_fluent_t * fluent) {
 // Poll server connection
 void wm_fluent_poll_server(wm_fluent_t * fluent) {
     char buffer[4];
-    int flags = fcntl(fluent->client_sock, F_GETFL, 0);
+    int flags;
 
     mdebug2("Polling Fluent server.");
 
+    // Acknowledgments carry the replies of the server
+
+    if (fluent->require_ack) {
+        int timeout = fluent->timeout ? fluent->timeout : WM_FLUENT_ACK_TIMEOUT;
+
+        if (wm_fluent_recv_acks(fluent, 0) < 0) {
+            minfo("Fluent server is down or timed-out. Reconnecting.");
+            wm_fluent_reconnect(fluent);
+        } else if (fluent->chunk_count > 0 && time(NULL) - fluent->chunks[fluent->chunk_first].sent > timeout) {
+            mwarn("No acknowledgment from '%s'. Reconnecting...", fluent->address);
+            wm_fluent_reconnect(fluent);
+        }
+
+        return;
+    }
+
+    flags = fcntl(fluent->client_sock, F_GETFL, 0);
+
     // Set up non-blocking mode
 
     if (fcntl(fluent->client_sock, F_SETFL, flags | O_NONBLOCK) == -1) {
@@ -826,6 +1200,10 @@ cJSON *wm_fluent_dump(const wm_fluent_t *fluent) {
     cJSON_AddStringToObject(wm_wd, "password", fluent->user_pass);
     cJSON_AddNumberToObject(wm_wd, "timeout", fluent->timeout);
     cJSON_AddNumberToObject(wm_wd, "poll_interval", fluent->poll_interval);
+    cJSON_AddNumberToObject(wm_wd, "batch_size", fluent->batch_size);
+    cJSON_AddStringToObject(wm_wd, "compression", fluent->compress ? "yes" : "no");
+    cJSON_AddStringToObject(wm_wd, "require_ack", fluent->require_ack ? "yes" : "no");
+    cJSON_AddNumberToObject(wm_wd, "retry_buffer", fluent->retry_buffer);
 
     cJSON_AddStringToObject(keepalive, "enabled", fluent->keepalive.enabled ? "yes" : "no");
     if (fluent->keepalive.count) cJSON_AddNumberToObject(keepalive, "count", fluent->keepalive.count);
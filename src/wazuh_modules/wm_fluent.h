@@ -15,6 +15,17 @@
 #include <openssl/ssl.h>
 
 #define WM_FLUENT_LOGTAG FLUENT_WM_NAME
+#define WM_FLUENT_CHUNK_LEN 25      // Base64 of a 16-byte id, plus terminator
+
+struct msgpack_unpacker;
+
+// Message sent to the server and waiting for acknowledgment
+typedef struct wm_fluent_chunk_t {
+    char * data;
+    size_t size;
+    char id[WM_FLUENT_CHUNK_LEN];
+    time_t sent;
+} wm_fluent_chunk_t;
 
 typedef struct wm_fluent_t {
     unsigned int enabled:1;
@@ -33,6 +44,14 @@ typedef struct wm_fluent_t {
     SSL * ssl;
     BIO * bio;
     int poll_interval;
+    int batch_size;             // Maximum events per PackedForward message
+    bool compress;              // Send CompressedPackedForward messages
+    bool require_ack;           // Wait for the server to acknowledge every message
+    int retry_buffer;           // Maximum unacknowledged messages
+    wm_fluent_chunk_t * chunks; // Ring of unacknowledged messages
+    int chunk_first;
+    int chunk_count;
+    struct msgpack_unpacker * ack_unp;
 
     struct keepalive {
         bool enabled;
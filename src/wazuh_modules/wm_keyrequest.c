@@ -85,6 +85,7 @@ void * wm_key_request_main(wm_krequest_t * data) {
 
     /* Init the queue input */
     request_queue = queue_init(data->queue_size);
+    queue_metrics_register(request_queue, "key_request");
 
     if ((sock = StartMQ(WM_KEY_REQUEST_SOCK_PATH, READ)) < 0) {
         merror(QUEUE_ERROR, WM_KEY_REQUEST_SOCK_PATH, strerror(errno));
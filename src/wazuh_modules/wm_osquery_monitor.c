@@ -19,6 +19,11 @@
 
 #define TMP_CONFIG_PATH "tmp/osquery.conf.tmp"
 
+#ifdef INOTIFY_ENABLED
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
 #ifdef WIN32
 #define OSQUERYD_BIN "osqueryd.exe"
 #else
@@ -40,6 +45,9 @@
 static void *wm_osquery_monitor_main(wm_osquery_monitor_t *osquery_monitor);
 static void wm_osquery_monitor_destroy(wm_osquery_monitor_t *osquery_monitor);
 static int wm_osquery_check_logfile(const char * path, FILE * fp);
+static void wm_osquery_send(wm_osquery_monitor_t * osquery, const char * payload, unsigned int * pending);
+static void wm_osquery_flush(wm_osquery_monitor_t * osquery, unsigned int * pending);
+static void wm_osquery_wait(int notify_fd);
 static int wm_osquery_packs(wm_osquery_monitor_t *osquery);
 static char * wm_osquery_already_running(char * text);
 cJSON *wm_osquery_dump(const wm_osquery_monitor_t *osquery_monitor);
@@ -53,6 +61,69 @@ const wm_context WM_OSQUERYMONITOR_CONTEXT = {
     (cJSON * (*)(const void *))wm_osquery_dump
 };
 
+/* Send a result. On Unix, results go out in batches, and the delay that
+ * keeps the rate under wm_max_eps is taken once per batch */
+static void wm_osquery_send(wm_osquery_monitor_t * osquery, const char * payload, unsigned int * pending)
+{
+#ifdef WIN32
+    (void)pending;
+
+    if (wm_sendmsg(osquery->msg_delay, osquery->queue_fd, payload, "osquery", LOCALFILE_MQ) < 0) {
+        mterror(WM_OSQUERYMONITOR_LOGTAG, QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
+    }
+#else
+    if (SendMSG(osquery->queue_fd, payload, "osquery", LOCALFILE_MQ) < 0) {
+        mterror(WM_OSQUERYMONITOR_LOGTAG, QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
+    }
+
+    if (++(*pending) >= MQ_BATCH_MAX) {
+        wm_osquery_flush(osquery, pending);
+    }
+#endif
+}
+
+static void wm_osquery_flush(__attribute__((unused)) wm_osquery_monitor_t * osquery, unsigned int * pending)
+{
+#ifndef WIN32
+    long long usec = (long long)osquery->msg_delay * *pending;
+    struct timeval timeout = { usec / 1000000, usec % 1000000 };
+
+    if (*pending == 0) {
+        return;
+    }
+
+    select(0, NULL, NULL, NULL, &timeout);
+
+    if (SendMSGFlush(osquery->queue_fd) < 0) {
+        mterror(WM_OSQUERYMONITOR_LOGTAG, QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
+    }
+#endif
+
+    *pending = 0;
+}
+
+/* Wait until the results file may have changed, or a second at most */
+static void wm_osquery_wait(int notify_fd)
+{
+#ifdef INOTIFY_ENABLED
+    char buffer[OS_SIZE_4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { notify_fd, POLLIN, 0 };
+
+    if (notify_fd >= 0) {
+        if (poll(&pfd, 1, 1000) > 0) {
+            // The events only wake us up: the file is checked anyway
+            while (read(notify_fd, buffer, sizeof(buffer)) > 0);
+        }
+
+        return;
+    }
+#else
+    (void)notify_fd;
+#endif
+
+    sleep(1);
+}
+
 void *Read_Log(wm_osquery_monitor_t * osquery)
 {
     int i = 0;
@@ -65,6 +136,37 @@ void *Read_Log(wm_osquery_monitor_t * osquery)
     cJSON * name;
     cJSON * osquery_json;
     char * begin;
+    int from_start = 0;
+    int notify_fd = -1;
+    unsigned int pending = 0;
+
+#ifdef INOTIFY_ENABLED
+    int file_wd = -1;
+
+    // Changes of the file, and files created in its directory on rotation
+
+    if (notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC), notify_fd >= 0) {
+        char * dir;
+
+        os_strdup(osquery->log_path, dir);
+
+        if (end = strrchr(dir, '/'), end) {
+            *(end == dir ? end + 1 : end) = '\0';
+
+            if (inotify_add_watch(notify_fd, dir, IN_CREATE | IN_MOVED_TO) < 0) {
+                mdebug1("Cannot watch directory '%s': %s (%d)", dir, strerror(errno), errno);
+            }
+        }
+
+        os_free(dir);
+    } else {
+        mdebug1("Cannot start inotify: %s (%d). Polling the results file.", strerror(errno), errno);
+    }
+#endif
+
+#ifndef WIN32
+    SendMSGBatch(MQ_BATCH_MAX);
+#endif
 
     while (active) {
         // Wait to open log file
@@ -83,11 +185,12 @@ void *Read_Log(wm_osquery_monitor_t * osquery)
             break;
         }
 
+        i = 0;
         minfo("Following osquery results file '%s'.", osquery->log_path);
 
-        // Move to end of the file
+        // Move to end of the file, unless it replaced the one being followed
 
-        if (fseek(result_log, 0, SEEK_END) < 0) {
+        if (!from_start && fseek(result_log, 0, SEEK_END) < 0) {
             merror(FSEEK_ERROR, osquery->log_path, errno, strerror(errno));
             fclose(result_log);
             continue;
@@ -101,6 +204,12 @@ void *Read_Log(wm_osquery_monitor_t * osquery)
             continue;
         }
 
+#ifdef INOTIFY_ENABLED
+        if (notify_fd >= 0 && (file_wd = inotify_add_watch(notify_fd, osquery->log_path, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF), file_wd < 0)) {
+            mdebug1("Cannot watch file '%s': %s (%d)", osquery->log_path, strerror(errno), errno);
+        }
+#endif
+
         // Read the file
 
         while (active) {
@@ -145,10 +254,7 @@ void *Read_Log(wm_osquery_monitor_t * osquery)
 
                     payload = cJSON_PrintUnformatted(root);
                     mdebug2("Sending... '%s'", payload);
-
-                    if (wm_sendmsg(osquery->msg_delay, osquery->queue_fd, payload, "osquery", LOCALFILE_MQ) < 0) {
-                        mterror(WM_OSQUERYMONITOR_LOGTAG, QUEUE_ERROR, DEFAULTQUEUE, strerror(errno));
-                    }
+                    wm_osquery_send(osquery, payload, &pending);
 
                     free(payload);
                     cJSON_Delete(root);
@@ -162,6 +268,10 @@ void *Read_Log(wm_osquery_monitor_t * osquery)
                 }
             }
 
+            // Send what was read before waiting for more
+
+            wm_osquery_flush(osquery, &pending);
+
             // Check if result path inode has changed.
 
             switch (wm_osquery_check_logfile(osquery->log_path, result_log)) {
@@ -172,10 +282,11 @@ void *Read_Log(wm_osquery_monitor_t * osquery)
                     mwarn("Couldn't access results file '%s': %s (%d)", osquery->log_path, strerror(errno), errno);
                 }
 
+                from_start = 1;
                 goto endloop;
             case 0:
                 // File did not change
-                sleep(1);
+                wm_osquery_wait(notify_fd);
                 break;
             case 1:
                 minfo("Results file '%s' truncated. Reloading.", osquery->log_path);
@@ -187,15 +298,27 @@ void *Read_Log(wm_osquery_monitor_t * osquery)
 
                 break;
             case 2:
+                // The old file was read to the end: the new one is read whole
                 minfo("Results file '%s' rotated. Reloading.", osquery->log_path);
+                from_start = 1;
                 goto endloop;
             }
         }
 
 endloop:
+#ifdef INOTIFY_ENABLED
+        if (file_wd >= 0) {
+            inotify_rm_watch(notify_fd, file_wd);
+            file_wd = -1;
+        }
+#endif
         fclose(result_log);
     }
 
+    if (notify_fd >= 0) {
+        close(notify_fd);
+    }
+
     return NULL;
 }
 
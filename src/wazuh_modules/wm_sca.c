@@ -37,6 +37,80 @@ typedef struct request_dump_t {
     int first_scan;
 } request_dump_t;
 
+/* Files bigger than this are read every time instead of being kept */
+#define WM_SCA_CACHE_FILE_MAX (1024 * 1024)
+
+/* A regex of the rules, compiled once per policy scan */
+typedef struct wm_sca_regex_t {
+    OSRegex regex;
+    int compiled;
+} wm_sca_regex_t;
+
+/* Lines of a file, or the error that prevented opening it */
+typedef struct wm_sca_file_t {
+    char **lines;
+    int error;
+} wm_sca_file_t;
+
+/* Result of running a command: the return value of wm_exec(), the exit code and the output lines */
+typedef struct wm_sca_command_t {
+    int status;
+    int result_code;
+    char **lines;
+} wm_sca_command_t;
+
+/* A file, directory or registry key read by a check, and its state then */
+typedef struct wm_sca_input_t {
+    char *path;
+    unsigned long arch;             // Registry view, 0 for files and directories
+    int exists;
+    long long mtime;                // Last write time for registry keys
+    long long ctime;
+    long long size;
+    unsigned long long inode;
+} wm_sca_input_t;
+
+/* Inputs recorded during the evaluation of a check */
+typedef struct wm_sca_inputs_t {
+    wm_sca_input_t *list;
+    int count;
+    int size;
+    unsigned int unknown:1;         // Something that can't be fingerprinted was read: commands, processes...
+} wm_sca_inputs_t;
+
+/* Last result of a check, reused while its inputs don't change */
+typedef struct wm_sca_check_state_t {
+    int found;
+    char *reason;
+    char **alert_msg;
+    wm_sca_inputs_t inputs;
+} wm_sca_check_state_t;
+
+/* Result of the evaluation of a check by the scan threads */
+typedef struct wm_sca_check_result_t {
+    int found;
+    char *reason;
+    char **alert_msg;
+} wm_sca_check_result_t;
+
+/* Checks of a policy shared by the scan threads */
+typedef struct wm_sca_pool_t {
+    cJSON **checks;
+    wm_sca_check_result_t *results;
+    int count;
+    int next;                       // Next check to be evaluated
+    OSStore *vars;
+    wm_sca_t *data;
+    cJSON *policy;
+    unsigned int remote_policy;
+    int policy_index;
+    OSList *p_list;
+    pthread_mutex_t mutex;
+} wm_sca_pool_t;
+
+/* Checks that read more inputs than these are always evaluated */
+#define WM_SCA_MAX_INPUTS 1024
+
 static const int RETURN_NOT_FOUND = 0;
 static const int RETURN_FOUND = 1;
 static const int RETURN_INVALID = 2;
@@ -62,7 +136,7 @@ static void wm_sca_free_hash_data(cis_db_info_t *event);
 static void * wm_sca_dump_db_thread(wm_sca_t * data);
 static void wm_sca_send_policies_scanned(wm_sca_t * data);
 static int wm_sca_send_dump_end(wm_sca_t * data, unsigned int elements_sent,char * policy_id,int scan_id);  // Send dump end event
-static int append_msg_to_vm_scat (wm_sca_t * const data, const char * const msg);
+static int append_msg_to_vm_scat (char ** const alert_msg, const char * const msg);
 static int compare_cis_db_info_t_entry(const void * const a, const void * const  b);
 
 #ifndef WIN32
@@ -84,12 +158,34 @@ static int wm_sca_test_positive_minterm(char * const minterm, const char * const
 static int wm_sca_pattern_matches(const char * const str, const char * const pattern, char **reason); // Check pattern match
 static int wm_sca_check_dir(const char * const dir, const char * const file, char * const pattern, char **reason);
 static int wm_sca_check_dir_existence(const char * const dir, char **reason);
-static int wm_sca_check_dir_list(wm_sca_t * const data, char * const dir_list, char * const file, char * const pattern, char **reason);
+static int wm_sca_check_dir_list(wm_sca_t * const data, char * const dir_list, char * const file, char * const pattern, char **alert_msg, char **reason);
 static int wm_sca_check_process_is_running(OSList *p_list, char *value, char **reason);
 #ifndef WIN32
 static int wm_sca_resolve_symlink(const char * const file, char * realpath_buffer, char **reason);
 #endif
 static int wm_sca_apply_numeric_partial_comparison(const char * const partial_comparison, const long int number, char **reason);
+static int wm_sca_cache_init();     // Create the caches of a policy scan
+static void wm_sca_cache_free();    // Release the caches of a policy scan
+static void wm_sca_compile_checks(const cJSON * const checks);  // Compile the regexes of the rules
+static const char * wm_sca_get_var(OSStore *vars, const char * const name);
+static wm_sca_regex_t * wm_sca_get_regex(const char * const pattern, int flags);
+static int wm_sca_regex_matches(const char * const pattern, const char * const str);
+static wm_sca_file_t * wm_sca_get_file(const char * const path);
+static wm_sca_command_t * wm_sca_get_command(char *command, wm_sca_t * data, int *cached);
+static int wm_sca_check_rules(const cJSON * const rules, int condition, const char * const condition_str, OSStore *vars, wm_sca_t * data,
+                              cJSON *policy, unsigned int remote_policy, OSList **p_list, char **alert_msg, char **reason);
+static int wm_sca_evaluate_check(int policy_index, int check_id, const cJSON * const rules, int condition, const char * const condition_str,
+                                 OSStore *vars, wm_sca_t * data, cJSON *policy, unsigned int remote_policy, OSList **p_list,
+                                 char **alert_msg, char **reason);
+static void wm_sca_record_path(const char * const path);    // Record a file or directory read by the current check
+static void wm_sca_record_unknown();                        // The current check read something that can't be fingerprinted
+static void wm_sca_free_check_state(wm_sca_check_state_t *state);
+#ifndef WIN32
+static wm_sca_check_result_t * wm_sca_evaluate_checks(cJSON *checks, OSStore *vars, wm_sca_t * data, cJSON *policy,
+                                                      unsigned int remote_policy, int policy_index, int *count);
+static void * wm_sca_evaluate_thread(wm_sca_pool_t *pool);
+static void wm_sca_free_results(wm_sca_check_result_t *results, int count);
+#endif
 
 #ifdef WIN32
 static int wm_check_registry_entry(char * const value, char **reason);
@@ -97,6 +193,7 @@ static int wm_sca_is_registry(char *entry_name, char *reg_option, char *reg_valu
 static char *wm_sca_os_winreg_getkey(char *reg_entry);
 static int wm_sca_test_key(char *subkey, char *full_key_name, unsigned long arch,char *reg_option, char *reg_value, char **reason);
 static int wm_sca_winreg_querykey(HKEY hKey, const char *full_key_name, char *reg_option, char *reg_value, char **reason);
+static void wm_sca_record_registry(const char * const key, unsigned long arch, HKEY hkey);
 #endif
 
 cJSON *wm_sca_dump(const wm_sca_t * data);     // Read config
@@ -124,6 +221,28 @@ cJSON **last_summary_json = NULL;
 /* Multiple readers / one write mutex */
 static pthread_rwlock_t dump_rwlock;
 
+/* The files, command outputs and regexes used by the checks of a policy
+ * are kept during its scan, as many checks look into the same ones */
+static struct {
+    OSHash *files;
+    OSHash *commands;
+    OSHash *regexes;
+    OSHash *numeric_regexes;        // Compiled with OS_RETURN_SUBSTRING
+} scan_cache;
+
+/* Last result of each check of each policy, by check ID */
+static OSHash **check_states;
+
+/* Inputs of the check being evaluated by this thread */
+#ifdef WIN32
+static wm_sca_inputs_t *current_inputs;
+#else
+static __thread wm_sca_inputs_t *current_inputs;
+#endif
+
+/* OSStore_Get() moves the cursor of the store */
+static pthread_mutex_t vars_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 // Module main function. It won't return
 void * wm_sca_main(wm_sca_t * data) {
     // If module is disabled, exit
@@ -149,9 +268,13 @@ void * wm_sca_main(wm_sca_t * data) {
     data->request_db_interval = 300;
     data->remote_commands = 0;
     data->commands_timeout = 30;
+    data->scan_threads = 1;
 
     data->request_db_interval = getDefine_Int("sca","request_db_interval", 1, 60) * 60;
     data->commands_timeout = getDefine_Int("sca", "commands_timeout", 1, 300);
+#ifndef WIN32
+    data->scan_threads = getDefine_Int("sca", "scan_threads", 1, 16);
+#endif
 #ifdef CLIENT
     data->remote_commands = getDefine_Int("sca", "remote_commands", 0, 1);
 #else
@@ -183,6 +306,15 @@ void * wm_sca_main(wm_sca_t * data) {
         }
         OSHash_SetFreeDataPointer(cis_db[i], (void (*)(void *))wm_sca_free_hash_data);
 
+        /* Last results of the checks */
+        os_realloc(check_states, (i + 2) * sizeof(OSHash *), check_states);
+        check_states[i] = OSHash_Create();
+        if (!check_states[i]) {
+            merror(LIST_ERROR);
+            pthread_exit(NULL);
+        }
+        OSHash_SetFreeDataPointer(check_states[i], (void (*)(void *))wm_sca_free_check_state);
+
         /* DB for calculating hash only */
         os_realloc(cis_db_for_hash, (i + 2) * sizeof(cis_db_hash_info_t), cis_db_for_hash);
 
@@ -215,6 +347,7 @@ void * wm_sca_main(wm_sca_t * data) {
 #endif
 
     request_queue = queue_init(1024);
+    queue_metrics_register(request_queue, "sca_request");
 
     w_rwlock_init(&dump_rwlock, NULL);
 
@@ -397,6 +530,14 @@ static void wm_sca_read_files(wm_sca_t * data) {
                 goto next;
             }
 
+            if (wm_sca_cache_init() < 0) {
+                merror(LIST_ERROR);
+                goto next;
+            }
+
+            wm_sca_compile_checks(requirements_array);
+            wm_sca_compile_checks(checks);
+
             // Set unique ID for each scan
 #ifndef WIN32
             int id = os_random();
@@ -433,6 +574,18 @@ static void wm_sca_read_files(wm_sca_t * data) {
 
                         OSHash_SetFreeDataPointer(cis_db[cis_db_index], (void (*)(void *))wm_sca_free_hash_data);
 
+                        /* The checks may have changed: evaluate them again */
+                        OSHash_Free(check_states[cis_db_index]);
+                        check_states[cis_db_index] = OSHash_Create();
+
+                        if (!check_states[cis_db_index]) {
+                            merror(LIST_ERROR);
+                            w_rwlock_unlock(&dump_rwlock);
+                            pthread_exit(NULL);
+                        }
+
+                        OSHash_SetFreeDataPointer(check_states[cis_db_index], (void (*)(void *))wm_sca_free_check_state);
+
                         os_free(cis_db_for_hash[cis_db_index].elem);
                         os_realloc(cis_db_for_hash[cis_db_index].elem, sizeof(cis_db_info_t *) * (2), cis_db_for_hash[cis_db_index].elem);
                         cis_db_for_hash[cis_db_index].elem[0] = NULL;
@@ -503,6 +656,8 @@ static void wm_sca_read_files(wm_sca_t * data) {
             if(vars) {
                 OSStore_Free(vars);
             }
+
+            wm_sca_cache_free();
         }
         first_scan = 0;
         OSHash_Clean(check_list, free);
@@ -796,7 +951,7 @@ static int wm_sca_resolve_symlink(const char * const file, char * realpath_buffe
 #endif
 
 static int wm_sca_check_dir_list(wm_sca_t * const data, char * const dir_list,
-    char * const file, char * const pattern, char **reason)
+    char * const file, char * const pattern, char **alert_msg, char **reason)
 {
     char *f_value_copy;
     os_strdup(dir_list, f_value_copy);
@@ -834,7 +989,7 @@ static int wm_sca_check_dir_list(wm_sca_t * const data, char * const dir_list,
         char _b_msg[OS_SIZE_1024 + 1];
         _b_msg[OS_SIZE_1024] = '\0';
         snprintf(_b_msg, OS_SIZE_1024, " Directory: %s", dir);
-        append_msg_to_vm_scat(data, _b_msg);
+        append_msg_to_vm_scat(alert_msg, _b_msg);
 
         if (found == RETURN_FOUND) {
             break;
@@ -895,390 +1050,754 @@ ANY and NONE aggregators are complementary.
 
 */
 
-static int wm_sca_do_scan(cJSON *checks, OSStore *vars, wm_sca_t * data, int id,cJSON *policy,
-    int requirements_scan, int cis_db_index, unsigned int remote_policy, int first_scan, int *checks_number)
+/* Evaluate the rules of a check. Returns -1 if a rule is invalid */
+static int wm_sca_check_rules(const cJSON * const rules, int condition, const char * const condition_str, OSStore *vars, wm_sca_t * data,
+                              cJSON *policy, unsigned int remote_policy, OSList **p_list, char **alert_msg, char **reason)
 {
     int type = 0;
-    char buf[OS_SIZE_1024 + 2];
-    char final_file[2048 + 1];
-    char *reason = NULL;
-
-    int ret_val = 0;
-    OSList *p_list = NULL;
-
-    /* Initialize variables */
-    memset(buf, '\0', sizeof(buf));
-    memset(final_file, '\0', sizeof(final_file));
-
-    int check_count = 0;
-    cJSON *check = NULL;
-    cJSON_ArrayForEach(check, checks) {
-        char _check_id_str[50];
-        if (requirements_scan) {
-            snprintf(_check_id_str, sizeof(_check_id_str), "Requirements check");
-        } else {
-            const cJSON * const c_id = cJSON_GetObjectItem(check, "id");
-            if (!c_id || !c_id->valueint) {
-                merror("Skipping check. Check ID is invalid. Offending check number: %d", check_count);
-                ret_val = 1;
-                continue;
-            }
-            snprintf(_check_id_str, sizeof(_check_id_str), "id: %d", c_id->valueint);
-        }
+    int g_found = RETURN_NOT_FOUND;
+    if ((condition & WM_SCA_COND_ANY) || (condition & WM_SCA_COND_NON)) {
+        /* aggregators ANY and NONE break by matching, so they shall return NOT_FOUND if they never break */
+        g_found = RETURN_NOT_FOUND;
+    } else if (condition & WM_SCA_COND_ALL) {
+        /* aggregator ALL breaks the moment a rule does not match. If it doesn't break, all rules have matched */
+        g_found = RETURN_FOUND;
+    }
+
+    mdebug2("Initial rule-aggregator value por this type of rule is '%d'",  g_found);
+    mdebug1("Beginning rules evaluation.");
+
+    char *rule_cp = NULL;
+    const cJSON *rule_ref;
+    cJSON_ArrayForEach(rule_ref, rules) {
+        /* this free is responsible of freeing the copy of the previous rule if
+        the loop 'continues', i.e, does not reach the end of its block. */
+        os_free(rule_cp);
 
-        const cJSON * const c_title = cJSON_GetObjectItem(check, "title");
-        if (!c_title || !c_title->valuestring) {
-            merror("Skipping check with %s: Check name is invalid.", _check_id_str);
-            if (requirements_scan) {
-                ret_val = 1;
-                goto clean_return;
-            }
-            continue;
+        if(!rule_ref->valuestring) {
+            mdebug1("Field 'rule' must be a string.");
+            return -1;
         }
 
-        const cJSON * const c_condition = cJSON_GetObjectItem(check, "condition");
-        if (!c_condition || !c_condition->valuestring) {
-            merror("Skipping check '%s: %s': Check condition not found.", _check_id_str, c_title->valuestring);
-            if (requirements_scan) {
-                ret_val = 1;
-                goto clean_return;
-            }
-            continue;
-        }
+        mdebug1("Considering rule: '%s'", rule_ref->valuestring);
 
-        int condition = 0;
-        wm_sca_set_condition(c_condition->valuestring, &condition);
+        os_strdup(rule_ref->valuestring, rule_cp);
+        char *rule_cp_ref = NULL;
 
-        if (condition == WM_SCA_COND_INV) {
-            merror("Skipping check '%s: %s': Check condition (%s) is invalid.",_check_id_str, c_title->valuestring, c_condition->valuestring);
-            if (requirements_scan) {
-                ret_val = 1;
-                goto clean_return;
-            }
-            continue;
-        }
+    #ifdef WIN32
+        char expanded_rule[2048] = {0};
+        ExpandEnvironmentStrings(rule_cp, expanded_rule, 2048);
+        rule_cp_ref = expanded_rule;
+        mdebug2("Rule after variable expansion: '%s'", rule_cp_ref);
+    #else
+        rule_cp_ref = rule_cp;
+    #endif
 
-        int g_found = RETURN_NOT_FOUND;
-        if ((condition & WM_SCA_COND_ANY) || (condition & WM_SCA_COND_NON)) {
-            /* aggregators ANY and NONE break by matching, so they shall return NOT_FOUND if they never break */
-            g_found = RETURN_NOT_FOUND;
-        } else if (condition & WM_SCA_COND_ALL) {
-            /* aggregator ALL breaks the moment a rule does not match. If it doesn't break, all rules have matched */
-            g_found = RETURN_FOUND;
+        int rule_is_negated = 0;
+        if (rule_cp_ref &&
+                (strncmp(rule_cp_ref, "NOT ", 4) == 0 ||
+                 strncmp(rule_cp_ref, "not ", 4) == 0))
+        {
+            mdebug2("Rule is negated.");
+            rule_is_negated = 1;
+            rule_cp_ref += 4;
         }
 
-        mdebug1("Beginning evaluation of check %s '%s'", _check_id_str, c_title->valuestring);
-        mdebug1("Rule aggregation strategy for this check is '%s'", c_condition->valuestring);
-        mdebug2("Initial rule-aggregator value por this type of rule is '%d'",  g_found);
-        mdebug1("Beginning rules evaluation.");
-
-        const cJSON *const rules = cJSON_GetObjectItem(check, "rules");
-        if (!rules) {
-            merror("Skipping check %s '%s': No rules found.", _check_id_str, c_title->valuestring);
-            if (requirements_scan) {
-                ret_val = 1;
-                goto clean_return;
-            }
-            continue;
-        }
+        /* Get value to look for. char *value is a reference
+        to rule_cp memory. Do not release value!  */
+        char *value = wm_sca_get_value(rule_cp_ref, &type);
 
-        char *rule_cp = NULL;
-        const cJSON *rule_ref;
-        cJSON_ArrayForEach(rule_ref, rules) {
-            /* this free is responsible of freeing the copy of the previous rule if
-            the loop 'continues', i.e, does not reach the end of its block. */
+        if (value == NULL) {
+            merror("Invalid rule: '%s'. Skipping policy.", rule_ref->valuestring);
             os_free(rule_cp);
+            return -1;
+        }
 
-            if(!rule_ref->valuestring) {
-                mdebug1("Field 'rule' must be a string.");
-                ret_val = 1;
-                goto clean_return;
-            }
-
-            mdebug1("Considering rule: '%s'", rule_ref->valuestring);
-
-            os_strdup(rule_ref->valuestring, rule_cp);
-            char *rule_cp_ref = NULL;
-
-        #ifdef WIN32
-            char expanded_rule[2048] = {0};
-            ExpandEnvironmentStrings(rule_cp, expanded_rule, 2048);
-            rule_cp_ref = expanded_rule;
-            mdebug2("Rule after variable expansion: '%s'", rule_cp_ref);
-        #else
-            rule_cp_ref = rule_cp;
-        #endif
+        int found = RETURN_NOT_FOUND;
+        if (type == WM_SCA_TYPE_FILE) {
+            /* Check files */
+            char *pattern = wm_sca_get_pattern(value);
+            char *file_list = value;
 
-            int rule_is_negated = 0;
-            if (rule_cp_ref &&
-                    (strncmp(rule_cp_ref, "NOT ", 4) == 0 ||
-                     strncmp(rule_cp_ref, "not ", 4) == 0))
-            {
-                mdebug2("Rule is negated.");
-                rule_is_negated = 1;
-                rule_cp_ref += 4;
+            /* Get any variable */
+            if (value[0] == '$') {
+                file_list = (char *) wm_sca_get_var(vars, value);
+                if (!file_list) {
+                    merror("Invalid variable: '%s'. Skipping check.", value);
+                    continue;
+                }
             }
 
-            /* Get value to look for. char *value is a reference
-            to rule_cp memory. Do not release value!  */
-            char *value = wm_sca_get_value(rule_cp_ref, &type);
-
-            if (value == NULL) {
-                merror("Invalid rule: '%s'. Skipping policy.", rule_ref->valuestring);
-                os_free(rule_cp);
-                ret_val = 1;
-                goto clean_return;
+            const int result = wm_sca_check_file_list(file_list, pattern, reason);
+            if (result == RETURN_FOUND || result == RETURN_INVALID) {
+                found = result;
             }
 
-            int found = RETURN_NOT_FOUND;
-            if (type == WM_SCA_TYPE_FILE) {
-                /* Check files */
-                char *pattern = wm_sca_get_pattern(value);
-                char *file_list = value;
-
-                /* Get any variable */
-                if (value[0] == '$') {
-                    file_list = (char *) OSStore_Get(vars, value);
-                    if (!file_list) {
-                        merror("Invalid variable: '%s'. Skipping check.", value);
-                        continue;
-                    }
-                }
-
-                const int result = wm_sca_check_file_list(file_list, pattern, &reason);
-                if (result == RETURN_FOUND || result == RETURN_INVALID) {
-                    found = result;
-                }
-
-                char _b_msg[OS_SIZE_1024 + 1];
-                _b_msg[OS_SIZE_1024] = '\0';
-                snprintf(_b_msg, OS_SIZE_1024, " File: %s", file_list);
-                append_msg_to_vm_scat(data, _b_msg);
-            } else if (type == WM_SCA_TYPE_COMMAND) {
-                /* Check command output */
-                char *pattern = wm_sca_get_pattern(value);
-                char *f_value = value;
-
-                if (!data->remote_commands && remote_policy) {
-                    mwarn("Ignoring check for policy '%s'. The internal option 'sca.remote_commands' is disabled.", cJSON_GetObjectItem(policy, "name")->valuestring);
-                    if (reason == NULL) {
-                        os_malloc(OS_MAXSTR, reason);
-                        sprintf(reason,"Ignoring check for running command '%s'. The internal option 'sca.remote_commands' is disabled", f_value);
-                    }
-                    found = RETURN_INVALID;
-                } else {
-                    /* Get any variable */
-                    if (value[0] == '$') {
-                        f_value = (char *) OSStore_Get(vars, value);
-                        if (!f_value) {
-                            merror("Invalid variable: '%s'. Skipping check.", value);
-                            continue;
-                        }
-                    }
+            char _b_msg[OS_SIZE_1024 + 1];
+            _b_msg[OS_SIZE_1024] = '\0';
+            snprintf(_b_msg, OS_SIZE_1024, " File: %s", file_list);
+            append_msg_to_vm_scat(alert_msg, _b_msg);
+        } else if (type == WM_SCA_TYPE_COMMAND) {
+            /* Check command output */
+            char *pattern = wm_sca_get_pattern(value);
+            char *f_value = value;
 
-                    mdebug2("Running command: '%s'", f_value);
-                    const int val = wm_sca_read_command(f_value, pattern, data, &reason);
-                    if (val == RETURN_FOUND) {
-                        mdebug2("Command output matched.");
-                        found = RETURN_FOUND;
-                    } else if (val == RETURN_INVALID){
-                        mdebug2("Command output did not match.");
-                        found = RETURN_INVALID;
-                    }
+            if (!data->remote_commands && remote_policy) {
+                mwarn("Ignoring check for policy '%s'. The internal option 'sca.remote_commands' is disabled.", cJSON_GetObjectItem(policy, "name")->valuestring);
+                if (*reason == NULL) {
+                    os_malloc(OS_MAXSTR, *reason);
+                    sprintf(*reason,"Ignoring check for running command '%s'. The internal option 'sca.remote_commands' is disabled", f_value);
                 }
-
-                char _b_msg[OS_SIZE_1024 + 1];
-                _b_msg[OS_SIZE_1024] = '\0';
-                snprintf(_b_msg, OS_SIZE_1024, " Command: %s", f_value);
-                append_msg_to_vm_scat(data, _b_msg);
-
-            } else if (type == WM_SCA_TYPE_DIR) {
-                /* Check directory */
-                mdebug2("Processing directory rule '%s'", value);
-                char * const file = wm_sca_get_pattern(value);
-                char *f_value = value;
-
+                found = RETURN_INVALID;
+            } else {
                 /* Get any variable */
                 if (value[0] == '$') {
-                    f_value = (char *) OSStore_Get(vars, value);
+                    f_value = (char *) wm_sca_get_var(vars, value);
                     if (!f_value) {
                         merror("Invalid variable: '%s'. Skipping check.", value);
                         continue;
                     }
                 }
 
-                char * const pattern = wm_sca_get_pattern(file);
-                found = wm_sca_check_dir_list(data, f_value, file, pattern, &reason);
-                mdebug2("Check directory rule result: %d", found);
-            } else if (type == WM_SCA_TYPE_PROCESS) {
-                /* Check process existence */
-                if (!p_list) {
-                    /* Lazy evaluation */
-                    p_list = w_os_get_process_list();
-                }
-
-                mdebug2("Checking process: '%s'", value);
-                if (wm_sca_check_process_is_running(p_list, value, &reason)) {
-                    mdebug2("Process found.");
+                mdebug2("Running command: '%s'", f_value);
+                const int val = wm_sca_read_command(f_value, pattern, data, reason);
+                if (val == RETURN_FOUND) {
+                    mdebug2("Command output matched.");
                     found = RETURN_FOUND;
-                } else {
-                    mdebug2("Process not found.");
+                } else if (val == RETURN_INVALID){
+                    mdebug2("Command output did not match.");
+                    found = RETURN_INVALID;
                 }
-
-                char _b_msg[OS_SIZE_1024 + 1];
-                _b_msg[OS_SIZE_1024] = '\0';
-                snprintf(_b_msg, OS_SIZE_1024, " Process: %s", value);
-                append_msg_to_vm_scat(data, _b_msg);
             }
-        #ifdef WIN32
-            else if (type == WM_SCA_TYPE_REGISTRY) {
-                /* Check windows registry */
-                found = wm_check_registry_entry(value, &reason);
 
-                char _b_msg[OS_SIZE_1024 + 1];
-                _b_msg[OS_SIZE_1024] = '\0';
-                snprintf(_b_msg, OS_SIZE_1024, " Registry: %s", value);
-                append_msg_to_vm_scat(data, _b_msg);
-            }
-        #endif
+            char _b_msg[OS_SIZE_1024 + 1];
+            _b_msg[OS_SIZE_1024] = '\0';
+            snprintf(_b_msg, OS_SIZE_1024, " Command: %s", f_value);
+            append_msg_to_vm_scat(alert_msg, _b_msg);
 
-            /* Rule result processing */
+        } else if (type == WM_SCA_TYPE_DIR) {
+            /* Check directory */
+            mdebug2("Processing directory rule '%s'", value);
+            char * const file = wm_sca_get_pattern(value);
+            char *f_value = value;
 
-            if (found != RETURN_INVALID) {
-                found = rule_is_negated ^ found;
+            /* Get any variable */
+            if (value[0] == '$') {
+                f_value = (char *) wm_sca_get_var(vars, value);
+                if (!f_value) {
+                    merror("Invalid variable: '%s'. Skipping check.", value);
+                    continue;
+                }
             }
 
-            mdebug1("Result for rule '%s': %d", rule_ref->valuestring, found);
-
-            if (((condition & WM_SCA_COND_ALL) && found == RETURN_NOT_FOUND) ||
-                ((condition & WM_SCA_COND_ANY) && found == RETURN_FOUND) ||
-                ((condition & WM_SCA_COND_NON) && found == RETURN_FOUND))
-            {
-                g_found = found;
-                mdebug1("Breaking from rule aggregator '%s' with found = %d", c_condition->valuestring, g_found);
-                break;
+            char * const pattern = wm_sca_get_pattern(file);
+            found = wm_sca_check_dir_list(data, f_value, file, pattern, alert_msg, reason);
+            mdebug2("Check directory rule result: %d", found);
+        } else if (type == WM_SCA_TYPE_PROCESS) {
+            /* Check process existence */
+            if (!*p_list) {
+                /* Lazy evaluation */
+                *p_list = w_os_get_process_list();
             }
 
-            if (found == RETURN_INVALID) {
-                /* Rules that agreggate by ANY are the only that can success after an INVALID
-                On the other hand ALL and NONE agregators can fail after an INVALID. */
-                g_found = found;
-                mdebug1("Rule evaluation returned INVALID. Continuing.");
+            mdebug2("Checking process: '%s'", value);
+            if (wm_sca_check_process_is_running(*p_list, value, reason)) {
+                mdebug2("Process found.");
+                found = RETURN_FOUND;
+            } else {
+                mdebug2("Process not found.");
             }
+
+            char _b_msg[OS_SIZE_1024 + 1];
+            _b_msg[OS_SIZE_1024] = '\0';
+            snprintf(_b_msg, OS_SIZE_1024, " Process: %s", value);
+            append_msg_to_vm_scat(alert_msg, _b_msg);
         }
+    #ifdef WIN32
+        else if (type == WM_SCA_TYPE_REGISTRY) {
+            /* Check windows registry */
+            found = wm_check_registry_entry(value, reason);
 
-        if ((condition & WM_SCA_COND_NON) && g_found != RETURN_INVALID) {
-            g_found = !g_found;
+            char _b_msg[OS_SIZE_1024 + 1];
+            _b_msg[OS_SIZE_1024] = '\0';
+            snprintf(_b_msg, OS_SIZE_1024, " Registry: %s", value);
+            append_msg_to_vm_scat(alert_msg, _b_msg);
         }
+    #endif
 
-        mdebug1("Result for check %s '%s' -> %d", _check_id_str, c_title->valuestring, g_found);
+        /* Rule result processing */
 
-        if (g_found != RETURN_INVALID) {
-            os_free(reason);
+        if (found != RETURN_INVALID) {
+            found = rule_is_negated ^ found;
         }
 
-        /* if the loop breaks, rule_cp shall be released.
-            Also frees the the memory reserved on the last iteration */
-        os_free(rule_cp);
+        mdebug1("Result for rule '%s': %d", rule_ref->valuestring, found);
 
-        /* Determine if requirements are satisfied */
-        if (requirements_scan) {
-            /*  return value for requirement scans is the inverse of the result,
-                unless the result is INVALID */
-            ret_val = g_found == RETURN_INVALID ? 1 : !g_found;
-            int i;
-            for (i=0; data->alert_msg[i]; i++){
-                free(data->alert_msg[i]);
-                data->alert_msg[i] = NULL;
-            }
-            goto clean_return;
+        if (((condition & WM_SCA_COND_ALL) && found == RETURN_NOT_FOUND) ||
+            ((condition & WM_SCA_COND_ANY) && found == RETURN_FOUND) ||
+            ((condition & WM_SCA_COND_NON) && found == RETURN_FOUND))
+        {
+            g_found = found;
+            mdebug1("Breaking from rule aggregator '%s' with found = %d", condition_str, g_found);
+            break;
         }
 
-        /* Event construction */
-        const char failed[] = "failed";
-        const char passed[] = "passed";
-        const char invalid[] = ""; //NOT AN ERROR!
-        const char *message_ref = NULL;
+        if (found == RETURN_INVALID) {
+            /* Rules that agreggate by ANY are the only that can success after an INVALID
+            On the other hand ALL and NONE agregators can fail after an INVALID. */
+            g_found = found;
+            mdebug1("Rule evaluation returned INVALID. Continuing.");
+        }
+    }
 
-        if (g_found == RETURN_NOT_FOUND) {
-            wm_sca_summary_increment_failed();
-            message_ref = failed;
-        } else if (g_found == RETURN_FOUND) {
-            wm_sca_summary_increment_passed();
-            message_ref = passed;
-        } else {
-            wm_sca_summary_increment_invalid();
-            message_ref = invalid;
+    if ((condition & WM_SCA_COND_NON) && g_found != RETURN_INVALID) {
+        g_found = !g_found;
+    }
 
-            if (reason == NULL) {
-                os_malloc(OS_MAXSTR, reason);
-                sprintf(reason, "Unknown reason");
-                mdebug1("A check returned INVALID for an unknown reason.");
-            }
-        }
+    if ((condition & WM_SCA_COND_NON) && g_found != RETURN_INVALID) {
+        g_found = !g_found;
+    }
 
-        cJSON *event = wm_sca_build_event(check, policy, data->alert_msg, id, message_ref, reason);
-        if (event) {
-            /* Alert if necessary */
-            if(!cis_db_for_hash[cis_db_index].elem[check_count]) {
-                os_realloc(cis_db_for_hash[cis_db_index].elem, sizeof(cis_db_info_t *) * (check_count + 2), cis_db_for_hash[cis_db_index].elem);
-                cis_db_for_hash[cis_db_index].elem[check_count] = NULL;
-                cis_db_for_hash[cis_db_index].elem[check_count + 1] = NULL;
-            }
+    /* if the loop breaks, rule_cp shall be released.
+        Also frees the the memory reserved on the last iteration */
+    os_free(rule_cp);
 
-            if (wm_sca_check_hash(cis_db[cis_db_index], message_ref, check, event, check_count, cis_db_index) && !first_scan) {
-                wm_sca_send_event_check(data,event);
-            }
+    return g_found;
+}
 
-            check_count++;
+#ifndef WIN32
+static void * wm_sca_evaluate_thread(wm_sca_pool_t *pool)
+{
+    int i;
 
-            cJSON_Delete(event);
-        } else {
-            merror("Error constructing event for check: %s. Set debug mode for more information.", c_title->valuestring);
-            ret_val = 1;
+    while (1) {
+        w_mutex_lock(&pool->mutex);
+        i = pool->next++;
+        w_mutex_unlock(&pool->mutex);
+
+        if (i >= pool->count) {
+            break;
         }
 
-        int i;
-        for (i=0; data->alert_msg[i]; i++){
-            free(data->alert_msg[i]);
-            data->alert_msg[i] = NULL;
+        /* Invalid checks are reported by wm_sca_do_scan() */
+        const cJSON * const c_id = cJSON_GetObjectItem(pool->checks[i], "id");
+        const cJSON * const c_condition = cJSON_GetObjectItem(pool->checks[i], "condition");
+        const cJSON * const rules = cJSON_GetObjectItem(pool->checks[i], "rules");
+        int condition = 0;
+
+        if (!c_id || !c_id->valueint || !c_condition || !c_condition->valuestring || !rules) {
+            continue;
         }
 
-        os_free(reason);
-    }
+        wm_sca_set_condition(c_condition->valuestring, &condition);
 
-    *checks_number = check_count;
+        if (condition == WM_SCA_COND_INV) {
+            continue;
+        }
 
-/* Clean up memory */
-clean_return:
-    os_free(reason);
-    w_del_plist(p_list);
+        /* The process list is only built here if it couldn't be built beforehand */
+        OSList *p_list = pool->p_list;
 
-    return ret_val;
-}
+        pool->results[i].found = wm_sca_evaluate_check(pool->policy_index, c_id->valueint, rules, condition, c_condition->valuestring,
+                                                       pool->vars, pool->data, pool->policy, pool->remote_policy, &p_list,
+                                                       pool->results[i].alert_msg, &pool->results[i].reason);
 
-static void wm_sca_set_condition(const char * const c_cond, int *condition)
-{
-    if (strcmp(c_cond, "all") == 0) {
-        *condition |= WM_SCA_COND_ALL;
-    } else if (strcmp(c_cond, "any") == 0) {
-        *condition |= WM_SCA_COND_ANY;
-    } else if (strcmp(c_cond, "none") == 0) {
-        *condition |= WM_SCA_COND_NON;
-    } else if (strcmp(c_cond, "any required") == 0) {
-        *condition |= WM_SCA_COND_ANY;
-        minfo("Modifier 'required' is deprecated. Defaults to 'any'");
-    } else if (strcmp(c_cond, "all required") == 0) {
-        *condition |= WM_SCA_COND_ALL;
-        minfo("Modifier 'required' is deprecated. Defaults to 'all'");
-    } else {
-        *condition = WM_SCA_COND_INV;
+        if (p_list != pool->p_list) {
+            w_del_plist(p_list);
+        }
     }
+
+    return NULL;
 }
 
-static int wm_sca_get_vars(const cJSON * const variables, OSStore * const vars)
+static wm_sca_check_result_t * wm_sca_evaluate_checks(cJSON *checks, OSStore *vars, wm_sca_t * data, cJSON *policy,
+                                                      unsigned int remote_policy, int policy_index, int *count)
 {
-    const cJSON *variable;
+    wm_sca_pool_t pool = { .vars = vars, .data = data, .policy = policy, .remote_policy = remote_policy, .policy_index = policy_index };
+    pthread_t *threads;
+    cJSON *check;
+    int threads_count;
+    int started = 0;
+    int i = 0;
+
+    pool.count = cJSON_GetArraySize(checks);
+    *count = pool.count;
+
+    if (pool.count == 0) {
+        return NULL;
+    }
+
+    os_calloc(pool.count, sizeof(cJSON *), pool.checks);
+    os_calloc(pool.count, sizeof(wm_sca_check_result_t), pool.results);
+
+    cJSON_ArrayForEach(check, checks) {
+        pool.checks[i] = check;
+        os_calloc(256, sizeof(char *), pool.results[i].alert_msg);
+        pool.results[i].found = RETURN_INVALID;
+        i++;
+    }
+
+    pool.p_list = w_os_get_process_list();
+    w_mutex_init(&pool.mutex, NULL);
+
+    threads_count = data->scan_threads < pool.count ? data->scan_threads : pool.count;
+    os_calloc(threads_count, sizeof(pthread_t), threads);
+
+    for (started = 0; started < threads_count; started++) {
+        if (CreateThreadJoinable(&threads[started], (void * (*)(void *))wm_sca_evaluate_thread, &pool) < 0) {
+            break;
+        }
+    }
+
+    mdebug1("Evaluating %d checks on %d threads.", pool.count, started);
+
+    /* Evaluate them here if no thread could be started */
+    if (started == 0) {
+        wm_sca_evaluate_thread(&pool);
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    w_mutex_destroy(&pool.mutex);
+    w_del_plist(pool.p_list);
+    os_free(threads);
+    os_free(pool.checks);
+
+    return pool.results;
+}
+
+static void wm_sca_free_results(wm_sca_check_result_t *results, int count)
+{
+    int i;
+
+    if (!results) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        os_free(results[i].reason);
+        free_strarray(results[i].alert_msg);
+    }
+
+    free(results);
+}
+#endif
+
+static void wm_sca_free_inputs(wm_sca_inputs_t *inputs)
+{
+    int i;
+
+    for (i = 0; i < inputs->count; i++) {
+        free(inputs->list[i].path);
+    }
+
+    os_free(inputs->list);
+    inputs->count = 0;
+    inputs->size = 0;
+}
+
+static void wm_sca_free_check_state(wm_sca_check_state_t *state)
+{
+    os_free(state->reason);
+    free_strarray(state->alert_msg);
+    wm_sca_free_inputs(&state->inputs);
+    free(state);
+}
+
+/* Read the current state of an input */
+static void wm_sca_fingerprint(wm_sca_input_t *input)
+{
+    input->exists = 0;
+    input->mtime = 0;
+    input->ctime = 0;
+    input->size = 0;
+    input->inode = 0;
+
+#ifdef WIN32
+    if (input->arch) {
+        char key[OS_MAXSTR];
+        HKEY oshkey;
+        FILETIME last_write;
+
+        snprintf(key, sizeof(key), "%s", input->path);
+        char *subkey = wm_sca_os_winreg_getkey(key);
+
+        if (wm_sca_sub_tree && subkey && RegOpenKeyEx(wm_sca_sub_tree, subkey, 0, KEY_READ | input->arch, &oshkey) == ERROR_SUCCESS) {
+            if (RegQueryInfoKey(oshkey, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &last_write) == ERROR_SUCCESS) {
+                input->exists = 1;
+                input->mtime = ((long long)last_write.dwHighDateTime << 32) | last_write.dwLowDateTime;
+            }
+
+            RegCloseKey(oshkey);
+        }
+
+        return;
+    }
+#endif
+
+    struct stat statbuf;
+
+    if (lstat(input->path, &statbuf) == 0) {
+        input->exists = 1;
+        input->mtime = (long long)statbuf.st_mtime;
+        input->ctime = (long long)statbuf.st_ctime;
+        input->size = (long long)statbuf.st_size;
+        input->inode = (unsigned long long)statbuf.st_ino;
+    }
+}
+
+static wm_sca_input_t * wm_sca_add_input(const char * const path, unsigned long arch)
+{
+    wm_sca_inputs_t *inputs = current_inputs;
+
+    if (!inputs || inputs->unknown) {
+        return NULL;
+    }
+
+    /* Files are usually checked for existence and then read */
+    if (inputs->count > 0 && inputs->list[inputs->count - 1].arch == arch && strcmp(inputs->list[inputs->count - 1].path, path) == 0) {
+        return NULL;
+    }
+
+    if (inputs->count == WM_SCA_MAX_INPUTS) {
+        inputs->unknown = 1;
+        return NULL;
+    }
+
+    if (inputs->count == inputs->size) {
+        inputs->size = inputs->size ? inputs->size * 2 : 8;
+        os_realloc(inputs->list, inputs->size * sizeof(wm_sca_input_t), inputs->list);
+    }
+
+    wm_sca_input_t *input = &inputs->list[inputs->count++];
+    memset(input, 0, sizeof(wm_sca_input_t));
+    os_strdup(path, input->path);
+    input->arch = arch;
+
+    return input;
+}
+
+static void wm_sca_record_path(const char * const path)
+{
+    wm_sca_input_t *input = wm_sca_add_input(path, 0);
+
+    if (input) {
+        wm_sca_fingerprint(input);
+    }
+}
+
+static void wm_sca_record_unknown()
+{
+    if (current_inputs) {
+        current_inputs->unknown = 1;
+    }
+}
+
+/* Returns 1 if any input differs from its recorded state */
+static int wm_sca_inputs_changed(const wm_sca_inputs_t * const inputs)
+{
+    int i;
+
+    for (i = 0; i < inputs->count; i++) {
+        wm_sca_input_t current = { .path = inputs->list[i].path, .arch = inputs->list[i].arch };
+        wm_sca_fingerprint(&current);
+
+        if (current.exists != inputs->list[i].exists || current.mtime != inputs->list[i].mtime ||
+            current.ctime != inputs->list[i].ctime || current.size != inputs->list[i].size ||
+            current.inode != inputs->list[i].inode) {
+            mdebug2("Input '%s' has changed.", current.path);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Evaluate the rules of a check, unless none of the inputs read by its last
+ * evaluation changed. Returns -1 if a rule is invalid */
+static int wm_sca_evaluate_check(int policy_index, int check_id, const cJSON * const rules, int condition, const char * const condition_str,
+                                 OSStore *vars, wm_sca_t * data, cJSON *policy, unsigned int remote_policy, OSList **p_list,
+                                 char **alert_msg, char **reason)
+{
+    OSHash *states = check_states ? check_states[policy_index] : NULL;
+    wm_sca_inputs_t inputs = { NULL, 0, 0, 0 };
+    wm_sca_check_state_t *state;
+    char key[OS_SIZE_32];
+    int found;
+    int i;
+
+    snprintf(key, sizeof(key), "%d", check_id);
+
+    if (states && (state = OSHash_Get_ex(states, key), state) && !wm_sca_inputs_changed(&state->inputs)) {
+        mdebug1("The inputs of check %d haven't changed. Reusing its last result: %d", check_id, state->found);
+
+        for (i = 0; state->alert_msg && state->alert_msg[i]; i++) {
+            append_msg_to_vm_scat(alert_msg, state->alert_msg[i]);
+        }
+
+        if (state->reason && *reason == NULL) {
+            os_strdup(state->reason, *reason);
+        }
+
+        return state->found;
+    }
+
+    current_inputs = &inputs;
+    found = wm_sca_check_rules(rules, condition, condition_str, vars, data, policy, remote_policy, p_list, alert_msg, reason);
+    current_inputs = NULL;
+
+    if (states) {
+        if (state = OSHash_Delete_ex(states, key), state) {
+            wm_sca_free_check_state(state);
+        }
+
+        if (found >= 0 && !inputs.unknown) {
+            os_calloc(1, sizeof(wm_sca_check_state_t), state);
+            state->found = found;
+            state->inputs = inputs;
+
+            if (*reason) {
+                os_strdup(*reason, state->reason);
+            }
+
+            for (i = 0; alert_msg[i]; i++);
+            os_calloc(i + 1, sizeof(char *), state->alert_msg);
+
+            for (i = 0; alert_msg[i]; i++) {
+                os_strdup(alert_msg[i], state->alert_msg[i]);
+            }
+
+            if (OSHash_Add_ex(states, key, state) != 2) {
+                wm_sca_free_check_state(state);
+            }
+
+            return found;
+        }
+    }
+
+    wm_sca_free_inputs(&inputs);
+    return found;
+}
+
+static int wm_sca_do_scan(cJSON *checks, OSStore *vars, wm_sca_t * data, int id,cJSON *policy,
+    int requirements_scan, int cis_db_index, unsigned int remote_policy, int first_scan, int *checks_number)
+{
+    char buf[OS_SIZE_1024 + 2];
+    char final_file[2048 + 1];
+    char *reason = NULL;
+
+    int ret_val = 0;
+    OSList *p_list = NULL;
+    wm_sca_check_result_t *results = NULL;
+    int results_count = 0;
+
+    /* Initialize variables */
+    memset(buf, '\0', sizeof(buf));
+    memset(final_file, '\0', sizeof(final_file));
+
+#ifndef WIN32
+    /* The rules of the checks are evaluated by the scan threads, and the
+     * results reported here in the order of the policy */
+    if (!requirements_scan && data->scan_threads > 1) {
+        results = wm_sca_evaluate_checks(checks, vars, data, policy, remote_policy, cis_db_index, &results_count);
+    }
+#endif
+
+    int check_count = 0;
+    int check_index = -1;
+    cJSON *check = NULL;
+    cJSON_ArrayForEach(check, checks) {
+        check_index++;
+        char _check_id_str[50];
+        int check_id = 0;
+        if (requirements_scan) {
+            snprintf(_check_id_str, sizeof(_check_id_str), "Requirements check");
+        } else {
+            const cJSON * const c_id = cJSON_GetObjectItem(check, "id");
+            if (!c_id || !c_id->valueint) {
+                merror("Skipping check. Check ID is invalid. Offending check number: %d", check_count);
+                ret_val = 1;
+                continue;
+            }
+            snprintf(_check_id_str, sizeof(_check_id_str), "id: %d", c_id->valueint);
+            check_id = c_id->valueint;
+        }
+
+        const cJSON * const c_title = cJSON_GetObjectItem(check, "title");
+        if (!c_title || !c_title->valuestring) {
+            merror("Skipping check with %s: Check name is invalid.", _check_id_str);
+            if (requirements_scan) {
+                ret_val = 1;
+                goto clean_return;
+            }
+            continue;
+        }
+
+        const cJSON * const c_condition = cJSON_GetObjectItem(check, "condition");
+        if (!c_condition || !c_condition->valuestring) {
+            merror("Skipping check '%s: %s': Check condition not found.", _check_id_str, c_title->valuestring);
+            if (requirements_scan) {
+                ret_val = 1;
+                goto clean_return;
+            }
+            continue;
+        }
+
+        int condition = 0;
+        wm_sca_set_condition(c_condition->valuestring, &condition);
+
+        if (condition == WM_SCA_COND_INV) {
+            merror("Skipping check '%s: %s': Check condition (%s) is invalid.",_check_id_str, c_title->valuestring, c_condition->valuestring);
+            if (requirements_scan) {
+                ret_val = 1;
+                goto clean_return;
+            }
+            continue;
+        }
+
+        mdebug1("Beginning evaluation of check %s '%s'", _check_id_str, c_title->valuestring);
+        mdebug1("Rule aggregation strategy for this check is '%s'", c_condition->valuestring);
+
+        const cJSON *const rules = cJSON_GetObjectItem(check, "rules");
+        if (!rules) {
+            merror("Skipping check %s '%s': No rules found.", _check_id_str, c_title->valuestring);
+            if (requirements_scan) {
+                ret_val = 1;
+                goto clean_return;
+            }
+            continue;
+        }
+
+        char **alert_msg = data->alert_msg;
+        int g_found;
+
+        if (results) {
+            /* Already evaluated by the scan threads */
+            g_found = results[check_index].found;
+            reason = results[check_index].reason;
+            results[check_index].reason = NULL;
+            alert_msg = results[check_index].alert_msg;
+        } else if (requirements_scan) {
+            g_found = wm_sca_check_rules(rules, condition, c_condition->valuestring, vars, data, policy, remote_policy, &p_list, alert_msg, &reason);
+        } else {
+            g_found = wm_sca_evaluate_check(cis_db_index, check_id, rules, condition, c_condition->valuestring, vars, data, policy,
+                                            remote_policy, &p_list, alert_msg, &reason);
+        }
+
+        if (g_found < 0) {
+            ret_val = 1;
+            goto clean_return;
+        }
+
+        mdebug1("Result for check %s '%s' -> %d", _check_id_str, c_title->valuestring, g_found);
+
+        if (g_found != RETURN_INVALID) {
+            os_free(reason);
+        }
+
+        /* Determine if requirements are satisfied */
+        if (requirements_scan) {
+            /*  return value for requirement scans is the inverse of the result,
+                unless the result is INVALID */
+            ret_val = g_found == RETURN_INVALID ? 1 : !g_found;
+            int i;
+            for (i=0; alert_msg[i]; i++){
+                free(alert_msg[i]);
+                alert_msg[i] = NULL;
+            }
+            goto clean_return;
+        }
+
+        /* Event construction */
+        const char failed[] = "failed";
+        const char passed[] = "passed";
+        const char invalid[] = ""; //NOT AN ERROR!
+        const char *message_ref = NULL;
+
+        if (g_found == RETURN_NOT_FOUND) {
+            wm_sca_summary_increment_failed();
+            message_ref = failed;
+        } else if (g_found == RETURN_FOUND) {
+            wm_sca_summary_increment_passed();
+            message_ref = passed;
+        } else {
+            wm_sca_summary_increment_invalid();
+            message_ref = invalid;
+
+            if (reason == NULL) {
+                os_malloc(OS_MAXSTR, reason);
+                sprintf(reason, "Unknown reason");
+                mdebug1("A check returned INVALID for an unknown reason.");
+            }
+        }
+
+        cJSON *event = wm_sca_build_event(check, policy, alert_msg, id, message_ref, reason);
+        if (event) {
+            /* Alert if necessary */
+            if(!cis_db_for_hash[cis_db_index].elem[check_count]) {
+                os_realloc(cis_db_for_hash[cis_db_index].elem, sizeof(cis_db_info_t *) * (check_count + 2), cis_db_for_hash[cis_db_index].elem);
+                cis_db_for_hash[cis_db_index].elem[check_count] = NULL;
+                cis_db_for_hash[cis_db_index].elem[check_count + 1] = NULL;
+            }
+
+            if (wm_sca_check_hash(cis_db[cis_db_index], message_ref, check, event, check_count, cis_db_index) && !first_scan) {
+                wm_sca_send_event_check(data,event);
+            }
+
+            check_count++;
+
+            cJSON_Delete(event);
+        } else {
+            merror("Error constructing event for check: %s. Set debug mode for more information.", c_title->valuestring);
+            ret_val = 1;
+        }
+
+        int i;
+        for (i=0; alert_msg[i]; i++){
+            free(alert_msg[i]);
+            alert_msg[i] = NULL;
+        }
+
+        os_free(reason);
+    }
+
+    *checks_number = check_count;
+
+/* Clean up memory */
+clean_return:
+    os_free(reason);
+    w_del_plist(p_list);
+#ifndef WIN32
+    wm_sca_free_results(results, results_count);
+#endif
+
+    return ret_val;
+}
+
+static void wm_sca_set_condition(const char * const c_cond, int *condition)
+{
+    if (strcmp(c_cond, "all") == 0) {
+        *condition |= WM_SCA_COND_ALL;
+    } else if (strcmp(c_cond, "any") == 0) {
+        *condition |= WM_SCA_COND_ANY;
+    } else if (strcmp(c_cond, "none") == 0) {
+        *condition |= WM_SCA_COND_NON;
+    } else if (strcmp(c_cond, "any required") == 0) {
+        *condition |= WM_SCA_COND_ANY;
+        minfo("Modifier 'required' is deprecated. Defaults to 'any'");
+    } else if (strcmp(c_cond, "all required") == 0) {
+        *condition |= WM_SCA_COND_ALL;
+        minfo("Modifier 'required' is deprecated. Defaults to 'all'");
+    } else {
+        *condition = WM_SCA_COND_INV;
+    }
+}
+
+static int wm_sca_get_vars(const cJSON * const variables, OSStore * const vars)
+{
+    const cJSON *variable;
     cJSON_ArrayForEach (variable, variables) {
         if (*variable->string != '$') {
             merror("Invalid variable: '%s'", variable->string);
@@ -1350,8 +1869,303 @@ static char *wm_sca_get_pattern(char *value)
     return (NULL);
 }
 
+static void wm_sca_free_regex(wm_sca_regex_t *entry)
+{
+    if (entry->compiled) {
+        OSRegex_FreePattern(&entry->regex);
+    }
+    free(entry);
+}
+
+static void wm_sca_free_file(wm_sca_file_t *entry)
+{
+    free_strarray(entry->lines);
+    free(entry);
+}
+
+static void wm_sca_free_command(wm_sca_command_t *entry)
+{
+    free_strarray(entry->lines);
+    free(entry);
+}
+
+static int wm_sca_cache_init()
+{
+    scan_cache.files = OSHash_Create();
+    scan_cache.commands = OSHash_Create();
+    scan_cache.regexes = OSHash_Create();
+    scan_cache.numeric_regexes = OSHash_Create();
+
+    if (!scan_cache.files || !scan_cache.commands || !scan_cache.regexes || !scan_cache.numeric_regexes) {
+        wm_sca_cache_free();
+        return -1;
+    }
+
+    OSHash_SetFreeDataPointer(scan_cache.files, (void (*)(void *))wm_sca_free_file);
+    OSHash_SetFreeDataPointer(scan_cache.commands, (void (*)(void *))wm_sca_free_command);
+    OSHash_SetFreeDataPointer(scan_cache.regexes, (void (*)(void *))wm_sca_free_regex);
+    OSHash_SetFreeDataPointer(scan_cache.numeric_regexes, (void (*)(void *))wm_sca_free_regex);
+    return 0;
+}
+
+static void wm_sca_cache_free()
+{
+    if (scan_cache.files) {
+        OSHash_Free(scan_cache.files);
+        scan_cache.files = NULL;
+    }
+
+    if (scan_cache.commands) {
+        OSHash_Free(scan_cache.commands);
+        scan_cache.commands = NULL;
+    }
+
+    if (scan_cache.regexes) {
+        OSHash_Free(scan_cache.regexes);
+        scan_cache.regexes = NULL;
+    }
+
+    if (scan_cache.numeric_regexes) {
+        OSHash_Free(scan_cache.numeric_regexes);
+        scan_cache.numeric_regexes = NULL;
+    }
+}
+
+static const char * wm_sca_get_var(OSStore *vars, const char * const name)
+{
+    const char *value;
+
+    w_mutex_lock(&vars_mutex);
+    value = (const char *)OSStore_Get(vars, name);
+    w_mutex_unlock(&vars_mutex);
+
+    return value;
+}
+
+/* Get a compiled regex, compiling it the first time. A pattern that can't be
+ * compiled is kept too, so that it's not compiled again */
+static wm_sca_regex_t * wm_sca_get_regex(const char * const pattern, int flags)
+{
+    OSHash *table = (flags & OS_RETURN_SUBSTRING) ? scan_cache.numeric_regexes : scan_cache.regexes;
+    wm_sca_regex_t *entry;
+
+    if (!table) {
+        return NULL;
+    }
+
+    if (entry = OSHash_Get_ex(table, pattern), entry) {
+        return entry;
+    }
+
+    os_calloc(1, sizeof(wm_sca_regex_t), entry);
+    entry->compiled = OSRegex_Compile(pattern, &entry->regex, flags);
+
+    /* Another thread may have compiled it in the meantime */
+    if (OSHash_Add_ex(table, pattern, entry) != 2) {
+        wm_sca_free_regex(entry);
+        entry = OSHash_Get_ex(table, pattern);
+    }
+
+    return entry;
+}
+
+/* Same as OS_Regex(), but the regex is compiled only once */
+static int wm_sca_regex_matches(const char * const pattern, const char * const str)
+{
+    wm_sca_regex_t *cached = wm_sca_get_regex(pattern, 0);
+
+    return cached && cached->compiled && OSRegex_Execute(str, &cached->regex) ? 1 : 0;
+}
+
+/* Compile the regexes of the patterns of a rule: "r:REGEX" and "n:REGEX compare OP VALUE" */
+static void wm_sca_compile_pattern(const char * const pattern)
+{
+    char *pattern_copy;
+    char *pattern_copy_ref;
+    char *minterm;
+
+    os_strdup(pattern, pattern_copy);
+    pattern_copy_ref = pattern_copy;
+
+    while ((minterm = w_strtok_r_str_delim(" && ", &pattern_copy_ref))) {
+        if (*minterm == '!') {
+            minterm++;
+        }
+
+        if (strncasecmp(minterm, "r:", 2) == 0) {
+            wm_sca_get_regex(minterm + 2, 0);
+        } else if (strncasecmp(minterm, "n:", 2) == 0) {
+            char *comparison = strstr(minterm + 2, " compare ");
+
+            if (comparison) {
+                *comparison = '\0';
+                wm_sca_get_regex(minterm + 2, OS_RETURN_SUBSTRING);
+            }
+        }
+    }
+
+    os_free(pattern_copy);
+}
+
+static void wm_sca_compile_checks(const cJSON * const checks)
+{
+    const cJSON *check;
+    const cJSON *rule;
+    int type;
+
+    cJSON_ArrayForEach(check, checks) {
+        const cJSON * const rules = cJSON_GetObjectItem(check, "rules");
+
+        cJSON_ArrayForEach(rule, rules) {
+            if (!rule->valuestring) {
+                continue;
+            }
+
+            char *rule_cp;
+            os_strdup(rule->valuestring, rule_cp);
+            char *rule_cp_ref = rule_cp;
+
+            if (strncmp(rule_cp_ref, "NOT ", 4) == 0 || strncmp(rule_cp_ref, "not ", 4) == 0) {
+                rule_cp_ref += 4;
+            }
+
+            char *value = wm_sca_get_value(rule_cp_ref, &type);
+            char *pattern = wm_sca_get_pattern(value);
+
+            if (type == WM_SCA_TYPE_DIR) {
+                /* d:DIR -> FILE -> PATTERN */
+                char *content_pattern = wm_sca_get_pattern(pattern);
+
+                if (pattern && strncasecmp(pattern, "r:", 2) == 0) {
+                    wm_sca_get_regex(pattern + 2, 0);
+                }
+
+                if (content_pattern) {
+                    wm_sca_compile_pattern(content_pattern);
+                }
+            } else if (pattern && (type == WM_SCA_TYPE_FILE || type == WM_SCA_TYPE_COMMAND)) {
+                wm_sca_compile_pattern(pattern);
+            } else if (value && type == WM_SCA_TYPE_PROCESS) {
+                wm_sca_compile_pattern(value);
+            }
+
+            os_free(rule_cp);
+        }
+    }
+}
+
+/* Get the lines of a file, reading it the first time. Returns NULL if the
+ * file is too big to be kept, or if it can't be kept */
+static wm_sca_file_t * wm_sca_get_file(const char * const path)
+{
+    wm_sca_file_t *entry;
+    struct stat statbuf;
+
+    if (!scan_cache.files) {
+        return NULL;
+    }
+
+    if (entry = OSHash_Get_ex(scan_cache.files, path), entry) {
+        return entry;
+    }
+
+    if (stat(path, &statbuf) == 0 && statbuf.st_size > WM_SCA_CACHE_FILE_MAX) {
+        return NULL;
+    }
+
+    os_calloc(1, sizeof(wm_sca_file_t), entry);
+
+    FILE *fp = fopen(path, "r");
+
+    if (fp) {
+        char buf[OS_SIZE_2048 + 1];
+        size_t count = 0;
+        size_t size = 0;
+
+        while (fgets(buf, OS_SIZE_2048, fp) != NULL) {
+            os_trimcrlf(buf);
+
+            if (count + 1 >= size) {
+                size = size ? size * 2 : 64;
+                os_realloc(entry->lines, size * sizeof(char *), entry->lines);
+            }
+
+            os_strdup(buf, entry->lines[count]);
+            count++;
+        }
+
+        if (entry->lines) {
+            entry->lines[count] = NULL;
+        } else {
+            os_calloc(1, sizeof(char *), entry->lines);
+        }
+
+        fclose(fp);
+    } else {
+        entry->error = errno ? errno : EIO;
+    }
+
+    if (OSHash_Add_ex(scan_cache.files, path, entry) != 2) {
+        wm_sca_free_file(entry);
+        entry = OSHash_Get_ex(scan_cache.files, path);
+    }
+
+    return entry;
+}
+
+/* Get the result of running a command, running it the first time. If the
+ * result can't be kept, cached is set to 0 and it must be freed */
+static wm_sca_command_t * wm_sca_get_command(char *command, wm_sca_t * data, int *cached)
+{
+    wm_sca_command_t *entry;
+    char *cmd_output = NULL;
+
+    *cached = 1;
+
+    if (scan_cache.commands) {
+        if (entry = OSHash_Get_ex(scan_cache.commands, command), entry) {
+            mdebug1("Command '%s' was already run. Using its output.", command);
+            return entry;
+        }
+    }
+
+    os_calloc(1, sizeof(wm_sca_command_t), entry);
+    entry->status = wm_exec(command, &cmd_output, &entry->result_code, data->commands_timeout, NULL);
+
+    if (entry->status == 0 && cmd_output) {
+        if (entry->lines = OS_StrBreak('\n', cmd_output, 256), entry->lines) {
+            int i;
+
+            for (i = 0; entry->lines[i]; i++) {
+                os_trimcrlf(entry->lines[i]);
+            }
+        } else {
+            mdebug1("Command output could not be processed. Output dump:\n%s", cmd_output);
+        }
+    }
+
+    os_free(cmd_output);
+
+    if (!scan_cache.commands) {
+        *cached = 0;
+    } else if (OSHash_Add_ex(scan_cache.commands, command, entry) != 2) {
+        wm_sca_command_t *stored = OSHash_Get_ex(scan_cache.commands, command);
+
+        if (stored) {
+            wm_sca_free_command(entry);
+            entry = stored;
+        } else {
+            *cached = 0;
+        }
+    }
+
+    return entry;
+}
+
 static int wm_sca_check_file_existence(const char * const file, char **reason)
 {
+    wm_sca_record_path(file);
+
     #ifdef WIN32
     const char *realpath_buffer = file;
     #else
@@ -1360,6 +2174,10 @@ static int wm_sca_check_file_existence(const char * const file, char **reason)
     if (wm_sca_resolve_symlink_result != RETURN_FOUND) {
         return wm_sca_resolve_symlink_result;
     }
+
+    if (strcmp(realpath_buffer, file) != 0) {
+        wm_sca_record_path(realpath_buffer);
+    }
     #endif
 
     struct stat statbuf;
@@ -1414,6 +2232,35 @@ static int wm_sca_check_file_contents(const char * const file, const char * cons
     }
     #endif
 
+    int result = RETURN_NOT_FOUND;
+    wm_sca_file_t *cached = wm_sca_get_file(realpath_buffer);
+
+    if (cached) {
+        if (cached->error) {
+            if (*reason == NULL) {
+                os_malloc(OS_MAXSTR, *reason);
+                sprintf(*reason, "Could not open file '%s': %s", file, strerror(cached->error));
+            }
+            mdebug2("Could not open file '%s': %s", file, strerror(cached->error));
+            return RETURN_INVALID;
+        }
+
+        int i;
+        for (i = 0; cached->lines[i]; i++) {
+            const char *line = cached->lines[i];
+            result = wm_sca_pattern_matches(line, pattern, reason);
+            mdebug2("(%s)(%s) -> %d", pattern, *line != '\0' ? line : "EMPTY_LINE" , result);
+
+            if (result) {
+                mdebug2("Match found. Skipping the rest.");
+                break;
+            }
+        }
+
+        mdebug2("Result for (%s)(%s) -> %d", pattern, file, result);
+        return result;
+    }
+
     FILE *fp = fopen(realpath_buffer, "r");
     const int fopen_errno = errno;
     if (!fp) {
@@ -1425,7 +2272,6 @@ static int wm_sca_check_file_contents(const char * const file, const char * cons
         return RETURN_INVALID;
     }
 
-    int result = RETURN_NOT_FOUND;
     char buf[OS_SIZE_2048 + 1];
     while (fgets(buf, OS_SIZE_2048, fp) != NULL) {
         os_trimcrlf(buf);
@@ -1553,68 +2399,61 @@ static int wm_sca_read_command(char *command, char *pattern, wm_sca_t * data, ch
     }
 
     mdebug1("Executing command '%s', and testing output with pattern '%s'", command, pattern);
-    char *cmd_output = NULL;
-    int result_code;
+    wm_sca_record_unknown();
+    int cached;
+    wm_sca_command_t *output = wm_sca_get_command(command, data, &cached);
+    int result = RETURN_NOT_FOUND;
 
-    switch (wm_exec(command, &cmd_output, &result_code, data->commands_timeout, NULL)) {
+    switch (output->status) {
     case 0:
-        mdebug1("Command '%s' returned code %d", command, result_code);
+        mdebug1("Command '%s' returned code %d", command, output->result_code);
         break;
     case WM_ERROR_TIMEOUT:
-        os_free(cmd_output);
         mdebug1("Timeout overtaken running command '%s'", command);
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
             sprintf(*reason, "Timeout overtaken running command '%s'", command);
         }
-        os_free(cmd_output);
-        return RETURN_INVALID;
+        result = RETURN_INVALID;
+        goto end;
     default:
-        if (result_code == EXECVE_ERROR) {
+        if (output->result_code == EXECVE_ERROR) {
             mdebug1("Invalid path or wrong permissions to run command '%s'", command);
             if (*reason == NULL) {
                 os_malloc(OS_MAXSTR, *reason);
                 sprintf(*reason, "Invalid path or wrong permissions to run command '%s'", command);
             }
         } else {
-            mdebug1("Failed to run command '%s'. Returned code %d", command, result_code);
+            mdebug1("Failed to run command '%s'. Returned code %d", command, output->result_code);
             if (*reason == NULL) {
                 os_malloc(OS_MAXSTR, *reason);
-                sprintf(*reason, "Failed to run command '%s'. Returned code %d", command, result_code);
+                sprintf(*reason, "Failed to run command '%s'. Returned code %d", command, output->result_code);
             }
         }
-        return RETURN_INVALID;
+        result = RETURN_INVALID;
+        goto end;
     }
 
-    if(!cmd_output) {
+    if (!output->lines) {
         mdebug2("Command yielded no output. Returning.");
-        return RETURN_NOT_FOUND;
-    }
-
-    char **output_line;
-    output_line = OS_StrBreak('\n', cmd_output, 256);
-
-    if(!output_line) {
-        mdebug1("Command output could not be processed. Output dump:\n%s", cmd_output);
-        os_free(cmd_output);
-        return RETURN_NOT_FOUND;
+        goto end;
     }
 
-    os_free(cmd_output);
-
     int i;
-    int result = RETURN_NOT_FOUND;
-    for (i=0; output_line[i] != NULL; i++) {
-        char *buf = output_line[i];
-        os_trimcrlf(buf);
-        result = wm_sca_pattern_matches(buf, pattern, reason);
+    for (i = 0; output->lines[i] != NULL; i++) {
+        result = wm_sca_pattern_matches(output->lines[i], pattern, reason);
         if (result == RETURN_FOUND){
             break;
         }
     }
 
-    free_strarray(output_line);
     mdebug2("Result for (%s)(%s) -> %d", pattern, command, result);
+
+end:
+    if (!cached) {
+        wm_sca_free_command(output);
+    }
+
     return result;
 }
 
@@ -1631,8 +2470,8 @@ static int wm_sca_apply_numeric_partial_comparison(const char * const partial_co
 
     mdebug2("Partial comparison '%s'", partial_comparison);
 
-    OSRegex regex;
-    if (!OSRegex_Compile("(\\d+)", &regex, OS_RETURN_SUBSTRING)) {
+    wm_sca_regex_t *cached = wm_sca_get_regex("(\\d+)", OS_RETURN_SUBSTRING);
+    if (!cached || !cached->compiled) {
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
             sprintf(*reason, "Cannot compile regex.");
@@ -1641,43 +2480,46 @@ static int wm_sca_apply_numeric_partial_comparison(const char * const partial_co
         return RETURN_INVALID;
     }
 
-    if (!OSRegex_Execute(partial_comparison, &regex)) {
+    regex_matching matching;
+    memset(&matching, 0, sizeof(regex_matching));
+
+    if (!OSRegex_Execute_ex(partial_comparison, &cached->regex, &matching)) {
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
             sprintf(*reason, "No integer was found within the comparison '%s' ", partial_comparison);
         }
         mwarn("No integer was found within the comparison '%s' ", partial_comparison);
-        OSRegex_FreePattern(&regex);
+        OSRegex_free_regex_matching(&matching);
         return RETURN_INVALID;
     }
 
-    if (!regex.d_sub_strings[0]) {
+    if (!matching.sub_strings || !matching.sub_strings[0]) {
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
             sprintf(*reason, "No number was captured.");
         }
         mwarn("No number was captured.");
-        OSRegex_FreePattern(&regex);
+        OSRegex_free_regex_matching(&matching);
         return RETURN_INVALID;
     }
 
-    mdebug2("Value given for comparison: '%s'", regex.d_sub_strings[0]);
+    mdebug2("Value given for comparison: '%s'", matching.sub_strings[0]);
 
     errno = 0;
     char *strtol_end_ptr = NULL;
-    const long int value_given = strtol(regex.d_sub_strings[0], &strtol_end_ptr, 10);
+    const long int value_given = strtol(matching.sub_strings[0], &strtol_end_ptr, 10);
 
-    if (errno != 0 || strtol_end_ptr == regex.d_sub_strings[0]) {
+    if (errno != 0 || strtol_end_ptr == matching.sub_strings[0]) {
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
-            sprintf(*reason, "Conversion error. Cannot convert '%s' to integer.", regex.d_sub_strings[0]);
+            sprintf(*reason, "Conversion error. Cannot convert '%s' to integer.", matching.sub_strings[0]);
         }
-        mwarn("Conversion error. Cannot convert '%s' to integer.", regex.d_sub_strings[0]);
-        OSRegex_FreePattern(&regex);
+        mwarn("Conversion error. Cannot convert '%s' to integer.", matching.sub_strings[0]);
+        OSRegex_free_regex_matching(&matching);
         return RETURN_INVALID;
     }
 
-    OSRegex_FreePattern(&regex);
+    OSRegex_free_regex_matching(&matching);
 
     mdebug2("Value converted: '%ld'", value_given);
 
@@ -1729,9 +2571,8 @@ int wm_sca_regex_numeric_comparison (const char * const pattern, const char *con
     partial_comparison_ref += 9;
     mdebug2("REGEX: '%s'. Partial comparison: '%s'", pattern_copy_ref, partial_comparison_ref);
 
-    OSRegex regex;
-    memset(&regex, 0, sizeof(OSRegex));
-    if (!OSRegex_Compile(pattern_copy_ref, &regex, OS_RETURN_SUBSTRING)) {
+    wm_sca_regex_t *cached = wm_sca_get_regex(pattern_copy_ref, OS_RETURN_SUBSTRING);
+    if (!cached || !cached->compiled) {
         mdebug2("Cannot compile regex '%s'", pattern_copy_ref);
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
@@ -1741,42 +2582,45 @@ int wm_sca_regex_numeric_comparison (const char * const pattern, const char *con
         return RETURN_INVALID;
     }
 
-    if (!OSRegex_Execute(str, &regex)) {
+    regex_matching matching;
+    memset(&matching, 0, sizeof(regex_matching));
+
+    if (!OSRegex_Execute_ex(str, &cached->regex, &matching)) {
         mdebug2("No match found for regex '%s'", pattern_copy_ref);
         os_free(pattern_copy);
-        OSRegex_FreePattern(&regex);
+        OSRegex_free_regex_matching(&matching);
         return RETURN_NOT_FOUND;
     }
 
-    if (!regex.d_sub_strings[0]) {
+    if (!matching.sub_strings || !matching.sub_strings[0]) {
         mdebug2("Regex '%s' matched, but no string was captured by it. Did you forget specifying a capture group?", pattern_copy_ref);
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
             sprintf(*reason, "Regex '%s' matched, but no string was captured by it. Did you forget specifying a capture group?", pattern_copy_ref);
         }
         os_free(pattern_copy);
-        OSRegex_FreePattern(&regex);
+        OSRegex_free_regex_matching(&matching);
         return RETURN_INVALID;
     }
 
-    mdebug2("Captured value: '%s'", regex.d_sub_strings[0]);
+    mdebug2("Captured value: '%s'", matching.sub_strings[0]);
 
     errno = 0;
     char *strtol_end_ptr = NULL;
-    const long int value_captured = strtol(regex.d_sub_strings[0], &strtol_end_ptr, 10);
+    const long int value_captured = strtol(matching.sub_strings[0], &strtol_end_ptr, 10);
 
-    if (errno != 0 || strtol_end_ptr == regex.d_sub_strings[0]) {
-        mdebug2("Conversion error. Cannot convert '%s' to integer.", regex.d_sub_strings[0]);
+    if (errno != 0 || strtol_end_ptr == matching.sub_strings[0]) {
+        mdebug2("Conversion error. Cannot convert '%s' to integer.", matching.sub_strings[0]);
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
-            sprintf(*reason, "Conversion error. Cannot convert '%s' to integer.", regex.d_sub_strings[0]);
+            sprintf(*reason, "Conversion error. Cannot convert '%s' to integer.", matching.sub_strings[0]);
         }
         os_free(pattern_copy);
-        OSRegex_FreePattern(&regex);
+        OSRegex_free_regex_matching(&matching);
         return RETURN_INVALID;
     }
 
-    OSRegex_FreePattern(&regex);
+    OSRegex_free_regex_matching(&matching);
 
     mdebug2("Converted value: '%ld'", value_captured);
 
@@ -1792,7 +2636,7 @@ int wm_sca_test_positive_minterm(char * const minterm, const char * const str, c
     const char *pattern_ref = minterm;
     if (strncasecmp(pattern_ref, "r:", 2) == 0) {
         pattern_ref += 2;
-        if (OS_Regex(pattern_ref, str)) {
+        if (wm_sca_regex_matches(pattern_ref, str)) {
             return RETURN_FOUND;
         }
     } else if (strncasecmp(pattern_ref, "n:", 2) == 0) {
@@ -1834,6 +2678,8 @@ int wm_sca_pattern_matches(const char * const str, const char * const pattern, c
 
 static int wm_sca_check_dir_existence(const char * const dir, char **reason)
 {
+    wm_sca_record_path(dir);
+
     #ifdef WIN32
     const char *realpath_buffer = dir;
     #else
@@ -1842,6 +2688,10 @@ static int wm_sca_check_dir_existence(const char * const dir, char **reason)
     if (wm_sca_resolve_symlink_result != RETURN_FOUND) {
         return wm_sca_resolve_symlink_result;
     }
+
+    if (strcmp(realpath_buffer, dir) != 0) {
+        wm_sca_record_path(realpath_buffer);
+    }
     #endif
 
     DIR *dp = opendir(realpath_buffer);
@@ -1872,6 +2722,9 @@ static int wm_sca_check_dir(const char * const dir, const char * const file, cha
         file ? " -> "  : "", file ? file : "",
         pattern ? " -> " : "", pattern ? pattern: "");
 
+    /* Adding or removing entries changes the directory */
+    wm_sca_record_path(dir);
+
     #ifdef WIN32
     const char *realpath_buffer = dir;
     #else
@@ -1887,6 +2740,10 @@ static int wm_sca_check_dir(const char * const dir, const char * const file, cha
 
         return RETURN_INVALID;
     }
+
+    if (strcmp(realpath_buffer, dir) != 0) {
+        wm_sca_record_path(realpath_buffer);
+    }
     #endif
 
     DIR *dp = opendir(realpath_buffer);
@@ -1930,7 +2787,7 @@ static int wm_sca_check_dir(const char * const dir, const char * const file, cha
 
         if (S_ISDIR(statbuf_local.st_mode)) {
             result = wm_sca_check_dir(f_name, file, pattern, reason);
-        } else if (((file && strncasecmp(file, "r:", 2) == 0) && OS_Regex(file + 2, entry->d_name))
+        } else if (((file && strncasecmp(file, "r:", 2) == 0) && wm_sca_regex_matches(file + 2, entry->d_name))
                 || OS_Match2(file, entry->d_name))
         {
             result = wm_sca_check_file_list(f_name, pattern, reason);
@@ -1957,6 +2814,8 @@ static int wm_sca_check_dir(const char * const dir, const char * const file, cha
 
 static int wm_sca_check_process_is_running(OSList *p_list, char *value, char **reason)
 {
+    wm_sca_record_unknown();
+
     if (p_list == NULL) {
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
@@ -1969,7 +2828,8 @@ static int wm_sca_check_process_is_running(OSList *p_list, char *value, char **r
         return RETURN_NOT_FOUND;
     }
 
-    OSListNode *l_node = OSList_GetFirstNode(p_list);
+    /* The list is walked by hand, as it may be shared by the scan threads */
+    OSListNode *l_node = p_list->first_node;
     while (l_node) {
         W_Proc_Info *pinfo = (W_Proc_Info *)l_node->data;
         /* Check if value matches */
@@ -1977,7 +2837,7 @@ static int wm_sca_check_process_is_running(OSList *p_list, char *value, char **r
             return RETURN_FOUND;
         }
 
-        l_node = OSList_GetNextNode(p_list);
+        l_node = l_node->next;
     }
 
     return RETURN_NOT_FOUND;
@@ -2085,6 +2945,8 @@ static int wm_sca_test_key(char *subkey, char *full_key_name, unsigned long arch
 
     HKEY oshkey;
     LSTATUS err = RegOpenKeyEx(wm_sca_sub_tree, subkey, 0, KEY_READ | arch, &oshkey);
+    wm_sca_record_registry(full_key_name, arch, err == ERROR_SUCCESS ? oshkey : NULL);
+
     if (err == ERROR_ACCESS_DENIED) {
         if (*reason == NULL) {
             os_malloc(OS_MAXSTR, *reason);
@@ -2127,6 +2989,18 @@ static int wm_sca_test_key(char *subkey, char *full_key_name, unsigned long arch
     return ret_val;
 }
 
+/* Record a registry key read by the current check, with its last write time if it could be opened */
+static void wm_sca_record_registry(const char * const key, unsigned long arch, HKEY hkey)
+{
+    wm_sca_input_t *input = wm_sca_add_input(key, arch);
+    FILETIME last_write;
+
+    if (input && hkey && RegQueryInfoKey(hkey, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &last_write) == ERROR_SUCCESS) {
+        input->exists = 1;
+        input->mtime = ((long long)last_write.dwHighDateTime << 32) | last_write.dwLowDateTime;
+    }
+}
+
 static int wm_sca_winreg_querykey(HKEY hKey, const char *full_key_name, char *reg_option, char *reg_value, char **reason)
 {
     int rc;
@@ -3063,20 +3937,20 @@ cJSON *wm_sca_dump(const wm_sca_t *data) {
     return root;
 }
 
-static int append_msg_to_vm_scat (wm_sca_t * const data, const char * const msg)
+static int append_msg_to_vm_scat (char ** const alert_msg, const char * const msg)
 {
     /* Already present */
-    if (w_is_str_in_array(data->alert_msg, msg)) {
+    if (w_is_str_in_array(alert_msg, msg)) {
         return 1;
     }
 
     int i = 0;
-    while (data->alert_msg[i] && (i < 255)) {
+    while (alert_msg[i] && (i < 255)) {
         i++;
     }
 
-    if (!data->alert_msg[i]) {
-        os_strdup(msg, data->alert_msg[i]);
+    if (!alert_msg[i]) {
+        os_strdup(msg, alert_msg[i]);
     }
     return 0;
 }
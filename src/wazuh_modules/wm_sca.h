@@ -53,6 +53,7 @@ typedef struct wm_sca_t {
     int queue;
     int remote_commands:1;
     int commands_timeout;
+    int scan_threads;
     sched_scan_config scan_config;
 } wm_sca_t;
 
@@ -233,6 +233,7 @@ void * wmcom_main(void * arg);
 #endif
 size_t wmcom_dispatch(char * command, char ** output);
 size_t wmcom_getconfig(const char * section, char ** output);
+size_t wmcom_getmetrics(char ** output);
 
 #ifdef __MACH__
 void freegate(gateway *gate);
@@ -167,6 +167,7 @@ int local_start()
     wm_children_pool_init();
 
     /* state_main thread */
+    agent_metrics_init();
     w_create_thread(NULL,
                      0,
                      (LPTHREAD_START_ROUTINE)state_main,
@@ -311,7 +312,7 @@ int SendMSG(__attribute__((unused)) int queue, const char *message, const char *
         agent_state.msg_count++;
         send_msg(tmpstr, -1);
     }else{
-        buffer_append(tmpstr);
+        buffer_append(tmpstr, -1);
     }
 
     if (!ReleaseMutex(hMutex)) {
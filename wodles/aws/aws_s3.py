@@ -144,6 +144,7 @@ class WazuhIntegration:
             self.wazuh_path = re.search(re_ossec_init, lines[0]).group(2)
             self.wazuh_version = re.search(re_ossec_init, lines[2]).group(2)
         self.wazuh_queue = '{0}/queue/ossec/queue'.format(self.wazuh_path)
+        self.wazuh_socket = None
         self.wazuh_wodle = '{0}/wodles/aws'.format(self.wazuh_path)
         self.msg_header = "1:Wazuh-AWS:"
         # GovCloud regions
@@ -159,7 +160,8 @@ class WazuhIntegration:
 
         # db_name is an instance variable of subclass
         self.db_path = "{0}/{1}.db".format(self.wazuh_wodle, self.db_name)
-        self.db_connector = sqlite3.connect(self.db_path)
+        # Several buckets may run at once, so wait for the writes of the others
+        self.db_connector = sqlite3.connect(self.db_path, timeout=60)
         self.db_cursor = self.db_connector.cursor()
         if bucket:
             self.bucket = bucket
@@ -284,11 +286,12 @@ class WazuhIntegration:
         try:
             json_msg = json.dumps(msg, default=str)
             debug(json_msg, 3)
-            s = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
-            s.connect(self.wazuh_queue)
-            s.send("{header}{msg}".format(header=self.msg_header,
-                                          msg=json_msg).encode())
-            s.close()
+            # Keep the socket connected for all the events of the run
+            if self.wazuh_socket is None:
+                self.wazuh_socket = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+                self.wazuh_socket.connect(self.wazuh_queue)
+            self.wazuh_socket.send("{header}{msg}".format(header=self.msg_header,
+                                                          msg=json_msg).encode())
         except socket.error as e:
             if e.errno == 111:
                 print("ERROR: Wazuh must be running.")
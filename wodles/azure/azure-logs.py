@@ -675,25 +675,29 @@ def get_token(ID, KEY, resource, domain):
 # Sends results by socket
 ################################################################################################
 
+wazuh_socket = None
+
 def send_socket(log):
+	global wazuh_socket
 
 	send_id = 1
 	send_location = "Azure"
 
-	sock = socket(AF_UNIX, SOCK_DGRAM)
-	sock.connect(ADDR)
-	oldbuf = sock.getsockopt(SOL_SOCKET, SO_SNDBUF)
+	# Keep the socket connected for all the events of the run
+	if wazuh_socket is None:
+		wazuh_socket = socket(AF_UNIX, SOCK_DGRAM)
+		wazuh_socket.connect(ADDR)
+		oldbuf = wazuh_socket.getsockopt(SOL_SOCKET, SO_SNDBUF)
 
-	if oldbuf < BLEN:
-		sock.setsockopt(SOL_SOCKET, SO_SNDBUF, BLEN)
-		newbuf = sock.getsockopt(SOL_SOCKET, SO_SNDBUF)
+		if oldbuf < BLEN:
+			wazuh_socket.setsockopt(SOL_SOCKET, SO_SNDBUF, BLEN)
 
 	string = "{}:{}:{}".format(send_id, send_location, log)
 	string_size = len(string)
 	if string_size > 6144:
 		logging.info("SOCKET WARNING: The size limit is exceeded, possibly the event will be truncated")
 
-	sock.send(string.encode())
+	wazuh_socket.send(string.encode())
 
 
 ################################################################################################
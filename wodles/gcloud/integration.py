@@ -34,6 +34,7 @@ class WazuhGCloudSubscriber:
         """
         # get Wazuh paths
         self.wazuh_path, self.wazuh_version, self.wazuh_queue = tools.get_wazuh_paths()  # noqa: E501
+        self.wazuh_socket = None
         # get subscriber
         self.subscriber = self.get_subscriber_client(credentials_file).api
         self.subscription_path = self.get_subscription_path(project,
@@ -63,10 +64,11 @@ class WazuhGCloudSubscriber:
         """
         event_json = f'{self.header}{msg}'.encode(errors='replace')  # noqa: E501
         try:
-            s = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
-            s.connect(self.wazuh_queue)
-            s.send(event_json)
-            s.close()
+            # Keep the socket connected for all the events of the run
+            if self.wazuh_socket is None:
+                self.wazuh_socket = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)  # noqa: E501
+                self.wazuh_socket.connect(self.wazuh_queue)
+            self.wazuh_socket.send(event_json)
         except socket.error as e:
             if e.errno == 111:
                 logger.critical('Wazuh must be running')
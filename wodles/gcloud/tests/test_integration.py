@@ -56,6 +56,16 @@ def test_send_msg_ok(mock_socket):
     client.send_msg(test_message)
 
 
+@patch('integration.socket.socket')
+def test_send_msg_reuse_socket(mock_socket):
+    """Test if the socket is kept connected for the next messages."""
+    client = get_wazuhgcloud_subscriber()
+    client.send_msg(test_message)
+    client.send_msg(test_message)
+    mock_socket.assert_called_once()
+    assert mock_socket.return_value.send.call_count == 2
+
+
 @pytest.mark.xfail(raises=socket.error)
 def test_send_msg_ko():
     """Test send_msg method when a socket exception happens."""